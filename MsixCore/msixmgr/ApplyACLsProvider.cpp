@@ -5,6 +5,9 @@
 #include <string>
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include <TraceLoggingProvider.h>
 #include "InstallUI.hpp"
 
@@ -42,9 +45,38 @@ namespace MsixCoreLib
             reinterpret_cast<APPLYACLSTOPACKAGEFOLDER>
             (GetProcAddress(*applyACLsDll, "ApplyACLsToPackageFolder"));
 
-        for (auto folder : packageFolders)
+        if (ApplyACLsToPackageFolder == nullptr)
         {
-            RETURN_IF_FAILED(ApplyACLsToPackageFolder(folder.c_str()));
+            return HRESULT_FROM_WIN32(ERROR_PROC_NOT_FOUND);
+        }
+
+        // Each folder is a separate package tree, so they are walked in parallel, each worker taking the
+        // next folder. The error returned is the one of the first folder that failed, in the given order.
+        std::vector<HRESULT> results(packageFolders.size(), S_OK);
+        std::atomic<size_t> next(0);
+        auto worker = [&]()
+        {
+            for (size_t index = next++; index < packageFolders.size(); index = next++)
+            {
+                results[index] = ApplyACLsToPackageFolder(packageFolders[index].c_str());
+            }
+        };
+
+        size_t workerCount = (std::min)(static_cast<size_t>((std::max)(std::thread::hardware_concurrency(), 1u)), packageFolders.size());
+        std::vector<std::thread> helpers;
+        for (size_t i = 1; i < workerCount; i++)
+        {
+            helpers.emplace_back(worker);
+        }
+        worker();
+        for (auto& helper : helpers)
+        {
+            helper.join();
+        }
+
+        for (auto result : results)
+        {
+            RETURN_IF_FAILED(result);
         }
 
         return S_OK;
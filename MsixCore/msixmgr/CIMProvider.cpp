@@ -6,6 +6,8 @@
 #include <string>
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <filesystem>
 #include <TraceLoggingProvider.h>
 #include "InstallUI.hpp"
 
@@ -115,4 +117,184 @@ namespace MsixCoreLib
         return S_OK;
     }
 
+    namespace
+    {
+        // The part of cimfs.h used by CIMWriter, so msixmgr still builds with Windows SDKs that predate CimFS.
+        typedef struct CIMFS_IMAGE_HANDLE__* CIMFS_IMAGE_HANDLE;
+        typedef struct CIMFS_STREAM_HANDLE__* CIMFS_STREAM_HANDLE;
+
+        typedef struct _CIMFS_FILE_METADATA
+        {
+            UINT32 Attributes;
+            INT64 FileSize;
+            LARGE_INTEGER CreationTime;
+            LARGE_INTEGER LastWriteTime;
+            LARGE_INTEGER ChangeTime;
+            LARGE_INTEGER LastAccessTime;
+            const void* SecurityDescriptorBuffer;
+            UINT32 SecurityDescriptorSize;
+            const void* ReparseDataBuffer;
+            UINT32 ReparseDataSize;
+            const void* EaBuffer;
+            UINT32 EaBufferSize;
+        } CIMFS_FILE_METADATA;
+
+        // Files are copied into the image through a buffer of this size
+        const size_t CIMWriterBufferSize = 1024 * 1024;
+
+        CIMFS_FILE_METADATA CreateMetadata(UINT32 attributes, UINT64 size)
+        {
+            FILETIME now;
+            GetSystemTimeAsFileTime(&now);
+            LARGE_INTEGER time;
+            time.LowPart = now.dwLowDateTime;
+            time.HighPart = static_cast<LONG>(now.dwHighDateTime);
+
+            CIMFS_FILE_METADATA metadata = {};
+            metadata.Attributes = attributes;
+            metadata.FileSize = static_cast<INT64>(size);
+            metadata.CreationTime = time;
+            metadata.LastWriteTime = time;
+            metadata.ChangeTime = time;
+            metadata.LastAccessTime = time;
+            return metadata;
+        }
+    }
+
+    struct CIMWriter::CimFunctions
+    {
+        HRESULT(STDMETHODCALLTYPE *CimCreateImage)(PCWSTR imageContainingPath, PCWSTR existingImageName, PCWSTR newImageName, CIMFS_IMAGE_HANDLE* image);
+        void(STDMETHODCALLTYPE *CimCloseImage)(CIMFS_IMAGE_HANDLE image);
+        HRESULT(STDMETHODCALLTYPE *CimCommitImage)(CIMFS_IMAGE_HANDLE image);
+        HRESULT(STDMETHODCALLTYPE *CimCreateFile)(CIMFS_IMAGE_HANDLE image, PCWSTR imageRelativePath, const CIMFS_FILE_METADATA* metadata, CIMFS_STREAM_HANDLE* stream);
+        HRESULT(STDMETHODCALLTYPE *CimWriteStream)(CIMFS_STREAM_HANDLE stream, const void* buffer, UINT32 bufferSize);
+        void(STDMETHODCALLTYPE *CimCloseStream)(CIMFS_STREAM_HANDLE stream);
+    };
+
+    CIMWriter::CIMWriter()
+    {
+    }
+
+    CIMWriter::~CIMWriter()
+    {
+        if (m_image != nullptr)
+        {
+            m_functions->CimCloseImage(static_cast<CIMFS_IMAGE_HANDLE>(m_image));
+        }
+        if (m_module != nullptr)
+        {
+            FreeLibrary(m_module);
+        }
+    }
+
+    HRESULT CIMWriter::Create(
+        _In_ std::wstring cimFilePath)
+    {
+        m_module = LoadLibraryEx(L"cimfs.dll", nullptr, LOAD_LIBRARY_SEARCH_SYSTEM32);
+        if (m_module == nullptr)
+        {
+            std::wcout << std::endl;
+            std::wcout << "Failed to load cimfs.dll. Creating a CIM file requires Windows 10 version 2004 or later." << std::endl;
+            std::wcout << std::endl;
+
+            return HRESULT_FROM_WIN32(ERROR_MOD_NOT_FOUND);
+        }
+
+        m_functions = std::make_unique<CimFunctions>();
+        auto load = [this](auto& function, const char* name)
+        {
+            function = reinterpret_cast<std::remove_reference_t<decltype(function)>>(GetProcAddress(m_module, name));
+            return function != nullptr;
+        };
+        if (!load(m_functions->CimCreateImage, "CimCreateImage") ||
+            !load(m_functions->CimCloseImage, "CimCloseImage") ||
+            !load(m_functions->CimCommitImage, "CimCommitImage") ||
+            !load(m_functions->CimCreateFile, "CimCreateFile") ||
+            !load(m_functions->CimWriteStream, "CimWriteStream") ||
+            !load(m_functions->CimCloseStream, "CimCloseStream"))
+        {
+            return HRESULT_FROM_WIN32(ERROR_PROC_NOT_FOUND);
+        }
+
+        std::filesystem::path cimPath = std::filesystem::absolute(cimFilePath);
+        std::wstring imageContainingPath = cimPath.parent_path().wstring();
+        std::wstring imageName = cimPath.filename().wstring();
+
+        CIMFS_IMAGE_HANDLE image = nullptr;
+        RETURN_IF_FAILED(m_functions->CimCreateImage(imageContainingPath.c_str(), nullptr, imageName.c_str(), &image));
+        m_image = image;
+        m_buffer.resize(CIMWriterBufferSize);
+
+        return S_OK;
+    }
+
+    HRESULT CIMWriter::AddFile(
+        _In_ std::wstring imageRelativePath,
+        _In_ IStream* stream,
+        _In_ UINT64 size)
+    {
+        std::replace(imageRelativePath.begin(), imageRelativePath.end(), L'/', L'\\');
+        RETURN_IF_FAILED(AddParentDirectories(imageRelativePath));
+
+        auto metadata = CreateMetadata(FILE_ATTRIBUTE_NORMAL, size);
+        CIMFS_STREAM_HANDLE cimStream = nullptr;
+        RETURN_IF_FAILED(m_functions->CimCreateFile(static_cast<CIMFS_IMAGE_HANDLE>(m_image), imageRelativePath.c_str(), &metadata, &cimStream));
+
+        HRESULT hr = S_OK;
+        UINT64 remaining = size;
+        while (SUCCEEDED(hr) && remaining > 0)
+        {
+            ULONG bytesRead = 0;
+            hr = stream->Read(m_buffer.data(), static_cast<ULONG>((std::min)(remaining, static_cast<UINT64>(m_buffer.size()))), &bytesRead);
+            if (SUCCEEDED(hr) && bytesRead == 0)
+            {
+                // The stream ended before the size the file was created with
+                hr = HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+            }
+            if (SUCCEEDED(hr))
+            {
+                hr = m_functions->CimWriteStream(cimStream, m_buffer.data(), bytesRead);
+                remaining -= bytesRead;
+            }
+        }
+        m_functions->CimCloseStream(cimStream);
+
+        return hr;
+    }
+
+    HRESULT CIMWriter::Commit()
+    {
+        return m_functions->CimCommitImage(static_cast<CIMFS_IMAGE_HANDLE>(m_image));
+    }
+
+    HRESULT CIMWriter::AddDirectory(
+        _In_ const std::wstring& imageRelativePath)
+    {
+        auto metadata = CreateMetadata(FILE_ATTRIBUTE_DIRECTORY, 0);
+        CIMFS_STREAM_HANDLE cimStream = nullptr;
+        RETURN_IF_FAILED(m_functions->CimCreateFile(static_cast<CIMFS_IMAGE_HANDLE>(m_image), imageRelativePath.c_str(), &metadata, &cimStream));
+        if (cimStream != nullptr)
+        {
+            m_functions->CimCloseStream(cimStream);
+        }
+        m_directories.insert(imageRelativePath);
+
+        return S_OK;
+    }
+
+    HRESULT CIMWriter::AddParentDirectories(
+        _In_ const std::wstring& imageRelativePath)
+    {
+        // CimFS doesn't create missing directories, so every parent of the file is created first, top down
+        for (size_t separator = imageRelativePath.find(L'\\'); separator != std::wstring::npos; separator = imageRelativePath.find(L'\\', separator + 1))
+        {
+            std::wstring directory = imageRelativePath.substr(0, separator);
+            if (!directory.empty() && m_directories.find(directory) == m_directories.end())
+            {
+                RETURN_IF_FAILED(AddDirectory(directory));
+            }
+        }
+
+        return S_OK;
+    }
 }
\ No newline at end of file
@@ -1,5 +1,8 @@
 #pragma once
 #include <string>
+#include <memory>
+#include <set>
+#include <vector>
 
 namespace MsixCoreLib
 {
@@ -15,6 +18,33 @@ namespace MsixCoreLib
     HRESULT UnmountCIM(
         _In_opt_ std::wstring cimFilePath,
         _In_opt_ std::wstring volumeIdString);
+
+    // Writes files straight into a new CIM image with the CimFS APIs of the system (cimfs.dll, Windows 10 2004
+    // and later), so they don't have to be staged in a directory and copied into the image afterwards.
+    // Parent directories are created in the image as needed. Nothing is visible until Commit succeeds.
+    class CIMWriter
+    {
+    public:
+        CIMWriter();
+        ~CIMWriter();
+        CIMWriter(const CIMWriter&) = delete;
+        CIMWriter& operator=(const CIMWriter&) = delete;
+
+        HRESULT Create(_In_ std::wstring cimFilePath);
+        HRESULT AddFile(_In_ std::wstring imageRelativePath, _In_ IStream* stream, _In_ UINT64 size);
+        HRESULT Commit();
+
+    private:
+        HRESULT AddDirectory(_In_ const std::wstring& imageRelativePath);
+        HRESULT AddParentDirectories(_In_ const std::wstring& imageRelativePath);
+
+        struct CimFunctions;
+        HMODULE m_module = nullptr;
+        std::unique_ptr<CimFunctions> m_functions;
+        void* m_image = nullptr;
+        std::set<std::wstring> m_directories;
+        std::vector<BYTE> m_buffer;
+    };
 }
 
 
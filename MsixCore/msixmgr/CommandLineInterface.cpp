@@ -192,6 +192,31 @@ std::map<std::wstring, Options, CaseInsensitiveLess> CommandLineInterface::s_opt
                     commandLineInterface->m_vhdSize = vhdSizeUll;
                     return S_OK;
                 }),
+            },
+            {
+                L"-parallel",
+                Option(true, IDS_STRING_HELP_OPTION_UNPACK_PARALLEL,
+                    [&](CommandLineInterface* commandLineInterface, const std::string& parallelCount)
+                {
+                    if (commandLineInterface->m_operationType != OperationType::Unpack)
+                    {
+                        return E_INVALIDARG;
+                    }
+
+                    ULONGLONG maxParallelCount = 64ull;
+                    errno = 0;
+                    ULONGLONG parallelCountUll = strtoull(parallelCount.c_str(), NULL, 10 /*base*/);
+                    if ((parallelCountUll == ULLONG_MAX && errno == ERANGE) ||
+                        parallelCountUll > maxParallelCount ||
+                        parallelCountUll < 1ull)
+                    {
+                        std::wcout << "\nInvalid parallel count. Specified value must be at least 1 and at most 64\n" << std::endl;
+                        return E_INVALIDARG;
+                    }
+
+                    commandLineInterface->m_parallelCount = static_cast<unsigned int>(parallelCountUll);
+                    return S_OK;
+                }),
             }
         })
     },
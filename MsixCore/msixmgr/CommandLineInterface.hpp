@@ -104,6 +104,7 @@ public:
     WVDFileType GetFileType() { return m_fileType; }
     OperationType GetOperationType() { return m_operationType; }
     ULONGLONG GetVHDSize() { return m_vhdSize; }
+    unsigned int GetParallelCount() { return m_parallelCount; }
 private:
     int m_argc = 0;
     char ** m_argv = nullptr;
@@ -124,6 +125,7 @@ private:
     bool m_readOnly = true;
     WVDFileType m_fileType = WVDFileType::NotSpecified;
     ULONGLONG m_vhdSize = 0;
+    unsigned int m_parallelCount = 1;
 
     OperationType m_operationType = OperationType::Undefined;
 
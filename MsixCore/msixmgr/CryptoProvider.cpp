@@ -13,6 +13,7 @@ namespace MsixCoreLib
     {
         this->providerHandle = NULL;
         this->hashHandle = NULL;
+        this->digestPending = false;
         this->digest.bytes = NULL;
         this->digest.length = 0;
     }
@@ -20,6 +21,12 @@ namespace MsixCoreLib
     CryptoProvider::~CryptoProvider()
     {
         Reset();
+
+        if (NULL != this->hashHandle)
+        {
+            (void)BcryptLibrary::BCryptDestroyHash(this->hashHandle);
+            this->hashHandle = NULL;
+        }
     }
 
     void CryptoProvider::Reset()
@@ -27,22 +34,15 @@ namespace MsixCoreLib
         this->digest.bytes = NULL;
         this->digest.length = 0;
 
-        if (NULL != this->hashHandle)
+        // Finishing a reusable hash object discards the data hashed so far and readies it for the next digest
+        if (this->digestPending)
         {
-            if (!SUCCEEDED(BcryptLibrary::BCryptDestroyHash(this->hashHandle)))
-            {
-                return;
-            }
-            this->hashHandle = NULL;
-        }
-
-        if (NULL != this->providerHandle)
-        {
-            if (!SUCCEEDED(BcryptLibrary::BCryptCloseAlgorithmProvider(this->providerHandle, 0)))
-            {
-                return;
-            }
-            this->providerHandle = NULL;
+            (void)BcryptLibrary::BCryptFinishHash(
+                this->hashHandle,
+                this->quickDigestBuffer,
+                32, // Size of a SHA256 digest
+                0);
+            this->digestPending = false;
         }
     }
 
@@ -63,53 +63,74 @@ namespace MsixCoreLib
 
     HRESULT CryptoProvider::OpenProvider()
     {
-        PCWSTR algorithmId = BCRYPT_SHA256_ALGORITHM;
-        PCWSTR implementation = NULL;
-        ULONG flags = 0;
-
-        BcryptLibrary::BCryptOpenAlgorithmProvider(
-            &this->providerHandle,
-            algorithmId,
-            implementation,
-            flags);
+        // Opening an algorithm provider is expensive, so it is opened once and kept until the process exits,
+        // like BCRYPT.DLL itself. A provider opened with BCRYPT_HASH_REUSABLE_FLAG creates hash objects that
+        // BCryptFinishHash resets, so each CryptoProvider creates a single one.
+        static BCRYPT_ALG_HANDLE sharedProvider = NULL;
+        static NTSTATUS sharedProviderStatus = BcryptLibrary::BCryptOpenAlgorithmProvider(
+            &sharedProvider,
+            BCRYPT_SHA256_ALGORITHM,
+            NULL,
+            BCRYPT_HASH_REUSABLE_FLAG);
 
+        if (FAILED(HRESULT_FROM_NT(sharedProviderStatus)))
+        {
+            return HRESULT_FROM_NT(sharedProviderStatus);
+        }
+        this->providerHandle = sharedProvider;
         return S_OK;
     }
 
     HRESULT CryptoProvider::StartDigest()
     {
-        BYTE* hashObject;
-        ULONG hashObjectSize;
-        ULONG resultSize;
-
-        RETURN_IF_FAILED(OpenProvider());
-
-        BcryptLibrary::BCryptGetProperty(
-            this->providerHandle,
-            BCRYPT_OBJECT_LENGTH,
-            (PUCHAR)&hashObjectSize,
-            sizeof(hashObjectSize),
-            &resultSize,
-            0);
+        Reset();
 
-        if (sizeof(this->quickHashObjectBuffer) >= hashObjectSize)
+        if (NULL == this->hashHandle)
         {
-            hashObject = this->quickHashObjectBuffer;
-        }
-        else
-        {
-            hashObject = hashObjectBuffer.data();
-        }
+            BYTE* hashObject;
+            ULONG hashObjectSize;
+            ULONG resultSize;
 
-        BcryptLibrary::BCryptCreateHash(
-            this->providerHandle,
-            &this->hashHandle,
-            hashObject,
-            hashObjectSize,
-            NULL,
-            NULL,
-            0);
+            RETURN_IF_FAILED(OpenProvider());
+
+            NTSTATUS status = BcryptLibrary::BCryptGetProperty(
+                this->providerHandle,
+                BCRYPT_OBJECT_LENGTH,
+                (PUCHAR)&hashObjectSize,
+                sizeof(hashObjectSize),
+                &resultSize,
+                0);
+            if (FAILED(HRESULT_FROM_NT(status)))
+            {
+                return HRESULT_FROM_NT(status);
+            }
+
+            if (sizeof(this->quickHashObjectBuffer) >= hashObjectSize)
+            {
+                hashObject = this->quickHashObjectBuffer;
+            }
+            else
+            {
+                this->hashObjectBuffer.resize(hashObjectSize);
+                hashObject = this->hashObjectBuffer.data();
+            }
+
+            status = BcryptLibrary::BCryptCreateHash(
+                this->providerHandle,
+                &this->hashHandle,
+                hashObject,
+                hashObjectSize,
+                NULL,
+                NULL,
+                BCRYPT_HASH_REUSABLE_FLAG);
+            if (FAILED(HRESULT_FROM_NT(status)))
+            {
+                this->hashHandle = NULL;
+                return HRESULT_FROM_NT(status);
+            }
+        }
 
+        this->digestPending = true;
         return S_OK;
     }
 
@@ -156,6 +177,7 @@ namespace MsixCoreLib
             }
             else
             {
+                this->digestBuffer.resize(digestSize);
                 digestPtr = this->digestBuffer.data();
             }
 
@@ -170,6 +192,7 @@ namespace MsixCoreLib
                 return HRESULT_FROM_NT(status);
             }
 
+            this->digestPending = false;
             this->digest.bytes = digestPtr;
             this->digest.length = digestSize;
         }
@@ -12,14 +12,18 @@ namespace MsixCoreLib
     };
 
     // CryptoProvider objects are not thread-safe, hence should not be called from multiple threads simultaneously.
+    // The algorithm provider is opened once per process and the hash object is reused for every digest.
     // Usage:
     //   (StartDigest DigestData* GetDigest* Reset)*
     class CryptoProvider
     {
     private:
 
+        // Shared by every CryptoProvider of the process, see OpenProvider
         BCRYPT_ALG_HANDLE providerHandle;
+        // Reusable hash object, created by the first StartDigest and kept until the CryptoProvider is destroyed
         BCRYPT_HASH_HANDLE hashHandle;
+        bool digestPending;
         std::vector<BYTE> hashObjectBuffer;
         std::vector<BYTE> digestBuffer;
         BYTE quickHashObjectBuffer[700];  // Tests shows that HMAC with 256-bit or 512-bit keys requires 600+ bytes of hash object space.
@@ -1,5 +1,11 @@
 #include <windows.h>
+#include <algorithm>
+#include <atomic>
 #include <iostream>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
 #include <experimental/filesystem> // C++-standard header file name
 #include <filesystem> // Microsoft-specific implementation header file name
 
@@ -16,46 +22,106 @@ using namespace MsixCoreLib;
 
 const PCWSTR Extractor::HandlerName = L"Extractor";
 
-HRESULT Extractor::GetOutputStream(LPCWSTR path, LPCWSTR fileName, IStream** stream)
+namespace
 {
-    std::wstring fullFileName = path + std::wstring(L"\\") + fileName;
-    std::wstring longFileName = std::wstring(L"\\\\?\\") + fullFileName;
-    RETURN_IF_FAILED(HRESULT_FROM_WIN32(mkdirp(longFileName)));
-    RETURN_IF_FAILED(CreateStreamOnFileUTF16(longFileName.c_str(), false, stream));
-    return S_OK;
-}
+    /// Reports the progress of the payload extraction to the MsixResponse, and cancels it when the user
+    /// cancels the installation. Lives on the stack for the duration of the unpack, so it isn't deleted
+    /// when its last reference is released.
+    class ExtractionProgress final : public IMsixProgressCallback
+    {
+    public:
+        ExtractionProgress(_In_ MsixRequest* msixRequest) : m_msixRequest(msixRequest) {}
 
-HRESULT Extractor::ExtractFile(IAppxFile* file)
-{
-    Text<WCHAR> fileName;
-    RETURN_IF_FAILED(file->GetName(&fileName));
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+        {
+            if (ppvObject == nullptr)
+            {
+                return E_POINTER;
+            }
+            if (riid == UuidOfImpl<IUnknown>::iid || riid == UuidOfImpl<IMsixProgressCallback>::iid)
+            {
+                *ppvObject = static_cast<IMsixProgressCallback*>(this);
+                AddRef();
+                return S_OK;
+            }
+            *ppvObject = nullptr;
+            return E_NOINTERFACE;
+        }
 
-    UINT64 fileSize = 0;
-    RETURN_IF_FAILED(file->GetSize(&fileSize));
+        ULONG STDMETHODCALLTYPE AddRef() noexcept override { return ++m_refCount; }
+        ULONG STDMETHODCALLTYPE Release() noexcept override { return --m_refCount; }
 
-    ULARGE_INTEGER fileSizeLargeInteger = { 0 };
-    fileSizeLargeInteger.QuadPart = fileSize;
+        HRESULT STDMETHODCALLTYPE OnProgress(UINT64 bytesCompleted, UINT64 bytesTotal, UINT32 filesCompleted, UINT32 filesTotal, BOOL* cancel) noexcept override
+        {
+            *cancel = m_msixRequest->GetMsixResponse()->GetIsInstallCancelled() ? TRUE : FALSE;
+            if (!*cancel && bytesTotal != 0)
+            {
+                float progress = 100.0f * bytesCompleted / bytesTotal;
+                m_msixRequest->GetMsixResponse()->Update(InstallationStep::InstallationStepExtraction, progress);
+            }
+            return S_OK;
+        }
 
-    TraceLoggingWrite(g_MsixTraceLoggingProvider,
-        "ExtractFile",
-        TraceLoggingValue(fileName.Get(), "FileName"),
-        TraceLoggingValue(fileSize, "FileSize"));
+    private:
+        MsixRequest* m_msixRequest = nullptr;
+        std::atomic<ULONG> m_refCount{ 0 };
+    };
 
-    ComPtr<IStream> fileStream;
-    RETURN_IF_FAILED(file->GetStream(&fileStream));
-    ComPtr<IStream> outputStream;
+    /// Traces what every file extracted from a package took. A single instance lives for the whole process, so
+    /// it isn't deleted when its last reference is released. Called concurrently when files are extracted in
+    /// parallel.
+    class ExtractionStatistics final : public IMsixFileStatisticsCallback
+    {
+    public:
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+        {
+            if (ppvObject == nullptr)
+            {
+                return E_POINTER;
+            }
+            if (riid == UuidOfImpl<IUnknown>::iid || riid == UuidOfImpl<IMsixFileStatisticsCallback>::iid)
+            {
+                *ppvObject = static_cast<IMsixFileStatisticsCallback*>(this);
+                AddRef();
+                return S_OK;
+            }
+            *ppvObject = nullptr;
+            return E_NOINTERFACE;
+        }
 
-    auto packageDirectoryPath = m_msixRequest->GetPackageDirectoryPath();
+        ULONG STDMETHODCALLTYPE AddRef() noexcept override { return 1; }
+        ULONG STDMETHODCALLTYPE Release() noexcept override { return 1; }
 
-    RETURN_IF_FAILED(GetOutputStream(packageDirectoryPath.c_str(), fileName.Get(), &outputStream));
-    RETURN_IF_FAILED(fileStream->CopyTo(outputStream.Get(), fileSizeLargeInteger, nullptr, nullptr));
+        void STDMETHODCALLTYPE OnFile(const MSIX_FILE_STATISTICS* statistics) noexcept override
+        {
+            TraceLoggingWrite(g_MsixTraceLoggingProvider,
+                "ExtractedFile",
+                TraceLoggingValue(statistics->utf8Name, "FileName"),
+                TraceLoggingValue(statistics->size, "FileSize"),
+                TraceLoggingValue(statistics->compressedSize, "CompressedSize"),
+                TraceLoggingValue(statistics->blockCount, "BlockCount"),
+                TraceLoggingValue(statistics->readNanoseconds, "ReadNanoseconds"),
+                TraceLoggingValue(statistics->inflateNanoseconds, "InflateNanoseconds"),
+                TraceLoggingValue(statistics->hashNanoseconds, "HashNanoseconds"),
+                TraceLoggingValue(statistics->writeNanoseconds, "WriteNanoseconds"));
+        }
+    };
+
+    ExtractionStatistics g_extractionStatistics;
+}
+
+HRESULT Extractor::SpecifyFileStatisticsCallback(IAppxFactory* factory)
+{
+    ComPtr<IMsixFactoryOverrides> factoryOverrides;
+    RETURN_IF_FAILED(factory->QueryInterface(UuidOfImpl<IMsixFactoryOverrides>::iid, reinterpret_cast<void**>(&factoryOverrides)));
+    RETURN_IF_FAILED(factoryOverrides->SpecifyExtension(MSIX_FACTORY_EXTENSION_FILE_STATISTICS_CALLBACK, static_cast<IMsixFileStatisticsCallback*>(&g_extractionStatistics)));
     return S_OK;
 }
 
-HRESULT Extractor::ExtractFootprintFiles()
+HRESULT Extractor::CheckFootprintFiles()
 {
     TraceLoggingWrite(g_MsixTraceLoggingProvider,
-        "Extracting footprint files from the package");
+        "Checking footprint files of the package");
 
     auto packageToInstall = std::dynamic_pointer_cast<Package>(m_msixRequest->GetPackageInfo());
     
@@ -71,11 +137,7 @@ HRESULT Extractor::ExtractFootprintFiles()
         {
             ComPtr<IAppxFile> footprintFile;
             HRESULT hr = packageToInstall->GetPackageReader()->GetFootprintFile(g_footprintFilesType[i].fileType, &footprintFile);
-            if (SUCCEEDED(hr) && footprintFile.Get())
-            {
-                RETURN_IF_FAILED(ExtractFile(footprintFile.Get()));
-            }
-            else if (g_footprintFilesType[i].isRequired)
+            if ((FAILED(hr) || footprintFile.Get() == nullptr) && g_footprintFilesType[i].isRequired)
             {
                 TraceLoggingWrite(g_MsixTraceLoggingProvider,
                     "Missing required Footprintfile",
@@ -87,11 +149,10 @@ HRESULT Extractor::ExtractFootprintFiles()
     return S_OK;
 }
 
-HRESULT Extractor::ExtractPayloadFiles()
+HRESULT Extractor::ExtractPackageFiles()
 {
-    ComPtr<IAppxFilesEnumerator> files;
     TraceLoggingWrite(g_MsixTraceLoggingProvider,
-        "Extracting payload files from the package");
+        "Extracting files from the package");
 
     auto packageToInstall = std::dynamic_pointer_cast<Package>(m_msixRequest->GetPackageInfo());
     if (packageToInstall == nullptr)
@@ -99,32 +160,41 @@ HRESULT Extractor::ExtractPayloadFiles()
         return E_FAIL;
     }
 
-    RETURN_IF_FAILED(packageToInstall->GetPackageReader()->GetPayloadFiles(&files));
-
-    BOOL hasCurrent = FALSE;
-    RETURN_IF_FAILED(files->GetHasCurrent(&hasCurrent));
-
-    unsigned int totalNumberFiles = m_msixRequest->GetPackageInfo()->GetNumberOfPayloadFiles();
-    unsigned int nbrFilesExtracted = 0;
-    while (hasCurrent)
+    if (m_msixRequest->GetMsixResponse()->GetIsInstallCancelled())
     {
-        if (m_msixRequest->GetMsixResponse()->GetIsInstallCancelled())
-        {
-            m_msixRequest->GetMsixResponse()->SetErrorStatus(HRESULT_FROM_WIN32(ERROR_INSTALL_USEREXIT), L"User cancelled installation.");
-            return HRESULT_FROM_WIN32(ERROR_INSTALL_USEREXIT);
-        }
-        ComPtr<IAppxFile> file;
-        RETURN_IF_FAILED(files->GetCurrent(&file));
+        m_msixRequest->GetMsixResponse()->SetErrorStatus(HRESULT_FROM_WIN32(ERROR_INSTALL_USEREXIT), L"User cancelled installation.");
+        return HRESULT_FROM_WIN32(ERROR_INSTALL_USEREXIT);
+    }
 
-        RETURN_IF_FAILED(ExtractFile(file.Get()));
+    // The SDK extracts the footprint and payload files together, on all the hardware threads, inflating the
+    // blocks of large files in parallel and checking them against the block map as they are written.
+    MSIX_PACKUNPACK_OPTION options = MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION;
 
-        RETURN_IF_FAILED(files->MoveNext(&hasCurrent));
-        ++nbrFilesExtracted;
+    // An update that linked the files of the previous version that didn't change only extracts the others,
+    // the linked ones are hashed against the block map and left as they are.
+    if (!m_msixRequest->GetUnchangedFiles().empty())
+    {
+        options = static_cast<MSIX_PACKUNPACK_OPTION>(options | MSIX_PACKUNPACK_OPTION_SKIPUNCHANGED);
+    }
 
-        float progress = 100.0f * nbrFilesExtracted / totalNumberFiles;
-        m_msixRequest->GetMsixResponse()->Update(InstallationStep::InstallationStepExtraction, progress);
+    auto packageDirectoryPathUTF8 = utf16_to_utf8(m_msixRequest->GetPackageDirectoryPath());
+    std::vector<char> packageDirectoryPath(packageDirectoryPathUTF8.c_str(), packageDirectoryPathUTF8.c_str() + packageDirectoryPathUTF8.size() + 1);
+
+    ExtractionProgress progress(m_msixRequest);
+    HRESULT hr = UnpackPackageFromPackageReaderWithProgress(
+        options,
+        packageToInstall->GetPackageReader(),
+        &packageDirectoryPath[0],
+        0,
+        &progress);
+    if (hr == static_cast<HRESULT>(MSIX::Error::Cancelled))
+    {
+        m_msixRequest->GetMsixResponse()->SetErrorStatus(HRESULT_FROM_WIN32(ERROR_INSTALL_USEREXIT), L"User cancelled installation.");
+        return HRESULT_FROM_WIN32(ERROR_INSTALL_USEREXIT);
     }
+    RETURN_IF_FAILED(hr);
 
+    m_msixRequest->GetMsixResponse()->Update(InstallationStep::InstallationStepExtraction, 100.0f);
     return S_OK;
 }
 
@@ -166,15 +236,75 @@ HRESULT Extractor::ExecuteForRemoveRequest()
     // First release manifest so we can delete the file.
     m_msixRequest->GetPackageInfo()->ReleaseManifest();
 
+    // The files are deleted in parallel, each worker taking the next one, since deleting a file mostly waits on
+    // the file system. The directories left empty are then removed in one go. The error traced is the last one.
     std::error_code error;
     auto packageDirectoryPath = m_msixRequest->GetPackageDirectoryPath();
-    uintmax_t numRemoved = std::experimental::filesystem::remove_all(packageDirectoryPath, error);
+
+    std::vector<std::experimental::filesystem::path> files;
+    for (std::experimental::filesystem::recursive_directory_iterator iterator(packageDirectoryPath, error), end; !error && iterator != end; iterator.increment(error))
+    {
+        if (!std::experimental::filesystem::is_directory(iterator->symlink_status()))
+        {
+            files.push_back(iterator->path());
+        }
+    }
+
+    std::mutex errorLock;
+    std::atomic<uintmax_t> numRemoved(0);
+    std::atomic<size_t> next(0);
+    auto worker = [&]()
+    {
+        for (size_t index = next++; index < files.size(); index = next++)
+        {
+            std::error_code fileError;
+            if (std::experimental::filesystem::remove(files[index], fileError))
+            {
+                ++numRemoved;
+            }
+            else if (fileError)
+            {
+                std::lock_guard<std::mutex> lock(errorLock);
+                error = fileError;
+            }
+        }
+    };
+
+    size_t workerCount = (std::min)(static_cast<size_t>((std::max)(std::thread::hardware_concurrency(), 1u)), files.size());
+    std::vector<std::thread> helpers;
+    try
+    {
+        for (size_t i = 1; i < workerCount; i++)
+        {
+            helpers.emplace_back(worker);
+        }
+    }
+    catch (const std::system_error&)
+    {
+        // Without more threads, the files are deleted by the helpers already started and the calling thread
+    }
+    worker();
+    for (auto& helper : helpers)
+    {
+        helper.join();
+    }
+
+    std::error_code directoryError;
+    uintmax_t directoriesRemoved = std::experimental::filesystem::remove_all(packageDirectoryPath, directoryError);
+    if (directoriesRemoved != static_cast<uintmax_t>(-1))
+    {
+        numRemoved += directoriesRemoved;
+    }
+    if (directoryError)
+    {
+        error = directoryError;
+    }
 
     TraceLoggingWrite(g_MsixTraceLoggingProvider,
         "Removed directory",
         TraceLoggingValue(packageDirectoryPath.c_str(), "PackageDirectoryPath"),
         TraceLoggingValue(error.value(), "Error"),
-        TraceLoggingValue(numRemoved, "NumRemoved"));
+        TraceLoggingValue(numRemoved.load(), "NumRemoved"));
 
     return S_OK;
 }
@@ -193,7 +323,7 @@ HRESULT Extractor::CreateHandler(MsixRequest * msixRequest, IPackageHandler ** i
 
 HRESULT Extractor::ExtractPackage()
 {
-    RETURN_IF_FAILED(ExtractFootprintFiles());
-    RETURN_IF_FAILED(ExtractPayloadFiles());
+    RETURN_IF_FAILED(CheckFootprintFiles());
+    RETURN_IF_FAILED(ExtractPackageFiles());
     return S_OK;
 }
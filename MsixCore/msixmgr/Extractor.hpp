@@ -20,6 +20,11 @@ public:
     
     static const PCWSTR HandlerName;
     static HRESULT CreateHandler(_In_ MsixRequest* msixRequest, _Out_ IPackageHandler** instance);
+
+    /// Has the readers the factory creates trace what extracting each of their files took.
+    ///
+    /// @param factory - The factory the package reader of the add request is created with.
+    static HRESULT SpecifyFileStatisticsCallback(_In_ IAppxFactory* factory);
     ~Extractor() {}
 private:
     MsixRequest* m_msixRequest =  nullptr;
@@ -30,28 +35,12 @@ private:
     /// Extracts all files from a package.
     HRESULT ExtractPackage();
 
-    /// Writes the file from the package to disk.
-    ///
-    /// @param file - The IAppxFile interface that represents a footprint or payload file 
-    ///                in the package.
-    HRESULT ExtractFile(IAppxFile* file);
-
-    /// Extracts all footprint files (i.e. manifest/blockmap/signature) from a package.
-    HRESULT ExtractFootprintFiles();
-
-    /// Extracts all payload files from a package.
-    HRESULT ExtractPayloadFiles();
+    /// Checks the package has all the required footprint files (i.e. manifest/blockmap/signature).
+    HRESULT CheckFootprintFiles();
 
-    /// Creates a writable IStream over a file with the specified name
-    /// under the specified path.  This function will also create intermediate
-    /// subdirectories if necessary.
-    ///
-    /// @param path - Path of the folder containing the file to be opened.  This should NOT
-    ///            end with a slash ('\') character.
-    /// @param fileName - Name, not including path, of the file to be opened
-    /// @param stream    - Output parameter pointing to the created instance of IStream over
-    ///              the specified file when this function succeeds.
-    HRESULT GetOutputStream(LPCWSTR path, LPCWSTR fileName, IStream** stream);
+    /// Extracts the footprint and payload files of a package to the package's root directory,
+    /// in parallel, reporting the progress to the MsixResponse.
+    HRESULT ExtractPackageFiles();
 
     /// Creates the package root directory where all the files will be installed to.
     /// This will be in c:\program files\msixcoreapps\<packagefullname>
@@ -0,0 +1,362 @@
+#include <windows.h>
+
+#include "RegistryKey.hpp"
+#include "InstalledPackageIndex.hpp"
+#include "GeneralUtil.hpp"
+#include <TraceLoggingProvider.h>
+#include "MsixTraceLoggingProvider.hpp"
+#include "Constants.hpp"
+#include <vector>
+using namespace MsixCoreLib;
+
+const PCWSTR InstalledPackageIndex::HandlerName = L"InstalledPackageIndex";
+
+namespace
+{
+    /// Version of the layout of the entries, an index written with another one is discarded.
+    const UINT32 PackageIndexVersion = 1;
+    const PCWSTR versionValueName = L"Version";
+    const PCWSTR packagesKeyName = L"Packages";
+
+    /// Appends the fields of an entry: numbers as they are, strings as their length followed by their characters.
+    class EntryWriter
+    {
+    public:
+        void Write(UINT32 value) { Append(&value, sizeof(value)); }
+        void Write(UINT64 value) { Append(&value, sizeof(value)); }
+        void Write(const std::wstring& value)
+        {
+            Write(static_cast<UINT32>(value.size()));
+            Append(value.c_str(), value.size() * sizeof(WCHAR));
+        }
+
+        std::vector<BYTE>& GetData() { return m_data; }
+
+    private:
+        void Append(const void* data, size_t size)
+        {
+            auto bytes = static_cast<const BYTE*>(data);
+            m_data.insert(m_data.end(), bytes, bytes + size);
+        }
+
+        std::vector<BYTE> m_data;
+    };
+
+    /// Reads back the fields appended by EntryWriter. Fails instead of reading past the end of a truncated entry.
+    class EntryReader
+    {
+    public:
+        EntryReader(const std::vector<BYTE>& data) : m_data(data) {}
+
+        bool Read(UINT32& value) { return Copy(&value, sizeof(value)); }
+        bool Read(UINT64& value) { return Copy(&value, sizeof(value)); }
+        bool Read(bool& value)
+        {
+            UINT32 number = 0;
+            if (!Read(number)) { return false; }
+            value = (number != 0);
+            return true;
+        }
+        bool Read(std::wstring& value)
+        {
+            UINT32 length = 0;
+            if (!Read(length) || (m_data.size() - m_offset) / sizeof(WCHAR) < length) { return false; }
+            value.resize(length);
+            return Copy(&value[0], length * sizeof(WCHAR));
+        }
+
+        bool IsAtEnd() { return m_offset == m_data.size(); }
+
+    private:
+        bool Copy(void* destination, size_t size)
+        {
+            if (m_data.size() - m_offset < size) { return false; }
+            if (size != 0)
+            {
+                memcpy(destination, &m_data[m_offset], size);
+            }
+            m_offset += size;
+            return true;
+        }
+
+        const std::vector<BYTE>& m_data;
+        size_t m_offset = 0;
+    };
+}
+
+HRESULT InstalledPackageIndex::ExecuteForAddRequest()
+{
+    const HRESULT hrAdd = Add(*m_msixRequest->GetPackageInfo());
+    if (FAILED(hrAdd))
+    {
+        // Not fatal, the package is read from its manifest instead and added then.
+        TraceLoggingWrite(g_MsixTraceLoggingProvider,
+            "Failed to add package to the installed package index",
+            TraceLoggingLevel(WINEVENT_LEVEL_WARNING),
+            TraceLoggingValue(hrAdd, "HR"));
+    }
+    return S_OK;
+}
+
+HRESULT InstalledPackageIndex::ExecuteForRemoveRequest()
+{
+    RETURN_IF_FAILED(Remove(m_msixRequest->GetPackageInfo()->GetPackageFullName()));
+
+    TraceLoggingWrite(g_MsixTraceLoggingProvider,
+        "Removed package from the installed package index");
+    return S_OK;
+}
+
+HRESULT InstalledPackageIndex::CreateHandler(MsixRequest * msixRequest, IPackageHandler ** instance)
+{
+    std::unique_ptr<InstalledPackageIndex> localInstance(new InstalledPackageIndex(msixRequest));
+    if (localInstance == nullptr)
+    {
+        return E_OUTOFMEMORY;
+    }
+    *instance = localInstance.release();
+
+    return S_OK;
+}
+
+HRESULT InstalledPackageIndex::OpenPackagesKey(bool write, RegistryKey& packagesKey)
+{
+    RegistryKey indexKey;
+    if (write)
+    {
+        RegistryKey softwareKey;
+        RETURN_IF_FAILED(softwareKey.Open(HKEY_LOCAL_MACHINE, L"SOFTWARE", KEY_READ | KEY_WRITE));
+        RETURN_IF_FAILED(softwareKey.CreateSubKey(packageIndexKeyPath.substr(wcslen(L"SOFTWARE\\")).c_str(), KEY_READ | KEY_WRITE, &indexKey));
+    }
+    else
+    {
+        RETURN_IF_FAILED(indexKey.Open(HKEY_LOCAL_MACHINE, packageIndexKeyPath.c_str(), KEY_READ));
+    }
+
+    UINT32 version = 0;
+    bool versionExists = false;
+    RETURN_IF_FAILED(indexKey.GetUInt32ValueIfExists(versionValueName, version, versionExists));
+    if (!versionExists || version != PackageIndexVersion)
+    {
+        if (!write)
+        {
+            return HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND);
+        }
+
+        TraceLoggingWrite(g_MsixTraceLoggingProvider,
+            "Discarding installed package index of another version",
+            TraceLoggingValue(version, "Version"));
+        const HRESULT hrDeleteTree = indexKey.DeleteTree(packagesKeyName);
+        if (FAILED(hrDeleteTree) && hrDeleteTree != HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND))
+        {
+            return hrDeleteTree;
+        }
+        RETURN_IF_FAILED(indexKey.SetUInt32Value(versionValueName, PackageIndexVersion));
+    }
+
+    if (write)
+    {
+        RETURN_IF_FAILED(indexKey.CreateSubKey(packagesKeyName, KEY_READ | KEY_WRITE, &packagesKey));
+    }
+    else
+    {
+        RETURN_IF_FAILED(indexKey.OpenSubKey(packagesKeyName, KEY_READ, &packagesKey));
+    }
+    return S_OK;
+}
+
+std::vector<BYTE> InstalledPackageIndex::WriteEntry(PackageBase& package)
+{
+    EntryWriter writer;
+    writer.Write(package.GetPackageFamilyName());
+    writer.Write(package.GetDisplayName());
+    writer.Write(package.GetId());
+    writer.Write(package.GetApplicationId());
+    writer.Write(static_cast<UINT64>(package.GetVersionNumber()));
+    writer.Write(package.GetPublisher());
+    writer.Write(package.GetPublisherDisplayName());
+    writer.Write(package.GetRelativeExecutableFilePath());
+    writer.Write(package.GetRelativeLogoPath());
+    writer.Write(static_cast<UINT32>(package.GetArchitecture()));
+
+    auto capabilities = package.GetCapabilities();
+    writer.Write(static_cast<UINT32>(capabilities.size()));
+    for (auto& capability : capabilities)
+    {
+        writer.Write(capability);
+    }
+
+    auto executionInfo = package.GetExecutionInfo();
+    writer.Write(executionInfo->resolvedExecutableFilePath);
+    writer.Write(executionInfo->commandLineArguments);
+    writer.Write(executionInfo->workingDirectory);
+
+    auto scriptSettings = package.GetScriptSettings();
+    writer.Write(scriptSettings->scriptPath);
+    writer.Write(static_cast<UINT32>(scriptSettings->runOnce));
+    writer.Write(static_cast<UINT32>(scriptSettings->showWindow));
+    writer.Write(static_cast<UINT32>(scriptSettings->waitForScriptToFinish));
+    return std::move(writer.GetData());
+}
+
+HRESULT InstalledPackageIndex::ReadEntry(const std::wstring& packageFullName, const std::vector<BYTE>& entry, std::shared_ptr<InstalledPackage>& installedPackage)
+{
+    std::shared_ptr<InstalledPackage> instance = std::make_shared<InstalledPackage>();
+    if (instance == nullptr)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    instance->m_packageFullName = packageFullName;
+    UINT64 version = 0;
+    UINT32 architecture = 0;
+    UINT32 capabilitiesCount = 0;
+    EntryReader reader(entry);
+    bool read = reader.Read(instance->m_packageFamilyName) &&
+        reader.Read(instance->m_displayName) &&
+        reader.Read(instance->m_appUserModelId) &&
+        reader.Read(instance->m_applicationId) &&
+        reader.Read(version) &&
+        reader.Read(instance->m_publisher) &&
+        reader.Read(instance->m_publisherName) &&
+        reader.Read(instance->m_relativeExecutableFilePath) &&
+        reader.Read(instance->m_relativeLogoPath) &&
+        reader.Read(architecture) &&
+        reader.Read(capabilitiesCount);
+    for (UINT32 i = 0; read && i < capabilitiesCount; i++)
+    {
+        std::wstring capability;
+        read = reader.Read(capability);
+        instance->m_capabilities.push_back(capability);
+    }
+    read = read &&
+        reader.Read(instance->m_executionInfo.resolvedExecutableFilePath) &&
+        reader.Read(instance->m_executionInfo.commandLineArguments) &&
+        reader.Read(instance->m_executionInfo.workingDirectory) &&
+        reader.Read(instance->m_scriptSettings.scriptPath) &&
+        reader.Read(instance->m_scriptSettings.runOnce) &&
+        reader.Read(instance->m_scriptSettings.showWindow) &&
+        reader.Read(instance->m_scriptSettings.waitForScriptToFinish) &&
+        reader.IsAtEnd();
+    if (!read)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    instance->m_version = version;
+    instance->m_architecture = static_cast<APPX_PACKAGE_ARCHITECTURE>(architecture);
+    instance->m_packageDirectoryPath = FilePathMappings::GetInstance().GetMsixCoreDirectory() + packageFullName + L"\\";
+
+    installedPackage = instance;
+    return S_OK;
+}
+
+HRESULT InstalledPackageIndex::Find(const std::wstring& packageFullName, std::shared_ptr<InstalledPackage>& installedPackage)
+{
+    installedPackage = nullptr;
+
+    RegistryKey packagesKey;
+    const HRESULT hrOpen = OpenPackagesKey(false, packagesKey);
+    if (hrOpen == HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND))
+    {
+        return S_OK;
+    }
+    RETURN_IF_FAILED(hrOpen);
+
+    DWORD type = REG_NONE;
+    DWORD size = 0;
+    LSTATUS status = RegQueryValueExW(packagesKey, packageFullName.c_str(), nullptr, &type, nullptr, &size);
+    if (status == ERROR_FILE_NOT_FOUND)
+    {
+        return S_OK;
+    }
+    RETURN_IF_FAILED(HRESULT_FROM_WIN32(status));
+
+    std::vector<BYTE> entry(size);
+    status = RegQueryValueExW(packagesKey, packageFullName.c_str(), nullptr, &type, entry.data(), &size);
+    RETURN_IF_FAILED(HRESULT_FROM_WIN32(status));
+    entry.resize(size);
+    if (type != REG_BINARY)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATATYPE);
+    }
+
+    RETURN_IF_FAILED(ReadEntry(packageFullName, entry, installedPackage));
+    return S_OK;
+}
+
+HRESULT InstalledPackageIndex::Load(std::map<std::wstring, std::shared_ptr<InstalledPackage>, CaseInsensitiveLess>& installedPackages)
+{
+    installedPackages.clear();
+
+    RegistryKey packagesKey;
+    const HRESULT hrOpen = OpenPackagesKey(false, packagesKey);
+    if (hrOpen == HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND))
+    {
+        return S_OK;
+    }
+    RETURN_IF_FAILED(hrOpen);
+
+    DWORD valuesCount = 0;
+    DWORD valueNameMaxLength = 0;
+    DWORD valueDataMaxLength = 0;
+    RETURN_IF_FAILED(packagesKey.GetValuesInfo(&valuesCount, &valueNameMaxLength, &valueDataMaxLength));
+
+    std::vector<wchar_t> valueNameBuffer(valueNameMaxLength + 1);
+    std::vector<BYTE> valueDataBuffer(valueDataMaxLength + 1);
+    for (DWORD i = 0; i < valuesCount; i++)
+    {
+        DWORD nameLength = static_cast<DWORD>(valueNameBuffer.size());
+        DWORD dataLength = static_cast<DWORD>(valueDataBuffer.size());
+        DWORD valueType = REG_NONE;
+        RETURN_IF_FAILED(packagesKey.EnumValue(i, &valueNameBuffer[0], &nameLength, &valueType, &valueDataBuffer[0], &dataLength));
+
+        std::wstring packageFullName(&valueNameBuffer[0], nameLength);
+        std::vector<BYTE> entry(valueDataBuffer.begin(), valueDataBuffer.begin() + dataLength);
+        std::shared_ptr<InstalledPackage> installedPackage;
+        const HRESULT hrReadEntry = (valueType == REG_BINARY) ? ReadEntry(packageFullName, entry, installedPackage) : HRESULT_FROM_WIN32(ERROR_INVALID_DATATYPE);
+        if (FAILED(hrReadEntry))
+        {
+            // The package is read from its manifest instead, which rewrites the entry.
+            TraceLoggingWrite(g_MsixTraceLoggingProvider,
+                "Ignoring invalid entry of the installed package index",
+                TraceLoggingLevel(WINEVENT_LEVEL_WARNING),
+                TraceLoggingValue(packageFullName.c_str(), "PackageFullName"),
+                TraceLoggingValue(hrReadEntry, "HR"));
+            continue;
+        }
+        installedPackages[packageFullName] = installedPackage;
+    }
+    return S_OK;
+}
+
+HRESULT InstalledPackageIndex::Add(PackageBase& package)
+{
+    RegistryKey packagesKey;
+    RETURN_IF_FAILED(OpenPackagesKey(true, packagesKey));
+
+    auto entry = WriteEntry(package);
+    RETURN_IF_FAILED(packagesKey.SetValue(package.GetPackageFullName().c_str(), entry.data(), static_cast<DWORD>(entry.size()), REG_BINARY));
+    return S_OK;
+}
+
+HRESULT InstalledPackageIndex::Remove(const std::wstring& packageFullName)
+{
+    // Without an index there is nothing to remove, don't create one.
+    RegistryKey packagesKey;
+    const HRESULT hrOpen = OpenPackagesKey(false, packagesKey);
+    if (hrOpen == HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND))
+    {
+        return S_OK;
+    }
+    RETURN_IF_FAILED(hrOpen);
+    packagesKey.Close();
+
+    RETURN_IF_FAILED(OpenPackagesKey(true, packagesKey));
+    const HRESULT hrDeleteValue = packagesKey.DeleteValue(packageFullName.c_str());
+    if (FAILED(hrDeleteValue) && hrDeleteValue != HRESULT_FROM_WIN32(ERROR_FILE_NOT_FOUND))
+    {
+        return hrDeleteValue;
+    }
+    return S_OK;
+}
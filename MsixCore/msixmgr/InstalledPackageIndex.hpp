@@ -0,0 +1,79 @@
+#pragma once
+
+#include "GeneralUtil.hpp"
+#include "IPackageHandler.hpp"
+#include "MsixRequest.hpp"
+#include "RegistryKey.hpp"
+#include <map>
+
+namespace MsixCoreLib
+{
+    /// Compares package full names the way the file system compares the package directories.
+    struct CaseInsensitiveLess
+    {
+        bool operator()(const std::wstring& left, const std::wstring& right) const
+        {
+            return _wcsicmp(left.c_str(), right.c_str()) < 0;
+        }
+    };
+
+    /// Handles adding/removing the entry of a package in the index of installed packages.
+    /// The index keeps, for every installed package, what FindPackage and FindPackages return, so they don't parse
+    /// the manifest of every installed package. It lives in the machine's registry (HKLM), one binary value per
+    /// package full name, and is versioned: an index of another version is discarded.
+    /// The package directories remain the source of truth, a package without an entry is read from its manifest,
+    /// an entry without a directory is ignored. Entries are only written when a package is installed, the queries
+    /// don't write to the registry.
+    class InstalledPackageIndex : IPackageHandler
+    {
+    public:
+        /// Adds the entry of the package being installed.
+        HRESULT ExecuteForAddRequest();
+
+        /// Removes the entry of the package being removed.
+        HRESULT ExecuteForRemoveRequest();
+
+        static const PCWSTR HandlerName;
+        static HRESULT CreateHandler(_In_ MsixRequest* msixRequest, _Out_ IPackageHandler** instance);
+        ~InstalledPackageIndex() {}
+
+        /// Reads the entry of a package.
+        ///
+        /// @param packageFullName - the full name of the package
+        /// @param installedPackage - the package, or null when the index has no entry for it
+        static HRESULT Find(const std::wstring& packageFullName, std::shared_ptr<InstalledPackage>& installedPackage);
+
+        /// Reads all the entries.
+        ///
+        /// @param installedPackages - the packages, by package full name
+        static HRESULT Load(std::map<std::wstring, std::shared_ptr<InstalledPackage>, CaseInsensitiveLess>& installedPackages);
+
+        /// Writes the entry of a package, replacing the existing one.
+        static HRESULT Add(PackageBase& package);
+
+        /// Deletes the entry of a package, if any.
+        static HRESULT Remove(const std::wstring& packageFullName);
+
+    private:
+        MsixRequest* m_msixRequest = nullptr;
+
+        InstalledPackageIndex() {}
+        InstalledPackageIndex(_In_ MsixRequest* msixRequest) : m_msixRequest(msixRequest) {}
+
+        /// Opens the key holding the entries, discarding them when the index has another version.
+        ///
+        /// @param write - true to open the key to write entries, creating it if needed
+        /// @param packagesKey - the opened key
+        static HRESULT OpenPackagesKey(bool write, RegistryKey& packagesKey);
+
+        /// Serializes what is kept of a package in its entry.
+        static std::vector<BYTE> WriteEntry(PackageBase& package);
+
+        /// Makes the package of an entry.
+        ///
+        /// @param packageFullName - the full name of the package, which names its entry
+        /// @param entry - the data of the entry
+        /// @param installedPackage - the package
+        static HRESULT ReadEntry(const std::wstring& packageFullName, const std::vector<BYTE>& entry, std::shared_ptr<InstalledPackage>& installedPackage);
+    };
+}
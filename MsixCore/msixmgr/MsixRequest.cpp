@@ -9,6 +9,7 @@
 #include <iostream>
 #include <functional>
 #include <thread>
+#include <chrono>
 
 #include "FootprintFiles.hpp"
 #include "FilePaths.hpp"
@@ -40,6 +41,8 @@
 #include "VirtualFileHandler.hpp"
 #include "PSFScriptExecuter.hpp"
 #include "AppExecutionAlias.hpp"
+#include "InstalledPackageIndex.hpp"
+#include "ShellIntegration.hpp"
 
 #include "Constants.hpp"
 
@@ -79,17 +82,13 @@ std::map<PCWSTR, AddHandlerInfo> AddHandlers =
     {PrepareDevirtualizedRegistry::HandlerName, {PrepareDevirtualizedRegistry::CreateHandler, VirtualFileHandler::HandlerName,           ExecuteErrorHandler, ErrorHandler::HandlerName}},
     {VirtualFileHandler::HandlerName,           {VirtualFileHandler::CreateHandler,           WriteDevirtualizedRegistry::HandlerName,   ExecuteErrorHandler, ErrorHandler::HandlerName}},
     {WriteDevirtualizedRegistry::HandlerName,   {WriteDevirtualizedRegistry::CreateHandler,   PSFScriptExecuter::HandlerName,            ExecuteErrorHandler, ErrorHandler::HandlerName}},
-    {PSFScriptExecuter::HandlerName,            {PSFScriptExecuter::CreateHandler,            StartMenuLink::HandlerName,                ExecuteErrorHandler, ErrorHandler::HandlerName}},
-    {StartMenuLink::HandlerName,                {StartMenuLink::CreateHandler,                AddRemovePrograms::HandlerName,            ExecuteErrorHandler, ErrorHandler::HandlerName}},
-    {AddRemovePrograms::HandlerName,            {AddRemovePrograms::CreateHandler,            Protocol::HandlerName,                     ExecuteErrorHandler, ErrorHandler::HandlerName}},
-    {Protocol::HandlerName,                     {Protocol::CreateHandler,                     ComInterface::HandlerName,                 ExecuteErrorHandler, ErrorHandler::HandlerName}},
+    {PSFScriptExecuter::HandlerName,            {PSFScriptExecuter::CreateHandler,            AddRemovePrograms::HandlerName,            ExecuteErrorHandler, ErrorHandler::HandlerName}},
+    {AddRemovePrograms::HandlerName,            {AddRemovePrograms::CreateHandler,            ComInterface::HandlerName,                 ExecuteErrorHandler, ErrorHandler::HandlerName}},
     {ComInterface::HandlerName,                 {ComInterface::CreateHandler,                 ComServer::HandlerName,                    ExecuteErrorHandler, ErrorHandler::HandlerName}},
     {ComServer::HandlerName,                    {ComServer::CreateHandler,                    StartupTask::HandlerName,                  ExecuteErrorHandler, ErrorHandler::HandlerName}},
-    {StartupTask::HandlerName,                  {StartupTask::CreateHandler,                  FileTypeAssociation::HandlerName,          ExecuteErrorHandler, ErrorHandler::HandlerName}},
-    {FileTypeAssociation::HandlerName,          {FileTypeAssociation::CreateHandler,          FirewallRules::HandlerName,                ExecuteErrorHandler, ErrorHandler::HandlerName}},
-    {FirewallRules::HandlerName,                {FirewallRules::CreateHandler,                AutoPlay::HandlerName,                     ExecuteErrorHandler, ErrorHandler::HandlerName}},
-    {AutoPlay::HandlerName,                     {AutoPlay::CreateHandler,                     AppExecutionAlias::HandlerName,            ExecuteErrorHandler, ErrorHandler::HandlerName}},
-    {AppExecutionAlias::HandlerName,            {AppExecutionAlias::CreateHandler,            InstallComplete::HandlerName,              ExecuteErrorHandler, ErrorHandler::HandlerName}},
+    {StartupTask::HandlerName,                  {StartupTask::CreateHandler,                  ShellIntegration::HandlerName,             ExecuteErrorHandler, ErrorHandler::HandlerName}},
+    {ShellIntegration::HandlerName,             {ShellIntegration::CreateHandler,             InstalledPackageIndex::HandlerName,        ExecuteErrorHandler, ErrorHandler::HandlerName}},
+    {InstalledPackageIndex::HandlerName,        {InstalledPackageIndex::CreateHandler,        InstallComplete::HandlerName,              ExecuteErrorHandler, ErrorHandler::HandlerName}},
     {InstallComplete::HandlerName,              {InstallComplete::CreateHandler,              nullptr,                                   ExecuteErrorHandler, ErrorHandler::HandlerName}},
     {ErrorHandler::HandlerName,                 {ErrorHandler::CreateHandler,                 nullptr,                                   ReturnError,         nullptr}},
 };
@@ -97,18 +96,14 @@ std::map<PCWSTR, AddHandlerInfo> AddHandlers =
 std::map<PCWSTR, RemoveHandlerInfo> RemoveHandlers =
 {
     //HandlerName                               Function to create                            NextHandler                                 ErrorHandling
-    {PopulatePackageInfo::HandlerName,          {PopulatePackageInfo::CreateHandler,          StartMenuLink::HandlerName,                 ReturnError}},
-    {StartMenuLink::HandlerName,                {StartMenuLink::CreateHandler,                AddRemovePrograms::HandlerName,             IgnoreAndProcessNextHandler}},
+    {PopulatePackageInfo::HandlerName,          {PopulatePackageInfo::CreateHandler,          InstalledPackageIndex::HandlerName,         ReturnError}},
+    {InstalledPackageIndex::HandlerName,        {InstalledPackageIndex::CreateHandler,        AddRemovePrograms::HandlerName,             IgnoreAndProcessNextHandler}},
     {AddRemovePrograms::HandlerName,            {AddRemovePrograms::CreateHandler,            PrepareDevirtualizedRegistry::HandlerName,  IgnoreAndProcessNextHandler}},
-    {PrepareDevirtualizedRegistry::HandlerName, {PrepareDevirtualizedRegistry::CreateHandler, Protocol::HandlerName,                      IgnoreAndProcessNextHandler}},
-    {Protocol::HandlerName,                     {Protocol::CreateHandler,                     ComInterface::HandlerName,                  IgnoreAndProcessNextHandler}},
+    {PrepareDevirtualizedRegistry::HandlerName, {PrepareDevirtualizedRegistry::CreateHandler, ShellIntegration::HandlerName,              IgnoreAndProcessNextHandler}},
+    {ShellIntegration::HandlerName,             {ShellIntegration::CreateHandler,             ComInterface::HandlerName,                  IgnoreAndProcessNextHandler}},
     {ComInterface::HandlerName,                 {ComInterface::CreateHandler,                 ComServer::HandlerName,                     IgnoreAndProcessNextHandler}},
     {ComServer::HandlerName,                    {ComServer::CreateHandler,                    StartupTask::HandlerName,                   IgnoreAndProcessNextHandler}},
-    {StartupTask::HandlerName,                  {StartupTask::CreateHandler,                  FileTypeAssociation::HandlerName,           IgnoreAndProcessNextHandler}},
-    {FileTypeAssociation::HandlerName,          {FileTypeAssociation::CreateHandler,          FirewallRules::HandlerName,                 IgnoreAndProcessNextHandler}},
-    {FirewallRules::HandlerName,                {FirewallRules::CreateHandler,                AutoPlay::HandlerName,                      IgnoreAndProcessNextHandler}},
-    {AutoPlay::HandlerName,                     {AutoPlay::CreateHandler,                     AppExecutionAlias::HandlerName,             IgnoreAndProcessNextHandler}},
-    {AppExecutionAlias::HandlerName,            {AppExecutionAlias::CreateHandler,            VirtualFileHandler::HandlerName,            IgnoreAndProcessNextHandler}},
+    {StartupTask::HandlerName,                  {StartupTask::CreateHandler,                  VirtualFileHandler::HandlerName,            IgnoreAndProcessNextHandler}},
     {VirtualFileHandler::HandlerName,           {VirtualFileHandler::CreateHandler,           WriteDevirtualizedRegistry::HandlerName,    IgnoreAndProcessNextHandler}},
     {WriteDevirtualizedRegistry::HandlerName,   {WriteDevirtualizedRegistry::CreateHandler,   Extractor::HandlerName,                     IgnoreAndProcessNextHandler}},
     {Extractor::HandlerName,                    {Extractor::CreateHandler,                    nullptr,                                    IgnoreAndProcessNextHandler}},
@@ -168,12 +163,18 @@ HRESULT MsixRequest::ProcessAddRequest()
             TraceLoggingValue(currentHandlerName, "HandlerName"));
 
         AddHandlerInfo currentHandler = AddHandlers[currentHandlerName];
+        auto start = std::chrono::steady_clock::now();
         AutoPtr<IPackageHandler> handler;
         HRESULT hr = currentHandler.create(this, &handler);
         if (SUCCEEDED(hr))
         {
             hr = handler->ExecuteForAddRequest();
         }
+        TraceLoggingWrite(g_MsixTraceLoggingProvider,
+            "Handler completed",
+            TraceLoggingValue(currentHandlerName, "HandlerName"),
+            TraceLoggingValue(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count(), "DurationMs"),
+            TraceLoggingValue(hr, "HR"));
         if (FAILED(hr) && currentHandler.errorMode != IgnoreAndProcessNextHandler)
         {
             m_msixResponse->SetErrorStatus(hr, L"Unable to install package. Please go to aka.ms/msix for more information.");
@@ -203,12 +204,18 @@ HRESULT MsixRequest::ProcessRemoveRequest()
             TraceLoggingValue(currentHandlerName, "HandlerName"));
 
         RemoveHandlerInfo currentHandler = RemoveHandlers[currentHandlerName];
+        auto start = std::chrono::steady_clock::now();
         AutoPtr<IPackageHandler> handler;
         HRESULT hr = currentHandler.create(this, &handler);
         if (SUCCEEDED(hr))
         {
             hr = handler->ExecuteForRemoveRequest();
         }
+        TraceLoggingWrite(g_MsixTraceLoggingProvider,
+            "Handler completed",
+            TraceLoggingValue(currentHandlerName, "HandlerName"),
+            TraceLoggingValue(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count(), "DurationMs"),
+            TraceLoggingValue(hr, "HR"));
 
         if (FAILED(hr))
         {
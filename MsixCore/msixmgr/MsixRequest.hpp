@@ -2,6 +2,7 @@
 #include "Package.hpp"
 #include "FilePaths.hpp"
 #include "MsixResponse.hpp"
+#include <set>
 
 namespace MsixCoreLib
 {
@@ -28,6 +29,7 @@ private:
 
     /// Filled by ProcessPotentialUpdate
     bool m_isReinstall = false;
+    std::set<std::wstring> m_unchangedFiles;
 
     /// MsixResponse object populated by handlers
     std::shared_ptr<MsixResponse> m_msixResponse;
@@ -71,6 +73,11 @@ public:
     void SetIsReinstall(bool isReinstall) { m_isReinstall = isReinstall; }
     bool IsReinstall() { return m_isReinstall;  }
 
+    /// Payload files, by their name in the block map, already in the package directory because they are
+    /// the same as in the updated package. Only the other files need to be extracted.
+    void SetUnchangedFiles(std::set<std::wstring> unchangedFiles) { m_unchangedFiles = std::move(unchangedFiles); }
+    const std::set<std::wstring>& GetUnchangedFiles() { return m_unchangedFiles; }
+
     /// @return can return null if called before PopulatePackageInfo.
     std::shared_ptr<PackageBase> GetPackageInfo() { return m_packageInfo; }
 
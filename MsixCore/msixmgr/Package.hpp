@@ -180,6 +180,9 @@ namespace MsixCoreLib
         /// the actual .msix package file is no longer accessible.
         static HRESULT MakeFromManifestReader(const std::wstring & directoryPath, IAppxManifestReader* manifestReader, std::shared_ptr<InstalledPackage>* packageInfo);
         InstalledPackage() :PackageBase(), IInstalledPackage() {}
+
+        /// Makes InstalledPackage objects from its entries, without a manifest reader.
+        friend class InstalledPackageIndex;
     
     };
 }
\ No newline at end of file
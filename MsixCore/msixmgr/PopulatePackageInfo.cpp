@@ -1,6 +1,7 @@
 #include <windows.h>
 
 #include "PopulatePackageInfo.hpp"
+#include "Extractor.hpp"
 #include "GeneralUtil.hpp"
 #include "FilePaths.hpp"
 #include <TraceLoggingProvider.h>
@@ -19,6 +20,7 @@ HRESULT PopulatePackageInfo::GetPackageInfoFromPackage(IStream * packageStream,
     // So on all platforms, it's always safe to call CoCreateAppxFactoryWithHeap, just be sure to bring your own heap!
     ComPtr<IAppxFactory> appxFactory;
     RETURN_IF_FAILED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, validationOption, &appxFactory));
+    RETURN_IF_FAILED(Extractor::SpecifyFileStatisticsCallback(appxFactory.Get()));
 
     // Create a new package reader using the factory.
     ComPtr<IAppxPackageReader> packageReader;
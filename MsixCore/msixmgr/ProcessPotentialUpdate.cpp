@@ -1,10 +1,121 @@
 #include "ProcessPotentialUpdate.hpp"
+#include <algorithm>
 #include <filesystem>
+#include <map>
+#include <set>
+#include <vector>
+#include "Constants.hpp"
+#include "CryptoProvider.hpp"
 #include "MsixTraceLoggingProvider.hpp"
 
 using namespace MsixCoreLib;
 const PCWSTR ProcessPotentialUpdate::HandlerName = L"ProcessPotentialUpdate";
 
+namespace
+{
+    /// Size and block hashes of a file of a block map. Two files with the same ones have the same content.
+    struct BlockMapFileContent
+    {
+        UINT64 size = 0;
+        std::vector<BYTE> hashes;
+
+        bool operator==(const BlockMapFileContent& other) const { return size == other.size && hashes == other.hashes; }
+    };
+
+    /// Reads the content of every file of a block map, by file name.
+    HRESULT GetBlockMapFiles(_In_ IAppxBlockMapReader* blockMap, std::map<std::wstring, BlockMapFileContent>& files)
+    {
+        ComPtr<IAppxBlockMapFilesEnumerator> fileEnumerator;
+        RETURN_IF_FAILED(blockMap->GetFiles(&fileEnumerator));
+        BOOL hasCurrentFile = FALSE;
+        RETURN_IF_FAILED(fileEnumerator->GetHasCurrent(&hasCurrentFile));
+        while (hasCurrentFile)
+        {
+            ComPtr<IAppxBlockMapFile> file;
+            RETURN_IF_FAILED(fileEnumerator->GetCurrent(&file));
+            Text<WCHAR> fileName;
+            RETURN_IF_FAILED(file->GetName(&fileName));
+
+            BlockMapFileContent content;
+            RETURN_IF_FAILED(file->GetUncompressedSize(&content.size));
+
+            ComPtr<IAppxBlockMapBlocksEnumerator> blockEnumerator;
+            RETURN_IF_FAILED(file->GetBlocks(&blockEnumerator));
+            BOOL hasCurrentBlock = FALSE;
+            RETURN_IF_FAILED(blockEnumerator->GetHasCurrent(&hasCurrentBlock));
+            while (hasCurrentBlock)
+            {
+                ComPtr<IAppxBlockMapBlock> block;
+                RETURN_IF_FAILED(blockEnumerator->GetCurrent(&block));
+                UINT32 hashSize = 0;
+                BYTE* hash = nullptr;
+                RETURN_IF_FAILED(block->GetHash(&hashSize, &hash));
+                content.hashes.insert(content.hashes.end(), hash, hash + hashSize);
+                MyFree(hash);
+                RETURN_IF_FAILED(blockEnumerator->MoveNext(&hasCurrentBlock));
+            }
+
+            files[fileName.Get()] = std::move(content);
+            RETURN_IF_FAILED(fileEnumerator->MoveNext(&hasCurrentFile));
+        }
+        return S_OK;
+    }
+
+    const ULONG BlockMapBlockSize = 64 * 1024;
+    const ULONG BlockMapHashSize = 32;
+
+    /// Checks that the file on disk has the size and the SHA-256 of every block the block map has for it.
+    /// A file that can't be read is treated as changed.
+    bool FileMatchesBlockMap(const std::wstring& filePath, const BlockMapFileContent& content, CryptoProvider* cryptoProvider)
+    {
+        UINT64 blockCount = (content.size + BlockMapBlockSize - 1) / BlockMapBlockSize;
+        if (content.hashes.size() != blockCount * BlockMapHashSize)
+        {
+            return false;
+        }
+
+        HANDLE file = CreateFileW(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+
+        bool matches = true;
+        LARGE_INTEGER fileSize = {};
+        if (!GetFileSizeEx(file, &fileSize) || static_cast<UINT64>(fileSize.QuadPart) != content.size)
+        {
+            matches = false;
+        }
+
+        std::vector<BYTE> buffer(BlockMapBlockSize);
+        for (UINT64 block = 0; matches && block < blockCount; block++)
+        {
+            ULONG blockSize = static_cast<ULONG>(std::min<UINT64>(BlockMapBlockSize, content.size - block * BlockMapBlockSize));
+            DWORD bytesRead = 0;
+            if (!ReadFile(file, buffer.data(), blockSize, &bytesRead, nullptr) || bytesRead != blockSize)
+            {
+                matches = false;
+                break;
+            }
+
+            COMMON_BYTES data = { blockSize, buffer.data() };
+            COMMON_BYTES digest = { 0 };
+            if (FAILED(cryptoProvider->StartDigest()) ||
+                FAILED(cryptoProvider->DigestData(&data)) ||
+                FAILED(cryptoProvider->GetDigest(&digest)) ||
+                digest.length != BlockMapHashSize ||
+                memcmp(digest.bytes, content.hashes.data() + block * BlockMapHashSize, BlockMapHashSize) != 0)
+            {
+                matches = false;
+            }
+            cryptoProvider->Reset();
+        }
+
+        CloseHandle(file);
+        return matches;
+    }
+}
+
 HRESULT ProcessPotentialUpdate::ExecuteForAddRequest()
 {
     /// This design chooses the simplest solution of removing the existing package in the family before proceeding with the install
@@ -33,6 +144,15 @@ HRESULT ProcessPotentialUpdate::ExecuteForAddRequest()
 
                     if (versionToBeInstalled > versionCurrentlyInstalled)
                     {
+                        const HRESULT hrLinkUnchangedFiles = LinkUnchangedFiles(p.path().filename());
+                        if (FAILED(hrLinkUnchangedFiles))
+                        {
+                            // Not fatal, the Extractor then extracts every file of the package.
+                            TraceLoggingWrite(g_MsixTraceLoggingProvider,
+                                "Failed to keep the unchanged files of the installed package",
+                                TraceLoggingLevel(WINEVENT_LEVEL_WARNING),
+                                TraceLoggingValue(hrLinkUnchangedFiles, "HR"));
+                        }
                         RETURN_IF_FAILED(RemovePackage(p.path().filename()));
                         return S_OK;
                     }
@@ -77,6 +197,82 @@ HRESULT ProcessPotentialUpdate::RemovePackage(std::wstring packageFullName)
     return S_OK;
 }
 
+HRESULT ProcessPotentialUpdate::LinkUnchangedFiles(const std::wstring& installedPackageFullName)
+{
+    auto packageToInstall = std::dynamic_pointer_cast<Package>(m_msixRequest->GetPackageInfo());
+    if (packageToInstall == nullptr)
+    {
+        return S_OK;
+    }
+
+    std::wstring installedPackageDirectoryPath = FilePathMappings::GetInstance().GetMsixCoreDirectory() + installedPackageFullName;
+    std::wstring packageDirectoryPath = m_msixRequest->GetPackageDirectoryPath();
+
+    ComPtr<IStream> installedBlockMapStream;
+    RETURN_IF_FAILED(CreateStreamOnFileUTF16((installedPackageDirectoryPath + blockMapFile).c_str(), true, &installedBlockMapStream));
+
+    ComPtr<IAppxFactory> appxFactory;
+    RETURN_IF_FAILED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &appxFactory));
+    ComPtr<IAppxBlockMapReader> installedBlockMap;
+    RETURN_IF_FAILED(appxFactory->CreateBlockMapReader(installedBlockMapStream.Get(), &installedBlockMap));
+    ComPtr<IAppxBlockMapReader> blockMap;
+    RETURN_IF_FAILED(packageToInstall->GetPackageReader()->GetBlockMap(&blockMap));
+
+    std::map<std::wstring, BlockMapFileContent> installedFiles;
+    RETURN_IF_FAILED(GetBlockMapFiles(installedBlockMap.Get(), installedFiles));
+    std::map<std::wstring, BlockMapFileContent> files;
+    RETURN_IF_FAILED(GetBlockMapFiles(blockMap.Get(), files));
+
+    AutoPtr<CryptoProvider> cryptoProvider;
+    RETURN_IF_FAILED(CryptoProvider::Create(&cryptoProvider));
+
+    // The files of the installed package are removed with it, a hard link keeps the ones that didn't change
+    // under the directory of the new version, so they don't need to be extracted again.
+    std::set<std::wstring> unchangedFiles;
+    UINT64 unchangedBytes = 0;
+    for (const auto& file : files)
+    {
+        auto installedFile = installedFiles.find(file.first);
+        if (installedFile == installedFiles.end() || !(installedFile->second == file.second))
+        {
+            continue;
+        }
+
+        std::wstring installedFilePath = std::wstring(L"\\\\?\\") + installedPackageDirectoryPath + L"\\" + file.first;
+        std::wstring filePath = std::wstring(L"\\\\?\\") + packageDirectoryPath + L"\\" + file.first;
+
+        // A file changed on disk since it was installed is extracted again, the link would share it with the
+        // new version otherwise.
+        if (!FileMatchesBlockMap(installedFilePath, file.second, cryptoProvider.Get()))
+        {
+            continue;
+        }
+
+        RETURN_IF_FAILED(HRESULT_FROM_WIN32(mkdirp(filePath)));
+        if (!CreateHardLinkW(filePath.c_str(), installedFilePath.c_str(), nullptr))
+        {
+            TraceLoggingWrite(g_MsixTraceLoggingProvider,
+                "Failed to link unchanged file, it will be extracted",
+                TraceLoggingLevel(WINEVENT_LEVEL_WARNING),
+                TraceLoggingValue(file.first.c_str(), "FileName"),
+                TraceLoggingValue(GetLastError(), "Error"));
+            continue;
+        }
+        unchangedFiles.insert(file.first);
+        unchangedBytes += file.second.size;
+    }
+
+    TraceLoggingWrite(g_MsixTraceLoggingProvider,
+        "Kept unchanged files of the installed package",
+        TraceLoggingValue(installedPackageFullName.c_str(), "PackageCurrentlyInstalled"),
+        TraceLoggingValue(static_cast<UINT32>(unchangedFiles.size()), "UnchangedFiles"),
+        TraceLoggingValue(static_cast<UINT32>(files.size()), "PayloadFiles"),
+        TraceLoggingValue(unchangedBytes, "UnchangedBytes"));
+
+    m_msixRequest->SetUnchangedFiles(std::move(unchangedFiles));
+    return S_OK;
+}
+
 HRESULT ProcessPotentialUpdate::CreateHandler(MsixRequest * msixRequest, IPackageHandler ** instance)
 {
     std::unique_ptr<ProcessPotentialUpdate> localInstance(new ProcessPotentialUpdate(msixRequest));
@@ -7,7 +7,7 @@
 namespace MsixCoreLib
 {
 /// Determines if the incoming add request is actually an update to an existing package.
-/// If it is, it'll remove the outdated package
+/// If it is, it'll remove the outdated package, keeping the files that didn't change in the update
 class ProcessPotentialUpdate : IPackageHandler
 {
 public:
@@ -26,5 +26,12 @@ private:
 
     /// Synchronously removes the outdated package before allowing the current request to proceed
     HRESULT RemovePackage(std::wstring packageFullName);
+
+    /// Compares the block map of the installed package with the one of the package to install, and hard links the
+    /// payload files with the same content into the directory of the package to install, before the installed
+    /// package is removed. The Extractor then only extracts the files that changed.
+    ///
+    /// @param installedPackageFullName - the full name of the outdated package
+    HRESULT LinkUnchangedFiles(const std::wstring& installedPackageFullName);
 };
 }
\ No newline at end of file
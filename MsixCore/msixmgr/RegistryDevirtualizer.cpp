@@ -1,6 +1,8 @@
 #include "RegistryDevirtualizer.hpp"
 #include "FilePaths.hpp"
 #include "Constants.hpp"
+#include <chrono>
+#include <cwchar>
 #include <vector>
 #include "MsixTraceLoggingProvider.hpp"
 
@@ -132,6 +134,109 @@ bool RegistryDevirtualizer::IsExcludeKey(RegistryKey* realKey)
 }
 
 HRESULT RegistryDevirtualizer::CopyAndDevirtualizeRegistryTree(RegistryKey* virtualKey, RegistryKey* realKey)
+{
+    // The hive is read once, detokenized in memory, then written, so each phase runs without the others
+    // in between and the time spent in each one shows in the log.
+    auto start = std::chrono::steady_clock::now();
+    VirtualRegistryTree tree;
+    RETURN_IF_FAILED(ReadRegistryTree(virtualKey, tree));
+    auto read = std::chrono::steady_clock::now();
+
+    RETURN_IF_FAILED(DetokenizeRegistryTree(tree));
+    auto detokenized = std::chrono::steady_clock::now();
+
+    RegistryTreeCounts counts;
+    RETURN_IF_FAILED(WriteRegistryTree(tree, realKey, counts));
+    auto written = std::chrono::steady_clock::now();
+
+    TraceLoggingWrite(g_MsixTraceLoggingProvider,
+        "Devirtualized registry tree",
+        TraceLoggingValue(realKey->GetPath().c_str(), "Realkey"),
+        TraceLoggingValue(counts.keys, "KeysWritten"),
+        TraceLoggingValue(counts.values, "ValuesWritten"),
+        TraceLoggingValue(static_cast<UINT64>(std::chrono::duration_cast<std::chrono::milliseconds>(read - start).count()), "ReadMs"),
+        TraceLoggingValue(static_cast<UINT64>(std::chrono::duration_cast<std::chrono::milliseconds>(detokenized - read).count()), "DetokenizeMs"),
+        TraceLoggingValue(static_cast<UINT64>(std::chrono::duration_cast<std::chrono::milliseconds>(written - detokenized).count()), "WriteMs"));
+    return S_OK;
+}
+
+HRESULT RegistryDevirtualizer::ReadRegistryTree(RegistryKey* virtualKey, VirtualRegistryTree& tree)
+{
+    RETURN_IF_FAILED(RegistryKey::EnumKeyAndDoActionForAllSubkeys(virtualKey,
+        [&](PCWSTR enumeratedSubKeyName, RegistryKey*, bool*) -> HRESULT
+    {
+        RegistryKey sourceSubKey;
+        RETURN_IF_FAILED(virtualKey->OpenSubKey(enumeratedSubKeyName, KEY_READ, &sourceSubKey));
+
+        VirtualRegistryTree subTree;
+        subTree.name = enumeratedSubKeyName;
+        RETURN_IF_FAILED(ReadRegistryTree(&sourceSubKey, subTree));
+        tree.subKeys.push_back(std::move(subTree));
+        return S_OK;
+    }));
+
+    DWORD valuesCount = 0;
+    DWORD valueNameMaxLength = 0;
+    DWORD valueDataMaxLength = 0;
+    RETURN_IF_FAILED(virtualKey->GetValuesInfo(&valuesCount, &valueNameMaxLength, &valueDataMaxLength));
+
+    if (valuesCount == 0)
+    {
+        return S_OK;
+    }
+
+    std::vector<wchar_t> valueNameBuffer(valueNameMaxLength + 1);
+    std::vector<BYTE> valueDataBuffer((valueDataMaxLength + 1));
+    tree.values.reserve(valuesCount);
+    for (DWORD i = 0; i < valuesCount; i++)
+    {
+        DWORD nameLength = static_cast<DWORD>(valueNameBuffer.size());
+        DWORD dataLength = static_cast<DWORD>(valueDataBuffer.size());
+        DWORD valueType = REG_NONE;
+
+        RETURN_IF_FAILED(virtualKey->EnumValue(i, &valueNameBuffer[0], &nameLength, &valueType,
+            reinterpret_cast<LPBYTE>(&valueDataBuffer[0]), &dataLength));
+
+        VirtualRegistryValue value;
+        value.name.assign(&valueNameBuffer[0], nameLength);
+        value.type = valueType;
+        value.data.assign(valueDataBuffer.begin(), valueDataBuffer.begin() + dataLength);
+        tree.values.push_back(std::move(value));
+    }
+    return S_OK;
+}
+
+HRESULT RegistryDevirtualizer::DetokenizeRegistryTree(VirtualRegistryTree& tree)
+{
+    for (auto& subTree : tree.subKeys)
+    {
+        RETURN_IF_FAILED(DetokenizeData(subTree.name));
+        RETURN_IF_FAILED(DetokenizeRegistryTree(subTree));
+    }
+
+    for (auto& value : tree.values)
+    {
+        RETURN_IF_FAILED(DetokenizeData(value.name));
+
+        // The type can have AppV flags, and values without one are strings.
+        value.type = (value.type & 0xff);
+        if (value.type == REG_NONE)
+        {
+            value.type = REG_SZ;
+        }
+
+        if (value.type == REG_SZ)
+        {
+            std::wstring dataWString(reinterpret_cast<PCWSTR>(value.data.data()), value.data.size() / sizeof(WCHAR));
+            dataWString.resize(wcsnlen(dataWString.c_str(), dataWString.size()));
+            RETURN_IF_FAILED(DetokenizeData(dataWString));
+            value.stringData = std::move(dataWString);
+        }
+    }
+    return S_OK;
+}
+
+HRESULT RegistryDevirtualizer::WriteRegistryTree(const VirtualRegistryTree& tree, RegistryKey* realKey, RegistryTreeCounts& counts)
 {
     if (IsExcludeKey(realKey))
     {
@@ -141,20 +246,9 @@ HRESULT RegistryDevirtualizer::CopyAndDevirtualizeRegistryTree(RegistryKey* virt
         return S_OK;
     }
 
-    RETURN_IF_FAILED(RegistryKey::EnumKeyAndDoActionForAllSubkeys(virtualKey,
-        [&](PCWSTR enumeratedSubKeyName, RegistryKey*, bool*) -> HRESULT
+    for (const auto& subTree : tree.subKeys)
     {
-        std::wstring subKeyNameWstring(enumeratedSubKeyName);
-        RETURN_IF_FAILED(DetokenizeData(subKeyNameWstring));
-        PCWSTR subKeyName = subKeyNameWstring.c_str();
-
-        RegistryKey sourceSubKey;
-        RETURN_IF_FAILED(virtualKey->OpenSubKey(enumeratedSubKeyName, KEY_READ, &sourceSubKey));
-
-        TraceLoggingWrite(g_MsixTraceLoggingProvider,
-            "Creating subkey",
-            TraceLoggingValue(realKey->GetPath().c_str(), "Realkey"),
-            TraceLoggingValue(subKeyName, "SubKey"));
+        PCWSTR subKeyName = subTree.name.c_str();
 
         RegistryKey destinationSubKey;
         HRESULT hrCreateKey = HRESULT_FROM_WIN32(realKey->CreateSubKey(subKeyName, KEY_READ | KEY_WRITE | WRITE_DAC, &destinationSubKey));
@@ -164,7 +258,7 @@ HRESULT RegistryDevirtualizer::CopyAndDevirtualizeRegistryTree(RegistryKey* virt
                 "Skipping attempted write to volatile key",
                 TraceLoggingValue(realKey->GetPath().c_str(), "Realkey"),
                 TraceLoggingValue(subKeyName, "SubKey"));
-            return S_OK;
+            continue;
         }
         else if (FAILED(hrCreateKey))
         {
@@ -174,53 +268,45 @@ HRESULT RegistryDevirtualizer::CopyAndDevirtualizeRegistryTree(RegistryKey* virt
                 TraceLoggingValue(realKey->GetPath().c_str(), "Realkey"),
                 TraceLoggingValue(subKeyName, "SubKey"),
                 TraceLoggingValue(hrCreateKey, "HR"));
-            return S_OK;
+            continue;
         }
 
-        RETURN_IF_FAILED(CopyAndDevirtualizeRegistryTree(&sourceSubKey, &destinationSubKey));
-        return S_OK;
-    }));
-    
-    DWORD valuesCount = 0;
-    DWORD valueNameMaxLength = 0;
-    DWORD valueDataMaxLength = 0;
-    RETURN_IF_FAILED(virtualKey->GetValuesInfo(&valuesCount, &valueNameMaxLength, &valueDataMaxLength));
-
-    if (valuesCount == 0)
-    {
-        // no values -- nothing more to devirtualize, return early.
-        return S_OK;
+        counts.keys++;
+        RETURN_IF_FAILED(WriteRegistryTree(subTree, &destinationSubKey, counts));
     }
 
-    DWORD valueType = REG_NONE;
-    std::vector<wchar_t> valueNameBuffer(valueNameMaxLength + 1);
-    std::vector<BYTE> valueDataBuffer((valueDataMaxLength + 1));
-
-    // for each value of this key, devirtualize it and write it to the real key.
-    for (DWORD i = 0; i < valuesCount; i++)
+    for (const auto& value : tree.values)
     {
-        valueNameBuffer[0] = 0;
-        valueDataBuffer[0] = 0;
-        DWORD nameLength = static_cast<DWORD>(valueNameBuffer.size());
-        DWORD dataLength = static_cast<DWORD>(valueDataBuffer.size());
-        valueType = REG_NONE;
-
-        RETURN_IF_FAILED(virtualKey->EnumValue(i, &valueNameBuffer[0], &nameLength, &valueType,
-            reinterpret_cast<LPBYTE>(&valueDataBuffer[0]), &dataLength));
-
-        std::wstring valueNameString(valueNameBuffer.begin(), valueNameBuffer.end());
-        RETURN_IF_FAILED(DetokenizeData(valueNameString));
-        RETURN_IF_FAILED(DevirtualizeValue(realKey, valueNameString.c_str(), valueDataBuffer, dataLength, valueType));
+        if (value.type == REG_SZ)
+        {
+            RETURN_IF_FAILED(realKey->SetStringValue(value.name.c_str(), value.stringData));
+        }
+        else
+        {
+            RETURN_IF_FAILED(realKey->SetValue(value.name.c_str(), value.data.data(), static_cast<DWORD>(value.data.size()), value.type));
+        }
+        counts.values++;
     }
     return S_OK;
 }
 
 HRESULT RegistryDevirtualizer::DetokenizeData(std::wstring& data)
 {
+    // Most of the names and data have no token at all.
+    if (data.find(L"[{") == std::wstring::npos)
+    {
+        return S_OK;
+    }
+
     TraceLoggingWrite(g_MsixTraceLoggingProvider,
         "Detokenizing string",
         TraceLoggingValue(data.c_str(), "data"));
 
+    if (m_tokens.empty())
+    {
+        m_tokens = FilePathMappings::GetInstance().GetMap();
+    }
+
     std::wstring::size_type beginToken = data.find(L"[{");
     std::wstring::size_type endToken = data.find(L"}]");
     while (beginToken != std::wstring::npos && endToken != std::wstring::npos)
@@ -229,9 +315,8 @@ HRESULT RegistryDevirtualizer::DetokenizeData(std::wstring& data)
         // get the contents of what's in between the braces, i.e. [{token}]
         std::wstring token = data.substr(beginToken + 2, (endToken - beginToken - 2)); // +2 to skip over [{ characters, -2 to omit }] characters
 
-        std::map<std::wstring, std::wstring> map = FilePathMappings::GetInstance().GetMap();
-        auto it = map.find(token);
-        if (it != map.end())
+        auto it = m_tokens.find(token);
+        if (it != m_tokens.end())
         {
             // replace the entire braces [{token}] with what it represents
             data.replace(beginToken, endToken + 2 - beginToken, it->second); // +2 to include the }] characters
@@ -240,7 +325,7 @@ HRESULT RegistryDevirtualizer::DetokenizeData(std::wstring& data)
 
         if (!foundToken)
         {
-            for (auto& pair : map)
+            for (auto& pair : m_tokens)
             {
                 if (token.find(pair.first) != std::wstring::npos)
                 {
@@ -279,33 +364,6 @@ HRESULT RegistryDevirtualizer::DetokenizeData(std::wstring& data)
     return S_OK;
 }
 
-HRESULT RegistryDevirtualizer::DevirtualizeValue(RegistryKey* realKey, PCWSTR name, std::vector<BYTE>& dataBuffer, DWORD dataLength, DWORD type)
-{
-    TraceLoggingWrite(g_MsixTraceLoggingProvider,
-        "Devirtualizing value info",
-        TraceLoggingValue(name, "value name"),
-        TraceLoggingValue(type, "valueType"));
-
-    DWORD actualType = (type & 0xff);
-    if (actualType == REG_NONE)
-    {
-        actualType = REG_SZ;
-    }
-
-    if (actualType == REG_SZ)
-    {
-        std::wstring dataWString = reinterpret_cast<PWSTR>(&dataBuffer[0]);
-        RETURN_IF_FAILED(DetokenizeData(dataWString));
-        RETURN_IF_FAILED(realKey->SetStringValue(name, dataWString));
-    }
-    else
-    {
-        RETURN_IF_FAILED(realKey->SetValue(name, reinterpret_cast<LPBYTE>(&dataBuffer[0]), dataLength, actualType));
-    }
-
-    return S_OK;
-}
-
 HRESULT RemoveSubKeyIfEmpty(RegistryKey* realKey, PCWSTR subKeyName)
 {
     // if there are no values left, try to delete the subkey
@@ -3,6 +3,7 @@
 #include "GeneralUtil.hpp"
 #include "MsixRequest.hpp"
 #include "RegistryKey.hpp"
+#include <map>
 #include <vector>
 #include "MsixRequest.hpp"
 
@@ -38,6 +39,31 @@ public:
     ~RegistryDevirtualizer();
 
 private:
+    /// A value of the loaded Registry.dat. After DetokenizeRegistryTree, type no longer has AppV flags and the
+    /// data of REG_SZ values is in stringData.
+    struct VirtualRegistryValue
+    {
+        std::wstring name;
+        DWORD type = REG_NONE;
+        std::vector<BYTE> data;
+        std::wstring stringData;
+    };
+
+    /// A key of the loaded Registry.dat with all its values and subkeys, read in memory.
+    struct VirtualRegistryTree
+    {
+        std::wstring name;
+        std::vector<VirtualRegistryValue> values;
+        std::vector<VirtualRegistryTree> subKeys;
+    };
+
+    /// Number of keys and values written to the actual registry.
+    struct RegistryTreeCounts
+    {
+        UINT32 keys = 0;
+        UINT32 values = 0;
+    };
+
     /// Determines if the registry key in question should not be written to the actual registry.
     /// Certain keys should not be written because they will be written by this installers.
     /// For instance, AddRemovePrograms will write an uninstall key, 
@@ -48,27 +74,35 @@ private:
     bool IsExcludeKey(RegistryKey * realKey);
 
     /// Recursively copy the registry tree from the loaded Registry.dat to the actual registry.
+    /// The tree is read in memory, detokenized, then written, and the time of each phase is logged.
     ///
     /// @param virtualKey - registry key from the loaded Registry.dat to copy from
     /// @param realKey - registry key in the actual registry to write to
     HRESULT CopyAndDevirtualizeRegistryTree(RegistryKey* virtualKey, RegistryKey* realKey);
 
+    /// Recursively reads the keys and values under a key of the loaded Registry.dat.
+    ///
+    /// @param virtualKey - registry key from the loaded Registry.dat to read
+    /// @param tree - receives the values and subkeys of virtualKey
+    HRESULT ReadRegistryTree(RegistryKey* virtualKey, VirtualRegistryTree& tree);
+
+    /// Detokenizes the names of the subkeys and values of the tree and the data of its string values.
+    HRESULT DetokenizeRegistryTree(VirtualRegistryTree& tree);
+
+    /// Recursively writes the subkeys and values of a detokenized tree to the actual registry.
+    ///
+    /// @param tree - the detokenized tree to write
+    /// @param realKey - registry key in the actual registry to write to
+    /// @param counts - incremented with the keys and values written
+    HRESULT WriteRegistryTree(const VirtualRegistryTree& tree, RegistryKey* realKey, RegistryTreeCounts& counts);
+
     /// Replaces the tokens with their real counterparts
     /// For instance, [{ProgramFilesX86}]\notepad\notepad.exe becomes c:\program files (x86)\notepad\notepad.exe
-    /// The tokens are based on the FilePathMappings 
+    /// The tokens are based on the FilePathMappings, copied once in m_tokens the first time a token is found.
     /// 
     /// @param data - the string to detokenize; this is the registry data to be written
     HRESULT DetokenizeData(std::wstring & data);
 
-    /// Writes the value to the actual key after detokenizing it if necessary
-    ///
-    /// @param realKey - registry key from actual registry to write the value to
-    /// @param name - registry value name, can be null for (default)
-    /// @param dataBuffer - registry data
-    /// @param dataLength - length of registry data
-    /// @param type - registry data type, which can have AppV flags.
-    HRESULT DevirtualizeValue(RegistryKey * realKey, PCWSTR name, std::vector<BYTE>& dataBuffer, DWORD dataLength, DWORD type);
-
     /// Recursively removes the data contained in the loaded Registry.dat from the actual registry.
     /// Remove counterpart of @see CopyAndDevirtualizeRegistryTree
     ///
@@ -90,5 +124,8 @@ private:
 
     RegistryKey m_rootKey;
     bool m_hiveFileNameExists = false;
+
+    /// Token to real path, see DetokenizeData
+    std::map<std::wstring, std::wstring> m_tokens;
 };
 }
\ No newline at end of file
@@ -0,0 +1,413 @@
+#include <windows.h>
+
+#include "RemotePackageStream.hpp"
+#include "GeneralUtil.hpp"
+#include <TraceLoggingProvider.h>
+#include "MsixTraceLoggingProvider.hpp"
+#include <algorithm>
+#include <vector>
+
+#pragma comment( lib, "wininet.lib" )
+
+using namespace MsixCoreLib;
+
+namespace
+{
+    /// Size of the reads from the connections.
+    const DWORD DownloadChunkSize = 64 * 1024;
+
+    /// A read at most this far ahead of the background download waits for it rather than fetching its range.
+    const UINT64 ReadAheadWindow = 4 * 1024 * 1024;
+
+    /// Smallest range fetched with a range request, the zip headers are read a few bytes at a time.
+    const UINT64 MinimumFetchSize = 256 * 1024;
+
+    HRESULT GetStatusCode(HINTERNET request, DWORD& statusCode)
+    {
+        DWORD size = sizeof(statusCode);
+        if (!HttpQueryInfoW(request, HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER, &statusCode, &size, nullptr))
+        {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+        return S_OK;
+    }
+
+    HRESULT GetHeader(HINTERNET request, DWORD header, std::wstring& value)
+    {
+        WCHAR buffer[64];
+        DWORD size = sizeof(buffer);
+        if (!HttpQueryInfoW(request, header, buffer, &size, nullptr))
+        {
+            return HRESULT_FROM_WIN32(GetLastError());
+        }
+        value = buffer;
+        return S_OK;
+    }
+}
+
+HRESULT RemotePackageStream::Make(const std::wstring& url, IStream** stream)
+{
+    auto cache = std::make_shared<RemotePackageCache>();
+    RETURN_IF_FAILED(cache->Initialize(url));
+
+    *stream = new RemotePackageStream(cache);
+    return S_OK;
+}
+
+HRESULT RemotePackageStream::QueryInterface(REFIID riid, void** object)
+{
+    if (object == nullptr)
+    {
+        return E_POINTER;
+    }
+    if (riid == __uuidof(IUnknown) || riid == __uuidof(ISequentialStream) || riid == __uuidof(IStream))
+    {
+        *object = static_cast<IStream*>(this);
+        AddRef();
+        return S_OK;
+    }
+    *object = nullptr;
+    return E_NOINTERFACE;
+}
+
+ULONG RemotePackageStream::AddRef()
+{
+    return ++m_refCount;
+}
+
+ULONG RemotePackageStream::Release()
+{
+    ULONG refCount = --m_refCount;
+    if (refCount == 0)
+    {
+        delete this;
+    }
+    return refCount;
+}
+
+HRESULT RemotePackageStream::Read(void* buffer, ULONG countBytes, ULONG* bytesRead)
+{
+    ULONG toRead = 0;
+    if (m_position < m_cache->GetSize())
+    {
+        toRead = static_cast<ULONG>(std::min<UINT64>(countBytes, m_cache->GetSize() - m_position));
+        RETURN_IF_FAILED(m_cache->Read(m_position, static_cast<BYTE*>(buffer), toRead));
+        m_position += toRead;
+    }
+    if (bytesRead != nullptr)
+    {
+        *bytesRead = toRead;
+    }
+    return S_OK;
+}
+
+HRESULT RemotePackageStream::Write(const void* buffer, ULONG countBytes, ULONG* bytesWritten)
+{
+    return STG_E_ACCESSDENIED;
+}
+
+HRESULT RemotePackageStream::Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition)
+{
+    LONGLONG position = 0;
+    switch (origin)
+    {
+    case STREAM_SEEK_SET: position = move.QuadPart; break;
+    case STREAM_SEEK_CUR: position = static_cast<LONGLONG>(m_position) + move.QuadPart; break;
+    case STREAM_SEEK_END: position = static_cast<LONGLONG>(m_cache->GetSize()) + move.QuadPart; break;
+    default: return STG_E_INVALIDFUNCTION;
+    }
+    if (position < 0)
+    {
+        return STG_E_INVALIDFUNCTION;
+    }
+
+    m_position = static_cast<UINT64>(position);
+    if (newPosition != nullptr)
+    {
+        newPosition->QuadPart = m_position;
+    }
+    return S_OK;
+}
+
+HRESULT RemotePackageStream::Stat(STATSTG* stat, DWORD flags)
+{
+    if (stat == nullptr)
+    {
+        return E_POINTER;
+    }
+    ZeroMemory(stat, sizeof(STATSTG));
+    stat->type = STGTY_STREAM;
+    stat->cbSize.QuadPart = m_cache->GetSize();
+    stat->grfMode = STGM_READ;
+    return S_OK;
+}
+
+HRESULT RemotePackageStream::Clone(IStream** stream)
+{
+    auto clone = new RemotePackageStream(m_cache);
+    clone->m_position = m_position;
+    *stream = clone;
+    return S_OK;
+}
+
+RemotePackageCache::~RemotePackageCache()
+{
+    m_stop = true;
+    if (m_download != nullptr)
+    {
+        // Closing the handle makes a pending InternetReadFile of the download fail
+        InternetCloseHandle(m_download);
+    }
+    if (m_downloadThread.joinable())
+    {
+        m_downloadThread.join();
+    }
+    if (m_internet != nullptr)
+    {
+        InternetCloseHandle(m_internet);
+    }
+    if (m_file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(m_file);
+    }
+}
+
+HRESULT RemotePackageCache::Initialize(const std::wstring& url)
+{
+    m_url = url;
+    m_internet = InternetOpenW(L"msixmgr", INTERNET_OPEN_TYPE_PRECONFIG, nullptr, nullptr, 0);
+    if (m_internet == nullptr)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    m_download = InternetOpenUrlW(m_internet, m_url.c_str(), nullptr, 0, INTERNET_FLAG_NO_CACHE_WRITE | INTERNET_FLAG_RELOAD, 0);
+    if (m_download == nullptr)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    DWORD statusCode = 0;
+    RETURN_IF_FAILED(GetStatusCode(m_download, statusCode));
+    if (statusCode != HTTP_STATUS_OK)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INTERNET_INVALID_URL);
+    }
+
+    // The package is read from its end first, which takes its size and range requests
+    std::wstring contentLength;
+    std::wstring acceptRanges;
+    if (FAILED(GetHeader(m_download, HTTP_QUERY_CONTENT_LENGTH, contentLength)) ||
+        FAILED(GetHeader(m_download, HTTP_QUERY_ACCEPT_RANGES, acceptRanges)) ||
+        _wcsicmp(acceptRanges.c_str(), L"bytes") != 0)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+    m_size = _wcstoui64(contentLength.c_str(), nullptr, 10);
+    if (m_size == 0)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    WCHAR tempPath[MAX_PATH];
+    WCHAR tempFileName[MAX_PATH];
+    if (GetTempPathW(MAX_PATH, tempPath) == 0 || GetTempFileNameW(tempPath, L"msx", 0, tempFileName) == 0)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    m_file = CreateFileW(tempFileName, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS,
+        FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    TraceLoggingWrite(g_MsixTraceLoggingProvider,
+        "Streaming package download",
+        TraceLoggingValue(m_url.c_str(), "Url"),
+        TraceLoggingValue(m_size, "Size"));
+
+    m_downloadThread = std::thread(&RemotePackageCache::Download, this);
+    return S_OK;
+}
+
+HRESULT RemotePackageCache::Read(UINT64 position, BYTE* buffer, ULONG countBytes)
+{
+    const UINT64 end = position + countBytes;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!HasRange(position, end))
+        {
+            if (!m_downloadDone && position < m_downloadPosition + ReadAheadWindow)
+            {
+                m_rangeAdded.wait(lock);
+                continue;
+            }
+
+            lock.unlock();
+            const UINT64 fetchEnd = std::min(m_size, std::max(end, position + MinimumFetchSize));
+            RETURN_IF_FAILED(FetchRange(position, fetchEnd));
+            lock.lock();
+        }
+    }
+
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = static_cast<DWORD>(position);
+    overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+    DWORD bytesRead = 0;
+    if (!ReadFile(m_file, buffer, countBytes, &bytesRead, &overlapped))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    if (bytesRead != countBytes)
+    {
+        return HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+    }
+    return S_OK;
+}
+
+void RemotePackageCache::Download()
+{
+    HRESULT hr = S_OK;
+    std::vector<BYTE> buffer(DownloadChunkSize);
+    UINT64 position = 0;
+    while (position < m_size && !m_stop)
+    {
+        {
+            // The end of the package is read first, the download is done once it reaches it
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (HasRange(position, m_size))
+            {
+                break;
+            }
+        }
+
+        DWORD bytesRead = 0;
+        if (!InternetReadFile(m_download, buffer.data(), DownloadChunkSize, &bytesRead))
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+            break;
+        }
+        if (bytesRead == 0)
+        {
+            break;
+        }
+        bytesRead = static_cast<DWORD>(std::min<UINT64>(bytesRead, m_size - position));
+
+        hr = WriteToFile(position, buffer.data(), bytesRead);
+        if (FAILED(hr))
+        {
+            break;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        AddRange(position, position + bytesRead);
+        position += bytesRead;
+        m_downloadPosition = position;
+        m_rangeAdded.notify_all();
+    }
+
+    if (FAILED(hr) && !m_stop)
+    {
+        // The reads left fetch their ranges
+        TraceLoggingWrite(g_MsixTraceLoggingProvider,
+            "Streaming package download stopped",
+            TraceLoggingLevel(WINEVENT_LEVEL_WARNING),
+            TraceLoggingValue(m_url.c_str(), "Url"),
+            TraceLoggingValue(position, "Position"),
+            TraceLoggingValue(hr, "HR"));
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_downloadDone = true;
+    m_rangeAdded.notify_all();
+}
+
+HRESULT RemotePackageCache::FetchRange(UINT64 start, UINT64 end)
+{
+    std::wstring rangeHeader = L"Range: bytes=" + std::to_wstring(start) + L"-" + std::to_wstring(end - 1) + L"\r\n";
+    HINTERNET request = InternetOpenUrlW(m_internet, m_url.c_str(), rangeHeader.c_str(), static_cast<DWORD>(-1),
+        INTERNET_FLAG_NO_CACHE_WRITE | INTERNET_FLAG_RELOAD, 0);
+    if (request == nullptr)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    HRESULT hr = S_OK;
+    DWORD statusCode = 0;
+    hr = GetStatusCode(request, statusCode);
+    if (SUCCEEDED(hr) && statusCode != HTTP_STATUS_PARTIAL_CONTENT)
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+    }
+
+    std::vector<BYTE> buffer(DownloadChunkSize);
+    UINT64 position = start;
+    while (SUCCEEDED(hr) && position < end)
+    {
+        DWORD bytesRead = 0;
+        if (!InternetReadFile(request, buffer.data(), DownloadChunkSize, &bytesRead))
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+            break;
+        }
+        if (bytesRead == 0)
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+            break;
+        }
+        bytesRead = static_cast<DWORD>(std::min<UINT64>(bytesRead, end - position));
+        hr = WriteToFile(position, buffer.data(), bytesRead);
+        position += bytesRead;
+    }
+    InternetCloseHandle(request);
+    RETURN_IF_FAILED(hr);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    AddRange(start, end);
+    m_rangeAdded.notify_all();
+    return S_OK;
+}
+
+HRESULT RemotePackageCache::WriteToFile(UINT64 position, const BYTE* buffer, DWORD countBytes)
+{
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = static_cast<DWORD>(position);
+    overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+    DWORD bytesWritten = 0;
+    if (!WriteFile(m_file, buffer, countBytes, &bytesWritten, &overlapped))
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+    return S_OK;
+}
+
+void RemotePackageCache::AddRange(UINT64 start, UINT64 end)
+{
+    // Merge with the ranges it overlaps or touches
+    auto range = m_ranges.upper_bound(start);
+    if (range != m_ranges.begin() && std::prev(range)->second >= start)
+    {
+        --range;
+        start = range->first;
+        end = std::max(end, range->second);
+        range = m_ranges.erase(range);
+    }
+    while (range != m_ranges.end() && range->first <= end)
+    {
+        end = std::max(end, range->second);
+        range = m_ranges.erase(range);
+    }
+    m_ranges[start] = end;
+}
+
+bool RemotePackageCache::HasRange(UINT64 start, UINT64 end) const
+{
+    auto range = m_ranges.upper_bound(start);
+    if (range == m_ranges.begin())
+    {
+        return false;
+    }
+    --range;
+    return range->second >= end;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "GeneralUtil.hpp"
+#include <wininet.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+
+namespace MsixCoreLib
+{
+    class RemotePackageCache;
+
+    /// Stream over a package being downloaded, so the package can be read while it downloads.
+    /// The package is downloaded from start to end in the background into a temporary file. A read of bytes the
+    /// download is about to reach waits for them, a read further away (the central directory and the footprint
+    /// files, which are at the end of the package and read first) fetches its range with an HTTP range request.
+    /// Clones share the downloaded bytes.
+    class RemotePackageStream : public IStream
+    {
+    public:
+        /// Starts downloading a package.
+        ///
+        /// @param url - the http(s) url of the package
+        /// @param stream - the stream over the package
+        /// @return failure if the server doesn't give the size of the package or doesn't take range requests, in
+        ///         which case the package has to be downloaded before being read.
+        static HRESULT Make(const std::wstring& url, IStream** stream);
+
+        // IUnknown
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** object) override;
+        ULONG STDMETHODCALLTYPE AddRef() override;
+        ULONG STDMETHODCALLTYPE Release() override;
+
+        // ISequentialStream
+        HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) override;
+        HRESULT STDMETHODCALLTYPE Write(const void* buffer, ULONG countBytes, ULONG* bytesWritten) override;
+
+        // IStream
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) override;
+        HRESULT STDMETHODCALLTYPE SetSize(ULARGE_INTEGER) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE CopyTo(IStream*, ULARGE_INTEGER, ULARGE_INTEGER*, ULARGE_INTEGER*) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE Commit(DWORD) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE Revert() override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE LockRegion(ULARGE_INTEGER, ULARGE_INTEGER, DWORD) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE UnlockRegion(ULARGE_INTEGER, ULARGE_INTEGER, DWORD) override { return E_NOTIMPL; }
+        HRESULT STDMETHODCALLTYPE Stat(STATSTG* stat, DWORD flags) override;
+        HRESULT STDMETHODCALLTYPE Clone(IStream** stream) override;
+
+    private:
+        RemotePackageStream(const std::shared_ptr<RemotePackageCache>& cache) : m_cache(cache) {}
+        ~RemotePackageStream() {}
+
+        std::atomic<ULONG> m_refCount{ 1 };
+        std::shared_ptr<RemotePackageCache> m_cache;
+        UINT64 m_position = 0;
+    };
+
+    /// The downloaded bytes of a package, shared by the streams over it.
+    class RemotePackageCache
+    {
+    public:
+        ~RemotePackageCache();
+
+        /// Connects to the server and starts the background download.
+        HRESULT Initialize(const std::wstring& url);
+
+        UINT64 GetSize() const { return m_size; }
+
+        /// Reads bytes of the package, waiting for or fetching them if they aren't downloaded yet.
+        HRESULT Read(UINT64 position, BYTE* buffer, ULONG countBytes);
+
+    private:
+        /// Downloads the package from its start, until it reaches the range already fetched at its end.
+        void Download();
+
+        /// Fetches a range of the package with a range request.
+        HRESULT FetchRange(UINT64 start, UINT64 end);
+
+        /// Writes downloaded bytes to the temporary file.
+        HRESULT WriteToFile(UINT64 position, const BYTE* buffer, DWORD countBytes);
+
+        /// Records a downloaded range, merging it with its neighbours. m_mutex must be held.
+        void AddRange(UINT64 start, UINT64 end);
+
+        /// Whether a range is downloaded. m_mutex must be held.
+        bool HasRange(UINT64 start, UINT64 end) const;
+
+        std::wstring m_url;
+        UINT64 m_size = 0;
+        HINTERNET m_internet = nullptr;
+        HINTERNET m_download = nullptr;
+        HANDLE m_file = INVALID_HANDLE_VALUE;
+
+        std::mutex m_mutex;
+        std::condition_variable m_rangeAdded;
+        // Downloaded ranges, [start, end) by start
+        std::map<UINT64, UINT64> m_ranges;
+        // Where the background download is
+        UINT64 m_downloadPosition = 0;
+        bool m_downloadDone = false;
+        std::atomic<bool> m_stop{ false };
+        std::thread m_downloadThread;
+    };
+}
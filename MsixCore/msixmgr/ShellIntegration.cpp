@@ -0,0 +1,127 @@
+#include <windows.h>
+#include <shlobj_core.h>
+
+#include "ShellIntegration.hpp"
+#include "GeneralUtil.hpp"
+#include <TraceLoggingProvider.h>
+#include "MsixTraceLoggingProvider.hpp"
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "StartMenuLink.hpp"
+#include "Protocol.hpp"
+#include "FileTypeAssociation.hpp"
+#include "FirewallRules.hpp"
+#include "AutoPlay.hpp"
+#include "AppExecutionAlias.hpp"
+
+using namespace MsixCoreLib;
+
+const PCWSTR ShellIntegration::HandlerName = L"ShellIntegration";
+
+namespace
+{
+    struct ShellIntegrationHandlerInfo
+    {
+        PCWSTR name;
+        CreateHandler create;
+    };
+
+    const ShellIntegrationHandlerInfo ShellIntegrationHandlers[] =
+    {
+        {StartMenuLink::HandlerName,        StartMenuLink::CreateHandler},
+        {Protocol::HandlerName,             Protocol::CreateHandler},
+        {FileTypeAssociation::HandlerName,  FileTypeAssociation::CreateHandler},
+        {FirewallRules::HandlerName,        FirewallRules::CreateHandler},
+        {AutoPlay::HandlerName,             AutoPlay::CreateHandler},
+        {AppExecutionAlias::HandlerName,    AppExecutionAlias::CreateHandler},
+    };
+
+    /// Executes a handler on the current thread, which has COM initialized for it.
+    HRESULT ExecuteHandler(IPackageHandler* handler, bool add)
+    {
+        AutoCoInitialize coInit;
+        RETURN_IF_FAILED(coInit.Initialize());
+        return add ? handler->ExecuteForAddRequest() : handler->ExecuteForRemoveRequest();
+    }
+}
+
+HRESULT ShellIntegration::ExecuteForAddRequest()
+{
+    RETURN_IF_FAILED(ExecuteHandlers(true));
+    return S_OK;
+}
+
+HRESULT ShellIntegration::ExecuteForRemoveRequest()
+{
+    RETURN_IF_FAILED(ExecuteHandlers(false));
+    return S_OK;
+}
+
+HRESULT ShellIntegration::ExecuteHandlers(bool add)
+{
+    const size_t handlerCount = ARRAYSIZE(ShellIntegrationHandlers);
+    std::vector<std::unique_ptr<IPackageHandler>> handlers(handlerCount);
+    std::vector<HRESULT> results(handlerCount, S_OK);
+    std::vector<long long> durations(handlerCount, 0);
+
+    // The handlers read the manifest when created, which is done on this thread only
+    for (size_t i = 0; i < handlerCount; i++)
+    {
+        IPackageHandler* handler = nullptr;
+        results[i] = ShellIntegrationHandlers[i].create(m_msixRequest, &handler);
+        handlers[i].reset(handler);
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < handlerCount; i++)
+    {
+        if (SUCCEEDED(results[i]))
+        {
+            threads.emplace_back([&, i]()
+            {
+                auto start = std::chrono::steady_clock::now();
+                results[i] = ExecuteHandler(handlers[i].get(), add);
+                durations[i] = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+            });
+        }
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    // One notification for all the associations the handlers changed
+    SHChangeNotify(SHCNE_ASSOCCHANGED, SHCNF_IDLIST | SHCNF_FLUSHNOWAIT, nullptr, nullptr);
+
+    HRESULT hr = S_OK;
+    for (size_t i = 0; i < handlerCount; i++)
+    {
+        TraceLoggingWrite(g_MsixTraceLoggingProvider,
+            "Shell integration handler completed",
+            TraceLoggingValue(ShellIntegrationHandlers[i].name, "HandlerName"),
+            TraceLoggingValue(durations[i], "DurationMs"),
+            TraceLoggingValue(results[i], "HR"));
+
+        if (FAILED(results[i]) && SUCCEEDED(hr))
+        {
+            hr = results[i];
+        }
+    }
+    return hr;
+}
+
+HRESULT ShellIntegration::CreateHandler(MsixRequest * msixRequest, IPackageHandler ** instance)
+{
+    std::unique_ptr<ShellIntegration> localInstance(new ShellIntegration(msixRequest));
+    if (localInstance == nullptr)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    *instance = localInstance.release();
+
+    return S_OK;
+}
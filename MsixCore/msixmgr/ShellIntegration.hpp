@@ -0,0 +1,36 @@
+#pragma once
+
+#include "GeneralUtil.hpp"
+#include "IPackageHandler.hpp"
+#include "MsixRequest.hpp"
+
+namespace MsixCoreLib
+{
+    /// Handles the shell integration of a package: the start menu link, file type associations, protocols, autoplay
+    /// handlers, firewall rules and app execution aliases.
+    /// These handlers don't depend on each other, so they are created one after the other (creating them reads the
+    /// manifest) and then executed in parallel, each on its own thread. The shell is notified of the changed
+    /// associations once they are all done.
+    class ShellIntegration : IPackageHandler
+    {
+    public:
+        HRESULT ExecuteForAddRequest();
+
+        HRESULT ExecuteForRemoveRequest();
+
+        static const PCWSTR HandlerName;
+        static HRESULT CreateHandler(_In_ MsixRequest* msixRequest, _Out_ IPackageHandler** instance);
+        ~ShellIntegration() {}
+    private:
+        MsixRequest * m_msixRequest = nullptr;
+
+        ShellIntegration() {}
+        ShellIntegration(_In_ MsixRequest* msixRequest) : m_msixRequest(msixRequest) {}
+
+        /// Executes the shell integration handlers.
+        ///
+        /// @param add - true for an add request, false for a remove request
+        /// @return the first failure of the handlers, after they have all run
+        HRESULT ExecuteHandlers(bool add);
+    };
+}
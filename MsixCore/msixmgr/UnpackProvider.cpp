@@ -7,9 +7,14 @@
 #include "..\msixmgrLib\GeneralUtil.hpp"
 #include <shlobj_core.h>
 #include <CommCtrl.h>
+#include <algorithm>
+#include <atomic>
 #include <map>
+#include <mutex>
+#include <set>
 #include <iostream>
 #include <filesystem>
+#include <thread>
 #include "MsixErrors.hpp"
 
 using namespace MsixCoreLib;
@@ -30,6 +35,7 @@ namespace MsixCoreLib
     //  - This function swallows errors from unpacking individual packages and bundles and adds
     //    the file paths of these packages/bundles to the failedPackages vector and adds the
     //    error code to the failedPackagesErrors vectors
+    //  - parallelCount is how many packages of a source directory are unpacked at the same time
     HRESULT Unpack(
         _In_ std::wstring source,
         _In_ std::wstring destination,
@@ -37,7 +43,8 @@ namespace MsixCoreLib
         _In_ bool validateSignature,
         _Inout_ std::vector<std::wstring> &skippedFiles,
         _Inout_ std::vector<std::wstring> &failedPackages,
-        _Inout_ std::vector<HRESULT> &failedPackagesErrors)
+        _Inout_ std::vector<HRESULT> &failedPackagesErrors,
+        _In_ unsigned int parallelCount)
     {
         filesystem::path sourcePath(source);
         bool isDirectory = filesystem::is_directory(sourcePath);
@@ -50,7 +57,8 @@ namespace MsixCoreLib
                 validateSignature,
                 skippedFiles,
                 failedPackages,
-                failedPackagesErrors));
+                failedPackagesErrors,
+                parallelCount));
         }
         else
         {
@@ -76,6 +84,8 @@ namespace MsixCoreLib
     //   vector at the corresponding index. 
     // - This function swallows errors from failing to unpack individual packages and should return
     //   S_OK in almost all cases, except when the given source path is not the path to a directory
+    // - Up to parallelCount packages are unpacked at the same time, each on its own thread. The failures
+    //   are reported in the order of the packages in the directory whatever order they finish in.
     HRESULT UnpackPackagesFromDirectory(
         _In_ std::wstring source,
         _In_ std::wstring destination,
@@ -83,31 +93,60 @@ namespace MsixCoreLib
         _In_ bool validateSignature,
         _Inout_ std::vector<std::wstring> &skippedFiles,
         _Inout_ std::vector<std::wstring> &failedPackages,
-        _Inout_ std::vector<HRESULT> &failedPackagesErrors)
+        _Inout_ std::vector<HRESULT> &failedPackagesErrors,
+        _In_ unsigned int parallelCount)
     {
         if (!filesystem::is_directory(filesystem::path(source)))
         {
             return E_INVALIDARG;
         }
 
+        std::vector<std::wstring> packages;
         for (const auto& entry : filesystem::directory_iterator(source))
         {
             auto fullFilePath = entry.path().wstring();
             if (entry.is_regular_file())
             {
-                // Swallow the error and add to list of failed packages and their associated errors
-                HRESULT hrUnpack = UnpackPackageOrBundle(fullFilePath, destination, isApplyACLs, validateSignature);
-                if (FAILED(hrUnpack))
-                {
-                    failedPackages.push_back(fullFilePath);
-                    failedPackagesErrors.push_back(hrUnpack);
-                }
+                packages.push_back(fullFilePath);
             }
             else
             {
                 skippedFiles.push_back(fullFilePath);
             }
         }
+
+        // Each worker takes the next package until there are none left
+        std::vector<HRESULT> results(packages.size(), S_OK);
+        std::atomic<size_t> next(0);
+        auto worker = [&]()
+        {
+            for (size_t index = next++; index < packages.size(); index = next++)
+            {
+                results[index] = UnpackPackageOrBundle(packages[index], destination, isApplyACLs, validateSignature);
+            }
+        };
+
+        size_t workerCount = (std::min)(static_cast<size_t>((std::max)(parallelCount, 1u)), packages.size());
+        std::vector<std::thread> helpers;
+        for (size_t i = 1; i < workerCount; i++)
+        {
+            helpers.emplace_back(worker);
+        }
+        worker();
+        for (auto& helper : helpers)
+        {
+            helper.join();
+        }
+
+        // Swallow the errors and add to list of failed packages and their associated errors
+        for (size_t index = 0; index < packages.size(); index++)
+        {
+            if (FAILED(results[index]))
+            {
+                failedPackages.push_back(packages[index]);
+                failedPackagesErrors.push_back(results[index]);
+            }
+        }
         return S_OK;
     }
 
@@ -117,24 +156,26 @@ namespace MsixCoreLib
         _In_ bool isApplyACLs,
         _In_ bool validateSignature)
     {
-        HRESULT hr = S_OK;
-        if (IsPackageFile(source))
-        {
-            hr = MsixCoreLib::UnpackPackage(source, destination, isApplyACLs, validateSignature);
-        }
-        else if (IsBundleFile(source))
-        {
-            hr = MsixCoreLib::UnpackBundle(source, destination, isApplyACLs, validateSignature);
-        }
-        else
+        // The source is opened once and told apart from its contents, whatever its extension
+        ComPtr<IStream> stream;
+        RETURN_IF_FAILED(CreateStreamOnFileUTF16(source.c_str(), true, &stream));
+
+        MSIX_CONTAINER_FORMAT format = MSIX_CONTAINER_FORMAT_UNKNOWN;
+        RETURN_IF_FAILED(GetContainerFormatFromStream(stream.Get(), &format));
+
+        switch (format)
         {
+        case MSIX_CONTAINER_FORMAT_PACKAGE:
+            return MsixCoreLib::UnpackPackage(stream.Get(), destination, isApplyACLs, validateSignature);
+        case MSIX_CONTAINER_FORMAT_BUNDLE:
+            return MsixCoreLib::UnpackBundle(stream.Get(), destination, isApplyACLs, validateSignature);
+        default:
             return E_INVALIDARG;
         }
-        return hr;
     }
 
     HRESULT UnpackPackage(
-        _In_ std::wstring packageFilePath,
+        _In_ IStream* stream,
         _In_ std::wstring destination,
         _In_ bool isApplyACLs,
         _In_ bool validateSignature)
@@ -148,11 +189,8 @@ namespace MsixCoreLib
         ComPtr<IAppxFactory> factory;
         RETURN_IF_FAILED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, validationOption, &factory));
 
-        ComPtr<IStream> stream;
-        RETURN_IF_FAILED(CreateStreamOnFileUTF16(packageFilePath.c_str(), true, &stream));
-
         ComPtr<IAppxPackageReader> reader;
-        RETURN_IF_FAILED(factory->CreatePackageReader(stream.Get(), &reader));
+        RETURN_IF_FAILED(factory->CreatePackageReader(stream, &reader));
 
         RETURN_IF_FAILED(UnpackPackageFromPackageReader(
             unpackOption,
@@ -184,7 +222,7 @@ namespace MsixCoreLib
     }
 
     HRESULT UnpackBundle(
-        _In_ std::wstring packageFilePath,
+        _In_ IStream* stream,
         _In_ std::wstring destination,
         _In_ bool isApplyACLs,
         _In_ bool validateSignature)
@@ -199,11 +237,8 @@ namespace MsixCoreLib
         ComPtr<IAppxBundleFactory> factory;
         RETURN_IF_FAILED(CoCreateAppxBundleFactoryWithHeap(MyAllocate, MyFree, validationOption, applicabilityOption, &factory));
 
-        ComPtr<IStream> stream;
-        RETURN_IF_FAILED(CreateStreamOnFileUTF16(packageFilePath.c_str(), true, &stream));
-
         ComPtr<IAppxBundleReader> reader;
-        RETURN_IF_FAILED(factory->CreateBundleReader(stream.Get(), &reader));
+        RETURN_IF_FAILED(factory->CreateBundleReader(stream, &reader));
 
         RETURN_IF_FAILED(UnpackBundleFromBundleReader(
             unpackOption,
@@ -330,10 +365,462 @@ namespace MsixCoreLib
         return S_OK;
     }
 
+    // Purpose:
+    // - Unpacks either a single package/bundle or multiple packages/bundles from a specified
+    //   source directory straight into a new CIM file, under rootDirectory.
+    //
+    // Notes:
+    //  - The files are streamed from the packages into the image, unlike CreateAndAddToCIM they
+    //    are not unpacked to a temporary directory first. The layout in the image is the same as
+    //    the one Unpack creates in a directory.
+    //  - skippedFiles, failedPackages and failedPackagesErrors are populated as by Unpack. The CIM
+    //    is committed as long as the image itself could be written.
+    HRESULT UnpackToCIM(
+        _In_ std::wstring source,
+        _In_ std::wstring cimFilePath,
+        _In_ std::wstring rootDirectory,
+        _In_ bool validateSignature,
+        _Inout_ std::vector<std::wstring> &skippedFiles,
+        _Inout_ std::vector<std::wstring> &failedPackages,
+        _Inout_ std::vector<HRESULT> &failedPackagesErrors)
+    {
+        // Paths in the image are relative to its root
+        size_t rootStart = rootDirectory.find_first_not_of(L"\\/");
+        size_t rootEnd = rootDirectory.find_last_not_of(L"\\/");
+        rootDirectory = (rootStart == std::wstring::npos) ? std::wstring() : rootDirectory.substr(rootStart, rootEnd - rootStart + 1);
+
+        CIMWriter writer;
+        RETURN_IF_FAILED(writer.Create(cimFilePath));
+
+        std::vector<std::wstring> packages;
+        if (filesystem::is_directory(filesystem::path(source)))
+        {
+            for (const auto& entry : filesystem::directory_iterator(source))
+            {
+                if (entry.is_regular_file())
+                {
+                    packages.push_back(entry.path().wstring());
+                }
+                else
+                {
+                    skippedFiles.push_back(entry.path().wstring());
+                }
+            }
+        }
+        else
+        {
+            packages.push_back(source);
+        }
+
+        for (const auto& package : packages)
+        {
+            // Swallow the error and add to list of failed packages and their associated errors
+            HRESULT hrUnpack = UnpackPackageOrBundleToCIM(package, writer, rootDirectory, validateSignature);
+            if (FAILED(hrUnpack))
+            {
+                failedPackages.push_back(package);
+                failedPackagesErrors.push_back(hrUnpack);
+            }
+        }
+
+        RETURN_IF_FAILED(writer.Commit());
+        return S_OK;
+    }
+
+    HRESULT UnpackPackageOrBundleToCIM(
+        _In_ std::wstring source,
+        _In_ CIMWriter& writer,
+        _In_ std::wstring rootDirectory,
+        _In_ bool validateSignature)
+    {
+        ComPtr<IStream> stream;
+        RETURN_IF_FAILED(CreateStreamOnFileUTF16(source.c_str(), true, &stream));
+
+        MSIX_CONTAINER_FORMAT format = MSIX_CONTAINER_FORMAT_UNKNOWN;
+        RETURN_IF_FAILED(GetContainerFormatFromStream(stream.Get(), &format));
+
+        switch (format)
+        {
+        case MSIX_CONTAINER_FORMAT_PACKAGE:
+            return MsixCoreLib::UnpackPackageToCIM(stream.Get(), writer, rootDirectory, validateSignature);
+        case MSIX_CONTAINER_FORMAT_BUNDLE:
+            return MsixCoreLib::UnpackBundleToCIM(stream.Get(), writer, rootDirectory, validateSignature);
+        default:
+            return E_INVALIDARG;
+        }
+    }
+
+    HRESULT UnpackPackageToCIM(
+        _In_ IStream* stream,
+        _In_ CIMWriter& writer,
+        _In_ std::wstring rootDirectory,
+        _In_ bool validateSignature)
+    {
+        MSIX_VALIDATION_OPTION validationOption = validateSignature ? MSIX_VALIDATION_OPTION_FULL : MSIX_VALIDATION_OPTION_SKIPSIGNATURE;
+
+        ComPtr<IAppxFactory> factory;
+        RETURN_IF_FAILED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, validationOption, &factory));
+
+        ComPtr<IAppxPackageReader> reader;
+        RETURN_IF_FAILED(factory->CreatePackageReader(stream, &reader));
+
+        ComPtr<IAppxManifestReader> manifestReader;
+        RETURN_IF_FAILED(reader->GetManifest(&manifestReader));
+
+        ComPtr<IAppxManifestPackageId> packageId;
+        RETURN_IF_FAILED(manifestReader->GetPackageId(&packageId));
+
+        Text<WCHAR> packageFullName;
+        RETURN_IF_FAILED(packageId->GetPackageFullName(&packageFullName));
+
+        std::wstring packageFolder = rootDirectory.empty() ? packageFullName.Get() : rootDirectory + L"\\" + packageFullName.Get();
+        RETURN_IF_FAILED(AddPackageFilesToCIM(reader.Get(), writer, packageFolder));
+
+        RETURN_IF_FAILED(OutputPackageDependencies(manifestReader.Get(), packageFullName.content));
+
+        return S_OK;
+    }
+
+    HRESULT UnpackBundleToCIM(
+        _In_ IStream* stream,
+        _In_ CIMWriter& writer,
+        _In_ std::wstring rootDirectory,
+        _In_ bool validateSignature)
+    {
+        MSIX_APPLICABILITY_OPTIONS applicabilityOption = static_cast<MSIX_APPLICABILITY_OPTIONS>(MSIX_APPLICABILITY_NONE);
+        MSIX_VALIDATION_OPTION validationOption = validateSignature ? MSIX_VALIDATION_OPTION_FULL : MSIX_VALIDATION_OPTION_SKIPSIGNATURE;
+
+        ComPtr<IAppxBundleFactory> bundleFactory;
+        RETURN_IF_FAILED(CoCreateAppxBundleFactoryWithHeap(MyAllocate, MyFree, validationOption, applicabilityOption, &bundleFactory));
+
+        ComPtr<IAppxBundleReader> reader;
+        RETURN_IF_FAILED(bundleFactory->CreateBundleReader(stream, &reader));
+
+        ComPtr<IAppxBundleManifestReader> bundleManifestReader;
+        RETURN_IF_FAILED(reader->GetManifest(&bundleManifestReader));
+
+        // The footprint files of the bundle go to a folder named after the bundle and each package to a
+        // folder named after the package next to it, as UnpackBundle does with a flat structure.
+        Text<WCHAR> bundleFullName;
+        ComPtr<IAppxManifestPackageId> bundleId;
+        RETURN_IF_FAILED(bundleManifestReader->GetPackageId(&bundleId));
+        RETURN_IF_FAILED(bundleId->GetPackageFullName(&bundleFullName));
+
+        std::wstring bundleFolder = rootDirectory.empty() ? bundleFullName.Get() : rootDirectory + L"\\" + bundleFullName.Get();
+        for (int type = APPX_BUNDLE_FOOTPRINT_FILE_TYPE_FIRST; type <= APPX_BUNDLE_FOOTPRINT_FILE_TYPE_LAST; type++)
+        {
+            ComPtr<IAppxFile> footprintFile;
+            HRESULT hrFootprint = reader->GetFootprintFile(static_cast<APPX_BUNDLE_FOOTPRINT_FILE_TYPE>(type), &footprintFile);
+            if (hrFootprint == static_cast<HRESULT>(MSIX::Error::FileNotFound))
+            {
+                continue;
+            }
+            RETURN_IF_FAILED(hrFootprint);
+            RETURN_IF_FAILED(AddFileToCIM(footprintFile.Get(), writer, bundleFolder));
+        }
+
+        // The dependencies of the first application package of the bundle are output, as UnpackBundle does
+        std::map<std::wstring, APPX_BUNDLE_PAYLOAD_PACKAGE_TYPE> packageTypes;
+        ComPtr<IAppxBundleManifestPackageInfoEnumerator> packageInfoItems;
+        RETURN_IF_FAILED(bundleManifestReader->GetPackageInfoItems(&packageInfoItems));
+        BOOL hasCurrent = FALSE;
+        for (packageInfoItems->GetHasCurrent(&hasCurrent); hasCurrent; packageInfoItems->MoveNext(&hasCurrent))
+        {
+            ComPtr<IAppxBundleManifestPackageInfo> packageInfo;
+            RETURN_IF_FAILED(packageInfoItems->GetCurrent(&packageInfo));
+
+            Text<WCHAR> packageFileName;
+            RETURN_IF_FAILED(packageInfo->GetFileName(&packageFileName));
+
+            APPX_BUNDLE_PAYLOAD_PACKAGE_TYPE packageType;
+            RETURN_IF_FAILED(packageInfo->GetPackageType(&packageType));
+            packageTypes[packageFileName.Get()] = packageType;
+        }
+
+        ComPtr<IAppxFactory> factory;
+        RETURN_IF_FAILED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, validationOption, &factory));
+
+        bool dependenciesOutput = false;
+        ComPtr<IAppxFilesEnumerator> packageFiles;
+        RETURN_IF_FAILED(reader->GetPayloadPackages(&packageFiles));
+        RETURN_IF_FAILED(packageFiles->GetHasCurrent(&hasCurrent));
+        while (hasCurrent)
+        {
+            ComPtr<IAppxFile> packageFile;
+            RETURN_IF_FAILED(packageFiles->GetCurrent(&packageFile));
+
+            Text<WCHAR> packageFileName;
+            RETURN_IF_FAILED(packageFile->GetName(&packageFileName));
+
+            ComPtr<IStream> packageStream;
+            RETURN_IF_FAILED(packageFile->GetStream(&packageStream));
+
+            ComPtr<IAppxPackageReader> packageReader;
+            RETURN_IF_FAILED(factory->CreatePackageReader(packageStream.Get(), &packageReader));
+
+            ComPtr<IAppxManifestReader> manifestReader;
+            RETURN_IF_FAILED(packageReader->GetManifest(&manifestReader));
+
+            ComPtr<IAppxManifestPackageId> packageId;
+            RETURN_IF_FAILED(manifestReader->GetPackageId(&packageId));
+
+            Text<WCHAR> packageFullName;
+            RETURN_IF_FAILED(packageId->GetPackageFullName(&packageFullName));
+
+            std::wstring packageFolder = rootDirectory.empty() ? packageFullName.Get() : rootDirectory + L"\\" + packageFullName.Get();
+            RETURN_IF_FAILED(AddPackageFilesToCIM(packageReader.Get(), writer, packageFolder));
+
+            if (!dependenciesOutput && packageTypes[packageFileName.Get()] == APPX_BUNDLE_PAYLOAD_PACKAGE_TYPE_APPLICATION)
+            {
+                RETURN_IF_FAILED(OutputPackageDependencies(manifestReader.Get(), packageFullName.content));
+                dependenciesOutput = true;
+            }
+
+            RETURN_IF_FAILED(packageFiles->MoveNext(&hasCurrent));
+        }
+
+        return S_OK;
+    }
+
+    // Adds the footprint and payload files of a package to the CIM, in packageFolder
+    HRESULT AddPackageFilesToCIM(
+        _In_ IAppxPackageReader* reader,
+        _In_ CIMWriter& writer,
+        _In_ std::wstring packageFolder)
+    {
+        const APPX_FOOTPRINT_FILE_TYPE footprintTypes[] =
+        {
+            APPX_FOOTPRINT_FILE_TYPE_MANIFEST,
+            APPX_FOOTPRINT_FILE_TYPE_BLOCKMAP,
+            APPX_FOOTPRINT_FILE_TYPE_SIGNATURE,
+            APPX_FOOTPRINT_FILE_TYPE_CODEINTEGRITY,
+        };
+        for (auto type : footprintTypes)
+        {
+            // The signature and the code integrity catalog are optional
+            ComPtr<IAppxFile> footprintFile;
+            HRESULT hrFootprint = reader->GetFootprintFile(type, &footprintFile);
+            if (hrFootprint == static_cast<HRESULT>(MSIX::Error::FileNotFound))
+            {
+                continue;
+            }
+            RETURN_IF_FAILED(hrFootprint);
+            RETURN_IF_FAILED(AddFileToCIM(footprintFile.Get(), writer, packageFolder));
+        }
+
+        ComPtr<IAppxFilesEnumerator> payloadFiles;
+        RETURN_IF_FAILED(reader->GetPayloadFiles(&payloadFiles));
+        BOOL hasCurrent = FALSE;
+        RETURN_IF_FAILED(payloadFiles->GetHasCurrent(&hasCurrent));
+        while (hasCurrent)
+        {
+            ComPtr<IAppxFile> payloadFile;
+            RETURN_IF_FAILED(payloadFiles->GetCurrent(&payloadFile));
+            RETURN_IF_FAILED(AddFileToCIM(payloadFile.Get(), writer, packageFolder));
+            RETURN_IF_FAILED(payloadFiles->MoveNext(&hasCurrent));
+        }
+
+        return S_OK;
+    }
+
+    HRESULT AddFileToCIM(
+        _In_ IAppxFile* file,
+        _In_ CIMWriter& writer,
+        _In_ std::wstring packageFolder)
+    {
+        Text<WCHAR> fileName;
+        RETURN_IF_FAILED(file->GetName(&fileName));
+
+        UINT64 size = 0;
+        RETURN_IF_FAILED(file->GetSize(&size));
+
+        ComPtr<IStream> stream;
+        RETURN_IF_FAILED(file->GetStream(&stream));
+
+        RETURN_IF_FAILED(writer.AddFile(packageFolder + L"\\" + fileName.Get(), stream.Get(), size));
+
+        return S_OK;
+    }
+
+    // Purpose:
+    // - Computes the space the packages/bundles of source take once unpacked, from their block maps,
+    //   without unpacking them.
+    //
+    // Notes:
+    //  - The files listed in a block map are the ones unpacked from the package, with their
+    //    uncompressed sizes. The block map and the signature are not listed in it and are added
+    //    from their footprint files.
+    //  - Files in a source directory that are not packages or bundles are ignored, as Unpack does.
+    HRESULT GetUnpackedSize(
+        _In_ std::wstring source,
+        _In_ ULONGLONG clusterSize,
+        _Inout_ UnpackedSize& unpackedSize)
+    {
+        std::vector<std::wstring> packages;
+        if (filesystem::is_directory(filesystem::path(source)))
+        {
+            for (const auto& entry : filesystem::directory_iterator(source))
+            {
+                if (entry.is_regular_file())
+                {
+                    packages.push_back(entry.path().wstring());
+                }
+            }
+        }
+        else
+        {
+            packages.push_back(source);
+        }
+
+        auto addFileSize = [&](IAppxFile* file)
+        {
+            UINT64 size = 0;
+            RETURN_IF_FAILED(file->GetSize(&size));
+            unpackedSize.fileCount++;
+            unpackedSize.allocatedBytes += (size + clusterSize - 1) / clusterSize * clusterSize;
+            return S_OK;
+        };
+
+        for (const auto& package : packages)
+        {
+            ComPtr<IStream> stream;
+            if (IsPackageFile(package))
+            {
+                ComPtr<IAppxFactory> factory;
+                RETURN_IF_FAILED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+                RETURN_IF_FAILED(CreateStreamOnFileUTF16(package.c_str(), true, &stream));
+
+                ComPtr<IAppxPackageReader> reader;
+                RETURN_IF_FAILED(factory->CreatePackageReader(stream.Get(), &reader));
+                RETURN_IF_FAILED(AddPackageToUnpackedSize(reader.Get(), clusterSize, unpackedSize));
+            }
+            else if (IsBundleFile(package))
+            {
+                MSIX_APPLICABILITY_OPTIONS applicabilityOption = static_cast<MSIX_APPLICABILITY_OPTIONS>(MSIX_APPLICABILITY_NONE);
+                ComPtr<IAppxBundleFactory> bundleFactory;
+                RETURN_IF_FAILED(CoCreateAppxBundleFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, applicabilityOption, &bundleFactory));
+                RETURN_IF_FAILED(CreateStreamOnFileUTF16(package.c_str(), true, &stream));
+
+                ComPtr<IAppxBundleReader> bundleReader;
+                RETURN_IF_FAILED(bundleFactory->CreateBundleReader(stream.Get(), &bundleReader));
+
+                // The folder of the bundle, with its footprint files
+                unpackedSize.directoryCount += 2;
+                for (int type = APPX_BUNDLE_FOOTPRINT_FILE_TYPE_FIRST; type <= APPX_BUNDLE_FOOTPRINT_FILE_TYPE_LAST; type++)
+                {
+                    ComPtr<IAppxFile> footprintFile;
+                    HRESULT hrFootprint = bundleReader->GetFootprintFile(static_cast<APPX_BUNDLE_FOOTPRINT_FILE_TYPE>(type), &footprintFile);
+                    if (hrFootprint == static_cast<HRESULT>(MSIX::Error::FileNotFound))
+                    {
+                        continue;
+                    }
+                    RETURN_IF_FAILED(hrFootprint);
+                    RETURN_IF_FAILED(addFileSize(footprintFile.Get()));
+                }
+
+                ComPtr<IAppxFactory> factory;
+                RETURN_IF_FAILED(CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+
+                ComPtr<IAppxFilesEnumerator> packageFiles;
+                RETURN_IF_FAILED(bundleReader->GetPayloadPackages(&packageFiles));
+                BOOL hasCurrent = FALSE;
+                RETURN_IF_FAILED(packageFiles->GetHasCurrent(&hasCurrent));
+                while (hasCurrent)
+                {
+                    ComPtr<IAppxFile> packageFile;
+                    RETURN_IF_FAILED(packageFiles->GetCurrent(&packageFile));
+
+                    ComPtr<IStream> packageStream;
+                    RETURN_IF_FAILED(packageFile->GetStream(&packageStream));
+
+                    ComPtr<IAppxPackageReader> reader;
+                    RETURN_IF_FAILED(factory->CreatePackageReader(packageStream.Get(), &reader));
+                    RETURN_IF_FAILED(AddPackageToUnpackedSize(reader.Get(), clusterSize, unpackedSize));
+
+                    RETURN_IF_FAILED(packageFiles->MoveNext(&hasCurrent));
+                }
+            }
+        }
+
+        return S_OK;
+    }
+
+    HRESULT AddPackageToUnpackedSize(
+        _In_ IAppxPackageReader* reader,
+        _In_ ULONGLONG clusterSize,
+        _Inout_ UnpackedSize& unpackedSize)
+    {
+        // The folder of the package
+        unpackedSize.directoryCount++;
+        std::set<std::wstring> directories;
+
+        auto addFile = [&](const std::wstring& name, UINT64 size)
+        {
+            unpackedSize.fileCount++;
+            unpackedSize.allocatedBytes += (size + clusterSize - 1) / clusterSize * clusterSize;
+            for (size_t separator = name.find_first_of(L"\\/"); separator != std::wstring::npos; separator = name.find_first_of(L"\\/", separator + 1))
+            {
+                directories.insert(name.substr(0, separator));
+            }
+        };
+
+        ComPtr<IAppxBlockMapReader> blockMapReader;
+        RETURN_IF_FAILED(reader->GetBlockMap(&blockMapReader));
+
+        ComPtr<IAppxBlockMapFilesEnumerator> blockMapFiles;
+        RETURN_IF_FAILED(blockMapReader->GetFiles(&blockMapFiles));
+        BOOL hasCurrent = FALSE;
+        RETURN_IF_FAILED(blockMapFiles->GetHasCurrent(&hasCurrent));
+        while (hasCurrent)
+        {
+            ComPtr<IAppxBlockMapFile> blockMapFile;
+            RETURN_IF_FAILED(blockMapFiles->GetCurrent(&blockMapFile));
+
+            Text<WCHAR> fileName;
+            RETURN_IF_FAILED(blockMapFile->GetName(&fileName));
+
+            UINT64 size = 0;
+            RETURN_IF_FAILED(blockMapFile->GetUncompressedSize(&size));
+            addFile(fileName.Get(), size);
+
+            RETURN_IF_FAILED(blockMapFiles->MoveNext(&hasCurrent));
+        }
+
+        const APPX_FOOTPRINT_FILE_TYPE unlistedFootprintTypes[] =
+        {
+            APPX_FOOTPRINT_FILE_TYPE_BLOCKMAP,
+            APPX_FOOTPRINT_FILE_TYPE_SIGNATURE,
+        };
+        for (auto type : unlistedFootprintTypes)
+        {
+            ComPtr<IAppxFile> footprintFile;
+            HRESULT hrFootprint = reader->GetFootprintFile(type, &footprintFile);
+            if (hrFootprint == static_cast<HRESULT>(MSIX::Error::FileNotFound))
+            {
+                continue;
+            }
+            RETURN_IF_FAILED(hrFootprint);
+
+            Text<WCHAR> fileName;
+            RETURN_IF_FAILED(footprintFile->GetName(&fileName));
+
+            UINT64 size = 0;
+            RETURN_IF_FAILED(footprintFile->GetSize(&size));
+            addFile(fileName.Get(), size);
+        }
+
+        unpackedSize.directoryCount += directories.size();
+        return S_OK;
+    }
+
     HRESULT OutputPackageDependencies(
         _In_ IAppxManifestReader* manifestReader,
         _In_ LPWSTR packageFullName)
     {
+        // Packages unpacked in parallel don't interleave their lists
+        static std::mutex outputLock;
+        std::lock_guard<std::mutex> lock(outputLock);
+
         ComPtr<IAppxManifestPackageDependenciesEnumerator> dependencyEnumerator;
         ComPtr<IAppxManifestPackageDependency> dependency;
         BOOL hasCurrent = FALSE;
@@ -3,9 +3,19 @@
 #include <vector>
 #include "MSIXWindows.hpp"
 #include "..\msixmgrLib\GeneralUtil.hpp"
+#include "CIMProvider.hpp"
 
 namespace MsixCoreLib
 {
+    // What unpacking a source takes on a volume: its files, the directories they go in, and the space
+    // allocated for the files once each is rounded up to the cluster size.
+    struct UnpackedSize
+    {
+        ULONGLONG fileCount = 0;
+        ULONGLONG directoryCount = 0;
+        ULONGLONG allocatedBytes = 0;
+    };
+
     HRESULT Unpack(
         _In_ std::wstring source,
         _In_ std::wstring destination,
@@ -13,7 +23,8 @@ namespace MsixCoreLib
         _In_ bool validateSignature,
         _Inout_ std::vector<std::wstring> &skippedFiles,
         _Inout_ std::vector<std::wstring> &failedPackages,
-        _Inout_ std::vector<HRESULT> &failedPackagesErrors);
+        _Inout_ std::vector<HRESULT> &failedPackagesErrors,
+        _In_ unsigned int parallelCount = 1);
 
     HRESULT UnpackPackagesFromDirectory(
         _In_ std::wstring source,
@@ -22,7 +33,8 @@ namespace MsixCoreLib
         _In_ bool validateSignature,
         _Inout_ std::vector<std::wstring> &skippedFiles,
         _Inout_ std::vector<std::wstring> &failedPackages,
-        _Inout_ std::vector<HRESULT> &failedPackagesErrors);
+        _Inout_ std::vector<HRESULT> &failedPackagesErrors,
+        _In_ unsigned int parallelCount = 1);
 
     HRESULT UnpackPackageOrBundle(
         _In_ std::wstring source,
@@ -31,17 +43,64 @@ namespace MsixCoreLib
         _In_ bool validateSignature);
 
     HRESULT UnpackPackage(
-        _In_ std::wstring packageFilePath,
+        _In_ IStream* stream,
         _In_ std::wstring destination,
         _In_ bool isApplyACLs,
         _In_ bool validateSignature);
 
     HRESULT UnpackBundle(
-        _In_ std::wstring packageFilePath,
+        _In_ IStream* stream,
         _In_ std::wstring destination,
         _In_ bool isApplyACLs,
         _In_ bool validateSignature);
 
+    HRESULT UnpackToCIM(
+        _In_ std::wstring source,
+        _In_ std::wstring cimFilePath,
+        _In_ std::wstring rootDirectory,
+        _In_ bool validateSignature,
+        _Inout_ std::vector<std::wstring> &skippedFiles,
+        _Inout_ std::vector<std::wstring> &failedPackages,
+        _Inout_ std::vector<HRESULT> &failedPackagesErrors);
+
+    HRESULT UnpackPackageOrBundleToCIM(
+        _In_ std::wstring source,
+        _In_ CIMWriter& writer,
+        _In_ std::wstring rootDirectory,
+        _In_ bool validateSignature);
+
+    HRESULT UnpackPackageToCIM(
+        _In_ IStream* stream,
+        _In_ CIMWriter& writer,
+        _In_ std::wstring rootDirectory,
+        _In_ bool validateSignature);
+
+    HRESULT UnpackBundleToCIM(
+        _In_ IStream* stream,
+        _In_ CIMWriter& writer,
+        _In_ std::wstring rootDirectory,
+        _In_ bool validateSignature);
+
+    HRESULT AddPackageFilesToCIM(
+        _In_ IAppxPackageReader* reader,
+        _In_ CIMWriter& writer,
+        _In_ std::wstring packageFolder);
+
+    HRESULT AddFileToCIM(
+        _In_ IAppxFile* file,
+        _In_ CIMWriter& writer,
+        _In_ std::wstring packageFolder);
+
+    HRESULT GetUnpackedSize(
+        _In_ std::wstring source,
+        _In_ ULONGLONG clusterSize,
+        _Inout_ UnpackedSize& unpackedSize);
+
+    HRESULT AddPackageToUnpackedSize(
+        _In_ IAppxPackageReader* reader,
+        _In_ ULONGLONG clusterSize,
+        _Inout_ UnpackedSize& unpackedSize);
+
     HRESULT OutputPackageDependencies(
         _In_ IAppxManifestReader* manifestReader,
         _In_ LPWSTR packageFullName);
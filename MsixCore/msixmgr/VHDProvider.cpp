@@ -4,6 +4,7 @@
 #include "..\msixmgrLib\GeneralUtil.hpp"
 #include <string>
 #include <iostream>
+#include <algorithm>
 #include "InstallUI.hpp"
 
 using namespace MsixCoreLib;
@@ -75,6 +76,28 @@ namespace MsixCoreLib
         return S_OK;
     }
 
+    ULONGLONG GetVHDSizeMBs(
+        _In_ ULONGLONG fileCount,
+        _In_ ULONGLONG directoryCount,
+        _In_ ULONGLONG allocatedBytes)
+    {
+        // Every file and directory takes a 1 KB MFT record, and a directory at least one cluster for its index.
+        // On top of that NTFS keeps its log file and the rest of its metadata, and the disk its partition
+        // table, which take a fixed amount plus a share of the volume.
+        const ULONGLONG mftRecordSize = 1024;
+        const ULONGLONG fixedOverheadBytes = 64ull * 1024 * 1024;
+        const ULONGLONG overheadPercent = 10;
+        const ULONGLONG minVhdSizeMB = 5;
+        const ULONGLONG maxVhdSizeMB = 2040000;
+
+        ULONGLONG bytes = allocatedBytes + (fileCount + directoryCount) * mftRecordSize + directoryCount * VHDClusterSize;
+        bytes += bytes / 100 * overheadPercent + fixedOverheadBytes;
+
+        const ULONGLONG megabyte = 1024 * 1024;
+        ULONGLONG sizeMBs = (bytes + megabyte - 1) / megabyte;
+        return (std::min)((std::max)(sizeMBs, minVhdSizeMB), maxVhdSizeMB);
+    }
+
     HRESULT UnmountVHD(
         _In_ const std::wstring& vhdFilePath)
     {
@@ -9,6 +9,16 @@ namespace MsixCoreLib
         _In_ bool isVHD,
         _Inout_ std::wstring& driveLetter);
 
+    // The size in MB of a VHD(X) with room for fileCount files in directoryCount directories, allocating
+    // allocatedBytes in clusters of VHDClusterSize bytes, on the NTFS volume CreateAndMountVHD formats.
+    ULONGLONG GetVHDSizeMBs(
+        _In_ ULONGLONG fileCount,
+        _In_ ULONGLONG directoryCount,
+        _In_ ULONGLONG allocatedBytes);
+
+    // The default NTFS cluster size of the volumes CreateAndMountVHD formats.
+    const ULONGLONG VHDClusterSize = 4096;
+
     HRESULT UnmountVHD(
         _In_ const std::wstring& vhdFilePath);
 
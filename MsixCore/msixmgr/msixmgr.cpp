@@ -333,58 +333,76 @@ int main(int argc, char * argv[])
                     return E_INVALIDARG;
                 }
 
-                // Create a temporary directory to unpack package(s) since we cannot unpack to the CIM directly.
-                // Append long path prefix to temporary directory path to handle paths that exceed the maximum path length limit
-                std::wstring currentDirectory = std::filesystem::current_path();
-                std::wstring uniqueIdString;
-                RETURN_IF_FAILED(CreateGUIDString(&uniqueIdString));
-                std::wstring tempDirPathString = L"\\\\?\\" + currentDirectory + L"\\" + uniqueIdString;
-                std::filesystem::path tempDirPath(tempDirPathString);
-
-                std::error_code createDirectoryErrorCode;
-                bool createTempDirResult = std::filesystem::create_directory(tempDirPath, createDirectoryErrorCode);
-
-                // Since we're using a GUID, this should almost never happen
-                if (!createTempDirResult)
+                HRESULT hrCreateCIM = S_OK;
+                if (cli.IsApplyACLs())
                 {
-                    std::wcout << std::endl;
-                    std::wcout << "Failed to create temp directory " << tempDirPathString << std::endl;
-                    std::wcout << "This may occur when the directory path already exists. Please try again."  << std::endl;
-                    std::wcout << std::endl;
-                    return E_UNEXPECTED;
-                }
-                if (createDirectoryErrorCode.value() != 0)
-                {
-                    // Again, we expect that the creation of the temp directory will fail very rarely. Output the exception
-                    // and have the user try again.
-                    std::wcout << std::endl;
-                    std::wcout << "Creation of temp directory " << tempDirPathString << " failed with error: " << createDirectoryErrorCode.value() << std::endl;
-                    std::cout << "Error message: " << createDirectoryErrorCode.message() << std::endl;
-                    std::wcout << "Please try again." << std::endl;
-                    std::wcout << std::endl;
-                    return E_UNEXPECTED;
-                }
+                    // ACLs are applied to a directory on disk, so in that case the package(s) are unpacked to a
+                    // temporary directory which is then copied into the CIM.
+                    // Append long path prefix to temporary directory path to handle paths that exceed the maximum path length limit
+                    std::wstring currentDirectory = std::filesystem::current_path();
+                    std::wstring uniqueIdString;
+                    RETURN_IF_FAILED(CreateGUIDString(&uniqueIdString));
+                    std::wstring tempDirPathString = L"\\\\?\\" + currentDirectory + L"\\" + uniqueIdString;
+                    std::filesystem::path tempDirPath(tempDirPathString);
+
+                    std::error_code createDirectoryErrorCode;
+                    bool createTempDirResult = std::filesystem::create_directory(tempDirPath, createDirectoryErrorCode);
+
+                    // Since we're using a GUID, this should almost never happen
+                    if (!createTempDirResult)
+                    {
+                        std::wcout << std::endl;
+                        std::wcout << "Failed to create temp directory " << tempDirPathString << std::endl;
+                        std::wcout << "This may occur when the directory path already exists. Please try again."  << std::endl;
+                        std::wcout << std::endl;
+                        return E_UNEXPECTED;
+                    }
+                    if (createDirectoryErrorCode.value() != 0)
+                    {
+                        // Again, we expect that the creation of the temp directory will fail very rarely. Output the exception
+                        // and have the user try again.
+                        std::wcout << std::endl;
+                        std::wcout << "Creation of temp directory " << tempDirPathString << " failed with error: " << createDirectoryErrorCode.value() << std::endl;
+                        std::cout << "Error message: " << createDirectoryErrorCode.message() << std::endl;
+                        std::wcout << "Please try again." << std::endl;
+                        std::wcout << std::endl;
+                        return E_UNEXPECTED;
+                    }
 
-                RETURN_IF_FAILED(MsixCoreLib::Unpack(
-                    packageSourcePath,
-                    tempDirPathString,
-                    cli.IsApplyACLs(),
-                    cli.IsValidateSignature(),
-                    skippedFiles,
-                    failedPackages,
-                    failedPackagesErrors));
-
-                HRESULT hrCreateCIM = MsixCoreLib::CreateAndAddToCIM(unpackDestination, tempDirPathString, rootDirectory);
-
-                // Best-effort attempt to remove temp directory
-                std::error_code removeTempDirErrorCode;
-                bool removeTemprDirResult = std::filesystem::remove_all(tempDirPath, removeTempDirErrorCode);
-                if (!removeTemprDirResult || removeTempDirErrorCode.value() != 0)
+                    RETURN_IF_FAILED(MsixCoreLib::Unpack(
+                        packageSourcePath,
+                        tempDirPathString,
+                        cli.IsApplyACLs(),
+                        cli.IsValidateSignature(),
+                        skippedFiles,
+                        failedPackages,
+                        failedPackagesErrors,
+                        cli.GetParallelCount()));
+
+                    hrCreateCIM = MsixCoreLib::CreateAndAddToCIM(unpackDestination, tempDirPathString, rootDirectory);
+
+                    // Best-effort attempt to remove temp directory
+                    std::error_code removeTempDirErrorCode;
+                    bool removeTemprDirResult = std::filesystem::remove_all(tempDirPath, removeTempDirErrorCode);
+                    if (!removeTemprDirResult || removeTempDirErrorCode.value() != 0)
+                    {
+                        std::wcout << std::endl;
+                        std::wcout << "Failed to remove the temp dir  " << tempDirPath << std::endl;
+                        std::wcout << "Ignoring this non-fatal error and moving on" << std::endl;
+                        std::wcout << std::endl;
+                    }
+                }
+                else
                 {
-                    std::wcout << std::endl;
-                    std::wcout << "Failed to remove the temp dir  " << tempDirPath << std::endl;
-                    std::wcout << "Ignoring this non-fatal error and moving on" << std::endl;
-                    std::wcout << std::endl;
+                    // Stream the files of the package(s) straight into the CIM, without writing them to disk first
+                    hrCreateCIM = MsixCoreLib::UnpackToCIM(
+                        packageSourcePath,
+                        unpackDestination,
+                        rootDirectory,
+                        cli.IsValidateSignature(),
+                        skippedFiles,
+                        failedPackages,
+                        failedPackagesErrors);
                 }
 
                 if (FAILED(hrCreateCIM))
@@ -418,16 +436,29 @@ int main(int argc, char * argv[])
                     }
                     else
                     {
-                        if (cli.GetVHDSize() == 0)
+                        ULONGLONG vhdSize = cli.GetVHDSize();
+                        if (vhdSize == 0)
                         {
+                            // Size the VHD to fit the unpacked package(s), as their block maps describe them
+                            MsixCoreLib::UnpackedSize unpackedSize;
+                            HRESULT hrUnpackedSize = MsixCoreLib::GetUnpackedSize(packageSourcePath, MsixCoreLib::VHDClusterSize, unpackedSize);
+                            if (FAILED(hrUnpackedSize))
+                            {
+                                std::wcout << std::endl;
+                                std::wcout << "VHD size was not specified and could not be computed from the package(s), failed with HRESULT 0x" << std::hex << hrUnpackedSize << std::endl;
+                                std::wcout << "Please provide a vhd size in MB using the -vhdSize option" << std::endl;
+                                std::wcout << std::endl;
+                                return hrUnpackedSize;
+                            }
+
+                            vhdSize = MsixCoreLib::GetVHDSizeMBs(unpackedSize.fileCount, unpackedSize.directoryCount, unpackedSize.allocatedBytes);
                             std::wcout << std::endl;
-                            std::wcout << "VHD size was not specified. Please provide a vhd size in MB using the -vhdSize option" << std::endl;
+                            std::wcout << "VHD size was not specified, creating a VHD of " << std::dec << vhdSize << " MB to fit the package(s)" << std::endl;
                             std::wcout << std::endl;
-                            return E_INVALIDARG;
                         }
 
                         std::wstring driveLetter;
-                        HRESULT hrCreateVHD = MsixCoreLib::CreateAndMountVHD(unpackDestination, cli.GetVHDSize(), fileType == WVDFileType::VHD,  driveLetter);
+                        HRESULT hrCreateVHD = MsixCoreLib::CreateAndMountVHD(unpackDestination, vhdSize, fileType == WVDFileType::VHD,  driveLetter);
                         if (FAILED(hrCreateVHD))
                         {
                             std::wcout << std::endl;
@@ -464,7 +495,8 @@ int main(int argc, char * argv[])
                             cli.IsValidateSignature(),
                             skippedFiles,
                             failedPackages,
-                            failedPackagesErrors
+                            failedPackagesErrors,
+                            cli.GetParallelCount()
                         ));
 
                         HRESULT hrUnmount = MsixCoreLib::UnmountVHD(unpackDestination);
@@ -492,7 +524,8 @@ int main(int argc, char * argv[])
                         cli.IsValidateSignature(),
                         skippedFiles,
                         failedPackages,
-                        failedPackagesErrors));
+                        failedPackagesErrors,
+                        cli.GetParallelCount()));
 
                     std::wcout << std::endl;
                     std::wcout << "Finished unpacking packages to: " << unpackDestination << std::endl;
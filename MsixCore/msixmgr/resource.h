@@ -66,6 +66,7 @@
 #define IDS_STRING_HELP_OPTION_MOUNT_FILETYPE 161
 #define IDS_STRING_HELP_OPTION_UNPACK_VHDSIZE 162
 #define IDS_STRING_HELP_OPTION_MOUNT_READONLY 163
+#define IDS_STRING_HELP_OPTION_UNPACK_PARALLEL 164
 
 // Next default values for new objects
 // 
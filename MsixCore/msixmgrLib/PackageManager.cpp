@@ -2,6 +2,8 @@
 #include "MsixRequest.hpp"
 #include "Constants.hpp"
 #include "PopulatePackageInfo.hpp"
+#include "InstalledPackageIndex.hpp"
+#include "RemotePackageStream.hpp"
 #include "MsixTraceLoggingProvider.hpp"
 #include <experimental/filesystem>
 #include <thread>
@@ -153,11 +155,19 @@ HRESULT PackageManager::RemovePackage(const wstring & packageFullName)
     return S_OK;
 }
 
-HRESULT PackageManager::GetPackageInfo(const wstring & directoryPath, shared_ptr<IInstalledPackage> & installedPackage)
+HRESULT PackageManager::GetInstalledPackage(const wstring & msixCoreDirectory, const wstring & packageFullName, shared_ptr<IInstalledPackage> & installedPackage)
 {
     std::shared_ptr<InstalledPackage> packageInfo;
-    RETURN_IF_FAILED(PopulatePackageInfo::GetPackageInfoFromManifest(directoryPath.c_str(), MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_FULL, &packageInfo));
-    
+    const HRESULT hrFind = InstalledPackageIndex::Find(packageFullName, packageInfo);
+    if (SUCCEEDED(hrFind) && packageInfo != nullptr)
+    {
+        installedPackage = std::dynamic_pointer_cast<IInstalledPackage>(packageInfo);
+        return S_OK;
+    }
+
+    wstring packageDirectoryPath = msixCoreDirectory + packageFullName;
+    RETURN_IF_FAILED(PopulatePackageInfo::GetPackageInfoFromManifest(packageDirectoryPath.c_str(), MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_FULL, &packageInfo));
+
     installedPackage = std::dynamic_pointer_cast<IInstalledPackage>(packageInfo);
     return S_OK;
 }
@@ -168,6 +178,18 @@ HRESULT MsixCoreLib::PackageManager::CreateStreamOnPackageUrl(const std::wstring
     bool isPathHttp = package.compare(0, httpPrefix.length(), httpPrefix) == 0;
     if (isPathHttp)
     {
+        // Read the package while it downloads, so extraction overlaps the download
+        const HRESULT hrStream = RemotePackageStream::Make(package, stream);
+        if (SUCCEEDED(hrStream))
+        {
+            return S_OK;
+        }
+
+        TraceLoggingWrite(g_MsixTraceLoggingProvider,
+            "Unable to stream the package download",
+            TraceLoggingValue(package.c_str(), "PackageFilePath"),
+            TraceLoggingValue(hrStream, "HR"));
+
         TraceLoggingWrite(g_MsixTraceLoggingProvider,
             "HTTP file detected, will download to cache",
             TraceLoggingValue(package.c_str(), "PackageFilePath"));
@@ -191,7 +213,12 @@ HRESULT PackageManager::FindPackage(const wstring & packageFullName, shared_ptr<
     
     wstring msixCoreDirectory = filemapping.GetMsixCoreDirectory();
     wstring packageDirectoryPath = msixCoreDirectory + packageFullName;
-    RETURN_IF_FAILED(GetPackageInfo(packageDirectoryPath, installedPackage));
+    // The package directory tells whether the package is installed, the index only saves parsing its manifest.
+    if (!experimental::filesystem::is_directory(packageDirectoryPath))
+    {
+        return HRESULT_FROM_WIN32(ERROR_PATH_NOT_FOUND);
+    }
+    RETURN_IF_FAILED(GetInstalledPackage(msixCoreDirectory, packageFullName, installedPackage));
     return S_OK;
 }
 
@@ -208,8 +235,7 @@ HRESULT PackageManager::FindPackageByFamilyName(const wstring & packageFamilyNam
             auto installedAppFamilyName = GetFamilyNameFromFullName(p.path().filename());
             if (CaseInsensitiveEquals(installedAppFamilyName, packageFamilyName))
             {
-                wstring packageDirectoryPath = msixCoreDirectory + std::wstring(p.path().filename());
-                RETURN_IF_FAILED(GetPackageInfo(packageDirectoryPath, installedPackage));
+                RETURN_IF_FAILED(GetInstalledPackage(msixCoreDirectory, p.path().filename(), installedPackage));
                 return S_OK;
             }
         }
@@ -233,6 +259,16 @@ HRESULT PackageManager::FindPackages(const std::wstring & searchParameter, uniqu
     std::string searchParameterString(searchParameterCopy.begin(), searchParameterCopy.end());
     std::regex searchParameterRegExp(searchParameterString, std::regex_constants::icase);
 
+    // One read of the index, then only the packages without an entry have their manifest parsed.
+    std::map<std::wstring, std::shared_ptr<InstalledPackage>, CaseInsensitiveLess> indexedPackages;
+    const HRESULT hrLoad = InstalledPackageIndex::Load(indexedPackages);
+    if (FAILED(hrLoad))
+    {
+        TraceLoggingWrite(g_MsixTraceLoggingProvider,
+            "Unable to read the installed package index",
+            TraceLoggingValue(hrLoad, "HR"));
+    }
+
     std::vector<std::wstring> packageFullNames;
     for (auto& p : experimental::filesystem::directory_iterator(msixCoreDirectory))
     {
@@ -245,9 +281,16 @@ HRESULT PackageManager::FindPackages(const std::wstring & searchParameter, uniqu
                 || std::regex_match(installedAppFamilyNameString, searchParameterRegExp)
                 || CaseInsensitiveEquals(searchParameter, L"*")))
             {
+                auto indexedPackage = indexedPackages.find(p.path().filename());
+                if (indexedPackage != indexedPackages.end())
+                {
+                    packages->push_back(std::dynamic_pointer_cast<IInstalledPackage>(indexedPackage->second));
+                    continue;
+                }
+
                 wstring packageDirectoryPath = msixCoreDirectory + std::wstring(p.path().filename());
-                shared_ptr<IInstalledPackage> packageInfo;
-                const HRESULT hrGetPackageInfo = GetPackageInfo(packageDirectoryPath, packageInfo);
+                shared_ptr<InstalledPackage> packageInfo;
+                const HRESULT hrGetPackageInfo = PopulatePackageInfo::GetPackageInfoFromManifest(packageDirectoryPath.c_str(), MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_FULL, &packageInfo);
                 if (FAILED(hrGetPackageInfo))
                 {
                     TraceLoggingWrite(g_MsixTraceLoggingProvider,
@@ -257,7 +300,7 @@ HRESULT PackageManager::FindPackages(const std::wstring & searchParameter, uniqu
                 }
                 else
                 {
-                    packages->push_back(packageInfo);
+                    packages->push_back(std::dynamic_pointer_cast<IInstalledPackage>(packageInfo));
                 }
             }
         }
@@ -19,7 +19,8 @@ namespace MsixCoreLib {
         HRESULT FindPackages(const std::wstring & searchParameter, std::unique_ptr<std::vector<std::shared_ptr<IInstalledPackage>>> & installedPackages) override;
         HRESULT GetMsixPackageInfo(const std::wstring & msixFullPath, std::shared_ptr<IPackage> & package, MSIX_VALIDATION_OPTION validationOption) override;
     private:
-        HRESULT GetPackageInfo(const std::wstring & directoryPath, std::shared_ptr<IInstalledPackage> & installedPackage);
+        /// Gets an installed package from the installed package index, or from its manifest when it isn't indexed.
+        HRESULT GetInstalledPackage(const std::wstring & msixCoreDirectory, const std::wstring & packageFullName, std::shared_ptr<IInstalledPackage> & installedPackage);
         HRESULT CreateStreamOnPackageUrl(const std::wstring & package, IStream** stream);
     };
 }
\ No newline at end of file
@@ -14,12 +14,18 @@ option(USE_STATIC_MSVC "Windows only. Pass /MT as a compiler flag to use the sta
 option(SKIP_BUNDLES "Removes bundle functionality from the MSIX SDK. Default is 'off'" OFF)
 option(MSIX_PACK "Include packaging features for the MSIX SDK. Not supported for mobile. Default is 'off'" OFF)
 option(USE_MSIX_SDK_ZLIB "Use zlib implementation under lib/zlib. If off, uses inbox compression library. For Windows and Linux this is no-opt." OFF)
+option(USE_EXTERNAL_ZLIB "Link against the zlib compatible library found by find_package(ZLIB) instead of lib/zlib, for example zlib-ng built with ZLIB_COMPAT or an accelerated zlib. Use -DZLIB_ROOT=<path> to choose it. Default is 'off'" OFF)
 
 option(MSIX_TESTS "Enables building MSIX SDK tests" ON)
+option(MSIX_BENCHMARKS "Enables building msixbench, which measures pack, unpack and open of synthetic packages. Default is 'off'" OFF)
+option(MSIX_STRESS_TESTS "Adds to msixtest the tests that pack and unpack generated large packages, over 4GB and with 100K files. Requires MSIX_PACK. Default is 'off'" OFF)
+option(MSIX_ALLOCATION_TESTS "Adds to msixtest the tests that count the heap allocations per payload block of pack and unpack, with replacements of the global operator new and malloc. Requires MSIX_PACK, not supported on Windows or mobile. Default is 'off'" OFF)
+option(MSIX_FUZZERS "Enables building msixfuzz, libFuzzer targets for the package, bundle, manifest and block map readers. Requires clang, builds the SDK with AddressSanitizer. Default is 'off'" OFF)
+option(MSIX_MOUNT "Enables building msixmount, which mounts a package as a read-only file system with FUSE. Linux and macOS only, requires libfuse 3. Default is 'off'" OFF)
 option(MSIX_SAMPLES "Enables building MSIX SDK samples" ON)
 
 set(CMAKE_BUILD_TYPE Debug CACHE STRING "Choose the type of build, options are: None Debug Release RelWithDebInfo MinSizeRel. Use the -DCMAKE_BUILD_TYPE=[option] to specify.")
-set(XML_PARSER "" CACHE STRING "Choose the type of parser, options are: [xerces, msxml6, javaxml].  Use the -DXML_PARSER=[option] to specify.")
+set(XML_PARSER "" CACHE STRING "Choose the type of parser, options are: [xerces, msxml6, javaxml, applexml, msixxml]. msixxml is the built in non validating parser.  Use the -DXML_PARSER=[option] to specify.")
 set(CRYPTO_LIB "" CACHE STRING "Choose the cryptography library to use, options are: [openssl, crypt32].  Use the -DCRYPTO_LIB=[option] to specify.")
 
 # Enforce that target platform is specified.
@@ -85,9 +91,25 @@ if(MSIX_PACK)
     endif()
 endif()
 
+if(USE_EXTERNAL_ZLIB AND USE_MSIX_SDK_ZLIB)
+    message(FATAL_ERROR "USE_EXTERNAL_ZLIB and USE_MSIX_SDK_ZLIB can't be used together.")
+endif()
+
+if(MSIX_FUZZERS)
+    if(NOT CMAKE_CXX_COMPILER_ID MATCHES "Clang")
+        message(FATAL_ERROR "MSIX_FUZZERS requires clang. Use -DCMAKE_C_COMPILER=clang -DCMAKE_CXX_COMPILER=clang++")
+    endif()
+    # The SDK and its dependencies are instrumented so the fuzzers see their coverage and memory errors, the
+    # fuzzer executables add the libFuzzer main.
+    add_compile_options(-fsanitize=fuzzer-no-link,address -fno-omit-frame-pointer)
+    set(CMAKE_SHARED_LINKER_FLAGS "${CMAKE_SHARED_LINKER_FLAGS} -fsanitize=address")
+endif()
+
 # Compression
 set(COMPRESSION_LIB "zlib")
-if(((IOS) OR (MACOS)) AND (NOT USE_MSIX_SDK_ZLIB))
+if(USE_EXTERNAL_ZLIB)
+    set(COMPRESSION_LIB "external zlib")
+elseif(((IOS) OR (MACOS)) AND (NOT USE_MSIX_SDK_ZLIB))
     set(COMPRESSION_LIB "libCompression")
 elseif((AOSP) AND (NOT USE_MSIX_SDK_ZLIB))
     set(COMPRESSION_LIB "inbox zlib")
@@ -118,3 +140,7 @@ endif()
 message(STATUS "\tCompression library = ${COMPRESSION_LIB}")
 message(STATUS "\tXML Parser          = ${XML_PARSER} with validation parser ${USE_VALIDATION_PARSER}")
 message(STATUS "\tCrypto library      = ${CRYPTO_LIB}")
+message(STATUS "\tBenchmarks          = ${MSIX_BENCHMARKS}")
+message(STATUS "\tStress tests        = ${MSIX_STRESS_TESTS}")
+message(STATUS "\tAllocation tests    = ${MSIX_ALLOCATION_TESTS}")
+message(STATUS "\tFuzzers             = ${MSIX_FUZZERS}")
@@ -25,6 +25,7 @@ usage()
     echo $'\t' "-b build_type           Default MinSizeRel"
     echo $'\t' "-xzlib                  Use MSIX SDK Zlib instead of inbox libz.so"
     echo $'\t' "-parser-xerces          Use xerces xml parser instead of default javaxml"
+    echo $'\t' "-parser-msixxml         Use the built in non validating xml parser instead of default javaxml"
     echo $'\t' "-sb                     Skip bundle support."
     echo $'\t' "--validation-parser|-vp Enable XML schema validation."
     echo $'\t' "--skip-samples          Skip building samples."
@@ -70,6 +71,9 @@ while [ "$1" != "" ]; do
         -parser-xerces )
                   xmlparser=xerces
                   ;;
+        -parser-msixxml )
+                  xmlparser=msixxml
+                  ;;
         -sdk )    shift
                   sdk=$1
                   ;;
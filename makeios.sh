@@ -17,6 +17,7 @@ usage()
     echo $'\t' "-xzlib                  Use MSIX SDK Zlib instead of inbox libCompression api. Default on iOS is libCompression."
     echo $'\t' "-sb                     Skip bundle support."
     echo $'\t' "-parser-xerces          Use xerces xml parser instead of default apple xml parser."
+    echo $'\t' "-parser-msixxml         Use the built in non validating xml parser instead of default apple xml parser."
     echo $'\t' "--validation-parser|-vp Enable XML schema validation."
     echo $'\t' "--skip-samples          Skip building samples."
     echo $'\t' "--skip-tests            Skip building tests."
@@ -48,6 +49,8 @@ while [ "$1" != "" ]; do
         -parser-xerces )  xmlparserLib=xerces
                 xmlparser=xerces
                 ;;
+        -parser-msixxml ) xmlparser=msixxml
+                ;;
         -sb )   bundle="on"
                 ;;
         --validation-parser ) validationParser=on
@@ -6,6 +6,9 @@ validationParser=off
 pack=off
 samples=on
 tests=on
+benchmarks=off
+benchBaseline=
+benchThreshold=10
 
 usage()
 {
@@ -16,6 +19,10 @@ usage()
     echo $'\t' "--pack                  Include packaging features. Sets validation parser on."
     echo $'\t' "--skip-samples          Skip building samples."
     echo $'\t' "--skip-tests            Skip building tests."
+    echo $'\t' "--bench                 Build msixbench."
+    echo $'\t' "--bench-baseline file   Build msixbench and run it after the build, failing if it is slower than the"
+    echo $'\t' "                        results in file, written by a previous run with -o."
+    echo $'\t' "--bench-threshold n     Percentage by which msixbench can be slower than the baseline. Default 10"
 }
 
 printsetup()
@@ -26,6 +33,7 @@ printsetup()
     echo "Pack support:" $pack 
     echo "Build samples:" $samples
     echo "Build tests:" $tests
+    echo "Build benchmarks:" $benchmarks
 }
 
 while [ "$1" != "" ]; do
@@ -49,6 +57,15 @@ while [ "$1" != "" ]; do
                 ;;
         --skip-tests ) tests=off
                 ;;
+        --bench ) benchmarks=on
+                ;;
+        --bench-baseline ) shift
+                benchmarks=on
+                benchBaseline=$(realpath "$1")
+                ;;
+        --bench-threshold ) shift
+                benchThreshold=$1
+                ;;
         * )     usage
                 exit 1
     esac
@@ -63,7 +80,7 @@ cd .vs
 find . -depth -name *msix* | xargs -0 -r rm -rf
 
 echo "cmake -DCMAKE_BUILD_TYPE="$build "-DSKIP_BUNDLES="$bundle "-DUSE_VALIDATION_PARSER="$validationParser 
-echo "-DCMAKE_TOOLCHAIN_FILE=../cmake/linux.cmake" "-DMSIX_PACK="$pack "-DMSIX_SAMPLES="$samples "-DMSIX_TESTS="$tests "-DLINUX=on .."
+echo "-DCMAKE_TOOLCHAIN_FILE=../cmake/linux.cmake" "-DMSIX_PACK="$pack "-DMSIX_SAMPLES="$samples "-DMSIX_TESTS="$tests "-DMSIX_BENCHMARKS="$benchmarks "-DLINUX=on .."
 cmake -DCMAKE_BUILD_TYPE=$build \
       -DSKIP_BUNDLES=$bundle \
       -DUSE_VALIDATION_PARSER=$validationParser \
@@ -71,5 +88,10 @@ cmake -DCMAKE_BUILD_TYPE=$build \
       -DMSIX_PACK=$pack \
       -DMSIX_SAMPLES=$samples \
       -DMSIX_TESTS=$tests \
+      -DMSIX_BENCHMARKS=$benchmarks \
       -DLINUX=on ..
 make
+
+if [ -n "$benchBaseline" ]; then
+    ./msixbench/msixbench -baseline "$benchBaseline" -threshold $benchThreshold -o msixbench_results.json || exit $?
+fi
@@ -18,6 +18,7 @@ usage()
     echo $'\t' "-xzlib                  Use MSIX SDK Zlib instead of inbox libCompression api. Default on MacOS is libCompression."
     echo $'\t' "-sb                     Skip bundle support."
     echo $'\t' "-parser-xerces          Use xerces xml parser instead of default apple xml parser."
+    echo $'\t' "-parser-msixxml         Use the built in non validating xml parser instead of default apple xml parser."
     echo $'\t' "-asan                   Turn on address sanitizer for memory corruption detection."
     echo $'\t' "--validation-parser|-vp Enable XML schema validation."
     echo $'\t' "--pack                  Include packaging features. Uses MSIX SDK Zlib and Xerces with validation parser on."
@@ -49,6 +50,8 @@ while [ "$1" != "" ]; do
                 ;;
         -parser-xerces ) xmlparser=xerces
                          ;;
+        -parser-msixxml ) xmlparser=msixxml
+                          ;;
         -asan ) addressSanitizer=on
                 ;;
         -sb )   bundle="on"
@@ -37,6 +37,9 @@ set bundle="-DSKIP_BUNDLES=off"
 set pack="-DMSIX_PACK=off"
 set samples="-DMSIX_SAMPLES=on"
 set tests="-DMSIX_TESTS=on"
+set benchmarks="-DMSIX_BENCHMARKS=off"
+set benchBaseline=
+set benchThreshold=10
 
 :parseArgs
 if /I "%~2" == "--debug" (
@@ -94,6 +97,18 @@ if /I "%~2" == "--skip-samples" (
 if /I "%~2" == "--skip-tests" (
     set tests="-DMSIX_TESTS=off"
 )
+if /I "%~2" == "--bench" (
+    set benchmarks="-DMSIX_BENCHMARKS=on"
+)
+if /I "%~2" == "--bench-baseline" (
+    set benchmarks="-DMSIX_BENCHMARKS=on"
+    set benchBaseline=%~f3
+    shift /2
+)
+if /I "%~2" == "--bench-threshold" (
+    set benchThreshold=%~3
+    shift /2
+)
 shift /2
 if not "%~2"=="" goto parseArgs
 
@@ -102,10 +117,15 @@ cd .vs
 if exist CMakeFiles rd /s /q CMakeFiles
 if exist CMakeCache.txt del CMakeCache.txt
 
-echo cmake -DWIN32=on -DCMAKE_BUILD_TYPE=%build% %validationParser% %zlib% %parser% %crypto% %msvc% %bundle% %pack% %samples% %tests% -G"NMake Makefiles" ..
-cmake -DWIN32=on -DCMAKE_BUILD_TYPE=%build% %validationParser% %zlib% %parser% %crypto% %msvc% %bundle% %pack% %samples% %tests% -G"NMake Makefiles" ..
+echo cmake -DWIN32=on -DCMAKE_BUILD_TYPE=%build% %validationParser% %zlib% %parser% %crypto% %msvc% %bundle% %pack% %samples% %tests% %benchmarks% -G"NMake Makefiles" ..
+cmake -DWIN32=on -DCMAKE_BUILD_TYPE=%build% %validationParser% %zlib% %parser% %crypto% %msvc% %bundle% %pack% %samples% %tests% %benchmarks% -G"NMake Makefiles" ..
 nmake /NOLOGO
 
+if not "%benchBaseline%" == "" (
+    msixbench\msixbench.exe -baseline "%benchBaseline%" -threshold %benchThreshold% -o msixbench_results.json
+    if errorlevel 1 goto BenchFailed
+)
+
 goto Exit
 :USAGE
 echo Usage
@@ -126,6 +146,12 @@ echo    --skip-bundles, -sb      = Turn off bundle support.
 echo    --pack                   = Include packaging features. Sets validation parser on.
 echo    --skip-samples           = Skip building samples.
 echo    --skip-test              = Skip building tests.
+echo    --bench                  = Build msixbench.
+echo    --bench-baseline ^<file^>  = Build msixbench and run it after the build, failing if it is slower than the
+echo                               results in file, written by a previous run with -o.
+echo    --bench-threshold ^<n^>    = Percentage by which msixbench can be slower than the baseline. Default 10.
 echo    --help, -h, /?           = Print this usage information and exit.
 :Exit
 EXIT /B 0
+:BenchFailed
+EXIT /B 1
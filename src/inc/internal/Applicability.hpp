@@ -7,6 +7,8 @@
 #include <vector>
 #include <utility>
 #include <string>
+#include <map>
+#include <mutex>
 
 #include "AppxPackaging.hpp"
 #include "ComHelper.hpp"
@@ -34,11 +36,13 @@ namespace MSIX {
         Bcp47Tag(const std::string& language, const std::string& script, const std::string& region) : 
             m_language(language), m_script(script), m_region(region) {} 
 
-        Bcp47ClosenessMeasure Compare(const Bcp47Tag& otherTag);
-        Bcp47ClosenessMeasure CompareNeutral(const Bcp47Tag& otherTag);
+        Bcp47ClosenessMeasure Compare(const Bcp47Tag& otherTag) const;
+        Bcp47ClosenessMeasure CompareNeutral(const Bcp47Tag& otherTag) const;
         const std::string GetFullTag() const;
 
     protected:
+        Bcp47ClosenessMeasure Compare(const Bcp47Tag& otherTag, const std::string& region) const;
+
         std::string m_language;
         std::string m_script;
         std::string m_region;
@@ -52,14 +56,20 @@ namespace MSIX {
 
         void InitializeLanguages();
         void InitializeLanguages(IMsixApplicabilityLanguagesEnumerator* languagesEnumerator);
+        void InitializeLanguages(const std::vector<Bcp47Tag>& languages) { m_languages = languages; }
+
+        // Identifies the bundle and every input of the package selection, so the same key always
+        // selects the same packages.
+        std::string GetSelectionKey(const std::string& bundleManifestHash) const;
 
         void AddPackageIfApplicable(ComPtr<IAppxPackageReader>& reader, APPX_BUNDLE_PAYLOAD_PACKAGE_TYPE packageType, const ComPtr<IAppxBundleManifestPackageInfo>& bundlePackageInfo);
 
         void GetApplicablePackages(std::vector<ComPtr<IAppxPackageReader>>* applicablePackages, std::vector<std::string>* applicablePackagesNames);
 
+        static std::vector<Bcp47Tag> GetLanguages();
+
     private:
         MSIX_PLATFORMS GetPlatform();
-        std::vector<Bcp47Tag> GetLanguages();
 
         bool m_hasExactLanguageMatch = false;
         bool m_matchApplicationPackage = false;
@@ -69,4 +79,21 @@ namespace MSIX {
         MSIX_APPLICABILITY_OPTIONS m_applicabilityFlags = MSIX_APPLICABILITY_OPTIONS::MSIX_APPLICABILITY_OPTION_FULL;
         std::vector<Bcp47Tag> m_languages;
     };
+
+    // Applicability decisions of a factory. The system languages are read once, and the packages selected
+    // for a bundle are kept by their selection key, so opening the same bundle again with the same inputs
+    // doesn't go through the packages again.
+    class ApplicabilityCache final
+    {
+    public:
+        std::vector<Bcp47Tag> GetSystemLanguages();
+        bool GetApplicablePackages(const std::string& selectionKey, std::vector<std::string>& applicablePackagesNames);
+        void AddApplicablePackages(const std::string& selectionKey, const std::vector<std::string>& applicablePackagesNames);
+
+    protected:
+        std::mutex m_lock;
+        bool m_hasSystemLanguages = false;
+        std::vector<Bcp47Tag> m_systemLanguages;
+        std::map<std::string, std::vector<std::string>> m_applicablePackages;
+    };
 }
\ No newline at end of file
@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <string>
 #include <map>
+#include <mutex>
 #include <vector>
 #include <iterator>
 
@@ -17,7 +18,9 @@
 #include "AppxFactory.hpp"
 #include "IXml.hpp"
 #include "BlockMapStream.hpp"
+#include "PackageIndex.hpp"
 #include "Enumerators.hpp"
+#include "Arena.hpp"
 
 // internal interface
 // {67fed21a-70ef-4175-8f12-415b213ab6d2}
@@ -31,8 +34,10 @@ class IAppxBlockMapInternal : public IUnknown
 {
 public:
     virtual std::vector<std::string> GetFileNames() = 0;
-    virtual std::vector<MSIX::Block> GetBlocks(const std::string& fileName) = 0;
+    virtual MSIX::FileBlocks GetBlocks(const std::string& fileName) = 0;
     virtual MSIX::ComPtr<IAppxBlockMapFile> GetFile(const std::string& fileName) = 0;
+    // The record given to the validation streams created afterwards, null for none
+    virtual void SetIntegrityRecord(const std::shared_ptr<MSIX::IntegrityRecord>& integrityRecord) = 0;
 };
 MSIX_INTERFACE(IAppxBlockMapInternal, 0x67fed21a,0x70ef,0x4175,0x8f,0x12,0x41,0x5b,0x21,0x3a,0xb6,0xd2);
 
@@ -41,28 +46,32 @@ namespace MSIX {
     class AppxBlockMapBlock final : public MSIX::ComClass<AppxBlockMapBlock, IAppxBlockMapBlock>
     {
     public:
-        AppxBlockMapBlock(IMsixFactory* factory, Block* block) :
+        AppxBlockMapBlock(IMsixFactory* factory, const FileBlocks& blocks, std::size_t index) :
             m_factory(factory),
-            m_block(block)
+            m_blocks(blocks),
+            m_index(index)
         {}
 
         // IAppxBlockMapBlock
         HRESULT STDMETHODCALLTYPE GetHash(UINT32* bufferSize, BYTE** buffer) noexcept override try
         {
-            ThrowHrIfFailed(m_factory->MarshalOutBytes(m_block->hash, bufferSize, buffer));
+            const auto& hash = m_blocks.Hash(m_index);
+            std::vector<std::uint8_t> data(hash.begin(), hash.end());
+            ThrowHrIfFailed(m_factory->MarshalOutBytes(data, bufferSize, buffer));
             return static_cast<HRESULT>(Error::OK);
         } CATCH_RETURN();
 
         HRESULT STDMETHODCALLTYPE GetCompressedSize(UINT32* size) noexcept override try
         {
             ThrowErrorIf(Error::InvalidParameter, (size == nullptr), "bad pointer");
-            *size = static_cast<UINT32>(m_block->compressedSize);
+            *size = static_cast<UINT32>(m_blocks.CompressedSize(m_index));
             return static_cast<HRESULT>(Error::OK);
         } CATCH_RETURN();
 
     private:
         IMsixFactory* m_factory;
-        Block*        m_block;
+        FileBlocks    m_blocks;
+        std::size_t   m_index;
     };
 
     class AppxBlockMapFile final : public MSIX::ComClass<AppxBlockMapFile, IAppxBlockMapFile, IAppxBlockMapFileUtf8 >
@@ -70,7 +79,7 @@ namespace MSIX {
     public:
         AppxBlockMapFile(
             IMsixFactory* factory,
-            std::vector<Block>* blocks,
+            const FileBlocks& blocks,
             std::uint32_t localFileHeaderSize,
             const std::string& name,
             std::uint64_t uncompressedSize
@@ -87,16 +96,16 @@ namespace MSIX {
         HRESULT STDMETHODCALLTYPE GetBlocks(IAppxBlockMapBlocksEnumerator **blocks) noexcept override try
         {
             ThrowErrorIf(Error::InvalidParameter, (blocks == nullptr || *blocks != nullptr), "bad pointer.");
-            if (m_blockMapBlocks.empty())
-            {   m_blockMapBlocks.reserve(m_blocks->size());
-                std::transform(
-                    m_blocks->begin(),
-                    m_blocks->end(),
-                    std::back_inserter(m_blockMapBlocks),
-                    [&](auto& item){
-                        return ComPtr<IAppxBlockMapBlock>::Make<AppxBlockMapBlock>(m_factory, &item);
-                    }
-                );
+            std::lock_guard<std::mutex> lock(m_blockMapBlocksLock);
+            if (!m_blockMapBlocks)
+            {
+                std::vector<ComPtr<IAppxBlockMapBlock>> blockMapBlocks;
+                blockMapBlocks.reserve(m_blocks.size());
+                for (std::size_t index = 0; index < m_blocks.size(); index++)
+                {
+                    blockMapBlocks.push_back(ComPtr<IAppxBlockMapBlock>::Make<AppxBlockMapBlock>(m_factory, m_blocks, index));
+                }
+                m_blockMapBlocks = std::make_shared<const std::vector<ComPtr<IAppxBlockMapBlock>>>(std::move(blockMapBlocks));
             }
             *blocks = ComPtr<IAppxBlockMapBlocksEnumerator>::
                 Make<EnumeratorCom<IAppxBlockMapBlocksEnumerator, IAppxBlockMapBlock>>(m_blockMapBlocks).Detach();
@@ -136,8 +145,10 @@ namespace MSIX {
         } CATCH_RETURN();
 
     private:
-        std::vector<ComPtr<IAppxBlockMapBlock>> m_blockMapBlocks;
-        std::vector<Block>* m_blocks;
+        // Made on first use and shared by the enumerators of the blocks
+        std::mutex m_blockMapBlocksLock;
+        std::shared_ptr<const std::vector<ComPtr<IAppxBlockMapBlock>>> m_blockMapBlocks;
+        FileBlocks          m_blocks;
         IMsixFactory*       m_factory;
         std::uint32_t       m_localFileHeaderSize;
         std::string         m_name;
@@ -149,6 +160,8 @@ namespace MSIX {
     {
     public:
         AppxBlockMapObject(IMsixFactory* factory, const ComPtr<IStream>& stream);
+        // For a block map whose files and blocks are in the index of its package, stream isn't parsed
+        AppxBlockMapObject(IMsixFactory* factory, const ComPtr<IStream>& stream, const PackageIndex& index);
 
         // IVerifierObject
         const std::string& GetPublisher() override { NOTSUPPORTED; }
@@ -164,16 +177,36 @@ namespace MSIX {
 
         // IAppxBlockMapInternal methods
         std::vector<std::string>        GetFileNames() override;
-        std::vector<Block>              GetBlocks(const std::string& fileName) override;
+        FileBlocks                      GetBlocks(const std::string& fileName) override;
         MSIX::ComPtr<IAppxBlockMapFile> GetFile(const std::string& fileName) override;
+        void SetIntegrityRecord(const std::shared_ptr<IntegrityRecord>& integrityRecord) override { m_integrityRecord = integrityRecord; }
 
         // IAppxBlockMapReaderUtf8
         HRESULT STDMETHODCALLTYPE GetFile(LPCSTR filename, IAppxBlockMapFile **file) noexcept override;
 
     protected:
-        std::map<std::string, std::vector<Block>>        m_blockMap;
-        std::map<std::string, ComPtr<IAppxBlockMapFile>> m_blockMapFiles;
+        // Checks a File element that is about to be added and returns its size
+        std::uint64_t StartFile(const std::string& name, const std::string& size);
+        // Adds the file whose blocks are the run of the table that starts at firstBlock
+        void AddFile(const std::string& name, std::uint64_t size, std::size_t firstBlock, std::size_t blockCount, std::uint32_t lfhSize);
+
+        struct BlockMapEntry
+        {
+            FileBlocks                blocks;
+            ComPtr<IAppxBlockMapFile> file;
+        };
+
+        // The blocks of all the files, each file has a run of them
+        std::shared_ptr<BlockTable>          m_blocks;
+        // Holds the nodes of m_blockMap, which are all created when the block map is read
+        MonotonicArena                       m_arena;
+        // One entry per file, so a name is stored and looked up once for both its blocks and its file object
+        ArenaMap<std::string, BlockMapEntry> m_blockMap{ m_arena };
         IMsixFactory*   m_factory;
         ComPtr<IStream> m_stream;
+        std::shared_ptr<IntegrityRecord> m_integrityRecord;
+        // The file objects of m_blockMap in its order, made on first use and shared by the enumerators of the files
+        std::mutex m_filesLock;
+        std::shared_ptr<const std::vector<ComPtr<IAppxBlockMapFile>>> m_files;
     };
 }
\ No newline at end of file
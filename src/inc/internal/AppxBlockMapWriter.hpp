@@ -7,21 +7,72 @@
 #include "Crypto.hpp"
 #include "XmlWriter.hpp"
 #include "ComHelper.hpp"
+#include "PerformanceCounters.hpp"
+#include "MemoryBudget.hpp"
+#include "PackageFileName.hpp"
 
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 namespace MSIX {
 
     static const std::uint32_t DefaultBlockSize = 65536;
 
+    // The block map xml is written to a SpillStream, so past this size it goes to a temporary file. Under a
+    // memory budget it goes there past a sixteenth of the budget, if that is less.
+    const std::uint64_t BlockMapSpillThreshold = 4 * 1024 * 1024;
+
+    // Computes the hash of whole files on a thread of its own, so the SHA256 of a file, which goes through its
+    // blocks one after the other, runs alongside the checksum and compression of the blocks that follow instead
+    // of after them. The blocks are copied to a bounded queue and hashed in the order they were added.
+    class FileHasher final
+    {
+    public:
+        ~FileHasher();
+
+        // Starts the hash of a new file
+        void Start();
+        // Waits while the queue is full
+        void Add(const std::uint8_t* block, std::uint32_t blockSize);
+        // Waits for the blocks of the file to be hashed, and rethrows the failure of the hash if there was one
+        void Finish(Sha256Digest& hash);
+
+    protected:
+        void Run() noexcept;
+
+        MSIX::SHA256 m_engine;
+        std::mutex m_lock;
+        std::condition_variable m_changed;
+        std::deque<std::vector<std::uint8_t>> m_queue;
+        // Buffers of blocks that were hashed, reused for the next ones
+        std::vector<std::vector<std::uint8_t>> m_free;
+        bool m_hashing = false;
+        bool m_stop = false;
+        std::exception_ptr m_failure;
+        std::thread m_thread;
+    };
+
     class BlockMapWriter final
     {
     public:
-        BlockMapWriter();
+        BlockMapWriter(const std::shared_ptr<MemoryBudget>& memoryBudget = nullptr);
 
         void EnableFileHash();
-        void AddFile(const std::string& name, std::uint64_t uncompressedSize, std::uint32_t lfh);
-        void AddBlock(const std::vector<std::uint8_t>& block, ULONG size, bool isCompressed);
+        bool IsFileHashEnabled() const { return m_enableFileHash; }
+        void SetPerformanceCounters(const std::shared_ptr<PerformanceCounters>& performanceCounters) { m_performanceCounters = performanceCounters; }
+        void AddFile(const PackageFileName& file, std::uint64_t uncompressedSize, std::uint32_t lfh);
+        void AddFile(const std::string& name, std::uint64_t uncompressedSize, std::uint32_t lfh)
+        {
+            AddFile(PackageFileName(name, false), uncompressedSize, lfh);
+        }
+        void AddBlock(const std::uint8_t* block, std::uint32_t blockSize, ULONG size, bool isCompressed);
+        // For blocks whose SHA256 was already computed
+        void AddBlock(const std::uint8_t* block, std::uint32_t blockSize, const Sha256Digest& hash, ULONG size, bool isCompressed);
         void CloseFile();
         void Close();
         ComPtr<IStream> GetStream() { return m_xmlWriter.GetStream(); }
@@ -30,8 +81,14 @@ namespace MSIX {
         XmlWriter m_xmlWriter;
 
     private:
-        MSIX::SHA256 m_fileHashEngine;
+        void WriteBlock(const std::uint8_t* block, std::uint32_t blockSize, const Sha256Digest& hash, ULONG size, bool isCompressed);
+
+        // Made for the first file that gets a <b4:FileHash>
+        std::unique_ptr<FileHasher> m_fileHasher;
+        // Reused for the hash of every block
+        Sha256Digest m_blockHash;
         bool m_enableFileHash = false;
         bool m_addFileHash = false;
+        std::shared_ptr<PerformanceCounters> m_performanceCounters;
     };
 }
\ No newline at end of file
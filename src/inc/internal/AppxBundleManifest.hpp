@@ -11,6 +11,7 @@
 #include "ComHelper.hpp"
 #include "Applicability.hpp"
 #include "VerifierObject.hpp"
+#include "IXml.hpp"
 
 // {ff82ffcd-747a-4df9-8879-853ab9dd15a1}
 #ifndef WIN32
@@ -48,7 +49,9 @@ namespace MSIX {
     class AppxBundleManifestObject final : public ComClass<AppxBundleManifestObject, IAppxBundleManifestReader, IVerifierObject, IBundleInfo>
     {
     public:
-        AppxBundleManifestObject(IMsixFactory* factory, const ComPtr<IStream>& stream);
+        AppxBundleManifestObject(IMsixFactory* factory, const ComPtr<IStream>& stream, bool validateSchema = true);
+        // For a bundle manifest already parsed, from the same bytes as stream, by the caller.
+        AppxBundleManifestObject(IMsixFactory* factory, const ComPtr<IStream>& stream, const ComPtr<IXmlDom>& dom);
 
          // IVerifierObject
         bool HasStream() override { return !!m_stream; }
@@ -35,7 +35,10 @@ namespace MSIX {
     class AppxBundleWriter final : public ComClass<AppxBundleWriter, IBundleWriter, IAppxBundleWriter, IAppxBundleWriter4>
     {
     public:
-        AppxBundleWriter(IMsixFactory* factory, const ComPtr<IZipWriter>& zip, std::uint64_t bundleVersion);
+        // With readManifests only the central directory and AppxManifest.xml of the packages are read, see
+        // MSIX_FACTORY_OPTION_WRITER_BUNDLE_READ_MANIFESTS. validatePackages still validates them then.
+        AppxBundleWriter(IMsixFactory* factory, const ComPtr<IZipWriter>& zip, std::uint64_t bundleVersion,
+            bool readManifests = false, bool validatePackages = false);
         ~AppxBundleWriter() {};
 
         // IBundleWriter
@@ -64,11 +67,28 @@ namespace MSIX {
         }
         WriterState;
 
-        void AddFileToPackage(const std::string& name, IStream* stream, bool toCompress,
+        // Returns the offset of the file data in the bundle.
+        std::uint64_t AddFileToPackage(const std::string& name, IStream* stream, APPX_COMPRESSION_OPTION compressionOpt,
             bool addToBlockMap, const char* contentType, bool forceContentTypeOverride = false);
 
+        std::uint32_t WriteStoredFile(IStream* stream, std::uint64_t size, IStream* zipFileStream, bool addToBlockMap);
+
         void AddPackageReferenceInternal(std::string fileName, IStream* packageStream, bool isDefaultApplicablePackage);
 
+        void AddPayloadPackageInternal(const std::string& fileName, IStream* packageStream, IAppxManifestReader* manifestReader,
+            bool isDefaultApplicablePackage);
+
+        // The manifest of a package, read alone with m_readManifests or from a package reader.
+        ComPtr<IAppxManifestReader> ReadPackageManifest(IStream* packageStream);
+
+        // Opens a package reader on the package, which throws if the package isn't valid.
+        void ValidatePackage(IStream* packageStream);
+
+        // Reads the package manifests on worker threads, and validates and adds each package to the bundle in
+        // order as soon as its manifest is ready. With m_validatePackages, all the packages are validated in
+        // parallel first. Packages are referenced by a flat bundle, otherwise they are stored in the bundle.
+        void AddPackages(const std::vector<std::pair<std::string, ComPtr<IStream>>>& packages, bool flatBundle);
+
         void AddExternalPackageReferenceInternal(std::string fileName, IStream* packageStream, bool isDefaultApplicablePackage);
             
         void ValidateAndAddPayloadFile(const std::string& name, IStream* stream, APPX_COMPRESSION_OPTION compressionOpt, const char* contentType);
@@ -81,6 +101,8 @@ namespace MSIX {
         BlockMapWriter m_blockMapWriter;
         ContentTypeWriter m_contentTypeWriter;
         BundleWriterHelper m_bundleWriterHelper;
+        bool m_readManifests = false;
+        bool m_validatePackages = false;
     };
 }
 
@@ -10,10 +10,21 @@
 #include "MSIXFactory.hpp"
 #include "IXml.hpp"
 #include "StorageObject.hpp"
+#include "Applicability.hpp"
+#include "SignatureCache.hpp"
+#include "BufferPool.hpp"
+#include "WorkerPool.hpp"
+#include "ProgressReporter.hpp"
+#include "PerformanceCounters.hpp"
+#include "MemoryBudget.hpp"
+#include "BlockStore.hpp"
+#include "BlockCache.hpp"
 
 #include <string>
 #include <vector>
 #include <array>
+#include <map>
+#include <mutex>
 
 namespace MSIX {
 
@@ -39,12 +50,23 @@ namespace MSIX {
         APPXSIGNATURE_P7X,
     };
 
+    // A factory can be shared by readers and writers created and used on any number of threads. What it keeps
+    // for all of them is either set once at construction, or behind a lock: the inflated resources and the
+    // schemas are filled in once and only read afterwards, the caches and pools lock themselves, and the
+    // extensions are swapped under m_extensionLock so a reader being created sees either the old one or the new.
     class AppxFactory final : public ComClass<AppxFactory, IMsixFactory, IAppxFactory, IXmlFactory, IAppxBundleFactory, IMsixFactoryOverrides, IAppxFactoryUtf8>
     {
     public:
         AppxFactory(MSIX_VALIDATION_OPTION validationOptions, MSIX_APPLICABILITY_OPTIONS applicability, MSIX_FACTORY_OPTIONS factoryOptions, 
             COTASKMEMALLOC* memalloc, COTASKMEMFREE* memfree ) :
-            m_validationOptions(validationOptions), m_applicabilityFlags(applicability), m_factoryOptions(factoryOptions), m_memalloc(memalloc), m_memfree(memfree)
+            m_validationOptions(validationOptions), m_applicabilityFlags(applicability), m_factoryOptions(factoryOptions), m_memalloc(memalloc), m_memfree(memfree),
+            m_signatureVerificationCache((factoryOptions & MSIX_FACTORY_OPTION_READER_CACHE_SIGNATURES) != 0),
+            m_memoryBudget(std::make_shared<MemoryBudget>()),
+            m_bufferPool(std::make_shared<BufferPool>(memalloc, memfree, m_memoryBudget)),
+            m_qualityOfService(std::make_shared<QualityOfService>()),
+            m_workerPool(std::make_shared<WorkerPool>(m_qualityOfService)),
+            m_progressReporter(std::make_shared<ProgressReporter>()),
+            m_performanceCounters((factoryOptions & MSIX_FACTORY_OPTION_PERFORMANCE_COUNTERS) ? std::make_shared<PerformanceCounters>() : nullptr)
         {
             ThrowErrorIf(Error::InvalidParameter, (m_memalloc == nullptr || m_memfree == nullptr), "allocator/deallocator pair not specified.")
             ComPtr<IMsixFactory> self;
@@ -67,17 +89,79 @@ namespace MSIX {
         HRESULT STDMETHODCALLTYPE CreateBundleManifestReader(IStream *inputStream, IAppxBundleManifestReader **manifestReader) noexcept override;
 
         // IMsixFactory
-        HRESULT MarshalOutString(std::string& internal, LPWSTR *result) noexcept override;
+        HRESULT MarshalOutString(const std::string& internal, LPWSTR *result) noexcept override;
         HRESULT MarshalOutWstring(std::wstring& internal, LPWSTR* result) noexcept override;
-        HRESULT MarshalOutStringUtf8(std::string& internal, LPSTR* result) noexcept override;
+        HRESULT MarshalOutStringUtf8(const std::string& internal, LPSTR* result) noexcept override;
         HRESULT MarshalOutBytes(std::vector<std::uint8_t>& data, UINT32* size, BYTE** buffer) noexcept override;
         MSIX_VALIDATION_OPTION GetValidationOptions() override { return m_validationOptions; }
         ComPtr<IStream> GetResource(const std::string& resource) override;
+        ApplicabilityCache& GetApplicabilityCache() override { return m_applicabilityCache; }
+        TrustedCertificateCache& GetTrustedCertificateCache() override { return m_trustedCertificateCache; }
+        SignatureVerificationCache& GetSignatureVerificationCache() override { return m_signatureVerificationCache; }
+        CertificateChainCache& GetCertificateChainCache() override { return m_certificateChainCache; }
+        std::shared_ptr<BufferPool> GetBufferPool() override { return m_bufferPool; }
+        std::shared_ptr<WorkerPool> GetWorkerPool() override { return m_workerPool; }
+        std::shared_ptr<ProgressReporter> GetProgressReporter() override { return m_progressReporter; }
+        std::shared_ptr<PerformanceCounters> GetPerformanceCounters() override { return m_performanceCounters; }
+        std::shared_ptr<MemoryBudget> GetMemoryBudget() override { return m_memoryBudget; }
+        std::shared_ptr<QualityOfService> GetQualityOfService() override { return m_qualityOfService; }
+        std::shared_ptr<BlockStore> GetBlockStore() override
+        {
+            std::lock_guard<std::mutex> lock(m_extensionLock);
+            return m_blockStore;
+        }
+        void SetBlockStore(const std::shared_ptr<BlockStore>& blockStore) override
+        {
+            std::lock_guard<std::mutex> lock(m_extensionLock);
+            m_blockStore = blockStore;
+        }
+        std::shared_ptr<BlockCache> GetBlockCache() override
+        {
+            std::lock_guard<std::mutex> lock(m_extensionLock);
+            return m_blockCache;
+        }
+        void SetBlockCache(const std::shared_ptr<BlockCache>& blockCache) override
+        {
+            std::lock_guard<std::mutex> lock(m_extensionLock);
+            m_blockCache = blockCache;
+        }
+        std::shared_ptr<CompressedBlockCache> GetCompressedBlockCache() override
+        {
+            std::lock_guard<std::mutex> lock(m_extensionLock);
+            return m_compressedBlockCache;
+        }
+        void SetCompressedBlockCache(const std::shared_ptr<CompressedBlockCache>& compressedBlockCache) override
+        {
+            std::lock_guard<std::mutex> lock(m_extensionLock);
+            m_compressedBlockCache = compressedBlockCache;
+        }
+        ComPtr<IMsixOutputStreamFactory> GetOutputStreamFactory() override
+        {
+            std::lock_guard<std::mutex> lock(m_extensionLock);
+            return m_outputStreamFactory;
+        }
+        ComPtr<IMsixManifestCache> GetManifestCache() override
+        {
+            std::lock_guard<std::mutex> lock(m_extensionLock);
+            return m_manifestCache;
+        }
+        ComPtr<IMsixIntegrityCache> GetIntegrityCache() override
+        {
+            std::lock_guard<std::mutex> lock(m_extensionLock);
+            return m_integrityCache;
+        }
+        ComPtr<IMsixFileStatisticsCallback> GetFileStatisticsCallback() override
+        {
+            std::lock_guard<std::mutex> lock(m_extensionLock);
+            return m_fileStatisticsCallback;
+        }
+        ComPtr<IAppxPackageReader> CreatePackageReaderWithIndex(const ComPtr<IStream>& inputStream, const PackageIndex* index) override;
 
         // IXmlFactory
-        MSIX::ComPtr<IXmlDom> CreateDomFromStream(XmlContentType footPrintType, const ComPtr<IStream>& stream) override
-        {   
-            return m_xmlFactory->CreateDomFromStream(footPrintType, stream);
+        MSIX::ComPtr<IXmlDom> CreateDomFromStream(XmlContentType footPrintType, const ComPtr<IStream>& stream, bool validateSchema) override
+        {
+            PerformanceCounters::Measure measure(m_performanceCounters.get(), MSIX_PERFORMANCE_COUNTER_STAGE_XML);
+            return m_xmlFactory->CreateDomFromStream(footPrintType, stream, validateSchema);
         }
 
         // IMsixFactoryOverrides
@@ -92,11 +176,33 @@ namespace MSIX {
         COTASKMEMFREE*  m_memfree;
         MSIX_VALIDATION_OPTION m_validationOptions;
         MSIX_FACTORY_OPTIONS m_factoryOptions;
-        ComPtr<IStorageObject> m_resourcezip;
-        std::vector<std::uint8_t> m_resourcesVector;
         MSIX_APPLICABILITY_OPTIONS m_applicabilityFlags;
+        ApplicabilityCache m_applicabilityCache;
+        std::mutex m_extensionLock;
         ComPtr<IMsixStreamFactory> m_streamFactory;
         ComPtr<IMsixApplicabilityLanguagesEnumerator> m_applicabilityLanguagesEnumerator;
+        ComPtr<IStream> m_trustedCertificates;
+        ComPtr<IMsixOutputStreamFactory> m_outputStreamFactory;
+        ComPtr<IMsixManifestCache> m_manifestCache;
+        ComPtr<IMsixIntegrityCache> m_integrityCache;
+        ComPtr<IMsixFileStatisticsCallback> m_fileStatisticsCallback;
+        TrustedCertificateCache m_trustedCertificateCache;
+        SignatureVerificationCache m_signatureVerificationCache;
+        CertificateChainCache m_certificateChainCache;
+        // Shared with the buffer pool and the streams that reserve memory in it
+        std::shared_ptr<MemoryBudget> m_memoryBudget;
+        // Outlives the factory while readers and streams still use its buffers
+        std::shared_ptr<BufferPool> m_bufferPool;
+        // Shared with the worker pool and the streams it throttles
+        std::shared_ptr<QualityOfService> m_qualityOfService;
+        // Shared with the readers and writers, which may run their parallel work after the factory is released
+        std::shared_ptr<WorkerPool> m_workerPool;
+        std::shared_ptr<ProgressReporter> m_progressReporter;
+        std::shared_ptr<PerformanceCounters> m_performanceCounters;
+        // Set and read under m_extensionLock
+        std::shared_ptr<BlockStore> m_blockStore;
+        std::shared_ptr<BlockCache> m_blockCache;
+        std::shared_ptr<CompressedBlockCache> m_compressedBlockCache;
 
     private:
         template<typename T>
@@ -18,18 +18,22 @@
 #include "FileStream.hpp"
 #include "UnicodeConversion.hpp"
 #include "StreamBase.hpp"
+#include "FileBlockReader.hpp"
 
 namespace MSIX {
-    class AppxFile : public ComClass<AppxFile, IAppxFile, IAppxFileUtf8>
+    class AppxFile : public ComClass<AppxFile, IAppxFile, IAppxFileUtf8, IMsixFileBlockReader>
     {
     public:
-        AppxFile(IMsixFactory* factory, const std::string& name, const ComPtr<IStream>& stream) : m_factory(factory), m_name(name), m_stream(stream)
+        // blockReader, when not null, reads the payload file by its blocks for IMsixFileBlockReader
+        AppxFile(IMsixFactory* factory, const std::string& name, const ComPtr<IStream>& stream,
+            const std::shared_ptr<FileBlockReader>& blockReader = nullptr) :
+            m_factory(factory), m_name(name), m_stream(stream), m_blockReader(blockReader)
         {
             LARGE_INTEGER start = { 0 };
             ULARGE_INTEGER end = { 0 };
             ThrowHrIfFailed(m_stream->Seek(start, StreamBase::Reference::END, &end));
             ThrowHrIfFailed(m_stream->Seek(start, StreamBase::Reference::START, nullptr));
-            m_size = end.u.LowPart;
+            m_size = end.QuadPart;
         }
 
         // IAppxFile methods
@@ -85,10 +89,38 @@ namespace MSIX {
             return m_factory->MarshalOutStringUtf8(m_name, fileName);
         } CATCH_RETURN();
 
+        // IMsixFileBlockReader
+        virtual HRESULT STDMETHODCALLTYPE GetBlockCount(UINT32* blockCount) noexcept override try
+        {
+            ThrowErrorIf(Error::InvalidParameter, (blockCount == nullptr), "bad pointer");
+            ThrowErrorIfNot(Error::NotSupported, m_blockReader, "the file isn't read by its blocks");
+            *blockCount = static_cast<UINT32>(m_blockReader->GetBlockCount());
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        virtual HRESULT STDMETHODCALLTYPE ReadBlock(UINT32 index, UINT32 bufferSize, BYTE* buffer, UINT32* bytesRead) noexcept override try
+        {
+            ThrowErrorIf(Error::InvalidParameter, (buffer == nullptr || bytesRead == nullptr), "bad pointer");
+            ThrowErrorIfNot(Error::NotSupported, m_blockReader, "the file isn't read by its blocks");
+            auto blockSize = m_blockReader->GetBlockSize(index);
+            ThrowErrorIf(Error::InvalidParameter, (bufferSize < blockSize), "the buffer can't hold the block");
+            *bytesRead = m_blockReader->ReadRange(static_cast<std::uint64_t>(index) * BLOCKMAP_BLOCK_SIZE, blockSize, buffer);
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        virtual HRESULT STDMETHODCALLTYPE ReadRange(UINT64 offset, UINT32 count, BYTE* buffer, UINT32* bytesRead) noexcept override try
+        {
+            ThrowErrorIf(Error::InvalidParameter, (bytesRead == nullptr), "bad pointer");
+            ThrowErrorIfNot(Error::NotSupported, m_blockReader, "the file isn't read by its blocks");
+            *bytesRead = m_blockReader->ReadRange(offset, count, buffer);
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
     protected:
         std::string m_name;
         ComPtr<IStream> m_stream;
         IMsixFactory* m_factory;
         std::uint64_t m_size;
+        std::shared_ptr<FileBlockReader> m_blockReader;
     };
 }
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include <vector>
 #include <memory>
 #include <map>
+#include <mutex>
 
 #include "AppxPackaging.hpp"
 #include "AppxPackageInfo.hpp"
@@ -18,6 +19,8 @@
 #include "IXml.hpp"
 #include "UnicodeConversion.hpp"
 
+namespace MSIX { struct ManifestSnapshot; }
+
 // {eff6d561-a236-4058-9f1d-8f93633fba4b}
 #ifndef WIN32
 interface IAppxManifestObject : public IUnknown
@@ -29,6 +32,8 @@ class IAppxManifestObject : public IUnknown
 {
 public:
     virtual const MSIX_PLATFORMS GetPlatform() = 0;
+    // Reads every section of the manifest, see ManifestSnapshot
+    virtual MSIX::ManifestSnapshot GetSnapshot(bool schemaValidated) = 0;
 };
 MSIX_INTERFACE(IAppxManifestObject, 0xeff6d561,0xa236,0x4058,0x9f,0x1d,0x8f,0x93,0x63,0x3f,0xba,0x4b);
 
@@ -81,7 +86,7 @@ namespace MSIX {
     class AppxManifestTargetDeviceFamily final : public ComClass<AppxManifestTargetDeviceFamily, IAppxManifestTargetDeviceFamily, IAppxManifestTargetDeviceFamilyUtf8, IAppxManifestTargetDeviceFamilyInternal>
     {
     public:
-        AppxManifestTargetDeviceFamily(IMsixFactory* factory, std::string& name, std::string& minVersion, std::string& maxVersion) :
+        AppxManifestTargetDeviceFamily(IMsixFactory* factory, const std::string& name, const std::string& minVersion, const std::string& maxVersion) :
             m_factory(factory), m_name(name)
         {
             m_minVersion = DecodeVersionNumber(minVersion);
@@ -130,7 +135,7 @@ namespace MSIX {
     class AppxManifestApplication final : public ComClass<AppxManifestApplication, IAppxManifestApplication, IAppxManifestApplicationUtf8>
     {
     public:
-        AppxManifestApplication(IMsixFactory* factory, std::string& aumid) :
+        AppxManifestApplication(IMsixFactory* factory, const std::string& aumid) :
             m_factory(factory), m_aumid(aumid)
         {}
 
@@ -219,7 +224,7 @@ namespace MSIX {
     class AppxManifestPackageDependency final : public ComClass<AppxManifestPackageDependency, IAppxManifestPackageDependency, IAppxManifestPackageDependencyUtf8>
     {
     public:
-        AppxManifestPackageDependency(IMsixFactory* factory, std::string& minVersion, std::string& name, std::string& publisher) :
+        AppxManifestPackageDependency(IMsixFactory* factory, const std::string& minVersion, const std::string& name, const std::string& publisher) :
             m_factory(factory), m_name(name), m_publisher(publisher)
         {
             m_minVersion = DecodeVersionNumber(minVersion);
@@ -368,7 +373,7 @@ namespace MSIX {
     class AppxManifestQualifiedResource final : public ComClass<AppxManifestQualifiedResource, IAppxManifestQualifiedResource, IAppxManifestQualifiedResourceUtf8, IAppxManifestQualifiedResourceInternal>
     {
     public:
-        AppxManifestQualifiedResource(IMsixFactory* factory, std::string& language, std::string& scale, std::string& DXFeatureLevel) :
+        AppxManifestQualifiedResource(IMsixFactory* factory, const std::string& language, const std::string& scale, const std::string& DXFeatureLevel) :
             m_factory(factory), m_language(language)
         {
             //TODO: Process and assign scale and DXFeatureLevel
@@ -410,12 +415,91 @@ namespace MSIX {
         DX_FEATURE_LEVEL m_DXFeatureLevel;
     };
 
-    // Object backed by AppxManifest.xml
+    // The values an AppxManifestObject gives out, read from AppxManifest.xml once, so an IMsixManifestCache can keep
+    // them and the manifest isn't parsed again. Save and Load convert it to and from an entry of the cache.
+    struct ManifestSnapshot
+    {
+        struct Identity
+        {
+            std::string name;
+            std::string version;
+            std::string resourceId;
+            std::string architecture;
+            std::string publisher;
+        };
+
+        struct PackageDependency
+        {
+            std::string name;
+            std::string publisher;
+            std::string minVersion;
+        };
+
+        // The publisher is empty when the manifest doesn't have it
+        struct MainPackageDependency
+        {
+            std::string name;
+            std::string publisher;
+        };
+
+        struct TargetDeviceFamily
+        {
+            std::string name;
+            std::string minVersion;
+            std::string maxVersion;
+        };
+
+        struct Resource
+        {
+            std::string language;
+            std::string scale;
+            std::string dxFeatureLevel;
+        };
+
+        // Only GENERAL, RESTRICTED, WINDOWS and CUSTOM, in the order they are given out
+        struct Capability
+        {
+            APPX_CAPABILITY_CLASS_TYPE capabilityClass;
+            std::string name;
+        };
+
+        bool schemaValidated = false;
+        Identity identity;
+        std::map<std::string, std::string> stringProperties;
+        std::map<std::string, bool> boolProperties;
+        std::vector<std::string> applicationIds;
+        std::vector<PackageDependency> packageDependencies;
+        std::vector<MainPackageDependency> mainPackageDependencies;
+        std::vector<TargetDeviceFamily> targetDeviceFamilies;
+        std::vector<Resource> resources;
+        std::vector<Capability> capabilities;
+
+        std::vector<std::uint8_t> Save() const;
+        // False when the entry wasn't written by Save of this version of the SDK
+        bool Load(const std::vector<std::uint8_t>& entry);
+    };
+
+    // Object backed by AppxManifest.xml. Only the identity and the target device families are read when the object
+    // is created, as they are needed to validate the package. The other sections are read from the retained DOM the
+    // first time they are asked for, and kept for the following calls. An object created from a snapshot gives out
+    // the values of the snapshot instead.
     class AppxManifestObject final : public ComClass<AppxManifestObject, ChainInterfaces<IAppxManifestReader4, IAppxManifestReader3, IAppxManifestReader2, IAppxManifestReader>,
                                                     IAppxManifestReader5, IVerifierObject, IAppxManifestObject, IMsixDocumentElement>
     {
     public:
-        AppxManifestObject(IMsixFactory* factory, const ComPtr<IStream>& stream);
+        AppxManifestObject(IMsixFactory* factory, const ComPtr<IStream>& stream, bool validateSchema = true);
+        // For a manifest already parsed, from the same bytes as stream, by the caller.
+        AppxManifestObject(IMsixFactory* factory, const ComPtr<IStream>& stream, const ComPtr<IXmlDom>& dom);
+        // For a manifest read before, from the same bytes as stream. It is parsed only if its document element
+        // is asked for.
+        AppxManifestObject(IMsixFactory* factory, const ComPtr<IStream>& stream, ManifestSnapshot&& snapshot);
+
+        // Reads every section of the manifest, which must have been parsed by the object.
+        ManifestSnapshot GetSnapshot(bool schemaValidated) override;
+
+        // Keeps the snapshot of the manifest instead of its DOM, which is several times the size of the xml. The
+        // DOM is parsed again if the document element is asked for. Must be called before the object is shared.
+        void ReleaseDom(bool schemaValidated);
 
         // IAppxManifestReader
         HRESULT STDMETHODCALLTYPE GetPackageId(IAppxManifestPackageId **packageId) noexcept override;
@@ -458,11 +542,33 @@ namespace MSIX {
     protected:
         std::vector<std::string> GetCapabilities(APPX_CAPABILITY_CLASS_TYPE capabilityClass);
 
+        // Sections read from the DOM
+        void ReadProperties(std::map<std::string, std::string>& stringValues, std::map<std::string, bool>& boolValues);
+        std::vector<std::string> ReadApplicationIds();
+        std::vector<ManifestSnapshot::PackageDependency> ReadPackageDependencies();
+        std::vector<ManifestSnapshot::MainPackageDependency> ReadMainPackageDependencies();
+        std::vector<ManifestSnapshot::TargetDeviceFamily> ReadTargetDeviceFamilies();
+        std::vector<ManifestSnapshot::Resource> ReadResources();
+        std::vector<ManifestSnapshot::Capability> ReadCapabilities();
+
+        void SetIdentity(ManifestSnapshot::Identity&& identity);
+
         ComPtr<IMsixFactory> m_factory;
         ComPtr<IStream> m_stream;
+        ManifestSnapshot::Identity m_identity;
         ComPtr<IAppxManifestPackageId> m_packageId;
         MSIX_PLATFORMS m_platform = MSIX_PLATFORM_NONE;
-        std::vector<ComPtr<IAppxManifestTargetDeviceFamily>> m_tdf;
+        // One of them is set. The DOM of a manifest created from a snapshot is parsed when it is asked for,
+        // guarded by m_lock.
         ComPtr<IXmlDom> m_dom;
+        std::unique_ptr<ManifestSnapshot> m_snapshot;
+
+        // Sections materialized on first access, guarded by m_lock. The arrays are shared by the enumerators made
+        // of them.
+        std::mutex m_lock;
+        ComPtr<IAppxManifestProperties> m_properties;
+        std::shared_ptr<const std::vector<ComPtr<IAppxManifestTargetDeviceFamily>>> m_tdf;
+        std::shared_ptr<const std::vector<ComPtr<IAppxManifestApplication>>> m_applications;
+        std::shared_ptr<const std::vector<ComPtr<IAppxManifestPackageDependency>>> m_packageDependencies;
     };
 }
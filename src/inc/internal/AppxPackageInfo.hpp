@@ -64,7 +64,7 @@ namespace MSIX {
         return static_cast<std::uint16_t>(value);
     }
 
-    static std::uint64_t DecodeVersionNumber(std::string& version)
+    static std::uint64_t DecodeVersionNumber(const std::string& version)
     {
         std::uint64_t result = 0;
         size_t position = 0;
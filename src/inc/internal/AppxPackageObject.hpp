@@ -8,6 +8,8 @@
 #include <vector>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #include "AppxPackaging.hpp"
 #include "MSIXWindows.hpp"
@@ -24,6 +26,24 @@
 #include "AppxPackageInfo.hpp"
 #include "AppxManifestObject.hpp"
 #include "DirectoryObject.hpp"
+#include "Arena.hpp"
+#include "FileFilter.hpp"
+#include "PackageLayout.hpp"
+#include "PackageIndex.hpp"
+#include "IntegrityCache.hpp"
+#include "FileStatistics.hpp"
+
+namespace MSIX {
+
+    // A payload file as it is stored in the zip container of a package, see IPackage::GetStoredPayloadFile
+    struct StoredPayloadFile
+    {
+        std::uint64_t size = 0;
+        FileBlocks blocks;
+        bool isCompressed = false;
+        ComPtr<IStream> stream;     // stored bytes of the file, deflated if it is compressed
+    };
+}
 
 // internal interface
 // {51b2c456-aaa9-46d6-8ec9-298220559189}
@@ -36,8 +56,21 @@ class IPackage : public IUnknown
 #endif
 {
 public:
-    virtual void Unpack(MSIX_PACKUNPACK_OPTION options, const MSIX::ComPtr<IDirectoryObject>& to) = 0;
+    // progress is told about the files extracted, the one of the factory is used when it is null. Only the files
+    // selected by filter are extracted, and the files of the packages of a bundle, all of them when it is null.
+    virtual void Unpack(MSIX_PACKUNPACK_OPTION options, const MSIX::ComPtr<IDirectoryObject>& to, std::uint32_t threadCount,
+        const std::shared_ptr<MSIX::ProgressReporter>& progress, const MSIX::FileFilter* filter = nullptr) = 0;
+    virtual void Verify(std::uint32_t threadCount) = 0;
     virtual std::vector<std::string>& GetFootprintFiles() = 0;
+    // Factory the reader was created with
+    virtual MSIX::ComPtr<IMsixFactory> GetFactory() = 0;
+    // What the sidecar index of the package keeps, see PackageIndex. Not supported for bundles.
+    virtual MSIX::PackageIndex GetIndex() = 0;
+    // The payload file of the block map named blockMapName as its bytes are stored in the package, to copy them
+    // into another one. Not supported for bundles and packages not read from a zip container.
+    virtual MSIX::StoredPayloadFile GetStoredPayloadFile(const std::string& blockMapName) = 0;
+    // True if targetName of to already has the content of the payload file fileName, checked against its block map hashes
+    virtual bool IsTargetUnchanged(const std::string& fileName, const std::string& targetName, const MSIX::ComPtr<IDirectoryObject>& to) = 0;
 };
 MSIX_INTERFACE(IPackage, 0x51b2c456,0xaaa9,0x46d6,0x8e,0xc9,0x29,0x82,0x20,0x55,0x91,0x89);
 
@@ -45,10 +78,11 @@ namespace MSIX {
     // Storage object representing the entire AppxPackage
     // Note: This class has is own implmentation of QueryInterface, if a new interface is implemented
     // AppxPackageObject::QueryInterface must also be modified too.
-    class AppxPackageObject final : public ComClass<AppxPackageObject, IAppxPackageReader, IPackage, IStorageObject, IAppxBundleReader, IAppxPackageReaderUtf8, IAppxBundleReaderUtf8>
+    class AppxPackageObject final : public ComClass<AppxPackageObject, IAppxPackageReader, IPackage, IStorageObject, IAppxBundleReader, IAppxPackageReaderUtf8, IAppxBundleReaderUtf8, IMsixPackageLayout>
     {
     public:
-        AppxPackageObject(IMsixFactory* factory, MSIX_VALIDATION_OPTION validation, MSIX_APPLICABILITY_OPTIONS applicabilityOptions, const ComPtr<IStorageObject>& container);
+        AppxPackageObject(IMsixFactory* factory, MSIX_VALIDATION_OPTION validation, MSIX_APPLICABILITY_OPTIONS applicabilityOptions, const ComPtr<IStorageObject>& container,
+            bool deferPayloadFiles = false, bool deferBundlePackages = false, bool releaseManifestDom = false, const PackageIndex* index = nullptr);
         ~AppxPackageObject() {}
 
         HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
@@ -82,6 +116,12 @@ namespace MSIX {
                 AddRef();
                 return S_OK;
             }
+            if (riid == UuidOfImpl<IMsixPackageLayout>::iid)
+            {
+                *ppvObject = static_cast<void*>(static_cast<IMsixPackageLayout*>(this));
+                AddRef();
+                return S_OK;
+            }
             #ifdef BUNDLE_SUPPORT
             if (riid == UuidOfImpl<IAppxBundleReader>::iid && m_isBundle)
             {
@@ -106,8 +146,14 @@ namespace MSIX {
         }
 
         // internal IPackage methods
-        void Unpack(MSIX_PACKUNPACK_OPTION options, const ComPtr<IDirectoryObject>& to) override;
+        void Unpack(MSIX_PACKUNPACK_OPTION options, const ComPtr<IDirectoryObject>& to, std::uint32_t threadCount,
+            const std::shared_ptr<ProgressReporter>& progress, const FileFilter* filter = nullptr) override;
+        void Verify(std::uint32_t threadCount) override;
         std::vector<std::string>& GetFootprintFiles() override { return m_footprintFiles; }
+        ComPtr<IMsixFactory> GetFactory() override { return m_factory; }
+        PackageIndex GetIndex() override;
+        StoredPayloadFile GetStoredPayloadFile(const std::string& blockMapName) override;
+        bool IsTargetUnchanged(const std::string& fileName, const std::string& targetName, const ComPtr<IDirectoryObject>& to) override;
 
         // IAppxPackageReader
         HRESULT STDMETHODCALLTYPE GetBlockMap(IAppxBlockMapReader** blockMapReader) noexcept override;
@@ -135,12 +181,57 @@ namespace MSIX {
         // IAppxBundleReaderUtf8
         HRESULT STDMETHODCALLTYPE GetPayloadPackage(LPCSTR fileName, IAppxFile **payloadPackage) noexcept override;
 
+        // IMsixPackageLayout
+        HRESULT STDMETHODCALLTYPE GetFileRanges(LPCSTR utf8FileName, MSIX_BYTE_RANGE* localFileHeader, MSIX_BYTE_RANGE* data,
+            MSIX_BYTE_RANGE* dataDescriptor) noexcept override;
+        HRESULT STDMETHODCALLTYPE GetBlockCount(LPCSTR utf8FileName, UINT32* count) noexcept override;
+        HRESULT STDMETHODCALLTYPE GetBlockRange(LPCSTR utf8FileName, UINT32 blockIndex, MSIX_BYTE_RANGE* range) noexcept override;
+        HRESULT STDMETHODCALLTYPE GetCentralDirectoryRange(MSIX_BYTE_RANGE* range) noexcept override;
+
     protected:
         // Helper methods
         void VerifyFile(const ComPtr<IStream>& stream, const std::string& fileName, const ComPtr<IAppxBlockMapInternal>& blockMapInternal);
         ComPtr<IAppxFile> GetAppxFile(const std::string& fileName);
+        ComPtr<IAppxFile> CreatePayloadFile(const std::string& opcFileName, const std::string& fileName, const ComPtr<IAppxBlockMapInternal>& blockMapInternal);
+        void CreateDeferredPayloadFiles();
+        ComPtr<IStream> GetBundlePackageStream(const ComPtr<IAppxBundleManifestPackageInfo>& package);
+        ComPtr<IAppxPackageReader> ValidateBundlePackage(const ComPtr<IAppxBundleManifestPackageInfo>& package, const ComPtr<IStream>& packageStream);
+        std::vector<ComPtr<IAppxPackageReader>> ValidateBundlePackages(const std::vector<ComPtr<IAppxBundleManifestPackageInfo>>& packages);
+        bool PrefetchBundlePackageEnds(const std::vector<ComPtr<IAppxBundleManifestPackageInfo>>& packages);
+        void PrefetchBundlePackageFootprints(const std::vector<ComPtr<IAppxBundleManifestPackageInfo>>& packages, const std::vector<ComPtr<IStream>>& streams);
+        void ExtractFile(const std::string& fileName, const std::string& targetName, const ComPtr<IDirectoryObject>& to,
+            ProgressReporter& progress);
+        bool ExtractFileInParallel(const std::string& fileName, const std::string& targetName, const ComPtr<IDirectoryObject>& to, std::uint32_t threadCount,
+            ProgressReporter& progress);
+        // Extracts a payload file of a single block with one read of the container and one write of the target,
+        // false if it isn't one
+        bool ExtractSmallFile(const std::string& fileName, const std::string& targetName, const ComPtr<IDirectoryObject>& to,
+            ProgressReporter& progress);
+        // Copies a package of a bundle straight from the bundle file by the file system, false if it can't
+        bool CopyBundlePackage(const std::string& fileName, const std::string& targetName, const ComPtr<IDirectoryObject>& to,
+            ProgressReporter& progress);
+        // Copies a large stored payload file straight from the package file by the file system, false if it can't
+        bool CopyStoredFile(const std::string& fileName, const std::string& targetName, const ComPtr<IDirectoryObject>& to,
+            ProgressReporter& progress);
+        // size is the size of the file once extracted
+        ComPtr<IStream> OpenTargetFile(const std::string& targetName, const ComPtr<IDirectoryObject>& to, std::uint64_t size);
+        // Tells callback, if there is one, about fileName once it is extracted
+        void ReportFileStatistics(const ComPtr<IMsixFileStatisticsCallback>& callback, const FileStatistics& statistics, const std::string& fileName);
+        // Ranges of the blocks of a file of the block map, computed on first use
+        const std::vector<ZipByteRange>& GetBlockRanges(const std::string& blockMapName);
 
-        std::map<std::string, ComPtr<IAppxFile>> m_files;
+        // Holds the nodes of the containers below, they get an entry per file while the package is opened
+        MonotonicArena m_arena;
+        ArenaUnorderedMap<std::string, ComPtr<IAppxFile>> m_files{ m_arena };
+        // Payload files not wired up yet, keyed by OPC name with their block map name as value.
+        ArenaMap<std::string, std::string> m_deferredPayloadFiles{ m_arena };
+        // Guards m_files, the deferred files and the deferred bundle packages once the package is open, they are
+        // wired up or validated on first use and clients can ask for them from several threads at once.
+        std::mutex m_filesLock;
+        // Packages of a bundle not validated yet, keyed by file name. Validated in GetAppxFile, under m_filesLock.
+        std::map<std::string, ComPtr<IAppxBundleManifestPackageInfo>> m_deferredBundlePackages;
+        // Block ranges of the files asked for with IMsixPackageLayout, keyed by block map name.
+        std::map<std::string, std::vector<ZipByteRange>> m_blockRanges;
 
         MSIX_VALIDATION_OPTION      m_validation = MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_FULL;
         ComPtr<IMsixFactory>        m_factory;
@@ -155,6 +246,16 @@ namespace MSIX {
         std::vector<std::string>    m_applicablePackagesNames;
         std::vector<ComPtr<IAppxPackageReader>> m_applicablePackages;
         bool                        m_isBundle = false;
+        // Whether the manifest was validated against the schema when the package was read
+        bool                        m_manifestSchemaValidated = false;
+        // Set when the bytes stored before the signature still have to be checked against its file records digest,
+        // which Verify does.
+        bool                        m_fileRecordsPending = false;
+        // Null unless the factory has an integrity cache and the package is read from a local file
+        std::shared_ptr<IntegrityRecord> m_integrityRecord;
+        // The payload files, made on first use of GetPayloadFiles and shared by the enumerators it returns
+        std::mutex m_payloadFileObjectsLock;
+        std::shared_ptr<const std::vector<ComPtr<IAppxFile>>> m_payloadFileObjects;
     };
 
     class AppxFilesEnumerator final : public MSIX::ComClass<AppxFilesEnumerator, IAppxFilesEnumerator>
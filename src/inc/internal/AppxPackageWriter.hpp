@@ -10,10 +10,37 @@
 #include "AppxBlockMapWriter.hpp"
 #include "ContentTypeWriter.hpp"
 #include "ZipObjectWriter.hpp"
+#include "DeflateStream.hpp"
+#include "BasePackage.hpp"
+#include "Crypto.hpp"
+#include "MemoryBudget.hpp"
+#include "CompressionPacer.hpp"
+#include "FileStatistics.hpp"
+#include "CompressedBlockCache.hpp"
+#include "AppxPackageObject.hpp"
 
+#include <chrono>
 #include <map>
 #include <memory>
 #include <future>
+#include <string>
+#include <vector>
+
+namespace MSIX {
+
+    // A payload file as a build system knows it from a previous pack. The block hashes and crc are only known if
+    // blockHashes isn't empty, the deflated blocks if compressedBlocks isn't null.
+    struct InventoryFile
+    {
+        std::string name;
+        std::string contentType;    // empty for the content type of the extension
+        std::uint64_t size = 0;
+        std::vector<Sha256Digest> blockHashes;
+        std::uint32_t crc = 0;
+        std::vector<std::uint64_t> compressedBlockSizes;
+        ComPtr<IStream> compressedBlocks;
+    };
+}
 
 // internal interface
 // {32e89da5-7cbb-4443-8cf0-b84eedb51d0a}
@@ -26,21 +53,73 @@ class IPackageWriter : public IUnknown
 #endif
 {
 public:
-    // TODO: add options if needed
-    virtual void PackPayloadFiles(const MSIX::ComPtr<IDirectoryObject>& from) = 0;
+    // Compressed files are deflated and hashed by up to threadCount threads, 1 does it all on the calling thread.
+    // Files with compressible content types are deflated with compressionOption. With adaptiveCompression,
+    // the first block of those files is compressed first and the file is stored if it barely shrinks.
+    virtual void PackPayloadFiles(const MSIX::ComPtr<IDirectoryObject>& from, std::uint32_t threadCount,
+        APPX_COMPRESSION_OPTION compressionOption, bool adaptiveCompression) = 0;
+
+    // Same as PackPayloadFiles for the files of an inventory, in its order. The files that still have the size of
+    // the inventory use what it has of them instead of being hashed and deflated again, see InventoryFile.
+    virtual void PackInventoryFiles(const MSIX::ComPtr<IDirectoryObject>& from, const std::vector<MSIX::InventoryFile>& files,
+        std::uint32_t threadCount, APPX_COMPRESSION_OPTION compressionOption, bool adaptiveCompression) = 0;
+
+    // Compressed files that are also compressed in the base package copy the deflated bytes of the blocks
+    // whose size and hash didn't change from it. Must be called before adding files.
+    virtual void SetBasePackage(const MSIX::ComPtr<IStream>& basePackage) = 0;
+
+    // Files are written with their sizes in the local file header instead of a data descriptor after their data,
+    // unless the output is written forward, hashed for signing or a size needs zip64. Must be called before adding files.
+    virtual void SetCompactZipRecords(bool compact) = 0;
+
+    // Compressed payload files with the size, crc and block hashes of one already deflated, with the same
+    // compression option, copy its deflated blocks instead of deflating them again. Must be called before adding files.
+    virtual void SetDuplicateReuse(bool reuse) = 0;
+
+    // PackPayloadFiles lowers the compression level of the files it packs, down to storing them, as needed to pack
+    // them all within budget. Zero packs every file at the level asked for. Must be called before adding files.
+    virtual void SetCompressionTimeBudget(std::chrono::milliseconds budget) = 0;
+
+    // PackPayloadFiles adds the payload files of files first, in that order, and then the others, so the files an
+    // app reads as it starts are together at the start of the package. Names are relative to the directory, with
+    // either separator, and the ones that aren't payload files of it are ignored. Must be called before adding files.
+    virtual void SetAccessOrder(const std::vector<std::string>& files) = 0;
 };
 MSIX_INTERFACE(IPackageWriter, 0x32e89da5,0x7cbb,0x4443,0x8c,0xf0,0xb8,0x4e,0xed,0xb5,0x1d,0x0a);
 
 namespace MSIX {
+
+    // With adaptive compression, files whose first block deflates to more than this percentage of its size are stored
+    const std::uint64_t AdaptiveCompressionMaxPercent = 95;
+
+    // With duplicate reuse, the deflated bytes kept for the copies of files, files that don't fit aren't kept
+    const std::uint64_t DuplicateReuseMaxSize = 64 * 1024 * 1024;
+
+    // AddPayloadFiles deflates the files of more than a block and up to this size whole, several at a time, into
+    // segments that are then copied to the package in order. Larger files deflate their blocks in parallel instead.
+    const std::uint64_t SpooledFileMaxSize = 4 * 1024 * 1024;
+    // The most bytes of files in a batch of spooled files. The segments past the memory limit are temporary files.
+    const std::uint64_t SpoolBatchMaxSize = 256 * 1024 * 1024;
+
     class AppxPackageWriter final : public ComClass<AppxPackageWriter, IPackageWriter, IAppxPackageWriter,
-        IAppxPackageWriterUtf8, IAppxPackageWriter3, IAppxPackageWriter3Utf8>
+        IAppxPackageWriterUtf8, IAppxPackageWriter3, IAppxPackageWriter3Utf8, IMsixPackageSigningDigests, IMsixPackageWriterCopy,
+        IMsixPackageWriterThreads>
     {
     public:
-        AppxPackageWriter(IMsixFactory* factory, const ComPtr<IZipWriter>& zip, bool enableFileHash);
+        // With signingDigests the package is written ready to be signed, zip must compute its signing digests.
+        AppxPackageWriter(IMsixFactory* factory, const ComPtr<IZipWriter>& zip, bool enableFileHash, bool signingDigests = false);
         ~AppxPackageWriter() {};
 
         // IPackageWriter
-        void PackPayloadFiles(const ComPtr<IDirectoryObject>& from) override;
+        void PackPayloadFiles(const ComPtr<IDirectoryObject>& from, std::uint32_t threadCount,
+            APPX_COMPRESSION_OPTION compressionOption, bool adaptiveCompression) override;
+        void PackInventoryFiles(const ComPtr<IDirectoryObject>& from, const std::vector<InventoryFile>& files,
+            std::uint32_t threadCount, APPX_COMPRESSION_OPTION compressionOption, bool adaptiveCompression) override;
+        void SetBasePackage(const ComPtr<IStream>& basePackage) override;
+        void SetCompactZipRecords(bool compact) override;
+        void SetDuplicateReuse(bool reuse) override;
+        void SetCompressionTimeBudget(std::chrono::milliseconds budget) override;
+        void SetAccessOrder(const std::vector<std::string>& files) override;
 
         // IAppxPackageWriter
         HRESULT STDMETHODCALLTYPE AddPayloadFile(LPCWSTR fileName, LPCWSTR contentType,
@@ -59,6 +138,15 @@ namespace MSIX {
         HRESULT STDMETHODCALLTYPE AddPayloadFiles(UINT32 fileCount, APPX_PACKAGE_WRITER_PAYLOAD_STREAM_UTF8* payloadFiles,
             UINT64 memoryLimit) noexcept override;
 
+        // IMsixPackageSigningDigests
+        HRESULT STDMETHODCALLTYPE GetSigningDigests(UINT32* digestsSize, BYTE** digests) noexcept override;
+
+        // IMsixPackageWriterCopy
+        HRESULT STDMETHODCALLTYPE AddPayloadFileFromPackage(IAppxPackageReader* reader, LPCSTR utf8FileName) noexcept override;
+
+        // IMsixPackageWriterThreads
+        HRESULT STDMETHODCALLTYPE SetCompressionThreadCount(UINT32 threadCount) noexcept override;
+
     protected:
         typedef enum
         {
@@ -68,19 +156,128 @@ namespace MSIX {
         }
         WriterState;
 
-        void ValidateAndAddPayloadFile(const std::string& name, IStream* stream,
+        struct PayloadFile
+        {
+            std::string name;
+            std::string contentType;
+            APPX_COMPRESSION_OPTION compressionOpt;
+            ComPtr<IStream> stream;
+        };
+
+        // A payload file of up to a block, read into memory and compressed ahead of being written
+        struct PreparedFile
+        {
+            const PayloadFile* file = nullptr;
+            std::vector<std::uint8_t> data;
+            std::vector<std::uint8_t> compressed;
+            Sha256Digest blockHash;
+            ULONG blockSize = 0;
+            std::uint32_t crc = 0;
+            std::unique_ptr<FileStatistics> statistics;     // null without a file statistics callback
+        };
+
+        // A payload file of more than a block, deflated, hashed and checksummed whole by a worker into its segment,
+        // the bytes of the file in the zip file
+        struct SpooledFile
+        {
+            const PayloadFile* file = nullptr;
+            std::uint64_t size = 0;
+            ComPtr<IStream> segment;
+            std::vector<Sha256Digest> blockHashes;
+            std::vector<ULONG> blockSizes;  // in the segment
+            std::uint32_t crc = 0;
+            std::unique_ptr<FileStatistics> statistics;     // null without a file statistics callback
+        };
+
+        // The deflated blocks of a compressed payload file, kept to write the files with the same content
+        struct DeflatedFile
+        {
+            APPX_COMPRESSION_OPTION compressionOpt = APPX_COMPRESSION_OPTION_NONE;
+            std::uint32_t crc = 0;
+            std::vector<Sha256Digest> blockHashes;
+            std::vector<ULONG> compressedBlockSizes;
+            std::vector<std::uint8_t> compressed;   // the blocks followed by the stream termination
+            MemoryBudget::Reservation reservation;
+        };
+
+        void AddPayloadFilesInternal(const std::vector<PayloadFile>& files, std::uint64_t memoryLimit);
+        void AddPreparedFiles(std::vector<PreparedFile>& batch);
+        void WritePreparedFile(const PreparedFile& prepared);
+        void AddSpooledFiles(std::vector<SpooledFile>& batch);
+        void SpoolFile(SpooledFile& spooled);
+        void WriteSpooledFile(const SpooledFile& spooled);
+
+        void ValidatePayloadFile(const std::string& name, APPX_COMPRESSION_OPTION compressionOpt);
+
+        void ValidateAndAddPayloadFile(const PackageFileName& file, IStream* stream,
             APPX_COMPRESSION_OPTION compressionOpt, const char* contentType);
 
-        void AddFileToPackage(const std::string& name, IStream* stream, bool toCompress,
+        void AddFileToPackage(const std::string& name, IStream* stream, APPX_COMPRESSION_OPTION compressionOpt,
+            bool addToBlockMap, const char* contentType, bool forceContentTypeOverride = false);
+        void AddFileToPackage(const PackageFileName& file, IStream* stream, APPX_COMPRESSION_OPTION compressionOpt,
             bool addToBlockMap, const char* contentType, bool forceContentTypeOverride = false);
 
+        // Writes a file with the block hashes and crc of the inventory. A compressed file copies the deflated blocks of
+        // the inventory followed by termination and isn't read.
+        void AddInventoryFile(const InventoryFile& file, const PackageFileName& fileName, IStream* stream,
+            APPX_COMPRESSION_OPTION compressionOpt, const std::string& contentType, const std::vector<std::uint8_t>& termination);
+
+        // Writes the stored bytes of a payload file of another package, checking every block against its hash
+        void AddStoredFile(const StoredPayloadFile& file, const PackageFileName& fileName, const std::string& contentType);
+
+        std::uint32_t AddCompressedBlocksInParallel(IStream* stream, const std::uint8_t* view, std::uint64_t uncompressedSize,
+            APPX_COMPRESSION_OPTION compressionOpt, const ComPtr<IStream>& zipFileStream, bool addToBlockMap,
+            const BaseFile* baseFile, CompressedBlockCache* blockCache, DeflatedFile* deflated = nullptr);
+
+        // Reads the file to find a kept file with the same content and leaves the stream at its start. Returns null if
+        // there isn't any.
+        const DeflatedFile* FindDeflatedCopy(IStream* stream, std::uint64_t uncompressedSize, APPX_COMPRESSION_OPTION compressionOpt);
+
+        // Writes the deflated blocks of a kept file for a file of the block map. Returns its crc.
+        std::uint32_t AddDeflatedCopy(const DeflatedFile& file, std::uint64_t uncompressedSize, const ComPtr<IStream>& zipFileStream,
+            bool reportProgress);
+
+        // Keeps the file if it fits in DuplicateReuseMaxSize and the memory budget
+        void KeepDeflatedFile(std::uint64_t uncompressedSize, DeflatedFile&& file);
+
         void ValidateCompressionOption(APPX_COMPRESSION_OPTION compressionOpt);
 
+        // Null unless the factory has a file statistics callback
+        std::unique_ptr<FileStatistics> CreateFileStatistics();
+        // Tells the callback of the factory about a payload file once it is in the package. Does nothing when
+        // statistics is null.
+        void ReportFileStatistics(const FileStatistics* statistics, const std::string& name, std::uint64_t size, std::uint64_t compressedSize);
+
+        // Deflates the first block of the stream and leaves the stream at its start. Returns false if the
+        // block doesn't shrink below AdaptiveCompressionMaxPercent of its size.
+        bool IsWorthCompressing(IStream* stream);
+
+        // Set for the duration of PackPayloadFiles and AddPayloadFiles
+        void SetCompressionThreads(std::uint32_t threadCount, std::uint64_t memoryLimit);
+
         WriterState m_state;
+        std::uint32_t m_compressionThreads = 1;
+        std::uint32_t m_payloadFilesThreads = 1;
+        std::size_t m_maxBlocksInFlight = 0;
+        std::unique_ptr<BlockDeflater> m_trialDeflater;
+        std::vector<std::uint8_t> m_trialBlock;
+        std::unique_ptr<BasePackage> m_basePackage;
         ComPtr<IMsixFactory> m_factory;
         ComPtr<IZipWriter> m_zipWriter;
         BlockMapWriter m_blockMapWriter;
         ContentTypeWriter m_contentTypeWriter;
+        bool m_signingDigests = false;
+        bool m_compactZipRecords = false;
+        bool m_reuseDuplicates = false;
+        std::chrono::milliseconds m_timeBudget = std::chrono::milliseconds(0);
+        // Position of the payload files of SetAccessOrder by their name with back slashes
+        std::map<std::string, std::size_t> m_accessOrder;
+        // The kept deflated files by uncompressed size, and the size of their deflated bytes
+        std::multimap<std::uint64_t, DeflatedFile> m_deflatedFiles;
+        std::uint64_t m_deflatedFilesSize = 0;
+        // The digests of the footprint files a signature covers, hashed as they are added
+        Sha256Digest m_blockMapDigest;
+        Sha256Digest m_contentTypesDigest;
     };
 }
 
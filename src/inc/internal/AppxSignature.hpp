@@ -9,6 +9,8 @@
 #include "StreamBase.hpp"
 #include "AppxFactory.hpp"
 
+#include <limits>
+
 namespace MSIX {
 
     enum class SignatureOrigin
@@ -44,6 +46,10 @@ namespace MSIX {
 
     const unsigned HASH_BYTES = 32;
 
+    // Parts of a package covered by the signature that aren't files, for GetValidationStream
+    #define SIGNATURE_CENTRAL_DIRECTORY_PART "<AXCD>"
+    #define SIGNATURE_FILE_RECORDS_PART      "<AXPC>"
+
     struct DigestHash
     {
         DigestName name;
@@ -71,7 +77,16 @@ namespace MSIX {
 
         void ValidateDigestHeader(DigestHeader* header, std::size_t numberOfHashes, std::size_t modHashes);
 
+        // Set by the signature validator to when the signing certificate is valid, in seconds since 1970. A cached
+        // validation is only reused while the certificate is in the same part of that period as when it was made.
+        void SetCertificateValidity(std::uint64_t notBefore, std::uint64_t notAfter)
+        {
+            m_notBefore = notBefore;
+            m_notAfter = notAfter;
+        }
+
         SignatureOrigin GetSignatureOrigin() { return m_signatureOrigin; }
+        bool HasDigests() { return m_hasDigests; }
 
         using Digest = std::vector<std::uint8_t>;        
         Digest& GetFileRecordsDigest()       { return m_FileRecords; }
@@ -81,6 +96,11 @@ namespace MSIX {
         Digest& GetCodeIntegrityDigest()     { return m_CodeIntegrity; }
 
     protected:
+        std::vector<std::uint8_t> SaveVerification();
+        bool LoadVerification(const std::vector<std::uint8_t>& entry);
+        std::uint64_t GetEpochTime();
+        int GetValidityPeriod(std::uint64_t time);
+
         bool                         m_hasDigests;
         Digest                       m_FileRecords;
         Digest                       m_CentralDirectory;
@@ -91,5 +111,11 @@ namespace MSIX {
         MSIX_VALIDATION_OPTION       m_validationOptions;
         ComPtr<IStream>              m_stream;
         std::string                  m_publisher;
+        std::uint64_t                m_notBefore = 0;
+        std::uint64_t                m_notAfter = std::numeric_limits<std::uint64_t>::max();
+        std::uint64_t                m_validatedAt = 0;
+        // Given to the validation streams
+        std::shared_ptr<PerformanceCounters> m_performanceCounters;
+        std::shared_ptr<MemoryBudget> m_memoryBudget;
     };
 } // namespace MSIX
\ No newline at end of file
@@ -0,0 +1,63 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "ComHelper.hpp"
+#include "DirectoryObject.hpp"
+#include "StorageObject.hpp"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace MSIX {
+
+    // The files of a zip or tar archive as the directory a package is packed from, see PackPackageFromArchive, so
+    // they are read from the archive instead of being extracted first. The root of the archive is the root of the
+    // package. Files are read from the archive as they are packed: inflated by a zip reader, or read in place from
+    // a tar archive. Read only. Directories are left out, and tar archives with links or devices aren't supported.
+    class ArchiveDirectory final : public ComClass<ArchiveDirectory, IStorageObject, IDirectoryObject>
+    {
+    public:
+        ArchiveDirectory(const ComPtr<IStream>& archive, const std::string& name);
+
+        // IStorageObject
+        std::vector<std::string> GetFileNames(FileNameOptions) override { return m_fileNames; }
+        // Throws FileNotFound for a file that isn't in the archive, like a directory does
+        ComPtr<IStream> GetFile(const std::string& fileName) override;
+        std::string GetFileName() override { return m_name; }
+
+        // IDirectoryObject
+        ComPtr<IStream> OpenFile(const std::string& fileName, FileStream::Mode mode, std::uint64_t expectedSize = 0) override;
+        std::unique_ptr<MappedOutputFile> OpenMappedFile(const std::string&, std::uint64_t) override { return nullptr; }
+        void CreateDirectories(const std::vector<std::string>&) override { NOTSUPPORTED; }
+        // Archives don't keep times that are worth ordering by, the files are in the order of the archive
+        std::multimap<std::uint64_t, std::string> GetFilesByLastModDate() override;
+        std::string GetFilePath(const std::string&) override { NOTSUPPORTED; }
+        bool LinkFile(const std::string&, const std::string&) override { return false; }
+        bool CopyFileRange(const std::string&, const std::string&, std::uint64_t, std::uint64_t) override { return false; }
+        void WriteFileContent(const std::string&, const void*, std::size_t) override { NOTSUPPORTED; }
+        void WaitForClosedFiles() override {}
+
+    protected:
+        struct TarFile
+        {
+            std::uint64_t offset;
+            std::uint64_t size;
+        };
+
+        void ReadTar();
+
+        ComPtr<IStream> m_archive;
+        std::string m_name;
+        // Set for a zip archive
+        ComPtr<IStorageObject> m_zip;
+        // Where the files of a tar archive are in it
+        std::map<std::string, TarFile> m_tarFiles;
+        std::vector<std::string> m_fileNames;
+    };
+}
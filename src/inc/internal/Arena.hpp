@@ -0,0 +1,87 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <new>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace MSIX {
+
+    const std::size_t MonotonicArenaChunkSize = 64 * 1024;
+
+    // Hands out memory from large chunks and releases all of it at once when destroyed. Meant for the
+    // metadata an object keeps per file of a package, which is created while the package is opened and
+    // lives as long as the object. Not thread safe, like the containers that use it.
+    class MonotonicArena final
+    {
+    public:
+        MonotonicArena() = default;
+        MonotonicArena(const MonotonicArena&) = delete;
+        MonotonicArena& operator=(const MonotonicArena&) = delete;
+
+        void* Allocate(std::size_t size, std::size_t alignment)
+        {
+            auto start = (m_next + alignment - 1) & ~(static_cast<std::uintptr_t>(alignment) - 1);
+            if (m_chunks.empty() || start + size > m_end)
+            {   // Large requests, like the buckets of a hash table, get a chunk of their own
+                auto chunkSize = std::max(MonotonicArenaChunkSize, size + alignment);
+                m_chunks.emplace_back(new std::uint8_t[chunkSize]);
+                m_next = reinterpret_cast<std::uintptr_t>(m_chunks.back().get());
+                m_end = m_next + chunkSize;
+                start = (m_next + alignment - 1) & ~(static_cast<std::uintptr_t>(alignment) - 1);
+            }
+            m_next = start + size;
+            return reinterpret_cast<void*>(start);
+        }
+
+    protected:
+        std::vector<std::unique_ptr<std::uint8_t[]>> m_chunks;
+        std::uintptr_t m_next = 0;
+        std::uintptr_t m_end = 0;
+    };
+
+    // Standard allocator over a MonotonicArena, the arena must outlive the container using it.
+    // Deallocation is a no op, the memory goes back when the arena is destroyed.
+    template<class T>
+    class ArenaAllocator
+    {
+    public:
+        using value_type = T;
+
+        ArenaAllocator(MonotonicArena& arena) noexcept : m_arena(&arena) {}
+        template<class U>
+        ArenaAllocator(const ArenaAllocator<U>& other) noexcept : m_arena(other.GetArena()) {}
+
+        T* allocate(std::size_t count)
+        {
+            return static_cast<T*>(m_arena->Allocate(count * sizeof(T), alignof(T)));
+        }
+        void deallocate(T*, std::size_t) noexcept {}
+
+        MonotonicArena* GetArena() const noexcept { return m_arena; }
+
+    protected:
+        MonotonicArena* m_arena;
+    };
+
+    template<class T, class U>
+    bool operator==(const ArenaAllocator<T>& left, const ArenaAllocator<U>& right) noexcept { return left.GetArena() == right.GetArena(); }
+    template<class T, class U>
+    bool operator!=(const ArenaAllocator<T>& left, const ArenaAllocator<U>& right) noexcept { return !(left == right); }
+
+    template<class Key, class Value>
+    using ArenaMap = std::map<Key, Value, std::less<Key>, ArenaAllocator<std::pair<const Key, Value>>>;
+
+    template<class Key, class Value>
+    using ArenaUnorderedMap = std::unordered_map<Key, Value, std::hash<Key>, std::equal_to<Key>, ArenaAllocator<std::pair<const Key, Value>>>;
+}
@@ -0,0 +1,171 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "Exceptions.hpp"
+#include "StreamBase.hpp"
+#include "ComHelper.hpp"
+#include "IoScheduler.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace MSIX {
+
+    // Bytes written synchronously before a stream starts writing through the I/O scheduler
+    const std::uint64_t AsyncWriteThreshold = 1024 * 1024;
+    // Bytes queued before Write waits for the scheduler
+    const std::uint64_t AsyncWriteMaxPending = 8 * 1024 * 1024;
+    const std::size_t AsyncWriteMaxFreeBuffers = 8;
+
+    // Write only stream that writes to another stream through an I/O scheduler, so producing the next bytes
+    // (inflating, hashing) overlaps writing the previous ones. Small files are written synchronously, the
+    // scheduler is only used once more than AsyncWriteThreshold bytes are written. The queued buffers are
+    // written one at a time and in order, so the streams of many files extracted at once share the threads
+    // of the scheduler instead of each having its own. A write failure is returned by a later Write or by
+    // Commit, so callers must Commit to know all the data got written. Seek and Read wait for the queued
+    // writes first.
+    class AsyncWriteStream final : public StreamBase
+    {
+    public:
+        AsyncWriteStream(const ComPtr<IStream>& stream, const std::shared_ptr<IoScheduler>& scheduler = IoScheduler::GetDefault()) :
+            m_stream(stream), m_streamInternal(stream.As<IStreamInternal>()), m_scheduler(scheduler) {}
+
+        virtual ~AsyncWriteStream() override
+        {   // Queued writes still complete, they reference this stream.
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_changed.wait(lock, [this]() { return !m_writing; });
+        }
+
+        // IStream
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept override try
+        {
+            Drain();
+            return m_stream->Seek(move, origin, newPosition);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) noexcept override try
+        {
+            Drain();
+            return m_stream->Read(buffer, countBytes, bytesRead);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Write(const void* buffer, ULONG countBytes, ULONG* bytesWritten) noexcept override try
+        {
+            if (bytesWritten) { *bytesWritten = 0; }
+            if (!m_async && (m_bytesWritten + countBytes <= AsyncWriteThreshold))
+            {
+                ULONG written = 0;
+                ThrowHrIfFailed(m_stream->Write(buffer, countBytes, &written));
+                m_bytesWritten += written;
+                if (bytesWritten) { *bytesWritten = written; }
+                return static_cast<HRESULT>(Error::OK);
+            }
+            m_async = true;
+
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_changed.wait(lock, [this]() { return (m_pendingBytes < AsyncWriteMaxPending) || FAILED(m_error); });
+            ThrowHrIfFailed(m_error);
+            std::vector<std::uint8_t> data;
+            if (!m_freeBuffers.empty())
+            {
+                data = std::move(m_freeBuffers.back());
+                m_freeBuffers.pop_back();
+            }
+            auto bytes = static_cast<const std::uint8_t*>(buffer);
+            data.assign(bytes, bytes + countBytes);
+            m_pendingBytes += countBytes;
+            m_queue.push_back(std::move(data));
+            if (!m_writing) { SubmitNext(); }
+            m_bytesWritten += countBytes;
+            if (bytesWritten) { *bytesWritten = countBytes; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        // Waits for the queued writes and returns the first write failure, if any.
+        HRESULT STDMETHODCALLTYPE Commit(DWORD flags) noexcept override try
+        {
+            Drain();
+            return m_stream->Commit(flags);
+        } CATCH_RETURN();
+
+        // IStreamInternal
+        std::uint64_t GetSize() override { Drain(); return m_streamInternal->GetSize(); }
+        bool IsCompressed() override { return false; }
+        std::string GetName() override { return m_streamInternal->GetName(); }
+
+    protected:
+        // Submits the write of the oldest queued buffer. Called with m_lock held.
+        void SubmitNext()
+        {
+            m_writing = true;
+            auto& data = m_queue.front();
+            std::vector<IoRequest> requests;
+            requests.push_back(IoRequest::Write(m_stream, IoCurrentPosition, data.data(), static_cast<ULONG>(data.size())));
+            try
+            {
+                m_scheduler->Submit(std::move(requests), [this](IoBatch& batch) { WriteDone(batch.GetResult()); });
+            }
+            catch (...)
+            {
+                m_writing = false;
+                throw;
+            }
+        }
+
+        void WriteDone(HRESULT hr) noexcept
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            auto data = std::move(m_queue.front());
+            m_queue.pop_front();
+            m_pendingBytes -= data.size();
+            if (m_freeBuffers.size() < AsyncWriteMaxFreeBuffers) { m_freeBuffers.push_back(std::move(data)); }
+            if (FAILED(hr) && SUCCEEDED(m_error))
+            {   // Nothing after a failed write is written
+                m_error = hr;
+                m_pendingBytes = 0;
+                m_queue.clear();
+            }
+            m_writing = false;
+            if (!m_queue.empty())
+            {
+                try
+                {
+                    SubmitNext();
+                }
+                catch (...)
+                {
+                    m_error = static_cast<HRESULT>(Error::Unexpected);
+                    m_pendingBytes = 0;
+                    m_queue.clear();
+                }
+            }
+            m_changed.notify_all();
+        }
+
+        void Drain()
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_changed.wait(lock, [this]() { return !m_writing; });
+            ThrowHrIfFailed(m_error);
+        }
+
+        ComPtr<IStream> m_stream;
+        ComPtr<IStreamInternal> m_streamInternal;
+        std::shared_ptr<IoScheduler> m_scheduler;
+        std::uint64_t m_bytesWritten = 0;
+        bool m_async = false;
+        std::mutex m_lock;
+        std::condition_variable m_changed;
+        std::deque<std::vector<std::uint8_t>> m_queue;
+        std::vector<std::vector<std::uint8_t>> m_freeBuffers;
+        std::uint64_t m_pendingBytes = 0;
+        bool m_writing = false;
+        HRESULT m_error = static_cast<HRESULT>(Error::OK);
+    };
+}
@@ -0,0 +1,54 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "ComHelper.hpp"
+#include "MSIXFactory.hpp"
+#include "AppxBlockMapObject.hpp"
+#include "ZipObjectReader.hpp"
+
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace MSIX {
+
+    // A compressed payload file of a base package. Every block was deflated on its own and ends on a full
+    // flush, so the deflated bytes of a block can be copied into another deflate stream.
+    struct BaseFile
+    {
+        std::uint64_t size = 0;
+        FileBlocks blocks;
+        std::vector<std::uint64_t> offsets; // offset of every block in the deflated stream
+        ComPtr<IStream> stream;             // deflated bytes of the file
+
+        // True if the block of the base file at index has the same size and hash
+        bool IsSameBlock(std::size_t index, std::uint32_t blockSize, const Sha256Digest& hash) const;
+
+        // Reads the deflated bytes of the block at index and inflates them on their own to check them against the
+        // hash of the block. Returns false if they don't inflate to exactly the block, or if they end the deflate
+        // stream and the block isn't the last one of the file being written. endsStream tells if they do.
+        bool ReadBlock(std::size_t index, bool last, std::vector<std::uint8_t>& compressed, bool& endsStream) const;
+    };
+
+    // A previous build of a package. Its block map is an index of the hashes of every block of its payload
+    // files, so the blocks that didn't change are copied from it instead of being compressed again. Every block
+    // copied is checked against its hash first, it should be one written by the package writer.
+    class BasePackage final
+    {
+    public:
+        BasePackage(IMsixFactory* factory, const ComPtr<IStream>& stream);
+
+        // Returns the file if the base package has it compressed, nullptr otherwise. name uses forward slashes.
+        std::unique_ptr<BaseFile> FindCompressedFile(const std::string& name);
+
+    protected:
+        ComPtr<ZipObjectReader> m_zip;
+        ComPtr<IAppxBlockMapInternal> m_blockMap;
+        std::set<std::string> m_fileNames;
+    };
+}
@@ -0,0 +1,69 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "Crypto.hpp"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace MSIX {
+
+    // Inflated blocks of payload files shared by the block readers of a factory, see MsixSetBlockCache. A block is
+    // found by the SHA256 its block map gives for it, and a block is only added once it matched it, so a block found
+    // is used without being inflated or hashed again, whatever package it was read from. Split in shards with a lock
+    // each, by the first byte of the hash, so threads reading different blocks rarely wait for each other. Every
+    // shard keeps its part of maxBytes, the least recently used block dropped first. Thread safe.
+    class BlockCache final
+    {
+    public:
+        BlockCache(std::uint64_t maxBytes);
+
+        // Copies to buffer the size bytes of the block with hash. Returns false if the cache doesn't have it.
+        bool Find(const Sha256Digest& hash, std::uint32_t size, std::uint8_t* buffer);
+
+        // Adds a block whose bytes match hash. A block larger than a shard is left out.
+        void Add(const Sha256Digest& hash, const std::uint8_t* bytes, std::uint32_t size);
+
+    protected:
+        static const std::size_t ShardCount = 16;
+
+        struct DigestHash
+        {
+            std::size_t operator()(const Sha256Digest& hash) const
+            {
+                // The bytes of a SHA256 are already spread evenly
+                std::size_t value = 0;
+                std::memcpy(&value, hash.data() + 1, sizeof(value));
+                return value;
+            }
+        };
+
+        struct Entry
+        {
+            std::vector<std::uint8_t> bytes;
+            std::list<Sha256Digest>::iterator use;
+        };
+
+        struct Shard
+        {
+            std::mutex lock;
+            std::unordered_map<Sha256Digest, Entry, DigestHash> entries;
+            // Keys of entries, the most recently used first
+            std::list<Sha256Digest> uses;
+            std::uint64_t bytes = 0;
+        };
+
+        Shard& GetShard(const Sha256Digest& hash) { return m_shards[hash[0] % ShardCount]; }
+
+        const std::uint64_t m_maxShardBytes;
+        std::array<Shard, ShardCount> m_shards;
+    };
+}
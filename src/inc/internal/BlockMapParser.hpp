@@ -0,0 +1,36 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "BlockMapStream.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+namespace MSIX {
+
+    // Block size and compressed size of a block whose Block element has no Size attribute. They depend on the
+    // size of its file, which is only validated once the whole document was parsed.
+    const std::uint64_t BlockMapParserNoSize = std::numeric_limits<std::uint64_t>::max();
+
+    // A File element of AppxBlockMap.xml. The attributes are the decoded values, empty if not there, and the
+    // blocks are the run of the table that starts at firstBlock.
+    struct BlockMapParserFile
+    {
+        std::string name;
+        std::string size;
+        std::string lfhSize;
+        std::size_t firstBlock = 0;
+        std::size_t blockCount = 0;
+    };
+
+    // Reads AppxBlockMap.xml in one pass, without a DOM, adding the blocks to table and the File elements to files.
+    // Only the document the block map schema describes is handled, with UTF-8 text and canonical hashes and sizes.
+    // Anything else, including malformed XML, returns false and the caller has to read the document with the DOM,
+    // which tells what is wrong with it. The semantic checks of the block map are left to the caller.
+    bool ParseBlockMap(const std::uint8_t* data, std::size_t size, BlockTable& table, std::vector<BlockMapParserFile>& files);
+}
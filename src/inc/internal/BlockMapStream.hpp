@@ -12,37 +12,99 @@
 #include "ComHelper.hpp"
 #include "Crypto.hpp"
 #include "AppxFactory.hpp"
+#include "IntegrityCache.hpp"
 
 #include <string>
 #include <map>
 #include <functional>
 #include <algorithm>
+#include <cstring>
+#include <memory>
 #include <vector>
 
 namespace MSIX {
   
     const std::uint64_t BLOCKMAP_BLOCK_SIZE = 65536; // 64KB
 
-    typedef struct Block
+    // The blocks of every file of a block map. Every field is an array of its own, so the digests of a file are
+    // contiguous and nothing is allocated per block.
+    struct BlockTable
+    {
+        std::vector<Sha256Digest>  hashes;
+        std::vector<std::uint64_t> compressedSizes;
+        std::vector<std::uint64_t> blockSizes;
+
+        void Add(const Sha256Digest& hash, std::uint64_t compressedSize, std::uint64_t blockSize)
+        {
+            hashes.push_back(hash);
+            compressedSizes.push_back(compressedSize);
+            blockSizes.push_back(blockSize);
+        }
+    };
+
+    // A block of a BlockTable
+    struct Block
     {
         std::uint64_t compressedSize;
         std::uint64_t blockSize;
-        std::vector<std::uint8_t> hash;
-    } Block;
+        const Sha256Digest& hash;
+    };
 
-    typedef struct BlockPlusStream : Block
+    // The blocks of one file, a run of the table of its block map. Copies share the table.
+    class FileBlocks
     {
-        std::uint64_t   size;
-        std::uint64_t   offset;         
-        ComPtr<IStream> stream;
-    } BlockPlusStream;
+    public:
+        class Iterator
+        {
+        public:
+            Iterator(const FileBlocks* blocks, std::size_t index) : m_blocks(blocks), m_index(index) {}
+            Block operator*() const { return (*m_blocks)[m_index]; }
+            Iterator& operator++() { m_index++; return *this; }
+            bool operator==(const Iterator& other) const { return m_index == other.m_index; }
+            bool operator!=(const Iterator& other) const { return m_index != other.m_index; }
+        private:
+            const FileBlocks* m_blocks;
+            std::size_t m_index;
+        };
+
+        FileBlocks() = default;
+        FileBlocks(const std::shared_ptr<const BlockTable>& table, std::size_t first, std::size_t count) :
+            m_table(table), m_first(first), m_count(count)
+        {}
+
+        std::size_t size() const { return m_count; }
+        bool empty() const { return m_count == 0; }
+        Iterator begin() const { return Iterator(this, 0); }
+        Iterator end() const { return Iterator(this, m_count); }
+
+        const Sha256Digest& Hash(std::size_t index) const { return m_table->hashes[m_first + index]; }
+        std::uint64_t CompressedSize(std::size_t index) const { return m_table->compressedSizes[m_first + index]; }
+        Block operator[](std::size_t index) const
+        {
+            return Block{ m_table->compressedSizes[m_first + index], m_table->blockSizes[m_first + index], m_table->hashes[m_first + index] };
+        }
+
+    private:
+        std::shared_ptr<const BlockTable> m_table;
+        std::size_t m_first = 0;
+        std::size_t m_count = 0;
+    };
+
+    // Bytes of a block that are inflated and hashed at a time, so each chunk is hashed while it is still in cache
+    const std::uint32_t BlockHashChunkSize = 32 * 1024;
 
     // This represents a subset of a Stream
+    // A block is inflated and hashed chunk by chunk, and its bytes are only handed out once its digest matches.
+    // A read that covers a whole block gets it inflated straight into its buffer, other reads are served from
+    // the one block kept in memory. With an integrity record, a file whose blocks have all been validated is
+    // recorded, and a file recorded before is read without validating its blocks.
     class BlockMapStream final : public StreamBase
     {
     public:
-        BlockMapStream(IMsixFactory* factory, std::string decodedName, const ComPtr<IStream>& stream, std::vector<Block>& blocks)
-            : m_factory(factory), m_decodedName(decodedName), m_stream(stream)
+        BlockMapStream(IMsixFactory* factory, std::string decodedName, const ComPtr<IStream>& stream, const FileBlocks& blocks,
+            const std::shared_ptr<IntegrityRecord>& integrityRecord = nullptr)
+            : m_factory(factory), m_decodedName(decodedName), m_stream(stream), m_streamInternal(stream.As<IStreamInternal>()), m_blocks(blocks),
+            m_integrityRecord(integrityRecord)
         {
             // Determine overall stream size
             ULARGE_INTEGER uli;
@@ -56,24 +118,26 @@ namespace MSIX {
             li.QuadPart = 0;
             ThrowHrIfFailed(stream->Seek(li, STREAM_SEEK_SET, nullptr));
 
-            // Build a vector of all HashStream->RangeStream's for the blocks in the blockmap
-            std::uint64_t offset = 0;
-            std::uint64_t sizeRemaining = m_streamSize;
-            for (auto block = blocks.begin(); ((sizeRemaining != 0) && (block != blocks.end())); block++)
+            // Only the blocks that hold bytes of the stream are read
+            m_blockCount = static_cast<std::size_t>(std::min(static_cast<std::uint64_t>(blocks.size()), (m_streamSize + BLOCKMAP_BLOCK_SIZE - 1) / BLOCKMAP_BLOCK_SIZE));
+
+            // Every block of a compressed file is compressed on its own, so the compressed sizes of the
+            // blocks tell the underlying stream where it can restart decompression after a seek.
+            if (m_streamInternal->IsCompressed())
+            {
+                std::vector<std::uint64_t> compressedBlockSizes;
+                compressedBlockSizes.reserve(blocks.size());
+                for (std::size_t index = 0; index < blocks.size(); index++)
+                {
+                    compressedBlockSizes.push_back(blocks.CompressedSize(index));
+                }
+                m_streamInternal->SetSeekPoints(BLOCKMAP_BLOCK_SIZE, compressedBlockSizes);
+            }
+
+            if (m_integrityRecord)
             {
-                auto rangeStream = ComPtr<IStream>::Make<RangeStream>(offset, std::min(sizeRemaining, BLOCKMAP_BLOCK_SIZE), stream.Get());                
-                auto hashStream = ComPtr<IStream>::Make<HashStream>(rangeStream, block->hash);
-                std::uint64_t blockSize = std::min(sizeRemaining, BLOCKMAP_BLOCK_SIZE);
-
-                BlockPlusStream bs;
-                bs.offset = offset;
-                bs.size   = blockSize;
-                bs.stream = hashStream;
-                bs.hash   = block->hash;
-                m_blockStreams.emplace_back(std::move(bs));
-                
-                offset          += blockSize;
-                sizeRemaining   -= blockSize;
+                m_trusted = m_integrityRecord->IsVerified(m_decodedName);
+                m_validatedBlocks.resize(m_blockCount);
             }
 
             // Reset seek position to beginning
@@ -99,8 +163,6 @@ namespace MSIX {
             }
             m_relativePosition = std::max((std::uint64_t)0, std::min(m_relativePosition, m_streamSize));
             if (newPosition) { newPosition->QuadPart = m_relativePosition; }
-
-            m_currentBlock = m_blockStreams.begin();
             return S_OK;
         } CATCH_RETURN();
 
@@ -109,33 +171,44 @@ namespace MSIX {
             std::uint32_t bytesRead = 0;
             if (m_relativePosition < m_streamSize)
             {
-                std::uint32_t bytesToRead = std::min(static_cast<std::uint32_t>(countBytes), static_cast<std::uint32_t>(m_streamSize - m_relativePosition));
-                while (m_currentBlock != m_blockStreams.end() && bytesToRead > 0)
+                // The rest of a file over 4GB doesn't fit in 32 bits, take the minimum first
+                std::uint32_t bytesToRead = static_cast<std::uint32_t>(std::min(static_cast<std::uint64_t>(countBytes), m_streamSize - m_relativePosition));
+                if (m_trusted)
                 {
-                    if ((m_currentBlock->offset + m_currentBlock->size) <= m_relativePosition)
-                    {
-                        m_currentBlock++;
-                    }
-                    else if (m_currentBlock->offset <= m_relativePosition)
+                    bytesRead = ReadTrusted(buffer, bytesToRead);
+                    bytesToRead = 0;
+                }
+                while (bytesToRead > 0)
+                {
+                    // Every block but the last one is BLOCKMAP_BLOCK_SIZE bytes, so the block that holds the
+                    // current position is known without looking for it.
+                    std::size_t index = static_cast<std::size_t>(m_relativePosition / BLOCKMAP_BLOCK_SIZE);
+                    if (index >= m_blockCount) { break; }
+                    std::uint64_t blockOffset = index * BLOCKMAP_BLOCK_SIZE;
+                    std::uint32_t blockSize = static_cast<std::uint32_t>(std::min(m_streamSize - blockOffset, BLOCKMAP_BLOCK_SIZE));
+                    std::uint32_t positionInBlock = static_cast<std::uint32_t>(m_relativePosition - blockOffset);
+                    std::uint32_t actual = std::min(bytesToRead, blockSize - positionInBlock);
+                    if ((positionInBlock == 0) && (actual == blockSize) && (m_bufferedBlock != index))
                     {
-                        std::uint64_t positionInBlock = m_relativePosition - m_currentBlock->offset;
-                        LARGE_INTEGER li{0};
-                        li.QuadPart = positionInBlock;
-                        ThrowHrIfFailed(m_currentBlock->stream->Seek(li, STREAM_SEEK_SET, nullptr));
-
-                        std::uint32_t count = std::min(bytesToRead, static_cast<std::uint32_t>(m_currentBlock->size - positionInBlock));
-                        ULONG actual = 0;
-                        ThrowHrIfFailed(m_currentBlock->stream->Read(buffer, count, &actual));
-
-                        buffer = static_cast<std::uint8_t*>(buffer) + actual;
-                        m_relativePosition += actual;
-                        bytesToRead -= actual;
-                        bytesRead += actual;
+                        ReadBlock(index, blockOffset, blockSize, static_cast<std::uint8_t*>(buffer));
                     }
                     else
                     {
-                        m_currentBlock = m_blockStreams.begin();
+                        if (m_bufferedBlock != index)
+                        {
+                            m_blockBuffer.resize(static_cast<std::size_t>(BLOCKMAP_BLOCK_SIZE));
+                            m_bufferedBlock = NoBlock;
+                            ReadBlock(index, blockOffset, blockSize, m_blockBuffer.data());
+                            m_bufferedBlock = index;
+                        }
+                        std::memcpy(buffer, m_blockBuffer.data() + positionInBlock, actual);
                     }
+                    if (m_integrityRecord) { RecordValidated(index); }
+
+                    buffer = static_cast<std::uint8_t*>(buffer) + actual;
+                    m_relativePosition += actual;
+                    bytesToRead -= actual;
+                    bytesRead += actual;
                 }
             }
             if (actualRead) { *actualRead = bytesRead; }
@@ -145,26 +218,90 @@ namespace MSIX {
         // IStreamInternal
         std::uint64_t GetSize() override
         {   // The underlying ZipFileStream/InflateStream object knows, so go ask it.
-            return m_stream.As<IStreamInternal>()->GetSize();
+            return m_streamInternal->GetSize();
         }
 
         bool IsCompressed() override
         {   // The underlying ZipFileStream/InflateStream object knows, so go ask it.
-            return m_stream.As<IStreamInternal>()->IsCompressed();
+            return m_streamInternal->IsCompressed();
         }
 
         std::string GetName() override
         {   // The underlying ZipFileStream/InflateStream object knows, so go ask it.
-            return m_stream.As<IStreamInternal>()->GetName();
+            return m_streamInternal->GetName();
         }
       
     protected:
-        std::vector<BlockPlusStream>::iterator m_currentBlock;
-        std::vector<BlockPlusStream> m_blockStreams;
+        // Reads the bytes of the file as they are, without validating any block
+        std::uint32_t ReadTrusted(void* buffer, std::uint32_t bytesToRead)
+        {
+            LARGE_INTEGER li{0};
+            li.QuadPart = m_relativePosition;
+            ThrowHrIfFailed(m_stream->Seek(li, STREAM_SEEK_SET, nullptr));
+            std::uint32_t bytesRead = 0;
+            while (bytesRead < bytesToRead)
+            {
+                ULONG actual = 0;
+                ThrowHrIfFailed(m_stream->Read(static_cast<std::uint8_t*>(buffer) + bytesRead, bytesToRead - bytesRead, &actual));
+                if (actual == 0) { break; }
+                bytesRead += actual;
+            }
+            m_relativePosition += bytesRead;
+            return bytesRead;
+        }
+
+        // Inflates the block into destination a chunk at a time, hashing each chunk right after it, and fails if
+        // the block doesn't match its digest.
+        void ReadBlock(std::size_t index, std::uint64_t blockOffset, std::uint32_t blockSize, std::uint8_t* destination)
+        {
+            LARGE_INTEGER li{0};
+            li.QuadPart = blockOffset;
+            ThrowHrIfFailed(m_stream->Seek(li, STREAM_SEEK_SET, nullptr));
+            auto performanceCounters = m_factory ? m_factory->GetPerformanceCounters() : nullptr;
+            m_hashEngine.Reset();
+            std::uint32_t position = 0;
+            while (position < blockSize)
+            {
+                ULONG actual = 0;
+                ThrowHrIfFailed(m_stream->Read(destination + position, std::min(BlockHashChunkSize, blockSize - position), &actual));
+                ThrowErrorIf(MSIX::Error::SignatureInvalid, (actual == 0), "read failed");
+                PerformanceCounters::Measure measure(performanceCounters.get(), MSIX_PERFORMANCE_COUNTER_STAGE_HASH, actual);
+                m_hashEngine.HashData(destination + position, actual);
+                position += actual;
+            }
+            Sha256Digest hash;
+            m_hashEngine.FinalizeAndGetHashValue(hash);
+            ThrowErrorIfNot(MSIX::Error::SignatureInvalid, (hash == m_blocks.Hash(index)), "Signature hash doesn't match digest hash");
+        }
+
+        // Every block of the file is validated once it has been read from
+        void RecordValidated(std::size_t index)
+        {
+            if (m_validatedBlocks[index]) { return; }
+            m_validatedBlocks[index] = true;
+            if ((++m_validatedCount == m_blockCount) && (m_blockCount == m_blocks.size()))
+            {
+                m_integrityRecord->AddVerified({ m_decodedName });
+            }
+        }
+
+        FileBlocks m_blocks;
+        std::size_t m_blockCount = 0;
+        // The block in m_blockBuffer, NoBlock when there is none
+        static const std::size_t NoBlock = static_cast<std::size_t>(-1);
+        std::size_t m_bufferedBlock = NoBlock;
+        std::vector<std::uint8_t> m_blockBuffer;
+        SHA256 m_hashEngine;
         std::uint64_t m_relativePosition;
         std::uint64_t m_streamSize;
         std::string m_decodedName;
         ComPtr<IStream> m_stream;
+        ComPtr<IStreamInternal> m_streamInternal;
         IMsixFactory* m_factory;
+        std::shared_ptr<IntegrityRecord> m_integrityRecord;
+        // Every block of the file matched before, see IntegrityRecord
+        bool m_trusted = false;
+        std::vector<bool> m_validatedBlocks;
+        std::size_t m_validatedCount = 0;
     };
 }
\ No newline at end of file
@@ -0,0 +1,49 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "ComHelper.hpp"
+#include "DirectoryObject.hpp"
+
+#include <cstdint>
+#include <string>
+
+namespace MSIX {
+
+    class FileBlocks;
+
+    // Content addressed store of the payload files unpacked by the readers of a factory, see MsixSetBlockStore.
+    // A file is stored under the SHA256 of its size and of the hashes of its blocks in the block map, so the
+    // same content unpacked from any package has the same key and is linked instead of being extracted again.
+    // Files only get in the store once extracted, after their blocks have been checked against the block map.
+    // Thread safe, and processes can share a store.
+    class BlockStore final
+    {
+    public:
+        BlockStore(const std::string& root);
+
+        // Key of the content of a payload file
+        static std::string GetKey(std::uint64_t size, const FileBlocks& blocks);
+
+        // Makes targetName of to the stored file with key. Returns false if the store doesn't have it, or it
+        // can't be linked, then the file is extracted as usual. The caller checks the linked file against the
+        // block map before using it: a hard linked target is the stored file itself, which anyone who can
+        // write to the store, or to a target linked to it before, can have changed since it was added.
+        bool Materialize(const std::string& key, IDirectoryObject* to, const std::string& targetName);
+
+        // Removes targetName of to, materialized from the stored file with key, and the stored file, whose
+        // content doesn't match its key.
+        void Drop(const std::string& key, IDirectoryObject* to, const std::string& targetName);
+
+        // Adds the extracted targetName of to the store. The store is a cache, a file it can't take is left out.
+        void Add(const std::string& key, IDirectoryObject* to, const std::string& targetName);
+
+    protected:
+        // Keys are spread in directories named after their first byte, so none gets too large
+        static std::string GetStoreName(const std::string& key) { return key.substr(0, 2) + "/" + key; }
+
+        ComPtr<IDirectoryObject> m_root;
+    };
+}
@@ -0,0 +1,98 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "ComHelper.hpp"
+#include "MemoryBudget.hpp"
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace MSIX {
+
+    // Size classes are powers of two from BufferPoolMinClassSize to BufferPoolMaxClassSize, which covers the
+    // inflate windows, the blockmap block sized copy buffers and the buffers used to hash runs of blocks.
+    const std::size_t BufferPoolMinClassSize = 32 * 1024;
+    const std::size_t BufferPoolMaxClassSize = 1024 * 1024;
+    const std::size_t BufferPoolClassCount = 6;
+    const std::size_t BufferPoolMaxFreePerClass = 8;
+
+    class BufferPool;
+
+    // Move only buffer that goes back to where it came from when destroyed.
+    class PooledBuffer final
+    {
+    public:
+        PooledBuffer() = default;
+        PooledBuffer(const PooledBuffer&) = delete;
+        PooledBuffer& operator=(const PooledBuffer&) = delete;
+        PooledBuffer(PooledBuffer&& other) noexcept { Swap(other); }
+        PooledBuffer& operator=(PooledBuffer&& other) noexcept { PooledBuffer(std::move(other)).Swap(*this); return *this; }
+        ~PooledBuffer();
+
+        // Without a pool the buffer comes from the heap.
+        static PooledBuffer Allocate(const std::shared_ptr<BufferPool>& pool, std::size_t size);
+
+        std::uint8_t* data() const noexcept { return m_data; }
+        std::size_t size() const noexcept { return m_size; }
+        bool empty() const noexcept { return m_size == 0; }
+
+    protected:
+        friend class BufferPool;
+
+        void Swap(PooledBuffer& other) noexcept
+        {
+            std::swap(m_data, other.m_data);
+            std::swap(m_size, other.m_size);
+            std::swap(m_capacity, other.m_capacity);
+            std::swap(m_pool, other.m_pool);
+            std::swap(m_extension, other.m_extension);
+        }
+
+        std::uint8_t* m_data = nullptr;
+        std::size_t m_size = 0;
+        std::size_t m_capacity = 0;
+        std::shared_ptr<BufferPool> m_pool;
+        // The allocator extension the buffer came from, if any
+        ComPtr<IMsixBufferAllocator> m_extension;
+    };
+
+    // I/O buffers of a factory. They come from the IMsixBufferAllocator extension when there is one, otherwise
+    // from the factory's allocator, by size class. A few freed buffers of each class are kept for the next
+    // request, so the windows of the files a package reads one after the other are reused. Thread safe, the
+    // buffers are used and given back by the threads that unpack and validate packages.
+    // The buffers from the factory's allocator, kept ones included, are reserved in budget. Buffers from the
+    // extension are the host's memory and aren't.
+    class BufferPool final : public std::enable_shared_from_this<BufferPool>
+    {
+    public:
+        BufferPool(COTASKMEMALLOC* memalloc, COTASKMEMFREE* memfree, const std::shared_ptr<MemoryBudget>& budget = nullptr);
+        ~BufferPool();
+
+        PooledBuffer Get(std::size_t size);
+        void SetExtension(const ComPtr<IMsixBufferAllocator>& extension);
+        ComPtr<IMsixBufferAllocator> GetExtension();
+
+    protected:
+        friend class PooledBuffer;
+
+        void Return(PooledBuffer& buffer) noexcept;
+        // Reserves a buffer in the budget, freeing the kept buffers first if it doesn't fit.
+        void Reserve(std::size_t capacity);
+        void Free(std::uint8_t* buffer, std::size_t capacity) noexcept;
+
+        COTASKMEMALLOC* m_memalloc;
+        COTASKMEMFREE*  m_memfree;
+        std::mutex m_lock;
+        ComPtr<IMsixBufferAllocator> m_extension;
+        std::array<std::vector<std::uint8_t*>, BufferPoolClassCount> m_free;
+        std::shared_ptr<MemoryBudget> m_budget;
+    };
+}
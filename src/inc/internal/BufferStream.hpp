@@ -0,0 +1,129 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+
+#include "AppxPackaging.hpp"
+#include "Exceptions.hpp"
+#include "StreamBase.hpp"
+
+namespace MSIX {
+    // Memory of the caller that streams read in place, see CreateStreamOnBuffer. The release callback, once set,
+    // is called when the last stream over the memory goes away.
+    class CallerBuffer final
+    {
+    public:
+        CallerBuffer(const void* data, std::uint64_t size) : m_data(static_cast<const std::uint8_t*>(data)), m_size(size)
+        {
+            ThrowErrorIf(Error::InvalidParameter, (data == nullptr && size != 0), "Invalid buffer");
+        }
+
+        ~CallerBuffer()
+        {
+            if (m_release) { m_release(m_context, m_data); }
+        }
+
+        void SetRelease(MSIX_RELEASE_BUFFER* release, void* context) noexcept
+        {
+            m_release = release;
+            m_context = context;
+        }
+
+        const std::uint8_t* GetData() const { return m_data; }
+        std::uint64_t GetSize() const { return m_size; }
+
+    protected:
+        const std::uint8_t* m_data;
+        std::uint64_t m_size;
+        MSIX_RELEASE_BUFFER* m_release = nullptr;
+        void* m_context = nullptr;
+    };
+
+    // Read only stream over memory of the caller. Reads are copied directly out of it, positional reads don't need
+    // any locking and the memory is seen as a raw view, like a mapped file. Clones share the memory.
+    class BufferStream final : public StreamBase
+    {
+    public:
+        BufferStream(const std::shared_ptr<CallerBuffer>& buffer) : m_buffer(buffer)
+        {}
+
+        // IStream
+        HRESULT STDMETHODCALLTYPE Clone(IStream** stream) noexcept override try
+        {
+            ThrowErrorIf(Error::InvalidParameter, (stream == nullptr || *stream != nullptr), "bad pointer");
+            auto clone = ComPtr<IStream>::Make<BufferStream>(m_buffer);
+            LARGE_INTEGER position = { 0 };
+            position.QuadPart = static_cast<LONGLONG>(m_offset);
+            ThrowHrIfFailed(clone->Seek(position, Reference::START, nullptr));
+            *stream = clone.Detach();
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept override try
+        {
+            LARGE_INTEGER newPos = { 0 };
+            switch (origin)
+            {
+            case Reference::CURRENT:
+                newPos.QuadPart = m_offset + move.QuadPart;
+                break;
+            case Reference::START:
+                newPos.QuadPart = move.QuadPart;
+                break;
+            case Reference::END:
+                newPos.QuadPart = m_buffer->GetSize() + move.QuadPart;
+                break;
+            }
+            ThrowErrorIf(Error::FileSeek, (newPos.QuadPart < 0), "seek failed");
+            m_offset = static_cast<std::uint64_t>(newPos.QuadPart);
+            if (newPosition) { newPosition->QuadPart = m_offset; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) noexcept override try
+        {
+            ULONG result = ReadAt(m_offset, buffer, countBytes);
+            m_offset += result;
+            if (bytesRead) { *bytesRead = result; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Write(const void*, ULONG, ULONG*) noexcept override
+        {
+            return static_cast<HRESULT>(Error::NotSupported);
+        }
+
+        // IStreamInternal
+        std::uint64_t GetSize() override { return m_buffer->GetSize(); }
+        bool IsCompressed() override { return false; }
+        std::string GetName() override { return "buffer"; }
+        bool SupportsReadAt() override { return true; }
+        bool IsBuffered() override { return true; }
+
+        ULONG ReadAt(std::uint64_t offset, void* buffer, ULONG countBytes) override
+        {
+            auto size = m_buffer->GetSize();
+            if (offset >= size) { return 0; }
+            ULONG result = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(countBytes), size - offset));
+            std::memcpy(buffer, m_buffer->GetData() + offset, result);
+            return result;
+        }
+
+        const std::uint8_t* GetRawView(std::uint64_t& available) override
+        {
+            auto size = m_buffer->GetSize();
+            available = (m_offset < size) ? (size - m_offset) : 0;
+            return (available != 0) ? (m_buffer->GetData() + m_offset) : nullptr;
+        }
+
+    protected:
+        std::shared_ptr<CallerBuffer> m_buffer;
+        std::uint64_t m_offset = 0;
+    };
+}
@@ -0,0 +1,139 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "Exceptions.hpp"
+#include "StreamBase.hpp"
+#include "ComHelper.hpp"
+#include "IoScheduler.hpp"
+
+#include <memory>
+#include <vector>
+
+namespace MSIX {
+
+    const std::size_t DefaultWriteBufferSize = 1024 * 1024;
+
+    // Write only stream that only ever writes forward to another stream, so it can be a pipe or an upload.
+    // Small writes are gathered in a buffer. A full buffer is written through the I/O scheduler while the
+    // next one fills, writes of at least a buffer go straight through once the previous one is written. The
+    // position is tracked here and starts at 0, seeking to it is allowed so range streams over this one work,
+    // seeking anywhere else fails. Commit writes the buffered bytes and returns write failures, callers must
+    // Commit once they are done.
+    class BufferedWriteStream final : public StreamBase
+    {
+    public:
+        BufferedWriteStream(const ComPtr<IStream>& stream, std::size_t bufferSize = DefaultWriteBufferSize,
+            const std::shared_ptr<IoScheduler>& scheduler = IoScheduler::GetDefault()) :
+            m_stream(stream), m_bufferSize(bufferSize), m_scheduler(scheduler)
+        {
+            ThrowErrorIf(Error::InvalidParameter, (m_bufferSize == 0), "Invalid buffer size");
+            m_buffer.reserve(m_bufferSize);
+        }
+
+        virtual ~BufferedWriteStream() override
+        {   // The buffer being written must outlive the write.
+            WaitNoThrow();
+        }
+
+        // IStream
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept override try
+        {
+            bool toCurrent = (origin == Reference::START) ?
+                (move.QuadPart == static_cast<LONGLONG>(m_position)) :
+                (move.QuadPart == 0);
+            ThrowErrorIfNot(Error::NotSupported, toCurrent, "forward only stream can't seek");
+            if (newPosition) { newPosition->QuadPart = m_position; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Read(void*, ULONG, ULONG*) noexcept override
+        {
+            return static_cast<HRESULT>(Error::NotSupported);
+        }
+
+        HRESULT STDMETHODCALLTYPE Write(const void* buffer, ULONG countBytes, ULONG* bytesWritten) noexcept override try
+        {
+            if (bytesWritten) { *bytesWritten = 0; }
+            if (m_buffer.size() + countBytes > m_bufferSize)
+            {
+                Flush();
+            }
+            if (countBytes >= m_bufferSize)
+            {
+                WriteThrough(buffer, countBytes);
+            }
+            else if (countBytes != 0)
+            {
+                auto bytes = static_cast<const std::uint8_t*>(buffer);
+                m_buffer.insert(m_buffer.end(), bytes, bytes + countBytes);
+            }
+            m_position += countBytes;
+            if (bytesWritten) { *bytesWritten = countBytes; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        // Writes the buffered bytes. The underlying stream isn't committed.
+        HRESULT STDMETHODCALLTYPE Commit(DWORD) noexcept override try
+        {
+            Flush();
+            WaitForPending();
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        // IStreamInternal
+        std::uint64_t GetSize() override { return m_position; }
+        bool IsCompressed() override { return false; }
+
+    protected:
+        // Starts writing the buffered bytes and switches to the other buffer.
+        void Flush()
+        {
+            if (m_buffer.empty()) { return; }
+            WaitForPending();
+            std::swap(m_buffer, m_writing);
+            m_buffer.clear();
+            m_buffer.reserve(m_bufferSize);
+            std::vector<IoRequest> requests;
+            requests.push_back(IoRequest::Write(m_stream, IoCurrentPosition, m_writing.data(), static_cast<ULONG>(m_writing.size())));
+            m_pending = m_scheduler->Submit(std::move(requests));
+        }
+
+        void WaitForPending()
+        {
+            if (!m_pending) { return; }
+            auto pending = std::move(m_pending);
+            pending->Wait();
+        }
+
+        void WaitNoThrow() noexcept
+        {
+            try
+            {
+                WaitForPending();
+            }
+            catch (...)
+            {   // Commit reports write failures, a stream destroyed without it has nothing to report them to.
+            }
+        }
+
+        void WriteThrough(const void* buffer, ULONG countBytes)
+        {
+            WaitForPending();
+            ULONG written = 0;
+            ThrowHrIfFailed(m_stream->Write(buffer, countBytes, &written));
+            ThrowErrorIf(Error::FileWrite, (written != countBytes), "Did not write as much as requested.");
+        }
+
+        ComPtr<IStream> m_stream;
+        std::size_t m_bufferSize = DefaultWriteBufferSize;
+        std::shared_ptr<IoScheduler> m_scheduler;
+        std::vector<std::uint8_t> m_buffer;
+        // The buffer the scheduler is writing, and its batch
+        std::vector<std::uint8_t> m_writing;
+        std::shared_ptr<IoBatch> m_pending;
+        std::uint64_t m_position = 0;
+    };
+}
@@ -22,9 +22,16 @@ namespace MSIX {
 
         std::uint64_t GetStreamSize(IStream* stream);
 
-        void AddPackage(std::string fileName, IAppxPackageReader* packageReader, std::uint64_t bundleOffset,
+        // Version used when a bundle doesn't specify one, with the format YYYY.MMDD.hhmm.0 from the current UTC time.
+        static std::uint64_t GetDefaultBundleVersion();
+
+        // Only the manifest of a package describes it in the bundle, from a package reader or read alone.
+        void AddPackage(std::string fileName, IAppxManifestReader* manifestReader, std::uint64_t bundleOffset,
             std::uint64_t packageSize, bool isDefaultApplicableResource);
 
+        // Adds a package from its manifest alone. The package is referenced by the bundle, like in a flat bundle.
+        void AddPackageFromManifest(std::string fileName, IAppxManifestReader* manifestReader, bool isDefaultApplicableResource);
+
         void GetValidatedPackageData(
             std::string fileName,
             IAppxPackageReader* packageReader,
@@ -33,6 +40,14 @@ namespace MSIX {
             IAppxManifestQualifiedResourcesEnumerator** resources,
             IAppxManifestTargetDeviceFamiliesEnumerator** tdfs);
 
+        void GetValidatedPackageData(
+            std::string fileName,
+            IAppxManifestReader* manifestReader,
+            APPX_BUNDLE_PAYLOAD_PACKAGE_TYPE* packageType,
+            IAppxManifestPackageId** packageId,
+            IAppxManifestQualifiedResourcesEnumerator** resources,
+            IAppxManifestTargetDeviceFamiliesEnumerator** tdfs);
+
         void AddValidatedPackageData(
             std::string fileName,
             std::uint64_t bundleOffset,
@@ -61,6 +76,10 @@ namespace MSIX {
         void AddExternalPackageReferenceFromManifest(std::string fileName, IAppxManifestReader* manifestReader,
             bool isDefaultApplicablePackage);
 
+        // packageStream is either the manifest of the external package or the package itself.
+        void AddExternalPackageReference(IAppxFactory* appxFactory, std::string fileName, IStream* packageStream,
+            bool isDefaultApplicablePackage);
+
         std::uint64_t GetMinTargetDeviceFamilyVersionFromManifestForWindows(IAppxManifestReader* packageManifestReader);
     
     private:
@@ -0,0 +1,93 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+#include "Exceptions.hpp"
+#include "StreamBase.hpp"
+#include "ComHelper.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+namespace MSIX {
+
+    // Read only stream over another stream where one range of the underlying stream is read into memory
+    // with a single request up front. Reads that fall entirely inside that range are copied from memory,
+    // anything else is forwarded to the underlying stream. Positions are the ones of the underlying stream.
+    class CachedRangeStream final : public StreamBase
+    {
+    public:
+        CachedRangeStream(const ComPtr<IStream>& stream, std::uint64_t offset, std::uint64_t count) :
+            m_stream(stream),
+            m_cacheStart(offset)
+        {
+            ULARGE_INTEGER end = { 0 };
+            ThrowHrIfFailed(m_stream->Seek({ 0 }, Reference::END, &end));
+            m_size = end.QuadPart;
+            std::uint64_t available = (offset < m_size) ? (m_size - offset) : 0;
+            m_cache.resize(static_cast<std::size_t>(std::min(count, available)));
+            if (!m_cache.empty())
+            {
+                LARGE_INTEGER pos = { 0 };
+                pos.QuadPart = offset;
+                ThrowHrIfFailed(m_stream->Seek(pos, Reference::START, nullptr));
+                ULONG bytesRead = 0;
+                ThrowHrIfFailed(m_stream->Read(m_cache.data(), static_cast<ULONG>(m_cache.size()), &bytesRead));
+                m_cache.resize(bytesRead);
+            }
+        }
+
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept override try
+        {
+            // Seeking doesn't read anything, let the underlying stream validate the new position.
+            if (origin == Reference::CURRENT)
+            {
+                move.QuadPart += m_position;
+                origin = Reference::START;
+            }
+            ULARGE_INTEGER pos = { 0 };
+            ThrowHrIfFailed(m_stream->Seek(move, origin, &pos));
+            m_position = pos.QuadPart;
+            if (newPosition) { newPosition->QuadPart = m_position; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) noexcept override try
+        {
+            ULONG result = 0;
+            if ((m_position >= m_cacheStart) && (m_position + countBytes <= m_cacheStart + m_cache.size()))
+            {
+                result = countBytes;
+                if (result != 0) { std::memcpy(buffer, m_cache.data() + (m_position - m_cacheStart), result); }
+            }
+            else
+            {
+                LARGE_INTEGER pos = { 0 };
+                pos.QuadPart = m_position;
+                ThrowHrIfFailed(m_stream->Seek(pos, Reference::START, nullptr));
+                ThrowHrIfFailed(m_stream->Read(buffer, countBytes, &result));
+            }
+            m_position += result;
+            if (bytesRead) { *bytesRead = result; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Write(const void*, ULONG, ULONG*) noexcept override
+        {
+            return static_cast<HRESULT>(Error::NotSupported);
+        }
+
+        // IStreamInternal
+        std::uint64_t GetSize() override { return m_size; }
+        bool IsCompressed() override { return false; }
+
+    protected:
+        ComPtr<IStream> m_stream;
+        std::vector<std::uint8_t> m_cache;
+        std::uint64_t m_cacheStart = 0;
+        std::uint64_t m_position = 0;
+        std::uint64_t m_size = 0;
+    };
+}
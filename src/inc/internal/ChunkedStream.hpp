@@ -0,0 +1,155 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "Exceptions.hpp"
+#include "StreamBase.hpp"
+#include "ComHelper.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <vector>
+
+namespace MSIX {
+
+    const std::size_t ChunkedStreamFirstChunkSize = 64 * 1024;
+    const std::size_t ChunkedStreamMaxChunkSize = 1024 * 1024;
+
+    // In memory stream for outputs that can grow to several MB. The bytes are kept in chunks that double in size
+    // up to ChunkedStreamMaxChunkSize, so growing the stream never copies what was already written the way
+    // growing a vector does. Writes past the end extend the stream. Unlike VectorStream it is writable without
+    // MSIX_PACK, the unpack side spools packages and tar entries through it, see SpillStream.
+    class ChunkedStream final : public StreamBase
+    {
+    public:
+        // Writes the whole content of the stream to stream, chunk by chunk.
+        void WriteTo(IStream* stream)
+        {
+            for (std::size_t index = 0; index < m_chunks.size() && m_chunks[index].start < m_size; index++)
+            {
+                const auto& chunk = m_chunks[index];
+                ULONG count = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(chunk.size), m_size - chunk.start));
+                ULONG written = 0;
+                ThrowHrIfFailed(stream->Write(chunk.data.get(), count, &written));
+                ThrowErrorIf(Error::FileWrite, (written != count), "write failed");
+            }
+        }
+
+        // IStream
+        HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) noexcept override try
+        {
+            ULONG amountToRead = ReadAt(m_position, buffer, countBytes);
+            m_position += amountToRead;
+            if (bytesRead) { *bytesRead = amountToRead; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept override try
+        {
+            LONGLONG newPos = 0;
+            switch (origin)
+            {
+            case Reference::CURRENT:
+                newPos = static_cast<LONGLONG>(m_position) + move.QuadPart;
+                break;
+            case Reference::START:
+                newPos = move.QuadPart;
+                break;
+            case Reference::END:
+                newPos = static_cast<LONGLONG>(m_size) + move.QuadPart;
+                break;
+            }
+            ThrowErrorIf(Error::InvalidParameter, (newPos < 0), "seek before the start of the stream");
+            m_position = std::min(static_cast<std::uint64_t>(newPos), m_size);
+            if (newPosition) { newPosition->QuadPart = m_position; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Write(const void* buffer, ULONG countBytes, ULONG* bytesWritten) noexcept override try
+        {
+            auto end = m_position + countBytes;
+            while (m_capacity < end)
+            {
+                AddChunk(m_chunks.empty() ? ChunkedStreamFirstChunkSize : std::min(m_chunks.back().size * 2, ChunkedStreamMaxChunkSize));
+            }
+            auto source = static_cast<const std::uint8_t*>(buffer);
+            auto index = FindChunk(m_position);
+            for (ULONG done = 0; done < countBytes; index++)
+            {
+                const auto& chunk = m_chunks[index];
+                auto offset = static_cast<std::size_t>(m_position + done - chunk.start);
+                auto count = std::min(static_cast<std::size_t>(countBytes - done), chunk.size - offset);
+                std::memcpy(chunk.data.get() + offset, source + done, count);
+                done += static_cast<ULONG>(count);
+            }
+            m_position = end;
+            m_size = std::max(m_size, end);
+            if (bytesWritten) { *bytesWritten = countBytes; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        // IStreamInternal
+        std::uint64_t GetSize() override { return m_size; }
+        bool SupportsReadAt() override { return true; }
+        bool IsBuffered() override { return true; }
+
+        ULONG ReadAt(std::uint64_t offset, void* buffer, ULONG countBytes) override
+        {
+            if (offset >= m_size) { return 0; }
+            ULONG amountToRead = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(countBytes), m_size - offset));
+            auto target = static_cast<std::uint8_t*>(buffer);
+            auto index = FindChunk(offset);
+            for (ULONG done = 0; done < amountToRead; index++)
+            {
+                const auto& chunk = m_chunks[index];
+                auto chunkOffset = static_cast<std::size_t>(offset + done - chunk.start);
+                auto count = std::min(static_cast<std::size_t>(amountToRead - done), chunk.size - chunkOffset);
+                std::memcpy(target + done, chunk.data.get() + chunkOffset, count);
+                done += static_cast<ULONG>(count);
+            }
+            return amountToRead;
+        }
+
+        // Only when the rest of the stream is in one chunk
+        const std::uint8_t* GetRawView(std::uint64_t& available) override
+        {
+            available = 0;
+            if (m_position >= m_size) { return nullptr; }
+            const auto& chunk = m_chunks[FindChunk(m_position)];
+            if (chunk.start + chunk.size < m_size) { return nullptr; }
+            available = m_size - m_position;
+            return chunk.data.get() + static_cast<std::size_t>(m_position - chunk.start);
+        }
+
+    protected:
+        struct Chunk
+        {
+            std::unique_ptr<std::uint8_t[]> data;
+            std::size_t size;
+            std::uint64_t start;
+        };
+
+        void AddChunk(std::size_t size)
+        {
+            m_chunks.push_back(Chunk{ std::unique_ptr<std::uint8_t[]>(new std::uint8_t[size]), size, m_capacity });
+            m_capacity += size;
+        }
+
+        // Index of the chunk that holds offset, which must be less than m_capacity
+        std::size_t FindChunk(std::uint64_t offset) const
+        {
+            auto chunk = std::upper_bound(m_chunks.begin(), m_chunks.end(), offset,
+                [](std::uint64_t value, const Chunk& item) { return value < item.start; });
+            return static_cast<std::size_t>(chunk - m_chunks.begin()) - 1;
+        }
+
+        std::vector<Chunk> m_chunks;
+        std::uint64_t m_capacity = 0;
+        std::uint64_t m_size = 0;
+        std::uint64_t m_position = 0;
+    };
+}
@@ -0,0 +1,65 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "ComHelper.hpp"
+#include "Crypto.hpp"
+#include "DirectoryObject.hpp"
+
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace MSIX {
+
+    // Deflated blocks shared by the package writers of a factory, see MsixSetCompressedBlockCache. A block is found
+    // by the SHA256 of its bytes, which the writers compute for the block map anyway, and its compression option.
+    // Every block ends on a full flush, so its deflated bytes don't depend on the file or the package it is in.
+    // Kept in memory up to a size, the least recently used dropped first, and in a directory when there is one.
+    // Thread safe, and processes can share a directory.
+    class CompressedBlockCache final
+    {
+    public:
+        // Without a root, blocks are only kept in memory
+        CompressedBlockCache(const std::string& root, std::uint64_t maxMemoryBytes);
+
+        // Puts in compressed the deflated bytes of the block of size bytes with hash. Returns false if the cache
+        // doesn't have it, then the block is deflated as usual.
+        bool Find(const Sha256Digest& hash, std::uint32_t size, APPX_COMPRESSION_OPTION compressionOpt,
+            std::vector<std::uint8_t>& compressed);
+
+        // Adds a deflated block. The cache is a cache, a block that can't be written is left out.
+        void Add(const Sha256Digest& hash, std::uint32_t size, APPX_COMPRESSION_OPTION compressionOpt,
+            const std::uint8_t* compressed, std::size_t compressedSize);
+
+    protected:
+        struct Entry
+        {
+            std::uint32_t size = 0;
+            std::vector<std::uint8_t> compressed;
+            std::list<std::string>::iterator use;
+        };
+
+        static std::string GetKey(const Sha256Digest& hash, APPX_COMPRESSION_OPTION compressionOpt);
+        // Keys are spread in directories named after their first byte, so none gets too large
+        static std::string GetCacheName(const std::string& key) { return key.substr(0, 2) + "/" + key; }
+
+        bool FindInDirectory(const std::string& key, const Sha256Digest& hash, std::uint32_t size, std::vector<std::uint8_t>& compressed);
+        // Called with m_lock held
+        void AddToMemory(const std::string& key, std::uint32_t size, const std::uint8_t* compressed, std::size_t compressedSize);
+
+        ComPtr<IDirectoryObject> m_root;
+        const std::uint64_t m_maxMemoryBytes;
+        std::mutex m_lock;
+        std::unordered_map<std::string, Entry> m_entries;
+        // Keys of m_entries, the most recently used first
+        std::list<std::string> m_uses;
+        std::uint64_t m_memoryBytes = 0;
+    };
+}
@@ -0,0 +1,51 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+namespace MSIX {
+
+    // Chooses the compression level of the payload files of a pack that must be done within a time budget. Every
+    // file is timed, reading, hashing and writing included, to know how fast each level packs. Before a file the
+    // levels are tried from the one asked for down to storing, and the first one fast enough to pack the bytes left
+    // before the deadline is chosen. A level not used yet is estimated from one that was, with the speeds zlib levels
+    // usually have relative to each other. Content that deflates slowly thus gets lower levels, content that deflates
+    // fast keeps the best one.
+    class CompressionPacer final
+    {
+    public:
+        // totalBytes is the size of every payload file left to pack, compressed or not
+        CompressionPacer(std::chrono::milliseconds budget, APPX_COMPRESSION_OPTION best, std::uint64_t totalBytes);
+
+        // The level of the next compressed file
+        APPX_COMPRESSION_OPTION Choose();
+
+        // Records that size bytes were packed with compressionOpt in elapsed
+        void Record(APPX_COMPRESSION_OPTION compressionOpt, std::uint64_t size, std::chrono::steady_clock::duration elapsed);
+
+    protected:
+        // From storing to APPX_COMPRESSION_OPTION_MAXIMUM
+        static const std::size_t LevelCount = 5;
+
+        struct LevelSpeed
+        {
+            std::uint64_t bytes = 0;
+            double seconds = 0;
+        };
+
+        // Bytes per second of the level at index, or 0 if nothing was measured yet
+        double GetSpeed(std::size_t index);
+
+        std::chrono::steady_clock::time_point m_deadline;
+        std::size_t m_best;
+        std::uint64_t m_bytesLeft;
+        std::array<LevelSpeed, LevelCount> m_speeds;
+    };
+}
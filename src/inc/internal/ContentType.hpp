@@ -7,7 +7,8 @@
 
 #include "AppxPackaging.hpp"
 
-#include <map>
+#include <string>
+#include <unordered_map>
 
 namespace MSIX {
 
@@ -21,7 +22,7 @@ namespace MSIX {
         const std::string& GetContentType() { return m_contentType; }
         APPX_COMPRESSION_OPTION GetCompressionOpt() { return m_compressionOpt; }
 
-        static const ContentType& GetContentTypeByExtension(std::string& ext);
+        static const ContentType& GetContentTypeByExtension(const std::string& ext);
         static const std::string GetPayloadFileContentType(APPX_FOOTPRINT_FILE_TYPE footprintFile);
         static const std::string GetBundlePayloadFileContentType(APPX_BUNDLE_FOOTPRINT_FILE_TYPE footprintFile);
     
@@ -7,6 +7,7 @@
 #include "AppxPackaging.hpp"
 #include "XmlWriter.hpp"
 #include "ComHelper.hpp"
+#include "PackageFileName.hpp"
 
 #include <map>
 
@@ -17,7 +18,11 @@ namespace MSIX {
     public:
         ContentTypeWriter();
 
-        void AddContentType(const std::string& name, const std::string& contentType, bool forceOverride = false);
+        void AddContentType(const PackageFileName& file, const std::string& contentType, bool forceOverride = false);
+        void AddContentType(const std::string& name, const std::string& contentType, bool forceOverride = false)
+        {
+            AddContentType(PackageFileName(name), contentType, forceOverride);
+        }
         void Close();
         ComPtr<IStream> GetStream() { return m_xmlWriter.GetStream(); }
 
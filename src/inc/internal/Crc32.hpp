@@ -0,0 +1,16 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace MSIX { namespace Crc32 {
+
+    // Same result as zlib's crc32. Uses the carry-less multiply instructions on x86 or the CRC32
+    // instructions on ARMv8 when the processor has them, and zlib otherwise.
+    std::uint32_t Update(std::uint32_t crc, const std::uint8_t* data, std::size_t size);
+
+} /* Crc32 */ } /* MSIX */
@@ -4,6 +4,10 @@
 // 
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
 #include <vector>
 
 #ifndef SHA256_DIGEST_LENGTH
@@ -12,10 +16,29 @@
 
 namespace MSIX {
 
+    using Sha256Digest = std::array<std::uint8_t, SHA256_DIGEST_LENGTH>;
+
+    // A buffer to hash with SHA256::ComputeHashes and where to put its hash.
+    struct HashRequest
+    {
+        const std::uint8_t* buffer;
+        std::uint32_t size;
+        Sha256Digest* hash;
+    };
+
     class SHA256
     {
     public:
         static bool ComputeHash(const std::uint8_t *buffer, std::uint32_t cbBuffer, std::vector<uint8_t>& hash);
+        static void ComputeHash(const std::uint8_t* buffer, std::uint32_t cbBuffer, Sha256Digest& hash);
+
+        /// <summary>
+        /// Compute the hashes of several independent buffers, like the blocks of a file. Where the platform supports it
+        /// the buffers are hashed side by side, so the rounds of one buffer fill the gaps left by the others.
+        /// </summary>
+        /// <param name="requests">Buffers to hash, each hash is written to the output buffer of its request.</param>
+        /// <param name="count">Number of requests</param>
+        static void ComputeHashes(const HashRequest* requests, std::size_t count);
 
         /// <summary>
         /// Construct and initialize the hash engine so it can be used to compute hash of input data.
@@ -42,8 +65,17 @@ namespace MSIX {
         /// </summary>
         /// <param name="hash">Output bufer to receive the computed hash value.</param>
         void FinalizeAndGetHashValue(std::vector<uint8_t>& hash);
+        void FinalizeAndGetHashValue(Sha256Digest& hash);
+
+        // Holds the hash state inline, so an engine can live on the stack and be reused without allocating.
+        struct Context
+        {
+            alignas(16) std::uint8_t bytes[128];
+        };
 
     private:
+        Context m_context;
+        // Used by the PALs whose hash state is an object of the platform
         void* m_hashContext = nullptr;
     };
 
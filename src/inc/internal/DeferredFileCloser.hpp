@@ -0,0 +1,60 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "MSIXWindows.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace MSIX {
+
+    const std::size_t DeferredFileCloserMaxThreads = 4;
+
+    // Closes the files written to a directory on up to threadCount threads of its own, started as they are needed,
+    // so the thread that wrote a file goes on with the next one instead of waiting for the close. On Windows closing
+    // a file that was just written is when the antivirus and the other file system filters scan it, which can take
+    // longer than writing it. Wait returns once every file handed over so far is closed, and the closer waits for
+    // them before it goes away. Failures to close are ignored, like when a stream closes its file itself.
+    class DeferredFileCloser final
+    {
+    public:
+        #ifdef WIN32
+        using Handle = HANDLE;
+        #else
+        using Handle = int;
+        #endif
+
+        DeferredFileCloser(std::size_t threadCount = DeferredFileCloserMaxThreads);
+        ~DeferredFileCloser();
+
+        DeferredFileCloser(const DeferredFileCloser&) = delete;
+        DeferredFileCloser& operator=(const DeferredFileCloser&) = delete;
+
+        // Takes ownership of file
+        void Close(Handle file);
+        void Wait();
+
+        static void CloseNow(Handle file);
+
+    protected:
+        void WorkerLoop() noexcept;
+
+        std::size_t m_maxThreads;
+        std::mutex m_lock;
+        std::condition_variable m_changed;
+        std::condition_variable m_closed;
+        std::deque<Handle> m_files;
+        std::vector<std::thread> m_threads;
+        std::size_t m_idleThreads = 0;
+        // Files taken from m_files and not closed yet
+        std::size_t m_closing = 0;
+        bool m_stop = false;
+    };
+}
@@ -6,16 +6,23 @@
 
 #include "ComHelper.hpp"
 #include "StreamBase.hpp"
+#include "AppxPackaging.hpp"
+#include "PerformanceCounters.hpp"
 
+#include <memory>
 #include <vector>
 #include <zlib.h>
 
 namespace MSIX {
 
+    // Initializes a raw deflate stream with the zlib level and memory level for the compression option
+    void InitializeDeflate(z_stream& zstrm, APPX_COMPRESSION_OPTION compressionOption);
+
     class DeflateStream final : public StreamBase
     {
     public:
-        DeflateStream(const ComPtr<IStream>& stream);
+        DeflateStream(const ComPtr<IStream>& stream, APPX_COMPRESSION_OPTION compressionOption = APPX_COMPRESSION_OPTION_NORMAL,
+            const std::shared_ptr<PerformanceCounters>& performanceCounters = nullptr);
         ~DeflateStream();
 
         // IStream
@@ -24,12 +31,13 @@ namespace MSIX {
         HRESULT STDMETHODCALLTYPE Write(void const *buffer, ULONG countBytes, ULONG *bytesWritten) noexcept override;
 
         // IStreamInternal
-        std::uint64_t GetSize() override { return m_stream.As<IStreamInternal>()->GetSize(); }
-        bool IsCompressed() override { return m_stream.As<IStreamInternal>()->IsCompressed(); }
-        std::string GetName() override { return m_stream.As<IStreamInternal>()->GetName(); }
+        std::uint64_t GetSize() override { return m_streamInternal->GetSize(); }
+        bool IsCompressed() override { return m_streamInternal->IsCompressed(); }
+        std::string GetName() override { return m_streamInternal->GetName(); }
     
     protected:
-        std::vector<std::uint8_t> Deflate(int disposition);
+        // The result is valid until the next call.
+        const std::vector<std::uint8_t>& Deflate(int disposition);
 
         typedef enum
         {
@@ -41,5 +49,40 @@ namespace MSIX {
         State m_state = State::Open;
         z_stream m_zstrm;
         ComPtr<IStream> m_stream;
+        ComPtr<IStreamInternal> m_streamInternal;
+        // Reused for every block, so its capacity settles after the first one
+        std::vector<std::uint8_t> m_output;
+        std::shared_ptr<PerformanceCounters> m_performanceCounters;
+    };
+
+    // Compresses blocks independently of each other. Every block ends on a Z_FULL_FLUSH boundary, like the
+    // ones written by DeflateStream, so blocks compressed by different BlockDeflaters can be written one
+    // after the other and terminated with Finish to make a single deflate stream.
+    class BlockDeflater final
+    {
+    public:
+        BlockDeflater(APPX_COMPRESSION_OPTION compressionOption = APPX_COMPRESSION_OPTION_NORMAL,
+            const std::shared_ptr<PerformanceCounters>& performanceCounters = nullptr);
+        ~BlockDeflater();
+        BlockDeflater(const BlockDeflater&) = delete;
+        BlockDeflater& operator=(const BlockDeflater&) = delete;
+
+        // The result is valid until the next call.
+        const std::vector<std::uint8_t>& Deflate(const std::uint8_t* data, std::uint32_t size);
+        const std::vector<std::uint8_t>& Finish();
+
+        // The deflater of the calling thread for compressionOption, made the first time the thread asks for it and
+        // kept until the thread ends. Its zlib state and output buffer are allocated and only ever touched by that
+        // thread, so they stay in its caches, and on its memory node when the workers are pinned. The result is
+        // valid until the next call on the same thread, which must not interleave it with other uses.
+        static BlockDeflater& ForCurrentThread(APPX_COMPRESSION_OPTION compressionOption,
+            const std::shared_ptr<PerformanceCounters>& performanceCounters);
+
+    protected:
+        const std::vector<std::uint8_t>& Run(int disposition);
+
+        z_stream m_zstrm;
+        std::vector<std::uint8_t> m_output;
+        std::shared_ptr<PerformanceCounters> m_performanceCounters;
     };
 }
@@ -0,0 +1,84 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "Exceptions.hpp"
+#include "StreamBase.hpp"
+#include "ComHelper.hpp"
+#include "Crypto.hpp"
+
+namespace MSIX {
+
+    // Write only stream that hashes with SHA256 what is written through it to another stream, in parts that
+    // follow each other. The bytes must be written in order: seeking is allowed as long as it ends where the
+    // last write did, so the position can be asked and range streams over this one work, seeking anywhere
+    // else fails.
+    class DigestStream final : public StreamBase
+    {
+    public:
+        DigestStream(const ComPtr<IStream>& stream) : m_stream(stream)
+        {
+            ULARGE_INTEGER position = { 0 };
+            ThrowHrIfFailed(m_stream->Seek({ 0 }, Reference::CURRENT, &position));
+            m_position = position.QuadPart;
+        }
+
+        // Ends the part hashed so far and starts the next one with the next byte written.
+        void EndPart(Sha256Digest& digest)
+        {
+            m_hash.FinalizeAndGetHashValue(digest);
+            m_hash.Reset();
+        }
+
+        // IStream
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept override try
+        {
+            ULARGE_INTEGER position = { 0 };
+            ThrowHrIfFailed(m_stream->Seek(move, origin, &position));
+            ThrowErrorIf(Error::NotSupported, (position.QuadPart != m_position), "the digests need the bytes to be written in order");
+            if (newPosition) { newPosition->QuadPart = position.QuadPart; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Read(void*, ULONG, ULONG*) noexcept override
+        {
+            return static_cast<HRESULT>(Error::NotSupported);
+        }
+
+        HRESULT STDMETHODCALLTYPE Write(const void* buffer, ULONG countBytes, ULONG* bytesWritten) noexcept override try
+        {
+            ULONG written = 0;
+            ThrowHrIfFailed(m_stream->Write(buffer, countBytes, &written));
+            m_hash.HashData(static_cast<const std::uint8_t*>(buffer), written);
+            m_position += written;
+            if (bytesWritten) { *bytesWritten = written; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Commit(DWORD flags) noexcept override
+        {
+            return m_stream->Commit(flags);
+        }
+
+        // IStreamInternal
+        std::uint64_t GetSize() override { return m_position; }
+        bool IsCompressed() override { return false; }
+
+        void WriteV(const StreamWriteBuffer* buffers, std::size_t count) override
+        {
+            WriteBuffers(m_stream.Get(), buffers, count);
+            for (std::size_t i = 0; i < count; i++)
+            {
+                m_hash.HashData(static_cast<const std::uint8_t*>(buffers[i].data), buffers[i].size);
+                m_position += buffers[i].size;
+            }
+        }
+
+    protected:
+        ComPtr<IStream> m_stream;
+        SHA256 m_hash;
+        std::uint64_t m_position = 0;
+    };
+}
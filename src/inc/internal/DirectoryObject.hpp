@@ -8,12 +8,16 @@
 #include <vector>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <unordered_set>
 
 #include "Exceptions.hpp"
 #include "StreamBase.hpp"
 #include "StorageObject.hpp"
 #include "ComHelper.hpp"
 #include "FileStream.hpp"
+#include "MappedFileStream.hpp"
+#include "DeferredFileCloser.hpp"
 
 // internal interface
 // {1675f000-9b74-49bb-ba31-94ed7c435c28}
@@ -28,12 +32,42 @@ class IDirectoryObject : public IUnknown
 public:
     // Opens a stream to a file by name in the storage object. If the file does not exist and mode is read,
     // or read + update, then nullptr is returned.  If the file is opened with write and it does not exist, 
-    // then the file is created and an empty stream to the file is handed back to the caller.
-    virtual MSIX::ComPtr<IStream> OpenFile(const std::string& fileName, MSIX::FileStream::Mode mode) = 0;
+    // then the file is created and an empty stream to the file is handed back to the caller. expectedSize, when
+    // known, is the size of the file about to be written. The space of large files is then reserved at once.
+    virtual MSIX::ComPtr<IStream> OpenFile(const std::string& fileName, MSIX::FileStream::Mode mode, std::uint64_t expectedSize = 0) = 0;
+
+    // Creates fileName, replacing it if it exists, with its space for size bytes allocated and maps it for write, so
+    // its content is written in place, see MappedOutputFile. Returns null if the directory can't, the file is then
+    // written with a stream from OpenFile.
+    virtual std::unique_ptr<MSIX::MappedOutputFile> OpenMappedFile(const std::string& fileName, std::uint64_t size) = 0;
+
+    // Creates the directories of files about to be opened for write, each once, so opening them doesn't have to.
+    virtual void CreateDirectories(const std::vector<std::string>& fileNames) = 0;
 
     // Returns a multipmap sorted by last modified time. Use multimap in the unlikely case there are two files
     // with the same last modified time.
     virtual std::multimap<std::uint64_t, std::string> GetFilesByLastModDate() = 0;
+
+    // Path of a file in the directory, as the platform takes it.
+    virtual std::string GetFilePath(const std::string& fileName) = 0;
+
+    // Makes fileName, replacing it if it exists, the same content as the file at sourcePath without copying it:
+    // the file is cloned where the file system supports it, otherwise hard linked, in which case both names are
+    // the same file. Returns false if neither can be done, like when sourcePath doesn't exist or is on another volume.
+    virtual bool LinkFile(const std::string& fileName, const std::string& sourcePath) = 0;
+
+    // Writes fileName, replacing it if it exists, with the size bytes at offset of the file at sourcePath, copied
+    // by the kernel without going through the process. File systems that share extents between files share the
+    // blocks of the range that allow it. Returns false, leaving no file behind, if the copy can't be done that way.
+    virtual bool CopyFileRange(const std::string& fileName, const std::string& sourcePath, std::uint64_t offset, std::uint64_t size) = 0;
+
+    // Writes fileName, replacing it if it exists, with the size bytes of data at once: the file is opened, written
+    // and closed here, without a stream that stays open or a background write. Meant for small files.
+    virtual void WriteFileContent(const std::string& fileName, const void* data, std::size_t size) = 0;
+
+    // Returns once the files written to the directory and released so far are closed. Directories that close files
+    // on threads of their own close them after the streams are released, see DeferredFileCloser.
+    virtual void WaitForClosedFiles() = 0;
 };
 MSIX_INTERFACE(IDirectoryObject, 0x1675f000,0x9b74,0x49bb,0xba,0x31,0x94,0xed,0x7c,0x43,0x5c,0x28);
 
@@ -43,25 +77,55 @@ namespace MSIX {
     {
     public:
         DirectoryObject(const std::string& root, bool createRootIfNecessary = false);
+        // The streams of the files may outlive the directory, those are still closed by the closer they share
+        ~DirectoryObject()
+        {
+            WaitForClosedFiles();
+        }
 
         // IStorageObject methods
         std::vector<std::string> GetFileNames(FileNameOptions options) override;
         ComPtr<IStream> GetFile(const std::string& fileName) override
         {
             std::string file = m_root + GetPathSeparator() + fileName;
+            // Files are mapped so the package writer can use their bytes without copying them. A 32 bit
+            // address space can't be relied on to map large files.
+            if (sizeof(void*) >= 8)
+            {
+                return ComPtr<IStream>::Make<MappedFileStream>(file);
+            }
             auto fileStream = ComPtr<IStream>::Make<FileStream>(file, FileStream::Mode::READ);
             return fileStream;
         }
         std::string GetFileName() override { return m_root; }
 
         // IDirectoryObject
-        ComPtr<IStream> OpenFile(const std::string& fileName, MSIX::FileStream::Mode mode) override;
+        ComPtr<IStream> OpenFile(const std::string& fileName, MSIX::FileStream::Mode mode, std::uint64_t expectedSize = 0) override;
+        std::unique_ptr<MappedOutputFile> OpenMappedFile(const std::string& fileName, std::uint64_t size) override;
+        void CreateDirectories(const std::vector<std::string>& fileNames) override;
         std::multimap<std::uint64_t, std::string> GetFilesByLastModDate() override;
+        std::string GetFilePath(const std::string& fileName) override;
+        bool LinkFile(const std::string& fileName, const std::string& sourcePath) override;
+        bool CopyFileRange(const std::string& fileName, const std::string& sourcePath, std::uint64_t offset, std::uint64_t size) override;
+        void WriteFileContent(const std::string& fileName, const void* data, std::size_t size) override;
+        void WaitForClosedFiles() override
+        {
+            if (m_closer) { m_closer->Wait(); }
+        }
 
         char GetPathSeparator() const;
 
     protected:
+        // Creates a directory, relative to the root, and its parents unless they were already created
+        void EnsureDirectoryExists(const std::string& directory);
+
         std::string m_root;
+        // Directories created by this object, relative to the root, so each is only created once
+        std::mutex m_directoriesLock;
+        std::unordered_set<std::string> m_createdDirectories;
+        // Closes the files written to the directory. Only on Windows, where closing a file that was just written
+        // can take as long as writing it, elsewhere files are closed by the stream that wrote them.
+        std::shared_ptr<DeferredFileCloser> m_closer;
 
     };//class DirectoryObject
 }
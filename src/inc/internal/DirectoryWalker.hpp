@@ -0,0 +1,96 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "WorkerPool.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace MSIX {
+
+    // Enumerating a directory is mostly waiting on the file system, more so on network shares, so
+    // directories are walked by more workers than the pool runs at once, up to this many.
+    const std::size_t DirectoryWalkerMaxThreads = 16;
+
+    using DirectoryWalkerFiles = std::vector<std::pair<std::uint64_t, std::string>>;
+
+    // Enumerates one directory. directory is relative to the root being walked and empty for the root
+    // itself. Each subdirectory is passed to addDirectory, using the same relative form, and each file is
+    // appended to files with its last modified time.
+    using DirectoryWalkerVisitor = std::function<void(const std::string& directory,
+        const std::function<void(std::string&&)>& addDirectory, DirectoryWalkerFiles& files)>;
+
+    // Walks a directory tree with workers of the default pool, each taking the next directory waiting to be enumerated.
+    // Returns the files by last modified time. Files with the same time are ordered by name, so the result
+    // doesn't depend on which thread found them.
+    inline std::multimap<std::uint64_t, std::string> WalkDirectoryInParallel(const DirectoryWalkerVisitor& visitor)
+    {
+        std::mutex lock;
+        std::condition_variable wake;
+        std::vector<std::string> pending = { std::string() };
+        std::size_t busy = 0;
+        std::exception_ptr failure;
+        DirectoryWalkerFiles allFiles;
+
+        auto worker = [&]()
+        {
+            DirectoryWalkerFiles files;
+            std::vector<std::string> found;
+            auto addDirectory = [&found](std::string&& directory) { found.push_back(std::move(directory)); };
+            std::unique_lock<std::mutex> guard(lock);
+            while (true)
+            {
+                wake.wait(guard, [&]() { return !pending.empty() || busy == 0 || failure; });
+                if (pending.empty() || failure) { break; }
+                auto directory = std::move(pending.back());
+                pending.pop_back();
+                busy++;
+                guard.unlock();
+                try
+                {
+                    visitor(directory, addDirectory, files);
+                }
+                catch (...)
+                {
+                    guard.lock();
+                    if (!failure) { failure = std::current_exception(); }
+                    busy--;
+                    wake.notify_all();
+                    break;
+                }
+                guard.lock();
+                busy--;
+                std::move(found.begin(), found.end(), std::back_inserter(pending));
+                found.clear();
+                wake.notify_all();
+            }
+            if (!guard.owns_lock()) { guard.lock(); }
+            std::move(files.begin(), files.end(), std::back_inserter(allFiles));
+        };
+
+        auto pool = WorkerPool::GetDefault();
+        auto workerCount = std::min<std::size_t>(DirectoryWalkerMaxThreads, pool->GetConcurrency() * 2);
+        pool->ForEach(workerCount, workerCount, [&](std::size_t) { worker(); });
+        if (failure) { std::rethrow_exception(failure); }
+
+        std::sort(allFiles.begin(), allFiles.end());
+        std::multimap<std::uint64_t, std::string> result;
+        for (auto& file : allFiles)
+        {
+            result.emplace_hint(result.end(), file.first, std::move(file.second));
+        }
+        return result;
+    }
+}
@@ -4,7 +4,9 @@
 //
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 namespace MSIX { namespace Encoding {
 
@@ -14,4 +16,12 @@ namespace MSIX { namespace Encoding {
     std::string Base32Encoding(const std::vector<uint8_t>& bytes);
     std::vector<std::uint8_t> GetBase64DecodedValue(const std::string& value);
 
+    // Fixed size variants for values like block hashes, they don't allocate.
+    inline std::size_t GetBase64EncodedSize(std::size_t size) { return ((size + 2) / 3) * 4; }
+    // Writes the GetBase64EncodedSize(size) characters of the encoding of data, without a terminator.
+    void EncodeBase64(const std::uint8_t* data, std::size_t size, char* output);
+    // Decodes value into the size bytes of output. Returns false unless value is exactly the canonical encoding
+    // of size bytes, padded, without whitespace and with the unused bits cleared.
+    bool DecodeBase64(const char* value, std::size_t length, std::uint8_t* output, std::size_t size);
+
 } /*Encoding */ } /* MSIX */
@@ -7,26 +7,37 @@
 #include "ComHelper.hpp"
 #include "MSIXFactory.hpp"
 
+#include <functional>
+#include <memory>
 #include <vector>
 #include <string>
 
 namespace MSIX {
 
     // Helper class for implementing any IAppx*Enumerator interfaces that has a COM interface as an 
-    // out parameter for their GetCurrent method.
+    // out parameter for their GetCurrent method. The objects are shared with the enumerators made from the
+    // same array and never change, so the object that owns them can keep one array and make enumerators of it
+    // without copying it. onCurrent, if set, is called with each object before it is handed out.
     template<typename EnumeratorInterface, typename ObjectType>
     class EnumeratorCom final : public MSIX::ComClass<EnumeratorCom<EnumeratorInterface, ObjectType>, EnumeratorInterface>
     {
     public:
-        EnumeratorCom(std::vector<ComPtr<ObjectType>>& objects) :
-            m_objects(objects)
+        using Objects = std::shared_ptr<const std::vector<ComPtr<ObjectType>>>;
+
+        EnumeratorCom(std::vector<ComPtr<ObjectType>> objects) :
+            m_objects(std::make_shared<const std::vector<ComPtr<ObjectType>>>(std::move(objects)))
+        {}
+
+        EnumeratorCom(Objects objects, std::function<void(ObjectType*)> onCurrent = nullptr) :
+            m_objects(std::move(objects)), m_onCurrent(std::move(onCurrent))
         {}
 
         // IAppx*Enumerator
         HRESULT STDMETHODCALLTYPE GetCurrent(ObjectType** object) noexcept override try
         {
             ThrowErrorIf(Error::InvalidParameter, (object == nullptr || *object != nullptr), "bad pointer");
-            auto obj = m_objects.at(m_cursor);
+            auto obj = m_objects->at(m_cursor);
+            if (m_onCurrent) { m_onCurrent(obj.Get()); }
             *object = obj.Detach();
             return static_cast<HRESULT>(Error::OK);
         } CATCH_RETURN();
@@ -34,51 +45,58 @@ namespace MSIX {
         HRESULT STDMETHODCALLTYPE GetHasCurrent(BOOL* hasCurrent) noexcept override try
         {   
             ThrowErrorIfNot(Error::InvalidParameter, (hasCurrent), "bad pointer");
-            *hasCurrent = (m_cursor != m_objects.size()) ? TRUE : FALSE;
+            *hasCurrent = (m_cursor != m_objects->size()) ? TRUE : FALSE;
             return static_cast<HRESULT>(Error::OK);
         } CATCH_RETURN();
 
         HRESULT STDMETHODCALLTYPE MoveNext(BOOL* hasNext) noexcept override try
         {
             ThrowErrorIfNot(Error::InvalidParameter, (hasNext), "bad pointer");
-            *hasNext = (++m_cursor != m_objects.size()) ? TRUE : FALSE;
+            *hasNext = (++m_cursor != m_objects->size()) ? TRUE : FALSE;
             return static_cast<HRESULT>(Error::OK);
         } CATCH_RETURN();
 
     protected:
-        std::vector<ComPtr<ObjectType>> m_objects;
+        Objects m_objects;
+        std::function<void(ObjectType*)> m_onCurrent;
         std::size_t m_cursor = 0;
     };
 
     // Helper class for implementing any IAppx*Enumerator that has an string as an out parameter
-    // for their GetCurrent method.
+    // for their GetCurrent method. The values are shared like the objects of EnumeratorCom.
     template<typename EnumeratorInterface, typename EnumeratorInterfaceUtf8>
     class EnumeratorString final : public MSIX::ComClass<EnumeratorString<EnumeratorInterface, EnumeratorInterfaceUtf8>, EnumeratorInterface, EnumeratorInterfaceUtf8>
     {
     public:
-        EnumeratorString(IMsixFactory* factory, std::vector<std::string>& values) :
-            m_factory(factory), m_values(values)
+        using Values = std::shared_ptr<const std::vector<std::string>>;
+
+        EnumeratorString(IMsixFactory* factory, std::vector<std::string> values) :
+            m_factory(factory), m_values(std::make_shared<const std::vector<std::string>>(std::move(values)))
+        {}
+
+        EnumeratorString(IMsixFactory* factory, Values values) :
+            m_factory(factory), m_values(std::move(values))
         {}
 
         // IAppx*Enumerator
         HRESULT STDMETHODCALLTYPE GetCurrent(LPWSTR* value) noexcept override try
         {
             ThrowErrorIf(Error::InvalidParameter, (value == nullptr || *value != nullptr), "bad pointer");
-            return m_factory->MarshalOutString(m_values.at(m_cursor), value);
+            return m_factory->MarshalOutString(m_values->at(m_cursor), value);
             return static_cast<HRESULT>(Error::OK);
         } CATCH_RETURN();
 
         HRESULT STDMETHODCALLTYPE GetHasCurrent(BOOL* hasCurrent) noexcept override try
         {   
             ThrowErrorIfNot(Error::InvalidParameter, (hasCurrent), "bad pointer");
-            *hasCurrent = (m_cursor != m_values.size()) ? TRUE : FALSE;
+            *hasCurrent = (m_cursor != m_values->size()) ? TRUE : FALSE;
             return static_cast<HRESULT>(Error::OK);
         } CATCH_RETURN();
 
         HRESULT STDMETHODCALLTYPE MoveNext(BOOL* hasNext) noexcept override try
         {
             ThrowErrorIfNot(Error::InvalidParameter, (hasNext), "bad pointer");
-            *hasNext = (++m_cursor != m_values.size()) ? TRUE : FALSE;
+            *hasNext = (++m_cursor != m_values->size()) ? TRUE : FALSE;
             return static_cast<HRESULT>(Error::OK);
         } CATCH_RETURN();
 
@@ -86,13 +104,13 @@ namespace MSIX {
         HRESULT STDMETHODCALLTYPE GetCurrent(LPSTR* value) noexcept override try
         {
             ThrowErrorIf(Error::InvalidParameter, (value == nullptr || *value != nullptr), "bad pointer");
-            return m_factory->MarshalOutStringUtf8(m_values.at(m_cursor), value);
+            return m_factory->MarshalOutStringUtf8(m_values->at(m_cursor), value);
             return static_cast<HRESULT>(Error::OK);
         } CATCH_RETURN();
 
     protected:
         IMsixFactory* m_factory;
-        std::vector<std::string> m_values;
+        Values m_values;
         std::size_t m_cursor = 0;
     };
 }
@@ -0,0 +1,63 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "Exceptions.hpp"
+#include "ComHelper.hpp"
+#include "StreamBase.hpp"
+#include "BlockMapStream.hpp"
+#include "PerformanceCounters.hpp"
+#include "BlockCache.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace MSIX {
+
+    // Reads the blocks of a payload file from the bytes it has in the package, see IMsixFileBlockReader. The file
+    // as it is stored, still deflated if it is compressed, is opened with openRawStream on the first read. Every
+    // block is inflated on its own and validated against its hash, or taken from the block cache of the factory
+    // when it has one with the block. Reads go through ReadAt when the raw stream supports it, so they run
+    // concurrently, and are serialized otherwise. Thread safe.
+    class FileBlockReader final
+    {
+    public:
+        FileBlockReader(std::function<ComPtr<IStream>()> openRawStream, std::uint64_t size, const FileBlocks& blocks,
+            const std::shared_ptr<PerformanceCounters>& performanceCounters = nullptr, const std::shared_ptr<BlockCache>& blockCache = nullptr);
+
+        std::size_t GetBlockCount() const { return m_blockCount; }
+        std::uint32_t GetBlockSize(std::size_t index) const;
+
+        // Reads the bytes of the file from offset and returns how many, fewer than count only at its end
+        std::uint32_t ReadRange(std::uint64_t offset, std::uint32_t count, std::uint8_t* buffer);
+
+    protected:
+        void Open();
+        // Reads the count bytes of the raw stream at offset
+        void ReadRaw(std::uint64_t offset, std::uint32_t count, std::uint8_t* buffer);
+        // Copies the block from the block cache to buffer and counts the hit or the miss
+        bool FindCached(std::size_t index, std::uint8_t* buffer);
+        void Inflate(const std::uint8_t* compressed, std::uint64_t compressedSize, std::uint8_t* buffer, std::uint32_t size);
+
+        std::function<ComPtr<IStream>()> m_openRawStream;
+        std::once_flag m_opened;
+        ComPtr<IStream> m_rawStream;
+        // Set when the raw stream supports positional reads
+        ComPtr<IStreamInternal> m_positionalStream;
+        // Serializes the seeks and reads of a raw stream without positional reads
+        std::mutex m_lock;
+        bool m_isCompressed = false;
+        std::uint64_t m_size = 0;
+        FileBlocks m_blocks;
+        std::size_t m_blockCount = 0;
+        // Where every block starts in the raw stream, and where the last one ends
+        std::vector<std::uint64_t> m_offsets;
+        std::shared_ptr<PerformanceCounters> m_performanceCounters;
+        std::shared_ptr<BlockCache> m_blockCache;
+    };
+}
@@ -0,0 +1,37 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace MSIX {
+
+    // Selects the files of a package to unpack with glob patterns, see UnpackPackageWithFilter. A file is selected
+    // when it matches one of the include patterns, or there are none, and none of the exclude patterns.
+    // Patterns are matched against the names of the files in the package, with '/' separators and ignoring case:
+    //   *   matches any characters but '/'
+    //   ?   matches any character but '/'
+    //   **  matches any characters, "**/" also matches no directory at all
+    // A pattern without '/' is matched against the last part of the name, so "*.pri" selects them in any directory.
+    class FileFilter final
+    {
+    public:
+        void AddInclude(const std::string& pattern) { m_includes.push_back(Normalize(pattern)); }
+        void AddExclude(const std::string& pattern) { m_excludes.push_back(Normalize(pattern)); }
+
+        bool IsEmpty() const { return m_includes.empty() && m_excludes.empty(); }
+        bool IsSelected(const std::string& fileName) const;
+
+        static bool Matches(const std::string& pattern, const std::string& fileName);
+
+    protected:
+        // Backslashes are taken as separators, like in the names of the block map
+        static std::string Normalize(const std::string& pattern);
+
+        std::vector<std::string> m_includes;
+        std::vector<std::string> m_excludes;
+    };
+}
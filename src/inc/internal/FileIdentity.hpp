@@ -0,0 +1,70 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include <string>
+
+#include "MSIXWindows.hpp"
+
+#ifndef WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+namespace MSIX {
+
+    // What identifies the content of an open regular file without reading it: the volume and file number, the
+    // size, and the times the file was last written to and had its metadata changed. Any write to the file, or
+    // another file renamed over its path, changes it. Empty when it can't be read or the file isn't a regular one.
+    #ifdef WIN32
+    inline std::string GetFileIdentity(HANDLE file)
+    {
+        BY_HANDLE_FILE_INFORMATION info = {};
+        FILE_BASIC_INFO basicInfo = {};
+        if ((GetFileType(file) != FILE_TYPE_DISK) || !GetFileInformationByHandle(file, &info) ||
+            !GetFileInformationByHandleEx(file, FileBasicInfo, &basicInfo, sizeof(basicInfo)))
+        {
+            return std::string();
+        }
+        return std::to_string(info.dwVolumeSerialNumber) + ":" +
+            std::to_string((static_cast<std::uint64_t>(info.nFileIndexHigh) << 32) | info.nFileIndexLow) + ":" +
+            std::to_string((static_cast<std::uint64_t>(info.nFileSizeHigh) << 32) | info.nFileSizeLow) + ":" +
+            std::to_string(basicInfo.LastWriteTime.QuadPart) + ":" + std::to_string(basicInfo.ChangeTime.QuadPart);
+    }
+    #else
+    inline std::string GetFileIdentity(const struct stat& fileStat)
+    {
+        if (!S_ISREG(fileStat.st_mode))
+        {
+            return std::string();
+        }
+        #ifdef __APPLE__
+        const auto& modified = fileStat.st_mtimespec;
+        const auto& changed = fileStat.st_ctimespec;
+        #else
+        const auto& modified = fileStat.st_mtim;
+        const auto& changed = fileStat.st_ctim;
+        #endif
+        return std::to_string(static_cast<std::uint64_t>(fileStat.st_dev)) + ":" +
+            std::to_string(static_cast<std::uint64_t>(fileStat.st_ino)) + ":" +
+            std::to_string(static_cast<std::uint64_t>(fileStat.st_size)) + ":" +
+            std::to_string(static_cast<std::int64_t>(modified.tv_sec)) + "." + std::to_string(static_cast<long>(modified.tv_nsec)) + ":" +
+            std::to_string(static_cast<std::int64_t>(changed.tv_sec)) + "." + std::to_string(static_cast<long>(changed.tv_nsec));
+    }
+
+    inline std::string GetFileIdentity(int file)
+    {
+        struct stat fileStat;
+        return (fstat(file, &fileStat) == -1) ? std::string() : GetFileIdentity(fileStat);
+    }
+
+    // Of the file at path, without opening it
+    inline std::string GetFileIdentity(const std::string& path)
+    {
+        struct stat fileStat;
+        return (stat(path.c_str(), &fileStat) == -1) ? std::string() : GetFileIdentity(fileStat);
+    }
+    #endif
+}
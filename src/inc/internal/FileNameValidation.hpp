@@ -13,6 +13,8 @@ namespace MSIX {
     {
         static bool IsFileNameValid(const std::string& name);
         static bool IsIdentifierValid(const std::string& name);
+        // Non-empty and only the characters the schema allows in package identifiers, a-z A-Z 0-9 . and -
+        static bool HasOnlyIdentifierCharacters(const std::string& name);
         static bool IsFootPrintFile(const std::string& fileName, bool isBundle);
         static bool IsReservedFolder(const std::string& fileName);
     };
@@ -0,0 +1,92 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace MSIX {
+
+    // Time a file being unpacked or packed spent in each stage, for the IMsixFileStatisticsCallback of a factory.
+    // The threads working on the file make it theirs with a Scope, and the stages they then measure, with Measure
+    // or PerformanceCounters::Measure, are charged to it. A stage measured within another one is taken out of the
+    // time of the outer one. Thread safe, the workers of a file add to it from their own threads.
+    class FileStatistics final
+    {
+    public:
+        enum class Stage
+        {
+            Read,
+            Inflate,
+            Deflate,
+            Hash,
+            Write,
+            Count,
+            None = Count,
+        };
+
+        void Add(Stage stage, std::chrono::steady_clock::duration duration);
+        // name is the name of the file in the package, with '/' separators.
+        void Report(IMsixFileStatisticsCallback* callback, const std::string& name, bool packed, std::uint64_t size,
+            std::uint64_t compressedSize, std::uint32_t blockCount) const;
+
+        // The file of the calling thread, null when it has none
+        static FileStatistics* GetCurrent();
+
+        // Makes statistics the file of the calling thread until it goes out of scope, then puts back the one it
+        // had. Does nothing when statistics is null.
+        class Scope final
+        {
+        public:
+            Scope(FileStatistics* statistics);
+            ~Scope();
+
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+        protected:
+            bool m_active = false;
+            FileStatistics* m_previous = nullptr;
+            Stage m_previousStage = Stage::None;
+        };
+
+        // Charges the time until it goes out of scope to a stage of the file of the calling thread, except the
+        // time of the stages measured meanwhile. Doesn't read the clock when the thread has no file.
+        class Measure final
+        {
+        public:
+            Measure(Stage stage);
+            ~Measure();
+
+            Measure(const Measure&) = delete;
+            Measure& operator=(const Measure&) = delete;
+
+        protected:
+            bool m_active = false;
+            Stage m_previous = Stage::None;
+        };
+
+    protected:
+        std::atomic<std::uint64_t> m_nanoseconds[static_cast<std::size_t>(Stage::Count)] = {};
+    };
+
+    // The stage of a file a stage of the performance counters is charged to
+    inline FileStatistics::Stage GetFileStatisticsStage(MSIX_PERFORMANCE_COUNTER_STAGE stage)
+    {
+        switch (stage)
+        {
+        case MSIX_PERFORMANCE_COUNTER_STAGE_INFLATE:  return FileStatistics::Stage::Inflate;
+        case MSIX_PERFORMANCE_COUNTER_STAGE_HASH:     return FileStatistics::Stage::Hash;
+        case MSIX_PERFORMANCE_COUNTER_STAGE_DEFLATE:  return FileStatistics::Stage::Deflate;
+        case MSIX_PERFORMANCE_COUNTER_STAGE_BLOCKMAP: return FileStatistics::Stage::Hash;
+        case MSIX_PERFORMANCE_COUNTER_STAGE_OPENFILE: return FileStatistics::Stage::Write;
+        default:                                      return FileStatistics::Stage::None;
+        }
+    }
+}
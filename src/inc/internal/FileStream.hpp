@@ -7,6 +7,12 @@
 #include <iostream>
 #include <string>
 #include <cstdio>
+#include <cerrno>
+#include <limits>
+
+#ifndef WIN32
+#include <unistd.h>
+#endif
 
 #include "Exceptions.hpp"
 #include "StreamBase.hpp"
@@ -18,7 +24,7 @@ namespace MSIX {
     public:
         enum Mode { READ = 0, WRITE, APPEND, READ_UPDATE, WRITE_UPDATE, APPEND_UPDATE };
 
-        FileStream(const std::string& name, Mode mode) : m_name(name)
+        FileStream(const std::string& name, Mode mode) : m_name(name), m_mode(mode)
         {
             static const char* modes[] = { "rb", "wb", "ab", "r+b", "w+b", "a+b" };
             #ifdef WIN32
@@ -34,10 +40,13 @@ namespace MSIX {
             ULARGE_INTEGER end = { 0 };
             ThrowHrIfFailed(Seek(start, StreamBase::Reference::END, &end));
             ThrowHrIfFailed(Seek(start, StreamBase::Reference::START, nullptr));
-            m_size = end.u.LowPart;
+            m_size = end.QuadPart;
+            #ifdef WIN32
+            OpenReadHandle(utf8_to_wstring(m_name));
+            #endif
         }
 
-        FileStream(const std::wstring& name, Mode mode)
+        FileStream(const std::wstring& name, Mode mode) : m_mode(mode)
         {
             m_name = wstring_to_utf8(name);
             #ifdef WIN32
@@ -54,7 +63,21 @@ namespace MSIX {
             ULARGE_INTEGER end = { 0 };
             ThrowHrIfFailed(Seek(start, StreamBase::Reference::END, &end));
             ThrowHrIfFailed(Seek(start, StreamBase::Reference::START, nullptr));
-            m_size = end.u.LowPart;
+            m_size = end.QuadPart;
+            #ifdef WIN32
+            OpenReadHandle(name);
+            #endif
+        }
+
+        // Takes ownership of an open file, such as the one returned by std::tmpfile
+        FileStream(FILE* file, Mode mode) : m_mode(mode), m_file(file)
+        {
+            ThrowErrorIfNot(Error::FileOpen, (m_file), "invalid file");
+            LARGE_INTEGER start = { 0 };
+            ULARGE_INTEGER end = { 0 };
+            ThrowHrIfFailed(Seek(start, StreamBase::Reference::END, &end));
+            ThrowHrIfFailed(Seek(start, StreamBase::Reference::START, nullptr));
+            m_size = end.QuadPart;
         }
 
         virtual ~FileStream() override
@@ -69,6 +92,13 @@ namespace MSIX {
                 std::fclose(m_file);
                 m_file = nullptr;
             }
+            #ifdef WIN32
+            if (m_readHandle != INVALID_HANDLE_VALUE)
+            {
+                CloseHandle(m_readHandle);
+                m_readHandle = INVALID_HANDLE_VALUE;
+            }
+            #endif
         }
 
         // IStream
@@ -76,8 +106,10 @@ namespace MSIX {
         {
             #ifdef WIN32
             int rc = _fseeki64(m_file, move.QuadPart, origin);
-            #else       
-            int rc = std::fseek(m_file, static_cast<long>(move.QuadPart), origin);
+            #else
+            ThrowErrorIf(Error::FileSeek, (move.QuadPart > std::numeric_limits<off_t>::max() || move.QuadPart < std::numeric_limits<off_t>::min()),
+                "seek out of range");
+            int rc = fseeko(m_file, static_cast<off_t>(move.QuadPart), origin);
             #endif
             ThrowErrorIfNot(Error::FileSeek, (rc == 0), "seek failed");
             m_offset = Ftell();
@@ -108,7 +140,57 @@ namespace MSIX {
         // IStreamInternal
         std::string GetName() override { return m_name; }
 
+        // Positional reads go directly to the OS file, so they are only allowed if nothing
+        // can be buffered for writing by the FILE object. On Windows they go through a handle
+        // of their own, a ReadFile on the handle of the FILE object would move its position.
+        bool SupportsReadAt() override
+        {
+            #ifdef WIN32
+            return m_mode == Mode::READ && m_readHandle != INVALID_HANDLE_VALUE;
+            #else
+            return m_mode == Mode::READ;
+            #endif
+        }
+
+        ULONG ReadAt(std::uint64_t offset, void* buffer, ULONG countBytes) override
+        {
+            ThrowErrorIfNot(Error::NotSupported, SupportsReadAt(), "positional reads require a read only file");
+            auto bytes = static_cast<std::uint8_t*>(buffer);
+            ULONG result = 0;
+            while (result < countBytes)
+            {
+                std::uint64_t position = offset + result;
+                #ifdef WIN32
+                OVERLAPPED overlapped = {};
+                overlapped.Offset = static_cast<DWORD>(position);
+                overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+                DWORD read = 0;
+                BOOL success = ReadFile(m_readHandle, bytes + result, countBytes - result, &read, &overlapped);
+                ThrowErrorIf(Error::FileRead, (!success && GetLastError() != ERROR_HANDLE_EOF), "read failed");
+                #else
+                ThrowErrorIf(Error::FileRead, (position > static_cast<std::uint64_t>(std::numeric_limits<off_t>::max())), "read out of range");
+                auto read = pread(fileno(m_file), bytes + result, countBytes - result, static_cast<off_t>(position));
+                if (read < 0 && errno == EINTR) { continue; }
+                ThrowErrorIf(Error::FileRead, (read < 0), "read failed");
+                #endif
+                if (read == 0) { break; } // end of file
+                result += static_cast<ULONG>(read);
+            }
+            return result;
+        }
+
     protected:
+        #ifdef WIN32
+        void OpenReadHandle(const std::wstring& name)
+        {
+            if (m_mode == Mode::READ)
+            {   // Without it positional reads are not supported, the stream is still usable
+                m_readHandle = CreateFileW(name.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+                    FILE_ATTRIBUTE_NORMAL, nullptr);
+            }
+        }
+        #endif
+
         inline int Ferror() { return std::ferror(m_file); }
         inline bool Feof()  { return 0 != std::feof(m_file); }
         inline void Flush() { std::fflush(m_file); }
@@ -117,15 +199,20 @@ namespace MSIX {
         {
             #ifdef WIN32
             auto result = _ftelli64(m_file);
-            #else       
-            auto result = std::ftell(m_file);
-            #endif  
+            #else
+            auto result = ftello(m_file);
+            #endif
+            ThrowErrorIf(Error::FileSeek, (result < 0), "tell failed");
             return static_cast<std::uint64_t>(result);
         }
 
         std::uint64_t m_offset = 0;
         std::uint64_t m_size = 0;
         std::string m_name;
+        Mode m_mode;
         FILE* m_file;
+        #ifdef WIN32
+        HANDLE m_readHandle = INVALID_HANDLE_VALUE;
+        #endif
     };
 }
@@ -9,32 +9,61 @@
 #include "StreamBase.hpp"
 #include "ComHelper.hpp"
 #include "Crypto.hpp"
+#include "PerformanceCounters.hpp"
+#include "MemoryBudget.hpp"
 
 #include <string>
 #include <map>
 #include <functional>
 #include <algorithm>
+#include <memory>
 
 namespace MSIX {
   
-    // This represents a subset of a Stream
+    // Validates the bytes of a stream against their SHA256 digest.
+    // Streams of up to maxCacheSize bytes are read and validated as a whole on the first read, and then
+    // served from memory. Larger streams are hashed as the bytes pass through to the caller, and the
+    // read that gets to the end of the stream fails if the digest doesn't match. Bytes skipped by seeking
+    // forward are read and hashed at that point, so the stream is always hashed in order.
+    // With a memory budget, the cache is reserved in it up front and the stream is hashed as it is read
+    // when the cache doesn't fit.
     class HashStream final : public StreamBase
     {
     protected:
         bool m_validated;
         ComPtr<IStream> m_stream;
-        std::vector<std::uint8_t>& m_expectedHash;
+        Sha256Digest m_expectedHash;
+        bool m_isExpectedHashValid = true;
         std::unique_ptr<std::vector<std::uint8_t>> m_cacheBuffer;
         std::uint64_t m_relativePosition;
-        size_t m_streamSize;
+        std::uint64_t m_streamSize;
+        size_t m_maxCacheSize;
+        std::uint64_t m_hashedSize = 0;
+        SHA256 m_hashEngine;
+        std::shared_ptr<PerformanceCounters> m_performanceCounters;
+        MemoryBudget::Reservation m_cacheReservation;
 
     public:
-        HashStream(const ComPtr<IStream>& stream, std::vector<std::uint8_t>& expectedHash) :
+        HashStream(const ComPtr<IStream>& stream, const std::vector<std::uint8_t>& expectedHash, size_t maxCacheSize = 0,
+            const std::shared_ptr<PerformanceCounters>& performanceCounters = nullptr,
+            const std::shared_ptr<MemoryBudget>& memoryBudget = nullptr) :
+            HashStream(stream, Sha256Digest{}, maxCacheSize, performanceCounters, memoryBudget)
+        {
+            // A digest of the wrong size fails like a digest that doesn't match, when the stream is validated
+            m_isExpectedHashValid = (expectedHash.size() == m_expectedHash.size());
+            if (m_isExpectedHashValid) { std::copy(expectedHash.begin(), expectedHash.end(), m_expectedHash.begin()); }
+        }
+
+        HashStream(const ComPtr<IStream>& stream, const Sha256Digest& expectedHash, size_t maxCacheSize = 0,
+            const std::shared_ptr<PerformanceCounters>& performanceCounters = nullptr,
+            const std::shared_ptr<MemoryBudget>& memoryBudget = nullptr) :
             m_validated(false),
             m_stream(stream),
             m_expectedHash(expectedHash),
             m_relativePosition(0),
-            m_streamSize(0)
+            m_streamSize(0),
+            m_maxCacheSize(maxCacheSize),
+            m_performanceCounters(performanceCounters)
         {
             ULARGE_INTEGER uli;
             LARGE_INTEGER li;
@@ -42,58 +71,108 @@ namespace MSIX {
             
             ThrowHrIfFailed(m_stream->Seek(li, StreamBase::Reference::END, &uli));
             ThrowHrIfFailed(m_stream->Seek(li, StreamBase::Reference::START, nullptr));
-            m_streamSize = static_cast<size_t>(uli.u.LowPart);
+            m_streamSize = uli.QuadPart;
+
+            if ((m_streamSize <= m_maxCacheSize) && !m_cacheReservation.TryReserve(memoryBudget, m_streamSize))
+            {   m_maxCacheSize = 0;
+            }
         }
 
         void Validate()
         {
             if (m_validated) { return; }
 
+            // The cache holds the whole stream, whatever position it was moved to before the first read
+            LARGE_INTEGER start = { 0 };
+            ThrowHrIfFailed(m_stream->Seek(start, StreamBase::Reference::START, nullptr));
+
             // read stream into cache buffer
-            m_cacheBuffer = std::make_unique<std::vector<std::uint8_t>>(m_streamSize);
+            m_cacheBuffer = std::make_unique<std::vector<std::uint8_t>>(static_cast<size_t>(m_streamSize));
             ULONG bytesRead = 0;
             ThrowHrIfFailed(m_stream->Read(m_cacheBuffer->data(), static_cast<ULONG>(m_cacheBuffer->size()), &bytesRead));
             ThrowErrorIfNot(MSIX::Error::SignatureInvalid, bytesRead == m_streamSize, "read failed");
 
             // compute digest and compare against expected digest
-            std::vector<std::uint8_t> hash;
-            ThrowErrorIfNot(MSIX::Error::SignatureInvalid, 
-                MSIX::SHA256::ComputeHash(m_cacheBuffer->data(), static_cast<uint32_t>(m_cacheBuffer->size()), hash), 
-                "Invalid signature");
-            ThrowErrorIfNot(MSIX::Error::SignatureInvalid, m_expectedHash.size() == hash.size(), "Signature is corrupt");
+            Sha256Digest hash;
+            {
+                PerformanceCounters::Measure measure(m_performanceCounters.get(), MSIX_PERFORMANCE_COUNTER_STAGE_HASH, m_cacheBuffer->size());
+                MSIX::SHA256::ComputeHash(m_cacheBuffer->data(), static_cast<uint32_t>(m_cacheBuffer->size()), hash);
+            }
+            CompareHash(hash);
+        }
+
+        void CompareHash(const Sha256Digest& hash)
+        {
+            ThrowErrorIfNot(MSIX::Error::SignatureInvalid, m_isExpectedHashValid, "Signature is corrupt");
             ThrowErrorIfNot(
                 MSIX::Error::SignatureInvalid,
-                memcmp(m_expectedHash.data(), hash.data(), hash.size()) == 0,
+                m_expectedHash == hash,
                 "Signature hash doesn't match digest hash"); //TODO: better exception
 
             m_validated = true;
         }
 
+        // Hashes bytes of the stream that are right after the ones already hashed.
+        void HashData(const std::uint8_t* buffer, std::uint64_t offset, ULONG count)
+        {
+            if (m_validated || (offset + count <= m_hashedSize)) { return; }
+            ULONG skip = static_cast<ULONG>(m_hashedSize - offset);
+            Sha256Digest hash;
+            {
+                PerformanceCounters::Measure measure(m_performanceCounters.get(), MSIX_PERFORMANCE_COUNTER_STAGE_HASH, count - skip);
+                m_hashEngine.HashData(buffer + skip, count - skip);
+                m_hashedSize = offset + count;
+                if (m_hashedSize != m_streamSize) { return; }
+                m_hashEngine.FinalizeAndGetHashValue(hash);
+            }
+            CompareHash(hash);
+        }
+
+        // Reads and hashes the bytes between the ones already hashed and position.
+        void HashUpTo(std::uint64_t position)
+        {
+            const ULONG chunkSize = 64*1024;
+            std::vector<std::uint8_t> chunk(static_cast<size_t>(std::min(static_cast<std::uint64_t>(chunkSize), position - m_hashedSize)));
+            LARGE_INTEGER li = { 0 };
+            li.QuadPart = m_hashedSize;
+            ThrowHrIfFailed(m_stream->Seek(li, StreamBase::Reference::START, nullptr));
+            while (m_hashedSize < position)
+            {
+                ULONG count = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(chunk.size()), position - m_hashedSize));
+                ULONG bytesRead = 0;
+                ThrowHrIfFailed(m_stream->Read(chunk.data(), count, &bytesRead));
+                ThrowErrorIfNot(MSIX::Error::SignatureInvalid, bytesRead == count, "read failed");
+                HashData(chunk.data(), m_hashedSize, bytesRead);
+            }
+        }
+
         void CacheSeek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER *newPosition)
         {
             LARGE_INTEGER newPos = { 0 };
             switch (origin)
             {
                 case Reference::CURRENT:
-                    m_relativePosition += move.u.LowPart;
+                    newPos.QuadPart = m_relativePosition + move.QuadPart;
                     break;
                 case Reference::START:
-                    m_relativePosition = move.u.LowPart;
+                    newPos.QuadPart = move.QuadPart;
                     break;
                 case Reference::END:
-                    m_relativePosition = m_streamSize;
+                    newPos.QuadPart = m_streamSize + move.QuadPart;
                     break;
             }
-            m_relativePosition = std::max((std::uint64_t)0, std::min(m_relativePosition, static_cast<std::uint64_t>(m_streamSize)));
+            newPos.QuadPart = std::max(static_cast<LONGLONG>(0), newPos.QuadPart);
+            m_relativePosition = std::min(static_cast<std::uint64_t>(newPos.QuadPart), m_streamSize);
             if (newPosition) { newPosition->QuadPart = (std::uint64_t)m_relativePosition; }
         }        
 
         HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER *newPosition) noexcept override try
         {
-            if (m_cacheBuffer.get() == nullptr)
+            if ((m_streamSize <= m_maxCacheSize) && (m_cacheBuffer.get() == nullptr))
             {   ThrowHrIfFailed(m_stream->Seek(move, origin, newPosition));
             }
             // always call into cache seek to keep cache state aligned with the underlying stream state.
+            // When streaming, the underlying stream is moved to this position by the next read.
             CacheSeek(move, origin, newPosition);
             return static_cast<HRESULT>(Error::OK);
         } CATCH_RETURN();
@@ -108,12 +187,37 @@ namespace MSIX {
             }
 
             m_relativePosition += bytesToRead;
-            if (m_streamSize == m_relativePosition) { m_cacheBuffer = nullptr; }
+            if (m_streamSize == m_relativePosition)
+            {   m_cacheBuffer = nullptr;
+                m_cacheReservation = MemoryBudget::Reservation();
+            }
             if (actualRead) { *actualRead = bytesToRead; }
         }
 
+        void StreamingRead(void* buffer, ULONG countBytes, ULONG* actualRead)
+        {
+            ThrowErrorIf(Error::Stg_E_Invalidpointer, (buffer == nullptr), "bad input");
+            if (!m_validated && (m_relativePosition > m_hashedSize)) { HashUpTo(m_relativePosition); }
+
+            LARGE_INTEGER li = { 0 };
+            li.QuadPart = m_relativePosition;
+            ThrowHrIfFailed(m_stream->Seek(li, StreamBase::Reference::START, nullptr));
+            ULONG bytesToRead = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(countBytes), m_streamSize - m_relativePosition));
+            ULONG bytesRead = 0;
+            ThrowHrIfFailed(m_stream->Read(buffer, bytesToRead, &bytesRead));
+            HashData(static_cast<const std::uint8_t*>(buffer), m_relativePosition, bytesRead);
+
+            m_relativePosition += bytesRead;
+            if (actualRead) { *actualRead = bytesRead; }
+        }
+
         HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* actualRead) noexcept override try
         {
+            if (m_streamSize > m_maxCacheSize)
+            {   StreamingRead(buffer, countBytes, actualRead);
+                return static_cast<HRESULT>(Error::OK);
+            }
+
             Validate();
             if (m_cacheBuffer.get() == nullptr)
             {   ThrowHrIfFailed(m_stream->Read(buffer, countBytes, actualRead));
@@ -188,7 +188,13 @@ class IXmlFactory : public IUnknown
 // An internal interface for creating an IXmlDom object as well as managing XML services lifetime
 {
 public:
-    virtual MSIX::ComPtr<IXmlDom> CreateDomFromStream(XmlContentType footPrintType, const MSIX::ComPtr<IStream>& stream) = 0;
+    // When validateSchema is false the document is only checked to be well formed, even by a validating parser.
+    virtual MSIX::ComPtr<IXmlDom> CreateDomFromStream(XmlContentType footPrintType, const MSIX::ComPtr<IStream>& stream, bool validateSchema) = 0;
+
+    MSIX::ComPtr<IXmlDom> CreateDomFromStream(XmlContentType footPrintType, const MSIX::ComPtr<IStream>& stream)
+    {
+        return CreateDomFromStream(footPrintType, stream, true);
+    }
 };
 MSIX_INTERFACE(IXmlFactory, 0xf82a60ec,0xfbfc,0x4cb9,0xbc,0x04,0x1a,0x0f,0xe2,0xb4,0xd5,0xbe);
 
@@ -223,9 +229,8 @@ namespace MSIX {
     };
 
     template <class T>
-    static T GetNumber(const ComPtr<IXmlElement>& element, XmlAttributeName attribute, T defaultValue)
+    static T GetNumber(const std::string& attributeValue, T defaultValue)
     {
-        const auto& attributeValue = element->GetAttributeValue(attribute);
         bool hasValue = !attributeValue.empty();
         T value = defaultValue;
         if (hasValue)
@@ -250,6 +255,12 @@ namespace MSIX {
         return value;
     }
 
+    template <class T>
+    static T GetNumber(const ComPtr<IXmlElement>& element, XmlAttributeName attribute, T defaultValue)
+    {
+        return GetNumber<T>(element->GetAttributeValue(attribute), defaultValue);
+    }
+
 #ifdef USING_MSXML
     using XmlQueryNameCharType = wchar_t;
 #else
@@ -258,6 +269,8 @@ namespace MSIX {
 
     const XmlQueryNameCharType* GetQueryString(XmlQueryName query);
     std::string GetQueryStringUtf8(XmlQueryName query);
+    // Number of values of XmlQueryName, for PALs that precompile every query once.
+    std::size_t GetQueryCount();
 
     std::wstring GetAttributeNameString(XmlAttributeName attr);
     const char* GetAttributeNameStringUtf8(XmlAttributeName attr);
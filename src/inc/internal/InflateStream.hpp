@@ -7,6 +7,8 @@
 #include "StreamBase.hpp"
 #include "ComHelper.hpp"
 #include "ICompressionObject.hpp"
+#include "BufferPool.hpp"
+#include "PerformanceCounters.hpp"
 
 #undef max
 #undef min
@@ -17,13 +19,23 @@
 
 namespace MSIX {
 
+    class FileBlocks;
+    class WorkerPool;
+    class ProgressReporter;
+    class MappedOutputFile;
+
+    // Default size of the compressed buffer and of the inflate window. See zlib's updatewindow comment.
+    const std::size_t DefaultInflateBufferSize = 32*1024;
+
     // This represents a LZW-compressed stream
     class InflateStream final : public StreamBase
     {
     public:
-        InflateStream(const ComPtr<IStream>& stream, std::uint64_t uncompressedSize);
+        InflateStream(const ComPtr<IStream>& stream, std::uint64_t uncompressedSize, std::size_t bufferSize = DefaultInflateBufferSize,
+            const std::shared_ptr<BufferPool>& bufferPool = nullptr, const std::shared_ptr<PerformanceCounters>& performanceCounters = nullptr);
         ~InflateStream();
 
+        HRESULT STDMETHODCALLTYPE Clone(IStream** stream) noexcept override;
         HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER *newPosition) noexcept override;
         HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) noexcept override;
         HRESULT STDMETHODCALLTYPE Write(void const *buffer, ULONG countBytes, ULONG *bytesWritten) noexcept override
@@ -34,18 +46,20 @@ namespace MSIX {
         // IStreamInternal
         std::uint64_t GetSize() override
         {   // The underlying ZipFileStream object knows, so go ask it.
-            return m_stream.As<IStreamInternal>()->GetSize();
+            return m_streamInternal->GetSize();
         }
 
         bool IsCompressed() override
         {   // The underlying ZipFileStream object knows, so go ask it.
-            return m_stream.As<IStreamInternal>()->IsCompressed();
+            return m_streamInternal->IsCompressed();
         }
 
         std::string GetName() override
         {   // The underlying ZipFileStream object knows, so go ask it.
-            return m_stream.As<IStreamInternal>()->GetName();
+            return m_streamInternal->GetName();
         }
+
+        void SetSeekPoints(std::uint64_t uncompressedBlockSize, const std::vector<std::uint64_t>& compressedBlockSizes) override;
         void Cleanup();
 
         enum class State : size_t
@@ -62,18 +76,53 @@ namespace MSIX {
         State m_state    = State::UNINITIALIZED;
 
         ComPtr<IStream> m_stream;
+        // Queried once, the metadata of the stream is asked for per file and per seek
+        ComPtr<IStreamInternal> m_streamInternal;
         ULONGLONG       m_seekPosition = 0;
         ULONGLONG       m_uncompressedSize = 0;
         ULONG           m_bytesRead = 0;
         std::uint8_t*   m_startCurrentBuffer = nullptr;
         ULONG           m_inflateWindowPosition = 0;
+        ULONG           m_inflateWindowSize = 0;
         ULONGLONG       m_fileCurrentWindowPositionEnd = 0;
         ULONGLONG       m_fileCurrentPosition = 0;
 
+        // Compressed offset of the start of every block of m_seekPointInterval uncompressed bytes. When
+        // present, seeks restart inflation at the nearest block instead of at the start of the stream.
+        std::vector<std::uint64_t> m_seekPoints;
+        std::uint64_t   m_seekPointInterval = 0;
+        ULONGLONG       m_restartPosition = 0;
+        std::uint64_t   m_restartOffset = 0;
+
         std::unique_ptr<ICompressionObject> m_compressionObject;
         CompressionStatus m_compressionStatus = CompressionStatus::Ok;
 
-        std::unique_ptr<std::vector<std::uint8_t>> m_compressedBuffer;
-        std::unique_ptr<std::vector<std::uint8_t>> m_inflateWindow;
+        // Taken from the pool on first use and reused for every window, including after seeking backwards. They
+        // go back to the pool once the whole file is inflated, so files read one after the other share them.
+        std::size_t                 m_bufferSize = DefaultInflateBufferSize;
+        std::shared_ptr<BufferPool> m_bufferPool;
+        PooledBuffer                m_compressedBuffer;
+        PooledBuffer                m_inflateWindow;
+
+        std::shared_ptr<PerformanceCounters> m_performanceCounters;
     };
+
+    // Block-parallel alternative to reading an InflateStream sequentially. Each block of the file is
+    // compressed on its own (see DeflateStream), so the blocks are split across threadCount workers of
+    // pool, each one inflating from its own clone of stream and validating the block against its hash,
+    // and the blocks are then written to 'to' in order. Returns false without reading the file if stream
+    // can't be decoded this way, in which case it must be read sequentially instead. progress, when not null, is
+    // advanced as the blocks are written. Without validateBlocks, the blocks are only used for their sizes.
+    bool InflateBlocksInParallel(const ComPtr<IStream>& stream, const FileBlocks& blocks, IStream* to, std::uint32_t threadCount, WorkerPool& pool,
+        ProgressReporter* progress = nullptr, bool validateBlocks = true);
+
+    // The writeback of a mapped output file is started every time this many bytes of it are in place
+    const std::uint64_t MappedOutputWritebackSize = 8 * 1024 * 1024;
+
+    // Same as InflateBlocksInParallel, inflating the blocks straight to their place in file, which has the size of
+    // the stream. There is no copy to a stream and the workers don't wait for each other: each takes the next run
+    // of blocks and fills its part of the file, and the one that completes MappedOutputWritebackSize bytes of the
+    // file starts their writeback.
+    bool InflateBlocksToMappedFile(const ComPtr<IStream>& stream, const FileBlocks& blocks, MappedOutputFile& file, std::uint32_t threadCount,
+        WorkerPool& pool, ProgressReporter* progress = nullptr, bool validateBlocks = true);
 }
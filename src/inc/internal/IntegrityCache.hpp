@@ -0,0 +1,51 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "ComHelper.hpp"
+#include "Crypto.hpp"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace MSIX {
+
+    // The payload files of a package that were read or verified once with all their blocks matching the block map,
+    // as kept in the IMsixIntegrityCache of the factory for the local file the package is read from. The identity
+    // of the file is read again before a file is taken as verified or recorded, so a package written to while it
+    // is open is hashed as usual. Shared by a package reader and the streams of its files, on any thread.
+    class IntegrityRecord final
+    {
+    public:
+        using IdentityReader = std::function<std::string()>;
+
+        // Null when there is no cache or the package isn't read from a local file. readIdentity returns the
+        // current identity of that file, blockMapHash is the hash of the AppxBlockMap.xml of the package.
+        static std::shared_ptr<IntegrityRecord> Open(const ComPtr<IMsixIntegrityCache>& cache, const IdentityReader& readIdentity,
+            const Sha256Digest& blockMapHash);
+
+        IntegrityRecord(const ComPtr<IMsixIntegrityCache>& cache, const IdentityReader& readIdentity, const std::string& identity,
+            const std::string& key);
+
+        bool IsVerified(const std::string& fileName);
+        // Adds the files to the entry of the package, which is written again if any of them wasn't in it.
+        void AddVerified(const std::vector<std::string>& fileNames);
+
+    protected:
+        bool IsUnchanged() { return m_readIdentity() == m_identity; }
+
+        std::mutex m_lock;
+        ComPtr<IMsixIntegrityCache> m_cache;
+        IdentityReader m_readIdentity;
+        std::string m_identity;
+        std::string m_key;
+        std::set<std::string> m_verified;
+    };
+}
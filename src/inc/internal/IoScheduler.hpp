@@ -0,0 +1,142 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "Exceptions.hpp"
+#include "ComHelper.hpp"
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace MSIX {
+
+    // Offset of a request that reads or writes at the current position of its stream.
+    const std::uint64_t IoCurrentPosition = std::numeric_limits<std::uint64_t>::max();
+    const std::size_t IoSchedulerMaxThreads = 8;
+
+    enum class IoOperation
+    {
+        Read,
+        Write,
+    };
+
+    // One read or write of a batch. Reads fill the buffer up to size bytes or the end of the stream, writes
+    // write all of it. transferred and result are set once the request is done.
+    struct IoRequest
+    {
+        IoRequest(IoOperation operation, const ComPtr<IStream>& stream, std::uint64_t offset, void* buffer, ULONG size) :
+            operation(operation), stream(stream), offset(offset), buffer(buffer), size(size) {}
+
+        static IoRequest Read(const ComPtr<IStream>& stream, std::uint64_t offset, void* buffer, ULONG size)
+        {
+            return IoRequest(IoOperation::Read, stream, offset, buffer, size);
+        }
+
+        static IoRequest Write(const ComPtr<IStream>& stream, std::uint64_t offset, const void* buffer, ULONG size)
+        {
+            return IoRequest(IoOperation::Write, stream, offset, const_cast<void*>(buffer), size);
+        }
+
+        IoOperation operation;
+        ComPtr<IStream> stream;
+        std::uint64_t offset;
+        void* buffer;
+        ULONG size;
+        ULONG transferred = 0;
+        HRESULT result = static_cast<HRESULT>(Error::OK);
+    };
+
+    class IoBatch;
+    // Called once every request of a batch is done, on the thread that finished the last one.
+    using IoCompletion = std::function<void(IoBatch&)>;
+
+    // Requests submitted together. The buffers must stay valid until the batch is done.
+    class IoBatch final
+    {
+    public:
+        IoBatch(std::vector<IoRequest>&& requests, IoCompletion&& completion) :
+            m_requests(std::move(requests)), m_completion(std::move(completion)), m_pending(0) {}
+
+        std::vector<IoRequest>& GetRequests() { return m_requests; }
+
+        // Waits for every request and throws the first failure. Must not be called from a completion, the
+        // thread that runs it may be the one the batch waits for.
+        void Wait();
+        // The first failure of the batch, or OK.
+        HRESULT GetResult();
+        bool IsDone();
+
+    protected:
+        friend class IoScheduler;
+
+        void RequestsDone(std::size_t count);
+
+        std::vector<IoRequest> m_requests;
+        IoCompletion m_completion;
+        std::mutex m_lock;
+        std::condition_variable m_done;
+        std::size_t m_pending;
+        bool m_complete = false;
+    };
+
+    // Runs batches of reads and writes on streams asynchronously. Requests on streams that support positional
+    // reads run concurrently. Requests on other streams use the seek pointer, so the ones of the same stream run
+    // one after the other in the order they are in the batch, and a caller must not submit another batch on that
+    // stream before the previous one is done. Backends only differ in what runs the requests: the library reads
+    // and writes through IStream objects that callers implement, so there is no file handle to hand to io_uring
+    // or an I/O completion port, and the default backend is a small pool of threads shared by the process.
+    class IoScheduler
+    {
+    public:
+        virtual ~IoScheduler() = default;
+
+        std::shared_ptr<IoBatch> Submit(std::vector<IoRequest>&& requests, IoCompletion completion = nullptr);
+
+        // Submits the requests and waits for them.
+        void Run(std::vector<IoRequest>& requests);
+
+        // The scheduler used when a caller doesn't provide one.
+        static std::shared_ptr<IoScheduler> GetDefault();
+        // Stops the threads of the default scheduler, see MsixShutdownThreads. They start again when needed.
+        static void StopDefault();
+
+    protected:
+        // Runs task eventually, on any thread.
+        virtual void Post(std::function<void()>&& task) = 0;
+
+        static void Execute(IoRequest& request) noexcept;
+    };
+
+    // Backend that runs the requests on up to threadCount threads, started as they are needed.
+    class ThreadPoolIoScheduler final : public IoScheduler
+    {
+    public:
+        ThreadPoolIoScheduler(std::size_t threadCount);
+        ~ThreadPoolIoScheduler();
+
+        // Runs the queued requests and waits for the threads to return. Nothing may be submitted meanwhile.
+        void Stop();
+
+    protected:
+        void Post(std::function<void()>&& task) override;
+        void WorkerLoop() noexcept;
+
+        std::size_t m_maxThreads;
+        std::mutex m_lock;
+        std::condition_variable m_changed;
+        std::deque<std::function<void()>> m_tasks;
+        std::vector<std::thread> m_threads;
+        std::size_t m_idleThreads = 0;
+        bool m_stop = false;
+    };
+}
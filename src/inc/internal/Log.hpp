@@ -3,14 +3,24 @@
 //  See LICENSE file in the project root for full license information.
 // 
 #pragma once
+#include <cstddef>
 #include <string>
 
 namespace MSIX {
     namespace Global { 
         namespace Log {
+            // Only the last LogCapacity errors are kept, older ones are dropped as new ones come.
+            const std::size_t LogCapacity = 64;
+
+            class EntryRef;
+
             void Append(const std::string& comment);
-            std::string Text();
-            void Clear();
+            // Records a failure without formatting it, the text is only built when the log is read. Returns the
+            // entry, which the exception raising the failure keeps instead of a copy of its details.
+            // file must be a string literal, as given by __FILE__.
+            EntryRef Append(const char* file, int line, const char* details);
+            // Returns the text of the errors recorded so far and removes them from the log.
+            std::string Take();
         }
     }
 }
\ No newline at end of file
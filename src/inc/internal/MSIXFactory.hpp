@@ -8,6 +8,10 @@
 
 #include <vector>
 
+#include <memory>
+
+namespace MSIX { class ApplicabilityCache; class TrustedCertificateCache; class SignatureVerificationCache; class CertificateChainCache; class BufferPool; class WorkerPool; class ProgressReporter; class PerformanceCounters; class MemoryBudget; class QualityOfService; class BlockStore; class BlockCache; class CompressedBlockCache; struct PackageIndex; }
+
 // internal interface
 // {1f850db4-32b8-4db6-8bf4-5a897eb611f1}
 #ifndef WIN32
@@ -19,11 +23,41 @@ class IMsixFactory : public IUnknown
 #endif
 {
 public:
-    virtual HRESULT MarshalOutString(std::string& internal, LPWSTR* result) = 0;
+    virtual HRESULT MarshalOutString(const std::string& internal, LPWSTR* result) = 0;
     virtual HRESULT MarshalOutBytes(std::vector<std::uint8_t>& data, UINT32* size, BYTE** buffer) = 0;
     virtual MSIX_VALIDATION_OPTION GetValidationOptions() = 0;
     virtual MSIX::ComPtr<IStream> GetResource(const std::string& resource) = 0;
     virtual HRESULT MarshalOutWstring(std::wstring& internal, LPWSTR* result) = 0;
-    virtual HRESULT MarshalOutStringUtf8(std::string& internal, LPSTR* result) = 0;
+    virtual HRESULT MarshalOutStringUtf8(const std::string& internal, LPSTR* result) = 0;
+    virtual MSIX::ApplicabilityCache& GetApplicabilityCache() = 0;
+    virtual MSIX::TrustedCertificateCache& GetTrustedCertificateCache() = 0;
+    virtual MSIX::SignatureVerificationCache& GetSignatureVerificationCache() = 0;
+    virtual MSIX::CertificateChainCache& GetCertificateChainCache() = 0;
+    virtual std::shared_ptr<MSIX::BufferPool> GetBufferPool() = 0;
+    virtual std::shared_ptr<MSIX::WorkerPool> GetWorkerPool() = 0;
+    virtual std::shared_ptr<MSIX::ProgressReporter> GetProgressReporter() = 0;
+    // Null unless the factory was created with MSIX_FACTORY_OPTION_PERFORMANCE_COUNTERS
+    virtual std::shared_ptr<MSIX::PerformanceCounters> GetPerformanceCounters() = 0;
+    virtual std::shared_ptr<MSIX::MemoryBudget> GetMemoryBudget() = 0;
+    virtual std::shared_ptr<MSIX::QualityOfService> GetQualityOfService() = 0;
+    // Null unless a store was set with MsixSetBlockStore
+    virtual std::shared_ptr<MSIX::BlockStore> GetBlockStore() = 0;
+    virtual void SetBlockStore(const std::shared_ptr<MSIX::BlockStore>& blockStore) = 0;
+    // Null unless a cache was set with MsixSetBlockCache
+    virtual std::shared_ptr<MSIX::BlockCache> GetBlockCache() = 0;
+    virtual void SetBlockCache(const std::shared_ptr<MSIX::BlockCache>& blockCache) = 0;
+    // Null unless a cache was set with MsixSetCompressedBlockCache
+    virtual std::shared_ptr<MSIX::CompressedBlockCache> GetCompressedBlockCache() = 0;
+    virtual void SetCompressedBlockCache(const std::shared_ptr<MSIX::CompressedBlockCache>& compressedBlockCache) = 0;
+    // Null unless MSIX_FACTORY_EXTENSION_OUTPUT_STREAM_FACTORY was specified
+    virtual MSIX::ComPtr<IMsixOutputStreamFactory> GetOutputStreamFactory() = 0;
+    // Null unless MSIX_FACTORY_EXTENSION_MANIFEST_CACHE was specified
+    virtual MSIX::ComPtr<IMsixManifestCache> GetManifestCache() = 0;
+    // Null unless MSIX_FACTORY_EXTENSION_INTEGRITY_CACHE was specified
+    virtual MSIX::ComPtr<IMsixIntegrityCache> GetIntegrityCache() = 0;
+    // Null unless MSIX_FACTORY_EXTENSION_FILE_STATISTICS_CALLBACK was specified
+    virtual MSIX::ComPtr<IMsixFileStatisticsCallback> GetFileStatisticsCallback() = 0;
+    // Same as IAppxFactory::CreatePackageReader, index is the sidecar index of the package, or null
+    virtual MSIX::ComPtr<IAppxPackageReader> CreatePackageReaderWithIndex(const MSIX::ComPtr<IStream>& inputStream, const MSIX::PackageIndex* index) = 0;
 };
 MSIX_INTERFACE(IMsixFactory, 0x1f850db4,0x32b8,0x4db6,0x8b,0xf4,0x5a,0x89,0x7e,0xb6,0x11,0xf1);
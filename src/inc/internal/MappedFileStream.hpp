@@ -0,0 +1,298 @@
+//
+//  Copyright (C) 2017 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <limits>
+#include <memory>
+
+#include "Exceptions.hpp"
+#include "StreamBase.hpp"
+#include "UnicodeConversion.hpp"
+#include "FileIdentity.hpp"
+#include "DeferredFileCloser.hpp"
+
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/vfs.h>
+#endif
+
+namespace MSIX {
+    // A file opened for read and mapped in memory, for as long as the object exists.
+    class MappedFile final
+    {
+    public:
+        MappedFile(const std::string& name) : m_name(name)
+        {
+            #ifdef WIN32
+            auto utf16Name = utf8_to_wstring(name);
+            m_file = CreateFileW(utf16Name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            ThrowErrorIf(Error::FileOpen, (m_file == INVALID_HANDLE_VALUE), std::string("file: " + m_name + " does not exist.").c_str());
+            LARGE_INTEGER size = { 0 };
+            ThrowErrorIfNot(Error::FileOpen, GetFileSizeEx(m_file, &size), std::string("file: " + m_name + " size unknown.").c_str());
+            m_size = static_cast<std::uint64_t>(size.QuadPart);
+            if (m_size != 0)
+            {
+                m_mapping = CreateFileMappingW(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                ThrowErrorIf(Error::FileOpen, (m_mapping == nullptr), std::string("file: " + m_name + " can't be mapped.").c_str());
+                m_data = static_cast<const std::uint8_t*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+                ThrowErrorIf(Error::FileOpen, (m_data == nullptr), std::string("file: " + m_name + " can't be mapped.").c_str());
+            }
+            #else
+            m_file = open(name.c_str(), O_RDONLY);
+            ThrowErrorIf(Error::FileOpen, (m_file == -1), std::string("file: " + m_name + " does not exist.").c_str());
+            struct stat fileStat;
+            ThrowErrorIf(Error::FileOpen, (fstat(m_file, &fileStat) == -1), std::string("file: " + m_name + " size unknown.").c_str());
+            m_size = static_cast<std::uint64_t>(fileStat.st_size);
+            if (m_size != 0)
+            {
+                void* data = mmap(nullptr, static_cast<size_t>(m_size), PROT_READ, MAP_PRIVATE, m_file, 0);
+                ThrowErrorIf(Error::FileOpen, (data == MAP_FAILED), std::string("file: " + m_name + " can't be mapped.").c_str());
+                m_data = static_cast<const std::uint8_t*>(data);
+            }
+            #endif
+        }
+
+        ~MappedFile()
+        {
+            #ifdef WIN32
+            if (m_data) { UnmapViewOfFile(m_data); }
+            if (m_mapping) { CloseHandle(m_mapping); }
+            if (m_file != INVALID_HANDLE_VALUE) { CloseHandle(m_file); }
+            #else
+            if (m_data) { munmap(const_cast<std::uint8_t*>(m_data), static_cast<size_t>(m_size)); }
+            if (m_file != -1) { close(m_file); }
+            #endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const std::uint8_t* GetData() const { return m_data; }
+        std::uint64_t GetSize() const { return m_size; }
+        std::string GetIdentity() const { return MSIX::GetFileIdentity(m_file); }
+
+        // The mapping of the file the process already has open for name, if it is still the same file, or a new
+        // one. Mappings are shared by file identity, so every path to a file gets the same one, and one is
+        // released with the last stream over it.
+        static std::shared_ptr<MappedFile> OpenShared(const std::string& name);
+
+    protected:
+        std::string m_name;
+        std::uint64_t m_size = 0;
+        const std::uint8_t* m_data = nullptr;
+        #ifdef WIN32
+        HANDLE m_file = INVALID_HANDLE_VALUE;
+        HANDLE m_mapping = nullptr;
+        #else
+        int m_file = -1;
+        #endif
+    };
+
+    // A file created at its final size and mapped for write, so its bytes are put in place by whoever has them
+    // instead of going through a stream, see InflateBlocksToMappedFile. Its space is allocated when it is created:
+    // running out of disk space while writing to a mapping could only be reported by a fault. Flush starts the
+    // writeback of a range without waiting for it, what isn't flushed is written back by the system after the
+    // mapping is released, like what is written with a stream. With a closer, the file is closed by it.
+    class MappedOutputFile final
+    {
+    public:
+        // Null if the file can't be created, its space allocated or it mapped, like on a network share or a file
+        // system that can't allocate space up front. The file is then left empty, to be written with a stream.
+        static std::unique_ptr<MappedOutputFile> Create(const std::string& name, std::uint64_t size,
+            const std::shared_ptr<DeferredFileCloser>& closer = nullptr)
+        {
+            std::unique_ptr<MappedOutputFile> result(new MappedOutputFile(closer));
+            if ((size == 0) || (size > static_cast<std::uint64_t>(std::numeric_limits<std::size_t>::max())))
+            {
+                return nullptr;
+            }
+            #ifdef WIN32
+            result->m_file = CreateFileW(utf8_to_wstring(name).c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr,
+                CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (result->m_file == INVALID_HANDLE_VALUE) { return nullptr; }
+            // Only files on a remote file system have a remote protocol
+            FILE_REMOTE_PROTOCOL_INFO remote = {};
+            if (GetFileInformationByHandleEx(result->m_file, FileRemoteProtocolInfo, &remote, sizeof(remote))) { return nullptr; }
+            // Extending the end of file allocates the space
+            FILE_END_OF_FILE_INFO end = {};
+            end.EndOfFile.QuadPart = static_cast<LONGLONG>(size);
+            if (!SetFileInformationByHandle(result->m_file, FileEndOfFileInfo, &end, sizeof(end))) { return nullptr; }
+            result->m_mapping = CreateFileMappingW(result->m_file, nullptr, PAGE_READWRITE, 0, 0, nullptr);
+            if (result->m_mapping == nullptr) { return nullptr; }
+            result->m_data = static_cast<std::uint8_t*>(MapViewOfFile(result->m_mapping, FILE_MAP_WRITE, 0, 0, 0));
+            if (result->m_data == nullptr) { return nullptr; }
+            #elif defined(__linux__)
+            do
+            {
+                result->m_file = open(name.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+            } while (result->m_file == -1 && errno == EINTR);
+            if (result->m_file == -1) { return nullptr; }
+            // NFS, SMB and CIFS, whose writes are better sent as they are made
+            struct statfs fileSystem;
+            if (fstatfs(result->m_file, &fileSystem) == -1) { return nullptr; }
+            auto type = static_cast<std::uint32_t>(fileSystem.f_type);
+            if (type == 0x6969 || type == 0x517B || type == 0xFF534D42 || type == 0xFE534D42) { return nullptr; }
+            // Not posix_fallocate, which writes zeros where the file system can't allocate
+            if (size > static_cast<std::uint64_t>(std::numeric_limits<off_t>::max()) ||
+                fallocate(result->m_file, 0, 0, static_cast<off_t>(size)) == -1)
+            {
+                return nullptr;
+            }
+            void* data = mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, result->m_file, 0);
+            if (data == MAP_FAILED) { return nullptr; }
+            result->m_data = static_cast<std::uint8_t*>(data);
+            #else
+            // Other systems can't allocate the whole file without writing it
+            (void)name;
+            return nullptr;
+            #endif
+            result->m_size = size;
+            return result;
+        }
+
+        ~MappedOutputFile()
+        {
+            #ifdef WIN32
+            if (m_data) { UnmapViewOfFile(m_data); }
+            if (m_mapping) { CloseHandle(m_mapping); }
+            if (m_file != INVALID_HANDLE_VALUE)
+            #else
+            if (m_data) { munmap(m_data, static_cast<size_t>(m_size)); }
+            if (m_file != -1)
+            #endif
+            {
+                if (m_closer) { m_closer->Close(m_file); }
+                else { DeferredFileCloser::CloseNow(m_file); }
+            }
+        }
+
+        MappedOutputFile(const MappedOutputFile&) = delete;
+        MappedOutputFile& operator=(const MappedOutputFile&) = delete;
+
+        std::uint8_t* GetData() { return m_data; }
+        std::uint64_t GetSize() const { return m_size; }
+
+        // Starts writing back the pages of the range that were written, without waiting for them. Only a hint,
+        // failures are ignored.
+        void Flush(std::uint64_t offset, std::uint64_t size)
+        {
+            #ifdef WIN32
+            FlushViewOfFile(m_data + offset, static_cast<SIZE_T>(size));
+            #elif defined(__linux__)
+            // msync with MS_ASYNC doesn't start anything on Linux
+            sync_file_range(m_file, static_cast<off64_t>(offset), static_cast<off64_t>(size), SYNC_FILE_RANGE_WRITE);
+            #endif
+        }
+
+    protected:
+        MappedOutputFile(const std::shared_ptr<DeferredFileCloser>& closer) : m_closer(closer) {}
+
+        std::uint64_t m_size = 0;
+        std::uint8_t* m_data = nullptr;
+        std::shared_ptr<DeferredFileCloser> m_closer;
+        #ifdef WIN32
+        HANDLE m_file = INVALID_HANDLE_VALUE;
+        HANDLE m_mapping = nullptr;
+        #else
+        int m_file = -1;
+        #endif
+    };
+
+    // Read only stream over a memory mapped file. Reads are copied directly out of the mapped
+    // pages, and positional reads don't need any locking. Clones share the mapping.
+    class MappedFileStream final : public StreamBase
+    {
+    public:
+        MappedFileStream(const std::string& name) : m_name(name), m_file(std::make_shared<MappedFile>(name))
+        {}
+
+        MappedFileStream(const std::string& name, const std::shared_ptr<MappedFile>& file) : m_name(name), m_file(file)
+        {}
+
+        // IStream
+        HRESULT STDMETHODCALLTYPE Clone(IStream** stream) noexcept override try
+        {
+            ThrowErrorIf(Error::InvalidParameter, (stream == nullptr || *stream != nullptr), "bad pointer");
+            auto clone = ComPtr<IStream>::Make<MappedFileStream>(m_name, m_file);
+            LARGE_INTEGER position = { 0 };
+            position.QuadPart = static_cast<LONGLONG>(m_offset);
+            ThrowHrIfFailed(clone->Seek(position, Reference::START, nullptr));
+            *stream = clone.Detach();
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept override try
+        {
+            LARGE_INTEGER newPos = { 0 };
+            switch (origin)
+            {
+            case Reference::CURRENT:
+                newPos.QuadPart = m_offset + move.QuadPart;
+                break;
+            case Reference::START:
+                newPos.QuadPart = move.QuadPart;
+                break;
+            case Reference::END:
+                newPos.QuadPart = m_file->GetSize() + move.QuadPart;
+                break;
+            }
+            ThrowErrorIf(Error::FileSeek, (newPos.QuadPart < 0), "seek failed");
+            m_offset = static_cast<std::uint64_t>(newPos.QuadPart);
+            if (newPosition) { newPosition->QuadPart = m_offset; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) noexcept override try
+        {
+            ULONG result = ReadAt(m_offset, buffer, countBytes);
+            m_offset += result;
+            if (bytesRead) { *bytesRead = result; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Write(const void*, ULONG, ULONG*) noexcept override
+        {
+            return static_cast<HRESULT>(Error::NotSupported);
+        }
+
+        // IStreamInternal
+        std::uint64_t GetSize() override { return m_file->GetSize(); }
+        bool IsCompressed() override { return false; }
+        std::string GetName() override { return m_name; }
+        bool SupportsReadAt() override { return true; }
+        bool IsBuffered() override { return true; }
+        std::string GetFileIdentity() override { return m_file->GetIdentity(); }
+
+        ULONG ReadAt(std::uint64_t offset, void* buffer, ULONG countBytes) override
+        {
+            auto size = m_file->GetSize();
+            if (offset >= size) { return 0; }
+            ULONG result = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(countBytes), size - offset));
+            std::memcpy(buffer, m_file->GetData() + offset, result);
+            return result;
+        }
+
+        const std::uint8_t* GetRawView(std::uint64_t& available) override
+        {
+            auto size = m_file->GetSize();
+            available = (m_offset < size) ? (size - m_offset) : 0;
+            return (available != 0) ? (m_file->GetData() + m_offset) : nullptr;
+        }
+
+    protected:
+        std::string m_name;
+        std::uint64_t m_offset = 0;
+        std::shared_ptr<MappedFile> m_file;
+    };
+}
@@ -0,0 +1,89 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+namespace MSIX {
+
+    // Bytes held by the internal buffers of the readers and writers of a factory: the buffer pool, the caches of
+    // the footprint files being validated and the block maps being parsed. Keeps the peak for MsixGetMemoryUsage.
+    // With a limit, see MsixSetMemoryBudget, a reservation that doesn't fit fails with Error::OutOfMemory and the
+    // readers and writers take their streaming paths, so only the buffers they can't do without are reserved.
+    // Thread safe.
+    class MemoryBudget final
+    {
+    public:
+        // 0 is no limit
+        void SetLimit(std::uint64_t bytes) { m_limit = bytes; }
+        std::uint64_t GetLimit() const { return m_limit; }
+        bool IsLimited() const { return m_limit != 0; }
+
+        // What is left under the limit, the largest value there is without one.
+        std::uint64_t GetAvailable() const;
+
+        std::uint64_t GetCurrent() const { return m_current; }
+        std::uint64_t GetPeak() const { return m_peak; }
+        // The peak starts again from the current bytes
+        void ResetPeak() { m_peak = m_current.load(); }
+
+        // Counts bytes as held. Throws Error::OutOfMemory, without counting them, if they go over the limit.
+        void Reserve(std::uint64_t bytes);
+        // Counts bytes as held if they fit under the limit, for callers that can do without them.
+        bool TryReserve(std::uint64_t bytes);
+        void Release(std::uint64_t bytes) noexcept { m_current -= bytes; }
+
+        // Bytes reserved until it is destroyed. Does nothing without a budget.
+        class Reservation final
+        {
+        public:
+            Reservation() = default;
+            Reservation(const std::shared_ptr<MemoryBudget>& budget, std::uint64_t bytes) : m_budget(budget), m_bytes(bytes)
+            {
+                if (m_budget) { m_budget->Reserve(m_bytes); }
+            }
+            ~Reservation() { if (m_budget) { m_budget->Release(m_bytes); } }
+
+            // Reserves bytes, in place of the ones held before, if they fit under the limit.
+            bool TryReserve(const std::shared_ptr<MemoryBudget>& budget, std::uint64_t bytes)
+            {
+                *this = Reservation();
+                if (budget && !budget->TryReserve(bytes)) { return false; }
+                m_budget = budget;
+                m_bytes = bytes;
+                return true;
+            }
+
+            Reservation(const Reservation&) = delete;
+            Reservation& operator=(const Reservation&) = delete;
+            Reservation(Reservation&& other) noexcept : m_budget(std::move(other.m_budget)), m_bytes(other.m_bytes) { other.m_bytes = 0; }
+            Reservation& operator=(Reservation&& other) noexcept
+            {
+                if (this != &other)
+                {
+                    if (m_budget) { m_budget->Release(m_bytes); }
+                    m_budget = std::move(other.m_budget);
+                    m_bytes = other.m_bytes;
+                    other.m_bytes = 0;
+                }
+                return *this;
+            }
+
+        protected:
+            std::shared_ptr<MemoryBudget> m_budget;
+            std::uint64_t m_bytes = 0;
+        };
+
+    protected:
+        void UpdatePeak(std::uint64_t current);
+
+        std::atomic<std::uint64_t> m_limit{ 0 };
+        std::atomic<std::uint64_t> m_current{ 0 };
+        std::atomic<std::uint64_t> m_peak{ 0 };
+    };
+}
@@ -0,0 +1,409 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <limits>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "Exceptions.hpp"
+#include "StreamBase.hpp"
+#include "FileStream.hpp"
+#include "UnicodeConversion.hpp"
+#include "FileIdentity.hpp"
+#include "DeferredFileCloser.hpp"
+
+#ifndef WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+#include <sys/uio.h>
+#endif
+
+// Scatter and gather reads and writes at an offset. Windows has ReadFileScatter and WriteFileGather only for
+// files opened without buffering, whose buffers are whole pages, and older macOS and Android don't have them.
+#if defined(__linux__) && (!defined(__ANDROID__) || (__ANDROID_API__ >= 24))
+#define MSIX_VECTORED_FILE_IO
+#endif
+
+namespace MSIX {
+    // Stream over a file descriptor (POSIX) or a file handle (Win32) without any buffering in between.
+    // The stream keeps its own position and every read and write is a positional one, so there's no
+    // seek nor tell on the OS file for each call, and positional reads are supported in every mode.
+    // The OS is told that the file is going to be accessed sequentially. Pipes and character devices can
+    // only be read and written in order, from where they are, so they can't seek.
+    class NativeFileStream final : public StreamBase
+    {
+    public:
+        using Mode = FileStream::Mode;
+        #ifdef WIN32
+        using Handle = HANDLE;
+        #else
+        using Handle = int;
+        #endif
+
+        // expectedSize, when known, is the size of a file about to be written, see Preallocate. With a closer, the
+        // file is closed by it instead of by the thread that releases the stream.
+        NativeFileStream(const std::string& name, Mode mode, std::uint64_t expectedSize = 0,
+            const std::shared_ptr<DeferredFileCloser>& closer = nullptr) : m_name(name), m_mode(mode), m_closer(closer)
+        {
+            #ifdef WIN32
+            Open(utf8_to_wstring(name));
+            #else
+            Open(name);
+            #endif
+            if (expectedSize >= MinimumPreallocateSize && m_mode != Mode::READ) { Preallocate(expectedSize); }
+        }
+
+        NativeFileStream(const std::wstring& name, Mode mode, std::uint64_t expectedSize = 0,
+            const std::shared_ptr<DeferredFileCloser>& closer = nullptr) : m_mode(mode), m_closer(closer)
+        {
+            m_name = wstring_to_utf8(name);
+            #ifdef WIN32
+            Open(name);
+            #else
+            Open(m_name);
+            #endif
+            if (expectedSize >= MinimumPreallocateSize && m_mode != Mode::READ) { Preallocate(expectedSize); }
+        }
+
+        // Over a file that is already open, like the standard output, which is left open
+        NativeFileStream(Handle file, const std::string& name, Mode mode) : m_name(name), m_mode(mode), m_owned(false)
+        {
+            m_file = file;
+            ReadFileType();
+        }
+
+        virtual ~NativeFileStream() override
+        {
+            Close();
+        }
+
+        void Close()
+        {   // the most we would ever do w.r.t. a failure from close is *maybe* log something...
+            #ifdef WIN32
+            if (m_file != INVALID_HANDLE_VALUE && m_owned)
+            #else
+            if (m_file != -1 && m_owned)
+            #endif
+            {
+                if (m_closer) { m_closer->Close(m_file); }
+                else { DeferredFileCloser::CloseNow(m_file); }
+            }
+            #ifdef WIN32
+            m_file = INVALID_HANDLE_VALUE;
+            #else
+            m_file = -1;
+            #endif
+        }
+
+        // IStream
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept override try
+        {
+            LARGE_INTEGER newPos = { 0 };
+            switch (origin)
+            {
+            case Reference::CURRENT:
+                newPos.QuadPart = m_offset + move.QuadPart;
+                break;
+            case Reference::START:
+                newPos.QuadPart = move.QuadPart;
+                break;
+            case Reference::END:
+                newPos.QuadPart = m_size + move.QuadPart;
+                break;
+            default:
+                ThrowErrorAndLog(Error::FileSeek, "invalid seek origin");
+            }
+            ThrowErrorIf(Error::FileSeek, (newPos.QuadPart < 0), "seek failed");
+            ThrowErrorIf(Error::FileSeek, (m_sequential && static_cast<std::uint64_t>(newPos.QuadPart) != m_offset), "a pipe can't seek");
+            m_offset = static_cast<std::uint64_t>(newPos.QuadPart);
+            if (newPosition) { newPosition->QuadPart = m_offset; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) noexcept override try
+        {
+            if (bytesRead) { *bytesRead = 0; }
+            ULONG result = ReadAt(m_offset, buffer, countBytes);
+            m_offset += result;
+            if (bytesRead) { *bytesRead = result; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Write(const void *buffer, ULONG countBytes, ULONG *bytesWritten) noexcept override try
+        {
+            if (bytesWritten) { *bytesWritten = 0; }
+            ThrowErrorIf(Error::FileWrite, (m_mode == Mode::READ), "write failed");
+            // Like fopen's "a" modes, writes always go to the end of the file
+            if (m_mode == Mode::APPEND || m_mode == Mode::APPEND_UPDATE) { m_offset = m_size; }
+            auto bytes = static_cast<const std::uint8_t*>(buffer);
+            ULONG result = 0;
+            while (result < countBytes)
+            {
+                std::uint64_t position = m_offset + result;
+                #ifdef WIN32
+                OVERLAPPED overlapped = {};
+                overlapped.Offset = static_cast<DWORD>(position);
+                overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+                DWORD written = 0;
+                ThrowErrorIfNot(Error::FileWrite, WriteFile(m_file, bytes + result, countBytes - result, &written,
+                    m_sequential ? nullptr : &overlapped), "write failed");
+                #else
+                ThrowErrorIf(Error::FileWrite, (position > static_cast<std::uint64_t>(std::numeric_limits<off_t>::max())), "write out of range");
+                auto written = m_sequential ? ::write(m_file, bytes + result, countBytes - result) :
+                    pwrite(m_file, bytes + result, countBytes - result, static_cast<off_t>(position));
+                if (written < 0 && errno == EINTR) { continue; }
+                ThrowErrorIf(Error::FileWrite, (written < 0), "write failed");
+                #endif
+                ThrowErrorIf(Error::FileWrite, (written == 0), "write failed");
+                result += static_cast<ULONG>(written);
+            }
+            m_offset += result;
+            m_size = std::max(m_size, m_offset);
+            if (bytesWritten) { *bytesWritten = result; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        // Truncates or extends the file, the position doesn't change
+        HRESULT STDMETHODCALLTYPE SetSize(ULARGE_INTEGER size) noexcept override try
+        {
+            ThrowErrorIf(Error::FileWrite, (m_mode == Mode::READ || m_sequential), "the file can't be resized");
+            #ifdef WIN32
+            FILE_END_OF_FILE_INFO info = {};
+            info.EndOfFile.QuadPart = static_cast<LONGLONG>(size.QuadPart);
+            ThrowErrorIfNot(Error::FileWrite, SetFileInformationByHandle(m_file, FileEndOfFileInfo, &info, sizeof(info)), "resize failed");
+            #else
+            ThrowErrorIf(Error::FileWrite, (size.QuadPart > static_cast<std::uint64_t>(std::numeric_limits<off_t>::max())), "resize out of range");
+            int rc = 0;
+            do
+            {
+                rc = ftruncate(m_file, static_cast<off_t>(size.QuadPart));
+            } while (rc == -1 && errno == EINTR);
+            ThrowErrorIf(Error::FileWrite, (rc == -1), "resize failed");
+            #endif
+            m_size = size.QuadPart;
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        // IStreamInternal
+        std::uint64_t GetSize() override { return m_size; }
+        bool IsCompressed() override { return false; }
+        std::string GetName() override { return m_name; }
+        bool SupportsReadAt() override { return IsReadable() && !m_sequential; }
+        // Only for files opened to be read, a stream that can write could change the file under its own identity
+        std::string GetFileIdentity() override { return (m_mode == Mode::READ) ? MSIX::GetFileIdentity(m_file) : std::string(); }
+
+        ULONG ReadAt(std::uint64_t offset, void* buffer, ULONG countBytes) override
+        {
+            ThrowErrorIfNot(Error::FileRead, IsReadable(), "read failed");
+            auto bytes = static_cast<std::uint8_t*>(buffer);
+            ULONG result = 0;
+            while (result < countBytes)
+            {
+                std::uint64_t position = offset + result;
+                #ifdef WIN32
+                OVERLAPPED overlapped = {};
+                overlapped.Offset = static_cast<DWORD>(position);
+                overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+                DWORD read = 0;
+                BOOL success = ReadFile(m_file, bytes + result, countBytes - result, &read, &overlapped);
+                // A pipe whose writer is done ends with ERROR_BROKEN_PIPE
+                ThrowErrorIf(Error::FileRead, (!success && GetLastError() != ERROR_HANDLE_EOF && GetLastError() != ERROR_BROKEN_PIPE), "read failed");
+                #else
+                ThrowErrorIf(Error::FileRead, (position > static_cast<std::uint64_t>(std::numeric_limits<off_t>::max())), "read out of range");
+                // Pipes can only be read in order, from where they are
+                auto read = m_sequential ? ::read(m_file, bytes + result, countBytes - result) :
+                    pread(m_file, bytes + result, countBytes - result, static_cast<off_t>(position));
+                if (read < 0 && errno == EINTR) { continue; }
+                ThrowErrorIf(Error::FileRead, (read < 0), "read failed");
+                #endif
+                if (read == 0) { break; } // end of file
+                result += static_cast<ULONG>(read);
+            }
+            return result;
+        }
+
+        #ifdef MSIX_VECTORED_FILE_IO
+        ULONG ReadAtV(std::uint64_t offset, const StreamReadBuffer* buffers, std::size_t count) override
+        {
+            ThrowErrorIfNot(Error::FileRead, IsReadable(), "read failed");
+            std::vector<iovec> vectors = ToVectors(buffers, count);
+            std::uint64_t result = 0;
+            std::size_t next = 0;
+            while (next < vectors.size())
+            {
+                std::uint64_t position = offset + result;
+                ThrowErrorIf(Error::FileRead, (position > static_cast<std::uint64_t>(std::numeric_limits<off_t>::max())), "read out of range");
+                int batch = static_cast<int>(std::min<std::size_t>(vectors.size() - next, IOV_MAX));
+                // Pipes can only be read in order, from where they are
+                auto read = m_sequential ? ::readv(m_file, &vectors[next], batch) :
+                    preadv(m_file, &vectors[next], batch, static_cast<off_t>(position));
+                if (read < 0 && errno == EINTR) { continue; }
+                ThrowErrorIf(Error::FileRead, (read < 0), "read failed");
+                if (read == 0) { break; } // end of file
+                result += static_cast<std::uint64_t>(read);
+                next = Advance(vectors, next, static_cast<std::size_t>(read));
+            }
+            return static_cast<ULONG>(result);
+        }
+
+        void WriteV(const StreamWriteBuffer* buffers, std::size_t count) override
+        {
+            ThrowErrorIf(Error::FileWrite, (m_mode == Mode::READ), "write failed");
+            // Like fopen's "a" modes, writes always go to the end of the file
+            if (m_mode == Mode::APPEND || m_mode == Mode::APPEND_UPDATE) { m_offset = m_size; }
+            std::vector<iovec> vectors = ToVectors(buffers, count);
+            std::uint64_t result = 0;
+            std::size_t next = 0;
+            while (next < vectors.size())
+            {
+                std::uint64_t position = m_offset + result;
+                ThrowErrorIf(Error::FileWrite, (position > static_cast<std::uint64_t>(std::numeric_limits<off_t>::max())), "write out of range");
+                int batch = static_cast<int>(std::min<std::size_t>(vectors.size() - next, IOV_MAX));
+                auto written = m_sequential ? ::writev(m_file, &vectors[next], batch) :
+                    pwritev(m_file, &vectors[next], batch, static_cast<off_t>(position));
+                if (written < 0 && errno == EINTR) { continue; }
+                ThrowErrorIf(Error::FileWrite, (written <= 0), "write failed");
+                result += static_cast<std::uint64_t>(written);
+                next = Advance(vectors, next, static_cast<std::size_t>(written));
+            }
+            m_offset += result;
+            m_size = std::max(m_size, m_offset);
+        }
+        #endif
+
+    protected:
+        #ifdef MSIX_VECTORED_FILE_IO
+        // Empty buffers are left out, so a call that reads or writes nothing is done
+        template <class Buffer>
+        static std::vector<iovec> ToVectors(const Buffer* buffers, std::size_t count)
+        {
+            std::vector<iovec> vectors;
+            vectors.reserve(count);
+            for (std::size_t i = 0; i < count; i++)
+            {
+                if (buffers[i].size == 0) { continue; }
+                vectors.push_back({ const_cast<void*>(static_cast<const void*>(buffers[i].data)), buffers[i].size });
+            }
+            return vectors;
+        }
+
+        // Skips the bytes a call read or wrote, a buffer done in part keeps the rest of it for the next call.
+        // Returns the first buffer that isn't done.
+        static std::size_t Advance(std::vector<iovec>& vectors, std::size_t next, std::size_t bytes)
+        {
+            while (bytes != 0 && next < vectors.size())
+            {
+                std::size_t done = std::min(bytes, vectors[next].iov_len);
+                vectors[next].iov_base = static_cast<std::uint8_t*>(vectors[next].iov_base) + done;
+                vectors[next].iov_len -= done;
+                bytes -= done;
+                if (vectors[next].iov_len == 0) { next++; }
+            }
+            return next;
+        }
+        #endif
+
+        bool IsReadable() { return m_mode != Mode::WRITE && m_mode != Mode::APPEND; }
+
+        // Small files get their space in one go anyway, reserving it would only cost another call
+        static const std::uint64_t MinimumPreallocateSize = 1024 * 1024;
+
+        // Reserves the space of the file at once instead of as it grows, so it's less fragmented and its extents
+        // are updated once. The size of the file doesn't change. Only a hint, failures are ignored.
+        void Preallocate(std::uint64_t size)
+        {
+            #ifdef WIN32
+            FILE_ALLOCATION_INFO info = {};
+            info.AllocationSize.QuadPart = static_cast<LONGLONG>(size);
+            SetFileInformationByHandle(m_file, FileAllocationInfo, &info, sizeof(info));
+            #elif defined(FALLOC_FL_KEEP_SIZE)
+            if (size <= static_cast<std::uint64_t>(std::numeric_limits<off_t>::max()))
+            {
+                fallocate(m_file, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(size));
+            }
+            #elif defined(F_PREALLOCATE)
+            // Contiguous space if there is some, any space otherwise
+            fstore_t store = { F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, static_cast<off_t>(size), 0 };
+            if (fcntl(m_file, F_PREALLOCATE, &store) == -1)
+            {
+                store.fst_flags = F_ALLOCATEALL;
+                fcntl(m_file, F_PREALLOCATE, &store);
+            }
+            #endif
+        }
+
+        #ifdef WIN32
+        void Open(const std::wstring& name)
+        {
+            static const DWORD access[] = { GENERIC_READ, GENERIC_WRITE, GENERIC_WRITE,
+                GENERIC_READ | GENERIC_WRITE, GENERIC_READ | GENERIC_WRITE, GENERIC_READ | GENERIC_WRITE };
+            static const DWORD disposition[] = { OPEN_EXISTING, CREATE_ALWAYS, OPEN_ALWAYS, OPEN_EXISTING, CREATE_ALWAYS, OPEN_ALWAYS };
+            m_file = CreateFileW(name.c_str(), access[m_mode], FILE_SHARE_READ, nullptr, disposition[m_mode],
+                FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            ThrowErrorIf(Error::FileOpen, (m_file == INVALID_HANDLE_VALUE), std::string("file: " + m_name + " does not exist.").c_str());
+            ReadFileType();
+        }
+
+        void ReadFileType()
+        {
+            // Pipes have no size, they are read in order and the offsets of the reads are ignored
+            m_sequential = (GetFileType(m_file) != FILE_TYPE_DISK);
+            if (m_sequential) { return; }
+            LARGE_INTEGER size = { 0 };
+            ThrowErrorIfNot(Error::FileOpen, GetFileSizeEx(m_file, &size), std::string("file: " + m_name + " size unknown.").c_str());
+            m_size = static_cast<std::uint64_t>(size.QuadPart);
+        }
+        #else
+        void Open(const std::string& name)
+        {
+            static const int flags[] = { O_RDONLY, O_WRONLY | O_CREAT | O_TRUNC, O_WRONLY | O_CREAT,
+                O_RDWR, O_RDWR | O_CREAT | O_TRUNC, O_RDWR | O_CREAT };
+            do
+            {
+                m_file = open(name.c_str(), flags[m_mode] | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+            } while (m_file == -1 && errno == EINTR);
+            ThrowErrorIf(Error::FileOpen, (m_file == -1), std::string("file: " + m_name + " does not exist.").c_str());
+            ReadFileType();
+            // Only a hint, failures are ignored
+            #if defined(POSIX_FADV_SEQUENTIAL)
+            posix_fadvise(m_file, 0, 0, POSIX_FADV_SEQUENTIAL);
+            #elif defined(F_RDAHEAD)
+            fcntl(m_file, F_RDAHEAD, 1);
+            #endif
+        }
+
+        void ReadFileType()
+        {
+            struct stat fileStat;
+            ThrowErrorIf(Error::FileOpen, (fstat(m_file, &fileStat) == -1), std::string("file: " + m_name + " size unknown.").c_str());
+            m_size = static_cast<std::uint64_t>(fileStat.st_size);
+            m_sequential = !S_ISREG(fileStat.st_mode) && !S_ISBLK(fileStat.st_mode);
+        }
+        #endif
+
+        std::string m_name;
+        Mode m_mode;
+        std::uint64_t m_offset = 0;
+        std::uint64_t m_size = 0;
+        // A pipe or a character device, only read and written in order
+        bool m_sequential = false;
+        // The file is closed with the stream
+        bool m_owned = true;
+        std::shared_ptr<DeferredFileCloser> m_closer;
+        #ifdef WIN32
+        HANDLE m_file = INVALID_HANDLE_VALUE;
+        #else
+        int m_file = -1;
+        #endif
+    };
+}
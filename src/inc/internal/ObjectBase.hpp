@@ -4,6 +4,7 @@
 // 
 #pragma once
 
+#include <array>
 #include <vector>
 #include <tuple>
 #include <type_traits>
@@ -37,6 +38,19 @@ static void OnlyEitherValueValidation(T value, T spec1, T spec2)
         "Incorrect value specified at field.");
 }
 
+// Fields are stored little endian, whatever the byte order of the machine. Compilers turn this into a single
+// load on little endian machines.
+template <typename T>
+inline T LoadLittleEndian(const std::uint8_t* data) noexcept
+{
+    T value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i)
+    {
+        value |= static_cast<T>(static_cast<T>(data[i]) << (i * 8));
+    }
+    return value;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////
 //              Base type for individual serializable/deserializable fields                 //
 //////////////////////////////////////////////////////////////////////////////////////////////
@@ -48,6 +62,11 @@ public:
 
     constexpr size_t Size() const { return sizeof(T); }
 
+    void Load(const std::uint8_t* data) noexcept
+    {
+        value = LoadLittleEndian<T>(data);
+    }
+
     void GetBytes(std::vector<std::uint8_t>& bytes) const
     {
         THROW_IF_PACK_NOT_ENABLED
@@ -165,6 +184,32 @@ using OptionalField2Bytes = OptionalFieldBase<std::uint16_t>;
 using OptionalField4Bytes = OptionalFieldBase<std::uint32_t>;
 using OptionalField8Bytes = OptionalFieldBase<std::uint64_t>;
 
+//////////////////////////////////////////////////////////////////////////////////////////////
+//                  Compile-time layout of the fixed size fields of a record                //
+//////////////////////////////////////////////////////////////////////////////////////////////
+// Size of a field that always has the same size, 0 for variable length and optional fields
+template <class T>
+struct FixedFieldSize { static constexpr size_t value = 0; };
+
+template <class T>
+struct FixedFieldSize<FieldBase<T>> { static constexpr size_t value = sizeof(T); };
+
+// Number and total size of the fixed size fields a record starts with
+template <class... Types>
+struct FixedLayout
+{
+    static constexpr size_t count = 0;
+    static constexpr size_t size = 0;
+};
+
+template <class First, class... Rest>
+struct FixedLayout<First, Rest...>
+{
+    static constexpr bool isFixed = (FixedFieldSize<First>::value != 0);
+    static constexpr size_t count = isFixed ? 1 + FixedLayout<Rest...>::count : 0;
+    static constexpr size_t size = isFixed ? FixedFieldSize<First>::value + FixedLayout<Rest...>::size : 0;
+};
+
 //////////////////////////////////////////////////////////////////////////////////////////////
 //      Heterogeneous collection of types that are operated on as a compile-time vector     //
 //////////////////////////////////////////////////////////////////////////////////////////////
@@ -199,6 +244,29 @@ template <class... Types>
 class StructuredObject : public TypeList<Types...>
 {
 public:
+    // The fixed size fields at the start of the record, which are read together
+    static constexpr size_t FixedFieldCount = FixedLayout<Types...>::count;
+    static constexpr size_t FixedSize = FixedLayout<Types...>::size;
+
+    // Offset of a fixed size field from the start of the record
+    template <size_t index>
+    static constexpr size_t FieldOffset()
+    {
+        static_assert(index <= FixedFieldCount, "Only fixed size fields have a constant offset");
+        return FieldOffsetOf<index>();
+    }
+
+    // Reads the fixed size fields with a single read and decodes them. Variable length fields that follow are
+    // left to the record, their sizes are in the fixed fields.
+    void ReadFixedFields(const ComPtr<IStream>& stream)
+    {
+        std::array<std::uint8_t, FixedSize> bytes;
+        ULONG bytesRead = 0;
+        ThrowHrIfFailed(stream->Read(bytes.data(), static_cast<ULONG>(bytes.size()), &bytesRead));
+        ThrowErrorIf(Error::FileRead, (bytesRead != bytes.size()), "Entire object wasn't read!");
+        LoadFixedFields<0>(bytes.data());
+    }
+
     size_t Size()
     {
         size_t result = 0;
@@ -211,13 +279,19 @@ public:
 
     std::vector<std::uint8_t> GetBytes()
     {
-        THROW_IF_PACK_NOT_ENABLED
         std::vector<std::uint8_t> bytes;
+        AppendBytes(bytes);
+        return bytes;
+    }
+
+    // Puts the bytes of the record at the end of bytes, so records can be collected in one buffer
+    void AppendBytes(std::vector<std::uint8_t>& bytes)
+    {
+        THROW_IF_PACK_NOT_ENABLED
         this->for_each([](auto& field, std::size_t index, std::vector<std::uint8_t>& bytes)
         {
             field.GetBytes(bytes);
         }, bytes);
-        return bytes;
     }
 
     void WriteTo(const ComPtr<IStream>& stream)
@@ -227,6 +301,26 @@ public:
         ULONG bytesWritten = 0;
         ThrowHrIfFailed(stream->Write(bytes.data(), static_cast<ULONG>(bytes.size()), &bytesWritten));
     }
+
+private:
+    template <size_t index>
+    static constexpr typename std::enable_if<index == 0, size_t>::type FieldOffsetOf() { return 0; }
+
+    template <size_t index>
+    static constexpr typename std::enable_if<index != 0, size_t>::type FieldOffsetOf()
+    {
+        return FieldOffsetOf<index - 1>() + FixedFieldSize<typename std::tuple_element<index - 1, std::tuple<Types...>>::type>::value;
+    }
+
+    template <size_t index>
+    typename std::enable_if<index == FixedFieldCount, void>::type LoadFixedFields(const std::uint8_t*) noexcept {}
+
+    template <size_t index>
+    typename std::enable_if<index < FixedFieldCount, void>::type LoadFixedFields(const std::uint8_t* data) noexcept
+    {
+        this->template Field<index>().Load(data + FieldOffsetOf<index>());
+        LoadFixedFields<index + 1>(data);
+    }
 };
 
 } /* namespace Meta */ } /* namespace MSIX */
\ No newline at end of file
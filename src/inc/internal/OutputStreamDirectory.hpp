@@ -0,0 +1,49 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "ComHelper.hpp"
+#include "DirectoryObject.hpp"
+
+#include <string>
+#include <vector>
+
+namespace MSIX {
+
+    // Target of an unpack that hands the files to an IMsixOutputStreamFactory instead of writing them to disk,
+    // see MSIX_FACTORY_EXTENSION_OUTPUT_STREAM_FACTORY. The names of the files are prefixed with prefix, which
+    // is empty or ends with '/'.
+    class OutputStreamDirectory final : public ComClass<OutputStreamDirectory, IDirectoryObject>
+    {
+    public:
+        OutputStreamDirectory(const ComPtr<IMsixOutputStreamFactory>& factory, const std::string& prefix = "") :
+            m_factory(factory), m_prefix(prefix)
+        {}
+
+        // Directory of the files named prefix + name + '/'
+        ComPtr<IDirectoryObject> GetSubdirectory(const std::string& name)
+        {
+            return ComPtr<IDirectoryObject>::Make<OutputStreamDirectory>(m_factory, m_prefix + name + "/");
+        }
+
+        // IDirectoryObject
+        ComPtr<IStream> OpenFile(const std::string& fileName, FileStream::Mode mode, std::uint64_t expectedSize = 0) override;
+        std::unique_ptr<MappedOutputFile> OpenMappedFile(const std::string&, std::uint64_t) override { return nullptr; }
+        // The factory creates whatever it needs with the streams
+        void CreateDirectories(const std::vector<std::string>&) override {}
+        std::multimap<std::uint64_t, std::string> GetFilesByLastModDate() override { NOTSUPPORTED; }
+        std::string GetFilePath(const std::string&) override { NOTSUPPORTED; }
+        bool LinkFile(const std::string&, const std::string&) override { return false; }
+        bool CopyFileRange(const std::string&, const std::string&, std::uint64_t, std::uint64_t) override { return false; }
+        void WriteFileContent(const std::string& fileName, const void* data, std::size_t size) override;
+        // The streams are the factory's to close
+        void WaitForClosedFiles() override {}
+
+    protected:
+        ComPtr<IMsixOutputStreamFactory> m_factory;
+        std::string m_prefix;
+    };
+}
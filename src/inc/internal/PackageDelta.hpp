@@ -0,0 +1,36 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "ComHelper.hpp"
+#include "MSIXFactory.hpp"
+
+namespace MSIX {
+
+    // A delta between two versions of a package says how to rebuild the new package from the old one. It is
+    // computed from their block maps: the blocks of the new package whose hash and size are in the block map of
+    // the old package, and whose stored bytes are the same, are copied from the old package. Everything else,
+    // the changed blocks, the zip records and the footprint files that aren't in the block map, is fetched from
+    // the new package as byte ranges, which can be requested from wherever the new package is published.
+    // The delta is text, one record per line:
+    //     msixdelta 1
+    //     size <bytes of the new package>
+    //     sha256 <SHA256 of the new package, in hex>
+    //     copy <offset in the new package> <offset in the old package> <bytes>
+    //     fetch <offset in the new package> <bytes>
+    //     changed <index of the block> <name of the file in the block map>
+    // The copy and fetch records cover the new package in order. The changed records list the blocks of the
+    // payload files that aren't in the old package, they are only for information.
+
+    // Writes the delta from oldPackage to newPackage. If ranges isn't null, the ranges of the fetch records are
+    // written to it one after the other, as PatchPackage takes them.
+    void DiffPackages(IMsixFactory* factory, IStream* oldPackage, IStream* newPackage, IStream* delta, IStream* ranges);
+
+    // Writes the new package of delta to newPackage from oldPackage and ranges, the bytes of the fetch records
+    // one after the other. Fails if the result doesn't have the size and hash of the delta, like when the old
+    // package isn't the one the delta was computed from.
+    void PatchPackage(IStream* oldPackage, IStream* delta, IStream* ranges, IStream* newPackage);
+}
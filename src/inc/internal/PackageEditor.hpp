@@ -0,0 +1,21 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "ComHelper.hpp"
+
+#include <map>
+
+namespace MSIX {
+
+    // Replaces the footprint files of package, a stream that can be read, written and resized, with the content of
+    // files, and adds the ones it doesn't have. The payload isn't read nor written: the records of the replaced files
+    // written last, like the signature, and the central directory are overwritten, the others stay in the package
+    // unreferenced. [Content_Types].xml is replaced too when an added file needs an override in it. The signature,
+    // when there is one, is always written last, as a signed package has it. If the package can't be written it is
+    // restored as it was.
+    void ReplaceFootprintFiles(IStream* package, const std::map<APPX_FOOTPRINT_FILE_TYPE, ComPtr<IStream>>& files);
+}
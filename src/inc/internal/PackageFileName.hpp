@@ -0,0 +1,46 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "Encoding.hpp"
+#include "StringHelper.hpp"
+
+#include <string>
+
+namespace MSIX {
+
+    // The names of a file being added to a package, computed once and shared by the zip, content types and
+    // block map writers.
+    struct PackageFileName
+    {
+        // [Content_Types].xml isn't encoded, so encode is false for it
+        PackageFileName(const std::string& fileName, bool encode = true) :
+            name(fileName),
+            opcName(encode ? Encoding::EncodeFileName(fileName) : fileName),
+            blockMapName(Helper::toBackSlash(fileName))
+        {
+            auto lastSlash = opcName.find_last_of('/');
+            auto lastPeriod = opcName.find_last_of('.');
+            if ((lastPeriod != std::string::npos) && ((lastSlash == std::string::npos) || (lastPeriod > lastSlash)))
+            {
+                hasExtension = true;
+                extension = opcName.substr(lastPeriod + 1);
+                normalizedExtension = Helper::tolower(extension);
+            }
+        }
+
+        // As given, with forward slashes
+        std::string name;
+        // Percent encoded, as in the zip container and [Content_Types].xml
+        std::string opcName;
+        // With back slashes, as in AppxBlockMap.xml
+        std::string blockMapName;
+        // Whether the last segment of opcName has a period, and what follows the last one as it is written and
+        // in lower case
+        bool hasExtension = false;
+        std::string extension;
+        std::string normalizedExtension;
+    };
+}
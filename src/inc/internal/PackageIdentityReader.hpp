@@ -0,0 +1,28 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "ComHelper.hpp"
+#include "MSIXFactory.hpp"
+
+namespace MSIX {
+
+    // Reads the identity of the package or bundle in packageStream. Only the central directory and the start of
+    // AppxManifest.xml or AppxBundleManifest.xml, up to the Identity element, are read: the manifest is scanned
+    // as it is inflated and the scan stops at the Identity element. A manifest the scanner doesn't handle, like
+    // one that isn't UTF-8, is read with the DOM instead. Neither the signature nor the block map are checked.
+    ComPtr<IAppxManifestPackageId> ReadPackageIdentity(IMsixFactory* factory, const ComPtr<IStream>& packageStream);
+
+    // Reads the AppxManifest.xml of the package in packageStream with the manifest reader of the factory. Only the
+    // central directory and the manifest are read, the rest of the package, its block map and its signature aren't.
+    ComPtr<IAppxManifestReader> ReadPackageManifest(IMsixFactory* factory, const ComPtr<IStream>& packageStream);
+
+    // Whether stream is a package, a bundle or xml, see GetContainerFormatFromStream. A zip file is told by its
+    // local file header signature and then its central directory is read, which is all a reader that defers the
+    // local file headers reads to open it. Anything starting like xml is taken as a manifest. stream is left at
+    // its start.
+    MSIX_CONTAINER_FORMAT GetContainerFormat(const ComPtr<IStream>& stream);
+}
@@ -0,0 +1,51 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "Crypto.hpp"
+#include "BlockMapStream.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace MSIX {
+
+    // What a reader gets from the footprint files of a package, kept in a sidecar index so the package can be opened
+    // again without parsing AppxBlockMap.xml, [Content_Types].xml and AppxManifest.xml. The index is bound to the
+    // package by its size and the hash of its central directory, which has the offsets, sizes and CRCs of every file,
+    // the signature included. The block map and the content types are still read and hashed when the package is
+    // opened with its index, through the digests of the signature if it has one, and must be the ones the index was
+    // made from, and the manifest must have the bytes its values were read from. The files and the blocks aren't
+    // checked against the block map, so an index is only used when the caller trusts it, see
+    // MSIX_VALIDATION_OPTION_TRUSTPACKAGEINDEX. Save and Load convert it to and from the bytes of the index.
+    struct PackageIndex
+    {
+        // A file of the block map, its blocks follow the ones of the file before it in the table
+        struct File
+        {
+            std::string name;
+            std::uint64_t size = 0;
+            std::uint32_t localFileHeaderSize = 0;
+            std::size_t blockCount = 0;
+        };
+
+        std::uint64_t packageSize = 0;
+        Sha256Digest centralDirectoryHash = {};
+        Sha256Digest blockMapHash = {};
+        Sha256Digest contentTypesHash = {};
+        Sha256Digest manifestHash = {};
+        // ManifestSnapshot::Save of AppxManifest.xml
+        std::vector<std::uint8_t> manifestSnapshot;
+        std::vector<File> files;
+        std::shared_ptr<BlockTable> blocks = std::make_shared<BlockTable>();
+
+        std::vector<std::uint8_t> Save() const;
+        // False when data wasn't written by Save of this version of the SDK. data can be a mapped file, nothing
+        // points to it once Load returns.
+        bool Load(const std::uint8_t* data, std::size_t size);
+    };
+}
@@ -0,0 +1,19 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "BlockMapStream.hpp"
+#include "ZipObjectReader.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace MSIX {
+
+    // Where the stored bytes of every block of a file of the block map are in its container. Deflated blocks have
+    // the size in the block map, stored blocks the size of the block. Empty if the sizes of the blocks don't add
+    // up to the stored bytes of the file.
+    std::vector<ZipByteRange> GetBlockRanges(const ZipFileRecords& records, std::uint64_t fileSize, const FileBlocks& blocks);
+}
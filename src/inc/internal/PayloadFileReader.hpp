@@ -0,0 +1,88 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "Exceptions.hpp"
+#include "ComHelper.hpp"
+#include "StreamBase.hpp"
+#include "BlockMapStream.hpp"
+#include "ICompressionObject.hpp"
+#include "IntegrityCache.hpp"
+#include "PerformanceCounters.hpp"
+#include "Crypto.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace MSIX {
+
+    // The stream of a payload file of a zip package, in place of a BlockMapStream over an InflateStream over the
+    // ZipFileStream of the file. It reads the file as it is stored, opened with openRawStream on the first read,
+    // and keeps the position, the inflate state and the hash state itself. Every block is read at once, inflated
+    // and hashed a chunk at a time and only handed out once its digest matches, like a BlockMapStream. A read
+    // that covers a whole block gets it inflated straight into its buffer, other reads are served from the one
+    // block kept in memory. Seeking only moves the position, the next read starts at the block that holds it.
+    // GetSize, IsCompressed and GetName describe the file as it is stored, as they do for a BlockMapStream.
+    class PayloadFileReader final : public StreamBase
+    {
+    public:
+        PayloadFileReader(const std::string& name, std::function<ComPtr<IStream>()> openRawStream, std::uint64_t size,
+            bool isCompressed, std::uint64_t rawSize, const FileBlocks& blocks, const std::shared_ptr<IntegrityRecord>& integrityRecord = nullptr,
+            const std::shared_ptr<PerformanceCounters>& performanceCounters = nullptr);
+
+        // IStream
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept override;
+        HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* actualRead) noexcept override;
+
+        // IStreamInternal
+        std::uint64_t GetSize() override { return m_rawSize; }
+        bool IsCompressed() override { return m_isCompressed; }
+        std::string GetName() override { return m_name; }
+
+    protected:
+        void Open();
+        std::uint32_t GetBlockSize(std::size_t index) const;
+        // Reads the block into destination and fails if it doesn't match its digest
+        void ReadBlock(std::size_t index, std::uint8_t* destination);
+        void ReadRaw(std::uint64_t offset, std::uint32_t count, std::uint8_t* buffer);
+        // Hashes the chunk of the block being read, unless the file is trusted
+        void HashChunk(const std::uint8_t* chunk, std::uint32_t size);
+        // Every block of the file is validated once it has been read from
+        void RecordValidated(std::size_t index);
+
+        std::string m_name;
+        std::function<ComPtr<IStream>()> m_openRawStream;
+        ComPtr<IStream> m_rawStream;
+        // Set when the raw stream supports positional reads
+        ComPtr<IStreamInternal> m_positionalStream;
+        std::uint64_t m_size = 0;
+        std::uint64_t m_position = 0;
+        bool m_isCompressed = false;
+        std::uint64_t m_rawSize = 0;
+        FileBlocks m_blocks;
+        std::size_t m_blockCount = 0;
+        // Where every block starts in the raw stream, and where the last one ends
+        std::vector<std::uint64_t> m_offsets;
+
+        // The block in m_blockBuffer, NoBlock when there is none
+        static const std::size_t NoBlock = static_cast<std::size_t>(-1);
+        std::size_t m_bufferedBlock = NoBlock;
+        std::vector<std::uint8_t> m_blockBuffer;
+        // The deflated bytes of the block being inflated
+        std::vector<std::uint8_t> m_rawBuffer;
+        std::unique_ptr<ICompressionObject> m_inflater;
+        SHA256 m_hashEngine;
+
+        std::shared_ptr<IntegrityRecord> m_integrityRecord;
+        // Every block of the file matched before, see IntegrityRecord
+        bool m_trusted = false;
+        std::vector<bool> m_validatedBlocks;
+        std::size_t m_validatedCount = 0;
+        std::shared_ptr<PerformanceCounters> m_performanceCounters;
+    };
+}
@@ -0,0 +1,68 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "FileStatistics.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+
+namespace MSIX {
+
+    // Calls, bytes and time of the stages of the unpacks and packs of a factory, for MsixGetPerformanceCounters.
+    // Only factories created with MSIX_FACTORY_OPTION_PERFORMANCE_COUNTERS have them. The objects of any other
+    // factory get null, and Measure then doesn't even read the clock. Thread safe, the workers of a parallel
+    // unpack or pack add to the same counters.
+    class PerformanceCounters final
+    {
+    public:
+        void Add(MSIX_PERFORMANCE_COUNTER_STAGE stage, std::uint64_t bytes, std::chrono::steady_clock::duration duration);
+        void Get(MSIX_PERFORMANCE_COUNTERS& counters, bool reset);
+
+        // Adds the time until it goes out of scope, exception or not, to a stage, and to the file of the thread,
+        // see FileStatistics.
+        class Measure final
+        {
+        public:
+            Measure(PerformanceCounters* counters, MSIX_PERFORMANCE_COUNTER_STAGE stage, std::uint64_t bytes = 0) :
+                m_counters(counters), m_stage(stage), m_bytes(bytes), m_fileStage(GetFileStatisticsStage(stage))
+            {
+                if (m_counters) { m_start = std::chrono::steady_clock::now(); }
+            }
+
+            ~Measure()
+            {
+                if (m_counters) { m_counters->Add(m_stage, m_bytes, std::chrono::steady_clock::now() - m_start); }
+            }
+
+            Measure(const Measure&) = delete;
+            Measure& operator=(const Measure&) = delete;
+
+            // For stages that only know their bytes once done.
+            void SetBytes(std::uint64_t bytes) { m_bytes = bytes; }
+
+        protected:
+            PerformanceCounters* m_counters;
+            MSIX_PERFORMANCE_COUNTER_STAGE m_stage;
+            std::uint64_t m_bytes;
+            std::chrono::steady_clock::time_point m_start;
+            FileStatistics::Measure m_fileStage;
+        };
+
+    protected:
+        struct Counter
+        {
+            std::atomic<std::uint64_t> calls{ 0 };
+            std::atomic<std::uint64_t> bytes{ 0 };
+            std::atomic<std::uint64_t> nanoseconds{ 0 };
+        };
+
+        std::array<Counter, MSIX_PERFORMANCE_COUNTER_STAGE_COUNT> m_counters;
+    };
+}
@@ -0,0 +1,43 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "ComHelper.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+namespace MSIX {
+
+    // Progress of the unpacks and packs of a factory, reported to the IMsixProgressCallback extension. Without
+    // one, nothing is counted and IsEnabled is false, so callers can skip the work of measuring. Thread safe,
+    // the workers of a parallel unpack or pack report from their own threads and the callback is called by one
+    // of them at a time.
+    class ProgressReporter final
+    {
+    public:
+        void SetExtension(const ComPtr<IMsixProgressCallback>& callback);
+        ComPtr<IMsixProgressCallback> GetExtension();
+
+        bool IsEnabled() { return m_enabled; }
+
+        // Adds work found to the totals.
+        void AddWork(std::uint64_t bytes, std::uint32_t files);
+        // Adds work done and tells the callback. Throws Error::Cancelled once the callback has cancelled.
+        void Advance(std::uint64_t bytes, std::uint32_t files = 0);
+
+    protected:
+        std::mutex m_lock;
+        ComPtr<IMsixProgressCallback> m_callback;
+        std::atomic<bool> m_enabled{ false };
+        bool m_cancelled = false;
+        std::uint64_t m_bytesCompleted = 0;
+        std::uint64_t m_bytesTotal = 0;
+        std::uint32_t m_filesCompleted = 0;
+        std::uint32_t m_filesTotal = 0;
+    };
+}
@@ -0,0 +1,185 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "Exceptions.hpp"
+#include "StreamBase.hpp"
+#include "ComHelper.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+namespace MSIX {
+
+    // Limits a factory puts on the unpacks, verifies and packs of its readers and writers so they can run in the
+    // background, see MsixSetQualityOfService: the bytes they read and write per second, the workers their
+    // parallel loops run on, and the I/O priority of the threads doing their work. Also whether the threads of the
+    // SDK are pinned to processors while they do it, see MsixSetWorkerAffinity. Thread safe.
+    class QualityOfService final
+    {
+    public:
+        // 0 is no limit for maxBytesPerSecond and maxWorkerCount
+        void Set(std::uint64_t maxBytesPerSecond, std::uint32_t maxWorkerCount, bool lowPriorityIo);
+
+        bool IsThrottled() const { return m_maxBytesPerSecond != 0; }
+        std::uint32_t GetMaxWorkerCount() const { return m_maxWorkerCount; }
+        bool IsLowPriorityIo() const { return m_lowPriorityIo; }
+
+        void SetPinnedWorkers(bool pinned) { m_pinnedWorkers = pinned; }
+        bool IsPinnedWorkers() const { return m_pinnedWorkers; }
+
+        // Waits until bytes more fit under the limit of bytes per second, returns right away without one. Up to a
+        // second of bytes that weren't used goes without waiting, so short reads and writes aren't paced one by one.
+        void Consume(std::uint64_t bytes);
+
+        // Lowers the I/O priority of the calling thread until it is destroyed, then puts back the one it had.
+        // Does nothing when lower is false, see IsLowPriorityIo.
+        class IoPriorityScope final
+        {
+        public:
+            IoPriorityScope(bool lower);
+            ~IoPriorityScope();
+
+            IoPriorityScope(const IoPriorityScope&) = delete;
+            IoPriorityScope& operator=(const IoPriorityScope&) = delete;
+
+        protected:
+            bool m_lowered = false;
+            int m_previous = 0;
+        };
+
+        // Pins the calling thread to the index-th processor the process may run on, modulo their count, until it is
+        // destroyed, then lets it run on all of them again. Does nothing when pin is false, when an outer scope
+        // already pinned the thread, and on macOS, which doesn't pin threads.
+        class AffinityScope final
+        {
+        public:
+            AffinityScope(bool pin, std::size_t index);
+            ~AffinityScope();
+
+            AffinityScope(const AffinityScope&) = delete;
+            AffinityScope& operator=(const AffinityScope&) = delete;
+
+        protected:
+            bool m_pinned = false;
+        };
+
+    protected:
+        std::atomic<std::uint64_t> m_maxBytesPerSecond{ 0 };
+        std::atomic<std::uint32_t> m_maxWorkerCount{ 0 };
+        std::atomic<bool> m_lowPriorityIo{ false };
+        std::atomic<bool> m_pinnedWorkers{ false };
+        std::mutex m_lock;
+        // When the bytes consumed so far are all paid for, set and read under m_lock
+        std::chrono::steady_clock::time_point m_next;
+    };
+
+    // Charges what is read and written through it to the limit of bytes per second of a QualityOfService, in
+    // chunks so a large write is paced as it goes.
+    class ThrottledStream final : public StreamBase
+    {
+    public:
+        ThrottledStream(const ComPtr<IStream>& stream, const std::shared_ptr<QualityOfService>& qualityOfService) :
+            m_stream(stream), m_qualityOfService(qualityOfService)
+        {
+            m_streamInternal = m_stream.TryAs<IStreamInternal>();
+        }
+
+        // IStream
+        HRESULT STDMETHODCALLTYPE Clone(IStream** stream) noexcept override try
+        {
+            ThrowErrorIf(Error::InvalidParameter, (stream == nullptr), "bad pointer");
+            ComPtr<IStream> clone;
+            ThrowHrIfFailed(m_stream->Clone(&clone));
+            *stream = ComPtr<IStream>::Make<ThrottledStream>(clone, m_qualityOfService).Detach();
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept override
+        {
+            return m_stream->Seek(move, origin, newPosition);
+        }
+
+        HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) noexcept override try
+        {
+            ULONG read = 0;
+            ThrowHrIfFailed(m_stream->Read(buffer, countBytes, &read));
+            m_qualityOfService->Consume(read);
+            if (bytesRead) { *bytesRead = read; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Write(const void* buffer, ULONG countBytes, ULONG* bytesWritten) noexcept override try
+        {
+            auto bytes = static_cast<const std::uint8_t*>(buffer);
+            ULONG total = 0;
+            while (total < countBytes)
+            {
+                ULONG chunk = std::min(countBytes - total, static_cast<ULONG>(ChunkSize));
+                m_qualityOfService->Consume(chunk);
+                ULONG written = 0;
+                ThrowHrIfFailed(m_stream->Write(bytes + total, chunk, &written));
+                total += written;
+                if (written != chunk) { break; }
+            }
+            if (bytesWritten) { *bytesWritten = total; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE SetSize(ULARGE_INTEGER size) noexcept override
+        {
+            return m_stream->SetSize(size);
+        }
+
+        HRESULT STDMETHODCALLTYPE Commit(DWORD flags) noexcept override
+        {
+            return m_stream->Commit(flags);
+        }
+
+        // IStreamInternal
+        std::uint64_t GetSize() override
+        {
+            if (m_streamInternal) { return m_streamInternal->GetSize(); }
+            ULARGE_INTEGER position = { 0 };
+            ULARGE_INTEGER end = { 0 };
+            ThrowHrIfFailed(m_stream->Seek({ 0 }, Reference::CURRENT, &position));
+            ThrowHrIfFailed(m_stream->Seek({ 0 }, Reference::END, &end));
+            LARGE_INTEGER back = { 0 };
+            back.QuadPart = static_cast<LONGLONG>(position.QuadPart);
+            ThrowHrIfFailed(m_stream->Seek(back, Reference::START, nullptr));
+            return end.QuadPart;
+        }
+        bool IsCompressed() override { return m_streamInternal ? m_streamInternal->IsCompressed() : false; }
+        std::string GetName() override { return m_streamInternal ? m_streamInternal->GetName() : std::string(); }
+
+        // A gathered write that fits in a chunk is paced as one, larger ones are written a chunk at a time
+        void WriteV(const StreamWriteBuffer* buffers, std::size_t count) override
+        {
+            std::uint64_t total = 0;
+            for (std::size_t i = 0; i < count; i++)
+            {
+                total += buffers[i].size;
+            }
+            if (total > ChunkSize)
+            {
+                StreamBase::WriteV(buffers, count);
+                return;
+            }
+            m_qualityOfService->Consume(total);
+            WriteBuffers(m_stream.Get(), buffers, count);
+        }
+
+    protected:
+        static const ULONG ChunkSize = 256 * 1024;
+
+        ComPtr<IStream> m_stream;
+        ComPtr<IStreamInternal> m_streamInternal;
+        std::shared_ptr<QualityOfService> m_qualityOfService;
+    };
+}
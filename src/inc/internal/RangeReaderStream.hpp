@@ -0,0 +1,228 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "Exceptions.hpp"
+#include "StreamBase.hpp"
+#include "ComHelper.hpp"
+#include "AppxPackaging.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace MSIX {
+
+    // Matches BLOCKMAP_BLOCK_SIZE, so a cached block covers whole blocks of stored payload files.
+    const std::uint32_t DefaultRangeReaderBlockSize = 64 * 1024;
+    const std::uint64_t RangeReaderMaxBlocksPerRequest = 16;
+    const std::size_t RangeReaderMaxCachedBlocks = 64;
+    // Prefetched blocks are kept until they are read, on top of the cached ones
+    const std::size_t RangeReaderMaxPrefetchedBlocks = 256;
+
+    // Read only stream over an IMsixRangeReader. The data is cached in blocks aligned to blockSize, and
+    // consecutive missing blocks are fetched with a single request, so reading a zip central directory or
+    // a payload file costs a few requests instead of one per read. Positional reads are supported, the
+    // cache and the range reader are guarded by a lock. Prefetch gets the missing blocks of many ranges with
+    // back to back requests, one per run of consecutive blocks, and keeps them until they are first read.
+    class RangeReaderStream final : public StreamBase
+    {
+    public:
+        RangeReaderStream(IMsixRangeReader* rangeReader, std::uint32_t blockSize) : m_rangeReader(rangeReader), m_blockSize(blockSize)
+        {
+            ThrowErrorIf(Error::InvalidParameter, (m_blockSize == 0), "Invalid block size");
+            UINT64 size = 0;
+            ThrowHrIfFailed(m_rangeReader->GetSize(&size));
+            m_size = static_cast<std::uint64_t>(size);
+        }
+
+        // IStream
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept override try
+        {
+            LARGE_INTEGER newPos = { 0 };
+            switch (origin)
+            {
+            case Reference::CURRENT:
+                newPos.QuadPart = m_offset + move.QuadPart;
+                break;
+            case Reference::START:
+                newPos.QuadPart = move.QuadPart;
+                break;
+            case Reference::END:
+                newPos.QuadPart = m_size + move.QuadPart;
+                break;
+            }
+            ThrowErrorIf(Error::FileSeek, (newPos.QuadPart < 0), "seek failed");
+            m_offset = static_cast<std::uint64_t>(newPos.QuadPart);
+            if (newPosition) { newPosition->QuadPart = m_offset; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) noexcept override try
+        {
+            ULONG result = ReadAt(m_offset, buffer, countBytes);
+            m_offset += result;
+            if (bytesRead) { *bytesRead = result; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Write(const void*, ULONG, ULONG*) noexcept override
+        {
+            return static_cast<HRESULT>(Error::NotSupported);
+        }
+
+        // IStreamInternal
+        std::uint64_t GetSize() override { return m_size; }
+        bool IsCompressed() override { return false; }
+        bool SupportsReadAt() override { return true; }
+        bool IsBuffered() override { return true; }
+
+        ULONG ReadAt(std::uint64_t offset, void* buffer, ULONG countBytes) override
+        {
+            if (offset >= m_size) { return 0; }
+            ULONG result = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(countBytes), m_size - offset));
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_useCount++;
+            auto output = static_cast<std::uint8_t*>(buffer);
+            std::uint64_t position = offset;
+            std::uint64_t end = offset + result;
+            while (position < end)
+            {
+                auto block = position / m_blockSize;
+                auto cached = m_blocks.find(block);
+                if (cached == m_blocks.end())
+                {
+                    cached = FetchBlocks(block, (end - 1) / m_blockSize);
+                }
+                cached->second.lastUse = m_useCount;
+                if (cached->second.prefetched)
+                {
+                    cached->second.prefetched = false;
+                    m_prefetchedCount--;
+                }
+                auto blockStart = block * m_blockSize;
+                auto blockEnd = blockStart + cached->second.data.size();
+                ThrowErrorIf(Error::FileRead, (blockEnd <= position), "range reader returned less data than expected");
+                auto available = std::min(end, blockEnd) - position;
+                std::memcpy(output, cached->second.data.data() + (position - blockStart), static_cast<std::size_t>(available));
+                output += available;
+                position += available;
+            }
+            return result;
+        }
+
+        // IMsixRangeReader::ReadRange can't be called concurrently, so the requests are made in turn, but with
+        // nothing in between for the caller to wait on. Blocks past RangeReaderMaxPrefetchedBlocks are left to
+        // be fetched when they are read.
+        bool Prefetch(const StreamRange* ranges, std::size_t count) override
+        {
+            std::set<std::uint64_t> blocks;
+            for (std::size_t i = 0; i < count; i++)
+            {
+                if (ranges[i].offset >= m_size || ranges[i].size == 0) { continue; }
+                auto end = std::min(ranges[i].offset + ranges[i].size, m_size);
+                for (auto block = ranges[i].offset / m_blockSize; block <= (end - 1) / m_blockSize; block++)
+                {
+                    blocks.insert(block);
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_useCount++;
+            auto block = blocks.begin();
+            while (block != blocks.end() && m_prefetchedCount < RangeReaderMaxPrefetchedBlocks)
+            {
+                if (m_blocks.find(*block) != m_blocks.end())
+                {
+                    block++;
+                    continue;
+                }
+                // FetchBlocks ends the run at the first cached block, the next ones are skipped as they are fetched
+                auto first = *block;
+                auto last = first;
+                for (auto next = std::next(block); next != blocks.end() && *next == last + 1; next++)
+                {
+                    last = *next;
+                }
+                last = std::min<std::uint64_t>(last, first + (RangeReaderMaxPrefetchedBlocks - m_prefetchedCount) - 1);
+                FetchBlocks(first, last, true);
+                block++;
+            }
+            return true;
+        }
+
+    protected:
+        struct CachedBlock
+        {
+            std::vector<std::uint8_t> data;
+            std::uint64_t lastUse = 0;
+            // Fetched by Prefetch and not read yet, it isn't evicted
+            bool prefetched = false;
+        };
+
+        // Requests the run of missing blocks starting at first, up to last, and returns the first one.
+        std::map<std::uint64_t, CachedBlock>::iterator FetchBlocks(std::uint64_t first, std::uint64_t last, bool prefetch = false)
+        {
+            // A request must fit in a ReadRange call
+            auto maxBlocks = std::max<std::uint64_t>(1, std::min<std::uint64_t>(RangeReaderMaxBlocksPerRequest, std::numeric_limits<std::uint32_t>::max() / m_blockSize));
+            last = std::min(last, first + maxBlocks - 1);
+            for (auto block = first + 1; block <= last; block++)
+            {
+                if (m_blocks.find(block) != m_blocks.end())
+                {
+                    last = block - 1;
+                    break;
+                }
+            }
+            auto offset = first * m_blockSize;
+            auto count = static_cast<std::uint32_t>(std::min((last - first + 1) * m_blockSize, m_size - offset));
+            std::vector<std::uint8_t> data(count);
+            UINT32 bytesRead = 0;
+            ThrowHrIfFailed(m_rangeReader->ReadRange(offset, count, data.data(), &bytesRead));
+            ThrowErrorIf(Error::FileRead, (bytesRead != count), "range reader returned less data than expected");
+
+            // Only the blocks that were read count against RangeReaderMaxCachedBlocks
+            auto added = prefetch ? 0 : (last - first + 1);
+            while (m_blocks.size() - m_prefetchedCount + added > RangeReaderMaxCachedBlocks && m_blocks.size() > m_prefetchedCount)
+            {
+                auto oldest = m_blocks.end();
+                for (auto block = m_blocks.begin(); block != m_blocks.end(); block++)
+                {
+                    if (!block->second.prefetched && (oldest == m_blocks.end() || block->second.lastUse < oldest->second.lastUse))
+                    {
+                        oldest = block;
+                    }
+                }
+                m_blocks.erase(oldest);
+            }
+            for (auto block = first; block <= last; block++)
+            {
+                auto start = static_cast<std::size_t>((block - first) * m_blockSize);
+                auto blockEnd = std::min(start + m_blockSize, data.size());
+                CachedBlock cached;
+                cached.data.assign(data.begin() + start, data.begin() + blockEnd);
+                cached.lastUse = m_useCount;
+                cached.prefetched = prefetch;
+                m_blocks[block] = std::move(cached);
+            }
+            if (prefetch) { m_prefetchedCount += static_cast<std::size_t>(last - first + 1); }
+            return m_blocks.find(first);
+        }
+
+        ComPtr<IMsixRangeReader> m_rangeReader;
+        std::uint32_t m_blockSize = DefaultRangeReaderBlockSize;
+        std::uint64_t m_size = 0;
+        std::uint64_t m_offset = 0;
+        std::mutex m_lock;
+        std::map<std::uint64_t, CachedBlock> m_blocks;
+        std::uint64_t m_useCount = 0;
+        std::size_t m_prefetchedCount = 0;
+    };
+}
@@ -15,6 +15,8 @@
 namespace MSIX {
 
     // This represents a subset of a Stream
+    // If the underlying stream supports positional reads, the range keeps its own position and reads
+    // with ReadAt, so ranges over the same stream are independent and can be read concurrently.
     class RangeStream : public StreamBase
     {
     public:
@@ -23,6 +25,15 @@ namespace MSIX {
             m_size(size),
             m_stream(stream)
         {
+            ComPtr<IStreamInternal> streamInternal;
+            if (SUCCEEDED(m_stream->QueryInterface(UuidOfImpl<IStreamInternal>::iid, reinterpret_cast<void**>(&streamInternal))))
+            {
+                m_isBuffered = streamInternal->IsBuffered();
+                if (streamInternal->SupportsReadAt())
+                {
+                    m_positionalStream = std::move(streamInternal);
+                }
+            }
         }
 
         // For writing/pack
@@ -38,29 +49,12 @@ namespace MSIX {
 
         HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER *newPosition) noexcept override try
         {
-            // Determine new range relative position
-            LARGE_INTEGER newPos = { 0 };
-            switch (origin)
-            {
-            case Reference::CURRENT:
-                newPos.QuadPart = m_relativePosition + move.QuadPart;
-                break;
-            case Reference::START:
-                newPos.QuadPart = move.QuadPart;
-                break;
-            case Reference::END:
-                newPos.QuadPart = m_size + move.QuadPart;
-                break;
-            }
-
-            // Constrain newPos to range relative values
-            if (newPos.QuadPart < 0)
-            {
-                newPos.QuadPart = 0;
-            }
-            else if (static_cast<uint64_t>(newPos.QuadPart) > m_size)
-            {
-                newPos.QuadPart = m_size;
+            LARGE_INTEGER newPos = GetRelativePosition(move, origin);
+            if (m_positionalStream)
+            {   // Nothing to do on the underlying stream, the next read will be done at the new position.
+                m_relativePosition = static_cast<std::uint64_t>(newPos.QuadPart);
+                if (newPosition) { newPosition->QuadPart = m_relativePosition; }
+                return static_cast<HRESULT>(Error::OK);
             }
 
             // Add in the underlying stream offset
@@ -75,12 +69,19 @@ namespace MSIX {
 
         HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) noexcept override try
         {
-            LARGE_INTEGER offset = {0};
-            offset.QuadPart = m_relativePosition + m_offset;
-            ThrowHrIfFailed(m_stream->Seek(offset, StreamBase::START, nullptr));
-            ULONG amountToRead = std::min(countBytes, static_cast<ULONG>(m_size - m_relativePosition));
+            ULONG amountToRead = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(countBytes), m_size - m_relativePosition));
             ULONG amountRead = 0;
-            ThrowHrIfFailed(m_stream->Read(buffer, amountToRead, &amountRead));
+            if (m_positionalStream)
+            {
+                amountRead = m_positionalStream->ReadAt(m_offset + m_relativePosition, buffer, amountToRead);
+            }
+            else
+            {
+                LARGE_INTEGER offset = {0};
+                offset.QuadPart = m_relativePosition + m_offset;
+                ThrowHrIfFailed(m_stream->Seek(offset, StreamBase::START, nullptr));
+                ThrowHrIfFailed(m_stream->Read(buffer, amountToRead, &amountRead));
+            }
             ThrowErrorIf(Error::FileRead, (amountToRead != amountRead), "Did not read as much as requested.");
             m_relativePosition += amountRead;
             if (bytesRead) { *bytesRead = amountRead; }
@@ -103,12 +104,92 @@ namespace MSIX {
             return static_cast<HRESULT>(Error::OK);
         } CATCH_RETURN();
 
+        // IStreamInternal
+        // Ranges over a stream with positional reads are positional too, so a package stored in another
+        // container can be read concurrently straight from the container.
+        bool SupportsReadAt() override { return m_positionalStream.Get() != nullptr; }
+        bool IsBuffered() override { return m_isBuffered; }
+
+        ULONG ReadAt(std::uint64_t offset, void* buffer, ULONG countBytes) override
+        {
+            ThrowErrorIfNot(Error::NotSupported, m_positionalStream, "positional reads not supported by the underlying stream");
+            if (offset >= m_size) { return 0; }
+            ULONG amountToRead = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(countBytes), m_size - offset));
+            ULONG amountRead = m_positionalStream->ReadAt(m_offset + offset, buffer, amountToRead);
+            ThrowErrorIf(Error::FileRead, (amountToRead != amountRead), "Did not read as much as requested.");
+            return amountRead;
+        }
+
+        ULONG ReadAtV(std::uint64_t offset, const StreamReadBuffer* buffers, std::size_t count) override
+        {
+            ThrowErrorIfNot(Error::NotSupported, m_positionalStream, "positional reads not supported by the underlying stream");
+            if (offset >= m_size) { return 0; }
+            // The buffers are cut at the end of the range
+            std::vector<StreamReadBuffer> inRange;
+            std::uint64_t left = m_size - offset;
+            ULONG amountToRead = 0;
+            for (std::size_t i = 0; (i < count) && (left != 0); i++)
+            {
+                ULONG size = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(buffers[i].size), left));
+                inRange.push_back({ buffers[i].data, size });
+                left -= size;
+                amountToRead += size;
+            }
+            ULONG amountRead = m_positionalStream->ReadAtV(m_offset + offset, inRange.data(), inRange.size());
+            ThrowErrorIf(Error::FileRead, (amountToRead != amountRead), "Did not read as much as requested.");
+            return amountRead;
+        }
+
+        void WriteV(const StreamWriteBuffer* buffers, std::size_t count) override
+        {
+            THROW_IF_PACK_NOT_ENABLED
+            LARGE_INTEGER offset = { 0 };
+            offset.QuadPart = m_relativePosition + m_offset;
+            ThrowHrIfFailed(m_stream->Seek(offset, StreamBase::START, nullptr));
+            WriteBuffers(m_stream.Get(), buffers, count);
+            for (std::size_t i = 0; i < count; i++)
+            {
+                m_relativePosition += buffers[i].size;
+            }
+            m_size = std::max(m_size, m_relativePosition);
+        }
+
         std::uint64_t Size() { return m_size; }
 
     protected:
+        // Determine new range relative position, constrained to the range
+        LARGE_INTEGER GetRelativePosition(LARGE_INTEGER move, DWORD origin)
+        {
+            LARGE_INTEGER newPos = { 0 };
+            switch (origin)
+            {
+            case Reference::CURRENT:
+                newPos.QuadPart = m_relativePosition + move.QuadPart;
+                break;
+            case Reference::START:
+                newPos.QuadPart = move.QuadPart;
+                break;
+            case Reference::END:
+                newPos.QuadPart = m_size + move.QuadPart;
+                break;
+            }
+
+            if (newPos.QuadPart < 0)
+            {
+                newPos.QuadPart = 0;
+            }
+            else if (static_cast<uint64_t>(newPos.QuadPart) > m_size)
+            {
+                newPos.QuadPart = m_size;
+            }
+            return newPos;
+        }
+
         std::uint64_t m_offset;
         std::uint64_t m_size;
         std::uint64_t m_relativePosition = 0;
         ComPtr<IStream> m_stream;
+        ComPtr<IStreamInternal> m_positionalStream;
+        bool m_isBuffered = false;
     };
 }
\ No newline at end of file
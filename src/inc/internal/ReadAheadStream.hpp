@@ -0,0 +1,166 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "Exceptions.hpp"
+#include "StreamBase.hpp"
+#include "ComHelper.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+namespace MSIX {
+
+    const std::uint32_t DefaultReadAheadSize = 256 * 1024;
+    const std::size_t ReadAheadMaxWindows = 4;
+
+    // Read only stream over another stream that turns small reads into large sequential ones. A read smaller
+    // than the read ahead size that misses the buffered windows reads readAheadSize bytes from its offset, so
+    // the next small reads of the same area, like the local file header and the data of a file or consecutive
+    // files of the container, are copied from memory. Larger reads go straight to the underlying stream.
+    // A few windows are kept so concurrent readers working on different files don't evict each other.
+    // Positional reads are supported if the underlying stream supports them. Otherwise, as with the
+    // underlying stream, reads must be serialized by the caller.
+    class ReadAheadStream final : public StreamBase
+    {
+    public:
+        ReadAheadStream(const ComPtr<IStream>& stream, std::uint32_t readAheadSize = DefaultReadAheadSize) :
+            m_stream(stream),
+            m_readAheadSize(readAheadSize)
+        {
+            ThrowErrorIf(Error::InvalidParameter, (m_readAheadSize == 0), "Invalid read ahead size");
+            ComPtr<IStreamInternal> streamInternal;
+            if (SUCCEEDED(m_stream->QueryInterface(UuidOfImpl<IStreamInternal>::iid, reinterpret_cast<void**>(&streamInternal))))
+            {
+                m_streamInternal = std::move(streamInternal);
+            }
+            ULARGE_INTEGER end = { 0 };
+            ThrowHrIfFailed(m_stream->Seek({ 0 }, Reference::END, &end));
+            m_size = end.QuadPart;
+        }
+
+        // IStream
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept override try
+        {
+            if (origin == Reference::CURRENT)
+            {
+                move.QuadPart += m_position;
+                origin = Reference::START;
+            }
+            if (SupportsReadAt())
+            {
+                if (origin == Reference::END) { move.QuadPart += m_size; }
+                ThrowErrorIf(Error::FileSeek, (move.QuadPart < 0), "seek failed");
+                m_position = static_cast<std::uint64_t>(move.QuadPart);
+            }
+            else
+            {   // Let the underlying stream validate the new position.
+                ULARGE_INTEGER pos = { 0 };
+                ThrowHrIfFailed(m_stream->Seek(move, origin, &pos));
+                m_position = pos.QuadPart;
+            }
+            if (newPosition) { newPosition->QuadPart = m_position; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) noexcept override try
+        {
+            ULONG result = ReadAt(m_position, buffer, countBytes);
+            m_position += result;
+            if (bytesRead) { *bytesRead = result; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Write(const void*, ULONG, ULONG*) noexcept override
+        {
+            return static_cast<HRESULT>(Error::NotSupported);
+        }
+
+        // IStreamInternal
+        std::uint64_t GetSize() override { return m_size; }
+        bool IsCompressed() override { return false; }
+        std::string GetName() override { return m_streamInternal ? m_streamInternal->GetName() : std::string(); }
+        bool SupportsReadAt() override { return m_streamInternal && m_streamInternal->SupportsReadAt(); }
+        bool IsBuffered() override { return true; }
+
+        ULONG ReadAt(std::uint64_t offset, void* buffer, ULONG countBytes) override
+        {
+            if (countBytes >= m_readAheadSize)
+            {
+                return ReadFromStream(offset, buffer, countBytes);
+            }
+
+            {   std::lock_guard<std::mutex> lock(m_lock);
+                m_useCount++;
+                for (auto& window : m_windows)
+                {
+                    if ((offset >= window.start) && (offset + countBytes <= window.start + window.data.size()))
+                    {
+                        window.lastUse = m_useCount;
+                        if (countBytes != 0) { std::memcpy(buffer, window.data.data() + (offset - window.start), countBytes); }
+                        return countBytes;
+                    }
+                }
+            }
+
+            // Read the window without holding the lock, concurrent readers of other windows don't wait on it.
+            Window window;
+            window.start = offset;
+            window.data.resize(m_readAheadSize);
+            window.data.resize(ReadFromStream(offset, window.data.data(), m_readAheadSize));
+            ULONG result = static_cast<ULONG>(std::min(static_cast<std::size_t>(countBytes), window.data.size()));
+            if (result != 0) { std::memcpy(buffer, window.data.data(), result); }
+
+            std::lock_guard<std::mutex> lock(m_lock);
+            window.lastUse = ++m_useCount;
+            if (m_windows.size() < ReadAheadMaxWindows)
+            {
+                m_windows.push_back(std::move(window));
+            }
+            else
+            {
+                auto oldest = std::min_element(m_windows.begin(), m_windows.end(), [](const Window& left, const Window& right)
+                {
+                    return left.lastUse < right.lastUse;
+                });
+                *oldest = std::move(window);
+            }
+            return result;
+        }
+
+    protected:
+        struct Window
+        {
+            std::uint64_t start = 0;
+            std::vector<std::uint8_t> data;
+            std::uint64_t lastUse = 0;
+        };
+
+        ULONG ReadFromStream(std::uint64_t offset, void* buffer, ULONG countBytes)
+        {
+            if (SupportsReadAt())
+            {
+                return m_streamInternal->ReadAt(offset, buffer, countBytes);
+            }
+            LARGE_INTEGER pos = { 0 };
+            pos.QuadPart = offset;
+            ThrowHrIfFailed(m_stream->Seek(pos, Reference::START, nullptr));
+            ULONG result = 0;
+            ThrowHrIfFailed(m_stream->Read(buffer, countBytes, &result));
+            return result;
+        }
+
+        ComPtr<IStream> m_stream;
+        ComPtr<IStreamInternal> m_streamInternal;
+        std::uint32_t m_readAheadSize = DefaultReadAheadSize;
+        std::uint64_t m_position = 0;
+        std::uint64_t m_size = 0;
+        std::mutex m_lock;
+        std::vector<Window> m_windows;
+        std::uint64_t m_useCount = 0;
+    };
+}
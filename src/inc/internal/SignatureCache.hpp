@@ -0,0 +1,112 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "ComHelper.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace MSIX {
+
+    const std::size_t SignatureCacheMaxEntries = 1024;
+    const std::chrono::seconds CertificateChainCacheDefaultLifetime(300);
+
+    // Trusted roots in the form the signature validator uses them. Defined by the signature PAL that needs it.
+    struct TrustedCertificateStore;
+
+    // Trusted roots of a factory. The store is built from the certificate resources and the custom roots the
+    // first time a signature is validated, then shared read only by every package the factory opens, on any
+    // thread. Specifying custom roots drops the store, so the next validation builds it again.
+    class TrustedCertificateCache final
+    {
+    public:
+        using Builder = std::function<std::shared_ptr<TrustedCertificateStore>(const std::vector<std::uint8_t>& customRoots)>;
+
+        std::shared_ptr<TrustedCertificateStore> GetStore(const Builder& build)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (!m_store) { m_store = build(m_customRoots); }
+            return m_store;
+        }
+
+        void SetCustomRoots(std::vector<std::uint8_t>&& customRoots)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_customRoots = std::move(customRoots);
+            m_store.reset();
+        }
+
+        std::vector<std::uint8_t> GetCustomRoots()
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            return m_customRoots;
+        }
+
+    protected:
+        std::mutex m_lock;
+        std::vector<std::uint8_t> m_customRoots;
+        std::shared_ptr<TrustedCertificateStore> m_store;
+    };
+
+    // Results of signature validations of a factory, by a key computed from the signature. Kept by the
+    // IMsixSignatureCache extension when there is one, otherwise in memory when enabled, where the least
+    // recently used entries are dropped past SignatureCacheMaxEntries.
+    class SignatureVerificationCache final
+    {
+    public:
+        SignatureVerificationCache(bool enabled) : m_enabled(enabled) {}
+
+        bool IsEnabled();
+        void SetExtension(const ComPtr<IMsixSignatureCache>& extension);
+        ComPtr<IMsixSignatureCache> GetExtension();
+        bool GetEntry(const std::string& key, std::vector<std::uint8_t>& entry);
+        void AddEntry(const std::string& key, std::vector<std::uint8_t>& entry);
+
+    protected:
+        struct CachedEntry
+        {
+            std::vector<std::uint8_t> data;
+            std::uint64_t lastUse = 0;
+        };
+
+        std::mutex m_lock;
+        bool m_enabled = false;
+        ComPtr<IMsixSignatureCache> m_extension;
+        std::map<std::string, CachedEntry> m_entries;
+        std::uint64_t m_useCount = 0;
+    };
+
+    // Trust results of the certificate chains of a factory, by a key computed from the signing certificate. Packages
+    // signed with the same certificate reuse the result of the chain built for the first one until it is older than
+    // the lifetime, and only check their own signature. Past SignatureCacheMaxEntries the oldest entries are dropped.
+    // A lifetime of 0 disables the cache.
+    class CertificateChainCache final
+    {
+    public:
+        void SetLifetime(std::chrono::seconds lifetime);
+        bool GetEntry(const std::string& key, std::uint32_t& result);
+        void AddEntry(const std::string& key, std::uint32_t result);
+
+    protected:
+        struct CachedChain
+        {
+            std::uint32_t result = 0;
+            std::chrono::steady_clock::time_point added;
+        };
+
+        std::mutex m_lock;
+        std::chrono::seconds m_lifetime = CertificateChainCacheDefaultLifetime;
+        std::map<std::string, CachedChain> m_entries;
+    };
+}
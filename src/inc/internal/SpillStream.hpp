@@ -0,0 +1,97 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "Exceptions.hpp"
+#include "StreamBase.hpp"
+#include "ComHelper.hpp"
+#include "ChunkedStream.hpp"
+#include "FileStream.hpp"
+
+#include <cstdio>
+#include <limits>
+#include <vector>
+
+namespace MSIX {
+
+    const std::uint64_t DefaultSpillThreshold = 4 * 1024 * 1024;
+
+    // Stream that is written at its end and read back. The data is kept in memory until there is more than
+    // threshold bytes of it, then it is moved to a temporary file that is deleted when the stream is released.
+    // If no temporary file can be created the data stays in memory, in chunks so growing it doesn't copy it.
+    class SpillStream final : public StreamBase
+    {
+    public:
+        SpillStream(std::uint64_t threshold = DefaultSpillThreshold) : m_threshold(threshold)
+        {
+            m_memory = ComPtr<ChunkedStream>::Make<ChunkedStream>();
+            m_stream = m_memory.As<IStream>();
+        }
+
+        // IStream
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept override
+        {
+            return m_stream->Seek(move, origin, newPosition);
+        }
+
+        HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) noexcept override
+        {
+            return m_stream->Read(buffer, countBytes, bytesRead);
+        }
+
+        HRESULT STDMETHODCALLTYPE Write(const void* buffer, ULONG countBytes, ULONG* bytesWritten) noexcept override try
+        {
+            ThrowHrIfFailed(m_stream->Write(buffer, countBytes, bytesWritten));
+            if (!m_spilled && (m_memory->GetSize() > m_threshold))
+            {
+                Spill();
+            }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        // IStreamInternal
+        std::uint64_t GetSize() override
+        {
+            if (!m_spilled) { return m_memory->GetSize(); }
+            ULARGE_INTEGER current = { 0 };
+            ULARGE_INTEGER end = { 0 };
+            LARGE_INTEGER position = { 0 };
+            ThrowHrIfFailed(m_stream->Seek({ 0 }, Reference::CURRENT, &current));
+            ThrowHrIfFailed(m_stream->Seek({ 0 }, Reference::END, &end));
+            position.QuadPart = static_cast<LONGLONG>(current.QuadPart);
+            ThrowHrIfFailed(m_stream->Seek(position, Reference::START, nullptr));
+            return end.QuadPart;
+        }
+
+        bool IsCompressed() override { return false; }
+
+        const std::uint8_t* GetRawView(std::uint64_t& available) override
+        {
+            available = 0;
+            return m_spilled ? nullptr : m_memory->GetRawView(available);
+        }
+
+    protected:
+        void Spill()
+        {
+            auto file = std::tmpfile();
+            if (file == nullptr)
+            {   // Keep everything in memory
+                m_threshold = std::numeric_limits<std::uint64_t>::max();
+                return;
+            }
+            auto fileStream = ComPtr<IStream>::Make<FileStream>(file, FileStream::Mode::WRITE_UPDATE);
+            m_memory->WriteTo(fileStream.Get());
+            m_stream = fileStream;
+            m_spilled = true;
+            m_memory = ComPtr<ChunkedStream>();
+        }
+
+        std::uint64_t m_threshold = DefaultSpillThreshold;
+        ComPtr<ChunkedStream> m_memory;
+        ComPtr<IStream> m_stream;
+        bool m_spilled = false;
+    };
+}
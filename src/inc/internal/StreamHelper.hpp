@@ -8,6 +8,7 @@
 #include "Exceptions.hpp"
 #include "StreamBase.hpp"
 
+#include <limits>
 #include <utility>
 
 namespace MSIX {
@@ -21,7 +22,9 @@ namespace MSIX {
             ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::END, &end));
             ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::START, nullptr));
             
-            std::uint32_t streamSize = end.u.LowPart;
+            // The whole stream is read with a single call
+            ThrowErrorIf(Error::FileRead, (end.QuadPart > std::numeric_limits<ULONG>::max()), "stream too big to be buffered");
+            std::uint32_t streamSize = static_cast<std::uint32_t>(end.QuadPart);
             std::vector<std::uint8_t> buffer(streamSize);
             ULONG actualRead = 0;
             ThrowHrIfFailed(stream->Read(buffer.data(), streamSize, &actualRead));
@@ -40,7 +43,9 @@ namespace MSIX {
             ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::END, &end));
             ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::START, nullptr));
             
-            std::uint32_t streamSize = end.u.LowPart;
+            // The whole stream is read with a single call
+            ThrowErrorIf(Error::FileRead, (end.QuadPart > std::numeric_limits<ULONG>::max()), "stream too big to be buffered");
+            std::uint32_t streamSize = static_cast<std::uint32_t>(end.QuadPart);
             std::unique_ptr<std::uint8_t[]> buffer = std::make_unique<std::uint8_t[]>(streamSize);
             ULONG actualRead = 0;
             ThrowHrIfFailed(stream->Read(buffer.get(), streamSize, &actualRead));
@@ -0,0 +1,66 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "ComHelper.hpp"
+#include "DirectoryObject.hpp"
+#include "ICompressionObject.hpp"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace MSIX {
+
+    // Unpacks a package that can only be read front to back, like from a pipe, see UnpackPackageFromSequentialStream.
+    // The local header of each file comes before its data, so the payload files are extracted as the package arrives,
+    // to provisional files named after their targets with a ".partial" suffix. Everything read is spooled and, once
+    // the package is complete, it is opened and validated from the spool as usual. The provisional files of its
+    // payload files are then moved to their targets and checked against the block map like with
+    // MSIX_PACKUNPACK_OPTION_SKIPUNCHANGED, which extracts from the spool whatever is missing or different.
+    class StreamingUnpacker final
+    {
+    public:
+        StreamingUnpacker(const ComPtr<IAppxFactory>& factory, const ComPtr<IStream>& input, const ComPtr<IDirectoryObject>& to);
+
+        void Unpack(MSIX_PACKUNPACK_OPTION options, std::uint32_t threadCount);
+
+    protected:
+        // Extracts the next local file to a provisional file. Returns false at the central directory, or at a file
+        // that can't be extracted ahead, like a stored file with a data descriptor without signature. The files
+        // from there on are only extracted from the spool.
+        bool ExtractProvisionalFile();
+        bool CopyStored(std::uint64_t size, IStream* target);
+        bool CopyStoredUntilDataDescriptor(IStream* target);
+        bool Inflate(bool sizeKnown, std::uint64_t compressedSize, IStream* target);
+        void Write(IStream* target, const std::uint8_t* data, std::size_t size);
+
+        // Makes count bytes available from the current position, unless the input ends first
+        bool Ensure(std::size_t count);
+        std::uint8_t* Data() { return m_buffer.data() + m_begin; }
+        std::size_t Available() const { return m_end - m_begin; }
+        void Consume(std::size_t count) { m_begin += count; }
+        void ReadToEnd();
+
+        ComPtr<IAppxFactory> m_factory;
+        ComPtr<IStream> m_input;
+        ComPtr<IDirectoryObject> m_to;
+        // Every byte read from the input
+        ComPtr<IStream> m_spool;
+        std::vector<std::uint8_t> m_buffer;
+        std::size_t m_begin = 0;
+        std::size_t m_end = 0;
+        bool m_endOfInput = false;
+        std::unique_ptr<ICompressionObject> m_inflater;
+        std::vector<std::uint8_t> m_inflated;
+        // Provisional file names of the files extracted ahead by their names in the package, and all the ones
+        // created, which are removed if they aren't moved to their targets
+        std::map<std::string, std::string> m_provisionalFiles;
+        std::vector<std::string> m_createdFiles;
+    };
+}
@@ -24,6 +24,8 @@ namespace MSIX {
             ULONG amountToRead = std::min(countBytes, static_cast<ULONG>(available));
             if (amountToRead > 0)
             {
+                // The position is the one of the put pointer, the get pointer is only moved here
+                m_data.seekg(current);
                 buf->sgetn(static_cast<char*>(buffer),amountToRead);
                 m_data.seekp(static_cast<std::ostringstream::off_type>(amountToRead), std::ios_base::cur);
             }
@@ -0,0 +1,93 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "ComHelper.hpp"
+#include "DirectoryObject.hpp"
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#ifdef MSIX_PACK
+#include <zlib.h>
+#endif
+
+namespace MSIX {
+
+    class TarEntryStream;
+
+    // Target of an unpack that writes the files as a tar archive to a stream instead of to disk, see
+    // UnpackPackageToTarStream. The entries are in the order the files were given to CreateDirectories, which is
+    // the order they are in the package, whatever order they are written in, and have fixed metadata: no time,
+    // owner 0 and mode 644, 755 for the directories, which get an entry before their first file. So the same
+    // package always makes the same archive. The file written in its turn goes straight to the stream, the ones
+    // written ahead of their turn wait in a SpillStream. Written once, front to back, never seeked. Available
+    // without MSIX_PACK, SpillStream doesn't need it, but gzip, which deflates, does: MSIX_TAR_COMPRESSION_GZIP
+    // fails with Error::NotSupported in a build without it.
+    class TarStreamDirectory final : public ComClass<TarStreamDirectory, IDirectoryObject>
+    {
+    public:
+        TarStreamDirectory(const ComPtr<IStream>& output, MSIX_TAR_COMPRESSION compression);
+        ~TarStreamDirectory();
+
+        // Ends the archive. Fails if a file given to CreateDirectories wasn't written.
+        void Finish();
+
+        // IDirectoryObject
+        ComPtr<IStream> OpenFile(const std::string& fileName, FileStream::Mode mode, std::uint64_t expectedSize = 0) override;
+        std::unique_ptr<MappedOutputFile> OpenMappedFile(const std::string&, std::uint64_t) override { return nullptr; }
+        // Sets the order of the entries
+        void CreateDirectories(const std::vector<std::string>& fileNames) override;
+        std::multimap<std::uint64_t, std::string> GetFilesByLastModDate() override { NOTSUPPORTED; }
+        std::string GetFilePath(const std::string&) override { NOTSUPPORTED; }
+        bool LinkFile(const std::string&, const std::string&) override { return false; }
+        bool CopyFileRange(const std::string&, const std::string&, std::uint64_t, std::uint64_t) override { return false; }
+        void WriteFileContent(const std::string& fileName, const void* data, std::size_t size) override;
+        void WaitForClosedFiles() override {}
+
+    protected:
+        friend class TarEntryStream;
+
+        // Called by the stream of the entry at index when it is first written. Returns true if it is its turn, then
+        // the header is written and the stream writes its content with WriteContent and ends it with EndEntry.
+        bool BeginEntry(std::size_t index, std::uint64_t size);
+        void WriteContent(const void* data, std::size_t size);
+        void EndEntry(std::uint64_t size);
+        // The entry at index written ahead of its turn, added when it comes
+        void AddEntry(std::size_t index, const ComPtr<IStream>& content, std::uint64_t size);
+        // An entry was abandoned after part of it was written to the stream
+        void AbortEntry();
+
+        std::size_t GetIndex(const std::string& fileName);
+        // With m_lock held
+        void WriteHeader(const std::string& name, std::uint64_t size, char type);
+        void WriteReadyEntries();
+        void WritePadding(std::uint64_t size);
+        void WriteOutput(const void* data, std::size_t size);
+
+        ComPtr<IStream> m_output;
+        std::mutex m_lock;
+        std::vector<std::string> m_order;
+        std::unordered_map<std::string, std::size_t> m_indexes;
+        // The next entry to write, and whether its stream is writing it
+        std::size_t m_next = 0;
+        bool m_writing = false;
+        bool m_failed = false;
+        std::map<std::size_t, std::pair<ComPtr<IStream>, std::uint64_t>> m_ready;
+        std::set<std::string> m_directories;
+        #ifdef MSIX_PACK
+        bool m_gzip = false;
+        z_stream m_zstrm;
+        gz_header m_gzipHeader;
+        std::vector<std::uint8_t> m_compressed;
+        #endif
+    };
+}
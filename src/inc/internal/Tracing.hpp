@@ -0,0 +1,68 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace MSIX { namespace Tracing {
+
+    // Intervals of the library's work that are traced. Every platform backend names them after the enum.
+    enum class Event : std::uint32_t
+    {
+        OpenPackage,          // Reading a package or bundle, from its central directory to its validated footprint files
+        ValidateSignature,    // Validating AppxSignature.p7x
+        ParseBlockMap,        // Reading AppxBlockMap.xml
+        ExtractFile,          // Writing a file of a package to disk, detail is its name
+        PackFile,             // Adding a file to a package or bundle being written, detail is its name
+        CompressBlock,        // Deflating data, value is its size
+        SelectBundlePackages, // Applicability of the packages of a bundle, and validating the applicable ones
+    };
+
+    // For the backends, whose event names must be literals or identifiers
+    #define MSIX_TRACING_FOR_EACH_EVENT(X) \
+        X(OpenPackage)          \
+        X(ValidateSignature)    \
+        X(ParseBlockMap)        \
+        X(ExtractFile)          \
+        X(PackFile)             \
+        X(CompressBlock)        \
+        X(SelectBundlePackages) \
+
+    // Platform backend, in PAL/Tracing. Windows writes TraceLogging events (ETW) with start and stop opcodes,
+    // Linux fires USDT probes that perf, bpftrace or LTTng can attach to, and Apple platforms emit os_signpost
+    // intervals. Platforms without a backend trace nothing.
+    //
+    // IsEnabled is cheap, so callers check it before making a detail string.
+    bool IsEnabled();
+    // Returns the id that pairs the end of the interval with its begin.
+    std::uint64_t Begin(Event event, const char* detail, std::uint64_t value);
+    void End(Event event, std::uint64_t id);
+
+    // Traces the interval until it goes out of scope, exception or not.
+    class Activity final
+    {
+    public:
+        Activity(Event event, const char* detail = "", std::uint64_t value = 0) : m_event(event), m_enabled(IsEnabled())
+        {
+            if (m_enabled) { m_id = Begin(m_event, detail, value); }
+        }
+
+        Activity(Event event, const std::string& detail, std::uint64_t value = 0) : Activity(event, detail.c_str(), value) {}
+
+        ~Activity()
+        {
+            if (m_enabled) { End(m_event, m_id); }
+        }
+
+        Activity(const Activity&) = delete;
+        Activity& operator=(const Activity&) = delete;
+
+    protected:
+        Event m_event;
+        bool m_enabled;
+        std::uint64_t m_id = 0;
+    };
+} }
@@ -4,6 +4,7 @@
 // 
 #pragma once
 
+#include <cstddef>
 #include <string>
 #include <locale>
 #include <codecvt>
@@ -42,5 +43,13 @@ namespace MSIX {
     std::string wstring_to_utf8(const std::wstring& utf16string);
     std::string u16string_to_utf8(const std::u16string& utf16string);
 
+    // Non allocating conversions into a buffer of the caller, they return how many units they wrote and throw on
+    // invalid input. The utf16 of a utf8 string never has more units than it has bytes. The utf8 of a utf16 string
+    // has at most 3 bytes per unit, 4 for a wchar_t that holds a code point rather than utf16 units.
+    std::size_t utf8_to_utf16(const char* utf8, std::size_t size, char16_t* utf16);
+    std::size_t utf8_to_utf16(const char* utf8, std::size_t size, wchar_t* utf16);
+    std::size_t utf16_to_utf8(const char16_t* utf16, std::size_t size, char* utf8);
+    std::size_t utf16_to_utf8(const wchar_t* utf16, std::size_t size, char* utf8);
+
 
 } // namespace MSIX
\ No newline at end of file
@@ -51,11 +51,15 @@ namespace MSIX {
         {
             THROW_IF_PACK_NOT_ENABLED
             // make sure that we can allocate the buffer
-            ULONG expected = static_cast<ULONG>(m_data->size()) + countBytes; 
-            m_data->resize(expected);
-            if (countBytes > 0) { memcpy(&(m_data->at(m_offset)), buffer, countBytes); }
-            m_offset = static_cast<ULONG>(m_data->size());
-            ThrowErrorIf(Error::FileWrite, expected != m_offset, "Error writing to stream");
+            ULONG expected = m_offset + countBytes;
+            ThrowErrorIf(Error::FileWrite, expected < m_offset, "Error writing to stream");
+            if (expected > m_data->size())
+            {   // Grow geometrically, like push_back would, so appending in small writes stays linear
+                if (expected > m_data->capacity()) { m_data->reserve(std::max(static_cast<std::size_t>(expected), m_data->capacity() * 2)); }
+                m_data->resize(expected);
+            }
+            if (countBytes > 0) { memcpy(m_data->data() + m_offset, buffer, countBytes); }
+            m_offset = expected;
             if (bytesWritten) { *bytesWritten = countBytes; }
             return static_cast<HRESULT>(Error::OK);
         } CATCH_RETURN();
@@ -65,6 +69,23 @@ namespace MSIX {
             return static_cast<std::uint64_t>(m_data->size());
         }
 
+        bool SupportsReadAt() override { return true; }
+        bool IsBuffered() override { return true; }
+
+        const std::uint8_t* GetRawView(std::uint64_t& available) override
+        {
+            available = static_cast<std::uint64_t>(m_data->size() - m_offset);
+            return m_data->data() + m_offset;
+        }
+
+        ULONG ReadAt(std::uint64_t offset, void* buffer, ULONG countBytes) override
+        {
+            if (offset >= m_data->size()) { return 0; }
+            ULONG amountToRead = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(countBytes), m_data->size() - offset));
+            if (amountToRead > 0) { memcpy(buffer, m_data->data() + offset, amountToRead); }
+            return amountToRead;
+        }
+
     protected:
         ULONG m_offset = 0;
         std::vector<std::uint8_t>* m_data;
@@ -0,0 +1,162 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include "AppxPackaging.hpp"
+#include "ComHelper.hpp"
+#include "QualityOfService.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace MSIX {
+
+    // Work handed to a pool. Whoever gets to it first runs it: a thread of the pool, or the thread that waits
+    // for it when it hasn't started yet. So waiting for a task never depends on a free thread in the pool, and
+    // parallel work nested in parallel work (the packages of a bundle, then the files of each package) can't
+    // deadlock, whatever the size of the pool.
+    class PoolTask final
+    {
+    public:
+        PoolTask(std::function<void()>&& work) : m_work(std::move(work)) {}
+
+        // Runs the task if nobody has started it yet.
+        void TryRun() noexcept;
+        // Waits for the task, running it here if it hasn't started, and rethrows its failure.
+        void Wait();
+
+    protected:
+        enum class State { Queued, Running, Done };
+
+        std::function<void()> m_work;
+        std::mutex m_lock;
+        std::condition_variable m_done;
+        State m_state = State::Queued;
+        std::exception_ptr m_failure;
+    };
+
+    // What runs the tasks of a pool.
+    class TaskExecutor
+    {
+    public:
+        virtual ~TaskExecutor() = default;
+        // Eventually calls TryRun on the task, on any thread. False when the task wasn't queued, it then only runs
+        // when it is waited on.
+        virtual bool Post(const std::shared_ptr<PoolTask>& task) = 0;
+        // How many tasks may run at the same time.
+        virtual std::size_t GetConcurrency() = 0;
+    };
+
+    // One thread per hardware thread, shared by the process. Each thread has its own queue. Tasks posted by a
+    // thread of the pool go to its queue and it runs the newest first, so nested work stays on a warm cache.
+    // Tasks posted from elsewhere go to a shared queue. A thread with nothing to do steals the oldest task of
+    // another thread, the ones next to it by index first, which are on the nearest processors when pinned.
+    class WorkStealingExecutor final : public TaskExecutor
+    {
+    public:
+        WorkStealingExecutor(std::size_t threadCount);
+        ~WorkStealingExecutor();
+
+        bool Post(const std::shared_ptr<PoolTask>& task) override;
+        std::size_t GetConcurrency() override { return m_threadCount; }
+
+        // Waits for the threads to run the queued tasks and return. They start again with the next task. Nothing
+        // may be posted meanwhile.
+        void Stop();
+
+    protected:
+        struct Worker
+        {
+            std::mutex lock;
+            std::deque<std::shared_ptr<PoolTask>> tasks;
+        };
+
+        void Start();
+        void WorkerLoop(std::size_t index) noexcept;
+        std::shared_ptr<PoolTask> Take(std::size_t index);
+
+        std::size_t m_threadCount;
+        std::vector<std::unique_ptr<Worker>> m_workers;
+        std::vector<std::thread> m_threads;
+        std::mutex m_startLock;
+        std::atomic<bool> m_started;
+        std::mutex m_sharedLock;
+        std::deque<std::shared_ptr<PoolTask>> m_shared;
+        std::mutex m_sleepLock;
+        std::condition_variable m_wake;
+        std::atomic<std::size_t> m_queued;
+        bool m_stop = false;
+    };
+
+    // Runs the tasks with the IMsixTaskScheduler a host specified.
+    class HostTaskExecutor final : public TaskExecutor
+    {
+    public:
+        HostTaskExecutor(const ComPtr<IMsixTaskScheduler>& scheduler);
+
+        bool Post(const std::shared_ptr<PoolTask>& task) override;
+        std::size_t GetConcurrency() override { return m_concurrency; }
+
+        ComPtr<IMsixTaskScheduler> GetScheduler() { return m_scheduler; }
+
+    protected:
+        ComPtr<IMsixTaskScheduler> m_scheduler;
+        std::size_t m_concurrency;
+    };
+
+    // The threads a factory runs its parallel work on: the work-stealing threads of the process, or the
+    // executor of the host when it specified one with MSIX_FACTORY_EXTENSION_TASK_SCHEDULER. Every parallel
+    // loop of the SDK goes through here, so the threads in use stay bounded however the loops nest. The limits of
+    // the quality of service of the factory, if it has one, apply to every loop and task: at most its maximum
+    // worker count per loop, the work runs with low priority I/O when asked to, and the work-stealing threads
+    // are pinned to the processor of their index when asked to.
+    class WorkerPool final
+    {
+    public:
+        WorkerPool(const std::shared_ptr<QualityOfService>& qualityOfService = nullptr);
+
+        void SetExtension(const ComPtr<IMsixTaskScheduler>& scheduler);
+        ComPtr<IMsixTaskScheduler> GetExtension();
+
+        // How many tasks may run at the same time.
+        std::size_t GetConcurrency();
+        // The number of workers for a caller that asked for threadCount threads, where 0 means as many as
+        // the pool runs, within the maximum worker count of the quality of service.
+        std::size_t GetWorkerCount(std::uint32_t threadCount);
+
+        // Starts work on the pool. The returned task must be waited on.
+        std::shared_ptr<PoolTask> Async(std::function<void()>&& work);
+        // Starts work on the pool that nobody waits for, so it must not throw. Throws when the pool can't take it.
+        void Detach(std::function<void()>&& work);
+
+        // Runs action for every index up to count on up to workerCount workers, the calling thread being one
+        // of them. Each worker takes the next index available. After a failure the workers stop picking up
+        // new indexes and the first failure is rethrown once they are done.
+        void ForEach(std::size_t count, std::size_t workerCount, const std::function<void(std::size_t)>& action);
+
+        // The pool of code that has no factory.
+        static std::shared_ptr<WorkerPool> GetDefault();
+        // Stops the work-stealing threads of the process, see MsixShutdownThreads. They start again when needed.
+        static void StopDefault();
+
+    protected:
+        std::shared_ptr<TaskExecutor> GetExecutor();
+        // work, run with the I/O priority and on the processor the quality of service asks for
+        std::function<void()> WithQualityOfService(std::function<void()>&& work);
+
+        std::shared_ptr<QualityOfService> m_qualityOfService;
+        std::mutex m_lock;
+        std::shared_ptr<TaskExecutor> m_executor;
+        ComPtr<IMsixTaskScheduler> m_extension;
+    };
+}
@@ -7,8 +7,10 @@
 #include "ComHelper.hpp"
 #include "StringStream.hpp"
 
+#include <cstring>
 #include <stack>
 #include <string>
+#include <vector>
 
 namespace MSIX {
 
@@ -16,6 +18,9 @@ namespace MSIX {
     static const char* xmlnsAttribute = "xmlns";
     static const char* xmlNamespaceDelimiter = ":";
 
+    // The xml is appended to a buffer and written to the stream once it holds this many bytes
+    const std::size_t XmlWriterBufferSize = 64 * 1024;
+
     // This is a super light xml writer that doesn't use any xml libraries and 
     // just writes to a stream the basics of an xml file.
     class XmlWriter final
@@ -43,18 +48,30 @@ namespace MSIX {
         }
 
         void StartElement(const std::string& name);
+        void StartElement(const char* name);
         void CloseElement();
         void AddAttribute(const std::string& name, const std::string& value);
+        void AddAttribute(const char* name, const std::string& value);
+        void AddAttribute(const char* name, const char* value);
+        // The value is written in decimal without making a string
+        void AddNumericAttribute(const char* name, std::uint64_t value);
+        // The value is written in base64 without making a string
+        void AddBase64Attribute(const char* name, const std::vector<std::uint8_t>& value);
+        void AddBase64Attribute(const char* name, const std::uint8_t* value, std::size_t size);
         State GetState() { return m_state; }
         ComPtr<IStream> GetStream();
 
     protected:
         void StartWrite(const std::string& root, bool standalone);
-        void Write(const std::string& toWrite);
-        void Write(const char toWrite);
-        void WriteTextValue(const std::string& value);
+        void StartAttribute(const char* name, std::size_t size);
+        void Write(const char* toWrite, std::size_t size);
+        void Write(const std::string& toWrite) { Write(toWrite.data(), toWrite.size()); }
+        void Write(const char* toWrite) { Write(toWrite, std::strlen(toWrite)); }
+        void WriteTextValue(const char* value, std::size_t size);
+        void Flush();
         State m_state;
         ComPtr<IStream> m_stream;
         std::stack<std::string> m_elements;
+        std::string m_buffer;
     };
 }
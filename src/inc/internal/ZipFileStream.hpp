@@ -8,9 +8,16 @@
 #include "StreamBase.hpp"
 #include "RangeStream.hpp"
 #include "AppxFactory.hpp"
+#include "ZipObject.hpp"
 #include "MsixFeatureSelector.hpp"
+#include "VectorStream.hpp"
 
 #include <string>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <limits>
+#include <vector>
 
 namespace MSIX {
 
@@ -19,16 +26,37 @@ namespace MSIX {
     {
     public:
         // Represents an stream taken from the zip file (unpack)
+        // If the zip file stream doesn't support positional reads, all the streams over it share streamLock,
+        // which serializes the seek and read done on the zip file stream. Either way, different files can
+        // be read concurrently.
         ZipFileStream(
             std::string name,
             bool isCompressed,
             std::uint64_t offset,
             std::uint64_t size,
-            IStream* stream // this is the actual zip file stream
-        ) : m_isCompressed(isCompressed), RangeStream(offset, size, stream), m_name(std::move(name))
+            IStream* stream, // this is the actual zip file stream
+            std::shared_ptr<std::mutex> streamLock
+        ) : m_isCompressed(isCompressed), RangeStream(offset, size, stream), m_name(std::move(name)), m_streamLock(std::move(streamLock))
         {
         }
 
+        // Represents an stream taken from the zip file whose local file header hasn't been read yet (unpack)
+        // The header is read and validated against the central directory on the first read, until then
+        // seeking doesn't touch the zip file.
+        ZipFileStream(
+            std::string name,
+            bool isCompressed,
+            std::uint64_t localHeaderOffset,
+            bool hasDataDescriptor,
+            std::uint64_t size,
+            IStream* stream,
+            std::shared_ptr<std::mutex> streamLock
+        ) : ZipFileStream(std::move(name), isCompressed, localHeaderOffset, size, stream, std::move(streamLock))
+        {
+            m_pendingLocalHeader = true;
+            m_hasDataDescriptor = hasDataDescriptor;
+        }
+
         // Represents an stream to be added to the zip file (pack)
         ZipFileStream(
             std::string name,
@@ -39,13 +67,168 @@ namespace MSIX {
             THROW_IF_PACK_NOT_ENABLED
         }
 
+        // Represents an stream to be added to the zip file (pack) whose records in front of it, like its local file
+        // header, aren't written yet. They are written with the first bytes of the file in one gathered write, until
+        // then seeking doesn't touch the zip file. The zip writer shares pendingRecords with the stream.
+        ZipFileStream(
+            std::string name,
+            bool isCompressed,
+            IStream* stream,
+            std::shared_ptr<std::vector<std::uint8_t>> pendingRecords
+        ) : ZipFileStream(std::move(name), isCompressed, stream)
+        {
+            m_pendingRecords = std::move(pendingRecords);
+            m_offset += m_pendingRecords->size();
+        }
+
+        // IStream
+        // The clone reads the same bytes of the zip file with its own position.
+        HRESULT STDMETHODCALLTYPE Clone(IStream** stream) noexcept override try
+        {
+            ThrowErrorIf(Error::InvalidParameter, (stream == nullptr || *stream != nullptr), "bad pointer");
+            ThrowErrorIfNot(Error::NotSupported, m_streamLock, "only streams taken from the zip file can be cloned");
+            if (m_positionalStream)
+            {
+                ThrowHrIfFailed(ReadLocalHeader());
+            }
+            else
+            {
+                std::lock_guard<std::mutex> lock(*m_streamLock);
+                ThrowHrIfFailed(ReadLocalHeader());
+            }
+            auto clone = ComPtr<IStream>::Make<ZipFileStream>(m_name, m_isCompressed, m_offset, m_size, m_stream.Get(), m_streamLock);
+            LARGE_INTEGER position = { 0 };
+            position.QuadPart = static_cast<LONGLONG>(m_relativePosition);
+            ThrowHrIfFailed(clone->Seek(position, Reference::START, nullptr));
+            *stream = clone.Detach();
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER *newPosition) noexcept override
+        {
+            if (m_pendingLocalHeader || HasPendingRecords())
+            {   // Every read and write seeks the zip file first, so only the position is needed.
+                m_relativePosition = static_cast<std::uint64_t>(GetRelativePosition(move, origin).QuadPart);
+                if (newPosition) { newPosition->QuadPart = m_relativePosition; }
+                return static_cast<HRESULT>(Error::OK);
+            }
+            if (!m_streamLock || m_positionalStream) { return RangeStream::Seek(move, origin, newPosition); }
+            std::lock_guard<std::mutex> lock(*m_streamLock);
+            return RangeStream::Seek(move, origin, newPosition);
+        }
+
+        HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) noexcept override try
+        {
+            if (!m_streamLock || m_positionalStream)
+            {
+                ULONG read = 0;
+                if ((m_relativePosition == 0) && ReadLocalHeaderWithData(buffer, countBytes, read))
+                {
+                    m_relativePosition += read;
+                    if (bytesRead) { *bytesRead = read; }
+                    return static_cast<HRESULT>(Error::OK);
+                }
+                auto hr = ReadLocalHeader();
+                if (FAILED(hr)) { return hr; }
+                return RangeStream::Read(buffer, countBytes, bytesRead);
+            }
+            std::lock_guard<std::mutex> lock(*m_streamLock);
+            auto hr = ReadLocalHeader();
+            if (FAILED(hr)) { return hr; }
+            return RangeStream::Read(buffer, countBytes, bytesRead);
+        } CATCH_RETURN();
+
         // IStreamInternal
         std::uint64_t GetSize() override { return m_size; }
         bool IsCompressed() override { return m_isCompressed; }
         std::string GetName() override { return m_name; }
 
+        ULONG ReadAt(std::uint64_t offset, void* buffer, ULONG countBytes) override
+        {
+            ULONG read = 0;
+            if ((offset == 0) && ReadLocalHeaderWithData(buffer, countBytes, read)) { return read; }
+            ThrowHrIfFailed(ReadLocalHeader());
+            return RangeStream::ReadAt(offset, buffer, countBytes);
+        }
+
+        HRESULT STDMETHODCALLTYPE Write(const void* buffer, ULONG countBytes, ULONG* bytesWritten) noexcept override try
+        {
+            if (!HasPendingRecords()) { return RangeStream::Write(buffer, countBytes, bytesWritten); }
+            if (bytesWritten) { *bytesWritten = 0; }
+            StreamWriteBuffer data = { buffer, countBytes };
+            WriteV(&data, 1);
+            if (bytesWritten) { *bytesWritten = countBytes; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        void WriteV(const StreamWriteBuffer* buffers, std::size_t count) override
+        {
+            if (!HasPendingRecords()) { return RangeStream::WriteV(buffers, count); }
+            // The records go right before the file, where the zip file is
+            std::vector<StreamWriteBuffer> withRecords;
+            withRecords.reserve(count + 1);
+            withRecords.push_back({ m_pendingRecords->data(), static_cast<ULONG>(m_pendingRecords->size()) });
+            withRecords.insert(withRecords.end(), buffers, buffers + count);
+            LARGE_INTEGER offset = { 0 };
+            offset.QuadPart = static_cast<LONGLONG>(m_offset - m_pendingRecords->size());
+            ThrowHrIfFailed(m_stream->Seek(offset, Reference::START, nullptr));
+            WriteBuffers(m_stream.Get(), withRecords.data(), withRecords.size());
+            m_pendingRecords->clear();
+            m_relativePosition = 0;
+            for (std::size_t i = 0; i < count; i++)
+            {
+                m_relativePosition += buffers[i].size;
+            }
+            m_size = std::max(m_size, m_relativePosition);
+        }
+
     protected:
+        // Must be called with m_streamLock held if the zip file doesn't support positional reads. Positional
+        // reads of the same stream can happen concurrently, so the header is read only once under m_headerLock.
+        HRESULT ReadLocalHeader() noexcept try
+        {
+            if (!m_pendingLocalHeader) { return static_cast<HRESULT>(Error::OK); }
+            std::lock_guard<std::mutex> lock(m_headerLock);
+            if (!m_pendingLocalHeader) { return static_cast<HRESULT>(Error::OK); }
+            // The header is at most its fixed part plus the file name and extra field.
+            auto header = ComPtr<IStream>::Make<RangeStream>(m_offset, 30 + 2 * std::numeric_limits<std::uint16_t>::max(), m_stream.Get());
+            LocalFileHeader lfh = LocalFileHeader();
+            lfh.Read(header.Get(), m_hasDataDescriptor);
+            m_offset += lfh.GetHeaderSize();
+            m_pendingLocalHeader = false;
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        // Reads the local header and the first bytes of the file with one vectored read, guessing that the header is
+        // as long as the ones this SDK writes, the name of the file without an extra field. True when it is and buffer
+        // has the bytes of the file, false when the header isn't pending or the file must be read again.
+        bool ReadLocalHeaderWithData(void* buffer, ULONG countBytes, ULONG& bytesRead)
+        {
+            if (!m_pendingLocalHeader || !m_positionalStream) { return false; }
+            std::lock_guard<std::mutex> lock(m_headerLock);
+            if (!m_pendingLocalHeader) { return false; }
+            std::vector<std::uint8_t> header(30 + m_name.size());
+            ULONG amountToRead = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(countBytes), m_size));
+            StreamReadBuffer buffers[] = { { header.data(), static_cast<ULONG>(header.size()) }, { buffer, amountToRead } };
+            ULONG read = m_positionalStream->ReadAtV(m_offset, buffers, 2);
+            ThrowErrorIf(Error::FileRead, (read < header.size()), "Entire object wasn't read!");
+            LocalFileHeader lfh = LocalFileHeader();
+            lfh.Read(ComPtr<IStream>::Make<VectorStream>(&header), m_hasDataDescriptor);
+            m_offset += lfh.GetHeaderSize();
+            m_pendingLocalHeader = false;
+            if ((lfh.GetHeaderSize() != header.size()) || (read - header.size() != amountToRead)) { return false; }
+            bytesRead = amountToRead;
+            return true;
+        }
+
+        bool HasPendingRecords() { return m_pendingRecords && !m_pendingRecords->empty(); }
+
         std::string     m_name;
         bool            m_isCompressed = false;
+        std::atomic<bool> m_pendingLocalHeader{false};
+        bool            m_hasDataDescriptor = false;
+        std::shared_ptr<std::mutex> m_streamLock;
+        std::mutex      m_headerLock;
+        std::shared_ptr<std::vector<std::uint8_t>> m_pendingRecords;
     };
 }
\ No newline at end of file
@@ -288,6 +288,42 @@ namespace MSIX {
         bool m_isZip64 = true;
     };
 
+    // Read only index over the raw bytes of a central directory. Headers are validated like
+    // CentralDirectoryFileHeader::Read does, but only the fields needed to open a file are kept in a
+    // single array sorted by name, so parsing doesn't allocate per entry.
+    class CentralDirectoryIndex final
+    {
+    public:
+        struct Entry
+        {
+            std::size_t     nameOffset; // offset of the file name in the index buffer
+            std::uint16_t   nameLength;
+            std::uint16_t   extraLength;
+            CompressionType compressionMethod;
+            bool            hasDataDescriptor;
+            std::uint64_t   compressedSize;
+            std::uint64_t   uncompressedSize;
+            std::uint64_t   relativeOffsetOfLocalHeader;
+        };
+
+        // buffer contains the bytes of the container starting at startOfCD. Returns the number of bytes
+        // used by the headers.
+        std::size_t Parse(std::vector<std::uint8_t>&& buffer, std::uint64_t startOfCD, std::uint64_t totalNumberOfEntries, bool isZip64);
+
+        const Entry* Find(const std::string& fileName) const;
+        std::string GetFileName(const Entry& entry) const;
+        const std::vector<Entry>& GetEntries() const noexcept { return m_entries; }
+        const std::vector<std::uint8_t>& GetBuffer() const noexcept { return m_buffer; }
+        // Offset in the index buffer and size of the central directory header of entry.
+        std::pair<std::size_t, std::size_t> GetHeaderRange(const Entry& entry) const noexcept;
+
+    protected:
+        bool IsLess(const Entry& left, const char* right, std::size_t rightLength) const noexcept;
+
+        std::vector<std::uint8_t> m_buffer;
+        std::vector<Entry> m_entries;
+    };
+
     class LocalFileHeader final : public Meta::StructuredObject<
         Meta::Field4Bytes,  // 0 - local file header signature     4 bytes(0x04034b50)
         Meta::Field2Bytes,  // 1 - version needed to extract       2 bytes
@@ -310,11 +346,13 @@ namespace MSIX {
         void SetData(const std::string& name, bool isCompressed);
         void SetData(std::uint32_t crc, std::uint64_t compressedSize, std::uint64_t uncompressedSize);
 
-        void Read(const ComPtr<IStream>& stream, CentralDirectoryFileHeader& directoryEntry);
+        void Read(const ComPtr<IStream>& stream, bool directoryHasDataDescriptor);
 
         GeneralPurposeBitFlags GetGeneralPurposeBitFlags() const noexcept { return static_cast<GeneralPurposeBitFlags>(Field<2>().get()); }
         std::uint16_t GetCompressionMethod() const noexcept { return Field<3>(); }
         std::uint16_t GetFileNameLength() const noexcept    { return Field<9>();  }
+        // Read skips the file name and extra field, so this is the size of the header in the package rather than Size()
+        std::uint64_t GetHeaderSize() const noexcept        { return FixedSize + Field<9>().get() + Field<10>().get(); }
         std::string GetFileName() const
         {
             auto data = Field<11>().get();
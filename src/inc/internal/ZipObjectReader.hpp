@@ -7,24 +7,129 @@
 #include "Exceptions.hpp"
 #include "ComHelper.hpp"
 #include "ZipObject.hpp"
+#include "Arena.hpp"
+#include "BufferPool.hpp"
+#include "PerformanceCounters.hpp"
+#include "Crypto.hpp"
 
 #include <vector>
 #include <map>
 #include <memory>
+#include <mutex>
+
+namespace MSIX {
+    // Bytes read from the end of a container when it is opened, which hold the end of central directory records
+    // and, for most packages, the central directory itself.
+    const std::uint64_t CentralDirectoryReadAhead = 64 * 1024;
+
+    // Bytes of a container
+    struct ZipByteRange
+    {
+        std::uint64_t offset = 0;
+        std::uint64_t size = 0;
+    };
+
+    // Where the records of a file are in a container. The data descriptor is empty if the file doesn't have one.
+    struct ZipFileRecords
+    {
+        ZipByteRange localFileHeader;
+        ZipByteRange data;
+        ZipByteRange dataDescriptor;
+        bool isCompressed = false;
+    };
+}
+
+// {4d7c2f1e-8b3a-4c65-9e0d-7a1f6b2c9e48}
+#ifndef WIN32
+interface IZipReader : public IUnknown
+#else
+#include "Unknwn.h"
+#include "Objidl.h"
+class IZipReader : public IUnknown
+#endif
+{
+public:
+    // Returns the central directory headers followed by the end of central directory records, as they were
+    // before fileName was added as the last file of the container.
+    virtual std::vector<std::uint8_t> GetCentralDirectoryWithoutFile(const std::string& fileName) = 0;
+
+    // Returns a stream over the bytes of the container before the local file header of fileName.
+    virtual MSIX::ComPtr<IStream> GetFileRecordsBeforeFile(const std::string& fileName) = 0;
+
+    // Returns where the records of fileName are in the container. Its local file header and data descriptor are
+    // read to get their sizes.
+    virtual MSIX::ZipFileRecords GetFileRecords(const std::string& fileName) = 0;
+
+    // Returns where the central directory headers are, followed by the end of central directory records up to
+    // the end of the container.
+    virtual MSIX::ZipByteRange GetCentralDirectoryRange() = 0;
+
+    // Returns the hash of the central directory headers and the end of central directory records, which change
+    // when any file of the container does.
+    virtual MSIX::Sha256Digest GetCentralDirectoryHash() = 0;
+
+    // Returns what identifies the local file the container is read from, or an empty string when it isn't read
+    // from one. See IStreamInternal::GetFileIdentity.
+    virtual std::string GetFileIdentity() = 0;
+
+    // Returns the bytes of the file as they are stored in the zip file, still deflated if the file is
+    // compressed, or an empty ComPtr if the file isn't in it. The stream isn't cached.
+    virtual MSIX::ComPtr<IStream> GetRawFile(const std::string& fileName) = 0;
+
+    // Returns the bytes fileName is stored in, from its local file header to the end of its data descriptor, from
+    // the central directory alone so nothing is read. The local file header is taken to have the extra field of the
+    // central directory header, which it usually has, so the range is only good for hints like Prefetch. Empty if
+    // the file isn't in the container.
+    virtual MSIX::ZipByteRange GetStoredFileRange(const std::string& fileName) = 0;
+
+    // Hint that the ranges of the container are about to be read, see IStreamInternal::Prefetch. Returns false
+    // if the container isn't read from a stream that fetches ahead.
+    virtual bool Prefetch(const std::vector<MSIX::ZipByteRange>& ranges) = 0;
+};
+MSIX_INTERFACE(IZipReader, 0x4d7c2f1e,0x8b3a,0x4c65,0x9e,0x0d,0x7a,0x1f,0x6b,0x2c,0x9e,0x48);
 
 namespace MSIX {
     // This represents a raw stream over a.zip file.
-    class ZipObjectReader final : public ComClass<ZipObjectReader, IStorageObject>, ZipObject
+    class ZipObjectReader final : public ComClass<ZipObjectReader, IStorageObject, IZipReader>, public ZipObject
     {
     public:
-        ZipObjectReader(const ComPtr<IStream>& stream);
+        ZipObjectReader(const ComPtr<IStream>& stream, bool deferLocalFileHeaders = false, const std::shared_ptr<BufferPool>& bufferPool = nullptr,
+            const std::shared_ptr<PerformanceCounters>& performanceCounters = nullptr);
 
         // IStorageObject methods
         std::vector<std::string> GetFileNames(FileNameOptions options) override;
         ComPtr<IStream> GetFile(const std::string& fileName) override;
         std::string GetFileName() override;
 
+        // IZipReader
+        std::vector<std::uint8_t> GetCentralDirectoryWithoutFile(const std::string& fileName) override;
+        ComPtr<IStream> GetFileRecordsBeforeFile(const std::string& fileName) override;
+        ZipFileRecords GetFileRecords(const std::string& fileName) override;
+        ZipByteRange GetCentralDirectoryRange() override;
+        Sha256Digest GetCentralDirectoryHash() override;
+        std::string GetFileIdentity() override;
+        ComPtr<IStream> GetRawFile(const std::string& fileName) override;
+        ZipByteRange GetStoredFileRange(const std::string& fileName) override;
+        bool Prefetch(const std::vector<ZipByteRange>& ranges) override;
+
     protected:
-        std::map<std::string, ComPtr<IStream>> m_streams;
+        ComPtr<IStream> OpenRawFile(const std::string& fileName, const CentralDirectoryIndex::Entry& centralFileHeader);
+
+        CentralDirectoryIndex m_centralDirectoryIndex;
+        std::size_t m_sizeOfCentralDirectoryHeaders = 0;
+        std::uint64_t m_startOfCentralDirectory = 0;
+        std::uint64_t m_containerSize = 0;
+        // The zip64 end of central directory record and locator if any, and the end of central directory record
+        std::vector<std::uint8_t> m_endOfCentralDirectory;
+        ComPtr<IStream> m_readStream;
+        bool m_deferLocalFileHeaders = false;
+        // Where the inflate windows of the files come from, the heap when there is none
+        std::shared_ptr<BufferPool> m_bufferPool;
+        // Given to the inflate streams of the files, null when not counting
+        std::shared_ptr<PerformanceCounters> m_performanceCounters;
+        // Holds the nodes of m_streams
+        MonotonicArena m_arena;
+        ArenaMap<std::string, ComPtr<IStream>> m_streams{ m_arena };
+        std::shared_ptr<std::mutex> m_streamLock = std::make_shared<std::mutex>();
     };
 }
@@ -8,10 +8,13 @@
 #include "Exceptions.hpp"
 #include "ComHelper.hpp"
 #include "ZipObject.hpp"
+#include "PerformanceCounters.hpp"
+#include "DigestStream.hpp"
 
 #include <vector>
 #include <map>
 #include <memory>
+#include <unordered_set>
 #include <utility>
 
 #include <zlib.h>
@@ -26,16 +29,27 @@ class IZipWriter : public IUnknown
 #endif
 {
 public:
-    // Writes the lfh header to the stream and return the size of the header
-    virtual std::pair<std::uint32_t, MSIX::ComPtr<IStream>> PrepareToAddFile(const std::string& name, bool isCompressed) = 0;
+    // Starts the file with its lfh and returns the size of the header. The lfh is written with the first bytes of the
+    // file written to the returned stream, or by EndFile.
+    // Files are compressed unless compressionOption is APPX_COMPRESSION_OPTION_NONE. If isPrecompressed is true,
+    // the caller writes deflated data to the returned stream; otherwise the data is deflated by the stream.
+    virtual std::pair<std::uint32_t, MSIX::ComPtr<IStream>> PrepareToAddFile(const std::string& name, APPX_COMPRESSION_OPTION compressionOption, bool isPrecompressed) = 0;
 
-    // Ends the file, rewrites the LFH or writes data descriptor and adds an entry
-    // to the central directories map
+    // Ends the file, rewrites the LFH or writes data descriptor and adds its record
+    // to the central directory
     virtual void EndFile(std::uint32_t crc, std::uint64_t compressedSize, std::uint64_t uncompressedSize, bool forceDataDescriptor) = 0;
 
+    // Returns the offset in the zip file where the data of the file being added starts, right after its lfh.
+    virtual std::uint64_t GetCurrentFileOffset() = 0;
+
     // Ends zip file by writing the central directory records, zip64 locator,
     // zip64 end of central directory and the end of central directories.
     virtual void Close() = 0;
+
+    // The SHA256 of everything written before the central directory and of the central directory with the
+    // records after it, the AXPC and AXCD digests of a signature appended to the package. False unless the
+    // writer computes them and is closed.
+    virtual bool GetSigningDigests(MSIX::Sha256Digest& fileRecords, MSIX::Sha256Digest& centralDirectory) = 0;
 };
 MSIX_INTERFACE(IZipWriter, 0x350dd671,0x0c40,0x4cd7,0x9a,0x5b,0x27,0x45,0x6d,0x60,0x4b,0xd0);
 
@@ -46,17 +60,33 @@ namespace MSIX {
     public:
         ZipObjectWriter(const ComPtr<IStream>& stream);
 
+        // With isStreaming the output stream is only written forward through a buffer, so it doesn't need
+        // to support seeking. Every file gets a data descriptor instead of having its LFH rewritten.
+        // performanceCounters, when not null, count the deflating of the files. With signingDigests the bytes are
+        // hashed as they are written, so every file gets a data descriptor too.
+        ZipObjectWriter(const ComPtr<IStream>& stream, bool isStreaming, const std::shared_ptr<PerformanceCounters>& performanceCounters = nullptr,
+            bool signingDigests = false);
+
+        // Edits the zip file of storageObject, a ZipObjectReader over a stream that can be written and resized. Files
+        // are added after the last one and Close rewrites the central directory and truncates what was after it.
         ZipObjectWriter(const ComPtr<IStorageObject>& storageObject);
 
+        // Removes files from the zip file being edited, before any file is added. The records of the ones written
+        // last are overwritten by the files added next, the others stay where they are, unreferenced. Names that
+        // aren't in the zip file are ignored.
+        void RemoveFiles(const std::vector<std::string>& fileNames);
+
         // IStorage methods
         std::vector<std::string> GetFileNames(FileNameOptions options) override;
         ComPtr<IStream> GetFile(const std::string& fileName) override;
         std::string GetFileName() override { NOTIMPLEMENTED };
 
         // IZipWriter
-        std::pair<std::uint32_t, ComPtr<IStream>> PrepareToAddFile(const std::string& name, bool isCompressed) override;
+        std::pair<std::uint32_t, ComPtr<IStream>> PrepareToAddFile(const std::string& name, APPX_COMPRESSION_OPTION compressionOption, bool isPrecompressed) override;
         void EndFile(std::uint32_t crc, std::uint64_t compressedSize, std::uint64_t uncompressedSize, bool forceDataDescriptor) override;
+        std::uint64_t GetCurrentFileOffset() override;
         void Close() override;
+        bool GetSigningDigests(Sha256Digest& fileRecords, Sha256Digest& centralDirectory) override;
 
     protected:
         enum class State
@@ -66,7 +96,30 @@ namespace MSIX {
             Closed,
         };
 
+        // Moves the records of the zip file being edited, which RemoveFiles finds in m_centralDirectories, to
+        // m_centralDirectory. Does nothing once they are moved, or for a new zip file.
+        void MoveCentralDirectories();
+
+        // Writes the pending records, then the buffers, with one gathered write
+        void WriteWithPendingRecords(const StreamWriteBuffer* buffers, std::size_t count);
+
         State m_state = State::ReadyForLfhOrClose;
+        // The records of the central directory, in the order the files were added, written by Close at once
+        std::vector<std::uint8_t> m_centralDirectory;
+        std::size_t m_centralDirectoryCount = 0;
+        // Names of the files of m_centralDirectory, to find duplicates
+        std::unordered_set<std::string> m_fileNames;
+        bool m_isStreaming = false;
+        bool m_isEditing = false;
         std::pair<std::uint64_t, LocalFileHeader> m_lastLFH;
+        // Records that go where the stream is and aren't written yet, written with the next bytes so a small record
+        // doesn't cost a write of its own: the data descriptor of the last file, and the lfh of the file being added
+        // until its first bytes are written. Shared with the stream of the file being added.
+        std::shared_ptr<std::vector<std::uint8_t>> m_pendingRecords = std::make_shared<std::vector<std::uint8_t>>();
+        std::shared_ptr<PerformanceCounters> m_performanceCounters;
+        // Set when the signing digests are computed, in front of m_stream
+        ComPtr<DigestStream> m_digestStream;
+        Sha256Digest m_fileRecordsDigest;
+        Sha256Digest m_centralDirectoryDigest;
     };
 }
\ No newline at end of file
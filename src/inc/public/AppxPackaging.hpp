@@ -216,6 +216,16 @@ enum tagLOCKTYPE
         LOCK_ONLYONCE   = 4
     }   LOCKTYPE;
 
+typedef
+enum tagSTGC
+    {
+        STGC_DEFAULT    = 0,
+        STGC_OVERWRITE  = 1,
+        STGC_ONLYIFCURRENT  = 2,
+        STGC_DANGEROUSLYCOMMITMERELYTODISKCACHE = 4,
+        STGC_CONSOLIDATE    = 8
+    }   STGC;
+
     // {0000000c-0000-0000-C000-000000000046}
     MSIX_INTERFACE(IStream,0x0000000c,0x0000,0x0000,0xC0,0x00,0x00,0x00,0x00,0x00,0x00,0x46);
     interface IStream : public ISequentialStream
@@ -1200,6 +1210,22 @@ interface IMsixFactoryOverrides;
 interface IMsixStreamFactory;
 interface IMsixApplicabilityLanguagesEnumerator;
 interface IMsixPackageWriterFactory;
+interface IMsixRangeReader;
+interface IMsixSignatureCache;
+interface IMsixManifestCache;
+interface IMsixIntegrityCache;
+interface IMsixBufferAllocator;
+interface IMsixTask;
+interface IMsixTaskScheduler;
+interface IMsixProgressCallback;
+interface IMsixFileStatisticsCallback;
+interface IMsixCompletionCallback;
+interface IMsixOutputStreamFactory;
+interface IMsixPackageLayout;
+interface IMsixPackageSigningDigests;
+interface IMsixFileBlockReader;
+interface IMsixPackageWriterCopy;
+interface IMsixPackageWriterThreads;
 
 #ifndef __IMsixDocumentElement_INTERFACE_DEFINED__
 #define __IMsixDocumentElement_INTERFACE_DEFINED__
@@ -1273,8 +1299,40 @@ interface IMsixPackageWriterFactory;
     {
         MSIX_FACTORY_EXTENSION_STREAM_FACTORY = 0x1,
         MSIX_FACTORY_EXTENSION_APPLICABILITY_LANGUAGES = 0x2,
+        // IStream with PEM encoded certificates trusted as roots on top of the built in ones. Only used
+        // where signatures are validated with OpenSSL. Specifying it again reloads the trusted roots, an
+        // empty stream leaves only the built in ones.
+        MSIX_FACTORY_EXTENSION_TRUSTED_CERTIFICATES = 0x3,
+        // IMsixSignatureCache where the results of signature validations are kept, instead of the
+        // bounded in memory cache enabled by MSIX_FACTORY_OPTION_READER_CACHE_SIGNATURES.
+        MSIX_FACTORY_EXTENSION_SIGNATURE_CACHE = 0x4,
+        // IMsixBufferAllocator that provides the I/O buffers used to read and inflate files, instead of the
+        // buffers the factory pools from its allocator.
+        MSIX_FACTORY_EXTENSION_BUFFER_ALLOCATOR = 0x5,
+        // IMsixTaskScheduler that runs the parallel work of the factory, instead of the work-stealing threads
+        // the SDK shares between the factories of the process.
+        MSIX_FACTORY_EXTENSION_TASK_SCHEDULER = 0x6,
+        // IMsixProgressCallback told about the files unpacked and packed by the readers and writers of the
+        // factory, which can cancel them.
+        MSIX_FACTORY_EXTENSION_PROGRESS_CALLBACK = 0x7,
+        // IMsixOutputStreamFactory that gets the files unpacked by UnpackPackageFromPackageReader* and
+        // UnpackBundleFromBundleReader with readers of the factory, instead of writing them to the destination.
+        MSIX_FACTORY_EXTENSION_OUTPUT_STREAM_FACTORY = 0x8,
+        // IMsixManifestCache where package readers keep snapshots of the manifests they read, so a manifest seen
+        // before isn't parsed again.
+        MSIX_FACTORY_EXTENSION_MANIFEST_CACHE = 0x9,
+        // IMsixIntegrityCache where package readers record the payload files of local packages whose blocks all
+        // matched the block map, so they aren't hashed again while the package file is unchanged.
+        MSIX_FACTORY_EXTENSION_INTEGRITY_CACHE = 0xA,
+        // IMsixFileStatisticsCallback told what every file unpacked or packed by the readers and writers of the
+        // factory took, once it is done.
+        MSIX_FACTORY_EXTENSION_FILE_STATISTICS_CALLBACK = 0xB,
     } 	MSIX_FACTORY_EXTENSION;
 
+    // A factory is safe to share between threads: readers and writers can be created from it and used
+    // concurrently, each reader or writer object being used by one thread at a time. Extensions can be
+    // specified at any time and apply to the readers and writers created afterwards. The extensions
+    // themselves are called from whichever thread uses the factory, so they must be thread safe too.
     // {0acedbdb-57cd-4aca-8cee-33fa52394316}
     MSIX_INTERFACE(IMsixFactoryOverrides,0x0acedbdb,0x57cd,0x4aca,0x8c,0xee,0x33,0xfa,0x52,0x39,0x43,0x16);
     interface IMsixFactoryOverrides : public IUnknown
@@ -1326,6 +1384,397 @@ interface IMsixPackageWriterFactory;
     };
 #endif  /* __IMsixApplicabilityLanguagesEnumerator_INTERFACE_DEFINED__ */
 
+#ifndef __IMsixRangeReader_INTERFACE_DEFINED__
+#define __IMsixRangeReader_INTERFACE_DEFINED__
+
+    // Provides byte ranges of a package that isn't local, for example with HTTP range requests.
+    // ReadRange may be called from different threads, but never concurrently.
+    // {ca851bc3-9384-4f8c-8ada-425c5519771c}
+    MSIX_INTERFACE(IMsixRangeReader,0xca851bc3,0x9384,0x4f8c,0x8a,0xda,0x42,0x5c,0x55,0x19,0x77,0x1c);
+    interface IMsixRangeReader : public IUnknown
+    {
+    public:
+        virtual HRESULT STDMETHODCALLTYPE GetSize(
+            /* [retval][out] */ UINT64* size) noexcept = 0;
+
+        virtual HRESULT STDMETHODCALLTYPE ReadRange(
+            /* [in] */ UINT64 offset,
+            /* [in] */ UINT32 count,
+            /* [out] */ BYTE* buffer,
+            /* [retval][out] */ UINT32* bytesRead) noexcept = 0;
+    };
+#endif  /* __IMsixRangeReader_INTERFACE_DEFINED__ */
+
+#ifndef __IMsixSignatureCache_INTERFACE_DEFINED__
+#define __IMsixSignatureCache_INTERFACE_DEFINED__
+
+    // Keeps the results of signature validations, so a signature seen before isn't validated again. The key
+    // covers the signature, the validation options and the custom trusted roots. Entries are opaque and only
+    // valid for the version of the SDK that wrote them, an entry that can't be read is ignored. Methods may
+    // be called from different threads, concurrently.
+    // {3c5a0e9b-7d41-4e0f-a4d6-1b92f5c8e7a3}
+    MSIX_INTERFACE(IMsixSignatureCache,0x3c5a0e9b,0x7d41,0x4e0f,0xa4,0xd6,0x1b,0x92,0xf5,0xc8,0xe7,0xa3);
+    interface IMsixSignatureCache : public IUnknown
+    {
+    public:
+        // Sets entry to a stream over the entry kept for key, or to nullptr when there is none.
+        virtual HRESULT STDMETHODCALLTYPE GetEntry(
+            /* [in] */ LPCSTR key,
+            /* [retval][out] */ IStream** entry) noexcept = 0;
+
+        // entry is only valid during the call.
+        virtual HRESULT STDMETHODCALLTYPE AddEntry(
+            /* [in] */ LPCSTR key,
+            /* [in] */ IStream* entry) noexcept = 0;
+    };
+#endif  /* __IMsixSignatureCache_INTERFACE_DEFINED__ */
+
+#ifndef __IMsixManifestCache_INTERFACE_DEFINED__
+#define __IMsixManifestCache_INTERFACE_DEFINED__
+
+    // Keeps snapshots of the AppxManifest.xml read by package readers: the values their manifest readers give
+    // out, without the xml. The key is the hashes of the blocks of the manifest in the block map, in hexadecimal,
+    // which for almost every manifest is the hash of its only block. A reader created from a snapshot parses the
+    // manifest only if its document element is asked for. Entries are opaque and only valid for the version of
+    // the SDK that wrote them, an entry that can't be read is ignored. Methods may be called from different
+    // threads, concurrently.
+    // {6e0c4a2d-93b7-4f51-8a1e-5d27c0b9f468}
+    MSIX_INTERFACE(IMsixManifestCache,0x6e0c4a2d,0x93b7,0x4f51,0x8a,0x1e,0x5d,0x27,0xc0,0xb9,0xf4,0x68);
+    interface IMsixManifestCache : public IUnknown
+    {
+    public:
+        // Sets entry to a stream over the entry kept for key, or to nullptr when there is none.
+        virtual HRESULT STDMETHODCALLTYPE GetEntry(
+            /* [in] */ LPCSTR key,
+            /* [retval][out] */ IStream** entry) noexcept = 0;
+
+        // entry is only valid during the call.
+        virtual HRESULT STDMETHODCALLTYPE AddEntry(
+            /* [in] */ LPCSTR key,
+            /* [in] */ IStream* entry) noexcept = 0;
+    };
+#endif  /* __IMsixManifestCache_INTERFACE_DEFINED__ */
+
+#ifndef __IMsixIntegrityCache_INTERFACE_DEFINED__
+#define __IMsixIntegrityCache_INTERFACE_DEFINED__
+
+    // Keeps the names of the payload files of a package that were read or verified once, every block matching
+    // the block map, so later readers of the same package read them without hashing their blocks. Only packages
+    // read from a local file are recorded. The key is a hash, in hexadecimal, of what identifies that file (its
+    // volume and file number, size and modification and change times) and of the block map of the package,
+    // so an entry stops being used as soon as the file is written to or replaced. Whoever can change a package
+    // while keeping all of those, or can write the entries, can get changed files read without errors: hosts
+    // should only specify a cache they trust as much as the packages. Entries are opaque and only valid for the
+    // version of the SDK that wrote them, an entry that can't be read is ignored. Methods may be called from
+    // different threads, concurrently.
+    // {b7d0e3a5-2c1f-4e86-9a4b-6f35d8c1e072}
+    MSIX_INTERFACE(IMsixIntegrityCache,0xb7d0e3a5,0x2c1f,0x4e86,0x9a,0x4b,0x6f,0x35,0xd8,0xc1,0xe0,0x72);
+    interface IMsixIntegrityCache : public IUnknown
+    {
+    public:
+        // Sets entry to a stream over the entry kept for key, or to nullptr when there is none.
+        virtual HRESULT STDMETHODCALLTYPE GetEntry(
+            /* [in] */ LPCSTR key,
+            /* [retval][out] */ IStream** entry) noexcept = 0;
+
+        // Replaces the entry kept for key. entry is only valid during the call.
+        virtual HRESULT STDMETHODCALLTYPE AddEntry(
+            /* [in] */ LPCSTR key,
+            /* [in] */ IStream* entry) noexcept = 0;
+    };
+#endif  /* __IMsixIntegrityCache_INTERFACE_DEFINED__ */
+
+#ifndef __IMsixBufferAllocator_INTERFACE_DEFINED__
+#define __IMsixBufferAllocator_INTERFACE_DEFINED__
+
+    // Provides the I/O buffers of a factory, for hosts that cap or pool the memory the SDK uses. Buffers are
+    // mostly 32 KB to 1 MB. A buffer may be freed after the factory is released, and methods may be called
+    // from different threads, concurrently.
+    // {9b2e6d47-3f18-4c0a-b85e-2d7a41c9f036}
+    MSIX_INTERFACE(IMsixBufferAllocator,0x9b2e6d47,0x3f18,0x4c0a,0xb8,0x5e,0x2d,0x7a,0x41,0xc9,0xf0,0x36);
+    interface IMsixBufferAllocator : public IUnknown
+    {
+    public:
+        // Sets buffer to at least size bytes.
+        virtual HRESULT STDMETHODCALLTYPE AllocateBuffer(
+            /* [in] */ UINT32 size,
+            /* [retval][out] */ BYTE** buffer) noexcept = 0;
+
+        // Called once for every buffer returned by AllocateBuffer, with the size it was requested with.
+        virtual void STDMETHODCALLTYPE FreeBuffer(
+            /* [in] */ BYTE* buffer,
+            /* [in] */ UINT32 size) noexcept = 0;
+    };
+#endif  /* __IMsixBufferAllocator_INTERFACE_DEFINED__ */
+
+#ifndef __IMsixTask_INTERFACE_DEFINED__
+#define __IMsixTask_INTERFACE_DEFINED__
+
+    // Work the SDK hands to an IMsixTaskScheduler.
+    // {616fb661-75fc-4702-87cf-db53d31533ca}
+    MSIX_INTERFACE(IMsixTask,0x616fb661,0x75fc,0x4702,0x87,0xcf,0xdb,0x53,0xd3,0x15,0x33,0xca);
+    interface IMsixTask : public IUnknown
+    {
+    public:
+        // Runs the work. Returns right away if it already ran, the SDK runs work it waits for itself when no
+        // thread of the scheduler has started it yet.
+        virtual void STDMETHODCALLTYPE Run() noexcept = 0;
+    };
+#endif  /* __IMsixTask_INTERFACE_DEFINED__ */
+
+#ifndef __IMsixTaskScheduler_INTERFACE_DEFINED__
+#define __IMsixTaskScheduler_INTERFACE_DEFINED__
+
+    // Executor of a host, for hosts that run the parallel work of the SDK on their own threads. Tasks may be
+    // run in any order, on any thread, and methods may be called from different threads, concurrently.
+    // {d4ec0cdd-544f-4583-976c-3a8ac614aefc}
+    MSIX_INTERFACE(IMsixTaskScheduler,0xd4ec0cdd,0x544f,0x4583,0x97,0x6c,0x3a,0x8a,0xc6,0x14,0xae,0xfc);
+    interface IMsixTaskScheduler : public IUnknown
+    {
+    public:
+        // How many tasks the scheduler runs at the same time. The SDK splits its work in as many parts.
+        virtual HRESULT STDMETHODCALLTYPE GetConcurrency(
+            /* [retval][out] */ UINT32* concurrency) noexcept = 0;
+
+        // Runs task later. The scheduler keeps a reference to the task until it has run.
+        virtual HRESULT STDMETHODCALLTYPE Schedule(
+            /* [in] */ IMsixTask* task) noexcept = 0;
+    };
+#endif  /* __IMsixTaskScheduler_INTERFACE_DEFINED__ */
+
+#ifndef __IMsixProgressCallback_INTERFACE_DEFINED__
+#define __IMsixProgressCallback_INTERFACE_DEFINED__
+
+    // Told about the progress of unpacking and packing, as often as every block of a file. Calls are never
+    // concurrent, but may come from different threads. The totals grow as work is discovered, for example as
+    // the packages of a bundle are unpacked, and sum up every operation of the factory until a callback is
+    // specified again.
+    // {7d2bee1e-f026-4234-8369-2c36ac137ae1}
+    MSIX_INTERFACE(IMsixProgressCallback,0x7d2bee1e,0xf026,0x4234,0x83,0x69,0x2c,0x36,0xac,0x13,0x7a,0xe1);
+    interface IMsixProgressCallback : public IUnknown
+    {
+    public:
+        // Setting cancel to TRUE, or failing, stops the operation, which then fails with
+        // MSIX::Error::Cancelled, and so does any later one of the factory. Files extracted so far are left
+        // in place.
+        virtual HRESULT STDMETHODCALLTYPE OnProgress(
+            /* [in] */ UINT64 bytesCompleted,
+            /* [in] */ UINT64 bytesTotal,
+            /* [in] */ UINT32 filesCompleted,
+            /* [in] */ UINT32 filesTotal,
+            /* [retval][out] */ BOOL* cancel) noexcept = 0;
+    };
+#endif  /* __IMsixProgressCallback_INTERFACE_DEFINED__ */
+
+#ifndef __IMsixFileStatisticsCallback_INTERFACE_DEFINED__
+#define __IMsixFileStatisticsCallback_INTERFACE_DEFINED__
+
+    // What it took to unpack or pack a file. Times are summed over the threads that worked on the file, and a
+    // stage doesn't include the ones done within it: reading a compressed file doesn't count the inflating and
+    // hashing of the bytes read. Work done for several files at once, like hashing a batch of small files, isn't
+    // counted in any of them.
+    typedef struct MSIX_FILE_STATISTICS
+    {
+        LPCSTR utf8Name;            // Name of the file in the package, with '/' separators
+        BOOL packed;                // TRUE when the file was added to a package, FALSE when it was extracted
+        UINT64 size;                // Bytes of the file
+        UINT64 compressedSize;      // Bytes of the file in the package, size when it is stored
+        UINT32 blockCount;          // Blocks of the file in the block map, 0 for footprint files
+        UINT64 readNanoseconds;     // Reading the file, from the package when extracted or from its stream when packed
+        UINT64 inflateNanoseconds;
+        UINT64 deflateNanoseconds;
+        UINT64 hashNanoseconds;     // Hashing its blocks, against the block map or for it
+        UINT64 writeNanoseconds;    // Creating and writing the extracted file, or writing the file to the package
+    }   MSIX_FILE_STATISTICS;
+
+    // Told about every file unpacked or packed, see MSIX_FACTORY_EXTENSION_FILE_STATISTICS_CALLBACK. Files that
+    // fail aren't reported, nor are the ones an unpack doesn't extract, like targets left as they were and files
+    // linked from the block store. Called on the thread that finished the file, possibly concurrently when files
+    // are extracted in parallel.
+    // {5c3e8a1d-94b2-4f6e-8d07-a1c46e9b3f25}
+    MSIX_INTERFACE(IMsixFileStatisticsCallback,0x5c3e8a1d,0x94b2,0x4f6e,0x8d,0x07,0xa1,0xc4,0x6e,0x9b,0x3f,0x25);
+    interface IMsixFileStatisticsCallback : public IUnknown
+    {
+    public:
+        // statistics is only valid during the call.
+        virtual void STDMETHODCALLTYPE OnFile(
+            /* [in] */ const MSIX_FILE_STATISTICS* statistics) noexcept = 0;
+    };
+#endif  /* __IMsixFileStatisticsCallback_INTERFACE_DEFINED__ */
+
+#ifndef __IMsixCompletionCallback_INTERFACE_DEFINED__
+#define __IMsixCompletionCallback_INTERFACE_DEFINED__
+
+    // Told once an asynchronous operation, like UnpackPackageAsync, is done. It is called on a thread of the pool
+    // that ran the operation, which can start other operations but shouldn't wait for them there.
+    // {3f9a6c1e-52d8-4b07-a4e3-8c61d05f2b97}
+    MSIX_INTERFACE(IMsixCompletionCallback,0x3f9a6c1e,0x52d8,0x4b07,0xa4,0xe3,0x8c,0x61,0xd0,0x5f,0x2b,0x97);
+    interface IMsixCompletionCallback : public IUnknown
+    {
+    public:
+        // status is what the synchronous version of the operation would have returned. result is the object
+        // it created, like the IAppxPackageReader of CreatePackageReaderAsync, or null. Take a reference to
+        // keep it.
+        virtual void STDMETHODCALLTYPE OnComplete(
+            /* [in] */ HRESULT status,
+            /* [in] */ IUnknown* result) noexcept = 0;
+    };
+#endif  /* __IMsixCompletionCallback_INTERFACE_DEFINED__ */
+
+#ifndef __IMsixOutputStreamFactory_INTERFACE_DEFINED__
+#define __IMsixOutputStreamFactory_INTERFACE_DEFINED__
+
+    // Takes the files of an unpack in place of the file system, see MSIX_FACTORY_EXTENSION_OUTPUT_STREAM_FACTORY.
+    // The destination of the unpack isn't used, not even created. Streams may be created from several threads at
+    // once when the files are extracted in parallel, each stream is written by one thread at a time.
+    // {0b2bed17-293a-4cf0-b37c-7915f2e18b8a}
+    MSIX_INTERFACE(IMsixOutputStreamFactory,0x0b2bed17,0x293a,0x4cf0,0xb3,0x7c,0x79,0x15,0xf2,0xe1,0x8b,0x8a);
+    interface IMsixOutputStreamFactory : public IUnknown
+    {
+    public:
+        // Stream the file at utf8RelativePath, with '/' separators and relative to the destination, is written to.
+        // size is the size the file has once written. The stream is committed when the file is complete.
+        virtual HRESULT STDMETHODCALLTYPE CreateOutputStream(
+            /* [in] */ LPCSTR utf8RelativePath,
+            /* [in] */ UINT64 size,
+            /* [retval][out] */ IStream** stream) noexcept = 0;
+    };
+#endif  /* __IMsixOutputStreamFactory_INTERFACE_DEFINED__ */
+
+#ifndef __IMsixPackageLayout_INTERFACE_DEFINED__
+#define __IMsixPackageLayout_INTERFACE_DEFINED__
+
+    // Bytes of a package file, from offset
+    typedef struct MSIX_BYTE_RANGE
+    {
+        UINT64 offset;
+        UINT64 length;
+    }   MSIX_BYTE_RANGE;
+
+    // Where the records of a package are in its file, for clients that download the blocks of a package they
+    // don't have with range requests. Got from a package or bundle reader with QueryInterface. File names are
+    // the names of the block map, '/' and '\\' are both separators. The ranges aren't validated against the
+    // signature, the blocks downloaded are checked against their hash in the block map.
+    // {198c691e-f044-481e-8b0e-5d6eeb94e8d9}
+    MSIX_INTERFACE(IMsixPackageLayout,0x198c691e,0xf044,0x481e,0x8b,0x0e,0x5d,0x6e,0xeb,0x94,0xe8,0xd9);
+    interface IMsixPackageLayout : public IUnknown
+    {
+    public:
+        // The local file header, the stored bytes and the data descriptor of a file of the package, footprint files
+        // included. The data descriptor is empty, right after the stored bytes, when the file doesn't have one.
+        virtual HRESULT STDMETHODCALLTYPE GetFileRanges(
+            /* [in] */ LPCSTR utf8FileName,
+            /* [out] */ MSIX_BYTE_RANGE* localFileHeader,
+            /* [out] */ MSIX_BYTE_RANGE* data,
+            /* [out] */ MSIX_BYTE_RANGE* dataDescriptor) noexcept = 0;
+
+        // Number of blocks of a file of the block map.
+        virtual HRESULT STDMETHODCALLTYPE GetBlockCount(
+            /* [in] */ LPCSTR utf8FileName,
+            /* [retval][out] */ UINT32* count) noexcept = 0;
+
+        // The stored bytes of a block of a file of the block map, the deflated bytes if the file is compressed.
+        virtual HRESULT STDMETHODCALLTYPE GetBlockRange(
+            /* [in] */ LPCSTR utf8FileName,
+            /* [in] */ UINT32 blockIndex,
+            /* [retval][out] */ MSIX_BYTE_RANGE* range) noexcept = 0;
+
+        // The central directory and the end of central directory records, up to the end of the package.
+        virtual HRESULT STDMETHODCALLTYPE GetCentralDirectoryRange(
+            /* [retval][out] */ MSIX_BYTE_RANGE* range) noexcept = 0;
+    };
+#endif  /* __IMsixPackageLayout_INTERFACE_DEFINED__ */
+
+#ifndef __IMsixPackageSigningDigests_INTERFACE_DEFINED__
+#define __IMsixPackageSigningDigests_INTERFACE_DEFINED__
+
+    // What a signature of a package signs, computed by the package writer as it writes the package, so signing
+    // doesn't need to read it again. Got from the package writer of a factory created with
+    // MSIX_FACTORY_OPTION_WRITER_SIGNING_DIGESTS with QueryInterface.
+    // {a4223e45-97ed-4ae5-8825-41f5c0b20c9b}
+    MSIX_INTERFACE(IMsixPackageSigningDigests,0xa4223e45,0x97ed,0x4ae5,0x88,0x25,0x41,0xf5,0xc0,0xb2,0x0c,0x9b);
+    interface IMsixPackageSigningDigests : public IUnknown
+    {
+    public:
+        // Once the writer is closed, the digest of the SpcIndirectDataContent of AppxSignature.p7x: "APPX" followed
+        // by the AXPC, AXCD, AXCT and AXBM SHA256 digests, each after its name, for the signature added as the last
+        // file of the package. Fails with InvalidState before the writer is closed.
+        virtual HRESULT STDMETHODCALLTYPE GetSigningDigests(
+            /* [out] */ UINT32* digestsSize,
+            /* [retval][size_is][size_is][out] */ BYTE** digests) noexcept = 0;
+    };
+#endif  /* __IMsixPackageSigningDigests_INTERFACE_DEFINED__ */
+
+#ifndef __IMsixFileBlockReader_INTERFACE_DEFINED__
+#define __IMsixFileBlockReader_INTERFACE_DEFINED__
+
+    // Random access to a payload file of a package, from its IAppxFile with QueryInterface. A read only reads the
+    // blocks of the block map that hold the bytes asked for, straight from the package: each is inflated on its
+    // own and validated against its hash, nothing before it is. Every block is 65536 bytes but the last one. Files
+    // that aren't read from a zip file or aren't in the block map, like the footprint files, fail with NotSupported.
+    // Methods may be called from different threads, concurrently.
+    // {6e0c4b9a-2f17-4d83-b5e1-9a7c3d8f0b24}
+    MSIX_INTERFACE(IMsixFileBlockReader,0x6e0c4b9a,0x2f17,0x4d83,0xb5,0xe1,0x9a,0x7c,0x3d,0x8f,0x0b,0x24);
+    interface IMsixFileBlockReader : public IUnknown
+    {
+    public:
+        virtual HRESULT STDMETHODCALLTYPE GetBlockCount(
+            /* [retval][out] */ UINT32* blockCount) noexcept = 0;
+
+        // buffer must hold the whole block, bufferSize is checked against its size
+        virtual HRESULT STDMETHODCALLTYPE ReadBlock(
+            /* [in] */ UINT32 index,
+            /* [in] */ UINT32 bufferSize,
+            /* [out] */ BYTE* buffer,
+            /* [retval][out] */ UINT32* bytesRead) noexcept = 0;
+
+        // Reads fewer than count bytes only at the end of the file
+        virtual HRESULT STDMETHODCALLTYPE ReadRange(
+            /* [in] */ UINT64 offset,
+            /* [in] */ UINT32 count,
+            /* [out] */ BYTE* buffer,
+            /* [retval][out] */ UINT32* bytesRead) noexcept = 0;
+    };
+#endif  /* __IMsixFileBlockReader_INTERFACE_DEFINED__ */
+
+#ifndef __IMsixPackageWriterCopy_INTERFACE_DEFINED__
+#define __IMsixPackageWriterCopy_INTERFACE_DEFINED__
+
+    // Adds payload files of another package to a package as they are stored in it, for repacking a package with a
+    // few files changed. Got from a package writer with QueryInterface.
+    // {c27d2988-fa05-4e61-95ec-d4b92ab1f722}
+    MSIX_INTERFACE(IMsixPackageWriterCopy,0xc27d2988,0xfa05,0x4e61,0x95,0xec,0xd4,0xb9,0x2a,0xb1,0xf7,0x22);
+    interface IMsixPackageWriterCopy : public IUnknown
+    {
+    public:
+        // Adds the payload file utf8FileName of the package of reader with the same name. Its stored bytes, deflated
+        // or not, are copied with its blocks: each block is inflated only to be checked against its hash in the block
+        // map of reader, and the file fails with SignatureInvalid, like reading it would, if one doesn't match. The content type is the one
+        // of its extension. reader must read a package from a zip file, bundles aren't supported.
+        virtual HRESULT STDMETHODCALLTYPE AddPayloadFileFromPackage(
+            /* [in] */ IAppxPackageReader* reader,
+            /* [in] */ LPCSTR utf8FileName) noexcept = 0;
+    };
+#endif  /* __IMsixPackageWriterCopy_INTERFACE_DEFINED__ */
+
+#ifndef __IMsixPackageWriterThreads_INTERFACE_DEFINED__
+#define __IMsixPackageWriterThreads_INTERFACE_DEFINED__
+
+    // Lets AddPayloadFiles of IAppxPackageWriter3 deflate and hash payload files on a pool of worker threads, by
+    // default they are all compressed on the calling thread. Got from a package writer with QueryInterface.
+    // {5d1e7f3a-8b62-4c09-a4d7-2e9f6b0c8a31}
+    MSIX_INTERFACE(IMsixPackageWriterThreads,0x5d1e7f3a,0x8b62,0x4c09,0xa4,0xd7,0x2e,0x9f,0x6b,0x0c,0x8a,0x31);
+    interface IMsixPackageWriterThreads : public IUnknown
+    {
+    public:
+        // The next calls to AddPayloadFiles compress with up to threadCount threads, 0 means all the hardware threads
+        // and 1 the calling thread only. Their memoryLimit bounds the data the threads hold at a time, small files are
+        // only compressed together under a non zero one.
+        virtual HRESULT STDMETHODCALLTYPE SetCompressionThreadCount(
+            /* [in] */ UINT32 threadCount) noexcept = 0;
+    };
+#endif  /* __IMsixPackageWriterThreads_INTERFACE_DEFINED__ */
+
 // Specific to MSIX SDK. UTF8 variant of AppxPackaging interfaces
 interface IAppxBlockMapFileUtf8;
 interface IAppxBlockMapReaderUtf8;
@@ -1661,6 +2110,17 @@ enum MSIX_VALIDATION_OPTION
                                                                   // no schema validation is done, but it needs to be
                                                                   // valid xml.
         MSIX_VALIDATION_OPTION_SKIPPACKAGEVALIDATION       = 0x8,
+        MSIX_VALIDATION_OPTION_DEFERLOCALFILEHEADERS       = 0x10, // Trust the zip central directory to open files. The local
+                                                                   // file header of a file is read and validated on its
+                                                                   // first read.
+        MSIX_VALIDATION_OPTION_SKIPMANIFESTSCHEMAIFTRUSTED = 0x20, // If the signature of the package validates and chains to a
+                                                                   // trusted root, AppxManifest.xml and AppxBundleManifest.xml
+                                                                   // are not validated against their schemas. They still need
+                                                                   // to be valid xml and the semantic checks are still done.
+        MSIX_VALIDATION_OPTION_TRUSTPACKAGEINDEX           = 0x40, // Use the index given to CreatePackageReaderWithIndex. Its
+                                                                   // blocks and manifest values are not checked against the
+                                                                   // block map, whoever can write the index can change them.
+                                                                   // Without it, the index is ignored.
     }   MSIX_VALIDATION_OPTION;
 
 typedef /* [v1_enum] */
@@ -1668,7 +2128,14 @@ enum MSIX_PACKUNPACK_OPTION
     {
         MSIX_PACKUNPACK_OPTION_NONE                    = 0x0,
         MSIX_PACKUNPACK_OPTION_CREATEPACKAGESUBFOLDER  = 0x1,
-        MSIX_PACKUNPACK_OPTION_UNPACKWITHFLATSTRUCTURE = 0x2
+        MSIX_PACKUNPACK_OPTION_UNPACKWITHFLATSTRUCTURE = 0x2,
+        MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION      = 0x4, // Extract payload files on a pool of worker threads.
+        MSIX_PACKUNPACK_OPTION_PARALLELCOMPRESSION     = 0x8, // Compress and hash payload blocks on a pool of worker threads.
+        MSIX_PACKUNPACK_OPTION_ADAPTIVECOMPRESSION     = 0x10, // Store payload files whose first block doesn't compress well.
+        MSIX_PACKUNPACK_OPTION_SKIPUNCHANGED           = 0x20, // Leave payload files already unpacked whose blocks match the block map.
+        MSIX_PACKUNPACK_OPTION_COMPACTZIPRECORDS       = 0x40, // Write file sizes in the local file headers instead of data descriptors.
+        MSIX_PACKUNPACK_OPTION_REUSEDUPLICATES         = 0x80, // Deflate payload files with the same content once and copy the result.
+        MSIX_PACKUNPACK_OPTION_PACKAGESASFILES         = 0x100, // Write the applicable packages of a bundle as package files instead of unpacking them.
     }   MSIX_PACKUNPACK_OPTION;
 
 typedef /* [v1_enum] */
@@ -1704,6 +2171,8 @@ enum MSIX_BUNDLE_OPTIONS
         MSIX_OPTION_VERSION = 0x8,
         MSIX_BUNDLE_OPTION_FLATBUNDLE = 0x10,
         MSIX_BUNDLE_OPTION_BUNDLEMANIFESTONLY = 0x20,
+        MSIX_BUNDLE_OPTION_READMANIFESTS = 0x40,  // See MSIX_FACTORY_OPTION_WRITER_BUNDLE_READ_MANIFESTS
+        MSIX_BUNDLE_OPTION_VALIDATEPACKAGES = 0x80,  // See MSIX_FACTORY_OPTION_WRITER_BUNDLE_VALIDATE_PACKAGES
     }   MSIX_BUNDLE_OPTIONS;
 
 typedef /* [v1_enum] */
@@ -1711,8 +2180,72 @@ enum MSIX_FACTORY_OPTIONS
 {
     MSIX_FACTORY_OPTION_NONE = 0x0,
     MSIX_FACTORY_OPTION_WRITER_ENABLE_FILE_HASH = 0x1,  // The package writer will compute full file hash and add <FileHash> element in block map xml
+    MSIX_FACTORY_OPTION_READER_DEFER_PAYLOAD_FILES = 0x2,  // The package reader only opens and validates a payload file against the block map
+                                                           // when it is first requested, instead of for every file when the reader is created
+    MSIX_FACTORY_OPTION_WRITER_STREAMING_OUTPUT = 0x4,  // The package and bundle writers only write forward to the output stream, with large buffered
+                                                        // writes and data descriptors for every file, so the output stream doesn't need to seek
+    MSIX_FACTORY_OPTION_READER_DEFER_BUNDLE_PACKAGES = 0x8,  // The bundle reader only opens and validates the packages selected by applicability when the
+                                                             // bundle is opened. Any other package is validated when it is first requested
+    MSIX_FACTORY_OPTION_READER_CACHE_SIGNATURES = 0x10,  // The package reader keeps the results of the last signature validations in memory, and
+                                                         // doesn't validate the same signature again with the same validation options
+    MSIX_FACTORY_OPTION_PERFORMANCE_COUNTERS = 0x20,  // The factory counts the calls, bytes and time of the stages of its unpacks and packs,
+                                                      // see MsixGetPerformanceCounters
+    MSIX_FACTORY_OPTION_WRITER_SIGNING_DIGESTS = 0x40,  // The package writer adds the content type of AppxSignature.p7x, gives every file a data
+                                                        // descriptor and hashes the package as it writes it, see IMsixPackageSigningDigests
+    MSIX_FACTORY_OPTION_READER_RELEASE_MANIFEST_DOM = 0x80,  // The package and manifest readers keep what they read from AppxManifest.xml in compact
+                                                             // form and release its parsed document, which IMsixDocumentElement parses again if asked
+    MSIX_FACTORY_OPTION_WRITER_BUNDLE_READ_MANIFESTS = 0x100,  // The bundle writer only reads the central directory and AppxManifest.xml of the packages
+                                                               // it adds. The packages aren't validated against their block maps and signatures
+    MSIX_FACTORY_OPTION_WRITER_BUNDLE_VALIDATE_PACKAGES = 0x200,  // With MSIX_FACTORY_OPTION_WRITER_BUNDLE_READ_MANIFESTS, the bundle writer still validates
+                                                                  // the packages like a package reader, in parallel before any of them is added
 }   MSIX_FACTORY_OPTIONS;
 
+typedef /* [v1_enum] */
+enum MSIX_PERFORMANCE_COUNTER_STAGE
+{
+    MSIX_PERFORMANCE_COUNTER_STAGE_INFLATE = 0,   // Inflating files, bytes are the inflated bytes
+    MSIX_PERFORMANCE_COUNTER_STAGE_HASH = 1,      // Hashing footprint files to validate them against the signature, and the blocks of payload
+                                                  // files read from their streams against the block map, bytes are the hashed bytes
+    MSIX_PERFORMANCE_COUNTER_STAGE_DEFLATE = 2,   // Deflating files, bytes are the bytes given to deflate
+    MSIX_PERFORMANCE_COUNTER_STAGE_BLOCKMAP = 3,  // Hashing blocks and adding them to the block map being written, bytes are the block bytes
+    MSIX_PERFORMANCE_COUNTER_STAGE_OPENFILE = 4,  // Creating the files and directories an unpack writes to, bytes are always 0
+    MSIX_PERFORMANCE_COUNTER_STAGE_XML = 5,       // Parsing xml files into a DOM, bytes are always 0
+    MSIX_PERFORMANCE_COUNTER_STAGE_BLOCKCACHE_HIT = 6,   // Blocks IMsixFileBlockReader found in the block cache, see MsixSetBlockCache, bytes are
+                                                         // the block bytes
+    MSIX_PERFORMANCE_COUNTER_STAGE_BLOCKCACHE_MISS = 7,  // Blocks IMsixFileBlockReader looked for in the block cache and read from the package
+                                                         // instead, bytes are the block bytes
+    MSIX_PERFORMANCE_COUNTER_STAGE_COUNT = 8,
+}   MSIX_PERFORMANCE_COUNTER_STAGE;
+
+typedef struct MSIX_PERFORMANCE_COUNTER
+{
+    UINT64 calls;
+    UINT64 bytes;
+    UINT64 nanoseconds;
+}   MSIX_PERFORMANCE_COUNTER;
+
+// Indexed by MSIX_PERFORMANCE_COUNTER_STAGE. The time of a stage is summed over all the threads that ran it.
+typedef struct MSIX_PERFORMANCE_COUNTERS
+{
+    MSIX_PERFORMANCE_COUNTER stages[MSIX_PERFORMANCE_COUNTER_STAGE_COUNT];
+}   MSIX_PERFORMANCE_COUNTERS;
+
+typedef /* [v1_enum] */
+enum MSIX_CONTAINER_FORMAT
+{
+    MSIX_CONTAINER_FORMAT_UNKNOWN = 0,   // Neither a zip file with a manifest nor xml
+    MSIX_CONTAINER_FORMAT_PACKAGE = 1,   // A zip file with AppxManifest.xml
+    MSIX_CONTAINER_FORMAT_BUNDLE = 2,    // A zip file with AppxMetadata/AppxBundleManifest.xml
+    MSIX_CONTAINER_FORMAT_MANIFEST = 3,  // Xml, like a manifest on its own. What document it is isn't checked.
+}   MSIX_CONTAINER_FORMAT;
+
+typedef /* [v1_enum] */
+enum MSIX_TAR_COMPRESSION
+{
+    MSIX_TAR_COMPRESSION_NONE = 0,
+    MSIX_TAR_COMPRESSION_GZIP = 1,   // Requires a build with MSIX_PACK
+}   MSIX_TAR_COMPRESSION;
+
 #define MSIX_PLATFORM_ALL MSIX_PLATFORM_WINDOWS10      | \
                           MSIX_PLATFORM_WINDOWS10      | \
                           MSIX_PLATFORM_WINDOWS8       | \
@@ -1741,6 +2274,17 @@ MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageFromPackageReader(
     char* utf8Destination
 ) noexcept;
 
+// Same as UnpackPackageFromPackageReader, with the threadCount of UnpackPackageWithThreadCount. progress,
+// which can be null, is told about the files extracted by this call only and can cancel it, see
+// IMsixProgressCallback. The progress callback of the factory of the reader, if any, isn't told.
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageFromPackageReaderWithProgress(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    IAppxPackageReader* packageReader,
+    char* utf8Destination,
+    UINT32 threadCount,
+    IMsixProgressCallback* progress
+) noexcept;
+
 MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageFromStream(
     MSIX_PACKUNPACK_OPTION packUnpackOptions,
     MSIX_VALIDATION_OPTION validationOption,
@@ -1748,6 +2292,179 @@ MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageFromStream(
     char* utf8Destination
 ) noexcept;
 
+// Same as UnpackPackage and UnpackPackageFromStream. If MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION is
+// specified, threadCount is the maximum number of worker threads used to extract the payload files.
+// A threadCount of 0 uses the number of hardware threads available.
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageWithThreadCount(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8SourcePackage,
+    char* utf8Destination,
+    UINT32 threadCount
+) noexcept;
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageFromStreamWithThreadCount(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    IStream* stream,
+    char* utf8Destination,
+    UINT32 threadCount
+) noexcept;
+
+// Same as UnpackPackageWithThreadCount and UnpackPackageFromStreamWithThreadCount. progress, which can be null,
+// is told about the files extracted and can cancel the unpack, see IMsixProgressCallback.
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageWithProgress(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8SourcePackage,
+    char* utf8Destination,
+    UINT32 threadCount,
+    IMsixProgressCallback* progress
+) noexcept;
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageFromStreamWithProgress(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    IStream* stream,
+    char* utf8Destination,
+    UINT32 threadCount,
+    IMsixProgressCallback* progress
+) noexcept;
+
+// Same as UnpackPackageWithProgress, but returns once the unpack is started on the worker threads of the process.
+// completion, which can't be null, is told how it went, see IMsixCompletionCallback. The strings are copied, so they
+// can be freed right away. Fails without calling completion when the unpack can't be started.
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageAsync(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8SourcePackage,
+    char* utf8Destination,
+    UINT32 threadCount,
+    IMsixProgressCallback* progress,
+    IMsixCompletionCallback* completion
+) noexcept;
+
+// Same as UnpackPackageWithProgress and UnpackPackageFromStreamWithProgress, only extracting the files whose names
+// match one of the includeCount includePatterns, or all of them when includeCount is 0, and none of the excludeCount
+// excludePatterns. The other files aren't read, the footprint files are still read to validate the package. Patterns
+// are matched against the names of the files in the package, with '/' separators and ignoring case. '*' and '?'
+// match any characters and any character but '/', "**" matches across directories, like "Assets/**" or
+// "**/*.png". A pattern without '/' is matched against the last part of the names, so "*.pri" matches in any
+// directory.
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageWithFilter(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8SourcePackage,
+    char* utf8Destination,
+    UINT32 threadCount,
+    IMsixProgressCallback* progress,
+    UINT32 includeCount,
+    char** includePatterns,
+    UINT32 excludeCount,
+    char** excludePatterns
+) noexcept;
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageFromStreamWithFilter(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    IStream* stream,
+    char* utf8Destination,
+    UINT32 threadCount,
+    IMsixProgressCallback* progress,
+    UINT32 includeCount,
+    char** includePatterns,
+    UINT32 excludeCount,
+    char** excludePatterns
+) noexcept;
+
+// Same as UnpackPackageFromStreamWithProgress for a stream that can only be read in order, like a pipe. The stream
+// is read once, front to back, and never seeked. The payload files are extracted while the package arrives, to
+// provisional files next to their targets with a ".partial" suffix, and the package is spooled to memory and then
+// to a temporary file. Once it is read to the end, the package is validated from the spool, the provisional files
+// become the payload files if they match the block map and whatever is missing or different is extracted from the
+// spool. No provisional file is left behind if the call fails. Bundles aren't supported.
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageFromSequentialStream(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    IStream* stream,
+    char* utf8Destination,
+    UINT32 threadCount,
+    IMsixProgressCallback* progress
+) noexcept;
+
+// Same as UnpackPackageFromStreamWithProgress, writing the files to tarStream as a tar archive, compressed as
+// compression says, instead of to a directory. tarStream is written once, front to back, and never seeked, like
+// a layer of a container image. The archive is the same for the same package and options: the files are in the
+// order they are in the package, each directory comes before its first file, and the entries have no time,
+// owner 0, mode 644 for the files and 755 for the directories. The files are extracted with up to threadCount
+// worker threads like the other unpacks, the one whose turn it is is written to tarStream as it is extracted,
+// the others are held until then. MSIX_PACKUNPACK_OPTION_SKIPUNCHANGED doesn't apply. Bundles aren't supported.
+// A build without MSIX_PACK only writes archives with MSIX_TAR_COMPRESSION_NONE.
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageToTarStream(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    IStream* stream,
+    IStream* tarStream,
+    MSIX_TAR_COMPRESSION compression,
+    UINT32 threadCount,
+    IMsixProgressCallback* progress
+) noexcept;
+
+// Checks every block of every file in the block map of the package against its hash without extracting
+// anything. The blocks are read and hashed using up to threadCount worker threads, 0 uses the number of
+// hardware threads available. Files whose content doesn't match are logged with their first block that
+// doesn't match, and the call fails with MSIX::Error::SignatureInvalid.
+MSIX_API HRESULT STDMETHODCALLTYPE VerifyPackage(
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8SourcePackage,
+    UINT32 threadCount
+) noexcept;
+
+MSIX_API HRESULT STDMETHODCALLTYPE VerifyPackageFromStream(
+    MSIX_VALIDATION_OPTION validationOption,
+    IStream* stream,
+    UINT32 threadCount
+) noexcept;
+
+// Reads the identity of a package or bundle without opening it. Only the central directory and the start of
+// the manifest up to its Identity element are read, so over a range reader stream identifying a package costs
+// a few KB of I/O. Nothing is validated, the signature and the block map are only checked when the package is
+// opened with a package or bundle reader. The strings of packageId are allocated with the allocator of factory.
+MSIX_API HRESULT STDMETHODCALLTYPE ReadPackageIdentityFromStream(
+    IAppxFactory* factory,
+    IStream* stream,
+    IAppxManifestPackageId** packageId
+) noexcept;
+
+// Tells whether stream is a package, a bundle or a manifest without creating a reader for it. Only its first bytes
+// and, for a zip file, its central directory are read, nothing is parsed or validated. stream is left at its start.
+MSIX_API HRESULT STDMETHODCALLTYPE GetContainerFormatFromStream(
+    IStream* stream,
+    MSIX_CONTAINER_FORMAT* format
+) noexcept;
+
+// Writes to utf8Delta how to rebuild utf8NewPackage from utf8OldPackage, computed from their block maps: the blocks
+// of the new package that are in the old one are copied from it, everything else is fetched from the new package
+// as byte ranges. The delta is text: the size and SHA256 of the new package, then "copy <offset> <old offset> <size>"
+// and "fetch <offset> <size>" records that cover it in order, then the changed blocks. If utf8Ranges isn't null, the
+// fetched ranges are written to it one after the other, which is what PatchPackage reads. Neither package is validated.
+MSIX_API HRESULT STDMETHODCALLTYPE DiffPackages(
+    char* utf8OldPackage,
+    char* utf8NewPackage,
+    char* utf8Delta,
+    char* utf8Ranges
+) noexcept;
+
+// Rebuilds the new package of utf8Delta at utf8NewPackage from utf8OldPackage and utf8Ranges, the ranges of its
+// fetch records one after the other. The call fails and deletes utf8NewPackage if the result doesn't have the size
+// and SHA256 in the delta.
+MSIX_API HRESULT STDMETHODCALLTYPE PatchPackage(
+    char* utf8OldPackage,
+    char* utf8Delta,
+    char* utf8Ranges,
+    char* utf8NewPackage
+) noexcept;
+
 MSIX_API HRESULT STDMETHODCALLTYPE UnpackBundle(
     MSIX_PACKUNPACK_OPTION packUnpackOptions,
     MSIX_VALIDATION_OPTION validationOption,
@@ -1762,6 +2479,28 @@ MSIX_API HRESULT STDMETHODCALLTYPE UnpackBundleFromBundleReader(
     char* utf8Destination
 ) noexcept;
 
+// A device to select the packages of a bundle for, as the applicability options and languages of a factory.
+// The languages are BCP-47 tags in order of preference, none means the languages of the system.
+typedef struct MSIX_APPLICABILITY_PROFILE
+{
+    MSIX_APPLICABILITY_OPTIONS applicabilityOptions;
+    UINT32 languageCount;
+    LPCSTR* languages;
+} MSIX_APPLICABILITY_PROFILE;
+
+// Selects the packages of an opened bundle for each of profileCount profiles, the packages a bundle reader
+// created by a factory with the options and languages of the profile would select. The bundle is opened and
+// validated once, and the packages of its manifest are parsed once for all the profiles. applicable is
+// profileCount rows of packageCount, the number of packages in the bundle manifest, in the order of
+// IAppxBundleManifestReader::GetPackageInfoItems. It is set to TRUE for the packages that apply to the profile.
+MSIX_API HRESULT STDMETHODCALLTYPE GetApplicablePackagesForProfiles(
+    IAppxBundleReader* bundleReader,
+    UINT32 profileCount,
+    MSIX_APPLICABILITY_PROFILE* profiles,
+    UINT32 packageCount,
+    BOOL* applicable
+) noexcept;
+
 MSIX_API HRESULT STDMETHODCALLTYPE UnpackBundleFromStream(
     MSIX_PACKUNPACK_OPTION packUnpackOptions,
     MSIX_VALIDATION_OPTION validationOption,
@@ -1770,6 +2509,49 @@ MSIX_API HRESULT STDMETHODCALLTYPE UnpackBundleFromStream(
     char* utf8Destination
 ) noexcept;
 
+// Same as UnpackBundle and UnpackBundleFromStream. If MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION is
+// specified, up to threadCount applicable packages are unpacked at the same time and the threads are
+// split between them to extract their files. A threadCount of 0 uses the number of hardware threads available.
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackBundleWithThreadCount(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    MSIX_APPLICABILITY_OPTIONS applicabilityOptions,
+    char* utf8SourcePackage,
+    char* utf8Destination,
+    UINT32 threadCount
+) noexcept;
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackBundleFromStreamWithThreadCount(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    MSIX_APPLICABILITY_OPTIONS applicabilityOptions,
+    IStream* stream,
+    char* utf8Destination,
+    UINT32 threadCount
+) noexcept;
+
+// Same as UnpackBundleWithThreadCount and UnpackBundleFromStreamWithThreadCount, reporting to progress, which
+// can be null.
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackBundleWithProgress(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    MSIX_APPLICABILITY_OPTIONS applicabilityOptions,
+    char* utf8SourcePackage,
+    char* utf8Destination,
+    UINT32 threadCount,
+    IMsixProgressCallback* progress
+) noexcept;
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackBundleFromStreamWithProgress(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    MSIX_APPLICABILITY_OPTIONS applicabilityOptions,
+    IStream* stream,
+    char* utf8Destination,
+    UINT32 threadCount,
+    IMsixProgressCallback* progress
+) noexcept;
+
 #ifdef MSIX_PACK
 
 MSIX_API HRESULT STDMETHODCALLTYPE PackPackage(
@@ -1779,6 +2561,129 @@ MSIX_API HRESULT STDMETHODCALLTYPE PackPackage(
     char* outputPackage
 ) noexcept;
 
+// threadCount is the number of workers used with MSIX_PACKUNPACK_OPTION_PARALLELCOMPRESSION, 0 means all the hardware threads.
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackageWithThreadCount(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* directoryPath,
+    char* outputPackage,
+    UINT32 threadCount
+) noexcept;
+
+// compressionOption is used for the payload files with compressible content types. APPX_COMPRESSION_OPTION_NONE
+// stores every file. With MSIX_PACKUNPACK_OPTION_ADAPTIVECOMPRESSION, files that don't compress well are stored.
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackageWithOptions(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* directoryPath,
+    char* outputPackage,
+    UINT32 threadCount,
+    APPX_COMPRESSION_OPTION compressionOption
+) noexcept;
+
+// Same as PackPackageWithOptions. basePackage is a previous build of the package, the compressed payload files
+// also compressed in it copy the deflated bytes of every block whose size and hash match the block at the same
+// position, instead of deflating it again. basePackage can't be outputPackage.
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackageFromBase(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* directoryPath,
+    char* outputPackage,
+    UINT32 threadCount,
+    APPX_COMPRESSION_OPTION compressionOption,
+    char* basePackage
+) noexcept;
+
+// Same as PackPackageFromBase, basePackage can be null. progress, which can be null, is told about the
+// payload files added and can cancel the pack, in which case the output package is deleted. An outputPackage of
+// "-" is the standard output, which is written like by PackPackageToStream.
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackageWithProgress(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* directoryPath,
+    char* outputPackage,
+    UINT32 threadCount,
+    APPX_COMPRESSION_OPTION compressionOption,
+    char* basePackage,
+    IMsixProgressCallback* progress
+) noexcept;
+
+// Same as PackPackageWithProgress, with the pack paced to take about timeBudgetMilliseconds. The time each payload
+// file takes to pack is measured, and the files left are compressed with lower levels than compressionOption, down
+// to being stored, when the pack would otherwise finish late. The package is smaller the larger the budget, one
+// that is never reached gives the same package as PackPackageWithProgress, and 0 doesn't pace the pack at all.
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackageWithTimeBudget(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* directoryPath,
+    char* outputPackage,
+    UINT32 threadCount,
+    APPX_COMPRESSION_OPTION compressionOption,
+    char* basePackage,
+    IMsixProgressCallback* progress,
+    UINT32 timeBudgetMilliseconds
+) noexcept;
+
+// Same as PackPackageWithTimeBudget, with the payload files of accessOrder, an access-order profile such as the
+// files read by a launch trace of the app, added first in that order and the other payload files after them. The
+// files an app reads as it starts are then next to each other at the start of the package, which a package read
+// from a network or mounted in place reads with fewer and larger reads. The paths of accessOrder are relative to
+// directoryPath, with either separator, and the ones that aren't payload files of it are ignored.
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackageWithAccessOrder(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* directoryPath,
+    char* outputPackage,
+    UINT32 threadCount,
+    APPX_COMPRESSION_OPTION compressionOption,
+    char* basePackage,
+    IMsixProgressCallback* progress,
+    UINT32 timeBudgetMilliseconds,
+    UINT32 accessOrderCount,
+    char** accessOrder
+) noexcept;
+
+// Same as PackPackageWithProgress, but returns once the pack is started on the worker threads of the process, like
+// UnpackPackageAsync. outputPackage can't be "-".
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackageAsync(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* directoryPath,
+    char* outputPackage,
+    UINT32 threadCount,
+    APPX_COMPRESSION_OPTION compressionOption,
+    char* basePackage,
+    IMsixProgressCallback* progress,
+    IMsixCompletionCallback* completion
+) noexcept;
+
+// Same as PackPackageWithProgress to outputStream, which is only written forward and never seeked, like a pipe
+// or a socket, see MSIX_FACTORY_OPTION_WRITER_STREAMING_OUTPUT. Whatever was written stays there if the pack fails.
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackageToStream(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* directoryPath,
+    IStream* outputStream,
+    UINT32 threadCount,
+    APPX_COMPRESSION_OPTION compressionOption,
+    char* basePackage,
+    IMsixProgressCallback* progress
+) noexcept;
+
+// Same as PackPackageWithProgress, without a base package, for the files of archivePath, a zip or a tar archive,
+// instead of a directory. The root of the archive is the root of the package, AppxManifest.xml included. The files
+// are read from the archive as they are packed, without extracting it first, in the order they are in it. Links,
+// devices and fifos in a tar archive fail the pack with NotSupported.
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackageFromArchive(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* archivePath,
+    char* outputPackage,
+    UINT32 threadCount,
+    APPX_COMPRESSION_OPTION compressionOption,
+    IMsixProgressCallback* progress
+) noexcept;
+
 MSIX_API HRESULT STDMETHODCALLTYPE PackBundle(
     MSIX_BUNDLE_OPTIONS bundleOptions,
     char* directoryPath,
@@ -1787,6 +2692,80 @@ MSIX_API HRESULT STDMETHODCALLTYPE PackBundle(
     char* version
 ) noexcept;
 
+// Same as PackBundle. progress, which can be null, is told about the packages added to the bundle and can
+// cancel it, in which case the output bundle is deleted.
+MSIX_API HRESULT STDMETHODCALLTYPE PackBundleWithProgress(
+    MSIX_BUNDLE_OPTIONS bundleOptions,
+    char* directoryPath,
+    char* outputBundle,
+    char* mappingFile,
+    char* version,
+    IMsixProgressCallback* progress
+) noexcept;
+
+// Writes to bundleManifest the AppxBundleManifest.xml of a bundle that references packageCount packages,
+// named packageFileNames in the bundle and described by the AppxManifest.xml streams in packageManifests.
+// No package or bundle is built. The manifests are validated as when their packages are added to a bundle.
+// If bundleVersion is 0, the version is generated from the current time as YYYY.MMDD.hhmm.0
+MSIX_API HRESULT STDMETHODCALLTYPE PackBundleManifest(
+    UINT32 packageCount,
+    LPCSTR* packageFileNames,
+    IStream** packageManifests,
+    UINT64 bundleVersion,
+    IStream* bundleManifest
+) noexcept;
+
+// Replaces the footprint files of utf8Package with files, of the types in fileTypes, and adds the ones it doesn't
+// have, without reading or rewriting the payload: only the replaced files written last, like the signature, and the
+// central directory are rewritten, so re-signing costs as much as the footprint files. The records of other replaced
+// files stay in the package unreferenced. An override is added to [Content_Types].xml for added files that need one,
+// and the signature stays the last file. Only zip64 packages can be edited, and the content isn't validated. If the
+// call fails the package is left as it was.
+MSIX_API HRESULT STDMETHODCALLTYPE ReplaceFootprintFiles(
+    char* utf8Package,
+    UINT32 fileCount,
+    APPX_FOOTPRINT_FILE_TYPE* fileTypes,
+    IStream** files
+) noexcept;
+
+// A payload file of the directory as a build system knows it from a previous pack, for PackPackageFromInventory.
+// fileName is relative to the directory, '/' separated, and is also its name in the package. contentType can be
+// null for the content type of its extension. blockHashes are the SHA256 of the 64KB blocks of the file, blockCount
+// of them one after the other, as in the block map, and crc its zip CRC-32; blockHashes can be null if they aren't
+// known. compressedBlocks, which can be null, are the blocks deflated one after the other, each ending on a full
+// flush and the last one not terminating the deflate stream, as they are stored in a package, and
+// compressedBlockSizes their sizes.
+typedef struct MSIX_INVENTORY_FILE
+{
+    LPCSTR fileName;
+    LPCSTR contentType;
+    UINT64 size;
+    UINT32 blockCount;
+    BYTE* blockHashes;
+    UINT32 crc;
+    UINT64* compressedBlockSizes;
+    IStream* compressedBlocks;
+}   MSIX_INVENTORY_FILE;
+
+// Same as PackPackageWithProgress, without a base package, for the payload files of an inventory instead of the
+// files of directoryPath; AppxManifest.xml is still read from it and the footprint files of the inventory are
+// ignored. The files are added in the order of the inventory. The inventory is trusted, only its sizes are checked:
+// a file that still has the size of the inventory and has its block hashes and crc in it isn't hashed, and if it
+// is compressed and its deflated blocks are there too, it isn't read either, the blocks are copied. Any other file
+// is packed as usual. An inventory that doesn't match the files gives a package whose block map doesn't match
+// its content, which fails to be read.
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackageFromInventory(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* directoryPath,
+    char* outputPackage,
+    UINT32 threadCount,
+    APPX_COMPRESSION_OPTION compressionOption,
+    IMsixProgressCallback* progress,
+    UINT32 fileCount,
+    MSIX_INVENTORY_FILE* files
+) noexcept;
+
 #endif // MSIX_PACK
 
 // A call to called CoCreateAppxFactory is required before start using the factory on non-windows platforms specifying
@@ -1806,6 +2785,150 @@ MSIX_API HRESULT STDMETHODCALLTYPE MsixGetLogTextUTF8(COTASKMEMALLOC* memalloc,
 #endif
 #endif
 
+#ifdef MSIX_PACK
+
+// Same as PackPackageWithProgress. The package is written ready to be signed and digests gets what its signature
+// signs, allocated with memalloc, see IMsixPackageSigningDigests.
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackageWithSigningDigests(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* directoryPath,
+    char* outputPackage,
+    UINT32 threadCount,
+    APPX_COMPRESSION_OPTION compressionOption,
+    char* basePackage,
+    IMsixProgressCallback* progress,
+    COTASKMEMALLOC* memalloc,
+    UINT32* digestsSize,
+    BYTE** digests
+) noexcept;
+
+// Has the package writers of factory, an IAppxFactory or IAppxBundleFactory, look up the blocks of the files they
+// compress in a cache of deflated blocks before deflating them, and add the ones they deflate. A block is kept under
+// the SHA256 of its bytes and the compression option, so the blocks the packages built by the writers share, like the
+// assets of the packages of a bundle, are deflated once. Up to maxMemoryBytes of deflated blocks are kept in memory,
+// for the writers of factory, and the least recently used are dropped past that. When utf8CacheDirectory isn't null,
+// the blocks are also kept there, where writers of any factory or process, and later builds, find them. Entries of
+// the directory that don't check out, like ones being written by another process, are deflated again. The packages
+// written are the same as without the cache. A null utf8CacheDirectory with a maxMemoryBytes of 0 stops using it.
+MSIX_API HRESULT STDMETHODCALLTYPE MsixSetCompressedBlockCache(
+    IUnknown* factory,
+    char* utf8CacheDirectory,
+    UINT64 maxMemoryBytes) noexcept;
+
+#endif // MSIX_PACK
+
+// Gets the performance counters of the readers and writers of factory, an IAppxFactory or IAppxBundleFactory.
+// They are only counted by factories created with MSIX_FACTORY_OPTION_PERFORMANCE_COUNTERS, for any other factory
+// all of them are 0. When reset is true, the counters start again from 0 after being read.
+MSIX_API HRESULT STDMETHODCALLTYPE MsixGetPerformanceCounters(
+    IUnknown* factory,
+    bool reset,
+    MSIX_PERFORMANCE_COUNTERS* counters) noexcept;
+
+// Limits the bytes held by the internal buffers of the readers and writers of factory, an IAppxFactory or
+// IAppxBundleFactory, to budgetBytes, or removes the limit with 0. Under a limit they take their streaming paths:
+// footprint files are validated as they are read instead of being cached, the block map being written goes to a
+// temporary file early, and the memory limits of AddPayloadFiles are lowered to what is left of the budget. A
+// buffer that doesn't fit fails the call that needs it with E_OUTOFMEMORY. Memory of the xml parser and of the
+// IMsixBufferAllocator extension isn't counted.
+MSIX_API HRESULT STDMETHODCALLTYPE MsixSetMemoryBudget(
+    IUnknown* factory,
+    UINT64 budgetBytes) noexcept;
+
+// Gets the bytes held by the internal buffers of the readers and writers of factory, and the most they have held.
+// When resetPeak is true, the peak starts again from the current bytes.
+MSIX_API HRESULT STDMETHODCALLTYPE MsixGetMemoryUsage(
+    IUnknown* factory,
+    bool resetPeak,
+    UINT64* currentBytes,
+    UINT64* peakBytes) noexcept;
+
+// Lets the unpacks, verifies and packs of the readers and writers of factory, an IAppxFactory or IAppxBundleFactory,
+// run in the background without starving the rest of the machine. maxBytesPerSecond limits the bytes of files they go
+// through per second, all of them together: written when unpacking, read when verifying and packing. maxWorkerCount limits the threads each of their parallel loops runs on, whatever thread
+// count they are called with. 0 is no limit for either. With lowPriorityIo their threads do their I/O with a low
+// priority: the idle I/O class on Linux, the throttled I/O policy on macOS and the background mode on Windows.
+// A limit of bytes per second turns off the copy of stored files by the file system when unpacking.
+MSIX_API HRESULT STDMETHODCALLTYPE MsixSetQualityOfService(
+    IUnknown* factory,
+    UINT64 maxBytesPerSecond,
+    UINT32 maxWorkerCount,
+    bool lowPriorityIo) noexcept;
+
+// With pinWorkers, each of the threads the SDK shares between the factories of the process is pinned to one processor
+// while it runs parallel work of the readers and writers of factory, an IAppxFactory or IAppxBundleFactory: the n-th
+// thread to the n-th processor the process may run on. The blocks a thread reads, hashes and deflates, and its zlib
+// state, then stay in the caches of one processor, and in the memory of its node on machines with several NUMA nodes.
+// The threads of an IMsixTaskScheduler and the threads calling the SDK aren't pinned, and no thread is on macOS.
+MSIX_API HRESULT STDMETHODCALLTYPE MsixSetWorkerAffinity(
+    IUnknown* factory,
+    bool pinWorkers) noexcept;
+
+// Stops the threads the SDK shares between the factories of the process to run its parallel work and to read and
+// write with, once the tasks and requests queued on them are done. They are never stopped otherwise: a host that unloads the library must call this first,
+// when none of its calls into the SDK is running, since the threads can't exit while the library is being unloaded.
+// They start again the next time the SDK needs them.
+MSIX_API HRESULT STDMETHODCALLTYPE MsixShutdownThreads() noexcept;
+
+// Keeps whether the certificate chain of a signing certificate is trusted, and how, for lifetimeSeconds after the
+// readers of factory, an IAppxFactory or IAppxBundleFactory, build it. The packages signed with the same certificate
+// in that time only have their own signature and digests checked. 0 builds the chain for every package. The default
+// is 300 seconds. Only used where signatures are validated by Windows, the call succeeds and does nothing elsewhere.
+MSIX_API HRESULT STDMETHODCALLTYPE MsixSetCertificateChainCacheLifetime(
+    IUnknown* factory,
+    UINT32 lifetimeSeconds) noexcept;
+
+// Unpacks the payload files read by the readers of factory, an IAppxFactory or IAppxBundleFactory, through a content
+// addressed store in utf8StoreDirectory, which packages unpacked by any factory or process can share. A payload file
+// whose content, as given by the hashes of its blocks in the block map, is in the store is linked to it instead of
+// being inflated and written. A file that isn't is extracted and then added to the store. Files are cloned where the
+// file system shares extents between files (Btrfs, XFS, APFS), otherwise hard linked, so the unpacked file and the
+// stored one are the same file and files unpacked with a store must not be modified in place. A file that can't be
+// linked, like when the store is on another volume, is extracted as usual. A null utf8StoreDirectory stops using it.
+MSIX_API HRESULT STDMETHODCALLTYPE MsixSetBlockStore(
+    IUnknown* factory,
+    char* utf8StoreDirectory) noexcept;
+
+// Keeps up to maxBytes of the blocks the payload files of the readers of factory, an IAppxFactory or
+// IAppxBundleFactory, are read by with IMsixFileBlockReader, inflated and validated against their block maps. They
+// are shared by all the readers of factory and their threads, a block read again, from the same package or from any
+// other with the same block, is copied without being read, inflated or hashed. The least recently used blocks are
+// dropped first. A maxBytes of 0 stops using it, and releases the blocks.
+MSIX_API HRESULT STDMETHODCALLTYPE MsixSetBlockCache(
+    IUnknown* factory,
+    UINT64 maxBytes) noexcept;
+
+// Same as IAppxFactory::CreatePackageReader, but returns once the reader is being created on the worker pool of
+// factory, see MSIX_FACTORY_EXTENSION_TASK_SCHEDULER. completion gets the IAppxPackageReader, or why it couldn't be
+// created. inputStream must not be used until then. Fails without calling completion when it can't be started.
+MSIX_API HRESULT STDMETHODCALLTYPE CreatePackageReaderAsync(
+    IAppxFactory* factory,
+    IStream* inputStream,
+    IMsixCompletionCallback* completion) noexcept;
+
+// Writes to indexStream a sidecar index of the package read by packageReader, usually kept next to it as
+// <package>.msixidx. It has the files and blocks of the block map, the values of the manifest, the hashes of the
+// block map and of the content types, and the size and the hash of the central directory of the package, so
+// CreatePackageReaderWithIndex doesn't parse the footprint files again. Bundles don't have an index.
+MSIX_API HRESULT STDMETHODCALLTYPE WritePackageIndex(
+    IAppxPackageReader* packageReader,
+    IStream* indexStream) noexcept;
+
+// Same as IAppxFactory::CreatePackageReader, with the index WritePackageIndex wrote for the package. Only the
+// central directory of the package is parsed, the block map and the content types are read and hashed but not
+// parsed, and the manifest isn't parsed either. indexStream is read once and can be released when it returns, an
+// index mapped with CreateStreamOnFileMapped isn't copied. An index that isn't the one of the package, because it
+// changed or because the index was made with a validation that didn't check the manifest against the schema and
+// this one does, is ignored and the package is read as CreatePackageReader does. The blocks and the manifest values
+// of the index are not checked against the block map, the index is used only when factory was created with
+// MSIX_VALIDATION_OPTION_TRUSTPACKAGEINDEX, so only an index no one else can write should be given with it.
+MSIX_API HRESULT STDMETHODCALLTYPE CreatePackageReaderWithIndex(
+    IAppxFactory* factory,
+    IStream* inputStream,
+    IStream* indexStream,
+    IAppxPackageReader** packageReader) noexcept;
+
 // Call specific for Windows. Default to call CoTaskMemAlloc and CoTaskMemFree
 MSIX_API HRESULT STDMETHODCALLTYPE CoCreateAppxFactory(
     MSIX_VALIDATION_OPTION validationOption,
@@ -1841,6 +2964,14 @@ MSIX_API HRESULT STDMETHODCALLTYPE CoCreateAppxBundleFactoryWithHeap(
     MSIX_APPLICABILITY_OPTIONS applicabilityOptions,
     IAppxBundleFactory** appxBundleFactory) noexcept;
 
+MSIX_API HRESULT STDMETHODCALLTYPE CoCreateAppxBundleFactoryWithHeapAndOptions(
+    COTASKMEMALLOC* memalloc,
+    COTASKMEMFREE* memfree,
+    MSIX_VALIDATION_OPTION validationOption,
+    MSIX_APPLICABILITY_OPTIONS applicabilityOptions,
+    MSIX_FACTORY_OPTIONS factoryOptions,
+    IAppxBundleFactory** appxBundleFactory) noexcept;
+
 // provided as a helper for platforms that do not have an implementation of SHCreateStreamOnFileEx
 MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamOnFile(
     char* utf8File,
@@ -1852,6 +2983,59 @@ MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamOnFileUTF16(
     bool forRead,
     IStream** stream) noexcept;
 
+// Creates a read only stream over a memory mapped file. The file must not be modified while the stream exists.
+MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamOnFileMapped(
+    char* utf8File,
+    IStream** stream) noexcept;
+
+// Same as CreateStreamOnFileMapped, except the mapping is shared. All the streams of the process over the same file
+// use one mapping, whatever the path they were created with. The file is the same one while its identity is
+// unchanged: its volume, file number, size and modification times. So readers of a package opened by many threads
+// share its pages and its read-ahead. The file stays mapped until the last stream over it is released.
+MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamOnFileShared(
+    char* utf8File,
+    IStream** stream) noexcept;
+
+// Creates a read only stream whose data comes from rangeReader. Reads are served from a cache of blockSize
+// aligned blocks, and runs of missing blocks are requested together. Use 0 for the default block size.
+MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamOnRangeReader(
+    IMsixRangeReader* rangeReader,
+    UINT32 blockSize,
+    IStream** stream) noexcept;
+
+// Called with the context and the data given to CreateStreamOnBuffer once the memory isn't used anymore
+typedef void STDMETHODCALLTYPE MSIX_RELEASE_BUFFER(void* context, const void* data);
+
+// Creates a read only stream over size bytes of memory of the caller, like a package received over RPC, without
+// copying them. The stream and its clones read the memory in place, and a package reader reads it like a mapped
+// file. The memory must not be modified while a stream over it exists. release, when not null, is called with
+// context and data when the last of them is released, it isn't called if the stream can't be created.
+MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamOnBuffer(
+    const void* data,
+    UINT64 size,
+    MSIX_RELEASE_BUFFER* release,
+    void* context,
+    IStream** stream) noexcept;
+
+#ifdef __ANDROID__
+struct AAsset;
+
+// Creates a read only stream over length bytes of fd from offset, without copying them. The stream has its own
+// duplicate of fd, which can be closed. The bytes must not be modified while the stream exists.
+MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamOnFileDescriptor(
+    int fd,
+    UINT64 offset,
+    UINT64 length,
+    IStream** stream) noexcept;
+
+// Creates a read only stream over an asset of an APK, read in place from the APK. The asset must be stored
+// uncompressed in it, see noCompress in the aaptOptions of the android gradle plugin. The asset can be closed
+// once the stream is created.
+MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamOnAsset(
+    AAsset* asset,
+    IStream** stream) noexcept;
+#endif // __ANDROID__
+
 } // extern "C++"
 
 #endif //__appxpackaging_hpp__
\ No newline at end of file
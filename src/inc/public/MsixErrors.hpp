@@ -30,6 +30,7 @@ namespace MSIX {
         BadFormat                   = 0x8007000b,
         InvalidData                 = 0x8007000d,
         OutOfBounds                 = 0x8000000b,
+        Cancelled                   = 0x800704c7,
         PackagingErrorInternal      = 0x80080200,
 
         //
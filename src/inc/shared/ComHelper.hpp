@@ -158,6 +158,20 @@ namespace MSIX {
             ThrowHrIfFailed(m_ptr->QueryInterface(UuidOfImpl<U>::iid, reinterpret_cast<void**>(&out)));
             return out;
         }
+
+        // Like As, for interfaces that are optional. Returns an empty ComPtr instead of throwing when the
+        // interface is not implemented.
+        template <class U>
+        ComPtr<U> TryAs() const
+        {
+            ComPtr<U> out;
+            U* result = nullptr;
+            if (m_ptr && SUCCEEDED(m_ptr->QueryInterface(UuidOfImpl<U>::iid, reinterpret_cast<void**>(&result))))
+            {
+                *(&out) = result;
+            }
+            return out;
+        }
     protected:
         T* m_ptr = nullptr;
 
@@ -4,8 +4,10 @@
 // 
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <string>
+#include <utility>
 #include <exception>
 #include <cassert>
 #include <functional>
@@ -14,6 +16,49 @@
 #include "MSIXWindows.hpp"
 #include "MsixErrors.hpp"
 
+namespace MSIX {
+    // Text of a failure raised at file and line, as found in the log.
+    inline std::string FormatErrorMessage(const char* file, int line, const std::string& details)
+    {
+        std::ostringstream builder;
+        if (!details.empty()) { builder << details << "\n"; }
+        builder << "Call failed in " << file << " on line " << line;
+        return builder.str();
+    }
+
+    namespace Global {
+        namespace Log {
+            // A failure raised at file and line, which must be a string literal as given by __FILE__. The
+            // exception that raised it and the log share it, so logging a failure doesn't copy its details.
+            struct Entry
+            {
+                Entry(const char* file, int line, const char* details) : file(file), line(line), details(details ? details : "") {}
+
+                const char* file;
+                int line;
+                std::string details;
+                std::atomic<std::uint32_t> references{1};
+            };
+
+            // Counted reference to an Entry
+            class EntryRef final
+            {
+            public:
+                explicit EntryRef(Entry* entry) noexcept : m_entry(entry) {}
+                EntryRef(const EntryRef& other) noexcept : m_entry(other.m_entry) { if (m_entry) { m_entry->references++; } }
+                EntryRef(EntryRef&& other) noexcept : m_entry(other.m_entry) { other.m_entry = nullptr; }
+                EntryRef& operator=(EntryRef other) noexcept { std::swap(m_entry, other.m_entry); return *this; }
+                ~EntryRef() { if (m_entry && --m_entry->references == 0) { delete m_entry; } }
+
+                const Entry* operator->() const noexcept { return m_entry; }
+
+            private:
+                Entry* m_entry;
+            };
+        }
+    }
+}
+
 #ifndef MSIX_TEST
 #include "Log.hpp"
 #else
@@ -21,6 +66,7 @@ namespace MSIX {
     namespace Global {
         namespace Log {
             inline void Append(const std::string&) {}
+            inline EntryRef Append(const char* file, int line, const char* details) { return EntryRef(new Entry(file, line, details)); }
         }
     }
 }
@@ -30,38 +76,38 @@ namespace MSIX {
 
     // Defines a common exception type to throw in exceptional cases.  DO NOT USE FOR FLOW CONTROL!
     // Throwing MSIX::Exception will break into the debugger on chk builds to aid debugging
+    // The message is only formatted when asked for, most failures are handled without anyone reading it.
     class Exception : public std::exception
     {
     public:
-        Exception(std::string& message, Error error) :
-            m_code(static_cast<std::uint32_t>(error)),
-            m_message(message)
-        {
-            Global::Log::Append(Message());
-        }
+        Exception(const char* file, int line, const char* details, Error error) :
+            Exception(file, line, details, static_cast<HRESULT>(error))
+        {}
 
-        Exception(std::string& message, HRESULT error) :
+        Exception(const char* file, int line, const char* details, HRESULT error) :
             m_code(error),
-            m_message(message)
-        {
-            Global::Log::Append(Message());
-        }
+            m_entry(Global::Log::Append(file, line, details))
+        {}
 
         uint32_t            Code() { return m_code; }
-        const std::string&  Message() { return m_message; }
+        const std::string&  Message()
+        {
+            if (m_message.empty()) { m_message = FormatErrorMessage(m_entry->file, m_entry->line, m_entry->details); }
+            return m_message;
+        }
 
     protected:
-        std::uint32_t   m_code;
-        std::string     m_message;
+        std::uint32_t           m_code;
+        Global::Log::EntryRef   m_entry;
+        std::string             m_message;
     };
 
     class Win32Exception final : public Exception
     {
     public:
-        Win32Exception(std::string& message, DWORD error) : Exception(message, 0x80070000 + error)
-        {
-            Global::Log::Append(Message());
-        }
+        Win32Exception(const char* file, int line, const char* details, DWORD error) :
+            Exception(file, line, details, static_cast<HRESULT>(0x80070000 + error))
+        {}
     };
 
     // Provides an ABI exception boundary with parameter validation
@@ -105,11 +151,7 @@ namespace MSIX {
             assert(false);
         }
 
-        std::ostringstream builder;
-        if (details) { builder << details << "\n"; }
-        builder << "Call failed in " << file << " on line " << line;
-        std::string message = builder.str();
-        throw E(message, c);
+        throw E(file, line, details, c);
     }
     
     #ifdef WIN32
@@ -15,6 +15,28 @@
 #include "Exceptions.hpp"
 #include "ComHelper.hpp"
 
+namespace MSIX {
+    // The buffers of a vectored read or write, see IStreamInternal::ReadAtV and WriteV
+    struct StreamReadBuffer
+    {
+        void* data;
+        ULONG size;
+    };
+
+    struct StreamWriteBuffer
+    {
+        const void* data;
+        ULONG size;
+    };
+
+    // Bytes of a stream, see IStreamInternal::Prefetch
+    struct StreamRange
+    {
+        std::uint64_t offset;
+        std::uint64_t size;
+    };
+}
+
 // {44d2a7a8-a165-4a6e-a56f-c7c24de7505c}
 #ifndef WIN32
 interface IStreamInternal : public IUnknown
@@ -28,6 +50,31 @@ public:
     virtual std::uint64_t GetSize() = 0;
     virtual bool IsCompressed() = 0;
     virtual std::string GetName() = 0;
+    // Positional read. Reads from offset without using or moving the seek pointer of the stream, which
+    // allows concurrent reads on the same stream. ReadAt must only be called if SupportsReadAt is true.
+    virtual bool SupportsReadAt() = 0;
+    virtual ULONG ReadAt(std::uint64_t offset, void* buffer, ULONG countBytes) = 0;
+    // Hint for compressed streams. compressedBlockSizes are the compressed sizes of consecutive blocks of
+    // uncompressedBlockSize bytes that can each be decompressed on their own. Streams that can't use it ignore it.
+    virtual void SetSeekPoints(std::uint64_t uncompressedBlockSize, const std::vector<std::uint64_t>& compressedBlockSizes) = 0;
+    // Streams that hold all their bytes in memory, or map them, return the bytes at the current position and
+    // how many are left, so they can be consumed without copying them to a buffer first. Others return nullptr.
+    virtual const std::uint8_t* GetRawView(std::uint64_t& available) = 0;
+    // Streams whose reads are served from memory, or that already read ahead of the caller. Another read
+    // ahead layer over them would only copy the same bytes again.
+    virtual bool IsBuffered() = 0;
+    // Streams that read a local file as it is on disk return what identifies its content, see GetFileIdentity in
+    // FileIdentity.hpp. Others return an empty string.
+    virtual std::string GetFileIdentity() = 0;
+    // Vectored reads and writes, the buffers are read or written in turn as if they were one, with a single call
+    // to the OS where the stream can. ReadAtV reads from offset like ReadAt, must only be called if SupportsReadAt
+    // is true and returns the bytes it read, which fill the buffers in turn. WriteV writes at the seek pointer and
+    // moves it past all the bytes, or fails.
+    virtual ULONG ReadAtV(std::uint64_t offset, const MSIX::StreamReadBuffer* buffers, std::size_t count) = 0;
+    virtual void WriteV(const MSIX::StreamWriteBuffer* buffers, std::size_t count) = 0;
+    // Hint that the ranges are about to be read. Streams whose reads are costly, like the ones over a range reader,
+    // fetch them ahead with as few requests as they can and return true. Others ignore it and return false.
+    virtual bool Prefetch(const MSIX::StreamRange* ranges, std::size_t count) = 0;
 };
 MSIX_INTERFACE(IStreamInternal, 0x44d2a7a8,0xa165,0x4a6e,0xa5,0x6f,0xc7,0xc2,0x4d,0xe7,0x50,0x5c);
 
@@ -58,12 +105,39 @@ namespace MSIX {
             if (bytesWritten) { bytesWritten->QuadPart = 0; }
             ThrowErrorIf(Error::InvalidParameter, (nullptr == stream), "invalid parameter.");
 
-            static const ULONGLONG size = 1024;
-            std::vector<std::int8_t> bytes(size);
             std::int64_t read = 0;
             std::int64_t written = 0;
             ULONG length = 0;
 
+            // Bytes that are already in memory are written straight from the stream.
+            std::uint64_t available = 0;
+            const std::uint8_t* view = GetRawView(available);
+            if (view != nullptr)
+            {
+                std::uint64_t toCopy = std::min(static_cast<std::uint64_t>(bytesCount.QuadPart), available);
+                while (static_cast<std::uint64_t>(written) < toCopy)
+                {
+                    ULONG chunk = static_cast<ULONG>(std::min(toCopy - written, static_cast<std::uint64_t>(std::numeric_limits<ULONG>::max())));
+                    ULONG copy = 0;
+                    ThrowHrIfFailed(stream->Write(reinterpret_cast<const void*>(view + written), chunk, &copy));
+                    ThrowErrorIf(Error::FileWrite, (copy == 0), "write failed");
+                    written += copy;
+                }
+                read = written;
+                LARGE_INTEGER move = { 0 };
+                move.QuadPart = written;
+                ThrowHrIfFailed(Seek(move, Reference::CURRENT, nullptr));
+                if (bytesRead)      { bytesRead->QuadPart = read; }
+                if (bytesWritten)   { bytesWritten->QuadPart = written;}
+                return static_cast<HRESULT>(Error::OK);
+            }
+
+            // Copy through a buffer the size of a blockmap block (BLOCKMAP_BLOCK_SIZE), or smaller if fewer bytes
+            // are requested, so reads line up with the blocks of package files.
+            static const ULONGLONG maxSize = 64*1024;
+            const ULONGLONG size = std::max(std::min(bytesCount.QuadPart, maxSize), static_cast<ULONGLONG>(1));
+            std::vector<std::int8_t> bytes(static_cast<size_t>(size));
+
             while (0 < bytesCount.QuadPart)
             {
                 ULONGLONG chunk = std::min(bytesCount.QuadPart, static_cast<ULONGLONG>(size));
@@ -116,7 +190,7 @@ namespace MSIX {
             ThrowHrIfFailed(Seek(start, StreamBase::Reference::END, &end));
             ThrowHrIfFailed(Seek(start, StreamBase::Reference::START, nullptr));
             statStg->type = STGTY_STREAM;
-            statStg->cbSize.QuadPart = end.u.LowPart;
+            statStg->cbSize.QuadPart = end.QuadPart;
             return static_cast<HRESULT>(Error::OK);
         } CATCH_RETURN();
 
@@ -133,6 +207,37 @@ namespace MSIX {
         virtual std::uint64_t GetSize() override { NOTIMPLEMENTED; }
         virtual bool IsCompressed() override { NOTIMPLEMENTED; }
         virtual std::string GetName() override { NOTIMPLEMENTED; }
+        virtual bool SupportsReadAt() override { return false; }
+        virtual ULONG ReadAt(std::uint64_t, void*, ULONG) override { NOTSUPPORTED; }
+
+        virtual const std::uint8_t* GetRawView(std::uint64_t& available) override { available = 0; return nullptr; }
+        virtual void SetSeekPoints(std::uint64_t, const std::vector<std::uint64_t>&) override { }
+        virtual bool IsBuffered() override { return false; }
+        virtual std::string GetFileIdentity() override { return std::string(); }
+        virtual bool Prefetch(const StreamRange*, std::size_t) override { return false; }
+
+        // One ReadAt or Write per buffer, streams that can do better override them
+        virtual ULONG ReadAtV(std::uint64_t offset, const StreamReadBuffer* buffers, std::size_t count) override
+        {
+            ULONG result = 0;
+            for (std::size_t i = 0; i < count; i++)
+            {
+                ULONG read = ReadAt(offset + result, buffers[i].data, buffers[i].size);
+                result += read;
+                if (read != buffers[i].size) { break; }
+            }
+            return result;
+        }
+
+        virtual void WriteV(const StreamWriteBuffer* buffers, std::size_t count) override
+        {
+            for (std::size_t i = 0; i < count; i++)
+            {
+                ULONG written = 0;
+                ThrowHrIfFailed(Write(buffers[i].data, buffers[i].size, &written));
+                ThrowErrorIf(Error::FileWrite, (written != buffers[i].size), "write failed");
+            }
+        }
 
         template <class T>
         static ULONG Read(const ComPtr<IStream>& stream, T* value)
@@ -150,5 +255,22 @@ namespace MSIX {
             ThrowHrIfFailed(stream->Write(value, static_cast<ULONG>(sizeof(T)), nullptr));
             ThrowErrorIf(Error::FileWrite, (result != sizeof(T)), "Entire object wasn't written!");
         }
+
+        // Writes the buffers with one WriteV if the stream has it, or one Write per buffer
+        static void WriteBuffers(IStream* stream, const StreamWriteBuffer* buffers, std::size_t count)
+        {
+            ComPtr<IStreamInternal> streamInternal;
+            if (SUCCEEDED(stream->QueryInterface(UuidOfImpl<IStreamInternal>::iid, reinterpret_cast<void**>(&streamInternal))))
+            {
+                streamInternal->WriteV(buffers, count);
+                return;
+            }
+            for (std::size_t i = 0; i < count; i++)
+            {
+                ULONG written = 0;
+                ThrowHrIfFailed(stream->Write(buffers[i].data, buffers[i].size, &written));
+                ThrowErrorIf(Error::FileWrite, (written != buffers[i].size), "write failed");
+            }
+        }
     };
 }
\ No newline at end of file
@@ -4,15 +4,24 @@
 // 
 #include "MSIXWindows.hpp"
 #include "AppxPackaging.hpp"
+#include "MsixErrors.hpp"
 
 #include <iostream>
 #include <iomanip>
+#include <fstream>
 #include <vector>
 #include <string>
 #include <initializer_list>
 #include <algorithm>
 #include <functional>
 #include <sstream>
+#include <cstring>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <cstdio>
+#include <cctype>
+#include <atomic>
 
 #define TOOL_HELP_COMMAND_STRING "-?"
 
@@ -212,6 +221,24 @@ struct Invocation
         return opt->params[0];
     }
 
+    // Values of an option that takes one parameter and can be given more than once, in order
+    std::vector<std::string> GetOptionValues(const std::string& name) const
+    {
+        std::vector<std::string> values;
+        for (const auto& opt : options)
+        {
+            if (opt == name)
+            {
+                if (opt.option.ParameterCount != 1)
+                {
+                    throw std::runtime_error("Given option does not take exactly one parameter");
+                }
+                values.push_back(opt.params[0]);
+            }
+        }
+        return values;
+    }
+
 private:
     mutable std::string error;
     std::string         toolName;
@@ -318,6 +345,7 @@ void Command::PrintHelpText(const Invocation& invocation) const
 }
 
 LPVOID STDMETHODCALLTYPE MyAllocate(SIZE_T cb)  { return std::malloc(cb); }
+void STDMETHODCALLTYPE MyFree(LPVOID pv)        { std::free(pv); }
 
 class Text
 {
@@ -364,6 +392,16 @@ MSIX_PACKUNPACK_OPTION GetPackUnpackOptionForPackage(const Invocation& invocatio
         packUnpack |= MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_CREATEPACKAGESUBFOLDER;
     }
 
+    if (invocation.IsOptionPresent("-threads"))
+    {
+        packUnpack |= MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION;
+    }
+
+    if (invocation.IsOptionPresent("-skip-unchanged"))
+    {
+        packUnpack |= MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_SKIPUNCHANGED;
+    }
+
     return packUnpack;
 }
 
@@ -376,6 +414,16 @@ MSIX_PACKUNPACK_OPTION GetPackUnpackOptionForBundle(const Invocation& invocation
         packUnpack |= MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_UNPACKWITHFLATSTRUCTURE;
     }
 
+    if (invocation.IsOptionPresent("-threads"))
+    {
+        packUnpack |= MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION;
+    }
+
+    if (invocation.IsOptionPresent("-packages-only"))
+    {
+        packUnpack |= MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_PACKAGESASFILES;
+    }
+
     return packUnpack;
 }
 
@@ -452,6 +500,16 @@ MSIX_BUNDLE_OPTIONS GetBundleOptions(const Invocation& invocation)
         bundleOptions |= MSIX_BUNDLE_OPTIONS::MSIX_BUNDLE_OPTION_BUNDLEMANIFESTONLY;
     }
 
+    if (invocation.IsOptionPresent("-rm"))
+    {
+        bundleOptions |= MSIX_BUNDLE_OPTIONS::MSIX_BUNDLE_OPTION_READMANIFESTS;
+    }
+
+    if (invocation.IsOptionPresent("-vp"))
+    {
+        bundleOptions |= MSIX_BUNDLE_OPTIONS::MSIX_BUNDLE_OPTION_VALIDATEPACKAGES;
+    }
+
     return bundleOptions;
 }
 
@@ -486,6 +544,75 @@ Command CreateHelpCommand(const std::vector<Command>& commands)
     return result;
 }
 
+// The block store is set on a factory, so the package is read with one of its own instead of with UnpackPackage
+HRESULT UnpackPackageWithBlockStore(const Invocation& invocation, UINT32 threadCount)
+{
+    IAppxFactory* factory = nullptr;
+    IStream* stream = nullptr;
+    IAppxPackageReader* reader = nullptr;
+    HRESULT hr = CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, GetValidationOption(invocation), &factory);
+    if (SUCCEEDED(hr))
+    {
+        hr = MsixSetBlockStore(factory, const_cast<char*>(invocation.GetOptionValue("-store").c_str()));
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = CreateStreamOnFile(const_cast<char*>(invocation.GetOptionValue("-p").c_str()), true, &stream);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = factory->CreatePackageReader(stream, &reader);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = UnpackPackageFromPackageReaderWithProgress(GetPackUnpackOptionForPackage(invocation), reader,
+            const_cast<char*>(invocation.GetOptionValue("-d").c_str()), threadCount, nullptr);
+    }
+    if (reader != nullptr) { reader->Release(); }
+    if (stream != nullptr) { stream->Release(); }
+    if (factory != nullptr) { factory->Release(); }
+    return hr;
+}
+
+HRESULT UnpackPackageWithFilter(const Invocation& invocation, UINT32 threadCount)
+{
+    auto includes = invocation.GetOptionValues("-include");
+    auto excludes = invocation.GetOptionValues("-exclude");
+    std::vector<char*> includePatterns;
+    std::vector<char*> excludePatterns;
+    for (auto& pattern : includes) { includePatterns.push_back(const_cast<char*>(pattern.c_str())); }
+    for (auto& pattern : excludes) { excludePatterns.push_back(const_cast<char*>(pattern.c_str())); }
+    return UnpackPackageWithFilter(
+        GetPackUnpackOptionForPackage(invocation),
+        GetValidationOption(invocation),
+        const_cast<char*>(invocation.GetOptionValue("-p").c_str()),
+        const_cast<char*>(invocation.GetOptionValue("-d").c_str()),
+        threadCount,
+        nullptr,
+        static_cast<UINT32>(includePatterns.size()),
+        includePatterns.data(),
+        static_cast<UINT32>(excludePatterns.size()),
+        excludePatterns.data());
+}
+
+HRESULT UnpackPackageFromSequentialStream(const Invocation& invocation, UINT32 threadCount)
+{
+    IStream* stream = nullptr;
+    HRESULT hr = CreateStreamOnFile(const_cast<char*>(invocation.GetOptionValue("-p").c_str()), true, &stream);
+    if (SUCCEEDED(hr))
+    {
+        hr = UnpackPackageFromSequentialStream(
+            GetPackUnpackOptionForPackage(invocation),
+            GetValidationOption(invocation),
+            stream,
+            const_cast<char*>(invocation.GetOptionValue("-d").c_str()),
+            threadCount,
+            nullptr);
+    }
+    if (stream != nullptr) { stream->Release(); }
+    return hr;
+}
+
 Command CreateUnpackCommand()
 {
     Command result{ "unpack", "Unpack files from a package to disk",
@@ -498,6 +625,12 @@ Command CreateUnpackCommand()
             // Identical behavior as -pfn. This option was created to create parity with unbundle's -pfn-flat option so that IT pros
             // creating packages for app attach only need to be aware of a single option.
             Option{ "-pfn-flat", "Same behavior as -pfn for packages." },
+            Option{ "-threads", "Extracts the files using up to <count> worker threads. 0 uses all the hardware threads.", false, 1, "count" },
+            Option{ "-store", "Links payload files already unpacked to the content addressed store in <directory> instead of extracting them, and adds the others to it. Files linked to the store must not be modified.", false, 1, "directory" },
+            Option{ "-skip-unchanged", "Leaves the payload files already in the output directory whose content matches the block map instead of extracting them again." },
+            Option{ "-include", "Only extracts the files matching <pattern>. Can be given more than once, '*' and '?' don't match '/', '**' matches any directories and a pattern without '/' matches the file names in any directory.", false, 1, "pattern" },
+            Option{ "-exclude", "Doesn't extract the files matching <pattern>, same as -include. Can be given more than once.", false, 1, "pattern" },
+            Option{ "-sequential", "Reads <package> once from front to back, extracting the files while it arrives, so it can be a pipe like /dev/stdin. Not for bundles." },
             Option{ TOOL_HELP_COMMAND_STRING, "Displays this help text." },
         }
     };
@@ -512,11 +645,510 @@ Command CreateUnpackCommand()
 
     result.SetInvocationFunc([](const Invocation& invocation)
         {
-            return UnpackPackage(
+            UINT32 threadCount = 0;
+            if (invocation.IsOptionPresent("-threads"))
+            {
+                threadCount = static_cast<UINT32>(std::stoul(invocation.GetOptionValue("-threads")));
+            }
+            bool filtered = invocation.IsOptionPresent("-include") || invocation.IsOptionPresent("-exclude");
+            if (invocation.IsOptionPresent("-sequential"))
+            {
+                if (filtered || invocation.IsOptionPresent("-store"))
+                {
+                    std::cout << "Error: -sequential can't be used with -store, -include or -exclude" << std::endl;
+                    return static_cast<HRESULT>(E_INVALIDARG);
+                }
+                return UnpackPackageFromSequentialStream(invocation, threadCount);
+            }
+            if (invocation.IsOptionPresent("-store"))
+            {
+                if (filtered)
+                {
+                    std::cout << "Error: -store can't be used with -include or -exclude" << std::endl;
+                    return static_cast<HRESULT>(E_INVALIDARG);
+                }
+                return UnpackPackageWithBlockStore(invocation, threadCount);
+            }
+            if (filtered)
+            {
+                return UnpackPackageWithFilter(invocation, threadCount);
+            }
+            return UnpackPackageWithThreadCount(
                 GetPackUnpackOptionForPackage(invocation),
                 GetValidationOption(invocation),
                 const_cast<char*>(invocation.GetOptionValue("-p").c_str()),
-                const_cast<char*>(invocation.GetOptionValue("-d").c_str()));
+                const_cast<char*>(invocation.GetOptionValue("-d").c_str()),
+                threadCount);
+        });
+
+    return result;
+}
+
+Command CreateVerifyCommand()
+{
+    Command result{ "verify", "Verify the files of a package against its block map",
+        {
+            Option{ "-p", "Input package file path.", true, 1, "package" },
+            Option{ "-ac", "Allows any certificate. By default the signature origin must be known." },
+            Option{ "-ss", "Skips enforcement of signed packages. By default packages must be signed." },
+            Option{ "-threads", "Verifies the files using up to <count> worker threads. 0 uses all the hardware threads.", false, 1, "count" },
+            Option{ TOOL_HELP_COMMAND_STRING, "Displays this help text." },
+        }
+    };
+
+    result.SetDescription({
+        "Checks that every block of every file within the app package at the input",
+        "<package> name matches its hash in the block map, without extracting anything.",
+        "The first block that doesn't match is reported for each file.",
+        });
+
+    result.SetInvocationFunc([](const Invocation& invocation)
+        {
+            UINT32 threadCount = 0;
+            if (invocation.IsOptionPresent("-threads"))
+            {
+                threadCount = static_cast<UINT32>(std::stoul(invocation.GetOptionValue("-threads")));
+            }
+            return VerifyPackage(
+                GetValidationOption(invocation),
+                const_cast<char*>(invocation.GetOptionValue("-p").c_str()),
+                threadCount);
+        });
+
+    return result;
+}
+
+// Releases the interface it holds when it goes out of scope
+template <typename T>
+class Interface
+{
+public:
+    T** operator&() { return &ptr; }
+    T* operator->() { return ptr; }
+    ~Interface() { if (ptr) { ptr->Release(); } }
+
+    T* ptr = nullptr;
+};
+
+struct PackageInfo
+{
+    std::string package;
+    HRESULT     hr = S_OK;
+    std::string name;
+    std::string publisher;
+    std::string version;
+    std::string architecture;
+    std::string resourceId;
+    std::string fullName;
+    bool        full = false;
+    bool        isBundle = false;
+    std::vector<std::string> capabilities;
+    UINT32      count = 0;   // Payload files of a package, packages of a bundle
+};
+
+HRESULT ReadIdentity(IAppxFactory* factory, IStream* stream, PackageInfo& info)
+{
+    Interface<IAppxManifestPackageId> packageId;
+    HRESULT hr = ReadPackageIdentityFromStream(factory, stream, &packageId);
+    Interface<IAppxManifestPackageIdUtf8> packageIdUtf8;
+    if (SUCCEEDED(hr)) { hr = packageId->QueryInterface(UuidOfImpl<IAppxManifestPackageIdUtf8>::iid, reinterpret_cast<void**>(&packageIdUtf8)); }
+    Text name, publisher, resourceId, fullName;
+    if (SUCCEEDED(hr)) { hr = packageIdUtf8->GetName(&name); }
+    if (SUCCEEDED(hr)) { hr = packageIdUtf8->GetPublisher(&publisher); }
+    if (SUCCEEDED(hr)) { hr = packageIdUtf8->GetResourceId(&resourceId); }
+    if (SUCCEEDED(hr)) { hr = packageIdUtf8->GetPackageFullName(&fullName); }
+    UINT64 version = 0;
+    if (SUCCEEDED(hr)) { hr = packageId->GetVersion(&version); }
+    APPX_PACKAGE_ARCHITECTURE architecture = APPX_PACKAGE_ARCHITECTURE_NEUTRAL;
+    if (SUCCEEDED(hr)) { hr = packageId->GetArchitecture(&architecture); }
+    if (SUCCEEDED(hr))
+    {
+        info.name = name.content;
+        info.publisher = publisher.content;
+        info.resourceId = resourceId.content ? resourceId.content : "";
+        info.fullName = fullName.content;
+        info.version = std::to_string((version >> 48) & 0xFFFF) + "." + std::to_string((version >> 32) & 0xFFFF) + "." +
+            std::to_string((version >> 16) & 0xFFFF) + "." + std::to_string(version & 0xFFFF);
+        switch (architecture)
+        {
+        case APPX_PACKAGE_ARCHITECTURE_X86:   info.architecture = "x86"; break;
+        case APPX_PACKAGE_ARCHITECTURE_ARM:   info.architecture = "arm"; break;
+        case APPX_PACKAGE_ARCHITECTURE_X64:   info.architecture = "x64"; break;
+        case APPX_PACKAGE_ARCHITECTURE_ARM64: info.architecture = "arm64"; break;
+        default:                              info.architecture = "neutral"; break;
+        }
+    }
+    return hr;
+}
+
+// Opens the package without validating its signature for its capabilities and how many payload files it has
+HRESULT ReadPackageContents(IAppxFactory* factory, IStream* stream, PackageInfo& info)
+{
+    Interface<IAppxPackageReader> reader;
+    HRESULT hr = factory->CreatePackageReader(stream, &reader);
+    Interface<IAppxManifestReader> manifest;
+    if (SUCCEEDED(hr)) { hr = reader->GetManifest(&manifest); }
+    Interface<IAppxManifestReader3> manifest3;
+    if (SUCCEEDED(hr)) { hr = manifest->QueryInterface(UuidOfImpl<IAppxManifestReader3>::iid, reinterpret_cast<void**>(&manifest3)); }
+    Interface<IAppxManifestCapabilitiesEnumerator> capabilities;
+    if (SUCCEEDED(hr)) { hr = manifest3->GetCapabilitiesByCapabilityClass(APPX_CAPABILITY_CLASS_ALL, &capabilities); }
+    Interface<IAppxManifestCapabilitiesEnumeratorUtf8> capabilitiesUtf8;
+    if (SUCCEEDED(hr)) { hr = capabilities->QueryInterface(UuidOfImpl<IAppxManifestCapabilitiesEnumeratorUtf8>::iid, reinterpret_cast<void**>(&capabilitiesUtf8)); }
+    BOOL hasCurrent = FALSE;
+    if (SUCCEEDED(hr)) { hr = capabilities->GetHasCurrent(&hasCurrent); }
+    while (SUCCEEDED(hr) && hasCurrent)
+    {
+        Text capability;
+        hr = capabilitiesUtf8->GetCurrent(&capability);
+        if (SUCCEEDED(hr))
+        {
+            info.capabilities.push_back(capability.content);
+            hr = capabilities->MoveNext(&hasCurrent);
+        }
+    }
+    Interface<IAppxFilesEnumerator> files;
+    if (SUCCEEDED(hr)) { hr = reader->GetPayloadFiles(&files); }
+    if (SUCCEEDED(hr)) { hr = files->GetHasCurrent(&hasCurrent); }
+    while (SUCCEEDED(hr) && hasCurrent)
+    {
+        info.count++;
+        hr = files->MoveNext(&hasCurrent);
+    }
+    return hr;
+}
+
+HRESULT ReadBundleContents(IAppxBundleFactory* factory, IStream* stream, PackageInfo& info)
+{
+    Interface<IAppxBundleReader> reader;
+    HRESULT hr = factory->CreateBundleReader(stream, &reader);
+    Interface<IAppxBundleManifestReader> manifest;
+    if (SUCCEEDED(hr)) { hr = reader->GetManifest(&manifest); }
+    Interface<IAppxBundleManifestPackageInfoEnumerator> packages;
+    if (SUCCEEDED(hr)) { hr = manifest->GetPackageInfoItems(&packages); }
+    BOOL hasCurrent = FALSE;
+    if (SUCCEEDED(hr)) { hr = packages->GetHasCurrent(&hasCurrent); }
+    while (SUCCEEDED(hr) && hasCurrent)
+    {
+        info.count++;
+        hr = packages->MoveNext(&hasCurrent);
+    }
+    return hr;
+}
+
+std::string JsonString(const std::string& value)
+{
+    std::ostringstream json;
+    json << '"';
+    for (char c : value)
+    {
+        switch (c)
+        {
+        case '"':  json << "\\\""; break;
+        case '\\': json << "\\\\"; break;
+        case '\n': json << "\\n"; break;
+        case '\r': json << "\\r"; break;
+        case '\t': json << "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                json << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec;
+            }
+            else
+            {
+                json << c;
+            }
+        }
+    }
+    json << '"';
+    return json.str();
+}
+
+std::string FormatPackageInfo(const PackageInfo& info, bool json)
+{
+    std::ostringstream text;
+    if (json)
+    {
+        text << "{\"package\":" << JsonString(info.package);
+        if (FAILED(info.hr))
+        {
+            text << ",\"error\":\"0x" << std::hex << static_cast<UINT32>(info.hr) << std::dec << "\"}";
+            return text.str();
+        }
+        text << ",\"name\":" << JsonString(info.name) << ",\"publisher\":" << JsonString(info.publisher) <<
+            ",\"version\":" << JsonString(info.version) << ",\"architecture\":" << JsonString(info.architecture) <<
+            ",\"resourceId\":" << JsonString(info.resourceId) << ",\"fullName\":" << JsonString(info.fullName);
+        if (info.full)
+        {
+            if (info.isBundle)
+            {
+                text << ",\"packages\":" << info.count;
+            }
+            else
+            {
+                text << ",\"capabilities\":[";
+                for (size_t i = 0; i < info.capabilities.size(); i++)
+                {
+                    text << ((i == 0) ? "" : ",") << JsonString(info.capabilities[i]);
+                }
+                text << "],\"files\":" << info.count;
+            }
+        }
+        text << "}";
+        return text.str();
+    }
+
+    text << info.package << std::endl;
+    if (FAILED(info.hr))
+    {
+        text << "    Error: 0x" << std::hex << static_cast<UINT32>(info.hr) << std::dec;
+        return text.str();
+    }
+    text << "    Name: " << info.name << std::endl;
+    text << "    Publisher: " << info.publisher << std::endl;
+    text << "    Version: " << info.version << std::endl;
+    text << "    Architecture: " << info.architecture << std::endl;
+    text << "    ResourceId: " << info.resourceId << std::endl;
+    text << "    FullName: " << info.fullName;
+    if (info.full)
+    {
+        if (info.isBundle)
+        {
+            text << std::endl << "    Packages: " << info.count;
+        }
+        else
+        {
+            text << std::endl << "    Capabilities:";
+            for (const auto& capability : info.capabilities) { text << " " << capability; }
+            text << std::endl << "    Files: " << info.count;
+        }
+    }
+    return text.str();
+}
+
+Command CreateInfoCommand()
+{
+    Command result{ "info", "Show the identity and contents of packages",
+        {
+            Option{ "-p", "Input package or bundle file path. Can be given more than once.", true, 1, "package" },
+            Option{ "-json", "Writes one JSON object per line for each package." },
+            Option{ "-identity", "Only reads the identity, which only reads the central directory and the start of the manifest." },
+            Option{ "-threads", "Reads up to <count> packages at once. 0, the default, uses all the hardware threads.", false, 1, "count" },
+            Option{ TOOL_HELP_COMMAND_STRING, "Displays this help text." },
+        }
+    };
+
+    result.SetDescription({
+        "Writes the identity of each <package>, and unless -identity is given the",
+        "capabilities and the number of payload files of a package or the number of",
+        "packages of a bundle. Signatures aren't validated, nothing is extracted.",
+        "Packages are read concurrently and written as soon as they're read, so not",
+        "necessarily in the order they were given. A package that can't be read is",
+        "written with its error and doesn't stop the others.",
+        });
+
+    result.SetInvocationFunc([](const Invocation& invocation)
+        {
+            auto packages = invocation.GetOptionValues("-p");
+            bool json = invocation.IsOptionPresent("-json");
+            bool identityOnly = invocation.IsOptionPresent("-identity");
+            unsigned int threads = 0;
+            if (invocation.IsOptionPresent("-threads"))
+            {
+                threads = static_cast<unsigned int>(std::stoul(invocation.GetOptionValue("-threads")));
+            }
+            if (threads == 0)
+            {
+                threads = std::max(std::thread::hardware_concurrency(), 1u);
+            }
+            threads = std::min(threads, static_cast<unsigned int>(packages.size()));
+
+            std::atomic<size_t> next(0);
+            std::atomic<bool> failed(false);
+            std::mutex outputLock;
+            // Each worker has its factories, which keep what they decode for the next packages it reads
+            auto worker = [&]()
+            {
+                Interface<IAppxFactory> factory;
+                Interface<IAppxBundleFactory> bundleFactory;
+                HRESULT factoryResult = CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory);
+                if (SUCCEEDED(factoryResult) && !identityOnly)
+                {
+                    factoryResult = CoCreateAppxBundleFactoryWithHeap(MyAllocate, MyFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                        static_cast<MSIX_APPLICABILITY_OPTIONS>(MSIX_APPLICABILITY_NONE), &bundleFactory);
+                }
+                for (size_t index = next++; index < packages.size(); index = next++)
+                {
+                    PackageInfo info;
+                    info.package = packages[index];
+                    info.hr = factoryResult;
+                    Interface<IStream> stream;
+                    if (SUCCEEDED(info.hr)) { info.hr = CreateStreamOnFile(const_cast<char*>(info.package.c_str()), true, &stream); }
+                    if (SUCCEEDED(info.hr)) { info.hr = ReadIdentity(factory.ptr, stream.ptr, info); }
+                    if (SUCCEEDED(info.hr) && !identityOnly)
+                    {
+                        info.full = true;
+                        MSIX_CONTAINER_FORMAT format = MSIX_CONTAINER_FORMAT_UNKNOWN;
+                        info.hr = GetContainerFormatFromStream(stream.ptr, &format);
+                        info.isBundle = (format == MSIX_CONTAINER_FORMAT_BUNDLE);
+                        if (SUCCEEDED(info.hr))
+                        {
+                            info.hr = info.isBundle ? ReadBundleContents(bundleFactory.ptr, stream.ptr, info) :
+                                ReadPackageContents(factory.ptr, stream.ptr, info);
+                        }
+                    }
+                    if (FAILED(info.hr)) { failed = true; }
+
+                    auto text = FormatPackageInfo(info, json) + "\n";
+                    std::lock_guard<std::mutex> lock(outputLock);
+                    std::fwrite(text.data(), 1, text.size(), stdout);
+                    std::fflush(stdout);
+                }
+            };
+            std::vector<std::thread> workers;
+            for (unsigned int i = 0; i < threads; i++)
+            {
+                workers.emplace_back(worker);
+            }
+            for (auto& thread : workers)
+            {
+                thread.join();
+            }
+            return failed ? static_cast<int>(E_FAIL) : 0;
+        });
+
+    return result;
+}
+
+// Writes the sidecar index of package to indexFile, the package is read with validation
+HRESULT WritePackageIndexFile(const std::string& package, const std::string& indexFile, MSIX_VALIDATION_OPTION validation)
+{
+    Interface<IAppxFactory> factory;
+    Interface<IStream> packageStream;
+    Interface<IAppxPackageReader> reader;
+    Interface<IStream> indexStream;
+    HRESULT hr = CoCreateAppxFactoryWithHeap(MyAllocate, MyFree, validation, &factory);
+    if (SUCCEEDED(hr)) { hr = CreateStreamOnFile(const_cast<char*>(package.c_str()), true, &packageStream); }
+    if (SUCCEEDED(hr)) { hr = factory->CreatePackageReader(packageStream.ptr, &reader); }
+    if (SUCCEEDED(hr)) { hr = CreateStreamOnFile(const_cast<char*>(indexFile.c_str()), false, &indexStream); }
+    if (SUCCEEDED(hr)) { hr = WritePackageIndex(reader.ptr, indexStream.ptr); }
+    return hr;
+}
+
+// Writes the index of the package just packed when -index is given
+HRESULT IndexPackedPackage(const Invocation& invocation, HRESULT hr)
+{
+    if (FAILED(hr) || !invocation.IsOptionPresent("-index")) { return hr; }
+    const auto& package = invocation.GetOptionValue("-p");
+    return WritePackageIndexFile(package, package + ".msixidx", MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE);
+}
+
+Command CreateIndexCommand()
+{
+    Command result{ "index", "Write the sidecar index of a package",
+        {
+            Option{ "-p", "Input package file path.", true, 1, "package" },
+            Option{ "-o", "Output index file path. By default <package>.msixidx.", false, 1, "index" },
+            Option{ "-ac", "Allows any certificate. By default the signature origin must be known." },
+            Option{ "-ss", "Skips enforcement of signed packages. By default packages must be signed." },
+            Option{ TOOL_HELP_COMMAND_STRING, "Displays this help text." },
+        }
+    };
+
+    result.SetDescription({
+        "Reads the app package at <package> and writes what its block map, content",
+        "types and manifest have to <index>, bound to the size and the central",
+        "directory of the package. Readers given the index with",
+        "CreatePackageReaderWithIndex don't parse them again. An index that doesn't",
+        "match the package anymore is ignored. Not for bundles.",
+        });
+
+    result.SetInvocationFunc([](const Invocation& invocation)
+        {
+            const auto& package = invocation.GetOptionValue("-p");
+            std::string indexFile = invocation.IsOptionPresent("-o") ? invocation.GetOptionValue("-o") : package + ".msixidx";
+            return WritePackageIndexFile(package, indexFile, GetValidationOption(invocation));
+        });
+
+    return result;
+}
+
+Command CreateDiffCommand()
+{
+    Command result{ "diff", "Compute the delta from a package to a new version of it",
+        {
+            Option{ "-old", "Package to update from.", true, 1, "oldPackage" },
+            Option{ "-new", "Package to update to.", true, 1, "newPackage" },
+            Option{ "-delta", "Output delta file path.", true, 1, "delta" },
+            Option{ "-ranges", "Also writes the ranges to fetch from <newPackage> to <ranges>, one after the other.", false, 1, "ranges" },
+            Option{ TOOL_HELP_COMMAND_STRING, "Displays this help text." },
+        }
+    };
+
+    result.SetDescription({
+        "Compares the block maps of <oldPackage> and <newPackage> and writes to",
+        "<delta> the ranges of <newPackage> that are copied from <oldPackage> and",
+        "the ranges to fetch from <newPackage>, with the blocks that changed.",
+        "Use patch to rebuild <newPackage> from <oldPackage> and the fetched ranges.",
+        });
+
+    result.SetInvocationFunc([](const Invocation& invocation)
+        {
+            char* ranges = (invocation.IsOptionPresent("-ranges")) ?
+                const_cast<char*>(invocation.GetOptionValue("-ranges").c_str()) : nullptr;
+            auto hr = DiffPackages(
+                const_cast<char*>(invocation.GetOptionValue("-old").c_str()),
+                const_cast<char*>(invocation.GetOptionValue("-new").c_str()),
+                const_cast<char*>(invocation.GetOptionValue("-delta").c_str()),
+                ranges);
+            if (SUCCEEDED(hr))
+            {
+                std::uint64_t size = 0;
+                std::uint64_t fetched = 0;
+                std::ifstream delta(invocation.GetOptionValue("-delta"));
+                std::string line;
+                while (std::getline(delta, line))
+                {
+                    std::istringstream fields(line);
+                    std::string type;
+                    std::uint64_t offset = 0;
+                    std::uint64_t count = 0;
+                    fields >> type;
+                    if (type == "size") { fields >> size; }
+                    else if (type == "fetch" && (fields >> offset >> count)) { fetched += count; }
+                }
+                std::cout << "Fetches " << fetched << " of " << size << " bytes of the new package." << std::endl;
+            }
+            return hr;
+        });
+
+    return result;
+}
+
+Command CreatePatchCommand()
+{
+    Command result{ "patch", "Rebuild a new version of a package from a delta",
+        {
+            Option{ "-old", "Package to update from.", true, 1, "oldPackage" },
+            Option{ "-delta", "Delta file path, written by diff.", true, 1, "delta" },
+            Option{ "-ranges", "Ranges fetched from the new package, one after the other.", true, 1, "ranges" },
+            Option{ "-p", "Output package file path.", true, 1, "package" },
+            Option{ TOOL_HELP_COMMAND_STRING, "Displays this help text." },
+        }
+    };
+
+    result.SetDescription({
+        "Writes the new package of <delta> to <package> by copying ranges from",
+        "<oldPackage> and taking the fetched ones from <ranges>. Fails if the result",
+        "doesn't have the size and hash of the new package recorded in <delta>.",
+        });
+
+    result.SetInvocationFunc([](const Invocation& invocation)
+        {
+            return PatchPackage(
+                const_cast<char*>(invocation.GetOptionValue("-old").c_str()),
+                const_cast<char*>(invocation.GetOptionValue("-delta").c_str()),
+                const_cast<char*>(invocation.GetOptionValue("-ranges").c_str()),
+                const_cast<char*>(invocation.GetOptionValue("-p").c_str()));
         });
 
     return result;
@@ -535,6 +1167,8 @@ Command CreateUnbundleCommand()
             Option{ "-sp", "Skips matching packages with of the same system. By default unpacked application packages will only match the platform." },
             Option{ "-extract-all", "Extracts all packages from the bundle." },
             Option{ "-pfn-flat", "Unpacks bundle's files to a subdirectory under the specified output path, named after the package full name. Unpacks packages to subdirectories also under the specified output path, named after the package full name. By default unpacked packages will be nested inside the bundle folder." },
+            Option{ "-threads", "Unpacks several packages at once and extracts their files using up to <count> worker threads in total. 0 uses all the hardware threads.", false, 1, "count" },
+            Option{ "-packages-only", "Writes the applicable packages to the output path as package files, checked against the bundle block map, instead of unpacking them." },
             Option{ TOOL_HELP_COMMAND_STRING, "Displays this help text." },
         }
     };
@@ -549,12 +1183,18 @@ Command CreateUnbundleCommand()
 
     result.SetInvocationFunc([](const Invocation& invocation)
         {
-            return UnpackBundle(
+            UINT32 threadCount = 0;
+            if (invocation.IsOptionPresent("-threads"))
+            {
+                threadCount = static_cast<UINT32>(std::stoul(invocation.GetOptionValue("-threads")));
+            }
+            return UnpackBundleWithThreadCount(
                 GetPackUnpackOptionForBundle(invocation),
                 GetValidationOption(invocation),
                 GetApplicabilityOption(invocation),
                 const_cast<char*>(invocation.GetOptionValue("-p").c_str()),
-                const_cast<char*>(invocation.GetOptionValue("-d").c_str()));
+                const_cast<char*>(invocation.GetOptionValue("-d").c_str()),
+                threadCount);
         });
 
     return result;
@@ -566,7 +1206,17 @@ Command CreatePackCommand()
     Command result{ "pack", "Pack files from disk to a package",
         {
             Option{ "-d", "Input directory path.", true, 1, "directory" },
-            Option{ "-p", "Output package file path.", true, 1, "package" },
+            Option{ "-p", "Output package file path, - writes the package to the standard output.", true, 1, "package" },
+            Option{ "-threads", "Compresses the files using up to <count> worker threads. 0 uses all the hardware threads.", false, 1, "count" },
+            Option{ "-compression", "Compression level of the payload files: none, superfast, fast, normal (default) or maximum.", false, 1, "level" },
+            Option{ "-adaptive", "Stores the payload files whose first block doesn't compress well instead of deflating them." },
+            Option{ "-compact", "Writes the file sizes in the local file headers instead of a data descriptor after each file." },
+            Option{ "-dedup", "Deflates the payload files with the same content once and copies the deflated bytes for the others." },
+            Option{ "-base", "Previous build of the package. The blocks that didn't change are copied from it instead of compressed again.", false, 1, "basePackage" },
+            Option{ "-digests", "Writes the package ready to be signed and what its signature signs to <file>, the APPX digests of the SpcIndirectDataContent.", false, 1, "file" },
+            Option{ "-timebudget", "Lowers the compression level of the payload files left as needed to pack them in about <milliseconds>. Can't be used with -digests.", false, 1, "milliseconds" },
+            Option{ "-order", "Adds the payload files listed in <file>, one path per line such as the files read by a launch trace, first and in that order. Can't be used with -digests.", false, 1, "file" },
+            Option{ "-index", "Also writes the sidecar index of the package to <package>.msixidx, see the index command." },
             Option{ TOOL_HELP_COMMAND_STRING, "Displays this help text." },
         }
     };
@@ -579,11 +1229,122 @@ Command CreatePackCommand()
 
     result.SetInvocationFunc([](const Invocation& invocation)
         {
-            return PackPackage(
-                MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+            MSIX_PACKUNPACK_OPTION packUnpack = MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE;
+            UINT32 threadCount = 0;
+            if (invocation.IsOptionPresent("-threads"))
+            {
+                packUnpack |= MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_PARALLELCOMPRESSION;
+                threadCount = static_cast<UINT32>(std::stoul(invocation.GetOptionValue("-threads")));
+            }
+            if (invocation.IsOptionPresent("-adaptive"))
+            {
+                packUnpack |= MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_ADAPTIVECOMPRESSION;
+            }
+            if (invocation.IsOptionPresent("-compact"))
+            {
+                packUnpack |= MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_COMPACTZIPRECORDS;
+            }
+            if (invocation.IsOptionPresent("-dedup"))
+            {
+                packUnpack |= MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_REUSEDUPLICATES;
+            }
+            APPX_COMPRESSION_OPTION compression = APPX_COMPRESSION_OPTION_NORMAL;
+            if (invocation.IsOptionPresent("-compression"))
+            {
+                const auto& level = invocation.GetOptionValue("-compression");
+                if (level == "none") { compression = APPX_COMPRESSION_OPTION_NONE; }
+                else if (level == "superfast") { compression = APPX_COMPRESSION_OPTION_SUPERFAST; }
+                else if (level == "fast") { compression = APPX_COMPRESSION_OPTION_FAST; }
+                else if (level == "normal") { compression = APPX_COMPRESSION_OPTION_NORMAL; }
+                else if (level == "maximum") { compression = APPX_COMPRESSION_OPTION_MAXIMUM; }
+                else
+                {
+                    std::cout << "Error: invalid compression level " << level << std::endl;
+                    return static_cast<HRESULT>(E_INVALIDARG);
+                }
+            }
+            if (invocation.IsOptionPresent("-index") && (invocation.GetOptionValue("-p") == "-"))
+            {
+                std::cout << "Error: -index can't be used when the package is written to the standard output" << std::endl;
+                return static_cast<HRESULT>(E_INVALIDARG);
+            }
+            char* basePackage = (invocation.IsOptionPresent("-base")) ?
+                const_cast<char*>(invocation.GetOptionValue("-base").c_str()) : nullptr;
+            if (invocation.IsOptionPresent("-timebudget") || invocation.IsOptionPresent("-order"))
+            {
+                if (invocation.IsOptionPresent("-digests"))
+                {
+                    std::cout << "Error: -timebudget and -order can't be used with -digests" << std::endl;
+                    return static_cast<HRESULT>(E_INVALIDARG);
+                }
+                UINT32 timeBudget = invocation.IsOptionPresent("-timebudget") ?
+                    static_cast<UINT32>(std::stoul(invocation.GetOptionValue("-timebudget"))) : 0;
+                std::vector<std::string> files;
+                if (invocation.IsOptionPresent("-order"))
+                {
+                    std::ifstream order(invocation.GetOptionValue("-order"));
+                    if (!order)
+                    {
+                        std::cout << "Error: unable to read " << invocation.GetOptionValue("-order") << std::endl;
+                        return static_cast<HRESULT>(E_INVALIDARG);
+                    }
+                    std::string line;
+                    while (std::getline(order, line))
+                    {
+                        if (!line.empty() && (line.back() == '\r')) { line.pop_back(); }
+                        if (!line.empty()) { files.push_back(std::move(line)); }
+                    }
+                }
+                std::vector<char*> accessOrder;
+                for (auto& file : files) { accessOrder.push_back(const_cast<char*>(file.c_str())); }
+                return IndexPackedPackage(invocation, PackPackageWithAccessOrder(
+                    packUnpack,
+                    MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_FULL,
+                    const_cast<char*>(invocation.GetOptionValue("-d").c_str()),
+                    const_cast<char*>(invocation.GetOptionValue("-p").c_str()),
+                    threadCount,
+                    compression,
+                    basePackage,
+                    nullptr,
+                    timeBudget,
+                    static_cast<UINT32>(accessOrder.size()),
+                    accessOrder.data()));
+            }
+            if (invocation.IsOptionPresent("-digests"))
+            {
+                UINT32 size = 0;
+                BYTE* digests = nullptr;
+                HRESULT hr = PackPackageWithSigningDigests(
+                    packUnpack,
+                    MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_FULL,
+                    const_cast<char*>(invocation.GetOptionValue("-d").c_str()),
+                    const_cast<char*>(invocation.GetOptionValue("-p").c_str()),
+                    threadCount,
+                    compression,
+                    basePackage,
+                    nullptr,
+                    MyAllocate,
+                    &size,
+                    &digests);
+                if (FAILED(hr)) { return hr; }
+                std::ofstream file(invocation.GetOptionValue("-digests"), std::ios::binary);
+                file.write(reinterpret_cast<const char*>(digests), size);
+                MyFree(digests);
+                if (!file)
+                {
+                    std::cout << "Error: unable to write " << invocation.GetOptionValue("-digests") << std::endl;
+                    return static_cast<HRESULT>(E_FAIL);
+                }
+                return IndexPackedPackage(invocation, hr);
+            }
+            return IndexPackedPackage(invocation, PackPackageFromBase(
+                packUnpack,
                 MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_FULL,
                 const_cast<char*>(invocation.GetOptionValue("-d").c_str()),
-                const_cast<char*>(invocation.GetOptionValue("-p").c_str()));
+                const_cast<char*>(invocation.GetOptionValue("-p").c_str()),
+                threadCount,
+                compression,
+                basePackage));
         });
 
     return result;
@@ -606,6 +1367,9 @@ Command CreateBundleCommand()
                             "be package manifests in XML format if this option is specified." },
             Option{ "-fb", "Generates a fully sparse bundle where all packages are references to"
                            "packages that exist outside of the bundle file." },
+            Option{ "-rm", "Reads only the central directory and the manifest of the input packages. The packages "
+                           "aren't validated against their block maps and signatures unless -vp is specified." },
+            Option{ "-vp", "With -rm, validates all the input packages in parallel before the bundle is written." },
             Option{ "-o", "Forces the output to overwrite any existing files with the"
                            "same name.By default, the user is asked whether to overwrite existing"
                            "files with the same name.You can't use this option with /no." },
@@ -650,25 +1414,250 @@ Command CreateBundleCommand()
     return result;
 }
 
+Command CreateReplaceCommand()
+{
+    Command result{ "replace", "Replace the footprint files of a package in place",
+        {
+            Option{ "-p", "Package file path, edited in place.", true, 1, "package" },
+            Option{ "-signature", "New AppxSignature.p7x.", false, 1, "file" },
+            Option{ "-ci", "New AppxMetadata/CodeIntegrity.cat.", false, 1, "file" },
+            Option{ "-manifest", "New AppxManifest.xml.", false, 1, "file" },
+            Option{ "-blockmap", "New AppxBlockMap.xml.", false, 1, "file" },
+            Option{ TOOL_HELP_COMMAND_STRING, "Displays this help text." },
+        }
+    };
+
+    result.SetDescription({
+        "Replaces or adds the given footprint files of <package> without rewriting",
+        "its payload, only the files after them and the central directory are",
+        "written again. Use it to sign or re-sign a package with -signature.",
+        });
+
+    result.SetInvocationFunc([](const Invocation& invocation)
+        {
+            const std::pair<const char*, APPX_FOOTPRINT_FILE_TYPE> options[] = {
+                { "-signature", APPX_FOOTPRINT_FILE_TYPE_SIGNATURE },
+                { "-ci", APPX_FOOTPRINT_FILE_TYPE_CODEINTEGRITY },
+                { "-manifest", APPX_FOOTPRINT_FILE_TYPE_MANIFEST },
+                { "-blockmap", APPX_FOOTPRINT_FILE_TYPE_BLOCKMAP },
+            };
+            std::vector<APPX_FOOTPRINT_FILE_TYPE> types;
+            std::vector<IStream*> files;
+            HRESULT hr = S_OK;
+            for (const auto& option : options)
+            {
+                if (SUCCEEDED(hr) && invocation.IsOptionPresent(option.first))
+                {
+                    IStream* stream = nullptr;
+                    hr = CreateStreamOnFile(const_cast<char*>(invocation.GetOptionValue(option.first).c_str()), true, &stream);
+                    if (SUCCEEDED(hr))
+                    {
+                        types.push_back(option.second);
+                        files.push_back(stream);
+                    }
+                }
+            }
+            if (SUCCEEDED(hr) && files.empty())
+            {
+                std::cout << "Error: no footprint file to replace" << std::endl;
+                hr = static_cast<HRESULT>(E_INVALIDARG);
+            }
+            if (SUCCEEDED(hr))
+            {
+                hr = ReplaceFootprintFiles(
+                    const_cast<char*>(invocation.GetOptionValue("-p").c_str()),
+                    static_cast<UINT32>(files.size()),
+                    types.data(),
+                    files.data());
+            }
+            for (auto file : files) { file->Release(); }
+            return hr;
+        });
+
+    return result;
+}
+
 #endif
 
+// Splits a request line in arguments at white space. Double quotes group an argument with spaces, and within
+// them a backslash escapes a double quote or a backslash.
+std::vector<std::string> SplitRequest(const std::string& line)
+{
+    std::vector<std::string> args;
+    std::string arg;
+    bool inArg = false;
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); i++)
+    {
+        char c = line[i];
+        if (quoted)
+        {
+            if ((c == '\\') && (i + 1 < line.size()) && ((line[i + 1] == '"') || (line[i + 1] == '\\'))) { arg += line[++i]; }
+            else if (c == '"') { quoted = false; }
+            else { arg += c; }
+        }
+        else if (c == '"') { quoted = true; inArg = true; }
+        else if (std::isspace(static_cast<unsigned char>(c)))
+        {
+            if (inArg) { args.push_back(std::move(arg)); arg.clear(); inArg = false; }
+        }
+        else { arg += c; inArg = true; }
+    }
+    if (inArg) { args.push_back(std::move(arg)); }
+    return args;
+}
+
+// Runs the command of a request, the arguments after its id, as if it were the command line of the tool
+int RunRequest(const std::string& toolName, const std::vector<Command>& commands, const std::vector<std::string>& args, std::string& errorText)
+{
+    if (args.size() < 2)
+    {
+        errorText = "Missing command";
+        return static_cast<int>(E_INVALIDARG);
+    }
+    if ((args[1] == "serve") || (std::find(args.begin() + 2, args.end(), "-") != args.end()))
+    {
+        errorText = "The standard input and output are the requests and the responses";
+        return static_cast<int>(E_INVALIDARG);
+    }
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(toolName.c_str()));
+    for (size_t i = 1; i < args.size(); i++) { argv.push_back(const_cast<char*>(args[i].c_str())); }
+
+    Invocation request;
+    if (!request.Parse(commands, static_cast<int>(argv.size()), argv.data()))
+    {
+        errorText = request.GetErrorText();
+        return static_cast<int>(E_INVALIDARG);
+    }
+    int result = request.Run();
+    if (result != 0)
+    {
+        errorText = request.GetErrorText();
+    }
+    return result;
+}
+
+Command CreateServeCommand(const std::vector<Command>& commands)
+{
+    Command result{ "serve", "Runs the commands read from the standard input",
+        {
+            Option{ "-jobs", "Runs up to <count> commands at once. 0, the default, uses all the hardware threads.", false, 1, "count" },
+            Option{ TOOL_HELP_COMMAND_STRING, "Displays this help text." },
+        }
+    };
+
+    result.SetDescription({
+        "Keeps running and reads requests from the standard input, one per line, as",
+        "'<id> <command> [options]' with the options of the command. Requests run",
+        "concurrently in a single process, which decodes the schemas and the trusted",
+        "certificates once for all of them. The response to each request is written",
+        "to the standard output once it completes, in the order they complete, as",
+        "'<id> 0x<result> [error]'. Any other text goes to the standard error. Ends",
+        "when the standard input does, after the last request completes.",
+        });
+
+    result.SetInvocationFunc([&commands](const Invocation& invocation)
+        {
+            unsigned int jobs = 0;
+            if (invocation.IsOptionPresent("-jobs"))
+            {
+                jobs = static_cast<unsigned int>(std::stoul(invocation.GetOptionValue("-jobs")));
+            }
+            if (jobs == 0)
+            {
+                jobs = std::max(std::thread::hardware_concurrency(), 1u);
+            }
+
+            // Each worker takes the next request when it's done with its own
+            std::mutex inputLock;
+            std::mutex outputLock;
+            auto worker = [&]()
+            {
+                std::string line;
+                while (true)
+                {
+                    {
+                        std::lock_guard<std::mutex> lock(inputLock);
+                        if (!std::getline(std::cin, line)) { return; }
+                    }
+                    auto args = SplitRequest(line);
+                    if (args.empty()) { continue; }
+
+                    std::string errorText;
+                    int hr = RunRequest(invocation.GetToolName(), commands, args, errorText);
+                    std::ostringstream response;
+                    response << args[0] << " 0x" << std::hex << hr;
+                    if (!errorText.empty()) { response << " " << errorText; }
+                    response << "\n";
+                    auto text = response.str();
+
+                    std::lock_guard<std::mutex> lock(outputLock);
+                    std::fwrite(text.data(), 1, text.size(), stdout);
+                    std::fflush(stdout);
+                }
+            };
+            std::vector<std::thread> workers;
+            for (unsigned int i = 0; i < jobs; i++)
+            {
+                workers.emplace_back(worker);
+            }
+            for (auto& thread : workers)
+            {
+                thread.join();
+            }
+            return 0;
+        });
+
+    return result;
+}
+
 #pragma endregion
 
 // Defines the grammar of commands and each command's associated options,
 int main(int argc, char* argv[])
 {
+    // A package written to the standard output keeps it to itself, the text goes to the standard error. So do
+    // the responses of serve and the JSON lines of info.
+    if ((argc > 1) && (strcmp(argv[1], "serve") == 0))
+    {
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+    for (int index = 2; (argc > 1) && (strcmp(argv[1], "info") == 0) && (index < argc); index++)
+    {
+        if (strcmp(argv[index], "-json") == 0)
+        {
+            std::cout.rdbuf(std::cerr.rdbuf());
+        }
+    }
+    for (int index = 2; (argc > 1) && (strcmp(argv[1], "pack") == 0) && (index + 1 < argc); index++)
+    {
+        if ((strcmp(argv[index], "-p") == 0) && (strcmp(argv[index + 1], "-") == 0))
+        {
+            std::cout.rdbuf(std::cerr.rdbuf());
+        }
+    }
+
     std::cout << "Microsoft (R) makemsix version " << SDK_VERSION << std::endl;
     std::cout << "Copyright (C) 2017 Microsoft.  All rights reserved." << std::endl;
 
     std::vector<Command> commands = {
         CreateUnpackCommand(),
         CreateUnbundleCommand(),
+        CreateVerifyCommand(),
+        CreateInfoCommand(),
+        CreateIndexCommand(),
+        CreateDiffCommand(),
+        CreatePatchCommand(),
         #ifdef MSIX_PACK
         CreatePackCommand(),
         CreateBundleCommand(),
+        CreateReplaceCommand(),
         #endif
     };
 
+    commands.emplace_back(CreateServeCommand(commands));
+
     // Help command is always last
     commands.emplace_back(CreateHelpCommand(commands));
     const Command& mainHelpCommand = commands.back();
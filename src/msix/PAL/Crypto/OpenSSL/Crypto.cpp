@@ -8,45 +8,366 @@
 #include "openssl/sha.h"
 #include "openssl/evp.h"
 
+#include <algorithm>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define MSIX_SHA256_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
 namespace MSIX {
+
+#ifdef MSIX_SHA256_X86
+    // The bundled OpenSSL is built without its assembly, so its SHA256 is portable C. Where the CPU has the SHA
+    // extensions, blocks are hashed here instead, two buffers at a time, as the rounds of one message depend on each
+    // other and two independent messages keep the SHA units busy.
+    namespace {
+
+        #define MSIX_SHA256_TARGET __attribute__((target("sha,sse4.1,ssse3")))
+        #define MSIX_SHA256_INLINE inline __attribute__((always_inline, target("sha,sse4.1,ssse3")))
+
+        const std::uint32_t Sha256InitialState[8] = {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+
+        alignas(16) const std::uint32_t Sha256RoundConstants[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+        bool CpuHasShaExtensions()
+        {
+            unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+            if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSSE3) || !(ecx & bit_SSE4_1))
+            {
+                return false;
+            }
+            if (__get_cpuid_max(0, nullptr) < 7)
+            {
+                return false;
+            }
+            __cpuid_count(7, 0, eax, ebx, ecx, edx);
+            return (ebx & (1u << 29)) != 0; // SHA
+        }
+
+        bool UseShaExtensions()
+        {
+            static const bool result = CpuHasShaExtensions();
+            return result;
+        }
+
+        void WriteDigest(const std::uint32_t* state, Sha256Digest& hash)
+        {
+            for (std::size_t i = 0; i < 8; i++)
+            {
+                hash[i * 4]     = static_cast<std::uint8_t>(state[i] >> 24);
+                hash[i * 4 + 1] = static_cast<std::uint8_t>(state[i] >> 16);
+                hash[i * 4 + 2] = static_cast<std::uint8_t>(state[i] >> 8);
+                hash[i * 4 + 3] = static_cast<std::uint8_t>(state[i]);
+            }
+        }
+
+        // Builds the last one or two blocks of a message of length bytes, from the bytes after its last whole
+        // block. Returns the number of blocks.
+        std::size_t BuildTail(std::uint8_t* tail, const std::uint8_t* remaining, std::size_t remainingSize, std::uint64_t length)
+        {
+            std::size_t tailSize = (remainingSize < 56) ? 64 : 128;
+            std::memset(tail, 0, tailSize);
+            if (remainingSize != 0) { std::memcpy(tail, remaining, remainingSize); }
+            tail[remainingSize] = 0x80;
+            std::uint64_t bits = length * 8;
+            for (std::size_t i = 0; i < 8; i++)
+            {
+                tail[tailSize - 1 - i] = static_cast<std::uint8_t>(bits >> (i * 8));
+            }
+            return tailSize / 64;
+        }
+
+        // Working registers of one message while its blocks are compressed.
+        struct Sha256Lane
+        {
+            __m128i abef, cdgh, abefSave, cdghSave;
+            __m128i w[4];
+        };
+
+        MSIX_SHA256_INLINE void LoadState(Sha256Lane& lane, const std::uint32_t* state)
+        {
+            __m128i dcba = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0xB1);
+            __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4)), 0x1B);
+            lane.abef = _mm_alignr_epi8(dcba, efgh, 8);
+            lane.cdgh = _mm_blend_epi16(efgh, dcba, 0xF0);
+        }
+
+        MSIX_SHA256_INLINE void StoreState(const Sha256Lane& lane, std::uint32_t* state)
+        {
+            __m128i feba = _mm_shuffle_epi32(lane.abef, 0x1B);
+            __m128i dchg = _mm_shuffle_epi32(lane.cdgh, 0xB1);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_blend_epi16(feba, dchg, 0xF0));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), _mm_alignr_epi8(dchg, feba, 8));
+        }
+
+        MSIX_SHA256_INLINE void StartBlock(Sha256Lane& lane, const std::uint8_t* block)
+        {
+            const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+            lane.abefSave = lane.abef;
+            lane.cdghSave = lane.cdgh;
+            for (int i = 0; i < 4; i++)
+            {
+                lane.w[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i * 16)), byteSwap);
+            }
+        }
+
+        MSIX_SHA256_INLINE void EndBlock(Sha256Lane& lane)
+        {
+            lane.abef = _mm_add_epi32(lane.abef, lane.abefSave);
+            lane.cdgh = _mm_add_epi32(lane.cdgh, lane.cdghSave);
+        }
+
+        // Four rounds, and the message schedule for the rounds that come later.
+        template <int Group>
+        MSIX_SHA256_INLINE void Rounds(Sha256Lane& lane)
+        {
+            __m128i& current = lane.w[Group % 4];
+            __m128i& next = lane.w[(Group + 1) % 4];
+            __m128i& previous = lane.w[(Group + 3) % 4];
+            __m128i message = _mm_add_epi32(current, _mm_load_si128(reinterpret_cast<const __m128i*>(Sha256RoundConstants + Group * 4)));
+            lane.cdgh = _mm_sha256rnds2_epu32(lane.cdgh, lane.abef, message);
+            if (Group >= 3 && Group <= 14)
+            {
+                next = _mm_sha256msg2_epu32(_mm_add_epi32(next, _mm_alignr_epi8(current, previous, 4)), current);
+            }
+            lane.abef = _mm_sha256rnds2_epu32(lane.abef, lane.cdgh, _mm_shuffle_epi32(message, 0x0E));
+            if (Group >= 1 && Group <= 12)
+            {
+                previous = _mm_sha256msg1_epu32(previous, current);
+            }
+        }
+
+        template <int Group>
+        MSIX_SHA256_INLINE void RoundsFrom(Sha256Lane& lane)
+        {
+            Rounds<Group>(lane);
+            RoundsFrom<Group + 1>(lane);
+        }
+
+        template <>
+        MSIX_SHA256_INLINE void RoundsFrom<16>(Sha256Lane&) {}
+
+        template <int Group>
+        MSIX_SHA256_INLINE void RoundsFrom(Sha256Lane& first, Sha256Lane& second)
+        {
+            Rounds<Group>(first);
+            Rounds<Group>(second);
+            RoundsFrom<Group + 1>(first, second);
+        }
+
+        template <>
+        MSIX_SHA256_INLINE void RoundsFrom<16>(Sha256Lane&, Sha256Lane&) {}
+
+        MSIX_SHA256_TARGET void CompressBlocks(std::uint32_t* state, const std::uint8_t* blocks, std::size_t count)
+        {
+            Sha256Lane lane;
+            LoadState(lane, state);
+            for (std::size_t block = 0; block < count; block++)
+            {
+                StartBlock(lane, blocks + block * 64);
+                RoundsFrom<0>(lane);
+                EndBlock(lane);
+            }
+            StoreState(lane, state);
+        }
+
+        // A message hashed by HashWithShaExtensions. The whole blocks are read from the buffer, the last one or
+        // two blocks with the padding and the length are built in tail.
+        struct Sha256Message
+        {
+            const std::uint8_t* buffer = nullptr;
+            std::size_t wholeBlocks = 0;
+            std::size_t blockCount = 0;
+            std::uint8_t tail[128];
+            std::uint32_t state[8];
+
+            void Initialize(const std::uint8_t* data, std::uint32_t size)
+            {
+                buffer = data;
+                wholeBlocks = size / 64;
+                blockCount = wholeBlocks + BuildTail(tail, data + wholeBlocks * 64, size % 64, size);
+                std::memcpy(state, Sha256InitialState, sizeof(state));
+            }
+
+            const std::uint8_t* Block(std::size_t index) const
+            {
+                return (index < wholeBlocks) ? (buffer + index * 64) : (tail + (index - wholeBlocks) * 64);
+            }
+
+            void CompressFrom(std::size_t block)
+            {
+                if (block < wholeBlocks)
+                {
+                    CompressBlocks(state, buffer + block * 64, wholeBlocks - block);
+                    block = wholeBlocks;
+                }
+                CompressBlocks(state, tail + (block - wholeBlocks) * 64, blockCount - block);
+            }
+        };
+
+        MSIX_SHA256_TARGET void CompressTwo(Sha256Message& first, Sha256Message& second, std::size_t count)
+        {
+            Sha256Lane firstLane, secondLane;
+            LoadState(firstLane, first.state);
+            LoadState(secondLane, second.state);
+            for (std::size_t block = 0; block < count; block++)
+            {
+                StartBlock(firstLane, first.Block(block));
+                StartBlock(secondLane, second.Block(block));
+                RoundsFrom<0>(firstLane, secondLane);
+                EndBlock(firstLane);
+                EndBlock(secondLane);
+            }
+            StoreState(firstLane, first.state);
+            StoreState(secondLane, second.state);
+        }
+
+        void HashWithShaExtensions(const HashRequest* first, const HashRequest* second)
+        {
+            Sha256Message messages[2];
+            messages[0].Initialize(first->buffer, first->size);
+            std::size_t shared = 0;
+            if (second != nullptr)
+            {
+                messages[1].Initialize(second->buffer, second->size);
+                shared = std::min(messages[0].blockCount, messages[1].blockCount);
+                CompressTwo(messages[0], messages[1], shared);
+                messages[1].CompressFrom(shared);
+                WriteDigest(messages[1].state, *second->hash);
+            }
+            messages[0].CompressFrom(shared);
+            WriteDigest(messages[0].state, *first->hash);
+        }
+
+        // State of a SHA256 engine that streams data through the SHA extensions.
+        struct ShaExtensionsContext
+        {
+            std::uint32_t state[8];
+            std::uint8_t pending[64];
+            std::uint64_t length;
+        };
+        static_assert(sizeof(ShaExtensionsContext) <= sizeof(SHA256::Context), "SHA256::Context is too small");
+    }
+#endif
+
+    static_assert(sizeof(SHA256_CTX) <= sizeof(SHA256::Context), "SHA256::Context is too small");
+
     SHA256::SHA256()
     {
-        m_hashContext = new SHA256_CTX;
         Reset();
     }
 
-    SHA256::~SHA256()
+    SHA256::~SHA256() = default;
+
+    void SHA256::Reset()
     {
-        if (m_hashContext != nullptr)
+        #ifdef MSIX_SHA256_X86
+        if (UseShaExtensions())
         {
-            // Linux, aosp (Android) and iOS compilers do not allow delete a void pointer, hence the casting.
-            delete (SHA256_CTX*)m_hashContext;
+            auto context = reinterpret_cast<ShaExtensionsContext*>(&m_context);
+            std::memcpy(context->state, Sha256InitialState, sizeof(context->state));
+            context->length = 0;
+            return;
         }
+        #endif
+        ThrowErrorIfNot(Error::Unexpected, ::SHA256_Init(reinterpret_cast<SHA256_CTX*>(&m_context)), "SHA256_Init failed");
     }
 
-    void SHA256::Reset()
+    void SHA256::HashData(const std::uint8_t* buffer, std::uint32_t cbBuffer)
     {
-        ThrowErrorIfNot(Error::Unexpected, ::SHA256_Init((SHA256_CTX*)m_hashContext), "SHA256_Init failed");
+        #ifdef MSIX_SHA256_X86
+        if (UseShaExtensions())
+        {
+            auto context = reinterpret_cast<ShaExtensionsContext*>(&m_context);
+            std::size_t pending = static_cast<std::size_t>(context->length % 64);
+            context->length += cbBuffer;
+            if (pending != 0)
+            {
+                std::size_t count = std::min<std::size_t>(64 - pending, cbBuffer);
+                std::memcpy(context->pending + pending, buffer, count);
+                buffer += count;
+                cbBuffer -= static_cast<std::uint32_t>(count);
+                if (pending + count < 64) { return; }
+                CompressBlocks(context->state, context->pending, 1);
+            }
+            CompressBlocks(context->state, buffer, cbBuffer / 64);
+            if (cbBuffer % 64 != 0)
+            {
+                std::memcpy(context->pending, buffer + (cbBuffer - cbBuffer % 64), cbBuffer % 64);
+            }
+            return;
+        }
+        #endif
+        ThrowErrorIfNot(Error::Unexpected, ::SHA256_Update(reinterpret_cast<SHA256_CTX*>(&m_context), buffer, cbBuffer), "SHA256_Update failed");
     }
 
-    void SHA256::HashData(const std::uint8_t* buffer, std::uint32_t cbBuffer)
+    void SHA256::FinalizeAndGetHashValue(Sha256Digest& hash)
     {
-        ThrowErrorIfNot(Error::Unexpected, ::SHA256_Update((SHA256_CTX*)m_hashContext, buffer, cbBuffer), "SHA256_Update failed");
+        #ifdef MSIX_SHA256_X86
+        if (UseShaExtensions())
+        {
+            auto context = reinterpret_cast<ShaExtensionsContext*>(&m_context);
+            std::uint8_t tail[128];
+            auto blocks = BuildTail(tail, context->pending, static_cast<std::size_t>(context->length % 64), context->length);
+            CompressBlocks(context->state, tail, blocks);
+            WriteDigest(context->state, hash);
+            return;
+        }
+        #endif
+        ThrowErrorIfNot(Error::Unexpected, ::SHA256_Final(hash.data(), reinterpret_cast<SHA256_CTX*>(&m_context)), "SHA256_Final failed");
     }
 
     void SHA256::FinalizeAndGetHashValue(std::vector<uint8_t>& hash)
     {
-        hash.resize(SHA256_DIGEST_LENGTH);
-        ThrowErrorIfNot(Error::Unexpected, ::SHA256_Final(hash.data(), (SHA256_CTX*)m_hashContext), "SHA256_Final failed");
+        Sha256Digest digest;
+        FinalizeAndGetHashValue(digest);
+        hash.assign(digest.begin(), digest.end());
+    }
+
+    void SHA256::ComputeHash(const std::uint8_t* buffer, std::uint32_t cbBuffer, Sha256Digest& hash)
+    {
+        HashRequest request = { buffer, cbBuffer, &hash };
+        ComputeHashes(&request, 1);
     }
 
     bool SHA256::ComputeHash(const std::uint8_t *buffer, std::uint32_t cbBuffer, std::vector<uint8_t>& hash)
     {
-        hash.resize(SHA256_DIGEST_LENGTH);
-        ::SHA256(buffer, cbBuffer, hash.data());
+        Sha256Digest digest;
+        ComputeHash(buffer, cbBuffer, digest);
+        hash.assign(digest.begin(), digest.end());
         return true;
     }
 
+    void SHA256::ComputeHashes(const HashRequest* requests, std::size_t count)
+    {
+        #ifdef MSIX_SHA256_X86
+        if (UseShaExtensions())
+        {
+            for (std::size_t index = 0; index < count; index += 2)
+            {
+                HashWithShaExtensions(&requests[index], (index + 1 < count) ? &requests[index + 1] : nullptr);
+            }
+            return;
+        }
+        #endif
+        for (std::size_t index = 0; index < count; index++)
+        {
+            ::SHA256(requests[index].buffer, requests[index].size, requests[index].hash->data());
+        }
+    }
+
     std::string Base64::ComputeBase64(const std::vector<std::uint8_t>& buffer)
     {
         int expectedSize = ((buffer.size() +2)/3)*4; // +2 for a cheap round up if it needs padding
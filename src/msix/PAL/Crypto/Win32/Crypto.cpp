@@ -35,7 +35,7 @@ namespace MSIX {
     class NtStatusException final : public Exception
     {
     public:
-        NtStatusException(std::string& message, NTSTATUS error) : Exception(message, static_cast<std::uint32_t>(error)) {}
+        NtStatusException(const char* file, int line, const char* details, NTSTATUS error) : Exception(file, line, details, static_cast<HRESULT>(error)) {}
     };
 
     #define ThrowStatusIfFailed(a, m)                                                      \
@@ -45,54 +45,57 @@ namespace MSIX {
         }                                                                                  \
     }
     
-    SHA256::SHA256()
-    {
-        Reset();
-    }
-
-    SHA256::~SHA256()
+    // The algorithm provider is opened once, and loads a provider which supports reusable hash objects. Those are
+    // reset by BCryptFinishHash and can take the next data right away.
+    static BCRYPT_ALG_HANDLE GetSha256Provider()
     {
-        if (m_hashContext != nullptr)
+        static unique_alg_handle algHandle([]()
         {
-            (void)BCryptDestroyHash(m_hashContext);
-        }
+            BCRYPT_ALG_HANDLE algHandleT;
+            ThrowStatusIfFailed(BCryptOpenAlgorithmProvider(
+                &algHandleT,                // Alg Handle pointer
+                BCRYPT_SHA256_ALGORITHM,    // Cryptographic Algorithm name (null terminated unicode string)
+                nullptr,                    // Provider name; if null, the default provider is loaded
+                BCRYPT_HASH_REUSABLE_FLAG), // Flags; Loads a provider which supports reusable hash
+                "failed computing SHA256 hash");
+            return algHandleT;
+        }());
+        return algHandle.get();
     }
 
-    void SHA256::Reset()
+    SHA256::SHA256()
     {
-        if (m_hashContext != nullptr)
-        {
-            (void)BCryptDestroyHash(m_hashContext);
-            m_hashContext = nullptr;
-        }
-
         BCRYPT_HASH_HANDLE hashHandleT;
-        BCRYPT_ALG_HANDLE algHandleT;
-
-        // Open an algorithm handle
-        // This code passes BCRYPT_HASH_REUSABLE_FLAG with BCryptAlgorithmProvider(...) to load a provider which supports reusable hash
-        ThrowStatusIfFailed(BCryptOpenAlgorithmProvider(
-            &algHandleT,                 // Alg Handle pointer
-            BCRYPT_SHA256_ALGORITHM,    // Cryptographic Algorithm name (null terminated unicode string)
-            nullptr,                    // Provider name; if null, the default provider is loaded
-            0),                         // Flags; Loads a provider which supports reusable hash
-            "failed computing SHA256 hash");
-        unique_alg_handle algHandle(algHandleT);
 
         // Create a hash handle
         ThrowStatusIfFailed(BCryptCreateHash(
-            algHandle.get(),            // Handle to an algorithm provider                 
+            GetSha256Provider(),        // Handle to an algorithm provider
             &hashHandleT,               // A pointer to a hash handle - can be a hash or hmac object
             nullptr,                    // Pointer to the buffer that receives the hash/hmac object
             0,                          // Size of the buffer in bytes
             nullptr,                    // A pointer to a key to use for the hash or MAC
             0,                          // Size of the key in bytes
-            0),                         // Flags
+            BCRYPT_HASH_REUSABLE_FLAG), // Flags
             "failed computing SHA256 hash");
 
         m_hashContext = hashHandleT;
     }
-    
+
+    SHA256::~SHA256()
+    {
+        if (m_hashContext != nullptr)
+        {
+            (void)BCryptDestroyHash(m_hashContext);
+        }
+    }
+
+    void SHA256::Reset()
+    {
+        // Finishing a reusable hash discards what was hashed so far
+        Sha256Digest discarded;
+        FinalizeAndGetHashValue(discarded);
+    }
+
     void SHA256::HashData(const std::uint8_t* buffer, std::uint32_t cbBuffer)
     {
         ThrowErrorIf(Error::InvalidState, m_hashContext == nullptr, "HashData is called before hash context is initialized.");
@@ -105,13 +108,10 @@ namespace MSIX {
             "failed computing SHA256 hash");
     }
 
-    void SHA256::FinalizeAndGetHashValue(std::vector<uint8_t>& hash)
+    void SHA256::FinalizeAndGetHashValue(Sha256Digest& hash)
     {
         ThrowErrorIf(Error::InvalidState, m_hashContext == nullptr, "HashData is called before hash context is initialized.");
 
-        // Size the hash buffer appropriately
-        hash.resize(SHA256_DIGEST_LENGTH);
-
         // Obtain the hash of the message(s) into the hash buffer
         ThrowStatusIfFailed(BCryptFinishHash(
             m_hashContext,              // Handle to the hash or MAC object
@@ -119,19 +119,49 @@ namespace MSIX {
             static_cast<ULONG>(hash.size()),   // Size of the buffer in bytes
             0),                         // Flags
             "failed computing SHA256 hash");
+    }
+
+    void SHA256::FinalizeAndGetHashValue(std::vector<uint8_t>& hash)
+    {
+        Sha256Digest digest;
+        FinalizeAndGetHashValue(digest);
+        hash.assign(digest.begin(), digest.end());
+    }
 
-        (void)BCryptDestroyHash(m_hashContext);
-        m_hashContext = nullptr;
+    void SHA256::ComputeHash(const std::uint8_t* buffer, std::uint32_t cbBuffer, Sha256Digest& hash)
+    {
+        HashRequest request = { buffer, cbBuffer, &hash };
+        ComputeHashes(&request, 1);
     }
 
     bool SHA256::ComputeHash(const std::uint8_t* buffer, std::uint32_t cbBuffer, std::vector<uint8_t>& hash)
     {
-        SHA256 hashEngine;
-        hashEngine.HashData(buffer, cbBuffer);
-        hashEngine.FinalizeAndGetHashValue(hash);
+        Sha256Digest digest;
+        ComputeHash(buffer, cbBuffer, digest);
+        hash.assign(digest.begin(), digest.end());
         return true;
     }
 
+    void SHA256::ComputeHashes(const HashRequest* requests, std::size_t count)
+    {
+        // CNG picks the SHA extensions of the CPU by itself, what matters here is to not create a hash object per
+        // buffer. Each thread keeps one for the one shot hashes.
+        thread_local SHA256 hashEngine;
+        for (std::size_t index = 0; index < count; index++)
+        {
+            try
+            {
+                hashEngine.HashData(requests[index].buffer, requests[index].size);
+                hashEngine.FinalizeAndGetHashValue(*requests[index].hash);
+            }
+            catch (...)
+            {   // Don't leave a partial hash for the next caller on this thread
+                hashEngine.Reset();
+                throw;
+            }
+        }
+    }
+
     std::string Base64::ComputeBase64(const std::vector<std::uint8_t>& buffer)
     {
         std::wstring result;
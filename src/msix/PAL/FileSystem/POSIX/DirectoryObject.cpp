@@ -5,49 +5,70 @@
 #include "Exceptions.hpp"
 #include "StreamBase.hpp"
 #include "DirectoryObject.hpp"
+#include "DirectoryWalker.hpp"
+#include "NativeFileStream.hpp"
+#include "AsyncWriteStream.hpp"
 #include "MsixFeatureSelector.hpp"
+#include "ScopeExit.hpp"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <fts.h>
 #include <dirent.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstring>
 #include <map>
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
+#elif defined(__APPLE__)
+#include <sys/clonefile.h>
+#endif
 
 namespace MSIX
 {
     namespace
     {
-        template<class Lambda>
-        void WalkDirectory(const std::string& root, Lambda& visitor)
+        // Enumerates one directory of the tree opened as rootFd. The directory is opened and its entries
+        // are stat'ed relative to file descriptors, so the kernel doesn't resolve the full path every time.
+        void EnumerateDirectory(int rootFd, const std::string& directory,
+            const std::function<void(std::string&&)>& addDirectory, DirectoryWalkerFiles& files)
         {
-            static std::string dot(".");
-            static std::string dotdot("..");
-
-            std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(root.c_str()), closedir);
-            ThrowErrorIf(Error::FileNotFound, dir.get() == nullptr, "Invalid directory");
+            int fd = directory.empty() ? dup(rootFd) : openat(rootFd, directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            ThrowErrorIf(Error::FileNotFound, fd == -1, "Invalid directory");
+            std::unique_ptr<DIR, decltype(&closedir)> dir(fdopendir(fd), closedir);
+            if (dir.get() == nullptr)
+            {
+                close(fd);
+                ThrowErrorAndLog(Error::FileNotFound, "Invalid directory");
+            }
+            std::string prefix = directory.empty() ? directory : directory + "/";
             struct dirent* dp;
             // TODO: handle junction loops
             while((dp = readdir(dir.get())) != nullptr)
             {
-                std::string fileName = std::string(dp->d_name);
-                std::string child = root + "/" + fileName;
+                if ((std::strcmp(dp->d_name, ".") == 0) || (std::strcmp(dp->d_name, "..") == 0))
+                {
+                    continue;
+                }
                 if (dp->d_type == DT_DIR)
                 {
-                    if ((fileName != dot) && (fileName != dotdot))
-                    {
-                        WalkDirectory(child, visitor);
-                    }
+                    addDirectory(prefix + dp->d_name);
+                    continue;
                 }
-                else
+                // TODO: ignore .DS_STORE for mac?
+                struct stat sb;
+                ThrowErrorIf(Error::Unexpected, fstatat(dirfd(dir.get()), dp->d_name, &sb, 0) == -1, std::string("stat call failed" + std::to_string(errno)).c_str());
+                // Some file systems don't report the entry type
+                if ((dp->d_type == DT_UNKNOWN) && S_ISDIR(sb.st_mode))
                 {
-                    // TODO: ignore .DS_STORE for mac?
-                    struct stat sb;
-                    ThrowErrorIf(Error::Unexpected, stat(child.c_str(), &sb) == -1, std::string("stat call failed" + std::to_string(errno)).c_str());
-                    if (!visitor(root, std::move(fileName), static_cast<std::uint64_t>(sb.st_mtime)))
-                    {
-                        break;
-                    }
+                    addDirectory(prefix + dp->d_name);
+                    continue;
                 }
+                files.emplace_back(static_cast<std::uint64_t>(sb.st_mtime), prefix + dp->d_name);
             }
         }
 
@@ -67,6 +88,31 @@ namespace MSIX
                 if (*p != '\0') {p++;}
             }
         }
+
+        // Makes the temporary names of the files being linked unique in the process
+        std::atomic<std::uint64_t> linkCount{ 0 };
+
+        // Clones source as target, which must not exist, on file systems that share extents between files
+        bool CloneFile(const std::string& source, const std::string& target)
+        {
+            #if defined(__APPLE__)
+            return clonefile(source.c_str(), target.c_str(), 0) == 0;
+            #elif defined(FICLONE)
+            int sourceFd = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+            if (sourceFd == -1) { return false; }
+            auto closeSource = MSIX::scope_exit([sourceFd] { close(sourceFd); });
+            struct stat sb;
+            if (fstat(sourceFd, &sb) == -1) { return false; }
+            int targetFd = open(target.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, sb.st_mode & 0777);
+            if (targetFd == -1) { return false; }
+            bool cloned = (ioctl(targetFd, FICLONE, sourceFd) == 0);
+            close(targetFd);
+            if (!cloned) { unlink(target.c_str()); }
+            return cloned;
+            #else
+            return false;
+            #endif
+        }
     }
 
     std::vector<std::string> DirectoryObject::GetFileNames(FileNameOptions)
@@ -90,33 +136,160 @@ namespace MSIX
         }
     }
 
-    ComPtr<IStream> DirectoryObject::OpenFile(const std::string& fileName, MSIX::FileStream::Mode mode)
+    void DirectoryObject::EnsureDirectoryExists(const std::string& directory)
+    {
+        if (directory.empty())
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_directoriesLock);
+            if (m_createdDirectories.find(directory) != m_createdDirectories.end())
+            {
+                return;
+            }
+        }
+        auto lastSlash = directory.find_last_of(GetPathSeparator());
+        if (lastSlash != std::string::npos)
+        {
+            EnsureDirectoryExists(directory.substr(0, lastSlash));
+        }
+        std::string path = m_root + GetPathSeparator() + directory;
+        ThrowErrorIfNot(Error::FileCreateDirectory, (mkdir(path.c_str(), DEFAULT_MODE) != -1 || errno == EEXIST), path.c_str());
+        std::lock_guard<std::mutex> lock(m_directoriesLock);
+        m_createdDirectories.insert(directory);
+    }
+
+    void DirectoryObject::CreateDirectories(const std::vector<std::string>& fileNames)
+    {
+        for (const auto& fileName : fileNames)
+        {
+            auto lastSlash = fileName.find_last_of(GetPathSeparator());
+            if (lastSlash != std::string::npos)
+            {
+                EnsureDirectoryExists(fileName.substr(0, lastSlash));
+            }
+        }
+    }
+
+    ComPtr<IStream> DirectoryObject::OpenFile(const std::string& fileName, MSIX::FileStream::Mode mode, std::uint64_t expectedSize)
     {
         std::string name = m_root + GetPathSeparator() + fileName;
-        auto lastSlash = name.find_last_of(GetPathSeparator());
-        std::string path = name.substr(0, lastSlash);
-        mkdirp(path, m_root.size());
-        auto result = ComPtr<IStream>::Make<FileStream>(std::move(name), mode);
+        auto lastSlash = fileName.find_last_of(GetPathSeparator());
+        if (lastSlash != std::string::npos)
+        {
+            EnsureDirectoryExists(fileName.substr(0, lastSlash));
+        }
+        auto result = ComPtr<IStream>::Make<NativeFileStream>(std::move(name), mode, expectedSize);
+        if (mode == FileStream::Mode::WRITE)
+        {   // Large files are written on a background thread. Callers must Commit to get write failures.
+            result = ComPtr<IStream>::Make<AsyncWriteStream>(result);
+        }
         return result;
     }
 
+    std::unique_ptr<MappedOutputFile> DirectoryObject::OpenMappedFile(const std::string& fileName, std::uint64_t size)
+    {
+        std::string name = m_root + GetPathSeparator() + fileName;
+        auto lastSlash = fileName.find_last_of(GetPathSeparator());
+        if (lastSlash != std::string::npos)
+        {
+            EnsureDirectoryExists(fileName.substr(0, lastSlash));
+        }
+        return MappedOutputFile::Create(name, size);
+    }
+
+    std::string DirectoryObject::GetFilePath(const std::string& fileName)
+    {
+        return m_root + GetPathSeparator() + fileName;
+    }
+
+    bool DirectoryObject::LinkFile(const std::string& fileName, const std::string& sourcePath)
+    {
+        std::string name = m_root + GetPathSeparator() + fileName;
+        auto lastSlash = fileName.find_last_of(GetPathSeparator());
+        if (lastSlash != std::string::npos)
+        {
+            EnsureDirectoryExists(fileName.substr(0, lastSlash));
+        }
+
+        // Linked under a temporary name and renamed, so an existing file is replaced at once
+        std::string temporary = name + ".link" + std::to_string(getpid()) + "." + std::to_string(++linkCount);
+        if (!CloneFile(sourcePath, temporary) && (link(sourcePath.c_str(), temporary.c_str()) == -1))
+        {
+            return false;
+        }
+        if (rename(temporary.c_str(), name.c_str()) == -1)
+        {
+            unlink(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    bool DirectoryObject::CopyFileRange(const std::string& fileName, const std::string& sourcePath, std::uint64_t offset, std::uint64_t size)
+    {
+        #if defined(__linux__) && defined(SYS_copy_file_range)
+        std::string name = m_root + GetPathSeparator() + fileName;
+        auto lastSlash = fileName.find_last_of(GetPathSeparator());
+        if (lastSlash != std::string::npos)
+        {
+            EnsureDirectoryExists(fileName.substr(0, lastSlash));
+        }
+
+        int sourceFd = open(sourcePath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (sourceFd == -1) { return false; }
+        auto closeSource = MSIX::scope_exit([sourceFd] { close(sourceFd); });
+        int targetFd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+        if (targetFd == -1) { return false; }
+        auto closeTarget = MSIX::scope_exit([targetFd] { close(targetFd); });
+
+        // Called through syscall, the C library may be older than the kernel. Kernels that can't copy between
+        // these files, or that don't have the call, fail it and the file is written by the caller.
+        loff_t sourceOffset = static_cast<loff_t>(offset);
+        loff_t targetOffset = 0;
+        std::uint64_t remaining = size;
+        while (remaining > 0)
+        {
+            auto copied = syscall(SYS_copy_file_range, sourceFd, &sourceOffset, targetFd, &targetOffset, static_cast<size_t>(remaining), 0u);
+            if ((copied == -1) && (errno == EINTR)) { continue; }
+            if (copied <= 0)
+            {
+                unlink(name.c_str());
+                return false;
+            }
+            remaining -= static_cast<std::uint64_t>(copied);
+        }
+        return true;
+        #else
+        return false;
+        #endif
+    }
+
+    void DirectoryObject::WriteFileContent(const std::string& fileName, const void* data, std::size_t size)
+    {
+        std::string name = m_root + GetPathSeparator() + fileName;
+        auto lastSlash = fileName.find_last_of(GetPathSeparator());
+        if (lastSlash != std::string::npos)
+        {
+            EnsureDirectoryExists(fileName.substr(0, lastSlash));
+        }
+        auto file = ComPtr<IStream>::Make<NativeFileStream>(std::move(name), FileStream::Mode::WRITE);
+        ULONG written = 0;
+        ThrowHrIfFailed(file->Write(data, static_cast<ULONG>(size), &written));
+        ThrowErrorIf(Error::FileWrite, (written != size), "write failed");
+    }
+
     std::multimap<std::uint64_t, std::string> DirectoryObject::GetFilesByLastModDate()
     {
         THROW_IF_PACK_NOT_ENABLED
-        std::multimap<std::uint64_t, std::string> files;
-        auto rootSize = m_root.size() + 1; // plus separator
-        auto lamdba = [&](
-                std::string root,
-                std::string&& name,
-                std::uint64_t size)
-           {
-                std::string fileName = root + GetPathSeparator() + name;
-                // root contains the top level directory, which we don't need
-                fileName = fileName.substr(rootSize);
-                files.insert(std::make_pair(size, std::move(fileName)));
-                return true;
-           };
-        WalkDirectory(m_root, lamdba);
-        return files;
+        int rootFd = open(m_root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        ThrowErrorIf(Error::FileNotFound, rootFd == -1, "Invalid directory");
+        auto closeRoot = MSIX::scope_exit([rootFd] { close(rootFd); });
+        return WalkDirectoryInParallel([rootFd](const std::string& directory,
+            const std::function<void(std::string&&)>& addDirectory, DirectoryWalkerFiles& files)
+        {
+            EnumerateDirectory(rootFd, directory, addDirectory, files);
+        });
     }
 }
@@ -5,12 +5,16 @@
 // ONLY build on platforms other than Win32
 #include "Exceptions.hpp"
 #include "DirectoryObject.hpp"
+#include "DirectoryWalker.hpp"
 #include "FileStream.hpp"
+#include "NativeFileStream.hpp"
+#include "AsyncWriteStream.hpp"
 #include "MSIXWindows.hpp"
 #include "UnicodeConversion.hpp"
 #include "MsixFeatureSelector.hpp"
 #include "StringHelper.hpp"
 
+#include <atomic>
 #include <memory>
 #include <iostream>
 #include <string>
@@ -23,38 +27,17 @@ namespace MSIX
 {
     namespace
     {
-        enum class WalkOptions : std::uint16_t
+        // Enumerates one directory below root. The directory is read in large batches and the last write
+        // times come from the enumeration, so no file has to be opened.
+        void EnumerateDirectory(const std::string& root, const std::string& directory,
+            const std::function<void(std::string&&)>& addDirectory, DirectoryWalkerFiles& files)
         {
-            Files = 1,          // Enumerate files within the specified directory
-            Directories = 2,    // Enumerate directories
-            Recursive = 4       // Enumerate recursively
-        };
-
-        inline constexpr WalkOptions operator& (WalkOptions a, WalkOptions b)
-        {
-            return static_cast<WalkOptions>(static_cast<uint16_t>(a) & static_cast<uint16_t>(b));
-        }
-
-        inline constexpr WalkOptions operator| (WalkOptions a, WalkOptions b)
-        {
-            return static_cast<WalkOptions>(static_cast<uint16_t>(a) | static_cast<uint16_t>(b));
-        }
-
-        template <class Lambda>
-        void WalkDirectory(const std::string& root, WalkOptions options, Lambda& visitor)
-        {
-            static std::string dot(".");
-            static std::string dotdot("..");
-
-            std::wstring utf16Name = utf8_to_wstring(root);
-            if ((options & WalkOptions::Files) == WalkOptions::Files)
-            {
-                utf16Name += L"\\*";
-            }
+            std::string prefix = directory.empty() ? directory : directory + "\\";
+            std::wstring utf16Name = utf8_to_wstring(root + "\\" + prefix + "*");
 
-            WIN32_FIND_DATA findFileData = {};
+            WIN32_FIND_DATAW findFileData = {};
             std::unique_ptr<std::remove_pointer<HANDLE>::type, decltype(&::FindClose)> find(
-                FindFirstFile(reinterpret_cast<LPCWSTR>(utf16Name.c_str()), &findFileData),
+                FindFirstFileExW(utf16Name.c_str(), FindExInfoBasic, &findFileData, FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH),
                 &FindClose);
 
             if (INVALID_HANDLE_VALUE == find.get())
@@ -70,36 +53,24 @@ namespace MSIX
             // TODO: handle junction loops
             do
             {
-                utf16Name = std::wstring(findFileData.cFileName);
-                auto utf8Name = wstring_to_utf8(utf16Name);
+                if ((wcscmp(findFileData.cFileName, L".") == 0) || (wcscmp(findFileData.cFileName, L"..") == 0))
+                {
+                    continue;
+                }
+                auto utf8Name = prefix + wstring_to_utf8(findFileData.cFileName);
                 if (findFileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
                 {
-                    if (dot != utf8Name && dotdot != utf8Name)
-                    {
-                        std::string child = root + "\\" + utf8Name;
-                        if ((options & WalkOptions::Directories) == WalkOptions::Directories &&
-                            !visitor(root, WalkOptions::Directories, std::move(utf8Name), 0))
-                        {
-                            break;
-                        }
-                        if ((options & WalkOptions::Recursive) == WalkOptions::Recursive)
-                        {
-                            WalkDirectory(child, options, visitor);
-                        }
-                    }
+                    addDirectory(std::move(utf8Name));
                 }
-                else if ((options & WalkOptions::Files) == WalkOptions::Files)
+                else
                 {
                     ULARGE_INTEGER fileTime;
                     fileTime.HighPart = findFileData.ftLastWriteTime.dwHighDateTime;
                     fileTime.LowPart = findFileData.ftLastWriteTime.dwLowDateTime;
-                    if (!visitor(root, WalkOptions::Files, std::move(utf8Name), static_cast<std::uint64_t>(fileTime.QuadPart)))
-                    {
-                        break;
-                    }
+                    files.emplace_back(static_cast<std::uint64_t>(fileTime.QuadPart), std::move(utf8Name));
                 }
             }
-            while (FindNextFile(find.get(), &findFileData));
+            while (FindNextFileW(find.get(), &findFileData));
 
             std::uint32_t lastError = static_cast<std::uint32_t>(GetLastError());
             ThrowWin32ErrorIfNot(lastError,
@@ -272,11 +243,15 @@ namespace MSIX
                 *resultingPath = std::move(path);
             }
         }
+
+        // Makes the temporary names of the files being linked unique in the process
+        std::atomic<std::uint64_t> linkCount{ 0 };
     }
 
     char DirectoryObject::GetPathSeparator() const { return '\\'; }
 
-    DirectoryObject::DirectoryObject(const std::string& root, bool createRootIfNecessary)
+    DirectoryObject::DirectoryObject(const std::string& root, bool createRootIfNecessary) :
+        m_closer(std::make_shared<DeferredFileCloser>())
     {
         m_root = GetFullPath(root);
 
@@ -300,40 +275,150 @@ namespace MSIX
     }
 
     // IDirectoryObject
-    ComPtr<IStream> DirectoryObject::OpenFile(const std::string& fileName, FileStream::Mode mode)
+    void DirectoryObject::EnsureDirectoryExists(const std::string& directory)
+    {
+        if (directory.empty())
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_directoriesLock);
+            if (m_createdDirectories.find(directory) != m_createdDirectories.end())
+            {
+                return;
+            }
+        }
+        std::queue<DirectoryInfo> directories;
+        SplitDirectories(directory, directories, true);
+        if (!directories.empty())
+        {
+            EnsureDirectoryStructureExists(m_root, directories, false, GetPathSeparator());
+        }
+        std::lock_guard<std::mutex> lock(m_directoriesLock);
+        m_createdDirectories.insert(directory);
+    }
+
+    void DirectoryObject::CreateDirectories(const std::vector<std::string>& fileNames)
+    {
+        for (const auto& fileName : fileNames)
+        {
+            auto lastSlash = fileName.find_last_of("\\/");
+            if (lastSlash != std::string::npos)
+            {
+                EnsureDirectoryExists(fileName.substr(0, lastSlash));
+            }
+        }
+    }
+
+    ComPtr<IStream> DirectoryObject::OpenFile(const std::string& fileName, FileStream::Mode mode, std::uint64_t expectedSize)
     {
         std::queue<DirectoryInfo> directories;
 
         // Enforce that directory structure exists before creating file at specified location;
         // but only if we are going to write the file.  If reading, the file should already exist.
         bool modeWillCreateFile = (mode != FileStream::Mode::READ && mode != FileStream::Mode::READ_UPDATE);
-        SplitDirectories(fileName, directories, modeWillCreateFile);
+        auto lastSlash = fileName.find_last_of("\\/");
+        if (modeWillCreateFile && (lastSlash != std::string::npos))
+        {
+            EnsureDirectoryExists(fileName.substr(0, lastSlash));
+        }
+        SplitDirectories(fileName, directories, false);
 
         std::string path;
         EnsureDirectoryStructureExists(m_root, directories, true, GetPathSeparator(), &path);
 
-        auto result = ComPtr<IStream>::Make<FileStream>(std::move(utf8_to_wstring(path)), mode);
+        // Files written are closed on the threads of m_closer, so the next file is written while the file system
+        // filters scan the ones written before
+        auto result = ComPtr<IStream>::Make<NativeFileStream>(utf8_to_wstring(path), mode, expectedSize,
+            modeWillCreateFile ? m_closer : nullptr);
+        if (mode == FileStream::Mode::WRITE)
+        {   // Large files are written on a background thread. Callers must Commit to get write failures.
+            result = ComPtr<IStream>::Make<AsyncWriteStream>(result);
+        }
         return result;
     }
 
+    std::unique_ptr<MappedOutputFile> DirectoryObject::OpenMappedFile(const std::string& fileName, std::uint64_t size)
+    {
+        std::queue<DirectoryInfo> directories;
+        auto lastSlash = fileName.find_last_of("\\/");
+        if (lastSlash != std::string::npos)
+        {
+            EnsureDirectoryExists(fileName.substr(0, lastSlash));
+        }
+        SplitDirectories(fileName, directories, false);
+
+        std::string path;
+        EnsureDirectoryStructureExists(m_root, directories, true, GetPathSeparator(), &path);
+        return MappedOutputFile::Create(path, size, m_closer);
+    }
+
+    std::string DirectoryObject::GetFilePath(const std::string& fileName)
+    {
+        std::queue<DirectoryInfo> directories;
+        SplitDirectories(fileName, directories, false);
+        std::string path;
+        EnsureDirectoryStructureExists(m_root, directories, true, GetPathSeparator(), &path);
+        return path;
+    }
+
+    bool DirectoryObject::LinkFile(const std::string& fileName, const std::string& sourcePath)
+    {
+        auto lastSlash = fileName.find_last_of("\\/");
+        if (lastSlash != std::string::npos)
+        {
+            EnsureDirectoryExists(fileName.substr(0, lastSlash));
+        }
+        std::queue<DirectoryInfo> directories;
+        SplitDirectories(fileName, directories, false);
+        std::string path;
+        EnsureDirectoryStructureExists(m_root, directories, true, GetPathSeparator(), &path);
+
+        // Block cloning needs ReFS and a copy of the file metadata, so files are hard linked. They are linked
+        // under a temporary name and renamed, so an existing file is replaced at once.
+        auto target = utf8_to_wstring(path);
+        auto temporary = target + L".link" + std::to_wstring(GetCurrentProcessId()) + L"." + std::to_wstring(++linkCount);
+        if (!CreateHardLinkW(temporary.c_str(), utf8_to_wstring(sourcePath).c_str(), nullptr))
+        {
+            return false;
+        }
+        if (!MoveFileExW(temporary.c_str(), target.c_str(), MOVEFILE_REPLACE_EXISTING))
+        {
+            DeleteFileW(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // Block cloning (FSCTL_DUPLICATE_EXTENTS_TO_FILE) needs ranges aligned to clusters, which the files stored in a
+    // package aren't, and CopyFile2 only copies whole files, so there is no range copy that saves the read and write.
+    bool DirectoryObject::CopyFileRange(const std::string&, const std::string&, std::uint64_t, std::uint64_t)
+    {
+        return false;
+    }
+
+    void DirectoryObject::WriteFileContent(const std::string& fileName, const void* data, std::size_t size)
+    {
+        std::queue<DirectoryInfo> directories;
+        SplitDirectories(fileName, directories, true);
+        std::string path;
+        EnsureDirectoryStructureExists(m_root, directories, true, GetPathSeparator(), &path);
+
+        auto file = ComPtr<IStream>::Make<NativeFileStream>(utf8_to_wstring(path), FileStream::Mode::WRITE, 0, m_closer);
+        ULONG written = 0;
+        ThrowHrIfFailed(file->Write(data, static_cast<ULONG>(size), &written));
+        ThrowErrorIf(Error::FileWrite, (written != size), "write failed");
+    }
+
     std::multimap<std::uint64_t, std::string> DirectoryObject::GetFilesByLastModDate()
     {
         THROW_IF_PACK_NOT_ENABLED
-        std::multimap<std::uint64_t, std::string> files;
-        auto rootSize = m_root.size() + 1; // plus separator
-        WalkDirectory(m_root, WalkOptions::Recursive | WalkOptions::Files, [&](
-                std::string root,
-                WalkOptions option,
-                std::string&& name,
-                std::uint64_t lastWrite)
-            {
-                std::string fileName = root + GetPathSeparator() + name;
-                // root contains the top level directory, which we don't need
-                fileName = fileName.substr(rootSize);
-                files.insert(std::make_pair(lastWrite, std::move(fileName)));
-                return true;
-            });
-        return files;
+        const auto& root = m_root;
+        return WalkDirectoryInParallel([&root](const std::string& directory,
+            const std::function<void(std::string&&)>& addDirectory, DirectoryWalkerFiles& files)
+        {
+            EnumerateDirectory(root, directory, addDirectory, files);
+        });
     }
 }
 
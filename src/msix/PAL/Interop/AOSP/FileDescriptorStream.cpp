@@ -0,0 +1,37 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "AppxPackaging.hpp"
+#include "Exceptions.hpp"
+#include "ComHelper.hpp"
+#include "ScopeExit.hpp"
+#include "FileDescriptorStream.hpp"
+
+#include <android/asset_manager.h>
+
+MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamOnFileDescriptor(
+    int fd,
+    UINT64 offset,
+    UINT64 length,
+    IStream** stream) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (fd < 0 || stream == nullptr || *stream != nullptr), "Invalid parameters");
+    *stream = MSIX::ComPtr<IStream>::Make<MSIX::FileDescriptorStream>(fd, offset, length).Detach();
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamOnAsset(
+    AAsset* asset,
+    IStream** stream) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (asset == nullptr || stream == nullptr || *stream != nullptr), "Invalid parameters");
+    // Only an asset stored uncompressed in the APK has a descriptor, the APK itself, and a range of it
+    off64_t start = 0;
+    off64_t length = 0;
+    int fd = AAsset_openFileDescriptor64(asset, &start, &length);
+    ThrowErrorIf(MSIX::Error::NotSupported, (fd < 0), "The asset is compressed in the APK, it must be stored to be read in place");
+    auto closeFd = MSIX::scope_exit([fd] { close(fd); });
+    *stream = MSIX::ComPtr<IStream>::Make<MSIX::FileDescriptorStream>(fd, static_cast<std::uint64_t>(start), static_cast<std::uint64_t>(length)).Detach();
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
@@ -0,0 +1,134 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+
+#include "Exceptions.hpp"
+#include "StreamBase.hpp"
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+namespace MSIX {
+    // Read only stream over a range of a file descriptor, like a package stored in an APK. The stream has its own
+    // duplicate of the descriptor. The range is memory mapped, and read with pread when it can't be, as the address
+    // space of a 32 bit device may not fit a large package. Either way positional reads don't need any locking.
+    class FileDescriptorStream final : public StreamBase
+    {
+    public:
+        FileDescriptorStream(int fd, std::uint64_t offset, std::uint64_t length) : m_start(offset), m_size(length)
+        {
+            ThrowErrorIf(Error::InvalidParameter, (fd < 0), "Invalid file descriptor");
+            ThrowErrorIf(Error::InvalidParameter, (length > static_cast<std::uint64_t>(std::numeric_limits<off_t>::max()) - offset),
+                "Range out of the file");
+            m_file = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+            ThrowErrorIf(Error::FileOpen, (m_file == -1), "Can't duplicate the file descriptor");
+            // mmap wants an offset aligned to pages
+            auto pageSize = static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+            if ((m_size != 0) && (m_size <= std::numeric_limits<size_t>::max() - pageSize))
+            {
+                std::uint64_t alignedStart = m_start - (m_start % pageSize);
+                m_mappedSize = static_cast<size_t>(m_size + (m_start - alignedStart));
+                void* data = mmap(nullptr, m_mappedSize, PROT_READ, MAP_PRIVATE, m_file, static_cast<off_t>(alignedStart));
+                if (data != MAP_FAILED)
+                {
+                    m_mapping = static_cast<std::uint8_t*>(data);
+                    m_data = m_mapping + (m_start - alignedStart);
+                }
+            }
+        }
+
+        virtual ~FileDescriptorStream() override
+        {
+            if (m_mapping) { munmap(m_mapping, m_mappedSize); }
+            if (m_file != -1) { close(m_file); }
+        }
+
+        // IStream
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept override try
+        {
+            LARGE_INTEGER newPos = { 0 };
+            switch (origin)
+            {
+            case Reference::CURRENT:
+                newPos.QuadPart = m_offset + move.QuadPart;
+                break;
+            case Reference::START:
+                newPos.QuadPart = move.QuadPart;
+                break;
+            case Reference::END:
+                newPos.QuadPart = m_size + move.QuadPart;
+                break;
+            }
+            ThrowErrorIf(Error::FileSeek, (newPos.QuadPart < 0), "seek failed");
+            m_offset = static_cast<std::uint64_t>(newPos.QuadPart);
+            if (newPosition) { newPosition->QuadPart = m_offset; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) noexcept override try
+        {
+            ULONG result = ReadAt(m_offset, buffer, countBytes);
+            m_offset += result;
+            if (bytesRead) { *bytesRead = result; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Write(const void*, ULONG, ULONG*) noexcept override
+        {
+            return static_cast<HRESULT>(Error::NotSupported);
+        }
+
+        // IStreamInternal
+        std::uint64_t GetSize() override { return m_size; }
+        bool IsCompressed() override { return false; }
+        std::string GetName() override { return "fd:" + std::to_string(m_file); }
+        bool SupportsReadAt() override { return true; }
+        bool IsBuffered() override { return m_data != nullptr; }
+
+        ULONG ReadAt(std::uint64_t offset, void* buffer, ULONG countBytes) override
+        {
+            if (offset >= m_size) { return 0; }
+            ULONG toRead = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(countBytes), m_size - offset));
+            if (m_data)
+            {
+                std::memcpy(buffer, m_data + offset, toRead);
+                return toRead;
+            }
+            auto bytes = static_cast<std::uint8_t*>(buffer);
+            ULONG result = 0;
+            while (result < toRead)
+            {
+                auto read = pread(m_file, bytes + result, toRead - result, static_cast<off_t>(m_start + offset + result));
+                if (read < 0 && errno == EINTR) { continue; }
+                ThrowErrorIf(Error::FileRead, (read < 0), "read failed");
+                if (read == 0) { break; } // the file is shorter than the range
+                result += static_cast<ULONG>(read);
+            }
+            return result;
+        }
+
+        const std::uint8_t* GetRawView(std::uint64_t& available) override
+        {
+            available = (m_data && (m_offset < m_size)) ? (m_size - m_offset) : 0;
+            return (available != 0) ? (m_data + m_offset) : nullptr;
+        }
+
+    protected:
+        int m_file = -1;
+        std::uint64_t m_start = 0;
+        std::uint64_t m_size = 0;
+        std::uint64_t m_offset = 0;
+        std::uint8_t* m_mapping = nullptr;
+        size_t m_mappedSize = 0;
+        const std::uint8_t* m_data = nullptr;
+    };
+}
@@ -6,6 +6,7 @@
 #include "Exceptions.hpp"
 #include "FileStream.hpp"
 #include "SignatureValidator.hpp"
+#include "SignatureCache.hpp"
 #include "MSIXResource.hpp"
 #include "StreamHelper.hpp"
 
@@ -56,6 +57,10 @@ namespace MSIX
         void operator()(STACK_OF(X509) *sx) const { if (sx) sk_X509_free(sx); };
     };
 
+    struct unique_ASN1_TIME_deleter {
+        void operator()(ASN1_TIME *t) const { if (t) ASN1_TIME_free(t); };
+    };
+
     struct shared_BIO_deleter {
         void operator()(BIO *b) const { if (b) BIO_free(b); };
     };
@@ -67,6 +72,7 @@ namespace MSIX
     typedef std::unique_ptr<X509_STORE_CTX, unique_X509_STORE_CTX_deleter> unique_X509_STORE_CTX;
     typedef std::unique_ptr<char, unique_OPENSSL_string_deleter> unique_OPENSSL_string;
     typedef std::unique_ptr<STACK_OF(X509), unique_STACK_X509_deleter> unique_STACK_X509;
+    typedef std::unique_ptr<ASN1_TIME, unique_ASN1_TIME_deleter> unique_ASN1_TIME;
     
     typedef struct Asn1Sequence
     {
@@ -236,6 +242,18 @@ namespace MSIX
         return ok; 
     }
 
+    // Converts a certificate time to seconds since 1970, times before it are clamped to 0
+    std::uint64_t GetEpochSeconds(const ASN1_TIME* time)
+    {
+        unique_ASN1_TIME epoch(ASN1_TIME_set(nullptr, 0));
+        int days = 0;
+        int seconds = 0;
+        ThrowErrorIfNot(Error::SignatureInvalid, epoch && ASN1_TIME_diff(&days, &seconds, epoch.get(), time) == 1,
+            "Could not read the certificate validity");
+        std::int64_t result = static_cast<std::int64_t>(days) * 86400 + seconds;
+        return (result < 0) ? 0 : static_cast<std::uint64_t>(result);
+    }
+
     void replaceAll( std::string &s, const std::string &search, const std::string &replace ) {
         for(size_t pos = 0; ; pos += replace.length() ) {
             // Locate the substring to replace
@@ -319,6 +337,99 @@ namespace MSIX
         return false;
     }
 
+    struct TrustedCertificateStore
+    {
+        unique_X509_STORE store;
+        unique_STACK_X509 chain;
+        // The chain doesn't own its certificates, these are the custom roots, the built in ones live for the process
+        std::vector<unique_X509> certificates;
+    };
+
+    // Appends every PEM certificate in buffer to certificates and returns how many there were.
+    std::size_t ReadCertificates(const std::vector<std::uint8_t>& buffer, std::vector<unique_X509>& certificates)
+    {
+        // Load the certs into memory
+        unique_BIO bcert(BIO_new_mem_buf(const_cast<std::uint8_t*>(buffer.data()), static_cast<int>(buffer.size())));
+        std::size_t count = 0;
+        while (true)
+        {
+            // Create a cert from the memory buffer
+            unique_X509 cert(PEM_read_bio_X509(bcert.get(), nullptr, nullptr, nullptr));
+            if (!cert) { break; }
+            certificates.push_back(std::move(cert));
+            count++;
+        }
+        // Reading past the last cert leaves an error behind
+        ERR_clear_error();
+        return count;
+    }
+
+    // Adds a certificate to the trusted store. The store holds its own reference, the chain doesn't.
+    void AddTrustedCertificate(TrustedCertificateStore& trusted, X509* cert)
+    {
+        // A root that is there already is fine
+        if (X509_STORE_add_cert(trusted.store.get(), cert) != 1)
+        {
+            ThrowErrorIfNot(Error::SignatureInvalid,
+                ERR_GET_REASON(ERR_peek_last_error()) == X509_R_CERT_ALREADY_IN_HASH_TABLE,
+                "Could not add cert to keychain");
+            ERR_clear_error();
+        }
+        sk_X509_push(trusted.chain.get(), cert);
+    }
+
+    // The certificates of the resources, decoded once per process rather than by every factory that validates a
+    // signature. They are only read after being decoded, so every store can share them.
+    const std::vector<unique_X509>& GetResourceCertificates(IMsixFactory* factory)
+    {
+        static std::mutex lock;
+        static std::unique_ptr<std::vector<unique_X509>> certificates;
+        std::lock_guard<std::mutex> guard(lock);
+        if (!certificates)
+        {
+            auto decoded = std::make_unique<std::vector<unique_X509>>();
+            for (auto& appxCert : GetResources(factory, Resource::Certificates))
+            {
+                ReadCertificates(Helper::CreateBufferFromStream(appxCert.second), *decoded);
+            }
+            // Verification caches the extensions of a certificate in it the first time, do it now so the shared
+            // certificates aren't written to by concurrent verifications
+            for (const auto& cert : *decoded)
+            {
+                X509_check_purpose(cert.get(), -1, 0);
+            }
+            certificates = std::move(decoded);
+        }
+        return *certificates;
+    }
+
+    std::shared_ptr<TrustedCertificateStore> CreateTrustedCertificateStore(IMsixFactory* factory, const std::vector<std::uint8_t>& customRoots)
+    {
+        auto trusted = std::make_shared<TrustedCertificateStore>();
+        // Create a trusted cert store
+        trusted->store.reset(X509_STORE_new());
+        // Set a verify callback to evaluate errors
+        X509_STORE_set_verify_cb(trusted->store.get(), &VerifyCallback);
+        // We have to tell OpenSSL why we are using the store -- in this case, closest is ANY.
+        X509_STORE_set_purpose(trusted->store.get(), X509_PURPOSE_ANY);
+        trusted->chain.reset(sk_X509_new_null());
+
+        // Get certificates from our resources
+        for (const auto& cert : GetResourceCertificates(factory))
+        {
+            AddTrustedCertificate(*trusted, cert.get());
+        }
+        if (!customRoots.empty())
+        {
+            ThrowErrorIf(Error::InvalidParameter, (ReadCertificates(customRoots, trusted->certificates) == 0), "No certificate found in the trusted certificates");
+            for (const auto& cert : trusted->certificates)
+            {
+                AddTrustedCertificate(*trusted, cert.get());
+            }
+        }
+        return trusted;
+    }
+
     bool SignatureValidator::Validate(
         IMsixFactory* factory,
         MSIX_VALIDATION_OPTION option,
@@ -364,34 +475,13 @@ namespace MSIX
             }
         });
 
-        // Create a trusted cert store
-        unique_X509_STORE store(X509_STORE_new());
-        // Set a verify callback to evaluate errors
-        X509_STORE_set_verify_cb(store.get(), &VerifyCallback);
-        // We have to tell OpenSSL why we are using the store -- in this case, closest is ANY.
-        X509_STORE_set_purpose(store.get(), X509_PURPOSE_ANY);
-        
-        // Loop through our trusted PEM certs, create X509 objects from them, and add to trusted store
-        unique_STACK_X509 trustedChain(sk_X509_new_null());
-        
-        // Get certificates from our resources
-        auto appxCerts = GetResources(factory, Resource::Certificates);
-        for ( auto& appxCert : appxCerts )
+        // The trusted store is built once per factory and only read from here on
+        auto trusted = factory->GetTrustedCertificateCache().GetStore([factory](const std::vector<std::uint8_t>& customRoots)
         {
-            auto certBuffer = Helper::CreateBufferFromStream(appxCert.second);
-            // Load the cert into memory
-            unique_BIO bcert(BIO_new_mem_buf(certBuffer.data(), certBuffer.size()));
-
-            // Create a cert from the memory buffer
-            unique_X509 cert(PEM_read_bio_X509(bcert.get(), nullptr, nullptr, nullptr));
-            
-            // Add the cert to the trusted store
-            ThrowErrorIfNot(Error::SignatureInvalid, 
-                X509_STORE_add_cert(store.get(), cert.get()) == 1, 
-                "Could not add cert to keychain");
-            
-            sk_X509_push(trustedChain.get(), cert.get());
-        }
+            return CreateTrustedCertificateStore(factory, customRoots);
+        });
+        X509_STORE* store = trusted->store.get();
+        STACK_OF(X509)* trustedChain = trusted->chain.get();
 
         unique_BIO signatureDigest(nullptr);
         ReadDigestHashes(p7.get(), signatureObject, signatureDigest);
@@ -404,10 +494,10 @@ namespace MSIX
             {
                 X509* cert = sk_X509_value(untrustedCerts, i);
                 unique_X509_STORE_CTX context(X509_STORE_CTX_new());
-                X509_STORE_CTX_init(context.get(), store.get(), nullptr, nullptr);
+                X509_STORE_CTX_init(context.get(), store, nullptr, nullptr);
 
                 X509_STORE_CTX_set_chain(context.get(), untrustedCerts);
-                X509_STORE_CTX_trusted_stack(context.get(), trustedChain.get());
+                X509_STORE_CTX_trusted_stack(context.get(), trustedChain);
                 X509_STORE_CTX_set_cert(context.get(), cert);
 
                 X509_VERIFY_PARAM* param = X509_STORE_CTX_get0_param(context.get());
@@ -420,7 +510,7 @@ namespace MSIX
             }
 
             ThrowErrorIfNot(Error::SignatureInvalid, 
-                PKCS7_verify(p7.get(), trustedChain.get(), store.get(), signatureDigest.get(), nullptr/*out*/, PKCS7_NOCRL/*flags*/) == 1, 
+                PKCS7_verify(p7.get(), trustedChain, store, signatureDigest.get(), nullptr/*out*/, PKCS7_NOCRL/*flags*/) == 1, 
                 "Could not verify package signature");
         }
 
@@ -442,6 +532,11 @@ namespace MSIX
         ThrowErrorIfNot(Error::SignatureInvalid, (
             GetPublisherName(p7, publisher) == true
         ), "Signature origin check failed");
+
+        unique_STACK_X509 signers(PKCS7_get0_signers(p7.get(), trustedChain, 0));
+        ThrowErrorIf(Error::SignatureInvalid, !signers || sk_X509_num(signers.get()) < 1, "Could not find the signing certificate");
+        X509* signingCert = sk_X509_value(signers.get(), 0);
+        signatureObject->SetCertificateValidity(GetEpochSeconds(X509_get_notBefore(signingCert)), GetEpochSeconds(X509_get_notAfter(signingCert)));
         
         return true;
     }
@@ -12,6 +12,8 @@
 #include "AppxSignature.hpp"
 #include "FileStream.hpp"
 #include "SignatureValidator.hpp"
+#include "SignatureCache.hpp"
+#include "MSIXFactory.hpp"
 
 namespace MSIX
 {
@@ -70,9 +72,12 @@ namespace MSIX
     typedef std::unique_ptr<void, unique_cert_store_handle_deleter> unique_cert_store_handle;
     typedef std::unique_ptr<void, unique_crypt_msg_handle_deleter> unique_crypt_msg_handle;
 
-    static PCCERT_CHAIN_CONTEXT GetCertChainContext(
+    // Gets the certificate that signed the signature, with the certificates and the message of the signature
+    static unique_cert_context GetSigningCertContext(
         _In_ byte* signatureBuffer,
-        _In_ ULONG cbSignatureBuffer)
+        _In_ ULONG cbSignatureBuffer,
+        unique_cert_store_handle& certStore,
+        unique_crypt_msg_handle& signedMessage)
     {
         // Get the cert content
         HCERTSTORE certStoreT;
@@ -94,8 +99,8 @@ namespace MSIX
                 &signedMessageT,
                 NULL)
             ), "CryptQueryObject failed.");
-        unique_cert_store_handle certStore(certStoreT);
-        unique_crypt_msg_handle signedMessage(signedMessageT);
+        certStore.reset(certStoreT);
+        signedMessage.reset(signedMessageT);
 
         // Get the signer size and information from the signed data message
         // The properties of the signer info will be used to uniquely identify the signing certificate in the certificate store
@@ -125,7 +130,21 @@ namespace MSIX
             X509_ASN_ENCODING | PKCS_7_ASN_ENCODING,
             &certInfo));
         ThrowErrorIf(Error::SignatureInvalid, (signingCertContext.get() == NULL), "failed to get signing cert context.");
+        return signingCertContext;
+    }
+
+    // Converts a certificate time to seconds since 1970, times before it are clamped to 0
+    static std::uint64_t GetEpochSeconds(const FILETIME& time)
+    {
+        const std::uint64_t epochTicks = 116444736000000000ULL;
+        std::uint64_t ticks = (static_cast<std::uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime;
+        return (ticks < epochTicks) ? 0 : (ticks - epochTicks) / 10000000ULL;
+    }
 
+    static PCCERT_CHAIN_CONTEXT GetCertChainContext(
+        _In_ PCCERT_CONTEXT signingCertContext,
+        _In_ HCERTSTORE certStore)
+    {
         // Get the signing certificate chain context.  Do not connect online for URL
         // retrievals. If CertVerifyCertificateChainPolicy fails to validate the certificates
         //  we call WinVerifyTrust, which also checks if a package was timestamped while the cert was valid.
@@ -138,9 +157,9 @@ namespace MSIX
         ThrowErrorIfNot(Error::SignatureInvalid, (
             CertGetCertificateChain(
                 HCCE_LOCAL_MACHINE,
-                signingCertContext.get(),
+                signingCertContext,
                 NULL,   // Use the current system time for CRL validation
-                certStore.get(),
+                certStore,
                 &certChainParameters,
                 certChainFlags,
                 NULL,   // Reserved parameter; must be NULL
@@ -445,19 +464,67 @@ namespace MSIX
     }
 
     // Best effort to determine whether the signature file is associated with a store cert
-    static bool IsStoreOrigin(byte* signatureBuffer, ULONG cbSignatureBuffer)
+    static bool IsStoreOrigin(byte* signatureBuffer, ULONG cbSignatureBuffer, PCCERT_CHAIN_CONTEXT certChainContext)
     {
         if (DoesSignatureCertContainStoreEKU(signatureBuffer, cbSignatureBuffer))
-        {   unique_cert_chain_context certChainContext(GetCertChainContext(signatureBuffer, cbSignatureBuffer));
-            return IsMicrosoftTrustedChain(certChainContext.get());
+        {
+            return IsMicrosoftTrustedChain(certChainContext);
         }
         return false;
     }
 
     // Best effort to determine whether the signature file is associated with a store cert
-    static bool IsAuthenticodeOrigin(byte* signatureBuffer, ULONG cbSignatureBuffer)
-    {   unique_cert_chain_context certChainContext(GetCertChainContext(signatureBuffer, cbSignatureBuffer));
-        return IsAuthenticodeTrustedChain(certChainContext.get());
+    static bool IsAuthenticodeOrigin(PCCERT_CHAIN_CONTEXT certChainContext)
+    {
+        return IsAuthenticodeTrustedChain(certChainContext);
+    }
+
+    // The origin the chain of the signing certificate gives, Unknown if WinVerifyTrust has to decide. The chain is
+    // built once per certificate and its origin kept in the chain cache of the factory, by the SHA256 of the
+    // certificate.
+    static SignatureOrigin GetChainOrigin(IMsixFactory* factory, byte* signatureBuffer, ULONG cbSignatureBuffer,
+        PCCERT_CONTEXT signingCertContext, HCERTSTORE certStore)
+    {
+        BYTE thumbprint[HASH_BYTES];
+        DWORD thumbprintLength = HASH_BYTES;
+        ThrowErrorIfNot(Error::SignatureInvalid,
+            (CryptHashCertificate2(
+                BCRYPT_SHA256_ALGORITHM,
+                0,                  // dwFlags
+                nullptr,            // pvReserved
+                signingCertContext->pbCertEncoded,
+                signingCertContext->cbCertEncoded,
+                thumbprint,
+                &thumbprintLength) && HASH_BYTES == thumbprintLength),
+            "CryptHashCertificate2 failed");
+        const char* hexDigits = "0123456789abcdef";
+        std::string key;
+        for (auto value : thumbprint)
+        {
+            key.push_back(hexDigits[value >> 4]);
+            key.push_back(hexDigits[value & 0xf]);
+        }
+
+        auto& cache = factory->GetCertificateChainCache();
+        std::uint32_t cached = 0;
+        if (cache.GetEntry(key, cached))
+        {
+            return static_cast<SignatureOrigin>(cached);
+        }
+
+        unique_cert_chain_context certChainContext(GetCertChainContext(signingCertContext, certStore));
+        auto origin = MSIX::SignatureOrigin::Unknown;
+        if (IsStoreOrigin(signatureBuffer, cbSignatureBuffer, certChainContext.get()))
+        {
+            origin = MSIX::SignatureOrigin::Store;
+        }
+        // Determine whether the signature file is associated with a store cert.
+        else if (IsAuthenticodeOrigin(certChainContext.get()))
+        {
+            origin = MSIX::SignatureOrigin::LOB;
+        }
+        cache.AddEntry(key, static_cast<std::uint32_t>(origin));
+        return origin;
     }
 
     static bool GetPublisherDisplayName(/*in*/byte* signatureBuffer, /*in*/ ULONG cbSignatureBuffer, /*inout*/ std::string& publisher)
@@ -631,15 +698,15 @@ namespace MSIX
             (indirectContent->Digest.cbData - sizeof(DWORD)) % sizeof(DigestHash)
         );
 
-        origin = MSIX::SignatureOrigin::Unknown;
-        if (IsStoreOrigin(p7s, p7sSize))
-        {
-            origin = MSIX::SignatureOrigin::Store;
-        }
-        // Determine whether the signature file is associated with a store cert.
-        else if (IsAuthenticodeOrigin(p7s, p7sSize))
-        {
-            origin = MSIX::SignatureOrigin::LOB;
+        unique_cert_store_handle certStore;
+        unique_crypt_msg_handle signedMessage;
+        auto signingCertContext = GetSigningCertContext(p7s, p7sSize, certStore, signedMessage);
+        origin = GetChainOrigin(factory, p7s, p7sSize, signingCertContext.get(), certStore.get());
+        if (MSIX::SignatureOrigin::Unknown != origin)
+        {   // The chain may be the one of another package, this one must still be signed by its certificate
+            ThrowErrorIfNot(Error::SignatureInvalid,
+                CryptMsgControl(signedMessage.get(), 0, CMSG_CTRL_VERIFY_SIGNATURE, signingCertContext->pCertInfo),
+                "CryptMsgControl failed to verify the signature");
         }
         // WinVerifyTrust is called to validate the certificate signature and the timestamp.
         else if (ValidateCertWithWinVerifyTrust(p7x))
@@ -657,6 +724,10 @@ namespace MSIX
             GetPublisherDisplayName(p7s, p7sSize, publisher) == true,
             "Could not retrieve publisher name");
 
+        signatureObject->SetCertificateValidity(
+            GetEpochSeconds(signingCertContext->pCertInfo->NotBefore),
+            GetEpochSeconds(signingCertContext->pCertInfo->NotAfter));
+
         return true;
     }
 } // namespace MSIX
\ No newline at end of file
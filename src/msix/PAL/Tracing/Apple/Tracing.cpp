@@ -0,0 +1,67 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include <os/log.h>
+#include <os/signpost.h>
+
+#include "Tracing.hpp"
+
+// Signpost intervals of the com.microsoft.msix subsystem, shown by the os_signpost instrument of Instruments.
+namespace MSIX { namespace Tracing {
+
+    namespace {
+        os_log_t GetLog()
+        {
+            static os_log_t log = os_log_create("com.microsoft.msix", "Msix");
+            return log;
+        }
+    }
+
+    bool IsEnabled()
+    {
+        if (__builtin_available(macOS 10.14, iOS 12.0, *))
+        {
+            return os_signpost_enabled(GetLog());
+        }
+        return false;
+    }
+
+    std::uint64_t Begin(Event event, const char* detail, std::uint64_t value)
+    {
+        if (__builtin_available(macOS 10.14, iOS 12.0, *))
+        {
+            auto log = GetLog();
+            os_signpost_id_t id = os_signpost_id_generate(log);
+            switch (event)
+            {
+            #define MSIX_TRACING_BEGIN(name) \
+            case Event::name: \
+                os_signpost_interval_begin(log, id, #name, "%{public}s %llu", detail, static_cast<unsigned long long>(value)); \
+                break;
+            MSIX_TRACING_FOR_EACH_EVENT(MSIX_TRACING_BEGIN)
+            #undef MSIX_TRACING_BEGIN
+            }
+            return static_cast<std::uint64_t>(id);
+        }
+        return 0;
+    }
+
+    void End(Event event, std::uint64_t id)
+    {
+        if (__builtin_available(macOS 10.14, iOS 12.0, *))
+        {
+            auto log = GetLog();
+            auto signpostId = static_cast<os_signpost_id_t>(id);
+            switch (event)
+            {
+            #define MSIX_TRACING_END(name) \
+            case Event::name: \
+                os_signpost_interval_end(log, signpostId, #name); \
+                break;
+            MSIX_TRACING_FOR_EACH_EVENT(MSIX_TRACING_END)
+            #undef MSIX_TRACING_END
+            }
+        }
+    }
+} }
@@ -0,0 +1,54 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include <sys/sdt.h>
+
+#include <atomic>
+
+#include "Tracing.hpp"
+
+// USDT probes, a nop until a tracer attaches to them. Every event has a <name>_begin probe with the id,
+// detail and value, and a <name>_end probe with the id, all in the msix provider. For example
+//   perf probe -x libmsix.so sdt_msix:ExtractFile_begin
+//   bpftrace -e 'usdt:libmsix.so:msix:ExtractFile_begin { printf("%s\n", str(arg1)); }'
+//   lttng enable-event --userspace-probe=sdt:libmsix.so:msix:ExtractFile_begin extract_begin
+namespace MSIX { namespace Tracing {
+
+    namespace {
+        std::atomic<std::uint64_t> s_nextId{ 1 };
+    }
+
+    bool IsEnabled()
+    {
+        return true;
+    }
+
+    std::uint64_t Begin(Event event, const char* detail, std::uint64_t value)
+    {
+        std::uint64_t id = s_nextId.fetch_add(1, std::memory_order_relaxed);
+        switch (event)
+        {
+        #define MSIX_TRACING_BEGIN(name) \
+        case Event::name: \
+            DTRACE_PROBE3(msix, name##_begin, id, detail, value); \
+            break;
+        MSIX_TRACING_FOR_EACH_EVENT(MSIX_TRACING_BEGIN)
+        #undef MSIX_TRACING_BEGIN
+        }
+        return id;
+    }
+
+    void End(Event event, std::uint64_t id)
+    {
+        switch (event)
+        {
+        #define MSIX_TRACING_END(name) \
+        case Event::name: \
+            DTRACE_PROBE1(msix, name##_end, id); \
+            break;
+        MSIX_TRACING_FOR_EACH_EVENT(MSIX_TRACING_END)
+        #undef MSIX_TRACING_END
+        }
+    }
+} }
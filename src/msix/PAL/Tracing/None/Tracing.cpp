@@ -0,0 +1,23 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "Tracing.hpp"
+
+// For platforms without a tracing backend. Activities check IsEnabled, so they cost nothing else.
+namespace MSIX { namespace Tracing {
+
+    bool IsEnabled()
+    {
+        return false;
+    }
+
+    std::uint64_t Begin(Event, const char*, std::uint64_t)
+    {
+        return 0;
+    }
+
+    void End(Event, std::uint64_t)
+    {
+    }
+} }
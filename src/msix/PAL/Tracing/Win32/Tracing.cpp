@@ -0,0 +1,72 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include <windows.h>
+#include <winmeta.h>
+#include <TraceLoggingProvider.h>
+
+#include <atomic>
+
+#include "Tracing.hpp"
+
+// {29236c6e-03f1-4aff-b1d7-0f4f2f80f53e}
+// One way to enable:
+// logman create trace MsixSdkTrace -p "{29236c6e-03f1-4aff-b1d7-0f4f2f80f53e}" -o c:\msixsdktrace.etl
+// logman start MsixSdkTrace
+// logman stop MsixSdkTrace
+// Windows Performance Analyzer shows every event pair as a region, they have the Start and Stop opcodes.
+TRACELOGGING_DEFINE_PROVIDER(
+    g_MsixSdkTraceLoggingProvider,
+    "MsixSdkTraceLoggingProvider",
+    (0x29236c6e, 0x03f1, 0x4aff, 0xb1, 0xd7, 0x0f, 0x4f, 0x2f, 0x80, 0xf5, 0x3e));
+
+namespace MSIX { namespace Tracing {
+
+    namespace {
+        // Registered on first use, unregistered when the library is unloaded
+        struct Registration
+        {
+            Registration() { TraceLoggingRegister(g_MsixSdkTraceLoggingProvider); }
+            ~Registration() { TraceLoggingUnregister(g_MsixSdkTraceLoggingProvider); }
+        };
+
+        std::atomic<std::uint64_t> s_nextId{ 1 };
+    }
+
+    bool IsEnabled()
+    {
+        static Registration registration;
+        return TraceLoggingProviderEnabled(g_MsixSdkTraceLoggingProvider, 0, 0);
+    }
+
+    std::uint64_t Begin(Event event, const char* detail, std::uint64_t value)
+    {
+        std::uint64_t id = s_nextId.fetch_add(1, std::memory_order_relaxed);
+        switch (event)
+        {
+        #define MSIX_TRACING_BEGIN(name) \
+        case Event::name: \
+            TraceLoggingWrite(g_MsixSdkTraceLoggingProvider, #name, TraceLoggingOpcode(WINEVENT_OPCODE_START), \
+                TraceLoggingUInt64(id, "Id"), TraceLoggingString(detail, "Detail"), TraceLoggingUInt64(value, "Value")); \
+            break;
+        MSIX_TRACING_FOR_EACH_EVENT(MSIX_TRACING_BEGIN)
+        #undef MSIX_TRACING_BEGIN
+        }
+        return id;
+    }
+
+    void End(Event event, std::uint64_t id)
+    {
+        switch (event)
+        {
+        #define MSIX_TRACING_END(name) \
+        case Event::name: \
+            TraceLoggingWrite(g_MsixSdkTraceLoggingProvider, #name, TraceLoggingOpcode(WINEVENT_OPCODE_STOP), \
+                TraceLoggingUInt64(id, "Id")); \
+            break;
+        MSIX_TRACING_FOR_EACH_EVENT(MSIX_TRACING_END)
+        #undef MSIX_TRACING_END
+        }
+    }
+} }
@@ -28,6 +28,80 @@ MSIX_INTERFACE(IJavaXmlElement,  0x69ab3660,0x398d,0x4cd6,0xa1,0x31,0xe7,0x31,0x
 
 namespace MSIX {
 
+// Method ids of com.microsoft.msix.XmlElement, looked up once instead of for every element.
+struct JavaXmlElementMethods
+{
+    jmethodID getAttributeValueFunc = nullptr;
+    jmethodID getTextContentFunc = nullptr;
+    jmethodID getPrefixFunc = nullptr;
+    jmethodID getElementsFunc = nullptr;
+
+    static const JavaXmlElementMethods& Get(JNIEnv* env)
+    {
+        static const JavaXmlElementMethods methods = [env]()
+        {
+            JavaXmlElementMethods result;
+            std::unique_ptr<_jclass, JObjectDeleter> xmlElementClass(env->FindClass("com/microsoft/msix/XmlElement"));
+            result.getAttributeValueFunc = env->GetMethodID(
+                    xmlElementClass.get(), "GetAttributeValue",
+                    "(Ljava/lang/String;)Ljava/lang/String;");
+            result.getTextContentFunc = env->GetMethodID(
+                    xmlElementClass.get(), "GetTextContent",
+                    "()Ljava/lang/String;");
+            result.getPrefixFunc = env->GetMethodID(
+                    xmlElementClass.get(), "GetPrefix",
+                    "()Ljava/lang/String;");
+            result.getElementsFunc = env->GetMethodID(
+                    xmlElementClass.get(), "GetElements",
+                    "(Ljava/lang/String;)[Lcom/microsoft/msix/XmlElement;");
+            return result;
+        }();
+        return methods;
+    }
+};
+
+// The array of java elements returned by a query. It's kept alive by the elements created from it, so an element
+// is only taken out of the array if it's used for more than reading its attributes.
+class JavaXmlElementArray final
+{
+public:
+    JavaXmlElementArray(JNIEnv* env, jobject elements) : m_env(env)
+    {
+        m_elements = reinterpret_cast<jobjectArray>(m_env->NewGlobalRef(elements));
+    }
+
+    ~JavaXmlElementArray() { m_env->DeleteGlobalRef(m_elements); }
+
+    jsize GetLength() { return m_env->GetArrayLength(m_elements); }
+    jobject GetElement(jsize index) { return m_env->GetObjectArrayElement(m_elements, index); }
+
+private:
+    JNIEnv* m_env = nullptr;
+    jobjectArray m_elements = nullptr;
+};
+
+// The attributes of all the elements returned by XmlDom.GetElementsAndAttributes, converted to utf-8 at once. Each
+// attribute is name '\0' value '\0' and each element ends with '\1'.
+struct JavaXmlAttributes
+{
+    std::string data;
+    std::vector<std::pair<std::size_t, std::size_t>> elements;
+
+    JavaXmlAttributes(JNIEnv* env, jstring attributes)
+    {
+        const jchar* chars = env->GetStringChars(attributes, nullptr);
+        std::u16string utf16(reinterpret_cast<const char16_t*>(chars), env->GetStringLength(attributes));
+        env->ReleaseStringChars(attributes, chars);
+        data = u16string_to_utf8(utf16);
+        std::size_t begin = 0;
+        for (std::size_t end = data.find('\1'); end != std::string::npos; end = data.find('\1', begin))
+        {
+            elements.emplace_back(begin, end);
+            begin = end + 1;
+        }
+    }
+};
+
 class JavaXmlElement final : public ComClass<JavaXmlElement, IXmlElement, IJavaXmlElement, IMsixElement>
 {
 public:
@@ -35,23 +109,14 @@ public:
         m_factory(factory), m_javaXmlElementObject(javaXmlElementObject)
     {
         m_env = Jni::Instance()->GetEnv();
-        std::unique_ptr<_jclass, JObjectDeleter> xmlElementClass(m_env->FindClass("com/microsoft/msix/XmlElement"));
-       
-        getAttributeValueFunc = m_env->GetMethodID(
-                xmlElementClass.get(), "GetAttributeValue",
-                "(Ljava/lang/String;)Ljava/lang/String;");
-        getTextContentFunc = m_env->GetMethodID(
-                xmlElementClass.get(), "GetTextContent",
-                "()Ljava/lang/String;");
-        getPrefixFunc = m_env->GetMethodID(
-                xmlElementClass.get(), "GetPrefix",
-                "()Ljava/lang/String;");
-        getElementsByTagNameFunc = m_env->GetMethodID(
-                xmlElementClass.get(), "GetElementsByTagName",
-                "(Ljava/lang/String;)[Lcom/microsoft/msix/XmlElement;");
-        getElementsFunc = m_env->GetMethodID(
-                xmlElementClass.get(), "GetElements",
-                "(Ljava/lang/String;)[Lcom/microsoft/msix/XmlElement;");
+    }
+
+    // An element of the result of a query, with its attributes already read.
+    JavaXmlElement(IMsixFactory* factory, const std::shared_ptr<JavaXmlElementArray>& elements, jsize index,
+        const std::shared_ptr<JavaXmlAttributes>& attributes) :
+        m_factory(factory), m_elements(elements), m_index(index), m_attributes(attributes)
+    {
+        m_env = Jni::Instance()->GetEnv();
     }
 
     // IXmlElement
@@ -69,13 +134,15 @@ public:
 
     std::string GetText() override
     {
-        std::unique_ptr<_jstring, JObjectDeleter> jvalue(reinterpret_cast<jstring>(m_env->CallObjectMethod(m_javaXmlElementObject.get(), getTextContentFunc)));
+        const auto& methods = JavaXmlElementMethods::Get(m_env);
+        std::unique_ptr<_jstring, JObjectDeleter> jvalue(reinterpret_cast<jstring>(m_env->CallObjectMethod(GetJavaObject(), methods.getTextContentFunc)));
         return GetStringFromJString(jvalue.get());
     }
 
     std::string GetPrefix() override
     {
-        std::unique_ptr<_jstring, JObjectDeleter> jvalue(reinterpret_cast<jstring>(m_env->CallObjectMethod(m_javaXmlElementObject.get(), getPrefixFunc)));
+        const auto& methods = JavaXmlElementMethods::Get(m_env);
+        std::unique_ptr<_jstring, JObjectDeleter> jvalue(reinterpret_cast<jstring>(m_env->CallObjectMethod(GetJavaObject(), methods.getPrefixFunc)));
         if (jvalue.get() != nullptr)
         {
             std::string nodeName = GetStringFromJString(jvalue.get());
@@ -89,7 +156,14 @@ public:
     }
 
     // IJavaXmlElement
-    jobject GetJavaObject() override { return m_javaXmlElementObject.get(); }
+    jobject GetJavaObject() override
+    {
+        if (!m_javaXmlElementObject)
+        {
+            m_javaXmlElementObject.reset(m_elements->GetElement(m_index));
+        }
+        return m_javaXmlElementObject.get();
+    }
 
      // IMsixElement
     HRESULT STDMETHODCALLTYPE GetAttributeValue(LPCWSTR name, LPWSTR* value) noexcept override try
@@ -130,8 +204,9 @@ public:
     HRESULT STDMETHODCALLTYPE GetElementsUtf8(LPCSTR xpath, IMsixElementEnumerator** elements) noexcept override try
     {
         ThrowErrorIf(Error::InvalidParameter, (elements == nullptr || *elements != nullptr), "bad pointer.");
+        const auto& methods = JavaXmlElementMethods::Get(m_env);
         std::unique_ptr<_jstring, JObjectDeleter> jname(m_env->NewStringUTF(xpath));
-        std::unique_ptr<_jobjectArray, JObjectDeleter> javaElements(reinterpret_cast<jobjectArray>(m_env->CallObjectMethod(m_javaXmlElementObject.get(), getElementsFunc, jname.get())));
+        std::unique_ptr<_jobjectArray, JObjectDeleter> javaElements(reinterpret_cast<jobjectArray>(m_env->CallObjectMethod(GetJavaObject(), methods.getElementsFunc, jname.get())));
         std::vector<ComPtr<IMsixElement>> elementsEnum;
         // Note: if the number of elements are large, JNI might barf due to too many local refs alive. This should only be used for small lists.
         for(int i = 0; i < m_env->GetArrayLength(javaElements.get()); i++)
@@ -139,24 +214,41 @@ public:
             auto item = ComPtr<IMsixElement>::Make<JavaXmlElement>(m_factory, m_env->GetObjectArrayElement(javaElements.get(), i));
             elementsEnum.push_back(std::move(item));
         }
-        *elements = ComPtr<IMsixElementEnumerator>::Make<EnumeratorCom<IMsixElementEnumerator,IMsixElement>>(elementsEnum).Detach();
+        *elements = ComPtr<IMsixElementEnumerator>::Make<EnumeratorCom<IMsixElementEnumerator,IMsixElement>>(std::move(elementsEnum)).Detach();
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
 
 private:
     IMsixFactory* m_factory = nullptr;
     std::unique_ptr<_jobject, JObjectDeleter> m_javaXmlElementObject;
-    jmethodID getAttributeValueFunc = nullptr;
-    jmethodID getTextContentFunc = nullptr;
-    jmethodID getPrefixFunc = nullptr;
-    jmethodID getElementsByTagNameFunc = nullptr;
-    jmethodID getElementsFunc = nullptr;
+    std::shared_ptr<JavaXmlElementArray> m_elements;
+    jsize m_index = 0;
+    std::shared_ptr<JavaXmlAttributes> m_attributes;
     JNIEnv* m_env = nullptr;
 
     std::string GetAttributeValue(std::string& attributeName)
     {
+        if (m_attributes)
+        {
+            // name '\0' value '\0' for each attribute of this element, a missing attribute is empty like in java.
+            const auto& data = m_attributes->data;
+            auto range = m_attributes->elements[m_index];
+            auto pos = range.first;
+            while (pos < range.second)
+            {
+                auto nameEnd = data.find('\0', pos);
+                auto valueEnd = data.find('\0', nameEnd + 1);
+                if (data.compare(pos, nameEnd - pos, attributeName) == 0)
+                {
+                    return data.substr(nameEnd + 1, valueEnd - nameEnd - 1);
+                }
+                pos = valueEnd + 1;
+            }
+            return {};
+        }
+        const auto& methods = JavaXmlElementMethods::Get(m_env);
         std::unique_ptr<_jstring, JObjectDeleter> jname(m_env->NewStringUTF(attributeName.c_str()));
-        std::unique_ptr<_jstring, JObjectDeleter> jvalue(reinterpret_cast<jstring>(m_env->CallObjectMethod(m_javaXmlElementObject.get(), getAttributeValueFunc, jname.get())));
+        std::unique_ptr<_jstring, JObjectDeleter> jvalue(reinterpret_cast<jstring>(m_env->CallObjectMethod(GetJavaObject(), methods.getAttributeValueFunc, jname.get())));
         return GetStringFromJString(jvalue.get());
     }
 };
@@ -207,9 +299,9 @@ public:
                     xmlDomClass.get(), "GetDocument",
                     "()Lcom/microsoft/msix/XmlElement;");
 
-        getElementsFunc = m_env->GetMethodID(
-                xmlDomClass.get(), "GetElements",
-                "(Lcom/microsoft/msix/XmlElement;Ljava/lang/String;)[Lcom/microsoft/msix/XmlElement;");
+        getElementsAndAttributesFunc = m_env->GetMethodID(
+                xmlDomClass.get(), "GetElementsAndAttributes",
+                "(Lcom/microsoft/msix/XmlElement;Ljava/lang/String;)[Ljava/lang/Object;");
         jmethodID ctor = m_env->GetMethodID(xmlDomClass.get(), "<init>", "()V");
         m_javaXmlDom.reset(m_env->NewObject(xmlDomClass.get(), ctor));
 
@@ -237,12 +329,21 @@ public:
     {
         ComPtr<IJavaXmlElement> element = root.As<IJavaXmlElement>();
 
+        // A single call returns the elements and all their attributes, so reading the attributes of an element,
+        // like the hash of each block of the blockmap, doesn't call back into java.
         std::unique_ptr<_jstring, JObjectDeleter> jquery(m_env->NewStringUTF(GetQueryString(query)));
-        std::unique_ptr<_jobjectArray, JObjectDeleter> javaElements(reinterpret_cast<jobjectArray>(m_env->CallObjectMethod(m_javaXmlDom.get(), getElementsFunc, element->GetJavaObject(), jquery.get())));
-
-        for(int i = 0; i < m_env->GetArrayLength(javaElements.get()); i++)
+        std::unique_ptr<_jobjectArray, JObjectDeleter> result(reinterpret_cast<jobjectArray>(m_env->CallObjectMethod(m_javaXmlDom.get(), getElementsAndAttributesFunc, element->GetJavaObject(), jquery.get())));
+        CheckForJavaXmlParseException(m_env);
+        ThrowErrorIf(Error::XmlError, (result.get() == nullptr), "Xml query failed");
+        std::unique_ptr<_jobject, JObjectDeleter> javaElements(m_env->GetObjectArrayElement(result.get(), 0));
+        std::unique_ptr<_jstring, JObjectDeleter> javaAttributes(reinterpret_cast<jstring>(m_env->GetObjectArrayElement(result.get(), 1)));
+        auto elements = std::make_shared<JavaXmlElementArray>(m_env, javaElements.get());
+        auto attributes = std::make_shared<JavaXmlAttributes>(m_env, javaAttributes.get());
+        ThrowErrorIf(Error::Unexpected, (attributes->elements.size() != static_cast<std::size_t>(elements->GetLength())), "Unexpected number of attribute lists");
+
+        for(jsize i = 0; i < elements->GetLength(); i++)
         {
-            auto item = ComPtr<IXmlElement>::Make<JavaXmlElement>(m_factory, m_env->GetObjectArrayElement(javaElements.get(), i));
+            auto item = ComPtr<IXmlElement>::Make<JavaXmlElement>(m_factory, elements, i, attributes);
             if (!visitor(item))
             {
                 return false;
@@ -255,7 +356,7 @@ protected:
     IMsixFactory* m_factory;
     ComPtr<IStream> m_stream;
     jmethodID getDocumentFunc = nullptr;
-    jmethodID getElementsFunc = nullptr;
+    jmethodID getElementsAndAttributesFunc = nullptr;
     std::unique_ptr<_jobject, JObjectDeleter> m_javaXmlDom;
     JNIEnv* m_env = nullptr;
 };
@@ -267,7 +368,7 @@ public:
     {
     }
 
-    ComPtr<IXmlDom> CreateDomFromStream(XmlContentType footPrintType, const ComPtr<IStream>& stream) override
+    ComPtr<IXmlDom> CreateDomFromStream(XmlContentType footPrintType, const ComPtr<IStream>& stream, bool validateSchema) override
     {
         return ComPtr<IXmlDom>::Make<JavaXmlDom>(m_factory, stream);
     }
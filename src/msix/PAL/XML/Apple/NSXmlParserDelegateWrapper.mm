@@ -5,6 +5,8 @@
 #import "NSXmlParserDelegateWrapper.h"
 #import "XmlDocumentReader.hpp"
 
+#include <cstring>
+
 @implementation NSXmlParserDelegateWrapper{
     MSIX::XmlDocumentReader* m_xmlDocumentReader;
 }
@@ -21,28 +23,30 @@
 - (void) parserDidStartDocument:(NSXMLParser *)parser {
 }
 
+// The names and values are handed over as the utf-8 buffers of the strings, copied once into the node. The
+// attributes are enumerated with their values, instead of looked up again by key.
 - (void)parser:(NSXMLParser *)parser didStartElement:(NSString *)elementName namespaceURI:(NSString *)namespaceURI qualifiedName:(NSString *)qName attributes:(NSDictionary *)attributeDict {
     std::unique_ptr<MSIX::XmlNode> node(new MSIX::XmlNode());
 
-    std::string nodeName = std::string([elementName UTF8String]);
-    std::size_t semiColon = nodeName.find_first_of(':');
-    if (semiColon != std::string::npos)
+    const char* nodeName = [elementName UTF8String];
+    const char* colon = std::strchr(nodeName, ':');
+    if (colon != nullptr)
     {
-        node->NodeName = nodeName.substr(semiColon + 1);
-        node->Prefix = nodeName.substr(0, semiColon);
+        node->NodeName.assign(colon + 1);
+        node->Prefix.assign(nodeName, colon - nodeName);
     }
     else
     {
-        node->NodeName = nodeName;
+        node->NodeName.assign(nodeName);
     }
     if (qName)
     {
-        node->QualifiedNodeName = std::string([qName UTF8String]);
-    }
-    for(id key in attributeDict)
-    {
-        node->Attributes.emplace(std::string([key UTF8String]), std::string([[attributeDict objectForKey:key] UTF8String]));
+        node->QualifiedNodeName.assign([qName UTF8String]);
     }
+    MSIX::XmlNode* target = node.get();
+    [attributeDict enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL* stop) {
+        target->Attributes.emplace([key UTF8String], [value UTF8String]);
+    }];
     m_xmlDocumentReader->ProcessNodeBegin(std::move(node));
 }
 
@@ -51,13 +55,7 @@
 }
 
 - (void)parser:(NSXMLParser *)parser didEndElement:(NSString *)elementName namespaceURI:(NSString *)namespaceURI qualifiedName:(NSString *)qName {
-    std::string name = std::string([elementName UTF8String]);
-    std::size_t semiColon = name.find_first_of(':');
-    if (semiColon != std::string::npos)
-    {
-        name = name.substr(semiColon + 1);
-    }
-     m_xmlDocumentReader->ProcessNodeEnd(name);
+    m_xmlDocumentReader->ProcessNodeEnd([elementName UTF8String]);
 }
 
 - (void) parserDidEndDocument:(NSXMLParser *)parser {
@@ -5,6 +5,8 @@
 #include "XmlDocumentReader.hpp"
 #include "Exceptions.hpp"
 
+#include <cstring>
+
 namespace MSIX {
 
 void XmlDocumentReader::Init()
@@ -32,20 +34,22 @@ void XmlDocumentReader::ProcessNodeBegin(std::unique_ptr<XmlNode> node)
     }
 }
 
-void XmlDocumentReader::ProcessNodeEnd(std::string nodeName)
+void XmlDocumentReader::ProcessNodeEnd(const char* nodeName)
 {
     if (!m_currentNodeStack.empty())
     {
         auto currentNode = m_currentNodeStack.top();
-        ThrowErrorIf(Error::XmlFatal, nodeName.compare(currentNode->NodeName) != 0, "Node end does not match current node opened.");
+        const char* colon = std::strchr(nodeName, ':');
+        const char* localName = (colon != nullptr) ? colon + 1 : nodeName;
+        ThrowErrorIf(Error::XmlFatal, currentNode->NodeName.compare(localName) != 0, "Node end does not match current node opened.");
         m_currentNodeStack.pop();
     }
 }
 
-void XmlDocumentReader::ProcessCharacters(std::string string)
+void XmlDocumentReader::ProcessCharacters(const char* characters)
 {
     auto currentNode = m_currentNodeStack.top();
-    currentNode->Text.append(string);
+    currentNode->Text.append(characters);
 }
 
 void XmlNode::FindElementsRecursive(std::string xpath, std::list<XmlNode*>& list)
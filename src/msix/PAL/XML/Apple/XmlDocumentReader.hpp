@@ -41,8 +41,9 @@ public:
     bool Parse(uint8_t* data, size_t size);
     
     void ProcessNodeBegin(std::unique_ptr<XmlNode> node);
-    void ProcessNodeEnd(std::string nodeName);
-    void ProcessCharacters(std::string string);
+    // The name may have a prefix, which isn't compared
+    void ProcessNodeEnd(const char* nodeName);
+    void ProcessCharacters(const char* characters);
     
     XmlNode* GetRoot(){return m_root.get();};
       
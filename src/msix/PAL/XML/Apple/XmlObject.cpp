@@ -109,7 +109,7 @@ public:
             auto item = ComPtr<IMsixElement>::Make<XmlElement>(m_factory, element);
             elementsEnum.push_back(std::move(item));
         }
-        *elements = ComPtr<IMsixElementEnumerator>::Make<EnumeratorCom<IMsixElementEnumerator,IMsixElement>>(elementsEnum).Detach();
+        *elements = ComPtr<IMsixElementEnumerator>::Make<EnumeratorCom<IMsixElementEnumerator,IMsixElement>>(std::move(elementsEnum)).Detach();
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
 
@@ -175,7 +175,7 @@ public:
     {
     }
 
-    ComPtr<IXmlDom> CreateDomFromStream(XmlContentType footPrintType, const ComPtr<IStream>& stream) override
+    ComPtr<IXmlDom> CreateDomFromStream(XmlContentType footPrintType, const ComPtr<IStream>& stream, bool validateSchema) override
     {
         return ComPtr<IXmlDom>::Make<XmlDom>(m_factory, stream);
     }
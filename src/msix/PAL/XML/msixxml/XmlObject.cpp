@@ -0,0 +1,808 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "Exceptions.hpp"
+#include "StreamBase.hpp"
+#include "IXml.hpp"
+#include "Encoding.hpp"
+#include "StreamHelper.hpp"
+#include "UnicodeConversion.hpp"
+#include "Enumerators.hpp"
+
+// An internal interface for the built in XML document object model
+// {4f1a9b62-7c3e-4d8a-9e25-6b0d3c8f1a47}
+#ifndef WIN32
+interface IMsixXmlElement : public IUnknown
+#else
+class IMsixXmlElement : public IUnknown
+#endif
+{
+public:
+    virtual std::uint32_t GetNode() = 0;
+};
+MSIX_INTERFACE(IMsixXmlElement, 0x4f1a9b62, 0x7c3e, 0x4d8a, 0x9e, 0x25, 0x6b, 0x0d, 0x3c, 0x8f, 0x1a, 0x47);
+
+namespace MSIX {
+
+const std::uint32_t MsixXmlNoNode = std::numeric_limits<std::uint32_t>::max();
+
+// Built in, non validating parser for the small documents of a package: the blockmap, the content types
+// and the manifests. The document is checked for well-formedness and parsed once into two flat arrays of
+// offsets into the utf-8 buffer, one entry per element and one per attribute, so building the document
+// doesn't allocate per node. Text and attribute values are only decoded when they are asked for. DTDs are
+// not supported. If schema validation is required, then use xerces or msxml6 as the xml parser.
+class MsixXmlDocument final
+{
+public:
+    struct Node
+    {
+        std::uint32_t name;
+        std::uint32_t nameLength;
+        std::uint32_t prefixLength;
+        std::uint32_t firstAttribute;
+        std::uint32_t attributeCount;
+        std::uint32_t firstChild;
+        std::uint32_t nextSibling;
+        std::uint32_t contentBegin;
+        std::uint32_t contentEnd;
+    };
+
+    struct Attribute
+    {
+        std::uint32_t name;
+        std::uint32_t nameLength;
+        std::uint32_t value;
+        std::uint32_t valueLength;
+        bool needsDecode;
+    };
+
+    MsixXmlDocument(std::vector<std::uint8_t>&& buffer) : m_buffer(std::move(buffer))
+    {
+        std::size_t start = 0;
+        if (m_buffer.size() >= 3 && m_buffer[0] == 0xEF && m_buffer[1] == 0xBB && m_buffer[2] == 0xBF)
+        {
+            start = 3;
+        }
+        else if (m_buffer.size() >= 2 && ((m_buffer[0] == 0xFF && m_buffer[1] == 0xFE) || (m_buffer[0] == 0xFE && m_buffer[1] == 0xFF)))
+        {
+            ThrowErrorIf(Error::XmlFatal, (m_buffer.size() % 2 != 0), "Invalid utf-16 xml document");
+            bool bigEndian = (m_buffer[0] == 0xFE);
+            std::u16string utf16;
+            utf16.reserve(m_buffer.size() / 2);
+            for (std::size_t i = 2; i < m_buffer.size(); i += 2)
+            {
+                utf16.push_back(bigEndian ? static_cast<char16_t>((m_buffer[i] << 8) | m_buffer[i + 1]) :
+                                            static_cast<char16_t>(m_buffer[i] | (m_buffer[i + 1] << 8)));
+            }
+            auto utf8 = u16string_to_utf8(utf16);
+            m_buffer.assign(utf8.begin(), utf8.end());
+        }
+        ThrowErrorIf(Error::XmlFatal, (m_buffer.size() - start >= MsixXmlNoNode), "Xml document too large");
+        m_data = reinterpret_cast<const char*>(m_buffer.data()) + start;
+        m_size = m_buffer.size() - start;
+        CheckCharacters();
+        Parse();
+    }
+
+    const Node& GetNode(std::uint32_t node) const { return m_nodes[node]; }
+
+    bool MatchesStep(std::uint32_t node, const std::string& step) const
+    {
+        const auto& element = m_nodes[node];
+        if (step.size() == 1 && step[0] == '*') { return true; }
+        if (step.find(':') != std::string::npos)
+        {
+            return Equals(element.name, element.nameLength, step);
+        }
+        auto localName = element.name + element.prefixLength;
+        return Equals(localName, element.nameLength - element.prefixLength, step);
+    }
+
+    std::string GetPrefix(std::uint32_t node) const
+    {
+        const auto& element = m_nodes[node];
+        return (element.prefixLength == 0) ? std::string() : std::string(m_data + element.name, element.prefixLength - 1);
+    }
+
+    std::string GetAttributeValue(std::uint32_t node, const std::string& name) const
+    {
+        const auto& element = m_nodes[node];
+        for (auto i = element.firstAttribute; i < element.firstAttribute + element.attributeCount; i++)
+        {
+            const auto& attribute = m_attributes[i];
+            if (Equals(attribute.name, attribute.nameLength, name))
+            {
+                if (!attribute.needsDecode)
+                {
+                    return std::string(m_data + attribute.value, attribute.valueLength);
+                }
+                return DecodeAttributeValue(attribute);
+            }
+        }
+        return {};
+    }
+
+    // Text of the element and all of its descendants, like the DOM textContent.
+    std::string GetText(std::uint32_t node) const
+    {
+        const auto& element = m_nodes[node];
+        std::string text;
+        text.reserve(element.contentEnd - element.contentBegin);
+        std::size_t pos = element.contentBegin;
+        while (pos < element.contentEnd)
+        {
+            char c = m_data[pos];
+            if (c == '<')
+            {
+                if (StartsWith(pos, "<!--"))
+                {
+                    pos = Find("-->", pos + 4) + 3;
+                }
+                else if (StartsWith(pos, "<?"))
+                {
+                    pos = Find("?>", pos + 2) + 2;
+                }
+                else if (StartsWith(pos, "<![CDATA["))
+                {
+                    auto end = Find("]]>", pos + 9);
+                    for (pos = pos + 9; pos < end; pos++)
+                    {
+                        AppendNormalizedLineEnd(text, pos);
+                    }
+                    pos = end + 3;
+                }
+                else
+                {
+                    pos = SkipTag(pos);
+                }
+            }
+            else if (c == '&')
+            {
+                std::uint32_t codePoint = 0;
+                pos = ReadReference(pos, codePoint);
+                AppendUtf8(text, codePoint);
+            }
+            else
+            {
+                pos = AppendNormalizedLineEnd(text, pos) + 1;
+            }
+        }
+        return text;
+    }
+
+    // Calls callback for each element that matches names, starting at names[index], among the children of node.
+    template <class Callback>
+    bool ForEachChild(std::uint32_t node, const std::vector<std::string>& names, std::size_t index, Callback& callback) const
+    {
+        for (auto child = m_nodes[node].firstChild; child != MsixXmlNoNode; child = m_nodes[child].nextSibling)
+        {
+            if (MatchesStep(child, names[index]))
+            {
+                if (index + 1 == names.size())
+                {
+                    if (!callback(child)) { return false; }
+                }
+                else if (!ForEachChild(child, names, index + 1, callback))
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+protected:
+    static bool IsNameStart(char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == ':' || static_cast<std::uint8_t>(c) >= 0x80;
+    }
+
+    static bool IsNameChar(char c)
+    {
+        return IsNameStart(c) || (c >= '0' && c <= '9') || c == '-' || c == '.';
+    }
+
+    static bool IsWhitespace(char c)
+    {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    static void AppendUtf8(std::string& text, std::uint32_t codePoint)
+    {
+        if (codePoint < 0x80)
+        {
+            text.push_back(static_cast<char>(codePoint));
+        }
+        else if (codePoint < 0x800)
+        {
+            text.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+            text.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+        else if (codePoint < 0x10000)
+        {
+            text.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+            text.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+            text.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+        else
+        {
+            text.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+            text.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+            text.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+            text.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+        }
+    }
+
+    static bool IsXmlCharacter(std::uint32_t codePoint)
+    {
+        return (codePoint >= 0x20 && codePoint <= 0xD7FF) || codePoint == 0x9 || codePoint == 0xA || codePoint == 0xD ||
+               (codePoint >= 0xE000 && codePoint <= 0xFFFD) || (codePoint >= 0x10000 && codePoint <= 0x10FFFF);
+    }
+
+    bool Equals(std::uint32_t pos, std::uint32_t length, const std::string& value) const
+    {
+        return (length == value.size()) && (std::memcmp(m_data + pos, value.data(), length) == 0);
+    }
+
+    bool StartsWith(std::size_t pos, const char* value) const
+    {
+        auto length = std::strlen(value);
+        return (m_size - pos >= length) && (std::memcmp(m_data + pos, value, length) == 0);
+    }
+
+    std::size_t Find(const char* value, std::size_t from) const
+    {
+        auto end = m_data + m_size;
+        auto found = std::search(m_data + from, end, value, value + std::strlen(value));
+        ThrowErrorIf(Error::XmlFatal, (found == end), "Unexpected end of xml document");
+        return static_cast<std::size_t>(found - m_data);
+    }
+
+    std::size_t SkipWhitespace(std::size_t pos) const
+    {
+        while (pos < m_size && IsWhitespace(m_data[pos])) { pos++; }
+        return pos;
+    }
+
+    // Appends the character at pos, with line ends normalized to \n, and returns the position of the last character used.
+    std::size_t AppendNormalizedLineEnd(std::string& text, std::size_t pos) const
+    {
+        if (m_data[pos] == '\r')
+        {
+            text.push_back('\n');
+            if (pos + 1 < m_size && m_data[pos + 1] == '\n') { pos++; }
+        }
+        else
+        {
+            text.push_back(m_data[pos]);
+        }
+        return pos;
+    }
+
+    // Skips a start or end tag that is already known to be well formed, '>' can appear in attribute values.
+    std::size_t SkipTag(std::size_t pos) const
+    {
+        char quote = 0;
+        for (pos++; pos < m_size; pos++)
+        {
+            char c = m_data[pos];
+            if (quote != 0)
+            {
+                if (c == quote) { quote = 0; }
+            }
+            else if (c == '"' || c == '\'')
+            {
+                quote = c;
+            }
+            else if (c == '>')
+            {
+                return pos + 1;
+            }
+        }
+        ThrowErrorAndLog(Error::XmlFatal, "Unexpected end of xml document");
+    }
+
+    // Reads a qualified name, returns its end and the length of the prefix including the ':', or 0 if there's none.
+    std::size_t ReadName(std::size_t pos, std::uint32_t& prefixLength) const
+    {
+        ThrowErrorIf(Error::XmlFatal, (pos >= m_size || !IsNameStart(m_data[pos]) || m_data[pos] == ':'), "Invalid xml name");
+        auto start = pos;
+        prefixLength = 0;
+        for (; pos < m_size && IsNameChar(m_data[pos]); pos++)
+        {
+            if (m_data[pos] == ':')
+            {
+                ThrowErrorIf(Error::XmlFatal, (prefixLength != 0), "Invalid xml qualified name");
+                prefixLength = static_cast<std::uint32_t>(pos - start + 1);
+            }
+        }
+        ThrowErrorIf(Error::XmlFatal, (m_data[pos - 1] == ':'), "Invalid xml qualified name");
+        return pos;
+    }
+
+    // Reads the entity or character reference at pos and returns the position after it.
+    std::size_t ReadReference(std::size_t pos, std::uint32_t& codePoint) const
+    {
+        auto end = pos + 1;
+        while (end < m_size && end - pos <= 12 && m_data[end] != ';') { end++; }
+        ThrowErrorIf(Error::XmlFatal, (end >= m_size || m_data[end] != ';'), "Invalid xml reference");
+        std::string name(m_data + pos + 1, end - pos - 1);
+        if (name == "lt") { codePoint = '<'; }
+        else if (name == "gt") { codePoint = '>'; }
+        else if (name == "amp") { codePoint = '&'; }
+        else if (name == "apos") { codePoint = '\''; }
+        else if (name == "quot") { codePoint = '"'; }
+        else
+        {
+            ThrowErrorIf(Error::XmlFatal, (name.size() < 2 || name[0] != '#'), "Unknown xml entity reference");
+            bool hex = (name[1] == 'x');
+            std::size_t i = hex ? 2 : 1;
+            ThrowErrorIf(Error::XmlFatal, (i == name.size()), "Invalid xml character reference");
+            codePoint = 0;
+            for (; i < name.size(); i++)
+            {
+                char c = name[i];
+                std::uint32_t digit = 0;
+                if (c >= '0' && c <= '9') { digit = c - '0'; }
+                else if (hex && c >= 'a' && c <= 'f') { digit = c - 'a' + 10; }
+                else if (hex && c >= 'A' && c <= 'F') { digit = c - 'A' + 10; }
+                else { ThrowErrorAndLog(Error::XmlFatal, "Invalid xml character reference"); }
+                codePoint = codePoint * (hex ? 16 : 10) + digit;
+            }
+            ThrowErrorIfNot(Error::XmlFatal, IsXmlCharacter(codePoint), "Invalid xml character reference");
+        }
+        return end + 1;
+    }
+
+    std::string DecodeAttributeValue(const Attribute& attribute) const
+    {
+        std::string value;
+        value.reserve(attribute.valueLength);
+        std::size_t end = attribute.value + attribute.valueLength;
+        for (std::size_t pos = attribute.value; pos < end; pos++)
+        {
+            char c = m_data[pos];
+            if (c == '&')
+            {
+                std::uint32_t codePoint = 0;
+                pos = ReadReference(pos, codePoint) - 1;
+                AppendUtf8(value, codePoint);
+            }
+            else if (c == '\r' || c == '\n' || c == '\t')
+            {
+                // Attribute values are normalized, a line end or tab becomes a single space
+                if (c == '\r' && pos + 1 < end && m_data[pos + 1] == '\n') { pos++; }
+                value.push_back(' ');
+            }
+            else
+            {
+                value.push_back(c);
+            }
+        }
+        return value;
+    }
+
+    // Every character must be valid utf-8 and allowed in xml, so the parser only has to look at ascii.
+    void CheckCharacters() const
+    {
+        auto data = reinterpret_cast<const std::uint8_t*>(m_data);
+        std::size_t pos = 0;
+        while (pos < m_size)
+        {
+            auto c = data[pos];
+            if (c < 0x80)
+            {
+                ThrowErrorIf(Error::XmlFatal, (c < 0x20 && c != '\t' && c != '\n' && c != '\r'), "Invalid character in xml document");
+                pos++;
+                continue;
+            }
+            std::size_t length = 0;
+            std::uint32_t codePoint = 0;
+            std::uint32_t minimum = 0;
+            if ((c & 0xE0) == 0xC0)      { length = 2; codePoint = c & 0x1F; minimum = 0x80; }
+            else if ((c & 0xF0) == 0xE0) { length = 3; codePoint = c & 0x0F; minimum = 0x800; }
+            else if ((c & 0xF8) == 0xF0) { length = 4; codePoint = c & 0x07; minimum = 0x10000; }
+            ThrowErrorIf(Error::XmlFatal, (length == 0 || m_size - pos < length), "Invalid utf-8 sequence in xml document");
+            for (std::size_t i = 1; i < length; i++)
+            {
+                ThrowErrorIf(Error::XmlFatal, ((data[pos + i] & 0xC0) != 0x80), "Invalid utf-8 sequence in xml document");
+                codePoint = (codePoint << 6) | (data[pos + i] & 0x3F);
+            }
+            ThrowErrorIf(Error::XmlFatal, (codePoint < minimum || !IsXmlCharacter(codePoint)), "Invalid character in xml document");
+            pos += length;
+        }
+    }
+
+    // Text or attribute value between pos and end. Returns true if it has references or characters to normalize.
+    bool CheckCharacterData(std::size_t pos, std::size_t end, bool attribute) const
+    {
+        bool needsDecode = false;
+        while (pos < end)
+        {
+            char c = m_data[pos];
+            if (c == '&')
+            {
+                std::uint32_t codePoint = 0;
+                pos = ReadReference(pos, codePoint);
+                needsDecode = true;
+                continue;
+            }
+            ThrowErrorIf(Error::XmlFatal, (c == '<'), "Invalid '<' in xml attribute value");
+            ThrowErrorIf(Error::XmlFatal, (!attribute && c == '>' && pos >= 2 && m_data[pos - 1] == ']' && m_data[pos - 2] == ']'), "Invalid ']]>' in xml text");
+            needsDecode |= (c == '\r' || c == '\n' || c == '\t');
+            pos++;
+        }
+        return needsDecode;
+    }
+
+    std::size_t ParseStartTag(std::size_t pos, std::vector<std::uint32_t>& open, std::vector<std::uint32_t>& lastChild)
+    {
+        auto index = static_cast<std::uint32_t>(m_nodes.size());
+        Node node = {};
+        node.name = static_cast<std::uint32_t>(pos + 1);
+        pos = ReadName(pos + 1, node.prefixLength);
+        node.nameLength = static_cast<std::uint32_t>(pos) - node.name;
+        node.firstAttribute = static_cast<std::uint32_t>(m_attributes.size());
+        node.firstChild = MsixXmlNoNode;
+        node.nextSibling = MsixXmlNoNode;
+        bool isEmpty = false;
+        while (true)
+        {
+            auto afterWhitespace = SkipWhitespace(pos);
+            ThrowErrorIf(Error::XmlFatal, (afterWhitespace >= m_size), "Unexpected end of xml document");
+            if (m_data[afterWhitespace] == '/')
+            {
+                ThrowErrorIf(Error::XmlFatal, (afterWhitespace + 1 >= m_size || m_data[afterWhitespace + 1] != '>'), "Invalid xml start tag");
+                pos = afterWhitespace + 2;
+                node.contentBegin = node.contentEnd = static_cast<std::uint32_t>(pos);
+                isEmpty = true;
+                break;
+            }
+            if (m_data[afterWhitespace] == '>')
+            {
+                pos = afterWhitespace + 1;
+                node.contentBegin = static_cast<std::uint32_t>(pos);
+                break;
+            }
+            ThrowErrorIf(Error::XmlFatal, (afterWhitespace == pos), "Missing whitespace before xml attribute");
+            Attribute attribute = {};
+            std::uint32_t prefixLength = 0;
+            attribute.name = static_cast<std::uint32_t>(afterWhitespace);
+            pos = ReadName(afterWhitespace, prefixLength);
+            attribute.nameLength = static_cast<std::uint32_t>(pos) - attribute.name;
+            pos = SkipWhitespace(pos);
+            ThrowErrorIf(Error::XmlFatal, (pos >= m_size || m_data[pos] != '='), "Missing '=' after xml attribute name");
+            pos = SkipWhitespace(pos + 1);
+            ThrowErrorIf(Error::XmlFatal, (pos >= m_size || (m_data[pos] != '"' && m_data[pos] != '\'')), "Xml attribute value must be quoted");
+            auto quote = m_data[pos];
+            auto value = pos + 1;
+            auto end = static_cast<const char*>(std::memchr(m_data + value, quote, m_size - value));
+            ThrowErrorIf(Error::XmlFatal, (end == nullptr), "Unexpected end of xml document");
+            pos = static_cast<std::size_t>(end - m_data);
+            attribute.value = static_cast<std::uint32_t>(value);
+            attribute.valueLength = static_cast<std::uint32_t>(pos - value);
+            attribute.needsDecode = CheckCharacterData(value, pos, true);
+            pos++;
+            for (auto i = node.firstAttribute; i < m_attributes.size(); i++)
+            {
+                ThrowErrorIf(Error::XmlFatal,
+                    (m_attributes[i].nameLength == attribute.nameLength && std::memcmp(m_data + m_attributes[i].name, m_data + attribute.name, attribute.nameLength) == 0),
+                    "Duplicate xml attribute");
+            }
+            m_attributes.push_back(attribute);
+        }
+        node.attributeCount = static_cast<std::uint32_t>(m_attributes.size()) - node.firstAttribute;
+
+        if (!open.empty())
+        {
+            if (lastChild.back() == MsixXmlNoNode) { m_nodes[open.back()].firstChild = index; }
+            else { m_nodes[lastChild.back()].nextSibling = index; }
+            lastChild.back() = index;
+        }
+        m_nodes.push_back(node);
+        if (!isEmpty)
+        {
+            open.push_back(index);
+            lastChild.push_back(MsixXmlNoNode);
+        }
+        return pos;
+    }
+
+    std::size_t ParseEndTag(std::size_t pos, std::vector<std::uint32_t>& open, std::vector<std::uint32_t>& lastChild)
+    {
+        ThrowErrorIf(Error::XmlFatal, open.empty(), "Unexpected xml end tag");
+        auto& node = m_nodes[open.back()];
+        std::uint32_t prefixLength = 0;
+        auto end = ReadName(pos + 2, prefixLength);
+        ThrowErrorIfNot(Error::XmlFatal, ((end - pos - 2) == node.nameLength && std::memcmp(m_data + pos + 2, m_data + node.name, node.nameLength) == 0),
+            "Xml end tag doesn't match the start tag");
+        end = SkipWhitespace(end);
+        ThrowErrorIf(Error::XmlFatal, (end >= m_size || m_data[end] != '>'), "Invalid xml end tag");
+        node.contentEnd = static_cast<std::uint32_t>(pos);
+        open.pop_back();
+        lastChild.pop_back();
+        return end + 1;
+    }
+
+    void Parse()
+    {
+        // Upper bounds of the number of elements and attributes, so the arrays are only allocated once.
+        m_nodes.reserve(std::count(m_data, m_data + m_size, '<'));
+        m_attributes.reserve(std::count(m_data, m_data + m_size, '='));
+        std::vector<std::uint32_t> open;
+        std::vector<std::uint32_t> lastChild;
+        std::size_t pos = 0;
+        while (pos < m_size)
+        {
+            if (m_data[pos] != '<')
+            {
+                auto found = static_cast<const char*>(std::memchr(m_data + pos, '<', m_size - pos));
+                auto end = (found == nullptr) ? m_size : static_cast<std::size_t>(found - m_data);
+                if (open.empty())
+                {
+                    ThrowErrorIf(Error::XmlFatal, (SkipWhitespace(pos) < end), "Text outside of the xml root element");
+                }
+                else
+                {
+                    CheckCharacterData(pos, end, false);
+                }
+                pos = end;
+            }
+            else if (StartsWith(pos, "<!--"))
+            {
+                auto end = Find("--", pos + 4);
+                ThrowErrorIf(Error::XmlFatal, (end + 2 >= m_size || m_data[end + 2] != '>'), "Invalid '--' in xml comment");
+                pos = end + 3;
+            }
+            else if (StartsWith(pos, "<?"))
+            {
+                std::uint32_t prefixLength = 0;
+                ReadName(pos + 2, prefixLength);
+                pos = Find("?>", pos + 2) + 2;
+            }
+            else if (StartsWith(pos, "<![CDATA["))
+            {
+                ThrowErrorIf(Error::XmlFatal, open.empty(), "CDATA outside of the xml root element");
+                pos = Find("]]>", pos + 9) + 3;
+            }
+            else if (StartsWith(pos, "<!"))
+            {
+                ThrowErrorAndLog(Error::XmlFatal, "DTDs are not supported");
+            }
+            else if (StartsWith(pos, "</"))
+            {
+                pos = ParseEndTag(pos, open, lastChild);
+            }
+            else
+            {
+                ThrowErrorIf(Error::XmlFatal, (open.empty() && !m_nodes.empty()), "Multiple xml root elements");
+                pos = ParseStartTag(pos, open, lastChild);
+            }
+        }
+        ThrowErrorIf(Error::XmlFatal, m_nodes.empty(), "Xml document has no root element");
+        ThrowErrorIf(Error::XmlFatal, !open.empty(), "Unexpected end of xml document");
+    }
+
+    std::vector<std::uint8_t> m_buffer;
+    const char* m_data = nullptr;
+    std::size_t m_size = 0;
+    std::vector<Node> m_nodes;
+    std::vector<Attribute> m_attributes;
+};
+
+// The supported xpath subset: "/A/B", "./A/B" and "A/B". A name without a prefix is matched against the local
+// name of the element, like the local-name() queries of msxml6, a qualified name or '*' is matched as is.
+struct MsixXmlQuery
+{
+    bool fromRoot = false;
+    std::vector<std::string> names;
+};
+
+static MsixXmlQuery ParseMsixXmlQuery(const std::string& xpath)
+{
+    MsixXmlQuery result;
+    std::size_t start = 0;
+    if (xpath.size() >= 2 && xpath[0] == '.' && xpath[1] == '/')
+    {
+        start = 2;
+    }
+    else if (!xpath.empty() && xpath[0] == '/')
+    {
+        result.fromRoot = true;
+        start = 1;
+    }
+    while (start <= xpath.size())
+    {
+        std::size_t separator = std::min(xpath.find_first_of('/', start), xpath.size());
+        auto name = xpath.substr(start, separator - start);
+        ThrowErrorIf(Error::InvalidParameter,
+            (name.empty() || name == "." || name == ".." || name.find_first_of("[(@") != std::string::npos),
+            "Unsupported xpath");
+        result.names.push_back(std::move(name));
+        start = separator + 1;
+    }
+    return result;
+}
+
+static const MsixXmlQuery& GetMsixXmlQuery(XmlQueryName query)
+{
+    static const std::vector<MsixXmlQuery> queries = []()
+    {
+        std::vector<MsixXmlQuery> result;
+        for (std::size_t i = 0; i < GetQueryCount(); i++)
+        {
+            result.push_back(ParseMsixXmlQuery(GetQueryString(static_cast<XmlQueryName>(i))));
+        }
+        return result;
+    }();
+    return queries[static_cast<std::underlying_type_t<XmlQueryName>>(query)];
+}
+
+class XmlElement final : public ComClass<XmlElement, IXmlElement, IMsixXmlElement, IMsixElement>
+{
+public:
+    XmlElement(IMsixFactory* factory, const MsixXmlDocument* document, std::uint32_t node) :
+        m_factory(factory), m_document(document), m_node(node)
+    {
+    }
+
+    // IXmlElement
+    std::string GetAttributeValue(XmlAttributeName attribute) override
+    {
+        return m_document->GetAttributeValue(m_node, GetAttributeNameStringUtf8(attribute));
+    }
+
+    std::vector<std::uint8_t> GetBase64DecodedAttributeValue(XmlAttributeName attribute) override
+    {
+        auto intermediate = GetAttributeValue(attribute);
+        return Encoding::GetBase64DecodedValue(intermediate);
+    }
+
+    std::string GetText() override
+    {
+        return m_document->GetText(m_node);
+    }
+
+    std::string GetPrefix() override
+    {
+        return m_document->GetPrefix(m_node);
+    }
+
+    // IMsixXmlElement
+    std::uint32_t GetNode() override { return m_node; }
+
+     // IMsixElement
+    HRESULT STDMETHODCALLTYPE GetAttributeValue(LPCWSTR name, LPWSTR* value) noexcept override try
+    {
+        ThrowErrorIf(Error::InvalidParameter, (value == nullptr), "bad pointer.");
+        auto attributeValue = m_document->GetAttributeValue(m_node, wstring_to_utf8(name));
+        return m_factory->MarshalOutString(attributeValue, value);
+    } CATCH_RETURN();
+
+    HRESULT STDMETHODCALLTYPE GetText(LPWSTR* value) noexcept override try
+    {
+        ThrowErrorIf(Error::InvalidParameter, (value == nullptr), "bad pointer.");
+        auto text = GetText();
+        return m_factory->MarshalOutString(text, value);
+    } CATCH_RETURN();
+
+    HRESULT STDMETHODCALLTYPE GetElements(LPCWSTR xpath, IMsixElementEnumerator** elements) noexcept override try
+    {
+        return GetElementsUtf8(wstring_to_utf8(xpath).c_str(), elements);
+    } CATCH_RETURN();
+
+    HRESULT STDMETHODCALLTYPE GetAttributeValueUtf8(LPCSTR name, LPSTR* value) noexcept override try
+    {
+        ThrowErrorIf(Error::InvalidParameter, (value == nullptr), "bad pointer.");
+        auto attributeValue = m_document->GetAttributeValue(m_node, std::string(name));
+        return m_factory->MarshalOutStringUtf8(attributeValue, value);
+    } CATCH_RETURN();
+
+    HRESULT STDMETHODCALLTYPE GetTextUtf8(LPSTR* value) noexcept override try
+    {
+        ThrowErrorIf(Error::InvalidParameter, (value == nullptr), "bad pointer.");
+        auto text = GetText();
+        return m_factory->MarshalOutStringUtf8(text, value);
+    } CATCH_RETURN();
+
+    HRESULT STDMETHODCALLTYPE GetElementsUtf8(LPCSTR xpath, IMsixElementEnumerator** elements) noexcept override try
+    {
+        ThrowErrorIf(Error::InvalidParameter, (xpath == nullptr || elements == nullptr || *elements != nullptr), "bad pointer.");
+        auto query = ParseMsixXmlQuery(xpath);
+        std::vector<ComPtr<IMsixElement>> elementsEnum;
+        auto add = [&](std::uint32_t node)
+        {
+            elementsEnum.push_back(ComPtr<IMsixElement>::Make<XmlElement>(m_factory, m_document, node));
+            return true;
+        };
+        if (!query.fromRoot)
+        {
+            m_document->ForEachChild(m_node, query.names, 0, add);
+        }
+        else if (m_document->MatchesStep(0, query.names[0]))
+        {
+            // The first name is the one of the root element, which is always the first node
+            if (query.names.size() == 1) { add(0); }
+            else { m_document->ForEachChild(0, query.names, 1, add); }
+        }
+        *elements = ComPtr<IMsixElementEnumerator>::Make<EnumeratorCom<IMsixElementEnumerator,IMsixElement>>(std::move(elementsEnum)).Detach();
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
+
+private:
+    IMsixFactory* m_factory = nullptr;
+    const MsixXmlDocument* m_document = nullptr;
+    std::uint32_t m_node = 0;
+};
+
+class XmlDom final : public ComClass<XmlDom, IXmlDom>
+{
+public:
+    XmlDom(IMsixFactory* factory, const ComPtr<IStream>& stream) :
+        m_factory(factory), m_stream(stream), m_document(Helper::CreateBufferFromStream(stream))
+    {
+        // This parser doesn't do schema validation. If schema validation is required, then use xerces or msxml6 as the xml parser.
+    }
+
+    // IXmlDom
+    MSIX::ComPtr<IXmlElement> GetDocument() override
+    {
+        return ComPtr<IXmlElement>::Make<XmlElement>(m_factory, &m_document, 0);
+    }
+
+    bool ForEachElementIn(const ComPtr<IXmlElement>& root, XmlQueryName query, XmlVisitor& visitor) override
+    {
+        auto node = root.As<IMsixXmlElement>()->GetNode();
+        const auto& msixXmlQuery = GetMsixXmlQuery(query);
+        auto visit = [&](std::uint32_t element)
+        {
+            auto item = ComPtr<IXmlElement>::Make<XmlElement>(m_factory, &m_document, element);
+            return visitor(item);
+        };
+
+        if (!msixXmlQuery.fromRoot)
+        {
+            return m_document.ForEachChild(node, msixXmlQuery.names, 0, visit);
+        }
+        // The first name is the one of the root element
+        ThrowErrorIfNot(Error::XmlFatal, m_document.MatchesStep(node, msixXmlQuery.names[0]), "Invalid root element");
+        if (msixXmlQuery.names.size() == 1)
+        {
+            return visit(node);
+        }
+        return m_document.ForEachChild(node, msixXmlQuery.names, 1, visit);
+    }
+
+protected:
+    IMsixFactory* m_factory;
+    ComPtr<IStream> m_stream;
+    MsixXmlDocument m_document;
+};
+
+class MsixXmlFactory final : public ComClass<MsixXmlFactory, IXmlFactory>
+{
+public:
+    MsixXmlFactory(IMsixFactory* factory) : m_factory(factory)
+    {
+    }
+
+    ComPtr<IXmlDom> CreateDomFromStream(XmlContentType footPrintType, const ComPtr<IStream>& stream, bool validateSchema) override
+    {
+        return ComPtr<IXmlDom>::Make<XmlDom>(m_factory, stream);
+    }
+protected:
+    IMsixFactory* m_factory;
+};
+
+ComPtr<IXmlFactory> CreateXmlFactory(IMsixFactory* factory) { return ComPtr<IXmlFactory>::Make<MsixXmlFactory>(factory); }
+
+} // namespace MSIX
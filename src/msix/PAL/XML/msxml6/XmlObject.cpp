@@ -9,6 +9,8 @@
 #include <tuple>
 #include <map>
 #include <algorithm>
+#include <mutex>
+#include <type_traits>
 #include <wchar.h>
 
 #include "Exceptions.hpp"
@@ -128,6 +130,21 @@ public:
     VARIANT& Get() { return m_variant; }
 };
 
+// The xpath of every XmlQueryName, allocated once for the process instead of on every query.
+static BSTR GetQueryBstr(XmlQueryName query)
+{
+    static const std::vector<std::unique_ptr<Bstr>> queries = []()
+    {
+        std::vector<std::unique_ptr<Bstr>> result;
+        for (std::size_t i = 0; i < GetQueryCount(); i++)
+        {
+            result.push_back(std::make_unique<Bstr>(GetQueryString(static_cast<XmlQueryName>(i))));
+        }
+        return result;
+    }();
+    return queries[static_cast<std::underlying_type_t<XmlQueryName>>(query)]->Get();
+}
+
 class MSXMLElement final : public ComClass<MSXMLElement, IXmlElement, IMSXMLElement, IMsixElement>
 {
 public:
@@ -179,9 +196,8 @@ public:
     // IMSXMLElement
     ComPtr<IXMLDOMNodeList> SelectNodes(XmlQueryName query) override
     {
-        Bstr xPath(GetQueryString(query));
         ComPtr<IXMLDOMNodeList> list;
-        ThrowHrIfFailed(m_element->selectNodes(xPath, &list));
+        ThrowHrIfFailed(m_element->selectNodes(GetQueryBstr(query), &list));
         return list;
     }
 
@@ -233,7 +249,7 @@ public:
             elementsEnum.push_back(std::move(item));
         }
         *elements = ComPtr<IMsixElementEnumerator>::
-            Make<EnumeratorCom<IMsixElementEnumerator,IMsixElement>>(elementsEnum).Detach();
+            Make<EnumeratorCom<IMsixElementEnumerator,IMsixElement>>(std::move(elementsEnum)).Detach();
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
 
@@ -298,7 +314,7 @@ protected:
             auto item = ComPtr<IMsixElement>::Make<MSXMLElement>(m_factory, elementItem);
             elementsEnum.push_back(std::move(item));
         }
-        return ComPtr<IMsixElementEnumerator>::Make<EnumeratorCom<IMsixElementEnumerator,IMsixElement>>(elementsEnum);
+        return ComPtr<IMsixElementEnumerator>::Make<EnumeratorCom<IMsixElementEnumerator,IMsixElement>>(std::move(elementsEnum));
     }
 
     IMsixFactory* m_factory;
@@ -321,10 +337,19 @@ protected:
     }                                                                            \
 }
 
+// A validated schema collection and the selection namespaces for a set of namespaces. Once validated
+// the collection is read only and can be set on any number of documents.
+struct MSXMLSchemas
+{
+    ComPtr<IXMLDOMSchemaCollection2> cache;
+    std::wstring selectionNamespaces;
+};
+
 class MSXMLDom final : public ComClass<MSXMLDom, IXmlDom, IMSXMLDom>
 {
 public:
-    MSXMLDom(const ComPtr<IStream>& stream, const NamespaceManager& namespaces, IMsixFactory* factory = nullptr, bool stripIgnorableNamespaces = false) : m_factory(factory)
+    MSXMLDom(const ComPtr<IStream>& stream, const NamespaceManager& namespaces, IMsixFactory* factory = nullptr, bool stripIgnorableNamespaces = false,
+        const MSXMLSchemas* schemas = nullptr) : m_factory(factory)
     {
         ThrowHrIfFailed(CoCreateInstance(__uuidof(DOMDocument60), nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&m_xmlDocument)));
         ThrowHrIfFailed(m_xmlDocument->put_async(VARIANT_FALSE));
@@ -334,39 +359,20 @@ public:
         ThrowHrIfFailed(m_xmlDocument->setProperty(property.Get(), vTrue.Get()));
 
         if (nullptr != m_factory && !namespaces.empty())
-        {   // Create and populate schema cache
-            ComPtr<IXMLDOMSchemaCollection2> cache;
-            ThrowHrIfFailed(CoCreateInstance(__uuidof(XMLSchemaCache60), nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&cache)));
-            ThrowHrIfFailed(cache->put_validateOnLoad(VARIANT_FALSE));
-
-            std::size_t countNamespaces = 0;
-            std::wostringstream value;
-            for(const auto& item : namespaces)
+        {   // Use the compiled schemas when given, otherwise compile them for this document only
+            MSXMLSchemas localSchemas;
+            if (nullptr == schemas)
             {
-                std::wstring uri = item.uri;
-                if (0 != countNamespaces++) { value << L" "; } // namespaces are space-delimited
-                value << L"xmlns:" << item.alias << LR"(=")" << uri << LR"(")";
-                // Process schema XSD for current namespace
-                NamespaceManager emptyManager;
-                ComPtr<IStream> resource(m_factory->GetResource(item.schema));
-                auto schema = ComPtr<IMSXMLDom>::Make<MSXMLDom>(resource, emptyManager)->GetDomDocument();
-
-                long readyState = 0;
-                ThrowHrIfFailed(schema->get_readyState(&readyState));
-                ThrowErrorIfNot(Error::Unexpected, (4 == readyState), "The document has not been completely loaded.");
-
-                Bstr schemaNamespace(uri);
-                Variant var(schema);
-                ThrowHrIfFailedWithIErrorInfo(cache->add(schemaNamespace, var.Get()));
+                localSchemas = CreateSchemas(m_factory, namespaces);
+                schemas = &localSchemas;
             }
             // Set selection namespaces for the XML document
             Bstr selectionProperty(L"SelectionNamespaces");
-            Bstr selectionValue(value.str());
+            Bstr selectionValue(schemas->selectionNamespaces);
             Variant selectionVariant(selectionValue);
             ThrowHrIfFailed(m_xmlDocument->setProperty(selectionProperty, selectionVariant.Get()));
-            // Validate the schema collection and set the schemas for the XML document
-            ThrowHrIfFailedWithIErrorInfo(cache->validate());
-            Variant schemasVariant(cache);
+            // Set the schemas for the XML document
+            Variant schemasVariant(schemas->cache);
             ThrowHrIfFailed(m_xmlDocument->putref_schemas(schemasVariant.Get()));
         }
 
@@ -391,7 +397,7 @@ public:
             ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::START, nullptr));
 
             ULARGE_INTEGER bytesCount = {0};
-            bytesCount.QuadPart = end.u.LowPart;
+            bytesCount.QuadPart = end.QuadPart;
             // Now create the in memory copy
             ComPtr<IStream> inMemoryCopy;
             ThrowHrIfFailed(CreateStreamOnHGlobal(NULL, TRUE, &inMemoryCopy));
@@ -515,6 +521,39 @@ public:
         }
     }
 
+    // Loads and validates the schemas of every namespace, which is the expensive part of creating a validating document.
+    static MSXMLSchemas CreateSchemas(IMsixFactory* factory, const NamespaceManager& namespaces)
+    {
+        MSXMLSchemas result;
+        ThrowHrIfFailed(CoCreateInstance(__uuidof(XMLSchemaCache60), nullptr, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&result.cache)));
+        ThrowHrIfFailed(result.cache->put_validateOnLoad(VARIANT_FALSE));
+
+        std::size_t countNamespaces = 0;
+        std::wostringstream value;
+        for(const auto& item : namespaces)
+        {
+            std::wstring uri = item.uri;
+            if (0 != countNamespaces++) { value << L" "; } // namespaces are space-delimited
+            value << L"xmlns:" << item.alias << LR"(=")" << uri << LR"(")";
+            // Process schema XSD for current namespace
+            NamespaceManager emptyManager;
+            ComPtr<IStream> resource(factory->GetResource(item.schema));
+            auto schema = ComPtr<IMSXMLDom>::Make<MSXMLDom>(resource, emptyManager)->GetDomDocument();
+
+            long readyState = 0;
+            ThrowHrIfFailed(schema->get_readyState(&readyState));
+            ThrowErrorIfNot(Error::Unexpected, (4 == readyState), "The document has not been completely loaded.");
+
+            Bstr schemaNamespace(uri);
+            Variant var(schema);
+            ThrowHrIfFailedWithIErrorInfo(result.cache->add(schemaNamespace, var.Get()));
+        }
+        // Validate the schema collection
+        ThrowHrIfFailedWithIErrorInfo(result.cache->validate());
+        result.selectionNamespaces = value.str();
+        return result;
+    }
+
     // IMSXMLDom
     MSIX::ComPtr<IXMLDOMDocument> GetDomDocument() override
     {
@@ -569,33 +608,52 @@ public:
         ThrowHrIfFailed(result);
     }
 
-    ~MSXMLFactory() { if (m_CoInitialized) { CoUninitialize(); m_CoInitialized = false; } }
+    ~MSXMLFactory()
+    {
+        m_schemas.clear();
+        if (m_CoInitialized) { CoUninitialize(); m_CoInitialized = false; }
+    }
 
-    ComPtr<IXmlDom> CreateDomFromStream(XmlContentType footPrintType, const ComPtr<IStream>& stream) override
+    ComPtr<IXmlDom> CreateDomFromStream(XmlContentType footPrintType, const ComPtr<IStream>& stream, bool validateSchema) override
     {
         NamespaceManager emptyManager;
 
         #if VALIDATING
-        bool HasIgnorableNamespaces = (XmlContentType::AppxManifestXml == footPrintType);
+        bool HasIgnorableNamespaces = validateSchema && (XmlContentType::AppxManifestXml == footPrintType);
         #else
         bool HasIgnorableNamespaces = false;
         #endif
 
-        return ComPtr<IXmlDom>::Make<MSXMLDom>(
-            stream,
-            #if VALIDATING
-                // No need to validate block map xml schema as it is CPU intensive, especially for large packages with large block map xml, which is  
-                // about 0.1% of the uncompressed payload size. We have semantic validation at consumption to catch mal-formatted xml. 
-                // We consume what we know and ignore what we don't know for future proof.
-                (XmlContentType::AppxBlockMapXml == footPrintType) ? emptyManager : s_xmlNamespaces[static_cast<std::uint8_t>(footPrintType)],
-            #else
-                emptyManager,
-            #endif
-            m_factory,
-            HasIgnorableNamespaces);
+        #if VALIDATING
+        // No need to validate block map xml schema as it is CPU intensive, especially for large packages with large block map xml, which is  
+        // about 0.1% of the uncompressed payload size. We have semantic validation at consumption to catch mal-formatted xml. 
+        // We consume what we know and ignore what we don't know for future proof.
+        const NamespaceManager& namespaces = (!validateSchema || XmlContentType::AppxBlockMapXml == footPrintType) ? emptyManager : s_xmlNamespaces[static_cast<std::uint8_t>(footPrintType)];
+        #else
+        const NamespaceManager& namespaces = emptyManager;
+        #endif
+
+        return ComPtr<IXmlDom>::Make<MSXMLDom>(stream, namespaces, m_factory, HasIgnorableNamespaces, GetSchemas(footPrintType, namespaces));
     }
 
 protected:
+    // The schemas are compiled the first time a document of a type is created and shared by every document created
+    // by this factory afterwards. They are not shared across factories, as they must be released before the factory
+    // uninitializes COM.
+    const MSXMLSchemas* GetSchemas(XmlContentType footPrintType, const NamespaceManager& namespaces)
+    {
+        if (namespaces.empty()) { return nullptr; }
+        std::lock_guard<std::mutex> lock(m_schemasLock);
+        auto& schemas = m_schemas[static_cast<std::uint8_t>(footPrintType)];
+        if (!schemas.cache)
+        {
+            schemas = MSXMLDom::CreateSchemas(m_factory, namespaces);
+        }
+        return &schemas;
+    }
+
+    std::mutex      m_schemasLock;
+    std::map<std::uint8_t, MSXMLSchemas> m_schemas;
     bool            m_CoInitialized;
     IMsixFactory*   m_factory;
 };
@@ -2,12 +2,15 @@
 //  Copyright (C) 2017 Microsoft.  All rights reserved.
 //  See LICENSE file in the project root for full license information.
 // 
+#include <algorithm>
 #include <memory>
 #include <string>
+#include <type_traits>
 #include <vector>
 #include <map>
 #include <queue>
 #include <list>
+#include <mutex>
 
 #include "Exceptions.hpp"
 #include "StreamBase.hpp"
@@ -360,7 +363,7 @@ public:
             elementsEnum.push_back(std::move(item));
         }
         *elements = ComPtr<IMsixElementEnumerator>::
-            Make<EnumeratorCom<IMsixElementEnumerator,IMsixElement>>(elementsEnum).Detach();
+            Make<EnumeratorCom<IMsixElementEnumerator,IMsixElement>>(std::move(elementsEnum)).Detach();
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
 
@@ -371,43 +374,150 @@ protected:
     XercesPtr<DOMXPathNSResolver> m_resolver;
 };
 
+// Process wide cache of the compiled schemas, one locked grammar pool per type of xml document. Compiling the
+// schemas with full checking costs much more than validating a manifest against them, so it is done once and the
+// pools are shared by every parser afterwards. A locked pool is read only and safe to use from several threads.
+// The cache holds its own reference on xerces, so the pools outlive the factories that created them.
+class SchemaGrammarCache final
+{
+public:
+    static SchemaGrammarCache& Instance()
+    {
+        static SchemaGrammarCache cache;
+        return cache;
+    }
+
+    // Returns the compiled schemas of a type of document, or null when there are no schemas to validate it with.
+    // The schema resources are only read the first time, by the first factory that needs them.
+    XERCES_CPP_NAMESPACE::XMLGrammarPool* GetGrammarPool(IMsixFactory* factory, XmlContentType footPrintType, Resource::Type schemaType)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto cached = m_pools.find(static_cast<std::uint8_t>(footPrintType));
+        if (cached == m_pools.end())
+        {
+            // For Non validation parser GetResources will return an empty vector for the ContentType, BlockMap and AppxBundleManifest.
+            // The document is then only checked to be valid xml.
+            auto schemas = GetResources(factory, schemaType);
+            if (schemas.empty())
+            {
+                m_pools.emplace(static_cast<std::uint8_t>(footPrintType), nullptr);
+                return nullptr;
+            }
+            auto newPool = std::make_unique<XERCES_CPP_NAMESPACE::XMLGrammarPoolImpl>(XERCES_CPP_NAMESPACE::XMLPlatformUtils::fgMemoryManager);
+            {
+                XERCES_CPP_NAMESPACE::XercesDOMParser parser(nullptr, XERCES_CPP_NAMESPACE::XMLPlatformUtils::fgMemoryManager, newPool.get());
+                ParsingException errorHandler;
+                MsixEntityResolver entityResolver(factory, s_xmlNamespaces[static_cast<std::uint8_t>(footPrintType)]);
+                parser.setErrorHandler(&errorHandler);
+                parser.setXMLEntityResolver(&entityResolver);
+                parser.setDoNamespaces(true);
+                parser.setValidationScheme(XERCES_CPP_NAMESPACE::AbstractDOMParser::ValSchemes::Val_Always);
+                parser.setDoSchema(true);
+                parser.setValidationSchemaFullChecking(true);
+                parser.setIgnoreCachedDTD(true);
+                parser.setSkipDTDValidation(true);
+                for(const auto& schema : schemas)
+                {
+                    auto schemaBuffer = Helper::CreateBufferFromStream(schema.second);
+                    auto item = std::make_unique<XERCES_CPP_NAMESPACE::MemBufInputSource>(
+                        reinterpret_cast<const XMLByte*>(&schemaBuffer[0]), schemaBuffer.size(), schema.first.c_str());
+                    parser.loadGrammar(*item, XERCES_CPP_NAMESPACE::Grammar::GrammarType::SchemaGrammarType, true);
+                }
+            }
+            newPool->lockPool();
+            cached = m_pools.emplace(static_cast<std::uint8_t>(footPrintType), std::move(newPool)).first;
+        }
+        return cached->second.get();
+    }
+
+private:
+    SchemaGrammarCache()
+    {
+        XERCES_CPP_NAMESPACE::XMLPlatformUtils::Initialize();
+    }
+
+    ~SchemaGrammarCache()
+    {
+        m_pools.clear();
+        XERCES_CPP_NAMESPACE::XMLPlatformUtils::Terminate();
+    }
+
+    std::mutex m_lock;
+    std::map<std::uint8_t, std::unique_ptr<XERCES_CPP_NAMESPACE::XMLGrammarPoolImpl>> m_pools;
+};
+
+// A query of XmlQueryName split into the local names to match, transcoded once for the process.
+struct XercesQuery
+{
+    bool fromRoot = false;
+    std::vector<std::basic_string<XMLCh>> names;
+};
+
+static const XercesQuery& GetXercesQuery(XmlQueryName query)
+{
+    static const std::vector<XercesQuery> queries = []()
+    {
+        std::vector<XercesQuery> result(GetQueryCount());
+        for (std::size_t i = 0; i < result.size(); i++)
+        {
+            std::string xpath(GetQueryString(static_cast<XmlQueryName>(i)));
+            std::size_t start = 0;
+            if (xpath.size() >= 2 && xpath[0] == '.' && xpath[1] == '/')
+            {
+                start = 2;
+            }
+            else if (xpath.size() > 1 && xpath[0] == '/')
+            {
+                result[i].fromRoot = true;
+                start = 1;
+            }
+            ThrowErrorIf(Error::Unexpected, (start == 0), "Invalid query");
+            while (start <= xpath.size())
+            {
+                std::size_t separator = std::min(xpath.find_first_of('/', start), xpath.size());
+                XercesXMLChPtr name(XMLString::transcode(xpath.substr(start, separator - start).c_str()));
+                result[i].names.emplace_back(name.Get());
+                start = separator + 1;
+            }
+        }
+        return result;
+    }();
+    return queries[static_cast<std::underlying_type_t<XmlQueryName>>(query)];
+}
+
 class XercesDom final : public ComClass<XercesDom, IXmlDom>
 {
 public:
-    XercesDom(IMsixFactory* factory, const ComPtr<IStream>& stream, XmlContentType footPrintType) :
+    XercesDom(IMsixFactory* factory, const ComPtr<IStream>& stream, XmlContentType footPrintType, bool validateSchema) :
         m_factory(factory), m_stream(stream)
     {
         auto buffer = Helper::CreateBufferFromStream(stream);
         std::unique_ptr<XERCES_CPP_NAMESPACE::MemBufInputSource> source = std::make_unique<XERCES_CPP_NAMESPACE::MemBufInputSource>(
             reinterpret_cast<const XMLByte*>(&buffer[0]), buffer.size(), "XML File");
 
-        // Create parser and grammar pool
-        auto grammarPool = std::make_unique<XERCES_CPP_NAMESPACE::XMLGrammarPoolImpl>(XERCES_CPP_NAMESPACE::XMLPlatformUtils::fgMemoryManager);
-        m_parser = std::make_unique<XERCES_CPP_NAMESPACE::XercesDOMParser>(nullptr, XERCES_CPP_NAMESPACE::XMLPlatformUtils::fgMemoryManager, grammarPool.get());
-        
-        // For Non validation parser GetResources will return an empty vector for the ContentType, BlockMap and AppxBundleManifest.
-        // XercesDom will only parse the schemas if the vector is not empty. If not, it will only see that it is valid xml.
-        std::vector<std::pair<std::string, ComPtr<IStream>>> schemas;
-        if (footPrintType == XmlContentType::AppxBlockMapXml)
+        // Create the parser, using the shared compiled schemas when the document is validated. Block map xml does
+        // not need schema validation, and neither does a document that was already validated.
+        XERCES_CPP_NAMESPACE::XMLGrammarPool* grammarPool = nullptr;
+        if (footPrintType == XmlContentType::AppxBlockMapXml || !validateSchema)
         {
-            // Block map xml does not need schema validation.
         }
         else if (footPrintType == XmlContentType::AppxManifestXml)
         {
-            schemas = GetResources(m_factory, Resource::Type::AppxManifest);
+            grammarPool = SchemaGrammarCache::Instance().GetGrammarPool(m_factory, footPrintType, Resource::Type::AppxManifest);
         }
         else if (footPrintType == XmlContentType::ContentTypeXml)
         {
-            schemas = GetResources(m_factory, Resource::Type::ContentType);
+            grammarPool = SchemaGrammarCache::Instance().GetGrammarPool(m_factory, footPrintType, Resource::Type::ContentType);
         }
         else if (footPrintType == XmlContentType::AppxBundleManifestXml)
         {
-            schemas = GetResources(m_factory, Resource::Type::AppxBundleManifest);
+            grammarPool = SchemaGrammarCache::Instance().GetGrammarPool(m_factory, footPrintType, Resource::Type::AppxBundleManifest);
         }
         else
         {
             ThrowError(Error::InvalidParameter);
         }
+        m_parser = std::make_unique<XERCES_CPP_NAMESPACE::XercesDOMParser>(nullptr, XERCES_CPP_NAMESPACE::XMLPlatformUtils::fgMemoryManager, grammarPool);
 
         // Set the error handler and entity resolver for the parser
         auto errorHandler = std::make_unique<ParsingException>();
@@ -416,7 +526,7 @@ public:
         m_parser->setXMLEntityResolver(entityResolver.get());
         m_parser->setDoNamespaces(true);
 
-        if (!schemas.empty())
+        if (grammarPool)
         {
             if (footPrintType == XmlContentType::AppxManifestXml || footPrintType == XmlContentType::AppxBundleManifestXml)
             {
@@ -424,21 +534,13 @@ public:
             }
 
             m_parser->setValidationScheme(XERCES_CPP_NAMESPACE::AbstractDOMParser::ValSchemes::Val_Always);
-            m_parser->cacheGrammarFromParse(true);
+            m_parser->useCachedGrammarInParse(true);
             m_parser->setDoSchema(true);
             m_parser->setValidationSchemaFullChecking(true);
             // Disable DTD and prevent XXE attacks.  See https://www.owasp.org/index.php/XML_External_Entity_(XXE)_Prevention_Cheat_Sheet#libxerces-c for additional details.
             m_parser->setIgnoreCachedDTD(true);
             m_parser->setSkipDTDValidation(true);
             m_parser->setCreateEntityReferenceNodes(false);
-
-            for(const auto& schema : schemas)
-            {
-                auto schemaBuffer = Helper::CreateBufferFromStream(schema.second);
-                auto item = std::make_unique<XERCES_CPP_NAMESPACE::MemBufInputSource>(
-                    reinterpret_cast<const XMLByte*>(&schemaBuffer[0]), schemaBuffer.size(), schema.first.c_str());
-                m_parser->loadGrammar(*item, XERCES_CPP_NAMESPACE::Grammar::GrammarType::SchemaGrammarType, true);
-            }
         }
 
         m_parser->parse(*source);
@@ -457,20 +559,18 @@ public:
         DOMElement* element = root.As<IXercesElement>()->GetElement();
 
         std::list<DOMElement*> list;
-        std::string xpath(GetQueryString(query));
+        const auto& xercesQuery = GetXercesQuery(query);
 
-        if (xpath.size() >= 2 && xpath[0] == '.' && xpath[1] == '/')
+        if (!xercesQuery.fromRoot)
         {
-            FindChildElements(xpath.substr(2), element, list);
+            FindChildElements(xercesQuery.names, 0, element, list);
         }
-        else if (xpath.size() > 1 && xpath[0] == '/')
+        else
         {
-            // Get name of root element
-            std::size_t secondSlash =  xpath.find_first_of('/', 1);
-            XercesXMLChPtr firstElement(XMLString::transcode(xpath.substr(1, secondSlash - 1).c_str()));
-            if (XMLString::compareString(firstElement.Get(), static_cast<DOMNode*>(element)->getLocalName()) == 0)
+            // The first name is the one of the root element
+            if (XMLString::compareString(xercesQuery.names[0].c_str(), static_cast<DOMNode*>(element)->getLocalName()) == 0)
             {
-                FindChildElements(xpath.substr(secondSlash + 1), element, list);
+                FindChildElements(xercesQuery.names, 1, element, list);
             }
             else
             {
@@ -607,30 +707,29 @@ protected:
         }
     }
 
-    void FindChildElements(std::string xpath, DOMElement* root, std::list<DOMElement*>& list)
+    void FindChildElements(const std::vector<std::basic_string<XMLCh>>& names, std::size_t index, DOMElement* root, std::list<DOMElement*>& list)
     {
         // The special value "*" matches all namespaces
-        XercesXMLChPtr allNS(XMLString::transcode("*"));
+        static const XMLCh allNS[] = { chAsterisk, chNull };
 
         // Find next element to search
-        std::size_t nextSeparator = xpath.find_first_of('/');
-        XercesXMLChPtr nextElement(XMLString::transcode(xpath.substr(0, nextSeparator).c_str()));
+        const XMLCh* nextElement = names[index].c_str();
 
-        DOMNodeList* childs = root->getElementsByTagNameNS(allNS.Get(), nextElement.Get());
+        DOMNodeList* childs = root->getElementsByTagNameNS(allNS, nextElement);
         XMLSize_t childsSize = childs->getLength();
         for(XMLSize_t i = 0; i < childsSize; i++)
         {
             DOMNode* node = childs->item(i);
-            if (XMLString::compareString(nextElement.Get(), node->getLocalName()) == 0)
+            if (XMLString::compareString(nextElement, node->getLocalName()) == 0)
             {
-                if (nextSeparator == std::string::npos)
+                if (index + 1 == names.size())
                 {
                     // This is the node we are looking for.
                     list.emplace_back(static_cast<DOMElement*>(node));
                 }
                 else
                 {
-                    FindChildElements(xpath.substr(nextSeparator + 1), static_cast<DOMElement*>(node), list);
+                    FindChildElements(names, index + 1, static_cast<DOMElement*>(node), list);
                 }
             }
         }
@@ -644,19 +743,14 @@ protected:
 class XercesFactory final : public ComClass<XercesFactory, IXmlFactory>
 {
 public:
-    XercesFactory(IMsixFactory* factory) : m_factory(factory)
-    {
-        XERCES_CPP_NAMESPACE::XMLPlatformUtils::Initialize();
-    }
-
-    ~XercesFactory()
-    {
-        XERCES_CPP_NAMESPACE::XMLPlatformUtils::Terminate();
-    }
+    XercesFactory(IMsixFactory* factory) : m_factory(factory) {}
 
-    ComPtr<IXmlDom> CreateDomFromStream(XmlContentType footPrintType, const ComPtr<IStream>& stream) override
+    ComPtr<IXmlDom> CreateDomFromStream(XmlContentType footPrintType, const ComPtr<IStream>& stream, bool validateSchema) override
     {
-        return ComPtr<IXmlDom>::Make<XercesDom>(m_factory, stream, footPrintType);
+        // Xerces is initialized by the first document of the process rather than by every factory, so creating a
+        // factory that doesn't parse xml costs nothing. It stays initialized until the process exits.
+        SchemaGrammarCache::Instance();
+        return ComPtr<IXmlDom>::Make<XercesDom>(m_factory, stream, footPrintType, validateSchema);
     }
 protected:
     IMsixFactory* m_factory;
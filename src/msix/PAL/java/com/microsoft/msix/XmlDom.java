@@ -6,6 +6,8 @@ package com.microsoft.msix;
 
 import org.w3c.dom.Document;
 import org.w3c.dom.Element;
+import org.w3c.dom.NamedNodeMap;
+import org.w3c.dom.Node;
 import org.w3c.dom.NodeList;
 
 import java.io.ByteArrayInputStream;
@@ -51,4 +53,24 @@ public class XmlDom {
         }
         return elements.toArray(new XmlElement[0]);
     }
+
+    // Returns the elements that match query and all of their attributes, so the caller can read them without
+    // calling back for each one. The attributes are in a single string, each one written as name '\0' value '\0'
+    // and each element terminated by '\1'. Neither character can appear in an xml name or value.
+    public Object[] GetElementsAndAttributes(XmlElement root, String query) throws Exception {
+        NodeList results = (NodeList) m_xpath.evaluate(query, root.GetElement(), XPathConstants.NODESET);
+        XmlElement[] elements = new XmlElement[results.getLength()];
+        StringBuilder attributes = new StringBuilder();
+        for (int i = 0; i < results.getLength(); i++) {
+            Element element = (Element) results.item(i);
+            elements[i] = new XmlElement(element);
+            NamedNodeMap map = element.getAttributes();
+            for (int j = 0; j < map.getLength(); j++) {
+                Node attribute = map.item(j);
+                attributes.append(attribute.getNodeName()).append('\0').append(attribute.getNodeValue()).append('\0');
+            }
+            attributes.append('\1');
+        }
+        return new Object[] { elements, attributes.toString() };
+    }
 }
\ No newline at end of file
@@ -20,8 +20,7 @@ public class XmlElement {
 
     public XmlElement(Element element) {
         m_element = element;
-        XPathFactory factory = XPathFactory.newInstance();
-        m_xpath = factory.newXPath();
+        m_xpath = null;
     }
 
     public Element GetElement() {
@@ -56,6 +55,10 @@ public class XmlElement {
 
     public XmlElement[] GetElements(String query) throws Exception {
         List<XmlElement> elements = new ArrayList<>();
+        // Most elements are never queried, only create the XPath when it's needed
+        if (m_xpath == null) {
+            m_xpath = XPathFactory.newInstance().newXPath();
+        }
         NodeList results = (NodeList) m_xpath.evaluate(query, m_element, XPathConstants.NODESET);
         for (int i = 0; i < results.getLength(); i++) {
             XmlElement element = new XmlElement((Element) results.item(i));
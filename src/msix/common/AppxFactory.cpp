@@ -9,10 +9,13 @@
 #include "AppxPackageObject.hpp"
 #include "MSIXResource.hpp"
 #include "VectorStream.hpp"
+#include "StreamHelper.hpp"
 #include "MsixFeatureSelector.hpp"
 #include "AppxPackageWriter.hpp"
 #include "AppxBundleWriter.hpp"
 #include "ZipObjectWriter.hpp"
+#include "Tracing.hpp"
+#include "ScopeExit.hpp"
 
 #ifdef BUNDLE_SUPPORT
 #include "AppxBundleManifest.hpp"
@@ -32,9 +35,11 @@ namespace MSIX {
         #ifdef MSIX_PACK 
         ComPtr<IMsixFactory> self;
         ThrowHrIfFailed(QueryInterface(UuidOfImpl<IMsixFactory>::iid, reinterpret_cast<void**>(&self)));
-        auto zip = ComPtr<IZipWriter>::Make<ZipObjectWriter>(outputStream);
+        bool isStreaming = (m_factoryOptions & MSIX_FACTORY_OPTION_WRITER_STREAMING_OUTPUT) != 0;
+        bool signingDigests = (m_factoryOptions & MSIX_FACTORY_OPTION_WRITER_SIGNING_DIGESTS) != 0;
+        auto zip = ComPtr<IZipWriter>::Make<ZipObjectWriter>(outputStream, isStreaming, m_performanceCounters, signingDigests);
         bool enableFileHash = m_factoryOptions & MSIX_FACTORY_OPTION_WRITER_ENABLE_FILE_HASH;
-        auto result = ComPtr<IAppxPackageWriter>::Make<AppxPackageWriter>(self.Get(), zip, enableFileHash);
+        auto result = ComPtr<IAppxPackageWriter>::Make<AppxPackageWriter>(self.Get(), zip, enableFileHash, signingDigests);
         *packageWriter = result.Detach();
         #endif
         return static_cast<HRESULT>(Error::OK);
@@ -46,9 +51,7 @@ namespace MSIX {
     {
         ThrowErrorIf(Error::InvalidParameter, (packageReader == nullptr || *packageReader != nullptr), "Invalid parameter");
         ComPtr<IStream> input(inputStream);
-        auto zip = ComPtr<IStorageObject>::Make<ZipObjectReader>(input);
-        auto result = ComPtr<IAppxPackageReader>::Make<AppxPackageObject>(this, m_validationOptions, m_applicabilityFlags, zip);
-        *packageReader = result.Detach();
+        *packageReader = CreatePackageReaderWithIndex(input, nullptr).Detach();
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
 
@@ -58,8 +61,12 @@ namespace MSIX {
     {
         ThrowErrorIf(Error::InvalidParameter, (manifestReader == nullptr || *manifestReader != nullptr), "Invalid parameter");
         ComPtr<IStream> input(inputStream);
-        auto result = ComPtr<IAppxManifestReader>::Make<AppxManifestObject>(this, input);
-        *manifestReader = result.Detach();
+        auto result = ComPtr<AppxManifestObject>::Make<AppxManifestObject>(this, input);
+        if (m_factoryOptions & MSIX_FACTORY_OPTION_READER_RELEASE_MANIFEST_DOM)
+        {
+            result->ReleaseDom(true);
+        }
+        *manifestReader = result.As<IAppxManifestReader>().Detach();
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
 
@@ -94,8 +101,11 @@ namespace MSIX {
         #ifdef MSIX_PACK 
         ComPtr<IMsixFactory> self;
         ThrowHrIfFailed(QueryInterface(UuidOfImpl<IMsixFactory>::iid, reinterpret_cast<void**>(&self)));
-        auto zip = ComPtr<IZipWriter>::Make<ZipObjectWriter>(outputStream);
-        auto result = ComPtr<IAppxBundleWriter>::Make<AppxBundleWriter>(self.Get(), zip, bundleVersion);
+        bool isStreaming = (m_factoryOptions & MSIX_FACTORY_OPTION_WRITER_STREAMING_OUTPUT) != 0;
+        auto zip = ComPtr<IZipWriter>::Make<ZipObjectWriter>(outputStream, isStreaming, m_performanceCounters);
+        bool readManifests = (m_factoryOptions & MSIX_FACTORY_OPTION_WRITER_BUNDLE_READ_MANIFESTS) != 0;
+        bool validatePackages = (m_factoryOptions & MSIX_FACTORY_OPTION_WRITER_BUNDLE_VALIDATE_PACKAGES) != 0;
+        auto result = ComPtr<IAppxBundleWriter>::Make<AppxBundleWriter>(self.Get(), zip, bundleVersion, readManifests, validatePackages);
         *bundleWriter = result.Detach();
         #endif
         return static_cast<HRESULT>(Error::OK);
@@ -124,14 +134,18 @@ namespace MSIX {
     } CATCH_RETURN();
 
     // IMsixFactory
-    HRESULT AppxFactory::MarshalOutString(std::string& internal, LPWSTR *result) noexcept try
+    HRESULT AppxFactory::MarshalOutString(const std::string& internal, LPWSTR *result) noexcept try
     {
         ThrowErrorIf(Error::InvalidParameter, (result == nullptr || *result != nullptr), "bad pointer" );
         *result = nullptr;
         if (!internal.empty())
-        {
-            auto intermediate = utf8_to_wstring(internal);
-            ThrowHrIfFailed(MarshalOutWstring(intermediate, result));
+        {   // Converted straight into the buffer returned, which has a unit per byte of utf8 and the terminator
+            auto buffer = reinterpret_cast<wchar_t*>(m_memalloc(sizeof(wchar_t) * (internal.size() + 1)));
+            ThrowErrorIfNot(Error::OutOfMemory, buffer, "Allocation failed!");
+            auto freeBuffer = MSIX::scope_exit([this, buffer] { m_memfree(buffer); });
+            buffer[utf8_to_utf16(internal.data(), internal.size(), buffer)] = 0;
+            freeBuffer.release();
+            *result = buffer;
         }
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
@@ -148,7 +162,7 @@ namespace MSIX {
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
 
-    HRESULT AppxFactory::MarshalOutStringUtf8(std::string& internal, LPSTR* result) noexcept try
+    HRESULT AppxFactory::MarshalOutStringUtf8(const std::string& internal, LPSTR* result) noexcept try
     {
         ThrowErrorIf(Error::InvalidParameter, (result == nullptr || *result != nullptr), "bad pointer" );
         *result = nullptr;
@@ -172,6 +186,59 @@ namespace MSIX {
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
 
+    // The resources are the same for every factory, so they are inflated once per process, each the first time
+    // it's asked for. A process that never validates a signature or a schema never reads the resource zip.
+    class ResourceCache final
+    {
+    public:
+        static ResourceCache& Instance()
+        {
+            static ResourceCache cache;
+            return cache;
+        }
+
+        // Inflated resources are never dropped, so readers on any thread can get their own stream over them.
+        std::vector<std::uint8_t>& Get(const std::string& resource)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            auto cached = m_resources.find(resource);
+            if (cached == m_resources.end())
+            {
+                if (!m_zip)
+                {
+                    // Get stream of the resource zip file generated at CMake processing.
+                    m_zipBytes = std::vector<std::uint8_t>(Resource::resourceByte, Resource::resourceByte + Resource::resourceLength);
+                    auto zipStream = ComPtr<IStream>::Make<VectorStream>(&m_zipBytes);
+                    m_zip = ComPtr<IStorageObject>::Make<ZipObjectReader>(zipStream.Get());
+                }
+                auto file = m_zip->GetFile(resource);
+                ThrowErrorIfNot(Error::FileNotFound, file, resource.c_str());
+                cached = m_resources.emplace(resource, Helper::CreateBufferFromStream(file)).first;
+            }
+            return cached->second;
+        }
+
+    private:
+        ResourceCache() {}
+
+        std::mutex m_lock;
+        std::vector<std::uint8_t> m_zipBytes;
+        ComPtr<IStorageObject> m_zip;
+        std::map<std::string, std::vector<std::uint8_t>> m_resources;
+    };
+
+    ComPtr<IAppxPackageReader> AppxFactory::CreatePackageReaderWithIndex(const ComPtr<IStream>& inputStream, const PackageIndex* index)
+    {
+        Tracing::Activity activity(Tracing::Event::OpenPackage);
+        bool deferLocalFileHeaders = (m_validationOptions & MSIX_VALIDATION_OPTION_DEFERLOCALFILEHEADERS) != 0;
+        auto zip = ComPtr<IStorageObject>::Make<ZipObjectReader>(inputStream, deferLocalFileHeaders, m_bufferPool, m_performanceCounters);
+        bool deferPayloadFiles = (m_factoryOptions & MSIX_FACTORY_OPTION_READER_DEFER_PAYLOAD_FILES) != 0;
+        bool deferBundlePackages = (m_factoryOptions & MSIX_FACTORY_OPTION_READER_DEFER_BUNDLE_PACKAGES) != 0;
+        bool releaseManifestDom = (m_factoryOptions & MSIX_FACTORY_OPTION_READER_RELEASE_MANIFEST_DOM) != 0;
+        return ComPtr<IAppxPackageReader>::Make<AppxPackageObject>(this, m_validationOptions, m_applicabilityFlags, zip,
+            deferPayloadFiles, deferBundlePackages, releaseManifestDom, index);
+    }
+
     ComPtr<IStream> AppxFactory::GetResource(const std::string& resource)
     {
         // Short-circuit the case where there were no resources and throw not found immediately.
@@ -179,17 +246,7 @@ namespace MSIX {
         {
             ThrowErrorAndLog(Error::FileNotFound, resource.c_str());
         }
-
-        if(!m_resourcezip) // Initialize it when first needed.
-        {
-            // Get stream of the resource zip file generated at CMake processing.
-            m_resourcesVector = std::vector<std::uint8_t>(Resource::resourceByte, Resource::resourceByte + Resource::resourceLength);
-            auto resourceStream = ComPtr<IStream>::Make<VectorStream>(&m_resourcesVector);
-            m_resourcezip = ComPtr<IStorageObject>::Make<ZipObjectReader>(resourceStream.Get());
-        }
-        auto file = m_resourcezip->GetFile(resource);
-        ThrowErrorIfNot(Error::FileNotFound, file, resource.c_str());
-        return file;
+        return ComPtr<IStream>::Make<VectorStream>(&ResourceCache::Instance().Get(resource));
     }
 
     // IMsixFactoryOverrides
@@ -199,11 +256,79 @@ namespace MSIX {
 
         if (name == MSIX_FACTORY_EXTENSION_STREAM_FACTORY)
         {
-            ThrowHrIfFailed(extension->QueryInterface(UuidOfImpl<IMsixStreamFactory>::iid, reinterpret_cast<void**>(&m_streamFactory)));
+            ComPtr<IMsixStreamFactory> streamFactory;
+            ThrowHrIfFailed(extension->QueryInterface(UuidOfImpl<IMsixStreamFactory>::iid, reinterpret_cast<void**>(&streamFactory)));
+            std::lock_guard<std::mutex> lock(m_extensionLock);
+            m_streamFactory = std::move(streamFactory);
         }
         else if (name == MSIX_FACTORY_EXTENSION_APPLICABILITY_LANGUAGES)
         {
-            ThrowHrIfFailed(extension->QueryInterface(UuidOfImpl<IMsixApplicabilityLanguagesEnumerator>::iid, reinterpret_cast<void**>(&m_applicabilityLanguagesEnumerator)));
+            ComPtr<IMsixApplicabilityLanguagesEnumerator> languagesEnumerator;
+            ThrowHrIfFailed(extension->QueryInterface(UuidOfImpl<IMsixApplicabilityLanguagesEnumerator>::iid, reinterpret_cast<void**>(&languagesEnumerator)));
+            std::lock_guard<std::mutex> lock(m_extensionLock);
+            m_applicabilityLanguagesEnumerator = std::move(languagesEnumerator);
+        }
+        else if (name == MSIX_FACTORY_EXTENSION_TRUSTED_CERTIFICATES)
+        {
+            ComPtr<IStream> certificates;
+            ThrowHrIfFailed(extension->QueryInterface(UuidOfImpl<IStream>::iid, reinterpret_cast<void**>(&certificates)));
+            LARGE_INTEGER start = { 0 };
+            ThrowHrIfFailed(certificates->Seek(start, StreamBase::Reference::START, nullptr));
+            m_trustedCertificateCache.SetCustomRoots(Helper::CreateBufferFromStream(certificates));
+            std::lock_guard<std::mutex> lock(m_extensionLock);
+            m_trustedCertificates = std::move(certificates);
+        }
+        else if (name == MSIX_FACTORY_EXTENSION_SIGNATURE_CACHE)
+        {
+            ComPtr<IMsixSignatureCache> signatureCache;
+            ThrowHrIfFailed(extension->QueryInterface(UuidOfImpl<IMsixSignatureCache>::iid, reinterpret_cast<void**>(&signatureCache)));
+            m_signatureVerificationCache.SetExtension(signatureCache);
+        }
+        else if (name == MSIX_FACTORY_EXTENSION_BUFFER_ALLOCATOR)
+        {
+            ComPtr<IMsixBufferAllocator> bufferAllocator;
+            ThrowHrIfFailed(extension->QueryInterface(UuidOfImpl<IMsixBufferAllocator>::iid, reinterpret_cast<void**>(&bufferAllocator)));
+            m_bufferPool->SetExtension(bufferAllocator);
+        }
+        else if (name == MSIX_FACTORY_EXTENSION_TASK_SCHEDULER)
+        {
+            ComPtr<IMsixTaskScheduler> taskScheduler;
+            ThrowHrIfFailed(extension->QueryInterface(UuidOfImpl<IMsixTaskScheduler>::iid, reinterpret_cast<void**>(&taskScheduler)));
+            m_workerPool->SetExtension(taskScheduler);
+        }
+        else if (name == MSIX_FACTORY_EXTENSION_PROGRESS_CALLBACK)
+        {
+            ComPtr<IMsixProgressCallback> progressCallback;
+            ThrowHrIfFailed(extension->QueryInterface(UuidOfImpl<IMsixProgressCallback>::iid, reinterpret_cast<void**>(&progressCallback)));
+            m_progressReporter->SetExtension(progressCallback);
+        }
+        else if (name == MSIX_FACTORY_EXTENSION_OUTPUT_STREAM_FACTORY)
+        {
+            ComPtr<IMsixOutputStreamFactory> outputStreamFactory;
+            ThrowHrIfFailed(extension->QueryInterface(UuidOfImpl<IMsixOutputStreamFactory>::iid, reinterpret_cast<void**>(&outputStreamFactory)));
+            std::lock_guard<std::mutex> lock(m_extensionLock);
+            m_outputStreamFactory = std::move(outputStreamFactory);
+        }
+        else if (name == MSIX_FACTORY_EXTENSION_MANIFEST_CACHE)
+        {
+            ComPtr<IMsixManifestCache> manifestCache;
+            ThrowHrIfFailed(extension->QueryInterface(UuidOfImpl<IMsixManifestCache>::iid, reinterpret_cast<void**>(&manifestCache)));
+            std::lock_guard<std::mutex> lock(m_extensionLock);
+            m_manifestCache = std::move(manifestCache);
+        }
+        else if (name == MSIX_FACTORY_EXTENSION_INTEGRITY_CACHE)
+        {
+            ComPtr<IMsixIntegrityCache> integrityCache;
+            ThrowHrIfFailed(extension->QueryInterface(UuidOfImpl<IMsixIntegrityCache>::iid, reinterpret_cast<void**>(&integrityCache)));
+            std::lock_guard<std::mutex> lock(m_extensionLock);
+            m_integrityCache = std::move(integrityCache);
+        }
+        else if (name == MSIX_FACTORY_EXTENSION_FILE_STATISTICS_CALLBACK)
+        {
+            ComPtr<IMsixFileStatisticsCallback> fileStatisticsCallback;
+            ThrowHrIfFailed(extension->QueryInterface(UuidOfImpl<IMsixFileStatisticsCallback>::iid, reinterpret_cast<void**>(&fileStatisticsCallback)));
+            std::lock_guard<std::mutex> lock(m_extensionLock);
+            m_fileStatisticsCallback = std::move(fileStatisticsCallback);
         }
         else
         {
@@ -219,6 +344,7 @@ namespace MSIX {
 
         if (name == MSIX_FACTORY_EXTENSION_STREAM_FACTORY)
         {
+            std::lock_guard<std::mutex> lock(m_extensionLock);
             if (m_streamFactory.Get() != nullptr)
             {
                 *extension = m_streamFactory.As<IUnknown>().Detach();
@@ -226,11 +352,84 @@ namespace MSIX {
         }
         else if (name == MSIX_FACTORY_EXTENSION_APPLICABILITY_LANGUAGES)
         {
+            std::lock_guard<std::mutex> lock(m_extensionLock);
             if (m_applicabilityLanguagesEnumerator.Get() != nullptr)
             {
                 *extension = m_applicabilityLanguagesEnumerator.As<IUnknown>().Detach();
             }
         }
+        else if (name == MSIX_FACTORY_EXTENSION_TRUSTED_CERTIFICATES)
+        {
+            std::lock_guard<std::mutex> lock(m_extensionLock);
+            if (m_trustedCertificates.Get() != nullptr)
+            {
+                *extension = m_trustedCertificates.As<IUnknown>().Detach();
+            }
+        }
+        else if (name == MSIX_FACTORY_EXTENSION_SIGNATURE_CACHE)
+        {
+            auto signatureCache = m_signatureVerificationCache.GetExtension();
+            if (signatureCache.Get() != nullptr)
+            {
+                *extension = signatureCache.As<IUnknown>().Detach();
+            }
+        }
+        else if (name == MSIX_FACTORY_EXTENSION_BUFFER_ALLOCATOR)
+        {
+            auto bufferAllocator = m_bufferPool->GetExtension();
+            if (bufferAllocator.Get() != nullptr)
+            {
+                *extension = bufferAllocator.As<IUnknown>().Detach();
+            }
+        }
+        else if (name == MSIX_FACTORY_EXTENSION_TASK_SCHEDULER)
+        {
+            auto taskScheduler = m_workerPool->GetExtension();
+            if (taskScheduler.Get() != nullptr)
+            {
+                *extension = taskScheduler.As<IUnknown>().Detach();
+            }
+        }
+        else if (name == MSIX_FACTORY_EXTENSION_PROGRESS_CALLBACK)
+        {
+            auto progressCallback = m_progressReporter->GetExtension();
+            if (progressCallback.Get() != nullptr)
+            {
+                *extension = progressCallback.As<IUnknown>().Detach();
+            }
+        }
+        else if (name == MSIX_FACTORY_EXTENSION_OUTPUT_STREAM_FACTORY)
+        {
+            std::lock_guard<std::mutex> lock(m_extensionLock);
+            if (m_outputStreamFactory.Get() != nullptr)
+            {
+                *extension = m_outputStreamFactory.As<IUnknown>().Detach();
+            }
+        }
+        else if (name == MSIX_FACTORY_EXTENSION_MANIFEST_CACHE)
+        {
+            std::lock_guard<std::mutex> lock(m_extensionLock);
+            if (m_manifestCache.Get() != nullptr)
+            {
+                *extension = m_manifestCache.As<IUnknown>().Detach();
+            }
+        }
+        else if (name == MSIX_FACTORY_EXTENSION_INTEGRITY_CACHE)
+        {
+            std::lock_guard<std::mutex> lock(m_extensionLock);
+            if (m_integrityCache.Get() != nullptr)
+            {
+                *extension = m_integrityCache.As<IUnknown>().Detach();
+            }
+        }
+        else if (name == MSIX_FACTORY_EXTENSION_FILE_STATISTICS_CALLBACK)
+        {
+            std::lock_guard<std::mutex> lock(m_extensionLock);
+            if (m_fileStatisticsCallback.Get() != nullptr)
+            {
+                *extension = m_fileStatisticsCallback.As<IUnknown>().Detach();
+            }
+        }
         else
         {
             return static_cast<HRESULT>(Error::InvalidParameter);
@@ -9,8 +9,10 @@
 #include "Encoding.hpp"
 #include "Enumerators.hpp"
 #include "AppxPackageInfo.hpp"
+#include "StreamBase.hpp"
 
 #include <array>
+#include <cstring>
 
 namespace MSIX {
 
@@ -76,11 +78,226 @@ namespace MSIX {
         Entry<APPX_CAPABILITIES>(u8"contacts",                   APPX_CAPABILITY_CONTACTS),
     };
 
-    AppxManifestObject::AppxManifestObject(IMsixFactory* factory, const ComPtr<IStream>& stream) : m_factory(factory), m_stream(stream)
+    // Version of the entries kept in a manifest cache, change it when the layout of ManifestSnapshot changes.
+    static const std::uint8_t ManifestCacheEntryVersion = 1;
+
+    namespace {
+        ComPtr<IXmlDom> ParseManifest(IMsixFactory* factory, const ComPtr<IStream>& stream, bool validateSchema)
+        {
+            ComPtr<IXmlFactory> xmlFactory;
+            ThrowHrIfFailed(factory->QueryInterface(UuidOfImpl<IXmlFactory>::iid, reinterpret_cast<void**>(&xmlFactory)));
+            return xmlFactory->CreateDomFromStream(XmlContentType::AppxManifestXml, stream, validateSchema);
+        }
+
+        MSIX_PLATFORMS PlatformOfTargetDeviceFamily(std::string name)
+        {
+            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+            const auto& tdfEntry = std::find(std::begin(targetDeviceFamilyList), std::end(targetDeviceFamilyList), name.c_str());
+            // TODO: Here and below; are unknown device families really an error?  I don't think so.
+            ThrowErrorIf(Error::AppxManifestSemanticError, (tdfEntry == std::end(targetDeviceFamilyList)), "Unrecognized TargetDeviceFamily");
+            return (*tdfEntry).value;
+        }
+    }
+
+    std::vector<std::uint8_t> ManifestSnapshot::Save() const
+    {
+        std::vector<std::uint8_t> entry;
+        auto append = [&entry](const void* data, std::size_t size)
+        {
+            auto bytes = static_cast<const std::uint8_t*>(data);
+            entry.insert(entry.end(), bytes, bytes + size);
+        };
+        auto appendByte = [&append](std::uint8_t value) { append(&value, sizeof(value)); };
+        auto appendSize = [&append](std::size_t size)
+        {
+            std::uint32_t value = static_cast<std::uint32_t>(size);
+            append(&value, sizeof(value));
+        };
+        auto appendString = [&append, &appendSize](const std::string& value)
+        {
+            appendSize(value.size());
+            append(value.data(), value.size());
+        };
+
+        appendByte(ManifestCacheEntryVersion);
+        appendByte(schemaValidated ? 1 : 0);
+        for (auto value : { &identity.name, &identity.version, &identity.resourceId, &identity.architecture, &identity.publisher })
+        {
+            appendString(*value);
+        }
+        appendSize(stringProperties.size());
+        for (const auto& property : stringProperties)
+        {
+            appendString(property.first);
+            appendString(property.second);
+        }
+        appendSize(boolProperties.size());
+        for (const auto& property : boolProperties)
+        {
+            appendString(property.first);
+            appendByte(property.second ? 1 : 0);
+        }
+        appendSize(applicationIds.size());
+        for (const auto& applicationId : applicationIds)
+        {
+            appendString(applicationId);
+        }
+        appendSize(packageDependencies.size());
+        for (const auto& dependency : packageDependencies)
+        {
+            appendString(dependency.name);
+            appendString(dependency.publisher);
+            appendString(dependency.minVersion);
+        }
+        appendSize(mainPackageDependencies.size());
+        for (const auto& dependency : mainPackageDependencies)
+        {
+            appendString(dependency.name);
+            appendString(dependency.publisher);
+        }
+        appendSize(targetDeviceFamilies.size());
+        for (const auto& tdf : targetDeviceFamilies)
+        {
+            appendString(tdf.name);
+            appendString(tdf.minVersion);
+            appendString(tdf.maxVersion);
+        }
+        appendSize(resources.size());
+        for (const auto& resource : resources)
+        {
+            appendString(resource.language);
+            appendString(resource.scale);
+            appendString(resource.dxFeatureLevel);
+        }
+        appendSize(capabilities.size());
+        for (const auto& capability : capabilities)
+        {
+            appendByte(static_cast<std::uint8_t>(capability.capabilityClass));
+            appendString(capability.name);
+        }
+        return entry;
+    }
+
+    // Counts are not trusted to reserve anything, an entry that claims more than it has fails to read.
+    bool ManifestSnapshot::Load(const std::vector<std::uint8_t>& entry)
+    {
+        std::size_t position = 0;
+        auto read = [&entry, &position](void* data, std::size_t size)
+        {
+            if (entry.size() - position < size) { return false; }
+            if (size != 0) { std::memcpy(data, entry.data() + position, size); }
+            position += size;
+            return true;
+        };
+        auto readByte = [&read](std::uint8_t& value) { return read(&value, sizeof(value)); };
+        auto readSize = [&read](std::size_t& size)
+        {
+            std::uint32_t value = 0;
+            if (!read(&value, sizeof(value))) { return false; }
+            size = value;
+            return true;
+        };
+        auto readString = [&entry, &position, &readSize](std::string& value)
+        {
+            std::size_t size = 0;
+            if (!readSize(size) || (entry.size() - position < size)) { return false; }
+            value.assign(reinterpret_cast<const char*>(entry.data() + position), size);
+            position += size;
+            return true;
+        };
+
+        ManifestSnapshot snapshot;
+        std::uint8_t version = 0;
+        std::uint8_t validated = 0;
+        if (!readByte(version) || (version != ManifestCacheEntryVersion) || !readByte(validated) || (validated > 1))
+        {
+            return false;
+        }
+        snapshot.schemaValidated = (validated == 1);
+        auto& id = snapshot.identity;
+        for (auto value : { &id.name, &id.version, &id.resourceId, &id.architecture, &id.publisher })
+        {
+            if (!readString(*value)) { return false; }
+        }
+        std::size_t count = 0;
+        if (!readSize(count)) { return false; }
+        for (std::size_t index = 0; index < count; index++)
+        {
+            std::string name;
+            std::string value;
+            if (!readString(name) || !readString(value)) { return false; }
+            snapshot.stringProperties[name] = std::move(value);
+        }
+        if (!readSize(count)) { return false; }
+        for (std::size_t index = 0; index < count; index++)
+        {
+            std::string name;
+            std::uint8_t value = 0;
+            if (!readString(name) || !readByte(value) || (value > 1)) { return false; }
+            snapshot.boolProperties[name] = (value == 1);
+        }
+        if (!readSize(count)) { return false; }
+        for (std::size_t index = 0; index < count; index++)
+        {
+            std::string applicationId;
+            if (!readString(applicationId)) { return false; }
+            snapshot.applicationIds.push_back(std::move(applicationId));
+        }
+        if (!readSize(count)) { return false; }
+        for (std::size_t index = 0; index < count; index++)
+        {
+            PackageDependency dependency;
+            if (!readString(dependency.name) || !readString(dependency.publisher) || !readString(dependency.minVersion)) { return false; }
+            snapshot.packageDependencies.push_back(std::move(dependency));
+        }
+        if (!readSize(count)) { return false; }
+        for (std::size_t index = 0; index < count; index++)
+        {
+            MainPackageDependency dependency;
+            if (!readString(dependency.name) || !readString(dependency.publisher)) { return false; }
+            snapshot.mainPackageDependencies.push_back(std::move(dependency));
+        }
+        if (!readSize(count)) { return false; }
+        for (std::size_t index = 0; index < count; index++)
+        {
+            TargetDeviceFamily tdf;
+            if (!readString(tdf.name) || !readString(tdf.minVersion) || !readString(tdf.maxVersion)) { return false; }
+            snapshot.targetDeviceFamilies.push_back(std::move(tdf));
+        }
+        if (!readSize(count)) { return false; }
+        for (std::size_t index = 0; index < count; index++)
+        {
+            Resource resource;
+            if (!readString(resource.language) || !readString(resource.scale) || !readString(resource.dxFeatureLevel)) { return false; }
+            snapshot.resources.push_back(std::move(resource));
+        }
+        if (!readSize(count)) { return false; }
+        for (std::size_t index = 0; index < count; index++)
+        {
+            std::uint8_t capabilityClass = 0;
+            std::string name;
+            if (!readByte(capabilityClass) || !readString(name)) { return false; }
+            if ((capabilityClass != APPX_CAPABILITY_CLASS_GENERAL) && (capabilityClass != APPX_CAPABILITY_CLASS_RESTRICTED) &&
+                (capabilityClass != APPX_CAPABILITY_CLASS_WINDOWS) && (capabilityClass != APPX_CAPABILITY_CLASS_CUSTOM))
+            {
+                return false;
+            }
+            snapshot.capabilities.push_back({ static_cast<APPX_CAPABILITY_CLASS_TYPE>(capabilityClass), std::move(name) });
+        }
+        if (position != entry.size()) { return false; }
+
+        *this = std::move(snapshot);
+        return true;
+    }
+
+    AppxManifestObject::AppxManifestObject(IMsixFactory* factory, const ComPtr<IStream>& stream, bool validateSchema) :
+        AppxManifestObject(factory, stream, ParseManifest(factory, stream, validateSchema))
+    {
+    }
+
+    AppxManifestObject::AppxManifestObject(IMsixFactory* factory, const ComPtr<IStream>& stream, const ComPtr<IXmlDom>& dom) :
+        m_factory(factory), m_stream(stream), m_dom(dom)
     {
-        ComPtr<IXmlFactory> xmlFactory;
-        ThrowHrIfFailed(m_factory->QueryInterface(UuidOfImpl<IXmlFactory>::iid, reinterpret_cast<void**>(&xmlFactory)));
-        m_dom = xmlFactory->CreateDomFromStream(XmlContentType::AppxManifestXml, stream);
 
 #if VALIDATING
         AppxManifestValidation::ValidateManifest(m_dom.Get());
@@ -92,39 +309,74 @@ namespace MSIX {
             AppxManifestObject* self = reinterpret_cast<AppxManifestObject*>(s);
             ThrowErrorIf(Error::AppxManifestSemanticError, (nullptr != self->m_packageId.Get()), "There must be only one Identity element at most in AppxManifest.xml");
 
-            const auto& name           = identityNode->GetAttributeValue(XmlAttributeName::Name);
-            const auto& architecture   = identityNode->GetAttributeValue(XmlAttributeName::Identity_ProcessorArchitecture);
-            const auto& publisher      = identityNode->GetAttributeValue(XmlAttributeName::Publisher);
-            const auto& version        = identityNode->GetAttributeValue(XmlAttributeName::Version);
-            const auto& resourceId     = identityNode->GetAttributeValue(XmlAttributeName::ResourceId);
-            ThrowErrorIf(Error::AppxManifestSemanticError, (publisher.empty()), "Invalid Identity element");
-            self->m_packageId = ComPtr<IAppxManifestPackageId>::Make<AppxManifestPackageId>(self->m_factory.Get(), name, version, resourceId, architecture, publisher);
+            ManifestSnapshot::Identity identity;
+            identity.name           = identityNode->GetAttributeValue(XmlAttributeName::Name);
+            identity.architecture   = identityNode->GetAttributeValue(XmlAttributeName::Identity_ProcessorArchitecture);
+            identity.publisher      = identityNode->GetAttributeValue(XmlAttributeName::Publisher);
+            identity.version        = identityNode->GetAttributeValue(XmlAttributeName::Version);
+            identity.resourceId     = identityNode->GetAttributeValue(XmlAttributeName::ResourceId);
+            self->SetIdentity(std::move(identity));
             return true;
         });
         m_dom->ForEachElementIn(m_dom->GetDocument(), XmlQueryName::Package_Identity, visitor);
         // Have to check for this semantically as not all validating parsers can validate this via schema
         ThrowErrorIfNot(Error::AppxManifestSemanticError, m_packageId, "No Identity element in AppxManifest.xml");
 
-        // Parse TargetDeviceFamily elements
+        // Parse TargetDeviceFamily elements. Only the platforms are needed now, the objects are created by GetTargetDeviceFamilies.
         XmlVisitor visitorTDF(static_cast<void*>(this), [](void* s, const ComPtr<IXmlElement>& tdfNode)->bool
         {
             AppxManifestObject* self = reinterpret_cast<AppxManifestObject*>(s);
-            auto name = tdfNode->GetAttributeValue(XmlAttributeName::Name);
-            auto min = tdfNode->GetAttributeValue(XmlAttributeName::MinVersion);
-            auto max = tdfNode->GetAttributeValue(XmlAttributeName::Dependencies_Tdf_MaxVersionTested);
-            auto tdf = ComPtr<IAppxManifestTargetDeviceFamily>::Make<AppxManifestTargetDeviceFamily>(self->m_factory.Get(), name, min, max);
-            self->m_tdf.push_back(std::move(tdf));
-            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
-            const auto& tdfEntry = std::find(std::begin(targetDeviceFamilyList), std::end(targetDeviceFamilyList), name.c_str());
-            // TODO: Here and below; are unknown device families really an error?  I don't think so.
-            ThrowErrorIf(Error::AppxManifestSemanticError, (tdfEntry == std::end(targetDeviceFamilyList)), "Unrecognized TargetDeviceFamily");
-            self->m_platform = static_cast<MSIX_PLATFORMS>(self->m_platform | (*tdfEntry).value);
+            auto platform = PlatformOfTargetDeviceFamily(tdfNode->GetAttributeValue(XmlAttributeName::Name));
+            self->m_platform = static_cast<MSIX_PLATFORMS>(self->m_platform | platform);
             return true;
         });
         m_dom->ForEachElementIn(m_dom->GetDocument(), XmlQueryName::Package_Dependencies_TargetDeviceFamily, visitorTDF);
         ThrowErrorIf(Error::AppxManifestSemanticError, m_platform == MSIX_PLATFORM_NONE , "Couldn't find TargetDeviceFamily element in AppxManifest.xml");
     }
 
+    // The snapshot comes from a manifest that passed the checks of the constructor above.
+    AppxManifestObject::AppxManifestObject(IMsixFactory* factory, const ComPtr<IStream>& stream, ManifestSnapshot&& snapshot) :
+        m_factory(factory), m_stream(stream), m_snapshot(std::make_unique<ManifestSnapshot>(std::move(snapshot)))
+    {
+        SetIdentity(ManifestSnapshot::Identity(m_snapshot->identity));
+        for (const auto& tdf : m_snapshot->targetDeviceFamilies)
+        {
+            m_platform = static_cast<MSIX_PLATFORMS>(m_platform | PlatformOfTargetDeviceFamily(tdf.name));
+        }
+        ThrowErrorIf(Error::AppxManifestSemanticError, m_platform == MSIX_PLATFORM_NONE , "Couldn't find TargetDeviceFamily element in AppxManifest.xml");
+    }
+
+    void AppxManifestObject::SetIdentity(ManifestSnapshot::Identity&& identity)
+    {
+        ThrowErrorIf(Error::AppxManifestSemanticError, (identity.publisher.empty()), "Invalid Identity element");
+        m_identity = std::move(identity);
+        m_packageId = ComPtr<IAppxManifestPackageId>::Make<AppxManifestPackageId>(m_factory.Get(), m_identity.name, m_identity.version,
+            m_identity.resourceId, m_identity.architecture, m_identity.publisher);
+    }
+
+    ManifestSnapshot AppxManifestObject::GetSnapshot(bool schemaValidated)
+    {
+        if (m_snapshot) { return *m_snapshot; }
+        ManifestSnapshot snapshot;
+        snapshot.schemaValidated = schemaValidated;
+        snapshot.identity = m_identity;
+        ReadProperties(snapshot.stringProperties, snapshot.boolProperties);
+        snapshot.applicationIds = ReadApplicationIds();
+        snapshot.packageDependencies = ReadPackageDependencies();
+        snapshot.mainPackageDependencies = ReadMainPackageDependencies();
+        snapshot.targetDeviceFamilies = ReadTargetDeviceFamilies();
+        snapshot.resources = ReadResources();
+        snapshot.capabilities = ReadCapabilities();
+        return snapshot;
+    }
+
+    void AppxManifestObject::ReleaseDom(bool schemaValidated)
+    {
+        if (m_snapshot) { return; }
+        m_snapshot = std::make_unique<ManifestSnapshot>(GetSnapshot(schemaValidated));
+        m_dom = nullptr;
+    }
+
     HRESULT STDMETHODCALLTYPE AppxManifestObject::GetPackageId(IAppxManifestPackageId **packageId) noexcept try
     {
         ThrowErrorIf(Error::InvalidParameter, (packageId == nullptr || *packageId != nullptr), "bad pointer");
@@ -136,10 +388,31 @@ namespace MSIX {
     HRESULT STDMETHODCALLTYPE AppxManifestObject::GetProperties(IAppxManifestProperties **packageProperties) noexcept try
     {
         ThrowErrorIf(Error::InvalidParameter, (packageProperties == nullptr || *packageProperties != nullptr), "bad pointer");
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (!m_properties)
+        {
+            std::map<std::string, std::string> stringValues;
+            std::map<std::string, bool> boolValues;
+            if (m_snapshot)
+            {
+                stringValues = m_snapshot->stringProperties;
+                boolValues = m_snapshot->boolProperties;
+            }
+            else
+            {
+                ReadProperties(stringValues, boolValues);
+            }
+            m_properties = ComPtr<IAppxManifestProperties>::Make<AppxManifestProperties>(
+                m_factory.Get(), std::move(stringValues), std::move(boolValues));
+        }
+        auto properties = m_properties;
+        *packageProperties = properties.Detach();
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
 
+    void AppxManifestObject::ReadProperties(std::map<std::string, std::string>& stringValues, std::map<std::string, bool>& boolValues)
+    {
         // Parse elements in Properties element
-        std::map<std::string, std::string> stringValues;
-        std::map<std::string, bool> boolValues;
         struct _context
         {
             AppxManifestObject* self;
@@ -234,39 +507,47 @@ namespace MSIX {
             return true;
         });
         m_dom->ForEachElementIn(m_dom->GetDocument(), XmlQueryName::Package_Properties, visitorProperties);
-        *packageProperties = ComPtr<IAppxManifestProperties>::Make<AppxManifestProperties>(
-            m_factory.Get(), std::move(stringValues), std::move(boolValues)).Detach();
-        return static_cast<HRESULT>(Error::OK);
-    } CATCH_RETURN();
+    }
 
     HRESULT STDMETHODCALLTYPE AppxManifestObject::GetPackageDependencies(IAppxManifestPackageDependenciesEnumerator **dependencies) noexcept try
     {
         ThrowErrorIf(Error::InvalidParameter, (dependencies == nullptr || *dependencies != nullptr), "bad pointer");
-        std::vector<ComPtr<IAppxManifestPackageDependency>> packageDependencies;
-        struct _context
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (!m_packageDependencies)
         {
-            AppxManifestObject* self;
-            std::vector<ComPtr<IAppxManifestPackageDependency>>* packageDependencies;
-        };
-        _context context = { this, &packageDependencies};
+            std::vector<ComPtr<IAppxManifestPackageDependency>> dependencies;
+            auto packageDependencies = m_snapshot ? m_snapshot->packageDependencies : ReadPackageDependencies();
+            for (const auto& packageDependency : packageDependencies)
+            {
+                // TODO: get MaxMajorVersionTested if needed
+                auto dependency = ComPtr<IAppxManifestPackageDependency>::Make<AppxManifestPackageDependency>(m_factory.Get(),
+                    packageDependency.minVersion, packageDependency.name, packageDependency.publisher);
+                dependencies.push_back(std::move(dependency));
+            }
+            m_packageDependencies = std::make_shared<const std::vector<ComPtr<IAppxManifestPackageDependency>>>(std::move(dependencies));
+        }
+        *dependencies = ComPtr<IAppxManifestPackageDependenciesEnumerator>::
+            Make<EnumeratorCom<IAppxManifestPackageDependenciesEnumerator,IAppxManifestPackageDependency>>(m_packageDependencies).Detach();
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
 
+    std::vector<ManifestSnapshot::PackageDependency> AppxManifestObject::ReadPackageDependencies()
+    {
+        std::vector<ManifestSnapshot::PackageDependency> packageDependencies;
         // Parse PackageDependency elements
-        XmlVisitor visitorDependencies(static_cast<void*>(&context), [](void* c, const ComPtr<IXmlElement>& dependencyNode)->bool
+        XmlVisitor visitorDependencies(static_cast<void*>(&packageDependencies), [](void* d, const ComPtr<IXmlElement>& dependencyNode)->bool
         {
-            _context* context = reinterpret_cast<_context*>(c);
-            auto min = dependencyNode->GetAttributeValue(XmlAttributeName::MinVersion);
-            auto name = dependencyNode->GetAttributeValue(XmlAttributeName::Name);
-            auto publisher = dependencyNode->GetAttributeValue(XmlAttributeName::Publisher);
-            // TODO: get MaxMajorVersionTested if needed
-            auto dependency = ComPtr<IAppxManifestPackageDependency>::Make<AppxManifestPackageDependency>(context->self->m_factory.Get(), min, name, publisher);
-            context->packageDependencies->push_back(std::move(dependency));
+            auto packageDependencies = reinterpret_cast<std::vector<ManifestSnapshot::PackageDependency>*>(d);
+            ManifestSnapshot::PackageDependency dependency;
+            dependency.name = dependencyNode->GetAttributeValue(XmlAttributeName::Name);
+            dependency.publisher = dependencyNode->GetAttributeValue(XmlAttributeName::Publisher);
+            dependency.minVersion = dependencyNode->GetAttributeValue(XmlAttributeName::MinVersion);
+            packageDependencies->push_back(std::move(dependency));
             return true;
         });
         m_dom->ForEachElementIn(m_dom->GetDocument(), XmlQueryName::Package_Dependencies_PackageDependency, visitorDependencies);
-        *dependencies = ComPtr<IAppxManifestPackageDependenciesEnumerator>::
-            Make<EnumeratorCom<IAppxManifestPackageDependenciesEnumerator,IAppxManifestPackageDependency>>(packageDependencies).Detach();
-        return static_cast<HRESULT>(Error::OK);
-    } CATCH_RETURN();
+        return packageDependencies;
+    }
 
     HRESULT STDMETHODCALLTYPE AppxManifestObject::GetCapabilities(APPX_CAPABILITIES *capabilities) noexcept try
     {
@@ -290,19 +571,32 @@ namespace MSIX {
     HRESULT STDMETHODCALLTYPE AppxManifestObject::GetResources(IAppxManifestResourcesEnumerator **resources) noexcept try
     {
         ThrowErrorIf(Error::InvalidParameter, (resources == nullptr || *resources != nullptr), "bad pointer");
-        // Parse Resource elements.
         std::vector<std::string> appxResources;
-        XmlVisitor visitorResource(static_cast<void*>(&appxResources), [](void* r, const ComPtr<IXmlElement>& resourceNode)->bool
+        for (auto& resource : m_snapshot ? m_snapshot->resources : ReadResources())
+        {
+            appxResources.push_back(std::move(resource.language));
+        }
+        *resources = ComPtr<IAppxManifestResourcesEnumerator>::Make<EnumeratorString<IAppxManifestResourcesEnumerator, IAppxManifestResourcesEnumeratorUtf8>>(m_factory.Get(), std::move(appxResources)).Detach();
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
+
+    std::vector<ManifestSnapshot::Resource> AppxManifestObject::ReadResources()
+    {
+        std::vector<ManifestSnapshot::Resource> resources;
+        // Parse Resource elements
+        XmlVisitor visitorResource(static_cast<void*>(&resources), [](void* r, const ComPtr<IXmlElement>& resourceNode)->bool
         {
-            std::vector<std::string>* resources = reinterpret_cast<std::vector<std::string>*>(r);
-            auto name = resourceNode->GetAttributeValue(XmlAttributeName::Language);
-            resources->push_back(std::move(name));
+            auto resources = reinterpret_cast<std::vector<ManifestSnapshot::Resource>*>(r);
+            ManifestSnapshot::Resource resource;
+            resource.language = resourceNode->GetAttributeValue(XmlAttributeName::Language);
+            resource.scale = resourceNode->GetAttributeValue(XmlAttributeName::Scale);
+            resource.dxFeatureLevel = resourceNode->GetAttributeValue(XmlAttributeName::DXFeatureLevel);
+            resources->push_back(std::move(resource));
             return true;
         });
         m_dom->ForEachElementIn(m_dom->GetDocument(), XmlQueryName::Package_Resources_Resource, visitorResource);
-        *resources = ComPtr<IAppxManifestResourcesEnumerator>::Make<EnumeratorString<IAppxManifestResourcesEnumerator, IAppxManifestResourcesEnumeratorUtf8>>(m_factory.Get(), appxResources).Detach();
-        return static_cast<HRESULT>(Error::OK);
-    } CATCH_RETURN();
+        return resources;
+    }
 
     HRESULT STDMETHODCALLTYPE AppxManifestObject::GetDeviceCapabilities(IAppxManifestDeviceCapabilitiesEnumerator **deviceCapabilities) noexcept
     {
@@ -318,33 +612,40 @@ namespace MSIX {
     HRESULT STDMETHODCALLTYPE AppxManifestObject::GetApplications(IAppxManifestApplicationsEnumerator **applications) noexcept try
     {
         ThrowErrorIf(Error::InvalidParameter, (applications == nullptr || *applications != nullptr), "bad pointer");
-
-        std::vector<ComPtr<IAppxManifestApplication>> apps;
-        struct _context
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (!m_applications)
         {
-            AppxManifestObject* self;
-            std::vector<ComPtr<IAppxManifestApplication>>* apps;
-        };
-        _context context = { this, &apps};
+            std::vector<ComPtr<IAppxManifestApplication>> applicationObjects;
+            auto packageIdInternal = m_packageId.As<IAppxManifestPackageIdInternal>();
+            auto packageFamilyName = packageIdInternal->GetPackageFamilyName();
+            for (const auto& appId : m_snapshot ? m_snapshot->applicationIds : ReadApplicationIds())
+            {
+                auto aumid = packageFamilyName + "!" + appId;
+                // TODO: get other attributes from the Application element and store them a map in AppxManifestApplication
+                // or make the AppxManifestApplication have a IXmlElement member to get attributes at will.
+                auto application = ComPtr<IAppxManifestApplication>::Make<AppxManifestApplication>(m_factory.Get(), aumid);
+                applicationObjects.push_back(std::move(application));
+            }
+            m_applications = std::make_shared<const std::vector<ComPtr<IAppxManifestApplication>>>(std::move(applicationObjects));
+        }
+        *applications = ComPtr<IAppxManifestApplicationsEnumerator>::
+            Make<EnumeratorCom<IAppxManifestApplicationsEnumerator,IAppxManifestApplication>>(m_applications).Detach();
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
 
+    std::vector<std::string> AppxManifestObject::ReadApplicationIds()
+    {
+        std::vector<std::string> applicationIds;
         // Parse Application elements
-        XmlVisitor visitorApplication(static_cast<void*>(&context), [](void* c, const ComPtr<IXmlElement>& applicationNode)->bool
+        XmlVisitor visitorApplication(static_cast<void*>(&applicationIds), [](void* a, const ComPtr<IXmlElement>& applicationNode)->bool
         {
-            _context* context = reinterpret_cast<_context*>(c);
-            auto appId = applicationNode->GetAttributeValue(XmlAttributeName::Package_Applications_Application_Id);
-            auto packageIdInternal = context->self->m_packageId.As<IAppxManifestPackageIdInternal>();
-            auto aumid = packageIdInternal->GetPackageFamilyName() + "!" + appId;
-            auto application = ComPtr<IAppxManifestApplication>::Make<AppxManifestApplication>(context->self->m_factory.Get(), aumid);
-            // TODO: get other attributes from the Application element and store them a map in AppxManifestApplication
-            // or make the AppxManifestApplication have a IXmlElement member to get attributes at will.
-            context->apps->push_back(std::move(application));
+            auto applicationIds = reinterpret_cast<std::vector<std::string>*>(a);
+            applicationIds->push_back(applicationNode->GetAttributeValue(XmlAttributeName::Package_Applications_Application_Id));
             return true;
         });
         m_dom->ForEachElementIn(m_dom->GetDocument(), XmlQueryName::Package_Applications_Application, visitorApplication);
-        *applications = ComPtr<IAppxManifestApplicationsEnumerator>::
-            Make<EnumeratorCom<IAppxManifestApplicationsEnumerator,IAppxManifestApplication>>(apps).Detach();
-        return static_cast<HRESULT>(Error::OK);
-    } CATCH_RETURN();
+        return applicationIds;
+    }
 
     HRESULT STDMETHODCALLTYPE AppxManifestObject::GetStream(IStream **manifestStream) noexcept try
     {
@@ -360,27 +661,13 @@ namespace MSIX {
         ThrowErrorIf(Error::InvalidParameter, (resources == nullptr || *resources != nullptr), "bad pointer");
 
         std::vector<ComPtr<IAppxManifestQualifiedResource>> qualifiedResources;
-        struct _context
+        for (const auto& resource : m_snapshot ? m_snapshot->resources : ReadResources())
         {
-            AppxManifestObject* self;
-            std::vector<ComPtr<IAppxManifestQualifiedResource>>* qualifiedResources;
-        };
-        _context context = { this, &qualifiedResources};
-
-        // Parse Resource elements
-        XmlVisitor visitorResource(static_cast<void*>(&context), [](void* c, const ComPtr<IXmlElement>& resourceNode)->bool
-        {
-            _context* context = reinterpret_cast<_context*>(c);
-            auto language = resourceNode->GetAttributeValue(XmlAttributeName::Language);
-            auto scale = resourceNode->GetAttributeValue(XmlAttributeName::Scale);
-            auto dxFeatureLevel = resourceNode->GetAttributeValue(XmlAttributeName::DXFeatureLevel);
-            auto resource = ComPtr<IAppxManifestQualifiedResource>::Make<AppxManifestQualifiedResource>(context->self->m_factory.Get(), language, scale, dxFeatureLevel);
-            context->qualifiedResources->push_back(std::move(resource));
-            return true;
-        });
-        m_dom->ForEachElementIn(m_dom->GetDocument(), XmlQueryName::Package_Resources_Resource, visitorResource);
+            qualifiedResources.push_back(ComPtr<IAppxManifestQualifiedResource>::Make<AppxManifestQualifiedResource>(m_factory.Get(),
+                resource.language, resource.scale, resource.dxFeatureLevel));
+        }
         *resources = ComPtr<IAppxManifestQualifiedResourcesEnumerator>::
-            Make<EnumeratorCom<IAppxManifestQualifiedResourcesEnumerator,IAppxManifestQualifiedResource>>(qualifiedResources).Detach();
+            Make<EnumeratorCom<IAppxManifestQualifiedResourcesEnumerator,IAppxManifestQualifiedResource>>(std::move(qualifiedResources)).Detach();
         return static_cast<HRESULT>(Error::OK);
     }
 
@@ -393,39 +680,56 @@ namespace MSIX {
 
         *capabilities = nullptr;
         auto capabilitiesNames = GetCapabilities(capabilityClass);
-        *capabilities = ComPtr<IAppxManifestCapabilitiesEnumerator>::Make<EnumeratorString<IAppxManifestCapabilitiesEnumerator, IAppxManifestCapabilitiesEnumeratorUtf8>>(m_factory.Get(), capabilitiesNames).Detach();
+        *capabilities = ComPtr<IAppxManifestCapabilitiesEnumerator>::Make<EnumeratorString<IAppxManifestCapabilitiesEnumerator, IAppxManifestCapabilitiesEnumeratorUtf8>>(m_factory.Get(), std::move(capabilitiesNames)).Detach();
         return static_cast<HRESULT>(Error::OK);
     }
 
     HRESULT STDMETHODCALLTYPE AppxManifestObject::GetTargetDeviceFamilies(IAppxManifestTargetDeviceFamiliesEnumerator **targetDeviceFamilies) noexcept try
     {
         ThrowErrorIf(Error::InvalidParameter, (targetDeviceFamilies == nullptr || *targetDeviceFamilies != nullptr), "bad pointer");
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (!m_tdf)
+        {
+            std::vector<ComPtr<IAppxManifestTargetDeviceFamily>> families;
+            for (const auto& targetDeviceFamily : m_snapshot ? m_snapshot->targetDeviceFamilies : ReadTargetDeviceFamilies())
+            {
+                auto tdf = ComPtr<IAppxManifestTargetDeviceFamily>::Make<AppxManifestTargetDeviceFamily>(m_factory.Get(),
+                    targetDeviceFamily.name, targetDeviceFamily.minVersion, targetDeviceFamily.maxVersion);
+                families.push_back(std::move(tdf));
+            }
+            m_tdf = std::make_shared<const std::vector<ComPtr<IAppxManifestTargetDeviceFamily>>>(std::move(families));
+        }
         *targetDeviceFamilies = ComPtr<IAppxManifestTargetDeviceFamiliesEnumerator>::
             Make<EnumeratorCom<IAppxManifestTargetDeviceFamiliesEnumerator, IAppxManifestTargetDeviceFamily>>(m_tdf).Detach();
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
 
+    std::vector<ManifestSnapshot::TargetDeviceFamily> AppxManifestObject::ReadTargetDeviceFamilies()
+    {
+        std::vector<ManifestSnapshot::TargetDeviceFamily> tdfs;
+        XmlVisitor visitorTDF(static_cast<void*>(&tdfs), [](void* t, const ComPtr<IXmlElement>& tdfNode)->bool
+        {
+            auto tdfs = reinterpret_cast<std::vector<ManifestSnapshot::TargetDeviceFamily>*>(t);
+            ManifestSnapshot::TargetDeviceFamily tdf;
+            tdf.name = tdfNode->GetAttributeValue(XmlAttributeName::Name);
+            tdf.minVersion = tdfNode->GetAttributeValue(XmlAttributeName::MinVersion);
+            tdf.maxVersion = tdfNode->GetAttributeValue(XmlAttributeName::Dependencies_Tdf_MaxVersionTested);
+            tdfs->push_back(std::move(tdf));
+            return true;
+        });
+        m_dom->ForEachElementIn(m_dom->GetDocument(), XmlQueryName::Package_Dependencies_TargetDeviceFamily, visitorTDF);
+        return tdfs;
+    }
+
     // IAppxManifestReader4
     HRESULT STDMETHODCALLTYPE AppxManifestObject::GetOptionalPackageInfo(IAppxManifestOptionalPackageInfo **optionalPackageInfo) noexcept try
     {
         ThrowErrorIf(Error::InvalidParameter, (optionalPackageInfo == nullptr || *optionalPackageInfo != nullptr), "bad pointer.");
 
-        struct _context
-        {
-            std::string mainPackageName;
-        };
-        _context context = {};
-
-        // Parse MainPackageDependency elements
-        XmlVisitor visitorMainPackageDependencies(static_cast<void*>(&context), [](void* c, const ComPtr<IXmlElement>& dependencyNode)->bool
-        {
-            _context* context = reinterpret_cast<_context*>(c);
-            auto name = dependencyNode->GetAttributeValue(XmlAttributeName::Name);
-            context->mainPackageName = name;
-            return false;
-        });
-        m_dom->ForEachElementIn(m_dom->GetDocument(), XmlQueryName::Package_Dependencies_MainPackageDependency, visitorMainPackageDependencies);
-        *optionalPackageInfo = ComPtr<IAppxManifestOptionalPackageInfo>::Make<AppxManifestOptionalPackageInfo>(this->m_factory.Get(), context.mainPackageName).Detach();
+        // The first MainPackageDependency element
+        auto mainPackageDependencies = m_snapshot ? m_snapshot->mainPackageDependencies : ReadMainPackageDependencies();
+        std::string mainPackageName = mainPackageDependencies.empty() ? std::string() : mainPackageDependencies.front().name;
+        *optionalPackageInfo = ComPtr<IAppxManifestOptionalPackageInfo>::Make<AppxManifestOptionalPackageInfo>(this->m_factory.Get(), mainPackageName).Detach();
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
 
@@ -434,49 +738,53 @@ namespace MSIX {
     {
         ThrowErrorIf(Error::InvalidParameter, (mainPackageDependencies == nullptr || *mainPackageDependencies != nullptr), "bad pointer.");
         std::vector<ComPtr<IAppxManifestMainPackageDependency>> packageDependencies;
-
-        struct _context
+        for (const auto& mainPackageDependency : m_snapshot ? m_snapshot->mainPackageDependencies : ReadMainPackageDependencies())
         {
-            AppxManifestObject* self;
-            std::vector<ComPtr<IAppxManifestMainPackageDependency>>* packageDependencies;
-        };
-        _context context = { this, &packageDependencies };
+            // if no publisher for the main package dependency is specified, we default to the publisher of the optional package itself
+            auto publisher = mainPackageDependency.publisher.empty() ? m_identity.publisher : mainPackageDependency.publisher;
+            auto packageFamilyName = mainPackageDependency.name + "_" + ComputePublisherId(publisher);
+            auto dependency = ComPtr<IAppxManifestMainPackageDependency>::Make<AppxManifestMainPackageDependency>(m_factory.Get(),
+                mainPackageDependency.name, publisher, packageFamilyName);
+            packageDependencies.push_back(std::move(dependency));
+        }
+        *mainPackageDependencies = ComPtr<IAppxManifestMainPackageDependenciesEnumerator>::
+            Make<EnumeratorCom<IAppxManifestMainPackageDependenciesEnumerator, IAppxManifestMainPackageDependency>>(std::move(packageDependencies)).Detach();
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
 
+    std::vector<ManifestSnapshot::MainPackageDependency> AppxManifestObject::ReadMainPackageDependencies()
+    {
+        std::vector<ManifestSnapshot::MainPackageDependency> packageDependencies;
         // Parse MainPackageDependency elements
-        XmlVisitor visitorMainPackageDependencies(static_cast<void*>(&context), [](void* c, const ComPtr<IXmlElement>& dependencyNode)->bool
+        XmlVisitor visitorMainPackageDependencies(static_cast<void*>(&packageDependencies), [](void* d, const ComPtr<IXmlElement>& dependencyNode)->bool
         {
-            _context* context = reinterpret_cast<_context*>(c);
-            auto name = dependencyNode->GetAttributeValue(XmlAttributeName::Name);
-            auto publisher = dependencyNode->GetAttributeValue(XmlAttributeName::Publisher);
-            std::string packageFamilyName;
-            std::string publisherHash;
-
-            // if no publisher for the main package dependency is specified, we default to the publisher of the optional package itself
-            if (publisher.empty())
-            {
-                auto packageIdInternal = context->self->m_packageId.As<IAppxManifestPackageIdInternal>();
-                publisher = packageIdInternal->GetPublisher();
-            }
-
-            publisherHash = ComputePublisherId(publisher);
-            packageFamilyName = name + "_" + publisherHash;
-
-            auto dependency = ComPtr<IAppxManifestMainPackageDependency>::Make<AppxManifestMainPackageDependency>(context->self->m_factory.Get(), name, publisher, packageFamilyName);
-            context->packageDependencies->push_back(std::move(dependency));
+            auto packageDependencies = reinterpret_cast<std::vector<ManifestSnapshot::MainPackageDependency>*>(d);
+            ManifestSnapshot::MainPackageDependency dependency;
+            dependency.name = dependencyNode->GetAttributeValue(XmlAttributeName::Name);
+            dependency.publisher = dependencyNode->GetAttributeValue(XmlAttributeName::Publisher);
+            packageDependencies->push_back(std::move(dependency));
             return true;
         });
-
         m_dom->ForEachElementIn(m_dom->GetDocument(), XmlQueryName::Package_Dependencies_MainPackageDependency, visitorMainPackageDependencies);
-        *mainPackageDependencies = ComPtr<IAppxManifestMainPackageDependenciesEnumerator>::
-            Make<EnumeratorCom<IAppxManifestMainPackageDependenciesEnumerator, IAppxManifestMainPackageDependency>>(packageDependencies).Detach();
-        return static_cast<HRESULT>(Error::OK);
-    } CATCH_RETURN();
+        return packageDependencies;
+    }
 
     // IMsixDocumentElement
     HRESULT STDMETHODCALLTYPE AppxManifestObject::GetDocumentElement(IMsixElement** documentElement) noexcept try
     {
         ThrowErrorIf(Error::InvalidParameter, (documentElement == nullptr || *documentElement != nullptr), "bad pointer");
-        *documentElement = m_dom->GetDocument().As<IMsixElement>().Detach();
+        ComPtr<IXmlDom> dom;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (!m_dom)
+            {   // The manifest was validated when the snapshot was taken
+                LARGE_INTEGER start = { 0 };
+                ThrowHrIfFailed(m_stream->Seek(start, StreamBase::Reference::START, nullptr));
+                m_dom = ParseManifest(m_factory.Get(), m_stream, false);
+            }
+            dom = m_dom;
+        }
+        *documentElement = dom->GetDocument().As<IMsixElement>().Detach();
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
 
@@ -487,100 +795,80 @@ namespace MSIX {
             "Invalid capability class.");
 
         std::vector<std::string> capabilitiesNames;
-        struct _context
+        for (auto& capability : m_snapshot ? m_snapshot->capabilities : ReadCapabilities())
         {
-            APPX_CAPABILITY_CLASS_TYPE capabilityClass;
-            std::vector<std::string>& capabilitiesNames;
-        };
-        _context context = { capabilityClass, capabilitiesNames};
+            if ((capabilityClass == APPX_CAPABILITY_CLASS_ALL) || (capabilityClass == capability.capabilityClass) ||
+                ((capabilityClass == APPX_CAPABILITY_CLASS_DEFAULT) && (capability.capabilityClass == APPX_CAPABILITY_CLASS_GENERAL)))
+            {
+                capabilitiesNames.push_back(capability.name);
+            }
+        }
+        return capabilitiesNames;
+    }
+
+    // The Capability elements by the class of their namespace, then the CustomCapability elements. Capabilities of
+    // other namespaces are left out.
+    std::vector<ManifestSnapshot::Capability> AppxManifestObject::ReadCapabilities()
+    {
+        std::vector<ManifestSnapshot::Capability> capabilities;
 
         // Parse Capability elements.
-        if (capabilityClass != APPX_CAPABILITY_CLASS_CUSTOM)
+        XmlVisitor visitorCapabilities(static_cast<void*>(&capabilities), [](void* c, const ComPtr<IXmlElement>& capabilitiesNode)->bool
         {
-            XmlVisitor visitorCapabilities(static_cast<void*>(&context), [](void* c, const ComPtr<IXmlElement>& capabilitiesNode)->bool
+            auto capabilities = reinterpret_cast<std::vector<ManifestSnapshot::Capability>*>(c);
+            std::string prefix = capabilitiesNode->GetPrefix();
+            auto name = capabilitiesNode->GetAttributeValue(XmlAttributeName::Name);
+
+            static std::array<std::string, 11> generalCapabilities = 
             {
-                _context* context = reinterpret_cast<_context*>(c);
-                std::string prefix = capabilitiesNode->GetPrefix();
-                auto name = capabilitiesNode->GetAttributeValue(XmlAttributeName::Name);
-
-                static std::array<std::string, 11> generalCapabilities = 
-                {
-                    "foundation",
-                    "uap",
-                    "win10foundation",
-                    "win10uap",
-                    "uap2",
-                    "uap3",
-                    "uap4",
-                    "uap6",
-                    "uap7",
-                    "win10mobile",
-                    "", // If no prefix then default namespace for AppxManifest is win10foundation.
-                };
-
-                static std::array<std::string, 2> restrictedCapabilities = 
-                {
-                    "rescap",
-                    "win10rescap",
-                };
-
-                static std::array<std::string, 2> windowsCapabilities = 
-                {
-                    "wincap",
-                    "win10wincap",
-                };
-
-                if (context->capabilityClass == APPX_CAPABILITY_CLASS_GENERAL ||
-                    context->capabilityClass == APPX_CAPABILITY_CLASS_DEFAULT ||
-                    context->capabilityClass == APPX_CAPABILITY_CLASS_ALL)
-                {
-                    auto found = std::find(generalCapabilities.begin(), generalCapabilities.end(), prefix);
-                    if (found != generalCapabilities.end())
-                    {
-                        context->capabilitiesNames.push_back(name);
-                        return true;
-                    }
-                }
-
-                if (context->capabilityClass == APPX_CAPABILITY_CLASS_RESTRICTED ||
-                    context->capabilityClass == APPX_CAPABILITY_CLASS_ALL)
-                { 
-                    auto found = std::find(restrictedCapabilities.begin(), restrictedCapabilities.end(), prefix);
-                    if (found != restrictedCapabilities.end())
-                    {
-                        context->capabilitiesNames.push_back(name);
-                        return true;
-                    }
-                }
-
-                if (context->capabilityClass == APPX_CAPABILITY_CLASS_WINDOWS ||
-                    context->capabilityClass == APPX_CAPABILITY_CLASS_ALL)
-                {
-                    auto found = std::find(windowsCapabilities.begin(), windowsCapabilities.end(), prefix);
-                    if (found != windowsCapabilities.end())
-                    {
-                        context->capabilitiesNames.push_back(name);
-                        return true;
-                    }
-                }
+                "foundation",
+                "uap",
+                "win10foundation",
+                "win10uap",
+                "uap2",
+                "uap3",
+                "uap4",
+                "uap6",
+                "uap7",
+                "win10mobile",
+                "", // If no prefix then default namespace for AppxManifest is win10foundation.
+            };
 
-                return true;
-            });
-            m_dom->ForEachElementIn(m_dom->GetDocument(), XmlQueryName::Package_Capabilities_Capability, visitorCapabilities);
-        }
+            static std::array<std::string, 2> restrictedCapabilities = 
+            {
+                "rescap",
+                "win10rescap",
+            };
 
-        if (capabilityClass == APPX_CAPABILITY_CLASS_CUSTOM || capabilityClass == APPX_CAPABILITY_CLASS_ALL)
-        {
-            XmlVisitor visitorCustomCapabilities(static_cast<void*>(&context), [](void* c, const ComPtr<IXmlElement>& capabilitiesNode)->bool
+            static std::array<std::string, 2> windowsCapabilities = 
             {
-                _context* context = reinterpret_cast<_context*>(c);
-                auto name = capabilitiesNode->GetAttributeValue(XmlAttributeName::Name);
-                context->capabilitiesNames.push_back(name);
-                return true;
-            });
-            m_dom->ForEachElementIn(m_dom->GetDocument(), XmlQueryName::Package_Capabilities_CustomCapability, visitorCustomCapabilities);
-        }
+                "wincap",
+                "win10wincap",
+            };
 
-        return capabilitiesNames;
+            if (std::find(generalCapabilities.begin(), generalCapabilities.end(), prefix) != generalCapabilities.end())
+            {
+                capabilities->push_back({ APPX_CAPABILITY_CLASS_GENERAL, std::move(name) });
+            }
+            else if (std::find(restrictedCapabilities.begin(), restrictedCapabilities.end(), prefix) != restrictedCapabilities.end())
+            {
+                capabilities->push_back({ APPX_CAPABILITY_CLASS_RESTRICTED, std::move(name) });
+            }
+            else if (std::find(windowsCapabilities.begin(), windowsCapabilities.end(), prefix) != windowsCapabilities.end())
+            {
+                capabilities->push_back({ APPX_CAPABILITY_CLASS_WINDOWS, std::move(name) });
+            }
+            return true;
+        });
+        m_dom->ForEachElementIn(m_dom->GetDocument(), XmlQueryName::Package_Capabilities_Capability, visitorCapabilities);
+
+        XmlVisitor visitorCustomCapabilities(static_cast<void*>(&capabilities), [](void* c, const ComPtr<IXmlElement>& capabilitiesNode)->bool
+        {
+            auto capabilities = reinterpret_cast<std::vector<ManifestSnapshot::Capability>*>(c);
+            capabilities->push_back({ APPX_CAPABILITY_CLASS_CUSTOM, capabilitiesNode->GetAttributeValue(XmlAttributeName::Name) });
+            return true;
+        });
+        m_dom->ForEachElementIn(m_dom->GetDocument(), XmlQueryName::Package_Capabilities_CustomCapability, visitorCustomCapabilities);
+        return capabilities;
     }
 }
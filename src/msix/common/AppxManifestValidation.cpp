@@ -3,7 +3,6 @@
 //  See LICENSE file in the project root for full license information.
 //
 
-#include <regex>
 #include <string>
 
 #include "AppxManifestValidation.hpp"
@@ -264,8 +263,7 @@ namespace MSIX {
     {
 #if !VALIDATING
         // If the schema didn't check for us, do it now.
-        std::regex e("[a-zA-Z0-9\\.\\-]+"); // valid characters
-        if (!std::regex_match(identifier, e))
+        if (!FileNameValidation::HasOnlyIdentifierCharacters(identifier))
         {
             return false;
         }
@@ -0,0 +1,166 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "BufferPool.hpp"
+#include "Exceptions.hpp"
+
+#include <limits>
+
+namespace MSIX {
+
+    // Returns the size class that fits size, or BufferPoolClassCount if there is none.
+    static std::size_t GetSizeClass(std::size_t size)
+    {
+        std::size_t sizeClass = 0;
+        for (auto classSize = BufferPoolMinClassSize; classSize < size && sizeClass < BufferPoolClassCount; classSize *= 2)
+        {
+            sizeClass++;
+        }
+        return sizeClass;
+    }
+
+    PooledBuffer::~PooledBuffer()
+    {
+        if (m_data == nullptr) { return; }
+        if (m_extension)
+        {
+            m_extension->FreeBuffer(m_data, static_cast<UINT32>(m_size));
+        }
+        else if (m_pool)
+        {
+            m_pool->Return(*this);
+        }
+        else
+        {
+            delete[] m_data;
+        }
+    }
+
+    PooledBuffer PooledBuffer::Allocate(const std::shared_ptr<BufferPool>& pool, std::size_t size)
+    {
+        if (pool) { return pool->Get(size); }
+        PooledBuffer result;
+        if (size != 0)
+        {
+            result.m_data = new std::uint8_t[size];
+            result.m_size = size;
+            result.m_capacity = size;
+        }
+        return result;
+    }
+
+    BufferPool::BufferPool(COTASKMEMALLOC* memalloc, COTASKMEMFREE* memfree, const std::shared_ptr<MemoryBudget>& budget) :
+        m_memalloc(memalloc), m_memfree(memfree), m_budget(budget)
+    {
+        for (auto& buffers : m_free) { buffers.reserve(BufferPoolMaxFreePerClass); }
+    }
+
+    BufferPool::~BufferPool()
+    {
+        for (std::size_t sizeClass = 0; sizeClass < BufferPoolClassCount; sizeClass++)
+        {
+            for (auto buffer : m_free[sizeClass]) { Free(buffer, BufferPoolMinClassSize << sizeClass); }
+        }
+    }
+
+    PooledBuffer BufferPool::Get(std::size_t size)
+    {
+        PooledBuffer result;
+        if (size == 0) { return result; }
+        ThrowErrorIf(Error::InvalidParameter, (size > std::numeric_limits<UINT32>::max()), "buffer too big");
+
+        auto extension = GetExtension();
+        if (extension)
+        {
+            BYTE* buffer = nullptr;
+            ThrowHrIfFailed(extension->AllocateBuffer(static_cast<UINT32>(size), &buffer));
+            ThrowErrorIf(Error::OutOfMemory, (buffer == nullptr), "buffer allocator returned no buffer");
+            result.m_data = buffer;
+            result.m_size = size;
+            result.m_capacity = size;
+            result.m_extension = std::move(extension);
+            return result;
+        }
+
+        auto sizeClass = GetSizeClass(size);
+        result.m_capacity = (sizeClass < BufferPoolClassCount) ? (BufferPoolMinClassSize << sizeClass) : size;
+        if (sizeClass < BufferPoolClassCount)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (!m_free[sizeClass].empty())
+            {
+                result.m_data = m_free[sizeClass].back();
+                m_free[sizeClass].pop_back();
+            }
+        }
+        if (result.m_data == nullptr)
+        {
+            Reserve(result.m_capacity);
+            result.m_data = static_cast<std::uint8_t*>(m_memalloc(result.m_capacity));
+            if (result.m_data == nullptr)
+            {
+                if (m_budget) { m_budget->Release(result.m_capacity); }
+                ThrowErrorAndLog(Error::OutOfMemory, "buffer allocation failed");
+            }
+        }
+        result.m_size = size;
+        result.m_pool = shared_from_this();
+        return result;
+    }
+
+    void BufferPool::SetExtension(const ComPtr<IMsixBufferAllocator>& extension)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_extension = extension;
+    }
+
+    ComPtr<IMsixBufferAllocator> BufferPool::GetExtension()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_extension;
+    }
+
+    void BufferPool::Return(PooledBuffer& buffer) noexcept
+    {
+        auto sizeClass = GetSizeClass(buffer.m_capacity);
+        if (sizeClass < BufferPoolClassCount && buffer.m_capacity == (BufferPoolMinClassSize << sizeClass))
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (m_free[sizeClass].size() < BufferPoolMaxFreePerClass)
+            {   // The vector has room for BufferPoolMaxFreePerClass buffers, so this doesn't allocate
+                m_free[sizeClass].push_back(buffer.m_data);
+                buffer.m_data = nullptr;
+                return;
+            }
+        }
+        Free(buffer.m_data, buffer.m_capacity);
+        buffer.m_data = nullptr;
+    }
+
+    void BufferPool::Reserve(std::size_t capacity)
+    {
+        if (!m_budget || m_budget->TryReserve(capacity)) { return; }
+        std::array<std::vector<std::uint8_t*>, BufferPoolClassCount> kept;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            for (std::size_t sizeClass = 0; sizeClass < BufferPoolClassCount; sizeClass++)
+            {
+                // Cleared rather than swapped, so the vectors keep their room for Return
+                kept[sizeClass] = m_free[sizeClass];
+                m_free[sizeClass].clear();
+            }
+        }
+        for (std::size_t sizeClass = 0; sizeClass < BufferPoolClassCount; sizeClass++)
+        {
+            for (auto buffer : kept[sizeClass]) { Free(buffer, BufferPoolMinClassSize << sizeClass); }
+        }
+        m_budget->Reserve(capacity);
+    }
+
+    void BufferPool::Free(std::uint8_t* buffer, std::size_t capacity) noexcept
+    {
+        m_memfree(buffer);
+        if (m_budget) { m_budget->Release(capacity); }
+    }
+}
@@ -0,0 +1,214 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "Crc32.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <zlib.h>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define MSIX_CRC32_X86 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#include <emmintrin.h>
+#include <smmintrin.h>
+#include <wmmintrin.h>
+#elif (defined(__aarch64__) || defined(_M_ARM64)) && (defined(__linux__) || defined(__APPLE__))
+#define MSIX_CRC32_ARM 1
+#include <arm_acle.h>
+#ifdef __linux__
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define MSIX_TARGET(features) __attribute__((target(features)))
+#else
+#define MSIX_TARGET(features)
+#endif
+
+namespace MSIX { namespace Crc32 {
+
+    namespace {
+
+    std::uint32_t ZlibUpdate(std::uint32_t crc, const std::uint8_t* data, std::size_t size)
+    {
+        while (size > 0)
+        {
+            auto chunk = static_cast<uInt>(std::min<std::size_t>(size, std::numeric_limits<uInt>::max()));
+            crc = static_cast<std::uint32_t>(crc32(crc, data, chunk));
+            data += chunk;
+            size -= chunk;
+        }
+        return crc;
+    }
+
+    #ifdef MSIX_CRC32_X86
+    // Folds 64 bytes at a time with carry-less multiplications and finishes with a Barrett
+    // reduction, as described in Intel's "Fast CRC Computation for Generic Polynomials Using
+    // PCLMULQDQ Instruction". The constants are for the bit reflected zip polynomial. size must be
+    // at least 64 and a multiple of 16, and crc is the raw (not inverted) register.
+    MSIX_TARGET("pclmul,sse4.1")
+    std::uint32_t FoldPclmul(std::uint32_t crc, const std::uint8_t* data, std::size_t size)
+    {
+        alignas(16) static const std::uint64_t k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+        alignas(16) static const std::uint64_t k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+        alignas(16) static const std::uint64_t k5k0[] = { 0x0163cd6124, 0x0000000000 };
+        alignas(16) static const std::uint64_t poly[] = { 0x01db710641, 0x01f7011641 };
+
+        __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00));
+        __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10));
+        __m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20));
+        __m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30));
+        x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(static_cast<int>(crc)));
+        __m128i x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+        data += 64;
+        size -= 64;
+
+        // Fold four lanes in parallel
+        while (size >= 64)
+        {
+            __m128i x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            __m128i x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+            __m128i x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+            __m128i x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+            x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+            x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x00)));
+            x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x10)));
+            x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x20)));
+            x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 0x30)));
+            data += 64;
+            size -= 64;
+        }
+
+        // Fold the four lanes into one
+        x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+        __m128i x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+        // Fold the remaining 16 byte blocks
+        while (size >= 16)
+        {
+            x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+            x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+            data += 16;
+            size -= 16;
+        }
+
+        // 128 bits to 64 bits
+        x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+        x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+        x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+        x0 = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+        x2 = _mm_srli_si128(x1, 4);
+        x1 = _mm_and_si128(x1, x3);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        // Barrett reduction to 32 bits
+        x0 = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+        x2 = _mm_and_si128(x1, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+        x2 = _mm_and_si128(x2, x3);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+        return static_cast<std::uint32_t>(_mm_extract_epi32(x1, 1));
+    }
+
+    bool HasPclmul()
+    {
+        #ifdef _MSC_VER
+        int info[4] = { 0 };
+        __cpuid(info, 1);
+        unsigned int ecx = static_cast<unsigned int>(info[2]);
+        #else
+        unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+        if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) { return false; }
+        #endif
+        const unsigned int pclmulqdq = 1u << 1;
+        const unsigned int sse41 = 1u << 19;
+        return ((ecx & pclmulqdq) != 0) && ((ecx & sse41) != 0);
+    }
+
+    std::uint32_t HardwareUpdate(std::uint32_t crc, const std::uint8_t* data, std::size_t size)
+    {
+        if (size >= 64)
+        {
+            std::size_t folded = size & ~static_cast<std::size_t>(15);
+            crc = ~FoldPclmul(~crc, data, folded);
+            data += folded;
+            size -= folded;
+        }
+        return ZlibUpdate(crc, data, size);
+    }
+    #endif
+
+    #ifdef MSIX_CRC32_ARM
+    MSIX_TARGET("crc")
+    std::uint32_t HardwareUpdate(std::uint32_t crc, const std::uint8_t* data, std::size_t size)
+    {
+        crc = ~crc;
+        while (size >= 8)
+        {
+            std::uint64_t value;
+            std::memcpy(&value, data, sizeof(value));
+            crc = __crc32d(crc, value);
+            data += 8;
+            size -= 8;
+        }
+        while (size > 0)
+        {
+            crc = __crc32b(crc, *data);
+            data++;
+            size--;
+        }
+        return ~crc;
+    }
+
+    bool HasCrcInstructions()
+    {
+        #ifdef __APPLE__
+        return true; // every arm64 Apple processor has them
+        #else
+        return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+        #endif
+    }
+    #endif
+
+    } // namespace
+
+    std::uint32_t Update(std::uint32_t crc, const std::uint8_t* data, std::size_t size)
+    {
+        #if defined(MSIX_CRC32_X86)
+        static const bool hardware = HasPclmul();
+        #elif defined(MSIX_CRC32_ARM)
+        static const bool hardware = HasCrcInstructions();
+        #else
+        static const bool hardware = false;
+        #endif
+        #if defined(MSIX_CRC32_X86) || defined(MSIX_CRC32_ARM)
+        if (hardware) { return HardwareUpdate(crc, data, size); }
+        #endif
+        return ZlibUpdate(crc, data, size);
+    }
+
+} /* Crc32 */ } /* MSIX */
@@ -0,0 +1,86 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "DeferredFileCloser.hpp"
+
+#include <algorithm>
+#include <system_error>
+
+#ifndef WIN32
+#include <unistd.h>
+#endif
+
+namespace MSIX {
+
+    DeferredFileCloser::DeferredFileCloser(std::size_t threadCount) : m_maxThreads(std::max<std::size_t>(threadCount, 1))
+    {
+    }
+
+    DeferredFileCloser::~DeferredFileCloser()
+    {
+        {   std::lock_guard<std::mutex> lock(m_lock);
+            m_stop = true;
+            m_changed.notify_all();
+        }
+        // Queued files are still closed before the threads return
+        for (auto& thread : m_threads) { thread.join(); }
+    }
+
+    void DeferredFileCloser::Close(Handle file)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if ((m_idleThreads <= m_files.size()) && (m_threads.size() < m_maxThreads))
+        {
+            try
+            {
+                m_threads.emplace_back([this]() { WorkerLoop(); });
+            }
+            catch (const std::system_error&)
+            {   // Without a thread to close it on, and none already running, the file is closed here
+                if (m_threads.empty())
+                {
+                    CloseNow(file);
+                    return;
+                }
+            }
+        }
+        m_files.push_back(file);
+        m_changed.notify_one();
+    }
+
+    void DeferredFileCloser::Wait()
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_closed.wait(lock, [this]() { return m_files.empty() && m_closing == 0; });
+    }
+
+    void DeferredFileCloser::CloseNow(Handle file)
+    {
+        #ifdef WIN32
+        CloseHandle(file);
+        #else
+        close(file);
+        #endif
+    }
+
+    void DeferredFileCloser::WorkerLoop() noexcept
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        while (true)
+        {
+            m_idleThreads++;
+            m_changed.wait(lock, [this]() { return !m_files.empty() || m_stop; });
+            m_idleThreads--;
+            if (m_files.empty()) { return; }
+            auto file = m_files.front();
+            m_files.pop_front();
+            m_closing++;
+            lock.unlock();
+            CloseNow(file);
+            lock.lock();
+            m_closing--;
+            if (m_files.empty() && m_closing == 0) { m_closed.notify_all(); }
+        }
+    }
+}
@@ -7,6 +7,8 @@
 #include <algorithm>
 #include <vector>
 #include <array>
+#include <cstring>
+#include <cwchar>
 
 #include "Encoding.hpp"
 #include "Exceptions.hpp"
@@ -45,10 +47,63 @@ namespace MSIX { namespace Encoding {
         EncodingChar(const wchar_t* e, wchar_t d) : encode(e), decode(d) {}
     };
 
+    // Returns true if every byte of value is ASCII and none of them is excluded. Looks at eight bytes at a time,
+    // this runs for every file name of a package.
+    static bool IsAsciiWithout(const std::string& value, char excluded)
+    {
+        const std::uint64_t ones = 0x0101010101010101ull;
+        const std::uint64_t highBits = 0x8080808080808080ull;
+        const std::uint64_t pattern = ones * static_cast<std::uint8_t>(excluded);
+        const char* data = value.data();
+        std::size_t size = value.size();
+        std::size_t index = 0;
+        for (; index + sizeof(std::uint64_t) <= size; index += sizeof(std::uint64_t))
+        {
+            std::uint64_t word;
+            std::memcpy(&word, data + index, sizeof(word));
+            auto matches = word ^ pattern; // a byte equal to excluded is now zero
+            if (((word | ((matches - ones) & ~matches)) & highBits) != 0) { return false; }
+        }
+        for (; index < size; index++)
+        {
+            if ((static_cast<std::uint8_t>(data[index]) & 0x80) || data[index] == excluded) { return false; }
+        }
+        return true;
+    }
+
     // Returns the file name percentage encoded.
     std::string EncodeFileName(const std::string& fileName)
     {
         ThrowErrorIf(Error::InvalidParameter, fileName.empty(), "Empty value tries to be encoded");
+        // ASCII names are encoded directly from the UTF-8 bytes, and returned as they are when nothing is escaped.
+        if (IsAsciiWithout(fileName, '\0'))
+        {
+            auto encodingOf = [](char c) -> const wchar_t*
+            {
+                auto index = static_cast<std::size_t>(c);
+                return (index < PercentageEncodingTableSize) ? PercentageEncoding[index] : nullptr;
+            };
+            auto first = std::find_if(fileName.begin(), fileName.end(), [&encodingOf](char c) { return c == '\\' || encodingOf(c) != nullptr; });
+            if (first == fileName.end()) { return fileName; }
+            std::string result(fileName.begin(), first);
+            result.reserve(fileName.size() + 16);
+            for (auto c = first; c != fileName.end(); c++)
+            {
+                if (*c == '\\')
+                {   result.push_back('/');
+                }
+                else if (const auto encoded = encodingOf(*c))
+                {   result.push_back('%');
+                    result.push_back(static_cast<char>(encoded[1]));
+                    result.push_back(static_cast<char>(encoded[2]));
+                }
+                else
+                {   result.push_back(*c);
+                }
+            }
+            return result;
+        }
+
         std::wstring fileNameW = utf8_to_wstring(fileName);
         std::wstring result = L"";
 
@@ -217,6 +272,31 @@ namespace MSIX { namespace Encoding {
     // Decodes a percentage encoded string
     std::string DecodeFileName(const std::string& fileName)
     {
+        // ASCII without any percentage encoding decodes to itself. ASCII with only the escapes EncodeFileName uses for
+        // ASCII characters is decoded directly from the UTF-8 bytes, anything else goes through UTF-16 below.
+        if (IsAsciiWithout(fileName, '%')) { return fileName; }
+        if (IsAsciiWithout(fileName, '\0'))
+        {
+            std::string result;
+            result.reserve(fileName.size());
+            std::size_t index = 0;
+            for (; index < fileName.size(); index++)
+            {
+                if (fileName[index] != '%')
+                {   result.push_back(fileName[index]);
+                    continue;
+                }
+                if (index + 2 >= fileName.size()) { break; }
+                const wchar_t encoding[] = { static_cast<wchar_t>(fileName[index + 1]), static_cast<wchar_t>(fileName[index + 2]), L'\0' };
+                const auto found = std::find_if(std::begin(EncodingToChar), std::end(EncodingToChar),
+                    [&encoding](const EncodingChar& c) { return std::wcscmp(c.encode, encoding) == 0; });
+                if (found == std::end(EncodingToChar)) { break; }
+                result.push_back(static_cast<char>(found->decode));
+                index += 2;
+            }
+            if (index == fileName.size()) { return result; }
+        }
+
         std::wstring fileNameW = utf8_to_wstring(fileName);
         std::wstring result = L"";
         for (std::uint32_t index = 0; index < fileNameW.length(); index++)
@@ -448,4 +528,71 @@ namespace MSIX { namespace Encoding {
         return result;
     }
 
+    void EncodeBase64(const std::uint8_t* data, std::size_t size, char* output)
+    {
+        static const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        std::size_t index = 0;
+        for (; index + 3 <= size; index += 3)
+        {
+            std::uint32_t group = (static_cast<std::uint32_t>(data[index]) << 16) |
+                (static_cast<std::uint32_t>(data[index + 1]) << 8) | data[index + 2];
+            output[0] = alphabet[(group >> 18) & 0x3F];
+            output[1] = alphabet[(group >> 12) & 0x3F];
+            output[2] = alphabet[(group >> 6) & 0x3F];
+            output[3] = alphabet[group & 0x3F];
+            output += 4;
+        }
+        if (index < size)
+        {
+            std::uint32_t group = static_cast<std::uint32_t>(data[index]) << 16;
+            if (index + 1 < size) { group |= static_cast<std::uint32_t>(data[index + 1]) << 8; }
+            output[0] = alphabet[(group >> 18) & 0x3F];
+            output[1] = alphabet[(group >> 12) & 0x3F];
+            output[2] = (index + 1 < size) ? alphabet[(group >> 6) & 0x3F] : '=';
+            output[3] = '=';
+        }
+    }
+
+    bool DecodeBase64(const char* value, std::size_t length, std::uint8_t* output, std::size_t size)
+    {
+        if (length != GetBase64EncodedSize(size)) { return false; }
+        auto input = reinterpret_cast<const std::uint8_t*>(value);
+        // Characters outside of the ring, invalid ones and = all set one of the two high bits, so they are
+        // only checked once at the end.
+        auto lookup = [&input](std::size_t i) -> std::uint32_t
+        {
+            return static_cast<std::uint32_t>(base64DecoderRing[input[i] & 0x7F]) | (input[i] & 0x80);
+        };
+        std::uint32_t invalid = 0;
+        std::size_t index = 0;
+        for (; index + 3 <= size; index += 3)
+        {
+            auto v1 = lookup(0), v2 = lookup(1), v3 = lookup(2), v4 = lookup(3);
+            invalid |= v1 | v2 | v3 | v4;
+            std::uint32_t group = (v1 << 18) | (v2 << 12) | (v3 << 6) | v4;
+            output[index] = static_cast<std::uint8_t>(group >> 16);
+            output[index + 1] = static_cast<std::uint8_t>(group >> 8);
+            output[index + 2] = static_cast<std::uint8_t>(group);
+            input += 4;
+        }
+        if (index < size)
+        {
+            auto v1 = lookup(0), v2 = lookup(1);
+            invalid |= v1 | v2;
+            output[index] = static_cast<std::uint8_t>((v1 << 2) | (v2 >> 4));
+            if (index + 1 < size)
+            {
+                auto v3 = lookup(2);
+                invalid |= v3;
+                output[index + 1] = static_cast<std::uint8_t>((v2 << 4) | (v3 >> 2));
+                if ((v3 & 0x03) != 0 || input[3] != '=') { return false; }
+            }
+            else
+            {
+                if ((v2 & 0x0F) != 0 || input[2] != '=' || input[3] != '=') { return false; }
+            }
+        }
+        return (invalid & 0xC0) == 0;
+    }
+
 } /*Encoding */ } /* MSIX */
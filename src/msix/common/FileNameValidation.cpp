@@ -4,161 +4,228 @@
 //
 
 #include "FileNameValidation.hpp"
-#include "StringHelper.hpp"
 #include "UnicodeConversion.hpp"
 
-#include <array>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
 
 namespace MSIX {
 
     namespace
     {
-        static const std::array<bool, 0x7D> IsReservedFileNameChar = {
-            true,  true,  true,  true,  true,  true,  true,  true,
-            true,  true,  true,  true,  true,  true,  true,  true,
-            true,  true,  true,  true,  true,  true,  true,  true,
-            true,  true,  true,  true,  true,  true,  true,  true,  // characters in the range 0 - 31
-            false, false, true,  false, false, false, false, false, // character "
-            false, false, true,  false, false, false, false, true,  // characters * /
-            false, false, false, false, false, false, false, false,
-            false, false, true,  false, true,  false, true,  true,  // characters : < > ?
-            false, false, false, false, false, false, false, false,
-            false, false, false, false, false, false, false, false,
-            false, false, false, false, false, false, false, false,
-            false, false, false, false, false, false, false, false,
-            false, false, false, false, false, false, false, false,
-            false, false, false, false, false, false, false, false,
-            false, false, false, false, false, false, false, false,
-            false, false, false, false, true                        // character |
-        };
-
-        const std::string ProhibitedFileNames[] = {
-            ".",
-            "..",
-            "con",
-            "prn",
-            "aux",
-            "nul",
-            "com1",
-            "com2",
-            "com3",
-            "com4",
-            "com5",
-            "com6",
-            "com7",
-            "com8",
-            "com9",
-            "lpt1",
-            "lpt2",
-            "lpt3",
-            "lpt4",
-            "lpt5",
-            "lpt6",
-            "lpt7",
-            "lpt8",
-            "lpt9",
-        };
-
-        // Caller must pass in a lowercase string!
-        bool IsProhibitedFileName(const std::string& identifier)
+        // What every ASCII character is for validation, so every check of a character is one lookup
+        struct CharacterClasses
         {
-            for (const auto& name : ProhibitedFileNames)
+            enum Class : std::uint8_t
             {
-                if (identifier == name)
+                Reserved   = 0x01, // not allowed in file names: 0 - 31 and " * / : < > ? |
+                Identifier = 0x02, // allowed in package identifiers: a-z A-Z 0-9 . -
+            };
+
+            constexpr CharacterClasses() : classes(), lower()
+            {
+                for (int c = 0; c < 128; c++)
                 {
-                    return true;
+                    lower[c] = static_cast<char>(((c >= 'A') && (c <= 'Z')) ? (c - 'A' + 'a') : c);
+                    if ((c < 32) || (c == '"') || (c == '*') || (c == '/') || (c == ':') || (c == '<') || (c == '>') || (c == '?') || (c == '|'))
+                    {
+                        classes[c] |= Reserved;
+                    }
+                    if (((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || ((c >= '0') && (c <= '9')) || (c == '.') || (c == '-'))
+                    {
+                        classes[c] |= Identifier;
+                    }
                 }
             }
-            return false;
-        }
 
-        const std::string ProhibitedPrefixes[] = {
-            "con.",
-            "prn.",
-            "aux.",
-            "nul.",
-            "com1.",
-            "com2.",
-            "com3.",
-            "com4.",
-            "com5.",
-            "com6.",
-            "com7.",
-            "com8.",
-            "com9.",
-            "lpt1.",
-            "lpt2.",
-            "lpt3.",
-            "lpt4.",
-            "lpt5.",
-            "lpt6.",
-            "lpt7.",
-            "lpt8.",
-            "lpt9.",
-            "xn--",
+            std::uint8_t classes[128];
+            char lower[128];
         };
 
-        bool HasProhibitedPrefix(const std::string& identifier)
+        constexpr CharacterClasses Characters;
+
+        template <class Char>
+        bool Is(Char c, CharacterClasses::Class characterClass)
+        {
+            return (static_cast<std::uint32_t>(c) < 128) && ((Characters.classes[static_cast<std::uint32_t>(c)] & characterClass) != 0);
+        }
+
+        // Characters outside of ASCII are returned as they are, they never match the ASCII names compared with
+        template <class Char>
+        std::uint32_t ToLower(Char c)
         {
-            for (const auto& prefix : ProhibitedPrefixes)
+            auto value = static_cast<std::uint32_t>(static_cast<typename std::make_unsigned<Char>::type>(c));
+            return (value < 128) ? static_cast<std::uint32_t>(Characters.lower[value]) : value;
+        }
+
+        // Whether [begin, end) starts with the lowercase ASCII prefix, ignoring case
+        template <class Char>
+        bool StartsWith(const Char* begin, const Char* end, const char* prefix)
+        {
+            for (; *prefix != '\0'; begin++, prefix++)
             {
-                if (identifier.size() >= prefix.size() &&
-                    identifier.substr(0, prefix.size()) == prefix)
-                {
-                    return true;
-                }
+                if ((begin == end) || (ToLower(*begin) != static_cast<std::uint32_t>(*prefix))) { return false; }
             }
-            return false;
+            return true;
         }
 
-        const std::string ProhibitedSuffixes[] = {
-            ".",
-        };
+        template <class Char>
+        bool Equals(const Char* begin, const Char* end, const char* name)
+        {
+            return (static_cast<std::size_t>(end - begin) == std::strlen(name)) && StartsWith(begin, end, name);
+        }
 
-        bool HasProhibitedSuffix(const std::string& identifier)
+        // Names that conflict with device names (con, prn, aux, nul, com1-9 and lpt1-9), alone or followed by an
+        // extension, that end with a dot (which includes . and ..) or that start with xn--
+        template <class Char>
+        bool IsIdentifierValid(const Char* begin, const Char* end)
         {
-            for (const auto& suffix : ProhibitedSuffixes)
+            auto size = static_cast<std::size_t>(end - begin);
+            if ((size != 0) && (*(end - 1) == '.'))
             {
-                if (identifier.size() >= suffix.size() &&
-                    identifier.substr(identifier.size() - suffix.size()) == suffix)
-                {
-                    return true;
-                }
+                return false;
             }
-            return false;
+            if (StartsWith(begin, end, "xn--"))
+            {
+                return false;
+            }
+            std::size_t deviceSize = 0;
+            if (StartsWith(begin, end, "con") || StartsWith(begin, end, "prn") || StartsWith(begin, end, "aux") || StartsWith(begin, end, "nul"))
+            {
+                deviceSize = 3;
+            }
+            else if ((StartsWith(begin, end, "com") || StartsWith(begin, end, "lpt")) && (size > 3) && (begin[3] >= '1') && (begin[3] <= '9'))
+            {
+                deviceSize = 4;
+            }
+            return (deviceSize == 0) || ((size != deviceSize) && (begin[deviceSize] != '.'));
         }
 
-        constexpr wchar_t highSurrogateStart = 0xd800;
-        constexpr wchar_t highSurrogateEnd   = 0xdbff;
-        constexpr wchar_t lowSurrogateStart  = 0xdc00;
-        constexpr wchar_t lowSurrogateEnd    = 0xdfff;
+        constexpr std::uint32_t highSurrogateStart = 0xd800;
+        constexpr std::uint32_t highSurrogateEnd   = 0xdbff;
+        constexpr std::uint32_t lowSurrogateStart  = 0xdc00;
+        constexpr std::uint32_t lowSurrogateEnd    = 0xdfff;
 
-        bool IsLowSurrogate(wchar_t ch)
+        bool IsLowSurrogate(std::uint32_t ch)
         {
-            return (((ch) >= lowSurrogateStart) && ((ch) <= lowSurrogateEnd));
+            return ((ch >= lowSurrogateStart) && (ch <= lowSurrogateEnd));
         }
 
-        bool IsHighSurrogate(wchar_t ch)
+        bool IsHighSurrogate(std::uint32_t ch)
         {
-            return (((ch) >= highSurrogateStart) && ((ch) <= highSurrogateEnd));
+            return ((ch >= highSurrogateStart) && (ch <= highSurrogateEnd));
         }
 
-
-        bool IsValidSegment(wchar_t previousChar, const std::wstring& segmentUtf16)
+        bool IsValidSegment(std::uint32_t previousChar, std::size_t segmentSize)
         {
             // Segments cannot end with multiple segment delimiters ('\'), space, dot or orphaned high surrogate char.
-            if ((previousChar == L'\\') || (previousChar == L' ') || (previousChar == L'.' ) || IsHighSurrogate(previousChar))
+            if ((previousChar == '\\') || (previousChar == ' ') || (previousChar == '.' ) || IsHighSurrogate(previousChar))
             {
                 return false;
             }
 
             // Segments cannot be longer than 255 characters
-            if (segmentUtf16.size() > 255)
+            return (segmentSize <= 255);
+        }
+
+        // One pass over the characters of the name, either its bytes when it is all ASCII or its UTF-16 code units
+        template <class Char>
+        bool IsFileNameValid(const Char* begin, const Char* end)
+        {
+            // Windows files cannot have '/'. Unix-based systems can have '\' in their file names, but restrict
+            // it to allow real "cross plat" packages
+            #ifdef WIN32
+            const Char separator = '\\';
+            #else
+            const Char separator = '/';
+            #endif
+
+            if (*begin == separator)
             {
                 return false;
             }
-            std::string segment = wstring_to_utf8(segmentUtf16);
-            return FileNameValidation::IsIdentifierValid(segment);
+
+            std::uint32_t previousChar = '\0';
+            const Char* segment = begin;
+            const Char* lastDot = nullptr;
+            bool hasRelsSubFolder = false; // the file name is under a _rels subfolder
+
+            for (const Char* current = begin; current != end; current++)
+            {
+                auto currentChar = static_cast<std::uint32_t>(static_cast<typename std::make_unsigned<Char>::type>(*current));
+
+                if (*current == separator)
+                {
+                    if (!IsValidSegment(previousChar, static_cast<std::size_t>(current - segment)) || !IsIdentifierValid(segment, current))
+                    {
+                        return false;
+                    }
+
+                    if (Equals(segment, current, "_rels"))
+                    {
+                        hasRelsSubFolder = true;
+                    }
+
+                    segment = current + 1;
+                    previousChar = '\\';
+                    continue;
+                }
+
+                // Reserved characters in the file name, or the separator of the other platform
+                if (Is(currentChar, CharacterClasses::Reserved) || (currentChar == '\\'))
+                {
+                    return false;
+                }
+
+                // Character is a non-character Unicode codepoint
+                if ((currentChar == 0xFFFE) || (currentChar == 0xFFFF))
+                {
+                    return false;
+                }
+
+                // Found low surrogate value without preceding high surrogate value
+                if (IsLowSurrogate(currentChar) && !IsHighSurrogate(previousChar))
+                {
+                    return false;
+                }
+
+                // Previous high surrogate value was not completed
+                if (IsHighSurrogate(previousChar) && !IsLowSurrogate(currentChar))
+                {
+                    return false;
+                }
+
+                if (currentChar == '.')
+                {
+                    lastDot = current;
+                }
+                previousChar = currentChar;
+            }
+
+            // Validate final segment
+            if (!IsValidSegment(previousChar, static_cast<std::size_t>(end - segment)) || !IsIdentifierValid(segment, end))
+            {
+                return false;
+            }
+
+            // Relationship Part URI must have a .rels extension and be under a _rels subfolder
+            if (hasRelsSubFolder && Equals((lastDot == nullptr) ? begin : lastDot + 1, end, "rels"))
+            {
+                return false;
+            }
+
+            return true;
+        }
+
+        bool EqualsIgnoreCase(const std::string& value, const char* name)
+        {
+            return Equals(value.data(), value.data() + value.size(), name);
+        }
+
+        bool StartsWithIgnoreCase(const std::string& value, const char* prefix)
+        {
+            return StartsWith(value.data(), value.data() + value.size(), prefix);
         }
     }
 
@@ -184,133 +251,59 @@ namespace MSIX {
             return false;
         }
 
-        // Windows files cannot have '/'.
-        #ifdef WIN32
-        auto findSlash = name.find("/");
-        if (findSlash != std::string::npos)
-        {
-            return false;
-        }
-        #else
-        // Unix-based systems can have '\' in their file names, but restrict
-        // it to allow real "cross plat" packages 
-        auto findBackSlash = name.find("\\");
-        if (findBackSlash != std::string::npos)
+        // Almost every name is ASCII, which is the same in UTF-8 and UTF-16, so it isn't converted
+        bool isAscii = true;
+        for (auto c : name)
         {
-            return false;
+            if (static_cast<unsigned char>(c) >= 128) { isAscii = false; break; }
         }
-        #endif
-
-        std::string backSlashName = Helper::toBackSlash(name);
-        if (backSlashName[0] == '\\')
+        if (isAscii)
         {
-            return false;
+            return ::MSIX::IsFileNameValid(name.data(), name.data() + name.size());
         }
+        std::wstring nameUtf16 = utf8_to_wstring(name);
+        return ::MSIX::IsFileNameValid(nameUtf16.data(), nameUtf16.data() + nameUtf16.size());
+    }
 
-        wchar_t previousChar = L'\0';
-        std::wstring currentSegment;
-        bool hasRelsSubFolder = false; // the file name is under a _rels subfolder
-
-        std::wstring nameUtf16 = utf8_to_wstring(backSlashName);
-        for(size_t i = 0; i < nameUtf16.size(); i++)
-        {
-            wchar_t currentChar = nameUtf16[i];
-
-            // Reserved characters in the file name
-            if ((currentChar < IsReservedFileNameChar.size()) && IsReservedFileNameChar[currentChar])
-            {
-                return false;
-            }
-
-            // Character is a non-character Unicode codepoint
-            if (currentChar == 0xFFFE || currentChar == 0xFFFF)
-            {
-                return false;
-            }
-
-            // Found low surrogate value without preceding high surrogate value
-            if (IsLowSurrogate(currentChar) && !IsHighSurrogate(previousChar))
-            {
-                return false;
-            } 
-
-            // Previous high surrogate value was not completed
-            if (IsHighSurrogate(previousChar) && !IsLowSurrogate(currentChar))
-            {
-                return false;
-            } 
-
-            if (currentChar == L'\\')
-            {
-                if(!IsValidSegment(previousChar, currentSegment))
-                {
-                    return false;
-                }
-
-                std::wstring lowSegment = Helper::towlower(currentSegment);
-                if (lowSegment == L"_rels")
-                {
-                    hasRelsSubFolder = true;
-                }
-
-                currentSegment.clear();
-            }
-            else
-            {
-                currentSegment += currentChar;
-            }
-
-            previousChar = currentChar;
-        }
+    bool FileNameValidation::IsIdentifierValid(const std::string& identifier)
+    {
+        return ::MSIX::IsIdentifierValid(identifier.data(), identifier.data() + identifier.size());
+    }
 
-        // Validate final segment
-        if (!IsValidSegment(previousChar, currentSegment))
+    bool FileNameValidation::HasOnlyIdentifierCharacters(const std::string& identifier)
+    {
+        if (identifier.empty())
         {
             return false;
         }
-
-        // Relationship Part URI must have a .rels extension and be under a _rels subfolder
-        if (hasRelsSubFolder)
+        for (auto c : identifier)
         {
-            std::string ext = Helper::tolower(name.substr(name.find_last_of(".") + 1));
-            if (ext == "rels")
-            {
-                return false;
-            }
+            if (!Is(static_cast<unsigned char>(c), CharacterClasses::Identifier)) { return false; }
         }
-
         return true;
     }
 
-    bool FileNameValidation::IsIdentifierValid(const std::string& identifier)
-    {
-        std::string lowSegment = Helper::tolower(identifier);
-        return !IsProhibitedFileName(lowSegment) && !HasProhibitedPrefix(lowSegment) && !HasProhibitedSuffix(lowSegment);
-    }
-
     bool FileNameValidation::IsFootPrintFile(const std::string& fileName, bool isBundle)
     {
         bool result = false;
-        std::string lowIdent = Helper::tolower(fileName);
         if (isBundle)
         {
-            result = lowIdent == "appxmetadata/appxbundlemanifest.xml";
+            result = EqualsIgnoreCase(fileName, "appxmetadata/appxbundlemanifest.xml");
         }
         else
         {
-            result = lowIdent == "appxmanifest.xml";
+            result = EqualsIgnoreCase(fileName, "appxmanifest.xml");
         }
 
         return (result ||
-                (lowIdent == "appxsignature.p7x") ||
-                (lowIdent == "appxblockmap.xml") ||
-                (lowIdent == "[content_types].xml"));
+                EqualsIgnoreCase(fileName, "appxsignature.p7x") ||
+                EqualsIgnoreCase(fileName, "appxblockmap.xml") ||
+                EqualsIgnoreCase(fileName, "[content_types].xml"));
     }
 
     bool FileNameValidation::IsReservedFolder(const std::string& fileName)
     {
-        std::string lowIdent = Helper::tolower(fileName);
-        return ((lowIdent.rfind("appxmetadata", 0) != std::string::npos) ||
-                (lowIdent.rfind("microsoft.system.package.metadata", 0) != std::string::npos));
+        return (StartsWithIgnoreCase(fileName, "appxmetadata") ||
+                StartsWithIgnoreCase(fileName, "microsoft.system.package.metadata"));
     }
 }
@@ -0,0 +1,103 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "FileStatistics.hpp"
+
+namespace MSIX {
+
+    namespace {
+        // The file of the thread, the stage it is in and since when the time of that stage isn't charged yet
+        struct ThreadFile
+        {
+            FileStatistics* statistics = nullptr;
+            FileStatistics::Stage stage = FileStatistics::Stage::None;
+            std::chrono::steady_clock::time_point since;
+        };
+        thread_local ThreadFile currentFile;
+    }
+
+    void FileStatistics::Add(Stage stage, std::chrono::steady_clock::duration duration)
+    {
+        m_nanoseconds[static_cast<std::size_t>(stage)].fetch_add(
+            static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()), std::memory_order_relaxed);
+    }
+
+    void FileStatistics::Report(IMsixFileStatisticsCallback* callback, const std::string& name, bool packed, std::uint64_t size,
+        std::uint64_t compressedSize, std::uint32_t blockCount) const
+    {
+        auto nanoseconds = [this](Stage stage)
+        {
+            return static_cast<UINT64>(m_nanoseconds[static_cast<std::size_t>(stage)].load(std::memory_order_relaxed));
+        };
+        MSIX_FILE_STATISTICS statistics = {};
+        statistics.utf8Name = name.c_str();
+        statistics.packed = packed ? TRUE : FALSE;
+        statistics.size = size;
+        statistics.compressedSize = compressedSize;
+        statistics.blockCount = blockCount;
+        statistics.readNanoseconds = nanoseconds(Stage::Read);
+        statistics.inflateNanoseconds = nanoseconds(Stage::Inflate);
+        statistics.deflateNanoseconds = nanoseconds(Stage::Deflate);
+        statistics.hashNanoseconds = nanoseconds(Stage::Hash);
+        statistics.writeNanoseconds = nanoseconds(Stage::Write);
+        callback->OnFile(&statistics);
+    }
+
+    FileStatistics* FileStatistics::GetCurrent()
+    {
+        return currentFile.statistics;
+    }
+
+    // The stage the thread was in when the scope started is picked up again as the scope ends, without the time
+    // spent in the scope.
+    FileStatistics::Scope::Scope(FileStatistics* statistics)
+    {
+        if (statistics == nullptr) { return; }
+        auto& current = currentFile;
+        auto now = std::chrono::steady_clock::now();
+        if (current.stage != Stage::None)
+        {
+            current.statistics->Add(current.stage, now - current.since);
+        }
+        m_active = true;
+        m_previous = current.statistics;
+        m_previousStage = current.stage;
+        current.statistics = statistics;
+        current.stage = Stage::None;
+    }
+
+    FileStatistics::Scope::~Scope()
+    {
+        if (!m_active) { return; }
+        auto& current = currentFile;
+        current.statistics = m_previous;
+        current.stage = m_previousStage;
+        current.since = std::chrono::steady_clock::now();
+    }
+
+    FileStatistics::Measure::Measure(Stage stage)
+    {
+        auto& current = currentFile;
+        if ((current.statistics == nullptr) || (stage == Stage::None)) { return; }
+        auto now = std::chrono::steady_clock::now();
+        if (current.stage != Stage::None)
+        {
+            current.statistics->Add(current.stage, now - current.since);
+        }
+        m_active = true;
+        m_previous = current.stage;
+        current.stage = stage;
+        current.since = now;
+    }
+
+    FileStatistics::Measure::~Measure()
+    {
+        if (!m_active) { return; }
+        auto& current = currentFile;
+        auto now = std::chrono::steady_clock::now();
+        current.statistics->Add(current.stage, now - current.since);
+        current.stage = m_previous;
+        current.since = now;
+    }
+}
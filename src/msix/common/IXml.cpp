@@ -106,6 +106,11 @@ namespace MSIX {
         return xPaths[static_cast<std::underlying_type_t<XmlQueryName>>(query)];
     }
 
+    std::size_t GetQueryCount()
+    {
+        return std::extent<decltype(xPaths)>::value;
+    }
+
     std::string GetQueryStringUtf8(XmlQueryName query)
     {
 #ifdef USING_MSXML
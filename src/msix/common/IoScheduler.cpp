@@ -0,0 +1,235 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "IoScheduler.hpp"
+#include "StreamBase.hpp"
+
+#include <algorithm>
+#include <map>
+
+namespace MSIX {
+
+    void IoBatch::Wait()
+    {
+        {   std::unique_lock<std::mutex> lock(m_lock);
+            m_done.wait(lock, [this]() { return m_complete; });
+        }
+        ThrowHrIfFailed(GetResult());
+    }
+
+    HRESULT IoBatch::GetResult()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (const auto& request : m_requests)
+        {
+            if (FAILED(request.result)) { return request.result; }
+        }
+        return static_cast<HRESULT>(Error::OK);
+    }
+
+    bool IoBatch::IsDone()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_complete;
+    }
+
+    void IoBatch::RequestsDone(std::size_t count)
+    {
+        {   std::lock_guard<std::mutex> lock(m_lock);
+            m_pending -= count;
+            if (m_pending != 0) { return; }
+        }
+        // Waiters are released after the completion, so what it does is visible to them.
+        if (m_completion) { m_completion(*this); }
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_complete = true;
+        m_done.notify_all();
+    }
+
+    std::shared_ptr<IoBatch> IoScheduler::Submit(std::vector<IoRequest>&& requests, IoCompletion completion)
+    {
+        auto batch = std::make_shared<IoBatch>(std::move(requests), std::move(completion));
+        auto& batchRequests = batch->GetRequests();
+
+        // Positional reads run on their own, the requests that use the seek pointer of a stream run in order.
+        std::vector<std::size_t> independent;
+        std::map<IStream*, std::vector<std::size_t>> sequences;
+        for (std::size_t index = 0; index < batchRequests.size(); index++)
+        {
+            const auto& request = batchRequests[index];
+            ThrowErrorIf(Error::InvalidParameter, !request.stream || (request.buffer == nullptr && request.size != 0), "invalid I/O request");
+            auto streamInternal = request.stream.TryAs<IStreamInternal>();
+            bool positional = (request.operation == IoOperation::Read) && (request.offset != IoCurrentPosition) &&
+                streamInternal && streamInternal->SupportsReadAt();
+            if (positional) { independent.push_back(index); }
+            else { sequences[request.stream.Get()].push_back(index); }
+        }
+
+        batch->m_pending = batchRequests.size();
+        if (batchRequests.empty())
+        {
+            batch->RequestsDone(0);
+            return batch;
+        }
+        for (auto index : independent)
+        {
+            Post([batch, index]()
+            {
+                Execute(batch->GetRequests()[index]);
+                batch->RequestsDone(1);
+            });
+        }
+        for (auto& sequence : sequences)
+        {
+            Post([batch, indexes = std::move(sequence.second)]()
+            {
+                auto& requests = batch->GetRequests();
+                bool failed = false;
+                for (auto index : indexes)
+                {   // Nothing after a failed request of the same stream runs, the position of the stream is unknown.
+                    if (failed) { requests[index].result = static_cast<HRESULT>(Error::Unexpected); continue; }
+                    Execute(requests[index]);
+                    failed = FAILED(requests[index].result);
+                }
+                batch->RequestsDone(indexes.size());
+            });
+        }
+        return batch;
+    }
+
+    void IoScheduler::Run(std::vector<IoRequest>& requests)
+    {
+        auto batch = Submit(std::move(requests));
+        batch->Wait();
+        requests = std::move(batch->GetRequests());
+    }
+
+    namespace {
+        // Never destroyed. Its destructor would join the threads when the process exits, after they are gone,
+        // or while the library is unloaded, when they can't exit. MsixShutdownThreads stops them instead.
+        std::shared_ptr<ThreadPoolIoScheduler>& GetDefaultThreadPool()
+        {
+            static auto scheduler = new std::shared_ptr<ThreadPoolIoScheduler>(std::make_shared<ThreadPoolIoScheduler>(
+                std::min<std::size_t>(IoSchedulerMaxThreads, std::max(std::thread::hardware_concurrency(), 1u))));
+            return *scheduler;
+        }
+    }
+
+    std::shared_ptr<IoScheduler> IoScheduler::GetDefault()
+    {
+        return GetDefaultThreadPool();
+    }
+
+    void IoScheduler::StopDefault()
+    {
+        GetDefaultThreadPool()->Stop();
+    }
+
+    void IoScheduler::Execute(IoRequest& request) noexcept try
+    {
+        request.transferred = 0;
+        auto bytes = static_cast<std::uint8_t*>(request.buffer);
+        if (request.operation == IoOperation::Read)
+        {
+            auto streamInternal = request.stream.TryAs<IStreamInternal>();
+            bool positional = (request.offset != IoCurrentPosition) && streamInternal && streamInternal->SupportsReadAt();
+            if (!positional && (request.offset != IoCurrentPosition))
+            {
+                LARGE_INTEGER position = { 0 };
+                position.QuadPart = static_cast<LONGLONG>(request.offset);
+                ThrowHrIfFailed(request.stream->Seek(position, StreamBase::Reference::START, nullptr));
+            }
+            while (request.transferred < request.size)
+            {
+                ULONG bytesRead = 0;
+                if (positional)
+                {
+                    bytesRead = streamInternal->ReadAt(request.offset + request.transferred, bytes + request.transferred, request.size - request.transferred);
+                }
+                else
+                {
+                    ThrowHrIfFailed(request.stream->Read(bytes + request.transferred, request.size - request.transferred, &bytesRead));
+                }
+                if (bytesRead == 0) { break; }
+                request.transferred += bytesRead;
+            }
+        }
+        else
+        {
+            if (request.offset != IoCurrentPosition)
+            {
+                LARGE_INTEGER position = { 0 };
+                position.QuadPart = static_cast<LONGLONG>(request.offset);
+                ThrowHrIfFailed(request.stream->Seek(position, StreamBase::Reference::START, nullptr));
+            }
+            while (request.transferred < request.size)
+            {
+                ULONG written = 0;
+                ThrowHrIfFailed(request.stream->Write(bytes + request.transferred, request.size - request.transferred, &written));
+                ThrowErrorIf(Error::FileWrite, (written == 0), "write failed");
+                request.transferred += written;
+            }
+        }
+        request.result = static_cast<HRESULT>(Error::OK);
+    }
+    catch (MSIX::Exception& e)
+    {
+        request.result = static_cast<HRESULT>(e.Code());
+    }
+    catch (...)
+    {
+        request.result = static_cast<HRESULT>(Error::Unexpected);
+    }
+
+    ThreadPoolIoScheduler::ThreadPoolIoScheduler(std::size_t threadCount) : m_maxThreads(std::max<std::size_t>(threadCount, 1))
+    {
+    }
+
+    ThreadPoolIoScheduler::~ThreadPoolIoScheduler()
+    {
+        Stop();
+    }
+
+    void ThreadPoolIoScheduler::Stop()
+    {
+        std::vector<std::thread> threads;
+        {   std::lock_guard<std::mutex> lock(m_lock);
+            m_stop = true;
+            m_changed.notify_all();
+            threads.swap(m_threads);
+        }
+        for (auto& thread : threads) { thread.join(); }
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_stop = false;
+    }
+
+    void ThreadPoolIoScheduler::Post(std::function<void()>&& task)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_tasks.push_back(std::move(task));
+        if ((m_idleThreads < m_tasks.size()) && (m_threads.size() < m_maxThreads))
+        {
+            m_threads.emplace_back([this]() { WorkerLoop(); });
+        }
+        m_changed.notify_one();
+    }
+
+    void ThreadPoolIoScheduler::WorkerLoop() noexcept
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        while (true)
+        {
+            m_idleThreads++;
+            m_changed.wait(lock, [this]() { return !m_tasks.empty() || m_stop; });
+            m_idleThreads--;
+            // Queued requests still run when the scheduler goes away, their batches are waited on.
+            if (m_tasks.empty()) { return; }
+            auto task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+    }
+}
@@ -3,13 +3,61 @@
 //  See LICENSE file in the project root for full license information.
 // 
 #include "Log.hpp"
-#include <sstream>
+#include "Exceptions.hpp"
+#include <atomic>
+#include <cstdint>
 
 namespace MSIX { namespace Global { namespace Log {
-static std::stringstream g_content;
 
-void Append(const std::string& comment) { ((!comment.empty()) ? g_content << '\n' : g_content) << comment; }
-std::string Text() { return g_content.str(); }
-void Clear() { g_content.str(""), g_content.clear(); }
+// Errors are raised from any thread, including the workers that unpack and validate packages, so the log is a
+// ring of entries that writers claim with an atomic counter and swap in, without a lock. An entry is owned by
+// whoever holds its pointer: the slot, the writer that just swapped it out or the reader that took it. Entries
+// of failures are shared with their exceptions, each slot holds a reference. Comments have no file.
+static std::atomic<Entry*> g_entries[LogCapacity];
+static std::atomic<std::uint64_t> g_next(0);
+
+static void Release(Entry* entry)
+{
+    if (entry && --entry->references == 0) { delete entry; }
+}
+
+static void Store(Entry* entry)
+{
+    auto slot = g_next++ % LogCapacity;
+    Release(g_entries[slot].exchange(entry));
+}
+
+void Append(const std::string& comment)
+{
+    if (comment.empty()) { return; }
+    Store(new Entry(nullptr, 0, comment.c_str()));
+}
+
+EntryRef Append(const char* file, int line, const char* details)
+{
+    auto entry = new Entry(file, line, details);
+    EntryRef result(entry);
+    entry->references++;
+    Store(entry);
+    return result;
+}
+
+std::string Take()
+{
+    std::string text;
+    auto end = g_next.load();
+    auto begin = (end > LogCapacity) ? end - LogCapacity : 0;
+    for (auto i = begin; i < end; i++)
+    {
+        auto entry = g_entries[i % LogCapacity].exchange(nullptr);
+        if (entry)
+        {
+            text += '\n';
+            text += (entry->file != nullptr) ? FormatErrorMessage(entry->file, entry->line, entry->details) : entry->details;
+            Release(entry);
+        }
+    }
+    return text;
+}
 
 } /* log */ } /* Global */ } /* msix */
\ No newline at end of file
@@ -0,0 +1,71 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "MappedFileStream.hpp"
+
+#include <map>
+#include <mutex>
+
+namespace MSIX {
+
+    namespace {
+        // The identity of a file is read without mapping it, so a file the process has mapped already isn't
+        // opened again on POSIX. Windows needs a handle to the file for its file number.
+        std::string GetIdentityOfPath(const std::string& name)
+        {
+            #ifdef WIN32
+            auto utf16Name = utf8_to_wstring(name);
+            HANDLE file = CreateFileW(utf16Name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+            {
+                return std::string();
+            }
+            auto identity = GetFileIdentity(file);
+            CloseHandle(file);
+            return identity;
+            #else
+            return GetFileIdentity(name);
+            #endif
+        }
+    }
+
+    std::shared_ptr<MappedFile> MappedFile::OpenShared(const std::string& name)
+    {
+        static std::mutex lock;
+        static std::map<std::string, std::weak_ptr<MappedFile>> files;
+
+        auto identity = GetIdentityOfPath(name);
+        if (!identity.empty())
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            auto found = files.find(identity);
+            if (found != files.end())
+            {
+                if (auto file = found->second.lock())
+                {
+                    return file;
+                }
+            }
+        }
+
+        // The file may have changed since, it is kept by the identity of what was mapped
+        auto file = std::make_shared<MappedFile>(name);
+        identity = file->GetIdentity();
+        if (!identity.empty())
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            for (auto entry = files.begin(); entry != files.end();)
+            {
+                entry = entry->second.expired() ? files.erase(entry) : std::next(entry);
+            }
+            auto& entry = files[identity];
+            if (auto existing = entry.lock())
+            {   // Mapped by another thread meanwhile
+                return existing;
+            }
+            entry = file;
+        }
+        return file;
+    }
+}
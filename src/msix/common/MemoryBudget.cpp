@@ -0,0 +1,42 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "MemoryBudget.hpp"
+#include "Exceptions.hpp"
+
+namespace MSIX {
+
+    std::uint64_t MemoryBudget::GetAvailable() const
+    {
+        std::uint64_t limit = m_limit;
+        if (limit == 0) { return std::numeric_limits<std::uint64_t>::max(); }
+        std::uint64_t current = m_current;
+        return (current < limit) ? (limit - current) : 0;
+    }
+
+    void MemoryBudget::Reserve(std::uint64_t bytes)
+    {
+        ThrowErrorIfNot(Error::OutOfMemory, TryReserve(bytes), "memory budget exceeded");
+    }
+
+    bool MemoryBudget::TryReserve(std::uint64_t bytes)
+    {
+        std::uint64_t limit = m_limit;
+        std::uint64_t current = m_current;
+        std::uint64_t updated = 0;
+        do
+        {
+            updated = current + bytes;
+            if ((limit != 0) && (updated > limit)) { return false; }
+        } while (!m_current.compare_exchange_weak(current, updated));
+        UpdatePeak(updated);
+        return true;
+    }
+
+    void MemoryBudget::UpdatePeak(std::uint64_t current)
+    {
+        std::uint64_t peak = m_peak;
+        while ((current > peak) && !m_peak.compare_exchange_weak(peak, current)) {}
+    }
+}
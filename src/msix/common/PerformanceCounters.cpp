@@ -0,0 +1,39 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "PerformanceCounters.hpp"
+
+namespace MSIX {
+
+    void PerformanceCounters::Add(MSIX_PERFORMANCE_COUNTER_STAGE stage, std::uint64_t bytes, std::chrono::steady_clock::duration duration)
+    {
+        auto& counter = m_counters[static_cast<std::size_t>(stage)];
+        counter.calls.fetch_add(1, std::memory_order_relaxed);
+        counter.bytes.fetch_add(bytes, std::memory_order_relaxed);
+        counter.nanoseconds.fetch_add(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()),
+            std::memory_order_relaxed);
+    }
+
+    void PerformanceCounters::Get(MSIX_PERFORMANCE_COUNTERS& counters, bool reset)
+    {
+        for (std::size_t stage = 0; stage < m_counters.size(); stage++)
+        {
+            auto& counter = m_counters[stage];
+            auto& result = counters.stages[stage];
+            // Each counter is read and reset at once, so nothing added meanwhile is lost.
+            if (reset)
+            {
+                result.calls = counter.calls.exchange(0, std::memory_order_relaxed);
+                result.bytes = counter.bytes.exchange(0, std::memory_order_relaxed);
+                result.nanoseconds = counter.nanoseconds.exchange(0, std::memory_order_relaxed);
+            }
+            else
+            {
+                result.calls = counter.calls.load(std::memory_order_relaxed);
+                result.bytes = counter.bytes.load(std::memory_order_relaxed);
+                result.nanoseconds = counter.nanoseconds.load(std::memory_order_relaxed);
+            }
+        }
+    }
+}
@@ -0,0 +1,49 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "ProgressReporter.hpp"
+#include "Exceptions.hpp"
+
+namespace MSIX {
+
+    void ProgressReporter::SetExtension(const ComPtr<IMsixProgressCallback>& callback)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_callback = callback;
+        m_enabled = (m_callback.Get() != nullptr);
+        m_cancelled = false;
+        m_bytesCompleted = m_bytesTotal = 0;
+        m_filesCompleted = m_filesTotal = 0;
+    }
+
+    ComPtr<IMsixProgressCallback> ProgressReporter::GetExtension()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_callback;
+    }
+
+    void ProgressReporter::AddWork(std::uint64_t bytes, std::uint32_t files)
+    {
+        if (!m_enabled) { return; }
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_bytesTotal += bytes;
+        m_filesTotal += files;
+    }
+
+    void ProgressReporter::Advance(std::uint64_t bytes, std::uint32_t files)
+    {
+        if (!m_enabled) { return; }
+        std::lock_guard<std::mutex> lock(m_lock);
+        // Workers still running after a cancel stop at their next block without bothering the callback
+        if (!m_cancelled)
+        {
+            m_bytesCompleted += bytes;
+            m_filesCompleted += files;
+            BOOL cancel = FALSE;
+            HRESULT hr = m_callback->OnProgress(m_bytesCompleted, m_bytesTotal, m_filesCompleted, m_filesTotal, &cancel);
+            m_cancelled = FAILED(hr) || cancel;
+        }
+        ThrowErrorIf(Error::Cancelled, m_cancelled, "The operation was cancelled");
+    }
+}
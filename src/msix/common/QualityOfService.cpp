@@ -0,0 +1,161 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "QualityOfService.hpp"
+
+#include <thread>
+
+#ifdef WIN32
+#include "MSIXWindows.hpp"
+#elif defined(__APPLE__)
+#include <sys/resource.h>
+#elif defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace MSIX {
+
+    namespace {
+
+        #if defined(__linux__) && defined(SYS_ioprio_set)
+        // From linux/ioprio.h, which not every libc ships
+        const int IoprioWhoProcess = 1;
+        const int IoprioClassShift = 13;
+        const int IoprioClassIdle = 3;
+        #endif
+
+        // Whether an AffinityScope pinned the current thread
+        thread_local bool currentThreadPinned = false;
+
+        #if defined(__linux__)
+        // The processors the process may run on. Only threads that aren't pinned ask for them, so the first one
+        // to ask still has them all.
+        const cpu_set_t& GetProcessProcessors()
+        {
+            static const cpu_set_t processors = []()
+            {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                if (sched_getaffinity(0, sizeof(set), &set) != 0) { CPU_ZERO(&set); }
+                return set;
+            }();
+            return processors;
+        }
+        #endif
+    }
+
+    void QualityOfService::Set(std::uint64_t maxBytesPerSecond, std::uint32_t maxWorkerCount, bool lowPriorityIo)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_maxBytesPerSecond = maxBytesPerSecond;
+        m_maxWorkerCount = maxWorkerCount;
+        m_lowPriorityIo = lowPriorityIo;
+        m_next = std::chrono::steady_clock::time_point();
+    }
+
+    void QualityOfService::Consume(std::uint64_t bytes)
+    {
+        std::uint64_t rate = m_maxBytesPerSecond;
+        if ((rate == 0) || (bytes == 0)) { return; }
+
+        auto now = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::duration wait;
+        {   std::lock_guard<std::mutex> lock(m_lock);
+            auto earliest = now - std::chrono::seconds(1);
+            if (m_next < earliest) { m_next = earliest; }
+            m_next += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(static_cast<double>(bytes) / static_cast<double>(rate)));
+            wait = m_next - now;
+        }
+        // Sleeping outside the lock lets the other workers take their share in the meantime
+        if (wait > std::chrono::steady_clock::duration::zero())
+        {
+            std::this_thread::sleep_for(wait);
+        }
+    }
+
+    // Linux: the idle I/O class of the thread, which gets the disk when nobody else uses it.
+    // macOS: the throttled I/O policy of the thread.
+    // Windows: the background mode of the thread, which lowers its I/O priority along with its scheduling priority.
+    QualityOfService::IoPriorityScope::IoPriorityScope(bool lower)
+    {
+        if (!lower) { return; }
+        #ifdef WIN32
+        m_lowered = (SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN) != FALSE);
+        #elif defined(__APPLE__)
+        m_previous = getiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_THREAD);
+        m_lowered = (m_previous != -1) && (setiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_THREAD, IOPOL_THROTTLE) == 0);
+        #elif defined(__linux__) && defined(SYS_ioprio_set)
+        m_previous = static_cast<int>(syscall(SYS_ioprio_get, IoprioWhoProcess, 0));
+        m_lowered = (m_previous != -1) &&
+            (syscall(SYS_ioprio_set, IoprioWhoProcess, 0, IoprioClassIdle << IoprioClassShift) == 0);
+        #endif
+    }
+
+    QualityOfService::IoPriorityScope::~IoPriorityScope()
+    {
+        if (!m_lowered) { return; }
+        #ifdef WIN32
+        SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_END);
+        #elif defined(__APPLE__)
+        setiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_THREAD, m_previous);
+        #elif defined(__linux__) && defined(SYS_ioprio_set)
+        syscall(SYS_ioprio_set, IoprioWhoProcess, 0, m_previous);
+        #endif
+    }
+
+    // Linux: the affinity of the thread, among the processors of the affinity of the process.
+    // Windows: the affinity mask of the thread, among the processors of the process in its processor group.
+    QualityOfService::AffinityScope::AffinityScope(bool pin, std::size_t index)
+    {
+        if (!pin || currentThreadPinned) { return; }
+        #ifdef WIN32
+        DWORD_PTR processMask = 0;
+        DWORD_PTR systemMask = 0;
+        if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask) || (processMask == 0)) { return; }
+        std::size_t count = 0;
+        for (DWORD_PTR mask = processMask; mask != 0; mask &= (mask - 1)) { count++; }
+        std::size_t skip = index % count;
+        DWORD_PTR mask = processMask;
+        for (; skip != 0; skip--) { mask &= (mask - 1); }
+        m_pinned = (SetThreadAffinityMask(GetCurrentThread(), mask & ~(mask - 1)) != 0);
+        #elif defined(__linux__)
+        const auto& processors = GetProcessProcessors();
+        auto count = static_cast<std::size_t>(CPU_COUNT(&processors));
+        if (count == 0) { return; }
+        std::size_t skip = index % count;
+        for (int processor = 0; processor < CPU_SETSIZE; processor++)
+        {
+            if (!CPU_ISSET(processor, &processors)) { continue; }
+            if (skip-- == 0)
+            {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(processor, &set);
+                m_pinned = (sched_setaffinity(0, sizeof(set), &set) == 0);
+                break;
+            }
+        }
+        #endif
+        currentThreadPinned = m_pinned;
+    }
+
+    QualityOfService::AffinityScope::~AffinityScope()
+    {
+        if (!m_pinned) { return; }
+        #ifdef WIN32
+        DWORD_PTR processMask = 0;
+        DWORD_PTR systemMask = 0;
+        if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+        {
+            SetThreadAffinityMask(GetCurrentThread(), processMask);
+        }
+        #elif defined(__linux__)
+        sched_setaffinity(0, sizeof(cpu_set_t), &GetProcessProcessors());
+        #endif
+        currentThreadPinned = false;
+    }
+}
@@ -2,13 +2,15 @@
 //  Copyright (C) 2017 Microsoft.  All rights reserved.
 //  See LICENSE file in the project root for full license information.
 // 
+#include <cstdint>
+#include <cstring>
 #include <memory>
 #include <iostream>
 #include <sstream>
 
-#ifdef WIN32
-#include <windows.h>
-#include <stringapiset.h>
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define MSIX_UNICODE_SSE2 1
+#include <emmintrin.h>
 #endif
 
 #include "UnicodeConversion.hpp"
@@ -16,56 +18,202 @@
 
 namespace MSIX {
 
+    namespace {
+
+    // Names and manifest strings are mostly ASCII. Runs of it are widened or narrowed 16 bytes at a time with
+    // SSE2, which every x86 processor that runs the SDK has, and 8 bytes at a time elsewhere. Anything else goes
+    // a code point at a time.
+    template <typename CharT>
+    std::size_t Utf8ToUtf16(const char* utf8, std::size_t size, CharT* utf16)
+    {
+        auto src = reinterpret_cast<const std::uint8_t*>(utf8);
+        auto end = src + size;
+        auto dst = utf16;
+        while (src < end)
+        {
+            #ifdef MSIX_UNICODE_SSE2
+            if (sizeof(CharT) == 2)
+            {
+                const __m128i zero = _mm_setzero_si128();
+                while ((end - src) >= 16)
+                {
+                    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+                    if (_mm_movemask_epi8(bytes) != 0) { break; }
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi8(bytes, zero));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 8), _mm_unpackhi_epi8(bytes, zero));
+                    src += 16;
+                    dst += 16;
+                }
+            }
+            #endif
+            while ((end - src) >= 8)
+            {
+                std::uint64_t word;
+                std::memcpy(&word, src, sizeof(word));
+                if ((word & 0x8080808080808080ull) != 0) { break; }
+                for (std::size_t i = 0; i < 8; i++) { dst[i] = static_cast<CharT>(src[i]); }
+                src += 8;
+                dst += 8;
+            }
+            if (src == end) { break; }
+
+            std::uint8_t lead = *src;
+            if (lead < 0x80)
+            {
+                *dst++ = static_cast<CharT>(lead);
+                src++;
+                continue;
+            }
+            std::uint32_t codePoint = 0;
+            std::uint32_t minimum = 0;
+            std::size_t length = 0;
+            if ((lead & 0xE0) == 0xC0)      { codePoint = lead & 0x1F; minimum = 0x80;    length = 2; }
+            else if ((lead & 0xF0) == 0xE0) { codePoint = lead & 0x0F; minimum = 0x800;   length = 3; }
+            else if ((lead & 0xF8) == 0xF0) { codePoint = lead & 0x07; minimum = 0x10000; length = 4; }
+            else { ThrowErrorAndLog(Error::Unexpected, "Invalid UTF-8 lead byte"); }
+            ThrowErrorIf(Error::Unexpected, (static_cast<std::size_t>(end - src) < length), "Truncated UTF-8 sequence");
+            for (std::size_t i = 1; i < length; i++)
+            {
+                ThrowErrorIf(Error::Unexpected, ((src[i] & 0xC0) != 0x80), "Invalid UTF-8 continuation byte");
+                codePoint = (codePoint << 6) | (src[i] & 0x3F);
+            }
+            // Overlong forms, surrogates and values past the last code point don't have a utf16 form
+            ThrowErrorIf(Error::Unexpected, ((codePoint < minimum) || (codePoint > 0x10FFFF) || ((codePoint >= 0xD800) && (codePoint <= 0xDFFF))),
+                "Invalid UTF-8 code point");
+            src += length;
+            if (codePoint >= 0x10000)
+            {
+                codePoint -= 0x10000;
+                *dst++ = static_cast<CharT>(0xD800 + (codePoint >> 10));
+                *dst++ = static_cast<CharT>(0xDC00 + (codePoint & 0x3FF));
+            }
+            else
+            {
+                *dst++ = static_cast<CharT>(codePoint);
+            }
+        }
+        return static_cast<std::size_t>(dst - utf16);
+    }
+
+    // A wchar_t of 32 bits can also hold a code point past the basic plane instead of a surrogate pair.
+    template <typename CharT>
+    std::size_t Utf16ToUtf8(const CharT* utf16, std::size_t size, char* utf8)
+    {
+        auto src = utf16;
+        auto end = utf16 + size;
+        auto dst = reinterpret_cast<std::uint8_t*>(utf8);
+        while (src < end)
+        {
+            #ifdef MSIX_UNICODE_SSE2
+            if (sizeof(CharT) == 2)
+            {
+                const __m128i nonAscii = _mm_set1_epi16(static_cast<short>(0xFF80));
+                const __m128i zero = _mm_setzero_si128();
+                while ((end - src) >= 16)
+                {
+                    __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+                    __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 8));
+                    __m128i bits = _mm_and_si128(_mm_or_si128(low, high), nonAscii);
+                    if (_mm_movemask_epi8(_mm_cmpeq_epi16(bits, zero)) != 0xFFFF) { break; }
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_packus_epi16(low, high));
+                    src += 16;
+                    dst += 16;
+                }
+            }
+            #endif
+            while (((end - src) >= 4) && ((static_cast<std::uint32_t>(src[0]) | static_cast<std::uint32_t>(src[1]) |
+                static_cast<std::uint32_t>(src[2]) | static_cast<std::uint32_t>(src[3])) < 0x80))
+            {
+                for (std::size_t i = 0; i < 4; i++) { dst[i] = static_cast<std::uint8_t>(src[i]); }
+                src += 4;
+                dst += 4;
+            }
+            if (src == end) { break; }
+
+            auto codePoint = static_cast<std::uint32_t>(*src++);
+            if (codePoint < 0x80)
+            {
+                *dst++ = static_cast<std::uint8_t>(codePoint);
+                continue;
+            }
+            if ((codePoint >= 0xD800) && (codePoint <= 0xDBFF))
+            {
+                ThrowErrorIf(Error::Unexpected, (src == end), "Truncated UTF-16 surrogate pair");
+                auto trail = static_cast<std::uint32_t>(*src++);
+                ThrowErrorIf(Error::Unexpected, ((trail < 0xDC00) || (trail > 0xDFFF)), "Invalid UTF-16 surrogate pair");
+                codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (trail - 0xDC00);
+            }
+            else
+            {
+                ThrowErrorIf(Error::Unexpected, (((codePoint >= 0xDC00) && (codePoint <= 0xDFFF)) || (codePoint > 0x10FFFF)),
+                    "Invalid UTF-16 code unit");
+            }
+            if (codePoint < 0x800)
+            {
+                *dst++ = static_cast<std::uint8_t>(0xC0 | (codePoint >> 6));
+            }
+            else if (codePoint < 0x10000)
+            {
+                *dst++ = static_cast<std::uint8_t>(0xE0 | (codePoint >> 12));
+                *dst++ = static_cast<std::uint8_t>(0x80 | ((codePoint >> 6) & 0x3F));
+            }
+            else
+            {
+                *dst++ = static_cast<std::uint8_t>(0xF0 | (codePoint >> 18));
+                *dst++ = static_cast<std::uint8_t>(0x80 | ((codePoint >> 12) & 0x3F));
+                *dst++ = static_cast<std::uint8_t>(0x80 | ((codePoint >> 6) & 0x3F));
+            }
+            *dst++ = static_cast<std::uint8_t>(0x80 | (codePoint & 0x3F));
+        }
+        return static_cast<std::size_t>(dst - reinterpret_cast<std::uint8_t*>(utf8));
+    }
+
+    template <typename StringT>
+    StringT ToUtf16(const std::string& utf8string)
+    {
+        StringT result(utf8string.size(), 0);
+        result.resize(Utf8ToUtf16(utf8string.data(), utf8string.size(), &result[0]));
+        return result;
+    }
+
+    template <typename StringT>
+    std::string ToUtf8(const StringT& utf16string)
+    {
+        std::string result(utf16string.size() * ((sizeof(typename StringT::value_type) > 2) ? 4 : 3), 0);
+        result.resize(Utf16ToUtf8(utf16string.data(), utf16string.size(), &result[0]));
+        return result;
+    }
+
+    }
+
+    std::size_t utf8_to_utf16(const char* utf8, std::size_t size, char16_t* utf16) { return Utf8ToUtf16(utf8, size, utf16); }
+    std::size_t utf8_to_utf16(const char* utf8, std::size_t size, wchar_t* utf16) { return Utf8ToUtf16(utf8, size, utf16); }
+    std::size_t utf16_to_utf8(const char16_t* utf16, std::size_t size, char* utf8) { return Utf16ToUtf8(utf16, size, utf8); }
+    std::size_t utf16_to_utf8(const wchar_t* utf16, std::size_t size, char* utf8) { return Utf16ToUtf8(utf16, size, utf8); }
+
     StringType utf8_to_utf16(const std::string& utf8string)
     {
-        return StringConvert{}.from_bytes(utf8string.data());
+        return ToUtf16<StringType>(utf8string);
     }
 
     std::wstring utf8_to_wstring(const std::string& utf8string)
     {
-        if (utf8string.empty()) { return {}; }
-        #ifdef WIN32
-        int size = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, utf8string.data(), static_cast<int>(utf8string.size()), nullptr, 0);
-        ThrowLastErrorIf(size == 0, "Error converting to wstring");
-        std::wstring result(size, 0);
-        MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, utf8string.data(), static_cast<int>(utf8string.size()), &result[0], size);
-        #else
-        auto converted = utf8_to_utf16(utf8string);
-        std::wstring result(converted.begin(), converted.end());
-        #endif
-        return result;
+        return ToUtf16<std::wstring>(utf8string);
     }
 
     std::u16string utf8_to_u16string(const std::string& utf8string)
     {
-        auto converted = utf8_to_utf16(utf8string);
-        std::u16string result(converted.begin(), converted.end());
-        return result;
+        return ToUtf16<std::u16string>(utf8string);
     }
 
     std::string wstring_to_utf8(const std::wstring& utf16string)
     {
-        if (utf16string.empty()) { return {}; }
-        #ifdef WIN32
-        int size = WideCharToMultiByte(CP_UTF8, WC_ERR_INVALID_CHARS, utf16string.data(), static_cast<int>(utf16string.size()), nullptr, 0, nullptr, nullptr);
-        ThrowLastErrorIf(size == 0, "Error converting to string");
-        std::string result(size, 0);
-        WideCharToMultiByte(CP_UTF8, WC_ERR_INVALID_CHARS, utf16string.data(), static_cast<int>(utf16string.size()), &result[0], size, nullptr, nullptr);
-        #else
-        auto result = std::wstring_convert<std::codecvt_utf8<wchar_t>>{}.to_bytes(utf16string.data());
-        #endif
-        return result;
+        return ToUtf8(utf16string);
     }
 
     std::string u16string_to_utf8(const std::u16string& utf16string)
     {
-        #ifdef WIN32
-        std::wstring intermediate(utf16string.begin(), utf16string.end());
-        auto result = wstring_to_utf8(intermediate);
-        #else
-        auto result = StringConvert{}.to_bytes(utf16string.data());
-        #endif
-        return result;
+        return ToUtf8(utf16string);
     }
 
-} // namespace MSIX
\ No newline at end of file
+} // namespace MSIX
@@ -0,0 +1,341 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "WorkerPool.hpp"
+#include "Exceptions.hpp"
+
+#include <algorithm>
+
+namespace MSIX {
+
+    namespace {
+
+        // The work-stealing executor and worker index of the current thread, if it is one of its threads.
+        thread_local WorkStealingExecutor* currentExecutor = nullptr;
+        thread_local std::size_t currentWorker = 0;
+
+        // Never destroyed. Its destructor would join the threads when the process exits, after they are gone,
+        // or while the library is unloaded, when they can't exit. MsixShutdownThreads stops them instead.
+        std::shared_ptr<WorkStealingExecutor>& GetSharedExecutor()
+        {
+            static auto executor = new std::shared_ptr<WorkStealingExecutor>(
+                std::make_shared<WorkStealingExecutor>(std::max(std::thread::hardware_concurrency(), 1u)));
+            return *executor;
+        }
+
+        class MsixTask final : public ComClass<MsixTask, IMsixTask>
+        {
+        public:
+            MsixTask(const std::shared_ptr<PoolTask>& task) : m_task(task) {}
+
+            void STDMETHODCALLTYPE Run() noexcept override
+            {
+                m_task->TryRun();
+            }
+
+        protected:
+            std::shared_ptr<PoolTask> m_task;
+        };
+    }
+
+    void PoolTask::TryRun() noexcept
+    {
+        {   std::lock_guard<std::mutex> lock(m_lock);
+            if (m_state != State::Queued) { return; }
+            m_state = State::Running;
+        }
+        std::exception_ptr failure;
+        try
+        {
+            m_work();
+        }
+        catch (...)
+        {
+            failure = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_work = nullptr;
+        m_failure = failure;
+        m_state = State::Done;
+        m_done.notify_all();
+    }
+
+    void PoolTask::Wait()
+    {
+        TryRun();
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_done.wait(lock, [this]() { return m_state == State::Done; });
+        if (m_failure) { std::rethrow_exception(m_failure); }
+    }
+
+    WorkStealingExecutor::WorkStealingExecutor(std::size_t threadCount) : m_threadCount(std::max<std::size_t>(threadCount, 1)), m_started(false), m_queued(0)
+    {
+        for (std::size_t i = 0; i < m_threadCount; i++)
+        {
+            m_workers.push_back(std::unique_ptr<Worker>(new Worker()));
+        }
+    }
+
+    WorkStealingExecutor::~WorkStealingExecutor()
+    {
+        Stop();
+    }
+
+    // The threads start with the first task, processes that never run parallel work don't have them.
+    void WorkStealingExecutor::Start()
+    {
+        if (m_started) { return; }
+        std::lock_guard<std::mutex> lock(m_startLock);
+        if (m_started) { return; }
+        for (std::size_t i = 0; i < m_threadCount; i++)
+        {
+            m_threads.emplace_back([this, i]() { WorkerLoop(i); });
+        }
+        m_started = true;
+    }
+
+    void WorkStealingExecutor::Stop()
+    {
+        std::lock_guard<std::mutex> startLock(m_startLock);
+        {   std::lock_guard<std::mutex> lock(m_sleepLock);
+            m_stop = true;
+            m_wake.notify_all();
+        }
+        for (auto& thread : m_threads) { thread.join(); }
+        m_threads.clear();
+        std::lock_guard<std::mutex> lock(m_sleepLock);
+        m_stop = false;
+        m_started = false;
+    }
+
+    bool WorkStealingExecutor::Post(const std::shared_ptr<PoolTask>& task)
+    {
+        Start();
+        if (currentExecutor == this)
+        {
+            auto& worker = *m_workers[currentWorker];
+            std::lock_guard<std::mutex> lock(worker.lock);
+            worker.tasks.push_back(task);
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock(m_sharedLock);
+            m_shared.push_back(task);
+        }
+        m_queued++;
+        std::lock_guard<std::mutex> lock(m_sleepLock);
+        m_wake.notify_one();
+        return true;
+    }
+
+    std::shared_ptr<PoolTask> WorkStealingExecutor::Take(std::size_t index)
+    {
+        std::shared_ptr<PoolTask> task;
+        {   auto& own = *m_workers[index];
+            std::lock_guard<std::mutex> lock(own.lock);
+            if (!own.tasks.empty())
+            {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return task;
+            }
+        }
+        {   std::lock_guard<std::mutex> lock(m_sharedLock);
+            if (!m_shared.empty())
+            {
+                task = std::move(m_shared.front());
+                m_shared.pop_front();
+                return task;
+            }
+        }
+        for (std::size_t offset = 1; offset < m_threadCount; offset++)
+        {
+            auto& victim = *m_workers[(index + offset) % m_threadCount];
+            std::lock_guard<std::mutex> lock(victim.lock);
+            if (!victim.tasks.empty())
+            {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return task;
+            }
+        }
+        return task;
+    }
+
+    void WorkStealingExecutor::WorkerLoop(std::size_t index) noexcept
+    {
+        currentExecutor = this;
+        currentWorker = index;
+        while (true)
+        {
+            auto task = Take(index);
+            if (task)
+            {
+                m_queued--;
+                task->TryRun();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(m_sleepLock);
+            m_wake.wait(lock, [this]() { return (m_queued != 0) || m_stop; });
+            if (m_stop) { return; }
+        }
+    }
+
+    HostTaskExecutor::HostTaskExecutor(const ComPtr<IMsixTaskScheduler>& scheduler) : m_scheduler(scheduler)
+    {
+        UINT32 concurrency = 0;
+        ThrowHrIfFailed(m_scheduler->GetConcurrency(&concurrency));
+        m_concurrency = std::max<std::size_t>(concurrency, 1);
+    }
+
+    bool HostTaskExecutor::Post(const std::shared_ptr<PoolTask>& task)
+    {   // A task the host can't take runs when it is waited on.
+        auto msixTask = ComPtr<IMsixTask>::Make<MsixTask>(task);
+        return SUCCEEDED(m_scheduler->Schedule(msixTask.Get()));
+    }
+
+    WorkerPool::WorkerPool(const std::shared_ptr<QualityOfService>& qualityOfService) : m_qualityOfService(qualityOfService)
+    {
+        m_executor = GetSharedExecutor();
+    }
+
+    void WorkerPool::SetExtension(const ComPtr<IMsixTaskScheduler>& scheduler)
+    {
+        auto executor = std::make_shared<HostTaskExecutor>(scheduler);
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_executor = std::move(executor);
+        m_extension = scheduler;
+    }
+
+    ComPtr<IMsixTaskScheduler> WorkerPool::GetExtension()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_extension;
+    }
+
+    std::shared_ptr<TaskExecutor> WorkerPool::GetExecutor()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_executor;
+    }
+
+    std::size_t WorkerPool::GetConcurrency()
+    {
+        return GetExecutor()->GetConcurrency();
+    }
+
+    std::size_t WorkerPool::GetWorkerCount(std::uint32_t threadCount)
+    {
+        std::size_t workerCount = (threadCount != 0) ? threadCount : GetConcurrency();
+        std::size_t maxWorkerCount = m_qualityOfService ? m_qualityOfService->GetMaxWorkerCount() : 0;
+        return (maxWorkerCount != 0) ? std::min(workerCount, maxWorkerCount) : workerCount;
+    }
+
+    std::function<void()> WorkerPool::WithQualityOfService(std::function<void()>&& work)
+    {
+        bool lowPriorityIo = m_qualityOfService && m_qualityOfService->IsLowPriorityIo();
+        bool pinnedWorkers = m_qualityOfService && m_qualityOfService->IsPinnedWorkers();
+        if (!lowPriorityIo && !pinnedWorkers) { return std::move(work); }
+        return [work = std::move(work), lowPriorityIo, pinnedWorkers]()
+        {
+            QualityOfService::IoPriorityScope priority(lowPriorityIo);
+            // Only the threads of the work-stealing executor are pinned, by their index
+            QualityOfService::AffinityScope affinity(pinnedWorkers && (currentExecutor != nullptr), currentWorker);
+            work();
+        };
+    }
+
+    std::shared_ptr<PoolTask> WorkerPool::Async(std::function<void()>&& work)
+    {
+        auto task = std::make_shared<PoolTask>(WithQualityOfService(std::move(work)));
+        GetExecutor()->Post(task);
+        return task;
+    }
+
+    void WorkerPool::Detach(std::function<void()>&& work)
+    {
+        auto task = std::make_shared<PoolTask>(WithQualityOfService(std::move(work)));
+        ThrowErrorIfNot(Error::Unexpected, GetExecutor()->Post(task), "The task scheduler didn't take the task");
+    }
+
+    void WorkerPool::ForEach(std::size_t count, std::size_t workerCount, const std::function<void(std::size_t)>& action)
+    {
+        workerCount = std::min(workerCount, count);
+        std::size_t maxWorkerCount = m_qualityOfService ? m_qualityOfService->GetMaxWorkerCount() : 0;
+        if (maxWorkerCount != 0) { workerCount = std::min(workerCount, maxWorkerCount); }
+        bool lowPriorityIo = m_qualityOfService && m_qualityOfService->IsLowPriorityIo();
+        bool pinnedWorkers = m_qualityOfService && m_qualityOfService->IsPinnedWorkers();
+        if (workerCount <= 1)
+        {
+            QualityOfService::IoPriorityScope priority(lowPriorityIo);
+            for (std::size_t index = 0; index < count; index++) { action(index); }
+            return;
+        }
+
+        std::atomic<std::size_t> next(0);
+        std::atomic<bool> failed(false);
+        auto worker = [&]()
+        {
+            QualityOfService::IoPriorityScope priority(lowPriorityIo);
+            QualityOfService::AffinityScope affinity(pinnedWorkers && (currentExecutor != nullptr), currentWorker);
+            try
+            {
+                std::size_t index = 0;
+                while (!failed && (index = next++) < count)
+                {
+                    action(index);
+                }
+            }
+            catch (...)
+            {
+                failed = true;
+                throw;
+            }
+        };
+
+        // Helpers that start after every index is taken return right away, the ones that never started run
+        // here when they are waited on and return right away too.
+        auto executor = GetExecutor();
+        std::vector<std::shared_ptr<PoolTask>> helpers;
+        std::exception_ptr error;
+        try
+        {
+            for (std::size_t i = 1; i < workerCount; i++)
+            {
+                auto helper = std::make_shared<PoolTask>(worker);
+                helpers.push_back(helper);
+                executor->Post(helper);
+            }
+            worker();
+        }
+        catch (...)
+        {
+            failed = true;
+            error = std::current_exception();
+        }
+        for (auto& helper : helpers)
+        {
+            try
+            {
+                helper->Wait();
+            }
+            catch (...)
+            {
+                if (!error) { error = std::current_exception(); }
+            }
+        }
+        if (error) { std::rethrow_exception(error); }
+    }
+
+    std::shared_ptr<WorkerPool> WorkerPool::GetDefault()
+    {
+        static auto pool = std::make_shared<WorkerPool>();
+        return pool;
+    }
+
+    void WorkerPool::StopDefault()
+    {
+        GetSharedExecutor()->Stop();
+    }
+}
@@ -7,6 +7,7 @@
 #include "ObjectBase.hpp"
 #include "ComHelper.hpp"
 #include "ZipObject.hpp"
+#include "ZipObjectReader.hpp"
 #include "VectorStream.hpp"
 #include "MsixFeatureSelector.hpp"
 
@@ -15,6 +16,7 @@
 #include <limits>
 #include <functional>
 #include <algorithm>
+#include <cstring>
 namespace MSIX {
 /* Zip File Structure
 [LocalFileHeader 1]
@@ -174,46 +176,27 @@ void CentralDirectoryFileHeader::SetData(const std::string& name, std::uint32_t
 void CentralDirectoryFileHeader::Read(const ComPtr<IStream>& stream, bool isZip64)
 {
     m_isZip64 = isZip64;
-    StreamBase::Read(stream, &Field<0>());
+    ULARGE_INTEGER pos = {0};
+    ThrowHrIfFailed(stream->Seek({0}, StreamBase::Reference::CURRENT, &pos));
+    ReadFixedFields(stream);
+    pos.QuadPart += FixedSize;
     Meta::ExactValueValidation<std::uint32_t>(Field<0>(), static_cast<std::uint32_t>(Signatures::CentralFileHeader));
 
-    StreamBase::Read(stream, &Field<1>());
-    StreamBase::Read(stream, &Field<2>());
-
-    StreamBase::Read(stream, &Field<3>());
     ThrowErrorIfNot(Error::ZipCentralDirectoryHeader,
         0 == (Field<3>().get() & static_cast<std::uint16_t>(UnsupportedFlagsMask)),
         "unsupported flag(s) specified");
 
-    StreamBase::Read(stream, &Field<4>());
     Meta::OnlyEitherValueValidation<std::uint16_t>(Field<4>(),  static_cast<std::uint16_t>(CompressionType::Deflate),
         static_cast<std::uint16_t>(CompressionType::Store));
 
-    StreamBase::Read(stream, &Field<5>());
-    StreamBase::Read(stream, &Field<6>());
-    StreamBase::Read(stream, &Field<7>());
-    StreamBase::Read(stream, &Field<8>());
-    StreamBase::Read(stream, &Field<9>());
-
-    StreamBase::Read(stream, &Field<10>());
     ThrowErrorIfNot(Error::ZipCentralDirectoryHeader, (Field<10>().get() != 0), "unsupported file name size");
     if (Field<10>().get() != 0) {Field<17>().get().resize(Field<10>().get(), 0); }
 
-    StreamBase::Read(stream, &Field<11>());
     if (Field<11>().get() != 0) { Field<18>().get().resize(Field<11>().get(), 0); }
 
-    StreamBase::Read(stream, &Field<12>());
     Meta::ExactValueValidation<std::uint32_t>(Field<12>(), 0);
-
-    StreamBase::Read(stream, &Field<13>());
     Meta::ExactValueValidation<std::uint32_t>(Field<13>(), 0);
 
-    StreamBase::Read(stream, &Field<14>());
-
-    StreamBase::Read(stream, &Field<15>());
-    StreamBase::Read(stream, &Field<16>());
-    ULARGE_INTEGER pos = {0};
-    ThrowHrIfFailed(stream->Seek({0}, StreamBase::Reference::CURRENT, &pos));
     if (!m_isZip64 || !IsValueInExtendedInfo(Field<16>()))
     {
         ThrowErrorIf(Error::ZipCentralDirectoryHeader, (Field<16>().get() >= pos.QuadPart), "invalid relative header offset");
@@ -243,6 +226,146 @@ void CentralDirectoryFileHeader::Read(const ComPtr<IStream>& stream, bool isZip6
     }
 }
 
+//////////////////////////////////////////////////////////////////////////////////////////////
+//                                  CentralDirectoryIndex                                   //
+//////////////////////////////////////////////////////////////////////////////////////////////
+// Size of the fixed part of a central directory file header
+constexpr static const std::size_t CentralDirectoryFileHeaderSize = 46;
+
+// Fields are in the same byte order StreamBase::Read expects.
+template <typename T>
+static T GetValue(const std::vector<std::uint8_t>& buffer, std::size_t offset, std::size_t end = std::numeric_limits<std::size_t>::max())
+{
+    ThrowErrorIf(Error::FileRead, (offset + sizeof(T) > std::min(end, buffer.size())), "Entire object wasn't read!");
+    T value;
+    std::memcpy(&value, buffer.data() + offset, sizeof(T));
+    return value;
+}
+
+std::pair<std::size_t, std::size_t> CentralDirectoryIndex::GetHeaderRange(const Entry& entry) const noexcept
+{
+    return std::make_pair(entry.nameOffset - CentralDirectoryFileHeaderSize,
+        CentralDirectoryFileHeaderSize + entry.nameLength + entry.extraLength);
+}
+
+std::size_t CentralDirectoryIndex::Parse(std::vector<std::uint8_t>&& buffer, std::uint64_t startOfCD, std::uint64_t totalNumberOfEntries, bool isZip64)
+{
+    m_buffer = std::move(buffer);
+    m_entries.clear();
+    // Every entry needs at least its fixed size, this also stops bogus entry counts from reserving too much
+    m_entries.reserve(static_cast<std::size_t>(std::min<std::uint64_t>(totalNumberOfEntries, m_buffer.size() / CentralDirectoryFileHeaderSize)));
+
+    std::size_t offset = 0;
+    for (std::uint64_t index = 0; index < totalNumberOfEntries; index++)
+    {
+        auto header = offset;
+        Meta::ExactValueValidation<std::uint32_t>(GetValue<std::uint32_t>(m_buffer, header), static_cast<std::uint32_t>(Signatures::CentralFileHeader));
+
+        auto flags = GetValue<std::uint16_t>(m_buffer, header + 8);
+        ThrowErrorIfNot(Error::ZipCentralDirectoryHeader,
+            0 == (flags & static_cast<std::uint16_t>(UnsupportedFlagsMask)),
+            "unsupported flag(s) specified");
+
+        auto compressionMethod = GetValue<std::uint16_t>(m_buffer, header + 10);
+        Meta::OnlyEitherValueValidation<std::uint16_t>(compressionMethod, static_cast<std::uint16_t>(CompressionType::Deflate),
+            static_cast<std::uint16_t>(CompressionType::Store));
+
+        auto compressedSize = GetValue<std::uint32_t>(m_buffer, header + 20);
+        auto uncompressedSize = GetValue<std::uint32_t>(m_buffer, header + 24);
+
+        auto nameLength = GetValue<std::uint16_t>(m_buffer, header + 28);
+        ThrowErrorIfNot(Error::ZipCentralDirectoryHeader, (nameLength != 0), "unsupported file name size");
+        auto extraLength = GetValue<std::uint16_t>(m_buffer, header + 30);
+        Meta::ExactValueValidation<std::uint32_t>(GetValue<std::uint16_t>(m_buffer, header + 32), 0); // file comment length
+        Meta::ExactValueValidation<std::uint32_t>(GetValue<std::uint16_t>(m_buffer, header + 34), 0); // disk number start
+
+        auto relativeOffset = GetValue<std::uint32_t>(m_buffer, header + 42);
+        if (!isZip64 || !IsValueInExtendedInfo(relativeOffset))
+        {
+            ThrowErrorIf(Error::ZipCentralDirectoryHeader, (relativeOffset >= startOfCD + header + CentralDirectoryFileHeaderSize),
+                "invalid relative header offset");
+        }
+
+        auto nameOffset = header + CentralDirectoryFileHeaderSize;
+        auto extraOffset = nameOffset + nameLength;
+        offset = extraOffset + extraLength;
+        ThrowErrorIf(Error::FileRead, (offset > m_buffer.size()), "Entire object wasn't read!");
+
+        Entry entry;
+        entry.nameOffset = nameOffset;
+        entry.nameLength = nameLength;
+        entry.extraLength = extraLength;
+        entry.compressionMethod = static_cast<CompressionType>(compressionMethod);
+        entry.hasDataDescriptor = (static_cast<GeneralPurposeBitFlags>(flags) & GeneralPurposeBitFlags::DataDescriptor) == GeneralPurposeBitFlags::DataDescriptor;
+        entry.compressedSize = IsValueInExtendedInfo(compressedSize) ? 0 : compressedSize;
+        entry.uncompressedSize = IsValueInExtendedInfo(uncompressedSize) ? 0 : uncompressedSize;
+        entry.relativeOffsetOfLocalHeader = IsValueInExtendedInfo(relativeOffset) ? 0 : relativeOffset;
+
+        // Only process for Zip64ExtendedInformation. See Zip64ExtendedInformation::Read
+        if (extraLength > 2 && m_buffer[extraOffset] == 0x01 && m_buffer[extraOffset + 1] == 0x00)
+        {
+            ThrowErrorIf(Error::FileRead, (extraLength < 4), "Entire object wasn't read!");
+            Meta::ExactValueValidation<std::uint32_t>(GetValue<std::uint16_t>(m_buffer, extraOffset + 2), static_cast<std::uint32_t>(extraLength - 4));
+            // Values can't be read past the end of the extra field
+            std::size_t field = extraOffset + 4;
+            if (IsValueInExtendedInfo(uncompressedSize))
+            {
+                entry.uncompressedSize = GetValue<std::uint64_t>(m_buffer, field, offset);
+                field += sizeof(std::uint64_t);
+            }
+            if (IsValueInExtendedInfo(compressedSize))
+            {
+                entry.compressedSize = GetValue<std::uint64_t>(m_buffer, field, offset);
+                field += sizeof(std::uint64_t);
+            }
+            if (IsValueInExtendedInfo(relativeOffset))
+            {
+                entry.relativeOffsetOfLocalHeader = GetValue<std::uint64_t>(m_buffer, field, offset);
+                ThrowErrorIfNot(Error::ZipBadExtendedData, entry.relativeOffsetOfLocalHeader < startOfCD + offset, "invalid relative header offset");
+            }
+        }
+        m_entries.push_back(entry);
+    }
+
+    // Keep the first entry if a name is repeated
+    std::stable_sort(m_entries.begin(), m_entries.end(), [this](const Entry& left, const Entry& right)
+    {
+        return IsLess(left, reinterpret_cast<const char*>(m_buffer.data() + right.nameOffset), right.nameLength);
+    });
+    auto last = std::unique(m_entries.begin(), m_entries.end(), [this](const Entry& left, const Entry& right)
+    {
+        return (left.nameLength == right.nameLength) &&
+            (std::memcmp(m_buffer.data() + left.nameOffset, m_buffer.data() + right.nameOffset, left.nameLength) == 0);
+    });
+    m_entries.erase(last, m_entries.end());
+    return offset;
+}
+
+// Same order as std::string
+bool CentralDirectoryIndex::IsLess(const Entry& left, const char* right, std::size_t rightLength) const noexcept
+{
+    auto result = std::memcmp(m_buffer.data() + left.nameOffset, right, std::min<std::size_t>(left.nameLength, rightLength));
+    return (result < 0) || ((result == 0) && (left.nameLength < rightLength));
+}
+
+const CentralDirectoryIndex::Entry* CentralDirectoryIndex::Find(const std::string& fileName) const
+{
+    auto result = std::lower_bound(m_entries.begin(), m_entries.end(), fileName, [this](const Entry& entry, const std::string& name)
+    {
+        return IsLess(entry, name.data(), name.size());
+    });
+    if ((result == m_entries.end()) || (GetFileName(*result) != fileName))
+    {
+        return nullptr;
+    }
+    return &(*result);
+}
+
+std::string CentralDirectoryIndex::GetFileName(const Entry& entry) const
+{
+    return std::string(reinterpret_cast<const char*>(m_buffer.data() + entry.nameOffset), entry.nameLength);
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////
 //                                  LocalFileHeader                                         //
 //////////////////////////////////////////////////////////////////////////////////////////////
@@ -277,50 +400,29 @@ void LocalFileHeader::SetData(std::uint32_t crc, std::uint64_t compressedSize, s
     SetUncompressedSize(static_cast<uint32_t>(uncompressedSize));
 }
 
-void LocalFileHeader::Read(const ComPtr<IStream> &stream, CentralDirectoryFileHeader& directoryEntry)
+void LocalFileHeader::Read(const ComPtr<IStream> &stream, bool directoryHasDataDescriptor)
 {
-    StreamBase::Read(stream, &Field<0>());
+    ReadFixedFields(stream);
     Meta::ExactValueValidation<std::uint32_t>(Field<0>(), static_cast<std::uint32_t>(Signatures::LocalFileHeader));
 
-    StreamBase::Read(stream, &Field<1>());
     Meta::OnlyEitherValueValidation<std::uint16_t>(Field<1>(), static_cast<std::uint16_t>(ZipVersions::Zip32DefaultVersion),
                                               static_cast<std::uint16_t>(ZipVersions::Zip64FormatExtension));
 
-    StreamBase::Read(stream, &Field<2>());
     ThrowErrorIfNot(Error::ZipLocalFileHeader, ((Field<2>().get() & static_cast<std::uint16_t>(UnsupportedFlagsMask)) == 0), "unsupported flag(s) specified");
-    ThrowErrorIfNot(Error::ZipLocalFileHeader, (IsGeneralPurposeBitSet() == directoryEntry.IsGeneralPurposeBitSet()), "inconsistent general purpose bits specified");
+    ThrowErrorIfNot(Error::ZipLocalFileHeader, (IsGeneralPurposeBitSet() == directoryHasDataDescriptor), "inconsistent general purpose bits specified");
 
-    StreamBase::Read(stream, &Field<3>());
     Meta::OnlyEitherValueValidation<std::uint16_t>(Field<3>(), static_cast<std::uint16_t>(CompressionType::Deflate),
                                               static_cast<std::uint16_t>(CompressionType::Store));
 
-    StreamBase::Read(stream, &Field<4>());
-    StreamBase::Read(stream, &Field<5>());
-    StreamBase::Read(stream, &Field<6>());
     ThrowErrorIfNot(Error::ZipLocalFileHeader, (!IsGeneralPurposeBitSet() || (Field<6>().get() == 0)), "Invalid Zip CRC");
-
-    StreamBase::Read(stream, &Field<7>());
     ThrowErrorIfNot(Error::ZipLocalFileHeader, (!IsGeneralPurposeBitSet() || (Field<7>().get() == 0)), "Invalid Zip compressed size");
-
-    StreamBase::Read(stream, &Field<8>());
-
-    StreamBase::Read(stream, &Field<9>());
     ThrowErrorIfNot(Error::ZipLocalFileHeader, (Field<9>().get() != 0), "unsupported file name size");
-    Field<11>().get().resize(GetFileNameLength(), 0);
-
-    StreamBase::Read(stream, &Field<10>());
-    // Even if we don't validate them, we need to read the extra field
-    if (Field<10>().get() != 0) {Field<12>().get().resize(Field<10>().get(), 0); }
-
-    if (Field<11>().Size())
-    {
-        ThrowHrIfFailed(stream->Read(reinterpret_cast<void*>(Field<11>().get().data()), static_cast<ULONG>(Field<11>().Size()), nullptr));
-    }
 
-    if (Field<12>().Size())
-    {
-        ThrowHrIfFailed(stream->Read(reinterpret_cast<void*>(Field<12>().get().data()), static_cast<ULONG>(Field<12>().Size()), nullptr));
-    }
+    // The file name and extra field aren't validated, the central directory has them. They are skipped
+    // rather than read, so reading a header doesn't allocate.
+    LARGE_INTEGER skip = {0};
+    skip.QuadPart = static_cast<std::int64_t>(Field<9>().get()) + Field<10>().get();
+    ThrowHrIfFailed(stream->Seek(skip, StreamBase::Reference::CURRENT, nullptr));
 }
 
 //////////////////////////////////////////////////////////////////////////////////////////////
@@ -346,42 +448,27 @@ void Zip64EndOfCentralDirectoryRecord::SetData(std::uint64_t numCentralDirs, std
 
 void Zip64EndOfCentralDirectoryRecord::Read(const ComPtr<IStream>& stream)
 {
-    StreamBase::Read(stream, &Field<0>());
+    ULARGE_INTEGER start = {0};
+    ThrowHrIfFailed(stream->Seek({0}, StreamBase::Reference::CURRENT, &start));
+    ReadFixedFields(stream);
     Meta::ExactValueValidation<std::uint32_t>(Field<0>(), static_cast<std::uint32_t>(Signatures::Zip64EndOfCD));
 
-    StreamBase::Read(stream, &Field<1>());
     //4.3.14.1 The value stored into the "size of zip64 end of central
     //    directory record" should be the size of the remaining
     //    record and should not include the leading 12 bytes.
     ThrowErrorIfNot(Error::Zip64EOCDRecord, (Field<1>().get() == (this->Size() - 12)), "invalid size of zip64 EOCD");
 
-    StreamBase::Read(stream, &Field<2>());
     Meta::ExactValueValidation<std::uint16_t>(Field<2>(), static_cast<std::uint16_t>(ZipVersions::Zip64FormatExtension));
-
-    StreamBase::Read(stream, &Field<3>());
     Meta::ExactValueValidation<std::uint16_t>(Field<3>(), static_cast<std::uint16_t>(ZipVersions::Zip64FormatExtension));
-
-    StreamBase::Read(stream, &Field<4>());
     Meta::ExactValueValidation<std::uint32_t>(Field<4>(), 0);
-
-    StreamBase::Read(stream, &Field<5>());
     Meta::ExactValueValidation<std::uint32_t>(Field<5>(), 0);
-
-    StreamBase::Read(stream, &Field<6>());
     Meta::NotValueValidation<std::uint64_t>(Field<6>(), 0);
-
-    StreamBase::Read(stream, &Field<7>());
     Meta::NotValueValidation<std::uint64_t>(Field<7>(), 0);
     ThrowErrorIfNot(Error::Zip64EOCDRecord, (Field<7>().get() == GetTotalNumberOfEntries()), "invalid total number of entries");
 
-    ULARGE_INTEGER pos = {0};
-    ThrowHrIfFailed(stream->Seek({0}, StreamBase::Reference::CURRENT, &pos));
-    StreamBase::Read(stream, &Field<8>());
-    ThrowErrorIfNot(Error::Zip64EOCDRecord, ((Field<8>().get() != 0) && (Field<8>().get() < pos.QuadPart)), "invalid size of central directory");
-
-    ThrowHrIfFailed(stream->Seek({0}, StreamBase::Reference::CURRENT, &pos));
-    StreamBase::Read(stream, &Field<9>());
-    ThrowErrorIfNot(Error::Zip64EOCDRecord, ((Field<9>().get() != 0) && (Field<9>().get() < pos.QuadPart)), "invalid size of central directory");
+    // The central directory is before where the field is
+    ThrowErrorIfNot(Error::Zip64EOCDRecord, ((Field<8>().get() != 0) && (Field<8>().get() < start.QuadPart + FieldOffset<8>())), "invalid size of central directory");
+    ThrowErrorIfNot(Error::Zip64EOCDRecord, ((Field<9>().get() != 0) && (Field<9>().get() < start.QuadPart + FieldOffset<9>())), "invalid size of central directory");
 
     if (Field<10>().Size())
     {
@@ -406,18 +493,13 @@ void Zip64EndOfCentralDirectoryLocator::SetData(std::uint64_t zip64EndCdrOffset)
 
 void Zip64EndOfCentralDirectoryLocator::Read(const ComPtr<IStream>& stream)
 {
-    StreamBase::Read(stream, &Field<0>());
+    ULARGE_INTEGER start = {0};
+    ThrowHrIfFailed(stream->Seek({0}, StreamBase::Reference::CURRENT, &start));
+    ReadFixedFields(stream);
     Meta::ExactValueValidation<std::uint32_t>(Field<0>(), static_cast<std::uint32_t>(Signatures::Zip64EndOfCDLocator));
-
-    StreamBase::Read(stream, &Field<1>());
     Meta::ExactValueValidation<std::uint32_t>(Field<1>(), 0);
-
-    ULARGE_INTEGER pos = {0};
-    StreamBase::Read(stream, &Field<2>());
-    ThrowHrIfFailed(stream->Seek({0}, StreamBase::Reference::CURRENT, &pos));
-    ThrowErrorIfNot(Error::Zip64EOCDLocator, ((Field<2>().get() != 0) && (Field<2>().get() < pos.QuadPart)), "Invalid relative offset");
-
-    StreamBase::Read(stream, &Field<3>());
+    // The record is before the end of the field
+    ThrowErrorIfNot(Error::Zip64EOCDLocator, ((Field<2>().get() != 0) && (Field<2>().get() < start.QuadPart + FieldOffset<3>())), "Invalid relative offset");
     Meta::ExactValueValidation<std::uint32_t>(Field<3>(), 1);
 }
 
@@ -439,23 +521,14 @@ EndCentralDirectoryRecord::EndCentralDirectoryRecord()
 
 void EndCentralDirectoryRecord::Read(const ComPtr<IStream>& stream)
 {
-    StreamBase::Read(stream, &Field<0>());
+    ReadFixedFields(stream);
     Meta::ExactValueValidation<std::uint32_t>(Field<0>(), static_cast<std::uint32_t>(Signatures::EndOfCentralDirectory));
 
-    StreamBase::Read(stream, &Field<1>());
     Meta::OnlyEitherValueValidation<std::uint32_t>(Field<1>(), 0, 0xFFFF);
-
-    StreamBase::Read(stream, &Field<2>());
     Meta::OnlyEitherValueValidation<std::uint32_t>(Field<2>(), 0, 0xFFFF);
     ThrowErrorIf(Error::ZipEOCDRecord, (Field<1>().get() != Field<2>().get()), "field missmatch");
-
-    StreamBase::Read(stream, &Field<3>());
-    StreamBase::Read(stream, &Field<4>());
     ThrowErrorIf(Error::ZipEOCDRecord, (Field<3>().get() != Field<4>().get()), "field missmatch");
 
-    StreamBase::Read(stream, &Field<5>());
-    StreamBase::Read(stream, &Field<6>());
-
     m_isZip64 = (
         IsValueInExtendedInfo(Field<1>()) ||
         IsValueInExtendedInfo(Field<2>()) ||
@@ -472,7 +545,6 @@ void EndCentralDirectoryRecord::Read(const ComPtr<IStream>& stream)
             "unsupported offset of start of central directory");
     }
 
-    StreamBase::Read(stream, &Field<7>());
     Meta::ExactValueValidation<std::uint32_t>(Field<7>(), 0);
 
     if (Field<8>().Size())
@@ -484,12 +556,26 @@ void EndCentralDirectoryRecord::Read(const ComPtr<IStream>& stream)
 // Use for editing a package
 ZipObject::ZipObject(const ComPtr<IStorageObject>& storageObject)
 {
-    auto other = reinterpret_cast<ZipObject*>(storageObject.Get());
+    // The storage object of a zip file is a ZipObjectReader, whose ZipObject isn't where its IStorageObject is
+    ZipObject* other = static_cast<ZipObjectReader*>(storageObject.Get());
     m_endCentralDirectoryRecord = other->m_endCentralDirectoryRecord;
     m_zip64Locator = other->m_zip64Locator;
     m_zip64EndOfCentralDirectory = other->m_zip64EndOfCentralDirectory;
-    m_centralDirectories = std::move(other->m_centralDirectories);
-    m_stream = std::move(m_stream);
+    m_stream = other->m_stream;
+
+    // The reader only keeps an index of the central directory, so read the headers again
+    if (m_endCentralDirectoryRecord.GetIsZip64())
+    {
+        LARGE_INTEGER pos = {0};
+        pos.QuadPart = m_zip64EndOfCentralDirectory.GetOffsetStartOfCD();
+        ThrowHrIfFailed(m_stream->Seek(pos, StreamBase::Reference::START, nullptr));
+        for (std::uint64_t index = 0; index < m_zip64EndOfCentralDirectory.GetTotalNumberOfEntries(); index++)
+        {
+            auto centralFileHeader = CentralDirectoryFileHeader();
+            centralFileHeader.Read(m_stream.Get(), true);
+            m_centralDirectories.insert(std::make_pair(centralFileHeader.GetFileName(), std::move(centralFileHeader)));
+        }
+    }
 }
 
 } // namespace MSIX
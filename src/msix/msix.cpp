@@ -5,11 +5,18 @@
 #include <string>
 #include <memory>
 #include <cstdlib>
+#include <cstring>
 #include <functional>
 #include <map>
+#include <vector>
+#include <algorithm>
 
 #include "Exceptions.hpp"
 #include "FileStream.hpp"
+#include "NativeFileStream.hpp"
+#include "MappedFileStream.hpp"
+#include "BufferStream.hpp"
+#include "RangeReaderStream.hpp"
 #include "ComHelper.hpp"
 #include "AppxPackaging.hpp"
 #include "AppxFactory.hpp"
@@ -22,8 +29,22 @@
 #include "ScopeExit.hpp"
 #include "VersionHelpers.hpp"
 #include "MappingFileParser.hpp"
+#include "FileNameValidation.hpp"
 #include "FileStream.hpp"
 #include "VectorStream.hpp"
+#include "StreamHelper.hpp"
+#include "PackageIdentityReader.hpp"
+#include "OutputStreamDirectory.hpp"
+#include "TarStreamDirectory.hpp"
+#include "StreamingUnpacker.hpp"
+#include "PackageDelta.hpp"
+#include "PackageEditor.hpp"
+#include "CompressedBlockCache.hpp"
+#include "ArchiveDirectory.hpp"
+#include "Applicability.hpp"
+#include "AppxBundleManifest.hpp"
+#include "WorkerPool.hpp"
+#include "IoScheduler.hpp"
 
 #ifndef WIN32
 // on non-win32 platforms, compile with -fvisibility=hidden
@@ -47,17 +68,219 @@ static void finalizer(void) {
 LPVOID STDMETHODCALLTYPE InternalAllocate(SIZE_T cb)  { return std::malloc(cb); }
 void STDMETHODCALLTYPE InternalFree(LPVOID pv)        { std::free(pv); }
 
+static HRESULT RunOperation(const std::function<MSIX::ComPtr<IUnknown>()>& operation, MSIX::ComPtr<IUnknown>& result) noexcept try
+{
+    result = operation();
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+// Runs operation on pool, then tells completion how it went, with the object the operation returned if any
+static void StartOperation(MSIX::WorkerPool& pool, IMsixCompletionCallback* completion, std::function<MSIX::ComPtr<IUnknown>()>&& operation)
+{
+    MSIX::ComPtr<IMsixCompletionCallback> callback(completion);
+    pool.Detach([callback, operation]()
+    {
+        MSIX::ComPtr<IUnknown> result;
+        HRESULT hr = RunOperation(operation, result);
+        callback->OnComplete(hr, result.Get());
+    });
+}
+
 MSIX_API HRESULT STDMETHODCALLTYPE MsixGetLogTextUTF8(COTASKMEMALLOC* memalloc, char** logText) noexcept try
 {
     ThrowErrorIf(MSIX::Error::InvalidParameter, (logText == nullptr || *logText != nullptr), "bad pointer" );
-    std::size_t countBytes = sizeof(char)*(MSIX::Global::Log::Text().size()+1);
+    auto text = MSIX::Global::Log::Take();
+    std::size_t countBytes = sizeof(char)*(text.size()+1);
     *logText = reinterpret_cast<char*>(memalloc(countBytes));
     ThrowErrorIfNot(MSIX::Error::OutOfMemory, (*logText), "Allocation failed!");
     std::memset(reinterpret_cast<void*>(*logText), 0, countBytes);
-    std::memcpy(reinterpret_cast<void*>(*logText),
-                reinterpret_cast<void*>(const_cast<char*>(MSIX::Global::Log::Text().c_str())),
-                countBytes - sizeof(char));
-    MSIX::Global::Log::Clear();
+    std::memcpy(reinterpret_cast<void*>(*logText), reinterpret_cast<const void*>(text.c_str()), countBytes - sizeof(char));
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE MsixGetPerformanceCounters(
+    IUnknown* factory,
+    bool reset,
+    MSIX_PERFORMANCE_COUNTERS* counters) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (factory == nullptr || counters == nullptr), "bad pointer");
+    MSIX::ComPtr<IMsixFactory> msixFactory;
+    ThrowHrIfFailed(factory->QueryInterface(UuidOfImpl<IMsixFactory>::iid, reinterpret_cast<void**>(&msixFactory)));
+    std::memset(counters, 0, sizeof(MSIX_PERFORMANCE_COUNTERS));
+    auto performanceCounters = msixFactory->GetPerformanceCounters();
+    if (performanceCounters)
+    {
+        performanceCounters->Get(*counters, reset);
+    }
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE MsixSetMemoryBudget(
+    IUnknown* factory,
+    UINT64 budgetBytes) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (factory == nullptr), "bad pointer");
+    MSIX::ComPtr<IMsixFactory> msixFactory;
+    ThrowHrIfFailed(factory->QueryInterface(UuidOfImpl<IMsixFactory>::iid, reinterpret_cast<void**>(&msixFactory)));
+    msixFactory->GetMemoryBudget()->SetLimit(budgetBytes);
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE MsixGetMemoryUsage(
+    IUnknown* factory,
+    bool resetPeak,
+    UINT64* currentBytes,
+    UINT64* peakBytes) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (factory == nullptr || currentBytes == nullptr || peakBytes == nullptr), "bad pointer");
+    MSIX::ComPtr<IMsixFactory> msixFactory;
+    ThrowHrIfFailed(factory->QueryInterface(UuidOfImpl<IMsixFactory>::iid, reinterpret_cast<void**>(&msixFactory)));
+    auto budget = msixFactory->GetMemoryBudget();
+    *currentBytes = budget->GetCurrent();
+    *peakBytes = budget->GetPeak();
+    if (resetPeak) { budget->ResetPeak(); }
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE MsixSetQualityOfService(
+    IUnknown* factory,
+    UINT64 maxBytesPerSecond,
+    UINT32 maxWorkerCount,
+    bool lowPriorityIo) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (factory == nullptr), "bad pointer");
+    MSIX::ComPtr<IMsixFactory> msixFactory;
+    ThrowHrIfFailed(factory->QueryInterface(UuidOfImpl<IMsixFactory>::iid, reinterpret_cast<void**>(&msixFactory)));
+    msixFactory->GetQualityOfService()->Set(maxBytesPerSecond, maxWorkerCount, lowPriorityIo);
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE MsixSetWorkerAffinity(
+    IUnknown* factory,
+    bool pinWorkers) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (factory == nullptr), "bad pointer");
+    MSIX::ComPtr<IMsixFactory> msixFactory;
+    ThrowHrIfFailed(factory->QueryInterface(UuidOfImpl<IMsixFactory>::iid, reinterpret_cast<void**>(&msixFactory)));
+    msixFactory->GetQualityOfService()->SetPinnedWorkers(pinWorkers);
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE MsixShutdownThreads() noexcept try
+{
+    MSIX::WorkerPool::StopDefault();
+    MSIX::IoScheduler::StopDefault();
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE MsixSetCertificateChainCacheLifetime(
+    IUnknown* factory,
+    UINT32 lifetimeSeconds) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (factory == nullptr), "bad pointer");
+    MSIX::ComPtr<IMsixFactory> msixFactory;
+    ThrowHrIfFailed(factory->QueryInterface(UuidOfImpl<IMsixFactory>::iid, reinterpret_cast<void**>(&msixFactory)));
+    msixFactory->GetCertificateChainCache().SetLifetime(std::chrono::seconds(lifetimeSeconds));
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE MsixSetBlockStore(
+    IUnknown* factory,
+    char* utf8StoreDirectory) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (factory == nullptr), "bad pointer");
+    MSIX::ComPtr<IMsixFactory> msixFactory;
+    ThrowHrIfFailed(factory->QueryInterface(UuidOfImpl<IMsixFactory>::iid, reinterpret_cast<void**>(&msixFactory)));
+    std::shared_ptr<MSIX::BlockStore> blockStore;
+    if (utf8StoreDirectory != nullptr)
+    {
+        blockStore = std::make_shared<MSIX::BlockStore>(utf8StoreDirectory);
+    }
+    msixFactory->SetBlockStore(blockStore);
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE MsixSetBlockCache(
+    IUnknown* factory,
+    UINT64 maxBytes) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (factory == nullptr), "bad pointer");
+    MSIX::ComPtr<IMsixFactory> msixFactory;
+    ThrowHrIfFailed(factory->QueryInterface(UuidOfImpl<IMsixFactory>::iid, reinterpret_cast<void**>(&msixFactory)));
+    std::shared_ptr<MSIX::BlockCache> blockCache;
+    if (maxBytes != 0)
+    {
+        blockCache = std::make_shared<MSIX::BlockCache>(maxBytes);
+    }
+    msixFactory->SetBlockCache(blockCache);
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE CreatePackageReaderAsync(
+    IAppxFactory* factory,
+    IStream* inputStream,
+    IMsixCompletionCallback* completion) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (factory == nullptr || inputStream == nullptr || completion == nullptr), "bad pointer");
+    MSIX::ComPtr<IMsixFactory> msixFactory;
+    ThrowHrIfFailed(factory->QueryInterface(UuidOfImpl<IMsixFactory>::iid, reinterpret_cast<void**>(&msixFactory)));
+    MSIX::ComPtr<IAppxFactory> appxFactory(factory);
+    MSIX::ComPtr<IStream> stream(inputStream);
+    StartOperation(*msixFactory->GetWorkerPool(), completion, [appxFactory, stream]()
+    {
+        MSIX::ComPtr<IAppxPackageReader> reader;
+        ThrowHrIfFailed(appxFactory->CreatePackageReader(stream.Get(), &reader));
+        return reader.As<IUnknown>();
+    });
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE WritePackageIndex(
+    IAppxPackageReader* packageReader,
+    IStream* indexStream) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (packageReader == nullptr || indexStream == nullptr), "bad pointer");
+    MSIX::ComPtr<IPackage> package;
+    ThrowHrIfFailed(packageReader->QueryInterface(UuidOfImpl<IPackage>::iid, reinterpret_cast<void**>(&package)));
+    auto index = package->GetIndex().Save();
+    ULONG bytesWritten = 0;
+    ThrowHrIfFailed(indexStream->Write(index.data(), static_cast<ULONG>(index.size()), &bytesWritten));
+    ThrowErrorIf(MSIX::Error::FileWrite, (bytesWritten != index.size()), "Entire index wasn't written");
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE CreatePackageReaderWithIndex(
+    IAppxFactory* factory,
+    IStream* inputStream,
+    IStream* indexStream,
+    IAppxPackageReader** packageReader) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (factory == nullptr || inputStream == nullptr || indexStream == nullptr ||
+        packageReader == nullptr || *packageReader != nullptr), "bad pointer");
+    MSIX::ComPtr<IMsixFactory> msixFactory;
+    ThrowHrIfFailed(factory->QueryInterface(UuidOfImpl<IMsixFactory>::iid, reinterpret_cast<void**>(&msixFactory)));
+
+    // A mapped index is read in place
+    MSIX::ComPtr<IStream> index(indexStream);
+    LARGE_INTEGER start = { 0 };
+    ULARGE_INTEGER end = { 0 };
+    ThrowHrIfFailed(index->Seek(start, MSIX::StreamBase::Reference::END, &end));
+    ThrowHrIfFailed(index->Seek(start, MSIX::StreamBase::Reference::START, nullptr));
+    std::uint64_t available = 0;
+    const std::uint8_t* view = nullptr;
+    auto indexInternal = index.TryAs<IStreamInternal>();
+    if (indexInternal) { view = indexInternal->GetRawView(available); }
+    std::vector<std::uint8_t> buffer;
+    if ((view == nullptr) || (available < end.QuadPart))
+    {
+        buffer = MSIX::Helper::CreateBufferFromStream(index);
+        view = buffer.data();
+    }
+
+    MSIX::PackageIndex packageIndex;
+    bool loaded = packageIndex.Load(view, static_cast<std::size_t>(end.QuadPart));
+    MSIX::ComPtr<IStream> input(inputStream);
+    *packageReader = msixFactory->CreatePackageReaderWithIndex(input, loaded ? &packageIndex : nullptr).Detach();
     return static_cast<HRESULT>(MSIX::Error::OK);
 } CATCH_RETURN();
 
@@ -69,9 +292,9 @@ MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamOnFile(
     MSIX::FileStream::Mode mode = forRead ? MSIX::FileStream::Mode::READ : MSIX::FileStream::Mode::WRITE_UPDATE;
     #ifdef WIN32
     auto utf16File = MSIX::utf8_to_wstring(utf8File);
-    *stream = MSIX::ComPtr<IStream>::Make<MSIX::FileStream>(utf16File.c_str(), mode).Detach();
+    *stream = MSIX::ComPtr<IStream>::Make<MSIX::NativeFileStream>(utf16File, mode).Detach();
     #else
-    *stream = MSIX::ComPtr<IStream>::Make<MSIX::FileStream>(utf8File, mode).Detach();
+    *stream = MSIX::ComPtr<IStream>::Make<MSIX::NativeFileStream>(utf8File, mode).Detach();
     #endif
     return static_cast<HRESULT>(MSIX::Error::OK);
 } CATCH_RETURN();
@@ -82,7 +305,52 @@ MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamOnFileUTF16(
     IStream** stream) noexcept try
 {
     MSIX::FileStream::Mode mode = forRead ? MSIX::FileStream::Mode::READ : MSIX::FileStream::Mode::WRITE_UPDATE;
-    *stream = MSIX::ComPtr<IStream>::Make<MSIX::FileStream>(utf16File, mode).Detach();
+    *stream = MSIX::ComPtr<IStream>::Make<MSIX::NativeFileStream>(utf16File, mode).Detach();
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamOnFileMapped(
+    char* utf8File,
+    IStream** stream) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (utf8File == nullptr || stream == nullptr || *stream != nullptr), "Invalid parameters");
+    *stream = MSIX::ComPtr<IStream>::Make<MSIX::MappedFileStream>(utf8File).Detach();
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamOnFileShared(
+    char* utf8File,
+    IStream** stream) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (utf8File == nullptr || stream == nullptr || *stream != nullptr), "Invalid parameters");
+    *stream = MSIX::ComPtr<IStream>::Make<MSIX::MappedFileStream>(utf8File, MSIX::MappedFile::OpenShared(utf8File)).Detach();
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamOnRangeReader(
+    IMsixRangeReader* rangeReader,
+    UINT32 blockSize,
+    IStream** stream) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (rangeReader == nullptr || stream == nullptr || *stream != nullptr), "Invalid parameters");
+    if (blockSize == 0) { blockSize = MSIX::DefaultRangeReaderBlockSize; }
+    *stream = MSIX::ComPtr<IStream>::Make<MSIX::RangeReaderStream>(rangeReader, blockSize).Detach();
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE CreateStreamOnBuffer(
+    const void* data,
+    UINT64 size,
+    MSIX_RELEASE_BUFFER* release,
+    void* context,
+    IStream** stream) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (stream == nullptr || *stream != nullptr), "Invalid parameters");
+    auto buffer = std::make_shared<MSIX::CallerBuffer>(data, size);
+    auto result = MSIX::ComPtr<IStream>::Make<MSIX::BufferStream>(buffer);
+    // Only now the memory is the stream's to release
+    buffer->SetRelease(release, context);
+    *stream = result.Detach();
     return static_cast<HRESULT>(MSIX::Error::OK);
 } CATCH_RETURN();
 
@@ -119,179 +387,998 @@ MSIX_API HRESULT STDMETHODCALLTYPE CoCreateAppxFactoryWithOptions(
     #endif
 }
 
-MSIX_API HRESULT STDMETHODCALLTYPE CoCreateAppxFactory(
-    MSIX_VALIDATION_OPTION validationOption,
-    IAppxFactory** appxFactory) noexcept
-{
-    return CoCreateAppxFactoryWithOptions(validationOption, MSIX_FACTORY_OPTION_NONE, appxFactory);
+MSIX_API HRESULT STDMETHODCALLTYPE CoCreateAppxFactory(
+    MSIX_VALIDATION_OPTION validationOption,
+    IAppxFactory** appxFactory) noexcept
+{
+    return CoCreateAppxFactoryWithOptions(validationOption, MSIX_FACTORY_OPTION_NONE, appxFactory);
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE CoCreateAppxBundleFactoryWithHeap(
+    COTASKMEMALLOC* memalloc,
+    COTASKMEMFREE* memfree,
+    MSIX_VALIDATION_OPTION validationOption,
+    MSIX_APPLICABILITY_OPTIONS applicabilityOptions,
+    IAppxBundleFactory** appxBundleFactory) noexcept try
+{
+    return CoCreateAppxBundleFactoryWithHeapAndOptions(memalloc, memfree, validationOption, applicabilityOptions, MSIX_FACTORY_OPTION_NONE, appxBundleFactory);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE CoCreateAppxBundleFactoryWithHeapAndOptions(
+    COTASKMEMALLOC* memalloc,
+    COTASKMEMFREE* memfree,
+    MSIX_VALIDATION_OPTION validationOption,
+    MSIX_APPLICABILITY_OPTIONS applicabilityOptions,
+    MSIX_FACTORY_OPTIONS factoryOptions,
+    IAppxBundleFactory** appxBundleFactory) noexcept try
+{
+    THROW_IF_BUNDLE_NOT_ENABLED
+    *appxBundleFactory = MSIX::ComPtr<IAppxBundleFactory>::Make<MSIX::AppxFactory>(validationOption, applicabilityOptions, factoryOptions, memalloc, memfree).Detach();
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+// Call specific for Windows. Default to call CoTaskMemAlloc and CoTaskMemFree
+MSIX_API HRESULT STDMETHODCALLTYPE CoCreateAppxBundleFactory(
+    MSIX_VALIDATION_OPTION validationOption,
+    MSIX_APPLICABILITY_OPTIONS applicabilityOptions,
+    IAppxBundleFactory** appxBundleFactory) noexcept
+{
+    #if defined(WIN32) && defined(BUNDLE_SUPPORT)
+        return CoCreateAppxBundleFactoryWithHeap(CoTaskMemAlloc, CoTaskMemFree, validationOption, applicabilityOptions, appxBundleFactory);
+    #else
+        return static_cast<HRESULT>(MSIX::Error::NotSupported);
+    #endif
+}
+
+// The files of a reader go to the output stream factory of its factory, if any, instead of to utf8Destination
+static MSIX::ComPtr<IDirectoryObject> CreateUnpackTarget(const MSIX::ComPtr<IPackage>& package, char* utf8Destination)
+{
+    auto outputStreamFactory = package->GetFactory()->GetOutputStreamFactory();
+    if (outputStreamFactory)
+    {
+        return MSIX::ComPtr<IDirectoryObject>::Make<MSIX::OutputStreamDirectory>(outputStreamFactory);
+    }
+    return MSIX::ComPtr<IDirectoryObject>::Make<MSIX::DirectoryObject>(utf8Destination, true);
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackage(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8SourcePackage,
+    char* utf8Destination) noexcept
+{
+    return UnpackPackageWithThreadCount(packUnpackOptions, validationOption, utf8SourcePackage, utf8Destination, 0);
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageWithThreadCount(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8SourcePackage,
+    char* utf8Destination,
+    UINT32 threadCount) noexcept
+{
+    return UnpackPackageWithProgress(packUnpackOptions, validationOption, utf8SourcePackage, utf8Destination, threadCount, nullptr);
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageWithProgress(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8SourcePackage,
+    char* utf8Destination,
+    UINT32 threadCount,
+    IMsixProgressCallback* progress) noexcept try
+{
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter, 
+        (utf8SourcePackage != nullptr && utf8Destination != nullptr), 
+        "Invalid parameters"
+    );
+
+    MSIX::ComPtr<IStream> stream;
+    ThrowHrIfFailed(CreateStreamOnFile(utf8SourcePackage, true, &stream));
+    ThrowHrIfFailed(UnpackPackageFromStreamWithProgress(packUnpackOptions, validationOption, stream.Get(), utf8Destination, threadCount, progress));
+
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageAsync(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8SourcePackage,
+    char* utf8Destination,
+    UINT32 threadCount,
+    IMsixProgressCallback* progress,
+    IMsixCompletionCallback* completion) noexcept try
+{
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter,
+        (utf8SourcePackage != nullptr && utf8Destination != nullptr && completion != nullptr),
+        "Invalid parameters"
+    );
+
+    std::string source = utf8SourcePackage;
+    std::string destination = utf8Destination;
+    MSIX::ComPtr<IMsixProgressCallback> progressCallback(progress);
+    StartOperation(*MSIX::WorkerPool::GetDefault(), completion, [=]()
+    {
+        ThrowHrIfFailed(UnpackPackageWithProgress(packUnpackOptions, validationOption, const_cast<char*>(source.c_str()),
+            const_cast<char*>(destination.c_str()), threadCount, progressCallback.Get()));
+        return MSIX::ComPtr<IUnknown>();
+    });
+
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageFromPackageReader(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    IAppxPackageReader* packageReader,
+    char* utf8Destination) noexcept
+{
+    return UnpackPackageFromPackageReaderWithProgress(packUnpackOptions, packageReader, utf8Destination, 0, nullptr);
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageFromPackageReaderWithProgress(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    IAppxPackageReader* packageReader,
+    char* utf8Destination,
+    UINT32 threadCount,
+    IMsixProgressCallback* progress) noexcept try
+{
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter,
+        (packageReader != nullptr && utf8Destination != nullptr),
+        "Invalid parameters"
+    );
+
+    MSIX::ComPtr<IPackage> package;
+    ThrowHrIfFailed(packageReader->QueryInterface(UuidOfImpl<IPackage>::iid, reinterpret_cast<void**>(&package)));
+    auto to = CreateUnpackTarget(package, utf8Destination);
+
+    // The reader comes with its factory, so the callback only gets the progress of this unpack.
+    std::shared_ptr<MSIX::ProgressReporter> reporter;
+    if (progress != nullptr)
+    {
+        reporter = std::make_shared<MSIX::ProgressReporter>();
+        reporter->SetExtension(progress);
+    }
+    package->Unpack(packUnpackOptions, to.Get(), threadCount, reporter);
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageFromStream(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    IStream* stream,
+    char* utf8Destination) noexcept
+{
+    return UnpackPackageFromStreamWithThreadCount(packUnpackOptions, validationOption, stream, utf8Destination, 0);
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageFromStreamWithThreadCount(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    IStream* stream,
+    char* utf8Destination,
+    UINT32 threadCount) noexcept
+{
+    return UnpackPackageFromStreamWithProgress(packUnpackOptions, validationOption, stream, utf8Destination, threadCount, nullptr);
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageFromStreamWithProgress(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    IStream* stream,
+    char* utf8Destination,
+    UINT32 threadCount,
+    IMsixProgressCallback* progress) noexcept
+{
+    return UnpackPackageFromStreamWithFilter(packUnpackOptions, validationOption, stream, utf8Destination, threadCount, progress,
+        0, nullptr, 0, nullptr);
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageWithFilter(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8SourcePackage,
+    char* utf8Destination,
+    UINT32 threadCount,
+    IMsixProgressCallback* progress,
+    UINT32 includeCount,
+    char** includePatterns,
+    UINT32 excludeCount,
+    char** excludePatterns) noexcept try
+{
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter,
+        (utf8SourcePackage != nullptr && utf8Destination != nullptr),
+        "Invalid parameters"
+    );
+
+    MSIX::ComPtr<IStream> stream;
+    ThrowHrIfFailed(CreateStreamOnFile(utf8SourcePackage, true, &stream));
+    ThrowHrIfFailed(UnpackPackageFromStreamWithFilter(packUnpackOptions, validationOption, stream.Get(), utf8Destination, threadCount, progress,
+        includeCount, includePatterns, excludeCount, excludePatterns));
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageFromStreamWithFilter(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    IStream* stream,
+    char* utf8Destination,
+    UINT32 threadCount,
+    IMsixProgressCallback* progress,
+    UINT32 includeCount,
+    char** includePatterns,
+    UINT32 excludeCount,
+    char** excludePatterns) noexcept try
+{
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter, 
+        (stream != nullptr && utf8Destination != nullptr), 
+        "Invalid parameters"
+    );
+    ThrowErrorIf(MSIX::Error::InvalidParameter,
+        ((includeCount != 0 && includePatterns == nullptr) || (excludeCount != 0 && excludePatterns == nullptr)),
+        "Invalid patterns"
+    );
+
+    MSIX::FileFilter filter;
+    for (UINT32 index = 0; index < includeCount; index++)
+    {
+        ThrowErrorIf(MSIX::Error::InvalidParameter, (includePatterns[index] == nullptr), "Invalid pattern");
+        filter.AddInclude(includePatterns[index]);
+    }
+    for (UINT32 index = 0; index < excludeCount; index++)
+    {
+        ThrowErrorIf(MSIX::Error::InvalidParameter, (excludePatterns[index] == nullptr), "Invalid pattern");
+        filter.AddExclude(excludePatterns[index]);
+    }
+
+    MSIX::ComPtr<IAppxFactory> factory;
+    // We don't need to use the caller's heap here because we're not marshalling any strings
+    // out to the caller.  So default to new / delete[] and be done with it!
+    ThrowHrIfFailed(CoCreateAppxFactoryWithHeap(InternalAllocate, InternalFree, validationOption, &factory));
+    if (progress != nullptr)
+    {
+        ThrowHrIfFailed(factory.As<IMsixFactoryOverrides>()->SpecifyExtension(MSIX_FACTORY_EXTENSION_PROGRESS_CALLBACK, progress));
+    }
+
+    MSIX::ComPtr<IAppxPackageReader> reader;
+    ThrowHrIfFailed(factory->CreatePackageReader(stream, &reader));
+
+    auto to = MSIX::ComPtr<IDirectoryObject>::Make<MSIX::DirectoryObject>(utf8Destination, true);
+    auto package = reader.As<IPackage>();
+    package->Unpack(packUnpackOptions, to.Get(), threadCount, nullptr, filter.IsEmpty() ? nullptr : &filter);
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageFromSequentialStream(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    IStream* stream,
+    char* utf8Destination,
+    UINT32 threadCount,
+    IMsixProgressCallback* progress) noexcept try
+{
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter,
+        (stream != nullptr && utf8Destination != nullptr),
+        "Invalid parameters"
+    );
+
+    MSIX::ComPtr<IAppxFactory> factory;
+    ThrowHrIfFailed(CoCreateAppxFactoryWithHeap(InternalAllocate, InternalFree, validationOption, &factory));
+    if (progress != nullptr)
+    {
+        ThrowHrIfFailed(factory.As<IMsixFactoryOverrides>()->SpecifyExtension(MSIX_FACTORY_EXTENSION_PROGRESS_CALLBACK, progress));
+    }
+
+    auto to = MSIX::ComPtr<IDirectoryObject>::Make<MSIX::DirectoryObject>(utf8Destination, true);
+    MSIX::StreamingUnpacker unpacker(factory, stream, to);
+    unpacker.Unpack(packUnpackOptions, threadCount);
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageToTarStream(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    IStream* stream,
+    IStream* tarStream,
+    MSIX_TAR_COMPRESSION compression,
+    UINT32 threadCount,
+    IMsixProgressCallback* progress) noexcept try
+{
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter,
+        (stream != nullptr && tarStream != nullptr),
+        "Invalid parameters"
+    );
+
+    MSIX::ComPtr<IAppxFactory> factory;
+    ThrowHrIfFailed(CoCreateAppxFactoryWithHeap(InternalAllocate, InternalFree, validationOption, &factory));
+    if (progress != nullptr)
+    {
+        ThrowHrIfFailed(factory.As<IMsixFactoryOverrides>()->SpecifyExtension(MSIX_FACTORY_EXTENSION_PROGRESS_CALLBACK, progress));
+    }
+
+    MSIX::ComPtr<IAppxPackageReader> reader;
+    ThrowHrIfFailed(factory->CreatePackageReader(stream, &reader));
+
+    // There is nothing on disk to compare with
+    auto options = static_cast<MSIX_PACKUNPACK_OPTION>(packUnpackOptions & ~MSIX_PACKUNPACK_OPTION_SKIPUNCHANGED);
+    auto to = MSIX::ComPtr<MSIX::TarStreamDirectory>::Make<MSIX::TarStreamDirectory>(tarStream, compression);
+    reader.As<IPackage>()->Unpack(options, to.As<IDirectoryObject>(), threadCount, nullptr);
+    to->Finish();
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE VerifyPackage(
+    MSIX_VALIDATION_OPTION validationOption,
+    char* utf8SourcePackage,
+    UINT32 threadCount) noexcept try
+{
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter, (utf8SourcePackage != nullptr), "Invalid parameters");
+
+    MSIX::ComPtr<IStream> stream;
+    ThrowHrIfFailed(CreateStreamOnFile(utf8SourcePackage, true, &stream));
+    ThrowHrIfFailed(VerifyPackageFromStream(validationOption, stream.Get(), threadCount));
+
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE VerifyPackageFromStream(
+    MSIX_VALIDATION_OPTION validationOption,
+    IStream* stream,
+    UINT32 threadCount) noexcept try
+{
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter, (stream != nullptr), "Invalid parameters");
+
+    MSIX::ComPtr<IAppxFactory> factory;
+    ThrowHrIfFailed(CoCreateAppxFactoryWithHeap(InternalAllocate, InternalFree, validationOption, &factory));
+
+    MSIX::ComPtr<IAppxPackageReader> reader;
+    ThrowHrIfFailed(factory->CreatePackageReader(stream, &reader));
+    reader.As<IPackage>()->Verify(threadCount);
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE ReadPackageIdentityFromStream(
+    IAppxFactory* factory,
+    IStream* stream,
+    IAppxManifestPackageId** packageId) noexcept try
+{
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter, (factory != nullptr && stream != nullptr), "Invalid parameters");
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (packageId == nullptr || *packageId != nullptr), "bad pointer");
+
+    MSIX::ComPtr<IMsixFactory> msixFactory;
+    ThrowHrIfFailed(factory->QueryInterface(UuidOfImpl<IMsixFactory>::iid, reinterpret_cast<void**>(&msixFactory)));
+    *packageId = MSIX::ReadPackageIdentity(msixFactory.Get(), stream).Detach();
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE GetContainerFormatFromStream(
+    IStream* stream,
+    MSIX_CONTAINER_FORMAT* format) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (stream == nullptr || format == nullptr), "bad pointer");
+    *format = MSIX::GetContainerFormat(stream);
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE DiffPackages(
+    char* utf8OldPackage,
+    char* utf8NewPackage,
+    char* utf8Delta,
+    char* utf8Ranges) noexcept try
+{
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter,
+        (utf8OldPackage != nullptr && utf8NewPackage != nullptr && utf8Delta != nullptr),
+        "Invalid parameters");
+
+    // The factory only parses the block maps
+    MSIX::ComPtr<IAppxFactory> factory;
+    ThrowHrIfFailed(CoCreateAppxFactoryWithHeap(InternalAllocate, InternalFree, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+
+    MSIX::ComPtr<IStream> oldPackage;
+    ThrowHrIfFailed(CreateStreamOnFile(utf8OldPackage, true, &oldPackage));
+    MSIX::ComPtr<IStream> newPackage;
+    ThrowHrIfFailed(CreateStreamOnFile(utf8NewPackage, true, &newPackage));
+    MSIX::ComPtr<IStream> delta;
+    ThrowHrIfFailed(CreateStreamOnFile(utf8Delta, false, &delta));
+    MSIX::ComPtr<IStream> ranges;
+    if (utf8Ranges != nullptr)
+    {
+        ThrowHrIfFailed(CreateStreamOnFile(utf8Ranges, false, &ranges));
+    }
+    MSIX::DiffPackages(factory.As<IMsixFactory>().Get(), oldPackage.Get(), newPackage.Get(), delta.Get(), ranges.Get());
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE PatchPackage(
+    char* utf8OldPackage,
+    char* utf8Delta,
+    char* utf8Ranges,
+    char* utf8NewPackage) noexcept try
+{
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter,
+        (utf8OldPackage != nullptr && utf8Delta != nullptr && utf8Ranges != nullptr && utf8NewPackage != nullptr),
+        "Invalid parameters");
+
+    MSIX::ComPtr<IStream> oldPackage;
+    ThrowHrIfFailed(CreateStreamOnFile(utf8OldPackage, true, &oldPackage));
+    MSIX::ComPtr<IStream> delta;
+    ThrowHrIfFailed(CreateStreamOnFile(utf8Delta, true, &delta));
+    MSIX::ComPtr<IStream> ranges;
+    ThrowHrIfFailed(CreateStreamOnFile(utf8Ranges, true, &ranges));
+
+    auto deleteFile = MSIX::scope_exit([&utf8NewPackage]
+    {
+        remove(utf8NewPackage);
+    });
+
+    MSIX::ComPtr<IStream> newPackage;
+    ThrowHrIfFailed(CreateStreamOnFile(utf8NewPackage, false, &newPackage));
+    MSIX::PatchPackage(oldPackage.Get(), delta.Get(), ranges.Get(), newPackage.Get());
+    deleteFile.release();
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackBundle(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    MSIX_APPLICABILITY_OPTIONS applicabilityOptions,
+    char* utf8SourcePackage,
+    char* utf8Destination) noexcept
+{
+    return UnpackBundleWithThreadCount(packUnpackOptions, validationOption, applicabilityOptions, utf8SourcePackage, utf8Destination, 0);
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackBundleWithThreadCount(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    MSIX_APPLICABILITY_OPTIONS applicabilityOptions,
+    char* utf8SourcePackage,
+    char* utf8Destination,
+    UINT32 threadCount) noexcept
+{
+    return UnpackBundleWithProgress(packUnpackOptions, validationOption, applicabilityOptions, utf8SourcePackage, utf8Destination,
+        threadCount, nullptr);
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackBundleWithProgress(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    MSIX_APPLICABILITY_OPTIONS applicabilityOptions,
+    char* utf8SourcePackage,
+    char* utf8Destination,
+    UINT32 threadCount,
+    IMsixProgressCallback* progress) noexcept try
+{
+    THROW_IF_BUNDLE_NOT_ENABLED
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter, 
+        (utf8SourcePackage != nullptr && utf8Destination != nullptr), 
+        "Invalid parameters"
+    );
+
+    MSIX::ComPtr<IStream> stream;
+    ThrowHrIfFailed(CreateStreamOnFile(utf8SourcePackage, true, &stream));
+    ThrowHrIfFailed(UnpackBundleFromStreamWithProgress(packUnpackOptions, validationOption, applicabilityOptions, stream.Get(), utf8Destination,
+        threadCount, progress));
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackBundleFromBundleReader(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    IAppxBundleReader* bundleReader,
+    char* utf8Destination) noexcept try
+{
+    THROW_IF_BUNDLE_NOT_ENABLED
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter,
+        (bundleReader != nullptr && utf8Destination != nullptr),
+        "Invalid parameters"
+    );
+
+    MSIX::ComPtr<IPackage> package;
+    ThrowHrIfFailed(bundleReader->QueryInterface(UuidOfImpl<IPackage>::iid, reinterpret_cast<void**>(&package)));
+
+    auto to = CreateUnpackTarget(package, utf8Destination);
+    package->Unpack(packUnpackOptions, to.Get(), 0, nullptr);
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE GetApplicablePackagesForProfiles(
+    IAppxBundleReader* bundleReader,
+    UINT32 profileCount,
+    MSIX_APPLICABILITY_PROFILE* profiles,
+    UINT32 packageCount,
+    BOOL* applicable) noexcept try
+{
+    THROW_IF_BUNDLE_NOT_ENABLED
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter,
+        (bundleReader != nullptr && (profileCount == 0 || (profiles != nullptr && applicable != nullptr))),
+        "Invalid parameters"
+    );
+#ifdef BUNDLE_SUPPORT
+    MSIX::ComPtr<IAppxBundleManifestReader> manifest;
+    ThrowHrIfFailed(bundleReader->GetManifest(&manifest));
+    auto& packages = manifest.As<IBundleInfo>()->GetPackages();
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (packageCount != packages.size()), "packageCount isn't the number of packages of the bundle");
+
+    std::vector<APPX_BUNDLE_PAYLOAD_PACKAGE_TYPE> packageTypes(packages.size());
+    std::map<std::string, std::size_t> packageIndexes;
+    for (std::size_t i = 0; i < packages.size(); i++)
+    {
+        ThrowHrIfFailed(packages[i]->GetPackageType(&packageTypes[i]));
+        packageIndexes[packages[i].As<IAppxBundleManifestPackageInfoInternal>()->GetFileName()] = i;
+    }
+
+    std::vector<MSIX::Bcp47Tag> systemLanguages;
+    bool hasSystemLanguages = false;
+    for (UINT32 index = 0; index < profileCount; index++)
+    {
+        const auto& profile = profiles[index];
+        ThrowErrorIf(MSIX::Error::InvalidParameter, (profile.languageCount != 0 && profile.languages == nullptr), "Invalid profile");
+        MSIX::Applicability applicability(profile.applicabilityOptions);
+        if (profile.languageCount == 0)
+        {
+            if (!hasSystemLanguages)
+            {
+                systemLanguages = MSIX::Applicability::GetLanguages();
+                hasSystemLanguages = true;
+            }
+            applicability.InitializeLanguages(systemLanguages);
+        }
+        else
+        {
+            std::vector<MSIX::Bcp47Tag> languages;
+            for (UINT32 i = 0; i < profile.languageCount; i++)
+            {
+                ThrowErrorIf(MSIX::Error::InvalidParameter, (profile.languages[i] == nullptr), "Invalid profile");
+                languages.emplace_back(std::string(profile.languages[i]));
+            }
+            applicability.InitializeLanguages(languages);
+        }
+
+        // Only the bundle manifest is looked at, the packages aren't opened
+        for (std::size_t i = 0; i < packages.size(); i++)
+        {
+            MSIX::ComPtr<IAppxPackageReader> reader;
+            applicability.AddPackageIfApplicable(reader, packageTypes[i], packages[i]);
+        }
+        std::vector<MSIX::ComPtr<IAppxPackageReader>> readers;
+        std::vector<std::string> names;
+        applicability.GetApplicablePackages(&readers, &names);
+
+        BOOL* row = applicable + (static_cast<std::size_t>(index) * packageCount);
+        std::fill(row, row + packageCount, FALSE);
+        for (const auto& name : names)
+        {
+            row[packageIndexes[name]] = TRUE;
+        }
+    }
+#endif
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackBundleFromStream(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    MSIX_APPLICABILITY_OPTIONS applicabilityOptions,
+    IStream* stream,
+    char* utf8Destination) noexcept
+{
+    return UnpackBundleFromStreamWithThreadCount(packUnpackOptions, validationOption, applicabilityOptions, stream, utf8Destination, 0);
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackBundleFromStreamWithThreadCount(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    MSIX_APPLICABILITY_OPTIONS applicabilityOptions,
+    IStream* stream,
+    char* utf8Destination,
+    UINT32 threadCount) noexcept
+{
+    return UnpackBundleFromStreamWithProgress(packUnpackOptions, validationOption, applicabilityOptions, stream, utf8Destination,
+        threadCount, nullptr);
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE UnpackBundleFromStreamWithProgress(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    MSIX_APPLICABILITY_OPTIONS applicabilityOptions,
+    IStream* stream,
+    char* utf8Destination,
+    UINT32 threadCount,
+    IMsixProgressCallback* progress) noexcept try
+{
+    THROW_IF_BUNDLE_NOT_ENABLED
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter, 
+        (stream != nullptr && utf8Destination != nullptr), 
+        "Invalid parameters"
+    );
+
+    MSIX::ComPtr<IAppxBundleFactory> factory;
+    // We don't need to use the caller's heap here because we're not marshalling any strings
+    // out to the caller.  So default to new / delete[] and be done with it!
+    ThrowHrIfFailed(CoCreateAppxBundleFactoryWithHeap(InternalAllocate, InternalFree, validationOption, applicabilityOptions, &factory));
+    if (progress != nullptr)
+    {
+        ThrowHrIfFailed(factory.As<IMsixFactoryOverrides>()->SpecifyExtension(MSIX_FACTORY_EXTENSION_PROGRESS_CALLBACK, progress));
+    }
+
+    MSIX::ComPtr<IAppxBundleReader> reader;
+    ThrowHrIfFailed(factory->CreateBundleReader(stream, &reader));
+
+    auto to = MSIX::ComPtr<IDirectoryObject>::Make<MSIX::DirectoryObject>(utf8Destination, true);
+    auto package = reader.As<IPackage>();
+    package->Unpack(packUnpackOptions, to.Get(), threadCount, nullptr);
+
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+#ifdef MSIX_PACK
+
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackage(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* directoryPath,
+    char* outputPackage
+) noexcept
+{
+    return PackPackageWithThreadCount(packUnpackOptions, validationOption, directoryPath, outputPackage, 0);
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackageWithThreadCount(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* directoryPath,
+    char* outputPackage,
+    UINT32 threadCount
+) noexcept
+{
+    return PackPackageWithOptions(packUnpackOptions, validationOption, directoryPath, outputPackage, threadCount,
+        APPX_COMPRESSION_OPTION_NORMAL);
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackageWithOptions(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* directoryPath,
+    char* outputPackage,
+    UINT32 threadCount,
+    APPX_COMPRESSION_OPTION compressionOption
+) noexcept
+{
+    return PackPackageFromBase(packUnpackOptions, validationOption, directoryPath, outputPackage, threadCount,
+        compressionOption, nullptr);
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackageFromBase(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    char* directoryPath,
+    char* outputPackage,
+    UINT32 threadCount,
+    APPX_COMPRESSION_OPTION compressionOption,
+    char* basePackage
+) noexcept
+{
+    return PackPackageWithProgress(packUnpackOptions, validationOption, directoryPath, outputPackage, threadCount,
+        compressionOption, basePackage, nullptr);
+}
+
+// Packs the files of from, a directory or an archive, to stream. A streaming writer only writes forward to it. If
+// signingDigests isn't null, the package is written ready to be signed and signingDigests gets what its signature
+// signs. If inventory isn't null, its files are packed instead of the ones of from. A timeBudgetMilliseconds other
+// than 0 paces the compression level of the payload files. The files of accessOrder are packed first.
+static void PackDirectory(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
+    MSIX_VALIDATION_OPTION validationOption,
+    const MSIX::ComPtr<IDirectoryObject>& from,
+    IStream* stream,
+    bool streaming,
+    UINT32 threadCount,
+    APPX_COMPRESSION_OPTION compressionOption,
+    char* basePackage,
+    IMsixProgressCallback* progress,
+    std::vector<std::uint8_t>* signingDigests = nullptr,
+    const std::vector<MSIX::InventoryFile>* inventory = nullptr,
+    UINT32 timeBudgetMilliseconds = 0,
+    const std::vector<std::string>& accessOrder = {})
+{
+    // PackPackage assumes AppxManifest.xml to be in the directory provided.
+    auto manifest = from.As<IStorageObject>()->GetFile(MSIX::footprintFiles[APPX_FOOTPRINT_FILE_TYPE_MANIFEST]);
+
+    MSIX::ComPtr<IAppxFactory> factory;
+    auto factoryOptions = streaming ? MSIX_FACTORY_OPTION_WRITER_STREAMING_OUTPUT : MSIX_FACTORY_OPTION_NONE;
+    if (signingDigests != nullptr)
+    {
+        factoryOptions = static_cast<MSIX_FACTORY_OPTIONS>(factoryOptions | MSIX_FACTORY_OPTION_WRITER_SIGNING_DIGESTS);
+    }
+    ThrowHrIfFailed(CoCreateAppxFactoryWithHeapAndOptions(InternalAllocate, InternalFree, validationOption, factoryOptions, &factory));
+    if (progress != nullptr)
+    {
+        ThrowHrIfFailed(factory.As<IMsixFactoryOverrides>()->SpecifyExtension(MSIX_FACTORY_EXTENSION_PROGRESS_CALLBACK, progress));
+    }
+
+    MSIX::ComPtr<IAppxPackageWriter> writer;
+    ThrowHrIfFailed(factory->CreatePackageWriter(stream, nullptr, &writer));
+    MSIX::ComPtr<IStream> base;
+    if (basePackage != nullptr)
+    {
+        ThrowHrIfFailed(CreateStreamOnFile(basePackage, true, &base));
+        writer.As<IPackageWriter>()->SetBasePackage(base);
+    }
+    writer.As<IPackageWriter>()->SetCompactZipRecords((packUnpackOptions & MSIX_PACKUNPACK_OPTION_COMPACTZIPRECORDS) != 0);
+    writer.As<IPackageWriter>()->SetDuplicateReuse((packUnpackOptions & MSIX_PACKUNPACK_OPTION_REUSEDUPLICATES) != 0);
+    writer.As<IPackageWriter>()->SetCompressionTimeBudget(std::chrono::milliseconds(timeBudgetMilliseconds));
+    writer.As<IPackageWriter>()->SetAccessOrder(accessOrder);
+    std::uint32_t compressionThreads = (packUnpackOptions & MSIX_PACKUNPACK_OPTION_PARALLELCOMPRESSION) ? threadCount : 1;
+    bool adaptiveCompression = (packUnpackOptions & MSIX_PACKUNPACK_OPTION_ADAPTIVECOMPRESSION) != 0;
+    if (inventory != nullptr)
+    {
+        writer.As<IPackageWriter>()->PackInventoryFiles(from, *inventory, compressionThreads, compressionOption, adaptiveCompression);
+    }
+    else
+    {
+        writer.As<IPackageWriter>()->PackPayloadFiles(from, compressionThreads, compressionOption, adaptiveCompression);
+    }
+    ThrowHrIfFailed(writer->Close(manifest.Get()));
+
+    if (signingDigests != nullptr)
+    {
+        UINT32 size = 0;
+        BYTE* digests = nullptr;
+        ThrowHrIfFailed(writer.As<IMsixPackageSigningDigests>()->GetSigningDigests(&size, &digests));
+        signingDigests->assign(digests, digests + size);
+        InternalFree(digests);
+    }
 }
 
-MSIX_API HRESULT STDMETHODCALLTYPE CoCreateAppxBundleFactoryWithHeap(
-    COTASKMEMALLOC* memalloc,
-    COTASKMEMFREE* memfree,
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackageWithProgress(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
     MSIX_VALIDATION_OPTION validationOption,
-    MSIX_APPLICABILITY_OPTIONS applicabilityOptions,
-    IAppxBundleFactory** appxBundleFactory) noexcept try
+    char* directoryPath,
+    char* outputPackage,
+    UINT32 threadCount,
+    APPX_COMPRESSION_OPTION compressionOption,
+    char* basePackage,
+    IMsixProgressCallback* progress
+) noexcept
 {
-    THROW_IF_BUNDLE_NOT_ENABLED
-    *appxBundleFactory = MSIX::ComPtr<IAppxBundleFactory>::Make<MSIX::AppxFactory>(validationOption, applicabilityOptions, MSIX_FACTORY_OPTION_NONE, memalloc, memfree).Detach();
-    return static_cast<HRESULT>(MSIX::Error::OK);
-} CATCH_RETURN();
+    return PackPackageWithTimeBudget(packUnpackOptions, validationOption, directoryPath, outputPackage, threadCount,
+        compressionOption, basePackage, progress, 0);
+}
 
-// Call specific for Windows. Default to call CoTaskMemAlloc and CoTaskMemFree
-MSIX_API HRESULT STDMETHODCALLTYPE CoCreateAppxBundleFactory(
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackageWithTimeBudget(
+    MSIX_PACKUNPACK_OPTION packUnpackOptions,
     MSIX_VALIDATION_OPTION validationOption,
-    MSIX_APPLICABILITY_OPTIONS applicabilityOptions,
-    IAppxBundleFactory** appxBundleFactory) noexcept
+    char* directoryPath,
+    char* outputPackage,
+    UINT32 threadCount,
+    APPX_COMPRESSION_OPTION compressionOption,
+    char* basePackage,
+    IMsixProgressCallback* progress,
+    UINT32 timeBudgetMilliseconds
+) noexcept
 {
-    #if defined(WIN32) && defined(BUNDLE_SUPPORT)
-        return CoCreateAppxBundleFactoryWithHeap(CoTaskMemAlloc, CoTaskMemFree, validationOption, applicabilityOptions, appxBundleFactory);
-    #else
-        return static_cast<HRESULT>(MSIX::Error::NotSupported);
-    #endif
+    return PackPackageWithAccessOrder(packUnpackOptions, validationOption, directoryPath, outputPackage, threadCount,
+        compressionOption, basePackage, progress, timeBudgetMilliseconds, 0, nullptr);
 }
 
-MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackage(
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackageWithAccessOrder(
     MSIX_PACKUNPACK_OPTION packUnpackOptions,
     MSIX_VALIDATION_OPTION validationOption,
-    char* utf8SourcePackage,
-    char* utf8Destination) noexcept try
+    char* directoryPath,
+    char* outputPackage,
+    UINT32 threadCount,
+    APPX_COMPRESSION_OPTION compressionOption,
+    char* basePackage,
+    IMsixProgressCallback* progress,
+    UINT32 timeBudgetMilliseconds,
+    UINT32 accessOrderCount,
+    char** accessOrder
+) noexcept try
 {
     ThrowErrorIfNot(MSIX::Error::InvalidParameter, 
-        (utf8SourcePackage != nullptr && utf8Destination != nullptr), 
-        "Invalid parameters"
-    );
+        (directoryPath != nullptr && outputPackage != nullptr && (accessOrderCount == 0 || accessOrder != nullptr)), 
+        "Invalid parameters");
+    std::vector<std::string> files;
+    for (UINT32 index = 0; index < accessOrderCount; index++)
+    {
+        ThrowErrorIf(MSIX::Error::InvalidParameter, (accessOrder[index] == nullptr), "Invalid parameters");
+        files.emplace_back(accessOrder[index]);
+    }
 
-    MSIX::ComPtr<IStream> stream;
-    ThrowHrIfFailed(CreateStreamOnFile(utf8SourcePackage, true, &stream));
-    ThrowHrIfFailed(UnpackPackageFromStream(packUnpackOptions, validationOption, stream.Get(), utf8Destination));
+    if (strcmp(outputPackage, "-") == 0)
+    {
+        #ifdef WIN32
+        auto standardOutput = GetStdHandle(STD_OUTPUT_HANDLE);
+        #else
+        auto standardOutput = STDOUT_FILENO;
+        #endif
+        auto stream = MSIX::ComPtr<IStream>::Make<MSIX::NativeFileStream>(standardOutput, "<stdout>", MSIX::FileStream::Mode::WRITE);
+        auto from = MSIX::ComPtr<IDirectoryObject>::Make<MSIX::DirectoryObject>(directoryPath);
+        PackDirectory(packUnpackOptions, validationOption, from, stream.Get(), true, threadCount, compressionOption,
+            basePackage, progress, nullptr, nullptr, timeBudgetMilliseconds, files);
+        return static_cast<HRESULT>(MSIX::Error::OK);
+    }
+
+    auto deleteFile = MSIX::scope_exit([&outputPackage]
+    {
+        remove(outputPackage);
+    });
 
+    MSIX::ComPtr<IStream> stream;
+    ThrowHrIfFailed(CreateStreamOnFile(outputPackage, false, &stream));
+    auto from = MSIX::ComPtr<IDirectoryObject>::Make<MSIX::DirectoryObject>(directoryPath);
+    PackDirectory(packUnpackOptions, validationOption, from, stream.Get(), false, threadCount, compressionOption,
+        basePackage, progress, nullptr, nullptr, timeBudgetMilliseconds, files);
+    deleteFile.release();
     return static_cast<HRESULT>(MSIX::Error::OK);
 } CATCH_RETURN();
 
-MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageFromPackageReader(
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackageAsync(
     MSIX_PACKUNPACK_OPTION packUnpackOptions,
-    IAppxPackageReader* packageReader,
-    char* utf8Destination) noexcept try
+    MSIX_VALIDATION_OPTION validationOption,
+    char* directoryPath,
+    char* outputPackage,
+    UINT32 threadCount,
+    APPX_COMPRESSION_OPTION compressionOption,
+    char* basePackage,
+    IMsixProgressCallback* progress,
+    IMsixCompletionCallback* completion
+) noexcept try
 {
     ThrowErrorIfNot(MSIX::Error::InvalidParameter,
-        (packageReader != nullptr && utf8Destination != nullptr),
-        "Invalid parameters"
-    );
-
-    auto to = MSIX::ComPtr<IDirectoryObject>::Make<MSIX::DirectoryObject>(utf8Destination, true);
+        (directoryPath != nullptr && outputPackage != nullptr && strcmp(outputPackage, "-") != 0 && completion != nullptr),
+        "Invalid parameters");
 
-    MSIX::ComPtr<IPackage> package;
-    ThrowHrIfFailed(packageReader->QueryInterface(UuidOfImpl<IPackage>::iid, reinterpret_cast<void**>(&package)));
+    std::string directory = directoryPath;
+    std::string output = outputPackage;
+    bool hasBase = (basePackage != nullptr);
+    std::string base = hasBase ? basePackage : "";
+    MSIX::ComPtr<IMsixProgressCallback> progressCallback(progress);
+    StartOperation(*MSIX::WorkerPool::GetDefault(), completion, [=]()
+    {
+        ThrowHrIfFailed(PackPackageWithProgress(packUnpackOptions, validationOption, const_cast<char*>(directory.c_str()),
+            const_cast<char*>(output.c_str()), threadCount, compressionOption, hasBase ? const_cast<char*>(base.c_str()) : nullptr,
+            progressCallback.Get()));
+        return MSIX::ComPtr<IUnknown>();
+    });
 
-    package->Unpack(packUnpackOptions, to.Get());
     return static_cast<HRESULT>(MSIX::Error::OK);
 } CATCH_RETURN();
 
-MSIX_API HRESULT STDMETHODCALLTYPE UnpackPackageFromStream(
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackageWithSigningDigests(
     MSIX_PACKUNPACK_OPTION packUnpackOptions,
     MSIX_VALIDATION_OPTION validationOption,
-    IStream* stream,
-    char* utf8Destination) noexcept try
+    char* directoryPath,
+    char* outputPackage,
+    UINT32 threadCount,
+    APPX_COMPRESSION_OPTION compressionOption,
+    char* basePackage,
+    IMsixProgressCallback* progress,
+    COTASKMEMALLOC* memalloc,
+    UINT32* digestsSize,
+    BYTE** digests
+) noexcept try
 {
-    ThrowErrorIfNot(MSIX::Error::InvalidParameter, 
-        (stream != nullptr && utf8Destination != nullptr), 
-        "Invalid parameters"
-    );
-
-    MSIX::ComPtr<IAppxFactory> factory;
-    // We don't need to use the caller's heap here because we're not marshalling any strings
-    // out to the caller.  So default to new / delete[] and be done with it!
-    ThrowHrIfFailed(CoCreateAppxFactoryWithHeap(InternalAllocate, InternalFree, validationOption, &factory));
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter,
+        (directoryPath != nullptr && outputPackage != nullptr && memalloc != nullptr && digestsSize != nullptr &&
+         digests != nullptr && *digests == nullptr),
+        "Invalid parameters");
 
-    MSIX::ComPtr<IAppxPackageReader> reader;
-    ThrowHrIfFailed(factory->CreatePackageReader(stream, &reader));
+    auto deleteFile = MSIX::scope_exit([&outputPackage]
+    {
+        remove(outputPackage);
+    });
 
-    ThrowHrIfFailed(UnpackPackageFromPackageReader(packUnpackOptions, reader.Get(), utf8Destination));
+    MSIX::ComPtr<IStream> stream;
+    ThrowHrIfFailed(CreateStreamOnFile(outputPackage, false, &stream));
+    std::vector<std::uint8_t> signingDigests;
+    auto from = MSIX::ComPtr<IDirectoryObject>::Make<MSIX::DirectoryObject>(directoryPath);
+    PackDirectory(packUnpackOptions, validationOption, from, stream.Get(), false, threadCount, compressionOption,
+        basePackage, progress, &signingDigests);
 
+    *digests = reinterpret_cast<BYTE*>(memalloc(signingDigests.size()));
+    ThrowErrorIfNot(MSIX::Error::OutOfMemory, *digests, "Allocation failed");
+    std::memcpy(*digests, signingDigests.data(), signingDigests.size());
+    *digestsSize = static_cast<UINT32>(signingDigests.size());
+    deleteFile.release();
     return static_cast<HRESULT>(MSIX::Error::OK);
 } CATCH_RETURN();
 
-MSIX_API HRESULT STDMETHODCALLTYPE UnpackBundle(
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackageToStream(
     MSIX_PACKUNPACK_OPTION packUnpackOptions,
     MSIX_VALIDATION_OPTION validationOption,
-    MSIX_APPLICABILITY_OPTIONS applicabilityOptions,
-    char* utf8SourcePackage,
-    char* utf8Destination) noexcept try
-{
-    THROW_IF_BUNDLE_NOT_ENABLED
-    ThrowErrorIfNot(MSIX::Error::InvalidParameter, 
-        (utf8SourcePackage != nullptr && utf8Destination != nullptr), 
-        "Invalid parameters"
-    );
-
-    MSIX::ComPtr<IStream> stream;
-    ThrowHrIfFailed(CreateStreamOnFile(utf8SourcePackage, true, &stream));
-    ThrowHrIfFailed(UnpackBundleFromStream(packUnpackOptions, validationOption, applicabilityOptions, stream.Get(), utf8Destination));
-    return static_cast<HRESULT>(MSIX::Error::OK);
-} CATCH_RETURN();
-
-MSIX_API HRESULT STDMETHODCALLTYPE UnpackBundleFromBundleReader(
-    MSIX_PACKUNPACK_OPTION packUnpackOptions,
-    IAppxBundleReader* bundleReader,
-    char* utf8Destination) noexcept try
+    char* directoryPath,
+    IStream* outputStream,
+    UINT32 threadCount,
+    APPX_COMPRESSION_OPTION compressionOption,
+    char* basePackage,
+    IMsixProgressCallback* progress
+) noexcept try
 {
-    THROW_IF_BUNDLE_NOT_ENABLED
     ThrowErrorIfNot(MSIX::Error::InvalidParameter,
-        (bundleReader != nullptr && utf8Destination != nullptr),
-        "Invalid parameters"
-    );
-
-    MSIX::ComPtr<IPackage> package;
-    ThrowHrIfFailed(bundleReader->QueryInterface(UuidOfImpl<IPackage>::iid, reinterpret_cast<void**>(&package)));
+        (directoryPath != nullptr && outputStream != nullptr),
+        "Invalid parameters");
 
-    auto to = MSIX::ComPtr<IDirectoryObject>::Make<MSIX::DirectoryObject>(utf8Destination, true);
-    package->Unpack(packUnpackOptions, to.Get());
+    auto from = MSIX::ComPtr<IDirectoryObject>::Make<MSIX::DirectoryObject>(directoryPath);
+    PackDirectory(packUnpackOptions, validationOption, from, outputStream, true, threadCount, compressionOption,
+        basePackage, progress);
     return static_cast<HRESULT>(MSIX::Error::OK);
 } CATCH_RETURN();
 
-MSIX_API HRESULT STDMETHODCALLTYPE UnpackBundleFromStream(
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackageFromArchive(
     MSIX_PACKUNPACK_OPTION packUnpackOptions,
     MSIX_VALIDATION_OPTION validationOption,
-    MSIX_APPLICABILITY_OPTIONS applicabilityOptions,
-    IStream* stream,
-    char* utf8Destination) noexcept try
+    char* archivePath,
+    char* outputPackage,
+    UINT32 threadCount,
+    APPX_COMPRESSION_OPTION compressionOption,
+    IMsixProgressCallback* progress
+) noexcept try
 {
-    THROW_IF_BUNDLE_NOT_ENABLED
-    ThrowErrorIfNot(MSIX::Error::InvalidParameter, 
-        (stream != nullptr && utf8Destination != nullptr), 
-        "Invalid parameters"
-    );
-
-    MSIX::ComPtr<IAppxBundleFactory> factory;
-    // We don't need to use the caller's heap here because we're not marshalling any strings
-    // out to the caller.  So default to new / delete[] and be done with it!
-    ThrowHrIfFailed(CoCreateAppxBundleFactoryWithHeap(InternalAllocate, InternalFree, validationOption, applicabilityOptions, &factory));
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter,
+        (archivePath != nullptr && outputPackage != nullptr),
+        "Invalid parameters");
 
-    MSIX::ComPtr<IAppxBundleReader> reader;
-    ThrowHrIfFailed(factory->CreateBundleReader(stream, &reader));
+    MSIX::ComPtr<IStream> archive;
+    ThrowHrIfFailed(CreateStreamOnFile(archivePath, true, &archive));
+    auto from = MSIX::ComPtr<IDirectoryObject>::Make<MSIX::ArchiveDirectory>(archive, archivePath);
 
-    ThrowHrIfFailed(UnpackBundleFromBundleReader(packUnpackOptions, reader.Get(), utf8Destination));
+    auto deleteFile = MSIX::scope_exit([&outputPackage]
+    {
+        remove(outputPackage);
+    });
 
+    MSIX::ComPtr<IStream> stream;
+    ThrowHrIfFailed(CreateStreamOnFile(outputPackage, false, &stream));
+    PackDirectory(packUnpackOptions, validationOption, from, stream.Get(), false, threadCount, compressionOption,
+        nullptr, progress);
+    deleteFile.release();
     return static_cast<HRESULT>(MSIX::Error::OK);
 } CATCH_RETURN();
 
-#ifdef MSIX_PACK
-
-MSIX_API HRESULT STDMETHODCALLTYPE PackPackage(
+MSIX_API HRESULT STDMETHODCALLTYPE PackPackageFromInventory(
     MSIX_PACKUNPACK_OPTION packUnpackOptions,
     MSIX_VALIDATION_OPTION validationOption,
     char* directoryPath,
-    char* outputPackage
+    char* outputPackage,
+    UINT32 threadCount,
+    APPX_COMPRESSION_OPTION compressionOption,
+    IMsixProgressCallback* progress,
+    UINT32 fileCount,
+    MSIX_INVENTORY_FILE* files
 ) noexcept try
 {
-    ThrowErrorIfNot(MSIX::Error::InvalidParameter, 
-        (directoryPath != nullptr && outputPackage != nullptr), 
+    ThrowErrorIfNot(MSIX::Error::InvalidParameter,
+        (directoryPath != nullptr && outputPackage != nullptr && (fileCount == 0 || files != nullptr)),
         "Invalid parameters");
 
-    auto from = MSIX::ComPtr<IDirectoryObject>::Make<MSIX::DirectoryObject>(directoryPath);
-    // PackPackage assumes AppxManifest.xml to be in the directory provided.
-    auto manifest = from.As<IStorageObject>()->GetFile(MSIX::footprintFiles[APPX_FOOTPRINT_FILE_TYPE_MANIFEST]);
+    std::vector<MSIX::InventoryFile> inventory(fileCount);
+    for (UINT32 i = 0; i < fileCount; i++)
+    {
+        const auto& file = files[i];
+        ThrowErrorIf(MSIX::Error::InvalidParameter,
+            (file.fileName == nullptr || (file.blockCount != 0 && file.blockHashes == nullptr) ||
+             (file.compressedBlocks != nullptr && file.compressedBlockSizes == nullptr)),
+            "Invalid inventory file");
+        auto& inventoryFile = inventory[i];
+        inventoryFile.name = file.fileName;
+        inventoryFile.contentType = (file.contentType != nullptr) ? file.contentType : "";
+        inventoryFile.size = file.size;
+        if (file.blockHashes != nullptr)
+        {
+            inventoryFile.blockHashes.resize(file.blockCount);
+            for (UINT32 block = 0; block < file.blockCount; block++)
+            {
+                std::memcpy(inventoryFile.blockHashes[block].data(), file.blockHashes + block * inventoryFile.blockHashes[block].size(),
+                    inventoryFile.blockHashes[block].size());
+            }
+            inventoryFile.crc = file.crc;
+        }
+        if (file.compressedBlocks != nullptr)
+        {
+            inventoryFile.compressedBlockSizes.assign(file.compressedBlockSizes, file.compressedBlockSizes + file.blockCount);
+            inventoryFile.compressedBlocks = file.compressedBlocks;
+        }
+    }
 
     auto deleteFile = MSIX::scope_exit([&outputPackage]
     {
@@ -300,15 +1387,98 @@ MSIX_API HRESULT STDMETHODCALLTYPE PackPackage(
 
     MSIX::ComPtr<IStream> stream;
     ThrowHrIfFailed(CreateStreamOnFile(outputPackage, false, &stream));
+    auto from = MSIX::ComPtr<IDirectoryObject>::Make<MSIX::DirectoryObject>(directoryPath);
+    PackDirectory(packUnpackOptions, validationOption, from, stream.Get(), false, threadCount, compressionOption,
+        nullptr, progress, nullptr, &inventory);
+    deleteFile.release();
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
 
-    MSIX::ComPtr<IAppxFactory> factory;
-    ThrowHrIfFailed(CoCreateAppxFactoryWithHeap(InternalAllocate, InternalFree, validationOption, &factory));
+// Builds the bundle manifest straight from the manifests of the packages, the packages are referenced by it.
+// externalPackages, from a mapping file, are either manifests or packages.
+static void WriteBundleManifest(
+    const std::vector<std::pair<std::string, MSIX::ComPtr<IStream>>>& packageManifests,
+    const std::map<std::string, std::string>& externalPackages,
+    std::uint64_t bundleVersion,
+    IStream* bundleManifest)
+{
+    MSIX::ComPtr<IAppxFactory> appxFactory;
+    ThrowHrIfFailed(CoCreateAppxFactoryWithHeap(InternalAllocate, InternalFree,
+        MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+        &appxFactory));
+
+    MSIX::BundleWriterHelper bundleWriterHelper;
+    bundleWriterHelper.SetBundleVersion((bundleVersion != 0) ? bundleVersion : MSIX::BundleWriterHelper::GetDefaultBundleVersion());
+    for (const auto& packageManifest : packageManifests)
+    {
+        MSIX::ComPtr<IAppxManifestReader> manifestReader;
+        ThrowHrIfFailed(appxFactory->CreateManifestReader(packageManifest.second.Get(), &manifestReader));
+        bundleWriterHelper.AddPackageFromManifest(packageManifest.first, manifestReader.Get(), false);
+    }
+    for (const auto& externalPackage : externalPackages)
+    {
+        if (!MSIX::FileNameValidation::IsFootPrintFile(externalPackage.second, true))
+        {
+            auto inputStream = MSIX::ComPtr<IStream>::Make<MSIX::FileStream>(externalPackage.second, MSIX::FileStream::Mode::READ);
+            bundleWriterHelper.AddExternalPackageReference(appxFactory.Get(), externalPackage.first, inputStream.Get(), false);
+        }
+    }
+    bundleWriterHelper.EndBundleManifest();
+
+    auto stream = bundleWriterHelper.GetBundleManifestStream();
+    LARGE_INTEGER li{0};
+    ThrowHrIfFailed(stream->Seek(li, MSIX::StreamBase::Reference::START, nullptr));
+    ULARGE_INTEGER maxSize = { 0 };
+    maxSize.QuadPart = UINT64_MAX;
+    ThrowHrIfFailed(stream->CopyTo(bundleManifest, maxSize, nullptr, nullptr));
+}
 
-    MSIX::ComPtr<IAppxPackageWriter> writer;
-    ThrowHrIfFailed(factory->CreatePackageWriter(stream.Get(), nullptr, &writer));
-    writer.As<IPackageWriter>()->PackPayloadFiles(from);
-    ThrowHrIfFailed(writer->Close(manifest.Get()));
-    deleteFile.release();
+MSIX_API HRESULT STDMETHODCALLTYPE PackBundleManifest(
+    UINT32 packageCount,
+    LPCSTR* packageFileNames,
+    IStream** packageManifests,
+    UINT64 bundleVersion,
+    IStream* bundleManifest
+) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter,
+        (packageCount == 0 || packageFileNames == nullptr || packageManifests == nullptr || bundleManifest == nullptr),
+        "Invalid parameter");
+    std::vector<std::pair<std::string, MSIX::ComPtr<IStream>>> manifests;
+    for (UINT32 i = 0; i < packageCount; i++)
+    {
+        ThrowErrorIf(MSIX::Error::InvalidParameter, (packageFileNames[i] == nullptr || packageManifests[i] == nullptr), "Invalid parameter");
+        manifests.emplace_back(packageFileNames[i], MSIX::ComPtr<IStream>(packageManifests[i]));
+    }
+    WriteBundleManifest(manifests, std::map<std::string, std::string>(), bundleVersion, bundleManifest);
+    return static_cast<HRESULT>(MSIX::Error::OK);
+} CATCH_RETURN();
+
+MSIX_API HRESULT STDMETHODCALLTYPE ReplaceFootprintFiles(
+    char* utf8Package,
+    UINT32 fileCount,
+    APPX_FOOTPRINT_FILE_TYPE* fileTypes,
+    IStream** files
+) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter,
+        (utf8Package == nullptr || fileCount == 0 || fileTypes == nullptr || files == nullptr),
+        "Invalid parameter");
+    std::map<APPX_FOOTPRINT_FILE_TYPE, MSIX::ComPtr<IStream>> footprintFiles;
+    for (UINT32 i = 0; i < fileCount; i++)
+    {
+        ThrowErrorIf(MSIX::Error::InvalidParameter, (files[i] == nullptr), "Invalid parameter");
+        ThrowErrorIfNot(MSIX::Error::InvalidParameter, footprintFiles.emplace(fileTypes[i], MSIX::ComPtr<IStream>(files[i])).second,
+            "A footprint file is given more than once");
+    }
+
+    // The package is read and written in place
+    #ifdef WIN32
+    auto package = MSIX::ComPtr<IStream>::Make<MSIX::NativeFileStream>(MSIX::utf8_to_wstring(utf8Package), MSIX::FileStream::Mode::READ_UPDATE);
+    #else
+    auto package = MSIX::ComPtr<IStream>::Make<MSIX::NativeFileStream>(utf8Package, MSIX::FileStream::Mode::READ_UPDATE);
+    #endif
+    MSIX::ReplaceFootprintFiles(package.Get(), footprintFiles);
     return static_cast<HRESULT>(MSIX::Error::OK);
 } CATCH_RETURN();
 
@@ -318,6 +1488,18 @@ MSIX_API HRESULT STDMETHODCALLTYPE PackBundle(
     char* outputBundle,
     char* mappingFile,
     char* version
+) noexcept
+{
+    return PackBundleWithProgress(bundleOptions, directoryPath, outputBundle, mappingFile, version, nullptr);
+}
+
+MSIX_API HRESULT STDMETHODCALLTYPE PackBundleWithProgress(
+    MSIX_BUNDLE_OPTIONS bundleOptions,
+    char* directoryPath,
+    char* outputBundle,
+    char* mappingFile,
+    char* version,
+    IMsixProgressCallback* progress
 ) noexcept try
 {
     std::uint64_t bundleVersion = 0;
@@ -356,6 +1538,17 @@ MSIX_API HRESULT STDMETHODCALLTYPE PackBundle(
         manifestOnly = true;
     }
 
+    auto factoryOptions = MSIX_FACTORY_OPTION_NONE;
+    if (bundleOptions & MSIX_BUNDLE_OPTIONS::MSIX_BUNDLE_OPTION_READMANIFESTS)
+    {
+        factoryOptions = static_cast<MSIX_FACTORY_OPTIONS>(factoryOptions | MSIX_FACTORY_OPTION_WRITER_BUNDLE_READ_MANIFESTS);
+    }
+
+    if (bundleOptions & MSIX_BUNDLE_OPTIONS::MSIX_BUNDLE_OPTION_VALIDATEPACKAGES)
+    {
+        factoryOptions = static_cast<MSIX_FACTORY_OPTIONS>(factoryOptions | MSIX_FACTORY_OPTION_WRITER_BUNDLE_VALIDATE_PACKAGES);
+    }
+
     if (bundleOptions & MSIX_BUNDLE_OPTIONS::MSIX_OPTION_VERBOSE)
     {
         //TODO: Process option for verbose
@@ -392,25 +1585,35 @@ MSIX_API HRESULT STDMETHODCALLTYPE PackBundle(
     });
 
     MSIX::ComPtr<IStream> stream;
-    std::vector<std::uint8_t> streamVector;
+    ThrowHrIfFailed(CreateStreamOnFile(outputBundle, false, &stream));
 
     if(manifestOnly)
     {
-        stream = MSIX::ComPtr<IStream>::Make<MSIX::VectorStream>(&streamVector);
-    }
-    else
-    {
-        ThrowHrIfFailed(CreateStreamOnFile(outputBundle, false, &stream));
+        // The packages are only described by their manifests, so the bundle manifest references them
+        std::vector<std::pair<std::string, MSIX::ComPtr<IStream>>> manifests;
+        for (const auto& file : mappingFileParser.GetFileList())
+        {
+            auto manifestStream = MSIX::ComPtr<IStream>::Make<MSIX::FileStream>(file.second, MSIX::FileStream::Mode::READ);
+            manifests.emplace_back(file.first, std::move(manifestStream));
+        }
+        WriteBundleManifest(manifests, mappingFileParser.GetExternalPackagesList(), bundleVersion, stream.Get());
+        deleteFile.release();
+        return static_cast<HRESULT>(MSIX::Error::OK);
     }
 
     MSIX::ComPtr<IAppxBundleFactory> factory;
     MSIX_VALIDATION_OPTION validationOptions = MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_FULL;
     validationOptions = static_cast<MSIX_VALIDATION_OPTION>(validationOptions | MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE);
 
-    ThrowHrIfFailed(CoCreateAppxBundleFactoryWithHeap(InternalAllocate, InternalFree, 
+    ThrowHrIfFailed(CoCreateAppxBundleFactoryWithHeapAndOptions(InternalAllocate, InternalFree, 
         validationOptions,
         MSIX_APPLICABILITY_OPTIONS::MSIX_APPLICABILITY_OPTION_FULL,
+        factoryOptions,
         &factory));
+    if (progress != nullptr)
+    {
+        ThrowHrIfFailed(factory.As<IMsixFactoryOverrides>()->SpecifyExtension(MSIX_FACTORY_EXTENSION_PROGRESS_CALLBACK, progress));
+    }
 
     MSIX::ComPtr<IAppxBundleWriter> bundleWriter;
     MSIX::ComPtr<IAppxBundleWriter4> bundleWriter4;
@@ -418,53 +1621,14 @@ MSIX_API HRESULT STDMETHODCALLTYPE PackBundle(
     ThrowHrIfFailed(factory->CreateBundleWriter(stream.Get(), bundleVersion, &bundleWriter));
     bundleWriter4 = bundleWriter.As<IAppxBundleWriter4>();
 
-    if(manifestOnly)
+    if(directoryPath != nullptr && outputBundle != nullptr)
     {
-        MSIX::ComPtr<IAppxFactory> appxFactory;
-        ThrowHrIfFailed(CoCreateAppxFactoryWithHeap(InternalAllocate, InternalFree, 
-            MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE, 
-            &appxFactory));
-
-        std::map<std::string, std::string> fileList = mappingFileParser.GetFileList();
-        std::map<std::string, std::string>::iterator fileListIterator;
-        for (fileListIterator = fileList.begin(); fileListIterator != fileList.end(); fileListIterator++)
-        {
-            std::string inputPath = fileListIterator->second;
-            std::string outputPath = fileListIterator->first;
-
-            std::vector<std::uint8_t> tempPackageVector;
-            auto tempPackageStream = MSIX::ComPtr<IStream>::Make<MSIX::VectorStream>(&tempPackageVector);                
-
-            auto manifestStream = MSIX::ComPtr<IStream>::Make<MSIX::FileStream>(inputPath, MSIX::FileStream::Mode::READ);
-
-            MSIX::ComPtr<IAppxPackageWriter> tempPackageWriter;
-            ThrowHrIfFailed(appxFactory->CreatePackageWriter(tempPackageStream.Get(), nullptr, &tempPackageWriter));
-            ThrowHrIfFailed(tempPackageWriter->Close(manifestStream.Get()));
-
-            LARGE_INTEGER li{0};    
-            ThrowHrIfFailed(tempPackageStream->Seek(li, MSIX::StreamBase::Reference::START, nullptr));
-
-            if (flatBundle)
-            {
-                ThrowHrIfFailed(bundleWriter4->AddPackageReference(MSIX::utf8_to_wstring(outputPath).c_str(), tempPackageStream.Get(), false));
-            }
-            else
-            {
-                ThrowHrIfFailed(bundleWriter4->AddPayloadPackage(MSIX::utf8_to_wstring(outputPath).c_str(), tempPackageStream.Get(), false));
-            }
-        }
+        auto from = MSIX::ComPtr<IDirectoryObject>::Make<MSIX::DirectoryObject>(directoryPath);
+        bundleWriter4.As<IBundleWriter>()->ProcessBundlePayload(from, flatBundle);
     }
-    else
+    else if(mappingFile != nullptr && outputBundle != nullptr)
     {
-        if(directoryPath != nullptr && outputBundle != nullptr)
-        {
-            auto from = MSIX::ComPtr<IDirectoryObject>::Make<MSIX::DirectoryObject>(directoryPath);
-            bundleWriter4.As<IBundleWriter>()->ProcessBundlePayload(from, flatBundle);
-        }
-        else if(mappingFile != nullptr && outputBundle != nullptr)
-        {
-            bundleWriter4.As<IBundleWriter>()->ProcessBundlePayloadFromMappingFile(mappingFileParser.GetFileList(), flatBundle);
-        }
+        bundleWriter4.As<IBundleWriter>()->ProcessBundlePayloadFromMappingFile(mappingFileParser.GetFileList(), flatBundle);
     }
 
     if(!mappingFileParser.GetExternalPackagesList().empty())
@@ -474,42 +1638,27 @@ MSIX_API HRESULT STDMETHODCALLTYPE PackBundle(
 
     ThrowHrIfFailed(bundleWriter->Close());
 
-    if(manifestOnly)
-    {
-        LARGE_INTEGER li{0};    
-        ThrowHrIfFailed(stream->Seek(li, MSIX::StreamBase::Reference::START, nullptr));
-
-        MSIX_VALIDATION_OPTION validationOption = static_cast<MSIX_VALIDATION_OPTION>(MSIX_VALIDATION_OPTION_SKIPSIGNATURE | MSIX_VALIDATION_OPTION_SKIPPACKAGEVALIDATION);
-        MSIX_APPLICABILITY_OPTIONS applicabilityOption = static_cast<MSIX_APPLICABILITY_OPTIONS>(MSIX_APPLICABILITY_NONE);
-        
-        MSIX::ComPtr<IAppxBundleFactory> appxBundleFactory;
-        ThrowHrIfFailed(CoCreateAppxBundleFactoryWithHeap(InternalAllocate, InternalFree, 
-            validationOption, 
-            applicabilityOption,
-            &appxBundleFactory));
-
-        MSIX::ComPtr<IAppxBundleReader> bundleReader;
-        ThrowHrIfFailed(appxBundleFactory->CreateBundleReader(stream.Get(), &bundleReader));
-
-        MSIX::ComPtr<IAppxBundleManifestReader> bundleManifestReader;
-        ThrowHrIfFailed(bundleReader->GetManifest(&bundleManifestReader));
-        
-        MSIX::ComPtr<IStream> bundleManifestStream;
-        ThrowHrIfFailed(bundleManifestReader->GetStream(&bundleManifestStream));
+    deleteFile.release();
+    return static_cast<HRESULT>(MSIX::Error::OK);
 
-        MSIX::ComPtr<IStream> bundleManifestOutputStream;
-        ThrowHrIfFailed(CreateStreamOnFile(outputBundle, false, &bundleManifestOutputStream));
+} CATCH_RETURN();
 
-        ULARGE_INTEGER maxSize = { 0 };
-        maxSize.QuadPart = UINT64_MAX;
-        ULARGE_INTEGER sizeRead = { 0 };
-        ULARGE_INTEGER sizeWritten = { 0 };
-        bundleManifestStream->CopyTo(bundleManifestOutputStream.Get(), maxSize, &sizeRead, &sizeWritten);
+MSIX_API HRESULT STDMETHODCALLTYPE MsixSetCompressedBlockCache(
+    IUnknown* factory,
+    char* utf8CacheDirectory,
+    UINT64 maxMemoryBytes) noexcept try
+{
+    ThrowErrorIf(MSIX::Error::InvalidParameter, (factory == nullptr), "bad pointer");
+    MSIX::ComPtr<IMsixFactory> msixFactory;
+    ThrowHrIfFailed(factory->QueryInterface(UuidOfImpl<IMsixFactory>::iid, reinterpret_cast<void**>(&msixFactory)));
+    std::shared_ptr<MSIX::CompressedBlockCache> compressedBlockCache;
+    if ((utf8CacheDirectory != nullptr) || (maxMemoryBytes != 0))
+    {
+        compressedBlockCache = std::make_shared<MSIX::CompressedBlockCache>(
+            (utf8CacheDirectory != nullptr) ? utf8CacheDirectory : "", static_cast<std::uint64_t>(maxMemoryBytes));
     }
-
-    deleteFile.release();
+    msixFactory->SetCompressedBlockCache(compressedBlockCache);
     return static_cast<HRESULT>(MSIX::Error::OK);
-
 } CATCH_RETURN();
 
 #endif // MSIX_PACK
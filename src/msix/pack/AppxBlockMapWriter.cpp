@@ -6,8 +6,10 @@
 #include "XmlWriter.hpp"
 #include "AppxBlockMapWriter.hpp"
 #include "StringHelper.hpp"
+#include "SpillStream.hpp"
 
 #include <vector>
+#include <algorithm>
 
 namespace MSIX {
 
@@ -43,7 +45,9 @@ namespace MSIX {
     static const char* hashAttribute = "Hash";
 
     // <BlockMap HashMethod="http://www.w3.org/2001/04/xmlenc#sha256" xmlns="http://schemas.microsoft.com/appx/2010/blockmap">
-    BlockMapWriter::BlockMapWriter() : m_xmlWriter(XmlWriter(blockMapElement))
+    BlockMapWriter::BlockMapWriter(const std::shared_ptr<MemoryBudget>& memoryBudget) :
+        m_xmlWriter(XmlWriter(blockMapElement, ComPtr<IStream>::Make<SpillStream>(
+            (memoryBudget && memoryBudget->IsLimited()) ? std::min(BlockMapSpillThreshold, memoryBudget->GetLimit() / 16) : BlockMapSpillThreshold).Get()))
     {
         m_xmlWriter.AddAttribute(xmlnsAttribute, blockMapNamespace);
 
@@ -63,20 +67,23 @@ namespace MSIX {
     }
 
     // <File Size="18944" Name="App1.exe" LfhSize="38">
-    void BlockMapWriter::AddFile(const std::string& name, std::uint64_t uncompressedSize, std::uint32_t lfh)
+    void BlockMapWriter::AddFile(const PackageFileName& file, std::uint64_t uncompressedSize, std::uint32_t lfh)
     {
         // For the blockmap we always use the windows separator.
-        std::string winName = Helper::toBackSlash(name);
         m_xmlWriter.StartElement(fileElement);
-        m_xmlWriter.AddAttribute(nameAttribute, winName);
-        m_xmlWriter.AddAttribute(sizeAttribute, std::to_string(uncompressedSize));
-        m_xmlWriter.AddAttribute(lfhSizeAttribute, std::to_string(lfh));
+        m_xmlWriter.AddAttribute(nameAttribute, file.blockMapName);
+        m_xmlWriter.AddNumericAttribute(sizeAttribute, uncompressedSize);
+        m_xmlWriter.AddNumericAttribute(lfhSizeAttribute, lfh);
 
         if (m_enableFileHash && (uncompressedSize > DefaultBlockSize))
         {
             // If the file size is more than a block (64KB), we will add <FileHash> element after all the <Block> elements.
             // Otherwise, file hash is the same as the block hash, as there is only 1 block in the file.
-            m_fileHashEngine.Reset();
+            if (!m_fileHasher)
+            {
+                m_fileHasher = std::make_unique<FileHasher>();
+            }
+            m_fileHasher->Start();
             m_addFileHash = true;
         }
         else
@@ -86,27 +93,35 @@ namespace MSIX {
     }
 
     // <Block Size="2948" Hash="ORIk+3QF9mSpuOq51oT3Xqn0Gy0vcGbnBRn5lBg5irM="/>
-    void BlockMapWriter::AddBlock(const std::vector<std::uint8_t>& block, ULONG size, bool isCompressed)
+    void BlockMapWriter::AddBlock(const std::uint8_t* block, std::uint32_t blockSize, ULONG size, bool isCompressed)
     {
+        PerformanceCounters::Measure measure(m_performanceCounters.get(), MSIX_PERFORMANCE_COUNTER_STAGE_BLOCKMAP, blockSize);
         // hash block
-        std::vector<std::uint8_t> hash;
-        ThrowErrorIfNot(MSIX::Error::BlockMapInvalidData,
-            MSIX::SHA256::ComputeHash(block.data(), static_cast<uint32_t>(block.size()), hash), 
-            "Failed computing hash");
+        MSIX::SHA256::ComputeHash(block, blockSize, m_blockHash);
+        WriteBlock(block, blockSize, m_blockHash, size, isCompressed);
+    }
 
+    void BlockMapWriter::AddBlock(const std::uint8_t* block, std::uint32_t blockSize, const Sha256Digest& hash, ULONG size, bool isCompressed)
+    {
+        PerformanceCounters::Measure measure(m_performanceCounters.get(), MSIX_PERFORMANCE_COUNTER_STAGE_BLOCKMAP, blockSize);
+        WriteBlock(block, blockSize, hash, size, isCompressed);
+    }
+
+    void BlockMapWriter::WriteBlock(const std::uint8_t* block, std::uint32_t blockSize, const Sha256Digest& hash, ULONG size, bool isCompressed)
+    {
         m_xmlWriter.StartElement(blockElement);
-        m_xmlWriter.AddAttribute(hashAttribute, Base64::ComputeBase64(hash));
+        m_xmlWriter.AddBase64Attribute(hashAttribute, hash.data(), hash.size());
         // We only add the size attribute for compressed files, we cannot just check for the 
         // size of the block because the last block is going to be smaller than the default.
         if(isCompressed)
         {
-            m_xmlWriter.AddAttribute(sizeAttribute, std::to_string(size));
+            m_xmlWriter.AddNumericAttribute(sizeAttribute, size);
         }
         m_xmlWriter.CloseElement();
 
         if (m_addFileHash)
         {
-            m_fileHashEngine.HashData(block.data(), static_cast<uint32_t>(block.size()));
+            m_fileHasher->Add(block, blockSize);
         }
     }
 
@@ -114,12 +129,12 @@ namespace MSIX {
     {
         if (m_addFileHash)
         {
-            std::vector<std::uint8_t> hash;
-            m_fileHashEngine.FinalizeAndGetHashValue(hash);
+            Sha256Digest hash;
+            m_fileHasher->Finish(hash);
 
             // <b4:FileHash Hash="4EsIP4hU04SShLPR1KIiRBzuYpLVPcETqMp1HZaKdfc="/>
             m_xmlWriter.StartElement(fileHashElementV4);
-            m_xmlWriter.AddAttribute(hashAttribute, Base64::ComputeBase64(hash));
+            m_xmlWriter.AddBase64Attribute(hashAttribute, hash.data(), hash.size());
             m_xmlWriter.CloseElement();
         }
 
@@ -131,4 +146,103 @@ namespace MSIX {
         m_xmlWriter.CloseElement();
         ThrowErrorIf(Error::Unexpected, m_xmlWriter.GetState() != XmlWriter::Finish, "The blockmap didn't close correctly");
     }
+
+    namespace {
+        // 1 MB of blocks waiting to be hashed
+        const std::size_t FileHashQueueSize = 16;
+    }
+
+    FileHasher::~FileHasher()
+    {
+        if (m_thread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_stop = true;
+            }
+            m_changed.notify_all();
+            m_thread.join();
+        }
+    }
+
+    void FileHasher::Start()
+    {
+        if (!m_thread.joinable())
+        {
+            m_thread = std::thread([this]() { Run(); });
+        }
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_engine.Reset();
+        m_failure = nullptr;
+    }
+
+    void FileHasher::Add(const std::uint8_t* block, std::uint32_t blockSize)
+    {
+        std::vector<std::uint8_t> buffer;
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_changed.wait(lock, [this]() { return m_queue.size() < FileHashQueueSize; });
+            if (!m_free.empty())
+            {
+                buffer = std::move(m_free.back());
+                m_free.pop_back();
+            }
+        }
+        buffer.assign(block, block + blockSize);
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_queue.push_back(std::move(buffer));
+        }
+        m_changed.notify_all();
+    }
+
+    void FileHasher::Finish(Sha256Digest& hash)
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_changed.wait(lock, [this]() { return m_queue.empty() && !m_hashing; });
+        if (m_failure)
+        {
+            std::rethrow_exception(m_failure);
+        }
+        m_engine.FinalizeAndGetHashValue(hash);
+    }
+
+    // Only this thread uses m_engine while m_hashing is set, Start and Finish wait for it to be done
+    void FileHasher::Run() noexcept
+    {
+        std::unique_lock<std::mutex> lock(m_lock);
+        while (true)
+        {
+            m_changed.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty())
+            {
+                return;
+            }
+            auto block = std::move(m_queue.front());
+            m_queue.pop_front();
+            bool failed = static_cast<bool>(m_failure);
+            m_hashing = true;
+            lock.unlock();
+            std::exception_ptr failure;
+            if (!failed)
+            {
+                try
+                {
+                    m_engine.HashData(block.data(), static_cast<std::uint32_t>(block.size()));
+                }
+                catch (...)
+                {
+                    failure = std::current_exception();
+                }
+            }
+            lock.lock();
+            m_hashing = false;
+            if (failure)
+            {
+                m_failure = failure;
+            }
+            m_free.push_back(std::move(block));
+            m_changed.notify_all();
+        }
+    }
 }
@@ -15,24 +15,51 @@
 #include "FileNameValidation.hpp"
 #include "StringHelper.hpp"
 #include "VectorStream.hpp"
-
-#include <ctime>
-#include <iomanip>
+#include "Crc32.hpp"
+#include "PackageIdentityReader.hpp"
+#include "WorkerPool.hpp"
+#include "ProgressReporter.hpp"
+#include "Tracing.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
 
 namespace MSIX {
 
-    AppxBundleWriter::AppxBundleWriter(IMsixFactory* factory, const ComPtr<IZipWriter>& zip, std::uint64_t bundleVersion)
-        : m_factory(factory), m_zipWriter(zip)
+    namespace {
+
+    // Stored files are copied in chunks of whole blocks.
+    const std::uint32_t StoredCopyChunkSize = 64 * DefaultBlockSize;
+
+    // Returns the bytes of the whole stream if it can expose them without copying, like a mapped file.
+    // The stream must be at its start.
+    const std::uint8_t* GetStreamView(IStream* stream, std::uint64_t size)
     {
+        ComPtr<IStreamInternal> streamInternal;
+        if (FAILED(stream->QueryInterface(UuidOfImpl<IStreamInternal>::iid, reinterpret_cast<void**>(&streamInternal))))
+        {
+            return nullptr;
+        }
+        std::uint64_t available = 0;
+        const std::uint8_t* view = streamInternal->GetRawView(available);
+        return (available >= size) ? view : nullptr;
+    }
+
+    }
+
+    AppxBundleWriter::AppxBundleWriter(IMsixFactory* factory, const ComPtr<IZipWriter>& zip, std::uint64_t bundleVersion,
+        bool readManifests, bool validatePackages)
+        : m_factory(factory), m_zipWriter(zip), m_blockMapWriter(factory->GetMemoryBudget()),
+        m_readManifests(readManifests), m_validatePackages(readManifests && validatePackages)
+    {
+        m_blockMapWriter.SetPerformanceCounters(m_factory->GetPerformanceCounters());
         m_state = WriterState::Open;
         if(bundleVersion == 0)
         {
-            // The generated version number has the format: YYYY.MMDD.hhmm.0
-            std::time_t t = std::time(nullptr);
-            std::tm tm = *std::gmtime(&t);
-            std::stringstream ss;
-            ss << std::put_time(&tm, "%Y.%m%d.%H%M.0");
-            this->m_bundleWriterHelper.SetBundleVersion(ConvertVersionStringToUint64(ss.str()));
+            this->m_bundleWriterHelper.SetBundleVersion(BundleWriterHelper::GetDefaultBundleVersion());
         }
         else
         {
@@ -49,6 +76,7 @@ namespace MSIX {
                 this->m_state = WriterState::Failed;
             });
 
+        std::vector<std::pair<std::string, ComPtr<IStream>>> packages;
         auto fileMap = from->GetFilesByLastModDate();
         for (const auto& file : fileMap)
         {
@@ -58,12 +86,10 @@ namespace MSIX {
                 auto contentType = ContentType::GetContentTypeByExtension(ext);
                 auto stream = from.As<IStorageObject>()->GetFile(file.second);
 
-                if (flatBundle)
-                {
-                    ThrowHrIfFailed(AddPackageReference(utf8_to_wstring(file.second).c_str(), stream.Get(), false));
-                }
+                packages.emplace_back(file.second, std::move(stream));
             }
         }
+        AddPackages(packages, flatBundle);
 
         failState.release();
     }
@@ -76,6 +102,7 @@ namespace MSIX {
                 this->m_state = WriterState::Failed;
             });
 
+        std::vector<std::pair<std::string, ComPtr<IStream>>> packages;
         std::map<std::string, std::string>::iterator fileListIterator;
         for (fileListIterator = fileList.begin(); fileListIterator != fileList.end(); fileListIterator++)
         {
@@ -88,12 +115,10 @@ namespace MSIX {
                 auto contentType = ContentType::GetContentTypeByExtension(ext);
                 auto stream = ComPtr<IStream>::Make<FileStream>(inputPath, FileStream::Mode::READ);
 
-                if (flatBundle)
-                {
-                    ThrowHrIfFailed(AddPackageReference(utf8_to_wstring(outputPath).c_str(), stream.Get(), false));
-                }
+                packages.emplace_back(outputPath, std::move(stream));
             }
         }
+        AddPackages(packages, flatBundle);
         failState.release();
     }
 
@@ -114,11 +139,10 @@ namespace MSIX {
     }
 
     // IAppxBundleWriter
-    HRESULT STDMETHODCALLTYPE AppxBundleWriter::AddPayloadPackage(LPCWSTR fileName, IStream* packageStream) noexcept try
+    HRESULT STDMETHODCALLTYPE AppxBundleWriter::AddPayloadPackage(LPCWSTR fileName, IStream* packageStream) noexcept
     {
-        // TODO: implement
-        NOTIMPLEMENTED;
-    } CATCH_RETURN();
+        return AddPayloadPackage(fileName, packageStream, FALSE);
+    }
 
     HRESULT STDMETHODCALLTYPE AppxBundleWriter::Close() noexcept try
     {
@@ -133,18 +157,18 @@ namespace MSIX {
 
         auto bundleManifestStream = m_bundleWriterHelper.GetBundleManifestStream();
         auto bundleManifestContentType = ContentType::GetBundlePayloadFileContentType(APPX_BUNDLE_FOOTPRINT_FILE_TYPE_MANIFEST);
-        AddFileToPackage(APPXBUNDLEMANIFEST_XML, bundleManifestStream.Get(), true, true, bundleManifestContentType.c_str());
+        AddFileToPackage(APPXBUNDLEMANIFEST_XML, bundleManifestStream.Get(), APPX_COMPRESSION_OPTION_NORMAL, true, bundleManifestContentType.c_str());
 
         // Close blockmap and add it to the bundle
         m_blockMapWriter.Close();
         auto blockMapStream = m_blockMapWriter.GetStream();
         auto blockMapContentType = ContentType::GetPayloadFileContentType(APPX_FOOTPRINT_FILE_TYPE_BLOCKMAP);
-        AddFileToPackage(APPXBLOCKMAP_XML, blockMapStream.Get(), true, false, blockMapContentType.c_str());
+        AddFileToPackage(APPXBLOCKMAP_XML, blockMapStream.Get(), APPX_COMPRESSION_OPTION_NORMAL, false, blockMapContentType.c_str());
 
         // Close content types and add it to the bundle
         m_contentTypeWriter.Close();
         auto contentTypeStream = m_contentTypeWriter.GetStream();
-        AddFileToPackage(CONTENT_TYPES_XML, contentTypeStream.Get(), true, false, nullptr);
+        AddFileToPackage(CONTENT_TYPES_XML, contentTypeStream.Get(), APPX_COMPRESSION_OPTION_NORMAL, false, nullptr);
 
         m_zipWriter->Close();
         failState.release();
@@ -163,21 +187,206 @@ namespace MSIX {
     void AppxBundleWriter::AddPackageReferenceInternal(std::string fileName, IStream* packageStream,
         bool isDefaultApplicablePackage)
     {
-        auto appxFactory = m_factory.As<IAppxFactory>();
+        if (m_validatePackages)
+        {
+            ValidatePackage(packageStream);
+        }
+        auto manifestReader = ReadPackageManifest(packageStream);
+
+        std::uint64_t packageStreamSize = this->m_bundleWriterHelper.GetStreamSize(packageStream);
+                
+        this->m_bundleWriterHelper.AddPackage(fileName, manifestReader.Get(), 0, packageStreamSize, isDefaultApplicablePackage);
+    }
+
+    ComPtr<IAppxManifestReader> AppxBundleWriter::ReadPackageManifest(IStream* packageStream)
+    {
+        if (m_readManifests)
+        {
+            return MSIX::ReadPackageManifest(m_factory.Get(), ComPtr<IStream>(packageStream));
+        }
+        ComPtr<IAppxPackageReader> reader;
+        ThrowHrIfFailed(m_factory.As<IAppxFactory>()->CreatePackageReader(packageStream, &reader));
+        ComPtr<IAppxManifestReader> manifestReader;
+        ThrowHrIfFailed(reader->GetManifest(&manifestReader));
+        return manifestReader;
+    }
 
+    void AppxBundleWriter::ValidatePackage(IStream* packageStream)
+    {
         ComPtr<IAppxPackageReader> reader;
-        ThrowHrIfFailed(appxFactory->CreatePackageReader(packageStream, &reader));
+        ThrowHrIfFailed(m_factory.As<IAppxFactory>()->CreatePackageReader(packageStream, &reader));
+    }
+
+    void AppxBundleWriter::AddPayloadPackageInternal(const std::string& fileName, IStream* packageStream,
+        IAppxManifestReader* manifestReader, bool isDefaultApplicablePackage)
+    {
+        ComPtr<IAppxManifestPackageId> packageId;
+        APPX_BUNDLE_PAYLOAD_PACKAGE_TYPE packageType = APPX_BUNDLE_PAYLOAD_PACKAGE_TYPE::APPX_BUNDLE_PAYLOAD_PACKAGE_TYPE_APPLICATION;
+        ComPtr<IAppxManifestQualifiedResourcesEnumerator> resources;
+        ComPtr<IAppxManifestTargetDeviceFamiliesEnumerator> tdfs;
+
+        // Validate the package before its bytes are copied into the bundle
+        this->m_bundleWriterHelper.GetValidatedPackageData(fileName, manifestReader, &packageType, &packageId, &resources, &tdfs);
 
         std::uint64_t packageStreamSize = this->m_bundleWriterHelper.GetStreamSize(packageStream);
-                
-        this->m_bundleWriterHelper.AddPackage(fileName, reader.Get(), 0, packageStreamSize, isDefaultApplicablePackage);
+        std::string ext = Helper::tolower(fileName.substr(fileName.find_last_of(".") + 1));
+        auto contentType = ContentType::GetContentTypeByExtension(ext);
+        // Payload packages are always stored. They aren't in the bundle block map, their own block maps cover them.
+        ThrowErrorIfNot(Error::InvalidParameter, FileNameValidation::IsFileNameValid(fileName), "Invalid file name");
+        auto offset = AddFileToPackage(fileName, packageStream, APPX_COMPRESSION_OPTION_NONE, false, contentType.GetContentType().c_str());
+
+        this->m_bundleWriterHelper.AddValidatedPackageData(fileName, offset, packageStreamSize, packageType, packageId,
+            isDefaultApplicablePackage, resources.Get(), tdfs.Get());
+    }
+
+    void AppxBundleWriter::AddPackages(const std::vector<std::pair<std::string, ComPtr<IStream>>>& packages, bool flatBundle)
+    {
+        // Progress goes by package, a package is copied in one go or only referenced
+        auto progress = m_factory->GetProgressReporter();
+        if (progress->IsEnabled())
+        {
+            std::uint64_t totalSize = 0;
+            for (const auto& package : packages)
+            {
+                totalSize += m_bundleWriterHelper.GetStreamSize(package.second.Get());
+            }
+            progress->AddWork(totalSize, static_cast<std::uint32_t>(packages.size()));
+        }
+
+        auto addPackage = [this, flatBundle, &progress](const std::pair<std::string, ComPtr<IStream>>& package, IAppxManifestReader* manifestReader)
+        {
+            std::uint64_t packageStreamSize = this->m_bundleWriterHelper.GetStreamSize(package.second.Get());
+            if (flatBundle)
+            {
+                this->m_bundleWriterHelper.AddPackage(package.first, manifestReader, 0, packageStreamSize, false);
+            }
+            else
+            {
+                AddPayloadPackageInternal(package.first, package.second.Get(), manifestReader, false);
+            }
+            progress->Advance(packageStreamSize, 1);
+        };
+
+        auto workerPool = m_factory->GetWorkerPool();
+        if (m_validatePackages)
+        {
+            // Every package is validated before the first one is added, so an invalid package fails the bundle
+            // before anything is written. Each package stream is used by one worker at a time.
+            workerPool->ForEach(packages.size(), workerPool->GetWorkerCount(0), [this, &packages](std::size_t index)
+            {
+                ValidatePackage(packages[index].second.Get());
+            });
+        }
+
+        auto workerCount = std::min<std::size_t>(workerPool->GetConcurrency(), packages.size());
+        if (workerCount <= 1)
+        {
+            for (const auto& package : packages)
+            {
+                auto manifestReader = ReadPackageManifest(package.second.Get());
+                addPackage(package, manifestReader.Get());
+            }
+            return;
+        }
+
+        // Opening a package reader parses and validates the package, which is most of the work, and reading
+        // a manifest alone is still parsing it. The packages are added to the helper on this thread in their
+        // original order, so the bundle manifest and the first error reported are the same as adding them one
+        // by one.
+        struct OpenedPackage
+        {
+            ComPtr<IAppxManifestReader> manifestReader;
+            std::exception_ptr failure;
+            bool done = false;
+        };
+        std::vector<OpenedPackage> opened(packages.size());
+        std::mutex lock;
+        std::condition_variable ready;
+        std::atomic<std::size_t> next(0);
+        std::atomic<bool> cancelled(false);
+
+        auto open = [&](std::size_t index)
+        {
+            ComPtr<IAppxManifestReader> manifestReader;
+            std::exception_ptr failure;
+            try
+            {
+                manifestReader = ReadPackageManifest(packages[index].second.Get());
+            }
+            catch (...)
+            {
+                failure = std::current_exception();
+            }
+            std::lock_guard<std::mutex> guard(lock);
+            opened[index].manifestReader = std::move(manifestReader);
+            opened[index].failure = failure;
+            opened[index].done = true;
+            ready.notify_all();
+        };
+        auto worker = [&]()
+        {
+            std::size_t index;
+            while (!cancelled && (index = next++) < packages.size())
+            {
+                open(index);
+            }
+        };
+
+        std::vector<std::shared_ptr<PoolTask>> workers;
+        auto waitForWorkers = MSIX::scope_exit([&]()
+        {
+            cancelled = true;
+            for (auto& task : workers) { task->Wait(); }
+        });
+        for (std::size_t i = 0; i < workerCount; i++)
+        {
+            workers.push_back(workerPool->Async(worker));
+        }
+
+        for (std::size_t index = 0; index < packages.size(); index++)
+        {
+            // A package no worker has taken yet is opened here, so this doesn't wait on a pool that is busy
+            // with other work.
+            auto unclaimed = index;
+            if (next.compare_exchange_strong(unclaimed, index + 1))
+            {
+                open(index);
+            }
+            ComPtr<IAppxManifestReader> manifestReader;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                ready.wait(guard, [&]() { return opened[index].done; });
+                if (opened[index].failure) { std::rethrow_exception(opened[index].failure); }
+                manifestReader = std::move(opened[index].manifestReader);
+            }
+            addPackage(packages[index], manifestReader.Get());
+        }
     }
 
     HRESULT STDMETHODCALLTYPE AppxBundleWriter::AddPayloadPackage(LPCWSTR fileName, IStream* packageStream, 
         BOOL isDefaultApplicablePackage) noexcept try
     {
-        // TODO: implement
-        NOTIMPLEMENTED;
+        ThrowErrorIf(Error::InvalidState, m_state != WriterState::Open, "Invalid package writer state");
+        auto failState = MSIX::scope_exit([this]
+            {
+                this->m_state = WriterState::Failed;
+            });
+        if (m_validatePackages)
+        {
+            ValidatePackage(packageStream);
+        }
+        auto manifestReader = ReadPackageManifest(packageStream);
+        auto progress = m_factory->GetProgressReporter();
+        std::uint64_t packageStreamSize = 0;
+        if (progress->IsEnabled())
+        {
+            packageStreamSize = m_bundleWriterHelper.GetStreamSize(packageStream);
+            progress->AddWork(packageStreamSize, 1);
+        }
+        AddPayloadPackageInternal(wstring_to_utf8(fileName), packageStream, manifestReader.Get(), !!isDefaultApplicablePackage);
+        progress->Advance(packageStreamSize, 1);
+        failState.release();
+        return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
 
     HRESULT STDMETHODCALLTYPE AppxBundleWriter::AddExternalPackageReference(LPCWSTR fileName,
@@ -190,26 +399,7 @@ namespace MSIX {
     void AppxBundleWriter::AddExternalPackageReferenceInternal(std::string fileName, IStream* packageStream, bool isDefaultApplicablePackage)
     {
         auto appxFactory = m_factory.As<IAppxFactory>();
-
-        ComPtr<IAppxManifestReader> manifestReader;
-        HRESULT hr = appxFactory->CreateManifestReader(packageStream, &manifestReader);
-        if(SUCCEEDED(hr))
-        {
-            this->m_bundleWriterHelper.AddExternalPackageReferenceFromManifest(fileName, manifestReader.Get(), isDefaultApplicablePackage);
-            return;
-        }
-
-        ComPtr<IAppxPackageReader> packageReader;
-        hr = appxFactory->CreatePackageReader(packageStream, &packageReader);
-        if(SUCCEEDED(hr))
-        {
-            ComPtr<IAppxManifestReader> manifestReader;
-            ThrowHrIfFailed(packageReader->GetManifest(&manifestReader));
-            this->m_bundleWriterHelper.AddExternalPackageReferenceFromManifest(fileName, manifestReader.Get(), isDefaultApplicablePackage);
-            return;
-        }
-
-        ThrowErrorAndLog(Error::InvalidData, "The data is invalid.");
+        this->m_bundleWriterHelper.AddExternalPackageReference(appxFactory.Get(), fileName, packageStream, isDefaultApplicablePackage);
     }
 
     void AppxBundleWriter::ValidateAndAddPayloadFile(const std::string& name, IStream* stream,
@@ -219,12 +409,14 @@ namespace MSIX {
         ThrowErrorIf(Error::InvalidParameter, FileNameValidation::IsFootPrintFile(name, false), "Trying to add footprint file to package");
         ThrowErrorIf(Error::InvalidParameter, FileNameValidation::IsReservedFolder(name), "Trying to add file in reserved folder");
         ValidateCompressionOption(compressionOpt);
-        AddFileToPackage(name, stream, compressionOpt != APPX_COMPRESSION_OPTION_NONE, true, contentType);
+        AddFileToPackage(name, stream, compressionOpt, true, contentType);
     }
 
-    void AppxBundleWriter::AddFileToPackage(const std::string& name, IStream* stream, bool toCompress,
+    std::uint64_t AppxBundleWriter::AddFileToPackage(const std::string& name, IStream* stream, APPX_COMPRESSION_OPTION compressionOpt,
         bool addToBlockMap, const char* contentType, bool forceContentTypeOverride)
     {
+        Tracing::Activity activity(Tracing::Event::PackFile, name);
+        bool toCompress = (compressionOpt != APPX_COMPRESSION_OPTION_NONE);
         std::string opcFileName;
         // Don't encode [Content Type].xml
         if (contentType != nullptr)
@@ -235,7 +427,8 @@ namespace MSIX {
         {
             opcFileName = name;
         }
-        auto fileInfo = m_zipWriter->PrepareToAddFile(opcFileName, toCompress);
+        auto fileInfo = m_zipWriter->PrepareToAddFile(opcFileName, compressionOpt, false);
+        auto offset = m_zipWriter->GetCurrentFileOffset();
 
         // Add content type to [Content Types].xml
         if (contentType != nullptr)
@@ -257,22 +450,33 @@ namespace MSIX {
         }
 
         auto& zipFileStream = fileInfo.second;
+        if (!toCompress)
+        {
+            auto storedCrc = WriteStoredFile(stream, uncompressedSize, zipFileStream.Get(), addToBlockMap);
+            if (addToBlockMap)
+            {
+                m_blockMapWriter.CloseFile();
+            }
+            m_zipWriter->EndFile(storedCrc, uncompressedSize, uncompressedSize, true);
+            return offset;
+        }
 
         std::uint64_t bytesToRead = uncompressedSize;
         std::uint32_t crc = 0;
+        std::vector<std::uint8_t> block;
+        block.reserve(static_cast<std::size_t>(std::min<std::uint64_t>(bytesToRead, DefaultBlockSize)));
         while (bytesToRead > 0)
         {
             // Calculate the size of the next block to add
             std::uint32_t blockSize = (bytesToRead > DefaultBlockSize) ? DefaultBlockSize : static_cast<std::uint32_t>(bytesToRead);
             bytesToRead -= blockSize;
 
-            // read block from stream
-            std::vector<std::uint8_t> block;
+            // read block from stream. Only the last block is smaller, so this never reallocates.
             block.resize(blockSize);
             ULONG bytesRead;
             ThrowHrIfFailed(stream->Read(static_cast<void*>(block.data()), static_cast<ULONG>(blockSize), &bytesRead));
             ThrowErrorIfNot(Error::FileRead, (static_cast<ULONG>(blockSize) == bytesRead), "Read stream file failed");
-            crc = crc32(crc, block.data(), static_cast<uInt>(block.size()));
+            crc = Crc32::Update(crc, block.data(), block.size());
 
             // Write block and compress if needed
             ULONG bytesWritten = 0;
@@ -281,7 +485,7 @@ namespace MSIX {
             // Add block to blockmap
             if (addToBlockMap)
             {
-                m_blockMapWriter.AddBlock(block, bytesWritten, toCompress);
+                m_blockMapWriter.AddBlock(block.data(), static_cast<std::uint32_t>(block.size()), bytesWritten, toCompress);
             }
 
         }
@@ -303,6 +507,54 @@ namespace MSIX {
         // This could be the compressed or uncompressed size
         auto streamSize = zipFileStream.As<IStreamInternal>()->GetSize();
         m_zipWriter->EndFile(crc, streamSize, uncompressedSize, true);
+        return offset;
+    }
+
+    // Stored files, like the payload packages, are copied in large chunks straight from the source when it's
+    // mapped. The crc and the block hashes are computed from the same bytes that are written.
+    std::uint32_t AppxBundleWriter::WriteStoredFile(IStream* stream, std::uint64_t size, IStream* zipFileStream, bool addToBlockMap)
+    {
+        const std::uint8_t* view = GetStreamView(stream, size);
+        std::vector<std::uint8_t> buffer;
+        if (view == nullptr)
+        {
+            buffer.resize(static_cast<std::size_t>(std::min<std::uint64_t>(size, StoredCopyChunkSize)));
+        }
+
+        std::uint32_t crc = 0;
+        std::uint64_t copied = 0;
+        while (copied < size)
+        {
+            auto chunkSize = static_cast<ULONG>(std::min<std::uint64_t>(size - copied, StoredCopyChunkSize));
+            const std::uint8_t* chunk = nullptr;
+            if (view != nullptr)
+            {
+                chunk = view + copied;
+            }
+            else
+            {
+                ULONG bytesRead = 0;
+                ThrowHrIfFailed(stream->Read(static_cast<void*>(buffer.data()), chunkSize, &bytesRead));
+                ThrowErrorIfNot(Error::FileRead, (chunkSize == bytesRead), "Read stream file failed");
+                chunk = buffer.data();
+            }
+            crc = Crc32::Update(crc, chunk, chunkSize);
+
+            ULONG bytesWritten = 0;
+            ThrowHrIfFailed(zipFileStream->Write(chunk, chunkSize, &bytesWritten));
+            ThrowErrorIfNot(Error::FileWrite, (chunkSize == bytesWritten), "Write stream file failed");
+
+            if (addToBlockMap)
+            {
+                for (ULONG blockOffset = 0; blockOffset < chunkSize; blockOffset += DefaultBlockSize)
+                {
+                    auto blockSize = std::min<ULONG>(chunkSize - blockOffset, DefaultBlockSize);
+                    m_blockMapWriter.AddBlock(chunk + blockOffset, blockSize, blockSize, false);
+                }
+            }
+            copied += chunkSize;
+        }
+        return crc;
     }
 
     void AppxBundleWriter::ValidateCompressionOption(APPX_COMPRESSION_OPTION compressionOpt)
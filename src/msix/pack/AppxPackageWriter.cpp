@@ -14,17 +14,113 @@
 #include "ScopeExit.hpp"
 #include "FileNameValidation.hpp"
 #include "StringHelper.hpp"
+#include "DeflateStream.hpp"
+#include "Crypto.hpp"
+#include "Crc32.hpp"
+#include "WorkerPool.hpp"
+#include "ProgressReporter.hpp"
+#include "Tracing.hpp"
+#include "AppxSignature.hpp"
+#include "StreamHelper.hpp"
+#include "VectorStream.hpp"
+#include "QualityOfService.hpp"
+#include "SpillStream.hpp"
+#include "ICompressionObject.hpp"
 
 #include <string>
 #include <memory>
-#include <future>
 #include <algorithm>
+#include <condition_variable>
 #include <functional>
+#include <limits>
+#include <exception>
+#include <mutex>
 
 namespace MSIX {
 
-    AppxPackageWriter::AppxPackageWriter(IMsixFactory* factory, const ComPtr<IZipWriter>& zip, bool enableFileHash) : m_factory(factory), m_zipWriter(zip)
+    namespace {
+
+    // Returns the bytes of the whole stream if it can expose them without copying, like a mapped file.
+    // The stream must be at its start.
+    const std::uint8_t* GetStreamView(IStream* stream, std::uint64_t size)
+    {
+        ComPtr<IStreamInternal> streamInternal;
+        if (FAILED(stream->QueryInterface(UuidOfImpl<IStreamInternal>::iid, reinterpret_cast<void**>(&streamInternal))))
+        {
+            return nullptr;
+        }
+        std::uint64_t available = 0;
+        const std::uint8_t* view = streamInternal->GetRawView(available);
+        return (available >= size) ? view : nullptr;
+    }
+
+    std::uint64_t GetStreamSize(IStream* stream)
+    {
+        LARGE_INTEGER start = { 0 };
+        ULARGE_INTEGER end = { 0 };
+        ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::END, &end));
+        ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::START, nullptr));
+        return static_cast<std::uint64_t>(end.QuadPart);
+    }
+
+    // Hashes a footprint file written in memory and leaves the stream at its start
+    void ComputeStreamHash(IStream* stream, Sha256Digest& digest)
     {
+        auto buffer = Helper::CreateBufferFromStream(ComPtr<IStream>(stream));
+        SHA256::ComputeHash(buffer.data(), static_cast<std::uint32_t>(buffer.size()), digest);
+        ThrowHrIfFailed(stream->Seek({ 0 }, StreamBase::Reference::START, nullptr));
+    }
+
+    // Whether the inventory can be used instead of reading the file: the file still has the size of the inventory,
+    // which has a hash per block and, when the file is compressed, a deflated block per block that add up to its
+    // deflated blocks. Only the sizes are checked, the file isn't read.
+    bool IsInventoryUsable(const InventoryFile& file, IStream* stream, bool toCompress)
+    {
+        auto blockCount = (file.size + DefaultBlockSize - 1) / DefaultBlockSize;
+        if ((file.size == 0) || (file.blockHashes.size() != blockCount) || (GetStreamSize(stream) != file.size))
+        {
+            return false;
+        }
+        if (!toCompress)
+        {
+            return true;
+        }
+        if (!file.compressedBlocks || (file.compressedBlockSizes.size() != blockCount))
+        {
+            return false;
+        }
+        std::uint64_t compressedSize = 0;
+        for (auto blockSize : file.compressedBlockSizes)
+        {
+            if ((blockSize == 0) || (blockSize > std::numeric_limits<ULONG>::max()))
+            {
+                return false;
+            }
+            compressedSize += blockSize;
+        }
+        return compressedSize == GetStreamSize(file.compressedBlocks.Get());
+    }
+
+    // Inflates a block that ends on a full flush, so it doesn't need the ones before it
+    void InflateBlock(const std::uint8_t* compressed, std::size_t compressedSize, std::uint8_t* buffer, std::uint32_t size)
+    {
+        auto inflater = CreateCompressionObject();
+        ThrowErrorIfNot(Error::InflateInitialize, (inflater->Initialize(CompressionOperation::Inflate) == CompressionStatus::Ok), "compression_stream_init failed");
+        inflater->SetInput(const_cast<std::uint8_t*>(compressed), compressedSize);
+        inflater->SetOutput(buffer, size);
+        auto status = inflater->Inflate();
+        std::size_t inflated = size - inflater->GetAvailableDestinationSize();
+        inflater->Cleanup();
+        ThrowErrorIf(Error::InflateCorruptData, (status == CompressionStatus::Error || status == CompressionStatus::NeedDictionary ||
+            inflated != size), "inflate failed unexpectedly.");
+    }
+
+    } // namespace
+
+    AppxPackageWriter::AppxPackageWriter(IMsixFactory* factory, const ComPtr<IZipWriter>& zip, bool enableFileHash, bool signingDigests) :
+        m_factory(factory), m_zipWriter(zip), m_blockMapWriter(factory->GetMemoryBudget()), m_signingDigests(signingDigests)
+    {
+        m_blockMapWriter.SetPerformanceCounters(m_factory->GetPerformanceCounters());
         if (enableFileHash)
         {
             m_blockMapWriter.EnableFileHash();
@@ -33,30 +129,193 @@ namespace MSIX {
     }
 
     // IPackageWriter
-    void AppxPackageWriter::PackPayloadFiles(const ComPtr<IDirectoryObject>& from)
+    void AppxPackageWriter::PackPayloadFiles(const ComPtr<IDirectoryObject>& from, std::uint32_t threadCount,
+        APPX_COMPRESSION_OPTION compressionOption, bool adaptiveCompression)
     {
         ThrowErrorIf(Error::InvalidState, m_state != WriterState::Open, "Invalid package writer state");
         auto failState = MSIX::scope_exit([this]
         {
             this->m_state = WriterState::Failed;
         });
+        SetCompressionThreads(threadCount, 0);
+        auto resetThreads = MSIX::scope_exit([this]
+        {
+            this->SetCompressionThreads(1, 0);
+        });
+        ValidateCompressionOption(compressionOption);
+        auto qualityOfService = m_factory->GetQualityOfService();
+        QualityOfService::IoPriorityScope priority(qualityOfService->IsLowPriorityIo());
 
         auto fileMap = from->GetFilesByLastModDate();
+        std::vector<std::string> payloadFiles;
         for(const auto& file : fileMap)
         {
             // If any footprint file is present, ignore it. We only require the AppxManifest.xml
             // and any other will be ignored and a new one will be created for the package. 
             if(!(FileNameValidation::IsFootPrintFile(file.second, false) || FileNameValidation::IsReservedFolder(file.second)))
             {
-                std::string ext = Helper::tolower(file.second.substr(file.second.find_last_of(".") + 1));
-                auto contentType = ContentType::GetContentTypeByExtension(ext);
-                auto stream = from.As<IStorageObject>()->GetFile(file.second);
-                ValidateAndAddPayloadFile(file.second, stream.Get(), contentType.GetCompressionOpt(), contentType.GetContentType().c_str());
+                payloadFiles.push_back(file.second);
+            }
+        }
+        if (!m_accessOrder.empty())
+        {   // The files of the profile keep its order, the others keep theirs after them
+            auto positionOf = [this](const std::string& file)
+            {
+                auto found = m_accessOrder.find(Helper::toBackSlash(file));
+                return (found != m_accessOrder.end()) ? found->second : m_accessOrder.size();
+            };
+            std::stable_sort(payloadFiles.begin(), payloadFiles.end(), [&positionOf](const auto& left, const auto& right)
+            {
+                return positionOf(left) < positionOf(right);
+            });
+        }
+
+        auto progress = m_factory->GetProgressReporter();
+        bool paced = (m_timeBudget.count() != 0) && (compressionOption != APPX_COMPRESSION_OPTION_NONE);
+        std::uint64_t totalSize = 0;
+        if (progress->IsEnabled() || paced)
+        {   // The files are opened one more time to tell their total size up front
+            for (const auto& file : payloadFiles)
+            {
+                totalSize += GetStreamSize(from.As<IStorageObject>()->GetFile(file).Get());
+            }
+            progress->AddWork(totalSize, static_cast<std::uint32_t>(payloadFiles.size()));
+        }
+        std::unique_ptr<CompressionPacer> pacer;
+        if (paced)
+        {
+            pacer = std::make_unique<CompressionPacer>(m_timeBudget, compressionOption, totalSize);
+        }
+
+        for (const auto& file : payloadFiles)
+        {
+            PackageFileName fileName(file);
+            auto contentType = ContentType::GetContentTypeByExtension(fileName.normalizedExtension);
+            auto stream = from.As<IStorageObject>()->GetFile(file);
+            if (qualityOfService->IsThrottled())
+            {
+                stream = ComPtr<IStream>::Make<ThrottledStream>(stream, qualityOfService);
+            }
+            // Content types that are already compressed are always stored
+            auto compressionOpt = (contentType.GetCompressionOpt() == APPX_COMPRESSION_OPTION_NONE) ? APPX_COMPRESSION_OPTION_NONE : compressionOption;
+            if (pacer && (compressionOpt != APPX_COMPRESSION_OPTION_NONE))
+            {
+                compressionOpt = pacer->Choose();
             }
+            if (adaptiveCompression && (compressionOpt != APPX_COMPRESSION_OPTION_NONE) && !IsWorthCompressing(stream.Get()))
+            {
+                compressionOpt = APPX_COMPRESSION_OPTION_NONE;
+            }
+            if (pacer)
+            {
+                auto start = std::chrono::steady_clock::now();
+                ValidateAndAddPayloadFile(fileName, stream.Get(), compressionOpt, contentType.GetContentType().c_str());
+                pacer->Record(compressionOpt, GetStreamSize(stream.Get()), std::chrono::steady_clock::now() - start);
+                continue;
+            }
+            ValidateAndAddPayloadFile(fileName, stream.Get(), compressionOpt, contentType.GetContentType().c_str());
         }
         failState.release();
     }
 
+    void AppxPackageWriter::PackInventoryFiles(const ComPtr<IDirectoryObject>& from, const std::vector<InventoryFile>& files,
+        std::uint32_t threadCount, APPX_COMPRESSION_OPTION compressionOption, bool adaptiveCompression)
+    {
+        ThrowErrorIf(Error::InvalidState, m_state != WriterState::Open, "Invalid package writer state");
+        auto failState = MSIX::scope_exit([this]
+        {
+            this->m_state = WriterState::Failed;
+        });
+        SetCompressionThreads(threadCount, 0);
+        auto resetThreads = MSIX::scope_exit([this]
+        {
+            this->SetCompressionThreads(1, 0);
+        });
+        ValidateCompressionOption(compressionOption);
+
+        // Like PackPayloadFiles, the footprint files are ignored
+        std::vector<const InventoryFile*> payloadFiles;
+        std::uint64_t totalSize = 0;
+        for (const auto& file : files)
+        {
+            if (!(FileNameValidation::IsFootPrintFile(file.name, false) || FileNameValidation::IsReservedFolder(file.name)))
+            {
+                payloadFiles.push_back(&file);
+                totalSize += file.size;
+            }
+        }
+        // The sizes of the inventory are used for the progress, the files aren't opened for it
+        auto progress = m_factory->GetProgressReporter();
+        progress->AddWork(totalSize, static_cast<std::uint32_t>(payloadFiles.size()));
+
+        // Every deflated block ends on a full flush, the deflate stream is terminated the same way after any of them
+        std::vector<std::uint8_t> termination;
+        if (compressionOption != APPX_COMPRESSION_OPTION_NONE)
+        {
+            BlockDeflater deflater(compressionOption, m_factory->GetPerformanceCounters());
+            termination = deflater.Finish();
+        }
+
+        for (const auto file : payloadFiles)
+        {
+            PackageFileName fileName(file->name);
+            auto contentType = ContentType::GetContentTypeByExtension(fileName.normalizedExtension);
+            auto contentTypeName = file->contentType.empty() ? contentType.GetContentType() : file->contentType;
+            auto compressionOpt = (contentType.GetCompressionOpt() == APPX_COMPRESSION_OPTION_NONE) ? APPX_COMPRESSION_OPTION_NONE : compressionOption;
+            bool toCompress = (compressionOpt != APPX_COMPRESSION_OPTION_NONE);
+            ValidatePayloadFile(file->name, compressionOpt);
+            auto stream = from.As<IStorageObject>()->GetFile(file->name);
+            ThrowErrorIfNot(Error::FileNotFound, stream, "File of the inventory not found");
+
+            // The file hash of the block map needs the bytes of the file
+            if (IsInventoryUsable(*file, stream.Get(), toCompress) && !(toCompress && m_blockMapWriter.IsFileHashEnabled()))
+            {
+                AddInventoryFile(*file, fileName, stream.Get(), compressionOpt, contentTypeName, termination);
+                continue;
+            }
+            if (adaptiveCompression && toCompress && !IsWorthCompressing(stream.Get()))
+            {
+                compressionOpt = APPX_COMPRESSION_OPTION_NONE;
+            }
+            AddFileToPackage(fileName, stream.Get(), compressionOpt, true, contentTypeName.c_str());
+        }
+        failState.release();
+    }
+
+    void AppxPackageWriter::SetBasePackage(const ComPtr<IStream>& basePackage)
+    {
+        ThrowErrorIf(Error::InvalidState, m_state != WriterState::Open, "Invalid package writer state");
+        m_basePackage = std::make_unique<BasePackage>(m_factory.Get(), basePackage);
+    }
+
+    void AppxPackageWriter::SetCompactZipRecords(bool compact)
+    {
+        ThrowErrorIf(Error::InvalidState, m_state != WriterState::Open, "Invalid package writer state");
+        m_compactZipRecords = compact;
+    }
+
+    void AppxPackageWriter::SetDuplicateReuse(bool reuse)
+    {
+        ThrowErrorIf(Error::InvalidState, m_state != WriterState::Open, "Invalid package writer state");
+        m_reuseDuplicates = reuse;
+    }
+
+    void AppxPackageWriter::SetCompressionTimeBudget(std::chrono::milliseconds budget)
+    {
+        ThrowErrorIf(Error::InvalidState, m_state != WriterState::Open, "Invalid package writer state");
+        m_timeBudget = budget;
+    }
+
+    void AppxPackageWriter::SetAccessOrder(const std::vector<std::string>& files)
+    {
+        ThrowErrorIf(Error::InvalidState, m_state != WriterState::Open, "Invalid package writer state");
+        m_accessOrder.clear();
+        for (const auto& file : files)
+        {   // A file listed twice is where it was first read
+            m_accessOrder.emplace(Helper::toBackSlash(file), m_accessOrder.size());
+        }
+    }
+
     // IAppxPackageWriter
     HRESULT STDMETHODCALLTYPE AppxPackageWriter::AddPayloadFile(LPCWSTR fileName, LPCWSTR contentType,
         APPX_COMPRESSION_OPTION compressionOption, IStream *inputStream) noexcept try
@@ -73,24 +332,51 @@ namespace MSIX {
             this->m_state = WriterState::Failed;
         });
 
-        ComPtr<IStream> manifestStream(manifest);
+        ThrowErrorIf(Error::InvalidParameter, (manifest == nullptr), "Invalid parameter");
+
+        // The payload files are all added, the footprint files aren't copies of them
+        m_reuseDuplicates = false;
+        m_deflatedFiles.clear();
+        m_deflatedFilesSize = 0;
 
         // Process AppxManifest.xml
+        // The manifest is read once. The validation, the compression and the block map hashes all work on the
+        // same bytes, from memory.
+        auto manifestBytes = Helper::CreateBufferFromStream(ComPtr<IStream>(manifest));
+        auto manifestStream = ComPtr<IStream>::Make<VectorStream>(&manifestBytes);
         // If the creating the AppxManifestObject succeeds, then the stream is valid.
         auto manifestObj = ComPtr<IAppxManifestReader>::Make<AppxManifestObject>(m_factory.Get(), manifestStream.Get());
         auto manifestContentType = ContentType::GetPayloadFileContentType(APPX_FOOTPRINT_FILE_TYPE_MANIFEST);
-        AddFileToPackage(APPXMANIFEST_XML, manifestStream.Get(), true, true, manifestContentType.c_str());
+        auto progress = m_factory->GetProgressReporter();
+        if (progress->IsEnabled())
+        {
+            progress->AddWork(manifestBytes.size(), 1);
+        }
+        AddFileToPackage(APPXMANIFEST_XML, manifestStream.Get(), APPX_COMPRESSION_OPTION_NORMAL, true, manifestContentType.c_str());
 
         // Close blockmap and add it to package
         m_blockMapWriter.Close();
         auto blockMapStream = m_blockMapWriter.GetStream();
+        if (m_signingDigests)
+        {
+            ComputeStreamHash(blockMapStream.Get(), m_blockMapDigest);
+        }
         auto blockMapContentType = ContentType::GetPayloadFileContentType(APPX_FOOTPRINT_FILE_TYPE_BLOCKMAP);
-        AddFileToPackage(APPXBLOCKMAP_XML, blockMapStream.Get(), true, false, blockMapContentType.c_str());
+        AddFileToPackage(APPXBLOCKMAP_XML, blockMapStream.Get(), APPX_COMPRESSION_OPTION_NORMAL, false, blockMapContentType.c_str());
 
-        // Close content types and add it to package
+        // Close content types and add it to package. A package written to be signed has the content type of
+        // the signature already, so signing only has to append it.
+        if (m_signingDigests)
+        {
+            m_contentTypeWriter.AddContentType(APPXSIGNATURE_P7X, ContentType::GetPayloadFileContentType(APPX_FOOTPRINT_FILE_TYPE_SIGNATURE), true);
+        }
         m_contentTypeWriter.Close();
         auto contentTypeStream = m_contentTypeWriter.GetStream();
-        AddFileToPackage(CONTENT_TYPES_XML, contentTypeStream.Get(), true, false, nullptr);
+        if (m_signingDigests)
+        {
+            ComputeStreamHash(contentTypeStream.Get(), m_contentTypesDigest);
+        }
+        AddFileToPackage(CONTENT_TYPES_XML, contentTypeStream.Get(), APPX_COMPRESSION_OPTION_NORMAL, false, nullptr);
 
         m_zipWriter->Close();
         failState.release();
@@ -98,6 +384,64 @@ namespace MSIX {
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
 
+    // IMsixPackageSigningDigests
+    HRESULT STDMETHODCALLTYPE AppxPackageWriter::GetSigningDigests(UINT32* digestsSize, BYTE** digests) noexcept try
+    {
+        ThrowErrorIf(Error::InvalidParameter, (digestsSize == nullptr || digests == nullptr || *digests != nullptr), "Invalid parameter");
+        Sha256Digest fileRecords;
+        Sha256Digest centralDirectory;
+        ThrowErrorIf(Error::InvalidState, !m_signingDigests || (m_state != WriterState::Closed) ||
+            !m_zipWriter->GetSigningDigests(fileRecords, centralDirectory), "The signing digests are only known once the package is written");
+
+        // Laid out like the DigestHeader the signature is validated with
+        std::vector<std::uint8_t> result;
+        auto append = [&result](DigestName name, const Sha256Digest* digest)
+        {
+            auto value = static_cast<std::uint32_t>(name);
+            for (std::size_t i = 0; i < sizeof(value); i++) { result.push_back(static_cast<std::uint8_t>(value >> (8 * i))); }
+            if (digest != nullptr) { result.insert(result.end(), digest->begin(), digest->end()); }
+        };
+        append(DigestName::HEAD, nullptr);
+        append(DigestName::AXPC, &fileRecords);
+        append(DigestName::AXCD, &centralDirectory);
+        append(DigestName::AXCT, &m_contentTypesDigest);
+        append(DigestName::AXBM, &m_blockMapDigest);
+        return m_factory->MarshalOutBytes(result, digestsSize, digests);
+    } CATCH_RETURN();
+
+    // IMsixPackageWriterCopy
+    HRESULT STDMETHODCALLTYPE AppxPackageWriter::AddPayloadFileFromPackage(IAppxPackageReader* reader, LPCSTR utf8FileName) noexcept try
+    {
+        ThrowErrorIf(Error::InvalidState, m_state != WriterState::Open, "Invalid package writer state");
+        ThrowErrorIf(Error::InvalidParameter, (reader == nullptr || utf8FileName == nullptr || *utf8FileName == '\0'), "Invalid parameter");
+        auto failState = MSIX::scope_exit([this]
+        {
+            this->m_state = WriterState::Failed;
+        });
+        // Like the names of the block map, either separator can be used
+        std::string name = utf8FileName;
+        std::replace(name.begin(), name.end(), '\\', '/');
+        PackageFileName fileName(name);
+        ComPtr<IPackage> package;
+        ThrowHrIfFailed(reader->QueryInterface(UuidOfImpl<IPackage>::iid, reinterpret_cast<void**>(&package)));
+        auto file = package->GetStoredPayloadFile(fileName.blockMapName);
+        ValidatePayloadFile(fileName.name, file.isCompressed ? APPX_COMPRESSION_OPTION_NORMAL : APPX_COMPRESSION_OPTION_NONE);
+        auto progress = m_factory->GetProgressReporter();
+        progress->AddWork(file.size, 1);
+        auto contentType = ContentType::GetContentTypeByExtension(fileName.normalizedExtension);
+        AddStoredFile(file, fileName, contentType.GetContentType());
+        failState.release();
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
+
+    // IMsixPackageWriterThreads
+    HRESULT STDMETHODCALLTYPE AppxPackageWriter::SetCompressionThreadCount(UINT32 threadCount) noexcept try
+    {
+        ThrowErrorIf(Error::InvalidState, m_state != WriterState::Open, "Invalid package writer state");
+        m_payloadFilesThreads = threadCount;
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
+
     // IAppxPackageWriterUtf8
     HRESULT STDMETHODCALLTYPE AppxPackageWriter::AddPayloadFile(LPCSTR fileName, LPCSTR contentType,
         APPX_COMPRESSION_OPTION compressionOption, IStream* inputStream) noexcept try
@@ -108,7 +452,12 @@ namespace MSIX {
             this->m_state = WriterState::Failed;
         });
         ComPtr<IStream> stream(inputStream);
-        ValidateAndAddPayloadFile(fileName, stream.Get(), compressionOption, contentType);
+        auto progress = m_factory->GetProgressReporter();
+        if (progress->IsEnabled())
+        {
+            progress->AddWork(GetStreamSize(stream.Get()), 1);
+        }
+        ValidateAndAddPayloadFile(PackageFileName(fileName), stream.Get(), compressionOption, contentType);
         failState.release();
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
@@ -122,14 +471,15 @@ namespace MSIX {
         {
             this->m_state = WriterState::Failed;
         });
-        // TODO: use memoryLimit for how many files are going to be added
+        std::vector<PayloadFile> files(fileCount);
         for(UINT32 i = 0; i < fileCount; i++)
         {
-            std::string fileName = wstring_to_utf8(payloadFiles[i].fileName);
-            ComPtr<IStream> stream(payloadFiles[i].inputStream);
-            std::string contentType = wstring_to_utf8(payloadFiles[i].contentType);
-            ValidateAndAddPayloadFile(fileName, stream.Get(), payloadFiles[i].compressionOption, contentType.c_str());
+            files[i].name = wstring_to_utf8(payloadFiles[i].fileName);
+            files[i].contentType = wstring_to_utf8(payloadFiles[i].contentType);
+            files[i].compressionOpt = payloadFiles[i].compressionOption;
+            files[i].stream = payloadFiles[i].inputStream;
         }
+        AddPayloadFilesInternal(files, memoryLimit);
         failState.release();
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
@@ -143,96 +493,641 @@ namespace MSIX {
         {
             this->m_state = WriterState::Failed;
         });
-        // TODO: use memoryLimit for how many files are going to be added
+        std::vector<PayloadFile> files(fileCount);
         for(UINT32 i = 0; i < fileCount; i++)
         {
-            ComPtr<IStream> stream(payloadFiles[i].inputStream);
-            ValidateAndAddPayloadFile(payloadFiles[i].fileName, stream.Get(), payloadFiles[i].compressionOption, payloadFiles[i].contentType);
+            files[i].name = payloadFiles[i].fileName;
+            files[i].contentType = payloadFiles[i].contentType;
+            files[i].compressionOpt = payloadFiles[i].compressionOption;
+            files[i].stream = payloadFiles[i].inputStream;
         }
+        AddPayloadFilesInternal(files, memoryLimit);
         failState.release();
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
 
-    void AppxPackageWriter::ValidateAndAddPayloadFile(const std::string& name, IStream* stream,
-        APPX_COMPRESSION_OPTION compressionOpt, const char* contentType)
+    // Compression runs on the threads asked for with SetCompressionThreadCount. Files of up to a block are read into
+    // memory in batches of at most memoryLimit bytes of data and compressed data, deflated and hashed several
+    // files at a time, and then written in order. Files of up to SpooledFileMaxSize are spooled the same way,
+    // each one whole by a worker, into segments kept in memory up to memoryLimit and in temporary files past it.
+    // Larger files compress their blocks in parallel instead, with at most memoryLimit bytes of blocks in flight.
+    void AppxPackageWriter::AddPayloadFilesInternal(const std::vector<PayloadFile>& files, std::uint64_t memoryLimit)
+    {
+        // Under a memory budget the batches and the blocks in flight fit in what is left of it
+        if (memoryLimit != 0)
+        {
+            memoryLimit = std::max<std::uint64_t>(1, std::min(memoryLimit, m_factory->GetMemoryBudget()->GetAvailable()));
+        }
+        SetCompressionThreads(m_payloadFilesThreads, memoryLimit);
+        auto resetThreads = MSIX::scope_exit([this]
+        {
+            this->SetCompressionThreads(1, 0);
+        });
+
+        auto progress = m_factory->GetProgressReporter();
+        if (progress->IsEnabled())
+        {
+            std::uint64_t totalSize = 0;
+            for (const auto& file : files)
+            {
+                totalSize += GetStreamSize(file.stream.Get());
+            }
+            progress->AddWork(totalSize, static_cast<std::uint32_t>(files.size()));
+        }
+
+        // Only one of the batches has files at a time, so the files are written in order
+        std::vector<PreparedFile> batch;
+        std::uint64_t batchMemory = 0;
+        std::vector<SpooledFile> spoolBatch;
+        std::uint64_t spoolSize = 0;
+        std::uint64_t spoolMemory = 0;
+        auto flush = [&]()
+        {
+            if (!batch.empty())
+            {
+                AddPreparedFiles(batch);
+                batch.clear();
+                batchMemory = 0;
+            }
+            if (!spoolBatch.empty())
+            {
+                AddSpooledFiles(spoolBatch);
+                spoolBatch.clear();
+                spoolSize = 0;
+                spoolMemory = 0;
+            }
+        };
+        // Files with a base package, duplicate reuse or a compressed block cache are compared block by block as they
+        // are written, and the file hash needs the bytes of the file when its blocks are added to the block map
+        bool canSpool = (m_compressionThreads > 1) && !m_basePackage && !m_reuseDuplicates && !m_blockMapWriter.IsFileHashEnabled() &&
+            !m_factory->GetCompressedBlockCache();
+        for (const auto& file : files)
+        {
+            ValidatePayloadFile(file.name, file.compressionOpt);
+            LARGE_INTEGER start = { 0 };
+            ULARGE_INTEGER end = { 0 };
+            ThrowHrIfFailed(file.stream->Seek(start, StreamBase::Reference::END, &end));
+            ThrowHrIfFailed(file.stream->Seek(start, StreamBase::Reference::START, nullptr));
+            std::uint64_t size = static_cast<std::uint64_t>(end.QuadPart);
+
+            if (canSpool && (size > DefaultBlockSize) && (size <= SpooledFileMaxSize))
+            {
+                if (!batch.empty() || (spoolSize + size > SpoolBatchMaxSize))
+                {
+                    flush();
+                }
+                // A segment is at most about the size of its file
+                SpooledFile spooled;
+                spooled.file = &file;
+                spooled.size = size;
+                spooled.statistics = CreateFileStatistics();
+                bool inMemory = (spoolMemory + size <= memoryLimit);
+                spooled.segment = ComPtr<IStream>::Make<SpillStream>(inMemory ? std::numeric_limits<std::uint64_t>::max() : 0);
+                spoolBatch.push_back(std::move(spooled));
+                spoolSize += size;
+                spoolMemory += inMemory ? size : 0;
+                continue;
+            }
+            if (!spoolBatch.empty())
+            {
+                flush();
+            }
+
+            // A batched file holds its data and about as many bytes of compressed data
+            std::uint64_t memory = size * 2;
+            if ((m_compressionThreads <= 1) || (size > DefaultBlockSize) || (memory > memoryLimit))
+            {
+                flush();
+                AddFileToPackage(file.name, file.stream.Get(), file.compressionOpt, true, file.contentType.c_str());
+                continue;
+            }
+            if (batchMemory + memory > memoryLimit)
+            {
+                flush();
+            }
+            PreparedFile prepared;
+            prepared.file = &file;
+            prepared.data.resize(static_cast<std::size_t>(size));
+            prepared.statistics = CreateFileStatistics();
+            if (size != 0)
+            {
+                FileStatistics::Scope statisticsScope(prepared.statistics.get());
+                FileStatistics::Measure measure(FileStatistics::Stage::Read);
+                ULONG bytesRead = 0;
+                ThrowHrIfFailed(file.stream->Read(prepared.data.data(), static_cast<ULONG>(size), &bytesRead));
+                ThrowErrorIfNot(Error::FileRead, (static_cast<ULONG>(size) == bytesRead), "Read stream file failed");
+            }
+            batch.push_back(std::move(prepared));
+            batchMemory += memory;
+        }
+        flush();
+    }
+
+    void AppxPackageWriter::AddPreparedFiles(std::vector<PreparedFile>& batch)
+    {
+        std::size_t workerCount = std::min(static_cast<std::size_t>(m_compressionThreads), batch.size());
+        auto performanceCounters = m_factory->GetPerformanceCounters();
+        auto blockCache = m_factory->GetCompressedBlockCache();
+        m_factory->GetWorkerPool()->ForEach(workerCount, workerCount, [&](std::size_t worker)
+        {
+            // Hash all the files of this worker together. Files here are at most a block
+            std::vector<HashRequest> requests;
+            for (std::size_t index = worker; index < batch.size(); index += workerCount)
+            {
+                auto& prepared = batch[index];
+                if (!prepared.data.empty())
+                {
+                    requests.push_back({ prepared.data.data(), static_cast<std::uint32_t>(prepared.data.size()), &prepared.blockHash });
+                }
+            }
+            MSIX::SHA256::ComputeHashes(requests.data(), requests.size());
+
+            for (std::size_t index = worker; index < batch.size(); index += workerCount)
+            {
+                auto& prepared = batch[index];
+                FileStatistics::Scope statisticsScope(prepared.statistics.get());
+                auto size = static_cast<std::uint32_t>(prepared.data.size());
+                bool toCompress = (prepared.file->compressionOpt != APPX_COMPRESSION_OPTION_NONE);
+                BlockDeflater* deflater = nullptr;
+                if (toCompress)
+                {
+                    deflater = &BlockDeflater::ForCurrentThread(prepared.file->compressionOpt, performanceCounters);
+                }
+
+                prepared.crc = Crc32::Update(0, prepared.data.data(), size);
+                if (size != 0)
+                {
+                    prepared.blockSize = size;
+                    bool cached = toCompress && blockCache &&
+                        blockCache->Find(prepared.blockHash, size, prepared.file->compressionOpt, prepared.compressed);
+                    if (toCompress && !cached)
+                    {
+                        const auto& compressed = deflater->Deflate(prepared.data.data(), size);
+                        prepared.compressed.assign(compressed.begin(), compressed.end());
+                        if (blockCache)
+                        {
+                            blockCache->Add(prepared.blockHash, size, prepared.file->compressionOpt, compressed.data(), compressed.size());
+                        }
+                    }
+                    if (toCompress)
+                    {
+                        prepared.blockSize = static_cast<ULONG>(prepared.compressed.size());
+                    }
+                }
+                if (toCompress)
+                {
+                    const auto& termination = deflater->Finish();
+                    prepared.compressed.insert(prepared.compressed.end(), termination.begin(), termination.end());
+                }
+            }
+        });
+
+        for (const auto& prepared : batch)
+        {
+            WritePreparedFile(prepared);
+        }
+    }
+
+    void AppxPackageWriter::AddSpooledFiles(std::vector<SpooledFile>& batch)
+    {
+        std::size_t workerCount = std::min(static_cast<std::size_t>(m_compressionThreads), batch.size());
+        m_factory->GetWorkerPool()->ForEach(batch.size(), workerCount, [&](std::size_t index)
+        {
+            SpoolFile(batch[index]);
+        });
+
+        for (auto& spooled : batch)
+        {
+            WriteSpooledFile(spooled);
+            // Drops the segment, and its temporary file, as soon as it is in the package
+            spooled.segment = ComPtr<IStream>();
+        }
+    }
+
+    void AppxPackageWriter::SpoolFile(SpooledFile& spooled)
+    {
+        const auto& file = *spooled.file;
+        FileStatistics::Scope statisticsScope(spooled.statistics.get());
+        BlockDeflater* deflater = nullptr;
+        if (file.compressionOpt != APPX_COMPRESSION_OPTION_NONE)
+        {
+            deflater = &BlockDeflater::ForCurrentThread(file.compressionOpt, m_factory->GetPerformanceCounters());
+        }
+        auto write = [&spooled](const std::uint8_t* bytes, std::size_t size)
+        {
+            FileStatistics::Measure measure(FileStatistics::Stage::Write);
+            ULONG bytesWritten = 0;
+            ThrowHrIfFailed(spooled.segment->Write(bytes, static_cast<ULONG>(size), &bytesWritten));
+            ThrowErrorIfNot(Error::FileWrite, (bytesWritten == size), "Write spooled file failed");
+        };
+
+        const std::uint8_t* view = GetStreamView(file.stream.Get(), spooled.size);
+        std::vector<std::uint8_t> buffer;
+        std::uint32_t crc = 0;
+        for (std::uint64_t offset = 0; offset < spooled.size; offset += DefaultBlockSize)
+        {
+            std::uint32_t blockSize = static_cast<std::uint32_t>(std::min<std::uint64_t>(spooled.size - offset, DefaultBlockSize));
+            const std::uint8_t* block = nullptr;
+            if (view != nullptr)
+            {
+                block = view + offset;
+            }
+            else
+            {
+                FileStatistics::Measure measure(FileStatistics::Stage::Read);
+                buffer.resize(blockSize);
+                ULONG bytesRead = 0;
+                ThrowHrIfFailed(file.stream->Read(buffer.data(), static_cast<ULONG>(blockSize), &bytesRead));
+                ThrowErrorIfNot(Error::FileRead, (static_cast<ULONG>(blockSize) == bytesRead), "Read stream file failed");
+                block = buffer.data();
+            }
+            crc = Crc32::Update(crc, block, blockSize);
+            spooled.blockHashes.emplace_back();
+            {   FileStatistics::Measure measure(FileStatistics::Stage::Hash);
+                MSIX::SHA256::ComputeHash(block, blockSize, spooled.blockHashes.back());
+            }
+            if (deflater)
+            {
+                const auto& compressed = deflater->Deflate(block, blockSize);
+                write(compressed.data(), compressed.size());
+                spooled.blockSizes.push_back(static_cast<ULONG>(compressed.size()));
+            }
+            else
+            {
+                write(block, blockSize);
+                spooled.blockSizes.push_back(blockSize);
+            }
+        }
+        if (deflater)
+        {
+            const auto& termination = deflater->Finish();
+            write(termination.data(), termination.size());
+        }
+        spooled.crc = crc;
+    }
+
+    // Same output as AddFileToPackage for a file deflated in parallel, or stored. The segment is copied with
+    // large sequential writes.
+    void AppxPackageWriter::WriteSpooledFile(const SpooledFile& spooled)
+    {
+        const auto& file = *spooled.file;
+        Tracing::Activity activity(Tracing::Event::PackFile, file.name, spooled.size);
+        FileStatistics::Scope statisticsScope(spooled.statistics.get());
+        bool toCompress = (file.compressionOpt != APPX_COMPRESSION_OPTION_NONE);
+        PackageFileName fileName(file.name);
+        auto fileInfo = m_zipWriter->PrepareToAddFile(fileName.opcName, file.compressionOpt, true);
+        m_contentTypeWriter.AddContentType(fileName, file.contentType, false);
+        m_blockMapWriter.AddFile(fileName, spooled.size, fileInfo.first);
+
+        auto& zipFileStream = fileInfo.second;
+        ThrowHrIfFailed(spooled.segment->Seek({ 0 }, StreamBase::Reference::START, nullptr));
+        std::uint64_t segmentSize = GetStreamSize(spooled.segment.Get());
+        const std::uint8_t* view = GetStreamView(spooled.segment.Get(), segmentSize);
+        std::vector<std::uint8_t> buffer;
+        const std::uint64_t chunkSize = 1024 * 1024;
+        for (std::uint64_t offset = 0; offset < segmentSize; offset += chunkSize)
+        {
+            ULONG size = static_cast<ULONG>(std::min(segmentSize - offset, chunkSize));
+            const std::uint8_t* chunk = nullptr;
+            if (view != nullptr)
+            {
+                chunk = view + offset;
+            }
+            else
+            {
+                buffer.resize(size);
+                ULONG bytesRead = 0;
+                ThrowHrIfFailed(spooled.segment->Read(buffer.data(), size, &bytesRead));
+                ThrowErrorIfNot(Error::FileRead, (bytesRead == size), "Read spooled file failed");
+                chunk = buffer.data();
+            }
+            FileStatistics::Measure measure(FileStatistics::Stage::Write);
+            ULONG bytesWritten = 0;
+            ThrowHrIfFailed(zipFileStream->Write(chunk, size, &bytesWritten));
+            ThrowErrorIfNot(Error::FileWrite, (bytesWritten == size), "Write payload file failed");
+        }
+
+        // Only the file hash reads the bytes of the blocks, and spooled files don't have it
+        std::uint64_t bytesLeft = spooled.size;
+        for (std::size_t index = 0; index < spooled.blockHashes.size(); index++)
+        {
+            std::uint32_t blockSize = static_cast<std::uint32_t>(std::min<std::uint64_t>(bytesLeft, DefaultBlockSize));
+            bytesLeft -= blockSize;
+            m_blockMapWriter.AddBlock(nullptr, blockSize, spooled.blockHashes[index], spooled.blockSizes[index], toCompress);
+        }
+        m_blockMapWriter.CloseFile();
+
+        auto streamSize = zipFileStream.As<IStreamInternal>()->GetSize();
+        m_zipWriter->EndFile(spooled.crc, streamSize, spooled.size, !m_compactZipRecords);
+        m_factory->GetProgressReporter()->Advance(spooled.size, 1);
+        ReportFileStatistics(spooled.statistics.get(), file.name, spooled.size, streamSize);
+    }
+
+    // Same output as AddFileToPackage for a file of up to a block
+    void AppxPackageWriter::WritePreparedFile(const PreparedFile& prepared)
+    {
+        const auto& file = *prepared.file;
+        Tracing::Activity activity(Tracing::Event::PackFile, file.name, prepared.data.size());
+        FileStatistics::Scope statisticsScope(prepared.statistics.get());
+        bool toCompress = (file.compressionOpt != APPX_COMPRESSION_OPTION_NONE);
+        PackageFileName fileName(file.name);
+        auto fileInfo = m_zipWriter->PrepareToAddFile(fileName.opcName, file.compressionOpt, true);
+        m_contentTypeWriter.AddContentType(fileName, file.contentType, false);
+        m_blockMapWriter.AddFile(fileName, prepared.data.size(), fileInfo.first);
+
+        auto& zipFileStream = fileInfo.second;
+        const auto& output = toCompress ? prepared.compressed : prepared.data;
+        if (!output.empty())
+        {
+            FileStatistics::Measure measure(FileStatistics::Stage::Write);
+            ULONG bytesWritten = 0;
+            ThrowHrIfFailed(zipFileStream->Write(output.data(), static_cast<ULONG>(output.size()), &bytesWritten));
+            ThrowErrorIfNot(Error::FileWrite, (bytesWritten == output.size()), "Write payload file failed");
+        }
+        if (!prepared.data.empty())
+        {
+            m_blockMapWriter.AddBlock(prepared.data.data(), static_cast<std::uint32_t>(prepared.data.size()),
+                prepared.blockHash, prepared.blockSize, toCompress);
+        }
+        m_blockMapWriter.CloseFile();
+
+        auto streamSize = zipFileStream.As<IStreamInternal>()->GetSize();
+        m_zipWriter->EndFile(prepared.crc, streamSize, prepared.data.size(), !m_compactZipRecords);
+        m_factory->GetProgressReporter()->Advance(prepared.data.size(), 1);
+        ReportFileStatistics(prepared.statistics.get(), file.name, prepared.data.size(), streamSize);
+    }
+
+    void AppxPackageWriter::AddInventoryFile(const InventoryFile& file, const PackageFileName& fileName, IStream* stream,
+        APPX_COMPRESSION_OPTION compressionOpt, const std::string& contentType, const std::vector<std::uint8_t>& termination)
+    {
+        Tracing::Activity activity(Tracing::Event::PackFile, file.name, file.size);
+        auto statistics = CreateFileStatistics();
+        FileStatistics::Scope statisticsScope(statistics.get());
+        bool toCompress = (compressionOpt != APPX_COMPRESSION_OPTION_NONE);
+        auto fileInfo = m_zipWriter->PrepareToAddFile(fileName.opcName, compressionOpt, true);
+        m_contentTypeWriter.AddContentType(fileName, contentType, false);
+        m_blockMapWriter.AddFile(fileName, file.size, fileInfo.first);
+
+        auto& zipFileStream = fileInfo.second;
+        auto progress = m_factory->GetProgressReporter();
+        IStream* source = toCompress ? file.compressedBlocks.Get() : stream;
+        ThrowHrIfFailed(source->Seek({ 0 }, StreamBase::Reference::START, nullptr));
+        std::vector<std::uint8_t> buffer;
+        std::uint64_t bytesLeft = file.size;
+        for (std::size_t index = 0; index < file.blockHashes.size(); index++)
+        {
+            std::uint32_t blockSize = (bytesLeft > DefaultBlockSize) ? DefaultBlockSize : static_cast<std::uint32_t>(bytesLeft);
+            bytesLeft -= blockSize;
+            buffer.resize(toCompress ? static_cast<std::size_t>(file.compressedBlockSizes[index]) : blockSize);
+            ULONG bytesRead = 0;
+            {   FileStatistics::Measure measure(FileStatistics::Stage::Read);
+                ThrowHrIfFailed(source->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &bytesRead));
+            }
+            ThrowErrorIfNot(Error::FileRead, (bytesRead == buffer.size()), "Read stream file failed");
+            ULONG bytesWritten = 0;
+            {   FileStatistics::Measure measure(FileStatistics::Stage::Write);
+                ThrowHrIfFailed(zipFileStream->Write(buffer.data(), static_cast<ULONG>(buffer.size()), &bytesWritten));
+            }
+            ThrowErrorIfNot(Error::FileWrite, (bytesWritten == buffer.size()), "Write payload file failed");
+            // Only the file hash reads the bytes of the block, and compressed files don't get here with it
+            m_blockMapWriter.AddBlock(toCompress ? nullptr : buffer.data(), blockSize, file.blockHashes[index], bytesWritten, toCompress);
+            progress->Advance(blockSize);
+        }
+        if (toCompress)
+        {
+            // Put the stream termination on
+            ULONG bytesWritten = 0;
+            ThrowHrIfFailed(zipFileStream->Write(termination.data(), static_cast<ULONG>(termination.size()), &bytesWritten));
+            ThrowErrorIfNot(Error::FileWrite, (bytesWritten == termination.size()), "Write compressed block failed");
+        }
+        m_blockMapWriter.CloseFile();
+
+        auto streamSize = zipFileStream.As<IStreamInternal>()->GetSize();
+        m_zipWriter->EndFile(file.crc, streamSize, file.size, !m_compactZipRecords);
+        progress->Advance(0, 1);
+        ReportFileStatistics(statistics.get(), file.name, file.size, streamSize);
+    }
+
+    // Like AddInventoryFile with what the block map of the other package has of the file. The stored bytes of every
+    // block are copied as they are, a compressed block is inflated on its own, which is much cheaper than deflating
+    // it again, to check its hash and compute the crc.
+    void AppxPackageWriter::AddStoredFile(const StoredPayloadFile& file, const PackageFileName& fileName, const std::string& contentType)
+    {
+        Tracing::Activity activity(Tracing::Event::PackFile, fileName.name, file.size);
+        auto statistics = CreateFileStatistics();
+        FileStatistics::Scope statisticsScope(statistics.get());
+        ThrowErrorIf(Error::BlockMapInvalidData, (file.blocks.size() != (file.size + DefaultBlockSize - 1) / DefaultBlockSize),
+            "The blocks of the file don't match its size");
+        auto compressionOpt = file.isCompressed ? APPX_COMPRESSION_OPTION_NORMAL : APPX_COMPRESSION_OPTION_NONE;
+        auto fileInfo = m_zipWriter->PrepareToAddFile(fileName.opcName, compressionOpt, true);
+        m_contentTypeWriter.AddContentType(fileName, contentType, false);
+        m_blockMapWriter.AddFile(fileName, file.size, fileInfo.first);
+
+        auto& zipFileStream = fileInfo.second;
+        auto progress = m_factory->GetProgressReporter();
+        ThrowHrIfFailed(file.stream->Seek({ 0 }, StreamBase::Reference::START, nullptr));
+        std::vector<std::uint8_t> stored;
+        std::vector<std::uint8_t> block;
+        std::uint32_t crc = 0;
+        std::uint64_t bytesLeft = file.size;
+        for (std::size_t index = 0; index < file.blocks.size(); index++)
+        {
+            std::uint32_t blockSize = (bytesLeft > DefaultBlockSize) ? DefaultBlockSize : static_cast<std::uint32_t>(bytesLeft);
+            bytesLeft -= blockSize;
+            auto storedSize = file.isCompressed ? file.blocks.CompressedSize(index) : blockSize;
+            ThrowErrorIf(Error::BlockMapInvalidData, (storedSize == 0 || storedSize > std::numeric_limits<ULONG>::max()), "Invalid block size");
+            stored.resize(static_cast<std::size_t>(storedSize));
+            ULONG bytesRead = 0;
+            {   FileStatistics::Measure measure(FileStatistics::Stage::Read);
+                ThrowHrIfFailed(file.stream->Read(stored.data(), static_cast<ULONG>(stored.size()), &bytesRead));
+            }
+            ThrowErrorIfNot(Error::FileRead, (bytesRead == stored.size()), "Read stored file failed");
+            const std::uint8_t* bytes = stored.data();
+            if (file.isCompressed)
+            {
+                FileStatistics::Measure measure(FileStatistics::Stage::Inflate);
+                block.resize(blockSize);
+                InflateBlock(stored.data(), stored.size(), block.data(), blockSize);
+                bytes = block.data();
+            }
+            Sha256Digest hash;
+            {   FileStatistics::Measure measure(FileStatistics::Stage::Hash);
+                SHA256::ComputeHash(bytes, blockSize, hash);
+            }
+            ThrowErrorIfNot(Error::SignatureInvalid, (hash == file.blocks.Hash(index)), "Block hash doesn't match the block map");
+            crc = Crc32::Update(crc, bytes, blockSize);
+
+            ULONG bytesWritten = 0;
+            {   FileStatistics::Measure measure(FileStatistics::Stage::Write);
+                ThrowHrIfFailed(zipFileStream->Write(stored.data(), static_cast<ULONG>(stored.size()), &bytesWritten));
+            }
+            ThrowErrorIfNot(Error::FileWrite, (bytesWritten == stored.size()), "Write payload file failed");
+            m_blockMapWriter.AddBlock(bytes, blockSize, hash, bytesWritten, file.isCompressed);
+            progress->Advance(blockSize);
+        }
+        if (file.isCompressed)
+        {
+            // Every block ends on a full flush, the stream is terminated the same way after any of them
+            BlockDeflater deflater(compressionOpt, m_factory->GetPerformanceCounters());
+            const auto& termination = deflater.Finish();
+            ULONG bytesWritten = 0;
+            ThrowHrIfFailed(zipFileStream->Write(termination.data(), static_cast<ULONG>(termination.size()), &bytesWritten));
+            ThrowErrorIfNot(Error::FileWrite, (bytesWritten == termination.size()), "Write compressed block failed");
+        }
+        m_blockMapWriter.CloseFile();
+
+        auto streamSize = zipFileStream.As<IStreamInternal>()->GetSize();
+        m_zipWriter->EndFile(crc, streamSize, file.size, !m_compactZipRecords);
+        progress->Advance(0, 1);
+        ReportFileStatistics(statistics.get(), fileName.name, file.size, streamSize);
+    }
+
+    void AppxPackageWriter::ValidatePayloadFile(const std::string& name, APPX_COMPRESSION_OPTION compressionOpt)
     {
         ThrowErrorIfNot(Error::InvalidParameter, FileNameValidation::IsFileNameValid(name), "Invalid file name");
         ThrowErrorIf(Error::InvalidParameter, FileNameValidation::IsFootPrintFile(name, false), "Trying to add footprint file to package");
         ThrowErrorIf(Error::InvalidParameter, FileNameValidation::IsReservedFolder(name), "Trying to add file in reserved folder");
         ValidateCompressionOption(compressionOpt);
-        AddFileToPackage(name, stream, compressionOpt != APPX_COMPRESSION_OPTION_NONE, true, contentType);
     }
 
-    void AppxPackageWriter::AddFileToPackage(const std::string& name, IStream* stream, bool toCompress,
+    void AppxPackageWriter::ValidateAndAddPayloadFile(const PackageFileName& file, IStream* stream,
+        APPX_COMPRESSION_OPTION compressionOpt, const char* contentType)
+    {
+        ValidatePayloadFile(file.name, compressionOpt);
+        AddFileToPackage(file, stream, compressionOpt, true, contentType);
+    }
+
+    void AppxPackageWriter::AddFileToPackage(const std::string& name, IStream* stream, APPX_COMPRESSION_OPTION compressionOpt,
         bool addToBlockMap, const char* contentType, bool forceContentTypeOverride)
     {
-        std::string opcFileName;
         // Don't encode [Content Type].xml
-        if (contentType != nullptr)
+        AddFileToPackage(PackageFileName(name, contentType != nullptr), stream, compressionOpt, addToBlockMap, contentType,
+            forceContentTypeOverride);
+    }
+
+    void AppxPackageWriter::AddFileToPackage(const PackageFileName& file, IStream* stream, APPX_COMPRESSION_OPTION compressionOpt,
+        bool addToBlockMap, const char* contentType, bool forceContentTypeOverride)
+    {
+        const auto& name = file.name;
+        Tracing::Activity activity(Tracing::Event::PackFile, name);
+        // Only the files of the block map are reported
+        auto statistics = addToBlockMap ? CreateFileStatistics() : nullptr;
+        FileStatistics::Scope statisticsScope(statistics.get());
+        bool toCompress = (compressionOpt != APPX_COMPRESSION_OPTION_NONE);
+
+        // This might be called with external IStream implementations. Don't rely on internal implementation of FileStream
+        LARGE_INTEGER start = { 0 };
+        ULARGE_INTEGER end = { 0 };
+        ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::END, &end));
+        ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::START, nullptr));
+        std::uint64_t uncompressedSize = static_cast<std::uint64_t>(end.QuadPart);
+
+        // Files in the base package go block by block too, to copy the blocks that didn't change
+        std::unique_ptr<BaseFile> baseFile;
+        if (toCompress && addToBlockMap && m_basePackage && (uncompressedSize != 0))
+        {
+            baseFile = m_basePackage->FindCompressedFile(name);
+        }
+        // Files with the content of a kept file copy its deflated blocks. The others go block by block to be kept.
+        const DeflatedFile* copy = nullptr;
+        DeflatedFile deflated;
+        bool keepDeflated = false;
+        if (toCompress && addToBlockMap && m_reuseDuplicates && !baseFile && (uncompressedSize != 0) &&
+            !m_blockMapWriter.IsFileHashEnabled())
         {
-            opcFileName = Encoding::EncodeFileName(name);
+            copy = FindDeflatedCopy(stream, uncompressedSize, compressionOpt);
+            keepDeflated = (copy == nullptr) && (m_deflatedFilesSize + uncompressedSize <= DuplicateReuseMaxSize);
         }
-        else
+        // Blocks in the compressed block cache are copied from it, the others are deflated and added to it
+        std::shared_ptr<CompressedBlockCache> blockCache;
+        if (toCompress && addToBlockMap && (uncompressedSize != 0) && (copy == nullptr))
         {
-            opcFileName = name;
+            blockCache = m_factory->GetCompressedBlockCache();
         }
-        auto fileInfo = m_zipWriter->PrepareToAddFile(opcFileName, toCompress);
+        bool inParallel = toCompress && (((m_compressionThreads > 1) && (uncompressedSize > DefaultBlockSize)) || baseFile || copy || keepDeflated ||
+            blockCache);
+        auto fileInfo = m_zipWriter->PrepareToAddFile(file.opcName, compressionOpt, inParallel);
 
         // Add content type to [Content Types].xml
         if (contentType != nullptr)
         {
-            m_contentTypeWriter.AddContentType(name, contentType, forceContentTypeOverride);
+            m_contentTypeWriter.AddContentType(file, contentType, forceContentTypeOverride);
         }
 
-        // This might be called with external IStream implementations. Don't rely on internal implementation of FileStream
-        LARGE_INTEGER start = { 0 };
-        ULARGE_INTEGER end = { 0 };
-        ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::END, &end));
-        ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::START, nullptr));
-        std::uint64_t uncompressedSize = static_cast<std::uint64_t>(end.QuadPart);
-
         // Add file to block map.
         if (addToBlockMap)
         {
-            m_blockMapWriter.AddFile(name, uncompressedSize, fileInfo.first);
+            m_blockMapWriter.AddFile(file, uncompressedSize, fileInfo.first);
         }
 
         auto& zipFileStream = fileInfo.second;
+        // Only the files in the block map count, the other footprint files are written by Close
+        auto progress = m_factory->GetProgressReporter();
+        bool reportProgress = addToBlockMap && progress->IsEnabled();
 
-        std::uint64_t bytesToRead = uncompressedSize;
+        // Mapped source files are checksummed, hashed and compressed straight from their pages
+        const std::uint8_t* view = (copy == nullptr) ? GetStreamView(stream, uncompressedSize) : nullptr;
+        std::uint64_t bytesToRead = inParallel ? 0 : uncompressedSize;
         std::uint32_t crc = 0;
+        std::vector<std::uint8_t> buffer;
+        if (view == nullptr)
+        {
+            buffer.reserve(static_cast<std::size_t>(std::min<std::uint64_t>(bytesToRead, DefaultBlockSize)));
+        }
+        if (copy != nullptr)
+        {
+            crc = AddDeflatedCopy(*copy, uncompressedSize, zipFileStream, reportProgress);
+        }
+        else if (inParallel)
+        {
+            crc = AddCompressedBlocksInParallel(stream, view, uncompressedSize, compressionOpt, zipFileStream, addToBlockMap, baseFile.get(),
+                blockCache.get(), keepDeflated ? &deflated : nullptr);
+        }
         while (bytesToRead > 0)
         {
             // Calculate the size of the next block to add
             std::uint32_t blockSize = (bytesToRead > DefaultBlockSize) ? DefaultBlockSize : static_cast<std::uint32_t>(bytesToRead);
+            const std::uint8_t* block = nullptr;
+            if (view != nullptr)
+            {
+                block = view + (uncompressedSize - bytesToRead);
+            }
+            else
+            {
+                // read block from stream. Only the last block is smaller, so this never reallocates.
+                FileStatistics::Measure measure(FileStatistics::Stage::Read);
+                buffer.resize(blockSize);
+                ULONG bytesRead;
+                ThrowHrIfFailed(stream->Read(static_cast<void*>(buffer.data()), static_cast<ULONG>(blockSize), &bytesRead));
+                ThrowErrorIfNot(Error::FileRead, (static_cast<ULONG>(blockSize) == bytesRead), "Read stream file failed");
+                block = buffer.data();
+            }
             bytesToRead -= blockSize;
-
-            // read block from stream
-            std::vector<std::uint8_t> block;
-            block.resize(blockSize);
-            ULONG bytesRead;
-            ThrowHrIfFailed(stream->Read(static_cast<void*>(block.data()), static_cast<ULONG>(blockSize), &bytesRead));
-            ThrowErrorIfNot(Error::FileRead, (static_cast<ULONG>(blockSize) == bytesRead), "Read stream file failed");
-            crc = crc32(crc, block.data(), static_cast<uInt>(block.size()));
+            crc = Crc32::Update(crc, block, blockSize);
 
             // Write block and compress if needed
             ULONG bytesWritten = 0;
-            ThrowHrIfFailed(zipFileStream->Write(block.data(), static_cast<ULONG>(block.size()), &bytesWritten));
+            {   FileStatistics::Measure measure(FileStatistics::Stage::Write);
+                ThrowHrIfFailed(zipFileStream->Write(block, static_cast<ULONG>(blockSize), &bytesWritten));
+            }
 
             // Add block to blockmap
             if (addToBlockMap)
             {
-                m_blockMapWriter.AddBlock(block, bytesWritten, toCompress);
+                m_blockMapWriter.AddBlock(block, blockSize, bytesWritten, toCompress);
+            }
+            if (reportProgress)
+            {
+                progress->Advance(blockSize);
             }
-
         }
 
-        if (toCompress)
+        if (toCompress && !inParallel)
         {
             // Put the stream termination on
-            std::vector<std::uint8_t> buffer;
+            FileStatistics::Measure measure(FileStatistics::Stage::Write);
             ULONG bytesWritten = 0;
-            ThrowHrIfFailed(zipFileStream->Write(buffer.data(), static_cast<ULONG>(buffer.size()), &bytesWritten));
+            ThrowHrIfFailed(zipFileStream->Write(nullptr, 0, &bytesWritten));
         }
 
         // Close File element
@@ -243,7 +1138,328 @@ namespace MSIX {
 
         // This could be the compressed or uncompressed size
         auto streamSize = zipFileStream.As<IStreamInternal>()->GetSize();
-        m_zipWriter->EndFile(crc, streamSize, uncompressedSize, true);
+        m_zipWriter->EndFile(crc, streamSize, uncompressedSize, !m_compactZipRecords);
+        if (reportProgress)
+        {
+            progress->Advance(0, 1);
+        }
+        ReportFileStatistics(statistics.get(), name, uncompressedSize, streamSize);
+
+        if (keepDeflated)
+        {
+            deflated.compressionOpt = compressionOpt;
+            deflated.crc = crc;
+            KeepDeflatedFile(uncompressedSize, std::move(deflated));
+        }
+    }
+
+    // The blocks are read in batches. All the workers deflate, hash and checksum the blocks of a batch at
+    // the same time, every block is independent because it ends on a full flush, and then the batch is
+    // written in order. Blocks are read from view if it isn't null. Blocks that match the block of baseFile
+    // at the same position are copied from it instead of deflated, and so are the blocks blockCache has when it
+    // isn't null, the blocks deflated are then added to it. The hashes and deflated bytes of the blocks are put in
+    // deflated if it isn't null. Returns the crc of the file.
+    std::uint32_t AppxPackageWriter::AddCompressedBlocksInParallel(IStream* stream, const std::uint8_t* view, std::uint64_t uncompressedSize,
+        APPX_COMPRESSION_OPTION compressionOpt, const ComPtr<IStream>& zipFileStream, bool addToBlockMap,
+        const BaseFile* baseFile, CompressedBlockCache* blockCache, DeflatedFile* deflated)
+    {
+        struct PendingBlock
+        {
+            const std::uint8_t* bytes = nullptr;
+            std::uint32_t size = 0;
+            std::vector<std::uint8_t> data; // holds the bytes when there's no view
+            Sha256Digest hash;
+            std::vector<std::uint8_t> compressed;
+            uLong crc = 0;
+            bool fromBase = false;
+        };
+
+        const std::size_t blocksPerWorker = 4;
+        std::size_t blockCount = static_cast<std::size_t>((uncompressedSize + DefaultBlockSize - 1) / DefaultBlockSize);
+        std::size_t workerCount = std::min(static_cast<std::size_t>(m_compressionThreads), blockCount);
+        std::size_t batchSize = workerCount * blocksPerWorker;
+        if (m_maxBlocksInFlight != 0)
+        {
+            batchSize = std::max(workerCount, std::min(batchSize, m_maxBlocksInFlight));
+        }
+
+        auto performanceCounters = m_factory->GetPerformanceCounters();
+        std::vector<PendingBlock> blocks(std::min(batchSize, blockCount));
+
+        auto progress = m_factory->GetProgressReporter();
+        bool reportProgress = addToBlockMap && progress->IsEnabled();
+        // The workers charge their stages to the file of the calling thread
+        auto statistics = FileStatistics::GetCurrent();
+        uLong crc = 0;
+        bool terminated = false;
+        std::uint64_t bytesToRead = uncompressedSize;
+        for (std::size_t batch = 0; batch < blockCount; batch += blocks.size())
+        {
+            std::size_t count = std::min(blocks.size(), blockCount - batch);
+            for (std::size_t index = 0; index < count; index++)
+            {
+                auto& block = blocks[index];
+                block.size = (bytesToRead > DefaultBlockSize) ? DefaultBlockSize : static_cast<std::uint32_t>(bytesToRead);
+                if (view != nullptr)
+                {
+                    block.bytes = view + (uncompressedSize - bytesToRead);
+                }
+                bytesToRead -= block.size;
+            }
+
+            // Every worker takes a run of consecutive blocks and reads, hashes and deflates them itself, so a block
+            // stays in the caches of one thread until only its compressed bytes are left for the write. The stream
+            // is read in order, the workers take turns by their index.
+            std::mutex readLock;
+            std::condition_variable readTurn;
+            std::size_t nextReader = 0;
+            m_factory->GetWorkerPool()->ForEach(workerCount, workerCount, [&](std::size_t worker)
+            {
+                FileStatistics::Scope statisticsScope(statistics);
+                std::size_t first = count * worker / workerCount;
+                std::size_t last = count * (worker + 1) / workerCount;
+                if (view == nullptr)
+                {
+                    std::unique_lock<std::mutex> lock(readLock);
+                    readTurn.wait(lock, [&]() { return nextReader == worker; });
+                    // The next worker reads after this one even when it fails, the loop then fails as a whole
+                    auto passTurn = MSIX::scope_exit([&]()
+                    {
+                        nextReader++;
+                        readTurn.notify_all();
+                    });
+                    for (std::size_t index = first; index < last; index++)
+                    {
+                        auto& block = blocks[index];
+                        FileStatistics::Measure measure(FileStatistics::Stage::Read);
+                        block.data.resize(block.size);
+                        ULONG bytesRead = 0;
+                        ThrowHrIfFailed(stream->Read(block.data.data(), static_cast<ULONG>(block.size), &bytesRead));
+                        ThrowErrorIfNot(Error::FileRead, (static_cast<ULONG>(block.size) == bytesRead), "Read stream file failed");
+                        block.bytes = block.data.data();
+                    }
+                }
+
+                // Hash all the blocks of this worker together
+                std::vector<HashRequest> requests;
+                for (std::size_t index = first; index < last; index++)
+                {
+                    requests.push_back({ blocks[index].bytes, blocks[index].size, &blocks[index].hash });
+                }
+                {   FileStatistics::Measure measure(FileStatistics::Stage::Hash);
+                    MSIX::SHA256::ComputeHashes(requests.data(), requests.size());
+                }
+
+                auto& deflater = BlockDeflater::ForCurrentThread(compressionOpt, performanceCounters);
+                for (std::size_t index = first; index < last; index++)
+                {
+                    auto& block = blocks[index];
+                    block.crc = Crc32::Update(0, block.bytes, block.size);
+                    block.fromBase = (baseFile != nullptr) && baseFile->IsSameBlock(batch + index, block.size, block.hash);
+                    bool cached = !block.fromBase && (blockCache != nullptr) &&
+                        blockCache->Find(block.hash, block.size, compressionOpt, block.compressed);
+                    if (!block.fromBase && !cached)
+                    {
+                        const auto& compressed = deflater.Deflate(block.bytes, block.size);
+                        block.compressed.assign(compressed.begin(), compressed.end());
+                        if (blockCache != nullptr)
+                        {
+                            blockCache->Add(block.hash, block.size, compressionOpt, compressed.data(), compressed.size());
+                        }
+                    }
+                }
+            });
+
+            for (std::size_t index = 0; index < count; index++)
+            {
+                auto& block = blocks[index];
+                if (block.fromBase)
+                {
+                    // A block of the base package that doesn't inflate on its own to the same bytes is deflated again
+                    bool endsStream = false;
+                    bool last = (batch + index + 1 == blockCount);
+                    if (baseFile->ReadBlock(batch + index, last, block.compressed, endsStream))
+                    {
+                        terminated = endsStream;
+                    }
+                    else
+                    {
+                        const auto& compressed = BlockDeflater::ForCurrentThread(compressionOpt, performanceCounters).Deflate(block.bytes, block.size);
+                        block.compressed.assign(compressed.begin(), compressed.end());
+                    }
+                }
+                crc = crc32_combine(crc, block.crc, static_cast<z_off_t>(block.size));
+                ULONG bytesWritten = 0;
+                {   FileStatistics::Measure measure(FileStatistics::Stage::Write);
+                    ThrowHrIfFailed(zipFileStream->Write(block.compressed.data(), static_cast<ULONG>(block.compressed.size()), &bytesWritten));
+                }
+                ThrowErrorIfNot(Error::FileWrite, (bytesWritten == block.compressed.size()), "Write compressed block failed");
+                if (addToBlockMap)
+                {
+                    m_blockMapWriter.AddBlock(block.bytes, block.size, block.hash, bytesWritten, true);
+                }
+                if (deflated != nullptr)
+                {
+                    deflated->blockHashes.push_back(block.hash);
+                    deflated->compressedBlockSizes.push_back(bytesWritten);
+                    deflated->compressed.insert(deflated->compressed.end(), block.compressed.begin(), block.compressed.end());
+                }
+                if (reportProgress)
+                {
+                    progress->Advance(block.size);
+                }
+            }
+        }
+
+        // Put the stream termination on, unless the last block copied from the base package already ends the stream
+        if (!terminated)
+        {
+            const auto& termination = BlockDeflater::ForCurrentThread(compressionOpt, performanceCounters).Finish();
+            ULONG bytesWritten = 0;
+            ThrowHrIfFailed(zipFileStream->Write(termination.data(), static_cast<ULONG>(termination.size()), &bytesWritten));
+            ThrowErrorIfNot(Error::FileWrite, (bytesWritten == termination.size()), "Write compressed block failed");
+            if (deflated != nullptr)
+            {
+                deflated->compressed.insert(deflated->compressed.end(), termination.begin(), termination.end());
+            }
+        }
+        return static_cast<std::uint32_t>(crc);
+    }
+
+    const AppxPackageWriter::DeflatedFile* AppxPackageWriter::FindDeflatedCopy(IStream* stream, std::uint64_t uncompressedSize,
+        APPX_COMPRESSION_OPTION compressionOpt)
+    {
+        auto candidates = m_deflatedFiles.equal_range(uncompressedSize);
+        if (candidates.first == candidates.second)
+        {
+            return nullptr;
+        }
+
+        // The crc and block hashes are what the copy needs, if it isn't one they are computed again when it is deflated
+        const std::uint8_t* view = GetStreamView(stream, uncompressedSize);
+        std::vector<std::uint8_t> buffer;
+        std::uint32_t crc = 0;
+        std::vector<Sha256Digest> blockHashes;
+        for (std::uint64_t offset = 0; offset < uncompressedSize; offset += DefaultBlockSize)
+        {
+            std::uint32_t blockSize = static_cast<std::uint32_t>(std::min<std::uint64_t>(uncompressedSize - offset, DefaultBlockSize));
+            const std::uint8_t* block = nullptr;
+            if (view != nullptr)
+            {
+                block = view + offset;
+            }
+            else
+            {
+                FileStatistics::Measure measure(FileStatistics::Stage::Read);
+                buffer.resize(blockSize);
+                ULONG bytesRead = 0;
+                ThrowHrIfFailed(stream->Read(buffer.data(), static_cast<ULONG>(blockSize), &bytesRead));
+                ThrowErrorIfNot(Error::FileRead, (static_cast<ULONG>(blockSize) == bytesRead), "Read stream file failed");
+                block = buffer.data();
+            }
+            crc = Crc32::Update(crc, block, blockSize);
+            blockHashes.emplace_back();
+            {   FileStatistics::Measure measure(FileStatistics::Stage::Hash);
+                MSIX::SHA256::ComputeHash(block, blockSize, blockHashes.back());
+            }
+        }
+        ThrowHrIfFailed(stream->Seek({ 0 }, StreamBase::Reference::START, nullptr));
+
+        for (auto candidate = candidates.first; candidate != candidates.second; candidate++)
+        {
+            const auto& file = candidate->second;
+            if ((file.compressionOpt == compressionOpt) && (file.crc == crc) && (file.blockHashes == blockHashes))
+            {
+                return &file;
+            }
+        }
+        return nullptr;
+    }
+
+    std::uint32_t AppxPackageWriter::AddDeflatedCopy(const DeflatedFile& file, std::uint64_t uncompressedSize,
+        const ComPtr<IStream>& zipFileStream, bool reportProgress)
+    {
+        ULONG bytesWritten = 0;
+        {   FileStatistics::Measure measure(FileStatistics::Stage::Write);
+            ThrowHrIfFailed(zipFileStream->Write(file.compressed.data(), static_cast<ULONG>(file.compressed.size()), &bytesWritten));
+        }
+        ThrowErrorIfNot(Error::FileWrite, (bytesWritten == file.compressed.size()), "Write compressed block failed");
+
+        // Only the file hash reads the bytes of the block, and copies aren't made with it
+        auto progress = m_factory->GetProgressReporter();
+        std::uint64_t bytesLeft = uncompressedSize;
+        for (std::size_t index = 0; index < file.blockHashes.size(); index++)
+        {
+            std::uint32_t blockSize = (bytesLeft > DefaultBlockSize) ? DefaultBlockSize : static_cast<std::uint32_t>(bytesLeft);
+            bytesLeft -= blockSize;
+            m_blockMapWriter.AddBlock(nullptr, blockSize, file.blockHashes[index], file.compressedBlockSizes[index], true);
+            if (reportProgress)
+            {
+                progress->Advance(blockSize);
+            }
+        }
+        return file.crc;
+    }
+
+    void AppxPackageWriter::KeepDeflatedFile(std::uint64_t uncompressedSize, DeflatedFile&& file)
+    {
+        std::uint64_t size = static_cast<std::uint64_t>(file.compressed.size());
+        if ((m_deflatedFilesSize + size > DuplicateReuseMaxSize) || !file.reservation.TryReserve(m_factory->GetMemoryBudget(), size))
+        {
+            return;
+        }
+        m_deflatedFilesSize += size;
+        m_deflatedFiles.emplace(uncompressedSize, std::move(file));
+    }
+
+    std::unique_ptr<FileStatistics> AppxPackageWriter::CreateFileStatistics()
+    {
+        return m_factory->GetFileStatisticsCallback() ? std::make_unique<FileStatistics>() : nullptr;
+    }
+
+    void AppxPackageWriter::ReportFileStatistics(const FileStatistics* statistics, const std::string& name, std::uint64_t size,
+        std::uint64_t compressedSize)
+    {
+        auto callback = m_factory->GetFileStatisticsCallback();
+        if ((statistics == nullptr) || !callback) { return; }
+        auto blockCount = static_cast<std::uint32_t>((size + DefaultBlockSize - 1) / DefaultBlockSize);
+        statistics->Report(callback.Get(), name, true, size, compressedSize, blockCount);
+    }
+
+    void AppxPackageWriter::SetCompressionThreads(std::uint32_t threadCount, std::uint64_t memoryLimit)
+    {
+        m_compressionThreads = static_cast<std::uint32_t>(m_factory->GetWorkerPool()->GetWorkerCount(threadCount));
+        // Every block in flight holds its data and its compressed data, 0 is no limit. Under a memory budget they
+        // fit in what is left of it.
+        auto memoryBudget = m_factory->GetMemoryBudget();
+        if (memoryBudget->IsLimited())
+        {
+            memoryLimit = (memoryLimit == 0) ? memoryBudget->GetAvailable() : std::min(memoryLimit, memoryBudget->GetAvailable());
+        }
+        m_maxBlocksInFlight = 0;
+        if (memoryLimit != 0)
+        {
+            m_maxBlocksInFlight = static_cast<std::size_t>(std::max<std::uint64_t>(1, std::min<std::uint64_t>(memoryLimit / (2 * DefaultBlockSize),
+                std::numeric_limits<std::size_t>::max())));
+        }
+    }
+
+    bool AppxPackageWriter::IsWorthCompressing(IStream* stream)
+    {
+        // The trial uses the fastest level, the real compression level only does slightly better
+        if (!m_trialDeflater)
+        {
+            m_trialDeflater = std::make_unique<BlockDeflater>(APPX_COMPRESSION_OPTION_SUPERFAST, m_factory->GetPerformanceCounters());
+        }
+        m_trialBlock.resize(DefaultBlockSize);
+        LARGE_INTEGER start = { 0 };
+        ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::START, nullptr));
+        ULONG bytesRead = 0;
+        ThrowHrIfFailed(stream->Read(m_trialBlock.data(), static_cast<ULONG>(m_trialBlock.size()), &bytesRead));
+        ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::START, nullptr));
+        if (bytesRead == 0) { return true; }
+        const auto& compressed = m_trialDeflater->Deflate(m_trialBlock.data(), bytesRead);
+        return (static_cast<std::uint64_t>(compressed.size()) * 100) < (static_cast<std::uint64_t>(bytesRead) * AdaptiveCompressionMaxPercent);
     }
 
     void AppxPackageWriter::ValidateCompressionOption(APPX_COMPRESSION_OPTION compressionOpt)
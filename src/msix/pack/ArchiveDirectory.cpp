@@ -0,0 +1,231 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "ArchiveDirectory.hpp"
+#include "ZipObjectReader.hpp"
+#include "RangeStream.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace MSIX {
+
+    namespace {
+        const std::size_t TarBlockSize = 512;
+
+        // Fields of a ustar header, offset and size
+        const std::size_t TarName = 0, TarNameSize = 100;
+        const std::size_t TarSize = 124, TarSizeSize = 12;
+        const std::size_t TarChecksum = 148, TarChecksumSize = 8;
+        const std::size_t TarType = 156;
+        const std::size_t TarPrefix = 345, TarPrefixSize = 155;
+
+        void ReadExactly(IStream* stream, void* buffer, ULONG size)
+        {
+            ULONG read = 0;
+            ThrowHrIfFailed(stream->Read(buffer, size, &read));
+            ThrowErrorIf(Error::FileRead, (read != size), "tar archive is truncated");
+        }
+
+        std::string ReadString(const std::uint8_t* header, std::size_t offset, std::size_t size)
+        {
+            auto begin = reinterpret_cast<const char*>(header + offset);
+            return std::string(begin, std::find(begin, begin + size, '\0'));
+        }
+
+        // Octal, or base-256 with the high bit of the first byte set for the sizes of GNU tar that don't fit in octal
+        std::uint64_t ReadNumber(const std::uint8_t* header, std::size_t offset, std::size_t size)
+        {
+            std::uint64_t result = 0;
+            if (header[offset] & 0x80)
+            {
+                result = header[offset] & 0x7F;
+                for (std::size_t i = 1; i < size; i++)
+                {
+                    ThrowErrorIf(Error::FileRead, (result >> 56) != 0, "tar number out of range");
+                    result = (result << 8) | header[offset + i];
+                }
+                return result;
+            }
+            std::size_t i = 0;
+            while (i < size && header[offset + i] == ' ') { i++; }
+            for (; i < size && header[offset + i] >= '0' && header[offset + i] <= '7'; i++)
+            {
+                ThrowErrorIf(Error::FileRead, (result >> 61) != 0, "tar number out of range");
+                result = (result << 3) | static_cast<std::uint64_t>(header[offset + i] - '0');
+            }
+            return result;
+        }
+
+        bool IsValidTarHeader(const std::uint8_t* header)
+        {
+            std::uint64_t sum = 0;
+            for (std::size_t i = 0; i < TarBlockSize; i++)
+            {
+                sum += (i >= TarChecksum && i < TarChecksum + TarChecksumSize) ? ' ' : header[i];
+            }
+            return sum == ReadNumber(header, TarChecksum, TarChecksumSize);
+        }
+
+        // Takes what a pax extended header says about the next file: its path and its size
+        void ReadPaxRecords(const std::string& records, std::string& path, std::uint64_t& size, bool& hasSize)
+        {
+            std::size_t position = 0;
+            while (position < records.size())
+            {   // "<length> <key>=<value>\n", the length counting the whole record
+                auto space = records.find(' ', position);
+                ThrowErrorIf(Error::FileRead, (space == std::string::npos), "invalid pax header");
+                auto length = static_cast<std::size_t>(std::stoull(records.substr(position, space - position)));
+                ThrowErrorIf(Error::FileRead, (length == 0 || position + length > records.size()), "invalid pax header");
+                auto record = records.substr(space + 1, position + length - space - 2);
+                auto equals = record.find('=');
+                ThrowErrorIf(Error::FileRead, (equals == std::string::npos), "invalid pax header");
+                auto key = record.substr(0, equals);
+                if (key == "path") { path = record.substr(equals + 1); }
+                else if (key == "size")
+                {
+                    size = std::stoull(record.substr(equals + 1));
+                    hasSize = true;
+                }
+                position += length;
+            }
+        }
+
+        // Archives made from a directory name their files "./name"
+        std::string NormalizeName(std::string name)
+        {
+            while (name.compare(0, 2, "./") == 0) { name.erase(0, 2); }
+            return name;
+        }
+    }
+
+    ArchiveDirectory::ArchiveDirectory(const ComPtr<IStream>& archive, const std::string& name) : m_archive(archive), m_name(name)
+    {
+        std::uint8_t signature[4] = {};
+        ULONG read = 0;
+        ThrowHrIfFailed(m_archive->Read(signature, sizeof(signature), &read));
+        ThrowHrIfFailed(m_archive->Seek({ 0 }, StreamBase::Reference::START, nullptr));
+        if (read == sizeof(signature) && std::memcmp(signature, "PK\x03\x04", sizeof(signature)) == 0)
+        {
+            m_zip = ComPtr<IStorageObject>::Make<ZipObjectReader>(m_archive);
+            for (auto& fileName : m_zip->GetFileNames(FileNameOptions::All))
+            {
+                if (!fileName.empty() && fileName.back() != '/')
+                {
+                    m_fileNames.push_back(std::move(fileName));
+                }
+            }
+        }
+        else
+        {
+            ReadTar();
+        }
+    }
+
+    void ArchiveDirectory::ReadTar()
+    {
+        std::uint8_t header[TarBlockSize];
+        std::uint64_t offset = 0;
+        // Set by the pax or GNU headers before the header of a file
+        std::string longName;
+        std::uint64_t paxSize = 0;
+        bool hasPaxSize = false;
+        while (true)
+        {
+            ReadExactly(m_archive.Get(), header, TarBlockSize);
+            offset += TarBlockSize;
+            // The archive ends with blocks of zeros
+            if (std::all_of(header, header + TarBlockSize, [](std::uint8_t byte) { return byte == 0; }))
+            {
+                break;
+            }
+            ThrowErrorIfNot(Error::FileRead, IsValidTarHeader(header), "not a zip or tar archive");
+
+            auto type = static_cast<char>(header[TarType]);
+            std::uint64_t size = ReadNumber(header, TarSize, TarSizeSize);
+            std::uint64_t padded = (size + TarBlockSize - 1) / TarBlockSize * TarBlockSize;
+            if (type == 'x' || type == 'L')
+            {   // pax extended header, or GNU long name, of the next file
+                ThrowErrorIf(Error::FileRead, (size > 1024 * 1024), "tar header too large");
+                std::string data(static_cast<std::size_t>(padded), '\0');
+                ReadExactly(m_archive.Get(), &data[0], static_cast<ULONG>(padded));
+                offset += padded;
+                data.resize(static_cast<std::size_t>(size));
+                if (type == 'x') { ReadPaxRecords(data, longName, paxSize, hasPaxSize); }
+                else { longName = data.substr(0, data.find('\0')); }
+                continue;
+            }
+
+            if (hasPaxSize) { size = paxSize; padded = (size + TarBlockSize - 1) / TarBlockSize * TarBlockSize; }
+            std::string name = longName;
+            if (name.empty())
+            {
+                auto prefix = ReadString(header, TarPrefix, TarPrefixSize);
+                name = ReadString(header, TarName, TarNameSize);
+                if (!prefix.empty()) { name = prefix + "/" + name; }
+            }
+            name = NormalizeName(name);
+            longName.clear();
+            hasPaxSize = false;
+
+            if (type == '0' || type == '\0' || type == '7')
+            {
+                if (!name.empty() && name.back() != '/')
+                {
+                    if (m_tarFiles.find(name) == m_tarFiles.end()) { m_fileNames.push_back(name); }
+                    // Like extracting it, a file that is in the archive again replaces the one before
+                    m_tarFiles[name] = TarFile{ offset, size };
+                }
+            }
+            else
+            {   // Links would need their target, and devices and fifos have no content
+                ThrowErrorIf(Error::NotSupported, (type != '5' && type != 'g'), ("tar entry type not supported: " + name).c_str());
+            }
+
+            offset += padded;
+            LARGE_INTEGER next = { 0 };
+            next.QuadPart = static_cast<LONGLONG>(offset);
+            ThrowHrIfFailed(m_archive->Seek(next, StreamBase::Reference::START, nullptr));
+        }
+    }
+
+    ComPtr<IStream> ArchiveDirectory::GetFile(const std::string& fileName)
+    {
+        ComPtr<IStream> result;
+        if (m_zip)
+        {   // The zip reader hands out the same stream for a file every time
+            result = m_zip->GetFile(fileName);
+            if (result)
+            {
+                ThrowHrIfFailed(result->Seek({ 0 }, StreamBase::Reference::START, nullptr));
+            }
+        }
+        else
+        {
+            auto file = m_tarFiles.find(fileName);
+            if (file != m_tarFiles.end())
+            {
+                result = ComPtr<IStream>::Make<RangeStream>(file->second.offset, file->second.size, m_archive.Get());
+            }
+        }
+        ThrowErrorIfNot(Error::FileNotFound, result, ("file: " + fileName + " is not in the archive.").c_str());
+        return result;
+    }
+
+    ComPtr<IStream> ArchiveDirectory::OpenFile(const std::string& fileName, FileStream::Mode mode, std::uint64_t)
+    {
+        ThrowErrorIf(Error::NotSupported, (mode != FileStream::Mode::READ), "archives are read only");
+        return GetFile(fileName);
+    }
+
+    std::multimap<std::uint64_t, std::string> ArchiveDirectory::GetFilesByLastModDate()
+    {
+        std::multimap<std::uint64_t, std::string> result;
+        for (std::size_t index = 0; index < m_fileNames.size(); index++)
+        {
+            result.emplace(index, m_fileNames[index]);
+        }
+        return result;
+    }
+}
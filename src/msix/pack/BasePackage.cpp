@@ -0,0 +1,97 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+
+#include "BasePackage.hpp"
+#include "AppxFactory.hpp"
+#include "AppxBlockMapWriter.hpp"
+#include "Crypto.hpp"
+#include "Encoding.hpp"
+#include "Exceptions.hpp"
+#include "ICompressionObject.hpp"
+#include "StringHelper.hpp"
+
+#include <algorithm>
+
+namespace MSIX {
+
+    bool BaseFile::IsSameBlock(std::size_t index, std::uint32_t blockSize, const Sha256Digest& hash) const
+    {
+        if (index >= blocks.size()) { return false; }
+        auto baseBlockSize = std::min<std::uint64_t>(DefaultBlockSize, size - index * DefaultBlockSize);
+        return (baseBlockSize == blockSize) && (blocks.Hash(index) == hash);
+    }
+
+    bool BaseFile::ReadBlock(std::size_t index, bool last, std::vector<std::uint8_t>& compressed, bool& endsStream) const
+    {
+        compressed.resize(static_cast<std::size_t>(blocks[index].compressedSize));
+        LARGE_INTEGER pos = { 0 };
+        pos.QuadPart = static_cast<LONGLONG>(offsets[index]);
+        ThrowHrIfFailed(stream->Seek(pos, StreamBase::Reference::START, nullptr));
+        ULONG bytesRead = 0;
+        ThrowHrIfFailed(stream->Read(compressed.data(), static_cast<ULONG>(compressed.size()), &bytesRead));
+        ThrowErrorIfNot(Error::FileRead, (bytesRead == compressed.size()), "Read base package block failed");
+
+        // One byte more than the block tells a block that inflates to more than its size
+        auto blockSize = static_cast<std::size_t>(std::min<std::uint64_t>(DefaultBlockSize, size - index * DefaultBlockSize));
+        std::vector<std::uint8_t> block(blockSize + 1);
+        auto inflater = CreateCompressionObject();
+        ThrowErrorIfNot(Error::InflateInitialize, (inflater->Initialize(CompressionOperation::Inflate) == CompressionStatus::Ok), "compression_stream_init failed");
+        inflater->SetInput(compressed.data(), compressed.size());
+        inflater->SetOutput(block.data(), block.size());
+        auto status = inflater->Inflate();
+        std::size_t inflated = block.size() - inflater->GetAvailableDestinationSize();
+        std::size_t inputLeft = inflater->GetAvailableSourceSize();
+        inflater->Cleanup();
+        endsStream = (status == CompressionStatus::End);
+        if ((status == CompressionStatus::Error) || (status == CompressionStatus::NeedDictionary) || (inflated != blockSize) ||
+            (inputLeft != 0) || (endsStream && !last))
+        {
+            return false;
+        }
+        Sha256Digest hash;
+        SHA256::ComputeHash(block.data(), static_cast<std::uint32_t>(blockSize), hash);
+        return hash == blocks.Hash(index);
+    }
+
+    BasePackage::BasePackage(IMsixFactory* factory, const ComPtr<IStream>& stream)
+    {
+        m_zip = ComPtr<ZipObjectReader>::Make<ZipObjectReader>(stream);
+        auto blockMapStream = m_zip->GetFile(footprintFiles[APPX_FOOTPRINT_FILE_TYPE_BLOCKMAP]);
+        ThrowErrorIf(Error::MissingAppxBlockMapXML, !blockMapStream, "Base package doesn't have a block map");
+        m_blockMap = ComPtr<IAppxBlockMapReader>::Make<AppxBlockMapObject>(factory, blockMapStream).As<IAppxBlockMapInternal>();
+        auto fileNames = m_blockMap->GetFileNames();
+        m_fileNames.insert(fileNames.begin(), fileNames.end());
+    }
+
+    std::unique_ptr<BaseFile> BasePackage::FindCompressedFile(const std::string& name)
+    {
+        // The block map uses the windows separator and the zip file the encoded name
+        auto blockMapName = Helper::toBackSlash(name);
+        if (m_fileNames.find(blockMapName) == m_fileNames.end()) { return nullptr; }
+        auto stream = m_zip->GetRawFile(Encoding::EncodeFileName(name));
+        if (!stream || !stream.As<IStreamInternal>()->IsCompressed()) { return nullptr; }
+
+        auto file = std::make_unique<BaseFile>();
+        UINT64 size = 0;
+        ThrowHrIfFailed(m_blockMap->GetFile(blockMapName)->GetUncompressedSize(&size));
+        file->size = size;
+        file->blocks = m_blockMap->GetBlocks(blockMapName);
+        file->stream = std::move(stream);
+
+        // Every block has to be inside of the deflated stream
+        std::uint64_t streamSize = file->stream.As<IStreamInternal>()->GetSize();
+        std::uint64_t offset = 0;
+        for (const auto& block : file->blocks)
+        {
+            file->offsets.push_back(offset);
+            offset += block.compressedSize;
+        }
+        if ((offset > streamSize) || (file->blocks.size() != (file->size + DefaultBlockSize - 1) / DefaultBlockSize))
+        {
+            return nullptr;
+        }
+        return file;
+    }
+}
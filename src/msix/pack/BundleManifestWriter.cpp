@@ -26,6 +26,8 @@ namespace MSIX {
     static const char* packageArchitectureAttribute = "Architecture";
     static const char* packageResourceIdAttribute = "ResourceId";
     static const char* fileNameAttribute = "FileName";
+    static const char* offsetAttribute = "Offset";
+    static const char* sizeAttribute = "Size";
     static const char* resourcesManifestElement = "Resources";
     static const char* resourceManifestElement = "Resource";
     static const char* resourceLanguageAttribute = "Language";
@@ -138,14 +140,15 @@ namespace MSIX {
             m_xmlWriter.AddAttribute(fileNameAttribute, packageInfo.fileName);
         }
 
+        // Flat bundles reference their packages, only packages stored in the bundle have an offset
         if(packageInfo.offset > 0)
         {
-            //TODO: not applicable for flat bundle
+            m_xmlWriter.AddNumericAttribute(offsetAttribute, packageInfo.offset);
         }
 
         if (packageInfo.size > 0 && packageInfo.offset > 0)
         {
-            //TODO: not applicable for flat bundles
+            m_xmlWriter.AddNumericAttribute(sizeAttribute, packageInfo.size);
         }
 
         //WriteResourcesElement
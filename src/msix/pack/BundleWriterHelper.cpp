@@ -1,4 +1,9 @@
 #include "BundleWriterHelper.hpp"
+#include "PackageIdentityReader.hpp"
+
+#include <ctime>
+#include <iomanip>
+#include <sstream>
 
 namespace MSIX {
 
@@ -17,7 +22,16 @@ namespace MSIX {
         return stat.cbSize.QuadPart;
     }
 
-    void BundleWriterHelper::AddPackage(std::string fileName, IAppxPackageReader* packageReader,
+    std::uint64_t BundleWriterHelper::GetDefaultBundleVersion()
+    {
+        std::time_t t = std::time(nullptr);
+        std::tm tm = *std::gmtime(&t);
+        std::stringstream ss;
+        ss << std::put_time(&tm, "%Y.%m%d.%H%M.0");
+        return ConvertVersionStringToUint64(ss.str());
+    }
+
+    void BundleWriterHelper::AddPackage(std::string fileName, IAppxManifestReader* manifestReader,
         std::uint64_t bundleOffset, std::uint64_t packageSize, bool isDefaultApplicableResource)
     {
         ComPtr<IAppxManifestPackageId> packageId;
@@ -25,12 +39,18 @@ namespace MSIX {
         ComPtr<IAppxManifestQualifiedResourcesEnumerator> resources;
         ComPtr<IAppxManifestTargetDeviceFamiliesEnumerator> tdfs;
 
-        GetValidatedPackageData(fileName, packageReader, &packageType, &packageId, &resources, &tdfs);
+        GetValidatedPackageData(fileName, manifestReader, &packageType, &packageId, &resources, &tdfs);
 
         AddValidatedPackageData(fileName, bundleOffset, packageSize, packageType, packageId,
                 isDefaultApplicableResource, resources.Get(), tdfs.Get());
     }
 
+    void BundleWriterHelper::AddPackageFromManifest(std::string fileName, IAppxManifestReader* manifestReader,
+        bool isDefaultApplicableResource)
+    {
+        AddPackage(fileName, manifestReader, 0, 0, isDefaultApplicableResource);
+    }
+
     void BundleWriterHelper::GetValidatedPackageData(
         std::string fileName,
         IAppxPackageReader* packageReader,
@@ -38,6 +58,19 @@ namespace MSIX {
         IAppxManifestPackageId** packageId,
         IAppxManifestQualifiedResourcesEnumerator** resources,
         IAppxManifestTargetDeviceFamiliesEnumerator** tdfs)
+    {
+        ComPtr<IAppxManifestReader> manifestReader;
+        ThrowHrIfFailed(packageReader->GetManifest(&manifestReader));
+        GetValidatedPackageData(fileName, manifestReader.Get(), packageType, packageId, resources, tdfs);
+    }
+
+    void BundleWriterHelper::GetValidatedPackageData(
+        std::string fileName,
+        IAppxManifestReader* manifestReader,
+        APPX_BUNDLE_PAYLOAD_PACKAGE_TYPE* packageType,
+        IAppxManifestPackageId** packageId,
+        IAppxManifestQualifiedResourcesEnumerator** resources,
+        IAppxManifestTargetDeviceFamiliesEnumerator** tdfs)
     {
         *packageId = nullptr;
         *resources = nullptr;
@@ -48,8 +81,6 @@ namespace MSIX {
         ComPtr<IAppxManifestQualifiedResourcesEnumerator> loadedResources;
         ComPtr<IAppxManifestTargetDeviceFamiliesEnumerator> loadedTdfs;
 
-        ComPtr<IAppxManifestReader> manifestReader;
-        ThrowHrIfFailed(packageReader->GetManifest(&manifestReader));
         ThrowHrIfFailed(manifestReader->GetPackageId(&loadedPackageId));
 
         ComPtr<IAppxManifestReader3> manifestReader3;
@@ -59,15 +90,15 @@ namespace MSIX {
 
         auto packageIdInternal = loadedPackageId.As<IAppxManifestPackageIdInternal>();
 
-        loadedPackageType = this->m_validationHelper.GetPayloadPackageType(manifestReader.Get(), fileName);
+        loadedPackageType = this->m_validationHelper.GetPayloadPackageType(manifestReader, fileName);
         this->m_validationHelper.AddPackage(loadedPackageType, packageIdInternal.Get(), fileName);
-        this->m_validationHelper.ValidateOSVersion(manifestReader.Get(), fileName);        
+        this->m_validationHelper.ValidateOSVersion(manifestReader, fileName);        
 
         ValidateNameAndPublisher(packageIdInternal.Get(), fileName);
 
         if (loadedPackageType == APPX_BUNDLE_PAYLOAD_PACKAGE_TYPE_APPLICATION)
         {
-            this->m_validationHelper.ValidateApplicationElement(manifestReader.Get(), fileName);
+            this->m_validationHelper.ValidateApplicationElement(manifestReader, fileName);
             if (loadedTdfs.Get() != nullptr)
             {
                 ComPtr<IAppxManifestTargetDeviceFamiliesEnumerator> tdfCopy;
@@ -165,6 +196,29 @@ namespace MSIX {
         }
     }
 
+    void BundleWriterHelper::AddExternalPackageReference(IAppxFactory* appxFactory, std::string fileName, IStream* packageStream,
+        bool isDefaultApplicablePackage)
+    {
+        // The stream is a manifest or a package, told apart by its first bytes instead of parsing it as either
+        ComPtr<IAppxManifestReader> manifestReader;
+        auto format = GetContainerFormat(packageStream);
+        if (format == MSIX_CONTAINER_FORMAT_MANIFEST)
+        {
+            ThrowHrIfFailed(appxFactory->CreateManifestReader(packageStream, &manifestReader));
+        }
+        else if (format == MSIX_CONTAINER_FORMAT_PACKAGE)
+        {
+            ComPtr<IAppxPackageReader> packageReader;
+            ThrowHrIfFailed(appxFactory->CreatePackageReader(packageStream, &packageReader));
+            ThrowHrIfFailed(packageReader->GetManifest(&manifestReader));
+        }
+        else
+        {
+            ThrowErrorAndLog(Error::InvalidData, "The data is invalid.");
+        }
+        AddExternalPackageReferenceFromManifest(fileName, manifestReader.Get(), isDefaultApplicablePackage);
+    }
+
     void BundleWriterHelper::AddExternalPackageReferenceFromManifest(std::string fileName, IAppxManifestReader* manifestReader,
         bool isDefaultApplicablePackage)
     {
@@ -0,0 +1,189 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "CompressedBlockCache.hpp"
+#include "Crc32.hpp"
+#include "ICompressionObject.hpp"
+#include "ScopeExit.hpp"
+#include "UnicodeConversion.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+namespace MSIX {
+
+    namespace {
+        // "MSIXBLK" and the version of the layout of an entry of the directory: the header, the size of the block,
+        // the crc of the deflated bytes, then the deflated bytes. Change it when the layout changes.
+        const std::uint8_t EntryHeader[] = { 'M', 'S', 'I', 'X', 'B', 'L', 'K', 1 };
+        const std::size_t EntryPrefixSize = sizeof(EntryHeader) + 2 * sizeof(std::uint32_t);
+    }
+
+    CompressedBlockCache::CompressedBlockCache(const std::string& root, std::uint64_t maxMemoryBytes) :
+        m_maxMemoryBytes(maxMemoryBytes)
+    {
+        if (!root.empty())
+        {
+            m_root = ComPtr<IDirectoryObject>::Make<DirectoryObject>(root, true);
+        }
+    }
+
+    std::string CompressedBlockCache::GetKey(const Sha256Digest& hash, APPX_COMPRESSION_OPTION compressionOpt)
+    {
+        const char* hexDigits = "0123456789abcdef";
+        std::string key;
+        key.reserve(hash.size() * 2 + 2);
+        for (auto byte : hash)
+        {
+            key.push_back(hexDigits[byte >> 4]);
+            key.push_back(hexDigits[byte & 0xF]);
+        }
+        key.push_back('-');
+        key.push_back(hexDigits[static_cast<std::uint32_t>(compressionOpt) & 0xF]);
+        return key;
+    }
+
+    bool CompressedBlockCache::Find(const Sha256Digest& hash, std::uint32_t size, APPX_COMPRESSION_OPTION compressionOpt,
+        std::vector<std::uint8_t>& compressed)
+    {
+        auto key = GetKey(hash, compressionOpt);
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            auto entry = m_entries.find(key);
+            if (entry != m_entries.end())
+            {
+                if (entry->second.size != size) { return false; }
+                m_uses.splice(m_uses.begin(), m_uses, entry->second.use);
+                compressed = entry->second.compressed;
+                return true;
+            }
+        }
+        if (!m_root || !FindInDirectory(key, hash, size, compressed))
+        {
+            return false;
+        }
+        std::lock_guard<std::mutex> lock(m_lock);
+        AddToMemory(key, size, compressed.data(), compressed.size());
+        return true;
+    }
+
+    void CompressedBlockCache::Add(const Sha256Digest& hash, std::uint32_t size, APPX_COMPRESSION_OPTION compressionOpt,
+        const std::uint8_t* compressed, std::size_t compressedSize)
+    {
+        auto key = GetKey(hash, compressionOpt);
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            AddToMemory(key, size, compressed, compressedSize);
+        }
+        if (!m_root)
+        {
+            return;
+        }
+
+        std::vector<std::uint8_t> data(EntryPrefixSize + compressedSize);
+        std::uint32_t crc = Crc32::Update(0, compressed, compressedSize);
+        std::memcpy(data.data(), EntryHeader, sizeof(EntryHeader));
+        std::memcpy(data.data() + sizeof(EntryHeader), &size, sizeof(size));
+        std::memcpy(data.data() + sizeof(EntryHeader) + sizeof(size), &crc, sizeof(crc));
+        if (compressedSize != 0) { std::memcpy(data.data() + EntryPrefixSize, compressed, compressedSize); }
+        try
+        {
+            m_root->WriteFileContent(GetCacheName(key), data.data(), data.size());
+        }
+        catch (const Exception&)
+        {   // Left out, like when the directory is read only or full
+        }
+    }
+
+    // An entry is only taken when its size and crc check out, so one being written by another writer, or left half
+    // written, is a miss. Anyone can write to the directory, so the block is also inflated and hashed, and an entry
+    // that isn't the block of hash is a miss too.
+    bool CompressedBlockCache::FindInDirectory(const std::string& key, const Sha256Digest& hash, std::uint32_t size,
+        std::vector<std::uint8_t>& compressed)
+    {
+        auto path = m_root->GetFilePath(GetCacheName(key));
+        #ifdef WIN32
+        std::FILE* file = _wfopen(utf8_to_wstring(path).c_str(), L"rb");
+        #else
+        std::FILE* file = std::fopen(path.c_str(), "rb");
+        #endif
+        if (file == nullptr)
+        {
+            return false;
+        }
+        auto closeFile = MSIX::scope_exit([file] { std::fclose(file); });
+
+        std::uint8_t prefix[EntryPrefixSize] = {};
+        if ((std::fread(prefix, 1, sizeof(prefix), file) != sizeof(prefix)) ||
+            (std::memcmp(prefix, EntryHeader, sizeof(EntryHeader)) != 0))
+        {
+            return false;
+        }
+        std::uint32_t storedSize = 0;
+        std::uint32_t crc = 0;
+        std::memcpy(&storedSize, prefix + sizeof(EntryHeader), sizeof(storedSize));
+        std::memcpy(&crc, prefix + sizeof(EntryHeader) + sizeof(storedSize), sizeof(crc));
+        if (storedSize != size)
+        {
+            return false;
+        }
+
+        // A deflated block is at most a little larger than the block
+        std::vector<std::uint8_t> data(static_cast<std::size_t>(size) + size / 8 + 1024);
+        auto read = std::fread(data.data(), 1, data.size(), file);
+        if ((read == data.size()) || (Crc32::Update(0, data.data(), read) != crc))
+        {
+            return false;
+        }
+        data.resize(read);
+
+        std::vector<std::uint8_t> block(size);
+        auto inflater = CreateCompressionObject();
+        if (inflater->Initialize(CompressionOperation::Inflate) != CompressionStatus::Ok)
+        {
+            return false;
+        }
+        inflater->SetInput(data.data(), data.size());
+        inflater->SetOutput(block.data(), block.size());
+        auto status = inflater->Inflate();
+        bool inflated = (status != CompressionStatus::Error) && (status != CompressionStatus::NeedDictionary) &&
+            (inflater->GetAvailableDestinationSize() == 0);
+        inflater->Cleanup();
+        if (!inflated)
+        {
+            return false;
+        }
+        Sha256Digest blockHash;
+        SHA256::ComputeHash(block.data(), size, blockHash);
+        if (blockHash != hash)
+        {
+            return false;
+        }
+        compressed = std::move(data);
+        return true;
+    }
+
+    void CompressedBlockCache::AddToMemory(const std::string& key, std::uint32_t size, const std::uint8_t* compressed,
+        std::size_t compressedSize)
+    {
+        if ((compressedSize > m_maxMemoryBytes) || (m_entries.count(key) != 0))
+        {
+            return;
+        }
+        while (m_memoryBytes + compressedSize > m_maxMemoryBytes)
+        {
+            auto oldest = m_entries.find(m_uses.back());
+            m_memoryBytes -= oldest->second.compressed.size();
+            m_entries.erase(oldest);
+            m_uses.pop_back();
+        }
+        Entry entry;
+        entry.size = size;
+        entry.compressed.assign(compressed, compressed + compressedSize);
+        m_uses.push_front(key);
+        entry.use = m_uses.begin();
+        m_entries.emplace(key, std::move(entry));
+        m_memoryBytes += compressedSize;
+    }
+}
@@ -0,0 +1,90 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+
+#include "CompressionPacer.hpp"
+#include "Exceptions.hpp"
+
+#include <algorithm>
+
+namespace MSIX {
+
+    namespace {
+
+        // The levels from the fastest to the smallest output
+        const APPX_COMPRESSION_OPTION Levels[] = {
+            APPX_COMPRESSION_OPTION_NONE,
+            APPX_COMPRESSION_OPTION_SUPERFAST,
+            APPX_COMPRESSION_OPTION_FAST,
+            APPX_COMPRESSION_OPTION_NORMAL,
+            APPX_COMPRESSION_OPTION_MAXIMUM,
+        };
+
+        // How many times faster than APPX_COMPRESSION_OPTION_MAXIMUM each level usually packs, normal deflates the same way
+        const double RelativeSpeeds[] = { 50.0, 6.0, 4.0, 1.0, 1.0 };
+
+        std::size_t IndexOf(APPX_COMPRESSION_OPTION compressionOpt)
+        {
+            for (std::size_t index = 0; index < sizeof(Levels) / sizeof(Levels[0]); index++)
+            {
+                if (Levels[index] == compressionOpt) { return index; }
+            }
+            ThrowErrorAndLog(Error::InvalidParameter, "Invalid compression option.");
+        }
+    }
+
+    CompressionPacer::CompressionPacer(std::chrono::milliseconds budget, APPX_COMPRESSION_OPTION best, std::uint64_t totalBytes) :
+        m_deadline(std::chrono::steady_clock::now() + budget), m_best(IndexOf(best)), m_bytesLeft(totalBytes)
+    {
+    }
+
+    APPX_COMPRESSION_OPTION CompressionPacer::Choose()
+    {
+        // Nothing is known before the first file
+        bool measured = false;
+        for (std::size_t index = 0; index < LevelCount; index++)
+        {
+            measured = measured || (GetSpeed(index) != 0);
+        }
+        if (!measured) { return Levels[m_best]; }
+
+        double secondsLeft = std::chrono::duration<double>(m_deadline - std::chrono::steady_clock::now()).count();
+        if (secondsLeft <= 0) { return APPX_COMPRESSION_OPTION_NONE; }
+        double required = static_cast<double>(m_bytesLeft) / secondsLeft;
+        for (std::size_t index = m_best; index > 0; index--)
+        {
+            if (GetSpeed(index) >= required) { return Levels[index]; }
+        }
+        return APPX_COMPRESSION_OPTION_NONE;
+    }
+
+    void CompressionPacer::Record(APPX_COMPRESSION_OPTION compressionOpt, std::uint64_t size, std::chrono::steady_clock::duration elapsed)
+    {
+        auto& speed = m_speeds[IndexOf(compressionOpt)];
+        speed.bytes += size;
+        speed.seconds += std::chrono::duration<double>(elapsed).count();
+        m_bytesLeft -= std::min(m_bytesLeft, size);
+    }
+
+    double CompressionPacer::GetSpeed(std::size_t index)
+    {
+        if ((m_speeds[index].bytes != 0) && (m_speeds[index].seconds > 0))
+        {
+            return static_cast<double>(m_speeds[index].bytes) / m_speeds[index].seconds;
+        }
+        // From the closest level measured
+        for (std::size_t distance = 1; distance < LevelCount; distance++)
+        {
+            for (std::size_t other : { index + distance, index - distance })
+            {
+                if ((other < LevelCount) && (m_speeds[other].bytes != 0) && (m_speeds[other].seconds > 0))
+                {
+                    double otherSpeed = static_cast<double>(m_speeds[other].bytes) / m_speeds[other].seconds;
+                    return otherSpeed * RelativeSpeeds[index] / RelativeSpeeds[other];
+                }
+            }
+        }
+        return 0;
+    }
+}
@@ -10,13 +10,18 @@ namespace MSIX {
 
     // Well-known file types to automatically select a MIME content type and compression option to use based on the file extension
     // If the extension is not in this map the default is application/octet-stream and APPX_COMPRESSION_OPTION_NORMAL
-    const ContentType& ContentType::GetContentTypeByExtension(std::string& ext)
+    const ContentType& ContentType::GetContentTypeByExtension(const std::string& ext)
     {
-        static const std::map<std::string, ContentType> extToContentType = 
+        static const std::unordered_map<std::string, ContentType> extToContentType = 
         {
             { "atom",  ContentType("application/atom+xml", APPX_COMPRESSION_OPTION_NORMAL) },
+            { "7z",    ContentType("application/x-7z-compressed", APPX_COMPRESSION_OPTION_NONE) },
+            { "apk",   ContentType("application/vnd.android.package-archive", APPX_COMPRESSION_OPTION_NONE) },
             { "appx",  ContentType("application/vnd.ms-appx", APPX_COMPRESSION_OPTION_NONE) },
+            { "appxbundle", ContentType("application/vnd.ms-appx.bundle", APPX_COMPRESSION_OPTION_NONE) },
             { "b64",   ContentType("application/base64", APPX_COMPRESSION_OPTION_NORMAL) },
+            { "br",    ContentType("application/x-brotli", APPX_COMPRESSION_OPTION_NONE) },
+            { "bz2",   ContentType("application/x-bzip2", APPX_COMPRESSION_OPTION_NONE) },
             { "cab",   ContentType("application/vnd.ms-cab-compressed", APPX_COMPRESSION_OPTION_NONE) },
             { "doc",   ContentType("application/msword", APPX_COMPRESSION_OPTION_NORMAL) },
             { "dot",   ContentType("application/msword", APPX_COMPRESSION_OPTION_NORMAL) },
@@ -28,8 +33,13 @@ namespace MSIX {
             { "dtd",   ContentType("application/xml-dtd", APPX_COMPRESSION_OPTION_NORMAL) },
             { "exe",   ContentType("application/x-msdownload", APPX_COMPRESSION_OPTION_NORMAL) },
             { "gz",    ContentType("application/x-gzip-compressed", APPX_COMPRESSION_OPTION_NONE) },
+            { "jar",   ContentType("application/java-archive", APPX_COMPRESSION_OPTION_NONE) },
             { "java",  ContentType("application/java", APPX_COMPRESSION_OPTION_NORMAL) },
             { "json",  ContentType("application/json", APPX_COMPRESSION_OPTION_NORMAL) },
+            { "lz4",   ContentType("application/x-lz4", APPX_COMPRESSION_OPTION_NONE) },
+            { "msix",  ContentType("application/vnd.ms-appx", APPX_COMPRESSION_OPTION_NONE) },
+            { "msixbundle", ContentType("application/vnd.ms-appx.bundle", APPX_COMPRESSION_OPTION_NONE) },
+            { "nupkg", ContentType("application/zip", APPX_COMPRESSION_OPTION_NONE) },
             { "p7s",   ContentType("application/x-pkcs7-signature", APPX_COMPRESSION_OPTION_NORMAL) },
             { "pdf",   ContentType("application/pdf", APPX_COMPRESSION_OPTION_NORMAL) },
             { "ps",    ContentType("application/postscript", APPX_COMPRESSION_OPTION_NORMAL) },
@@ -47,8 +57,10 @@ namespace MSIX {
             { "rar",   ContentType("application/x-rar-compressed", APPX_COMPRESSION_OPTION_NONE) },
             { "rss",   ContentType("application/rss+xml", APPX_COMPRESSION_OPTION_NORMAL) },
             { "soap",  ContentType("application/soap+xml", APPX_COMPRESSION_OPTION_NORMAL) },
+            { "tgz",   ContentType("application/x-gzip-compressed", APPX_COMPRESSION_OPTION_NONE) },
             { "tar",   ContentType("application/x-tar", APPX_COMPRESSION_OPTION_NONE) },
             { "xaml",  ContentType("application/xaml+xml", APPX_COMPRESSION_OPTION_NORMAL) },
+            { "vsix",  ContentType("application/vsix", APPX_COMPRESSION_OPTION_NONE) },
             { "xap",   ContentType("application/x-silverlight-app", APPX_COMPRESSION_OPTION_NONE) },
             { "xbap",  ContentType("application/x-ms-xbap", APPX_COMPRESSION_OPTION_NORMAL) },
             { "xhtml", ContentType("application/xhtml+xml", APPX_COMPRESSION_OPTION_NORMAL) },
@@ -63,7 +75,12 @@ namespace MSIX {
             { "xltx",  ContentType("application/vnd.openxmlformats-officedocument.spreadsheetml.template", APPX_COMPRESSION_OPTION_NONE) },
             { "xsl",   ContentType("application/xslt+xml", APPX_COMPRESSION_OPTION_NORMAL) },
             { "xslt",  ContentType("application/xslt+xml", APPX_COMPRESSION_OPTION_NORMAL) },
+            { "xz",    ContentType("application/x-xz", APPX_COMPRESSION_OPTION_NONE) },
             { "zip",   ContentType("application/x-zip-compressed", APPX_COMPRESSION_OPTION_NONE) },
+            { "zst",   ContentType("application/zstd", APPX_COMPRESSION_OPTION_NONE) },
+            // Font types
+            { "woff",  ContentType("font/woff", APPX_COMPRESSION_OPTION_NONE) },
+            { "woff2", ContentType("font/woff2", APPX_COMPRESSION_OPTION_NONE) },
             // Text types
             { "c",     ContentType("text/plain", APPX_COMPRESSION_OPTION_NORMAL) },
             { "cpp",   ContentType("text/plain", APPX_COMPRESSION_OPTION_NORMAL) },
@@ -80,18 +97,25 @@ namespace MSIX {
             { "xml",   ContentType("text/xml", APPX_COMPRESSION_OPTION_NORMAL) },
             { "xsd",   ContentType("text/xml", APPX_COMPRESSION_OPTION_NORMAL) },
             // Audio types
+            { "aac",   ContentType("audio/aac", APPX_COMPRESSION_OPTION_NONE) },
             { "aiff",  ContentType("audio/x-aiff", APPX_COMPRESSION_OPTION_NORMAL) },
             { "au",    ContentType("audio/basic", APPX_COMPRESSION_OPTION_NORMAL) },
+            { "flac",  ContentType("audio/flac", APPX_COMPRESSION_OPTION_NONE) },
             { "m4a",   ContentType("audio/mp4", APPX_COMPRESSION_OPTION_NONE) },
             { "mid",   ContentType("audio/mid", APPX_COMPRESSION_OPTION_NORMAL) },
             { "mp3",   ContentType("audio/mpeg", APPX_COMPRESSION_OPTION_NONE) },
+            { "oga",   ContentType("audio/ogg", APPX_COMPRESSION_OPTION_NONE) },
+            { "ogg",   ContentType("audio/ogg", APPX_COMPRESSION_OPTION_NONE) },
+            { "opus",  ContentType("audio/opus", APPX_COMPRESSION_OPTION_NONE) },
             { "smf",   ContentType("audio/mid", APPX_COMPRESSION_OPTION_NORMAL) },
             { "wav",   ContentType("audio/wav", APPX_COMPRESSION_OPTION_NORMAL) },
             { "wma",   ContentType("audio/x-ms-wma", APPX_COMPRESSION_OPTION_NONE) },
             // Image types
+            { "avif",  ContentType("image/avif", APPX_COMPRESSION_OPTION_NONE) },
             { "bmp",   ContentType("image/bmp", APPX_COMPRESSION_OPTION_NORMAL) },
             { "emf",   ContentType("image/x-emf", APPX_COMPRESSION_OPTION_NORMAL) },
             { "gif",   ContentType("image/gif", APPX_COMPRESSION_OPTION_NONE) },
+            { "heic",  ContentType("image/heic", APPX_COMPRESSION_OPTION_NONE) },
             { "ico",   ContentType("image/vnd.microsoft.icon", APPX_COMPRESSION_OPTION_NORMAL) },
             { "jpg",   ContentType("image/jpeg", APPX_COMPRESSION_OPTION_NONE) },
             { "jpeg",  ContentType("image/jpeg", APPX_COMPRESSION_OPTION_NONE) },
@@ -99,12 +123,17 @@ namespace MSIX {
             { "svg",   ContentType("image/svg+xml", APPX_COMPRESSION_OPTION_NORMAL) },
             { "tif",   ContentType("image/tiff", APPX_COMPRESSION_OPTION_NORMAL) },
             { "tiff",  ContentType("image/tiff", APPX_COMPRESSION_OPTION_NORMAL) },
+            { "webp",  ContentType("image/webp", APPX_COMPRESSION_OPTION_NONE) },
             { "wmf",   ContentType("image/x-wmf", APPX_COMPRESSION_OPTION_NORMAL) },
             // Video types
             { "avi",   ContentType("video/avi", APPX_COMPRESSION_OPTION_NONE) },
+            { "m4v",   ContentType("video/mp4", APPX_COMPRESSION_OPTION_NONE) },
+            { "mkv",   ContentType("video/x-matroska", APPX_COMPRESSION_OPTION_NONE) },
+            { "mp4",   ContentType("video/mp4", APPX_COMPRESSION_OPTION_NONE) },
             { "mpeg",  ContentType("video/mpeg", APPX_COMPRESSION_OPTION_NONE) },
             { "mpg",   ContentType("video/mpeg", APPX_COMPRESSION_OPTION_NONE) },
             { "mov",   ContentType("video/quicktime", APPX_COMPRESSION_OPTION_NONE) },
+            { "webm",  ContentType("video/webm", APPX_COMPRESSION_OPTION_NONE) },
             { "wmv",   ContentType("video/x-ms-wmv", APPX_COMPRESSION_OPTION_NONE) }
         };
         // if the extension is not in the map these are the defaults
@@ -132,6 +161,10 @@ namespace MSIX {
         {
             return "application/vnd.ms-appx.signature";
         }
+        if (footprintFile == APPX_FOOTPRINT_FILE_TYPE_CODEINTEGRITY)
+        {
+            return "application/vnd.ms-pkiseccat";
+        }
         // TODO: add other ones if needed, otherwise throw
         ThrowErrorAndLog(Error::NotSupported, "Payload file content type not found");
     }
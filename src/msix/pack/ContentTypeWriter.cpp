@@ -40,48 +40,28 @@ namespace MSIX {
     // File extension to MIME value map that are added as default elements
     // If the extension is already in the map and its content type is different or
     // if the file doesn't have an extensions AddOverride is called.
-    void ContentTypeWriter::AddContentType(const std::string& name, const std::string& contentType, bool forceOverride)
+    void ContentTypeWriter::AddContentType(const PackageFileName& file, const std::string& contentType, bool forceOverride)
     {
-        auto percentageEncodedName = Encoding::EncodeFileName(name);
-
-        auto filename = percentageEncodedName;
-        auto lastSlash = filename.find_last_of("/");
-        if (lastSlash != std::string::npos)
-        {
-            filename = filename.substr(lastSlash + 1);
-        }
-
-        if (forceOverride)
+        if (forceOverride || !file.hasExtension)
         {
-            AddOverride(percentageEncodedName, contentType);
+            AddOverride(file.opcName, contentType);
             return;
         }
 
-        auto findLastPeriod = filename.find_last_of(".");
-        if (findLastPeriod != std::string::npos)
+        // See if already exist
+        auto find = m_defaultExtensions.find(file.normalizedExtension);
+        if (find != m_defaultExtensions.end())
         {
-            // See if already exist
-            std::string ext = filename.substr(findLastPeriod + 1);
-            std::string normalizedExt = ext;
-            std::transform(normalizedExt.begin(), normalizedExt.end(), normalizedExt.begin(), ::tolower);
-            auto find = m_defaultExtensions.find(normalizedExt);
-            if (find != m_defaultExtensions.end())
-            {
-                if (find->second != contentType)
-                {
-                    // The extension is in the table but with a different content type
-                    AddOverride(percentageEncodedName, contentType);
-                }
-            }
-            else
+            if (find->second != contentType)
             {
-                auto result = m_defaultExtensions.emplace(normalizedExt, contentType);
-                AddDefault(ext, contentType);
+                // The extension is in the table but with a different content type
+                AddOverride(file.opcName, contentType);
             }
         }
         else
         {
-            AddOverride(percentageEncodedName, contentType);
+            m_defaultExtensions.emplace(file.normalizedExtension, contentType);
+            AddDefault(file.extension, contentType);
         }
     }
 
@@ -5,20 +5,48 @@
 
 #include "DeflateStream.hpp"
 #include "Exceptions.hpp"
+#include "Tracing.hpp"
 
+#include <map>
 #include <vector>
 
 namespace MSIX {
 
-    DeflateStream::DeflateStream(const ComPtr<IStream>& stream) : m_stream(stream)
+    void InitializeDeflate(z_stream& zstrm, APPX_COMPRESSION_OPTION compressionOption)
     {
-        m_zstrm.zalloc = Z_NULL;
-        m_zstrm.zfree = Z_NULL;
-        m_zstrm.opaque = Z_NULL;
-        auto result = deflateInit2(&m_zstrm, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+        // Normal keeps the level packages have always been deflated with, only the faster options trade size for speed
+        int level = Z_BEST_COMPRESSION;
+        int memLevel = MAX_MEM_LEVEL;
+        switch (compressionOption)
+        {
+        case APPX_COMPRESSION_OPTION_MAXIMUM:
+        case APPX_COMPRESSION_OPTION_NORMAL:
+            break;
+        case APPX_COMPRESSION_OPTION_FAST:
+            level = 3;
+            memLevel = 8; // zlib's default
+            break;
+        case APPX_COMPRESSION_OPTION_SUPERFAST:
+            level = Z_BEST_SPEED;
+            memLevel = 8;
+            break;
+        default:
+            ThrowErrorAndLog(Error::InvalidParameter, "Invalid compression option.");
+        }
+        zstrm.zalloc = Z_NULL;
+        zstrm.zfree = Z_NULL;
+        zstrm.opaque = Z_NULL;
+        auto result = deflateInit2(&zstrm, level, Z_DEFLATED, -MAX_WBITS, memLevel, Z_DEFAULT_STRATEGY);
         ThrowErrorIf(Error::DeflateInitialize, result != Z_OK, "Error calling deflateinit2");
     }
 
+    DeflateStream::DeflateStream(const ComPtr<IStream>& stream, APPX_COMPRESSION_OPTION compressionOption,
+        const std::shared_ptr<PerformanceCounters>& performanceCounters) :
+        m_stream(stream), m_streamInternal(stream.As<IStreamInternal>()), m_performanceCounters(performanceCounters)
+    {
+        InitializeDeflate(m_zstrm, compressionOption);
+    }
+
     DeflateStream::~DeflateStream()
     {
         deflateEnd(&m_zstrm);
@@ -55,29 +83,102 @@ namespace MSIX {
         }
         m_zstrm.next_in = reinterpret_cast<Bytef *>(const_cast<void*>(buffer));
         m_zstrm.avail_in = static_cast<std::uint32_t>(countBytes);
-        auto toWrite = Deflate(disposition);
+        const auto& toWrite = Deflate(disposition);
         ThrowHrIfFailed(m_stream->Write(toWrite.data(), static_cast<ULONG>(toWrite.size()), bytesWritten));
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
 
-    std::vector<std::uint8_t> DeflateStream::Deflate(int disposition)
+    const std::vector<std::uint8_t>& DeflateStream::Deflate(int disposition)
     {
-        std::vector<std::uint8_t> compressedBuffer;
-        std::vector<std::uint8_t> deflateBuffer(1024);
-        do
+        Tracing::Activity activity(Tracing::Event::CompressBlock, "", m_zstrm.avail_in);
+        PerformanceCounters::Measure measure(m_performanceCounters.get(), MSIX_PERFORMANCE_COUNTER_STAGE_DEFLATE, m_zstrm.avail_in);
+        // Deflate straight into the output buffer. deflateBound is enough for the whole input unless
+        // zlib still has data pending from a previous call, in which case the buffer is grown.
+        m_output.resize(static_cast<std::size_t>(deflateBound(&m_zstrm, m_zstrm.avail_in)) + 16);
+        std::size_t have = 0;
+        while (true)
         {
-            m_zstrm.next_out = deflateBuffer.data();
-            m_zstrm.avail_out = static_cast<std::uint32_t>(deflateBuffer.size());
+            m_zstrm.next_out = m_output.data() + have;
+            m_zstrm.avail_out = static_cast<std::uint32_t>(m_output.size() - have);
             auto result = deflate(&m_zstrm, disposition);
             if (disposition == Z_FINISH && result == Z_STREAM_END)
             {
                 result = Z_OK;
             }
             ThrowErrorIf(Error::DeflateWrite, result != Z_OK, "Error deflating stream");
-            auto have = deflateBuffer.size() - m_zstrm.avail_out;
-            compressedBuffer.insert(compressedBuffer.end(), deflateBuffer.data(), deflateBuffer.data() + have);
-       } while (m_zstrm.avail_out == 0);
-       return compressedBuffer;
+            have = m_output.size() - m_zstrm.avail_out;
+            if (m_zstrm.avail_out != 0) { break; }
+            m_output.resize(m_output.size() * 2);
+        }
+        m_output.resize(have);
+        return m_output;
+    }
+
+    BlockDeflater::BlockDeflater(APPX_COMPRESSION_OPTION compressionOption, const std::shared_ptr<PerformanceCounters>& performanceCounters) :
+        m_performanceCounters(performanceCounters)
+    {
+        InitializeDeflate(m_zstrm, compressionOption);
+    }
+
+    BlockDeflater::~BlockDeflater()
+    {
+        deflateEnd(&m_zstrm);
+    }
+
+    const std::vector<std::uint8_t>& BlockDeflater::Deflate(const std::uint8_t* data, std::uint32_t size)
+    {
+        // A reset stream compresses the block exactly as DeflateStream does after a full flush
+        ThrowErrorIf(Error::DeflateWrite, deflateReset(&m_zstrm) != Z_OK, "Error resetting deflate stream");
+        m_zstrm.next_in = const_cast<Bytef*>(data);
+        m_zstrm.avail_in = size;
+        return Run(Z_FULL_FLUSH);
+    }
+
+    const std::vector<std::uint8_t>& BlockDeflater::Finish()
+    {
+        ThrowErrorIf(Error::DeflateWrite, deflateReset(&m_zstrm) != Z_OK, "Error resetting deflate stream");
+        m_zstrm.next_in = Z_NULL;
+        m_zstrm.avail_in = 0;
+        return Run(Z_FINISH);
+    }
+
+    BlockDeflater& BlockDeflater::ForCurrentThread(APPX_COMPRESSION_OPTION compressionOption,
+        const std::shared_ptr<PerformanceCounters>& performanceCounters)
+    {
+        thread_local std::map<APPX_COMPRESSION_OPTION, std::unique_ptr<BlockDeflater>> deflaters;
+        auto& deflater = deflaters[compressionOption];
+        if (!deflater)
+        {
+            deflater = std::make_unique<BlockDeflater>(compressionOption, performanceCounters);
+        }
+        // The deflater outlives the factory it was made for, the next one to use it gets the counts
+        deflater->m_performanceCounters = performanceCounters;
+        return *deflater;
+    }
+
+    const std::vector<std::uint8_t>& BlockDeflater::Run(int disposition)
+    {
+        Tracing::Activity activity(Tracing::Event::CompressBlock, "", m_zstrm.avail_in);
+        PerformanceCounters::Measure measure(m_performanceCounters.get(), MSIX_PERFORMANCE_COUNTER_STAGE_DEFLATE, m_zstrm.avail_in);
+        // deflateBound doesn't count the flush marker
+        m_output.resize(static_cast<std::size_t>(deflateBound(&m_zstrm, m_zstrm.avail_in)) + 16);
+        std::size_t have = 0;
+        while (true)
+        {
+            m_zstrm.next_out = m_output.data() + have;
+            m_zstrm.avail_out = static_cast<std::uint32_t>(m_output.size() - have);
+            auto result = deflate(&m_zstrm, disposition);
+            if (disposition == Z_FINISH && result == Z_STREAM_END)
+            {
+                result = Z_OK;
+            }
+            ThrowErrorIf(Error::DeflateWrite, result != Z_OK, "Error deflating stream");
+            have = m_output.size() - m_zstrm.avail_out;
+            if (m_zstrm.avail_out != 0) { break; }
+            m_output.resize(m_output.size() * 2);
+        }
+        m_output.resize(have);
+        return m_output;
     }
 
 }
\ No newline at end of file
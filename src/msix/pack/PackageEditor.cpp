@@ -0,0 +1,163 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "PackageEditor.hpp"
+#include "AppxFactory.hpp"
+#include "ContentType.hpp"
+#include "Crc32.hpp"
+#include "Exceptions.hpp"
+#include "ScopeExit.hpp"
+#include "StreamHelper.hpp"
+#include "ZipObjectReader.hpp"
+#include "ZipObjectWriter.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace MSIX {
+
+    namespace {
+
+        using FileContent = std::pair<std::string, std::vector<std::uint8_t>>;
+
+        std::vector<std::uint8_t> ReadAll(IStream* stream)
+        {
+            return Helper::CreateBufferFromStream(ComPtr<IStream>(stream));
+        }
+
+        std::string ToLower(std::string value)
+        {
+            std::transform(value.begin(), value.end(), value.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            return value;
+        }
+
+        // Adds an override for name to the content types if it doesn't have one. Returns false if it already had it.
+        bool AddOverride(std::string& contentTypes, const std::string& name, const std::string& contentType)
+        {
+            // Part names are case insensitive
+            auto partName = "PartName=\"/" + name + "\"";
+            if (ToLower(contentTypes).find(ToLower(partName)) != std::string::npos)
+            {
+                return false;
+            }
+            auto end = contentTypes.rfind("</Types>");
+            ThrowErrorIf(Error::XmlError, (end == std::string::npos), "[Content_Types].xml doesn't end with </Types>");
+            contentTypes.insert(end, "<Override ContentType=\"" + contentType + "\" " + partName + "/>");
+            return true;
+        }
+
+        void AddFile(ZipObjectWriter* zip, const FileContent& file)
+        {
+            auto fileInfo = zip->PrepareToAddFile(file.first, APPX_COMPRESSION_OPTION_NORMAL, false);
+            auto& zipFileStream = fileInfo.second;
+            ULONG bytesWritten = 0;
+            if (!file.second.empty())
+            {
+                ThrowHrIfFailed(zipFileStream->Write(file.second.data(), static_cast<ULONG>(file.second.size()), &bytesWritten));
+            }
+            // Put the stream termination on
+            ThrowHrIfFailed(zipFileStream->Write(nullptr, 0, &bytesWritten));
+            auto crc = Crc32::Update(0, file.second.data(), file.second.size());
+            auto compressedSize = zipFileStream.As<IStreamInternal>()->GetSize();
+            zip->EndFile(crc, compressedSize, file.second.size(), true);
+        }
+    }
+
+    void ReplaceFootprintFiles(IStream* package, const std::map<APPX_FOOTPRINT_FILE_TYPE, ComPtr<IStream>>& files)
+    {
+        auto reader = ComPtr<ZipObjectReader>::Make<ZipObjectReader>(ComPtr<IStream>(package));
+        auto names = reader->GetFileNames(FileNameOptions::All);
+        auto hasFile = [&names](const std::string& name) { return std::find(names.begin(), names.end(), name) != names.end(); };
+
+        // Everything is read before anything of the package is overwritten. The signature goes last, whether it is
+        // replaced or the package already has it, as it signs what is before it.
+        auto contentTypesStream = reader->GetFile(CONTENT_TYPES_XML);
+        ThrowErrorIfNot(Error::MissingContentTypesXML, contentTypesStream, "Package doesn't have [Content_Types].xml");
+        auto contentTypesBuffer = ReadAll(contentTypesStream.Get());
+        std::string contentTypes(contentTypesBuffer.begin(), contentTypesBuffer.end());
+        bool contentTypesChanged = false;
+
+        std::vector<FileContent> added;
+        std::vector<std::uint8_t> signature;
+        bool hasSignature = hasFile(APPXSIGNATURE_P7X);
+        for (const auto& file : files)
+        {
+            ThrowErrorIf(Error::NotSupported, (file.first >= footprintFiles.size()), "Only the manifest, block map, signature and code integrity catalog can be replaced");
+            std::string name = footprintFiles[file.first];
+            if (!hasFile(name))
+            {
+                contentTypesChanged |= AddOverride(contentTypes, name, ContentType::GetPayloadFileContentType(file.first));
+            }
+            if (file.first == APPX_FOOTPRINT_FILE_TYPE_SIGNATURE)
+            {
+                signature = ReadAll(file.second.Get());
+                hasSignature = true;
+            }
+            else
+            {
+                added.emplace_back(name, ReadAll(file.second.Get()));
+            }
+        }
+        if (contentTypesChanged)
+        {
+            added.emplace_back(CONTENT_TYPES_XML, std::vector<std::uint8_t>(contentTypes.begin(), contentTypes.end()));
+        }
+        if (hasSignature)
+        {
+            if (files.find(APPX_FOOTPRINT_FILE_TYPE_SIGNATURE) == files.end())
+            {
+                signature = ReadAll(reader->GetFile(APPXSIGNATURE_P7X).Get());
+            }
+            added.emplace_back(APPXSIGNATURE_P7X, std::move(signature));
+        }
+
+        std::vector<std::string> removed;
+        for (const auto& file : added)
+        {
+            removed.push_back(file.first);
+        }
+
+        // The files replaced that are written last and the central directory are overwritten, they are kept to put
+        // the package back as it was if it can't be written
+        auto start = reader->GetCentralDirectoryRange().offset;
+        for (auto name = names.rbegin(); (name != names.rend()) && (std::find(removed.begin(), removed.end(), *name) != removed.end()); name++)
+        {
+            start = reader->GetFileRecords(*name).localFileHeader.offset;
+        }
+        ULARGE_INTEGER end = { 0 };
+        ThrowHrIfFailed(package->Seek({ 0 }, StreamBase::Reference::END, &end));
+        LARGE_INTEGER position = { 0 };
+        position.QuadPart = static_cast<LONGLONG>(start);
+        ThrowHrIfFailed(package->Seek(position, StreamBase::Reference::START, nullptr));
+        std::vector<std::uint8_t> original(static_cast<std::size_t>(end.QuadPart - start));
+        ULONG bytesRead = 0;
+        ThrowHrIfFailed(package->Read(original.data(), static_cast<ULONG>(original.size()), &bytesRead));
+        ThrowErrorIf(Error::FileRead, (bytesRead != original.size()), "read error");
+
+        auto restore = MSIX::scope_exit([package, &position, &original]
+        {
+            // Nothing else can be done if this fails too
+            ULONG bytesWritten = 0;
+            ULARGE_INTEGER size = { 0 };
+            size.QuadPart = static_cast<std::uint64_t>(position.QuadPart) + original.size();
+            if (SUCCEEDED(package->Seek(position, StreamBase::Reference::START, nullptr)) &&
+                SUCCEEDED(package->Write(original.data(), static_cast<ULONG>(original.size()), &bytesWritten)))
+            {
+                package->SetSize(size);
+            }
+        });
+
+        auto zip = ComPtr<ZipObjectWriter>::Make<ZipObjectWriter>(reader.As<IStorageObject>());
+        zip->RemoveFiles(removed);
+        for (const auto& file : added)
+        {
+            AddFile(zip.Get(), file);
+        }
+        zip->Close();
+        restore.release();
+    }
+}
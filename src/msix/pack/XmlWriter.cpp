@@ -8,7 +8,9 @@
 #include "Exceptions.hpp"
 #include "MsixErrors.hpp"
 #include "StreamHelper.hpp"
+#include "Encoding.hpp"
 
+#include <algorithm>
 #include <stack>
 #include <string>
 
@@ -20,6 +22,7 @@ namespace MSIX {
         // Adds xml header declaration plus the name of the root element
         void XmlWriter::StartWrite(const std::string& root, bool standalone)
         {
+            m_buffer.reserve(XmlWriterBufferSize);
             m_elements.emplace(root);
             Write(xmlStart);
             if (standalone)
@@ -36,6 +39,11 @@ namespace MSIX {
         }
 
         void XmlWriter::StartElement(const std::string& name)
+        {
+            StartElement(name.c_str());
+        }
+
+        void XmlWriter::StartElement(const char* name)
         {
             ThrowErrorIf(Error::XmlError, m_state == State::Finish, "Invalid call, xml already finished");
             m_elements.emplace(name);
@@ -46,7 +54,7 @@ namespace MSIX {
                 Write(">"); // close parent element
             }
             Write("<");
-            Write(name);
+            Write(m_elements.top());
             m_state = State::OpenElement;
         }
 
@@ -72,17 +80,72 @@ namespace MSIX {
             if (m_elements.size() == 0)
             {
                 m_state = State::Finish;
+                Flush();
             }
         }
 
         void XmlWriter::AddAttribute(const std::string& name, const std::string& value)
+        {
+            StartAttribute(name.data(), name.size());
+            WriteTextValue(value.data(), value.size());
+            Write("\"");
+        }
+
+        void XmlWriter::AddAttribute(const char* name, const std::string& value)
+        {
+            StartAttribute(name, std::strlen(name));
+            WriteTextValue(value.data(), value.size());
+            Write("\"");
+        }
+
+        void XmlWriter::AddAttribute(const char* name, const char* value)
+        {
+            StartAttribute(name, std::strlen(name));
+            WriteTextValue(value, std::strlen(value));
+            Write("\"");
+        }
+
+        void XmlWriter::AddNumericAttribute(const char* name, std::uint64_t value)
+        {
+            StartAttribute(name, std::strlen(name));
+            char digits[20];
+            std::size_t count = 0;
+            do
+            {
+                digits[sizeof(digits) - ++count] = static_cast<char>('0' + (value % 10));
+                value /= 10;
+            } while (value != 0);
+            Write(digits + sizeof(digits) - count, count);
+            Write("\"");
+        }
+
+        void XmlWriter::AddBase64Attribute(const char* name, const std::vector<std::uint8_t>& value)
+        {
+            AddBase64Attribute(name, value.data(), value.size());
+        }
+
+        void XmlWriter::AddBase64Attribute(const char* name, const std::uint8_t* value, std::size_t size)
+        {
+            StartAttribute(name, std::strlen(name));
+            // Base64 has no characters to escape. Encode in chunks of whole groups, a digest is a single one.
+            const std::size_t chunkSize = 48;
+            char encoded[64];
+            for (std::size_t i = 0; i < size; i += chunkSize)
+            {
+                auto count = std::min(chunkSize, size - i);
+                Encoding::EncodeBase64(value + i, count, encoded);
+                Write(encoded, Encoding::GetBase64EncodedSize(count));
+            }
+            Write("\"");
+        }
+
+        // Writes the space before the attribute, the name, the equal sign and the opening quote
+        void XmlWriter::StartAttribute(const char* name, std::size_t size)
         {
             ThrowErrorIf(Error::XmlError, (m_state == State::Finish) || (m_state == State::ClosedElement), "Invalid call to AddAttribute");
             Write(" "); // always write a space. We just wrote either an element or an attribute
-            Write(name); // name="value"
+            Write(name, size); // name="value"
             Write("=\"");
-            WriteTextValue(value);
-            Write("\"");
         }
 
         ComPtr<IStream> XmlWriter::GetStream()
@@ -96,41 +159,53 @@ namespace MSIX {
         //  all open angle brackets (<) are replaced by &lt;
         //  all closing angle brackets (>) are replaced by &gt;
         //  and all #xD characters are replaced by &#xD; 
-        void XmlWriter::WriteTextValue(const std::string& value)
+        // The characters between the ones replaced are written all at once.
+        void XmlWriter::WriteTextValue(const char* value, std::size_t size)
         {
-            for(int i = 0; i < value.size(); i++)
+            std::size_t run = 0;
+            for (std::size_t i = 0; i < size; i++)
             {
+                const char* replacement = nullptr;
                 if (value[i] == '&')
                 {
-                    Write("&amp;");
+                    replacement = "&amp;";
                 }
                 else if (value[i] == '<')
                 {
-                    Write("&lt;");
+                    replacement = "&lt;";
                 }
                 else if (value[i] == '>')
                 {
-                    Write("&gt;");
+                    replacement = "&gt;";
                 }
                 else if (value[i] == 0xd)
                 {
-                    Write("&#xD;");
+                    replacement = "&#xD;";
                 }
-                else
+                if (replacement != nullptr)
                 {
-                    Write(value[i]);
+                    Write(value + run, i - run);
+                    Write(replacement);
+                    run = i + 1;
                 }
             }
+            Write(value + run, size - run);
         }
 
-        void XmlWriter::Write(const std::string& toWrite)
+        void XmlWriter::Write(const char* toWrite, std::size_t size)
         {
-            Helper::WriteStringToStream(m_stream, toWrite);
+            m_buffer.append(toWrite, size);
+            if (m_buffer.size() >= XmlWriterBufferSize)
+            {
+                Flush();
+            }
         }
 
-        void XmlWriter::Write(const char toWrite)
+        void XmlWriter::Flush()
         {
-            Helper::WriteStringToStream(m_stream, std::string(1, toWrite));
+            if (m_buffer.empty()) { return; }
+            Helper::WriteStringToStream(m_stream, m_buffer);
+            m_buffer.clear();
         }
 
 }
@@ -11,6 +11,9 @@
 #include "DeflateStream.hpp"
 #include "StreamHelper.hpp"
 #include "Encoding.hpp"
+#include "BufferedWriteStream.hpp"
+
+#include <algorithm>
 
 namespace MSIX {
 
@@ -37,6 +40,21 @@ namespace MSIX {
     {
     }
 
+    // The buffered stream tracks the offsets of the lfhs and the central directory, the zip file
+    // starts where the output stream is.
+    ZipObjectWriter::ZipObjectWriter(const ComPtr<IStream>& stream, bool isStreaming, const std::shared_ptr<PerformanceCounters>& performanceCounters,
+        bool signingDigests) :
+        ZipObject(isStreaming ? ComPtr<IStream>::Make<BufferedWriteStream>(stream) : stream),
+        m_isStreaming(isStreaming),
+        m_performanceCounters(performanceCounters)
+    {
+        if (signingDigests)
+        {
+            m_digestStream = ComPtr<DigestStream>::Make<DigestStream>(m_stream);
+            m_stream = m_digestStream.As<IStream>();
+        }
+    }
+
     // This is used for editing a package (aka signing)
     ZipObjectWriter::ZipObjectWriter(const ComPtr<IStorageObject>& storageObject) : ZipObject(storageObject)
     {
@@ -49,6 +67,48 @@ namespace MSIX {
         LARGE_INTEGER pos = {0};
         pos.QuadPart = m_zip64EndOfCentralDirectory.GetOffsetStartOfCD();
         ThrowHrIfFailed(m_stream->Seek(pos, StreamBase::Reference::START, nullptr));
+        m_isEditing = true;
+    }
+
+    void ZipObjectWriter::RemoveFiles(const std::vector<std::string>& fileNames)
+    {
+        ULARGE_INTEGER pos = {0};
+        ThrowHrIfFailed(m_stream->Seek({0}, StreamBase::Reference::CURRENT, &pos));
+        ThrowErrorIf(Error::InvalidState, !m_isEditing || (m_state != ZipObjectWriter::State::ReadyForLfhOrClose) ||
+            (pos.QuadPart != m_zip64EndOfCentralDirectory.GetOffsetStartOfCD()), "Files can only be removed before any is added");
+
+        // The offsets of the lfh of the files, and whether they are removed
+        std::vector<std::pair<std::uint64_t, bool>> records;
+        for (const auto& cdh : m_centralDirectories)
+        {
+            bool isRemoved = std::find(fileNames.begin(), fileNames.end(), cdh.first) != fileNames.end();
+            records.emplace_back(cdh.second.GetRelativeOffsetOfLocalHeader(), isRemoved);
+        }
+        std::sort(records.begin(), records.end());
+        std::uint64_t endOfFiles = pos.QuadPart;
+        for (auto record = records.rbegin(); (record != records.rend()) && record->second; record++)
+        {
+            endOfFiles = record->first;
+        }
+
+        for (const auto& name : fileNames)
+        {
+            m_centralDirectories.erase(name);
+        }
+        LARGE_INTEGER start = {0};
+        start.QuadPart = static_cast<LONGLONG>(endOfFiles);
+        ThrowHrIfFailed(m_stream->Seek(start, StreamBase::Reference::START, nullptr));
+    }
+
+    void ZipObjectWriter::MoveCentralDirectories()
+    {
+        for (auto& cdh : m_centralDirectories)
+        {
+            m_fileNames.insert(cdh.first);
+            cdh.second.AppendBytes(m_centralDirectory);
+        }
+        m_centralDirectoryCount += m_centralDirectories.size();
+        m_centralDirectories.clear();
     }
 
     // IStorage
@@ -65,33 +125,35 @@ namespace MSIX {
     }
 
     // IZipWriter
-    std::pair<std::uint32_t, ComPtr<IStream>> ZipObjectWriter::PrepareToAddFile(const std::string& name, bool isCompressed)
+    std::pair<std::uint32_t, ComPtr<IStream>> ZipObjectWriter::PrepareToAddFile(const std::string& name, APPX_COMPRESSION_OPTION compressionOption, bool isPrecompressed)
     {
+        bool isCompressed = (compressionOption != APPX_COMPRESSION_OPTION_NONE);
         ThrowErrorIf(Error::InvalidState, m_state != ZipObjectWriter::State::ReadyForLfhOrClose, "Invalid zip writer state");
 
-        auto result = m_centralDirectories.find(name);
-        if (result != m_centralDirectories.end())
+        MoveCentralDirectories();
+        if (m_fileNames.count(name) != 0)
         {
             auto message = "Adding duplicated file " + Encoding::DecodeFileName(name) + "to package";
             ThrowErrorAndLog(Error::DuplicateFile, message.c_str());
         }
 
-        // Get position were the lfh is going to be written
+        // Get position were the lfh is going to be written, after the records that are still pending
         ULARGE_INTEGER pos = {0};
         ThrowHrIfFailed(m_stream->Seek({0}, StreamBase::Reference::CURRENT, &pos));
+        pos.QuadPart += m_pendingRecords->size();
 
-        // Write lfh
+        // The lfh is written with the first bytes of the file
         LocalFileHeader lfh;
         lfh.SetData(name, isCompressed);
-        lfh.WriteTo(m_stream);
+        lfh.AppendBytes(*m_pendingRecords);
 
         m_lastLFH = std::make_pair(static_cast<std::uint64_t>(pos.QuadPart), std::move(lfh));
         m_state = ZipObjectWriter::State::ReadyForFile;
 
-        ComPtr<IStream> zipStream = ComPtr<IStream>::Make<ZipFileStream>(name, isCompressed, m_stream.Get());
-        if (isCompressed)
+        ComPtr<IStream> zipStream = ComPtr<IStream>::Make<ZipFileStream>(name, isCompressed, m_stream.Get(), m_pendingRecords);
+        if (isCompressed && !isPrecompressed)
         {
-            zipStream = ComPtr<IStream>::Make<DeflateStream>(zipStream);
+            zipStream = ComPtr<IStream>::Make<DeflateStream>(zipStream, compressionOption, m_performanceCounters);
         }
 
         return std::make_pair(static_cast<std::uint32_t>(m_lastLFH.second.Size()), std::move(zipStream));
@@ -101,13 +163,23 @@ namespace MSIX {
     {
         ThrowErrorIf(Error::InvalidState, m_state != ZipObjectWriter::State::ReadyForFile, "Invalid zip writer state");
 
+        // The lfh can't be rewritten once it is written forward or hashed
+        forceDataDescriptor = forceDataDescriptor || m_isStreaming || m_digestStream;
         if (forceDataDescriptor ||
             compressedSize > MaxSizeToNotUseDataDescriptor ||
             uncompressedSize > MaxSizeToNotUseDataDescriptor)
         {
-            // Create and write data descriptor 
+            // The data descriptor is written with the next lfh, or the central directory
             DataDescriptor descriptor = DataDescriptor(crc, compressedSize, uncompressedSize);
-            descriptor.WriteTo(m_stream);
+            descriptor.AppendBytes(*m_pendingRecords);
+        }
+        else if (!m_pendingRecords->empty())
+        {   // Nothing was written for the file, the lfh is still pending and is updated where it is
+            size_t currentSize = m_lastLFH.second.Size();
+            m_lastLFH.second.SetData(crc, compressedSize, uncompressedSize);
+            ThrowErrorIf(Error::Unexpected, currentSize != m_lastLFH.second.Size(), "Cannot change the LFH size when updating it");
+            m_pendingRecords->resize(m_pendingRecords->size() - currentSize);
+            m_lastLFH.second.AppendBytes(*m_pendingRecords);
         }
         else
         {
@@ -126,41 +198,91 @@ namespace MSIX {
             m_lastLFH.second.WriteTo(m_stream);
         }
 
-        // Create and add cdh to map
+        // Add the cdh to the central directory
+        auto name = m_lastLFH.second.GetFileName();
         CentralDirectoryFileHeader cdh;
-        cdh.SetData(m_lastLFH.second.GetFileName(), crc, compressedSize, uncompressedSize, m_lastLFH.first, m_lastLFH.second.GetCompressionMethod(), forceDataDescriptor);
-        m_centralDirectories.insert(std::make_pair(m_lastLFH.second.GetFileName(), std::move(cdh)));
+        cdh.SetData(name, crc, compressedSize, uncompressedSize, m_lastLFH.first, m_lastLFH.second.GetCompressionMethod(), forceDataDescriptor);
+        cdh.AppendBytes(m_centralDirectory);
+        m_centralDirectoryCount++;
+        m_fileNames.insert(std::move(name));
         m_state = ZipObjectWriter::State::ReadyForLfhOrClose;
     }
 
+    std::uint64_t ZipObjectWriter::GetCurrentFileOffset()
+    {
+        ThrowErrorIf(Error::InvalidState, m_state != ZipObjectWriter::State::ReadyForFile, "Invalid zip writer state");
+        return m_lastLFH.first + m_lastLFH.second.Size();
+    }
+
     void ZipObjectWriter::Close()
     {
         ThrowErrorIf(Error::InvalidState, m_state != ZipObjectWriter::State::ReadyForLfhOrClose, "Invalid zip writer state");
-        // Write central directories
+        if (m_digestStream)
+        {   // The digest of the file records ends with the last of them
+            WriteWithPendingRecords(nullptr, 0);
+            m_digestStream->EndPart(m_fileRecordsDigest);
+        }
+
+        // The central directories and the records after them are written at once, with what is still pending
+        MoveCentralDirectories();
         ULARGE_INTEGER startOfCdh = {0};
         ThrowHrIfFailed(m_stream->Seek({0}, StreamBase::Reference::CURRENT, &startOfCdh));
-        std::size_t cdhsSize = 0;
-        for (auto& cdh : m_centralDirectories)
-        {
-            cdhsSize += cdh.second.Size();
-            cdh.second.WriteTo(m_stream);
-        }
+        startOfCdh.QuadPart += m_pendingRecords->size();
+        std::size_t cdhsSize = m_centralDirectory.size();
 
-        // Write zip64 end of cds
-        ULARGE_INTEGER startOfZip64EndOfCds = {0};
-        ThrowHrIfFailed(m_stream->Seek({0}, StreamBase::Reference::CURRENT, &startOfZip64EndOfCds));
-        m_zip64EndOfCentralDirectory.SetData(m_centralDirectories.size(), static_cast<std::uint64_t>(cdhsSize), 
+        // zip64 end of cds and zip64 locator
+        std::uint64_t startOfZip64EndOfCds = static_cast<std::uint64_t>(startOfCdh.QuadPart) + cdhsSize;
+        m_zip64EndOfCentralDirectory.SetData(m_centralDirectoryCount, static_cast<std::uint64_t>(cdhsSize), 
             static_cast<std::uint64_t>(startOfCdh.QuadPart));
-        m_zip64EndOfCentralDirectory.WriteTo(m_stream);
-
-        // Write zip64 locator
-        m_zip64Locator.SetData(static_cast<std::uint64_t>(startOfZip64EndOfCds.QuadPart));
-        m_zip64Locator.WriteTo(m_stream);
+        m_zip64Locator.SetData(startOfZip64EndOfCds);
+        std::vector<std::uint8_t> endRecords;
+        m_zip64EndOfCentralDirectory.AppendBytes(endRecords);
+        m_zip64Locator.AppendBytes(endRecords);
 
         // Because we only use zip64, EndCentralDirectoryRecord never changes
-        m_endCentralDirectoryRecord.WriteTo(m_stream);
+        m_endCentralDirectoryRecord.AppendBytes(endRecords);
+        StreamWriteBuffer buffers[] = {
+            { m_centralDirectory.data(), static_cast<ULONG>(cdhsSize) },
+            { endRecords.data(), static_cast<ULONG>(endRecords.size()) } };
+        WriteWithPendingRecords(buffers, 2);
+        if (m_isEditing)
+        {   // The records can now be shorter than the ones they replaced
+            ULARGE_INTEGER end = {0};
+            ThrowHrIfFailed(m_stream->Seek({0}, StreamBase::Reference::CURRENT, &end));
+            ThrowHrIfFailed(m_stream->SetSize(end));
+        }
+        if (m_digestStream)
+        {
+            m_digestStream->EndPart(m_centralDirectoryDigest);
+        }
+
+        if (m_isStreaming)
+        {   // Write what is left in the buffer
+            ThrowHrIfFailed(m_stream->Commit(STGC_DEFAULT));
+        }
 
         m_state = ZipObjectWriter::State::Closed;
     }
 
+    void ZipObjectWriter::WriteWithPendingRecords(const StreamWriteBuffer* buffers, std::size_t count)
+    {
+        std::vector<StreamWriteBuffer> withRecords;
+        withRecords.reserve(count + 1);
+        withRecords.push_back({ m_pendingRecords->data(), static_cast<ULONG>(m_pendingRecords->size()) });
+        withRecords.insert(withRecords.end(), buffers, buffers + count);
+        StreamBase::WriteBuffers(m_stream.Get(), withRecords.data(), withRecords.size());
+        m_pendingRecords->clear();
+    }
+
+    bool ZipObjectWriter::GetSigningDigests(Sha256Digest& fileRecords, Sha256Digest& centralDirectory)
+    {
+        if (!m_digestStream || (m_state != ZipObjectWriter::State::Closed))
+        {
+            return false;
+        }
+        fileRecords = m_fileRecordsDigest;
+        centralDirectory = m_centralDirectoryDigest;
+        return true;
+    }
+
 }
\ No newline at end of file
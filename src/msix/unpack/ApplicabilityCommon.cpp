@@ -75,45 +75,35 @@ namespace MSIX {
         }
     }
 
-    Bcp47ClosenessMeasure Bcp47Tag::Compare(const Bcp47Tag& otherTag)
-    {
-        std::string thisLanguage;
-        thisLanguage.resize(m_language.size());
-        std::transform(m_language.begin(), m_language.end(), thisLanguage.begin(), ::tolower);
-
-        std::string otherLanguage;
-        otherLanguage.resize(otherTag.m_language.size());
-        std::transform(otherTag.m_language.begin(), otherTag.m_language.end(), otherLanguage.begin(), ::tolower);
-
-        std::string thisScript;
-        thisScript.resize(m_script.size());
-        std::transform(m_script.begin(), m_script.end(), thisScript.begin(), ::tolower);
-
-        std::string otherScript;
-        otherScript.resize(otherTag.m_script.size());
-        std::transform(otherTag.m_script.begin(), otherTag.m_script.end(), otherScript.begin(), ::tolower);
-
-        std::string thisRegion;
-        thisRegion.resize(m_region.size());
-        std::transform(m_region.begin(), m_region.end(), thisRegion.begin(), ::tolower);
+    namespace {
+        bool EqualsIgnoreCase(const std::string& left, const std::string& right)
+        {
+            return (left.size() == right.size()) && std::equal(left.begin(), left.end(), right.begin(), [](char l, char r)
+            {
+                return ::tolower(static_cast<unsigned char>(l)) == ::tolower(static_cast<unsigned char>(r));
+            });
+        }
+    }
 
-        std::string otherRegion;
-        otherRegion.resize(otherTag.m_region.size());
-        std::transform(otherTag.m_region.begin(), otherTag.m_region.end(), otherRegion.begin(), ::tolower);
+    // Every system language is compared with every language of every package of a bundle, for every set of
+    // languages it's selected for, so the parts are compared in place instead of lowered into copies.
+    Bcp47ClosenessMeasure Bcp47Tag::Compare(const Bcp47Tag& otherTag, const std::string& region) const
+    {
+        static const std::string undetermined = "und";
 
         // Compare for und-*
-        if (thisLanguage == "und" || otherLanguage == "und")
+        if (EqualsIgnoreCase(m_language, undetermined) || EqualsIgnoreCase(otherTag.m_language, undetermined))
         {
-            if (thisScript == otherScript)
+            if (EqualsIgnoreCase(m_script, otherTag.m_script))
             {
                 return Bcp47ClosenessMeasure::AnyMatchWithScript;
             }
             return Bcp47ClosenessMeasure::AnyMatch;
         }
 
-        if (thisLanguage == otherLanguage && thisScript == otherScript)
+        if (EqualsIgnoreCase(m_language, otherTag.m_language) && EqualsIgnoreCase(m_script, otherTag.m_script))
         {
-            if (thisRegion == otherRegion)
+            if (EqualsIgnoreCase(region, otherTag.m_region))
             {
                 return Bcp47ClosenessMeasure::ExactMatch;
             }
@@ -123,11 +113,15 @@ namespace MSIX {
         return Bcp47ClosenessMeasure::NoMatch;
     }
 
+    Bcp47ClosenessMeasure Bcp47Tag::Compare(const Bcp47Tag& otherTag) const
+    {
+        return Compare(otherTag, m_region);
+    }
+
     // Compares the neutral form of this Bcp47 tag
-    Bcp47ClosenessMeasure Bcp47Tag::CompareNeutral(const Bcp47Tag& otherTag)
+    Bcp47ClosenessMeasure Bcp47Tag::CompareNeutral(const Bcp47Tag& otherTag) const
     {
-        Bcp47Tag neutral(m_language, m_script, "");
-        return neutral.Compare(otherTag);
+        return Compare(otherTag, std::string());
     }
 
     const std::string Bcp47Tag::GetFullTag() const
@@ -157,12 +151,23 @@ namespace MSIX {
         }
     }
 
+    std::string Applicability::GetSelectionKey(const std::string& bundleManifestHash) const
+    {
+        std::string key = bundleManifestHash;
+        key += '\0' + std::to_string(static_cast<std::uint32_t>(m_applicabilityFlags));
+        for (const auto& language : m_languages)
+        {
+            key += '\0' + language.GetFullTag();
+        }
+        return key;
+    }
+
     void Applicability::AddPackageIfApplicable(ComPtr<IAppxPackageReader>& reader, APPX_BUNDLE_PAYLOAD_PACKAGE_TYPE packageType, const ComPtr<IAppxBundleManifestPackageInfo>& bundlePackageInfo)
     {
         auto bundlePackageInfoInternal = bundlePackageInfo.As<IAppxBundleManifestPackageInfoInternal>();
         auto packageName = bundlePackageInfoInternal->GetFileName();
-        auto packageLanguages = bundlePackageInfoInternal->GetLanguages();
-        auto packageScales = bundlePackageInfoInternal->GetScales();
+        const auto& packageLanguages = bundlePackageInfoInternal->GetLanguages();
+        const auto& packageScales = bundlePackageInfoInternal->GetScales();
         
         // If there are not qualified resources the package is always applicable
         // MSIX_APPLICABILITY_NONE indicates that we should skip all applicability checks
@@ -276,4 +281,30 @@ namespace MSIX {
         }
     }
 
+    std::vector<Bcp47Tag> ApplicabilityCache::GetSystemLanguages()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (!m_hasSystemLanguages)
+        {
+            m_systemLanguages = Applicability::GetLanguages();
+            m_hasSystemLanguages = true;
+        }
+        return m_systemLanguages;
+    }
+
+    bool ApplicabilityCache::GetApplicablePackages(const std::string& selectionKey, std::vector<std::string>& applicablePackagesNames)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto found = m_applicablePackages.find(selectionKey);
+        if (found == m_applicablePackages.end()) { return false; }
+        applicablePackagesNames = found->second;
+        return true;
+    }
+
+    void ApplicabilityCache::AddApplicablePackages(const std::string& selectionKey, const std::vector<std::string>& applicablePackagesNames)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_applicablePackages[selectionKey] = applicablePackagesNames;
+    }
+
 } // namespace MSIX
@@ -7,8 +7,12 @@
 #include <iterator>
 #include "IXml.hpp"
 #include "BlockMapStream.hpp"
+#include "BlockMapParser.hpp"
+#include "Encoding.hpp"
+#include "StreamHelper.hpp"
 #include "MSIXResource.hpp"
 #include "Enumerators.hpp"
+#include "Tracing.hpp"
 
 /* Example XML:
 <?xml version="1.0" encoding="UTF-8"?>
@@ -31,26 +35,87 @@
 
 namespace MSIX {
 
-    static Block GetBlock(const ComPtr<IXmlElement>& element, std::uint64_t fallbackSize)
+    static void AddBlock(BlockTable& table, const ComPtr<IXmlElement>& element, std::uint64_t fallbackSize)
     {
-        Block result {0};
+        std::uint64_t blockSize = BLOCKMAP_BLOCK_SIZE;
+        std::uint64_t compressedSize = fallbackSize;
         auto sizeAttr = GetNumber<std::uint64_t>(element, XmlAttributeName::Size, -1);
-        if (sizeAttr == -1)
+        if (sizeAttr != -1)
         {
-            result.blockSize = BLOCKMAP_BLOCK_SIZE;
-            result.compressedSize = fallbackSize;
+            blockSize = sizeAttr;
+            compressedSize = sizeAttr;
         }
-        else
-        {
-            result.blockSize = sizeAttr;
-            result.compressedSize = sizeAttr;
+        Sha256Digest digest;
+        const auto& value = element->GetAttributeValue(XmlAttributeName::BlockMap_File_Block_Hash);
+        if (!Encoding::DecodeBase64(value.data(), value.size(), digest.data(), digest.size()))
+        {   // Let the XML PAL decide what else is acceptable
+            auto hash = element->GetBase64DecodedAttributeValue(XmlAttributeName::BlockMap_File_Block_Hash);
+            ThrowErrorIf(Error::BlockMapSemanticError, (hash.size() != digest.size()), "Block hash is not a SHA256 digest");
+            std::copy(hash.begin(), hash.end(), digest.begin());
         }
-        result.hash = element->GetBase64DecodedAttributeValue(XmlAttributeName::BlockMap_File_Block_Hash);
-        return result;
+        table.Add(digest, compressedSize, blockSize);
+    }
+
+    std::uint64_t AppxBlockMapObject::StartFile(const std::string& name, const std::string& size)
+    {
+        ThrowErrorIf(Error::BlockMapSemanticError, (name == "[Content_Types].xml"), "[Content_Types].xml cannot be in the AppxBlockMap.xml file");
+
+        // The message is only built when the check fails, this runs for every file in the block map
+        ThrowErrorIf(Error::BlockMapSemanticError, (m_blockMap.find(name) != m_blockMap.end()),
+            std::string("Duplicate file: '" + name + "' specified in AppxBlockMap.xml.").c_str());
+
+        return GetNumber<std::uint64_t>(size, BLOCKMAP_BLOCK_SIZE);
+    }
+
+    void AppxBlockMapObject::AddFile(const std::string& name, std::uint64_t size, std::size_t firstBlock, std::size_t blockCount, std::uint32_t lfhSize)
+    {
+        FileBlocks blocks(m_blocks, firstBlock, blockCount);
+        ThrowErrorIf(Error::BlockMapSemanticError, (0 == blocks.size() && 0 != size), "If size is non-zero, then there must be 1+ blocks.");
+
+        auto file = ComPtr<IAppxBlockMapFile>::Make<AppxBlockMapFile>(
+            m_factory,
+            blocks,
+            lfhSize,
+            name,
+            size
+        );
+        m_blockMap.emplace(name, BlockMapEntry{ blocks, std::move(file) });
     }
 
-    AppxBlockMapObject::AppxBlockMapObject(IMsixFactory* factory, const ComPtr<IStream>& stream) : m_factory(factory), m_stream(stream)
+    AppxBlockMapObject::AppxBlockMapObject(IMsixFactory* factory, const ComPtr<IStream>& stream) :
+        m_blocks(std::make_shared<BlockTable>()), m_factory(factory), m_stream(stream)
     {
+        Tracing::Activity activity(Tracing::Event::ParseBlockMap);
+        // The block map of a large package has a hundred thousand blocks, read it without a DOM when it only has
+        // what the schema describes. Otherwise the DOM reads it again and reports what's wrong with it.
+        // The buffer is counted in the memory budget while the block map is parsed.
+        LARGE_INTEGER start = { 0 };
+        ULARGE_INTEGER end = { 0 };
+        ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::END, &end));
+        MemoryBudget::Reservation reservation(factory->GetMemoryBudget(), end.QuadPart);
+        auto buffer = Helper::CreateBufferFromStream(stream);
+        std::vector<BlockMapParserFile> files;
+        if (ParseBlockMap(buffer.data(), buffer.size(), *m_blocks, files))
+        {
+            auto& table = *m_blocks;
+            for (const auto& file : files)
+            {
+                auto size = StartFile(file.name, file.size);
+                for (auto block = file.firstBlock; block < file.firstBlock + file.blockCount; block++)
+                {
+                    if (table.blockSizes[block] == BlockMapParserNoSize)
+                    {
+                        table.blockSizes[block] = BLOCKMAP_BLOCK_SIZE;
+                        table.compressedSizes[block] = size;
+                    }
+                }
+                AddFile(file.name, size, file.firstBlock, file.blockCount, GetNumber<std::uint32_t>(file.lfhSize, 0));
+            }
+            ThrowErrorIf(Error::XmlError, files.empty(), "Empty AppxBlockMap.xml");
+            return;
+        }
+        *m_blocks = BlockTable();
+
         ComPtr<IXmlFactory> xmlFactory;
         ThrowHrIfFailed(factory->QueryInterface(UuidOfImpl<IXmlFactory>::iid, reinterpret_cast<void**>(&xmlFactory)));
         auto dom = xmlFactory->CreateDomFromStream(XmlContentType::AppxBlockMapXml, stream);
@@ -66,42 +131,28 @@ namespace MSIX {
 
         XmlVisitor visitor(static_cast<void*>(&context), [](void* c, const ComPtr<IXmlElement>& fileNode)->bool
         {
-            const auto& name = fileNode->GetAttributeValue(XmlAttributeName::Name);
-            ThrowErrorIf(Error::BlockMapSemanticError, (name == "[Content_Types].xml"), "[Content_Types].xml cannot be in the AppxBlockMap.xml file");
-
             _context* context = reinterpret_cast<_context*>(c);
-            std::ostringstream builder;
-            builder << "Duplicate file: '" << name << "' specified in AppxBlockMap.xml.";
-            ThrowErrorIf(Error::BlockMapSemanticError, (context->self->m_blockMap.find(name) != context->self->m_blockMap.end()), builder.str().c_str());
-
-            std::uint64_t sizeAttribute = GetNumber<std::uint64_t>(fileNode, XmlAttributeName::Size, BLOCKMAP_BLOCK_SIZE);
+            const auto& name = fileNode->GetAttributeValue(XmlAttributeName::Name);
+            std::uint64_t sizeAttribute = context->self->StartFile(name, fileNode->GetAttributeValue(XmlAttributeName::Size));
 
-            std::vector<Block> blocks;
+            auto& table = *context->self->m_blocks;
+            std::size_t first = table.hashes.size();
             struct _contextBlock
             {
-                std::vector<Block>* blocks;
+                BlockTable* table;
                 std::uint64_t fallbackSize;
             };
-            _contextBlock contextBlock = { &blocks, sizeAttribute};
+            _contextBlock contextBlock = { &table, sizeAttribute};
             XmlVisitor visitor(static_cast<void*>(&contextBlock), [](void* c, const ComPtr<IXmlElement>& blockNode)->bool
             {
                 _contextBlock* contextBlock = reinterpret_cast<_contextBlock*>(c);
-                contextBlock->blocks->push_back(GetBlock(blockNode, contextBlock->fallbackSize));
+                AddBlock(*contextBlock->table, blockNode, contextBlock->fallbackSize);
                 return true;
             });
             context->dom->ForEachElementIn(fileNode, XmlQueryName::Child_Block, visitor);
 
-            ThrowErrorIf(Error::BlockMapSemanticError, (0 == blocks.size() && 0 != sizeAttribute), "If size is non-zero, then there must be 1+ blocks.");
-
-            context->self->m_blockMap.insert(std::make_pair(name, std::move(blocks)));
-            context->self->m_blockMapFiles.insert(std::make_pair(name,
-                ComPtr<IAppxBlockMapFile>::Make<AppxBlockMapFile>(
-                    context->factory,
-                    &(context->self->m_blockMap[name]),
-                    GetNumber<std::uint32_t>(fileNode, XmlAttributeName::BlockMap_File_LocalFileHeaderSize, 0),
-                    name,
-                    sizeAttribute
-                )));
+            context->self->AddFile(name, sizeAttribute, first, table.hashes.size() - first,
+                GetNumber<std::uint32_t>(fileNode->GetAttributeValue(XmlAttributeName::BlockMap_File_LocalFileHeaderSize), 0));
             context->countFilesFound++;
             return true;
         });
@@ -109,15 +160,27 @@ namespace MSIX {
         ThrowErrorIf(Error::XmlError, (0 == context.countFilesFound), "Empty AppxBlockMap.xml");
     }
 
+    AppxBlockMapObject::AppxBlockMapObject(IMsixFactory* factory, const ComPtr<IStream>& stream, const PackageIndex& index) :
+        m_blocks(index.blocks), m_factory(factory), m_stream(stream)
+    {
+        std::size_t first = 0;
+        for (const auto& file : index.files)
+        {
+            ThrowErrorIf(Error::BlockMapSemanticError, (m_blockMap.find(file.name) != m_blockMap.end()), "Duplicate file in the package index");
+            AddFile(file.name, file.size, first, file.blockCount, file.localFileHeaderSize);
+            first += file.blockCount;
+        }
+        ThrowErrorIf(Error::XmlError, index.files.empty(), "Empty AppxBlockMap.xml");
+    }
+
     // IVerifierObject
     ComPtr<IStream> AppxBlockMapObject::GetValidationStream(const std::string& part, const ComPtr<IStream>& stream)
     {
         ThrowErrorIf(Error::InvalidParameter, (part.empty() || !stream), "bad input");
         auto item = m_blockMap.find(part);
-        std::ostringstream builder;
-        builder << "file: '" << part << "' not tracked by blockmap.";
-        ThrowErrorIf(Error::BlockMapSemanticError, item == m_blockMap.end(), builder.str().c_str());
-        return ComPtr<IStream>::Make<BlockMapStream>(m_factory, part, stream, item->second);
+        ThrowErrorIf(Error::BlockMapSemanticError, item == m_blockMap.end(),
+            std::string("file: '" + part + "' not tracked by blockmap.").c_str());
+        return ComPtr<IStream>::Make<BlockMapStream>(m_factory, part, stream, item->second.blocks, m_integrityRecord);
     }
 
     // IAppxBlockMapReader
@@ -129,14 +192,19 @@ namespace MSIX {
     HRESULT STDMETHODCALLTYPE AppxBlockMapObject::GetFiles(IAppxBlockMapFilesEnumerator **enumerator) noexcept try
     {
         ThrowErrorIf(Error::InvalidParameter, (enumerator == nullptr || *enumerator != nullptr), "bad pointer");
-        std::vector<ComPtr<IAppxBlockMapFile>> blockMapFiles;
-        for(const auto& file : m_blockMapFiles)
+        std::lock_guard<std::mutex> lock(m_filesLock);
+        if (!m_files)
         {
-            auto blockFile = file.second;
-            blockMapFiles.push_back(std::move(blockFile));
+            std::vector<ComPtr<IAppxBlockMapFile>> blockMapFiles;
+            blockMapFiles.reserve(m_blockMap.size());
+            for(const auto& file : m_blockMap)
+            {
+                blockMapFiles.push_back(file.second.file);
+            }
+            m_files = std::make_shared<const std::vector<ComPtr<IAppxBlockMapFile>>>(std::move(blockMapFiles));
         }
         *enumerator = ComPtr<IAppxBlockMapFilesEnumerator>::
-                Make<EnumeratorCom<IAppxBlockMapFilesEnumerator, IAppxBlockMapFile>>(blockMapFiles).Detach();
+                Make<EnumeratorCom<IAppxBlockMapFilesEnumerator, IAppxBlockMapFile>>(m_files).Detach();
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
 
@@ -159,27 +227,28 @@ namespace MSIX {
     std::vector<std::string> AppxBlockMapObject::GetFileNames()
     {
         std::vector<std::string> fileNames;
+        fileNames.reserve(m_blockMap.size());
         std::transform(
-            m_blockMapFiles.begin(),
-            m_blockMapFiles.end(),
+            m_blockMap.begin(),
+            m_blockMap.end(),
             std::back_inserter(fileNames),
-            [](auto keyValuePair){ return keyValuePair.first; }
+            [](const auto& keyValuePair){ return keyValuePair.first; }
         );
         return fileNames;
     }
 
-    std::vector<Block> AppxBlockMapObject::GetBlocks(const std::string& fileName)
+    FileBlocks AppxBlockMapObject::GetBlocks(const std::string& fileName)
     {
         auto index = m_blockMap.find(fileName);
         ThrowErrorIf(Error::FileNotFound, (index == m_blockMap.end()), "File not in blockmap");
-        return index->second;
+        return index->second.blocks;
     }
 
     ComPtr<IAppxBlockMapFile> AppxBlockMapObject::GetFile(const std::string& fileName)
     {
-        auto index = m_blockMapFiles.find(fileName);
-        ThrowErrorIf(Error::FileNotFound, (index == m_blockMapFiles.end()), "File not in blockmap");
-        return index->second;
+        auto index = m_blockMap.find(fileName);
+        ThrowErrorIf(Error::FileNotFound, (index == m_blockMap.end()), "File not in blockmap");
+        return index->second.file;
     }
 
     // IAppxBlockMapReaderUtf8
@@ -188,9 +257,9 @@ namespace MSIX {
         ThrowErrorIf(Error::InvalidParameter, (
             filename == nullptr || *filename == '\0' || file == nullptr || *file != nullptr
         ), "bad pointer");
-        auto blockMapFile = m_blockMapFiles.find(filename);
-        ThrowErrorIf(Error::InvalidParameter, (blockMapFile == m_blockMapFiles.end()), "File not found!");
-        MSIX::ComPtr<IAppxBlockMapFile> result = blockMapFile->second;
+        auto blockMapFile = m_blockMap.find(filename);
+        if (blockMapFile == m_blockMap.end()) { return static_cast<HRESULT>(Error::InvalidParameter); }
+        MSIX::ComPtr<IAppxBlockMapFile> result = blockMapFile->second.file;
         *file = result.Detach();
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
@@ -10,15 +10,28 @@
 #include "Encoding.hpp"
 #include "IXml.hpp"
 
-#include <regex>
+#include <algorithm>
+#include <iterator>
 
 namespace MSIX {
 
-    AppxBundleManifestObject::AppxBundleManifestObject(IMsixFactory* factory, const ComPtr<IStream>& stream) : m_factory(factory), m_stream(stream)
+    namespace {
+        ComPtr<IXmlDom> ParseBundleManifest(IMsixFactory* factory, const ComPtr<IStream>& stream, bool validateSchema)
+        {
+            ComPtr<IXmlFactory> xmlFactory;
+            ThrowHrIfFailed(factory->QueryInterface(UuidOfImpl<IXmlFactory>::iid, reinterpret_cast<void**>(&xmlFactory)));
+            return xmlFactory->CreateDomFromStream(XmlContentType::AppxBundleManifestXml, stream, validateSchema);
+        }
+    }
+
+    AppxBundleManifestObject::AppxBundleManifestObject(IMsixFactory* factory, const ComPtr<IStream>& stream, bool validateSchema) :
+        AppxBundleManifestObject(factory, stream, ParseBundleManifest(factory, stream, validateSchema))
+    {
+    }
+
+    AppxBundleManifestObject::AppxBundleManifestObject(IMsixFactory* factory, const ComPtr<IStream>& stream, const ComPtr<IXmlDom>& dom) :
+        m_factory(factory), m_stream(stream)
     {
-        ComPtr<IXmlFactory> xmlFactory;
-        ThrowHrIfFailed(m_factory->QueryInterface(UuidOfImpl<IXmlFactory>::iid, reinterpret_cast<void**>(&xmlFactory)));
-        auto dom = xmlFactory->CreateDomFromStream(XmlContentType::AppxBundleManifestXml, stream);
         XmlVisitor visitorIdentity(static_cast<void*>(this), [](void* s, const ComPtr<IXmlElement>& identityNode)->bool
         {
             AppxBundleManifestObject* self = reinterpret_cast<AppxBundleManifestObject*>(s);
@@ -149,8 +162,12 @@ namespace MSIX {
         APPX_BUNDLE_PAYLOAD_PACKAGE_TYPE packageType):
         m_factory(factory), m_fileName(name), m_size(size), m_offset(offset), m_languages(std::move(languages)), m_scales(scales), m_packageType(packageType)
     {
-        std::regex e (".+\\.((appx)|(msix))");
-        ThrowErrorIf(Error::AppxManifestSemanticError, !std::regex_match(m_fileName, e), "Invalid FileName attribute in AppxBundleManifest.xml");
+        // At least one character before .appx or .msix, none of them a line break
+        const char* extensions[] = { ".appx", ".msix" };
+        bool hasExtension = (m_fileName.size() > 5) && (m_fileName.find_first_of("\r\n") == std::string::npos) &&
+            std::any_of(std::begin(extensions), std::end(extensions), [this](const char* extension)
+            { return m_fileName.compare(m_fileName.size() - 5, 5, extension) == 0; });
+        ThrowErrorIf(Error::AppxManifestSemanticError, !hasExtension, "Invalid FileName attribute in AppxBundleManifest.xml");
         m_packageId = ComPtr<IAppxManifestPackageId>::Make<AppxManifestPackageId>(factory, bundleName, version, resourceId, architecture, publisher);
     }
 
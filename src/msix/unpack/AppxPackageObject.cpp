@@ -19,24 +19,106 @@
 #include "MsixFeatureSelector.hpp"
 #include "ScopeExit.hpp"
 #include "StringHelper.hpp"
+#include "IoScheduler.hpp"
+#include "WorkerPool.hpp"
+#include "ProgressReporter.hpp"
+#include "PerformanceCounters.hpp"
+#include "FileStatistics.hpp"
+#include "Tracing.hpp"
+#include "BlockStore.hpp"
+#include "NativeFileStream.hpp"
+#include "OutputStreamDirectory.hpp"
+#include "VectorStream.hpp"
+#include "StreamHelper.hpp"
+#include "Crypto.hpp"
+#include "BlockMapStream.hpp"
+#include "PayloadFileReader.hpp"
 
 #ifdef BUNDLE_SUPPORT
 #include "Applicability.hpp"
 #include "AppxBundleManifest.hpp"
+#include "InflateStream.hpp"
+#include "ZipObjectReader.hpp"
+#include "BufferPool.hpp"
+#include "QualityOfService.hpp"
 #endif
 
 #include <string>
 #include <vector>
 #include <map>
 #include <memory>
+#include <unordered_map>
+#include <unordered_set>
 #include <limits>
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <sstream>
 
 namespace MSIX {
 
+    namespace {
+        // Reads a validation stream to its end, which is when it checks what it read.
+        void ValidateToEnd(const ComPtr<IStream>& stream, const std::shared_ptr<BufferPool>& bufferPool)
+        {
+            auto buffer = PooledBuffer::Allocate(bufferPool, 1024 * 1024);
+            ULONG bytesRead = 0;
+            do
+            {
+                ThrowHrIfFailed(stream->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &bytesRead));
+            } while (bytesRead != 0);
+        }
+
+        // Checks the bytes of a file read from the container against its blocks in the block map, as reading them
+        // through the validation stream of the block map does.
+        void ValidateBlocks(const std::vector<std::uint8_t>& bytes, const FileBlocks& blocks)
+        {
+            ThrowErrorIfNot(Error::SignatureInvalid, (blocks.size() == (bytes.size() + BLOCKMAP_BLOCK_SIZE - 1) / BLOCKMAP_BLOCK_SIZE),
+                "File size doesn't match the block map");
+            Sha256Digest hash;
+            for (std::size_t index = 0; index < blocks.size(); index++)
+            {
+                std::uint64_t offset = index * BLOCKMAP_BLOCK_SIZE;
+                auto size = static_cast<std::uint32_t>(std::min(static_cast<std::uint64_t>(bytes.size()) - offset, BLOCKMAP_BLOCK_SIZE));
+                SHA256::ComputeHash(bytes.data() + offset, size, hash);
+                ThrowErrorIfNot(Error::SignatureInvalid, (hash == blocks.Hash(index)), "Block hash doesn't match the block map");
+            }
+        }
+
+        // The hash of the bytes of a footprint file, as a package index keeps it. The stream is left at its start.
+        Sha256Digest HashFootprintFile(const ComPtr<IStream>& stream)
+        {
+            auto bytes = Helper::CreateBufferFromStream(stream);
+            Sha256Digest hash;
+            SHA256::ComputeHash(bytes.data(), static_cast<std::uint32_t>(bytes.size()), hash);
+            return hash;
+        }
+
+        // The hashes the block map has for the bytes, in hexadecimal, so hosts can use it as a file name
+        std::string ManifestCacheKey(const std::vector<std::uint8_t>& bytes)
+        {
+            const char* hexDigits = "0123456789abcdef";
+            std::string key;
+            Sha256Digest hash;
+            for (std::uint64_t offset = 0; offset < bytes.size(); offset += BLOCKMAP_BLOCK_SIZE)
+            {
+                auto size = static_cast<std::uint32_t>(std::min(static_cast<std::uint64_t>(bytes.size()) - offset, BLOCKMAP_BLOCK_SIZE));
+                SHA256::ComputeHash(bytes.data() + offset, size, hash);
+                for (auto byte : hash)
+                {
+                    key.push_back(hexDigits[byte >> 4]);
+                    key.push_back(hexDigits[byte & 0xf]);
+                }
+            }
+            return key;
+        }
+    }
+
     AppxPackageObject::AppxPackageObject(IMsixFactory* factory, MSIX_VALIDATION_OPTION validation,
-        MSIX_APPLICABILITY_OPTIONS applicabilityFlags, const ComPtr<IStorageObject>& container) :
+        MSIX_APPLICABILITY_OPTIONS applicabilityFlags, const ComPtr<IStorageObject>& container, bool deferPayloadFiles, bool deferBundlePackages,
+        bool releaseManifestDom, const PackageIndex* index) :
         m_factory(factory),
         m_validation(validation),
         m_container(container)
@@ -50,22 +132,47 @@ namespace MSIX {
         if ((validation & MSIX_VALIDATION_OPTION_SKIPSIGNATURE) == 0)
         {   ThrowErrorIfNot(Error::MissingAppxSignatureP7X, file, "AppxSignature.p7x not in archive!");
         }
-        m_appxSignature = ComPtr<IVerifierObject>::Make<AppxSignatureObject>(factory, validation, file);
+        auto signature = ComPtr<AppxSignatureObject>::Make<AppxSignatureObject>(factory, validation, file);
+        m_appxSignature = signature.As<IVerifierObject>();
 
-        // 2. Get content type using signature object for validation
-        file = m_container->GetFile(CONTENT_TYPES_XML);
-        ThrowErrorIfNot(Error::MissingContentTypesXML, file, "[Content_Types].xml not in archive!");
-        ComPtr<IStream> stream = m_appxSignature->GetValidationStream(CONTENT_TYPES_XML, file);
-        auto contentType = xmlFactory->CreateDomFromStream(XmlContentType::ContentTypeXml, stream);
+        // 1b. Check the zip structure against the signature. The central directory is already in memory. The
+        // file records are everything stored before the signature, reading them costs a pass over the package.
+        // They are hashed on another thread while the footprint files are parsed under full validation when
+        // nothing is deferred, otherwise Verify checks them.
+        std::shared_ptr<PoolTask> fileRecordsValidation;
+        auto zipReader = m_container.TryAs<IZipReader>();
+        if (signature->HasDigests() && zipReader)
+        {
+            auto centralDirectory = zipReader->GetCentralDirectoryWithoutFile(APPXSIGNATURE_P7X);
+            auto centralDirectoryStream = ComPtr<IStream>::Make<VectorStream>(&centralDirectory);
+            auto bufferPool = m_factory->GetBufferPool();
+            ValidateToEnd(m_appxSignature->GetValidationStream(SIGNATURE_CENTRAL_DIRECTORY_PART, centralDirectoryStream), bufferPool);
 
-        // 3. Get blockmap object using signature object for validation
-        file = m_container->GetFile(APPXBLOCKMAP_XML);
-        ThrowErrorIfNot(Error::MissingAppxBlockMapXML, file, "AppxBlockMap.xml not in archive!");
-        stream = m_appxSignature->GetValidationStream(APPXBLOCKMAP_XML, file);
-        m_appxBlockMap = ComPtr<IVerifierObject>::Make<AppxBlockMapObject>(factory, stream);
+            if (!deferPayloadFiles && ((validation & ~MSIX_VALIDATION_OPTION_TRUSTPACKAGEINDEX) == MSIX_VALIDATION_OPTION_FULL))
+            {
+                auto records = zipReader->GetFileRecordsBeforeFile(APPXSIGNATURE_P7X);
+                bool positional = records.As<IStreamInternal>()->SupportsReadAt();
+                auto recordsStream = m_appxSignature->GetValidationStream(SIGNATURE_FILE_RECORDS_PART, records);
+                if (positional)
+                {
+                    fileRecordsValidation = m_factory->GetWorkerPool()->Async([recordsStream, bufferPool]() { ValidateToEnd(recordsStream, bufferPool); });
+                }
+                else
+                {   // Reads would move the position of the container under the other readers
+                    ValidateToEnd(recordsStream, bufferPool);
+                }
+            }
+            else
+            {
+                m_fileRecordsPending = true;
+            }
+        }
 
-        // 4. Get manifest object using blockmap object for validation
-        // TODO: pass validation flags and other necessary goodness through.
+        // 2. Find the footprint files. They are parsed concurrently on the worker pool of the factory below.
+        auto contentTypesInContainer = m_container->GetFile(CONTENT_TYPES_XML);
+        ThrowErrorIfNot(Error::MissingContentTypesXML, contentTypesInContainer, "[Content_Types].xml not in archive!");
+        auto blockMapInContainer = m_container->GetFile(APPXBLOCKMAP_XML);
+        ThrowErrorIfNot(Error::MissingAppxBlockMapXML, blockMapInContainer, "AppxBlockMap.xml not in archive!");
         auto appxManifestInContainer = m_container->GetFile(APPXMANIFEST_XML);
         auto appxBundleManifestInContainer = m_container->GetFile(APPXBUNDLEMANIFEST_XML);
 
@@ -73,21 +180,143 @@ namespace MSIX {
             "AppxManifest.xml or AppxBundleManifest.xml not in archive!");
         ThrowErrorIf(Error::MissingAppxManifestXML, (appxManifestInContainer && appxBundleManifestInContainer) ,
             "AppxManifest.xml and AppxBundleManifest.xml in archive!");
-        // We already validate that there's at least one and not both
-        if(appxManifestInContainer)
+        // It is valid for a user to create an IAppxPackageReader and then QI for IAppxBundleReader, but
+        // not when bundle support is off.
+        if (!appxManifestInContainer) { THROW_IF_BUNDLE_NOT_ENABLED }
+        auto manifestInContainer = appxManifestInContainer ? appxManifestInContainer : appxBundleManifestInContainer;
+        std::string manifestName = appxManifestInContainer ? std::string(APPXMANIFEST_XML) : Helper::toBackSlash(APPXBUNDLEMANIFEST_XML);
+        auto manifestType = appxManifestInContainer ? XmlContentType::AppxManifestXml : XmlContentType::AppxBundleManifestXml;
+
+        // The schema validation can be skipped for a manifest covered by a signature that validated and chains to
+        // a trusted root, if the caller asked for it.
+        bool trustedSignature = ((validation & MSIX_VALIDATION_OPTION_SKIPSIGNATURE) == 0) &&
+            (signature->GetSignatureOrigin() != SignatureOrigin::Unknown) && (signature->GetSignatureOrigin() != SignatureOrigin::Unsigned);
+        bool validateSchema = !trustedSignature || ((validation & MSIX_VALIDATION_OPTION_SKIPMANIFESTSCHEMAIFTRUSTED) == 0);
+        m_manifestSchemaValidated = validateSchema;
+
+        // Whatever fails first, the parses are done before the streams they read are released
+        std::shared_ptr<PoolTask> contentTypesParse;
+        std::shared_ptr<PoolTask> manifestParse;
+        auto waitForParses = MSIX::scope_exit([&contentTypesParse, &manifestParse]
+        {
+            for (const auto& task : { contentTypesParse, manifestParse })
+            {
+                try { if (task) { task->Wait(); } } catch (...) {}
+            }
+        });
+        auto workerPool = m_factory->GetWorkerPool();
+
+        // Nothing of the index is checked against the block map, it is only used when the caller trusts it
+        if ((validation & MSIX_VALIDATION_OPTION_TRUSTPACKAGEINDEX) == 0) { index = nullptr; }
+
+        // 3. Parse the content types. Its validation stream only needs the digests of the signature.
+        // Nothing is kept from it, so it isn't parsed again when it has the bytes a package index was made from.
+        auto contentTypesStream = m_appxSignature->GetValidationStream(CONTENT_TYPES_XML, contentTypesInContainer);
+        contentTypesParse = workerPool->Async([xmlFactory, contentTypesStream, index]()
+        {
+            if (index && (HashFootprintFile(contentTypesStream) == index->contentTypesHash)) { return; }
+            xmlFactory->CreateDomFromStream(XmlContentType::ContentTypeXml, contentTypesStream);
+        });
+
+        // 4. Parse the manifest, and validate it against the schema, while the block map is parsed here. Its bytes
+        // are read first and checked against the block map once it is parsed, before the manifest is used.
+        struct ManifestParse
+        {
+            std::vector<std::uint8_t> bytes;
+            ComPtr<IXmlDom> dom;
+        };
+        auto manifest = std::make_shared<ManifestParse>();
+        manifest->bytes = Helper::CreateBufferFromStream(manifestInContainer);
+
+        // 4b. An index made from this package, with the same block map and manifest, replaces the parses of the
+        // block map and of the manifest. It is ignored otherwise, as when the package changed after it was made.
+        auto blockMapStream = m_appxSignature->GetValidationStream(APPXBLOCKMAP_XML, blockMapInContainer);
+        const PackageIndex* packageIndex = nullptr;
+        std::unique_ptr<ManifestSnapshot> manifestSnapshot;
+        if (index && zipReader && appxManifestInContainer)
+        {
+            auto range = zipReader->GetCentralDirectoryRange();
+            Sha256Digest manifestHash;
+            SHA256::ComputeHash(manifest->bytes.data(), static_cast<std::uint32_t>(manifest->bytes.size()), manifestHash);
+            manifestSnapshot = std::make_unique<ManifestSnapshot>();
+            if ((index->packageSize == range.offset + range.size) && (index->centralDirectoryHash == zipReader->GetCentralDirectoryHash()) &&
+                (index->manifestHash == manifestHash) && manifestSnapshot->Load(index->manifestSnapshot) &&
+                (!validateSchema || manifestSnapshot->schemaValidated) && (HashFootprintFile(blockMapStream) == index->blockMapHash))
+            {
+                packageIndex = index;
+            }
+            else
+            {
+                manifestSnapshot.reset();
+            }
+        }
+
+        // An AppxManifest.xml in the manifest cache of the factory isn't parsed. Its bytes are checked against the
+        // block map all the same, so the snapshot found by their hashes is the one of this manifest.
+        auto manifestCache = (appxManifestInContainer && !packageIndex) ? m_factory->GetManifestCache() : ComPtr<IMsixManifestCache>();
+        std::string manifestKey;
+        if (manifestCache)
+        {
+            manifestKey = ManifestCacheKey(manifest->bytes);
+            ComPtr<IStream> entry;
+            ThrowHrIfFailed(manifestCache->GetEntry(manifestKey.c_str(), &entry));
+            if (entry)
+            {
+                manifestSnapshot = std::make_unique<ManifestSnapshot>();
+                if (!manifestSnapshot->Load(Helper::CreateBufferFromStream(entry)) || (validateSchema && !manifestSnapshot->schemaValidated))
+                {   // Read again, and replaced
+                    manifestSnapshot.reset();
+                }
+            }
+        }
+        if (!manifestSnapshot)
+        {
+            manifestParse = workerPool->Async([xmlFactory, manifest, manifestType, validateSchema]()
+            {
+                auto stream = ComPtr<IStream>::Make<VectorStream>(&manifest->bytes);
+                manifest->dom = xmlFactory->CreateDomFromStream(manifestType, stream, validateSchema);
+            });
+        }
+
+        if (packageIndex)
+        {
+            m_appxBlockMap = ComPtr<IVerifierObject>::Make<AppxBlockMapObject>(factory, blockMapStream, *packageIndex);
+        }
+        else
         {
-            stream = m_appxBlockMap->GetValidationStream(APPXMANIFEST_XML, appxManifestInContainer);
-            m_appxManifest = ComPtr<IVerifierObject>::Make<AppxManifestObject>(factory, stream);
+            m_appxBlockMap = ComPtr<IVerifierObject>::Make<AppxBlockMapObject>(factory, blockMapStream);
+        }
+
+        // The manifest is read again through the block map if it is asked for
+        auto manifestStream = m_appxBlockMap->GetValidationStream(manifestName, manifestInContainer);
+        ValidateBlocks(manifest->bytes, m_appxBlockMap.As<IAppxBlockMapInternal>()->GetBlocks(manifestName));
+        contentTypesParse->Wait();
+        if (manifestParse) { manifestParse->Wait(); }
+        waitForParses.release();
+
+        if(appxManifestInContainer && manifestSnapshot)
+        {
+            m_appxManifest = ComPtr<IVerifierObject>::Make<AppxManifestObject>(factory, manifestStream, std::move(*manifestSnapshot));
+        }
+        else if(appxManifestInContainer)
+        {
+            auto appxManifest = ComPtr<AppxManifestObject>::Make<AppxManifestObject>(factory, manifestStream, manifest->dom);
+            if (manifestCache)
+            {
+                auto entry = appxManifest->GetSnapshot(validateSchema).Save();
+                auto entryStream = ComPtr<IStream>::Make<VectorStream>(&entry);
+                ThrowHrIfFailed(manifestCache->AddEntry(manifestKey.c_str(), entryStream.Get()));
+            }
+            if (releaseManifestDom)
+            {
+                appxManifest->ReleaseDom(validateSchema);
+            }
+            m_appxManifest = appxManifest.As<IVerifierObject>();
         }
         else
         {
-            // It is valid for a user to create an IAppxPackageReader and then QI for IAppxBundleReader, but
-            // not when bundle support is off.
-            THROW_IF_BUNDLE_NOT_ENABLED
             #ifdef BUNDLE_SUPPORT
-            std::string pathInWindows = Helper::toBackSlash(APPXBUNDLEMANIFEST_XML);
-            stream = m_appxBlockMap->GetValidationStream(pathInWindows, appxBundleManifestInContainer);
-            m_appxBundleManifest = ComPtr<IVerifierObject>::Make<AppxBundleManifestObject>(factory, stream);
+            m_appxBundleManifest = ComPtr<IVerifierObject>::Make<AppxBundleManifestObject>(factory, manifestStream, manifest->dom);
             m_isBundle = true;
             #endif
         }
@@ -117,6 +346,18 @@ namespace MSIX {
             }
         }
 
+        if (fileRecordsValidation) { fileRecordsValidation->Wait(); }
+
+        // The payload files whose blocks all matched when they were read from the same unchanged file before
+        // aren't validated again. Not before the block map is validated, its hash is part of the key.
+        auto integrityCache = m_isBundle ? ComPtr<IMsixIntegrityCache>() : m_factory->GetIntegrityCache();
+        if (integrityCache && zipReader)
+        {
+            m_integrityRecord = IntegrityRecord::Open(integrityCache, [zipReader]() { return zipReader->GetFileIdentity(); },
+                HashFootprintFile(m_container->GetFile(APPXBLOCKMAP_XML)));
+            m_appxBlockMap.As<IAppxBlockMapInternal>()->SetIntegrityRecord(m_integrityRecord);
+        }
+
         struct Config
         {
             typedef ComPtr<IStream> (*lambda)(AppxPackageObject* self);
@@ -167,7 +408,10 @@ namespace MSIX {
         // 5. Ensure that the stream collection contains streams wired up for their appropriate validation
         // and partition the container's file names into footprint and payload files.  First by going through
         // the footprint files, and then by going through the payload files.
-        auto filesToProcess = m_container->GetFileNames(FileNameOptions::All);
+        auto containerFiles = m_container->GetFileNames(FileNameOptions::All);
+        std::unordered_set<std::string> filesToProcess(containerFiles.begin(), containerFiles.end());
+        // Buckets that are outgrown aren't given back to the arena until the package is released
+        m_files.reserve(containerFiles.size());
         for (const auto& fileName : m_container->GetFileNames(FileNameOptions::FootPrintOnly))
         {   auto footPrintFile = std::find(std::begin(footPrintFileNames), std::end(footPrintFileNames), fileName);
             if (footPrintFile != std::end(footPrintFileNames))
@@ -188,7 +432,7 @@ namespace MSIX {
                         m_files[fileName] = MSIX::ComPtr<IAppxFile>::Make<MSIX::AppxFile>(m_factory.Get(), fileName, std::move(stream));;
                     }
                 }
-                filesToProcess.erase(std::remove(filesToProcess.begin(), filesToProcess.end(), fileName), filesToProcess.end());
+                filesToProcess.erase(fileName);
             }
         }
 
@@ -202,8 +446,8 @@ namespace MSIX {
             // AppxMetadata/AppxBundleManifest.xml before, so just check the size.
             ThrowErrorIfNot(Error::BlockMapSemanticError, ((blockMapFiles.size() == 1)), "Block map contains invalid files.");
 
+            Tracing::Activity activity(Tracing::Event::SelectBundlePackages);
             auto bundleInfo = m_appxBundleManifest.As<IBundleInfo>();
-            auto appxFactory = m_factory.As<IAppxFactory>();
 
             Applicability applicability(applicabilityFlags);
 
@@ -217,109 +461,83 @@ namespace MSIX {
                 applicability.InitializeLanguages(applicabilityLanguagesEnumerator.Get());
             }
             else
-            {
-                applicability.InitializeLanguages();
+            {   // The system languages don't change while the factory is used, so they are only read once.
+                applicability.InitializeLanguages(m_factory->GetApplicabilityCache().GetSystemLanguages());
             }
 
             if (!(validation & MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPPACKAGEVALIDATION))
             {
-                for (const auto& package : bundleInfo->GetPackages())
+                auto& packages = bundleInfo->GetPackages();
+                // Applicability only looks at the bundle manifest, so the package can be validated after
+                // it is selected. Packages that are not applicable are validated when they are requested.
+                std::vector<ComPtr<IAppxPackageReader>> readers;
+                if (!deferBundlePackages)
                 {
-                    auto bundleInfoInternal = package.As<IAppxBundleManifestPackageInfoInternal>();
-                    auto packageName = bundleInfoInternal->GetFileName();
-                    auto packageStream = m_container->GetFile(Encoding::EncodeFileName(packageName));
-
-                    if (packageStream)
-                    {   // The package is in the bundle. Verify is not compressed.
-                        auto zipStream = packageStream.As<IStreamInternal>();
-                        ThrowErrorIf(Error::AppxManifestSemanticError, zipStream->IsCompressed(), "Packages cannot be compressed");
-                    }
-                    else if (!packageStream && (bundleInfoInternal->GetOffset() == 0)) // This is a flat bundle.
+                    readers = ValidateBundlePackages(packages);
+                }
+                else
+                {
+                    for (const auto& package : packages)
                     {
-                        // We should only do this for flat bundles. If we do it for normal bundles and the user specify a 
-                        // stream factory we will basically unpack any package the user wants with the same name as the package
-                        // we are looking, which sounds dangerous.
-                        ComPtr<IUnknown> streamFactoryUnk;
-                        ThrowHrIfFailed(factoryOverrides->GetCurrentSpecifiedExtension(MSIX_FACTORY_EXTENSION_STREAM_FACTORY, &streamFactoryUnk));
+                        m_deferredBundlePackages[package.As<IAppxBundleManifestPackageInfoInternal>()->GetFileName()] = package;
+                    }
+                }
 
-                        if(streamFactoryUnk.Get() != nullptr)
+                // The hashes of the bundle manifest blocks identify its content, the block map was already
+                // validated and the bytes the manifest was parsed from were checked against it.
+                std::string bundleManifestHash;
+                for (const auto& block : blockMapInternal->GetBlocks(Helper::toBackSlash(APPXBUNDLEMANIFEST_XML)))
+                {
+                    bundleManifestHash.append(block.hash.begin(), block.hash.end());
+                }
+                auto& applicabilityCache = m_factory->GetApplicabilityCache();
+                auto selectionKey = applicability.GetSelectionKey(bundleManifestHash);
+                if (applicabilityCache.GetApplicablePackages(selectionKey, m_applicablePackagesNames))
+                {
+                    if (!deferBundlePackages)
+                    {
+                        std::map<std::string, std::size_t> packageIndexes;
+                        for (std::size_t i = 0; i < packages.size(); i++)
                         {
-                            auto streamFactory = streamFactoryUnk.As<IMsixStreamFactory>();
-                            ThrowHrIfFailed(streamFactory->CreateStreamOnRelativePathUtf8(packageName.c_str(), &packageStream));
+                            packageIndexes[packages[i].As<IAppxBundleManifestPackageInfoInternal>()->GetFileName()] = i;
                         }
-                        else
-                        {   // User didn't specify a stream factory implementation. Assume packages are in the same location
-                            // as the bundle.
-                            auto containerName = GetFileName();
-                            #ifdef WIN32
-                            auto lastSeparator = containerName.find_last_of('\\');
-                            #else
-                            auto lastSeparator = containerName.find_last_of('/');
-                            #endif
-                            auto expandedPackageName = containerName.substr(0, lastSeparator + 1) + packageName;
-                            ThrowHrIfFailed(CreateStreamOnFile(const_cast<char*>(expandedPackageName.c_str()), true, &packageStream));
+                        for (const auto& name : m_applicablePackagesNames)
+                        {
+                            m_applicablePackages.push_back(readers[packageIndexes[name]]);
                         }
-                        ThrowErrorIfNot(Error::FileNotFound, packageStream, "Package from a flat bundle is not present");
                     }
-                    else
+                }
+                else
+                {
+                    for (std::size_t i = 0; i < packages.size(); i++)
                     {
-                        ThrowErrorIfNot(Error::FileNotFound, packageStream, "Package is not in container");
+                        APPX_BUNDLE_PAYLOAD_PACKAGE_TYPE packageType;
+                        ThrowHrIfFailed(packages[i]->GetPackageType(&packageType));
+                        ComPtr<IAppxPackageReader> reader;
+                        if (!deferBundlePackages)
+                        {   // Validation is done, now see if the package is applicable.
+                            reader = readers[i];
+                        }
+                        applicability.AddPackageIfApplicable(reader, packageType, packages[i]);
+                        // Intentionally don't remove from fileToProcess. For bundles, it is possible to don't unpack packages, like
+                        // resource packages that are not languages packages.
                     }
+                    applicability.GetApplicablePackages(&m_applicablePackages, &m_applicablePackagesNames);
+                    applicabilityCache.AddApplicablePackages(selectionKey, m_applicablePackagesNames);
+                }
 
-                    // Semantic checks
-                    LARGE_INTEGER start = { 0 };
-                    ULARGE_INTEGER end = { 0 };
-                    ThrowHrIfFailed(packageStream->Seek(start, StreamBase::Reference::END, &end));
-                    ThrowHrIfFailed(packageStream->Seek(start, StreamBase::Reference::START, nullptr));
-                    
-                    UINT64 size;
-                    ThrowHrIfFailed(package->GetSize(&size));
-                    ThrowErrorIf(Error::AppxManifestSemanticError, end.u.LowPart != size,
-                        "Size mistmach of package between AppxManifestBundle.appx and container");
-
-                    // Validate the package
-                    ComPtr<IAppxPackageReader> reader;
-                    ThrowHrIfFailed(appxFactory->CreatePackageReader(packageStream.Get(), &reader));
-                    ComPtr<IAppxManifestReader> innerPackageManifest;
-                    ThrowHrIfFailed(reader->GetManifest(&innerPackageManifest));
-                    // Do semantic checks to validate the relationship between the AppxBundleManifest and the AppxManifest.
-                    ComPtr<IAppxManifestPackageId> bundlePackageId;
-                    ThrowHrIfFailed(package->GetPackageId(&bundlePackageId));
-                    auto bundlePackageIdInternal = bundlePackageId.As<IAppxManifestPackageIdInternal>();
-
-                    ComPtr<IAppxManifestPackageId> innerPackageId;
-                    ThrowHrIfFailed(innerPackageManifest->GetPackageId(&innerPackageId));
-                    auto innerPackageIdInternal = innerPackageId.As<IAppxManifestPackageIdInternal>();
-                    ThrowErrorIf(Error::AppxManifestSemanticError,
-                        (innerPackageIdInternal->GetPublisher() != bundlePackageIdInternal->GetPublisher()),
-                        "AppxBundleManifest.xml and AppxManifest.xml publisher mismatch");
-                    UINT64 bundlePackageVersion = 0;
-                    UINT64 innerPackageVersion = 0;
-                    ThrowHrIfFailed(bundlePackageId->GetVersion(&bundlePackageVersion));
-                    ThrowHrIfFailed(innerPackageId->GetVersion(&innerPackageVersion));
-                    ThrowErrorIf(Error::AppxManifestSemanticError,
-                        (innerPackageVersion != bundlePackageVersion),
-                        "AppxBundleManifest.xml and AppxManifest.xml version mismatch");
-                    ThrowErrorIf(Error::AppxManifestSemanticError,
-                        (innerPackageIdInternal->GetName() != bundlePackageIdInternal->GetName()),
-                        "AppxBundleManifest.xml and AppxManifest.xml name mismatch");
-                    ThrowErrorIf(Error::AppxManifestSemanticError,
-                        (innerPackageIdInternal->GetArchitecture() != bundlePackageIdInternal->GetArchitecture()) &&
-                        !(innerPackageIdInternal->GetArchitecture().empty() && (bundlePackageIdInternal->GetArchitecture() == "neutral")),
-                        "AppxBundleManifest.xml and AppxManifest.xml architecture mismatch");
-
-                    APPX_BUNDLE_PAYLOAD_PACKAGE_TYPE packageType;
-                    ThrowHrIfFailed(package->GetPackageType(&packageType));
-                    
-                    // Validation is done, now see if the package is applicable.
-                    applicability.AddPackageIfApplicable(reader, packageType, package);
-
-                    m_files[packageName] = ComPtr<IAppxFile>::Make<MSIX::AppxFile>(m_factory.Get(), packageName, std::move(packageStream));
-                    // Intentionally don't remove from fileToProcess. For bundles, it is possible to don't unpack packages, like
-                    // resource packages that are not languages packages.
+                if (deferBundlePackages)
+                {
+                    std::vector<ComPtr<IAppxBundleManifestPackageInfo>> applicablePackages;
+                    for (const auto& name : m_applicablePackagesNames)
+                    {
+                        auto deferred = m_deferredBundlePackages.find(name);
+                        applicablePackages.push_back(deferred->second);
+                        m_deferredBundlePackages.erase(deferred);
+                    }
+                    m_applicablePackages = ValidateBundlePackages(applicablePackages);
                 }
             }
-            applicability.GetApplicablePackages(&m_applicablePackages, &m_applicablePackagesNames);
 
         }
         else
@@ -331,16 +549,23 @@ namespace MSIX {
                 {
                     auto opcFileName = Encoding::EncodeFileName(fileName);
                     m_payloadFiles.push_back(opcFileName);
-                    auto fileStream = m_container->GetFile(opcFileName);
-                    ThrowErrorIfNot(Error::FileNotFound, fileStream, "File described in blockmap not contained in OPC container");
-                    VerifyFile(fileStream, fileName, blockMapInternal);
-                    auto blockMapStream = m_appxBlockMap->GetValidationStream(fileName, fileStream);
-                    m_files[opcFileName] = MSIX::ComPtr<IAppxFile>::Make<MSIX::AppxFile>(m_factory.Get(), fileName, std::move(blockMapStream));
-                    filesToProcess.erase(std::remove(filesToProcess.begin(), filesToProcess.end(), opcFileName), filesToProcess.end());
+                    // Reading the local file header of every payload file is most of the cost of opening large
+                    // packages, so callers that only need the footprint files can postpone it to first use.
+                    if (deferPayloadFiles)
+                    {
+                        ThrowErrorIf(Error::FileNotFound, (filesToProcess.find(opcFileName) == filesToProcess.end()),
+                            "File described in blockmap not contained in OPC container");
+                        m_deferredPayloadFiles[opcFileName] = fileName;
+                    }
+                    else
+                    {
+                        m_files[opcFileName] = CreatePayloadFile(opcFileName, fileName, blockMapInternal);
+                    }
+                    filesToProcess.erase(opcFileName);
                 }
             }
 
-            // If the map is not empty, there's a file in the container that didn't go to the footprint or payload
+            // If the set is not empty, there's a file in the container that didn't go to the footprint or payload
             // files. (eg. payload file missing in the AppxBlockMap.xml)
             ThrowErrorIfNot(Error::BlockMapSemanticError, (filesToProcess.empty()), "Payload file not described in AppxBlockMap.xml");
 #ifdef BUNDLE_SUPPORT
@@ -348,6 +573,269 @@ namespace MSIX {
 #endif
     }
 
+#ifdef BUNDLE_SUPPORT
+    // Finds a package of the bundle. Neither the container nor the stream factory can be used concurrently,
+    // so this is done on the thread opening the bundle.
+    ComPtr<IStream> AppxPackageObject::GetBundlePackageStream(const ComPtr<IAppxBundleManifestPackageInfo>& package)
+    {
+        auto factoryOverrides = m_factory.As<IMsixFactoryOverrides>();
+
+        auto bundleInfoInternal = package.As<IAppxBundleManifestPackageInfoInternal>();
+        auto packageName = bundleInfoInternal->GetFileName();
+        auto packageStream = m_container->GetFile(Encoding::EncodeFileName(packageName));
+
+        if (packageStream)
+        {   // The package is in the bundle. Verify is not compressed.
+            auto zipStream = packageStream.As<IStreamInternal>();
+            ThrowErrorIf(Error::AppxManifestSemanticError, zipStream->IsCompressed(), "Packages cannot be compressed");
+        }
+        else if (!packageStream && (bundleInfoInternal->GetOffset() == 0)) // This is a flat bundle.
+        {
+            // We should only do this for flat bundles. If we do it for normal bundles and the user specify a 
+            // stream factory we will basically unpack any package the user wants with the same name as the package
+            // we are looking, which sounds dangerous.
+            ComPtr<IUnknown> streamFactoryUnk;
+            ThrowHrIfFailed(factoryOverrides->GetCurrentSpecifiedExtension(MSIX_FACTORY_EXTENSION_STREAM_FACTORY, &streamFactoryUnk));
+
+            if(streamFactoryUnk.Get() != nullptr)
+            {
+                auto streamFactory = streamFactoryUnk.As<IMsixStreamFactory>();
+                ThrowHrIfFailed(streamFactory->CreateStreamOnRelativePathUtf8(packageName.c_str(), &packageStream));
+            }
+            else
+            {   // User didn't specify a stream factory implementation. Assume packages are in the same location
+                // as the bundle.
+                auto containerName = GetFileName();
+                #ifdef WIN32
+                auto lastSeparator = containerName.find_last_of('\\');
+                #else
+                auto lastSeparator = containerName.find_last_of('/');
+                #endif
+                auto expandedPackageName = containerName.substr(0, lastSeparator + 1) + packageName;
+                ThrowHrIfFailed(CreateStreamOnFile(const_cast<char*>(expandedPackageName.c_str()), true, &packageStream));
+            }
+            ThrowErrorIfNot(Error::FileNotFound, packageStream, "Package from a flat bundle is not present");
+        }
+        else
+        {
+            ThrowErrorIfNot(Error::FileNotFound, packageStream, "Package is not in container");
+        }
+        return packageStream;
+    }
+
+    // Checks a package of the bundle against its entry in the bundle manifest and opens it. Only the package
+    // stream is read, so different packages can be validated at the same time.
+    ComPtr<IAppxPackageReader> AppxPackageObject::ValidateBundlePackage(const ComPtr<IAppxBundleManifestPackageInfo>& package, const ComPtr<IStream>& packageStream)
+    {
+        auto appxFactory = m_factory.As<IAppxFactory>();
+
+        // Semantic checks
+        LARGE_INTEGER start = { 0 };
+        ULARGE_INTEGER end = { 0 };
+        ThrowHrIfFailed(packageStream->Seek(start, StreamBase::Reference::END, &end));
+        ThrowHrIfFailed(packageStream->Seek(start, StreamBase::Reference::START, nullptr));
+        
+        UINT64 size;
+        ThrowHrIfFailed(package->GetSize(&size));
+        ThrowErrorIf(Error::AppxManifestSemanticError, end.QuadPart != size,
+            "Size mistmach of package between AppxManifestBundle.appx and container");
+
+        // Validate the package
+        ComPtr<IAppxPackageReader> reader;
+        ThrowHrIfFailed(appxFactory->CreatePackageReader(packageStream.Get(), &reader));
+        ComPtr<IAppxManifestReader> innerPackageManifest;
+        ThrowHrIfFailed(reader->GetManifest(&innerPackageManifest));
+        // Do semantic checks to validate the relationship between the AppxBundleManifest and the AppxManifest.
+        ComPtr<IAppxManifestPackageId> bundlePackageId;
+        ThrowHrIfFailed(package->GetPackageId(&bundlePackageId));
+        auto bundlePackageIdInternal = bundlePackageId.As<IAppxManifestPackageIdInternal>();
+
+        ComPtr<IAppxManifestPackageId> innerPackageId;
+        ThrowHrIfFailed(innerPackageManifest->GetPackageId(&innerPackageId));
+        auto innerPackageIdInternal = innerPackageId.As<IAppxManifestPackageIdInternal>();
+        ThrowErrorIf(Error::AppxManifestSemanticError,
+            (innerPackageIdInternal->GetPublisher() != bundlePackageIdInternal->GetPublisher()),
+            "AppxBundleManifest.xml and AppxManifest.xml publisher mismatch");
+        UINT64 bundlePackageVersion = 0;
+        UINT64 innerPackageVersion = 0;
+        ThrowHrIfFailed(bundlePackageId->GetVersion(&bundlePackageVersion));
+        ThrowHrIfFailed(innerPackageId->GetVersion(&innerPackageVersion));
+        ThrowErrorIf(Error::AppxManifestSemanticError,
+            (innerPackageVersion != bundlePackageVersion),
+            "AppxBundleManifest.xml and AppxManifest.xml version mismatch");
+        ThrowErrorIf(Error::AppxManifestSemanticError,
+            (innerPackageIdInternal->GetName() != bundlePackageIdInternal->GetName()),
+            "AppxBundleManifest.xml and AppxManifest.xml name mismatch");
+        ThrowErrorIf(Error::AppxManifestSemanticError,
+            (innerPackageIdInternal->GetArchitecture() != bundlePackageIdInternal->GetArchitecture()) &&
+            !(innerPackageIdInternal->GetArchitecture().empty() && (bundlePackageIdInternal->GetArchitecture() == "neutral")),
+            "AppxBundleManifest.xml and AppxManifest.xml architecture mismatch");
+        return reader;
+    }
+
+    // Validates packages of the bundle on a pool of threads and adds them to the files of the bundle once they
+    // are validated. Readers are returned in the order of the packages, and the error reported is the one of
+    // the first package that fails, same as validating the packages one by one.
+    std::vector<ComPtr<IAppxPackageReader>> AppxPackageObject::ValidateBundlePackages(const std::vector<ComPtr<IAppxBundleManifestPackageInfo>>& packages)
+    {
+        // Over a bundle read from a range reader, what opening the packages reads from the bundle is fetched in
+        // two batches up front instead of a request at a time as each package is opened.
+        bool prefetching = PrefetchBundlePackageEnds(packages);
+        std::vector<ComPtr<IStream>> streams;
+        std::exception_ptr lookupFailure;
+        for (const auto& package : packages)
+        {
+            try
+            {
+                streams.push_back(GetBundlePackageStream(package));
+            }
+            catch (...)
+            {
+                lookupFailure = std::current_exception();
+                break;
+            }
+        }
+        if (prefetching) { PrefetchBundlePackageFootprints(packages, streams); }
+
+        std::vector<ComPtr<IAppxPackageReader>> readers(streams.size());
+        std::vector<std::exception_ptr> failures(streams.size());
+        std::atomic<std::size_t> next(0);
+        std::atomic<bool> failed(false);
+        // Packages are taken in order, so when one fails every package before it has been taken already
+        // and the rest are not needed.
+        auto worker = [&]()
+        {
+            std::size_t index;
+            while (!failed && (index = next++) < streams.size())
+            {
+                try
+                {
+                    readers[index] = ValidateBundlePackage(packages[index], streams[index]);
+                }
+                catch (...)
+                {
+                    failures[index] = std::current_exception();
+                    failed = true;
+                }
+            }
+        };
+
+        auto workerPool = m_factory->GetWorkerPool();
+        auto workerCount = std::min<std::size_t>(workerPool->GetConcurrency(), streams.size());
+        workerPool->ForEach(workerCount, workerCount, [&](std::size_t) { worker(); });
+
+        for (std::size_t i = 0; i < streams.size(); i++)
+        {
+            if (failures[i]) { std::rethrow_exception(failures[i]); }
+            auto packageName = packages[i].As<IAppxBundleManifestPackageInfoInternal>()->GetFileName();
+            m_files[packageName] = ComPtr<IAppxFile>::Make<MSIX::AppxFile>(m_factory.Get(), packageName, std::move(streams[i]));
+        }
+        if (lookupFailure) { std::rethrow_exception(lookupFailure); }
+        return readers;
+    }
+
+    // Opening a package stored in the bundle starts with its local file header and the end of central directory
+    // records and central directory in its last bytes. Returns false if the bundle isn't read from a stream that
+    // fetches ahead, then there is nothing more to plan.
+    bool AppxPackageObject::PrefetchBundlePackageEnds(const std::vector<ComPtr<IAppxBundleManifestPackageInfo>>& packages)
+    {
+        auto zipReader = m_container.TryAs<IZipReader>();
+        if (!zipReader) { return false; }
+        std::vector<ZipByteRange> ranges;
+        for (const auto& package : packages)
+        {
+            auto packageName = package.As<IAppxBundleManifestPackageInfoInternal>()->GetFileName();
+            auto stored = zipReader->GetStoredFileRange(Encoding::EncodeFileName(packageName));
+            if (stored.size == 0) { continue; } // not in the bundle, like the packages of a flat bundle
+            auto tailSize = std::min(stored.size, CentralDirectoryReadAhead);
+            // 1 KB holds the local file header with its name and extra field
+            ranges.push_back(ZipByteRange{ stored.offset, std::min<std::uint64_t>(stored.size, 1024) });
+            ranges.push_back(ZipByteRange{ stored.offset + stored.size - tailSize, tailSize });
+        }
+        return !ranges.empty() && zipReader->Prefetch(ranges);
+    }
+
+    // Then it reads the footprint files, which are found in the central directory of the package, now in memory.
+    // A package whose central directory doesn't fit in its last bytes costs a request here. Packages that can't
+    // be read are left out, their errors are reported when they are validated.
+    void AppxPackageObject::PrefetchBundlePackageFootprints(const std::vector<ComPtr<IAppxBundleManifestPackageInfo>>& packages,
+        const std::vector<ComPtr<IStream>>& streams)
+    {
+        static const char* const footprintFiles[] = { CONTENT_TYPES_XML, APPXBLOCKMAP_XML, APPXSIGNATURE_P7X, APPXMANIFEST_XML, CODEINTEGRITY_CAT };
+        auto zipReader = m_container.As<IZipReader>();
+        std::vector<ZipByteRange> ranges;
+        for (std::size_t i = 0; i < streams.size(); i++)
+        {
+            try
+            {
+                auto packageName = Encoding::EncodeFileName(packages[i].As<IAppxBundleManifestPackageInfoInternal>()->GetFileName());
+                if (zipReader->GetStoredFileRange(packageName).size == 0) { continue; }
+                auto packageStart = zipReader->GetFileRecords(packageName).data.offset;
+                auto packageZip = ComPtr<IStorageObject>::Make<ZipObjectReader>(streams[i]).As<IZipReader>();
+                for (const auto footprintFile : footprintFiles)
+                {
+                    auto stored = packageZip->GetStoredFileRange(footprintFile);
+                    if (stored.size != 0) { ranges.push_back(ZipByteRange{ packageStart + stored.offset, stored.size }); }
+                }
+            }
+            catch (...)
+            {   // Reported by ValidateBundlePackage
+            }
+        }
+        if (!ranges.empty()) { zipReader->Prefetch(ranges); }
+    }
+#endif
+
+    ComPtr<IAppxFile> AppxPackageObject::CreatePayloadFile(const std::string& opcFileName, const std::string& fileName, const ComPtr<IAppxBlockMapInternal>& blockMapInternal)
+    {
+        auto fileStream = m_container->GetFile(opcFileName);
+        ThrowErrorIfNot(Error::FileNotFound, fileStream, "File described in blockmap not contained in OPC container");
+        VerifyFile(fileStream, fileName, blockMapInternal);
+        auto zipReader = m_container.TryAs<IZipReader>();
+        if (!zipReader)
+        {
+            return MSIX::ComPtr<IAppxFile>::Make<MSIX::AppxFile>(m_factory.Get(), fileName, m_appxBlockMap->GetValidationStream(fileName, fileStream));
+        }
+
+        // The file is read from its bytes in the zip file by a PayloadFileReader, or by its blocks, which open them
+        // on their first read
+        ULARGE_INTEGER size = { 0 };
+        ThrowHrIfFailed(fileStream->Seek({ 0 }, StreamBase::Reference::END, &size));
+        ThrowHrIfFailed(fileStream->Seek({ 0 }, StreamBase::Reference::START, nullptr));
+        auto blocks = blockMapInternal->GetBlocks(fileName);
+        auto streamInternal = fileStream.As<IStreamInternal>();
+        if (streamInternal->IsCompressed())
+        {   // The stream of the container is still the one that is inflated in parallel, by clones that start at the blocks
+            std::vector<std::uint64_t> compressedBlockSizes;
+            compressedBlockSizes.reserve(blocks.size());
+            for (std::size_t index = 0; index < blocks.size(); index++)
+            {
+                compressedBlockSizes.push_back(blocks.CompressedSize(index));
+            }
+            streamInternal->SetSeekPoints(BLOCKMAP_BLOCK_SIZE, compressedBlockSizes);
+        }
+        auto openRawStream = [zipReader, opcFileName]() { return zipReader->GetRawFile(opcFileName); };
+        auto payloadStream = ComPtr<IStream>::Make<PayloadFileReader>(fileName, openRawStream, size.QuadPart, streamInternal->IsCompressed(),
+            streamInternal->GetSize(), blocks, m_integrityRecord, m_factory->GetPerformanceCounters());
+        auto blockReader = std::make_shared<FileBlockReader>(openRawStream, size.QuadPart, blocks, m_factory->GetPerformanceCounters(),
+            m_factory->GetBlockCache());
+        return MSIX::ComPtr<IAppxFile>::Make<MSIX::AppxFile>(m_factory.Get(), fileName, std::move(payloadStream), blockReader);
+    }
+
+    // Wires up every payload file that hasn't been requested yet. The files are then only looked up, and
+    // the container, which can't be modified concurrently, is left alone once parallel work starts.
+    void AppxPackageObject::CreateDeferredPayloadFiles()
+    {
+        std::lock_guard<std::mutex> lock(m_filesLock);
+        if (m_deferredPayloadFiles.empty()) { return; }
+        auto blockMapInternal = m_appxBlockMap.As<IAppxBlockMapInternal>();
+        for (const auto& file : m_deferredPayloadFiles)
+        {
+            m_files[file.first] = CreatePayloadFile(file.first, file.second, blockMapInternal);
+        }
+        m_deferredPayloadFiles.clear();
+    }
+
     // Verify file in OPC and BlockMap
     void AppxPackageObject::VerifyFile(const ComPtr<IStream>& stream, const std::string& fileName, const ComPtr<IAppxBlockMapInternal>& blockMapInternal)
     {
@@ -357,7 +845,7 @@ namespace MSIX {
 
         auto blocks = blockMapInternal->GetBlocks(fileName);
         std::uint64_t blocksSize = 0;
-        for(auto& block : blocks)
+        for(const auto& block : blocks)
         {   // For Block elements that don't have a Size attribute, we always set its size as BLOCKMAP_BLOCK_SIZE
             // (even for the last one). The Size attribute isn't specified if the file is not compressed.
             ThrowErrorIf(Error::BlockMapSemanticError, (!isCompressed) && (block.blockSize != BLOCKMAP_BLOCK_SIZE),
@@ -396,52 +884,252 @@ namespace MSIX {
         }
     }
 
-    void AppxPackageObject::Unpack(MSIX_PACKUNPACK_OPTION options, const ComPtr<IDirectoryObject>& to)
+    void AppxPackageObject::Unpack(MSIX_PACKUNPACK_OPTION options, const ComPtr<IDirectoryObject>& to, std::uint32_t threadCount,
+        const std::shared_ptr<ProgressReporter>& progress, const FileFilter* filter)
     {
+        QualityOfService::IoPriorityScope priority(m_factory->GetQualityOfService()->IsLowPriorityIo());
+        std::string packageFullNamePrefix;
+        if ((options & MSIX_PACKUNPACK_OPTION_CREATEPACKAGESUBFOLDER) || options & MSIX_PACKUNPACK_OPTION_UNPACKWITHFLATSTRUCTURE)
+        {
+            ComPtr<IAppxManifestPackageId> packageId;
+            if (m_isBundle)
+            {
+                auto manifest = m_appxBundleManifest.As<IAppxBundleManifestReader>();
+                ThrowHrIfFailed(manifest->GetPackageId(&packageId));
+            }
+            else
+            {
+                auto manifest = m_appxManifest.As<IAppxManifestReader>();
+                ThrowHrIfFailed(manifest->GetPackageId(&packageId));
+            }
+            // Don't use to->GetPathSeparator(). DirectoryObject::OpenFile created directories
+            // by looking at "/" in the string. If to->GetPathSeparator() is used the subfolder with
+            // the package full name won't be created on Windows, but it will on other platforms.
+            // This means that we have different behaviors in non-Win platforms.
+            packageFullNamePrefix = packageId.As<IAppxManifestPackageIdInternal>()->GetPackageFullName() + "/";
+        }
+
+        CreateDeferredPayloadFiles();
+
+        // The packages of a bundle are then written like its other files, as they are stored in it, instead of
+        // being unpacked. They were validated when the bundle was read.
+        bool packagesAsFiles = m_isBundle && (options & MSIX_PACKUNPACK_OPTION_PACKAGESASFILES);
+
+        // Pairs of package file name and target file name
+        std::vector<std::pair<std::string, std::string>> filesToExtract;
         auto fileNames = GetFileNames(FileNameOptions::All);
+        std::unordered_set<std::string> packageFiles(m_applicablePackagesNames.begin(), m_applicablePackagesNames.end());
         for (const auto& fileName : fileNames)
-        {   // Don't extract packages files
-            auto file = std::find(std::begin(m_applicablePackagesNames), std::end(m_applicablePackagesNames), fileName);
-            if (file == std::end(m_applicablePackagesNames))
+        {   // Don't extract packages files. Files left out by the filter aren't read at all, the filter selects the
+            // files of the packages, not the packages.
+            bool isPackage = (packageFiles.find(fileName) != packageFiles.end());
+            if (!isPackage || packagesAsFiles)
             {
-                std::string targetName = Encoding::DecodeFileName(fileName);
-                if ((options & MSIX_PACKUNPACK_OPTION_CREATEPACKAGESUBFOLDER) || options & MSIX_PACKUNPACK_OPTION_UNPACKWITHFLATSTRUCTURE)
+                auto decodedName = Encoding::DecodeFileName(fileName);
+                if (isPackage || (filter == nullptr) || filter->IsSelected(decodedName))
                 {
-                    ComPtr<IAppxManifestPackageId> packageId;
-                    if (m_isBundle)
-                    {
-                        auto manifest = m_appxBundleManifest.As<IAppxBundleManifestReader>();
-                        ThrowHrIfFailed(manifest->GetPackageId(&packageId));
-                    }
-                    else
+                    filesToExtract.emplace_back(fileName, packageFullNamePrefix + decodedName);
+                }
+            }
+        }
+
+        // Extract the files in the order they are stored in the container, so the container is read
+        // sequentially instead of jumping around it in name order.
+        std::unordered_map<std::string, std::size_t> containerOrder;
+        auto containerFiles = m_container->GetFileNames(FileNameOptions::All);
+        containerOrder.reserve(containerFiles.size());
+        for (const auto& fileName : containerFiles)
+        {
+            containerOrder.emplace(fileName, containerOrder.size());
+        }
+        auto orderOf = [&containerOrder](const std::string& fileName)
+        {
+            auto found = containerOrder.find(fileName);
+            return (found != containerOrder.end()) ? found->second : containerOrder.size();
+        };
+        std::stable_sort(filesToExtract.begin(), filesToExtract.end(), [&orderOf](const auto& left, const auto& right)
+        {
+            return orderOf(left.first) < orderOf(right.first);
+        });
+
+        // The directories are created once up front instead of checked for every file extracted
+        std::vector<std::string> targetNames;
+        targetNames.reserve(filesToExtract.size());
+        for (const auto& file : filesToExtract)
+        {
+            targetNames.push_back(file.second);
+        }
+        to->CreateDirectories(targetNames);
+
+        auto reporter = progress ? progress : m_factory->GetProgressReporter();
+        if (reporter->IsEnabled())
+        {
+            std::uint64_t totalSize = 0;
+            for (const auto& file : filesToExtract)
+            {
+                UINT64 size = 0;
+                ThrowHrIfFailed(GetAppxFile(file.first)->GetSize(&size));
+                totalSize += size;
+            }
+            reporter->AddWork(totalSize, static_cast<std::uint32_t>(filesToExtract.size()));
+        }
+
+        std::size_t workerCount = 1;
+        if (options & MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION)
+        {
+            workerCount = m_factory->GetWorkerPool()->GetWorkerCount(threadCount);
+        }
+
+        // Files handed to an output stream factory aren't on disk to be compared, linked or stored
+        auto outputStreamFactory = m_factory->GetOutputStreamFactory();
+
+        // Payload files left by a previous unpack are only read and hashed, which is cheaper than inflating and
+        // writing them again when most of the package didn't change.
+        if ((options & MSIX_PACKUNPACK_OPTION_SKIPUNCHANGED) && !m_isBundle && !outputStreamFactory)
+        {
+            std::vector<std::uint8_t> unchanged(filesToExtract.size(), 0);
+            auto checkFile = [&](std::size_t index)
+            {
+                unchanged[index] = IsTargetUnchanged(filesToExtract[index].first, filesToExtract[index].second, to) ? 1 : 0;
+            };
+            if (workerCount > 1)
+            {
+                m_factory->GetWorkerPool()->ForEach(filesToExtract.size(), std::min(workerCount, filesToExtract.size()), checkFile);
+            }
+            else
+            {
+                for (std::size_t index = 0; index < filesToExtract.size(); index++) { checkFile(index); }
+            }
+
+            std::size_t kept = 0;
+            for (std::size_t index = 0; index < filesToExtract.size(); index++)
+            {
+                if (unchanged[index])
+                {
+                    UINT64 size = 0;
+                    ThrowHrIfFailed(GetAppxFile(filesToExtract[index].first)->GetSize(&size));
+                    reporter->Advance(size, 1);
+                }
+                else
+                {
+                    if (kept != index) { filesToExtract[kept] = std::move(filesToExtract[index]); }
+                    kept++;
+                }
+            }
+            filesToExtract.resize(kept);
+        }
+
+        // Payload files whose content is in the block store are linked to it instead of being extracted, the
+        // others are added to it once extracted. Pairs of target file name and key in the store.
+        std::vector<std::pair<std::string, std::string>> filesToStore;
+        auto blockStore = m_factory->GetBlockStore();
+        if (blockStore && !m_isBundle && !outputStreamFactory)
+        {
+            auto blockMapInternal = m_appxBlockMap.As<IAppxBlockMapInternal>();
+            auto materialized = std::remove_if(filesToExtract.begin(), filesToExtract.end(), [&](const auto& file)
+            {
+                if (std::find(m_footprintFiles.begin(), m_footprintFiles.end(), file.first) != m_footprintFiles.end())
+                {
+                    return false;
+                }
+                UINT64 size = 0;
+                ThrowHrIfFailed(GetAppxFile(file.first)->GetSize(&size));
+                if (size == 0)
+                {
+                    return false;
+                }
+                auto key = BlockStore::GetKey(size, blockMapInternal->GetBlocks(Helper::toBackSlash(Encoding::DecodeFileName(file.first))));
+                if (blockStore->Materialize(key, to.Get(), file.second))
+                {
+                    if (IsTargetUnchanged(file.first, file.second, to))
                     {
-                        auto manifest = m_appxManifest.As<IAppxManifestReader>();
-                        ThrowHrIfFailed(manifest->GetPackageId(&packageId));
+                        reporter->Advance(size, 1);
+                        return true;
                     }
-                    // Don't use to->GetPathSeparator(). DirectoryObject::OpenFile created directories
-                    // by looking at "/" in the string. If to->GetPathSeparator() is used the subfolder with
-                    // the package full name won't be created on Windows, but it will on other platforms.
-                    // This means that we have different behaviors in non-Win platforms.
-                    targetName = packageId.As<IAppxManifestPackageIdInternal>()->GetPackageFullName() + "/" + targetName;
+                    blockStore->Drop(key, to.Get(), file.second);
                 }
+                filesToStore.emplace_back(file.second, std::move(key));
+                return false;
+            });
+            filesToExtract.erase(materialized, filesToExtract.end());
+        }
 
-                auto deleteFile = MSIX::scope_exit([&targetName]
+        // Large stored payload files of a package read from a local file are copied by the file system, which
+        // doesn't bring their bytes to this process, and are then checked against the block map. So are the
+        // packages of a bundle written as files.
+        auto zipReader = m_container.TryAs<IZipReader>();
+        if ((!m_isBundle || packagesAsFiles) && !outputStreamFactory && zipReader && !zipReader->GetFileIdentity().empty())
+        {
+            std::vector<std::uint8_t> copied(filesToExtract.size(), 0);
+            auto copyFile = [&](std::size_t index)
+            {
+                const auto& file = filesToExtract[index];
+                copied[index] = (m_isBundle ? CopyBundlePackage(file.first, file.second, to, *reporter) :
+                    CopyStoredFile(file.first, file.second, to, *reporter)) ? 1 : 0;
+            };
+            if (workerCount > 1)
+            {
+                m_factory->GetWorkerPool()->ForEach(filesToExtract.size(), std::min(workerCount, filesToExtract.size()), copyFile);
+            }
+            else
+            {
+                for (std::size_t index = 0; index < filesToExtract.size(); index++) { copyFile(index); }
+            }
+            std::size_t kept = 0;
+            for (std::size_t index = 0; index < filesToExtract.size(); index++)
+            {
+                if (!copied[index])
                 {
-                    remove(targetName.c_str());
-                });
+                    if (kept != index) { filesToExtract[kept] = std::move(filesToExtract[index]); }
+                    kept++;
+                }
+            }
+            filesToExtract.resize(kept);
+        }
 
-                auto targetFile = to->OpenFile(targetName, MSIX::FileStream::Mode::WRITE);
-                auto sourceFile = GetFile(fileName).As<IStream>();
+        // Large compressed payload files are decoded by all the workers together, one file at a time,
+        // so a package with a single huge asset still uses every worker.
+        if (workerCount > 1 && !m_isBundle)
+        {
+            for (auto file = filesToExtract.begin(); file != filesToExtract.end();)
+            {
+                if (ExtractFileInParallel(file->first, file->second, to, static_cast<std::uint32_t>(workerCount), *reporter))
+                {
+                    file = filesToExtract.erase(file);
+                }
+                else
+                {
+                    file++;
+                }
+            }
+        }
+        workerCount = std::min(workerCount, filesToExtract.size());
 
-                ULARGE_INTEGER bytesCount = {0};
-                bytesCount.QuadPart = std::numeric_limits<std::uint64_t>::max();
-                ThrowHrIfFailed(sourceFile->CopyTo(targetFile.Get(), bytesCount, nullptr, nullptr));
-                deleteFile.release();
+        if (workerCount <= 1)
+        {
+            for (const auto& file : filesToExtract)
+            {
+                ExtractFile(file.first, file.second, to, *reporter);
             }
         }
+        else
+        {   // Every package file has its own stream with its own position over the container, so each worker
+            // takes the next file available and extracts it independently.
+            m_factory->GetWorkerPool()->ForEach(filesToExtract.size(), workerCount, [&](std::size_t index)
+            {
+                ExtractFile(filesToExtract[index].first, filesToExtract[index].second, to, *reporter);
+            });
+        }
+
+        // The files are linked to the store and the unpack returns once they are closed, not just written
+        to->WaitForClosedFiles();
+        for (const auto& file : filesToStore)
+        {
+            blockStore->Add(file.second, to.Get(), file.first);
+        }
 
 #ifdef BUNDLE_SUPPORT
-        if(m_isBundle)
+        if(m_isBundle && !packagesAsFiles)
         {
             ComPtr<IDirectoryObject> toPackages;
             // Only execute this block if the -pfn option is specified by itself. We should treat "-flat -pfn" the same way we treat "-flat"
@@ -451,23 +1139,615 @@ namespace MSIX {
                 auto manifest = m_appxBundleManifest.As<IAppxBundleManifestReader>();
                 ComPtr<IAppxManifestPackageId> packageId;
                 ThrowHrIfFailed(manifest->GetPackageId(&packageId));
-                std::string newLocation = to.As<IStorageObject>()->GetFileName() + "/" + 
-                    packageId.As<IAppxManifestPackageIdInternal>()->GetPackageFullName();
-                toPackages = MSIX::ComPtr<IDirectoryObject>::Make<DirectoryObject>(newLocation, true);
+                auto packageFullName = packageId.As<IAppxManifestPackageIdInternal>()->GetPackageFullName();
+                if (outputStreamFactory)
+                {
+                    toPackages = ComPtr<IDirectoryObject>::Make<OutputStreamDirectory>(outputStreamFactory, packageFullName + "/");
+                }
+                else
+                {
+                    std::string newLocation = to.As<IStorageObject>()->GetFileName() + "/" + packageFullName;
+                    toPackages = MSIX::ComPtr<IDirectoryObject>::Make<DirectoryObject>(newLocation, true);
+                }
             }
             else
             {
                 toPackages = to;
             }
-            for(const auto& appx : m_applicablePackages)
+            auto packageOptions = static_cast<MSIX_PACKUNPACK_OPTION>(options | MSIX_PACKUNPACK_OPTION_CREATEPACKAGESUBFOLDER);
+            std::uint32_t budget = 1;
+            if (options & MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION)
+            {
+                budget = static_cast<std::uint32_t>(m_factory->GetWorkerPool()->GetWorkerCount(threadCount));
+            }
+            auto packageWorkerCount = std::min<std::size_t>(budget, m_applicablePackages.size());
+
+            if (packageWorkerCount <= 1)
+            {
+                for(const auto& appx : m_applicablePackages)
+                {
+                    appx.As<IPackage>()->Unpack(packageOptions, toPackages.Get(), threadCount, reporter, filter);
+                }
+            }
+            else
+            {   // Each package is extracted to its own subfolder from its own stream over the bundle, so they are
+                // unpacked at the same time. The workers are split between the packages, each package extracts
+                // its files with its share, so the total number of threads stays within the one requested.
+                auto packageThreadCount = std::max<std::uint32_t>(1, static_cast<std::uint32_t>(budget / packageWorkerCount));
+                m_factory->GetWorkerPool()->ForEach(m_applicablePackages.size(), packageWorkerCount, [&](std::size_t index)
+                {
+                    m_applicablePackages[index].As<IPackage>()->Unpack(packageOptions, toPackages.Get(), packageThreadCount, reporter, filter);
+                });
+            }
+        }
+#endif
+    }
+
+    void AppxPackageObject::ExtractFile(const std::string& fileName, const std::string& targetName, const ComPtr<IDirectoryObject>& to,
+        ProgressReporter& progress)
+    {
+        Tracing::Activity activity(Tracing::Event::ExtractFile, fileName);
+        auto statisticsCallback = m_factory->GetFileStatisticsCallback();
+        FileStatistics statistics;
+        FileStatistics::Scope statisticsScope(statisticsCallback ? &statistics : nullptr);
+        if (ExtractSmallFile(fileName, targetName, to, progress))
+        {
+            ReportFileStatistics(statisticsCallback, statistics, fileName);
+            return;
+        }
+        auto deleteFile = MSIX::scope_exit([&targetName]
+        {
+            remove(targetName.c_str());
+        });
+
+        UINT64 size = 0;
+        ThrowHrIfFailed(GetAppxFile(fileName)->GetSize(&size));
+        auto targetFile = OpenTargetFile(targetName, to, size);
+        auto sourceFile = GetFile(fileName).As<IStream>();
+
+        if (progress.IsEnabled() || statisticsCallback)
+        {   // Copied a block at a time, so a cancel stops the extraction of a large file and reads are measured
+            // apart from writes
+            auto buffer = PooledBuffer::Allocate(m_factory->GetBufferPool(), static_cast<std::size_t>(BLOCKMAP_BLOCK_SIZE));
+            ULONG bytesRead = 0;
+            do
+            {
+                {   FileStatistics::Measure measure(FileStatistics::Stage::Read);
+                    ThrowHrIfFailed(sourceFile->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &bytesRead));
+                }
+                FileStatistics::Measure measure(FileStatistics::Stage::Write);
+                ULONG offset = 0;
+                while (offset < bytesRead)
+                {
+                    ULONG written = 0;
+                    ThrowHrIfFailed(targetFile->Write(buffer.data() + offset, bytesRead - offset, &written));
+                    ThrowErrorIf(Error::FileWrite, (written == 0), "write failed");
+                    offset += written;
+                }
+                progress.Advance(bytesRead);
+            } while (bytesRead != 0);
+        }
+        else
+        {
+            ULARGE_INTEGER bytesCount = {0};
+            bytesCount.QuadPart = std::numeric_limits<std::uint64_t>::max();
+            ThrowHrIfFailed(sourceFile->CopyTo(targetFile.Get(), bytesCount, nullptr, nullptr));
+        }
+        {   FileStatistics::Measure measure(FileStatistics::Stage::Write);
+            ThrowHrIfFailed(targetFile->Commit(STGC_DEFAULT));
+        }
+        progress.Advance(0, 1);
+        deleteFile.release();
+        ReportFileStatistics(statisticsCallback, statistics, fileName);
+    }
+
+    // The block map of a bundle only has its footprint files. A package of a bundle is checked against the bundle
+    // manifest, its size and offset, and against its own signature and block map when its reader is created, which
+    // happens for the applicable packages when the bundle is read, so it is copied as it is.
+    bool AppxPackageObject::CopyBundlePackage(const std::string& fileName, const std::string& targetName, const ComPtr<IDirectoryObject>& to,
+        ProgressReporter& progress)
+    {
+        if (m_factory->GetQualityOfService()->IsThrottled() ||
+            (std::find(m_applicablePackagesNames.begin(), m_applicablePackagesNames.end(), fileName) == m_applicablePackagesNames.end()))
+        {
+            return false;
+        }
+        auto records = m_container.As<IZipReader>()->GetFileRecords(fileName);
+        if (records.isCompressed)
+        {
+            return false;
+        }
+
+        Tracing::Activity activity(Tracing::Event::ExtractFile, fileName, records.data.size);
+        auto statisticsCallback = m_factory->GetFileStatisticsCallback();
+        FileStatistics statistics;
+        FileStatistics::Scope statisticsScope(statisticsCallback ? &statistics : nullptr);
+        {   FileStatistics::Measure measure(FileStatistics::Stage::Write);
+            if (!to->CopyFileRange(targetName, m_container->GetFileName(), records.data.offset, records.data.size))
+            {
+                return false;
+            }
+        }
+        progress.Advance(records.data.size, 1);
+        ReportFileStatistics(statisticsCallback, statistics, fileName);
+        return true;
+    }
+
+    // Most payload files of packages with many assets fit in a block. They don't go through the streams of the
+    // block map and of the target: the block is read from the container stream of the file at once, checked
+    // against its hash as a whole, and written with a single open, write and close of the target.
+    bool AppxPackageObject::ExtractSmallFile(const std::string& fileName, const std::string& targetName, const ComPtr<IDirectoryObject>& to,
+        ProgressReporter& progress)
+    {
+        if (m_isBundle || (std::find(m_footprintFiles.begin(), m_footprintFiles.end(), fileName) != m_footprintFiles.end()))
+        {
+            return false;
+        }
+        UINT64 size = 0;
+        ThrowHrIfFailed(GetAppxFile(fileName)->GetSize(&size));
+        if ((size == 0) || (size > BLOCKMAP_BLOCK_SIZE))
+        {
+            return false;
+        }
+        auto blockMapName = Helper::toBackSlash(Encoding::DecodeFileName(fileName));
+        auto blocks = m_appxBlockMap.As<IAppxBlockMapInternal>()->GetBlocks(blockMapName);
+        if (blocks.size() != 1)
+        {
+            return false;
+        }
+
+        auto stream = m_container->GetFile(fileName);
+        ThrowHrIfFailed(stream->Seek({ 0 }, StreamBase::Reference::START, nullptr));
+        auto buffer = PooledBuffer::Allocate(m_factory->GetBufferPool(), static_cast<std::size_t>(BLOCKMAP_BLOCK_SIZE));
+        ULONG bytesRead = 0;
+        {   FileStatistics::Measure measure(FileStatistics::Stage::Read);
+            while (bytesRead < size)
+            {
+                ULONG read = 0;
+                ThrowHrIfFailed(stream->Read(buffer.data() + bytesRead, static_cast<ULONG>(size - bytesRead), &read));
+                if (read == 0) { break; }
+                bytesRead += read;
+            }
+        }
+        ThrowErrorIf(Error::SignatureInvalid, (bytesRead != size), "file is shorter than its block");
+
+        // The block matched before, see IntegrityRecord
+        if (!m_integrityRecord || !m_integrityRecord->IsVerified(blockMapName))
+        {
+            Sha256Digest hash;
+            {   FileStatistics::Measure measure(FileStatistics::Stage::Hash);
+                SHA256::ComputeHash(buffer.data(), bytesRead, hash);
+            }
+            ThrowErrorIfNot(Error::SignatureInvalid, (blocks.Hash(0) == hash), "Signature hash doesn't match digest hash");
+            if (m_integrityRecord) { m_integrityRecord->AddVerified({ blockMapName }); }
+        }
+
+        m_factory->GetQualityOfService()->Consume(size);
+        {   auto performanceCounters = m_factory->GetPerformanceCounters();
+            PerformanceCounters::Measure measure(performanceCounters.get(), MSIX_PERFORMANCE_COUNTER_STAGE_OPENFILE);
+            to->WriteFileContent(targetName, buffer.data(), bytesRead);
+        }
+        progress.Advance(size, 1);
+        return true;
+    }
+
+    bool AppxPackageObject::ExtractFileInParallel(const std::string& fileName, const std::string& targetName, const ComPtr<IDirectoryObject>& to, std::uint32_t threadCount,
+        ProgressReporter& progress)
+    {
+        // Smaller files don't have enough blocks to be worth splitting.
+        const std::uint64_t minimumSize = 16 * BLOCKMAP_BLOCK_SIZE;
+        auto appxFile = GetAppxFile(fileName);
+        UINT64 size = 0;
+        ThrowHrIfFailed(appxFile->GetSize(&size));
+        // Only payload files have blocks. Bundle packages aren't extracted and bundles have no payload files, so
+        // anything that isn't one of the few footprint files is a payload file.
+        if ((size < minimumSize) || m_isBundle ||
+            (std::find(m_footprintFiles.begin(), m_footprintFiles.end(), fileName) != m_footprintFiles.end()))
+        {
+            return false;
+        }
+        APPX_COMPRESSION_OPTION compression = APPX_COMPRESSION_OPTION_NONE;
+        ThrowHrIfFailed(appxFile->GetCompressionOption(&compression));
+        if (compression == APPX_COMPRESSION_OPTION_NONE)
+        {
+            return false;
+        }
+
+        Tracing::Activity activity(Tracing::Event::ExtractFile, fileName, size);
+        auto statisticsCallback = m_factory->GetFileStatisticsCallback();
+        FileStatistics statistics;
+        FileStatistics::Scope statisticsScope(statisticsCallback ? &statistics : nullptr);
+        auto blockMapName = Helper::toBackSlash(Encoding::DecodeFileName(fileName));
+        auto blocks = m_appxBlockMap.As<IAppxBlockMapInternal>()->GetBlocks(blockMapName);
+        auto deleteFile = MSIX::scope_exit([&targetName]
+        {
+            remove(targetName.c_str());
+        });
+
+        // Every block of the file matched before, see IntegrityRecord
+        bool verified = m_integrityRecord && m_integrityRecord->IsVerified(blockMapName);
+
+        // The file is inflated in place where it can be mapped, which a 32 bit address space can't be relied on for.
+        // Not when throttled, writes to a mapping can't be paced.
+        std::unique_ptr<MappedOutputFile> mappedFile;
+        if ((sizeof(void*) >= 8) && !m_factory->GetQualityOfService()->IsThrottled())
+        {
+            PerformanceCounters::Measure measure(m_factory->GetPerformanceCounters().get(), MSIX_PERFORMANCE_COUNTER_STAGE_OPENFILE);
+            mappedFile = to->OpenMappedFile(targetName, size);
+        }
+        if (mappedFile)
+        {
+            if (!InflateBlocksToMappedFile(m_container->GetFile(fileName), blocks, *mappedFile, threadCount, *m_factory->GetWorkerPool(),
+                &progress, !verified))
+            {
+                return false;
+            }
+            FileStatistics::Measure measure(FileStatistics::Stage::Write);
+            mappedFile.reset();
+        }
+        else
+        {
+            auto targetFile = OpenTargetFile(targetName, to, size);
+            if (!InflateBlocksInParallel(m_container->GetFile(fileName), blocks, targetFile.Get(), threadCount, *m_factory->GetWorkerPool(), &progress,
+                !verified))
+            {
+                return false;
+            }
+            FileStatistics::Measure measure(FileStatistics::Stage::Write);
+            ThrowHrIfFailed(targetFile->Commit(STGC_DEFAULT));
+        }
+        if (m_integrityRecord && !verified) { m_integrityRecord->AddVerified({ blockMapName }); }
+        progress.Advance(0, 1);
+        deleteFile.release();
+        ReportFileStatistics(statisticsCallback, statistics, fileName);
+        return true;
+    }
+
+    bool AppxPackageObject::CopyStoredFile(const std::string& fileName, const std::string& targetName, const ComPtr<IDirectoryObject>& to,
+        ProgressReporter& progress)
+    {
+        // Smaller files cost less to write than the extra pass over the target. The file system copy can't be
+        // paced, so it isn't used under a limit of bytes per second.
+        const std::uint64_t minimumSize = 16 * BLOCKMAP_BLOCK_SIZE;
+        if (m_factory->GetQualityOfService()->IsThrottled() ||
+            (std::find(m_footprintFiles.begin(), m_footprintFiles.end(), fileName) != m_footprintFiles.end()))
+        {
+            return false;
+        }
+        auto appxFile = GetAppxFile(fileName);
+        UINT64 size = 0;
+        ThrowHrIfFailed(appxFile->GetSize(&size));
+        APPX_COMPRESSION_OPTION compression = APPX_COMPRESSION_OPTION_NONE;
+        ThrowHrIfFailed(appxFile->GetCompressionOption(&compression));
+        if ((size < minimumSize) || (compression != APPX_COMPRESSION_OPTION_NONE))
+        {
+            return false;
+        }
+
+        Tracing::Activity activity(Tracing::Event::ExtractFile, fileName, size);
+        auto statisticsCallback = m_factory->GetFileStatisticsCallback();
+        FileStatistics statistics;
+        FileStatistics::Scope statisticsScope(statisticsCallback ? &statistics : nullptr);
+        auto data = m_container.As<IZipReader>()->GetFileRecords(fileName).data;
+        if (data.size != size)
+        {
+            return false;
+        }
+        {   FileStatistics::Measure measure(FileStatistics::Stage::Write);
+            if (!to->CopyFileRange(targetName, m_container->GetFileName(), data.offset, size))
+            {
+                return false;
+            }
+        }
+        // The package file can change while it is copied, so what counts is the content of the target. A target
+        // that doesn't match is extracted again, which reports the error of the package if it really is corrupted.
+        if (!IsTargetUnchanged(fileName, targetName, to))
+        {
+            remove(to->GetFilePath(targetName).c_str());
+            return false;
+        }
+        progress.Advance(size, 1);
+        ReportFileStatistics(statisticsCallback, statistics, fileName);
+        return true;
+    }
+
+    bool AppxPackageObject::IsTargetUnchanged(const std::string& fileName, const std::string& targetName, const ComPtr<IDirectoryObject>& to)
+    {   // Footprint files have no blocks, they are small and always written again
+        if (std::find(m_footprintFiles.begin(), m_footprintFiles.end(), fileName) != m_footprintFiles.end())
+        {
+            return false;
+        }
+        UINT64 size = 0;
+        ThrowHrIfFailed(GetAppxFile(fileName)->GetSize(&size));
+
+        ComPtr<IStream> target;
+        try
+        {
+            target = ComPtr<IStream>::Make<NativeFileStream>(to->GetFilePath(targetName), NativeFileStream::Mode::READ);
+        }
+        catch (const Exception&)
+        {   // Not there yet
+            return false;
+        }
+        ULARGE_INTEGER targetSize = { 0 };
+        ThrowHrIfFailed(target->Seek({ 0 }, StreamBase::Reference::END, &targetSize));
+        auto blocks = m_appxBlockMap.As<IAppxBlockMapInternal>()->GetBlocks(Helper::toBackSlash(Encoding::DecodeFileName(fileName)));
+        if ((targetSize.QuadPart != size) || (blocks.size() != (size + BLOCKMAP_BLOCK_SIZE - 1) / BLOCKMAP_BLOCK_SIZE))
+        {
+            return false;
+        }
+        ThrowHrIfFailed(target->Seek({ 0 }, StreamBase::Reference::START, nullptr));
+
+        auto buffer = PooledBuffer::Allocate(m_factory->GetBufferPool(), static_cast<std::size_t>(BLOCKMAP_BLOCK_SIZE));
+        std::uint64_t remaining = size;
+        for (std::size_t index = 0; index < blocks.size(); index++)
+        {
+            auto blockSize = static_cast<ULONG>(std::min<std::uint64_t>(remaining, BLOCKMAP_BLOCK_SIZE));
+            ULONG bytesRead = 0;
+            {   FileStatistics::Measure measure(FileStatistics::Stage::Read);
+                ThrowHrIfFailed(target->Read(buffer.data(), blockSize, &bytesRead));
+            }
+            if (bytesRead != blockSize)
             {
-                appx.As<IPackage>()->Unpack(
-                    static_cast<MSIX_PACKUNPACK_OPTION>(options | MSIX_PACKUNPACK_OPTION_CREATEPACKAGESUBFOLDER), toPackages.Get());
+                return false;
             }
+            Sha256Digest hash;
+            {   FileStatistics::Measure measure(FileStatistics::Stage::Hash);
+                SHA256::ComputeHash(buffer.data(), blockSize, hash);
+            }
+            if (hash != blocks.Hash(index))
+            {
+                return false;
+            }
+            remaining -= blockSize;
+        }
+        return true;
+    }
+
+    ComPtr<IStream> AppxPackageObject::OpenTargetFile(const std::string& targetName, const ComPtr<IDirectoryObject>& to, std::uint64_t size)
+    {
+        auto performanceCounters = m_factory->GetPerformanceCounters();
+        PerformanceCounters::Measure measure(performanceCounters.get(), MSIX_PERFORMANCE_COUNTER_STAGE_OPENFILE);
+        auto file = to->OpenFile(targetName, MSIX::FileStream::Mode::WRITE, size);
+        auto qualityOfService = m_factory->GetQualityOfService();
+        if (qualityOfService->IsThrottled())
+        {
+            return ComPtr<IStream>::Make<ThrottledStream>(file, qualityOfService);
+        }
+        return file;
+    }
+
+    void AppxPackageObject::ReportFileStatistics(const ComPtr<IMsixFileStatisticsCallback>& callback, const FileStatistics& statistics,
+        const std::string& fileName)
+    {
+        if (!callback) { return; }
+        UINT64 size = 0;
+        ThrowHrIfFailed(GetAppxFile(fileName)->GetSize(&size));
+        auto zipReader = m_container.TryAs<IZipReader>();
+        std::uint64_t compressedSize = zipReader ? zipReader->GetFileRecords(fileName).data.size : size;
+        std::uint32_t blockCount = 0;
+        auto name = Encoding::DecodeFileName(fileName);
+        if (!m_isBundle && (std::find(m_footprintFiles.begin(), m_footprintFiles.end(), fileName) == m_footprintFiles.end()))
+        {
+            blockCount = static_cast<std::uint32_t>(m_appxBlockMap.As<IAppxBlockMapInternal>()->GetBlocks(Helper::toBackSlash(name)).size());
+        }
+        statistics.Report(callback.Get(), name, false, size, compressedSize, blockCount);
+    }
+
+    void AppxPackageObject::Verify(std::uint32_t threadCount)
+    {
+        auto qualityOfService = m_factory->GetQualityOfService();
+        QualityOfService::IoPriorityScope priority(qualityOfService->IsLowPriorityIo());
+        auto workerPool = m_factory->GetWorkerPool();
+        std::size_t workerCount = workerPool->GetWorkerCount(threadCount);
+        // Wires up the payload files, which checks that their sizes agree with the block map and sets
+        // the seek points of the compressed ones.
+        CreateDeferredPayloadFiles();
+
+        struct FileToVerify
+        {
+            std::string name;
+            FileBlocks blocks;
+            ComPtr<IStream> stream;
+            std::size_t blockCount;
+            std::size_t expectedBlocks;
+            std::uint64_t size;
+            bool canClone;
+        };
+        // Consecutive blocks of one file read and hashed together
+        struct BlockRun
+        {
+            std::size_t file;
+            std::size_t first;
+            std::size_t last;
+        };
+        const std::size_t blocksPerRun = 16;
+
+        // Read the files in the order they are stored in the container
+        auto blockMapInternal = m_appxBlockMap.As<IAppxBlockMapInternal>();
+        std::unordered_map<std::string, std::string> blockMapFiles;
+        for (const auto& fileName : blockMapInternal->GetFileNames())
+        {
+            blockMapFiles[Encoding::EncodeFileName(fileName)] = fileName;
+        }
+        std::vector<FileToVerify> files;
+        std::vector<BlockRun> runs;
+        for (const auto& opcFileName : m_container->GetFileNames(FileNameOptions::All))
+        {
+            auto blockMapFile = blockMapFiles.find(opcFileName);
+            if (blockMapFile == blockMapFiles.end()) { continue; }
+            if (m_integrityRecord && m_integrityRecord->IsVerified(blockMapFile->second)) { continue; }
+            FileToVerify file;
+            file.name = blockMapFile->second;
+            file.blocks = blockMapInternal->GetBlocks(file.name);
+            file.stream = m_container->GetFile(opcFileName);
+            ThrowErrorIfNot(Error::FileNotFound, file.stream, "File described in blockmap not contained in OPC container");
+            ULARGE_INTEGER end = { 0 };
+            ThrowHrIfFailed(file.stream->Seek({ 0 }, StreamBase::Reference::END, &end));
+            file.size = end.QuadPart;
+            file.expectedBlocks = static_cast<std::size_t>((file.size + BLOCKMAP_BLOCK_SIZE - 1) / BLOCKMAP_BLOCK_SIZE);
+            file.blockCount = std::min(file.expectedBlocks, file.blocks.size());
+            // Streams that can't be cloned, like compressed ones without seek points, are read from the start
+            ComPtr<IStream> clone;
+            file.canClone = SUCCEEDED(file.stream->Clone(&clone));
+            auto runSize = file.canClone ? blocksPerRun : file.blockCount;
+            for (std::size_t first = 0; first < file.blockCount; first += runSize)
+            {
+                runs.push_back({ files.size(), first, std::min(first + runSize, file.blockCount) });
+            }
+            files.push_back(std::move(file));
+        }
+
+        // The bytes stored before the signature weren't checked when the package was opened, they are hashed
+        // on another thread while the blocks are.
+        auto bufferPool = m_factory->GetBufferPool();
+        std::shared_ptr<PoolTask> fileRecordsValidation;
+        if (m_fileRecordsPending)
+        {
+            auto records = m_container.As<IZipReader>()->GetFileRecordsBeforeFile(APPXSIGNATURE_P7X);
+            bool positional = records.As<IStreamInternal>()->SupportsReadAt();
+            auto recordsStream = m_appxSignature->GetValidationStream(SIGNATURE_FILE_RECORDS_PART, records);
+            if (positional)
+            {
+                fileRecordsValidation = workerPool->Async([recordsStream, bufferPool]() { ValidateToEnd(recordsStream, bufferPool); });
+            }
+            else
+            {
+                ValidateToEnd(recordsStream, bufferPool);
+            }
+        }
+
+        // The first block of each run that doesn't match its hash, or the end of the run.
+        std::vector<std::size_t> mismatches(runs.size());
+        if (!runs.empty())
+        {
+            auto scheduler = IoScheduler::GetDefault();
+            workerPool->ForEach(runs.size(), std::min(workerCount, runs.size()), [&](std::size_t index)
+            {
+                const auto& run = runs[index];
+                const auto& file = files[run.file];
+                mismatches[index] = run.last;
+
+                ComPtr<IStream> stream;
+                if (file.canClone) { ThrowHrIfFailed(file.stream->Clone(&stream)); }
+                else { stream = file.stream; }
+                LARGE_INTEGER position = { 0 };
+                position.QuadPart = static_cast<LONGLONG>(run.first * BLOCKMAP_BLOCK_SIZE);
+                ThrowHrIfFailed(stream->Seek(position, StreamBase::Reference::START, nullptr));
+                auto streamInternal = stream.TryAs<IStreamInternal>();
+                bool positional = streamInternal && streamInternal->SupportsReadAt();
+
+                // The blocks of a batch are read as one read vector. Positional streams read them concurrently.
+                auto buffer = bufferPool->Get(static_cast<std::size_t>(blocksPerRun * BLOCKMAP_BLOCK_SIZE));
+                for (std::size_t batch = run.first; batch < run.last; batch += blocksPerRun)
+                {
+                    auto batchEnd = std::min(batch + blocksPerRun, run.last);
+                    HashRequest requests[blocksPerRun];
+                    Sha256Digest hashes[blocksPerRun];
+                    std::vector<IoRequest> reads;
+                    reads.reserve(batchEnd - batch);
+                    for (std::size_t block = batch; block < batchEnd; block++)
+                    {
+                        auto data = buffer.data() + (block - batch) * BLOCKMAP_BLOCK_SIZE;
+                        auto size = static_cast<ULONG>(std::min(BLOCKMAP_BLOCK_SIZE, file.size - block * BLOCKMAP_BLOCK_SIZE));
+                        reads.push_back(IoRequest::Read(stream, positional ? block * BLOCKMAP_BLOCK_SIZE : IoCurrentPosition, data, size));
+                    }
+                    scheduler->Run(reads);
+                    std::uint64_t transferred = 0;
+                    for (std::size_t block = batch; block < batchEnd; block++)
+                    {
+                        const auto& read = reads[block - batch];
+                        ThrowErrorIf(Error::FileRead, (read.transferred != read.size), "file is shorter than its blocks");
+                        requests[block - batch] = { static_cast<const std::uint8_t*>(read.buffer), read.size, &hashes[block - batch] };
+                        transferred += read.transferred;
+                    }
+                    qualityOfService->Consume(transferred);
+                    SHA256::ComputeHashes(requests, batchEnd - batch);
+                    for (std::size_t block = batch; block < batchEnd; block++)
+                    {
+                        if (file.blocks.Hash(block) != hashes[block - batch])
+                        {
+                            mismatches[index] = block;
+                            return;
+                        }
+                    }
+                }
+            });
+        }
+
+        // Runs are in block order, the first one that stopped early has the first mismatch of its file. When the
+        // blocks don't cover the file exactly, the first block past the shorter of the two doesn't match.
+        const auto noMismatch = std::numeric_limits<std::size_t>::max();
+        std::vector<std::size_t> firstMismatch(files.size(), noMismatch);
+        for (std::size_t index = 0; index < runs.size(); index++)
+        {
+            auto& first = firstMismatch[runs[index].file];
+            if ((first == noMismatch) && (mismatches[index] != runs[index].last)) { first = mismatches[index]; }
+        }
+        std::ostringstream report;
+        std::size_t mismatchedFiles = 0;
+        for (std::size_t index = 0; index < files.size(); index++)
+        {
+            const auto& file = files[index];
+            auto first = firstMismatch[index];
+            if ((first == noMismatch) && (file.expectedBlocks != file.blocks.size())) { first = file.blockCount; }
+            if (first == noMismatch) { continue; }
+            report << ((mismatchedFiles++ == 0) ? "" : "\n") << "'" << file.name << "': block " << first << " doesn't match the block map";
+        }
+        ThrowErrorIf(Error::SignatureInvalid, (mismatchedFiles != 0), report.str().c_str());
+        if (fileRecordsValidation) { fileRecordsValidation->Wait(); }
+        m_fileRecordsPending = false;
+        if (m_integrityRecord)
+        {
+            std::vector<std::string> verified;
+            for (const auto& file : files) { verified.push_back(file.name); }
+            m_integrityRecord->AddVerified(verified);
+        }
+
+#ifdef BUNDLE_SUPPORT
+        for (const auto& package : m_applicablePackages)
+        {
+            package.As<IPackage>()->Verify(threadCount);
         }
 #endif
     }
 
+    PackageIndex AppxPackageObject::GetIndex()
+    {
+        auto zipReader = m_container.TryAs<IZipReader>();
+        ThrowErrorIf(Error::NotSupported, (m_isBundle || !zipReader), "Only packages read from a zip container have an index");
+        PackageIndex index;
+        auto range = zipReader->GetCentralDirectoryRange();
+        index.packageSize = range.offset + range.size;
+        index.centralDirectoryHash = zipReader->GetCentralDirectoryHash();
+        index.blockMapHash = HashFootprintFile(m_container->GetFile(APPXBLOCKMAP_XML));
+        index.contentTypesHash = HashFootprintFile(m_container->GetFile(CONTENT_TYPES_XML));
+        index.manifestHash = HashFootprintFile(m_container->GetFile(APPXMANIFEST_XML));
+        index.manifestSnapshot = m_appxManifest.As<IAppxManifestObject>()->GetSnapshot(m_manifestSchemaValidated).Save();
+
+        auto blockMapInternal = m_appxBlockMap.As<IAppxBlockMapInternal>();
+        for (const auto& fileName : blockMapInternal->GetFileNames())
+        {
+            PackageIndex::File file;
+            file.name = fileName;
+            auto blockMapFile = blockMapInternal->GetFile(fileName);
+            UINT64 size = 0;
+            UINT32 localFileHeaderSize = 0;
+            ThrowHrIfFailed(blockMapFile->GetUncompressedSize(&size));
+            ThrowHrIfFailed(blockMapFile->GetLocalFileHeaderSize(&localFileHeaderSize));
+            file.size = size;
+            file.localFileHeaderSize = localFileHeaderSize;
+            auto blocks = blockMapInternal->GetBlocks(fileName);
+            file.blockCount = blocks.size();
+            for (const auto& block : blocks)
+            {
+                index.blocks->Add(block.hash, block.compressedSize, block.blockSize);
+            }
+            index.files.push_back(std::move(file));
+        }
+        return index;
+    }
+
     // IStorageObject
     std::vector<std::string> AppxPackageObject::GetFileNames(FileNameOptions options)
     {
@@ -499,12 +1779,35 @@ namespace MSIX {
         return stream;
     }
 
+    // The lookup, the creation of a deferred file and its insertion are one step, so concurrent callers asking for
+    // the same file get the same object.
     ComPtr<IAppxFile> AppxPackageObject::GetAppxFile(const std::string& fileName)
     {
+        std::lock_guard<std::mutex> lock(m_filesLock);
         auto result = m_files.find(fileName);
         if (result == m_files.end())
         {
-            return ComPtr<IAppxFile>();
+#ifdef BUNDLE_SUPPORT
+            // A package validated on first use is added to m_files by ValidateBundlePackages, still under the
+            // lock, so a concurrent caller waits for it instead of validating it again.
+            auto deferredPackage = m_deferredBundlePackages.find(fileName);
+            if (deferredPackage != m_deferredBundlePackages.end())
+            {
+                std::vector<ComPtr<IAppxBundleManifestPackageInfo>> packages = { deferredPackage->second };
+                ValidateBundlePackages(packages);
+                m_deferredBundlePackages.erase(deferredPackage);
+                return m_files[fileName];
+            }
+#endif
+            auto deferred = m_deferredPayloadFiles.find(fileName);
+            if (deferred == m_deferredPayloadFiles.end())
+            {
+                return ComPtr<IAppxFile>();
+            }
+            auto file = CreatePayloadFile(deferred->first, deferred->second, m_appxBlockMap.As<IAppxBlockMapInternal>());
+            m_files[fileName] = file;
+            m_deferredPayloadFiles.erase(deferred);
+            return file;
         }
         return result->second;
     }
@@ -524,8 +1827,9 @@ namespace MSIX {
         if (m_isBundle) { return static_cast<HRESULT>(Error::PackageIsBundle); }
         ThrowErrorIf(Error::InvalidParameter, (file == nullptr || *file != nullptr), "bad pointer");
         ThrowErrorIf(Error::FileNotFound, (static_cast<size_t>(type) > footprintFiles.size()), "unknown footprint file type");
+        // Optional footprint files are probed for, a missing one is not worth an exception
         auto result = GetAppxFile(footprintFiles[type]);
-        ThrowErrorIfNot(Error::FileNotFound, result, "requested footprint file not in package")
+        if (!result) { return static_cast<HRESULT>(Error::FileNotFound); }
         // Clients expect the stream's pointer to be at the start of the file!
         ComPtr<IStream> stream;
         ThrowHrIfFailed(result->GetStream(&stream));
@@ -543,18 +1847,23 @@ namespace MSIX {
     {
         if (m_isBundle) { return static_cast<HRESULT>(Error::PackageIsBundle); }
         ThrowErrorIf(Error::InvalidParameter,(filesEnumerator == nullptr || *filesEnumerator != nullptr), "bad pointer");
-        std::vector<ComPtr<IAppxFile>> files;
-        for (const auto& fileName : GetFileNames(FileNameOptions::PayloadOnly))
+        std::lock_guard<std::mutex> lock(m_payloadFileObjectsLock);
+        if (!m_payloadFileObjects)
         {
-            auto file = GetAppxFile(fileName);
-            // Clients expect the stream's pointer to be at the start of the file!
-            ComPtr<IStream> stream;
-            ThrowHrIfFailed(file->GetStream(&stream));
-            ThrowHrIfFailed(stream->Seek({0}, StreamBase::Reference::START, nullptr));
-            files.push_back(std::move(file));
+            std::vector<ComPtr<IAppxFile>> files;
+            for (const auto& fileName : GetFileNames(FileNameOptions::PayloadOnly))
+            {
+                files.push_back(GetAppxFile(fileName));
+            }
+            m_payloadFileObjects = std::make_shared<const std::vector<ComPtr<IAppxFile>>>(std::move(files));
         }
         *filesEnumerator = ComPtr<IAppxFilesEnumerator>::
-            Make<EnumeratorCom<IAppxFilesEnumerator, IAppxFile>>(files).Detach();
+            Make<EnumeratorCom<IAppxFilesEnumerator, IAppxFile>>(m_payloadFileObjects, [](IAppxFile* file)
+            {   // Clients expect the stream's pointer to be at the start of the file!
+                ComPtr<IStream> stream;
+                ThrowHrIfFailed(file->GetStream(&stream));
+                ThrowHrIfFailed(stream->Seek({0}, StreamBase::Reference::START, nullptr));
+            }).Detach();
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
 
@@ -575,7 +1884,7 @@ namespace MSIX {
         ThrowErrorIf(Error::FileNotFound, (static_cast<size_t>(fileType) > bundleFootprintFiles.size()), "unknown footprint file type");
         std::string footprint (bundleFootprintFiles[fileType]);
         auto result = GetAppxFile(footprint);
-        ThrowErrorIfNot(Error::FileNotFound, result, "Requested footprint file not in bundle")
+        if (!result) { return static_cast<HRESULT>(Error::FileNotFound); }
         // Clients expect the stream's pointer to be at the start of the file!
         ComPtr<IStream> stream;
         ThrowHrIfFailed(result->GetStream(&stream));
@@ -599,7 +1908,7 @@ namespace MSIX {
             packages.push_back(std::move(package));
         }
         *payloadPackages = ComPtr<IAppxFilesEnumerator>::
-            Make<EnumeratorCom<IAppxFilesEnumerator, IAppxFile>>(packages).Detach();
+            Make<EnumeratorCom<IAppxFilesEnumerator, IAppxFile>>(std::move(packages)).Detach();
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
 
@@ -623,7 +1932,7 @@ namespace MSIX {
         if (m_isBundle) { return static_cast<HRESULT>(Error::PackageIsBundle); }
         ThrowErrorIf(Error::InvalidParameter, (fileName == nullptr || file == nullptr || *file != nullptr), "bad pointer");
         auto result = GetAppxFile(Encoding::EncodeFileName(fileName));
-        ThrowErrorIfNot(Error::FileNotFound, result, "requested file not in package")
+        if (!result) { return static_cast<HRESULT>(Error::FileNotFound); }
         // Clients expect the stream's pointer to be at the start of the file!
         ComPtr<IStream> stream;
         ThrowHrIfFailed(result->GetStream(&stream));
@@ -632,6 +1941,79 @@ namespace MSIX {
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
 
+    StoredPayloadFile AppxPackageObject::GetStoredPayloadFile(const std::string& blockMapName)
+    {
+        auto zipReader = m_container.TryAs<IZipReader>();
+        ThrowErrorIf(Error::NotSupported, (m_isBundle || !zipReader), "Only the payload files of packages read from a zip container are stored");
+        auto opcFileName = Encoding::EncodeFileName(blockMapName);
+        ThrowErrorIf(Error::FileNotFound, (std::find(m_payloadFiles.begin(), m_payloadFiles.end(), opcFileName) == m_payloadFiles.end()),
+            "Not a payload file of the package");
+        auto blockMapInternal = m_appxBlockMap.As<IAppxBlockMapInternal>();
+        StoredPayloadFile file;
+        UINT64 size = 0;
+        ThrowHrIfFailed(blockMapInternal->GetFile(blockMapName)->GetUncompressedSize(&size));
+        file.size = size;
+        file.blocks = blockMapInternal->GetBlocks(blockMapName);
+        file.stream = zipReader->GetRawFile(opcFileName);
+        ThrowErrorIfNot(Error::FileNotFound, file.stream, "File described in blockmap not contained in OPC container");
+        file.isCompressed = file.stream.As<IStreamInternal>()->IsCompressed();
+        return file;
+    }
+
+    // IMsixPackageLayout
+    HRESULT STDMETHODCALLTYPE AppxPackageObject::GetFileRanges(LPCSTR utf8FileName, MSIX_BYTE_RANGE* localFileHeader, MSIX_BYTE_RANGE* data,
+        MSIX_BYTE_RANGE* dataDescriptor) noexcept try
+    {
+        ThrowErrorIf(Error::InvalidParameter, (utf8FileName == nullptr || localFileHeader == nullptr || data == nullptr || dataDescriptor == nullptr),
+            "bad pointer");
+        auto records = m_container.As<IZipReader>()->GetFileRecords(Encoding::EncodeFileName(Helper::toBackSlash(utf8FileName)));
+        *localFileHeader = MSIX_BYTE_RANGE{ records.localFileHeader.offset, records.localFileHeader.size };
+        *data = MSIX_BYTE_RANGE{ records.data.offset, records.data.size };
+        *dataDescriptor = MSIX_BYTE_RANGE{ records.dataDescriptor.offset, records.dataDescriptor.size };
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
+
+    HRESULT STDMETHODCALLTYPE AppxPackageObject::GetBlockCount(LPCSTR utf8FileName, UINT32* count) noexcept try
+    {
+        ThrowErrorIf(Error::InvalidParameter, (utf8FileName == nullptr || count == nullptr), "bad pointer");
+        *count = static_cast<UINT32>(m_appxBlockMap.As<IAppxBlockMapInternal>()->GetBlocks(Helper::toBackSlash(utf8FileName)).size());
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
+
+    HRESULT STDMETHODCALLTYPE AppxPackageObject::GetBlockRange(LPCSTR utf8FileName, UINT32 blockIndex, MSIX_BYTE_RANGE* range) noexcept try
+    {
+        ThrowErrorIf(Error::InvalidParameter, (utf8FileName == nullptr || range == nullptr), "bad pointer");
+        const auto& ranges = GetBlockRanges(Helper::toBackSlash(utf8FileName));
+        ThrowErrorIf(Error::InvalidParameter, (blockIndex >= ranges.size()), "block index out of range");
+        *range = MSIX_BYTE_RANGE{ ranges[blockIndex].offset, ranges[blockIndex].size };
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
+
+    HRESULT STDMETHODCALLTYPE AppxPackageObject::GetCentralDirectoryRange(MSIX_BYTE_RANGE* range) noexcept try
+    {
+        ThrowErrorIf(Error::InvalidParameter, (range == nullptr), "bad pointer");
+        auto centralDirectory = m_container.As<IZipReader>()->GetCentralDirectoryRange();
+        *range = MSIX_BYTE_RANGE{ centralDirectory.offset, centralDirectory.size };
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
+
+    const std::vector<ZipByteRange>& AppxPackageObject::GetBlockRanges(const std::string& blockMapName)
+    {
+        auto found = m_blockRanges.find(blockMapName);
+        if (found != m_blockRanges.end())
+        {
+            return found->second;
+        }
+        auto blockMap = m_appxBlockMap.As<IAppxBlockMapInternal>();
+        auto blocks = blockMap->GetBlocks(blockMapName);
+        UINT64 size = 0;
+        ThrowHrIfFailed(blockMap->GetFile(blockMapName)->GetUncompressedSize(&size));
+        auto records = m_container.As<IZipReader>()->GetFileRecords(Encoding::EncodeFileName(blockMapName));
+        auto ranges = MSIX::GetBlockRanges(records, size, blocks);
+        ThrowErrorIf(Error::BlockMapInvalidData, (ranges.size() != blocks.size()), "The blocks of the file don't match its stored bytes");
+        return m_blockRanges.emplace(blockMapName, std::move(ranges)).first->second;
+    }
+
     // IAppxBundleReaderUtf8
     HRESULT STDMETHODCALLTYPE AppxPackageObject::GetPayloadPackage(LPCSTR fileName, IAppxFile **payloadPackage) noexcept try
     {
@@ -639,7 +2021,7 @@ namespace MSIX {
         if (!m_isBundle) { return static_cast<HRESULT>(Error::NotImplemented); }
         ThrowErrorIf(Error::InvalidParameter, (fileName == nullptr || payloadPackage == nullptr || *payloadPackage != nullptr), "bad pointer");
         auto result = GetAppxFile(fileName);
-        ThrowErrorIfNot(Error::FileNotFound, result, "Requested package not in bundle")
+        if (!result) { return static_cast<HRESULT>(Error::FileNotFound); }
         // Clients expect the stream's pointer to be at the start of the file!
         ComPtr<IStream> stream;
         ThrowHrIfFailed(result->GetStream(&stream));
@@ -647,4 +2029,4 @@ namespace MSIX {
         *payloadPackage = result.Detach();
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
-}
\ No newline at end of file
+}
\ No newline at end of file
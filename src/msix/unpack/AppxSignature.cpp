@@ -12,12 +12,19 @@
 #include "ComHelper.hpp"
 #include "SignatureValidator.hpp"
 #include "BlockMapStream.hpp"
+#include "SignatureCache.hpp"
+#include "StreamHelper.hpp"
+#include "Crypto.hpp"
+#include "Tracing.hpp"
 
 #include <string>
 #include <vector>
 #include <memory>
 #include <functional>
 #include <set>
+#include <array>
+#include <chrono>
+#include <cstring>
 
 namespace MSIX {
 
@@ -65,11 +72,67 @@ void AppxSignatureObject::ValidateDigestHeader(DigestHeader* header, std::size_t
     ThrowErrorIf(Error::SignatureInvalid, (digestsFound != 4 && digestsFound != 5), "Digest hashes missing entries");
 }
 
+// Version of the entries kept in a signature cache, change it when their layout changes.
+static const std::uint8_t SignatureCacheEntryVersion = 2;
+// Signatures bigger than this are rejected by the validator, don't buffer them.
+static const std::uint64_t SignatureCacheMaxSignatureSize = 2 << 20;
+
 AppxSignatureObject::AppxSignatureObject(IMsixFactory* factory, MSIX_VALIDATION_OPTION validationOptions, const ComPtr<IStream>& stream) : 
     m_stream(stream), 
-    m_validationOptions(validationOptions)
+    m_validationOptions(validationOptions),
+    m_performanceCounters(factory->GetPerformanceCounters()),
+    m_memoryBudget(factory->GetMemoryBudget())
 {
-    m_hasDigests = SignatureValidator::Validate(factory, validationOptions, stream, this, m_signatureOrigin, m_publisher);
+    auto& cache = factory->GetSignatureVerificationCache();
+    std::string key;
+    if (0 == (validationOptions & MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE) && cache.IsEnabled())
+    {
+        LARGE_INTEGER start = { 0 };
+        ULARGE_INTEGER end = { 0 };
+        ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::END, &end));
+        if (end.QuadPart <= SignatureCacheMaxSignatureSize)
+        {   // The result depends on the signature, the options and the roots it is checked against
+            auto signature = Helper::CreateBufferFromStream(stream);
+            std::uint32_t options = static_cast<std::uint32_t>(validationOptions);
+            auto customRoots = factory->GetTrustedCertificateCache().GetCustomRoots();
+            SHA256 hashEngine;
+            hashEngine.HashData(signature.data(), static_cast<std::uint32_t>(signature.size()));
+            hashEngine.HashData(reinterpret_cast<const std::uint8_t*>(&options), sizeof(options));
+            hashEngine.HashData(customRoots.data(), static_cast<std::uint32_t>(customRoots.size()));
+            Sha256Digest hash;
+            hashEngine.FinalizeAndGetHashValue(hash);
+            // Hexadecimal, so hosts can use it as a file name
+            const char* hexDigits = "0123456789abcdef";
+            for (auto byte : hash)
+            {
+                key.push_back(hexDigits[byte >> 4]);
+                key.push_back(hexDigits[byte & 0xf]);
+            }
+
+            // The key covers the signing certificate. The result is only reused while the certificate is still on the
+            // same side of its validity period as when it was validated, so one that expired since is validated again.
+            std::vector<std::uint8_t> entry;
+            if (cache.GetEntry(key, entry) && LoadVerification(entry) &&
+                (GetValidityPeriod(GetEpochTime()) == GetValidityPeriod(m_validatedAt)))
+            {
+                ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::START, nullptr));
+                return;
+            }
+            ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::START, nullptr));
+        }
+    }
+
+    {
+        Tracing::Activity activity(Tracing::Event::ValidateSignature);
+        m_hasDigests = SignatureValidator::Validate(factory, validationOptions, stream, this, m_signatureOrigin, m_publisher);
+        m_validatedAt = GetEpochTime();
+    }
+
+    if (!key.empty())
+    {
+        auto entry = SaveVerification();
+        cache.AddEntry(key, entry);
+    }
 
     if (0 == (validationOptions & MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE))
     {   // reset the source stream back to the beginning after validating it.
@@ -78,23 +141,132 @@ AppxSignatureObject::AppxSignatureObject(IMsixFactory* factory, MSIX_VALIDATION_
     }
 }
 
+std::vector<std::uint8_t> AppxSignatureObject::SaveVerification()
+{
+    std::vector<std::uint8_t> entry;
+    auto append = [&entry](const void* data, std::size_t size)
+    {
+        auto bytes = static_cast<const std::uint8_t*>(data);
+        entry.insert(entry.end(), bytes, bytes + size);
+    };
+    std::uint8_t hasDigests = m_hasDigests ? 1 : 0;
+    std::uint32_t origin = static_cast<std::uint32_t>(m_signatureOrigin);
+    std::uint32_t publisherSize = static_cast<std::uint32_t>(m_publisher.size());
+    append(&SignatureCacheEntryVersion, sizeof(SignatureCacheEntryVersion));
+    append(&hasDigests, sizeof(hasDigests));
+    append(&origin, sizeof(origin));
+    append(&publisherSize, sizeof(publisherSize));
+    append(m_publisher.data(), m_publisher.size());
+    append(&m_notBefore, sizeof(m_notBefore));
+    append(&m_notAfter, sizeof(m_notAfter));
+    append(&m_validatedAt, sizeof(m_validatedAt));
+    for (auto digest : { &m_FileRecords, &m_CentralDirectory, &m_ContentTypes, &m_AppxBlockMap, &m_CodeIntegrity })
+    {
+        std::uint8_t digestSize = static_cast<std::uint8_t>(digest->size());
+        append(&digestSize, sizeof(digestSize));
+        append(digest->data(), digest->size());
+    }
+    return entry;
+}
+
+// An entry that doesn't read back exactly is ignored and the signature is validated again.
+bool AppxSignatureObject::LoadVerification(const std::vector<std::uint8_t>& entry)
+{
+    std::size_t position = 0;
+    auto read = [&entry, &position](void* data, std::size_t size)
+    {
+        if (entry.size() - position < size) { return false; }
+        if (size != 0) { std::memcpy(data, entry.data() + position, size); }
+        position += size;
+        return true;
+    };
+    std::uint8_t version = 0;
+    std::uint8_t hasDigests = 0;
+    std::uint32_t origin = 0;
+    std::uint32_t publisherSize = 0;
+    if (!read(&version, sizeof(version)) || (version != SignatureCacheEntryVersion) ||
+        !read(&hasDigests, sizeof(hasDigests)) || (hasDigests > 1) ||
+        !read(&origin, sizeof(origin)) || (origin > static_cast<std::uint32_t>(SignatureOrigin::Unsigned)) ||
+        !read(&publisherSize, sizeof(publisherSize)) || (entry.size() - position < publisherSize))
+    {
+        return false;
+    }
+    std::string publisher(reinterpret_cast<const char*>(entry.data() + position), publisherSize);
+    position += publisherSize;
+    std::uint64_t notBefore = 0;
+    std::uint64_t notAfter = 0;
+    std::uint64_t validatedAt = 0;
+    if (!read(&notBefore, sizeof(notBefore)) || !read(&notAfter, sizeof(notAfter)) || (notBefore > notAfter) ||
+        !read(&validatedAt, sizeof(validatedAt)))
+    {
+        return false;
+    }
+    std::array<Digest, 5> digests;
+    for (auto& digest : digests)
+    {
+        std::uint8_t digestSize = 0;
+        if (!read(&digestSize, sizeof(digestSize)) || (digestSize != 0 && digestSize != HASH_BYTES)) { return false; }
+        digest.resize(digestSize);
+        if (!read(digest.data(), digestSize)) { return false; }
+    }
+    if (position != entry.size()) { return false; }
+
+    m_hasDigests = (hasDigests == 1);
+    m_signatureOrigin = static_cast<SignatureOrigin>(origin);
+    m_publisher = std::move(publisher);
+    m_notBefore = notBefore;
+    m_notAfter = notAfter;
+    m_validatedAt = validatedAt;
+    m_FileRecords = std::move(digests[0]);
+    m_CentralDirectory = std::move(digests[1]);
+    m_ContentTypes = std::move(digests[2]);
+    m_AppxBlockMap = std::move(digests[3]);
+    m_CodeIntegrity = std::move(digests[4]);
+    return true;
+}
+
+std::uint64_t AppxSignatureObject::GetEpochTime()
+{
+    auto now = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    return (now < 0) ? 0 : static_cast<std::uint64_t>(now);
+}
+
+// 0 before the signing certificate is valid, 1 while it is and 2 once it expired
+int AppxSignatureObject::GetValidityPeriod(std::uint64_t time)
+{
+    if (time < m_notBefore) { return 0; }
+    return (time <= m_notAfter) ? 1 : 2;
+}
+
+// Footprint files up to this size are validated before any of their bytes are handed out. Larger ones,
+// typically the AppxBlockMap.xml of big packages, are validated as they are read to cap memory use, and so
+// are all of them when their cache doesn't fit in the memory budget of the factory.
+static const size_t FootprintCacheSize = 1024*1024;
+
 ComPtr<IStream>  AppxSignatureObject::GetValidationStream(const std::string& part, const ComPtr<IStream>& stream)
 {
     if (m_hasDigests)
     {
         if (part == std::string("AppxBlockMap.xml"))
         {   // This stream implementation will throw if the underlying stream does not match the digest
-            return ComPtr<IStream>::Make<HashStream>(stream, this->GetAppxBlockMapDigest());
+            return ComPtr<IStream>::Make<HashStream>(stream, this->GetAppxBlockMapDigest(), FootprintCacheSize, m_performanceCounters, m_memoryBudget);
         }
         else if (part == std::string("[Content_Types].xml"))
         {   // This stream implementation will throw if the underlying stream does not match the digest'
-            return ComPtr<IStream>::Make<HashStream>(stream, this->GetContentTypesDigest());
+            return ComPtr<IStream>::Make<HashStream>(stream, this->GetContentTypesDigest(), FootprintCacheSize, m_performanceCounters, m_memoryBudget);
         }
         else if (part == std::string("AppxMetadata/CodeIntegrity.cat"))
         {   // This stream implementation will throw if the underlying stream does not match the digest
-            return ComPtr<IStream>::Make<HashStream>(stream, this->GetCodeIntegrityDigest());
+            return ComPtr<IStream>::Make<HashStream>(stream, this->GetCodeIntegrityDigest(), FootprintCacheSize, m_performanceCounters, m_memoryBudget);
+        }
+        else if (part == std::string(SIGNATURE_CENTRAL_DIRECTORY_PART))
+        {   // The central directory as it was before the signature was added
+            return ComPtr<IStream>::Make<HashStream>(stream, this->GetCentralDirectoryDigest(), FootprintCacheSize, m_performanceCounters, m_memoryBudget);
+        }
+        else if (part == std::string(SIGNATURE_FILE_RECORDS_PART))
+        {   // Everything stored before the signature, always hashed as it is read
+            return ComPtr<IStream>::Make<HashStream>(stream, this->GetFileRecordsDigest(), 0, m_performanceCounters);
         }
-        // TODO: unnamed stream for central directory?
     }
     return stream;
 }
@@ -0,0 +1,46 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "BlockCache.hpp"
+
+namespace MSIX {
+
+    BlockCache::BlockCache(std::uint64_t maxBytes) : m_maxShardBytes(maxBytes / ShardCount)
+    {
+    }
+
+    bool BlockCache::Find(const Sha256Digest& hash, std::uint32_t size, std::uint8_t* buffer)
+    {
+        auto& shard = GetShard(hash);
+        std::lock_guard<std::mutex> lock(shard.lock);
+        auto entry = shard.entries.find(hash);
+        if (entry == shard.entries.end() || entry->second.bytes.size() != size)
+        {
+            return false;
+        }
+        shard.uses.splice(shard.uses.begin(), shard.uses, entry->second.use);
+        std::memcpy(buffer, entry->second.bytes.data(), size);
+        return true;
+    }
+
+    void BlockCache::Add(const Sha256Digest& hash, const std::uint8_t* bytes, std::uint32_t size)
+    {
+        if (size > m_maxShardBytes) { return; }
+        auto& shard = GetShard(hash);
+        std::lock_guard<std::mutex> lock(shard.lock);
+        if (shard.entries.find(hash) != shard.entries.end()) { return; }
+        while (shard.bytes + size > m_maxShardBytes)
+        {
+            auto oldest = shard.entries.find(shard.uses.back());
+            shard.bytes -= oldest->second.bytes.size();
+            shard.entries.erase(oldest);
+            shard.uses.pop_back();
+        }
+        shard.uses.push_front(hash);
+        auto& entry = shard.entries[hash];
+        entry.bytes.assign(bytes, bytes + size);
+        entry.use = shard.uses.begin();
+        shard.bytes += size;
+    }
+}
@@ -0,0 +1,488 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "BlockMapParser.hpp"
+#include "Encoding.hpp"
+
+#include <cstring>
+#include <utility>
+
+namespace MSIX {
+
+    namespace {
+
+        struct Name
+        {
+            const char* begin = nullptr;
+            const char* end = nullptr;
+
+            std::size_t Size() const { return static_cast<std::size_t>(end - begin); }
+            bool Is(const char* value) const { return (std::strlen(value) == Size()) && (std::memcmp(begin, value, Size()) == 0); }
+            bool operator==(const Name& other) const { return (Size() == other.Size()) && (std::memcmp(begin, other.begin, Size()) == 0); }
+
+            // The parts before and after the colon, prefix is empty if there's none
+            Name Prefix() const
+            {
+                auto colon = static_cast<const char*>(std::memchr(begin, ':', Size()));
+                return (colon == nullptr) ? Name{ begin, begin } : Name{ begin, colon };
+            }
+            Name LocalName() const
+            {
+                auto colon = static_cast<const char*>(std::memchr(begin, ':', Size()));
+                return (colon == nullptr) ? *this : Name{ colon + 1, end };
+            }
+        };
+
+        bool IsWhitespace(char c) { return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r'); }
+        bool IsNameStart(char c) { return ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || (c == '_') || (c == ':'); }
+        bool IsNameChar(char c) { return IsNameStart(c) || ((c >= '0') && (c <= '9')) || (c == '-') || (c == '.'); }
+
+        bool IsXmlChar(std::uint32_t c)
+        {
+            return (c == 0x9) || (c == 0xA) || (c == 0xD) || ((c >= 0x20) && (c <= 0xD7FF)) ||
+                ((c >= 0xE000) && (c <= 0xFFFD)) || ((c >= 0x10000) && (c <= 0x10FFFF));
+        }
+
+        // Decodes the UTF-8 sequence at position and moves past it. Returns false for an invalid sequence or a
+        // character that can't be in an XML document.
+        bool NextChar(const char*& position, const char* end, std::uint32_t& c)
+        {
+            auto byte = static_cast<std::uint8_t>(*position);
+            std::size_t count = 0;
+            if (byte < 0x80)      { c = byte; count = 0; }
+            else if (byte < 0xC2) { return false; }
+            else if (byte < 0xE0) { c = byte & 0x1F; count = 1; }
+            else if (byte < 0xF0) { c = byte & 0x0F; count = 2; }
+            else if (byte < 0xF5) { c = byte & 0x07; count = 3; }
+            else                  { return false; }
+            if (static_cast<std::size_t>(end - position) <= count) { return false; }
+            for (std::size_t i = 1; i <= count; i++)
+            {
+                auto next = static_cast<std::uint8_t>(position[i]);
+                if ((next & 0xC0) != 0x80) { return false; }
+                c = (c << 6) | (next & 0x3F);
+            }
+            // Overlong encodings
+            if (((count == 2) && (c < 0x800)) || ((count == 3) && (c < 0x10000))) { return false; }
+            position += count + 1;
+            return IsXmlChar(c);
+        }
+
+        bool AppendUtf8(std::string& value, std::uint32_t c)
+        {
+            if (!IsXmlChar(c)) { return false; }
+            if (c < 0x80)
+            {
+                value.push_back(static_cast<char>(c));
+            }
+            else if (c < 0x800)
+            {
+                value.push_back(static_cast<char>(0xC0 | (c >> 6)));
+                value.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            }
+            else if (c < 0x10000)
+            {
+                value.push_back(static_cast<char>(0xE0 | (c >> 12)));
+                value.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+                value.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            }
+            else
+            {
+                value.push_back(static_cast<char>(0xF0 | (c >> 18)));
+                value.push_back(static_cast<char>(0x80 | ((c >> 12) & 0x3F)));
+                value.push_back(static_cast<char>(0x80 | ((c >> 6) & 0x3F)));
+                value.push_back(static_cast<char>(0x80 | (c & 0x3F)));
+            }
+            return true;
+        }
+
+        // Decimal digits only, what GetNumber would read the same way
+        bool ParseSize(const std::string& value, std::uint64_t& size)
+        {
+            if (value.empty() || (value.size() > 20)) { return false; }
+            size = 0;
+            for (auto c : value)
+            {
+                if ((c < '0') || (c > '9')) { return false; }
+                std::uint64_t digit = static_cast<std::uint64_t>(c - '0');
+                if (size > (std::numeric_limits<std::uint64_t>::max() - digit) / 10) { return false; }
+                size = size * 10 + digit;
+            }
+            return true;
+        }
+
+        class BlockMapScanner
+        {
+        public:
+            BlockMapScanner(const std::uint8_t* data, std::size_t size, BlockTable& table, std::vector<BlockMapParserFile>& files) :
+                m_position(reinterpret_cast<const char*>(data)),
+                m_end(reinterpret_cast<const char*>(data) + size),
+                m_table(table),
+                m_files(files)
+            {}
+
+            bool Parse()
+            {
+                if (StartsWith("\xEF\xBB\xBF")) { m_position += 3; }
+                if (StartsWith("<?xml") && (Remaining() > 5) && IsWhitespace(m_position[5]))
+                {
+                    if (!ParseXmlDeclaration()) { return false; }
+                }
+                if (!SkipMisc()) { return false; }
+                if (!StartsWith("<") || (Remaining() < 2) || !IsNameStart(m_position[1])) { return false; }
+                if (!ParseElements()) { return false; }
+                return SkipMisc() && (m_position == m_end);
+            }
+
+        private:
+            struct OpenElement
+            {
+                Name name;
+                bool isFile;
+            };
+
+            std::size_t Remaining() const { return static_cast<std::size_t>(m_end - m_position); }
+            bool StartsWith(const char* value) const
+            {
+                auto size = std::strlen(value);
+                return (Remaining() >= size) && (std::memcmp(m_position, value, size) == 0);
+            }
+
+            void SkipWhitespace()
+            {
+                while ((m_position < m_end) && IsWhitespace(*m_position)) { m_position++; }
+            }
+
+            bool ParseName(Name& name)
+            {
+                if ((m_position == m_end) || !IsNameStart(*m_position)) { return false; }
+                name.begin = m_position;
+                while ((m_position < m_end) && IsNameChar(*m_position)) { m_position++; }
+                name.end = m_position;
+                // Names with other characters are left to the DOM
+                if ((m_position < m_end) && (static_cast<std::uint8_t>(*m_position) >= 0x80)) { return false; }
+                // A qualified name has at most one colon, between a prefix and a local name
+                auto colon = static_cast<const char*>(std::memchr(name.begin, ':', name.Size()));
+                if (colon != nullptr)
+                {
+                    if ((colon == name.begin) || (colon + 1 == name.end) || (std::memchr(colon + 1, ':', name.end - colon - 1) != nullptr))
+                    {
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            // Skips to the end marker, checking the characters in between
+            bool SkipTo(const char* marker, bool allowDoubleDash)
+            {
+                auto size = std::strlen(marker);
+                while (m_position < m_end)
+                {
+                    if ((Remaining() >= size) && (std::memcmp(m_position, marker, size) == 0))
+                    {
+                        m_position += size;
+                        return true;
+                    }
+                    if (!allowDoubleDash && StartsWith("--")) { return false; }
+                    std::uint32_t c = 0;
+                    if (!NextChar(m_position, m_end, c)) { return false; }
+                }
+                return false;
+            }
+
+            bool SkipComment()
+            {
+                m_position += 4; // <!--
+                return SkipTo("-->", false);
+            }
+
+            bool SkipProcessingInstruction()
+            {
+                m_position += 2; // <?
+                Name target;
+                if (!ParseName(target)) { return false; }
+                if ((target.Size() == 3) && ((target.begin[0] | 0x20) == 'x') && ((target.begin[1] | 0x20) == 'm') && ((target.begin[2] | 0x20) == 'l'))
+                {
+                    return false;
+                }
+                if (StartsWith("?>")) { m_position += 2; return true; }
+                if ((m_position == m_end) || !IsWhitespace(*m_position)) { return false; }
+                return SkipTo("?>", true);
+            }
+
+            // Whitespace, comments and processing instructions
+            bool SkipMisc()
+            {
+                while (true)
+                {
+                    SkipWhitespace();
+                    if (StartsWith("<!--"))
+                    {
+                        if (!SkipComment()) { return false; }
+                    }
+                    else if (StartsWith("<?"))
+                    {
+                        if (!SkipProcessingInstruction()) { return false; }
+                    }
+                    else
+                    {
+                        return true;
+                    }
+                }
+            }
+
+            bool ParseXmlDeclaration()
+            {
+                m_position += 5; // <?xml
+                std::string encoding;
+                while (true)
+                {
+                    bool hadWhitespace = (m_position < m_end) && IsWhitespace(*m_position);
+                    SkipWhitespace();
+                    if (StartsWith("?>")) { m_position += 2; break; }
+                    Name name;
+                    std::string value;
+                    if (!hadWhitespace || !ParseName(name) || !ParseAttributeValue(value)) { return false; }
+                    if (name.Is("encoding"))
+                    {
+                        encoding = value;
+                    }
+                    else if (name.Is("version"))
+                    {
+                        if (value != "1.0") { return false; }
+                    }
+                    else if (!name.Is("standalone"))
+                    {
+                        return false;
+                    }
+                }
+                if (!encoding.empty())
+                {
+                    for (auto& c : encoding) { if ((c >= 'a') && (c <= 'z')) { c = static_cast<char>(c - 'a' + 'A'); } }
+                    if (encoding != "UTF-8") { return false; }
+                }
+                return true;
+            }
+
+            // = and the quoted value, with the references replaced
+            bool ParseAttributeValue(std::string& value)
+            {
+                SkipWhitespace();
+                if (!StartsWith("=")) { return false; }
+                m_position++;
+                SkipWhitespace();
+                if ((m_position == m_end) || ((*m_position != '"') && (*m_position != '\''))) { return false; }
+                char quote = *m_position++;
+                value.clear();
+                while (true)
+                {
+                    if (m_position == m_end) { return false; }
+                    char c = *m_position;
+                    if (c == quote)
+                    {
+                        m_position++;
+                        return true;
+                    }
+                    // Whitespace other than spaces is normalized by the XML parser, leave that to the DOM
+                    if ((c == '<') || (c == '\t') || (c == '\n') || (c == '\r')) { return false; }
+                    if (c == '&')
+                    {
+                        if (!ParseReference(value)) { return false; }
+                        continue;
+                    }
+                    auto start = m_position;
+                    std::uint32_t character = 0;
+                    if (!NextChar(m_position, m_end, character)) { return false; }
+                    value.append(start, m_position);
+                }
+            }
+
+            bool ParseReference(std::string& value)
+            {
+                auto semicolon = static_cast<const char*>(std::memchr(m_position, ';', std::min<std::size_t>(Remaining(), 12)));
+                if (semicolon == nullptr) { return false; }
+                Name reference = { m_position + 1, semicolon };
+                m_position = semicolon + 1;
+                if (reference.Is("amp"))  { value.push_back('&');  return true; }
+                if (reference.Is("lt"))   { value.push_back('<');  return true; }
+                if (reference.Is("gt"))   { value.push_back('>');  return true; }
+                if (reference.Is("quot")) { value.push_back('"');  return true; }
+                if (reference.Is("apos")) { value.push_back('\''); return true; }
+                if ((reference.Size() < 2) || (reference.begin[0] != '#')) { return false; }
+                bool isHex = (reference.begin[1] == 'x');
+                auto digit = reference.begin + (isHex ? 2 : 1);
+                if (digit == reference.end) { return false; }
+                std::uint32_t c = 0;
+                for (; digit < reference.end; digit++)
+                {
+                    std::uint32_t d = 0;
+                    if ((*digit >= '0') && (*digit <= '9'))                { d = static_cast<std::uint32_t>(*digit - '0'); }
+                    else if (isHex && (*digit >= 'a') && (*digit <= 'f')) { d = static_cast<std::uint32_t>(*digit - 'a' + 10); }
+                    else if (isHex && (*digit >= 'A') && (*digit <= 'F')) { d = static_cast<std::uint32_t>(*digit - 'A' + 10); }
+                    else { return false; }
+                    c = c * (isHex ? 16 : 10) + d;
+                    if (c > 0x10FFFF) { return false; }
+                }
+                return AppendUtf8(value, c);
+            }
+
+            bool IsPrefixDeclared(const Name& prefix) const
+            {
+                if (prefix.Size() == 0 || prefix.Is("xml")) { return true; }
+                for (const auto& declared : m_prefixes)
+                {
+                    if ((declared.first.size() == prefix.Size()) && (std::memcmp(declared.first.data(), prefix.begin, prefix.Size()) == 0))
+                    {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            // Parses a start tag, m_position is on its name. Sets isEmpty for an element without content.
+            bool ParseStartTag(const std::vector<OpenElement>& open, OpenElement& element, bool& isEmpty)
+            {
+                if (!ParseName(element.name)) { return false; }
+                auto depth = open.size();
+                auto local = element.name.LocalName();
+                bool isRoot = (depth == 0);
+                element.isFile = (depth == 1) && local.Is("File");
+                bool isBlock = (depth == 2) && open.back().isFile && local.Is("Block");
+                if (isRoot && !local.Is("BlockMap")) { return false; }
+
+                BlockMapParserFile file;
+                std::string hash;
+                std::string size;
+                bool hasHash = false;
+                m_attributes.clear();
+                while (true)
+                {
+                    bool hadWhitespace = (m_position < m_end) && IsWhitespace(*m_position);
+                    SkipWhitespace();
+                    if (StartsWith("/>")) { m_position += 2; isEmpty = true; break; }
+                    if (StartsWith(">"))  { m_position += 1; isEmpty = false; break; }
+                    Name name;
+                    if (!hadWhitespace || !ParseName(name) || !ParseAttributeValue(m_value)) { return false; }
+                    for (const auto& previous : m_attributes)
+                    {
+                        if (previous == name) { return false; }
+                    }
+                    m_attributes.push_back(name);
+
+                    auto prefix = name.Prefix();
+                    if (name.Is("xmlns"))
+                    {
+                        continue;
+                    }
+                    else if (prefix.Is("xmlns"))
+                    {
+                        auto declared = name.LocalName();
+                        if (m_value.empty() || declared.Is("xmlns")) { return false; }
+                        m_prefixes.emplace_back(std::string(declared.begin, declared.end), depth);
+                        continue;
+                    }
+                    else if (prefix.Size() != 0)
+                    {   // Qualified attributes aren't used by block maps
+                        return false;
+                    }
+
+                    if (element.isFile)
+                    {
+                        if (name.Is("Name"))         { file.name = m_value; }
+                        else if (name.Is("Size"))    { file.size = m_value; }
+                        else if (name.Is("LfhSize")) { file.lfhSize = m_value; }
+                    }
+                    else if (isBlock)
+                    {
+                        if (name.Is("Hash"))      { hash = m_value; hasHash = true; }
+                        else if (name.Is("Size")) { size = m_value; }
+                    }
+                }
+                if (!IsPrefixDeclared(element.name.Prefix()) || element.name.Prefix().Is("xmlns")) { return false; }
+
+                if (element.isFile)
+                {
+                    file.firstBlock = m_table.hashes.size();
+                    m_files.push_back(std::move(file));
+                }
+                else if (isBlock)
+                {
+                    Sha256Digest digest;
+                    std::uint64_t blockSize = BlockMapParserNoSize;
+                    if (!hasHash || !Encoding::DecodeBase64(hash.data(), hash.size(), digest.data(), digest.size())) { return false; }
+                    // An empty Size is the same as no Size
+                    if (!size.empty() && (!ParseSize(size, blockSize) || (blockSize == BlockMapParserNoSize))) { return false; }
+                    m_table.Add(digest, blockSize, blockSize);
+                    m_files.back().blockCount++;
+                }
+                return true;
+            }
+
+            bool ParseElements()
+            {
+                std::vector<OpenElement> open;
+                do
+                {
+                    // Content between tags is only whitespace in a block map
+                    SkipWhitespace();
+                    if (m_position == m_end) { return false; }
+                    if (*m_position != '<') { return false; }
+                    if (StartsWith("<!--"))
+                    {
+                        if (!SkipComment()) { return false; }
+                    }
+                    else if (StartsWith("<?"))
+                    {
+                        if (!SkipProcessingInstruction()) { return false; }
+                    }
+                    else if (StartsWith("</"))
+                    {
+                        m_position += 2;
+                        Name name;
+                        if (open.empty() || !ParseName(name) || !(name == open.back().name)) { return false; }
+                        SkipWhitespace();
+                        if (!StartsWith(">")) { return false; }
+                        m_position++;
+                        PopElement(open);
+                    }
+                    else
+                    {
+                        m_position++;
+                        OpenElement element;
+                        bool isEmpty = false;
+                        if (!ParseStartTag(open, element, isEmpty)) { return false; }
+                        open.push_back(element);
+                        if (isEmpty) { PopElement(open); }
+                    }
+                } while (!open.empty());
+                return true;
+            }
+
+            void PopElement(std::vector<OpenElement>& open)
+            {
+                open.pop_back();
+                while (!m_prefixes.empty() && (m_prefixes.back().second == open.size()))
+                {
+                    m_prefixes.pop_back();
+                }
+            }
+
+            const char* m_position;
+            const char* m_end;
+            BlockTable& m_table;
+            std::vector<BlockMapParserFile>& m_files;
+            // Namespace prefixes in scope and the depth of the element that declares them
+            std::vector<std::pair<std::string, std::size_t>> m_prefixes;
+            std::vector<Name> m_attributes;
+            std::string m_value;
+        };
+    }
+
+    bool ParseBlockMap(const std::uint8_t* data, std::size_t size, BlockTable& table, std::vector<BlockMapParserFile>& files)
+    {
+        BlockMapScanner scanner(data, size, table, files);
+        return scanner.Parse();
+    }
+}
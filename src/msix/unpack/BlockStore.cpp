@@ -0,0 +1,60 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "BlockStore.hpp"
+#include "BlockMapStream.hpp"
+#include "Crypto.hpp"
+
+#include <cstdio>
+
+namespace MSIX {
+
+    BlockStore::BlockStore(const std::string& root) :
+        m_root(ComPtr<IDirectoryObject>::Make<DirectoryObject>(root, true))
+    {}
+
+    std::string BlockStore::GetKey(std::uint64_t size, const FileBlocks& blocks)
+    {
+        SHA256 engine;
+        std::uint8_t sizeBytes[sizeof(size)];
+        for (std::size_t i = 0; i < sizeof(size); i++)
+        {
+            sizeBytes[i] = static_cast<std::uint8_t>(size >> (i * 8));
+        }
+        engine.HashData(sizeBytes, sizeof(sizeBytes));
+        for (std::size_t index = 0; index < blocks.size(); index++)
+        {
+            const auto& hash = blocks.Hash(index);
+            engine.HashData(hash.data(), static_cast<std::uint32_t>(hash.size()));
+        }
+        Sha256Digest digest;
+        engine.FinalizeAndGetHashValue(digest);
+
+        const char* hexDigits = "0123456789abcdef";
+        std::string key;
+        key.reserve(digest.size() * 2);
+        for (auto byte : digest)
+        {
+            key.push_back(hexDigits[byte >> 4]);
+            key.push_back(hexDigits[byte & 0xF]);
+        }
+        return key;
+    }
+
+    bool BlockStore::Materialize(const std::string& key, IDirectoryObject* to, const std::string& targetName)
+    {
+        return to->LinkFile(targetName, m_root->GetFilePath(GetStoreName(key)));
+    }
+
+    void BlockStore::Drop(const std::string& key, IDirectoryObject* to, const std::string& targetName)
+    {
+        std::remove(to->GetFilePath(targetName).c_str());
+        std::remove(m_root->GetFilePath(GetStoreName(key)).c_str());
+    }
+
+    void BlockStore::Add(const std::string& key, IDirectoryObject* to, const std::string& targetName)
+    {
+        m_root->LinkFile(GetStoreName(key), to->GetFilePath(targetName));
+    }
+}
@@ -0,0 +1,208 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "FileBlockReader.hpp"
+#include "ICompressionObject.hpp"
+#include "Crypto.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+namespace MSIX {
+
+    FileBlockReader::FileBlockReader(std::function<ComPtr<IStream>()> openRawStream, std::uint64_t size, const FileBlocks& blocks,
+        const std::shared_ptr<PerformanceCounters>& performanceCounters, const std::shared_ptr<BlockCache>& blockCache) :
+        m_openRawStream(std::move(openRawStream)), m_size(size), m_blocks(blocks), m_performanceCounters(performanceCounters),
+        m_blockCache(blockCache)
+    {
+        m_blockCount = static_cast<std::size_t>((m_size + BLOCKMAP_BLOCK_SIZE - 1) / BLOCKMAP_BLOCK_SIZE);
+    }
+
+    std::uint32_t FileBlockReader::GetBlockSize(std::size_t index) const
+    {
+        ThrowErrorIf(Error::InvalidParameter, (index >= m_blockCount), "block out of range");
+        return static_cast<std::uint32_t>(std::min(BLOCKMAP_BLOCK_SIZE, m_size - index * BLOCKMAP_BLOCK_SIZE));
+    }
+
+    // The blocks a range covers follow each other in the raw stream, so the ones that aren't in the block cache are
+    // read at once. Blocks that are all in the range are inflated straight into buffer, the ones at its ends go
+    // through a buffer of their own.
+    std::uint32_t FileBlockReader::ReadRange(std::uint64_t offset, std::uint32_t count, std::uint8_t* buffer)
+    {
+        ThrowErrorIf(Error::InvalidParameter, (buffer == nullptr && count != 0), "bad pointer");
+        if (offset >= m_size || count == 0) { return 0; }
+        count = static_cast<std::uint32_t>(std::min(static_cast<std::uint64_t>(count), m_size - offset));
+        std::call_once(m_opened, [this]() { Open(); });
+
+        std::size_t first = static_cast<std::size_t>(offset / BLOCKMAP_BLOCK_SIZE);
+        std::size_t last = static_cast<std::size_t>((offset + count - 1) / BLOCKMAP_BLOCK_SIZE);
+        std::size_t blockCount = last - first + 1;
+        // Only the first and the last block can be partly in the range
+        std::vector<std::vector<std::uint8_t>> ends;
+        ends.reserve(2);
+        std::vector<std::uint8_t*> targets(blockCount, nullptr);
+        auto target = [&](std::size_t block) -> std::uint8_t*
+        {
+            auto& result = targets[block - first];
+            if (result == nullptr)
+            {
+                std::uint64_t blockOffset = block * BLOCKMAP_BLOCK_SIZE;
+                std::uint32_t blockSize = GetBlockSize(block);
+                if (blockOffset >= offset && blockOffset + blockSize <= offset + count)
+                {
+                    result = buffer + (blockOffset - offset);
+                }
+                else
+                {
+                    ends.emplace_back(blockSize);
+                    result = ends.back().data();
+                }
+            }
+            return result;
+        };
+
+        std::vector<const std::uint8_t*> data(blockCount, nullptr);
+        std::vector<std::size_t> misses;
+        for (std::size_t block = first; block <= last; block++)
+        {
+            if (m_blockCache && FindCached(block, target(block)))
+            {
+                data[block - first] = target(block);
+            }
+            else
+            {
+                misses.push_back(block);
+            }
+        }
+
+        if (!misses.empty())
+        {
+            std::uint64_t rawOffset = m_offsets[misses.front()];
+            std::vector<std::uint8_t> raw(static_cast<std::size_t>(m_offsets[misses.back() + 1] - rawOffset));
+            ReadRaw(rawOffset, static_cast<std::uint32_t>(raw.size()), raw.data());
+
+            std::vector<HashRequest> requests(misses.size());
+            std::vector<Sha256Digest> hashes(misses.size());
+            std::uint64_t hashed = 0;
+            for (std::size_t miss = 0; miss < misses.size(); miss++)
+            {
+                std::size_t block = misses[miss];
+                std::uint32_t blockSize = GetBlockSize(block);
+                const std::uint8_t* bytes = raw.data() + (m_offsets[block] - rawOffset);
+                if (m_isCompressed)
+                {
+                    Inflate(bytes, m_offsets[block + 1] - m_offsets[block], target(block), blockSize);
+                    bytes = target(block);
+                }
+                data[block - first] = bytes;
+                requests[miss] = { bytes, blockSize, &hashes[miss] };
+                hashed += blockSize;
+            }
+
+            {
+                PerformanceCounters::Measure measure(m_performanceCounters.get(), MSIX_PERFORMANCE_COUNTER_STAGE_HASH);
+                SHA256::ComputeHashes(requests.data(), requests.size());
+                measure.SetBytes(hashed);
+            }
+            for (std::size_t miss = 0; miss < misses.size(); miss++)
+            {
+                std::size_t block = misses[miss];
+                ThrowErrorIfNot(Error::SignatureInvalid, (m_blocks.Hash(block) == hashes[miss]), "Signature hash doesn't match digest hash");
+                if (m_blockCache)
+                {
+                    m_blockCache->Add(hashes[miss], data[block - first], GetBlockSize(block));
+                }
+            }
+        }
+
+        // Copy what isn't in buffer yet
+        for (std::size_t block = first; block <= last; block++)
+        {
+            std::uint64_t blockOffset = block * BLOCKMAP_BLOCK_SIZE;
+            std::uint64_t start = std::max(blockOffset, offset);
+            std::uint64_t end = std::min(blockOffset + GetBlockSize(block), offset + count);
+            std::uint8_t* destination = buffer + (start - offset);
+            const std::uint8_t* source = data[block - first] + (start - blockOffset);
+            if (destination != source)
+            {
+                std::memcpy(destination, source, static_cast<std::size_t>(end - start));
+            }
+        }
+        return count;
+    }
+
+    void FileBlockReader::Open()
+    {
+        ThrowErrorIf(Error::BlockMapSemanticError, (m_blockCount != m_blocks.size()), "blocks don't describe the file");
+        m_rawStream = m_openRawStream();
+        ThrowErrorIfNot(Error::FileNotFound, m_rawStream, "the file isn't in the package");
+        auto streamInternal = m_rawStream.As<IStreamInternal>();
+        m_isCompressed = streamInternal->IsCompressed();
+        if (streamInternal->SupportsReadAt())
+        {
+            m_positionalStream = std::move(streamInternal);
+        }
+
+        m_offsets.reserve(m_blockCount + 1);
+        std::uint64_t offset = 0;
+        for (std::size_t block = 0; block < m_blockCount; block++)
+        {
+            m_offsets.push_back(offset);
+            offset += m_isCompressed ? m_blocks.CompressedSize(block) : GetBlockSize(block);
+        }
+        m_offsets.push_back(offset);
+
+        ULARGE_INTEGER end = { 0 };
+        ThrowHrIfFailed(m_rawStream->Seek({ 0 }, StreamBase::Reference::END, &end));
+        ThrowErrorIf(Error::BlockMapSemanticError, (offset > end.QuadPart), "blocks don't describe the file");
+    }
+
+    void FileBlockReader::ReadRaw(std::uint64_t offset, std::uint32_t count, std::uint8_t* buffer)
+    {
+        ULONG read = 0;
+        if (m_positionalStream)
+        {
+            read = m_positionalStream->ReadAt(offset, buffer, count);
+        }
+        else
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            LARGE_INTEGER position = { 0 };
+            position.QuadPart = static_cast<LONGLONG>(offset);
+            ThrowHrIfFailed(m_rawStream->Seek(position, StreamBase::Reference::START, nullptr));
+            ThrowHrIfFailed(m_rawStream->Read(buffer, count, &read));
+        }
+        ThrowErrorIf(Error::FileRead, (read != count), "Did not read as much as requested.");
+    }
+
+    bool FileBlockReader::FindCached(std::size_t index, std::uint8_t* buffer)
+    {
+        std::uint32_t size = GetBlockSize(index);
+        if (!m_performanceCounters)
+        {
+            return m_blockCache->Find(m_blocks.Hash(index), size, buffer);
+        }
+        auto start = std::chrono::steady_clock::now();
+        bool found = m_blockCache->Find(m_blocks.Hash(index), size, buffer);
+        m_performanceCounters->Add(found ? MSIX_PERFORMANCE_COUNTER_STAGE_BLOCKCACHE_HIT : MSIX_PERFORMANCE_COUNTER_STAGE_BLOCKCACHE_MISS,
+            size, std::chrono::steady_clock::now() - start);
+        return found;
+    }
+
+    void FileBlockReader::Inflate(const std::uint8_t* compressed, std::uint64_t compressedSize, std::uint8_t* buffer, std::uint32_t size)
+    {
+        PerformanceCounters::Measure measure(m_performanceCounters.get(), MSIX_PERFORMANCE_COUNTER_STAGE_INFLATE);
+        auto inflater = CreateCompressionObject();
+        ThrowErrorIfNot(Error::InflateInitialize, (inflater->Initialize(CompressionOperation::Inflate) == CompressionStatus::Ok), "compression_stream_init failed");
+        inflater->SetInput(const_cast<std::uint8_t*>(compressed), static_cast<std::size_t>(compressedSize));
+        inflater->SetOutput(buffer, size);
+        auto status = inflater->Inflate();
+        std::size_t inflated = size - inflater->GetAvailableDestinationSize();
+        inflater->Cleanup();
+        ThrowErrorIf(Error::InflateCorruptData, (status == CompressionStatus::Error || status == CompressionStatus::NeedDictionary ||
+            inflated != size), "inflate failed unexpectedly.");
+        measure.SetBytes(inflated);
+    }
+}
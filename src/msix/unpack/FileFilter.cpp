@@ -0,0 +1,91 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "FileFilter.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+namespace MSIX {
+
+    namespace
+    {
+        bool SameCharacter(char left, char right)
+        {
+            return std::tolower(static_cast<unsigned char>(left)) == std::tolower(static_cast<unsigned char>(right));
+        }
+
+        bool MatchFrom(const char* pattern, const char* patternEnd, const char* name, const char* nameEnd)
+        {
+            while (pattern != patternEnd)
+            {
+                if (*pattern == '*')
+                {
+                    bool anyDirectory = ((pattern + 1) != patternEnd) && (pattern[1] == '*');
+                    if (anyDirectory)
+                    {
+                        pattern += 2;
+                        // "**/" continues at the start of any directory, including the current one
+                        bool atDirectory = (pattern != patternEnd) && (*pattern == '/');
+                        if (atDirectory) { pattern++; }
+                        for (auto next = name; ; next++)
+                        {
+                            if ((!atDirectory || next == name || next[-1] == '/') && MatchFrom(pattern, patternEnd, next, nameEnd))
+                            {
+                                return true;
+                            }
+                            if (next == nameEnd) { return false; }
+                        }
+                    }
+                    pattern++;
+                    for (auto next = name; ; next++)
+                    {
+                        if (MatchFrom(pattern, patternEnd, next, nameEnd)) { return true; }
+                        if ((next == nameEnd) || (*next == '/')) { return false; }
+                    }
+                }
+                if (name == nameEnd) { return false; }
+                if (*pattern == '?')
+                {
+                    if (*name == '/') { return false; }
+                }
+                else if (!SameCharacter(*pattern, *name))
+                {
+                    return false;
+                }
+                pattern++;
+                name++;
+            }
+            return name == nameEnd;
+        }
+    }
+
+    bool FileFilter::Matches(const std::string& pattern, const std::string& fileName)
+    {
+        const char* name = fileName.data();
+        if (pattern.find('/') == std::string::npos)
+        {
+            auto lastSlash = fileName.find_last_of('/');
+            if (lastSlash != std::string::npos) { name += lastSlash + 1; }
+        }
+        return MatchFrom(pattern.data(), pattern.data() + pattern.size(), name, fileName.data() + fileName.size());
+    }
+
+    bool FileFilter::IsSelected(const std::string& fileName) const
+    {
+        auto matches = [&fileName](const std::string& pattern) { return Matches(pattern, fileName); };
+        if (!m_includes.empty() && std::none_of(m_includes.begin(), m_includes.end(), matches))
+        {
+            return false;
+        }
+        return std::none_of(m_excludes.begin(), m_excludes.end(), matches);
+    }
+
+    std::string FileFilter::Normalize(const std::string& pattern)
+    {
+        std::string result = pattern;
+        std::replace(result.begin(), result.end(), '\\', '/');
+        return result;
+    }
+}
@@ -6,19 +6,24 @@
 #include "ZipFileStream.hpp"
 #include "InflateStream.hpp"
 #include "StreamBase.hpp"
+#include "BlockMapStream.hpp"
+#include "Crypto.hpp"
+#include "WorkerPool.hpp"
+#include "ProgressReporter.hpp"
+#include "FileStatistics.hpp"
+#include "MappedFileStream.hpp"
 
 #include <cassert>
 #include <algorithm>
 #include <cstring>
 #include <array>
+#include <atomic>
 #include <utility>
+#include <limits>
+#include <memory>
 
 namespace MSIX {
 
-    // Buffer size used for compressed buffer and inflate window.
-    // See zlib's updatewindow comment.
-    static const size_t BufferSize = 32*1024;
-
     struct InflateHandler
     {
         typedef std::pair<bool, InflateStream::State>(*lambda)(InflateStream* self, void* buffer, ULONG countBytes);
@@ -31,9 +36,24 @@ namespace MSIX {
         // State::UNINITIALIZED
         InflateHandler([](InflateStream* self, void*, ULONG)
         {
-            ThrowHrIfFailed(self->m_stream->Seek({0}, StreamBase::START, nullptr));
-            self->m_fileCurrentPosition = 0;
-            self->m_fileCurrentWindowPositionEnd = 0;
+            if (self->m_seekPosition < self->m_restartPosition)
+            {
+                self->m_restartPosition = 0;
+                self->m_restartOffset = 0;
+            }
+            LARGE_INTEGER start = { 0 };
+            start.QuadPart = static_cast<LONGLONG>(self->m_restartOffset);
+            ThrowHrIfFailed(self->m_stream->Seek(start, StreamBase::START, nullptr));
+            self->m_fileCurrentPosition = self->m_restartPosition;
+            self->m_fileCurrentWindowPositionEnd = self->m_restartPosition;
+            self->m_inflateWindowPosition = 0;
+            self->m_inflateWindowSize = 0;
+
+            if (self->m_inflateWindow.empty())
+            {
+                self->m_compressedBuffer = PooledBuffer::Allocate(self->m_bufferPool, self->m_bufferSize);
+                self->m_inflateWindow = PooledBuffer::Allocate(self->m_bufferPool, self->m_bufferSize);
+            }
 
             self->m_compressionStatus = self->m_compressionObject->Initialize(CompressionOperation::Inflate);
             ThrowErrorIfNot(Error::InflateInitialize, (self->m_compressionStatus == CompressionStatus::Ok), "compression_stream_init failed");
@@ -45,20 +65,35 @@ namespace MSIX {
         {
             ThrowErrorIfNot(Error::InflateRead,(self->m_compressionObject->GetAvailableSourceSize() == 0), "uninflated bytes overwritten");
             ULONG available = 0;
-            self->m_compressedBuffer = std::make_unique<std::vector<std::uint8_t>>(BufferSize);
-            ThrowHrIfFailed(self->m_stream->Read(self->m_compressedBuffer->data(), static_cast<ULONG>(self->m_compressedBuffer->size()), &available));
+            ThrowHrIfFailed(self->m_stream->Read(self->m_compressedBuffer.data(), static_cast<ULONG>(self->m_compressedBuffer.size()), &available));
             ThrowErrorIf(Error::FileRead, (available == 0), "Getting nothing back is unexpected here.");
-            self->m_compressionObject->SetInput(self->m_compressedBuffer->data(), static_cast<size_t>(available));
+            self->m_compressionObject->SetInput(self->m_compressedBuffer.data(), static_cast<size_t>(available));
             return std::make_pair(true, InflateStream::State::READY_TO_INFLATE);
         }), // State::READY_TO_READ
 
         // State::READY_TO_INFLATE
-        InflateHandler([](InflateStream* self, void*, ULONG)
+        InflateHandler([](InflateStream* self, void* buffer, ULONG countBytes)
         {
-            self->m_inflateWindow = std::make_unique<std::vector<std::uint8_t>>(BufferSize);
+            // If the caller wants the bytes right at the end of what we've inflated so far and can hold
+            // at least a full window, inflate straight into its buffer and skip the copy out of the window.
+            bool direct = (countBytes >= self->m_bufferSize) && (self->m_seekPosition == self->m_fileCurrentWindowPositionEnd);
+            std::size_t outputSize = self->m_bufferSize;
             self->m_inflateWindowPosition = 0;
-            self->m_compressionObject->SetOutput(self->m_inflateWindow->data(), self->m_inflateWindow->size());
-            self->m_compressionStatus = self->m_compressionObject->Inflate();
+            self->m_inflateWindowSize = 0;
+            if (direct)
+            {
+                outputSize = static_cast<std::size_t>(std::min(static_cast<ULONGLONG>(countBytes), self->m_uncompressedSize - self->m_fileCurrentWindowPositionEnd));
+                self->m_compressionObject->SetOutput(reinterpret_cast<std::uint8_t*>(buffer), outputSize);
+            }
+            else
+            {
+                self->m_compressionObject->SetOutput(self->m_inflateWindow.data(), self->m_inflateWindow.size());
+            }
+            {
+                PerformanceCounters::Measure measure(self->m_performanceCounters.get(), MSIX_PERFORMANCE_COUNTER_STAGE_INFLATE);
+                self->m_compressionStatus = self->m_compressionObject->Inflate();
+                measure.SetBytes(outputSize - self->m_compressionObject->GetAvailableDestinationSize());
+            }
             switch (self->m_compressionStatus)
             {
             case CompressionStatus::Error:
@@ -68,9 +103,22 @@ namespace MSIX {
             case CompressionStatus::Ok:
             case CompressionStatus::End:
             default:
-                self->m_fileCurrentWindowPositionEnd += (BufferSize - self->m_compressionObject->GetAvailableDestinationSize());
+            {
+                ULONG inflated = static_cast<ULONG>(outputSize - self->m_compressionObject->GetAvailableDestinationSize());
+                self->m_fileCurrentWindowPositionEnd += inflated;
+                if (direct)
+                {   // The window stays empty, the bytes already belong to the caller.
+                    self->m_bytesRead           += inflated;
+                    self->m_seekPosition        += inflated;
+                    self->m_fileCurrentPosition += inflated;
+                }
+                else
+                {
+                    self->m_inflateWindowSize = inflated;
+                }
                 return std::make_pair(true, InflateStream::State::READY_TO_COPY);
             }
+            }
         }), // State::READY_TO_INFLATE
 
         // State::READY_TO_COPY
@@ -97,7 +145,7 @@ namespace MSIX {
 
             // Calculate the difference between the beginning of the window and the seek position.
             // if there's nothing left in the window to copy, then we need to fetch another window.
-            ULONG bytesRemainingInWindow = static_cast<ULONG>((BufferSize - self->m_compressionObject->GetAvailableDestinationSize()) - self->m_inflateWindowPosition);
+            ULONG bytesRemainingInWindow = self->m_inflateWindowSize - self->m_inflateWindowPosition;
             if (bytesRemainingInWindow == 0)
             {
                 return std::make_pair(true, (self->m_compressionObject->GetAvailableDestinationSize() == 0) ? InflateStream::State::READY_TO_INFLATE : InflateStream::State::READY_TO_READ);
@@ -106,7 +154,7 @@ namespace MSIX {
             ULONG bytesToCopy = std::min(countBytes, bytesRemainingInWindow);
             if (bytesToCopy > 0)
             {
-                memcpy(buffer, &(self->m_inflateWindow->at(self->m_inflateWindowPosition)), bytesToCopy);
+                memcpy(buffer, self->m_inflateWindow.data() + self->m_inflateWindowPosition, bytesToCopy);
                 self->m_bytesRead             += bytesToCopy;
                 self->m_seekPosition          += bytesToCopy;
                 self->m_inflateWindowPosition += bytesToCopy;
@@ -132,11 +180,17 @@ namespace MSIX {
     };
 
     InflateStream::InflateStream(
-        const ComPtr<IStream>& stream, std::uint64_t uncompressedSize
+        const ComPtr<IStream>& stream, std::uint64_t uncompressedSize, std::size_t bufferSize, const std::shared_ptr<BufferPool>& bufferPool,
+        const std::shared_ptr<PerformanceCounters>& performanceCounters
     ) : m_stream(stream),
+        m_streamInternal(stream.As<IStreamInternal>()),
         m_state(State::UNINITIALIZED),
-        m_uncompressedSize(uncompressedSize)
+        m_uncompressedSize(uncompressedSize),
+        m_bufferSize(bufferSize),
+        m_bufferPool(bufferPool),
+        m_performanceCounters(performanceCounters)
     {
+        ThrowErrorIf(Error::InvalidParameter, (bufferSize == 0 || bufferSize > std::numeric_limits<ULONG>::max()), "invalid inflate buffer size");
         m_compressionObject = CreateCompressionObject();
     }
 
@@ -165,6 +219,24 @@ namespace MSIX {
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
 
+    // Without seek points the clone would have to inflate again everything before its position.
+    HRESULT InflateStream::Clone(IStream** stream) noexcept try
+    {
+        ThrowErrorIf(Error::InvalidParameter, (stream == nullptr || *stream != nullptr), "bad pointer");
+        ThrowErrorIf(Error::NotSupported, m_seekPoints.empty(), "stream without seek points can't be cloned");
+        ComPtr<IStream> source;
+        ThrowHrIfFailed(m_stream->Clone(&source));
+        auto clone = ComPtr<InflateStream>::Make<InflateStream>(source, m_uncompressedSize, m_bufferSize, m_bufferPool,
+            m_performanceCounters);
+        clone->m_seekPoints = m_seekPoints;
+        clone->m_seekPointInterval = m_seekPointInterval;
+        LARGE_INTEGER position = { 0 };
+        position.QuadPart = static_cast<LONGLONG>(m_seekPosition);
+        ThrowHrIfFailed(clone->Seek(position, Reference::START, nullptr));
+        *stream = clone.As<IStream>().Detach();
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
+
     HRESULT InflateStream::Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER *newPosition) noexcept try
     {
         LARGE_INTEGER seekPosition = { 0 };
@@ -190,11 +262,25 @@ namespace MSIX {
             // If the caller is trying to seek back to an earlier
             // point in the inflated stream, we will need to reset
             // zlib and start inflating from the beginning of the
-            // stream; otherwise, seeking forward is fine: We will
-            // catch up to the seek pointer during the ::Read operation.
-            if (m_seekPosition < m_fileCurrentPosition)
+            // stream, or from the closest seek point before the
+            // seek position if we have them; otherwise, seeking
+            // forward is fine: We will catch up to the seek pointer
+            // during the ::Read operation, unless a seek point lets
+            // us skip inflating the bytes in between.
+            std::uint64_t restartPosition = 0;
+            std::uint64_t restartOffset = 0;
+            if (!m_seekPoints.empty())
+            {
+                std::size_t block = static_cast<std::size_t>(std::min(m_seekPosition / m_seekPointInterval, static_cast<ULONGLONG>(m_seekPoints.size() - 1)));
+                restartPosition = block * m_seekPointInterval;
+                restartOffset = m_seekPoints[block];
+            }
+            if ((m_seekPosition < m_fileCurrentPosition) || (restartPosition > m_fileCurrentWindowPositionEnd))
             {
-                m_fileCurrentPosition = 0;
+                m_restartPosition = restartPosition;
+                m_restartOffset = restartOffset;
+                m_fileCurrentPosition = restartPosition;
+                m_fileCurrentWindowPositionEnd = restartPosition;
                 Cleanup();
             }
         }
@@ -202,6 +288,34 @@ namespace MSIX {
         return static_cast<HRESULT>(Error::OK);
     } CATCH_RETURN();
 
+    void InflateStream::SetSeekPoints(std::uint64_t uncompressedBlockSize, const std::vector<std::uint64_t>& compressedBlockSizes)
+    {
+        m_seekPoints.clear();
+        m_seekPointInterval = 0;
+        if (uncompressedBlockSize == 0 || compressedBlockSizes.empty() ||
+            compressedBlockSizes.size() != ((m_uncompressedSize + uncompressedBlockSize - 1) / uncompressedBlockSize))
+        {   // Doesn't describe this stream, keep inflating from the start.
+            return;
+        }
+
+        std::vector<std::uint64_t> seekPoints;
+        seekPoints.reserve(compressedBlockSizes.size());
+        std::uint64_t offset = 0;
+        for (auto size : compressedBlockSizes)
+        {
+            seekPoints.push_back(offset);
+            offset += size;
+        }
+        // The stream may end with a few bytes that aren't accounted for in any block (e.g. an empty final
+        // deflate block), but the blocks can't describe more data than the stream has.
+        if (offset > m_streamInternal->GetSize())
+        {
+            return;
+        }
+        m_seekPoints = std::move(seekPoints);
+        m_seekPointInterval = uncompressedBlockSize;
+    }
+
     void InflateStream::Cleanup()
     {
         if (m_state != State::UNINITIALIZED)
@@ -209,6 +323,179 @@ namespace MSIX {
             m_compressionObject->Cleanup();
             m_state = State::UNINITIALIZED;
         }
+        m_compressedBuffer = PooledBuffer();
+        m_inflateWindow = PooledBuffer();
+    }
+
+    bool InflateBlocksInParallel(const ComPtr<IStream>& stream, const FileBlocks& blocks, IStream* to, std::uint32_t threadCount, WorkerPool& pool,
+        ProgressReporter* progress, bool validateBlocks)
+    {
+        ThrowErrorIf(Error::InvalidParameter, (to == nullptr || threadCount == 0), "invalid parameter.");
+        ULARGE_INTEGER end = { 0 };
+        ThrowHrIfFailed(stream->Seek({0}, StreamBase::END, &end));
+        std::uint64_t fileSize = end.QuadPart;
+        std::size_t blockCount = static_cast<std::size_t>((fileSize + BLOCKMAP_BLOCK_SIZE - 1) / BLOCKMAP_BLOCK_SIZE);
+        ThrowErrorIf(Error::BlockMapSemanticError, (blockCount != blocks.size()), "blocks don't describe the file");
+
+        // The workers charge their stages to the file of the calling thread
+        auto statistics = FileStatistics::GetCurrent();
+        // Every worker gets its own clone, so all of them can inflate at the same time.
+        std::size_t workerCount = std::min(static_cast<std::size_t>(threadCount), blockCount);
+        std::vector<ComPtr<IStream>> clones(workerCount);
+        for (auto& clone : clones)
+        {
+            if (FAILED(stream->Clone(&clone))) { return false; }
+        }
+
+        // Decode a batch of a few consecutive blocks per worker, so each clone inflates a run of blocks
+        // without restarting, then write the batch before decoding the next one.
+        const std::size_t blocksPerWorker = 4;
+        std::vector<std::vector<std::uint8_t>> buffers(workerCount * blocksPerWorker);
+        for (std::size_t batch = 0; batch < blockCount; batch += buffers.size())
+        {
+            std::size_t batchEnd = std::min(batch + buffers.size(), blockCount);
+            auto decode = [&](std::size_t worker)
+            {
+                std::size_t first = batch + worker * blocksPerWorker;
+                std::size_t last = std::min(first + blocksPerWorker, batchEnd);
+                if (first >= last) { return; }
+                FileStatistics::Scope statisticsScope(statistics);
+                LARGE_INTEGER position = { 0 };
+                position.QuadPart = static_cast<LONGLONG>(first * BLOCKMAP_BLOCK_SIZE);
+                ThrowHrIfFailed(clones[worker]->Seek(position, StreamBase::START, nullptr));
+                HashRequest requests[blocksPerWorker];
+                Sha256Digest hashes[blocksPerWorker];
+                for (std::size_t block = first; block < last; block++)
+                {
+                    auto& buffer = buffers[block - batch];
+                    buffer.resize(static_cast<std::size_t>(std::min(BLOCKMAP_BLOCK_SIZE, fileSize - block * BLOCKMAP_BLOCK_SIZE)));
+                    ULONG bytesRead = 0;
+                    {   FileStatistics::Measure measure(FileStatistics::Stage::Read);
+                        ThrowHrIfFailed(clones[worker]->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &bytesRead));
+                    }
+                    ThrowErrorIfNot(Error::SignatureInvalid, (bytesRead == buffer.size()), "read failed");
+                    requests[block - first] = { buffer.data(), static_cast<std::uint32_t>(buffer.size()), &hashes[block - first] };
+                }
+                if (!validateBlocks) { return; }
+
+                // The blocks of the run are hashed together
+                {   FileStatistics::Measure measure(FileStatistics::Stage::Hash);
+                    SHA256::ComputeHashes(requests, last - first);
+                }
+                for (std::size_t block = first; block < last; block++)
+                {
+                    ThrowErrorIfNot(Error::SignatureInvalid, (blocks.Hash(block) == hashes[block - first]),
+                        "Signature hash doesn't match digest hash");
+                }
+            };
+
+            pool.ForEach(workerCount, workerCount, decode);
+
+            for (std::size_t block = batch; block < batchEnd; block++)
+            {
+                const auto& buffer = buffers[block - batch];
+                FileStatistics::Measure measure(FileStatistics::Stage::Write);
+                ULONG offset = 0;
+                while (offset < buffer.size())
+                {
+                    ULONG written = 0;
+                    ThrowHrIfFailed(to->Write(buffer.data() + offset, static_cast<ULONG>(buffer.size() - offset), &written));
+                    ThrowErrorIf(Error::FileWrite, (written == 0), "write failed");
+                    offset += written;
+                }
+                if (progress) { progress->Advance(buffer.size()); }
+            }
+        }
+        return true;
+    }
+
+    bool InflateBlocksToMappedFile(const ComPtr<IStream>& stream, const FileBlocks& blocks, MappedOutputFile& file, std::uint32_t threadCount,
+        WorkerPool& pool, ProgressReporter* progress, bool validateBlocks)
+    {
+        ThrowErrorIf(Error::InvalidParameter, (threadCount == 0), "invalid parameter.");
+        ULARGE_INTEGER end = { 0 };
+        ThrowHrIfFailed(stream->Seek({0}, StreamBase::END, &end));
+        std::uint64_t fileSize = end.QuadPart;
+        ThrowErrorIf(Error::InvalidParameter, (fileSize != file.GetSize()), "the file doesn't have the size of the stream");
+        std::size_t blockCount = static_cast<std::size_t>((fileSize + BLOCKMAP_BLOCK_SIZE - 1) / BLOCKMAP_BLOCK_SIZE);
+        ThrowErrorIf(Error::BlockMapSemanticError, (blockCount != blocks.size()), "blocks don't describe the file");
+
+        // A few consecutive blocks per run, so a clone inflates them without restarting
+        const std::size_t blocksPerRun = 4;
+        std::size_t runCount = (blockCount + blocksPerRun - 1) / blocksPerRun;
+        auto statistics = FileStatistics::GetCurrent();
+        std::size_t workerCount = std::min(static_cast<std::size_t>(threadCount), runCount);
+        std::vector<ComPtr<IStream>> clones(workerCount);
+        for (auto& clone : clones)
+        {
+            if (FAILED(stream->Clone(&clone))) { return false; }
+        }
+
+        // The runs of each part of the file that are still to be done, the worker that does the last one of a part
+        // starts its writeback
+        const std::size_t runsPerPart = static_cast<std::size_t>(MappedOutputWritebackSize / (BLOCKMAP_BLOCK_SIZE * blocksPerRun));
+        std::size_t partCount = (runCount + runsPerPart - 1) / runsPerPart;
+        std::unique_ptr<std::atomic<std::size_t>[]> remainingRuns(new std::atomic<std::size_t>[partCount]);
+        for (std::size_t part = 0; part < partCount; part++)
+        {
+            remainingRuns[part] = std::min(runsPerPart, runCount - part * runsPerPart);
+        }
+
+        std::atomic<std::size_t> nextRun{ 0 };
+        pool.ForEach(workerCount, workerCount, [&](std::size_t worker)
+        {
+            FileStatistics::Scope statisticsScope(statistics);
+            for (auto run = nextRun++; run < runCount; run = nextRun++)
+            {
+                std::size_t first = run * blocksPerRun;
+                std::size_t last = std::min(first + blocksPerRun, blockCount);
+                std::uint64_t offset = first * BLOCKMAP_BLOCK_SIZE;
+                std::uint64_t size = std::min(last * BLOCKMAP_BLOCK_SIZE, fileSize) - offset;
+                LARGE_INTEGER position = { 0 };
+                position.QuadPart = static_cast<LONGLONG>(offset);
+                ThrowHrIfFailed(clones[worker]->Seek(position, StreamBase::START, nullptr));
+                std::uint64_t done = 0;
+                {   FileStatistics::Measure measure(FileStatistics::Stage::Read);
+                    while (done < size)
+                    {
+                        ULONG bytesRead = 0;
+                        ThrowHrIfFailed(clones[worker]->Read(file.GetData() + offset + done, static_cast<ULONG>(size - done), &bytesRead));
+                        if (bytesRead == 0) { break; }
+                        done += bytesRead;
+                    }
+                }
+                ThrowErrorIfNot(Error::SignatureInvalid, (done == size), "read failed");
+
+                if (validateBlocks)
+                {   // The blocks of the run are hashed together, where they are in the file
+                    HashRequest requests[blocksPerRun];
+                    Sha256Digest hashes[blocksPerRun];
+                    for (std::size_t block = first; block < last; block++)
+                    {
+                        auto blockSize = std::min(BLOCKMAP_BLOCK_SIZE, fileSize - block * BLOCKMAP_BLOCK_SIZE);
+                        requests[block - first] = { file.GetData() + block * BLOCKMAP_BLOCK_SIZE, static_cast<std::uint32_t>(blockSize), &hashes[block - first] };
+                    }
+                    {   FileStatistics::Measure measure(FileStatistics::Stage::Hash);
+                        SHA256::ComputeHashes(requests, last - first);
+                    }
+                    for (std::size_t block = first; block < last; block++)
+                    {
+                        ThrowErrorIfNot(Error::SignatureInvalid, (blocks.Hash(block) == hashes[block - first]),
+                            "Signature hash doesn't match digest hash");
+                    }
+                }
+
+                auto part = run / runsPerPart;
+                if (--remainingRuns[part] == 0)
+                {
+                    FileStatistics::Measure measure(FileStatistics::Stage::Write);
+                    std::uint64_t partOffset = part * runsPerPart * blocksPerRun * BLOCKMAP_BLOCK_SIZE;
+                    file.Flush(partOffset, std::min(partOffset + MappedOutputWritebackSize, fileSize) - partOffset);
+                }
+                if (progress) { progress->Advance(size); }
+            }
+        });
+        return true;
     }
 } /* msix */
 
@@ -0,0 +1,111 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "IntegrityCache.hpp"
+#include "Exceptions.hpp"
+#include "StreamHelper.hpp"
+#include "VectorStream.hpp"
+
+#include <cstring>
+
+namespace MSIX {
+
+    namespace {
+        // The version of the layout of the entries, change it when the layout changes
+        const std::uint8_t IntegrityCacheEntryVersion = 1;
+
+        // The names of the verified files, each one after its size
+        std::vector<std::uint8_t> SaveEntry(const std::set<std::string>& fileNames)
+        {
+            std::vector<std::uint8_t> entry;
+            entry.push_back(IntegrityCacheEntryVersion);
+            for (const auto& fileName : fileNames)
+            {
+                std::uint32_t size = static_cast<std::uint32_t>(fileName.size());
+                auto sizeBytes = reinterpret_cast<const std::uint8_t*>(&size);
+                entry.insert(entry.end(), sizeBytes, sizeBytes + sizeof(size));
+                entry.insert(entry.end(), fileName.begin(), fileName.end());
+            }
+            return entry;
+        }
+
+        bool LoadEntry(const std::vector<std::uint8_t>& entry, std::set<std::string>& fileNames)
+        {
+            if (entry.empty() || (entry[0] != IntegrityCacheEntryVersion)) { return false; }
+            std::set<std::string> result;
+            std::size_t position = 1;
+            while (position < entry.size())
+            {
+                std::uint32_t size = 0;
+                if (entry.size() - position < sizeof(size)) { return false; }
+                std::memcpy(&size, entry.data() + position, sizeof(size));
+                position += sizeof(size);
+                if (entry.size() - position < size) { return false; }
+                result.emplace(reinterpret_cast<const char*>(entry.data() + position), size);
+                position += size;
+            }
+            fileNames = std::move(result);
+            return true;
+        }
+    }
+
+    std::shared_ptr<IntegrityRecord> IntegrityRecord::Open(const ComPtr<IMsixIntegrityCache>& cache, const IdentityReader& readIdentity,
+        const Sha256Digest& blockMapHash)
+    {
+        if (!cache) { return nullptr; }
+        auto identity = readIdentity();
+        if (identity.empty()) { return nullptr; }
+
+        // In hexadecimal, so hosts can use it as a file name
+        SHA256 engine;
+        engine.HashData(reinterpret_cast<const std::uint8_t*>(identity.data()), static_cast<std::uint32_t>(identity.size()));
+        engine.HashData(blockMapHash.data(), static_cast<std::uint32_t>(blockMapHash.size()));
+        Sha256Digest hash;
+        engine.FinalizeAndGetHashValue(hash);
+        const char* hexDigits = "0123456789abcdef";
+        std::string key;
+        for (auto byte : hash)
+        {
+            key.push_back(hexDigits[byte >> 4]);
+            key.push_back(hexDigits[byte & 0xf]);
+        }
+        return std::make_shared<IntegrityRecord>(cache, readIdentity, identity, key);
+    }
+
+    IntegrityRecord::IntegrityRecord(const ComPtr<IMsixIntegrityCache>& cache, const IdentityReader& readIdentity, const std::string& identity,
+        const std::string& key) : m_cache(cache), m_readIdentity(readIdentity), m_identity(identity), m_key(key)
+    {
+        ComPtr<IStream> entry;
+        ThrowHrIfFailed(m_cache->GetEntry(m_key.c_str(), &entry));
+        if (entry)
+        {   // An entry that can't be read is replaced by the next files verified
+            LoadEntry(Helper::CreateBufferFromStream(entry), m_verified);
+        }
+    }
+
+    bool IntegrityRecord::IsVerified(const std::string& fileName)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (m_verified.find(fileName) == m_verified.end()) { return false; }
+        }
+        return IsUnchanged();
+    }
+
+    void IntegrityRecord::AddVerified(const std::vector<std::string>& fileNames)
+    {
+        std::vector<std::uint8_t> entry;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            std::size_t count = m_verified.size();
+            m_verified.insert(fileNames.begin(), fileNames.end());
+            if (m_verified.size() == count) { return; }
+            entry = SaveEntry(m_verified);
+        }
+        // The files could have been read after the package changed
+        if (!IsUnchanged()) { return; }
+        auto stream = ComPtr<IStream>::Make<VectorStream>(&entry);
+        ThrowHrIfFailed(m_cache->AddEntry(m_key.c_str(), stream.Get()));
+    }
+}
@@ -0,0 +1,27 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "OutputStreamDirectory.hpp"
+
+namespace MSIX {
+
+    ComPtr<IStream> OutputStreamDirectory::OpenFile(const std::string& fileName, FileStream::Mode mode, std::uint64_t expectedSize)
+    {
+        ThrowErrorIf(Error::NotSupported, (mode != FileStream::Mode::WRITE), "output streams can only be written");
+        ComPtr<IStream> stream;
+        auto relativePath = m_prefix + fileName;
+        ThrowHrIfFailed(m_factory->CreateOutputStream(relativePath.c_str(), expectedSize, &stream));
+        ThrowErrorIf(Error::FileOpen, (stream.Get() == nullptr), "the output stream factory didn't create a stream");
+        return stream;
+    }
+
+    void OutputStreamDirectory::WriteFileContent(const std::string& fileName, const void* data, std::size_t size)
+    {
+        auto stream = OpenFile(fileName, FileStream::Mode::WRITE, size);
+        ULONG written = 0;
+        ThrowHrIfFailed(stream->Write(data, static_cast<ULONG>(size), &written));
+        ThrowErrorIf(Error::FileWrite, (written != size), "write failed");
+        ThrowHrIfFailed(stream->Commit(STGC_DEFAULT));
+    }
+}
@@ -0,0 +1,284 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "PackageDelta.hpp"
+#include "AppxBlockMapObject.hpp"
+#include "AppxFactory.hpp"
+#include "Crypto.hpp"
+#include "Encoding.hpp"
+#include "Exceptions.hpp"
+#include "PackageLayout.hpp"
+#include "StreamHelper.hpp"
+#include "StringHelper.hpp"
+#include "ZipObjectReader.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace MSIX {
+
+    namespace {
+
+        const char* DeltaHeader = "msixdelta 1";
+        const std::size_t CopyBufferSize = 65536;
+
+        // A block of a payload file and where its stored bytes are in the package
+        struct PayloadBlock
+        {
+            std::size_t file;
+            std::size_t index;
+            Sha256Digest hash;
+            std::uint64_t offset;
+            std::uint64_t size;
+            bool isCompressed;
+        };
+
+        struct DeltaRecord
+        {
+            bool isCopy;
+            std::uint64_t offset;
+            std::uint64_t oldOffset;
+            std::uint64_t size;
+        };
+
+        std::string ToHex(const Sha256Digest& digest)
+        {
+            const char* hexDigits = "0123456789abcdef";
+            std::string result;
+            for (auto byte : digest)
+            {
+                result.push_back(hexDigits[byte >> 4]);
+                result.push_back(hexDigits[byte & 0x0f]);
+            }
+            return result;
+        }
+
+        void Read(IStream* stream, std::uint64_t offset, std::uint8_t* buffer, std::size_t size)
+        {
+            LARGE_INTEGER position = { 0 };
+            position.QuadPart = static_cast<LONGLONG>(offset);
+            ThrowHrIfFailed(stream->Seek(position, StreamBase::Reference::START, nullptr));
+            ULONG bytesRead = 0;
+            ThrowHrIfFailed(stream->Read(buffer, static_cast<ULONG>(size), &bytesRead));
+            ThrowErrorIf(Error::FileRead, (bytesRead != size), "Read past the end of the package");
+        }
+
+        void Write(IStream* stream, const std::uint8_t* buffer, std::size_t size)
+        {
+            ULONG bytesWritten = 0;
+            ThrowHrIfFailed(stream->Write(buffer, static_cast<ULONG>(size), &bytesWritten));
+            ThrowErrorIf(Error::FileWrite, (bytesWritten != size), "Write failed");
+        }
+
+        std::uint64_t GetSize(IStream* stream)
+        {
+            LARGE_INTEGER start = { 0 };
+            ULARGE_INTEGER end = { 0 };
+            ThrowHrIfFailed(stream->Seek(start, StreamBase::Reference::END, &end));
+            return end.QuadPart;
+        }
+
+        // The blocks of the files of the block map of package, ordered by where they are. The blocks of a file
+        // whose sizes don't add up to what is stored in the zip file are left out.
+        std::vector<PayloadBlock> GetPayloadBlocks(IMsixFactory* factory, IStream* package, std::vector<std::string>& fileNames)
+        {
+            auto zip = ComPtr<ZipObjectReader>::Make<ZipObjectReader>(ComPtr<IStream>(package));
+            auto blockMapStream = zip->GetFile(footprintFiles[APPX_FOOTPRINT_FILE_TYPE_BLOCKMAP]);
+            ThrowErrorIf(Error::MissingAppxBlockMapXML, !blockMapStream, "Package doesn't have a block map");
+            auto blockMap = ComPtr<IAppxBlockMapReader>::Make<AppxBlockMapObject>(factory, blockMapStream).As<IAppxBlockMapInternal>();
+            auto blockMapNames = blockMap->GetFileNames();
+            std::set<std::string> blockMapFiles(blockMapNames.begin(), blockMapNames.end());
+
+            std::vector<PayloadBlock> result;
+            for (const auto& zipName : zip->GetFileNames(FileNameOptions::All))
+            {
+                // The block map uses the windows separator and the zip file the encoded name
+                auto name = Helper::toBackSlash(Encoding::DecodeFileName(zipName));
+                if (blockMapFiles.find(name) == blockMapFiles.end()) { continue; }
+
+                auto records = zip->GetFileRecords(zipName);
+                UINT64 fileSize = 0;
+                ThrowHrIfFailed(blockMap->GetFile(name)->GetUncompressedSize(&fileSize));
+                auto blocks = blockMap->GetBlocks(name);
+                auto ranges = GetBlockRanges(records, fileSize, blocks);
+                for (std::size_t index = 0; index < ranges.size(); index++)
+                {
+                    result.push_back(PayloadBlock{ fileNames.size(), index, blocks.Hash(index), ranges[index].offset, ranges[index].size,
+                        records.isCompressed });
+                }
+                fileNames.push_back(name);
+            }
+            std::sort(result.begin(), result.end(), [](const PayloadBlock& a, const PayloadBlock& b) { return a.offset < b.offset; });
+            return result;
+        }
+
+        void AddRecord(std::vector<DeltaRecord>& records, const DeltaRecord& record)
+        {
+            if (record.size == 0) { return; }
+            if (!records.empty())
+            {
+                auto& last = records.back();
+                if ((last.isCopy == record.isCopy) && (last.offset + last.size == record.offset) &&
+                    (!record.isCopy || (last.oldOffset + last.size == record.oldOffset)))
+                {
+                    last.size += record.size;
+                    return;
+                }
+            }
+            records.push_back(record);
+        }
+    }
+
+    void DiffPackages(IMsixFactory* factory, IStream* oldPackage, IStream* newPackage, IStream* delta, IStream* ranges)
+    {
+        std::vector<std::string> oldFileNames;
+        auto oldBlocks = GetPayloadBlocks(factory, oldPackage, oldFileNames);
+        std::multimap<Sha256Digest, std::size_t> oldBlockIndex;
+        for (std::size_t i = 0; i < oldBlocks.size(); i++)
+        {
+            oldBlockIndex.emplace(oldBlocks[i].hash, i);
+        }
+
+        std::vector<std::string> newFileNames;
+        auto newBlocks = GetPayloadBlocks(factory, newPackage, newFileNames);
+        auto newSize = GetSize(newPackage);
+
+        // The same content deflated with other settings has other bytes, so the bytes of the blocks with the same
+        // hash are compared too
+        std::vector<DeltaRecord> records;
+        std::vector<const PayloadBlock*> changedBlocks;
+        std::vector<std::uint8_t> oldBytes;
+        std::vector<std::uint8_t> newBytes;
+        std::uint64_t position = 0;
+        for (const auto& block : newBlocks)
+        {
+            const PayloadBlock* found = nullptr;
+            auto candidates = oldBlockIndex.equal_range(block.hash);
+            for (auto candidate = candidates.first; (candidate != candidates.second) && (found == nullptr) && (block.offset >= position); candidate++)
+            {
+                const auto& oldBlock = oldBlocks[candidate->second];
+                if ((oldBlock.size != block.size) || (oldBlock.isCompressed != block.isCompressed)) { continue; }
+                newBytes.resize(static_cast<std::size_t>(block.size));
+                oldBytes.resize(static_cast<std::size_t>(block.size));
+                Read(newPackage, block.offset, newBytes.data(), newBytes.size());
+                Read(oldPackage, oldBlock.offset, oldBytes.data(), oldBytes.size());
+                if (newBytes == oldBytes) { found = &oldBlock; }
+            }
+            if (found == nullptr)
+            {
+                changedBlocks.push_back(&block);
+                continue;
+            }
+            AddRecord(records, DeltaRecord{ false, position, 0, block.offset - position });
+            AddRecord(records, DeltaRecord{ true, block.offset, found->offset, block.size });
+            position = block.offset + block.size;
+        }
+        AddRecord(records, DeltaRecord{ false, position, 0, newSize - position });
+
+        // The records cover the new package in order, so it is hashed as the ranges are written
+        SHA256 hasher;
+        std::vector<std::uint8_t> buffer(CopyBufferSize);
+        for (const auto& record : records)
+        {
+            for (std::uint64_t done = 0; done < record.size; )
+            {
+                auto count = static_cast<std::size_t>(std::min<std::uint64_t>(buffer.size(), record.size - done));
+                Read(newPackage, record.offset + done, buffer.data(), count);
+                hasher.HashData(buffer.data(), static_cast<std::uint32_t>(count));
+                if (!record.isCopy && (ranges != nullptr))
+                {
+                    Write(ranges, buffer.data(), count);
+                }
+                done += count;
+            }
+        }
+        Sha256Digest hash;
+        hasher.FinalizeAndGetHashValue(hash);
+
+        std::ostringstream text;
+        text << DeltaHeader << "\n";
+        text << "size " << newSize << "\n";
+        text << "sha256 " << ToHex(hash) << "\n";
+        for (const auto& record : records)
+        {
+            if (record.isCopy) { text << "copy " << record.offset << " " << record.oldOffset << " " << record.size << "\n"; }
+            else               { text << "fetch " << record.offset << " " << record.size << "\n"; }
+        }
+        for (const auto block : changedBlocks)
+        {
+            text << "changed " << block->index << " " << newFileNames[block->file] << "\n";
+        }
+        auto content = text.str();
+        Write(delta, reinterpret_cast<const std::uint8_t*>(content.data()), content.size());
+    }
+
+    void PatchPackage(IStream* oldPackage, IStream* delta, IStream* ranges, IStream* newPackage)
+    {
+        auto deltaBuffer = Helper::CreateBufferFromStream(ComPtr<IStream>(delta));
+        std::istringstream text(std::string(deltaBuffer.begin(), deltaBuffer.end()));
+
+        std::string line;
+        ThrowErrorIf(Error::BadFormat, !std::getline(text, line) || (line != DeltaHeader), "Not a package delta");
+        std::uint64_t size = 0;
+        std::string expectedHash;
+        std::vector<DeltaRecord> records;
+        std::uint64_t position = 0;
+        while (std::getline(text, line))
+        {
+            std::istringstream fields(line);
+            std::string type;
+            fields >> type;
+            if (type == "size") { fields >> size; }
+            else if (type == "sha256") { fields >> expectedHash; }
+            else if ((type == "copy") || (type == "fetch"))
+            {
+                DeltaRecord record{ type == "copy", 0, 0, 0 };
+                fields >> record.offset;
+                if (record.isCopy) { fields >> record.oldOffset; }
+                fields >> record.size;
+                ThrowErrorIf(Error::BadFormat, (record.offset != position), "The records of the delta aren't in order");
+                position += record.size;
+                records.push_back(record);
+            }
+            else if (type == "changed") { continue; }
+            ThrowErrorIf(Error::BadFormat, fields.fail(), "Invalid record in the delta");
+        }
+        ThrowErrorIf(Error::BadFormat, (position != size) || expectedHash.empty(), "The records of the delta don't cover the package");
+
+        SHA256 hasher;
+        std::vector<std::uint8_t> buffer(CopyBufferSize);
+        for (const auto& record : records)
+        {
+            for (std::uint64_t done = 0; done < record.size; )
+            {
+                auto count = static_cast<std::size_t>(std::min<std::uint64_t>(buffer.size(), record.size - done));
+                if (record.isCopy)
+                {
+                    Read(oldPackage, record.oldOffset + done, buffer.data(), count);
+                }
+                else
+                {
+                    ULONG bytesRead = 0;
+                    ThrowHrIfFailed(ranges->Read(buffer.data(), static_cast<ULONG>(count), &bytesRead));
+                    ThrowErrorIf(Error::FileRead, (bytesRead != count), "The ranges end before the fetch records of the delta");
+                }
+                hasher.HashData(buffer.data(), static_cast<std::uint32_t>(count));
+                Write(newPackage, buffer.data(), count);
+                done += count;
+            }
+        }
+        ULONG extra = 0;
+        ThrowHrIfFailed(ranges->Read(buffer.data(), 1, &extra));
+        ThrowErrorIf(Error::InvalidData, (extra != 0), "The ranges are longer than the fetch records of the delta");
+
+        Sha256Digest hash;
+        hasher.FinalizeAndGetHashValue(hash);
+        ThrowErrorIf(Error::InvalidData, (ToHex(hash) != expectedHash), "The patched package doesn't match the delta");
+    }
+}
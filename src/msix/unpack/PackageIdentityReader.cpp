@@ -0,0 +1,398 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "PackageIdentityReader.hpp"
+#include "AppxFactory.hpp"
+#include "AppxPackageInfo.hpp"
+#include "Exceptions.hpp"
+#include "IXml.hpp"
+#include "StreamBase.hpp"
+#include "ZipObjectReader.hpp"
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace MSIX {
+
+    namespace {
+
+        const std::size_t IdentityScannerBufferSize = 4096;
+
+        // The attributes of the Identity element
+        struct IdentityAttributes
+        {
+            bool found = false;
+            std::string name;
+            std::string publisher;
+            std::string version;
+            std::string architecture;
+            std::string resourceId;
+        };
+
+        bool IsWhitespace(char c) { return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r'); }
+        bool IsNameStart(char c) { return ((c >= 'a') && (c <= 'z')) || ((c >= 'A') && (c <= 'Z')) || (c == '_') || (c == ':') || (static_cast<std::uint8_t>(c) >= 0x80); }
+        bool IsNameChar(char c) { return IsNameStart(c) || ((c >= '0') && (c <= '9')) || (c == '-') || (c == '.'); }
+
+        std::string LocalName(const std::string& name)
+        {
+            auto colon = name.find(':');
+            return (colon == std::string::npos) ? name : name.substr(colon + 1);
+        }
+
+        // Forward only scanner over the start of a UTF-8 manifest. It reads the stream in small chunks and stops at
+        // the Identity element below the root element. Any construct it doesn't expect makes Scan return false.
+        class IdentityScanner
+        {
+        public:
+            IdentityScanner(const ComPtr<IStream>& stream) : m_stream(stream), m_buffer(IdentityScannerBufferSize) {}
+
+            bool Scan(const char* rootName, IdentityAttributes& identity)
+            {
+                // UTF-8 byte order mark
+                char c = 0;
+                if (Peek(c) && (static_cast<std::uint8_t>(c) == 0xEF))
+                {
+                    if (!Expect("\xEF\xBB\xBF")) { return false; }
+                }
+
+                std::size_t depth = 0;
+                while (true)
+                {
+                    // Text until the next markup
+                    while (true)
+                    {
+                        if (!Next(c)) { return false; }
+                        if (c == '<') { break; }
+                        if ((depth == 0) && !IsWhitespace(c)) { return false; }
+                    }
+                    if (!Next(c)) { return false; }
+                    if (c == '?')
+                    {
+                        if (!SkipPast("?>")) { return false; }
+                    }
+                    else if (c == '!')
+                    {
+                        // Comments and CDATA sections, a DOCTYPE is left to the DOM to reject
+                        if (!Next(c)) { return false; }
+                        if ((c == '-') && Expect("-"))
+                        {
+                            if (!SkipPast("-->")) { return false; }
+                        }
+                        else if ((c == '[') && (depth > 0) && Expect("CDATA["))
+                        {
+                            if (!SkipPast("]]>")) { return false; }
+                        }
+                        else
+                        {
+                            return false;
+                        }
+                    }
+                    else if (c == '/')
+                    {
+                        std::string name;
+                        if (!Next(c) || !ReadName(c, name)) { return false; }
+                        SkipWhitespace();
+                        if (!Expect(">") || (depth <= 1))
+                        {   // The root element is closed, with no Identity in it
+                            return false;
+                        }
+                        depth--;
+                    }
+                    else
+                    {
+                        std::string name;
+                        if (!ReadName(c, name)) { return false; }
+                        auto localName = LocalName(name);
+                        if ((depth == 0) && (localName != rootName)) { return false; }
+                        bool isIdentity = (depth == 1) && (localName == "Identity");
+                        bool isEmpty = false;
+                        while (true)
+                        {
+                            bool hadWhitespace = SkipWhitespace();
+                            if (!Next(c)) { return false; }
+                            if (c == '>') { break; }
+                            if (c == '/')
+                            {
+                                if (!Expect(">")) { return false; }
+                                isEmpty = true;
+                                break;
+                            }
+                            std::string attributeName;
+                            std::string value;
+                            if (!hadWhitespace || !ReadName(c, attributeName)) { return false; }
+                            SkipWhitespace();
+                            if (!Expect("=")) { return false; }
+                            SkipWhitespace();
+                            if (!ReadAttributeValue(value)) { return false; }
+                            if (isIdentity)
+                            {
+                                if (attributeName == "Name") { identity.name = std::move(value); }
+                                else if (attributeName == "Publisher") { identity.publisher = std::move(value); }
+                                else if (attributeName == "Version") { identity.version = std::move(value); }
+                                else if (attributeName == "ProcessorArchitecture") { identity.architecture = std::move(value); }
+                                else if (attributeName == "ResourceId") { identity.resourceId = std::move(value); }
+                            }
+                        }
+                        if (isIdentity)
+                        {
+                            identity.found = true;
+                            return true;
+                        }
+                        if (!isEmpty) { depth++; }
+                    }
+                }
+            }
+
+        protected:
+            bool Peek(char& c)
+            {
+                if (m_position == m_end)
+                {
+                    ULONG bytesRead = 0;
+                    ThrowHrIfFailed(m_stream->Read(m_buffer.data(), static_cast<ULONG>(m_buffer.size()), &bytesRead));
+                    m_position = 0;
+                    m_end = bytesRead;
+                    if (bytesRead == 0) { return false; }
+                }
+                c = m_buffer[m_position];
+                return true;
+            }
+
+            bool Next(char& c)
+            {
+                if (!Peek(c)) { return false; }
+                m_position++;
+                return true;
+            }
+
+            bool Expect(const char* value)
+            {
+                char c = 0;
+                for (; *value != '\0'; value++)
+                {
+                    if (!Next(c) || (c != *value)) { return false; }
+                }
+                return true;
+            }
+
+            bool SkipWhitespace()
+            {
+                bool skipped = false;
+                char c = 0;
+                while (Peek(c) && IsWhitespace(c))
+                {
+                    m_position++;
+                    skipped = true;
+                }
+                return skipped;
+            }
+
+            bool SkipPast(const char* terminator)
+            {
+                std::size_t length = std::strlen(terminator);
+                std::string window;
+                char c = 0;
+                while (Next(c))
+                {
+                    window.push_back(c);
+                    if (window.size() > length) { window.erase(0, 1); }
+                    if (window == terminator) { return true; }
+                }
+                return false;
+            }
+
+            bool ReadName(char first, std::string& name)
+            {
+                if (!IsNameStart(first)) { return false; }
+                name.push_back(first);
+                char c = 0;
+                while (Peek(c) && IsNameChar(c))
+                {
+                    name.push_back(c);
+                    m_position++;
+                }
+                return true;
+            }
+
+            // Reads a quoted attribute value, normalizing whitespace and replacing the references
+            bool ReadAttributeValue(std::string& value)
+            {
+                char quote = 0;
+                if (!Next(quote) || ((quote != '"') && (quote != '\''))) { return false; }
+                char c = 0;
+                while (true)
+                {
+                    if (!Next(c) || (c == '<')) { return false; }
+                    if (c == quote) { return true; }
+                    if (c == '&')
+                    {
+                        if (!ReadReference(value)) { return false; }
+                    }
+                    else if (c == '\r')
+                    {
+                        char next = 0;
+                        if (Peek(next) && (next == '\n')) { m_position++; }
+                        value.push_back(' ');
+                    }
+                    else if ((c == '\n') || (c == '\t'))
+                    {
+                        value.push_back(' ');
+                    }
+                    else
+                    {
+                        value.push_back(c);
+                    }
+                }
+            }
+
+            bool ReadReference(std::string& value)
+            {
+                std::string reference;
+                char c = 0;
+                while (true)
+                {
+                    if (!Next(c) || (reference.size() > 10)) { return false; }
+                    if (c == ';') { break; }
+                    reference.push_back(c);
+                }
+                if (reference == "lt") { value.push_back('<'); }
+                else if (reference == "gt") { value.push_back('>'); }
+                else if (reference == "amp") { value.push_back('&'); }
+                else if (reference == "quot") { value.push_back('"'); }
+                else if (reference == "apos") { value.push_back('\''); }
+                else if ((reference.size() > 1) && (reference[0] == '#'))
+                {
+                    bool hex = (reference[1] == 'x');
+                    std::size_t start = hex ? 2 : 1;
+                    if (start == reference.size()) { return false; }
+                    std::uint32_t code = 0;
+                    for (std::size_t i = start; i < reference.size(); i++)
+                    {
+                        char digit = reference[i];
+                        std::uint32_t digitValue = 0;
+                        if ((digit >= '0') && (digit <= '9')) { digitValue = digit - '0'; }
+                        else if (hex && (digit >= 'a') && (digit <= 'f')) { digitValue = digit - 'a' + 10; }
+                        else if (hex && (digit >= 'A') && (digit <= 'F')) { digitValue = digit - 'A' + 10; }
+                        else { return false; }
+                        code = code * (hex ? 16 : 10) + digitValue;
+                        if (code > 0x10FFFF) { return false; }
+                    }
+                    // Only ASCII characters, anything else is left to the DOM
+                    if ((code < 0x20) || (code >= 0x80)) { return false; }
+                    value.push_back(static_cast<char>(code));
+                }
+                else
+                {
+                    return false;
+                }
+                return true;
+            }
+
+            ComPtr<IStream> m_stream;
+            std::vector<char> m_buffer;
+            std::size_t m_position = 0;
+            std::size_t m_end = 0;
+        };
+    }
+
+    MSIX_CONTAINER_FORMAT GetContainerFormat(const ComPtr<IStream>& stream)
+    {
+        std::uint8_t start[64] = {};
+        ULONG bytesRead = 0;
+        ThrowHrIfFailed(stream->Seek({ 0 }, StreamBase::Reference::START, nullptr));
+        ThrowHrIfFailed(stream->Read(start, sizeof(start), &bytesRead));
+        ThrowHrIfFailed(stream->Seek({ 0 }, StreamBase::Reference::START, nullptr));
+
+        if ((bytesRead >= 4) && (Meta::LoadLittleEndian<std::uint32_t>(start) == static_cast<std::uint32_t>(Signatures::LocalFileHeader)))
+        {
+            auto format = MSIX_CONTAINER_FORMAT_UNKNOWN;
+            {
+                auto container = ComPtr<IStorageObject>::Make<ZipObjectReader>(stream, true /*deferLocalFileHeaders*/);
+                if (container->GetFile(APPXMANIFEST_XML))
+                {
+                    format = MSIX_CONTAINER_FORMAT_PACKAGE;
+                }
+                else if (container->GetFile(APPXBUNDLEMANIFEST_XML))
+                {
+                    format = MSIX_CONTAINER_FORMAT_BUNDLE;
+                }
+            }
+            ThrowHrIfFailed(stream->Seek({ 0 }, StreamBase::Reference::START, nullptr));
+            return format;
+        }
+
+        // Xml starts with a byte order mark, or a declaration or element after white space
+        if ((bytesRead >= 2) && (((start[0] == 0xFF) && (start[1] == 0xFE)) || ((start[0] == 0xFE) && (start[1] == 0xFF))))
+        {
+            return MSIX_CONTAINER_FORMAT_MANIFEST;
+        }
+        std::size_t index = 0;
+        if ((bytesRead >= 3) && (start[0] == 0xEF) && (start[1] == 0xBB) && (start[2] == 0xBF))
+        {
+            index = 3;
+        }
+        while ((index < bytesRead) && ((start[index] == ' ') || (start[index] == '\t') || (start[index] == '\r') || (start[index] == '\n')))
+        {
+            index++;
+        }
+        return ((index < bytesRead) && (start[index] == '<')) ? MSIX_CONTAINER_FORMAT_MANIFEST : MSIX_CONTAINER_FORMAT_UNKNOWN;
+    }
+
+    ComPtr<IAppxManifestPackageId> ReadPackageIdentity(IMsixFactory* factory, const ComPtr<IStream>& packageStream)
+    {
+        auto container = ComPtr<IStorageObject>::Make<ZipObjectReader>(packageStream, true /*deferLocalFileHeaders*/);
+        bool isBundle = false;
+        auto manifest = container->GetFile(APPXMANIFEST_XML);
+        if (!manifest)
+        {
+            manifest = container->GetFile(APPXBUNDLEMANIFEST_XML);
+            isBundle = true;
+        }
+        ThrowErrorIfNot(Error::MissingAppxManifestXML, manifest, "AppxManifest.xml or AppxBundleManifest.xml not in archive!");
+
+        IdentityAttributes identity;
+        IdentityScanner scanner(manifest);
+        if (!scanner.Scan(isBundle ? "Bundle" : "Package", identity))
+        {
+            identity = IdentityAttributes();
+            ThrowHrIfFailed(manifest->Seek({ 0 }, StreamBase::Reference::START, nullptr));
+            ComPtr<IXmlFactory> xmlFactory;
+            ThrowHrIfFailed(factory->QueryInterface(UuidOfImpl<IXmlFactory>::iid, reinterpret_cast<void**>(&xmlFactory)));
+            auto dom = xmlFactory->CreateDomFromStream(isBundle ? XmlContentType::AppxBundleManifestXml : XmlContentType::AppxManifestXml, manifest);
+            XmlVisitor visitor(static_cast<void*>(&identity), [](void* i, const ComPtr<IXmlElement>& identityNode)->bool
+            {
+                IdentityAttributes* identity = reinterpret_cast<IdentityAttributes*>(i);
+                identity->found = true;
+                identity->name         = identityNode->GetAttributeValue(XmlAttributeName::Name);
+                identity->publisher    = identityNode->GetAttributeValue(XmlAttributeName::Publisher);
+                identity->version      = identityNode->GetAttributeValue(XmlAttributeName::Version);
+                identity->architecture = identityNode->GetAttributeValue(XmlAttributeName::Identity_ProcessorArchitecture);
+                identity->resourceId   = identityNode->GetAttributeValue(XmlAttributeName::ResourceId);
+                return false;
+            });
+            dom->ForEachElementIn(dom->GetDocument(), isBundle ? XmlQueryName::Bundle_Identity : XmlQueryName::Package_Identity, visitor);
+        }
+        ThrowErrorIfNot(Error::AppxManifestSemanticError, identity.found, "No Identity element in the manifest");
+        ThrowErrorIf(Error::AppxManifestSemanticError, (identity.publisher.empty()), "Invalid Identity element");
+
+        if (isBundle)
+        {   // Bundles don't have a ResourceId attribute in their manifest, but is always ~ for the package identity.
+            return ComPtr<IAppxManifestPackageId>::Make<AppxManifestPackageId>(factory, identity.name, identity.version, "~", "neutral", identity.publisher);
+        }
+        return ComPtr<IAppxManifestPackageId>::Make<AppxManifestPackageId>(factory, identity.name, identity.version, identity.resourceId, identity.architecture, identity.publisher);
+    }
+
+    ComPtr<IAppxManifestReader> ReadPackageManifest(IMsixFactory* factory, const ComPtr<IStream>& packageStream)
+    {
+        auto container = ComPtr<IStorageObject>::Make<ZipObjectReader>(packageStream, true /*deferLocalFileHeaders*/);
+        auto manifest = container->GetFile(APPXMANIFEST_XML);
+        ThrowErrorIfNot(Error::MissingAppxManifestXML, manifest, "AppxManifest.xml not in archive!");
+        ComPtr<IAppxFactory> appxFactory;
+        ThrowHrIfFailed(factory->QueryInterface(UuidOfImpl<IAppxFactory>::iid, reinterpret_cast<void**>(&appxFactory)));
+        ComPtr<IAppxManifestReader> manifestReader;
+        ThrowHrIfFailed(appxFactory->CreateManifestReader(manifest.Get(), &manifestReader));
+        return manifestReader;
+    }
+}
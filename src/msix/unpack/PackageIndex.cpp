@@ -0,0 +1,124 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "PackageIndex.hpp"
+
+#include <cstring>
+
+namespace MSIX {
+
+    namespace {
+        // "MSIXIDX" and the version of the layout, change it when the layout of PackageIndex changes
+        const std::uint8_t PackageIndexHeader[] = { 'M', 'S', 'I', 'X', 'I', 'D', 'X', 2 };
+    }
+
+    // The blocks are written as three arrays after the files, so they are read back with a copy per array
+    std::vector<std::uint8_t> PackageIndex::Save() const
+    {
+        std::vector<std::uint8_t> data;
+        auto append = [&data](const void* bytes, std::size_t size)
+        {
+            auto begin = static_cast<const std::uint8_t*>(bytes);
+            data.insert(data.end(), begin, begin + size);
+        };
+        auto appendSize = [&append](std::size_t size)
+        {
+            std::uint32_t value = static_cast<std::uint32_t>(size);
+            append(&value, sizeof(value));
+        };
+
+        append(PackageIndexHeader, sizeof(PackageIndexHeader));
+        append(&packageSize, sizeof(packageSize));
+        for (const auto& hash : { &centralDirectoryHash, &blockMapHash, &contentTypesHash, &manifestHash })
+        {
+            append(hash->data(), hash->size());
+        }
+        appendSize(manifestSnapshot.size());
+        append(manifestSnapshot.data(), manifestSnapshot.size());
+        appendSize(files.size());
+        for (const auto& file : files)
+        {
+            appendSize(file.name.size());
+            append(file.name.data(), file.name.size());
+            append(&file.size, sizeof(file.size));
+            append(&file.localFileHeaderSize, sizeof(file.localFileHeaderSize));
+            appendSize(file.blockCount);
+        }
+        appendSize(blocks->hashes.size());
+        append(blocks->hashes.data(), blocks->hashes.size() * sizeof(Sha256Digest));
+        append(blocks->compressedSizes.data(), blocks->compressedSizes.size() * sizeof(std::uint64_t));
+        append(blocks->blockSizes.data(), blocks->blockSizes.size() * sizeof(std::uint64_t));
+        return data;
+    }
+
+    // Counts are not trusted to reserve anything, an index that claims more than it has fails to read.
+    bool PackageIndex::Load(const std::uint8_t* data, std::size_t size)
+    {
+        std::size_t position = 0;
+        auto read = [data, size, &position](void* value, std::size_t count)
+        {
+            if (size - position < count) { return false; }
+            if (count != 0) { std::memcpy(value, data + position, count); }
+            position += count;
+            return true;
+        };
+        auto readSize = [&read](std::size_t& count)
+        {
+            std::uint32_t value = 0;
+            if (!read(&value, sizeof(value))) { return false; }
+            count = value;
+            return true;
+        };
+
+        std::uint8_t header[sizeof(PackageIndexHeader)] = {};
+        if (!read(header, sizeof(header)) || (std::memcmp(header, PackageIndexHeader, sizeof(header)) != 0))
+        {
+            return false;
+        }
+        PackageIndex index;
+        if (!read(&index.packageSize, sizeof(index.packageSize))) { return false; }
+        for (auto hash : { &index.centralDirectoryHash, &index.blockMapHash, &index.contentTypesHash, &index.manifestHash })
+        {
+            if (!read(hash->data(), hash->size())) { return false; }
+        }
+        std::size_t count = 0;
+        if (!readSize(count) || (size - position < count)) { return false; }
+        index.manifestSnapshot.assign(data + position, data + position + count);
+        position += count;
+
+        if (!readSize(count)) { return false; }
+        std::size_t blockCount = 0;
+        for (std::size_t i = 0; i < count; i++)
+        {
+            File file;
+            std::size_t nameSize = 0;
+            if (!readSize(nameSize) || (size - position < nameSize)) { return false; }
+            file.name.assign(reinterpret_cast<const char*>(data + position), nameSize);
+            position += nameSize;
+            if (!read(&file.size, sizeof(file.size)) || !read(&file.localFileHeaderSize, sizeof(file.localFileHeaderSize)) ||
+                !readSize(file.blockCount))
+            {
+                return false;
+            }
+            blockCount += file.blockCount;
+            index.files.push_back(std::move(file));
+        }
+
+        const std::size_t blockSize = sizeof(Sha256Digest) + 2 * sizeof(std::uint64_t);
+        if (!readSize(count) || (count != blockCount) || ((size - position) / blockSize < count)) { return false; }
+        auto& table = *index.blocks;
+        table.hashes.resize(count);
+        table.compressedSizes.resize(count);
+        table.blockSizes.resize(count);
+        if (!read(table.hashes.data(), count * sizeof(Sha256Digest)) ||
+            !read(table.compressedSizes.data(), count * sizeof(std::uint64_t)) ||
+            !read(table.blockSizes.data(), count * sizeof(std::uint64_t)) ||
+            (position != size))
+        {
+            return false;
+        }
+        *this = std::move(index);
+        return true;
+    }
+}
@@ -0,0 +1,29 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "PackageLayout.hpp"
+
+#include <algorithm>
+
+namespace MSIX {
+
+    std::vector<ZipByteRange> GetBlockRanges(const ZipFileRecords& records, std::uint64_t fileSize, const FileBlocks& blocks)
+    {
+        std::vector<ZipByteRange> result;
+        result.reserve(blocks.size());
+        std::uint64_t offset = records.data.offset;
+        for (std::size_t index = 0; index < blocks.size(); index++)
+        {
+            auto start = std::min<std::uint64_t>(fileSize, index * BLOCKMAP_BLOCK_SIZE);
+            auto size = records.isCompressed ? blocks.CompressedSize(index) : std::min<std::uint64_t>(BLOCKMAP_BLOCK_SIZE, fileSize - start);
+            result.push_back(ZipByteRange{ offset, size });
+            offset += size;
+        }
+        if (offset > records.data.offset + records.data.size)
+        {
+            result.clear();
+        }
+        return result;
+    }
+}
@@ -0,0 +1,208 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "PayloadFileReader.hpp"
+#include "ScopeExit.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace MSIX {
+
+    PayloadFileReader::PayloadFileReader(const std::string& name, std::function<ComPtr<IStream>()> openRawStream, std::uint64_t size,
+        bool isCompressed, std::uint64_t rawSize, const FileBlocks& blocks, const std::shared_ptr<IntegrityRecord>& integrityRecord,
+        const std::shared_ptr<PerformanceCounters>& performanceCounters) :
+        m_name(name), m_openRawStream(std::move(openRawStream)), m_size(size), m_isCompressed(isCompressed), m_rawSize(rawSize),
+        m_blocks(blocks), m_integrityRecord(integrityRecord), m_performanceCounters(performanceCounters)
+    {
+        m_blockCount = static_cast<std::size_t>((m_size + BLOCKMAP_BLOCK_SIZE - 1) / BLOCKMAP_BLOCK_SIZE);
+        if (m_integrityRecord)
+        {
+            m_trusted = m_integrityRecord->IsVerified(m_name);
+            m_validatedBlocks.resize(m_blockCount);
+        }
+    }
+
+    HRESULT STDMETHODCALLTYPE PayloadFileReader::Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept try
+    {
+        std::int64_t position = 0;
+        switch (origin)
+        {
+            case Reference::CURRENT:
+                position = static_cast<std::int64_t>(m_position) + move.QuadPart;
+                break;
+            case Reference::START:
+                position = move.QuadPart;
+                break;
+            case Reference::END:
+                position = static_cast<std::int64_t>(m_size) + move.QuadPart;
+                break;
+        }
+        m_position = std::min(static_cast<std::uint64_t>(std::max(position, static_cast<std::int64_t>(0))), m_size);
+        if (newPosition) { newPosition->QuadPart = m_position; }
+        return static_cast<HRESULT>(Error::OK);
+    } CATCH_RETURN();
+
+    HRESULT STDMETHODCALLTYPE PayloadFileReader::Read(void* buffer, ULONG countBytes, ULONG* actualRead) noexcept try
+    {
+        ThrowErrorIf(Error::Stg_E_Invalidpointer, (buffer == nullptr && countBytes != 0), "bad input");
+        std::uint32_t bytesRead = 0;
+        if (m_position < m_size)
+        {
+            if (!m_rawStream) { Open(); }
+            // The rest of a file over 4GB doesn't fit in 32 bits, take the minimum first
+            std::uint32_t bytesToRead = static_cast<std::uint32_t>(std::min(static_cast<std::uint64_t>(countBytes), m_size - m_position));
+            auto destination = static_cast<std::uint8_t*>(buffer);
+            while (bytesToRead > 0)
+            {
+                std::size_t index = static_cast<std::size_t>(m_position / BLOCKMAP_BLOCK_SIZE);
+                std::uint32_t blockSize = GetBlockSize(index);
+                std::uint32_t positionInBlock = static_cast<std::uint32_t>(m_position - index * BLOCKMAP_BLOCK_SIZE);
+                std::uint32_t count = std::min(bytesToRead, blockSize - positionInBlock);
+                if ((positionInBlock == 0) && (count == blockSize) && (m_bufferedBlock != index))
+                {
+                    ReadBlock(index, destination);
+                }
+                else
+                {
+                    if (m_bufferedBlock != index)
+                    {
+                        m_blockBuffer.resize(static_cast<std::size_t>(BLOCKMAP_BLOCK_SIZE));
+                        m_bufferedBlock = NoBlock;
+                        ReadBlock(index, m_blockBuffer.data());
+                        m_bufferedBlock = index;
+                    }
+                    std::memcpy(destination, m_blockBuffer.data() + positionInBlock, count);
+                }
+                if (m_integrityRecord && !m_trusted) { RecordValidated(index); }
+
+                destination += count;
+                m_position += count;
+                bytesToRead -= count;
+                bytesRead += count;
+            }
+        }
+        if (actualRead) { *actualRead = bytesRead; }
+        return (countBytes == bytesRead) ? S_OK : S_FALSE;
+    } CATCH_RETURN();
+
+    void PayloadFileReader::Open()
+    {
+        ThrowErrorIf(Error::BlockMapSemanticError, (m_blockCount != m_blocks.size()), "blocks don't describe the file");
+        auto rawStream = m_openRawStream();
+        ThrowErrorIfNot(Error::FileNotFound, rawStream, "the file isn't in the package");
+        auto streamInternal = rawStream.As<IStreamInternal>();
+        if (streamInternal->SupportsReadAt())
+        {
+            m_positionalStream = std::move(streamInternal);
+        }
+
+        m_offsets.reserve(m_blockCount + 1);
+        std::uint64_t offset = 0;
+        for (std::size_t block = 0; block < m_blockCount; block++)
+        {
+            m_offsets.push_back(offset);
+            offset += m_isCompressed ? m_blocks.CompressedSize(block) : GetBlockSize(block);
+        }
+        m_offsets.push_back(offset);
+        ThrowErrorIf(Error::BlockMapSemanticError, (offset > m_rawSize), "blocks don't describe the file");
+
+        if (m_isCompressed) { m_inflater = CreateCompressionObject(); }
+        m_rawStream = std::move(rawStream);
+    }
+
+    std::uint32_t PayloadFileReader::GetBlockSize(std::size_t index) const
+    {
+        return static_cast<std::uint32_t>(std::min(BLOCKMAP_BLOCK_SIZE, m_size - index * BLOCKMAP_BLOCK_SIZE));
+    }
+
+    // A stored block is read a chunk at a time. A deflated one is read at once and inflated a chunk at a time, so
+    // the inflater writes each chunk right where it belongs and it is hashed while it is still in cache.
+    void PayloadFileReader::ReadBlock(std::size_t index, std::uint8_t* destination)
+    {
+        std::uint32_t blockSize = GetBlockSize(index);
+        std::uint64_t rawOffset = m_offsets[index];
+        if (!m_trusted) { m_hashEngine.Reset(); }
+        std::uint32_t position = 0;
+        if (!m_isCompressed)
+        {
+            while (position < blockSize)
+            {
+                std::uint32_t count = std::min(BlockHashChunkSize, blockSize - position);
+                ReadRaw(rawOffset + position, count, destination + position);
+                HashChunk(destination + position, count);
+                position += count;
+            }
+        }
+        else
+        {
+            std::uint64_t rawCount = m_offsets[index + 1] - rawOffset;
+            ThrowErrorIf(Error::BlockMapSemanticError, (rawCount > 2 * BLOCKMAP_BLOCK_SIZE), "compressed block too large");
+            m_rawBuffer.resize(static_cast<std::size_t>(rawCount));
+            ReadRaw(rawOffset, static_cast<std::uint32_t>(rawCount), m_rawBuffer.data());
+
+            ThrowErrorIfNot(Error::InflateInitialize, (m_inflater->Initialize(CompressionOperation::Inflate) == CompressionStatus::Ok), "compression_stream_init failed");
+            auto cleanup = MSIX::scope_exit([this] { m_inflater->Cleanup(); });
+            m_inflater->SetInput(m_rawBuffer.data(), m_rawBuffer.size());
+            while (position < blockSize)
+            {
+                std::uint32_t count = std::min(BlockHashChunkSize, blockSize - position);
+                m_inflater->SetOutput(destination + position, count);
+                std::uint32_t inflated = 0;
+                CompressionStatus status;
+                {
+                    PerformanceCounters::Measure measure(m_performanceCounters.get(), MSIX_PERFORMANCE_COUNTER_STAGE_INFLATE);
+                    status = m_inflater->Inflate();
+                    inflated = count - static_cast<std::uint32_t>(m_inflater->GetAvailableDestinationSize());
+                    measure.SetBytes(inflated);
+                }
+                ThrowErrorIf(Error::InflateCorruptData, (status == CompressionStatus::Error || status == CompressionStatus::NeedDictionary ||
+                    inflated == 0), "inflate failed unexpectedly.");
+                HashChunk(destination + position, inflated);
+                position += inflated;
+            }
+        }
+
+        if (!m_trusted)
+        {
+            Sha256Digest hash;
+            m_hashEngine.FinalizeAndGetHashValue(hash);
+            ThrowErrorIfNot(Error::SignatureInvalid, (hash == m_blocks.Hash(index)), "Signature hash doesn't match digest hash");
+        }
+    }
+
+    void PayloadFileReader::ReadRaw(std::uint64_t offset, std::uint32_t count, std::uint8_t* buffer)
+    {
+        ULONG read = 0;
+        if (m_positionalStream)
+        {
+            read = m_positionalStream->ReadAt(offset, buffer, count);
+        }
+        else
+        {
+            LARGE_INTEGER position = { 0 };
+            position.QuadPart = static_cast<LONGLONG>(offset);
+            ThrowHrIfFailed(m_rawStream->Seek(position, StreamBase::Reference::START, nullptr));
+            ThrowHrIfFailed(m_rawStream->Read(buffer, count, &read));
+        }
+        ThrowErrorIf(Error::FileRead, (read != count), "Did not read as much as requested.");
+    }
+
+    void PayloadFileReader::HashChunk(const std::uint8_t* chunk, std::uint32_t size)
+    {
+        if (m_trusted) { return; }
+        PerformanceCounters::Measure measure(m_performanceCounters.get(), MSIX_PERFORMANCE_COUNTER_STAGE_HASH, size);
+        m_hashEngine.HashData(chunk, size);
+    }
+
+    void PayloadFileReader::RecordValidated(std::size_t index)
+    {
+        if (m_validatedBlocks[index]) { return; }
+        m_validatedBlocks[index] = true;
+        if (++m_validatedCount == m_blockCount)
+        {
+            m_integrityRecord->AddVerified({ m_name });
+        }
+    }
+}
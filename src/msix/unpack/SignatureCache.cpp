@@ -0,0 +1,113 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "SignatureCache.hpp"
+#include "Exceptions.hpp"
+#include "StreamHelper.hpp"
+#include "VectorStream.hpp"
+
+#include <algorithm>
+
+namespace MSIX {
+
+    bool SignatureVerificationCache::IsEnabled()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_enabled || (m_extension.Get() != nullptr);
+    }
+
+    void SignatureVerificationCache::SetExtension(const ComPtr<IMsixSignatureCache>& extension)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_extension = extension;
+    }
+
+    ComPtr<IMsixSignatureCache> SignatureVerificationCache::GetExtension()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_extension;
+    }
+
+    bool SignatureVerificationCache::GetEntry(const std::string& key, std::vector<std::uint8_t>& entry)
+    {
+        auto extension = GetExtension();
+        if (extension)
+        {
+            ComPtr<IStream> stream;
+            ThrowHrIfFailed(extension->GetEntry(key.c_str(), &stream));
+            if (!stream) { return false; }
+            entry = Helper::CreateBufferFromStream(stream);
+            return true;
+        }
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto found = m_entries.find(key);
+        if (found == m_entries.end()) { return false; }
+        found->second.lastUse = ++m_useCount;
+        entry = found->second.data;
+        return true;
+    }
+
+    void SignatureVerificationCache::AddEntry(const std::string& key, std::vector<std::uint8_t>& entry)
+    {
+        auto extension = GetExtension();
+        if (extension)
+        {
+            auto stream = ComPtr<IStream>::Make<VectorStream>(&entry);
+            ThrowHrIfFailed(extension->AddEntry(key.c_str(), stream.Get()));
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_entries.find(key) == m_entries.end() && m_entries.size() >= SignatureCacheMaxEntries)
+        {
+            auto oldest = std::min_element(m_entries.begin(), m_entries.end(), [](const auto& left, const auto& right)
+            {
+                return left.second.lastUse < right.second.lastUse;
+            });
+            m_entries.erase(oldest);
+        }
+        auto& cached = m_entries[key];
+        cached.data = entry;
+        cached.lastUse = ++m_useCount;
+    }
+
+    void CertificateChainCache::SetLifetime(std::chrono::seconds lifetime)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_lifetime = lifetime;
+        m_entries.clear();
+    }
+
+    bool CertificateChainCache::GetEntry(const std::string& key, std::uint32_t& result)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto found = m_entries.find(key);
+        if (found == m_entries.end()) { return false; }
+        if (std::chrono::steady_clock::now() - found->second.added >= m_lifetime)
+        {
+            m_entries.erase(found);
+            return false;
+        }
+        result = found->second.result;
+        return true;
+    }
+
+    void CertificateChainCache::AddEntry(const std::string& key, std::uint32_t result)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_lifetime.count() == 0) { return; }
+        if (m_entries.find(key) == m_entries.end() && m_entries.size() >= SignatureCacheMaxEntries)
+        {
+            auto oldest = std::min_element(m_entries.begin(), m_entries.end(), [](const auto& left, const auto& right)
+            {
+                return left.second.added < right.second.added;
+            });
+            m_entries.erase(oldest);
+        }
+        auto& cached = m_entries[key];
+        cached.result = result;
+        cached.added = std::chrono::steady_clock::now();
+    }
+}
@@ -0,0 +1,400 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "StreamingUnpacker.hpp"
+#include "AppxFactory.hpp"
+#include "AppxPackageObject.hpp"
+#include "AppxPackageInfo.hpp"
+#include "Crc32.hpp"
+#include "Encoding.hpp"
+#include "FileNameValidation.hpp"
+#include "ObjectBase.hpp"
+#include "ScopeExit.hpp"
+#include "SpillStream.hpp"
+#include "StringHelper.hpp"
+#include "WorkerPool.hpp"
+#include "ZipObject.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace MSIX {
+
+    namespace
+    {
+        const char* const ProvisionalSuffix = ".partial";
+        const std::size_t InputBufferSize = 1024 * 1024;
+        const std::size_t LocalFileHeaderSize = 30;
+        // Signature, crc-32 and the two sizes, in 32 or 64 bits
+        const std::size_t DataDescriptorSize = 16;
+        const std::size_t Zip64DataDescriptorSize = 24;
+
+        // The footprint files are only read from the spool, they are written once the package is validated
+        bool IsFootprintFile(const std::string& name)
+        {
+            return (name == CONTENT_TYPES_XML) ||
+                (std::find_if(footprintFiles.begin(), footprintFiles.end(), [&name](const char* footprint) { return name == footprint; }) != footprintFiles.end());
+        }
+
+        // The name of a local header isn't validated until the package is opened from the spool, so a provisional
+        // file is only created for a name that is valid with the separator of the platform
+        bool IsProvisionalNameValid(const std::string& provisionalName)
+        {
+            #ifdef WIN32
+            return FileNameValidation::IsFileNameValid(Helper::toBackSlash(provisionalName));
+            #else
+            return FileNameValidation::IsFileNameValid(provisionalName);
+            #endif
+        }
+    }
+
+    StreamingUnpacker::StreamingUnpacker(const ComPtr<IAppxFactory>& factory, const ComPtr<IStream>& input, const ComPtr<IDirectoryObject>& to) :
+        m_factory(factory), m_input(input), m_to(to),
+        m_spool(ComPtr<IStream>::Make<SpillStream>()),
+        m_buffer(InputBufferSize)
+    {}
+
+    void StreamingUnpacker::Unpack(MSIX_PACKUNPACK_OPTION options, std::uint32_t threadCount)
+    {
+        auto removeProvisionalFiles = MSIX::scope_exit([this]
+        {
+            for (const auto& fileName : m_createdFiles)
+            {
+                std::remove(m_to->GetFilePath(fileName).c_str());
+            }
+        });
+
+        while (ExtractProvisionalFile()) {}
+        ReadToEnd();
+
+        ThrowHrIfFailed(m_spool->Seek({ 0 }, StreamBase::Reference::START, nullptr));
+        ComPtr<IAppxPackageReader> reader;
+        ThrowHrIfFailed(m_factory->CreatePackageReader(m_spool.Get(), &reader));
+
+        std::string packageFullNamePrefix;
+        if ((options & MSIX_PACKUNPACK_OPTION_CREATEPACKAGESUBFOLDER) || (options & MSIX_PACKUNPACK_OPTION_UNPACKWITHFLATSTRUCTURE))
+        {
+            ComPtr<IAppxManifestReader> manifest;
+            ThrowHrIfFailed(reader->GetManifest(&manifest));
+            ComPtr<IAppxManifestPackageId> packageId;
+            ThrowHrIfFailed(manifest->GetPackageId(&packageId));
+            packageFullNamePrefix = packageId.As<IAppxManifestPackageIdInternal>()->GetPackageFullName() + "/";
+        }
+
+        // Only the provisional files of the payload files of the validated package are kept, pairs of file name
+        // and provisional file name
+        auto package = reader.As<IPackage>();
+        std::vector<std::pair<std::string, std::string>> provisionalFiles;
+        for (const auto& fileName : reader.As<IStorageObject>()->GetFileNames(FileNameOptions::PayloadOnly))
+        {
+            auto provisional = m_provisionalFiles.find(fileName);
+            if (provisional != m_provisionalFiles.end())
+            {
+                provisionalFiles.emplace_back(fileName, provisional->second);
+            }
+        }
+
+        // They are checked against the block map before they replace their targets, so a target is only ever
+        // replaced by a file of the validated package
+        std::vector<std::uint8_t> matches(provisionalFiles.size(), 0);
+        auto checkFile = [&](std::size_t index)
+        {
+            matches[index] = package->IsTargetUnchanged(provisionalFiles[index].first, provisionalFiles[index].second, m_to) ? 1 : 0;
+        };
+        std::size_t workerCount = 1;
+        if (options & MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION)
+        {
+            workerCount = package->GetFactory()->GetWorkerPool()->GetWorkerCount(threadCount);
+        }
+        if ((workerCount > 1) && (provisionalFiles.size() > 1))
+        {
+            package->GetFactory()->GetWorkerPool()->ForEach(provisionalFiles.size(), std::min(workerCount, provisionalFiles.size()), checkFile);
+        }
+        else
+        {
+            for (std::size_t index = 0; index < provisionalFiles.size(); index++) { checkFile(index); }
+        }
+
+        std::vector<std::string> movedFiles;
+        auto removeMovedFiles = MSIX::scope_exit([this, &movedFiles]
+        {
+            for (const auto& fileName : movedFiles)
+            {
+                std::remove(m_to->GetFilePath(fileName).c_str());
+            }
+        });
+        for (std::size_t index = 0; index < provisionalFiles.size(); index++)
+        {
+            if (!matches[index])
+            {
+                continue;
+            }
+            auto targetName = packageFullNamePrefix + Encoding::DecodeFileName(provisionalFiles[index].first);
+            m_to->CreateDirectories({ targetName });
+            auto targetPath = m_to->GetFilePath(targetName);
+            std::remove(targetPath.c_str());
+            if (std::rename(m_to->GetFilePath(provisionalFiles[index].second).c_str(), targetPath.c_str()) == 0)
+            {
+                movedFiles.push_back(targetName);
+            }
+        }
+
+        // The moved files are left by the skip-unchanged pass, the others are extracted from the spool
+        package->Unpack(static_cast<MSIX_PACKUNPACK_OPTION>(options | MSIX_PACKUNPACK_OPTION_SKIPUNCHANGED), m_to, threadCount, nullptr);
+        removeMovedFiles.release();
+    }
+
+    bool StreamingUnpacker::ExtractProvisionalFile()
+    {
+        if (!Ensure(LocalFileHeaderSize) || (Meta::LoadLittleEndian<std::uint32_t>(Data()) != static_cast<std::uint32_t>(Signatures::LocalFileHeader)))
+        {
+            return false;
+        }
+        auto flags = static_cast<GeneralPurposeBitFlags>(Meta::LoadLittleEndian<std::uint16_t>(Data() + 6));
+        auto compression = Meta::LoadLittleEndian<std::uint16_t>(Data() + 8);
+        std::uint64_t compressedSize = Meta::LoadLittleEndian<std::uint32_t>(Data() + 18);
+        std::uint64_t uncompressedSize = Meta::LoadLittleEndian<std::uint32_t>(Data() + 22);
+        std::size_t nameLength = Meta::LoadLittleEndian<std::uint16_t>(Data() + 26);
+        std::size_t extraLength = Meta::LoadLittleEndian<std::uint16_t>(Data() + 28);
+        if (!Ensure(LocalFileHeaderSize + nameLength + extraLength))
+        {
+            return false;
+        }
+        std::string name(reinterpret_cast<const char*>(Data() + LocalFileHeaderSize), nameLength);
+
+        bool zip64 = false;
+        const std::uint8_t* extra = Data() + LocalFileHeaderSize + nameLength;
+        for (std::size_t offset = 0; offset + 4 <= extraLength;)
+        {
+            auto id = Meta::LoadLittleEndian<std::uint16_t>(extra + offset);
+            std::size_t size = Meta::LoadLittleEndian<std::uint16_t>(extra + offset + 2);
+            if ((id == 0x0001) && (size >= 16) && (offset + 4 + size <= extraLength))
+            {
+                uncompressedSize = Meta::LoadLittleEndian<std::uint64_t>(extra + offset + 4);
+                compressedSize = Meta::LoadLittleEndian<std::uint64_t>(extra + offset + 12);
+                zip64 = true;
+            }
+            offset += 4 + size;
+        }
+
+        bool dataDescriptor = ((flags & GeneralPurposeBitFlags::DataDescriptor) == GeneralPurposeBitFlags::DataDescriptor);
+        bool encrypted = ((flags & GeneralPurposeBitFlags::UNSUPPORTED_0) == GeneralPurposeBitFlags::UNSUPPORTED_0);
+        bool stored = (compression == static_cast<std::uint16_t>(CompressionType::Store));
+        if (encrypted || (!stored && (compression != static_cast<std::uint16_t>(CompressionType::Deflate))) ||
+            (stored && !dataDescriptor && (compressedSize != uncompressedSize)))
+        {
+            return false;
+        }
+        Consume(LocalFileHeaderSize + nameLength + extraLength);
+
+        // The data of an entry without a provisional file is still read, and the file is extracted from the spool if
+        // the package turns out valid
+        ComPtr<IStream> target;
+        std::string provisionalName;
+        if (!IsFootprintFile(name) && (name.empty() || name.back() != '/'))
+        {
+            provisionalName = Encoding::DecodeFileName(name) + ProvisionalSuffix;
+        }
+        if (!provisionalName.empty() && !IsProvisionalNameValid(provisionalName))
+        {
+            provisionalName.clear();
+        }
+        if (!provisionalName.empty())
+        {
+            m_createdFiles.push_back(provisionalName);
+            m_to->CreateDirectories({ provisionalName });
+            target = m_to->OpenFile(provisionalName, FileStream::Mode::WRITE, dataDescriptor ? 0 : uncompressedSize);
+        }
+
+        bool extracted = false;
+        if (stored)
+        {
+            extracted = dataDescriptor ? CopyStoredUntilDataDescriptor(target.Get()) : CopyStored(compressedSize, target.Get());
+        }
+        else
+        {
+            extracted = Inflate(!dataDescriptor, compressedSize, target.Get());
+            if (extracted && dataDescriptor)
+            {   // The signature of the data descriptor is optional
+                if (Ensure(4) && (Meta::LoadLittleEndian<std::uint32_t>(Data()) == static_cast<std::uint32_t>(Signatures::DataDescriptor)))
+                {
+                    Consume(4);
+                }
+                std::size_t size = (zip64 ? Zip64DataDescriptorSize : DataDescriptorSize) - 4;
+                extracted = Ensure(size);
+                if (extracted) { Consume(size); }
+            }
+        }
+        if (!extracted)
+        {
+            return false;
+        }
+        if (target)
+        {
+            ThrowHrIfFailed(target->Commit(STGC_DEFAULT));
+            m_provisionalFiles[name] = provisionalName;
+        }
+        return true;
+    }
+
+    bool StreamingUnpacker::CopyStored(std::uint64_t size, IStream* target)
+    {
+        while (size != 0)
+        {
+            if (!Ensure(1))
+            {
+                return false;
+            }
+            auto count = static_cast<std::size_t>(std::min<std::uint64_t>(size, Available()));
+            Write(target, Data(), count);
+            Consume(count);
+            size -= count;
+        }
+        return true;
+    }
+
+    // The size of a stored file with a data descriptor is only known from the descriptor after its data. The data
+    // ends at the first descriptor signature followed by the crc-32 and the size of the data before it.
+    bool StreamingUnpacker::CopyStoredUntilDataDescriptor(IStream* target)
+    {
+        const std::uint8_t signature[] = { 0x50, 0x4b, 0x07, 0x08 };
+        std::uint32_t crc = 0;
+        std::uint64_t size = 0;
+        std::size_t needed = Zip64DataDescriptorSize;
+        for (;;)
+        {
+            Ensure(needed);
+            bool more = !m_endOfInput;
+            std::size_t available = Available();
+            // Everything before a signature that may still be the descriptor can be written
+            std::size_t count = more ? available - std::min(available, sizeof(signature) - 1) : 0;
+            for (auto found = Data(); ; found++)
+            {
+                found = std::search(found, Data() + available, std::begin(signature), std::end(signature));
+                std::size_t position = static_cast<std::size_t>(found - Data());
+                if (position == available) { break; }
+                bool complete32 = (position + DataDescriptorSize <= available);
+                bool complete64 = (position + Zip64DataDescriptorSize <= available);
+                auto dataCrc = Crc32::Update(crc, Data(), position);
+                auto dataSize = size + position;
+                bool matches32 = complete32 && (Meta::LoadLittleEndian<std::uint32_t>(found + 4) == dataCrc) &&
+                    (Meta::LoadLittleEndian<std::uint32_t>(found + 8) == dataSize) && (Meta::LoadLittleEndian<std::uint32_t>(found + 12) == dataSize);
+                bool matches64 = !matches32 && complete64 && (Meta::LoadLittleEndian<std::uint32_t>(found + 4) == dataCrc) &&
+                    (Meta::LoadLittleEndian<std::uint64_t>(found + 8) == dataSize) && (Meta::LoadLittleEndian<std::uint64_t>(found + 16) == dataSize);
+                if (matches32 || matches64)
+                {
+                    Write(target, Data(), position);
+                    Consume(position + (matches32 ? DataDescriptorSize : Zip64DataDescriptorSize));
+                    return true;
+                }
+                if (!complete64 && more)
+                {   // The descriptor may continue past what is read
+                    count = std::min(count, position);
+                    break;
+                }
+            }
+            if (!more)
+            {
+                return false;
+            }
+            crc = Crc32::Update(crc, Data(), count);
+            size += count;
+            Write(target, Data(), count);
+            Consume(count);
+            // Reads past a possible descriptor that didn't fit
+            needed = (count == 0) ? Available() + 1 : Zip64DataDescriptorSize;
+        }
+    }
+
+    bool StreamingUnpacker::Inflate(bool sizeKnown, std::uint64_t compressedSize, IStream* target)
+    {
+        if (!m_inflater)
+        {
+            m_inflater = CreateCompressionObject();
+            m_inflated.resize(InputBufferSize);
+        }
+        if (m_inflater->Initialize(CompressionOperation::Inflate) != CompressionStatus::Ok)
+        {
+            return false;
+        }
+        auto cleanup = MSIX::scope_exit([this] { m_inflater->Cleanup(); });
+
+        std::uint64_t remaining = compressedSize;
+        for (;;)
+        {
+            if (!Ensure(1) || (sizeKnown && remaining == 0))
+            {
+                return false;
+            }
+            auto count = Available();
+            if (sizeKnown)
+            {
+                count = static_cast<std::size_t>(std::min<std::uint64_t>(count, remaining));
+            }
+            m_inflater->SetInput(Data(), count);
+            m_inflater->SetOutput(m_inflated.data(), m_inflated.size());
+            auto status = m_inflater->Inflate();
+            if ((status != CompressionStatus::Ok) && (status != CompressionStatus::End))
+            {
+                return false;
+            }
+            auto consumed = count - m_inflater->GetAvailableSourceSize();
+            Write(target, m_inflated.data(), m_inflated.size() - m_inflater->GetAvailableDestinationSize());
+            Consume(consumed);
+            remaining -= consumed;
+            if (status == CompressionStatus::End)
+            {
+                return !sizeKnown || (remaining == 0);
+            }
+        }
+    }
+
+    void StreamingUnpacker::Write(IStream* target, const std::uint8_t* data, std::size_t size)
+    {
+        if ((target == nullptr) || (size == 0))
+        {
+            return;
+        }
+        ULONG written = 0;
+        ThrowHrIfFailed(target->Write(data, static_cast<ULONG>(size), &written));
+        ThrowErrorIf(Error::FileWrite, (written != size), "write failed");
+    }
+
+    bool StreamingUnpacker::Ensure(std::size_t count)
+    {
+        while ((Available() < count) && !m_endOfInput)
+        {
+            if (m_begin != 0)
+            {   // Keeps the unconsumed bytes at the start of the buffer
+                std::memmove(m_buffer.data(), Data(), Available());
+                m_end -= m_begin;
+                m_begin = 0;
+            }
+            if (m_end == m_buffer.size())
+            {
+                m_buffer.resize(std::max(m_buffer.size() * 2, count));
+            }
+            ULONG bytesRead = 0;
+            ThrowHrIfFailed(m_input->Read(m_buffer.data() + m_end, static_cast<ULONG>(m_buffer.size() - m_end), &bytesRead));
+            if (bytesRead == 0)
+            {
+                m_endOfInput = true;
+                break;
+            }
+            Write(m_spool.Get(), m_buffer.data() + m_end, bytesRead);
+            m_end += bytesRead;
+        }
+        return Available() >= count;
+    }
+
+    void StreamingUnpacker::ReadToEnd()
+    {
+        while (!m_endOfInput)
+        {
+            Consume(Available());
+            Ensure(1);
+        }
+    }
+}
@@ -0,0 +1,388 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "TarStreamDirectory.hpp"
+#include "SpillStream.hpp"
+#include "StreamBase.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace MSIX {
+
+    namespace {
+        const std::size_t TarBlockSize = 512;
+        // The largest size a ustar header has room for, 11 octal digits
+        const std::uint64_t TarMaxSize = 077777777777ULL;
+
+        void WriteOctal(char* field, std::size_t fieldSize, std::uint64_t value)
+        {   // Zero padded and ended with a NUL
+            field[fieldSize - 1] = '\0';
+            for (std::size_t i = fieldSize - 1; i > 0; i--)
+            {
+                field[i - 1] = static_cast<char>('0' + (value & 7));
+                value >>= 3;
+            }
+        }
+
+        // "<length> <key>=<value>\n", the length counting the whole record
+        std::string PaxRecord(const std::string& key, const std::string& value)
+        {
+            auto length = key.size() + value.size() + 3;
+            auto digits = std::to_string(length).size();
+            while (std::to_string(length + digits).size() != digits) { digits++; }
+            return std::to_string(length + digits) + " " + key + "=" + value + "\n";
+        }
+
+        // Splits a name that is too long for the name field of a ustar header at a '/', the start going to the prefix
+        bool SplitName(const std::string& name, std::string& prefix, std::string& rest)
+        {
+            if (name.size() <= 100)
+            {
+                prefix.clear();
+                rest = name;
+                return true;
+            }
+            auto slash = name.rfind('/', 155);
+            while (slash != std::string::npos && slash != 0)
+            {
+                if (name.size() - slash - 1 <= 100 && slash + 1 < name.size())
+                {
+                    prefix = name.substr(0, slash);
+                    rest = name.substr(slash + 1);
+                    return true;
+                }
+                slash = name.rfind('/', slash - 1);
+            }
+            return false;
+        }
+    }
+
+    // Stream of one entry of a TarStreamDirectory. The bytes of an entry written in its turn go to the archive as
+    // they come, the others to a SpillStream until the file is committed.
+    class TarEntryStream final : public StreamBase
+    {
+    public:
+        TarEntryStream(TarStreamDirectory* directory, std::size_t index, std::uint64_t expectedSize) :
+            m_directory(directory), m_keepAlive(static_cast<IDirectoryObject*>(directory)), m_index(index),
+            m_expectedSize(expectedSize)
+        {}
+
+        ~TarEntryStream()
+        {
+            if (m_direct && !m_committed) { m_directory->AbortEntry(); }
+        }
+
+        // IStream
+        HRESULT STDMETHODCALLTYPE Write(const void* buffer, ULONG countBytes, ULONG* bytesWritten) noexcept override try
+        {
+            if (bytesWritten) { *bytesWritten = 0; }
+            ThrowErrorIf(Error::FileWrite, m_committed, "the file was already written");
+            Begin();
+            if (m_direct)
+            {
+                ThrowErrorIf(Error::FileWrite, (m_written + countBytes > m_expectedSize), "the file is larger than its size");
+                m_directory->WriteContent(buffer, countBytes);
+            }
+            else
+            {
+                ULONG written = 0;
+                ThrowHrIfFailed(m_content->Write(buffer, countBytes, &written));
+                ThrowErrorIf(Error::FileWrite, (written != countBytes), "write failed");
+            }
+            m_written += countBytes;
+            if (bytesWritten) { *bytesWritten = countBytes; }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Commit(DWORD) noexcept override try
+        {
+            if (m_committed) { return static_cast<HRESULT>(Error::OK); }
+            Begin();
+            if (m_direct)
+            {
+                ThrowErrorIf(Error::FileWrite, (m_written != m_expectedSize), "the file is smaller than its size");
+                m_committed = true;
+                m_directory->EndEntry(m_written);
+            }
+            else
+            {
+                m_committed = true;
+                ThrowHrIfFailed(m_content->Seek({ 0 }, StreamBase::Reference::START, nullptr));
+                m_directory->AddEntry(m_index, m_content, m_written);
+            }
+            return static_cast<HRESULT>(Error::OK);
+        } CATCH_RETURN();
+
+        // IStreamInternal
+        std::uint64_t GetSize() override { return m_written; }
+        bool IsCompressed() override { return false; }
+        std::string GetName() override { return {}; }
+
+    protected:
+        void Begin()
+        {
+            if (m_direct || m_content) { return; }
+            m_direct = m_directory->BeginEntry(m_index, m_expectedSize);
+            if (!m_direct)
+            {
+                m_content = ComPtr<IStream>::Make<SpillStream>();
+            }
+        }
+
+        TarStreamDirectory* m_directory;
+        ComPtr<IDirectoryObject> m_keepAlive;
+        std::size_t m_index;
+        std::uint64_t m_expectedSize;
+        std::uint64_t m_written = 0;
+        bool m_direct = false;
+        bool m_committed = false;
+        ComPtr<IStream> m_content;
+    };
+
+    TarStreamDirectory::TarStreamDirectory(const ComPtr<IStream>& output, MSIX_TAR_COMPRESSION compression) : m_output(output)
+    {
+        ThrowErrorIf(Error::InvalidParameter,
+            (compression != MSIX_TAR_COMPRESSION_NONE && compression != MSIX_TAR_COMPRESSION_GZIP), "Invalid compression");
+        #ifdef MSIX_PACK
+        if (compression == MSIX_TAR_COMPRESSION_GZIP)
+        {
+            m_zstrm.zalloc = Z_NULL;
+            m_zstrm.zfree = Z_NULL;
+            m_zstrm.opaque = Z_NULL;
+            // 16 more window bits ask zlib for a gzip header and trailer
+            auto result = deflateInit2(&m_zstrm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, 8, Z_DEFAULT_STRATEGY);
+            ThrowErrorIf(Error::DeflateInitialize, result != Z_OK, "Error calling deflateinit2");
+            m_gzip = true;
+            // No time and an unknown OS, so the header is the same wherever the archive is made. zlib writes it with
+            // the first deflate, it has to live until then.
+            m_gzipHeader = {};
+            m_gzipHeader.os = 255;
+            ThrowErrorIf(Error::DeflateInitialize, deflateSetHeader(&m_zstrm, &m_gzipHeader) != Z_OK, "Error setting the gzip header");
+            m_compressed.resize(64 * 1024);
+        }
+        #else
+        ThrowErrorIf(Error::NotSupported, (compression == MSIX_TAR_COMPRESSION_GZIP), "gzip requires a build with MSIX_PACK");
+        #endif
+    }
+
+    TarStreamDirectory::~TarStreamDirectory()
+    {
+        #ifdef MSIX_PACK
+        if (m_gzip) { deflateEnd(&m_zstrm); }
+        #endif
+    }
+
+    void TarStreamDirectory::Finish()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        ThrowErrorIf(Error::FileWrite, (m_failed || m_writing || m_next != m_order.size()), "a file of the archive wasn't written");
+        // The archive ends with two blocks of zeros
+        std::uint8_t end[2 * TarBlockSize] = {};
+        WriteOutput(end, sizeof(end));
+        #ifdef MSIX_PACK
+        if (m_gzip)
+        {
+            int result = Z_OK;
+            do
+            {
+                m_zstrm.next_in = Z_NULL;
+                m_zstrm.avail_in = 0;
+                m_zstrm.next_out = m_compressed.data();
+                m_zstrm.avail_out = static_cast<uInt>(m_compressed.size());
+                result = deflate(&m_zstrm, Z_FINISH);
+                ThrowErrorIf(Error::DeflateWrite, (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR), "Error deflating stream");
+                auto have = m_compressed.size() - m_zstrm.avail_out;
+                ULONG written = 0;
+                ThrowHrIfFailed(m_output->Write(m_compressed.data(), static_cast<ULONG>(have), &written));
+                ThrowErrorIf(Error::FileWrite, (written != have), "write failed");
+            } while (result != Z_STREAM_END);
+        }
+        #endif
+        ThrowHrIfFailed(m_output->Commit(STGC_DEFAULT));
+    }
+
+    ComPtr<IStream> TarStreamDirectory::OpenFile(const std::string& fileName, FileStream::Mode mode, std::uint64_t expectedSize)
+    {
+        ThrowErrorIf(Error::NotSupported, (mode != FileStream::Mode::WRITE), "tar archives can only be written");
+        return ComPtr<IStream>::Make<TarEntryStream>(this, GetIndex(fileName), expectedSize);
+    }
+
+    void TarStreamDirectory::CreateDirectories(const std::vector<std::string>& fileNames)
+    {
+        for (const auto& fileName : fileNames)
+        {
+            GetIndex(fileName);
+        }
+    }
+
+    void TarStreamDirectory::WriteFileContent(const std::string& fileName, const void* data, std::size_t size)
+    {
+        auto stream = OpenFile(fileName, FileStream::Mode::WRITE, size);
+        ULONG written = 0;
+        ThrowHrIfFailed(stream->Write(data, static_cast<ULONG>(size), &written));
+        ThrowErrorIf(Error::FileWrite, (written != size), "write failed");
+        ThrowHrIfFailed(stream->Commit(STGC_DEFAULT));
+    }
+
+    std::size_t TarStreamDirectory::GetIndex(const std::string& fileName)
+    {   // A file that wasn't given to CreateDirectories goes after the others
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto found = m_indexes.find(fileName);
+        if (found != m_indexes.end()) { return found->second; }
+        m_order.push_back(fileName);
+        m_indexes.emplace(fileName, m_order.size() - 1);
+        return m_order.size() - 1;
+    }
+
+    bool TarStreamDirectory::BeginEntry(std::size_t index, std::uint64_t size)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_writing || m_failed || index != m_next) { return false; }
+        WriteHeader(m_order[index], size, '0');
+        m_writing = true;
+        return true;
+    }
+
+    void TarStreamDirectory::WriteContent(const void* data, std::size_t size)
+    {   // Only the stream writing the next entry gets here, and nothing else is written while it does
+        WriteOutput(data, size);
+    }
+
+    void TarStreamDirectory::EndEntry(std::uint64_t size)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        WritePadding(size);
+        m_writing = false;
+        m_next++;
+        WriteReadyEntries();
+    }
+
+    void TarStreamDirectory::AddEntry(std::size_t index, const ComPtr<IStream>& content, std::uint64_t size)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (index < m_next) { return; }
+        m_ready[index] = std::make_pair(content, size);
+        if (!m_writing) { WriteReadyEntries(); }
+    }
+
+    void TarStreamDirectory::AbortEntry()
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_writing = false;
+        m_failed = true;
+    }
+
+    void TarStreamDirectory::WriteHeader(const std::string& name, std::uint64_t size, char type)
+    {   // The parents of a file come first, so the archive can be extracted by tools that don't create them
+        for (auto slash = name.find('/'); type == '0' && slash != std::string::npos; slash = name.find('/', slash + 1))
+        {
+            auto directory = name.substr(0, slash + 1);
+            if (m_directories.insert(directory).second)
+            {
+                WriteHeader(directory, 0, '5');
+            }
+        }
+
+        std::string prefix;
+        std::string rest;
+        std::string pax;
+        if (!SplitName(name, prefix, rest))
+        {
+            pax += PaxRecord("path", name);
+            rest = name.substr(0, 100);
+        }
+        if (size > TarMaxSize)
+        {
+            pax += PaxRecord("size", std::to_string(size));
+        }
+        if (!pax.empty())
+        {
+            WriteHeader("././@PaxHeader", pax.size(), 'x');
+            WriteOutput(pax.data(), pax.size());
+            WritePadding(pax.size());
+        }
+
+        char header[TarBlockSize] = {};
+        std::memcpy(header, rest.data(), std::min<std::size_t>(rest.size(), 100));
+        WriteOctal(header + 100, 8, (type == '5') ? 0755 : 0644);
+        WriteOctal(header + 108, 8, 0);
+        WriteOctal(header + 116, 8, 0);
+        WriteOctal(header + 124, 12, std::min(size, TarMaxSize));
+        WriteOctal(header + 136, 12, 0);
+        header[156] = type;
+        std::memcpy(header + 257, "ustar", 6);
+        std::memcpy(header + 263, "00", 2);
+        std::memcpy(header + 345, prefix.data(), std::min<std::size_t>(prefix.size(), 155));
+        // The checksum is counted with its own field as spaces
+        std::memset(header + 148, ' ', 8);
+        std::uint32_t checksum = 0;
+        for (auto byte : header) { checksum += static_cast<std::uint8_t>(byte); }
+        WriteOctal(header + 148, 7, checksum);
+        WriteOutput(header, sizeof(header));
+    }
+
+    void TarStreamDirectory::WriteReadyEntries()
+    {
+        for (auto entry = m_ready.find(m_next); entry != m_ready.end(); entry = m_ready.find(m_next))
+        {
+            auto size = entry->second.second;
+            WriteHeader(m_order[m_next], size, '0');
+            std::vector<std::uint8_t> buffer(static_cast<std::size_t>(std::min<std::uint64_t>(size, 64 * 1024)));
+            auto remaining = size;
+            while (remaining > 0)
+            {
+                ULONG read = 0;
+                ThrowHrIfFailed(entry->second.first->Read(buffer.data(), static_cast<ULONG>(std::min<std::uint64_t>(remaining, buffer.size())), &read));
+                ThrowErrorIf(Error::FileRead, (read == 0), "read failed");
+                WriteOutput(buffer.data(), read);
+                remaining -= read;
+            }
+            WritePadding(size);
+            m_ready.erase(entry);
+            m_next++;
+        }
+    }
+
+    void TarStreamDirectory::WritePadding(std::uint64_t size)
+    {
+        static const std::uint8_t zeros[TarBlockSize] = {};
+        auto padding = static_cast<std::size_t>((TarBlockSize - size % TarBlockSize) % TarBlockSize);
+        if (padding != 0) { WriteOutput(zeros, padding); }
+    }
+
+    void TarStreamDirectory::WriteOutput(const void* data, std::size_t size)
+    {
+        #ifdef MSIX_PACK
+        if (m_gzip)
+        {
+            m_zstrm.next_in = reinterpret_cast<Bytef*>(const_cast<void*>(data));
+            m_zstrm.avail_in = static_cast<uInt>(size);
+            while (m_zstrm.avail_in != 0)
+            {
+                m_zstrm.next_out = m_compressed.data();
+                m_zstrm.avail_out = static_cast<uInt>(m_compressed.size());
+                ThrowErrorIf(Error::DeflateWrite, deflate(&m_zstrm, Z_NO_FLUSH) != Z_OK, "Error deflating stream");
+                auto have = m_compressed.size() - m_zstrm.avail_out;
+                if (have != 0)
+                {
+                    ULONG written = 0;
+                    ThrowHrIfFailed(m_output->Write(m_compressed.data(), static_cast<ULONG>(have), &written));
+                    ThrowErrorIf(Error::FileWrite, (written != have), "write failed");
+                }
+            }
+            return;
+        }
+        #endif
+        auto bytes = reinterpret_cast<const std::uint8_t*>(data);
+        std::size_t offset = 0;
+        while (offset < size)
+        {
+            ULONG written = 0;
+            ThrowHrIfFailed(m_output->Write(bytes + offset, static_cast<ULONG>(size - offset), &written));
+            ThrowErrorIf(Error::FileWrite, (written == 0), "write failed");
+            offset += written;
+        }
+    }
+}
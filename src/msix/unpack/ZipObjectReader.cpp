@@ -7,69 +7,130 @@
 #include "ComHelper.hpp"
 #include "ZipFileStream.hpp"
 #include "InflateStream.hpp"
+#include "CachedRangeStream.hpp"
+#include "ReadAheadStream.hpp"
 
+#include <algorithm>
+#include <limits>
 #include <vector>
 
 namespace MSIX {
 
-    ZipObjectReader::ZipObjectReader(const ComPtr<IStream>& stream) : ZipObject(stream)
+    ZipObjectReader::ZipObjectReader(const ComPtr<IStream>& stream, bool deferLocalFileHeaders, const std::shared_ptr<BufferPool>& bufferPool,
+        const std::shared_ptr<PerformanceCounters>& performanceCounters) :
+        ZipObject(stream),
+        m_deferLocalFileHeaders(deferLocalFileHeaders),
+        m_bufferPool(bufferPool),
+        m_performanceCounters(performanceCounters)
     {
+        // Files are read through a read ahead layer, so the small reads of local file headers and of files
+        // stored next to each other become a few large sequential reads of the container. m_stream is kept
+        // as is because editing a package writes to it. Containers that are already buffered, like a package
+        // stored in a bundle, are read directly instead of copying their bytes into another set of windows.
+        auto streamInternal = m_stream.TryAs<IStreamInternal>();
+        if (streamInternal && streamInternal->IsBuffered())
+        {
+            m_readStream = m_stream;
+        }
+        else
+        {
+            m_readStream = ComPtr<IStream>::Make<ReadAheadStream>(m_stream);
+        }
+
+        // The end of central directory records, and for most packages the central directory itself, are in
+        // the last few KB of the container. Get them with one request instead of a read per field.
+        ULARGE_INTEGER size = {0};
+        ThrowHrIfFailed(m_stream->Seek({0}, StreamBase::Reference::END, &size));
+        std::uint64_t tailStart = (size.QuadPart > CentralDirectoryReadAhead) ? (size.QuadPart - CentralDirectoryReadAhead) : 0;
+        auto tail = ComPtr<IStream>::Make<CachedRangeStream>(m_stream, tailStart, CentralDirectoryReadAhead);
+
         LARGE_INTEGER pos = {0};
         pos.QuadPart = m_endCentralDirectoryRecord.Size();
         pos.QuadPart *= -1;
-        ThrowHrIfFailed(m_stream->Seek(pos, StreamBase::Reference::END, nullptr));
-        m_endCentralDirectoryRecord.Read(m_stream.Get());
+        ULARGE_INTEGER startOfEndCD = {0};
+        ThrowHrIfFailed(tail->Seek(pos, StreamBase::Reference::END, &startOfEndCD));
+        m_endCentralDirectoryRecord.Read(tail.Get());
 
         // find where the zip central directory exists.
         std::uint64_t offsetStartOfCD = 0;
+        std::uint64_t offsetEndOfCD = 0;
         std::uint64_t totalNumberOfEntries = 0;
         if (!m_endCentralDirectoryRecord.GetIsZip64())
         {
             offsetStartOfCD = m_endCentralDirectoryRecord.GetStartOfCentralDirectory();
+            offsetEndOfCD = startOfEndCD.QuadPart;
             totalNumberOfEntries = m_endCentralDirectoryRecord.GetNumberOfCentralDirectoryEntries();
         }
         else
         {   // Make sure that we have a zip64 end of central directory locator
             pos.QuadPart = m_endCentralDirectoryRecord.Size() + m_zip64Locator.Size();
             pos.QuadPart *= -1;
-            ThrowHrIfFailed(m_stream->Seek(pos, StreamBase::Reference::END, nullptr));
-            m_zip64Locator.Read(m_stream.Get());
+            ThrowHrIfFailed(tail->Seek(pos, StreamBase::Reference::END, nullptr));
+            m_zip64Locator.Read(tail.Get());
 
             // now read the end of zip central directory record
             pos.QuadPart = m_zip64Locator.GetRelativeOffset();
-            ThrowHrIfFailed(m_stream->Seek(pos, StreamBase::Reference::START, nullptr));
-            m_zip64EndOfCentralDirectory.Read(m_stream.Get());
+            ThrowHrIfFailed(tail->Seek(pos, StreamBase::Reference::START, nullptr));
+            m_zip64EndOfCentralDirectory.Read(tail.Get());
             offsetStartOfCD = m_zip64EndOfCentralDirectory.GetOffsetStartOfCD();
+            offsetEndOfCD = m_zip64Locator.GetRelativeOffset();
             totalNumberOfEntries = m_zip64EndOfCentralDirectory.GetTotalNumberOfEntries();
         }
 
-        // read the zip central directory
+        // read the zip central directory in one go and index it from memory
+        ThrowErrorIf(Error::ZipCentralDirectoryHeader, (offsetStartOfCD > offsetEndOfCD), "invalid start of central directory");
+        ThrowErrorIf(Error::ZipCentralDirectoryHeader, (offsetEndOfCD - offsetStartOfCD > std::numeric_limits<ULONG>::max()),
+            "central directory too big");
+        std::vector<std::uint8_t> centralDirectory(static_cast<std::size_t>(offsetEndOfCD - offsetStartOfCD));
         pos.QuadPart = offsetStartOfCD;
-        ThrowHrIfFailed(m_stream->Seek(pos, StreamBase::Reference::START, nullptr));
-        for (std::uint32_t index = 0; index < totalNumberOfEntries; index++)
-        {
-            auto centralFileHeader = CentralDirectoryFileHeader();
-            centralFileHeader.Read(m_stream.Get(), m_endCentralDirectoryRecord.GetIsZip64());
-            // TODO: ensure that there are no collisions on name!
-            m_centralDirectories.insert(std::make_pair(centralFileHeader.GetFileName(), std::move(centralFileHeader)));
-        }
+        ThrowHrIfFailed(tail->Seek(pos, StreamBase::Reference::START, nullptr));
+        ULONG bytesRead = 0;
+        ThrowHrIfFailed(tail->Read(centralDirectory.data(), static_cast<ULONG>(centralDirectory.size()), &bytesRead));
+        ThrowErrorIf(Error::FileRead, (bytesRead != centralDirectory.size()), "Entire object wasn't read!");
+
+        auto sizeOfHeaders = m_centralDirectoryIndex.Parse(std::move(centralDirectory), offsetStartOfCD, totalNumberOfEntries,
+            m_endCentralDirectoryRecord.GetIsZip64());
+        m_sizeOfCentralDirectoryHeaders = sizeOfHeaders;
+        m_startOfCentralDirectory = offsetStartOfCD;
+        m_containerSize = size.QuadPart;
 
         if (m_endCentralDirectoryRecord.GetIsZip64())
         {   // We should have no data between the end of the last central directory header and the start of the EoCD
-            ULARGE_INTEGER uPos = {0};
-            ThrowHrIfFailed(m_stream->Seek({0}, StreamBase::Reference::CURRENT, &uPos));
-            ThrowErrorIfNot(Error::ZipHiddenData, (uPos.QuadPart == m_zip64Locator.GetRelativeOffset()), "hidden data unsupported");
+            ThrowErrorIfNot(Error::ZipHiddenData, (offsetStartOfCD + sizeOfHeaders == offsetEndOfCD), "hidden data unsupported");
         }
+
+        // Keep the records after the central directory headers, the signature digest of the central directory covers them
+        ThrowErrorIf(Error::ZipHiddenData, (size.QuadPart - offsetEndOfCD > CentralDirectoryReadAhead), "hidden data unsupported");
+        m_endOfCentralDirectory.resize(static_cast<std::size_t>(size.QuadPart - offsetEndOfCD));
+        pos.QuadPart = offsetEndOfCD;
+        ThrowHrIfFailed(tail->Seek(pos, StreamBase::Reference::START, nullptr));
+        ThrowHrIfFailed(tail->Read(m_endOfCentralDirectory.data(), static_cast<ULONG>(m_endOfCentralDirectory.size()), &bytesRead));
+        ThrowErrorIf(Error::FileRead, (bytesRead != m_endOfCentralDirectory.size()), "Entire object wasn't read!");
     }
 
     // IStoreageObject
-        std::vector<std::string> ZipObjectReader::GetFileNames(FileNameOptions)
+    // The names are in the order their files are stored in the container, so reading the files in this
+    // order is a single sequential sweep of the container.
+    std::vector<std::string> ZipObjectReader::GetFileNames(FileNameOptions)
     {
-        std::vector<std::string> result;
-        std::for_each(m_centralDirectories.begin(), m_centralDirectories.end(), [&result](auto it)
+        const auto& entries = m_centralDirectoryIndex.GetEntries();
+        std::vector<const CentralDirectoryIndex::Entry*> sorted;
+        sorted.reserve(entries.size());
+        for (const auto& entry : entries)
         {
-            result.push_back(it.first);
+            sorted.push_back(&entry);
+        }
+        std::stable_sort(sorted.begin(), sorted.end(), [](const CentralDirectoryIndex::Entry* left, const CentralDirectoryIndex::Entry* right)
+        {
+            return left->relativeOffsetOfLocalHeader < right->relativeOffsetOfLocalHeader;
         });
+
+        std::vector<std::string> result;
+        result.reserve(sorted.size());
+        for (const auto entry : sorted)
+        {
+            result.push_back(m_centralDirectoryIndex.GetFileName(*entry));
+        }
         return result;
     }
 
@@ -80,36 +141,212 @@ namespace MSIX {
         auto result = m_streams.find(fileName);
         if (result == m_streams.end())
         {
-            auto centralFileHeader = m_centralDirectories.find(fileName);
-            if(centralFileHeader == m_centralDirectories.end())
+            auto centralFileHeader = m_centralDirectoryIndex.Find(fileName);
+            if(centralFileHeader == nullptr)
             {
                 return ComPtr<IStream>();
             }
-            LARGE_INTEGER pos = {0};
-            pos.QuadPart = centralFileHeader->second.GetRelativeOffsetOfLocalHeader();
-            ThrowHrIfFailed(m_stream->Seek(pos, MSIX::StreamBase::Reference::START, nullptr));
-            LocalFileHeader lfh = LocalFileHeader();
-            lfh.Read(m_stream.Get(), centralFileHeader->second);
-
-            auto fileStream = ComPtr<IStream>::Make<ZipFileStream>(
-                centralFileHeader->first,
-                centralFileHeader->second.GetCompressionMethod() == CompressionType::Deflate,
-                centralFileHeader->second.GetRelativeOffsetOfLocalHeader() + lfh.Size(),
-                centralFileHeader->second.GetCompressedSize(),
-                m_stream.Get()
-            );
-
-            if (centralFileHeader->second.GetCompressionMethod() == CompressionType::Deflate)
+            ComPtr<IStream> fileStream = OpenRawFile(fileName, *centralFileHeader);
+            if (centralFileHeader->compressionMethod == CompressionType::Deflate)
             {
-                fileStream = ComPtr<IStream>::Make<InflateStream>(std::move(fileStream), centralFileHeader->second.GetUncompressedSize());
+                fileStream = ComPtr<IStream>::Make<InflateStream>(std::move(fileStream), centralFileHeader->uncompressedSize,
+                    DefaultInflateBufferSize, m_bufferPool, m_performanceCounters);
             }
             ComPtr<IStream> result(fileStream);
-            m_streams.insert(std::make_pair(centralFileHeader->first, std::move(fileStream)));
+            m_streams.insert(std::make_pair(fileName, std::move(fileStream)));
             return result;
         }
         return result->second;
     }
 
+    ComPtr<IStream> ZipObjectReader::GetRawFile(const std::string& fileName)
+    {
+        auto centralFileHeader = m_centralDirectoryIndex.Find(fileName);
+        if (centralFileHeader == nullptr)
+        {
+            return ComPtr<IStream>();
+        }
+        return OpenRawFile(fileName, *centralFileHeader);
+    }
+
+    ComPtr<IStream> ZipObjectReader::OpenRawFile(const std::string& fileName, const CentralDirectoryIndex::Entry& centralFileHeader)
+    {
+        if (m_deferLocalFileHeaders)
+        {
+            return ComPtr<IStream>::Make<ZipFileStream>(
+                fileName,
+                centralFileHeader.compressionMethod == CompressionType::Deflate,
+                centralFileHeader.relativeOffsetOfLocalHeader,
+                centralFileHeader.hasDataDescriptor,
+                centralFileHeader.compressedSize,
+                m_readStream.Get(),
+                m_streamLock
+            );
+        }
+
+        // Raw files can be opened while other files are read
+        std::unique_lock<std::mutex> lock(*m_streamLock);
+        LARGE_INTEGER pos = {0};
+        pos.QuadPart = centralFileHeader.relativeOffsetOfLocalHeader;
+        ThrowHrIfFailed(m_readStream->Seek(pos, MSIX::StreamBase::Reference::START, nullptr));
+        LocalFileHeader lfh = LocalFileHeader();
+        lfh.Read(m_readStream.Get(), centralFileHeader.hasDataDescriptor);
+        lock.unlock();
+
+        return ComPtr<IStream>::Make<ZipFileStream>(
+            fileName,
+            centralFileHeader.compressionMethod == CompressionType::Deflate,
+            centralFileHeader.relativeOffsetOfLocalHeader + lfh.GetHeaderSize(),
+            centralFileHeader.compressedSize,
+            m_readStream.Get(),
+            m_streamLock
+        );
+    }
+
+    // IZipReader
+    // Without its last file, the central directory of a container would start where the local file header of
+    // that file is and have one header less. The sizes, counts and offsets of the end records are changed to match.
+    std::vector<std::uint8_t> ZipObjectReader::GetCentralDirectoryWithoutFile(const std::string& fileName)
+    {
+        auto entry = m_centralDirectoryIndex.Find(fileName);
+        ThrowErrorIf(Error::FileNotFound, (entry == nullptr), fileName.c_str());
+        const auto& headers = m_centralDirectoryIndex.GetBuffer();
+        auto range = m_centralDirectoryIndex.GetHeaderRange(*entry);
+
+        std::vector<std::uint8_t> result;
+        result.reserve(m_sizeOfCentralDirectoryHeaders - range.second + m_endOfCentralDirectory.size());
+        result.insert(result.end(), headers.begin(), headers.begin() + range.first);
+        result.insert(result.end(), headers.begin() + range.first + range.second, headers.begin() + m_sizeOfCentralDirectoryHeaders);
+        std::uint64_t sizeOfCD = result.size();
+        std::uint64_t startOfCD = entry->relativeOffsetOfLocalHeader;
+        std::size_t endRecords = result.size();
+        result.insert(result.end(), m_endOfCentralDirectory.begin(), m_endOfCentralDirectory.end());
+
+        // Values that don't fit their field are in the zip64 records, they stay as they are
+        auto update = [&result](std::size_t offset, std::uint64_t value, std::size_t size)
+        {
+            ThrowErrorIf(Error::ZipCentralDirectoryHeader, (offset + size > result.size()), "invalid end of central directory");
+            std::uint64_t current = 0;
+            for (std::size_t i = 0; i < size; i++) { current |= static_cast<std::uint64_t>(result[offset + i]) << (8 * i); }
+            if (size < sizeof(std::uint64_t) && current == ((std::uint64_t(1) << (8 * size)) - 1)) { return; }
+            for (std::size_t i = 0; i < size; i++) { result[offset + i] = static_cast<std::uint8_t>(value >> (8 * i)); }
+        };
+        std::size_t endRecord = result.size() - m_endCentralDirectoryRecord.Size();
+        if (m_endCentralDirectoryRecord.GetIsZip64())
+        {
+            auto entries = m_zip64EndOfCentralDirectory.GetTotalNumberOfEntries() - 1;
+            update(endRecords + 24, entries, 8);   // entries on this disk
+            update(endRecords + 32, entries, 8);   // total entries
+            update(endRecords + 40, sizeOfCD, 8);
+            update(endRecords + 48, startOfCD, 8);
+            update(endRecord - m_zip64Locator.Size() + 8, startOfCD + sizeOfCD, 8);
+        }
+        auto entries = m_endCentralDirectoryRecord.GetNumberOfCentralDirectoryEntries() - 1;
+        update(endRecord + 8, entries, 2);   // entries on this disk
+        update(endRecord + 10, entries, 2);  // total entries
+        update(endRecord + 12, sizeOfCD, 4);
+        update(endRecord + 16, startOfCD, 4);
+        return result;
+    }
+
+    ComPtr<IStream> ZipObjectReader::GetFileRecordsBeforeFile(const std::string& fileName)
+    {
+        auto entry = m_centralDirectoryIndex.Find(fileName);
+        ThrowErrorIf(Error::FileNotFound, (entry == nullptr), fileName.c_str());
+        return ComPtr<IStream>::Make<RangeStream>(0, entry->relativeOffsetOfLocalHeader, m_stream.Get());
+    }
+
+    // The sizes of a data descriptor are 8 bytes for zip64 files and 4 bytes otherwise, and its signature is
+    // optional, so its size is found by matching its fields with the sizes of the central directory.
+    ZipFileRecords ZipObjectReader::GetFileRecords(const std::string& fileName)
+    {
+        auto entry = m_centralDirectoryIndex.Find(fileName);
+        ThrowErrorIf(Error::FileNotFound, (entry == nullptr), fileName.c_str());
+
+        ZipFileRecords result;
+        result.isCompressed = (entry->compressionMethod == CompressionType::Deflate);
+        std::lock_guard<std::mutex> lock(*m_streamLock);
+        LARGE_INTEGER pos = {0};
+        pos.QuadPart = entry->relativeOffsetOfLocalHeader;
+        ThrowHrIfFailed(m_readStream->Seek(pos, MSIX::StreamBase::Reference::START, nullptr));
+        LocalFileHeader lfh = LocalFileHeader();
+        lfh.Read(m_readStream.Get(), entry->hasDataDescriptor);
+        result.localFileHeader = ZipByteRange{ entry->relativeOffsetOfLocalHeader, lfh.GetHeaderSize() };
+        result.data = ZipByteRange{ result.localFileHeader.offset + result.localFileHeader.size, entry->compressedSize };
+        if (!entry->hasDataDescriptor)
+        {
+            result.dataDescriptor.offset = result.data.offset + result.data.size;
+            return result;
+        }
+
+        std::uint8_t descriptor[24] = {};
+        pos.QuadPart = result.data.offset + result.data.size;
+        ThrowHrIfFailed(m_readStream->Seek(pos, MSIX::StreamBase::Reference::START, nullptr));
+        ULONG bytesRead = 0;
+        ThrowHrIfFailed(m_readStream->Read(descriptor, sizeof(descriptor), &bytesRead));
+        std::size_t fields = (bytesRead >= 4 &&
+            Meta::LoadLittleEndian<std::uint32_t>(descriptor) == static_cast<std::uint32_t>(Signatures::DataDescriptor)) ? 4 : 0;
+        std::size_t size = 0;
+        if ((fields + 20 <= bytesRead) &&
+            (Meta::LoadLittleEndian<std::uint64_t>(descriptor + fields + 4) == entry->compressedSize) &&
+            (Meta::LoadLittleEndian<std::uint64_t>(descriptor + fields + 12) == entry->uncompressedSize))
+        {
+            size = fields + 20;
+        }
+        else if ((fields + 12 <= bytesRead) &&
+            (Meta::LoadLittleEndian<std::uint32_t>(descriptor + fields + 4) == entry->compressedSize) &&
+            (Meta::LoadLittleEndian<std::uint32_t>(descriptor + fields + 8) == entry->uncompressedSize))
+        {
+            size = fields + 12;
+        }
+        ThrowErrorIf(Error::ZipLocalFileHeader, (size == 0), "data descriptor doesn't match the central directory");
+        result.dataDescriptor = ZipByteRange{ result.data.offset + result.data.size, size };
+        return result;
+    }
+
+    ZipByteRange ZipObjectReader::GetCentralDirectoryRange()
+    {
+        return ZipByteRange{ m_startOfCentralDirectory, m_containerSize - m_startOfCentralDirectory };
+    }
+
+    Sha256Digest ZipObjectReader::GetCentralDirectoryHash()
+    {
+        SHA256 engine;
+        engine.HashData(m_centralDirectoryIndex.GetBuffer().data(), static_cast<std::uint32_t>(m_sizeOfCentralDirectoryHeaders));
+        engine.HashData(m_endOfCentralDirectory.data(), static_cast<std::uint32_t>(m_endOfCentralDirectory.size()));
+        Sha256Digest hash;
+        engine.FinalizeAndGetHashValue(hash);
+        return hash;
+    }
+
+    // A data descriptor is at most 24 bytes, with its signature and zip64 sizes
+    ZipByteRange ZipObjectReader::GetStoredFileRange(const std::string& fileName)
+    {
+        auto entry = m_centralDirectoryIndex.Find(fileName);
+        if (entry == nullptr) { return ZipByteRange(); }
+        return ZipByteRange{ entry->relativeOffsetOfLocalHeader, LocalFileHeader::FixedSize + entry->nameLength + entry->extraLength +
+            entry->compressedSize + (entry->hasDataDescriptor ? 24 : 0) };
+    }
+
+    bool ZipObjectReader::Prefetch(const std::vector<ZipByteRange>& ranges)
+    {
+        auto streamInternal = m_readStream.TryAs<IStreamInternal>();
+        if (!streamInternal) { return false; }
+        std::vector<StreamRange> streamRanges;
+        streamRanges.reserve(ranges.size());
+        for (const auto& range : ranges)
+        {
+            streamRanges.push_back(StreamRange{ range.offset, range.size });
+        }
+        return streamInternal->Prefetch(streamRanges.data(), streamRanges.size());
+    }
+
+    std::string ZipObjectReader::GetFileIdentity()
+    {
+        auto streamInternal = m_stream.TryAs<IStreamInternal>();
+        return streamInternal ? streamInternal->GetFileIdentity() : std::string();
+    }
+
     std::string ZipObjectReader::GetFileName()
     {
         return m_stream.As<IStreamInternal>()->GetName();
@@ -0,0 +1,192 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "PackageFileSystem.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+using MSIX::ComPtr;
+
+namespace MsixMount {
+
+    namespace
+    {
+        LPVOID STDMETHODCALLTYPE Allocate(SIZE_T cb) { return std::malloc(cb); }
+        void STDMETHODCALLTYPE Free(LPVOID pv)       { std::free(pv); }
+
+        // Throws with the SDK log text when an API fails
+        void ThrowIfFailed(HRESULT hr, const std::string& what)
+        {
+            if (FAILED(hr))
+            {
+                std::ostringstream message;
+                message << what << " failed with 0x" << std::hex << static_cast<std::uint32_t>(hr);
+                char* logText = nullptr;
+                if (SUCCEEDED(MsixGetLogTextUTF8(Allocate, &logText)) && logText != nullptr)
+                {
+                    message << ": " << logText;
+                    Free(logText);
+                }
+                throw std::runtime_error(message.str());
+            }
+        }
+    }
+
+    BlockCache::Block BlockCache::Find(const Key& key)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto found = m_index.find(key);
+        if (found == m_index.end())
+        {
+            m_misses++;
+            return nullptr;
+        }
+        m_hits++;
+        m_blocks.splice(m_blocks.begin(), m_blocks, found->second);
+        return found->second->second;
+    }
+
+    void BlockCache::Add(const Key& key, const Block& block)
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_capacity == 0 || m_index.find(key) != m_index.end())
+        {   // Another thread read the same block
+            return;
+        }
+        if (m_blocks.size() == m_capacity)
+        {
+            m_index.erase(m_blocks.back().first);
+            m_blocks.pop_back();
+        }
+        m_blocks.emplace_front(key, block);
+        m_index[key] = m_blocks.begin();
+    }
+
+    PackageFileSystem::PackageFileSystem(const std::string& package, MSIX_VALIDATION_OPTION validation, std::size_t cacheBlocks) :
+        m_cache(cacheBlocks)
+    {
+        ComPtr<IStream> stream;
+        ThrowIfFailed(CreateStreamOnFile(const_cast<char*>(package.c_str()), true, &stream), "CreateStreamOnFile " + package);
+        ComPtr<IAppxFactory> factory;
+        ThrowIfFailed(CoCreateAppxFactoryWithHeapAndOptions(Allocate, Free, validation, MSIX_FACTORY_OPTION_READER_DEFER_PAYLOAD_FILES,
+            &factory), "CoCreateAppxFactoryWithHeapAndOptions");
+        ThrowIfFailed(factory->CreatePackageReader(stream.Get(), &m_reader), "CreatePackageReader");
+
+        m_entries["/"].isDirectory = true;
+        const APPX_FOOTPRINT_FILE_TYPE footprintFiles[] = { APPX_FOOTPRINT_FILE_TYPE_MANIFEST, APPX_FOOTPRINT_FILE_TYPE_BLOCKMAP,
+            APPX_FOOTPRINT_FILE_TYPE_SIGNATURE, APPX_FOOTPRINT_FILE_TYPE_CODEINTEGRITY, APPX_FOOTPRINT_FILE_TYPE_CONTENTGROUPMAP };
+        for (auto type : footprintFiles)
+        {   // A package doesn't have to have all of them
+            ComPtr<IAppxFile> file;
+            if (SUCCEEDED(m_reader->GetFootprintFile(type, &file)) && file)
+            {
+                AddFile(file.Get());
+            }
+        }
+
+        ComPtr<IAppxFilesEnumerator> files;
+        ThrowIfFailed(m_reader->GetPayloadFiles(&files), "GetPayloadFiles");
+        BOOL hasCurrent = FALSE;
+        ThrowIfFailed(files->GetHasCurrent(&hasCurrent), "GetHasCurrent");
+        while (hasCurrent)
+        {
+            ComPtr<IAppxFile> file;
+            ThrowIfFailed(files->GetCurrent(&file), "GetCurrent");
+            AddFile(file.Get());
+            ThrowIfFailed(files->MoveNext(&hasCurrent), "MoveNext");
+        }
+    }
+
+    void PackageFileSystem::AddFile(IAppxFile* file)
+    {
+        char* name = nullptr;
+        ThrowIfFailed(ComPtr<IAppxFile>(file).As<IAppxFileUtf8>()->GetName(&name), "GetName");
+        std::string path = "/" + std::string(name);
+        Free(name);
+        std::replace(path.begin(), path.end(), '\\', '/');
+
+        auto content = std::make_unique<File>();
+        UINT64 size = 0;
+        ThrowIfFailed(file->GetSize(&size), "GetSize");
+        content->size = size;
+        ThrowIfFailed(file->GetStream(&content->stream), "GetStream");
+
+        Entry& entry = m_entries[path];
+        entry.size = content->size;
+        entry.file = m_files.size();
+        m_files.push_back(std::move(content));
+
+        // Directories only exist in the names of their files
+        for (auto separator = path.rfind('/'); ; separator = path.rfind('/', separator - 1))
+        {
+            auto parent = (separator == 0) ? std::string("/") : path.substr(0, separator);
+            auto child = path.substr(separator + 1, path.find('/', separator + 1) - separator - 1);
+            Entry& directory = m_entries[parent];
+            directory.isDirectory = true;
+            directory.children.insert(child);
+            if (separator == 0) { break; }
+        }
+    }
+
+    const PackageFileSystem::Entry* PackageFileSystem::Find(const std::string& path) const
+    {
+        auto found = m_entries.find(path);
+        return (found == m_entries.end()) ? nullptr : &found->second;
+    }
+
+    std::size_t PackageFileSystem::Read(const Entry& entry, std::uint64_t offset, std::size_t size, std::uint8_t* buffer)
+    {
+        if (entry.isDirectory || offset >= entry.size)
+        {
+            return 0;
+        }
+        size = static_cast<std::size_t>(std::min(static_cast<std::uint64_t>(size), entry.size - offset));
+        std::size_t result = 0;
+        while (result < size)
+        {
+            auto position = offset + result;
+            auto block = GetBlock(entry.file, position / BlockSize);
+            auto positionInBlock = static_cast<std::size_t>(position % BlockSize);
+            if (positionInBlock >= block->size())
+            {
+                break;
+            }
+            auto count = std::min(size - result, block->size() - positionInBlock);
+            std::memcpy(buffer + result, block->data() + positionInBlock, count);
+            result += count;
+        }
+        return result;
+    }
+
+    BlockCache::Block PackageFileSystem::GetBlock(std::size_t file, std::uint64_t block)
+    {
+        BlockCache::Key key(file, block);
+        auto cached = m_cache.Find(key);
+        if (cached)
+        {
+            return cached;
+        }
+
+        // The whole block is read, so its hash is checked
+        File& content = *m_files[file];
+        auto offset = block * BlockSize;
+        auto data = std::make_shared<std::vector<std::uint8_t>>(static_cast<std::size_t>(std::min(BlockSize, content.size - offset)));
+        {
+            std::lock_guard<std::mutex> lock(content.lock);
+            LARGE_INTEGER position = { 0 };
+            position.QuadPart = static_cast<LONGLONG>(offset);
+            ThrowIfFailed(content.stream->Seek(position, STREAM_SEEK_SET, nullptr), "Seek");
+            ULONG read = 0;
+            ThrowIfFailed(content.stream->Read(data->data(), static_cast<ULONG>(data->size()), &read), "Read");
+            data->resize(read);
+        }
+        m_cache.Add(key, data);
+        return data;
+    }
+}
@@ -0,0 +1,97 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#pragma once
+#include "MSIXWindows.hpp"
+#include "AppxPackaging.hpp"
+#include "ComHelper.hpp"
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace MsixMount {
+
+    // Size of the blocks of the block map, the unit files are read and verified in
+    const std::uint64_t BlockSize = 65536;
+
+    // Least recently used blocks of the files of a package, up to a number of blocks. Thread safe.
+    class BlockCache
+    {
+    public:
+        using Key = std::pair<std::size_t, std::uint64_t>;
+        using Block = std::shared_ptr<const std::vector<std::uint8_t>>;
+
+        BlockCache(std::size_t capacity) : m_capacity(capacity) {}
+
+        // Null if the block isn't cached
+        Block Find(const Key& key);
+        void Add(const Key& key, const Block& block);
+
+        std::uint64_t GetHits() const { return m_hits; }
+        std::uint64_t GetMisses() const { return m_misses; }
+
+    protected:
+        std::size_t m_capacity;
+        std::mutex m_lock;
+        // Most recently used first
+        std::list<std::pair<Key, Block>> m_blocks;
+        std::map<Key, std::list<std::pair<Key, Block>>::iterator> m_index;
+        std::uint64_t m_hits = 0;
+        std::uint64_t m_misses = 0;
+    };
+
+    // The files of a package as a read-only tree of directories. The package is opened with its payload files
+    // validated when first read, so it is available at once whatever its size. A read only decodes the blocks
+    // of the block map it covers, seeking in deflated files to the start of the block, and every block is
+    // checked against its hash in the block map before anything of it is returned.
+    // Paths start with '/', which is the root directory. Thread safe.
+    class PackageFileSystem
+    {
+    public:
+        struct Entry
+        {
+            bool isDirectory = false;
+            std::uint64_t size = 0;
+            // Index of the file, for files
+            std::size_t file = 0;
+            // Names in the directory, for directories
+            std::set<std::string> children;
+        };
+
+        PackageFileSystem(const std::string& package, MSIX_VALIDATION_OPTION validation, std::size_t cacheBlocks);
+
+        // Null if there is nothing at path
+        const Entry* Find(const std::string& path) const;
+
+        // Reads up to size bytes of the file at offset to buffer. Returns the number of bytes read, less than size
+        // only at the end of the file.
+        std::size_t Read(const Entry& entry, std::uint64_t offset, std::size_t size, std::uint8_t* buffer);
+
+        const BlockCache& GetCache() const { return m_cache; }
+
+    protected:
+        // Files are read one block at a time from their stream, which can't be shared by threads
+        struct File
+        {
+            MSIX::ComPtr<IStream> stream;
+            std::uint64_t size = 0;
+            std::mutex lock;
+        };
+
+        void AddFile(IAppxFile* file);
+        BlockCache::Block GetBlock(std::size_t file, std::uint64_t block);
+
+        MSIX::ComPtr<IAppxPackageReader> m_reader;
+        std::map<std::string, Entry> m_entries;
+        std::vector<std::unique_ptr<File>> m_files;
+        BlockCache m_cache;
+    };
+}
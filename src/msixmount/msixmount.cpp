@@ -0,0 +1,178 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+// Mounts the files of a package as a read-only file system with FUSE
+#define FUSE_USE_VERSION 31
+#include <fuse.h>
+
+#include "PackageFileSystem.hpp"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/stat.h>
+#include <fcntl.h>
+
+namespace MsixMount {
+
+    struct Options
+    {
+        std::string package;
+        std::string mountPoint;
+        MSIX_VALIDATION_OPTION validation = MSIX_VALIDATION_OPTION_FULL;
+        std::size_t cacheMegabytes = 64;
+        bool foreground = false;
+    };
+
+    std::unique_ptr<PackageFileSystem> FileSystem;
+
+    int GetAttributes(const char* path, struct stat* attributes, struct fuse_file_info*)
+    {
+        auto entry = FileSystem->Find(path);
+        if (entry == nullptr) { return -ENOENT; }
+        std::memset(attributes, 0, sizeof(*attributes));
+        if (entry->isDirectory)
+        {
+            attributes->st_mode = S_IFDIR | 0555;
+            attributes->st_nlink = 2;
+        }
+        else
+        {
+            attributes->st_mode = S_IFREG | 0444;
+            attributes->st_nlink = 1;
+            attributes->st_size = static_cast<off_t>(entry->size);
+            attributes->st_blocks = static_cast<blkcnt_t>((entry->size + 511) / 512);
+        }
+        return 0;
+    }
+
+    int ReadDirectory(const char* path, void* buffer, fuse_fill_dir_t fill, off_t, struct fuse_file_info*, enum fuse_readdir_flags)
+    {
+        auto entry = FileSystem->Find(path);
+        if (entry == nullptr) { return -ENOENT; }
+        if (!entry->isDirectory) { return -ENOTDIR; }
+        fill(buffer, ".", nullptr, 0, static_cast<fuse_fill_dir_flags>(0));
+        fill(buffer, "..", nullptr, 0, static_cast<fuse_fill_dir_flags>(0));
+        for (const auto& child : entry->children)
+        {
+            fill(buffer, child.c_str(), nullptr, 0, static_cast<fuse_fill_dir_flags>(0));
+        }
+        return 0;
+    }
+
+    int Open(const char* path, struct fuse_file_info* info)
+    {
+        auto entry = FileSystem->Find(path);
+        if (entry == nullptr) { return -ENOENT; }
+        if (entry->isDirectory) { return -EISDIR; }
+        if ((info->flags & O_ACCMODE) != O_RDONLY) { return -EROFS; }
+        // The content of a package never changes, the kernel can keep what it read
+        info->keep_cache = 1;
+        return 0;
+    }
+
+    int Read(const char* path, char* buffer, size_t size, off_t offset, struct fuse_file_info*)
+    {
+        auto entry = FileSystem->Find(path);
+        if (entry == nullptr) { return -ENOENT; }
+        try
+        {
+            return static_cast<int>(FileSystem->Read(*entry, static_cast<std::uint64_t>(offset), size, reinterpret_cast<std::uint8_t*>(buffer)));
+        }
+        catch (const std::exception& e)
+        {   // Most likely a block that doesn't match the block map
+            std::cerr << path << ": " << e.what() << std::endl;
+            return -EIO;
+        }
+    }
+
+    void Destroy(void*)
+    {
+        if (FileSystem && FileSystem->GetCache().GetHits() + FileSystem->GetCache().GetMisses() != 0)
+        {
+            std::cerr << "Block cache: " << FileSystem->GetCache().GetHits() << " hits, "
+                << FileSystem->GetCache().GetMisses() << " misses" << std::endl;
+        }
+    }
+
+    int Help(const char* toolName)
+    {
+        std::cout << "Usage:" << std::endl;
+        std::cout << "    " << toolName << " -p <package> -m <mountpoint> [options]" << std::endl;
+        std::cout << std::endl;
+        std::cout << "Mounts the files of <package> as a read-only file system at <mountpoint>. Files are" << std::endl;
+        std::cout << "decoded and checked against the block map one block at a time as they are read." << std::endl;
+        std::cout << "Unmount with fusermount -u <mountpoint>, or umount on macOS." << std::endl;
+        std::cout << std::endl;
+        std::cout << "Options:" << std::endl;
+        std::cout << "    -cache <MB>   Keeps up to <MB> megabytes of decoded blocks, 64 by default." << std::endl;
+        std::cout << "    -ac           Allows any certificate. By default the signature origin must be known." << std::endl;
+        std::cout << "    -ss           Skips enforcement of signed packages. By default packages must be signed." << std::endl;
+        std::cout << "    -f            Stays in the foreground and prints the block cache hits when unmounted." << std::endl;
+        std::cout << "    -?            Displays this help text." << std::endl;
+        return 0;
+    }
+
+    bool ParseOptions(int argc, char* argv[], Options& options)
+    {
+        for (int index = 1; index < argc; index++)
+        {
+            std::string option = argv[index];
+            bool hasValue = (index + 1 < argc);
+            if (option == "-p" && hasValue) { options.package = argv[++index]; }
+            else if (option == "-m" && hasValue) { options.mountPoint = argv[++index]; }
+            else if (option == "-cache" && hasValue) { options.cacheMegabytes = static_cast<std::size_t>(std::stoul(argv[++index])); }
+            else if (option == "-ac")
+            {
+                options.validation = static_cast<MSIX_VALIDATION_OPTION>(options.validation | MSIX_VALIDATION_OPTION_ALLOWSIGNATUREORIGINUNKNOWN);
+            }
+            else if (option == "-ss")
+            {
+                options.validation = static_cast<MSIX_VALIDATION_OPTION>(options.validation | MSIX_VALIDATION_OPTION_SKIPSIGNATURE);
+            }
+            else if (option == "-f") { options.foreground = true; }
+            else { return false; }
+        }
+        return !options.package.empty() && !options.mountPoint.empty();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    using namespace MsixMount;
+
+    Options options;
+    if (!ParseOptions(argc, argv, options))
+    {
+        return Help(argv[0]) + 1;
+    }
+
+    try
+    {
+        auto cacheBlocks = static_cast<std::size_t>(options.cacheMegabytes * 1024 * 1024 / BlockSize);
+        FileSystem.reset(new PackageFileSystem(options.package, options.validation, cacheBlocks));
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    struct fuse_operations operations = {};
+    operations.getattr = GetAttributes;
+    operations.readdir = ReadDirectory;
+    operations.open = Open;
+    operations.read = Read;
+    operations.destroy = Destroy;
+
+    std::vector<const char*> fuseArguments = { argv[0], options.mountPoint.c_str(), "-o", "ro", "-o", "fsname=msixmount" };
+    if (options.foreground) { fuseArguments.push_back("-f"); }
+    return fuse_main(static_cast<int>(fuseArguments.size()), const_cast<char**>(fuseArguments.data()), &operations, nullptr);
+}
@@ -0,0 +1,89 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+// 
+#include "BenchFileHelpers.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <cstdio>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+
+namespace MsixBench {
+
+    namespace Directory {
+
+        bool CreateDirectories(const std::string& directory)
+        {
+            auto path = PathAsCurrentPlatform(directory);
+            std::size_t position = 0;
+            do
+            {
+                position = path.find('/', position + 1);
+                auto parent = path.substr(0, position);
+                if (mkdir(parent.c_str(), 0755) != 0 && errno != EEXIST)
+                {
+                    return false;
+                }
+            } while (position != std::string::npos);
+            return true;
+        }
+
+        bool RemoveDirectory(const std::string& directory)
+        {
+            auto path = PathAsCurrentPlatform(directory);
+            std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(path.c_str()), closedir);
+            if (dir.get() == nullptr)
+            {
+                return errno == ENOENT;
+            }
+            bool result = true;
+            struct dirent* entry;
+            while ((entry = readdir(dir.get())) != nullptr)
+            {
+                std::string name(entry->d_name);
+                if (name == "." || name == "..")
+                {
+                    continue;
+                }
+                auto entryPath = path + "/" + name;
+                if (entry->d_type == DT_DIR)
+                {
+                    result &= RemoveDirectory(entryPath);
+                }
+                else
+                {
+                    result &= (std::remove(entryPath.c_str()) == 0);
+                }
+            }
+            return result && (rmdir(path.c_str()) == 0);
+        }
+
+        // Converts path to posix separator
+        std::string PathAsCurrentPlatform(const std::string& path)
+        {
+            std::string result(path);
+            std::replace(result.begin(), result.end(), '\\', '/');
+            return result;
+        }
+    }
+
+    namespace File {
+
+        std::uint64_t GetSize(const std::string& file)
+        {
+            struct stat sb;
+            if (stat(Directory::PathAsCurrentPlatform(file).c_str(), &sb) == -1)
+            {
+                return 0;
+            }
+            return static_cast<std::uint64_t>(sb.st_size);
+        }
+    }
+}
@@ -0,0 +1,109 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+#include "BenchFileHelpers.hpp"
+
+#include "Windows.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+namespace MsixBench {
+
+    namespace {
+        std::wstring utf8_to_utf16(const std::string& utf8string)
+        {
+            if (utf8string.empty()) { return {}; }
+            int size = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, utf8string.data(), static_cast<int>(utf8string.size()), nullptr, 0);
+            std::wstring result(size, 0);
+            MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, utf8string.data(), static_cast<int>(utf8string.size()), &result[0], size);
+            return result;
+        }
+
+        bool RemoveDirectoryUtf16(const std::wstring& path)
+        {
+            WIN32_FIND_DATA fileData = {};
+            std::unique_ptr<std::remove_pointer<HANDLE>::type, decltype(&::FindClose)> handle(
+                FindFirstFile((path + L"\\*").c_str(), &fileData),
+                &FindClose);
+            if (handle.get() == INVALID_HANDLE_VALUE)
+            {
+                return GetLastError() == ERROR_FILE_NOT_FOUND || GetLastError() == ERROR_PATH_NOT_FOUND;
+            }
+
+            bool result = true;
+            do
+            {
+                std::wstring name(fileData.cFileName);
+                if (name == L"." || name == L"..")
+                {
+                    continue;
+                }
+                auto entryPath = path + L"\\" + name;
+                if (fileData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+                {
+                    result &= RemoveDirectoryUtf16(entryPath);
+                }
+                else
+                {
+                    result &= (DeleteFile(entryPath.c_str()) != FALSE);
+                }
+            } while (FindNextFile(handle.get(), &fileData));
+            handle.reset();
+
+            return result && (::RemoveDirectory(path.c_str()) != FALSE);
+        }
+    }
+
+    namespace Directory {
+
+        bool CreateDirectories(const std::string& directory)
+        {
+            auto path = utf8_to_utf16(PathAsCurrentPlatform(directory));
+            std::size_t position = 0;
+            do
+            {
+                position = path.find(L'\\', position + 1);
+                auto parent = path.substr(0, position);
+                // Skip drive letters
+                if (parent.back() == L':')
+                {
+                    continue;
+                }
+                if (!CreateDirectory(parent.c_str(), nullptr) && GetLastError() != ERROR_ALREADY_EXISTS)
+                {
+                    return false;
+                }
+            } while (position != std::wstring::npos);
+            return true;
+        }
+
+        bool RemoveDirectory(const std::string& directory)
+        {
+            return RemoveDirectoryUtf16(utf8_to_utf16(PathAsCurrentPlatform(directory)));
+        }
+
+        // Converts path to windows separator
+        std::string PathAsCurrentPlatform(const std::string& path)
+        {
+            std::string result(path);
+            std::replace(result.begin(), result.end(), '/', '\\');
+            return result;
+        }
+    }
+
+    namespace File {
+
+        std::uint64_t GetSize(const std::string& file)
+        {
+            WIN32_FILE_ATTRIBUTE_DATA data = {};
+            if (!GetFileAttributesEx(utf8_to_utf16(Directory::PathAsCurrentPlatform(file)).c_str(), GetFileExInfoStandard, &data))
+            {
+                return 0;
+            }
+            return (static_cast<std::uint64_t>(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+        }
+    }
+}
@@ -0,0 +1,25 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+// 
+#pragma once
+#include <string>
+#include <cstdint>
+
+namespace MsixBench {
+    namespace Directory
+    {
+        // Creates the directory and its missing parents
+        bool CreateDirectories(const std::string& directory);
+        // Best effort to remove the directory and everything in it
+        bool RemoveDirectory(const std::string& directory);
+
+        std::string PathAsCurrentPlatform(const std::string& path);
+    }
+
+    namespace File
+    {
+        // Size of the file, 0 if it doesn't exist
+        std::uint64_t GetSize(const std::string& file);
+    }
+}
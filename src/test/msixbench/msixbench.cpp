@@ -0,0 +1,787 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+// This file is used for Windows, macOS and Linux
+// Measures pack, unpack, open and manifest read of synthetic packages and writes the results as JSON.
+#include "AppxPackaging.hpp"
+#include "MSIXWindows.hpp"
+#include "ComHelper.hpp"
+#include "BenchFileHelpers.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef MSIXBENCH_COMPRESSION
+#define MSIXBENCH_COMPRESSION "unknown"
+#endif
+#ifndef MSIXBENCH_XML_PARSER
+#define MSIXBENCH_XML_PARSER "unknown"
+#endif
+
+using MSIX::ComPtr;
+
+namespace MsixBench {
+
+    LPVOID STDMETHODCALLTYPE Allocate(SIZE_T cb) { return std::malloc(cb); }
+    void STDMETHODCALLTYPE Free(LPVOID pv)       { std::free(pv); }
+
+    // Throws with the SDK log text when an API fails
+    void ThrowIfFailed(HRESULT hr, const std::string& what)
+    {
+        if (FAILED(hr))
+        {
+            std::ostringstream message;
+            message << what << " failed with 0x" << std::hex << static_cast<std::uint32_t>(hr);
+            char* logText = nullptr;
+            if (SUCCEEDED(MsixGetLogTextUTF8(Allocate, &logText)) && logText != nullptr)
+            {
+                message << ": " << logText;
+                Free(logText);
+            }
+            throw std::runtime_error(message.str());
+        }
+    }
+
+    struct Options
+    {
+        std::string workDirectory = "msixbench_data";
+        std::string outputFile;
+        std::uint32_t iterations = 3;
+        double scale = 1.0;
+        bool generate = true;
+        std::string baselineFile;
+        // Percentage by which a median can be slower than the baseline before it is a regression
+        double threshold = 10.0;
+    };
+
+    // Deterministic data, so every run and every platform packs the same bytes
+    class DataGenerator
+    {
+    public:
+        std::uint64_t Next()
+        {   // xorshift64*
+            m_state ^= m_state >> 12;
+            m_state ^= m_state << 25;
+            m_state ^= m_state >> 27;
+            return m_state * 0x2545F4914F6CDD1DULL;
+        }
+
+        // Words and line breaks, compresses like source code or text
+        void Compressible(std::vector<char>& buffer)
+        {
+            static const char* words[] = { "msix", "package", "block", "map", "manifest", "stream", "deflate",
+                "inflate", "resource", "bundle", "signature", "payload", "footprint", "zip", "central", "directory" };
+            std::size_t position = 0;
+            while (position < buffer.size())
+            {
+                const char* word = words[Next() % (sizeof(words) / sizeof(words[0]))];
+                for (const char* c = word; *c != '\0' && position < buffer.size(); c++)
+                {
+                    buffer[position++] = *c;
+                }
+                if (position < buffer.size())
+                {
+                    buffer[position++] = (Next() % 8 == 0) ? '\n' : ' ';
+                }
+            }
+        }
+
+        // Random bytes, don't compress at all
+        void Incompressible(std::vector<char>& buffer)
+        {
+            std::size_t position = 0;
+            while (position < buffer.size())
+            {
+                std::uint64_t value = Next();
+                for (std::size_t i = 0; i < sizeof(value) && position < buffer.size(); i++, value >>= 8)
+                {
+                    buffer[position++] = static_cast<char>(value & 0xFF);
+                }
+            }
+        }
+
+    private:
+        std::uint64_t m_state = 0x9E3779B97F4A7C15ULL;
+    };
+
+    // A package content directory being generated
+    class PackageContent
+    {
+    public:
+        PackageContent(const std::string& directory, DataGenerator& generator) : m_directory(directory), m_generator(generator)
+        {
+            Directory::RemoveDirectory(m_directory);
+            if (!Directory::CreateDirectories(m_directory))
+            {
+                throw std::runtime_error("Unable to create " + m_directory);
+            }
+        }
+
+        void AddFile(const std::string& name, std::size_t size, bool compressible)
+        {
+            auto path = m_directory + "/" + name;
+            auto separator = path.find_last_of('/');
+            Directory::CreateDirectories(path.substr(0, separator));
+
+            std::ofstream file(Directory::PathAsCurrentPlatform(path), std::ios::binary);
+            std::vector<char> buffer;
+            std::size_t written = 0;
+            while (written < size)
+            {
+                buffer.resize(std::min<std::size_t>(size - written, ChunkSize));
+                if (compressible) { m_generator.Compressible(buffer); }
+                else { m_generator.Incompressible(buffer); }
+                file.write(buffer.data(), buffer.size());
+                written += buffer.size();
+            }
+            if (!file)
+            {
+                throw std::runtime_error("Unable to write " + path);
+            }
+            m_payloadSize += size;
+        }
+
+        void AddManifest(const std::string& manifest)
+        {
+            std::ofstream file(Directory::PathAsCurrentPlatform(m_directory + "/AppxManifest.xml"), std::ios::binary);
+            file << manifest;
+            // The logo referenced by the manifest
+            AddFile("Assets/Logo.png", 1024, false);
+        }
+
+        std::uint64_t GetPayloadSize() const { return m_payloadSize; }
+        const std::string& GetDirectory() const { return m_directory; }
+
+    private:
+        static const std::size_t ChunkSize = 1024 * 1024;
+        std::string m_directory;
+        DataGenerator& m_generator;
+        std::uint64_t m_payloadSize = 0;
+    };
+
+    namespace Manifest {
+
+        // Package names can't have '_'
+        std::string IdentityName(std::string name)
+        {
+            std::replace(name.begin(), name.end(), '_', '-');
+            return "MsixBench." + name;
+        }
+
+        const char* Header =
+            "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+            "<Package xmlns=\"http://schemas.microsoft.com/appx/manifest/foundation/windows10\" "
+            "xmlns:uap=\"http://schemas.microsoft.com/appx/manifest/uap/windows10\" IgnorableNamespaces=\"uap\">\n";
+
+        const char* TargetDeviceFamily =
+            "  <Dependencies>\n"
+            "    <TargetDeviceFamily Name=\"Windows.Desktop\" MinVersion=\"10.0.17134.0\" MaxVersionTested=\"10.0.18362.0\" />\n"
+            "  </Dependencies>\n";
+
+        // The schema allows up to 100 applications, every one of them has its protocols as extensions
+        std::string Application(const std::string& name, std::size_t applications = 1, std::size_t protocols = 0)
+        {
+            std::ostringstream manifest;
+            manifest << Header
+                << "  <Identity Name=\"" << IdentityName(name) << "\" Publisher=\"CN=MsixBench\" Version=\"1.0.0.0\" ProcessorArchitecture=\"x64\" />\n"
+                << "  <Properties>\n"
+                << "    <DisplayName>MsixBench " << name << "</DisplayName>\n"
+                << "    <PublisherDisplayName>MsixBench</PublisherDisplayName>\n"
+                << "    <Logo>Assets\\Logo.png</Logo>\n"
+                << "  </Properties>\n"
+                << TargetDeviceFamily
+                << "  <Resources>\n"
+                << "    <Resource Language=\"en-us\" />\n"
+                << "  </Resources>\n"
+                << "  <Applications>\n";
+            for (std::size_t i = 0; i < applications; i++)
+            {
+                auto id = (applications == 1) ? std::string("App") : "App" + std::to_string(i);
+                manifest << "    <Application Id=\"" << id << "\" Executable=\"" << id << ".exe\" EntryPoint=\"Windows.FullTrustApplication\">\n"
+                    << "      <uap:VisualElements DisplayName=\"MsixBench " << name << "\" Description=\"MsixBench " << name << "\" "
+                    << "BackgroundColor=\"transparent\" Square150x150Logo=\"Assets\\Logo.png\" Square44x44Logo=\"Assets\\Logo.png\" />\n";
+                if (protocols != 0)
+                {
+                    manifest << "      <Extensions>\n";
+                    for (std::size_t j = 0; j < protocols; j++)
+                    {
+                        manifest << "        <uap:Extension Category=\"windows.protocol\">\n"
+                            << "          <uap:Protocol Name=\"msixbench-" << i << "-" << j << "\" />\n"
+                            << "        </uap:Extension>\n";
+                    }
+                    manifest << "      </Extensions>\n";
+                }
+                manifest << "    </Application>\n";
+            }
+            manifest << "  </Applications>\n"
+                << "</Package>\n";
+            return manifest.str();
+        }
+
+        std::string Resource(const std::string& name, const std::string& language)
+        {
+            std::ostringstream manifest;
+            manifest << Header
+                << "  <Identity Name=\"" << IdentityName(name) << "\" Publisher=\"CN=MsixBench\" Version=\"1.0.0.0\" ResourceId=\"split.language-" << language << "\" />\n"
+                << "  <Properties>\n"
+                << "    <DisplayName>MsixBench " << name << "</DisplayName>\n"
+                << "    <PublisherDisplayName>MsixBench</PublisherDisplayName>\n"
+                << "    <Logo>Assets\\Logo.png</Logo>\n"
+                << "    <ResourcePackage>true</ResourcePackage>\n"
+                << "  </Properties>\n"
+                << TargetDeviceFamily
+                << "  <Resources>\n"
+                << "    <Resource Language=\"" << language << "\" />\n"
+                << "  </Resources>\n"
+                << "</Package>\n";
+            return manifest.str();
+        }
+    }
+
+    // Times of one operation on one scenario
+    struct Result
+    {
+        std::string scenario;
+        std::string operation;
+        std::uint64_t bytes = 0;        // bytes processed per iteration, 0 when throughput doesn't apply
+        std::vector<double> milliseconds;
+    };
+
+    template <class Operation>
+    double Time(Operation operation)
+    {
+        auto start = std::chrono::steady_clock::now();
+        operation();
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // A synthetic package or bundle, and how to generate and read it
+    class Scenario
+    {
+    public:
+        // The manifest of a package is the one of a single application, unless manifest says otherwise
+        Scenario(const std::string& name, bool isBundle, std::function<void(PackageContent&, double)> generate,
+            std::function<std::string(const std::string&, double)> manifest = nullptr) :
+            m_name(name), m_isBundle(isBundle), m_generate(generate), m_manifest(manifest) {}
+
+        const std::string& GetName() const { return m_name; }
+
+        void Run(const Options& options, DataGenerator& generator, std::vector<Result>& results)
+        {
+            m_package = options.workDirectory + "/" + m_name + (m_isBundle ? ".msixbundle" : ".msix");
+            m_unpackDirectory = options.workDirectory + "/unpacked/" + m_name;
+            #ifdef MSIX_PACK
+            if (options.generate)
+            {
+                std::cerr << "Generating " << m_name << std::endl;
+                Generate(options, generator);
+                results.push_back(Measure("pack", m_payloadSize, options.iterations, [this]() { Pack(); }));
+            }
+            #endif
+            if (File::GetSize(m_package) == 0)
+            {
+                throw std::runtime_error(m_package + " doesn't exist. Generate the packages with a build that has MSIX_PACK on.");
+            }
+            if (m_payloadSize == 0)
+            {   // Packages generated by another build, the throughput is of the package bytes instead
+                m_payloadSize = File::GetSize(m_package);
+            }
+
+            std::cerr << "Reading " << m_name << std::endl;
+            results.push_back(Measure("unpack", m_payloadSize, options.iterations, [this]() { Unpack(); }));
+            Directory::RemoveDirectory(m_unpackDirectory);
+            results.push_back(Measure("open", 0, options.iterations, [this]() { Open(); }));
+            results.push_back(ManifestRead(options.iterations));
+        }
+
+    private:
+        static const MSIX_VALIDATION_OPTION Validation = MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE;
+        static const MSIX_APPLICABILITY_OPTIONS Applicability = static_cast<MSIX_APPLICABILITY_OPTIONS>(
+            MSIX_APPLICABILITY_OPTIONS::MSIX_APPLICABILITY_OPTION_SKIPPLATFORM | MSIX_APPLICABILITY_OPTIONS::MSIX_APPLICABILITY_OPTION_SKIPLANGUAGE);
+
+        Result Measure(const std::string& operation, std::uint64_t bytes, std::uint32_t iterations, const std::function<void()>& run)
+        {
+            Result result;
+            result.scenario = m_name;
+            result.operation = operation;
+            result.bytes = bytes;
+            for (std::uint32_t i = 0; i < iterations; i++)
+            {
+                if (operation == "unpack")
+                {
+                    Directory::RemoveDirectory(m_unpackDirectory);
+                }
+                result.milliseconds.push_back(Time(run));
+            }
+            return result;
+        }
+
+        #ifdef MSIX_PACK
+        void Generate(const Options& options, DataGenerator& generator)
+        {
+            auto inputDirectory = options.workDirectory + "/input/" + m_name;
+            if (!m_isBundle)
+            {
+                PackageContent content(inputDirectory, generator);
+                content.AddManifest(m_manifest ? m_manifest(m_name, options.scale) : Manifest::Application(m_name));
+                m_generate(content, options.scale);
+                m_input = content.GetDirectory();
+                m_payloadSize = content.GetPayloadSize();
+                return;
+            }
+
+            // The packages of the bundle are packed once, only the bundle is measured
+            static const char* languages[] = { "de-de", "fr-fr", "es-es", "it-it", "ja-jp", "ko-kr", "zh-cn", "pt-br", "ru-ru", "nl-nl",
+                "sv-se", "pl-pl", "tr-tr", "cs-cz", "da-dk", "fi-fi", "nb-no", "hu-hu", "el-gr", "he-il" };
+            m_input = options.workDirectory + "/input/" + m_name + "_packages";
+            Directory::RemoveDirectory(m_input);
+            Directory::CreateDirectories(m_input);
+
+            std::vector<std::pair<std::string, std::string>> packages;
+            packages.emplace_back("main", Manifest::Application(m_name));
+            for (const auto& language : languages)
+            {
+                packages.emplace_back(language, Manifest::Resource(m_name, language));
+            }
+            for (const auto& package : packages)
+            {
+                PackageContent content(inputDirectory + "/" + package.first, generator);
+                content.AddManifest(package.second);
+                m_generate(content, options.scale);
+                auto output = Directory::PathAsCurrentPlatform(m_input + "/" + package.first + ".msix");
+                auto directory = Directory::PathAsCurrentPlatform(content.GetDirectory());
+                ThrowIfFailed(PackPackage(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE, MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_FULL,
+                    const_cast<char*>(directory.c_str()), const_cast<char*>(output.c_str())), "PackPackage " + output);
+                m_payloadSize += File::GetSize(output);
+            }
+        }
+
+        void Pack()
+        {
+            auto input = Directory::PathAsCurrentPlatform(m_input);
+            auto output = Directory::PathAsCurrentPlatform(m_package);
+            if (m_isBundle)
+            {
+                ThrowIfFailed(PackBundle(MSIX_BUNDLE_OPTIONS::MSIX_OPTION_OVERWRITE, const_cast<char*>(input.c_str()),
+                    const_cast<char*>(output.c_str()), nullptr, nullptr), "PackBundle " + output);
+            }
+            else
+            {
+                ThrowIfFailed(PackPackage(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE, MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_FULL,
+                    const_cast<char*>(input.c_str()), const_cast<char*>(output.c_str())), "PackPackage " + output);
+            }
+        }
+        #endif
+
+        void Unpack()
+        {
+            auto package = Directory::PathAsCurrentPlatform(m_package);
+            auto destination = Directory::PathAsCurrentPlatform(m_unpackDirectory);
+            if (m_isBundle)
+            {
+                ThrowIfFailed(UnpackBundle(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE, Validation, Applicability,
+                    const_cast<char*>(package.c_str()), const_cast<char*>(destination.c_str())), "UnpackBundle " + package);
+            }
+            else
+            {
+                ThrowIfFailed(UnpackPackage(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE, Validation,
+                    const_cast<char*>(package.c_str()), const_cast<char*>(destination.c_str())), "UnpackPackage " + package);
+            }
+        }
+
+        ComPtr<IStream> OpenStream()
+        {
+            auto package = Directory::PathAsCurrentPlatform(m_package);
+            ComPtr<IStream> stream;
+            ThrowIfFailed(CreateStreamOnFile(const_cast<char*>(package.c_str()), true, &stream), "CreateStreamOnFile " + package);
+            return stream;
+        }
+
+        ComPtr<IAppxBundleReader> OpenBundle()
+        {
+            auto stream = OpenStream();
+            ComPtr<IAppxBundleFactory> factory;
+            ThrowIfFailed(CoCreateAppxBundleFactoryWithHeap(Allocate, Free, Validation, Applicability, &factory), "CoCreateAppxBundleFactoryWithHeap");
+            ComPtr<IAppxBundleReader> reader;
+            ThrowIfFailed(factory->CreateBundleReader(stream.Get(), &reader), "CreateBundleReader");
+            return reader;
+        }
+
+        ComPtr<IAppxPackageReader> OpenPackage()
+        {
+            auto stream = OpenStream();
+            ComPtr<IAppxFactory> factory;
+            ThrowIfFailed(CoCreateAppxFactoryWithHeap(Allocate, Free, Validation, &factory), "CoCreateAppxFactoryWithHeap");
+            ComPtr<IAppxPackageReader> reader;
+            ThrowIfFailed(factory->CreatePackageReader(stream.Get(), &reader), "CreatePackageReader");
+            return reader;
+        }
+
+        void Open()
+        {
+            if (m_isBundle) { OpenBundle(); }
+            else { OpenPackage(); }
+        }
+
+        // Times the manifest reads of a reader opened beforehand
+        Result ManifestRead(std::uint32_t iterations)
+        {
+            Result result;
+            result.scenario = m_name;
+            result.operation = "manifest";
+            for (std::uint32_t i = 0; i < iterations; i++)
+            {
+                ComPtr<IAppxBundleReader> bundleReader;
+                ComPtr<IAppxPackageReader> packageReader;
+                if (m_isBundle) { bundleReader = OpenBundle(); }
+                else { packageReader = OpenPackage(); }
+                result.milliseconds.push_back(Time([this, &bundleReader, &packageReader]()
+                {
+                    ComPtr<IAppxManifestPackageId> packageId;
+                    if (m_isBundle)
+                    {
+                        ComPtr<IAppxBundleManifestReader> manifest;
+                        ThrowIfFailed(bundleReader->GetManifest(&manifest), "GetManifest");
+                        ThrowIfFailed(manifest->GetPackageId(&packageId), "GetPackageId");
+                        ComPtr<IAppxBundleManifestPackageInfoEnumerator> packages;
+                        ThrowIfFailed(manifest->GetPackageInfoItems(&packages), "GetPackageInfoItems");
+                        BOOL hasCurrent = FALSE;
+                        ThrowIfFailed(packages->GetHasCurrent(&hasCurrent), "GetHasCurrent");
+                        while (hasCurrent)
+                        {
+                            ComPtr<IAppxBundleManifestPackageInfo> package;
+                            ThrowIfFailed(packages->GetCurrent(&package), "GetCurrent");
+                            ThrowIfFailed(packages->MoveNext(&hasCurrent), "MoveNext");
+                        }
+                    }
+                    else
+                    {
+                        ComPtr<IAppxManifestReader> manifest;
+                        ThrowIfFailed(packageReader->GetManifest(&manifest), "GetManifest");
+                        ThrowIfFailed(manifest->GetPackageId(&packageId), "GetPackageId");
+                        ComPtr<IAppxManifestApplicationsEnumerator> applications;
+                        ThrowIfFailed(manifest->GetApplications(&applications), "GetApplications");
+                    }
+                    LPWSTR fullName = nullptr;
+                    ThrowIfFailed(packageId->GetPackageFullName(&fullName), "GetPackageFullName");
+                    Free(fullName);
+                }));
+            }
+            return result;
+        }
+
+        std::string m_name;
+        bool m_isBundle;
+        std::function<void(PackageContent&, double)> m_generate;
+        std::function<std::string(const std::string&, double)> m_manifest;
+        std::string m_input;
+        std::string m_package;
+        std::string m_unpackDirectory;
+        std::uint64_t m_payloadSize = 0;
+    };
+
+    std::size_t Scaled(std::size_t value, double scale)
+    {
+        return std::max<std::size_t>(1, static_cast<std::size_t>(value * scale));
+    }
+
+    std::vector<Scenario> GetScenarios()
+    {
+        const std::size_t MB = 1024 * 1024;
+        std::vector<Scenario> scenarios;
+        scenarios.emplace_back("tiny_files", false, [](PackageContent& content, double scale)
+        {
+            for (std::size_t i = 0; i < Scaled(4000, scale); i++)
+            {
+                content.AddFile("data/dir" + std::to_string(i / 100) + "/file" + std::to_string(i) + ".txt", 512 + (i * 97) % 1536, true);
+            }
+        });
+        // Mostly validation of the names, the files are too small for their content to matter
+        scenarios.emplace_back("many_names", false, [](PackageContent& content, double scale)
+        {
+            for (std::size_t i = 0; i < Scaled(100000, scale); i++)
+            {
+                content.AddFile("names/dir" + std::to_string(i / 1000) + "/Name.Of-File_" + std::to_string(i) + ".dat", 16, true);
+            }
+        });
+        // Mostly validation of the manifest
+        scenarios.emplace_back("many_applications", false, [](PackageContent& content, double)
+        {
+            for (std::size_t i = 0; i < 100; i++)
+            {
+                content.AddFile("App" + std::to_string(i) + ".exe", 1024, true);
+            }
+        }, [](const std::string& name, double scale)
+        {
+            return Manifest::Application(name, 100, Scaled(5, scale));
+        });
+        scenarios.emplace_back("huge_files", false, [MB](PackageContent& content, double scale)
+        {
+            content.AddFile("data/huge_text.txt", Scaled(128 * MB, scale), true);
+            content.AddFile("data/huge_random.dat", Scaled(128 * MB, scale), false);
+        });
+        scenarios.emplace_back("compressible", false, [MB](PackageContent& content, double scale)
+        {
+            for (std::size_t i = 0; i < 16; i++)
+            {
+                content.AddFile("data/text" + std::to_string(i) + ".txt", Scaled(8 * MB, scale), true);
+            }
+        });
+        scenarios.emplace_back("incompressible", false, [MB](PackageContent& content, double scale)
+        {
+            for (std::size_t i = 0; i < 16; i++)
+            {
+                content.AddFile("data/random" + std::to_string(i) + ".dat", Scaled(8 * MB, scale), false);
+            }
+        });
+        #ifndef MSIXBENCH_SKIP_BUNDLES
+        scenarios.emplace_back("resource_bundle", true, [](PackageContent& content, double scale)
+        {
+            for (std::size_t i = 0; i < Scaled(20, scale); i++)
+            {
+                content.AddFile("resources/strings" + std::to_string(i) + ".resw", 16 * 1024, true);
+            }
+        });
+        #endif
+        return scenarios;
+    }
+
+    double Median(std::vector<double> times)
+    {
+        std::sort(times.begin(), times.end());
+        return (times.size() % 2 == 1) ? times[times.size() / 2] : (times[times.size() / 2 - 1] + times[times.size() / 2]) / 2;
+    }
+
+    void WriteJson(std::ostream& out, const Options& options, const std::vector<Result>& results)
+    {
+        #if defined(WIN32)
+        const char* platform = "Windows";
+        #elif defined(__APPLE__)
+        const char* platform = "MacOS";
+        #else
+        const char* platform = "Linux";
+        #endif
+
+        out << std::fixed << std::setprecision(3);
+        out << "{\n"
+            << "  \"platform\": \"" << platform << "\",\n"
+            << "  \"compression\": \"" << MSIXBENCH_COMPRESSION << "\",\n"
+            << "  \"xmlParser\": \"" << MSIXBENCH_XML_PARSER << "\",\n"
+            << "  \"iterations\": " << options.iterations << ",\n"
+            << "  \"scale\": " << options.scale << ",\n"
+            << "  \"results\": [";
+        for (std::size_t i = 0; i < results.size(); i++)
+        {
+            auto times = results[i].milliseconds;
+            std::sort(times.begin(), times.end());
+            double mean = std::accumulate(times.begin(), times.end(), 0.0) / times.size();
+            double median = Median(times);
+
+            out << (i == 0 ? "\n" : ",\n")
+                << "    { \"scenario\": \"" << results[i].scenario << "\", \"operation\": \"" << results[i].operation << "\""
+                << ", \"minMs\": " << times.front() << ", \"medianMs\": " << median << ", \"meanMs\": " << mean << ", \"maxMs\": " << times.back();
+            if (results[i].bytes != 0)
+            {
+                out << ", \"bytes\": " << results[i].bytes
+                    << ", \"throughputMBps\": " << (median > 0 ? (results[i].bytes / (1024.0 * 1024.0)) / (median / 1000.0) : 0.0);
+            }
+            out << " }";
+        }
+        out << "\n  ]\n}\n";
+    }
+
+    // The medians of a previous run, by scenario and operation
+    struct Baseline
+    {
+        double scale = 0;
+        std::map<std::pair<std::string, std::string>, double> medians;
+    };
+
+    // Value of "key": in a line of the JSON written by WriteJson, which has one result per line
+    bool FindJsonValue(const std::string& line, const std::string& key, std::string& value)
+    {
+        auto position = line.find("\"" + key + "\":");
+        if (position == std::string::npos) { return false; }
+        position = line.find_first_not_of(' ', position + key.size() + 3);
+        if (position == std::string::npos) { return false; }
+        if (line[position] == '"')
+        {
+            auto end = line.find('"', position + 1);
+            if (end == std::string::npos) { return false; }
+            value = line.substr(position + 1, end - position - 1);
+        }
+        else
+        {
+            value = line.substr(position, line.find_first_of(",}", position) - position);
+        }
+        return true;
+    }
+
+    Baseline ReadBaseline(const std::string& fileName)
+    {
+        std::ifstream file(fileName);
+        if (!file)
+        {
+            throw std::runtime_error("Unable to read the baseline " + fileName);
+        }
+        Baseline baseline;
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::string scenario, operation, median, scale;
+            if (FindJsonValue(line, "scenario", scenario) && FindJsonValue(line, "operation", operation) && FindJsonValue(line, "medianMs", median))
+            {
+                baseline.medians[std::make_pair(scenario, operation)] = std::atof(median.c_str());
+            }
+            else if (FindJsonValue(line, "scale", scale))
+            {
+                baseline.scale = std::atof(scale.c_str());
+            }
+        }
+        if (baseline.medians.empty())
+        {
+            throw std::runtime_error(fileName + " isn't a msixbench result");
+        }
+        return baseline;
+    }
+
+    // Writes how every result compares with the baseline and returns the number of regressions. Operations that
+    // take less than MinimumComparableMs in both runs are too noisy to be compared.
+    std::size_t CompareWithBaseline(const Options& options, const Baseline& baseline, const std::vector<Result>& results)
+    {
+        const double MinimumComparableMs = 5.0;
+        std::size_t regressions = 0;
+        std::cerr << std::fixed << std::setprecision(3);
+        std::cerr << "Comparison with " << options.baselineFile << ", threshold " << options.threshold << "%" << std::endl;
+        for (const auto& result : results)
+        {
+            std::cerr << "  " << std::left << std::setw(16) << result.scenario << std::setw(9) << result.operation << std::right;
+            auto found = baseline.medians.find(std::make_pair(result.scenario, result.operation));
+            if (found == baseline.medians.end())
+            {
+                std::cerr << " not in the baseline" << std::endl;
+                continue;
+            }
+            double median = Median(result.milliseconds);
+            double change = (found->second > 0) ? (median - found->second) * 100.0 / found->second : 0.0;
+            std::cerr << std::setw(12) << found->second << "ms " << std::setw(12) << median << "ms " << std::showpos << std::setw(9) << change << "%" << std::noshowpos;
+            if ((median >= MinimumComparableMs || found->second >= MinimumComparableMs) && change > options.threshold)
+            {
+                std::cerr << "  REGRESSION";
+                regressions++;
+            }
+            std::cerr << std::endl;
+        }
+        return regressions;
+    }
+
+    int Help()
+    {
+        std::cout << "Usage:" << std::endl;
+        std::cout << "\tmsixbench [options]" << std::endl;
+        std::cout << std::endl;
+        std::cout << "Options:" << std::endl;
+        std::cout << "\t-w <directory>   Directory for the generated content and packages. Default msixbench_data" << std::endl;
+        std::cout << "\t-o <file>        Writes the JSON results to file instead of the standard output" << std::endl;
+        std::cout << "\t-i <count>       Iterations of every measure. Default 3" << std::endl;
+        std::cout << "\t-s <scale>       Multiplies the size of the generated content, e.g. 0.1 for a quick run. Default 1" << std::endl;
+        std::cout << "\t-scenario <name> Only runs this scenario: tiny_files, many_names," << std::endl;
+        std::cout << "\t                 many_applications, huge_files, compressible, incompressible or resource_bundle" << std::endl;
+        std::cout << "\t-no-generate     Reads the packages already in the work directory, for builds without pack" << std::endl;
+        std::cout << "\t-baseline <file> Compares the medians with the ones of file, written by a previous run with -o, and exits" << std::endl;
+        std::cout << "\t                 with 2 if one is slower by more than the threshold. The scale defaults to the one of file" << std::endl;
+        std::cout << "\t-threshold <%>   Slowdown over the baseline that is a regression. Default 10" << std::endl;
+        return 0;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    using namespace MsixBench;
+
+    Options options;
+    std::string onlyScenario;
+    bool hasScale = false;
+    #ifndef MSIX_PACK
+    options.generate = false;
+    #endif
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg(argv[i]);
+        bool hasValue = (i + 1 < argc);
+        if (arg == "-w" && hasValue) { options.workDirectory = argv[++i]; }
+        else if (arg == "-o" && hasValue) { options.outputFile = argv[++i]; }
+        else if (arg == "-i" && hasValue) { options.iterations = std::max(1, std::atoi(argv[++i])); }
+        else if (arg == "-s" && hasValue) { options.scale = std::atof(argv[++i]); hasScale = true; }
+        else if (arg == "-scenario" && hasValue) { onlyScenario = argv[++i]; }
+        else if (arg == "-no-generate") { options.generate = false; }
+        else if (arg == "-baseline" && hasValue) { options.baselineFile = argv[++i]; }
+        else if (arg == "-threshold" && hasValue) { options.threshold = std::atof(argv[++i]); }
+        else { return Help(); }
+    }
+    if (options.scale <= 0 || options.threshold < 0)
+    {
+        return Help();
+    }
+
+    try
+    {
+        Baseline baseline;
+        if (!options.baselineFile.empty())
+        {
+            baseline = ReadBaseline(options.baselineFile);
+            if (!hasScale && baseline.scale > 0) { options.scale = baseline.scale; }
+            if (baseline.scale != options.scale)
+            {
+                std::cerr << "msixbench: warning, the baseline was run with scale " << baseline.scale << std::endl;
+            }
+        }
+
+        Directory::CreateDirectories(options.workDirectory);
+        DataGenerator generator;
+        std::vector<Result> results;
+        for (auto& scenario : GetScenarios())
+        {
+            if (onlyScenario.empty() || onlyScenario == scenario.GetName())
+            {
+                scenario.Run(options, generator, results);
+            }
+        }
+
+        if (options.outputFile.empty())
+        {
+            WriteJson(std::cout, options, results);
+        }
+        else
+        {
+            std::ofstream out(options.outputFile);
+            WriteJson(out, options, results);
+        }
+
+        if (!options.baselineFile.empty() && CompareWithBaseline(options, baseline, results) != 0)
+        {
+            std::cerr << "msixbench: slower than the baseline" << std::endl;
+            return 2;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "msixbench: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
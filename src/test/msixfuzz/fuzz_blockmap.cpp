@@ -0,0 +1,22 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+// libFuzzer target. Parses the input as a block map and reads its files and blocks.
+#include "FuzzHelpers.hpp"
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size)
+{
+    MSIX::ComPtr<IAppxFactory> factory;
+    if (FAILED(CoCreateAppxFactoryWithHeap(MsixFuzz::Allocate, MsixFuzz::Free, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory)))
+    {
+        return 0;
+    }
+    auto stream = MsixFuzz::MakeInputStream(data, size);
+    MSIX::ComPtr<IAppxBlockMapReader> blockMapReader;
+    if (SUCCEEDED(factory->CreateBlockMapReader(stream.Get(), &blockMapReader)))
+    {
+        MsixFuzz::ReadBlockMap(blockMapReader.Get());
+    }
+    return 0;
+}
@@ -0,0 +1,61 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+// libFuzzer target. Opens the input as a bundle and reads its manifest and payload packages.
+#include "FuzzHelpers.hpp"
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size)
+{
+    MSIX::ComPtr<IAppxBundleFactory> factory;
+    if (FAILED(CoCreateAppxBundleFactoryWithHeap(MsixFuzz::Allocate, MsixFuzz::Free, MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+        static_cast<MSIX_APPLICABILITY_OPTIONS>(MSIX_APPLICABILITY_NONE), &factory)))
+    {
+        return 0;
+    }
+    auto stream = MsixFuzz::MakeInputStream(data, size);
+    MSIX::ComPtr<IAppxBundleReader> bundleReader;
+    if (FAILED(factory->CreateBundleReader(stream.Get(), &bundleReader)))
+    {
+        return 0;
+    }
+
+    MSIX::ComPtr<IAppxBundleManifestReader> manifestReader;
+    if (SUCCEEDED(bundleReader->GetManifest(&manifestReader)))
+    {
+        MSIX::ComPtr<IAppxBundleManifestPackageInfoEnumerator> packages;
+        if (SUCCEEDED(manifestReader->GetPackageInfoItems(&packages)))
+        {
+            BOOL hasCurrent = FALSE;
+            while (SUCCEEDED(packages->GetHasCurrent(&hasCurrent)) && hasCurrent)
+            {
+                MSIX::ComPtr<IAppxBundleManifestPackageInfo> packageInfo;
+                if (FAILED(packages->GetCurrent(&packageInfo))) { break; }
+                LPWSTR fileName = nullptr;
+                if (SUCCEEDED(packageInfo->GetFileName(&fileName))) { MsixFuzz::FreeString(fileName); }
+                if (FAILED(packages->MoveNext(&hasCurrent))) { break; }
+            }
+        }
+    }
+
+    MSIX::ComPtr<IAppxFilesEnumerator> packages;
+    if (FAILED(bundleReader->GetPayloadPackages(&packages)))
+    {
+        return 0;
+    }
+    std::uint64_t budget = MsixFuzz::MaxBytesReadPerInput;
+    BOOL hasCurrent = FALSE;
+    while (SUCCEEDED(packages->GetHasCurrent(&hasCurrent)) && hasCurrent && budget > 0)
+    {
+        MSIX::ComPtr<IAppxFile> package;
+        if (FAILED(packages->GetCurrent(&package))) { break; }
+        // The payload packages are opened and validated with the bundle, what's left is reading them
+        MSIX::ComPtr<IStream> packageStream;
+        if (SUCCEEDED(package->GetStream(&packageStream)))
+        {
+            MsixFuzz::ReadToEnd(packageStream.Get(), budget);
+        }
+        if (FAILED(packages->MoveNext(&hasCurrent))) { break; }
+    }
+    return 0;
+}
@@ -0,0 +1,22 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+// libFuzzer target. Parses the input as a package manifest and reads it.
+#include "FuzzHelpers.hpp"
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size)
+{
+    MSIX::ComPtr<IAppxFactory> factory;
+    if (FAILED(CoCreateAppxFactoryWithHeap(MsixFuzz::Allocate, MsixFuzz::Free, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory)))
+    {
+        return 0;
+    }
+    auto stream = MsixFuzz::MakeInputStream(data, size);
+    MSIX::ComPtr<IAppxManifestReader> manifestReader;
+    if (SUCCEEDED(factory->CreateManifestReader(stream.Get(), &manifestReader)))
+    {
+        MsixFuzz::ReadManifest(manifestReader.Get());
+    }
+    return 0;
+}
@@ -0,0 +1,47 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+// libFuzzer target. Opens the input as a package and reads its manifest and payload files, as an unpack does.
+#include "FuzzHelpers.hpp"
+
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size)
+{
+    MSIX::ComPtr<IAppxFactory> factory;
+    if (FAILED(CoCreateAppxFactoryWithHeap(MsixFuzz::Allocate, MsixFuzz::Free, MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory)))
+    {
+        return 0;
+    }
+    auto stream = MsixFuzz::MakeInputStream(data, size);
+    MSIX::ComPtr<IAppxPackageReader> packageReader;
+    if (FAILED(factory->CreatePackageReader(stream.Get(), &packageReader)))
+    {
+        return 0;
+    }
+
+    MSIX::ComPtr<IAppxManifestReader> manifestReader;
+    if (SUCCEEDED(packageReader->GetManifest(&manifestReader)))
+    {
+        MsixFuzz::ReadManifest(manifestReader.Get());
+    }
+
+    MSIX::ComPtr<IAppxFilesEnumerator> files;
+    if (FAILED(packageReader->GetPayloadFiles(&files)))
+    {
+        return 0;
+    }
+    std::uint64_t budget = MsixFuzz::MaxBytesReadPerInput;
+    BOOL hasCurrent = FALSE;
+    while (SUCCEEDED(files->GetHasCurrent(&hasCurrent)) && hasCurrent && budget > 0)
+    {
+        MSIX::ComPtr<IAppxFile> file;
+        if (FAILED(files->GetCurrent(&file))) { break; }
+        MSIX::ComPtr<IStream> fileStream;
+        if (SUCCEEDED(file->GetStream(&fileStream)))
+        {
+            MsixFuzz::ReadToEnd(fileStream.Get(), budget);
+        }
+        if (FAILED(files->MoveNext(&hasCurrent))) { break; }
+    }
+    return 0;
+}
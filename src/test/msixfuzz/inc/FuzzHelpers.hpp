@@ -0,0 +1,169 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+// 
+#pragma once
+#include "AppxPackaging.hpp"
+#include "MSIXWindows.hpp"
+#include "ComHelper.hpp"
+#include "StreamBase.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace MsixFuzz {
+
+    inline LPVOID STDMETHODCALLTYPE Allocate(SIZE_T cb) { return std::malloc(cb); }
+    inline void STDMETHODCALLTYPE Free(LPVOID pv) { std::free(pv); }
+
+    // Most of the bytes of a package read by a single input. Payload files can claim sizes far beyond the input
+    // through their compressed blocks, reading them past this is memory and time the fuzzer spends for nothing.
+    constexpr std::uint64_t MaxBytesReadPerInput = 64 * 1024 * 1024;
+
+    // Read only stream over the bytes of the fuzzer input. The input isn't copied, it lives until
+    // LLVMFuzzerTestOneInput returns, as long as the readers made from the stream.
+    class InputStream final : public MSIX::StreamBase
+    {
+    public:
+        InputStream(const std::uint8_t* data, std::size_t size) : m_data(data), m_size(size) {}
+
+        HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) noexcept override
+        {
+            std::size_t count = 0;
+            if (m_position < m_size)
+            {
+                count = static_cast<std::size_t>(std::min<std::uint64_t>(countBytes, m_size - m_position));
+                std::memcpy(buffer, m_data + m_position, count);
+                m_position += count;
+            }
+            if (bytesRead) { *bytesRead = static_cast<ULONG>(count); }
+            return static_cast<HRESULT>(MSIX::Error::OK);
+        }
+
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept override
+        {
+            std::int64_t position = 0;
+            switch (origin)
+            {
+            case Reference::START:   position = move.QuadPart; break;
+            case Reference::CURRENT: position = static_cast<std::int64_t>(m_position) + move.QuadPart; break;
+            case Reference::END:     position = static_cast<std::int64_t>(m_size) + move.QuadPart; break;
+            default: return static_cast<HRESULT>(MSIX::Error::InvalidParameter);
+            }
+            if (position < 0) { return static_cast<HRESULT>(MSIX::Error::InvalidParameter); }
+            m_position = static_cast<std::uint64_t>(position);
+            if (newPosition) { newPosition->QuadPart = m_position; }
+            return static_cast<HRESULT>(MSIX::Error::OK);
+        }
+
+    private:
+        const std::uint8_t* m_data;
+        std::uint64_t m_size;
+        std::uint64_t m_position = 0;
+    };
+
+    inline MSIX::ComPtr<IStream> MakeInputStream(const std::uint8_t* data, std::size_t size)
+    {
+        return MSIX::ComPtr<IStream>::Make<InputStream>(data, size);
+    }
+
+    // Reads a stream to its end, or until the budget of the input is spent. Returns false when the stream fails.
+    inline bool ReadToEnd(IStream* stream, std::uint64_t& budget)
+    {
+        std::uint8_t buffer[64 * 1024];
+        ULONG bytesRead = 0;
+        do
+        {
+            ULONG toRead = static_cast<ULONG>(std::min<std::uint64_t>(sizeof(buffer), budget));
+            if (toRead == 0) { return true; }
+            if (FAILED(stream->Read(buffer, toRead, &bytesRead))) { return false; }
+            budget -= bytesRead;
+        } while (bytesRead != 0);
+        return true;
+    }
+
+    // Frees the strings the SDK returns
+    inline void FreeString(LPWSTR value) { if (value) { Free(value); } }
+
+    // Reads what installers read of a manifest: the identity, properties, dependencies and applications.
+    // Failures are expected for most inputs and end the walk.
+    inline void ReadManifest(IAppxManifestReader* manifestReader)
+    {
+        MSIX::ComPtr<IAppxManifestPackageId> packageId;
+        if (SUCCEEDED(manifestReader->GetPackageId(&packageId)))
+        {
+            LPWSTR value = nullptr;
+            if (SUCCEEDED(packageId->GetPackageFullName(&value))) { FreeString(value); }
+            value = nullptr;
+            if (SUCCEEDED(packageId->GetPackageFamilyName(&value))) { FreeString(value); }
+            UINT64 version = 0;
+            packageId->GetVersion(&version);
+        }
+
+        MSIX::ComPtr<IAppxManifestProperties> properties;
+        if (SUCCEEDED(manifestReader->GetProperties(&properties)))
+        {
+            LPWSTR value = nullptr;
+            if (SUCCEEDED(properties->GetStringValue(L"DisplayName", &value))) { FreeString(value); }
+        }
+
+        MSIX::ComPtr<IAppxManifestPackageDependenciesEnumerator> dependencies;
+        if (SUCCEEDED(manifestReader->GetPackageDependencies(&dependencies)))
+        {
+            BOOL hasCurrent = FALSE;
+            while (SUCCEEDED(dependencies->GetHasCurrent(&hasCurrent)) && hasCurrent)
+            {
+                MSIX::ComPtr<IAppxManifestPackageDependency> dependency;
+                if (FAILED(dependencies->GetCurrent(&dependency))) { break; }
+                LPWSTR value = nullptr;
+                if (SUCCEEDED(dependency->GetName(&value))) { FreeString(value); }
+                if (FAILED(dependencies->MoveNext(&hasCurrent))) { break; }
+            }
+        }
+
+        MSIX::ComPtr<IAppxManifestApplicationsEnumerator> applications;
+        if (SUCCEEDED(manifestReader->GetApplications(&applications)))
+        {
+            BOOL hasCurrent = FALSE;
+            while (SUCCEEDED(applications->GetHasCurrent(&hasCurrent)) && hasCurrent)
+            {
+                MSIX::ComPtr<IAppxManifestApplication> application;
+                if (FAILED(applications->GetCurrent(&application))) { break; }
+                LPWSTR value = nullptr;
+                if (SUCCEEDED(application->GetAppUserModelId(&value))) { FreeString(value); }
+                if (FAILED(applications->MoveNext(&hasCurrent))) { break; }
+            }
+        }
+    }
+
+    // Reads the block map entries and their blocks
+    inline void ReadBlockMap(IAppxBlockMapReader* blockMapReader)
+    {
+        MSIX::ComPtr<IAppxBlockMapFilesEnumerator> files;
+        if (FAILED(blockMapReader->GetFiles(&files))) { return; }
+        BOOL hasCurrent = FALSE;
+        while (SUCCEEDED(files->GetHasCurrent(&hasCurrent)) && hasCurrent)
+        {
+            MSIX::ComPtr<IAppxBlockMapFile> file;
+            if (FAILED(files->GetCurrent(&file))) { break; }
+            LPWSTR name = nullptr;
+            if (SUCCEEDED(file->GetName(&name))) { FreeString(name); }
+            MSIX::ComPtr<IAppxBlockMapBlocksEnumerator> blocks;
+            if (SUCCEEDED(file->GetBlocks(&blocks)))
+            {
+                BOOL hasBlock = FALSE;
+                while (SUCCEEDED(blocks->GetHasCurrent(&hasBlock)) && hasBlock)
+                {
+                    MSIX::ComPtr<IAppxBlockMapBlock> block;
+                    if (FAILED(blocks->GetCurrent(&block))) { break; }
+                    UINT32 size = 0;
+                    block->GetCompressedSize(&size);
+                    if (FAILED(blocks->MoveNext(&hasBlock))) { break; }
+                }
+            }
+            if (FAILED(files->MoveNext(&hasCurrent))) { break; }
+        }
+    }
+}
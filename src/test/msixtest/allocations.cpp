@@ -0,0 +1,278 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+// Heap allocation tests, built with -DMSIX_ALLOCATION_TESTS=on. The global operator new, and with glibc malloc,
+// calloc and realloc too, are replaced by versions that count the calls made while a test measures. Packages with
+// a compressed and a stored payload file of a few blocks and of many blocks are packed and unpacked, and the
+// allocations each extra block costs must stay within the budgets below. Fixed costs, like parsing the manifest,
+// cancel out, and the caches filled by the first pack or unpack of the process are filled by a run that isn't
+// counted, so the budgets only catch hot loops that allocate per block.
+#include "catch.hpp"
+#include "msixtest_int.hpp"
+#include "FileHelpers.hpp"
+#include "PackTestData.hpp"
+#include "macros.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#ifdef __GLIBC__
+extern "C" {
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* pointer, size_t size);
+    void __libc_free(void* pointer);
+}
+#endif
+
+namespace {
+
+    std::atomic<bool> g_counting(false);
+    std::atomic<std::uint64_t> g_allocations(0);
+
+    inline void CountAllocation()
+    {
+        if (g_counting.load(std::memory_order_relaxed)) { g_allocations.fetch_add(1, std::memory_order_relaxed); }
+    }
+
+    // Allocates without counting, operator new is counted once and not again for the malloc under it
+    inline void* RawAllocate(std::size_t size)
+    {
+        if (size == 0) { size = 1; }
+        #ifdef __GLIBC__
+        return __libc_malloc(size);
+        #else
+        return std::malloc(size);
+        #endif
+    }
+
+    inline void RawFree(void* pointer)
+    {
+        #ifdef __GLIBC__
+        __libc_free(pointer);
+        #else
+        std::free(pointer);
+        #endif
+    }
+}
+
+void* operator new(std::size_t size)
+{
+    CountAllocation();
+    void* pointer = RawAllocate(size);
+    if (pointer == nullptr) { throw std::bad_alloc(); }
+    return pointer;
+}
+
+void* operator new[](std::size_t size) { return operator new(size); }
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    CountAllocation();
+    return RawAllocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept { return operator new(size, tag); }
+
+void operator delete(void* pointer) noexcept { RawFree(pointer); }
+void operator delete[](void* pointer) noexcept { RawFree(pointer); }
+void operator delete(void* pointer, std::size_t) noexcept { RawFree(pointer); }
+void operator delete[](void* pointer, std::size_t) noexcept { RawFree(pointer); }
+void operator delete(void* pointer, const std::nothrow_t&) noexcept { RawFree(pointer); }
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept { RawFree(pointer); }
+
+#ifdef __GLIBC__
+// zlib, OpenSSL and the C parts of the platform allocate with malloc. The allocator of glibc is still the one used.
+extern "C" {
+    void* malloc(size_t size)
+    {
+        CountAllocation();
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size)
+    {
+        CountAllocation();
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* pointer, size_t size)
+    {
+        CountAllocation();
+        return __libc_realloc(pointer, size);
+    }
+
+    void free(void* pointer) { __libc_free(pointer); }
+}
+#endif
+
+namespace {
+
+    constexpr std::uint32_t AllocationBlockSize = 65536;
+    constexpr std::uint32_t SmallBlockCount = 4;
+    constexpr std::uint32_t LargeBlockCount = 36;
+
+    // Allocations each extra payload block may cost, with the payload files on one thread. Packing doesn't allocate
+    // per block, unpacking allocates about 8 times per block. Lower them as hot loops stop allocating, so they don't
+    // start again.
+    constexpr double UnpackBudgetPerBlock = 9;
+    constexpr double PackBudgetPerBlock = 1;
+
+    // Counts the allocations of every thread while run runs. run must not use Catch assertions, which allocate.
+    std::uint64_t CountAllocations(const std::function<void()>& run)
+    {
+        g_allocations = 0;
+        g_counting = true;
+        run();
+        g_counting = false;
+        return g_allocations;
+    }
+
+    struct AllocationPackage
+    {
+        std::string compressedFile;
+        std::string storedFile;
+        std::string package;
+        std::uint32_t blocks;
+    };
+
+    // Writes a file of blocks that compress well, and one of blocks that don't, to be packed compressed and stored
+    AllocationPackage MakePayload(std::uint32_t blocks)
+    {
+        auto root = MsixTest::TestPath::GetInstance()->GetRoot();
+        AllocationPackage result = { root + "allocations_compressed.bin", root + "allocations_stored.bin",
+            root + "allocations_" + std::to_string(blocks) + ".msix", blocks };
+        std::vector<char> block(AllocationBlockSize);
+        std::uint32_t seed = 0x12345678;
+        {
+            std::ofstream compressed(result.compressedFile, std::ios::binary | std::ios::trunc);
+            std::ofstream stored(result.storedFile, std::ios::binary | std::ios::trunc);
+            for (std::uint32_t i = 0; i < blocks; i++)
+            {
+                for (std::uint32_t j = 0; j < AllocationBlockSize; j++) { block[j] = static_cast<char>('a' + ((i + j / 64) % 26)); }
+                compressed.write(block.data(), block.size());
+                for (auto& byte : block)
+                {
+                    seed = seed * 1664525 + 1013904223;
+                    byte = static_cast<char>(seed >> 24);
+                }
+                stored.write(block.data(), block.size());
+            }
+        }
+        return result;
+    }
+
+    // Packs the payload files of package, counting the allocations of adding them and of closing the package
+    std::uint64_t PackCounted(const AllocationPackage& package)
+    {
+        MsixTest::ComPtr<IStream> compressedStream;
+        MsixTest::ComPtr<IStream> storedStream;
+        MsixTest::ComPtr<IStream> manifestStream;
+        REQUIRE_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(package.compressedFile.c_str()), true, &compressedStream));
+        REQUIRE_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(package.storedFile.c_str()), true, &storedStream));
+        MsixTest::Pack::MakeManifestStream(&manifestStream);
+
+        auto outputStream = MsixTest::StreamFile(package.package, false);
+        MsixTest::ComPtr<IAppxFactory> factory;
+        REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+            MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+        MsixTest::ComPtr<IAppxPackageWriter> packageWriter;
+        REQUIRE_SUCCEEDED(factory->CreatePackageWriter(outputStream.Get(), nullptr, &packageWriter));
+
+        HRESULT compressedResult = S_OK;
+        HRESULT storedResult = S_OK;
+        HRESULT closeResult = S_OK;
+        auto allocations = CountAllocations([&]()
+        {
+            compressedResult = packageWriter->AddPayloadFile(L"compressed.bin", MsixTest::Pack::TestConstants::ContentType.c_str(),
+                APPX_COMPRESSION_OPTION_NORMAL, compressedStream.Get());
+            storedResult = packageWriter->AddPayloadFile(L"stored.bin", MsixTest::Pack::TestConstants::ContentType.c_str(),
+                APPX_COMPRESSION_OPTION_NONE, storedStream.Get());
+            closeResult = packageWriter->Close(manifestStream.Get());
+        });
+        REQUIRE_SUCCEEDED(compressedResult);
+        REQUIRE_SUCCEEDED(storedResult);
+        REQUIRE_SUCCEEDED(closeResult);
+        return allocations;
+    }
+
+    // Unpacks package on one thread, counting its allocations
+    std::uint64_t UnpackCounted(const AllocationPackage& package)
+    {
+        auto outputDir = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Output);
+        HRESULT result = S_OK;
+        auto allocations = CountAllocations([&]()
+        {
+            result = UnpackPackage(MSIX_PACKUNPACK_OPTION_NONE, MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                const_cast<char*>(package.package.c_str()), const_cast<char*>(outputDir.c_str()));
+        });
+        REQUIRE_SUCCEEDED(result);
+        CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+        return allocations;
+    }
+
+    void CheckBudget(const std::string& stage, std::uint64_t small, std::uint64_t large, double budget)
+    {
+        // Both payload files have the extra blocks
+        double perBlock = (static_cast<double>(large) - static_cast<double>(small)) / (2.0 * (LargeBlockCount - SmallBlockCount));
+        std::cout << "[allocations] " << stage << ": " << small << " with " << SmallBlockCount << " blocks per file, "
+            << large << " with " << LargeBlockCount << ", " << perBlock << " per block" << std::endl;
+        INFO(stage << ": " << perBlock << " allocations per block, the budget is " << budget);
+        CHECK(perBlock <= budget);
+    }
+
+    void Clean(const AllocationPackage& package)
+    {
+        std::remove(package.compressedFile.c_str());
+        std::remove(package.storedFile.c_str());
+        std::remove(package.package.c_str());
+    }
+}
+
+// The counting replacements must see the allocations of the SDK, or the other tests prove nothing
+TEST_CASE("Allocations_Counted", "[allocations]")
+{
+    MsixTest::ComPtr<IAppxFactory> factory;
+    auto allocations = CountAllocations([&]()
+    {
+        CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+            MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory);
+    });
+    REQUIRE_NOT_NULL(factory.Get());
+    CHECK(allocations != 0);
+}
+
+TEST_CASE("Allocations_Pack", "[allocations]")
+{
+    auto small = MakePayload(SmallBlockCount);
+    PackCounted(small);
+    auto smallAllocations = PackCounted(small);
+    auto large = MakePayload(LargeBlockCount);
+    auto largeAllocations = PackCounted(large);
+    CheckBudget("pack", smallAllocations, largeAllocations, PackBudgetPerBlock);
+    Clean(small);
+    Clean(large);
+}
+
+TEST_CASE("Allocations_Unpack", "[allocations]")
+{
+    auto small = MakePayload(SmallBlockCount);
+    PackCounted(small);
+    auto large = MakePayload(LargeBlockCount);
+    PackCounted(large);
+    UnpackCounted(small);
+    auto smallAllocations = UnpackCounted(small);
+    auto largeAllocations = UnpackCounted(large);
+    CheckBudget("unpack", smallAllocations, largeAllocations, UnpackBudgetPerBlock);
+    Clean(small);
+    Clean(large);
+}
@@ -9,6 +9,90 @@
 #include "UnbundleTestData.hpp"
 #include "macros.hpp"
 
+#include <memory>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+namespace {
+    // Goes through the files of an enumerator, reading every one of them when readFiles is true. Doesn't use
+    // Catch assertions, which are not thread safe, so it can run on any thread.
+    HRESULT ReadFiles(IAppxFilesEnumerator* files, bool readFiles, std::size_t& count, UINT64& bytes)
+    {
+        BOOL hasCurrent = FALSE;
+        HRESULT hr = files->GetHasCurrent(&hasCurrent);
+        std::vector<std::uint8_t> buffer(4096);
+        while (SUCCEEDED(hr) && hasCurrent)
+        {
+            MsixTest::ComPtr<IAppxFile> file;
+            hr = files->GetCurrent(&file);
+            if (SUCCEEDED(hr) && readFiles)
+            {
+                MsixTest::ComPtr<IStream> stream;
+                hr = file->GetStream(&stream);
+                ULONG read = 0;
+                while (SUCCEEDED(hr))
+                {
+                    hr = stream->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &read);
+                    if (read == 0) { break; }
+                    bytes += read;
+                }
+            }
+            count++;
+            if (SUCCEEDED(hr)) { hr = files->MoveNext(&hasCurrent); }
+        }
+        return hr;
+    }
+
+    // Serves a bundle from a stream and counts the requests
+    class BundleRangeReader final : public IMsixRangeReader
+    {
+    public:
+        BundleRangeReader(IStream* stream) : m_stream(stream) {}
+
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+        {
+            if (ppvObject == nullptr || *ppvObject != nullptr) { return static_cast<HRESULT>(MSIX::Error::InvalidParameter); }
+            if (riid == UuidOfImpl<IMsixRangeReader>::iid || riid == UuidOfImpl<IUnknown>::iid)
+            {
+                *ppvObject = static_cast<void*>(this);
+                AddRef();
+                return S_OK;
+            }
+            return static_cast<HRESULT>(MSIX::Error::NoInterface);
+        }
+        // Owned by the test
+        ULONG STDMETHODCALLTYPE AddRef() noexcept override { return 1; }
+        ULONG STDMETHODCALLTYPE Release() noexcept override { return 1; }
+
+        HRESULT STDMETHODCALLTYPE GetSize(UINT64* size) noexcept override
+        {
+            ULARGE_INTEGER end = { 0 };
+            auto hr = m_stream->Seek({ 0 }, STREAM_SEEK_END, &end);
+            *size = end.QuadPart;
+            return hr;
+        }
+
+        HRESULT STDMETHODCALLTYPE ReadRange(UINT64 offset, UINT32 count, BYTE* buffer, UINT32* bytesRead) noexcept override
+        {
+            requests++;
+            LARGE_INTEGER pos = { 0 };
+            pos.QuadPart = static_cast<LONGLONG>(offset);
+            auto hr = m_stream->Seek(pos, STREAM_SEEK_SET, nullptr);
+            if (hr != S_OK) { return hr; }
+            ULONG read = 0;
+            hr = m_stream->Read(buffer, count, &read);
+            *bytesRead = read;
+            return (hr == S_FALSE) ? S_OK : hr;
+        }
+
+        std::size_t requests = 0;
+
+    protected:
+        IStream* m_stream;
+    };
+}
+
 // Validates a footprint files from a bundle
 TEST_CASE("Api_AppxBundleReader_FootprintFiles", "[api]")
 {
@@ -85,3 +169,331 @@ TEST_CASE("Api_AppxBundleReader_PayloadPackages", "[api]")
     }
     REQUIRE(expectedPackages.size() == numOfPackages);
 }
+
+// Validates that packages that are not applicable are still available when the bundle reader
+// defers validating them with MSIX_FACTORY_OPTION_READER_DEFER_BUNDLE_PACKAGES
+TEST_CASE("Api_AppxBundleReader_DeferBundlePackages", "[api]")
+{
+    auto bundlePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unbundle) + "/StoreSigned_Desktop_x86_x64_MoviesTV.appxbundle";
+    auto inputStream = MsixTest::StreamFile(bundlePath, true);
+
+    MsixTest::ComPtr<IAppxBundleFactory> bundleFactory;
+    REQUIRE_SUCCEEDED(CoCreateAppxBundleFactoryWithHeapAndOptions(
+        MsixTest::Allocators::Allocate,
+        MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+        MSIX_APPLICABILITY_OPTIONS::MSIX_APPLICABILITY_OPTION_FULL,
+        MSIX_FACTORY_OPTION_READER_DEFER_BUNDLE_PACKAGES,
+        &bundleFactory));
+
+    MsixTest::ComPtr<IAppxBundleReader> bundleReader;
+    REQUIRE_SUCCEEDED(bundleFactory->CreateBundleReader(inputStream.Get(), &bundleReader));
+
+    MsixTest::ComPtr<IAppxFilesEnumerator> packages;
+    REQUIRE_SUCCEEDED(bundleReader->GetPayloadPackages(&packages));
+    BOOL hasCurrent = FALSE;
+    REQUIRE_SUCCEEDED(packages->GetHasCurrent(&hasCurrent));
+    std::size_t numOfPackages = 0;
+    while (hasCurrent)
+    {
+        REQUIRE_SUCCEEDED(packages->MoveNext(&hasCurrent));
+        numOfPackages++;
+    }
+    REQUIRE(numOfPackages > 0);
+    REQUIRE(numOfPackages < MsixTest::Unbundle::GetExpectedPackages().size());
+
+    // Not applicable for an English system, so it is validated here.
+    MsixTest::ComPtr<IAppxBundleReaderUtf8> bundleReaderUtf8;
+    REQUIRE_SUCCEEDED(bundleReader->QueryInterface(UuidOfImpl<IAppxBundleReaderUtf8>::iid, reinterpret_cast<void**>(&bundleReaderUtf8)));
+    MsixTest::ComPtr<IAppxFile> package;
+    REQUIRE_SUCCEEDED(bundleReaderUtf8->GetPayloadPackage("resources.language-af.map.appx", &package));
+    MsixTest::ComPtr<IAppxFile> package2;
+    REQUIRE_SUCCEEDED(bundleReaderUtf8->GetPayloadPackage("resources.language-af.map.appx", &package2));
+    REQUIRE_ARE_SAME(package.Get(), package2.Get());
+
+    MsixTest::ComPtr<IStream> packageStream;
+    REQUIRE_SUCCEEDED(package->GetStream(&packageStream));
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+    REQUIRE_SUCCEEDED(factory->CreatePackageReader(packageStream.Get(), &packageReader));
+}
+
+// Deferred packages asked for from several threads at once are validated once
+TEST_CASE("Api_AppxBundleReader_DeferBundlePackages_Concurrent", "[api]")
+{
+    auto bundlePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unbundle) + "/StoreSigned_Desktop_x86_x64_MoviesTV.appxbundle";
+    auto inputStream = MsixTest::StreamFile(bundlePath, true);
+
+    MsixTest::ComPtr<IAppxBundleFactory> bundleFactory;
+    REQUIRE_SUCCEEDED(CoCreateAppxBundleFactoryWithHeapAndOptions(
+        MsixTest::Allocators::Allocate,
+        MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+        MSIX_APPLICABILITY_OPTIONS::MSIX_APPLICABILITY_OPTION_FULL,
+        MSIX_FACTORY_OPTION_READER_DEFER_BUNDLE_PACKAGES,
+        &bundleFactory));
+    MsixTest::ComPtr<IAppxBundleReader> bundleReader;
+    REQUIRE_SUCCEEDED(bundleFactory->CreateBundleReader(inputStream.Get(), &bundleReader));
+    MsixTest::ComPtr<IAppxBundleReaderUtf8> bundleReaderUtf8;
+    REQUIRE_SUCCEEDED(bundleReader->QueryInterface(UuidOfImpl<IAppxBundleReaderUtf8>::iid, reinterpret_cast<void**>(&bundleReaderUtf8)));
+
+    // Not applicable for an English system, so none of them is validated yet
+    std::vector<std::string> names = { "resources.language-af.map.appx", "resources.language-am.map.appx", "resources.language-ar.map.appx" };
+
+    // Every thread asks for every package. Catch assertions are not thread safe, so only record the results.
+    const std::size_t threadCount = 4;
+    std::vector<HRESULT> results(threadCount * names.size(), S_OK);
+    std::vector<MsixTest::ComPtr<IAppxFile>> packages(threadCount * names.size());
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < threadCount; t++)
+    {
+        threads.emplace_back([&, t]()
+        {
+            for (std::size_t i = 0; i < names.size(); i++)
+            {
+                results[t * names.size() + i] = bundleReaderUtf8->GetPayloadPackage(names[i].c_str(), &packages[t * names.size() + i]);
+            }
+        });
+    }
+    for (auto& thread : threads) { thread.join(); }
+
+    for (std::size_t i = 0; i < results.size(); i++)
+    {
+        REQUIRE_SUCCEEDED(results[i]);
+        REQUIRE_ARE_SAME(packages[i % names.size()].Get(), packages[i].Get());
+    }
+}
+
+// Validates the identity of a bundle can be read without opening it
+TEST_CASE("Api_AppxBundleReader_ReadPackageIdentity", "[api]")
+{
+    auto bundlePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unbundle) + "/StoreSigned_Desktop_x86_x64_MoviesTV.appxbundle";
+    auto inputStream = MsixTest::StreamFile(bundlePath, true);
+
+    MsixTest::ComPtr<IAppxBundleFactory> bundleFactory;
+    REQUIRE_SUCCEEDED(CoCreateAppxBundleFactoryWithHeap(
+        MsixTest::Allocators::Allocate,
+        MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+        MSIX_APPLICABILITY_OPTIONS::MSIX_APPLICABILITY_OPTION_FULL,
+        &bundleFactory));
+    MsixTest::ComPtr<IAppxBundleReader> bundleReader;
+    REQUIRE_SUCCEEDED(bundleFactory->CreateBundleReader(inputStream.Get(), &bundleReader));
+    MsixTest::ComPtr<IAppxBundleManifestReader> manifestReader;
+    REQUIRE_SUCCEEDED(bundleReader->GetManifest(&manifestReader));
+    MsixTest::ComPtr<IAppxManifestPackageId> expectedPackageId;
+    REQUIRE_SUCCEEDED(manifestReader->GetPackageId(&expectedPackageId));
+
+    auto identityStream = MsixTest::StreamFile(bundlePath, true);
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_FULL, &factory));
+    MsixTest::ComPtr<IAppxManifestPackageId> packageId;
+    REQUIRE_SUCCEEDED(ReadPackageIdentityFromStream(factory.Get(), identityStream.Get(), &packageId));
+
+    MsixTest::Wrappers::Buffer<wchar_t> fullName;
+    MsixTest::Wrappers::Buffer<wchar_t> expectedFullName;
+    REQUIRE_SUCCEEDED(packageId->GetPackageFullName(&fullName));
+    REQUIRE_SUCCEEDED(expectedPackageId->GetPackageFullName(&expectedFullName));
+    REQUIRE(expectedFullName.ToString() == fullName.ToString());
+}
+
+// Validates that opening the same bundle again with the same factory selects the same packages
+TEST_CASE("Api_AppxBundleReader_ApplicabilityReused", "[api]")
+{
+    auto bundlePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unbundle) + "/StoreSigned_Desktop_x86_x64_MoviesTV.appxbundle";
+
+    MsixTest::ComPtr<IAppxBundleFactory> bundleFactory;
+    REQUIRE_SUCCEEDED(CoCreateAppxBundleFactoryWithHeap(
+        MsixTest::Allocators::Allocate,
+        MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+        MSIX_APPLICABILITY_OPTIONS::MSIX_APPLICABILITY_OPTION_FULL,
+        &bundleFactory));
+
+    auto getPayloadPackages = [&]()
+    {
+        auto inputStream = MsixTest::StreamFile(bundlePath, true);
+        MsixTest::ComPtr<IAppxBundleReader> bundleReader;
+        REQUIRE_SUCCEEDED(bundleFactory->CreateBundleReader(inputStream.Get(), &bundleReader));
+
+        std::vector<std::string> result;
+        MsixTest::ComPtr<IAppxFilesEnumerator> packages;
+        REQUIRE_SUCCEEDED(bundleReader->GetPayloadPackages(&packages));
+        BOOL hasCurrent = FALSE;
+        REQUIRE_SUCCEEDED(packages->GetHasCurrent(&hasCurrent));
+        while (hasCurrent)
+        {
+            MsixTest::ComPtr<IAppxFile> package;
+            REQUIRE_SUCCEEDED(packages->GetCurrent(&package));
+            MsixTest::Wrappers::Buffer<wchar_t> packageName;
+            REQUIRE_SUCCEEDED(package->GetName(&packageName));
+            result.push_back(packageName.ToString());
+
+            // The package readers are still the ones of this bundle reader.
+            MsixTest::ComPtr<IStream> packageStream;
+            REQUIRE_SUCCEEDED(package->GetStream(&packageStream));
+            REQUIRE_NOT_NULL(packageStream.Get());
+            REQUIRE_SUCCEEDED(packages->MoveNext(&hasCurrent));
+        }
+        return result;
+    };
+
+    auto first = getPayloadPackages();
+    REQUIRE(first.size() > 0);
+    REQUIRE(first.size() < MsixTest::Unbundle::GetExpectedPackages().size());
+    auto second = getPayloadPackages();
+    REQUIRE(first == second);
+}
+
+// Validates the packages selected for several profiles from one bundle reader
+TEST_CASE("Api_AppxBundleReader_ApplicablePackagesForProfiles", "[api]")
+{
+    std::string bundle = "StoreSigned_Desktop_x86_x64_MoviesTV.appxbundle";
+    MsixTest::ComPtr<IAppxBundleReader> bundleReader;
+    MsixTest::InitializeBundleReader(bundle, &bundleReader);
+    auto expectedPackages = MsixTest::Unbundle::GetExpectedPackages();
+
+    LPCSTR french[] = { "fr-FR" };
+    LPCSTR germanAndSpanish[] = { "de-DE", "es-MX" };
+    MSIX_APPLICABILITY_PROFILE profiles[] = {
+        { MSIX_APPLICABILITY_OPTION_FULL, 1, french },
+        { MSIX_APPLICABILITY_OPTION_FULL, 2, germanAndSpanish },
+        { static_cast<MSIX_APPLICABILITY_OPTIONS>(MSIX_APPLICABILITY_NONE), 0, nullptr },
+    };
+    // No application package has a match for these languages, so all of them apply
+    std::vector<std::vector<std::string>> expected = {
+        { "Video_Production_x86.appx", "Video_Production_x64.appx", "resources.language-fr.map.appx" },
+        { "Video_Production_x86.appx", "Video_Production_x64.appx", "resources.language-de.map.appx", "resources.language-es.map.appx" },
+    };
+
+    auto packageCount = static_cast<UINT32>(expectedPackages.size());
+    std::vector<BOOL> applicable(3 * packageCount, FALSE);
+    REQUIRE_HR(static_cast<HRESULT>(MSIX::Error::InvalidParameter),
+        GetApplicablePackagesForProfiles(bundleReader.Get(), 3, profiles, packageCount - 1, applicable.data()));
+    REQUIRE_SUCCEEDED(GetApplicablePackagesForProfiles(bundleReader.Get(), 3, profiles, packageCount, applicable.data()));
+
+    for (std::size_t profile = 0; profile < expected.size(); profile++)
+    {
+        std::vector<std::string> selected;
+        for (UINT32 i = 0; i < packageCount; i++)
+        {
+            if (applicable[profile * packageCount + i]) { selected.push_back(expectedPackages[i].name); }
+        }
+        REQUIRE(expected[profile] == selected);
+    }
+    // Without applicability every package applies
+    REQUIRE(std::all_of(applicable.begin() + 2 * packageCount, applicable.end(), [](BOOL value) { return value == TRUE; }));
+}
+
+// Validates that one factory can be shared by threads creating package and bundle readers at the same time
+TEST_CASE("Api_AppxBundleReader_SharedFactory_ConcurrentReaders", "[api]")
+{
+    auto packagePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack) + "/StoreSigned_Desktop_x64_MoviesTV.appx";
+    auto bundlePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unbundle) + "/StoreSigned_Desktop_x86_x64_MoviesTV.appxbundle";
+
+    MsixTest::ComPtr<IAppxBundleFactory> bundleFactory;
+    REQUIRE_SUCCEEDED(CoCreateAppxBundleFactoryWithHeap(
+        MsixTest::Allocators::Allocate,
+        MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+        static_cast<MSIX_APPLICABILITY_OPTIONS>(MSIX_APPLICABILITY_OPTIONS::MSIX_APPLICABILITY_OPTION_SKIPPLATFORM |
+                                                MSIX_APPLICABILITY_OPTIONS::MSIX_APPLICABILITY_OPTION_SKIPLANGUAGE),
+        &bundleFactory));
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(bundleFactory->QueryInterface(UuidOfImpl<IAppxFactory>::iid, reinterpret_cast<void**>(&factory)));
+
+    // What a single reader sees.
+    std::size_t expectedFiles = 0;
+    UINT64 expectedBytes = 0;
+    {
+        auto inputStream = MsixTest::StreamFile(packagePath, true);
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+        MsixTest::ComPtr<IAppxFilesEnumerator> files;
+        REQUIRE_SUCCEEDED(packageReader->GetPayloadFiles(&files));
+        REQUIRE_SUCCEEDED(ReadFiles(files.Get(), true, expectedFiles, expectedBytes));
+    }
+    REQUIRE(expectedFiles > 0);
+    std::size_t expectedPackages = MsixTest::Unbundle::GetExpectedPackages().size();
+
+    // Even threads read the package, odd threads the bundle. The streams are opened here because StreamFile
+    // asserts, every thread gets its own.
+    const std::size_t threadCount = 8;
+    const std::size_t iterations = 3;
+    std::vector<std::unique_ptr<MsixTest::StreamFile>> inputStreams;
+    for (std::size_t i = 0; i < threadCount * iterations; i++)
+    {
+        bool isBundle = ((i / iterations) % 2) != 0;
+        inputStreams.push_back(std::unique_ptr<MsixTest::StreamFile>(new MsixTest::StreamFile(isBundle ? bundlePath : packagePath, true)));
+    }
+
+    std::vector<HRESULT> results(threadCount * iterations, S_OK);
+    std::vector<std::size_t> counts(threadCount * iterations, 0);
+    std::vector<UINT64> bytes(threadCount * iterations, 0);
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < threadCount; t++)
+    {
+        threads.emplace_back([&, t]()
+        {
+            bool isBundle = (t % 2) != 0;
+            for (std::size_t i = t * iterations; i < (t + 1) * iterations; i++)
+            {
+                MsixTest::ComPtr<IAppxFilesEnumerator> files;
+                if (isBundle)
+                {
+                    MsixTest::ComPtr<IAppxBundleReader> bundleReader;
+                    results[i] = bundleFactory->CreateBundleReader(inputStreams[i]->Get(), &bundleReader);
+                    if (SUCCEEDED(results[i])) { results[i] = bundleReader->GetPayloadPackages(&files); }
+                }
+                else
+                {
+                    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+                    results[i] = factory->CreatePackageReader(inputStreams[i]->Get(), &packageReader);
+                    if (SUCCEEDED(results[i])) { results[i] = packageReader->GetPayloadFiles(&files); }
+                }
+                if (SUCCEEDED(results[i])) { results[i] = ReadFiles(files.Get(), !isBundle, counts[i], bytes[i]); }
+            }
+        });
+    }
+    for (auto& thread : threads) { thread.join(); }
+
+    for (std::size_t i = 0; i < threadCount * iterations; i++)
+    {
+        bool isBundle = ((i / iterations) % 2) != 0;
+        REQUIRE(SUCCEEDED(results[i]));
+        REQUIRE(counts[i] == (isBundle ? expectedPackages : expectedFiles));
+        REQUIRE(bytes[i] == (isBundle ? 0 : expectedBytes));
+    }
+}
+
+// The packages of a bundle read from a range reader are opened from bytes fetched ahead in a few batches, instead
+// of a few requests per package
+TEST_CASE("Api_AppxBundleReader_RangeReaderPrefetch", "[api]")
+{
+    auto bundlePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unbundle) + "/StoreSigned_Desktop_x86_x64_MoviesTV.appxbundle";
+    auto inputStream = MsixTest::StreamFile(bundlePath, true);
+    BundleRangeReader rangeReader(inputStream.Get());
+    MsixTest::ComPtr<IStream> stream;
+    REQUIRE_SUCCEEDED(CreateStreamOnRangeReader(&rangeReader, 0, &stream));
+
+    MsixTest::ComPtr<IAppxBundleFactory> bundleFactory;
+    REQUIRE_SUCCEEDED(CoCreateAppxBundleFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        static_cast<MSIX_VALIDATION_OPTION>(MSIX_VALIDATION_OPTION_SKIPSIGNATURE | MSIX_VALIDATION_OPTION_DEFERLOCALFILEHEADERS),
+        static_cast<MSIX_APPLICABILITY_OPTIONS>(MSIX_APPLICABILITY_OPTIONS::MSIX_APPLICABILITY_OPTION_SKIPPLATFORM |
+                                                MSIX_APPLICABILITY_OPTIONS::MSIX_APPLICABILITY_OPTION_SKIPLANGUAGE),
+        &bundleFactory));
+    MsixTest::ComPtr<IAppxBundleReader> bundleReader;
+    REQUIRE_SUCCEEDED(bundleFactory->CreateBundleReader(stream.Get(), &bundleReader));
+    auto bundleRequests = rangeReader.requests;
+    MsixTest::ComPtr<IAppxFilesEnumerator> packages;
+    REQUIRE_SUCCEEDED(bundleReader->GetPayloadPackages(&packages));
+    std::size_t count = 0;
+    UINT64 bytes = 0;
+    REQUIRE_SUCCEEDED(ReadFiles(packages.Get(), false, count, bytes));
+    REQUIRE(count == MsixTest::Unbundle::GetExpectedPackages().size());
+    // The 107 packages are opened with less than a request each
+    REQUIRE(rangeReader.requests - bundleRequests < 16);
+}
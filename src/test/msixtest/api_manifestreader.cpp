@@ -129,6 +129,30 @@ TEST_CASE("Api_AppxManifestReader_Properties", "[api]")
         propertiesUtf8->GetStringValue("InvalidValue", &valueUtf8));
 }
 
+// Validates that manifest sections are read once and the same objects are returned afterwards
+TEST_CASE("Api_AppxManifestReader_SectionsCached", "[api]")
+{
+    std::string manifest = "Sample_AppxManifest.xml";
+    MsixTest::ComPtr<IAppxManifestReader> manifestReader;
+    MsixTest::InitializeManifestReader(manifest, &manifestReader);
+
+    MsixTest::ComPtr<IAppxManifestProperties> properties;
+    MsixTest::ComPtr<IAppxManifestProperties> propertiesAgain;
+    REQUIRE_SUCCEEDED(manifestReader->GetProperties(&properties));
+    REQUIRE_SUCCEEDED(manifestReader->GetProperties(&propertiesAgain));
+    REQUIRE(properties.Get() == propertiesAgain.Get());
+
+    MsixTest::ComPtr<IAppxManifestApplicationsEnumerator> enumerator;
+    MsixTest::ComPtr<IAppxManifestApplicationsEnumerator> enumeratorAgain;
+    REQUIRE_SUCCEEDED(manifestReader->GetApplications(&enumerator));
+    REQUIRE_SUCCEEDED(manifestReader->GetApplications(&enumeratorAgain));
+    MsixTest::ComPtr<IAppxManifestApplication> app;
+    MsixTest::ComPtr<IAppxManifestApplication> appAgain;
+    REQUIRE_SUCCEEDED(enumerator->GetCurrent(&app));
+    REQUIRE_SUCCEEDED(enumeratorAgain->GetCurrent(&appAgain));
+    REQUIRE(app.Get() == appAgain.Get());
+}
+
 // Validates package dependencies. IAppxManifestPackageDependency and IAppxManifestPackageDependencyUtf8
 TEST_CASE("Api_AppxManifestReader_PackageDependencies", "[api]")
 {
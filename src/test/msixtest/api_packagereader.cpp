@@ -10,8 +10,17 @@
 #include "BlockMapTestData.hpp"
 #include "macros.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <array>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 // Validates all payload files from the package are correct
 TEST_CASE("Api_AppxPackageReader_PayloadFiles", "[api]")
@@ -67,45 +76,2082 @@ TEST_CASE("Api_AppxPackageReader_PayloadFiles", "[api]")
     REQUIRE(expectedFiles.empty());
 }
 
+// Enumerators of the payload files share the files of the package, each with its own cursor, and a file is handed
+// out with its stream at its start
+TEST_CASE("Api_AppxPackageReader_PayloadFiles_SharedEnumerators", "[api]")
+{
+    std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+    MsixTest::InitializePackageReader(package, &packageReader);
+
+    MsixTest::ComPtr<IAppxFilesEnumerator> first;
+    MsixTest::ComPtr<IAppxFilesEnumerator> second;
+    REQUIRE_SUCCEEDED(packageReader->GetPayloadFiles(&first));
+    REQUIRE_SUCCEEDED(packageReader->GetPayloadFiles(&second));
+    BOOL hasCurrent = FALSE;
+    REQUIRE_SUCCEEDED(first->GetHasCurrent(&hasCurrent));
+    REQUIRE(hasCurrent);
+    BOOL secondHasCurrent = FALSE;
+    std::size_t count = 0;
+    while (hasCurrent)
+    {
+        MsixTest::ComPtr<IAppxFile> file;
+        REQUIRE_SUCCEEDED(first->GetCurrent(&file));
+        MsixTest::ComPtr<IStream> stream;
+        REQUIRE_SUCCEEDED(file->GetStream(&stream));
+        std::array<char, 16> buffer;
+        ULONG read = 0;
+        REQUIRE_SUCCEEDED(stream->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &read));
+
+        REQUIRE_SUCCEEDED(second->GetHasCurrent(&secondHasCurrent));
+        REQUIRE(secondHasCurrent);
+        MsixTest::ComPtr<IAppxFile> same;
+        REQUIRE_SUCCEEDED(second->GetCurrent(&same));
+        REQUIRE_ARE_SAME(file.Get(), same.Get());
+        ULARGE_INTEGER position = { 0 };
+        REQUIRE_SUCCEEDED(stream->Seek({ 0 }, STREAM_SEEK_CUR, &position));
+        CHECK(position.QuadPart == 0);
+
+        count++;
+        REQUIRE_SUCCEEDED(first->MoveNext(&hasCurrent));
+        REQUIRE_SUCCEEDED(second->MoveNext(&secondHasCurrent));
+    }
+    CHECK(!secondHasCurrent);
+
+    // A new enumerator starts over
+    MsixTest::ComPtr<IAppxFilesEnumerator> third;
+    REQUIRE_SUCCEEDED(packageReader->GetPayloadFiles(&third));
+    REQUIRE_SUCCEEDED(third->GetHasCurrent(&hasCurrent));
+    std::size_t thirdCount = 0;
+    while (hasCurrent)
+    {
+        thirdCount++;
+        REQUIRE_SUCCEEDED(third->MoveNext(&hasCurrent));
+    }
+    CHECK(thirdCount == count);
+}
+
+// Validates that payload files from the same package can be read concurrently
+TEST_CASE("Api_AppxPackageReader_PayloadFiles_ConcurrentReads", "[api]")
+{
+    std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+    MsixTest::InitializePackageReader(package, &packageReader);
+
+    std::vector<MsixTest::ComPtr<IStream>> streams;
+    std::vector<UINT64> expectedSizes;
+    MsixTest::ComPtr<IAppxFilesEnumerator> files;
+    REQUIRE_SUCCEEDED(packageReader->GetPayloadFiles(&files));
+    BOOL hasCurrent = FALSE;
+    REQUIRE_SUCCEEDED(files->GetHasCurrent(&hasCurrent));
+    while (hasCurrent)
+    {
+        MsixTest::ComPtr<IAppxFile> file;
+        REQUIRE_SUCCEEDED(files->GetCurrent(&file));
+        UINT64 size = 0;
+        REQUIRE_SUCCEEDED(file->GetSize(&size));
+        expectedSizes.push_back(size);
+        MsixTest::ComPtr<IStream> stream;
+        REQUIRE_SUCCEEDED(file->GetStream(&stream));
+        streams.push_back(stream);
+        REQUIRE_SUCCEEDED(files->MoveNext(&hasCurrent));
+    }
+
+    // Each thread reads every other file. Catch assertions are not thread safe, so only record the results.
+    const std::size_t threadCount = 2;
+    std::vector<HRESULT> results(streams.size(), S_OK);
+    std::vector<UINT64> sizes(streams.size(), 0);
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < threadCount; t++)
+    {
+        threads.emplace_back([&, t]()
+        {
+            std::vector<std::uint8_t> buffer(4096);
+            for (std::size_t i = t; i < streams.size(); i += threadCount)
+            {
+                ULONG read = 0;
+                do
+                {
+                    results[i] = streams[i]->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &read);
+                    sizes[i] += read;
+                } while (SUCCEEDED(results[i]) && read > 0);
+            }
+        });
+    }
+    for (auto& thread : threads) { thread.join(); }
+
+    for (std::size_t i = 0; i < streams.size(); i++)
+    {
+        REQUIRE(SUCCEEDED(results[i])); // short reads return S_FALSE
+        REQUIRE(expectedSizes[i] == sizes[i]);
+    }
+}
+
 // Verifies a payload file information from the package
 TEST_CASE("Api_AppxPackageReader_PayloadFile", "[api]")
 {
-    std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+    MsixTest::InitializePackageReader(package, &packageReader);
+
+    MsixTest::ComPtr<IAppxFile> appxFile;
+
+    // Even on non windows, GetPayloadFile expects a '\'
+    std::string fileName = "Assets\\video_offline_demo_page2.jpg";
+    auto fileNameW = MsixTest::String::utf8_to_utf16(fileName);
+
+    REQUIRE_SUCCEEDED(packageReader->GetPayloadFile(fileNameW.c_str(), &appxFile));
+    REQUIRE_NOT_NULL(appxFile.Get());
+
+    MsixTest::Wrappers::Buffer<wchar_t> appxFileName;
+    REQUIRE_SUCCEEDED(appxFile->GetName(&appxFileName));
+    REQUIRE(fileName == appxFileName.ToString());
+
+    APPX_COMPRESSION_OPTION fileCompression;
+    REQUIRE_SUCCEEDED(appxFile->GetCompressionOption(&fileCompression));
+    REQUIRE(APPX_COMPRESSION_OPTION_NONE == fileCompression);
+
+    UINT64 fileSize;
+    REQUIRE_SUCCEEDED(appxFile->GetSize(&fileSize));
+    REQUIRE(78720 == static_cast<std::uint64_t>(fileSize));
+}
+
+// Validates a package can be read from a memory mapped file
+TEST_CASE("Api_AppxPackageReader_MappedFile", "[api]")
+{
+    std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    auto packagePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack) + "/" + package;
+    packagePath = MsixTest::Directory::PathAsCurrentPlatform(packagePath);
+
+    MsixTest::ComPtr<IStream> stream;
+    REQUIRE_SUCCEEDED(CreateStreamOnFileMapped(const_cast<char*>(packagePath.c_str()), &stream));
+    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+    MsixTest::InitializePackageReader(stream.Get(), &packageReader);
+
+    MsixTest::ComPtr<IAppxFile> appxFile;
+    REQUIRE_SUCCEEDED(packageReader->GetPayloadFile(L"Assets\\video_offline_demo_page2.jpg", &appxFile));
+    MsixTest::ComPtr<IStream> fileStream;
+    REQUIRE_SUCCEEDED(appxFile->GetStream(&fileStream));
+
+    std::vector<std::uint8_t> buffer(4096);
+    std::uint64_t size = 0;
+    ULONG read = 0;
+    do
+    {
+        HRESULT hr = fileStream->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &read);
+        REQUIRE(SUCCEEDED(hr)); // short reads return S_FALSE
+        size += read;
+    } while (read > 0);
+    REQUIRE(78720 == size);
+}
+
+// Validates streams over the same file from CreateStreamOnFileShared, through different paths, read a package
+// concurrently with positions of their own, and clones keep their position
+TEST_CASE("Api_AppxPackageReader_SharedFile", "[api]")
+{
+    std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    auto directory = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack);
+    std::vector<std::string> paths = {
+        MsixTest::Directory::PathAsCurrentPlatform(directory + "/" + package),
+        MsixTest::Directory::PathAsCurrentPlatform(directory + "/./" + package) };
+
+    std::vector<MsixTest::ComPtr<IStream>> streams(4);
+    for (std::size_t i = 0; i < streams.size(); i++)
+    {
+        REQUIRE_SUCCEEDED(CreateStreamOnFileShared(const_cast<char*>(paths[i % paths.size()].c_str()), &streams[i]));
+    }
+    LARGE_INTEGER position = { 0 };
+    position.QuadPart = 100;
+    REQUIRE_SUCCEEDED(streams[0]->Seek(position, STREAM_SEEK_SET, nullptr));
+    MsixTest::ComPtr<IStream> clone;
+    REQUIRE_SUCCEEDED(streams[0]->Clone(&clone));
+    ULARGE_INTEGER current = { 0 };
+    REQUIRE_SUCCEEDED(clone->Seek({ 0 }, STREAM_SEEK_CUR, &current));
+    REQUIRE(100 == current.QuadPart);
+    REQUIRE_SUCCEEDED(streams[1]->Seek({ 0 }, STREAM_SEEK_CUR, &current));
+    REQUIRE(0 == current.QuadPart);
+    REQUIRE_SUCCEEDED(streams[0]->Seek({ 0 }, STREAM_SEEK_SET, nullptr));
+
+    std::vector<std::uint64_t> sizes(streams.size());
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < streams.size(); i++)
+    {
+        threads.emplace_back([&streams, &sizes, i]()
+        {
+            // Catch isn't thread safe, failures show as a wrong size. FAILED evaluates its argument twice.
+            MsixTest::ComPtr<IAppxFactory> factory;
+            HRESULT hr = CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+                MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory);
+            if (FAILED(hr)) { return; }
+            MsixTest::ComPtr<IAppxPackageReader> packageReader;
+            hr = factory->CreatePackageReader(streams[i].Get(), &packageReader);
+            if (FAILED(hr)) { return; }
+            MsixTest::ComPtr<IAppxFile> appxFile;
+            hr = packageReader->GetPayloadFile(L"Assets\\video_offline_demo_page2.jpg", &appxFile);
+            if (FAILED(hr)) { return; }
+            MsixTest::ComPtr<IStream> fileStream;
+            hr = appxFile->GetStream(&fileStream);
+            if (FAILED(hr)) { return; }
+            std::vector<std::uint8_t> buffer(4096);
+            ULONG read = 0;
+            do
+            {
+                hr = fileStream->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &read);
+                if (FAILED(hr)) { return; }
+                sizes[i] += read;
+            } while (read > 0);
+        });
+    }
+    for (auto& thread : threads) { thread.join(); }
+    for (auto size : sizes)
+    {
+        REQUIRE(78720 == size);
+    }
+}
+
+// Validates copying from a memory mapped file
+TEST_CASE("Api_AppxPackageReader_MappedFile_CopyTo", "[api]")
+{
+    std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    auto packagePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack) + "/" + package;
+    packagePath = MsixTest::Directory::PathAsCurrentPlatform(packagePath);
+    std::string outputFile = "mapped_copy.appx";
+
+    MsixTest::ComPtr<IStream> stream;
+    REQUIRE_SUCCEEDED(CreateStreamOnFileMapped(const_cast<char*>(packagePath.c_str()), &stream));
+    ULARGE_INTEGER size = { 0 };
+    REQUIRE_SUCCEEDED(stream->Seek({ 0 }, STREAM_SEEK_END, &size));
+    LARGE_INTEGER start = { 0 };
+    start.QuadPart = 100;
+    REQUIRE_SUCCEEDED(stream->Seek(start, STREAM_SEEK_SET, nullptr));
+
+    {
+        auto outputStream = MsixTest::StreamFile(outputFile, false);
+        ULARGE_INTEGER count = { 0 };
+        count.QuadPart = std::numeric_limits<std::uint64_t>::max();
+        ULARGE_INTEGER bytesRead = { 0 };
+        ULARGE_INTEGER bytesWritten = { 0 };
+        REQUIRE_SUCCEEDED(stream->CopyTo(outputStream.Get(), count, &bytesRead, &bytesWritten));
+        REQUIRE(size.QuadPart - 100 == bytesRead.QuadPart);
+        REQUIRE(size.QuadPart - 100 == bytesWritten.QuadPart);
+    }
+    ULARGE_INTEGER position = { 0 };
+    REQUIRE_SUCCEEDED(stream->Seek({ 0 }, STREAM_SEEK_CUR, &position));
+    REQUIRE(size.QuadPart == position.QuadPart);
+
+    auto copy = MsixTest::StreamFile(outputFile, true, true);
+    REQUIRE_SUCCEEDED(stream->Seek(start, STREAM_SEEK_SET, nullptr));
+    std::vector<std::uint8_t> expected(65536);
+    std::vector<std::uint8_t> actual(65536);
+    ULONG expectedRead = 0;
+    ULONG actualRead = 0;
+    do
+    {
+        REQUIRE_SUCCEEDED(stream->Read(expected.data(), static_cast<ULONG>(expected.size()), &expectedRead));
+        REQUIRE_SUCCEEDED(copy.Get()->Read(actual.data(), static_cast<ULONG>(actual.size()), &actualRead));
+        REQUIRE(expectedRead == actualRead);
+        REQUIRE(std::equal(expected.begin(), expected.begin() + expectedRead, actual.begin()));
+    } while (expectedRead > 0);
+}
+
+// Validates random access into a compressed payload file returns the same bytes as reading it sequentially
+TEST_CASE("Api_AppxPackageReader_PayloadFile_CompressedSeek", "[api]")
+{
+    std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+    MsixTest::InitializePackageReader(package, &packageReader);
+
+    MsixTest::ComPtr<IAppxFile> appxFile;
+    REQUIRE_SUCCEEDED(packageReader->GetPayloadFile(L"resources.pri", &appxFile));
+    APPX_COMPRESSION_OPTION fileCompression;
+    REQUIRE_SUCCEEDED(appxFile->GetCompressionOption(&fileCompression));
+    REQUIRE(APPX_COMPRESSION_OPTION_NONE != fileCompression);
+    UINT64 fileSize = 0;
+    REQUIRE_SUCCEEDED(appxFile->GetSize(&fileSize));
+
+    MsixTest::ComPtr<IStream> fileStream;
+    REQUIRE_SUCCEEDED(appxFile->GetStream(&fileStream));
+    std::vector<std::uint8_t> expected(static_cast<size_t>(fileSize));
+    ULONG read = 0;
+    REQUIRE_SUCCEEDED(fileStream->Read(expected.data(), static_cast<ULONG>(expected.size()), &read));
+    REQUIRE(expected.size() == read);
+
+    const std::uint64_t blockSize = 65536;
+    std::vector<std::uint8_t> buffer(static_cast<size_t>(blockSize));
+    for (std::uint64_t offset = ((fileSize - 1) / blockSize) * blockSize + 100; offset >= blockSize; offset -= blockSize)
+    {
+        LARGE_INTEGER li = { 0 };
+        li.QuadPart = offset;
+        REQUIRE_SUCCEEDED(fileStream->Seek(li, STREAM_SEEK_SET, nullptr));
+        HRESULT hr = fileStream->Read(buffer.data(), 1000, &read);
+        REQUIRE(SUCCEEDED(hr));
+        REQUIRE(std::min<std::uint64_t>(1000, fileSize - offset) == read);
+        REQUIRE(std::equal(buffer.begin(), buffer.begin() + read, expected.begin() + static_cast<size_t>(offset)));
+    }
+}
+
+// Validates random access into the stored payload files, which are read a block at a time from the package
+TEST_CASE("Api_AppxPackageReader_PayloadFile_StoredSeek", "[api]")
+{
+    std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+    MsixTest::InitializePackageReader(package, &packageReader);
+
+    MsixTest::ComPtr<IAppxFilesEnumerator> files;
+    REQUIRE_SUCCEEDED(packageReader->GetPayloadFiles(&files));
+    BOOL hasCurrent = FALSE;
+    REQUIRE_SUCCEEDED(files->GetHasCurrent(&hasCurrent));
+    std::size_t storedFiles = 0;
+    while (hasCurrent)
+    {
+        MsixTest::ComPtr<IAppxFile> file;
+        REQUIRE_SUCCEEDED(files->GetCurrent(&file));
+        REQUIRE_SUCCEEDED(files->MoveNext(&hasCurrent));
+        APPX_COMPRESSION_OPTION fileCompression;
+        REQUIRE_SUCCEEDED(file->GetCompressionOption(&fileCompression));
+        UINT64 fileSize = 0;
+        REQUIRE_SUCCEEDED(file->GetSize(&fileSize));
+        if (APPX_COMPRESSION_OPTION_NONE != fileCompression || fileSize == 0) { continue; }
+        storedFiles++;
+
+        MsixTest::ComPtr<IStream> fileStream;
+        REQUIRE_SUCCEEDED(file->GetStream(&fileStream));
+        std::vector<std::uint8_t> expected(static_cast<size_t>(fileSize));
+        ULONG read = 0;
+        REQUIRE_SUCCEEDED(fileStream->Read(expected.data(), static_cast<ULONG>(expected.size()), &read));
+        REQUIRE(expected.size() == read);
+
+        std::vector<std::uint8_t> buffer(1000);
+        for (UINT64 offset : { fileSize - 1, fileSize / 2, static_cast<UINT64>(0) })
+        {
+            LARGE_INTEGER li = { 0 };
+            li.QuadPart = offset;
+            REQUIRE_SUCCEEDED(fileStream->Seek(li, STREAM_SEEK_SET, nullptr));
+            HRESULT hr = fileStream->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &read);
+            REQUIRE(SUCCEEDED(hr)); // short reads return S_FALSE
+            REQUIRE(std::min<std::uint64_t>(buffer.size(), fileSize - offset) == read);
+            REQUIRE(std::equal(buffer.begin(), buffer.begin() + read, expected.begin() + static_cast<size_t>(offset)));
+        }
+        REQUIRE_SUCCEEDED(fileStream->Seek({ 0 }, STREAM_SEEK_SET, nullptr));
+    }
+    REQUIRE(storedFiles > 0);
+}
+
+// Validates reads that end in the middle of a block return the same bytes as reading whole blocks
+TEST_CASE("Api_AppxPackageReader_PayloadFile_UnalignedReads", "[api]")
+{
+    std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+    MsixTest::InitializePackageReader(package, &packageReader);
+
+    MsixTest::ComPtr<IAppxFile> appxFile;
+    REQUIRE_SUCCEEDED(packageReader->GetPayloadFile(L"resources.pri", &appxFile));
+    UINT64 fileSize = 0;
+    REQUIRE_SUCCEEDED(appxFile->GetSize(&fileSize));
+
+    MsixTest::ComPtr<IStream> fileStream;
+    REQUIRE_SUCCEEDED(appxFile->GetStream(&fileStream));
+    std::vector<std::uint8_t> expected(static_cast<size_t>(fileSize));
+    ULONG read = 0;
+    REQUIRE_SUCCEEDED(fileStream->Read(expected.data(), static_cast<ULONG>(expected.size()), &read));
+    REQUIRE(expected.size() == read);
+
+    REQUIRE_SUCCEEDED(fileStream->Seek({ 0 }, STREAM_SEEK_SET, nullptr));
+    std::vector<std::uint8_t> actual(static_cast<size_t>(fileSize));
+    std::size_t position = 0;
+    for (ULONG count : { 100, 40000, 65536, 100000, 1 })
+    {
+        if (position == actual.size()) { break; }
+        count = static_cast<ULONG>(std::min<std::size_t>(count, actual.size() - position));
+        REQUIRE_SUCCEEDED(fileStream->Read(actual.data() + position, count, &read));
+        REQUIRE(count == read);
+        position += read;
+    }
+    REQUIRE_SUCCEEDED(fileStream->Read(actual.data() + position, static_cast<ULONG>(actual.size() - position), &read));
+    REQUIRE(actual.size() - position == read);
+    REQUIRE(expected == actual);
+}
+
+// Validates the blocks of a compressed payload file read on their own, and concurrently, match its stream
+TEST_CASE("Api_AppxPackageReader_PayloadFile_BlockReader", "[api]")
+{
+    std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+    MsixTest::InitializePackageReader(package, &packageReader);
+
+    MsixTest::ComPtr<IAppxFile> appxFile;
+    REQUIRE_SUCCEEDED(packageReader->GetPayloadFile(L"resources.pri", &appxFile));
+    UINT64 fileSize = 0;
+    REQUIRE_SUCCEEDED(appxFile->GetSize(&fileSize));
+
+    MsixTest::ComPtr<IStream> fileStream;
+    REQUIRE_SUCCEEDED(appxFile->GetStream(&fileStream));
+    std::vector<std::uint8_t> expected(static_cast<size_t>(fileSize));
+    ULONG read = 0;
+    REQUIRE_SUCCEEDED(fileStream->Read(expected.data(), static_cast<ULONG>(expected.size()), &read));
+    REQUIRE(expected.size() == read);
+
+    MsixTest::ComPtr<IMsixFileBlockReader> blockReader;
+    REQUIRE_SUCCEEDED(appxFile->QueryInterface(UuidOfImpl<IMsixFileBlockReader>::iid, reinterpret_cast<void**>(&blockReader)));
+    const std::uint64_t blockSize = 65536;
+    UINT32 blockCount = 0;
+    REQUIRE_SUCCEEDED(blockReader->GetBlockCount(&blockCount));
+    REQUIRE((fileSize + blockSize - 1) / blockSize == blockCount);
+
+    std::vector<std::uint8_t> buffer(static_cast<size_t>(blockSize) * 3);
+    for (UINT32 block = 0; block < blockCount; block++)
+    {
+        UINT32 bytesRead = 0;
+        REQUIRE_SUCCEEDED(blockReader->ReadBlock(block, static_cast<UINT32>(blockSize), buffer.data(), &bytesRead));
+        REQUIRE(std::min<std::uint64_t>(blockSize, fileSize - block * blockSize) == bytesRead);
+        REQUIRE(std::equal(buffer.begin(), buffer.begin() + bytesRead, expected.begin() + static_cast<size_t>(block * blockSize)));
+    }
+    UINT32 bytesRead = 0;
+    REQUIRE_HR(static_cast<HRESULT>(MSIX::Error::InvalidParameter), blockReader->ReadBlock(blockCount, static_cast<UINT32>(blockSize), buffer.data(), &bytesRead));
+
+    // Ranges inside a block, across blocks and past the end of the file
+    std::vector<std::pair<std::uint64_t, UINT32>> ranges = {
+        { 100, 1000 }, { blockSize - 10, 20 }, { blockSize / 2, static_cast<UINT32>(blockSize * 2) }, { fileSize - 100, 1000 }, { fileSize, 10 } };
+    for (const auto& range : ranges)
+    {
+        REQUIRE_SUCCEEDED(blockReader->ReadRange(range.first, range.second, buffer.data(), &bytesRead));
+        REQUIRE(std::min<std::uint64_t>(range.second, fileSize - range.first) == bytesRead);
+        REQUIRE(std::equal(buffer.begin(), buffer.begin() + bytesRead, expected.begin() + static_cast<size_t>(range.first)));
+    }
+
+    // Every thread reads every block. Catch assertions are not thread safe, so only record the results.
+    const std::size_t threadCount = 4;
+    std::vector<bool> matches(threadCount, true);
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < threadCount; t++)
+    {
+        threads.emplace_back([&, t]()
+        {
+            std::vector<std::uint8_t> block(static_cast<size_t>(blockSize));
+            for (UINT32 i = 0; i < blockCount; i++)
+            {
+                UINT32 index = static_cast<UINT32>((i + t) % blockCount);
+                UINT32 blockRead = 0;
+                if (FAILED(blockReader->ReadBlock(index, static_cast<UINT32>(blockSize), block.data(), &blockRead)) ||
+                    !std::equal(block.begin(), block.begin() + blockRead, expected.begin() + static_cast<size_t>(index * blockSize)))
+                {
+                    matches[t] = false;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) { thread.join(); }
+    REQUIRE(std::all_of(matches.begin(), matches.end(), [](bool match) { return match; }));
+
+    // Footprint files aren't in the block map
+    MsixTest::ComPtr<IAppxFile> manifestFile;
+    REQUIRE_SUCCEEDED(packageReader->GetFootprintFile(APPX_FOOTPRINT_FILE_TYPE_MANIFEST, &manifestFile));
+    MsixTest::ComPtr<IMsixFileBlockReader> manifestBlockReader;
+    REQUIRE_SUCCEEDED(manifestFile->QueryInterface(UuidOfImpl<IMsixFileBlockReader>::iid, reinterpret_cast<void**>(&manifestBlockReader)));
+    REQUIRE_HR(static_cast<HRESULT>(MSIX::Error::NotSupported), manifestBlockReader->GetBlockCount(&blockCount));
+}
+
+// Validates the blocks read by a reader of a factory with a block cache are found by its other readers
+TEST_CASE("Api_AppxPackageReader_PayloadFile_BlockCache", "[api]")
+{
+    auto unpackPath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack);
+    auto packagePath = unpackPath + "/StoreSigned_Desktop_x64_MoviesTV.appx";
+
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeapAndOptions(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_FULL, MSIX_FACTORY_OPTION_PERFORMANCE_COUNTERS, &factory));
+    REQUIRE_SUCCEEDED(MsixSetBlockCache(factory.Get(), 16 * 1024 * 1024));
+
+    // Reads the whole of resources.pri by its blocks with a new reader
+    auto readBlocks = [&]()
+    {
+        auto inputStream = MsixTest::StreamFile(packagePath, true);
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+        MsixTest::ComPtr<IAppxFile> appxFile;
+        REQUIRE_SUCCEEDED(packageReader->GetPayloadFile(L"resources.pri", &appxFile));
+        UINT64 fileSize = 0;
+        REQUIRE_SUCCEEDED(appxFile->GetSize(&fileSize));
+        MsixTest::ComPtr<IMsixFileBlockReader> blockReader;
+        REQUIRE_SUCCEEDED(appxFile->QueryInterface(UuidOfImpl<IMsixFileBlockReader>::iid, reinterpret_cast<void**>(&blockReader)));
+        std::vector<std::uint8_t> buffer(static_cast<size_t>(fileSize));
+        UINT32 bytesRead = 0;
+        REQUIRE_SUCCEEDED(blockReader->ReadRange(0, static_cast<UINT32>(fileSize), buffer.data(), &bytesRead));
+        REQUIRE(fileSize == bytesRead);
+        return buffer;
+    };
+
+    auto first = readBlocks();
+    MSIX_PERFORMANCE_COUNTERS counters = {};
+    REQUIRE_SUCCEEDED(MsixGetPerformanceCounters(factory.Get(), true, &counters));
+    CHECK(counters.stages[MSIX_PERFORMANCE_COUNTER_STAGE_BLOCKCACHE_HIT].calls == 0);
+    auto misses = counters.stages[MSIX_PERFORMANCE_COUNTER_STAGE_BLOCKCACHE_MISS];
+    CHECK(misses.calls > 0);
+    CHECK(misses.bytes == first.size());
+    auto inflateCalls = counters.stages[MSIX_PERFORMANCE_COUNTER_STAGE_INFLATE].calls;
+
+    // No block is inflated again, only the footprint files the reader reads
+    CHECK(readBlocks() == first);
+    REQUIRE_SUCCEEDED(MsixGetPerformanceCounters(factory.Get(), true, &counters));
+    CHECK(counters.stages[MSIX_PERFORMANCE_COUNTER_STAGE_BLOCKCACHE_HIT].calls == misses.calls);
+    CHECK(counters.stages[MSIX_PERFORMANCE_COUNTER_STAGE_BLOCKCACHE_MISS].calls == 0);
+    CHECK(counters.stages[MSIX_PERFORMANCE_COUNTER_STAGE_INFLATE].calls == inflateCalls - misses.calls);
+
+    // Without the cache the blocks are read from the package
+    REQUIRE_SUCCEEDED(MsixSetBlockCache(factory.Get(), 0));
+    CHECK(readBlocks() == first);
+    REQUIRE_SUCCEEDED(MsixGetPerformanceCounters(factory.Get(), true, &counters));
+    CHECK(counters.stages[MSIX_PERFORMANCE_COUNTER_STAGE_BLOCKCACHE_HIT].calls == 0);
+    CHECK(counters.stages[MSIX_PERFORMANCE_COUNTER_STAGE_INFLATE].calls == inflateCalls);
+
+    REQUIRE_HR(static_cast<HRESULT>(MSIX::Error::InvalidParameter), MsixSetBlockCache(nullptr, 0));
+}
+
+// Validate a file is not in the package.
+TEST_CASE("Api_AppxPackageReader_PayloadFile_DoesNotExist", "[api]")
+{
+    std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+    MsixTest::InitializePackageReader(package, &packageReader);
+    MsixTest::Wrappers::Buffer<char> previous;
+    REQUIRE_SUCCEEDED(GetLogTextUTF8(MsixTest::Allocators::Allocate, &previous));
+
+    MsixTest::ComPtr<IAppxFile> appxFile;
+    REQUIRE_HR(static_cast<HRESULT>(MSIX::Error::FileNotFound),
+        packageReader->GetPayloadFile(L"thisIsAFakeFile.txt", &appxFile));
+    REQUIRE(appxFile.Get() == nullptr);
+
+    // Probing for a file is expected to fail at times and is not logged
+    MsixTest::Wrappers::Buffer<char> text;
+    REQUIRE_SUCCEEDED(GetLogTextUTF8(MsixTest::Allocators::Allocate, &text));
+    REQUIRE(text.ToString().empty());
+}
+
+// Validates payload files are still available when the reader defers wiring them up
+TEST_CASE("Api_AppxPackageReader_DeferPayloadFiles", "[api]")
+{
+    std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    auto packagePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack) + "/" + package;
+    auto inputStream = MsixTest::StreamFile(packagePath, true);
+
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeapAndOptions(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_SKIPSIGNATURE, MSIX_FACTORY_OPTION_READER_DEFER_PAYLOAD_FILES, &factory));
+    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+    REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+
+    MsixTest::ComPtr<IAppxManifestReader> manifestReader;
+    REQUIRE_SUCCEEDED(packageReader->GetManifest(&manifestReader));
+    REQUIRE_NOT_NULL(manifestReader.Get());
+
+    MsixTest::ComPtr<IAppxFile> appxFile;
+    REQUIRE_SUCCEEDED(packageReader->GetPayloadFile(L"Assets\\video_offline_demo_page2.jpg", &appxFile));
+    UINT64 fileSize;
+    REQUIRE_SUCCEEDED(appxFile->GetSize(&fileSize));
+    REQUIRE(78720 == static_cast<std::uint64_t>(fileSize));
+
+    MsixTest::ComPtr<IAppxFile> fakeFile;
+    REQUIRE_HR(static_cast<HRESULT>(MSIX::Error::FileNotFound),
+        packageReader->GetPayloadFile(L"thisIsAFakeFile.txt", &fakeFile));
+
+    // The file requested before enumerating must be the same object the enumerator returns
+    auto expectedFiles = MsixTest::Unpack::GetExpectedFiles();
+    std::size_t payloadFiles = 0;
+    MsixTest::ComPtr<IAppxFilesEnumerator> files;
+    REQUIRE_SUCCEEDED(packageReader->GetPayloadFiles(&files));
+    BOOL hasCurrent = FALSE;
+    REQUIRE_SUCCEEDED(files->GetHasCurrent(&hasCurrent));
+    while (hasCurrent)
+    {
+        MsixTest::ComPtr<IAppxFile> file;
+        REQUIRE_SUCCEEDED(files->GetCurrent(&file));
+        MsixTest::Wrappers::Buffer<wchar_t> fileName;
+        REQUIRE_SUCCEEDED(file->GetName(&fileName));
+        if (fileName.ToString() == "Assets\\video_offline_demo_page2.jpg")
+        {
+            REQUIRE_ARE_SAME(appxFile.Get(), file.Get());
+        }
+        payloadFiles++;
+        REQUIRE_SUCCEEDED(files->MoveNext(&hasCurrent));
+    }
+    // Everything but the four footprint files
+    REQUIRE(expectedFiles.size() - 4 == payloadFiles);
+}
+
+// Deferred payload files asked for from several threads at once are wired up once
+TEST_CASE("Api_AppxPackageReader_DeferPayloadFiles_Concurrent", "[api]")
+{
+    std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    auto packagePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack) + "/" + package;
+    auto inputStream = MsixTest::StreamFile(packagePath, true);
+
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeapAndOptions(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_SKIPSIGNATURE, MSIX_FACTORY_OPTION_READER_DEFER_PAYLOAD_FILES, &factory));
+    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+    REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+
+    std::vector<std::wstring> names;
+    for (const auto& file : MsixTest::Unpack::GetExpectedFiles())
+    {
+        if (file.first.find("Assets/") != 0) { continue; }
+        std::wstring name(file.first.begin(), file.first.end());
+        std::replace(name.begin(), name.end(), L'/', L'\\');
+        names.push_back(name);
+    }
+    REQUIRE(!names.empty());
+
+    // Every thread asks for every file. Catch assertions are not thread safe, so only record the results.
+    const std::size_t threadCount = 4;
+    std::vector<HRESULT> results(threadCount * names.size(), S_OK);
+    std::vector<MsixTest::ComPtr<IAppxFile>> files(threadCount * names.size());
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < threadCount; t++)
+    {
+        threads.emplace_back([&, t]()
+        {
+            for (std::size_t i = 0; i < names.size(); i++)
+            {
+                results[t * names.size() + i] = packageReader->GetPayloadFile(names[i].c_str(), &files[t * names.size() + i]);
+            }
+        });
+    }
+    for (auto& thread : threads) { thread.join(); }
+
+    for (std::size_t i = 0; i < results.size(); i++)
+    {
+        REQUIRE_SUCCEEDED(results[i]);
+        REQUIRE_ARE_SAME(files[i % names.size()].Get(), files[i].Get());
+    }
+}
+
+// Validates payload files read the same when local file headers are only read on first use
+TEST_CASE("Api_AppxPackageReader_DeferLocalFileHeaders", "[api]")
+{
+    std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+    MsixTest::InitializePackageReader(package, &packageReader);
+
+    auto packagePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack) + "/" + package;
+    auto inputStream = MsixTest::StreamFile(packagePath, true);
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        static_cast<MSIX_VALIDATION_OPTION>(MSIX_VALIDATION_OPTION_SKIPSIGNATURE | MSIX_VALIDATION_OPTION_DEFERLOCALFILEHEADERS), &factory));
+    MsixTest::ComPtr<IAppxPackageReader> deferredReader;
+    REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &deferredReader));
+
+    MsixTest::ComPtr<IAppxFilesEnumerator> files;
+    REQUIRE_SUCCEEDED(deferredReader->GetPayloadFiles(&files));
+    BOOL hasCurrent = FALSE;
+    REQUIRE_SUCCEEDED(files->GetHasCurrent(&hasCurrent));
+    std::vector<std::uint8_t> expected(65536);
+    std::vector<std::uint8_t> actual(65536);
+    while (hasCurrent)
+    {
+        MsixTest::ComPtr<IAppxFile> file;
+        REQUIRE_SUCCEEDED(files->GetCurrent(&file));
+        MsixTest::Wrappers::Buffer<wchar_t> fileName;
+        REQUIRE_SUCCEEDED(file->GetName(&fileName));
+        MsixTest::ComPtr<IAppxFile> expectedFile;
+        REQUIRE_SUCCEEDED(packageReader->GetPayloadFile(fileName.Get(), &expectedFile));
+
+        MsixTest::ComPtr<IStream> expectedStream;
+        REQUIRE_SUCCEEDED(expectedFile->GetStream(&expectedStream));
+        MsixTest::ComPtr<IStream> actualStream;
+        REQUIRE_SUCCEEDED(file->GetStream(&actualStream));
+        ULONG expectedRead = 0;
+        ULONG actualRead = 0;
+        do
+        {   // short reads return S_FALSE
+            auto hr = expectedStream->Read(expected.data(), static_cast<ULONG>(expected.size()), &expectedRead);
+            REQUIRE(SUCCEEDED(hr));
+            hr = actualStream->Read(actual.data(), static_cast<ULONG>(actual.size()), &actualRead);
+            REQUIRE(SUCCEEDED(hr));
+            REQUIRE(expectedRead == actualRead);
+            REQUIRE(std::equal(expected.begin(), expected.begin() + expectedRead, actual.begin()));
+        } while (expectedRead > 0);
+        REQUIRE_SUCCEEDED(files->MoveNext(&hasCurrent));
+    }
+}
+
+// Range reader over a local package that records how much data was requested
+class CountingRangeReader final : public IMsixRangeReader
+{
+public:
+    CountingRangeReader(IStream* stream) : m_stream(stream) {}
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+    {
+        if (ppvObject == nullptr || *ppvObject != nullptr) { return static_cast<HRESULT>(MSIX::Error::InvalidParameter); }
+        if (riid == UuidOfImpl<IMsixRangeReader>::iid || riid == UuidOfImpl<IUnknown>::iid)
+        {
+            *ppvObject = static_cast<void*>(this);
+            AddRef();
+            return S_OK;
+        }
+        return static_cast<HRESULT>(MSIX::Error::NoInterface);
+    }
+    // Owned by the test
+    ULONG STDMETHODCALLTYPE AddRef() noexcept override { return 1; }
+    ULONG STDMETHODCALLTYPE Release() noexcept override { return 1; }
+
+    HRESULT STDMETHODCALLTYPE GetSize(UINT64* size) noexcept override
+    {
+        ULARGE_INTEGER end = { 0 };
+        auto hr = m_stream->Seek({ 0 }, STREAM_SEEK_END, &end);
+        *size = end.QuadPart;
+        return hr;
+    }
+
+    HRESULT STDMETHODCALLTYPE ReadRange(UINT64 offset, UINT32 count, BYTE* buffer, UINT32* bytesRead) noexcept override
+    {
+        requests++;
+        bytesRequested += count;
+        LARGE_INTEGER pos = { 0 };
+        pos.QuadPart = static_cast<LONGLONG>(offset);
+        auto hr = m_stream->Seek(pos, STREAM_SEEK_SET, nullptr);
+        if (hr != S_OK) { return hr; }
+        ULONG read = 0;
+        hr = m_stream->Read(buffer, count, &read);
+        *bytesRead = read;
+        return (hr == S_FALSE) ? S_OK : hr;
+    }
+
+    std::size_t requests = 0;
+    std::uint64_t bytesRequested = 0;
+
+private:
+    IStream* m_stream;
+};
+
+// Validates a package can be read through a range reader, transferring only the data needed
+TEST_CASE("Api_AppxPackageReader_RangeReader", "[api]")
+{
+    std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    auto packagePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack) + "/" + package;
+    auto inputStream = MsixTest::StreamFile(packagePath, true);
+    CountingRangeReader rangeReader(inputStream.Get());
+    UINT64 packageSize = 0;
+    REQUIRE_SUCCEEDED(rangeReader.GetSize(&packageSize));
+
+    MsixTest::ComPtr<IStream> stream;
+    REQUIRE_SUCCEEDED(CreateStreamOnRangeReader(&rangeReader, 0, &stream));
+
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeapAndOptions(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        static_cast<MSIX_VALIDATION_OPTION>(MSIX_VALIDATION_OPTION_SKIPSIGNATURE | MSIX_VALIDATION_OPTION_DEFERLOCALFILEHEADERS),
+        MSIX_FACTORY_OPTION_READER_DEFER_PAYLOAD_FILES, &factory));
+    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+    REQUIRE_SUCCEEDED(factory->CreatePackageReader(stream.Get(), &packageReader));
+    MsixTest::ComPtr<IAppxManifestReader> manifestReader;
+    REQUIRE_SUCCEEDED(packageReader->GetManifest(&manifestReader));
+    // Opening the package only needs the footprint files
+    REQUIRE(rangeReader.bytesRequested < packageSize / 10);
+
+    MsixTest::ComPtr<IAppxFile> appxFile;
+    REQUIRE_SUCCEEDED(packageReader->GetPayloadFile(L"Assets\\video_offline_demo_page2.jpg", &appxFile));
+    MsixTest::ComPtr<IStream> fileStream;
+    REQUIRE_SUCCEEDED(appxFile->GetStream(&fileStream));
+    std::vector<std::uint8_t> buffer(4096);
+    std::uint64_t fileSize = 0;
+    ULONG read = 0;
+    do
+    {
+        auto hr = fileStream->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &read);
+        REQUIRE(SUCCEEDED(hr)); // short reads return S_FALSE
+        fileSize += read;
+    } while (read > 0);
+    REQUIRE(78720 == fileSize);
+    REQUIRE(rangeReader.bytesRequested < packageSize / 10);
+}
+
+struct ReleasedBuffer
+{
+    const void* data = nullptr;
+    std::size_t count = 0;
+};
+
+void STDMETHODCALLTYPE ReleaseBuffer(void* context, const void* data)
+{
+    auto released = static_cast<ReleasedBuffer*>(context);
+    released->data = data;
+    released->count++;
+}
+
+// Validates a package can be read from memory of the caller, which is released with the last stream over it
+TEST_CASE("Api_AppxPackageReader_Buffer", "[api]")
+{
+    std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    auto packagePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack) + "/" + package;
+    auto inputStream = MsixTest::StreamFile(packagePath, true);
+    ULARGE_INTEGER packageSize = { 0 };
+    REQUIRE_SUCCEEDED(inputStream->Seek({ 0 }, STREAM_SEEK_END, &packageSize));
+    REQUIRE_SUCCEEDED(inputStream->Seek({ 0 }, STREAM_SEEK_SET, nullptr));
+    std::vector<std::uint8_t> packageBytes(static_cast<std::size_t>(packageSize.QuadPart));
+    ULONG read = 0;
+    REQUIRE_SUCCEEDED(inputStream->Read(packageBytes.data(), static_cast<ULONG>(packageBytes.size()), &read));
+    REQUIRE(packageBytes.size() == read);
+
+    ReleasedBuffer released;
+    {
+        MsixTest::ComPtr<IStream> stream;
+        REQUIRE_SUCCEEDED(CreateStreamOnBuffer(packageBytes.data(), packageBytes.size(), ReleaseBuffer, &released, &stream));
+        MsixTest::ComPtr<IStream> clone;
+        REQUIRE_SUCCEEDED(stream->Clone(&clone));
+
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        MsixTest::InitializePackageReader(stream.Get(), &packageReader);
+        MsixTest::ComPtr<IAppxFile> appxFile;
+        REQUIRE_SUCCEEDED(packageReader->GetPayloadFile(L"Assets\\video_offline_demo_page2.jpg", &appxFile));
+        MsixTest::ComPtr<IStream> fileStream;
+        REQUIRE_SUCCEEDED(appxFile->GetStream(&fileStream));
+        std::vector<std::uint8_t> buffer(4096);
+        std::uint64_t fileSize = 0;
+        do
+        {
+            auto hr = fileStream->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &read);
+            REQUIRE(SUCCEEDED(hr)); // short reads return S_FALSE
+            fileSize += read;
+        } while (read > 0);
+        REQUIRE(78720 == fileSize);
+
+        // The clone reads the same memory, with its own position
+        std::uint8_t signature[4] = {};
+        REQUIRE_SUCCEEDED(clone->Read(signature, sizeof(signature), &read));
+        REQUIRE(sizeof(signature) == read);
+        REQUIRE(std::equal(signature, signature + sizeof(signature), packageBytes.begin()));
+        REQUIRE(0 == released.count);
+    }
+    REQUIRE(1 == released.count);
+    REQUIRE(packageBytes.data() == released.data);
+
+    // Memory that isn't there can't be read, and isn't released
+    MsixTest::ComPtr<IStream> stream;
+    REQUIRE_FAILED(CreateStreamOnBuffer(nullptr, 10, ReleaseBuffer, &released, &stream));
+    REQUIRE(1 == released.count);
+}
+
+// Validates the identity of a package can be read without opening it, reading only the start of the manifest
+TEST_CASE("Api_AppxPackageReader_ReadPackageIdentity", "[api]")
+{
+    std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    auto packagePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack) + "/" + package;
+    auto inputStream = MsixTest::StreamFile(packagePath, true);
+    CountingRangeReader rangeReader(inputStream.Get());
+
+    MsixTest::ComPtr<IStream> stream;
+    REQUIRE_SUCCEEDED(CreateStreamOnRangeReader(&rangeReader, 4096, &stream));
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_FULL, &factory));
+    MsixTest::ComPtr<IAppxManifestPackageId> packageId;
+    REQUIRE_SUCCEEDED(ReadPackageIdentityFromStream(factory.Get(), stream.Get(), &packageId));
+
+    // Opening the package reads the footprint files, reading the identity only the central directory and the manifest
+    auto packageStream = MsixTest::StreamFile(packagePath, true);
+    CountingRangeReader packageRangeReader(packageStream.Get());
+    MsixTest::ComPtr<IStream> stream2;
+    REQUIRE_SUCCEEDED(CreateStreamOnRangeReader(&packageRangeReader, 4096, &stream2));
+    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+    REQUIRE_SUCCEEDED(factory->CreatePackageReader(stream2.Get(), &packageReader));
+    REQUIRE(rangeReader.bytesRequested < packageRangeReader.bytesRequested);
+    MsixTest::ComPtr<IAppxManifestReader> manifestReader;
+    REQUIRE_SUCCEEDED(packageReader->GetManifest(&manifestReader));
+    MsixTest::ComPtr<IAppxManifestPackageId> expectedPackageId;
+    REQUIRE_SUCCEEDED(manifestReader->GetPackageId(&expectedPackageId));
+
+    MsixTest::Wrappers::Buffer<wchar_t> fullName;
+    MsixTest::Wrappers::Buffer<wchar_t> expectedFullName;
+    REQUIRE_SUCCEEDED(packageId->GetPackageFullName(&fullName));
+    REQUIRE_SUCCEEDED(expectedPackageId->GetPackageFullName(&expectedFullName));
+    REQUIRE(expectedFullName.ToString() == fullName.ToString());
+
+    MsixTest::Wrappers::Buffer<wchar_t> publisher;
+    MsixTest::Wrappers::Buffer<wchar_t> expectedPublisher;
+    REQUIRE_SUCCEEDED(packageId->GetPublisher(&publisher));
+    REQUIRE_SUCCEEDED(expectedPackageId->GetPublisher(&expectedPublisher));
+    REQUIRE(expectedPublisher.ToString() == publisher.ToString());
+}
+
+// Validates packages, bundles and manifests are told apart from their first bytes and central directory
+TEST_CASE("Api_AppxPackageReader_GetContainerFormat", "[api]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    const std::vector<std::pair<std::string, MSIX_CONTAINER_FORMAT>> files = {
+        { testData->GetPath(MsixTest::TestPath::Directory::Unpack) + "/StoreSigned_Desktop_x64_MoviesTV.appx", MSIX_CONTAINER_FORMAT_PACKAGE },
+        { testData->GetPath(MsixTest::TestPath::Directory::Unbundle) + "/StoreSigned_Desktop_x86_x64_MoviesTV.appxbundle", MSIX_CONTAINER_FORMAT_BUNDLE },
+        { testData->GetPath(MsixTest::TestPath::Directory::Pack) + "/input/AppxManifest.xml", MSIX_CONTAINER_FORMAT_MANIFEST },
+        { testData->GetPath(MsixTest::TestPath::Directory::Pack) + "/input/TestAppxPackage.exe", MSIX_CONTAINER_FORMAT_UNKNOWN },
+    };
+    for (const auto& file : files)
+    {
+        auto stream = MsixTest::StreamFile(file.first, true);
+        MSIX_CONTAINER_FORMAT format = MSIX_CONTAINER_FORMAT_UNKNOWN;
+        REQUIRE_SUCCEEDED(GetContainerFormatFromStream(stream.Get(), &format));
+        CHECK(format == file.second);
+        ULARGE_INTEGER position = { 0 };
+        REQUIRE_SUCCEEDED(stream->Seek({ 0 }, STREAM_SEEK_CUR, &position));
+        CHECK(position.QuadPart == 0);
+    }
+}
+
+// Validates MSIX_VALIDATION_OPTION_SKIPMANIFESTSCHEMAIFTRUSTED still reads the manifest of a trusted package,
+// and doesn't change anything for a package whose signature isn't validated
+TEST_CASE("Api_AppxPackageReader_SkipManifestSchemaIfTrusted", "[api]")
+{
+    std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    auto packagePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack) + "/" + package;
+
+    for (auto validation : { MSIX_VALIDATION_OPTION_FULL, MSIX_VALIDATION_OPTION_SKIPSIGNATURE })
+    {
+        MsixTest::ComPtr<IAppxFactory> factory;
+        REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+            static_cast<MSIX_VALIDATION_OPTION>(validation | MSIX_VALIDATION_OPTION_SKIPMANIFESTSCHEMAIFTRUSTED), &factory));
+        auto inputStream = MsixTest::StreamFile(packagePath, true);
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+
+        MsixTest::ComPtr<IAppxManifestReader> manifestReader;
+        REQUIRE_SUCCEEDED(packageReader->GetManifest(&manifestReader));
+        MsixTest::ComPtr<IAppxManifestProperties> properties;
+        REQUIRE_SUCCEEDED(manifestReader->GetProperties(&properties));
+        MsixTest::Wrappers::Buffer<wchar_t> displayName;
+        REQUIRE_SUCCEEDED(properties->GetStringValue(L"DisplayName", &displayName));
+        REQUIRE_FALSE(displayName.ToString().empty());
+    }
+}
+
+// Validates signatures are checked against trusted roots loaded once per factory, and reloaded when
+// custom roots are specified
+TEST_CASE("Api_AppxPackageReader_TrustedCertificates", "[api]")
+{
+    std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    auto packagePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack) + "/" + package;
+
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_FULL, &factory));
+    for (int i = 0; i < 2; i++)
+    {
+        auto inputStream = MsixTest::StreamFile(packagePath, true);
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+    }
+
+    auto overrides = factory.As<IMsixFactoryOverrides>();
+    #ifndef WIN32
+    // A package isn't a PEM certificate
+    {
+        auto notCertificates = MsixTest::StreamFile(packagePath, true);
+        REQUIRE_SUCCEEDED(overrides->SpecifyExtension(MSIX_FACTORY_EXTENSION_TRUSTED_CERTIFICATES, notCertificates.Get()));
+        MsixTest::ComPtr<IUnknown> specified;
+        REQUIRE_SUCCEEDED(overrides->GetCurrentSpecifiedExtension(MSIX_FACTORY_EXTENSION_TRUSTED_CERTIFICATES, &specified));
+        REQUIRE_NOT_NULL(specified.Get());
+
+        auto inputStream = MsixTest::StreamFile(packagePath, true);
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        REQUIRE_HR(static_cast<HRESULT>(MSIX::Error::InvalidParameter),
+            factory->CreatePackageReader(inputStream.Get(), &packageReader));
+    }
+    #endif
+
+    // No custom roots
+    auto empty = MsixTest::StreamFile("trusted_certificates.pem", false, true);
+    REQUIRE_SUCCEEDED(overrides->SpecifyExtension(MSIX_FACTORY_EXTENSION_TRUSTED_CERTIFICATES, empty.Get()));
+    auto inputStream = MsixTest::StreamFile(packagePath, true);
+    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+    REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+}
+
+// Validates the bytes stored before the signature are checked against its file records digest, when the package is
+// opened under full validation and otherwise when it is verified
+TEST_CASE("Api_AppxPackageReader_TamperedFileRecords", "[api]")
+{
+    std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    auto packagePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack) + "/" + package;
+    std::vector<std::uint8_t> packageBytes;
+    {
+        auto inputStream = MsixTest::StreamFile(packagePath, true);
+        ULARGE_INTEGER size = { 0 };
+        REQUIRE_SUCCEEDED(inputStream->Seek({ 0 }, STREAM_SEEK_END, &size));
+        REQUIRE_SUCCEEDED(inputStream->Seek({ 0 }, STREAM_SEEK_SET, nullptr));
+        packageBytes.resize(static_cast<std::size_t>(size.QuadPart));
+        ULONG read = 0;
+        REQUIRE_SUCCEEDED(inputStream->Read(packageBytes.data(), static_cast<ULONG>(packageBytes.size()), &read));
+        REQUIRE(packageBytes.size() == read);
+    }
+    // Last modified time of the first local file header, the central directory doesn't mind
+    packageBytes[10] ^= 0x01;
+    std::string tamperedPath = "tampered_file_records.appx";
+    {
+        auto outputStream = MsixTest::StreamFile(tamperedPath, false);
+        REQUIRE_SUCCEEDED(outputStream->Write(packageBytes.data(), static_cast<ULONG>(packageBytes.size()), nullptr));
+    }
+    auto tampered = MsixTest::StreamFile(tamperedPath, true, true);
+
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_FULL, &factory));
+    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+    REQUIRE_HR(static_cast<HRESULT>(MSIX::Error::SignatureInvalid),
+        factory->CreatePackageReader(tampered.Get(), &packageReader));
+
+    MsixTest::ComPtr<IAppxFactory> otherFactory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_ALLOWSIGNATUREORIGINUNKNOWN, &otherFactory));
+    REQUIRE_SUCCEEDED(tampered->Seek({ 0 }, STREAM_SEEK_SET, nullptr));
+    REQUIRE_SUCCEEDED(otherFactory->CreatePackageReader(tampered.Get(), &packageReader));
+    packageReader = nullptr;
+    REQUIRE_HR(static_cast<HRESULT>(MSIX::Error::SignatureInvalid),
+        VerifyPackage(MSIX_VALIDATION_OPTION_ALLOWSIGNATUREORIGINUNKNOWN, const_cast<char*>(tamperedPath.c_str()), 2));
+}
+
+// Validates the ranges of the package layout are where the records of the package are, and that the blocks of
+// stored files are the bytes of the files
+TEST_CASE("Api_AppxPackageReader_PackageLayout", "[api]")
+{
+    std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    auto packagePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack) + "/" + package;
+    std::vector<std::uint8_t> packageBytes;
+    {
+        auto inputStream = MsixTest::StreamFile(packagePath, true);
+        ULARGE_INTEGER size = { 0 };
+        REQUIRE_SUCCEEDED(inputStream->Seek({ 0 }, STREAM_SEEK_END, &size));
+        REQUIRE_SUCCEEDED(inputStream->Seek({ 0 }, STREAM_SEEK_SET, nullptr));
+        packageBytes.resize(static_cast<std::size_t>(size.QuadPart));
+        ULONG read = 0;
+        REQUIRE_SUCCEEDED(inputStream->Read(packageBytes.data(), static_cast<ULONG>(packageBytes.size()), &read));
+        REQUIRE(packageBytes.size() == read);
+    }
+    auto hasSignature = [&packageBytes](std::uint64_t offset, std::uint8_t type)
+    {
+        return (offset + 4 <= packageBytes.size()) && (packageBytes[offset] == 'P') && (packageBytes[offset + 1] == 'K') &&
+            (packageBytes[offset + 2] == type) && (packageBytes[offset + 3] == type + 1);
+    };
+
+    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+    MsixTest::InitializePackageReader(package, &packageReader);
+    MsixTest::ComPtr<IMsixPackageLayout> layout;
+    REQUIRE_SUCCEEDED(packageReader->QueryInterface(UuidOfImpl<IMsixPackageLayout>::iid, reinterpret_cast<void**>(&layout)));
+    MsixTest::ComPtr<IAppxPackageReaderUtf8> packageReaderUtf8;
+    REQUIRE_SUCCEEDED(packageReader->QueryInterface(UuidOfImpl<IAppxPackageReaderUtf8>::iid, reinterpret_cast<void**>(&packageReaderUtf8)));
+
+    MSIX_BYTE_RANGE centralDirectory = {};
+    REQUIRE_SUCCEEDED(layout->GetCentralDirectoryRange(&centralDirectory));
+    CHECK(hasSignature(centralDirectory.offset, 1));
+    CHECK(centralDirectory.offset + centralDirectory.length == packageBytes.size());
+
+    MsixTest::ComPtr<IAppxBlockMapReader> blockMap;
+    REQUIRE_SUCCEEDED(packageReader->GetBlockMap(&blockMap));
+    MsixTest::ComPtr<IAppxBlockMapFilesEnumerator> files;
+    REQUIRE_SUCCEEDED(blockMap->GetFiles(&files));
+    std::size_t storedBlocks = 0;
+    BOOL hasCurrent = FALSE;
+    REQUIRE_SUCCEEDED(files->GetHasCurrent(&hasCurrent));
+    while (hasCurrent)
+    {
+        MsixTest::ComPtr<IAppxBlockMapFile> file;
+        REQUIRE_SUCCEEDED(files->GetCurrent(&file));
+        MsixTest::ComPtr<IAppxBlockMapFileUtf8> fileUtf8;
+        REQUIRE_SUCCEEDED(file->QueryInterface(UuidOfImpl<IAppxBlockMapFileUtf8>::iid, reinterpret_cast<void**>(&fileUtf8)));
+        MsixTest::Wrappers::Buffer<char> name;
+        REQUIRE_SUCCEEDED(fileUtf8->GetName(&name));
+
+        MSIX_BYTE_RANGE localFileHeader = {};
+        MSIX_BYTE_RANGE data = {};
+        MSIX_BYTE_RANGE dataDescriptor = {};
+        REQUIRE_SUCCEEDED(layout->GetFileRanges(name.Get(), &localFileHeader, &data, &dataDescriptor));
+        CHECK(hasSignature(localFileHeader.offset, 3));
+        CHECK(data.offset == localFileHeader.offset + localFileHeader.length);
+        CHECK(dataDescriptor.offset == data.offset + data.length);
+        CHECK(dataDescriptor.offset + dataDescriptor.length <= centralDirectory.offset);
+
+        UINT32 count = 0;
+        REQUIRE_SUCCEEDED(layout->GetBlockCount(name.Get(), &count));
+        UINT64 size = 0;
+        REQUIRE_SUCCEEDED(file->GetUncompressedSize(&size));
+        CHECK(count == (size + 65535) / 65536);
+        UINT64 uncompressedSize = 0;
+        // Stored files are their own blocks
+        MsixTest::ComPtr<IAppxFile> payloadFile;
+        bool isStored = (data.length == size) && SUCCEEDED(packageReaderUtf8->GetPayloadFile(name.Get(), &payloadFile));
+        std::uint64_t next = data.offset;
+        for (UINT32 index = 0; index < count; index++)
+        {
+            MSIX_BYTE_RANGE block = {};
+            REQUIRE_SUCCEEDED(layout->GetBlockRange(name.Get(), index, &block));
+            CHECK(block.offset == next);
+            next = block.offset + block.length;
+            uncompressedSize += std::min<UINT64>(65536, size - uncompressedSize);
+            if (isStored)
+            {
+                MsixTest::ComPtr<IStream> stream;
+                REQUIRE_SUCCEEDED(payloadFile->GetStream(&stream));
+                LARGE_INTEGER position = { 0 };
+                position.QuadPart = static_cast<LONGLONG>(index) * 65536;
+                REQUIRE_SUCCEEDED(stream->Seek(position, STREAM_SEEK_SET, nullptr));
+                std::vector<std::uint8_t> content(static_cast<std::size_t>(block.length));
+                ULONG read = 0;
+                REQUIRE_SUCCEEDED(stream->Read(content.data(), static_cast<ULONG>(content.size()), &read));
+                CHECK(std::equal(content.begin(), content.end(), packageBytes.begin() + static_cast<std::ptrdiff_t>(block.offset)));
+                storedBlocks++;
+            }
+        }
+        CHECK(next <= data.offset + data.length);
+        CHECK(uncompressedSize == size);
+        MSIX_BYTE_RANGE outside = {};
+        REQUIRE_FAILED(layout->GetBlockRange(name.Get(), count, &outside));
+
+        REQUIRE_SUCCEEDED(files->MoveNext(&hasCurrent));
+    }
+    CHECK(storedBlocks != 0);
+
+    MSIX_BYTE_RANGE localFileHeader = {};
+    MSIX_BYTE_RANGE data = {};
+    MSIX_BYTE_RANGE dataDescriptor = {};
+    REQUIRE_SUCCEEDED(layout->GetFileRanges("AppxSignature.p7x", &localFileHeader, &data, &dataDescriptor));
+    CHECK(hasSignature(localFileHeader.offset, 3));
+    REQUIRE_HR(static_cast<HRESULT>(MSIX::Error::FileNotFound), layout->GetFileRanges("NotInPackage.txt", &localFileHeader, &data, &dataDescriptor));
+    UINT32 count = 0;
+    REQUIRE_HR(static_cast<HRESULT>(MSIX::Error::FileNotFound), layout->GetBlockCount("AppxSignature.p7x", &count));
+}
+
+// Signature cache that keeps its entries in files, owned by the test
+class FileSignatureCache final : public IMsixSignatureCache
+{
+public:
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+    {
+        if (ppvObject == nullptr || *ppvObject != nullptr) { return static_cast<HRESULT>(MSIX::Error::InvalidParameter); }
+        if (riid == UuidOfImpl<IMsixSignatureCache>::iid || riid == UuidOfImpl<IUnknown>::iid)
+        {
+            *ppvObject = static_cast<void*>(this);
+            AddRef();
+            return S_OK;
+        }
+        return static_cast<HRESULT>(MSIX::Error::NoInterface);
+    }
+    ULONG STDMETHODCALLTYPE AddRef() noexcept override { return 1; }
+    ULONG STDMETHODCALLTYPE Release() noexcept override { return 1; }
+
+    HRESULT STDMETHODCALLTYPE GetEntry(LPCSTR key, IStream** entry) noexcept override
+    {
+        gets++;
+        auto found = m_files.find(key);
+        if (found == m_files.end()) { return S_OK; }
+        return CreateStreamOnFile(const_cast<char*>(found->second.c_str()), true, entry);
+    }
+
+    HRESULT STDMETHODCALLTYPE AddEntry(LPCSTR key, IStream* entry) noexcept override
+    {
+        adds++;
+        std::vector<std::uint8_t> data(4096);
+        ULONG read = 0;
+        auto hr = entry->Read(data.data(), static_cast<ULONG>(data.size()), &read);
+        if (FAILED(hr)) { return hr; }
+        data.resize(read);
+        auto fileName = "signature_" + std::string(key) + ".bin";
+        {
+            auto file = MsixTest::StreamFile(fileName, false);
+            hr = file->Write(data.data(), static_cast<ULONG>(data.size()), nullptr);
+        }
+        m_files[key] = fileName;
+        return hr;
+    }
+
+    // Replaces every entry with one that can't be read
+    void Corrupt()
+    {
+        for (auto& file : m_files)
+        {
+            auto stream = MsixTest::StreamFile(file.second, false);
+            std::uint8_t garbage[] = { 0xff, 0xff, 0xff };
+            stream->Write(garbage, sizeof(garbage), nullptr);
+        }
+    }
+
+    ~FileSignatureCache()
+    {
+        for (auto& file : m_files) { std::remove(file.second.c_str()); }
+    }
+
+    std::size_t gets = 0;
+    std::size_t adds = 0;
+
+private:
+    std::map<std::string, std::string> m_files;
+};
+
+// Validates signatures seen before are taken from the signature cache, and the digests kept there are
+// still checked against the package
+TEST_CASE("Api_AppxPackageReader_SignatureCache", "[api]")
+{
+    auto unpackPath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack);
+    auto packagePath = unpackPath + "/StoreSigned_Desktop_x64_MoviesTV.appx";
+
+    FileSignatureCache signatureCache;
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_FULL, &factory));
+    REQUIRE_SUCCEEDED(factory.As<IMsixFactoryOverrides>()->SpecifyExtension(MSIX_FACTORY_EXTENSION_SIGNATURE_CACHE, &signatureCache));
+
+    auto openPackage = [&](const std::string& path) -> HRESULT
+    {
+        auto inputStream = MsixTest::StreamFile(path, true);
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        return factory->CreatePackageReader(inputStream.Get(), &packageReader);
+    };
+    REQUIRE_SUCCEEDED(openPackage(packagePath));
+    REQUIRE(1 == signatureCache.gets);
+    REQUIRE(1 == signatureCache.adds);
+    REQUIRE_SUCCEEDED(openPackage(packagePath));
+    REQUIRE(2 == signatureCache.gets);
+    REQUIRE(1 == signatureCache.adds);
+
+    // An entry that can't be read is replaced
+    signatureCache.Corrupt();
+    REQUIRE_SUCCEEDED(openPackage(packagePath));
+    REQUIRE(2 == signatureCache.adds);
+    REQUIRE_SUCCEEDED(openPackage(packagePath));
+    REQUIRE(2 == signatureCache.adds);
+
+    // The signature of a package with a tampered block map is valid, its block map isn't
+    MsixTest::ComPtr<IAppxFactory> cachingFactory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeapAndOptions(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_ALLOWSIGNATUREORIGINUNKNOWN, MSIX_FACTORY_OPTION_READER_CACHE_SIGNATURES, &cachingFactory));
+    for (int i = 0; i < 2; i++)
+    {
+        auto inputStream = MsixTest::StreamFile(unpackPath + "/SignedTamperedBlockMap-TRUST_E_BAD_DIGEST.appx", true);
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        REQUIRE_HR(static_cast<HRESULT>(MSIX::Error::SignatureInvalid),
+            cachingFactory->CreatePackageReader(inputStream.Get(), &packageReader));
+    }
+}
+
+// Manifest or integrity cache that keeps its entries in files named after prefix, owned by the test
+template <class Cache>
+class FileCache final : public Cache
+{
+public:
+    FileCache(const std::string& prefix) : m_prefix(prefix) {}
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+    {
+        if (ppvObject == nullptr || *ppvObject != nullptr) { return static_cast<HRESULT>(MSIX::Error::InvalidParameter); }
+        if (riid == UuidOfImpl<Cache>::iid || riid == UuidOfImpl<IUnknown>::iid)
+        {
+            *ppvObject = static_cast<void*>(this);
+            AddRef();
+            return S_OK;
+        }
+        return static_cast<HRESULT>(MSIX::Error::NoInterface);
+    }
+    ULONG STDMETHODCALLTYPE AddRef() noexcept override { return 1; }
+    ULONG STDMETHODCALLTYPE Release() noexcept override { return 1; }
+
+    HRESULT STDMETHODCALLTYPE GetEntry(LPCSTR key, IStream** entry) noexcept override
+    {
+        gets++;
+        auto found = m_files.find(key);
+        if (found == m_files.end()) { return S_OK; }
+        return CreateStreamOnFile(const_cast<char*>(found->second.c_str()), true, entry);
+    }
+
+    HRESULT STDMETHODCALLTYPE AddEntry(LPCSTR key, IStream* entry) noexcept override
+    {
+        adds++;
+        std::vector<std::uint8_t> data;
+        std::uint8_t buffer[1024];
+        ULONG read = 0;
+        do
+        {
+            auto hr = entry->Read(buffer, sizeof(buffer), &read);
+            if (FAILED(hr)) { return hr; }
+            data.insert(data.end(), buffer, buffer + read);
+        } while (read != 0);
+        auto fileName = m_prefix + std::string(key) + ".bin";
+        HRESULT hr = S_OK;
+        {
+            auto file = MsixTest::StreamFile(fileName, false);
+            hr = file->Write(data.data(), static_cast<ULONG>(data.size()), nullptr);
+        }
+        m_files[key] = fileName;
+        return hr;
+    }
+
+    // Replaces every entry with one that can't be read
+    void Corrupt()
+    {
+        for (auto& file : m_files)
+        {
+            auto stream = MsixTest::StreamFile(file.second, false);
+            std::uint8_t garbage[] = { 0xff, 0xff, 0xff };
+            stream->Write(garbage, sizeof(garbage), nullptr);
+        }
+    }
+
+    ~FileCache()
+    {
+        for (auto& file : m_files) { std::remove(file.second.c_str()); }
+    }
+
+    std::size_t gets = 0;
+    std::size_t adds = 0;
+
+private:
+    std::string m_prefix;
+    std::map<std::string, std::string> m_files;
+};
+
+// Reads the values of the manifest of a package that a snapshot of it keeps
+static std::vector<std::string> ReadManifestValues(IAppxPackageReader* packageReader)
+{
+    MsixTest::ComPtr<IAppxManifestReader> manifestReader;
+    REQUIRE_SUCCEEDED(packageReader->GetManifest(&manifestReader));
+
+    std::vector<std::string> values;
+    MsixTest::ComPtr<IAppxManifestPackageId> packageId;
+    REQUIRE_SUCCEEDED(manifestReader->GetPackageId(&packageId));
+    MsixTest::Wrappers::Buffer<wchar_t> fullName;
+    REQUIRE_SUCCEEDED(packageId->GetPackageFullName(&fullName));
+    values.push_back(fullName.ToString());
+
+    MsixTest::ComPtr<IAppxManifestProperties> properties;
+    REQUIRE_SUCCEEDED(manifestReader->GetProperties(&properties));
+    MsixTest::Wrappers::Buffer<wchar_t> displayName;
+    REQUIRE_SUCCEEDED(properties->GetStringValue(L"DisplayName", &displayName));
+    values.push_back(displayName.ToString());
+    BOOL framework = TRUE;
+    REQUIRE_SUCCEEDED(properties->GetBoolValue(L"Framework", &framework));
+    values.push_back(framework ? "framework" : "application");
+
+    MsixTest::ComPtr<IAppxManifestApplicationsEnumerator> applications;
+    REQUIRE_SUCCEEDED(manifestReader->GetApplications(&applications));
+    BOOL hasCurrent = FALSE;
+    REQUIRE_SUCCEEDED(applications->GetHasCurrent(&hasCurrent));
+    while (hasCurrent)
+    {
+        MsixTest::ComPtr<IAppxManifestApplication> application;
+        REQUIRE_SUCCEEDED(applications->GetCurrent(&application));
+        MsixTest::Wrappers::Buffer<wchar_t> aumid;
+        REQUIRE_SUCCEEDED(application->GetAppUserModelId(&aumid));
+        values.push_back(aumid.ToString());
+        REQUIRE_SUCCEEDED(applications->MoveNext(&hasCurrent));
+    }
+
+    APPX_CAPABILITIES capabilityFlags;
+    REQUIRE_SUCCEEDED(manifestReader->GetCapabilities(&capabilityFlags));
+    values.push_back(std::to_string(capabilityFlags));
+    MsixTest::ComPtr<IAppxManifestReader3> manifestReader3;
+    REQUIRE_SUCCEEDED(manifestReader->QueryInterface(UuidOfImpl<IAppxManifestReader3>::iid, reinterpret_cast<void**>(&manifestReader3)));
+    MsixTest::ComPtr<IAppxManifestCapabilitiesEnumerator> capabilities;
+    REQUIRE_SUCCEEDED(manifestReader3->GetCapabilitiesByCapabilityClass(APPX_CAPABILITY_CLASS_ALL, &capabilities));
+    REQUIRE_SUCCEEDED(capabilities->GetHasCurrent(&hasCurrent));
+    while (hasCurrent)
+    {
+        MsixTest::Wrappers::Buffer<wchar_t> capability;
+        REQUIRE_SUCCEEDED(capabilities->GetCurrent(&capability));
+        values.push_back(capability.ToString());
+        REQUIRE_SUCCEEDED(capabilities->MoveNext(&hasCurrent));
+    }
+
+    MsixTest::ComPtr<IAppxManifestTargetDeviceFamiliesEnumerator> tdfs;
+    REQUIRE_SUCCEEDED(manifestReader3->GetTargetDeviceFamilies(&tdfs));
+    REQUIRE_SUCCEEDED(tdfs->GetHasCurrent(&hasCurrent));
+    while (hasCurrent)
+    {
+        MsixTest::ComPtr<IAppxManifestTargetDeviceFamily> tdf;
+        REQUIRE_SUCCEEDED(tdfs->GetCurrent(&tdf));
+        MsixTest::Wrappers::Buffer<wchar_t> name;
+        REQUIRE_SUCCEEDED(tdf->GetName(&name));
+        UINT64 minVersion = 0;
+        REQUIRE_SUCCEEDED(tdf->GetMinVersion(&minVersion));
+        values.push_back(name.ToString() + " " + std::to_string(minVersion));
+        REQUIRE_SUCCEEDED(tdfs->MoveNext(&hasCurrent));
+    }
+
+    // The document element of a manifest taken from a snapshot is parsed when asked for
+    MsixTest::ComPtr<IMsixElement> documentElement;
+    REQUIRE_SUCCEEDED(manifestReader.As<IMsixDocumentElement>()->GetDocumentElement(&documentElement));
+    REQUIRE_NOT_NULL(documentElement.Get());
+    return values;
+}
+
+// Reads the values of the manifest of packagePath that a snapshot of it keeps, through a package reader of factory
+static std::vector<std::string> ReadManifestValues(IAppxFactory* factory, const std::string& packagePath)
+{
+    auto inputStream = MsixTest::StreamFile(packagePath, true);
     MsixTest::ComPtr<IAppxPackageReader> packageReader;
-    MsixTest::InitializePackageReader(package, &packageReader);
+    REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+    return ReadManifestValues(packageReader.Get());
+}
+
+// Validates manifests seen before are taken from the manifest cache, and give out the same values as a parsed one
+TEST_CASE("Api_AppxPackageReader_ManifestCache", "[api]")
+{
+    auto packagePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack) + "/StoreSigned_Desktop_x64_MoviesTV.appx";
+
+    FileCache<IMsixManifestCache> manifestCache("manifest_");
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_FULL, &factory));
+    REQUIRE_SUCCEEDED(factory.As<IMsixFactoryOverrides>()->SpecifyExtension(MSIX_FACTORY_EXTENSION_MANIFEST_CACHE, &manifestCache));
+
+    auto readManifest = [&]() { return ReadManifestValues(factory.Get(), packagePath); };
+
+    auto parsed = readManifest();
+    REQUIRE(1 == manifestCache.gets);
+    REQUIRE(1 == manifestCache.adds);
+    REQUIRE(parsed == readManifest());
+    REQUIRE(2 == manifestCache.gets);
+    REQUIRE(1 == manifestCache.adds);
+
+    // An entry that can't be read is replaced
+    manifestCache.Corrupt();
+    REQUIRE(parsed == readManifest());
+    REQUIRE(2 == manifestCache.adds);
+    REQUIRE(parsed == readManifest());
+    REQUIRE(2 == manifestCache.adds);
+}
+
+// Reads a payload file of packagePath through a package reader of factory, hashedBytes are the bytes hashed to
+// validate it
+static std::vector<std::uint8_t> ReadPayloadFile(IAppxFactory* factory, const std::string& packagePath, LPCWSTR fileName,
+    std::uint64_t& hashedBytes)
+{
+    auto inputStream = MsixTest::StreamFile(packagePath, true);
+    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+    REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+    MSIX_PERFORMANCE_COUNTERS counters = {};
+    REQUIRE_SUCCEEDED(MsixGetPerformanceCounters(factory, true, &counters));
 
     MsixTest::ComPtr<IAppxFile> appxFile;
+    REQUIRE_SUCCEEDED(packageReader->GetPayloadFile(fileName, &appxFile));
+    MsixTest::ComPtr<IStream> fileStream;
+    REQUIRE_SUCCEEDED(appxFile->GetStream(&fileStream));
+    std::vector<std::uint8_t> bytes;
+    std::uint8_t buffer[4096];
+    ULONG read = 0;
+    do
+    {
+        HRESULT hr = fileStream->Read(buffer, sizeof(buffer), &read);
+        REQUIRE(SUCCEEDED(hr)); // short reads return S_FALSE
+        bytes.insert(bytes.end(), buffer, buffer + read);
+    } while (read > 0);
 
-    // Even on non windows, GetPayloadFile expects a '\'
-    std::string fileName = "Assets\\video_offline_demo_page2.jpg";
-    auto fileNameW = MsixTest::String::utf8_to_utf16(fileName);
+    REQUIRE_SUCCEEDED(MsixGetPerformanceCounters(factory, false, &counters));
+    hashedBytes = counters.stages[MSIX_PERFORMANCE_COUNTER_STAGE_HASH].bytes;
+    return bytes;
+}
 
-    REQUIRE_SUCCEEDED(packageReader->GetPayloadFile(fileNameW.c_str(), &appxFile));
-    REQUIRE_NOT_NULL(appxFile.Get());
+// Validates payload files whose blocks all matched are read again without hashing them, until the package file
+// is replaced
+TEST_CASE("Api_AppxPackageReader_IntegrityCache", "[api]")
+{
+    auto sourcePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack) + "/StoreSigned_Desktop_x64_MoviesTV.appx";
+    auto packagePath = MsixTest::TestPath::GetInstance()->GetRoot() + "integrity_package.appx";
+    auto outputDir = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Output);
+    // Written next to the package and renamed over it, so it is another file
+    auto copyPackage = [&]()
+    {
+        auto copyPath = packagePath + ".tmp";
+        {
+            std::ifstream source(sourcePath, std::ios::binary);
+            std::ofstream copy(copyPath, std::ios::binary | std::ios::trunc);
+            copy << source.rdbuf();
+        }
+        std::remove(packagePath.c_str());
+        REQUIRE(0 == std::rename(copyPath.c_str(), packagePath.c_str()));
+    };
+    copyPackage();
 
-    MsixTest::Wrappers::Buffer<wchar_t> appxFileName;
-    REQUIRE_SUCCEEDED(appxFile->GetName(&appxFileName));
-    REQUIRE(fileName == appxFileName.ToString());
+    FileCache<IMsixIntegrityCache> integrityCache("integrity_");
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeapAndOptions(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_FULL, MSIX_FACTORY_OPTION_PERFORMANCE_COUNTERS, &factory));
+    REQUIRE_SUCCEEDED(factory.As<IMsixFactoryOverrides>()->SpecifyExtension(MSIX_FACTORY_EXTENSION_INTEGRITY_CACHE, &integrityCache));
 
-    APPX_COMPRESSION_OPTION fileCompression;
-    REQUIRE_SUCCEEDED(appxFile->GetCompressionOption(&fileCompression));
-    REQUIRE(APPX_COMPRESSION_OPTION_NONE == fileCompression);
+    const wchar_t* fileName = L"Assets\\video_offline_demo_page2.jpg";
+    const wchar_t* otherFileName = L"Assets\\video_offline_demo_page1.jpg";
+    std::uint64_t hashedBytes = 0;
+    auto bytes = ReadPayloadFile(factory.Get(), packagePath, fileName, hashedBytes);
+    REQUIRE(78720 == bytes.size());
+    CHECK(hashedBytes >= bytes.size());
+    CHECK(1 == integrityCache.adds);
 
-    UINT64 fileSize;
-    REQUIRE_SUCCEEDED(appxFile->GetSize(&fileSize));
-    REQUIRE(78720 == static_cast<std::uint64_t>(fileSize));
+    CHECK(bytes == ReadPayloadFile(factory.Get(), packagePath, fileName, hashedBytes));
+    CHECK(0 == hashedBytes);
+    CHECK(1 == integrityCache.adds);
+
+    // Unpacking records the other files
+    {
+        auto inputStream = MsixTest::StreamFile(packagePath, true);
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+        REQUIRE_SUCCEEDED(UnpackPackageFromPackageReader(MSIX_PACKUNPACK_OPTION_NONE, packageReader.Get(), const_cast<char*>(outputDir.c_str())));
+        CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+    }
+    auto otherBytes = ReadPayloadFile(factory.Get(), packagePath, otherFileName, hashedBytes);
+    CHECK(187761 == otherBytes.size());
+    CHECK(0 == hashedBytes);
+
+    // Another file at the same path is validated again
+    copyPackage();
+    CHECK(bytes == ReadPayloadFile(factory.Get(), packagePath, fileName, hashedBytes));
+    CHECK(hashedBytes >= bytes.size());
+    std::remove(packagePath.c_str());
 }
 
-// Validate a file is not in the package.
-TEST_CASE("Api_AppxPackageReader_PayloadFile_DoesNotExist", "[api]")
+// Validates a package reader that releases the DOM of its manifest gives the same values, and parses it again for
+// the document element
+TEST_CASE("Api_AppxPackageReader_ReleaseManifestDom", "[api]")
+{
+    auto packagePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack) + "/StoreSigned_Desktop_x64_MoviesTV.appx";
+
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_FULL, &factory));
+    MsixTest::ComPtr<IAppxFactory> releasingFactory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeapAndOptions(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_FULL, MSIX_FACTORY_OPTION_READER_RELEASE_MANIFEST_DOM, &releasingFactory));
+
+    REQUIRE(ReadManifestValues(factory.Get(), packagePath) == ReadManifestValues(releasingFactory.Get(), packagePath));
+}
+
+// Reads the name, sizes and block hashes of the files of the block map of a package, sorted by name
+static std::vector<std::string> ReadBlockMapFiles(IAppxPackageReader* packageReader)
+{
+    MsixTest::ComPtr<IAppxBlockMapReader> blockMap;
+    REQUIRE_SUCCEEDED(packageReader->GetBlockMap(&blockMap));
+    MsixTest::ComPtr<IAppxBlockMapFilesEnumerator> files;
+    REQUIRE_SUCCEEDED(blockMap->GetFiles(&files));
+    std::vector<std::string> values;
+    BOOL hasCurrent = FALSE;
+    REQUIRE_SUCCEEDED(files->GetHasCurrent(&hasCurrent));
+    while (hasCurrent)
+    {
+        MsixTest::ComPtr<IAppxBlockMapFile> file;
+        REQUIRE_SUCCEEDED(files->GetCurrent(&file));
+        MsixTest::Wrappers::Buffer<wchar_t> name;
+        REQUIRE_SUCCEEDED(file->GetName(&name));
+        UINT64 size = 0;
+        REQUIRE_SUCCEEDED(file->GetUncompressedSize(&size));
+        UINT32 lfhSize = 0;
+        REQUIRE_SUCCEEDED(file->GetLocalFileHeaderSize(&lfhSize));
+        std::string value = name.ToString() + " " + std::to_string(size) + " " + std::to_string(lfhSize);
+
+        MsixTest::ComPtr<IAppxBlockMapBlocksEnumerator> blocks;
+        REQUIRE_SUCCEEDED(file->GetBlocks(&blocks));
+        BOOL hasBlock = FALSE;
+        REQUIRE_SUCCEEDED(blocks->GetHasCurrent(&hasBlock));
+        while (hasBlock)
+        {
+            MsixTest::ComPtr<IAppxBlockMapBlock> block;
+            REQUIRE_SUCCEEDED(blocks->GetCurrent(&block));
+            UINT32 compressedSize = 0;
+            REQUIRE_SUCCEEDED(block->GetCompressedSize(&compressedSize));
+            value += " " + std::to_string(compressedSize);
+            MsixTest::Wrappers::Buffer<BYTE> hash;
+            UINT32 hashSize = 0;
+            REQUIRE_SUCCEEDED(block->GetHash(&hashSize, &hash));
+            value.append(reinterpret_cast<const char*>(hash.Get()), hashSize);
+            REQUIRE_SUCCEEDED(blocks->MoveNext(&hasBlock));
+        }
+        values.push_back(value);
+        REQUIRE_SUCCEEDED(files->MoveNext(&hasCurrent));
+    }
+    std::sort(values.begin(), values.end());
+    return values;
+}
+
+// Validates a reader created with the index of its package gives out the same manifest and block map as one that
+// parses them, and that an index that isn't the one of the package, or that isn't trusted, is ignored
+TEST_CASE("Api_AppxPackageReader_PackageIndex", "[api]")
+{
+    auto packagePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack) + "/StoreSigned_Desktop_x64_MoviesTV.appx";
+    auto indexPath = MsixTest::TestPath::GetInstance()->GetRoot() + "package_index.msixidx";
+    auto outputDir = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Output);
+
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeapAndOptions(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_TRUSTPACKAGEINDEX, MSIX_FACTORY_OPTION_PERFORMANCE_COUNTERS, &factory));
+    MsixTest::ComPtr<IAppxFactory> untrustedFactory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeapAndOptions(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_FULL, MSIX_FACTORY_OPTION_PERFORMANCE_COUNTERS, &untrustedFactory));
+
+    std::vector<std::string> manifestValues;
+    std::vector<std::string> blockMapFiles;
+    {
+        auto inputStream = MsixTest::StreamFile(packagePath, true);
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+        manifestValues = ReadManifestValues(packageReader.Get());
+        blockMapFiles = ReadBlockMapFiles(packageReader.Get());
+        auto indexStream = MsixTest::StreamFile(indexPath, false);
+        REQUIRE_SUCCEEDED(WritePackageIndex(packageReader.Get(), indexStream.Get()));
+    }
+
+    std::vector<char> index;
+    {
+        std::ifstream file(indexPath, std::ios::binary);
+        index.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    REQUIRE(index.size() > 16);
+
+    // The package is read the same with its index, without parsing xml, with another index, with what isn't an
+    // index, and by a factory that doesn't trust the index
+    auto readWithIndex = [&](const std::vector<char>& bytes, bool indexUsed, IAppxFactory* readerFactory)
+    {
+        {
+            std::ofstream file(indexPath, std::ios::binary | std::ios::trunc);
+            file.write(bytes.data(), bytes.size());
+        }
+        MsixTest::ComPtr<IStream> indexStream;
+        REQUIRE_SUCCEEDED(CreateStreamOnFileMapped(const_cast<char*>(indexPath.c_str()), &indexStream));
+        auto inputStream = MsixTest::StreamFile(packagePath, true);
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        MSIX_PERFORMANCE_COUNTERS counters = {};
+        REQUIRE_SUCCEEDED(MsixGetPerformanceCounters(readerFactory, true, &counters));
+        REQUIRE_SUCCEEDED(CreatePackageReaderWithIndex(readerFactory, inputStream.Get(), indexStream.Get(), &packageReader));
+        REQUIRE_SUCCEEDED(MsixGetPerformanceCounters(readerFactory, false, &counters));
+        CHECK((counters.stages[MSIX_PERFORMANCE_COUNTER_STAGE_XML].calls == 0) == indexUsed);
+        CHECK(ReadManifestValues(packageReader.Get()) == manifestValues);
+        CHECK(ReadBlockMapFiles(packageReader.Get()) == blockMapFiles);
+        REQUIRE_SUCCEEDED(UnpackPackageFromPackageReader(MSIX_PACKUNPACK_OPTION_NONE, packageReader.Get(), const_cast<char*>(outputDir.c_str())));
+        CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+    };
+    readWithIndex(index, true, factory.Get());
+    readWithIndex(index, false, untrustedFactory.Get());
+
+    auto otherPackage = index;
+    otherPackage[8] ^= 1;
+    readWithIndex(otherPackage, false, factory.Get());
+
+    // The manifest hash follows the size and the hashes of the central directory, block map and content types
+    auto otherManifest = index;
+    otherManifest[8 + 8 + 3 * 32] ^= 1;
+    readWithIndex(otherManifest, false, factory.Get());
+
+    readWithIndex(std::vector<char>(index.begin() + 1, index.end()), false, factory.Get());
+    std::remove(indexPath.c_str());
+}
+
+// Buffer allocator that counts the buffers it hands out, owned by the test
+class CountingBufferAllocator final : public IMsixBufferAllocator
+{
+public:
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+    {
+        if (ppvObject == nullptr || *ppvObject != nullptr) { return static_cast<HRESULT>(MSIX::Error::InvalidParameter); }
+        if (riid == UuidOfImpl<IMsixBufferAllocator>::iid || riid == UuidOfImpl<IUnknown>::iid)
+        {
+            *ppvObject = static_cast<void*>(this);
+            AddRef();
+            return S_OK;
+        }
+        return static_cast<HRESULT>(MSIX::Error::NoInterface);
+    }
+    ULONG STDMETHODCALLTYPE AddRef() noexcept override { return 1; }
+    ULONG STDMETHODCALLTYPE Release() noexcept override { return 1; }
+
+    HRESULT STDMETHODCALLTYPE AllocateBuffer(UINT32 size, BYTE** buffer) noexcept override
+    {
+        *buffer = new BYTE[size];
+        allocations++;
+        outstanding++;
+        return S_OK;
+    }
+
+    void STDMETHODCALLTYPE FreeBuffer(BYTE* buffer, UINT32) noexcept override
+    {
+        delete[] buffer;
+        outstanding--;
+    }
+
+    std::size_t allocations = 0;
+    std::size_t outstanding = 0;
+};
+
+// Validates the I/O buffers come from the buffer allocator extension, and are all given back
+TEST_CASE("Api_AppxPackageReader_BufferAllocator", "[api]")
+{
+    auto packagePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack) + "/StoreSigned_Desktop_x64_MoviesTV.appx";
+
+    CountingBufferAllocator bufferAllocator;
+    {
+        MsixTest::ComPtr<IAppxFactory> factory;
+        REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+            MSIX_VALIDATION_OPTION_FULL, &factory));
+        auto factoryOverrides = factory.As<IMsixFactoryOverrides>();
+        REQUIRE_SUCCEEDED(factoryOverrides->SpecifyExtension(MSIX_FACTORY_EXTENSION_BUFFER_ALLOCATOR, &bufferAllocator));
+        MsixTest::ComPtr<IUnknown> current;
+        REQUIRE_SUCCEEDED(factoryOverrides->GetCurrentSpecifiedExtension(MSIX_FACTORY_EXTENSION_BUFFER_ALLOCATOR, &current));
+        REQUIRE(current.Get() == static_cast<IUnknown*>(&bufferAllocator));
+
+        auto inputStream = MsixTest::StreamFile(packagePath, true);
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+
+        // Reading a file validates it against the block map
+        MsixTest::ComPtr<IAppxFilesEnumerator> files;
+        REQUIRE_SUCCEEDED(packageReader->GetPayloadFiles(&files));
+        BOOL hasCurrent = FALSE;
+        REQUIRE_SUCCEEDED(files->GetHasCurrent(&hasCurrent));
+        std::vector<std::uint8_t> buffer(1000);
+        while (hasCurrent)
+        {
+            MsixTest::ComPtr<IAppxFile> file;
+            REQUIRE_SUCCEEDED(files->GetCurrent(&file));
+            MsixTest::ComPtr<IStream> stream;
+            REQUIRE_SUCCEEDED(file->GetStream(&stream));
+            ULONG bytesRead = 0;
+            do
+            {
+                REQUIRE(SUCCEEDED(stream->Read(buffer.data(), static_cast<ULONG>(buffer.size()), &bytesRead)));
+            } while (bytesRead != 0);
+            REQUIRE_SUCCEEDED(files->MoveNext(&hasCurrent));
+        }
+        REQUIRE(bufferAllocator.allocations != 0);
+    }
+    REQUIRE(0 == bufferAllocator.outstanding);
+}
+
+// Task scheduler that keeps the tasks it is given without running them, like a host whose threads are all busy
+class HoldingTaskScheduler final : public IMsixTaskScheduler
+{
+public:
+    ~HoldingTaskScheduler()
+    {
+        for (auto task : tasks) { task->Release(); }
+    }
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+    {
+        if (ppvObject == nullptr || *ppvObject != nullptr) { return static_cast<HRESULT>(MSIX::Error::InvalidParameter); }
+        if (riid == UuidOfImpl<IMsixTaskScheduler>::iid || riid == UuidOfImpl<IUnknown>::iid)
+        {
+            *ppvObject = static_cast<void*>(this);
+            AddRef();
+            return S_OK;
+        }
+        return static_cast<HRESULT>(MSIX::Error::NoInterface);
+    }
+    ULONG STDMETHODCALLTYPE AddRef() noexcept override { return 1; }
+    ULONG STDMETHODCALLTYPE Release() noexcept override { return 1; }
+
+    HRESULT STDMETHODCALLTYPE GetConcurrency(UINT32* concurrency) noexcept override
+    {
+        *concurrency = 4;
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE Schedule(IMsixTask* task) noexcept override
+    {
+        task->AddRef();
+        tasks.push_back(task);
+        return S_OK;
+    }
+
+    std::vector<IMsixTask*> tasks;
+};
+
+// Validates the parallel work of a factory goes to the task scheduler extension, and completes even when the
+// scheduler never runs it
+TEST_CASE("Api_AppxPackageReader_TaskScheduler", "[api]")
+{
+    auto packagePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack) + "/StoreSigned_Desktop_x64_MoviesTV.appx";
+    auto outputDir = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Output);
+
+    HoldingTaskScheduler taskScheduler;
+    {
+        MsixTest::ComPtr<IAppxFactory> factory;
+        REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+            MSIX_VALIDATION_OPTION_FULL, &factory));
+        auto factoryOverrides = factory.As<IMsixFactoryOverrides>();
+        REQUIRE_SUCCEEDED(factoryOverrides->SpecifyExtension(MSIX_FACTORY_EXTENSION_TASK_SCHEDULER, &taskScheduler));
+        MsixTest::ComPtr<IUnknown> current;
+        REQUIRE_SUCCEEDED(factoryOverrides->GetCurrentSpecifiedExtension(MSIX_FACTORY_EXTENSION_TASK_SCHEDULER, &current));
+        REQUIRE(current.Get() == static_cast<IUnknown*>(&taskScheduler));
+
+        auto inputStream = MsixTest::StreamFile(packagePath, true);
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+        REQUIRE_SUCCEEDED(UnpackPackageFromPackageReader(MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION, packageReader.Get(),
+            const_cast<char*>(outputDir.c_str())));
+    }
+    REQUIRE(!taskScheduler.tasks.empty());
+    // The tasks ran when they were waited on, running them again does nothing
+    for (auto task : taskScheduler.tasks) { task->Run(); }
+
+    auto files = MsixTest::Unpack::GetExpectedFiles();
+    CHECK(MsixTest::Directory::CompareDirectory(outputDir, files));
+    CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+}
+
+// Validates unpacking a reader in parallel reports its progress, and can be cancelled, without a progress
+// callback on the factory of the reader
+TEST_CASE("Api_AppxPackageReader_UnpackWithProgress", "[api]")
 {
     std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    auto outputDir = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Output);
+    auto files = MsixTest::Unpack::GetExpectedFiles();
+
+    {
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        MsixTest::InitializePackageReader(package, &packageReader);
+        MsixTest::ProgressCounter progress;
+        REQUIRE_SUCCEEDED(UnpackPackageFromPackageReaderWithProgress(MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION, packageReader.Get(),
+            const_cast<char*>(outputDir.c_str()), 4, &progress));
+        CHECK(progress.filesTotal == files.size());
+        CHECK(progress.filesCompleted == progress.filesTotal);
+        CHECK(progress.bytesCompleted == progress.bytesTotal);
+        CHECK(MsixTest::Directory::CompareDirectory(outputDir, files));
+        CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+    }
+    {
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        MsixTest::InitializePackageReader(package, &packageReader);
+        MsixTest::ProgressCounter progress(3);
+        CHECK(static_cast<HRESULT>(MSIX::Error::Cancelled) == UnpackPackageFromPackageReaderWithProgress(MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION,
+            packageReader.Get(), const_cast<char*>(outputDir.c_str()), 4, &progress));
+        CHECK(progress.calls == 3);
+        CHECK(progress.filesCompleted < progress.filesTotal);
+        CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+    }
+}
+
+// Validates a factory created with MSIX_FACTORY_OPTION_PERFORMANCE_COUNTERS counts the stages of an unpack
+TEST_CASE("Api_AppxPackageReader_PerformanceCounters", "[api]")
+{
+    auto unpackPath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack);
+    auto outputDir = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Output);
+    auto packagePath = unpackPath + "/StoreSigned_Desktop_x64_MoviesTV.appx";
+
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeapAndOptions(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_FULL, MSIX_FACTORY_OPTION_PERFORMANCE_COUNTERS, &factory));
+    {
+        auto inputStream = MsixTest::StreamFile(packagePath, true);
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+        REQUIRE_SUCCEEDED(UnpackPackageFromPackageReader(MSIX_PACKUNPACK_OPTION_NONE, packageReader.Get(), const_cast<char*>(outputDir.c_str())));
+    }
+    CHECK(MsixTest::Directory::CompareDirectory(outputDir, MsixTest::Unpack::GetExpectedFiles()));
+    CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+
+    MSIX_PERFORMANCE_COUNTERS counters = {};
+    REQUIRE_SUCCEEDED(MsixGetPerformanceCounters(factory.Get(), true, &counters));
+    const auto& inflate = counters.stages[MSIX_PERFORMANCE_COUNTER_STAGE_INFLATE];
+    CHECK(inflate.calls > 0);
+    CHECK(inflate.bytes > 0);
+    CHECK(counters.stages[MSIX_PERFORMANCE_COUNTER_STAGE_HASH].bytes > 0);
+    CHECK(counters.stages[MSIX_PERFORMANCE_COUNTER_STAGE_OPENFILE].calls == MsixTest::Unpack::GetExpectedFiles().size());
+    CHECK(counters.stages[MSIX_PERFORMANCE_COUNTER_STAGE_XML].calls > 0);
+    CHECK(counters.stages[MSIX_PERFORMANCE_COUNTER_STAGE_DEFLATE].calls == 0);
+
+    // Reset by the previous read
+    REQUIRE_SUCCEEDED(MsixGetPerformanceCounters(factory.Get(), false, &counters));
+    CHECK(counters.stages[MSIX_PERFORMANCE_COUNTER_STAGE_INFLATE].calls == 0);
+
+    // A factory created without the option doesn't count
+    MsixTest::ComPtr<IAppxFactory> otherFactory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_FULL, &otherFactory));
+    {
+        auto inputStream = MsixTest::StreamFile(packagePath, true);
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        REQUIRE_SUCCEEDED(otherFactory->CreatePackageReader(inputStream.Get(), &packageReader));
+    }
+    REQUIRE_SUCCEEDED(MsixGetPerformanceCounters(otherFactory.Get(), false, &counters));
+    CHECK(counters.stages[MSIX_PERFORMANCE_COUNTER_STAGE_XML].calls == 0);
+}
+
+// Validates the file statistics callback is told about every file an unpack extracts, in parallel or not
+TEST_CASE("Api_AppxPackageReader_FileStatistics", "[api]")
+{
+    auto unpackPath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack);
+    auto outputDir = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Output);
+    auto packagePath = unpackPath + "/StoreSigned_Desktop_x64_MoviesTV.appx";
+    const auto& expectedFiles = MsixTest::Unpack::GetExpectedFiles();
+
+    for (auto options : { MSIX_PACKUNPACK_OPTION_NONE, MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION })
+    {
+        MsixTest::FileStatisticsCollector statistics;
+        {
+            MsixTest::ComPtr<IAppxFactory> factory;
+            REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+                MSIX_VALIDATION_OPTION_FULL, &factory));
+            REQUIRE_SUCCEEDED(factory.As<IMsixFactoryOverrides>()->SpecifyExtension(MSIX_FACTORY_EXTENSION_FILE_STATISTICS_CALLBACK, &statistics));
+            auto inputStream = MsixTest::StreamFile(packagePath, true);
+            MsixTest::ComPtr<IAppxPackageReader> packageReader;
+            REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+            REQUIRE_SUCCEEDED(UnpackPackageFromPackageReaderWithProgress(options, packageReader.Get(),
+                const_cast<char*>(outputDir.c_str()), 4, nullptr));
+        }
+        CHECK(MsixTest::Directory::CompareDirectory(outputDir, expectedFiles));
+        CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+
+        REQUIRE(statistics.files.size() == expectedFiles.size());
+        for (const auto& expected : expectedFiles)
+        {
+            REQUIRE(statistics.files.count(expected.first) == 1);
+            const auto& file = statistics.files[expected.first];
+            CHECK(file.reports == 1);
+            CHECK(!file.packed);
+            CHECK(file.size == expected.second);
+            CHECK(file.compressedSize > 0);
+            CHECK(file.deflateNanoseconds == 0);
+        }
+        CHECK(statistics.files["AppxManifest.xml"].blockCount == 0);
+        const auto& asset = statistics.files["Assets/video_offline_demo_page2.jpg"];
+        CHECK(asset.blockCount == 2);
+        CHECK(asset.readNanoseconds > 0);
+        CHECK(asset.hashNanoseconds > 0);
+        CHECK(asset.writeNanoseconds > 0);
+    }
+}
+
+// Reports the memory of the internal buffers and keeps it under a budget
+TEST_CASE("Api_AppxPackageReader_MemoryBudget", "[api]")
+{
+    auto unpackPath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack);
+    auto outputDir = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Output);
+    auto packagePath = unpackPath + "/StoreSigned_Desktop_x64_MoviesTV.appx";
+
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_FULL, &factory));
+    UINT64 current = 0;
+    UINT64 peak = 0;
+    {
+        auto inputStream = MsixTest::StreamFile(packagePath, true);
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+        REQUIRE_SUCCEEDED(UnpackPackageFromPackageReader(MSIX_PACKUNPACK_OPTION_NONE, packageReader.Get(), const_cast<char*>(outputDir.c_str())));
+    }
+    CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+    REQUIRE_SUCCEEDED(MsixGetMemoryUsage(factory.Get(), true, &current, &peak));
+    CHECK(peak > 0);
+    CHECK(peak >= current);
+
+    // The same package unpacks under a budget, streaming what doesn't fit
+    const UINT64 budget = 4 * 1024 * 1024;
+    REQUIRE_SUCCEEDED(MsixSetMemoryBudget(factory.Get(), budget));
+    {
+        auto inputStream = MsixTest::StreamFile(packagePath, true);
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+        REQUIRE_SUCCEEDED(UnpackPackageFromPackageReader(MSIX_PACKUNPACK_OPTION_NONE, packageReader.Get(), const_cast<char*>(outputDir.c_str())));
+    }
+    CHECK(MsixTest::Directory::CompareDirectory(outputDir, MsixTest::Unpack::GetExpectedFiles()));
+    CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+    REQUIRE_SUCCEEDED(MsixGetMemoryUsage(factory.Get(), false, &current, &peak));
+    CHECK(peak <= budget);
+
+    // A budget too small for the block map fails the read
+    REQUIRE_SUCCEEDED(MsixSetMemoryBudget(factory.Get(), 1));
+    {
+        auto inputStream = MsixTest::StreamFile(packagePath, true);
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        REQUIRE_HR(static_cast<HRESULT>(MSIX::Error::OutOfMemory), factory->CreatePackageReader(inputStream.Get(), &packageReader));
+    }
+
+    REQUIRE_SUCCEEDED(MsixSetMemoryBudget(factory.Get(), 0));
+    {
+        auto inputStream = MsixTest::StreamFile(packagePath, true);
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+    }
+}
+
+// Unpacks at the pace of the limit of bytes per second, on a single worker with low priority I/O
+TEST_CASE("Api_AppxPackageReader_QualityOfService", "[api]")
+{
+    auto unpackPath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack);
+    auto outputDir = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Output);
+    auto packagePath = unpackPath + "/StoreSigned_Desktop_x64_MoviesTV.appx";
+
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_FULL, &factory));
+    REQUIRE_HR(static_cast<HRESULT>(MSIX::Error::InvalidParameter), MsixSetQualityOfService(nullptr, 0, 0, false));
+
+    auto inputStream = MsixTest::StreamFile(packagePath, true);
     MsixTest::ComPtr<IAppxPackageReader> packageReader;
-    MsixTest::InitializePackageReader(package, &packageReader);
+    REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+    UINT64 payloadSize = 0;
+    MsixTest::ComPtr<IAppxFilesEnumerator> files;
+    REQUIRE_SUCCEEDED(packageReader->GetPayloadFiles(&files));
+    BOOL hasCurrent = FALSE;
+    REQUIRE_SUCCEEDED(files->GetHasCurrent(&hasCurrent));
+    while (hasCurrent)
+    {
+        MsixTest::ComPtr<IAppxFile> file;
+        REQUIRE_SUCCEEDED(files->GetCurrent(&file));
+        UINT64 size = 0;
+        REQUIRE_SUCCEEDED(file->GetSize(&size));
+        payloadSize += size;
+        REQUIRE_SUCCEEDED(files->MoveNext(&hasCurrent));
+    }
 
-    MsixTest::ComPtr<IAppxFile> appxFile;
-    REQUIRE_HR(static_cast<HRESULT>(MSIX::Error::FileNotFound),
-        packageReader->GetPayloadFile(L"thisIsAFakeFile.txt", &appxFile));
+    // Two seconds of bytes, the first one of them goes without waiting
+    REQUIRE_SUCCEEDED(MsixSetQualityOfService(factory.Get(), payloadSize / 2, 1, true));
+    auto start = std::chrono::steady_clock::now();
+    REQUIRE_SUCCEEDED(UnpackPackageFromPackageReaderWithProgress(MSIX_PACKUNPACK_OPTION_NONE, packageReader.Get(),
+        const_cast<char*>(outputDir.c_str()), 0, nullptr));
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    CHECK(elapsed >= std::chrono::milliseconds(900));
+    CHECK(MsixTest::Directory::CompareDirectory(outputDir, MsixTest::Unpack::GetExpectedFiles()));
+    CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+
+    REQUIRE_SUCCEEDED(MsixSetQualityOfService(factory.Get(), 0, 0, false));
+    {
+        auto otherStream = MsixTest::StreamFile(packagePath, true);
+        MsixTest::ComPtr<IAppxPackageReader> otherReader;
+        REQUIRE_SUCCEEDED(factory->CreatePackageReader(otherStream.Get(), &otherReader));
+        REQUIRE_SUCCEEDED(UnpackPackageFromPackageReader(MSIX_PACKUNPACK_OPTION_NONE, otherReader.Get(), const_cast<char*>(outputDir.c_str())));
+    }
+    CHECK(MsixTest::Directory::CompareDirectory(outputDir, MsixTest::Unpack::GetExpectedFiles()));
+    CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+}
+
+// Packages signed with the same certificate validate the same with the chain of the first one kept or not
+TEST_CASE("Api_AppxPackageReader_CertificateChainCache", "[api]")
+{
+    auto unpackPath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack);
+    auto packagePath = unpackPath + "/StoreSigned_Desktop_x64_MoviesTV.appx";
+
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_FULL, &factory));
+
+    auto readPublisher = [&]()
+    {
+        auto inputStream = MsixTest::StreamFile(packagePath, true);
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+        MsixTest::ComPtr<IAppxManifestReader> manifestReader;
+        REQUIRE_SUCCEEDED(packageReader->GetManifest(&manifestReader));
+        MsixTest::ComPtr<IAppxManifestPackageId> packageId;
+        REQUIRE_SUCCEEDED(manifestReader->GetPackageId(&packageId));
+        MsixTest::Wrappers::Buffer<wchar_t> publisher;
+        REQUIRE_SUCCEEDED(packageId->GetPublisher(&publisher));
+        return publisher.ToString();
+    };
+
+    // The second read reuses the chain of the first one
+    auto publisher = readPublisher();
+    CHECK(readPublisher() == publisher);
+
+    // Without the cache every read builds the chain
+    REQUIRE_SUCCEEDED(MsixSetCertificateChainCacheLifetime(factory.Get(), 0));
+    CHECK(readPublisher() == publisher);
+    CHECK(readPublisher() == publisher);
+
+    REQUIRE_SUCCEEDED(MsixSetCertificateChainCacheLifetime(factory.Get(), 60));
+    CHECK(readPublisher() == publisher);
+
+    REQUIRE_HR(static_cast<HRESULT>(MSIX::Error::InvalidParameter), MsixSetCertificateChainCacheLifetime(nullptr, 60));
 }
 
 // Validates a footprint files
@@ -141,3 +2187,107 @@ TEST_CASE("Api_AppxPackageReader_FootprintFile", "[api]")
     std::replace(codeIntegrityName.begin(), codeIntegrityName.end(), '/', '\\');
     REQUIRE(codeIntegrityName == appxCodeIntegrityName.ToString());
 }
+
+// Output stream factory that writes the files it gets flat in the current directory, like the packages of the
+// pack tests, keeping the size given for each
+class FlatOutputStreams final : public IMsixOutputStreamFactory
+{
+public:
+    static std::string GetFlatName(std::string name)
+    {
+        std::replace(name.begin(), name.end(), '/', '_');
+        return "OutputStream_" + name;
+    }
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+    {
+        if (ppvObject == nullptr || *ppvObject != nullptr) { return static_cast<HRESULT>(MSIX::Error::InvalidParameter); }
+        if (riid == UuidOfImpl<IMsixOutputStreamFactory>::iid || riid == UuidOfImpl<IUnknown>::iid)
+        {
+            *ppvObject = static_cast<void*>(this);
+            AddRef();
+            return S_OK;
+        }
+        return static_cast<HRESULT>(MSIX::Error::NoInterface);
+    }
+    ULONG STDMETHODCALLTYPE AddRef() noexcept override { return 1; }
+    ULONG STDMETHODCALLTYPE Release() noexcept override { return 1; }
+
+    HRESULT STDMETHODCALLTYPE CreateOutputStream(LPCSTR utf8RelativePath, UINT64 size, IStream** stream) noexcept override
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            sizes[utf8RelativePath] = size;
+        }
+        auto path = GetFlatName(utf8RelativePath);
+        return CreateStreamOnFile(const_cast<char*>(path.c_str()), false, stream);
+    }
+
+    std::map<std::string, std::uint64_t> sizes;
+
+protected:
+    std::mutex m_lock;
+};
+
+// Unpacks the files of a package to the output stream factory of its factory instead of to disk
+TEST_CASE("Api_AppxPackageReader_OutputStreamFactory", "[api]")
+{
+    auto unpackPath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack);
+    auto outputDir = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Output);
+    auto packagePath = unpackPath + "/StoreSigned_Desktop_x64_MoviesTV.appx";
+
+    for (auto packUnpack : { MSIX_PACKUNPACK_OPTION_NONE, MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION })
+    {
+        FlatOutputStreams outputStreams;
+        MsixTest::ComPtr<IAppxFactory> factory;
+        REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+            MSIX_VALIDATION_OPTION_FULL, &factory));
+        REQUIRE_SUCCEEDED(factory.As<IMsixFactoryOverrides>()->SpecifyExtension(MSIX_FACTORY_EXTENSION_OUTPUT_STREAM_FACTORY, &outputStreams));
+        {
+            auto inputStream = MsixTest::StreamFile(packagePath, true);
+            MsixTest::ComPtr<IAppxPackageReader> packageReader;
+            REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+            REQUIRE_SUCCEEDED(UnpackPackageFromPackageReaderWithProgress(packUnpack, packageReader.Get(),
+                const_cast<char*>(outputDir.c_str()), 4, nullptr));
+        }
+        CHECK(outputStreams.sizes == MsixTest::Unpack::GetExpectedFiles());
+        for (const auto& file : MsixTest::Unpack::GetExpectedFiles())
+        {
+            auto flatName = FlatOutputStreams::GetFlatName(file.first);
+            {
+                std::ifstream written(flatName, std::ios::binary | std::ios::ate);
+                CHECK(static_cast<std::uint64_t>(written.tellg()) == file.second);
+            }
+            std::remove(flatName.c_str());
+        }
+    }
+}
+
+// Creates readers on the worker pool of a factory, the reader or the failure is told to the completion callback
+TEST_CASE("Api_AppxPackageReader_CreateAsync", "[api]")
+{
+    auto unpackPath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack);
+
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_FULL, &factory));
+
+    auto good = MsixTest::ComPtr<MsixTest::CompletionWaiter>::Make<MsixTest::CompletionWaiter>();
+    auto bad = MsixTest::ComPtr<MsixTest::CompletionWaiter>::Make<MsixTest::CompletionWaiter>();
+    {
+        auto goodStream = MsixTest::StreamFile(unpackPath + "/StoreSigned_Desktop_x64_MoviesTV.appx", true);
+        auto badStream = MsixTest::StreamFile(unpackPath + "/SignatureNotLastPart-ERROR_BAD_FORMAT.appx", true);
+        REQUIRE_SUCCEEDED(CreatePackageReaderAsync(factory.Get(), goodStream.Get(), good.Get()));
+        REQUIRE_SUCCEEDED(CreatePackageReaderAsync(factory.Get(), badStream.Get(), bad.Get()));
+    }
+
+    good->Wait();
+    REQUIRE_SUCCEEDED(good->status);
+    auto packageReader = good->result.As<IAppxPackageReader>();
+    MsixTest::ComPtr<IAppxManifestReader> manifestReader;
+    REQUIRE_SUCCEEDED(packageReader->GetManifest(&manifestReader));
+
+    bad->Wait();
+    CHECK(static_cast<HRESULT>(MSIX::Error::CertNotTrusted) == bad->status);
+    CHECK(bad->result.Get() == nullptr);
+}
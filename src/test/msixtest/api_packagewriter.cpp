@@ -7,10 +7,20 @@
 #include "msixtest_int.hpp"
 #include "FileHelpers.hpp"
 #include "PackTestData.hpp"
+#include "PackValidation.hpp"
 #include "macros.hpp"
 #include "StreamBase.hpp"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <thread>
+
+#ifndef WIN32
+#include <dirent.h>
+#endif
 
 using namespace MsixTest::Pack;
 
@@ -106,6 +116,55 @@ TEST_CASE("Api_AppxPackageWriter_FileHashEnabled_good", "[api]")
     TestAppxPackageWriter_good("test_package_with_filehash.msix", true /* enableFileHash */);
 }
 
+// Test that the file hash in the block map is the SHA256 of the whole file, stored and compressed
+TEST_CASE("Api_AppxPackageWriter_FileHashEnabled_hash", "[api]")
+{
+    auto outputStream = MsixTest::StreamFile("test_package_with_filehash.msix", false, true);
+
+    MsixTest::ComPtr<IAppxPackageWriter> packageWriter;
+    InitializePackageWriter(outputStream.Get(), &packageWriter, true /* enableFileHash */);
+
+    std::vector<std::uint8_t> content(200000);
+    for (std::size_t i = 0; i < content.size(); i++)
+    {
+        content[i] = static_cast<std::uint8_t>(i * 7 + i / 251);
+    }
+    auto contentStream = MsixTest::StreamFile("test_file.txt", false, true);
+    ULONG bytesWritten = 0;
+    REQUIRE_SUCCEEDED(contentStream.Get()->Write(content.data(), static_cast<ULONG>(content.size()), &bytesWritten));
+
+    LARGE_INTEGER zero = { 0 };
+    REQUIRE_SUCCEEDED(contentStream.Get()->Seek(zero, STREAM_SEEK_SET, nullptr));
+    REQUIRE_SUCCEEDED(packageWriter->AddPayloadFile(TestConstants::GoodFileNames[0].second.c_str(),
+        TestConstants::ContentType.c_str(), APPX_COMPRESSION_OPTION_NORMAL, contentStream.Get()));
+    REQUIRE_SUCCEEDED(contentStream.Get()->Seek(zero, STREAM_SEEK_SET, nullptr));
+    REQUIRE_SUCCEEDED(packageWriter->AddPayloadFile(TestConstants::GoodFileNames[1].second.c_str(),
+        TestConstants::ContentType.c_str(), APPX_COMPRESSION_OPTION_NONE, contentStream.Get()));
+
+    MsixTest::ComPtr<IStream> manifestStream;
+    MakeManifestStream(&manifestStream);
+    REQUIRE_SUCCEEDED(packageWriter->Close(manifestStream.Get()));
+
+    REQUIRE_SUCCEEDED(outputStream.Get()->Seek(zero, STREAM_SEEK_SET, nullptr));
+    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+    MsixTest::InitializePackageReader(outputStream.Get(), &packageReader);
+    MsixTest::ComPtr<IAppxFile> blockMapFile;
+    REQUIRE_SUCCEEDED(packageReader->GetFootprintFile(APPX_FOOTPRINT_FILE_TYPE_BLOCKMAP, &blockMapFile));
+    MsixTest::ComPtr<IStream> blockMapStream;
+    REQUIRE_SUCCEEDED(blockMapFile->GetStream(&blockMapStream));
+    UINT64 size = 0;
+    REQUIRE_SUCCEEDED(blockMapFile->GetSize(&size));
+    std::string blockMap(static_cast<std::size_t>(size), '\0');
+    ULONG bytesRead = 0;
+    REQUIRE_SUCCEEDED(blockMapStream->Read(&blockMap[0], static_cast<ULONG>(size), &bytesRead));
+    REQUIRE(bytesRead == size);
+
+    const std::string expected = "<b4:FileHash Hash=\"6HD+wyI7rI9hR7CLMebm5LuavXg4ILzSErdzevagIXQ=\"/>";
+    auto first = blockMap.find(expected);
+    REQUIRE(first != std::string::npos);
+    REQUIRE(blockMap.find(expected, first + 1) != std::string::npos);
+}
+
 // Test creating a valid msix package via IAppxPackageWriter.
 // Create a package with empty files in start, middle and end positions, 
 // and reuse the same content streams packaged under different names.
@@ -214,9 +273,10 @@ TEST_CASE("Api_AppxPackageWriter_payloadfiles", "[api]")
     }
 
     auto packageWriter3 = packageWriter.As<IAppxPackageWriter3>();
+    REQUIRE_SUCCEEDED(packageWriter.As<IMsixPackageWriterThreads>()->SetCompressionThreadCount(0));
 
-    // memoryLimist isn't implemented yet, but set a very small memory limit to force
-    // all the handling loops when we do: 320kb.
+    // Compress in parallel with a very small memory limit to force all the handling loops: 320kb.
+    // The small files are compressed in batches and the large ones block by block.
     REQUIRE_SUCCEEDED(packageWriter3->AddPayloadFiles(
         static_cast<UINT32>(TestConstants::GoodFileNames.size()),
         payloadFiles.data(),
@@ -276,8 +336,8 @@ TEST_CASE("Api_AppxPackageWriter_payloadfiles_utf8", "[api]")
 
     auto packageWriter3utf8 = packageWriter.As<IAppxPackageWriter3Utf8>();
 
-    // memoryLimist isn't implemented yet, but set a very small memory limit to force
-    // all the handling loops when we do: 320kb.
+    // A memory limit compresses in parallel, set a very small one to force all the handling
+    // loops: 320kb. The small files are compressed in batches and the large ones block by block.
     REQUIRE_SUCCEEDED(packageWriter3utf8->AddPayloadFiles(
         static_cast<UINT32>(TestConstants::GoodFileNames.size()),
         payloadFiles.data(),
@@ -297,6 +357,623 @@ TEST_CASE("Api_AppxPackageWriter_payloadfiles_utf8", "[api]")
     MsixTest::InitializePackageReader(outputStream.Get(), &packageReader);
 }
 
+// Test that small payload files compressed in batches via IAppxPackageWriter3 are written with their content,
+// whatever their compression option, including empty files and batches that don't fill the memory limit.
+TEST_CASE("Api_AppxPackageWriter_payloadfiles_batched", "[api]")
+{
+    auto outputStream = MsixTest::StreamFile("test_package.msix", false, true);
+
+    MsixTest::ComPtr<IAppxPackageWriter> packageWriter;
+    InitializePackageWriter(outputStream.Get(), &packageWriter);
+
+    std::vector<APPX_PACKAGE_WRITER_PAYLOAD_STREAM> payloadFiles;
+    std::vector<MsixTest::StreamFile> streams;
+    payloadFiles.resize(TestConstants::GoodFileNames.size());
+    streams.resize(TestConstants::GoodFileNames.size());
+
+    // Every file fits in a block, the first one is empty.
+    const std::uint32_t contentSizeIncrement = DefaultBlockSize / static_cast<uint32_t>(TestConstants::GoodFileNames.size());
+    std::uint32_t contentSize = 0;
+
+    for(size_t i = 0; i < TestConstants::GoodFileNames.size(); i++)
+    {
+        streams[i].Initialize(TestConstants::GoodFileNames[i].first, false, true);
+        WriteContentToStream(contentSize, streams[i].Get());
+
+        payloadFiles[i].fileName = TestConstants::GoodFileNames[i].second.c_str();
+        payloadFiles[i].contentType = TestConstants::ContentType.c_str();
+        payloadFiles[i].compressionOption = (i % 3 == 2) ? APPX_COMPRESSION_OPTION_NONE : APPX_COMPRESSION_OPTION_NORMAL;
+        payloadFiles[i].inputStream = streams[i].Get();
+        contentSize += contentSizeIncrement;
+    }
+
+    auto packageWriter3 = packageWriter.As<IAppxPackageWriter3>();
+    REQUIRE_SUCCEEDED(packageWriter3->AddPayloadFiles(
+        static_cast<UINT32>(TestConstants::GoodFileNames.size()),
+        payloadFiles.data(),
+        327680
+    ));
+
+    MsixTest::ComPtr<IStream> manifestStream;
+    MakeManifestStream(&manifestStream);
+    REQUIRE_SUCCEEDED(packageWriter->Close(manifestStream.Get()));
+
+    LARGE_INTEGER zero = { 0 };
+    REQUIRE_SUCCEEDED(outputStream.Get()->Seek(zero, STREAM_SEEK_SET, nullptr));
+    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+    MsixTest::InitializePackageReader(outputStream.Get(), &packageReader);
+
+    for(size_t i = 0; i < TestConstants::GoodFileNames.size(); i++)
+    {
+        MsixTest::ComPtr<IAppxFile> file;
+        REQUIRE_SUCCEEDED(packageReader->GetPayloadFile(TestConstants::GoodFileNames[i].second.c_str(), &file));
+        MsixTest::ComPtr<IStream> fileStream;
+        REQUIRE_SUCCEEDED(file->GetStream(&fileStream));
+
+        REQUIRE_SUCCEEDED(streams[i].Get()->Seek(zero, STREAM_SEEK_SET, nullptr));
+        UINT64 size = 0;
+        REQUIRE_SUCCEEDED(file->GetSize(&size));
+        REQUIRE(size == contentSizeIncrement * i);
+        std::vector<std::uint8_t> expected(static_cast<std::size_t>(size));
+        std::vector<std::uint8_t> actual(static_cast<std::size_t>(size));
+        ULONG bytesRead = 0;
+        REQUIRE_SUCCEEDED(streams[i].Get()->Read(expected.data(), static_cast<ULONG>(size), &bytesRead));
+        REQUIRE(bytesRead == size);
+        REQUIRE_SUCCEEDED(fileStream->Read(actual.data(), static_cast<ULONG>(size), &bytesRead));
+        REQUIRE(bytesRead == size);
+        REQUIRE(std::equal(expected.begin(), expected.end(), actual.begin()));
+    }
+}
+
+// Task scheduler that runs every task on a thread of its own, so the writer has several workers on any machine
+class ThreadTaskScheduler final : public IMsixTaskScheduler
+{
+public:
+    ~ThreadTaskScheduler()
+    {
+        for (auto& thread : threads) { thread.join(); }
+    }
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+    {
+        if (ppvObject == nullptr || *ppvObject != nullptr) { return static_cast<HRESULT>(MSIX::Error::InvalidParameter); }
+        if (riid == UuidOfImpl<IMsixTaskScheduler>::iid || riid == UuidOfImpl<IUnknown>::iid)
+        {
+            *ppvObject = static_cast<void*>(this);
+            AddRef();
+            return S_OK;
+        }
+        return static_cast<HRESULT>(MSIX::Error::NoInterface);
+    }
+    ULONG STDMETHODCALLTYPE AddRef() noexcept override { return 1; }
+    ULONG STDMETHODCALLTYPE Release() noexcept override { return 1; }
+
+    HRESULT STDMETHODCALLTYPE GetConcurrency(UINT32* concurrency) noexcept override
+    {
+        *concurrency = 4;
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE Schedule(IMsixTask* task) noexcept override
+    {
+        task->AddRef();
+        threads.emplace_back([task]()
+        {
+            task->Run();
+            task->Release();
+        });
+        return S_OK;
+    }
+
+    std::vector<std::thread> threads;
+};
+
+// Test that the medium files of IAppxPackageWriter3 spooled in parallel, in memory or in temporary files past the
+// memory limit, are written with their content between small and large files.
+TEST_CASE("Api_AppxPackageWriter_payloadfiles_spooled", "[api]")
+{
+    ThreadTaskScheduler taskScheduler;
+    auto outputStream = MsixTest::StreamFile("test_package.msix", false, true);
+
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+    REQUIRE_SUCCEEDED(factory.As<IMsixFactoryOverrides>()->SpecifyExtension(MSIX_FACTORY_EXTENSION_TASK_SCHEDULER, &taskScheduler));
+    MsixTest::ComPtr<IAppxPackageWriter> packageWriter;
+    REQUIRE_SUCCEEDED(factory->CreatePackageWriter(outputStream.Get(), nullptr, &packageWriter));
+
+    const std::vector<std::uint32_t> sizes = { 70000, 5000, 1000000, 3000000, 200000, 5000000, 4194304, 65537, 300000 };
+    std::vector<APPX_PACKAGE_WRITER_PAYLOAD_STREAM> payloadFiles(sizes.size());
+    std::vector<MsixTest::StreamFile> streams(sizes.size());
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        streams[i].Initialize(TestConstants::GoodFileNames[i].first, false, true);
+        WriteContentToStream(sizes[i], streams[i].Get());
+
+        payloadFiles[i].fileName = TestConstants::GoodFileNames[i].second.c_str();
+        payloadFiles[i].contentType = TestConstants::ContentType.c_str();
+        payloadFiles[i].compressionOption = (i % 3 == 1) ? APPX_COMPRESSION_OPTION_NONE : APPX_COMPRESSION_OPTION_NORMAL;
+        payloadFiles[i].inputStream = streams[i].Get();
+    }
+
+    REQUIRE_SUCCEEDED(packageWriter.As<IMsixPackageWriterThreads>()->SetCompressionThreadCount(0));
+    auto packageWriter3 = packageWriter.As<IAppxPackageWriter3>();
+    REQUIRE_SUCCEEDED(packageWriter3->AddPayloadFiles(static_cast<UINT32>(sizes.size()), payloadFiles.data(), 1500000));
+
+    MsixTest::ComPtr<IStream> manifestStream;
+    MakeManifestStream(&manifestStream);
+    REQUIRE_SUCCEEDED(packageWriter->Close(manifestStream.Get()));
+
+    LARGE_INTEGER zero = { 0 };
+    REQUIRE_SUCCEEDED(outputStream.Get()->Seek(zero, STREAM_SEEK_SET, nullptr));
+    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+    MsixTest::InitializePackageReader(outputStream.Get(), &packageReader);
+
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        MsixTest::ComPtr<IAppxFile> file;
+        REQUIRE_SUCCEEDED(packageReader->GetPayloadFile(TestConstants::GoodFileNames[i].second.c_str(), &file));
+        UINT64 size = 0;
+        REQUIRE_SUCCEEDED(file->GetSize(&size));
+        REQUIRE(size == sizes[i]);
+
+        MsixTest::ComPtr<IStream> fileStream;
+        REQUIRE_SUCCEEDED(file->GetStream(&fileStream));
+        REQUIRE_SUCCEEDED(streams[i].Get()->Seek(zero, STREAM_SEEK_SET, nullptr));
+        std::vector<std::uint8_t> expected(static_cast<std::size_t>(size));
+        std::vector<std::uint8_t> actual(static_cast<std::size_t>(size));
+        ULONG bytesRead = 0;
+        REQUIRE_SUCCEEDED(streams[i].Get()->Read(expected.data(), static_cast<ULONG>(size), &bytesRead));
+        REQUIRE(bytesRead == size);
+        REQUIRE_SUCCEEDED(fileStream->Read(actual.data(), static_cast<ULONG>(size), &bytesRead));
+        REQUIRE(bytesRead == size);
+        REQUIRE(expected == actual);
+    }
+}
+
+// Test the file statistics callback is told about every file of the block map, whichever way it is packed
+TEST_CASE("Api_AppxPackageWriter_file_statistics", "[api]")
+{
+    ThreadTaskScheduler taskScheduler;
+    MsixTest::FileStatisticsCollector statistics;
+    auto outputStream = MsixTest::StreamFile("test_package.msix", false, true);
+
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+    REQUIRE_SUCCEEDED(factory.As<IMsixFactoryOverrides>()->SpecifyExtension(MSIX_FACTORY_EXTENSION_TASK_SCHEDULER, &taskScheduler));
+    REQUIRE_SUCCEEDED(factory.As<IMsixFactoryOverrides>()->SpecifyExtension(MSIX_FACTORY_EXTENSION_FILE_STATISTICS_CALLBACK, &statistics));
+    MsixTest::ComPtr<IAppxPackageWriter> packageWriter;
+    REQUIRE_SUCCEEDED(factory->CreatePackageWriter(outputStream.Get(), nullptr, &packageWriter));
+
+    // The first file is added alone, the others are batched, spooled and spooled stored
+    const std::vector<std::string> names = { "block.txt", "batched.txt", "spooled.txt", "stored.txt" };
+    const std::vector<std::wstring> wideNames = { L"block.txt", L"batched.txt", L"spooled.txt", L"stored.txt" };
+    const std::vector<std::uint32_t> sizes = { 200000, 5000, 1000000, 70000 };
+    std::vector<MsixTest::StreamFile> streams(sizes.size());
+    std::vector<APPX_PACKAGE_WRITER_PAYLOAD_STREAM> payloadFiles;
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        streams[i].Initialize(TestConstants::GoodFileNames[i].first, false, true);
+        WriteContentToStream(sizes[i], streams[i].Get());
+        auto compressionOption = (names[i] == "stored.txt") ? APPX_COMPRESSION_OPTION_NONE : APPX_COMPRESSION_OPTION_NORMAL;
+        if (i == 0)
+        {
+            REQUIRE_SUCCEEDED(packageWriter->AddPayloadFile(wideNames[i].c_str(), TestConstants::ContentType.c_str(), compressionOption,
+                streams[i].Get()));
+            continue;
+        }
+        APPX_PACKAGE_WRITER_PAYLOAD_STREAM payloadFile = {};
+        payloadFile.fileName = wideNames[i].c_str();
+        payloadFile.contentType = TestConstants::ContentType.c_str();
+        payloadFile.compressionOption = compressionOption;
+        payloadFile.inputStream = streams[i].Get();
+        payloadFiles.push_back(payloadFile);
+    }
+    REQUIRE_SUCCEEDED(packageWriter.As<IMsixPackageWriterThreads>()->SetCompressionThreadCount(0));
+    auto packageWriter3 = packageWriter.As<IAppxPackageWriter3>();
+    REQUIRE_SUCCEEDED(packageWriter3->AddPayloadFiles(static_cast<UINT32>(payloadFiles.size()), payloadFiles.data(), 1500000));
+
+    MsixTest::ComPtr<IStream> manifestStream;
+    MakeManifestStream(&manifestStream);
+    REQUIRE_SUCCEEDED(packageWriter->Close(manifestStream.Get()));
+
+    // The manifest is in the block map too
+    REQUIRE(statistics.files.size() == sizes.size() + 1);
+    CHECK(statistics.files.count("AppxManifest.xml") == 1);
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        REQUIRE(statistics.files.count(names[i]) == 1);
+        const auto& file = statistics.files[names[i]];
+        CHECK(file.reports == 1);
+        CHECK(file.packed);
+        CHECK(file.size == sizes[i]);
+        CHECK(file.blockCount == (sizes[i] + DefaultBlockSize - 1) / DefaultBlockSize);
+        CHECK(file.writeNanoseconds > 0);
+        if (names[i] == "stored.txt")
+        {
+            CHECK(file.compressedSize == sizes[i]);
+            CHECK(file.deflateNanoseconds == 0);
+        }
+        else
+        {
+            CHECK(file.compressedSize > 0);
+            CHECK(file.deflateNanoseconds > 0);
+        }
+        CHECK(file.inflateNanoseconds == 0);
+    }
+}
+
+// Test that packages written with a compressed block cache are the same as without it, and that their blocks are
+// deflated once: by the writers of the factory with a cache in memory, and by the writers of any factory with a
+// cache directory.
+TEST_CASE("Api_AppxPackageWriter_compressed_block_cache", "[api]")
+{
+    ThreadTaskScheduler taskScheduler;
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto cacheDir = testData->GetPath(MsixTest::TestPath::Directory::Output) + "/blockcache";
+
+    // The first file is added alone, the others are batched
+    const std::vector<std::wstring> names = { L"block.txt", L"batched.txt", L"stored.txt" };
+    const std::vector<std::uint32_t> sizes = { 200000, 5000, 70000 };
+    std::vector<MsixTest::StreamFile> streams(sizes.size());
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        streams[i].Initialize(TestConstants::GoodFileNames[i].first, false, true);
+        WriteContentToStream(sizes[i], streams[i].Get());
+    }
+
+    auto createFactory = [&taskScheduler]()
+    {
+        MsixTest::ComPtr<IAppxFactory> factory;
+        REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeapAndOptions(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+            MSIX_VALIDATION_OPTION_SKIPSIGNATURE, MSIX_FACTORY_OPTION_PERFORMANCE_COUNTERS, &factory));
+        REQUIRE_SUCCEEDED(factory.As<IMsixFactoryOverrides>()->SpecifyExtension(MSIX_FACTORY_EXTENSION_TASK_SCHEDULER, &taskScheduler));
+        return factory;
+    };
+    // Returns the bytes of the package, and the bytes deflated to write it in deflated
+    auto pack = [&](IAppxFactory* factory, UINT64& deflated)
+    {
+        MSIX_PERFORMANCE_COUNTERS counters = {};
+        REQUIRE_SUCCEEDED(MsixGetPerformanceCounters(factory, true, &counters));
+        auto outputStream = MsixTest::StreamFile("test_package.msix", false, true);
+        MsixTest::ComPtr<IAppxPackageWriter> packageWriter;
+        REQUIRE_SUCCEEDED(factory->CreatePackageWriter(outputStream.Get(), nullptr, &packageWriter));
+        std::vector<APPX_PACKAGE_WRITER_PAYLOAD_STREAM> payloadFiles;
+        for (size_t i = 0; i < sizes.size(); i++)
+        {
+            auto compressionOption = (names[i] == L"stored.txt") ? APPX_COMPRESSION_OPTION_NONE : APPX_COMPRESSION_OPTION_NORMAL;
+            if (i == 0)
+            {
+                REQUIRE_SUCCEEDED(packageWriter->AddPayloadFile(names[i].c_str(), TestConstants::ContentType.c_str(), compressionOption,
+                    streams[i].Get()));
+                continue;
+            }
+            APPX_PACKAGE_WRITER_PAYLOAD_STREAM payloadFile = {};
+            payloadFile.fileName = names[i].c_str();
+            payloadFile.contentType = TestConstants::ContentType.c_str();
+            payloadFile.compressionOption = compressionOption;
+            payloadFile.inputStream = streams[i].Get();
+            payloadFiles.push_back(payloadFile);
+        }
+        REQUIRE_SUCCEEDED(packageWriter.As<IMsixPackageWriterThreads>()->SetCompressionThreadCount(0));
+        REQUIRE_SUCCEEDED(packageWriter.As<IAppxPackageWriter3>()->AddPayloadFiles(static_cast<UINT32>(payloadFiles.size()),
+            payloadFiles.data(), 1500000));
+        MsixTest::ComPtr<IStream> manifestStream;
+        MakeManifestStream(&manifestStream);
+        REQUIRE_SUCCEEDED(packageWriter->Close(manifestStream.Get()));
+
+        REQUIRE_SUCCEEDED(MsixGetPerformanceCounters(factory, false, &counters));
+        deflated = counters.stages[MSIX_PERFORMANCE_COUNTER_STAGE_DEFLATE].bytes;
+        LARGE_INTEGER zero = { 0 };
+        ULARGE_INTEGER size = { 0 };
+        REQUIRE_SUCCEEDED(outputStream.Get()->Seek(zero, STREAM_SEEK_END, &size));
+        REQUIRE_SUCCEEDED(outputStream.Get()->Seek(zero, STREAM_SEEK_SET, nullptr));
+        std::vector<std::uint8_t> bytes(static_cast<std::size_t>(size.QuadPart));
+        ULONG bytesRead = 0;
+        REQUIRE_SUCCEEDED(outputStream.Get()->Read(bytes.data(), static_cast<ULONG>(bytes.size()), &bytesRead));
+        REQUIRE(bytesRead == bytes.size());
+        return bytes;
+    };
+    // Every compressed file is deflated the first time
+    const UINT64 compressedSize = sizes[0] + sizes[1];
+
+    UINT64 expectedDeflated = 0;
+    auto expected = pack(createFactory().Get(), expectedDeflated);
+    REQUIRE(expectedDeflated > compressedSize);
+
+    SECTION("In memory")
+    {
+        auto factory = createFactory();
+        REQUIRE_SUCCEEDED(MsixSetCompressedBlockCache(factory.Get(), nullptr, 16 * 1024 * 1024));
+        UINT64 deflated = 0;
+        CHECK(pack(factory.Get(), deflated) == expected);
+        CHECK(deflated == expectedDeflated);
+        CHECK(pack(factory.Get(), deflated) == expected);
+        CHECK(deflated + compressedSize < expectedDeflated);
+
+        // Another factory doesn't share it
+        CHECK(pack(createFactory().Get(), deflated) == expected);
+        CHECK(deflated == expectedDeflated);
+        REQUIRE_SUCCEEDED(MsixSetCompressedBlockCache(factory.Get(), nullptr, 0));
+    }
+
+    SECTION("In a directory")
+    {
+        UINT64 deflated = 0;
+        for (int i = 0; i < 2; i++)
+        {
+            auto factory = createFactory();
+            REQUIRE_SUCCEEDED(MsixSetCompressedBlockCache(factory.Get(), const_cast<char*>(cacheDir.c_str()), 0));
+            CHECK(pack(factory.Get(), deflated) == expected);
+            if (i == 0)
+            {
+                CHECK(deflated == expectedDeflated);
+            }
+            else
+            {
+                CHECK(deflated + compressedSize < expectedDeflated);
+            }
+        }
+        CHECK(MsixTest::Directory::CleanDirectory(cacheDir));
+    }
+
+    #ifndef WIN32
+    // Entries of the directory that are well formed but aren't the blocks of their names are deflated again
+    SECTION("Changed entries in a directory")
+    {
+        UINT64 deflated = 0;
+        {
+            auto factory = createFactory();
+            REQUIRE_SUCCEEDED(MsixSetCompressedBlockCache(factory.Get(), const_cast<char*>(cacheDir.c_str()), 0));
+            CHECK(pack(factory.Get(), deflated) == expected);
+        }
+
+        // The full blocks of block.txt have the same size, each entry gets the bytes of the next one
+        std::vector<std::string> entries;
+        if (auto dir = opendir(cacheDir.c_str()))
+        {
+            while (auto entry = readdir(dir))
+            {
+                if (entry->d_name[0] == '.') { continue; }
+                auto subdirPath = cacheDir + "/" + entry->d_name;
+                if (auto subdir = opendir(subdirPath.c_str()))
+                {
+                    while (auto file = readdir(subdir))
+                    {
+                        if (file->d_name[0] != '.') { entries.push_back(subdirPath + "/" + file->d_name); }
+                    }
+                    closedir(subdir);
+                }
+            }
+            closedir(dir);
+        }
+        std::vector<std::string> fullBlocks;
+        std::vector<std::vector<char>> contents;
+        for (const auto& path : entries)
+        {
+            std::ifstream input(path, std::ios::binary);
+            std::vector<char> bytes((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+            // The header of an entry, then the size of its block
+            if (bytes.size() <= 12) { continue; }
+            std::uint32_t size = 0;
+            std::memcpy(&size, bytes.data() + 8, sizeof(size));
+            if (size == 65536)
+            {
+                fullBlocks.push_back(path);
+                contents.push_back(std::move(bytes));
+            }
+        }
+        REQUIRE(fullBlocks.size() >= 2);
+        for (std::size_t i = 0; i < fullBlocks.size(); i++)
+        {
+            const auto& bytes = contents[(i + 1) % contents.size()];
+            std::ofstream output(fullBlocks[i], std::ios::binary | std::ios::trunc);
+            output.write(bytes.data(), bytes.size());
+        }
+
+        auto factory = createFactory();
+        REQUIRE_SUCCEEDED(MsixSetCompressedBlockCache(factory.Get(), const_cast<char*>(cacheDir.c_str()), 0));
+        CHECK(pack(factory.Get(), deflated) == expected);
+        CHECK(deflated >= fullBlocks.size() * 65536);
+        CHECK(MsixTest::Directory::CleanDirectory(cacheDir));
+    }
+    #endif
+}
+
+// Workers pinned to processors make the same package, and so do several workers reading their own blocks
+TEST_CASE("Api_AppxPackageWriter_worker_affinity", "[api]")
+{
+    ThreadTaskScheduler taskScheduler;
+    REQUIRE_HR(static_cast<HRESULT>(MSIX::Error::InvalidParameter), MsixSetWorkerAffinity(nullptr, true));
+
+    // Several blocks, then files of a block that are batched
+    const std::vector<std::wstring> names = { L"blocks.txt", L"batched.txt", L"stored.txt" };
+    const std::vector<std::uint32_t> sizes = { 600000, 5000, 70000 };
+    std::vector<MsixTest::StreamFile> streams(sizes.size());
+    for (size_t i = 0; i < sizes.size(); i++)
+    {
+        streams[i].Initialize(TestConstants::GoodFileNames[i].first, false, true);
+        WriteContentToStream(sizes[i], streams[i].Get());
+    }
+
+    auto pack = [&](bool pinWorkers, bool hostScheduler)
+    {
+        MsixTest::ComPtr<IAppxFactory> factory;
+        REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+            MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+        REQUIRE_SUCCEEDED(MsixSetWorkerAffinity(factory.Get(), pinWorkers));
+        if (hostScheduler)
+        {
+            REQUIRE_SUCCEEDED(factory.As<IMsixFactoryOverrides>()->SpecifyExtension(MSIX_FACTORY_EXTENSION_TASK_SCHEDULER, &taskScheduler));
+        }
+        auto outputStream = MsixTest::StreamFile("test_package.msix", false, true);
+        MsixTest::ComPtr<IAppxPackageWriter> packageWriter;
+        REQUIRE_SUCCEEDED(factory->CreatePackageWriter(outputStream.Get(), nullptr, &packageWriter));
+        std::vector<APPX_PACKAGE_WRITER_PAYLOAD_STREAM> payloadFiles;
+        for (size_t i = 0; i < sizes.size(); i++)
+        {
+            LARGE_INTEGER zero = { 0 };
+            REQUIRE_SUCCEEDED(streams[i].Get()->Seek(zero, STREAM_SEEK_SET, nullptr));
+            APPX_PACKAGE_WRITER_PAYLOAD_STREAM payloadFile = {};
+            payloadFile.fileName = names[i].c_str();
+            payloadFile.contentType = TestConstants::ContentType.c_str();
+            payloadFile.compressionOption = (names[i] == L"stored.txt") ? APPX_COMPRESSION_OPTION_NONE : APPX_COMPRESSION_OPTION_NORMAL;
+            payloadFile.inputStream = streams[i].Get();
+            payloadFiles.push_back(payloadFile);
+        }
+        REQUIRE_SUCCEEDED(packageWriter.As<IMsixPackageWriterThreads>()->SetCompressionThreadCount(0));
+        REQUIRE_SUCCEEDED(packageWriter.As<IAppxPackageWriter3>()->AddPayloadFiles(static_cast<UINT32>(payloadFiles.size()),
+            payloadFiles.data(), 1500000));
+        MsixTest::ComPtr<IStream> manifestStream;
+        MakeManifestStream(&manifestStream);
+        REQUIRE_SUCCEEDED(packageWriter->Close(manifestStream.Get()));
+
+        LARGE_INTEGER zero = { 0 };
+        ULARGE_INTEGER size = { 0 };
+        REQUIRE_SUCCEEDED(outputStream.Get()->Seek(zero, STREAM_SEEK_END, &size));
+        REQUIRE_SUCCEEDED(outputStream.Get()->Seek(zero, STREAM_SEEK_SET, nullptr));
+        std::vector<std::uint8_t> bytes(static_cast<std::size_t>(size.QuadPart));
+        ULONG bytesRead = 0;
+        REQUIRE_SUCCEEDED(outputStream.Get()->Read(bytes.data(), static_cast<ULONG>(bytes.size()), &bytesRead));
+        REQUIRE(bytesRead == bytes.size());
+        return bytes;
+    };
+
+    auto expected = pack(false, false);
+    CHECK(pack(true, false) == expected);
+    CHECK(pack(true, true) == expected);
+}
+
+// Output stream that can't seek or read, like a pipe, that records the writes
+class ForwardOnlyStream final : public MSIX::StreamBase
+{
+public:
+    ForwardOnlyStream(IStream* stream) : m_stream(stream) {}
+
+    // IStream
+    HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER, DWORD, ULARGE_INTEGER*) noexcept override
+    {
+        return static_cast<HRESULT>(MSIX::Error::NotSupported);
+    }
+
+    HRESULT STDMETHODCALLTYPE Write(const void* buffer, ULONG countBytes, ULONG* bytesWritten) noexcept override
+    {
+        writes++;
+        bytes += countBytes;
+        return m_stream->Write(buffer, countBytes, bytesWritten);
+    }
+
+    std::size_t writes = 0;
+    std::uint64_t bytes = 0;
+
+private:
+    IStream* m_stream;
+};
+
+// Test creating a valid msix package on an output stream that can't seek with MSIX_FACTORY_OPTION_WRITER_STREAMING_OUTPUT
+TEST_CASE("Api_AppxPackageWriter_streaming_output", "[api]")
+{
+    auto outputFile = MsixTest::StreamFile("test_package.msix", false, true);
+    auto outputStream = MsixTest::ComPtr<IStream>::Make<ForwardOnlyStream>(outputFile.Get());
+
+    MsixTest::ComPtr<IAppxFactory> appxFactory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeapAndOptions(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_SKIPSIGNATURE, MSIX_FACTORY_OPTION_WRITER_STREAMING_OUTPUT, &appxFactory));
+    MsixTest::ComPtr<IAppxPackageWriter> packageWriter;
+    REQUIRE_SUCCEEDED(appxFactory->CreatePackageWriter(outputStream.Get(), nullptr, &packageWriter));
+
+    const std::uint32_t contentSizeIncrement = DefaultBlockSize * 10 / static_cast<uint32_t>(TestConstants::GoodFileNames.size()) + 1;
+    std::uint32_t contentSize = 10;
+    for (const auto& fileName : TestConstants::GoodFileNames)
+    {
+        auto fileStream = MsixTest::StreamFile(fileName.first, false, true);
+        WriteContentToStream(contentSize, fileStream.Get());
+        REQUIRE_SUCCEEDED(packageWriter->AddPayloadFile(
+            fileName.second.c_str(),
+            TestConstants::ContentType.c_str(),
+            APPX_COMPRESSION_OPTION_NORMAL,
+            fileStream.Get()));
+        contentSize += contentSizeIncrement;
+    }
+
+    MsixTest::ComPtr<IStream> manifestStream;
+    MakeManifestStream(&manifestStream);
+    REQUIRE_SUCCEEDED(packageWriter->Close(manifestStream.Get()));
+
+    // The headers and blocks are gathered into writes of about a megabyte
+    auto forwardOnly = static_cast<ForwardOnlyStream*>(outputStream.Get());
+    REQUIRE(forwardOnly->writes <= forwardOnly->bytes / (512 * 1024) + 1);
+
+    LARGE_INTEGER zero = { 0 };
+    REQUIRE_SUCCEEDED(outputFile.Get()->Seek(zero, STREAM_SEEK_SET, nullptr));
+    MsixTest::ComPtr<IAppxPackageReader> packageReader;
+    MsixTest::InitializePackageReader(outputFile.Get(), &packageReader);
+}
+
+// Test packing a directory to an output stream that can't seek
+TEST_CASE("Api_PackPackageToStream", "[api]")
+{
+    auto directoryPath = MsixTest::Directory::PathAsCurrentPlatform(
+        MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Pack) + "/input");
+    {
+        auto outputFile = MsixTest::StreamFile("test_package.msix", false, false);
+        auto outputStream = MsixTest::ComPtr<IStream>::Make<ForwardOnlyStream>(outputFile.Get());
+        REQUIRE_SUCCEEDED(PackPackageToStream(MSIX_PACKUNPACK_OPTION_PARALLELCOMPRESSION, MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+            const_cast<char*>(directoryPath.c_str()), outputStream.Get(), 4, APPX_COMPRESSION_OPTION_NORMAL, nullptr, nullptr));
+        CHECK(static_cast<ForwardOnlyStream*>(outputStream.Get())->bytes != 0);
+    }
+    MsixTest::Pack::ValidatePackageStream("test_package.msix");
+    std::remove("test_package.msix");
+}
+
+// Test repacking a package by copying its payload files as they are stored in it
+TEST_CASE("Api_AppxPackageWriter_copy_from_package", "[api]")
+{
+    auto directoryPath = MsixTest::Directory::PathAsCurrentPlatform(
+        MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Pack) + "/input");
+    std::string sourcePackage = "test_source_package.msix";
+    REQUIRE_SUCCEEDED(PackPackage(MSIX_PACKUNPACK_OPTION_NONE, MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+        const_cast<char*>(directoryPath.c_str()), const_cast<char*>(sourcePackage.c_str())));
+    {
+        auto sourceStream = MsixTest::StreamFile(sourcePackage, true, false);
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        MsixTest::InitializePackageReader(sourceStream.Get(), &packageReader);
+
+        {
+            auto outputStream = MsixTest::StreamFile("test_package.msix", false, false);
+            MsixTest::ComPtr<IAppxPackageWriter> packageWriter;
+            InitializePackageWriter(outputStream.Get(), &packageWriter);
+            auto packageWriterCopy = packageWriter.As<IMsixPackageWriterCopy>();
+            for (const auto& expected : MsixTest::Pack::GetExpectedFiles())
+            {
+                if ((expected.first == "AppxManifest.xml") || !std::ifstream(directoryPath + "/" + expected.first).is_open())
+                {   // footprint files
+                    continue;
+                }
+                REQUIRE_SUCCEEDED(packageWriterCopy->AddPayloadFileFromPackage(packageReader.Get(), expected.first.c_str()));
+            }
+            auto manifestStream = MsixTest::StreamFile(directoryPath + "/AppxManifest.xml", true, false);
+            REQUIRE_SUCCEEDED(packageWriter->Close(manifestStream.Get()));
+        }
+        MsixTest::Pack::ValidatePackageStream("test_package.msix");
+
+        // Only the payload files of the package can be copied
+        {
+            auto outputStream = MsixTest::StreamFile("test_package.msix", false, true);
+            MsixTest::ComPtr<IAppxPackageWriter> packageWriter;
+            InitializePackageWriter(outputStream.Get(), &packageWriter);
+            auto packageWriterCopy = packageWriter.As<IMsixPackageWriterCopy>();
+            REQUIRE_HR(static_cast<HRESULT>(MSIX::Error::InvalidParameter),
+                packageWriterCopy->AddPayloadFileFromPackage(nullptr, "resources.pri"));
+            REQUIRE_HR(static_cast<HRESULT>(MSIX::Error::FileNotFound),
+                packageWriterCopy->AddPayloadFileFromPackage(packageReader.Get(), "AppxManifest.xml"));
+        }
+    }
+    std::remove("test_package.msix");
+    std::remove(sourcePackage.c_str());
+}
+
 // Tests failure cases for IAppxPackageWriter
 TEST_CASE("Api_AppxPackageWriter_state_errors", "[api]")
 {
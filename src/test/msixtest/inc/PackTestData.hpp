@@ -80,7 +80,9 @@ namespace MsixTest { namespace Pack {
             { "test_file_16.txt" , L"a\\__cdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxy12345"} ,
             { "test_file_17.txt" , L"a\\___defghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxy12345\\b"} ,
             // File name with exactly MAX_PATH characters
-            { "test_file_18.txt" , L"123456789\\123456789\\123456789\\123456789\\123456789\\123456789\\123456789\\123456789\\123456789\\123456789\\987654321\\987654321\\987654321\\987654321\\987654321\\987654321\\987654321\\987654321\\987654321\\987654321\\123456789\\123456789\\123456789\\123456789\\123456789\\1234567890" }
+            { "test_file_18.txt" , L"123456789\\123456789\\123456789\\123456789\\123456789\\123456789\\123456789\\123456789\\123456789\\123456789\\987654321\\987654321\\987654321\\987654321\\987654321\\987654321\\987654321\\987654321\\987654321\\987654321\\123456789\\123456789\\123456789\\123456789\\123456789\\1234567890" },
+            // Names that start like device names but aren't
+            { "test_file_19.txt" , L"CONSOLE\\lpt10.txt" }
         } };
 
         // Filenames that should be invalid for adding to a package
@@ -117,6 +119,11 @@ namespace MsixTest { namespace Pack {
             L"MIcroSOFt.SYStem.package.metadata\\test",
             L"APPXmetadata",
             L"appxMeTaDaTa\\test",
+            // Device names, alone or with an extension, and punycode
+            L"CON",
+            L"abc\\lpt1.txt",
+            L"Aux.dat\\abc",
+            L"xn--abc",
             // File names with segments 256 characters long, where the segment is alone, at the beginning, at the end, and in the middle
             L"abcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxy123456",
             L"_bcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxy123456\\a",
@@ -148,7 +155,9 @@ namespace MsixTest { namespace Pack {
             { "test_file_16.txt" , L"a/__cdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxy12345"} ,
             { "test_file_17.txt" , L"a/___defghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxy12345/b"} ,
             // File name with exactly MAX_PATH characters
-            { "test_file_18.txt" , L"123456789/123456789/123456789/123456789/123456789/123456789/123456789/123456789/123456789/123456789/987654321/987654321/987654321/987654321/987654321/987654321/987654321/987654321/987654321/987654321/123456789/123456789/123456789/123456789/123456789/1234567890" }
+            { "test_file_18.txt" , L"123456789/123456789/123456789/123456789/123456789/123456789/123456789/123456789/123456789/123456789/987654321/987654321/987654321/987654321/987654321/987654321/987654321/987654321/987654321/987654321/123456789/123456789/123456789/123456789/123456789/1234567890" },
+            // Names that start like device names but aren't
+            { "test_file_19.txt" , L"CONSOLE/lpt10.txt" }
         } };
 
         const std::vector<std::wstring> BadFileNames = {
@@ -184,6 +193,11 @@ namespace MsixTest { namespace Pack {
             L"MIcroSOFt.SYStem.package.metadata/test",
             L"APPXmetadata",
             L"appxMeTaDaTa/test",
+            // Device names, alone or with an extension, and punycode
+            L"CON",
+            L"abc/lpt1.txt",
+            L"Aux.dat/abc",
+            L"xn--abc",
             // File names with segments 256 characters long, where the segment is alone, at the beginning, at the end, and in the middle
             L"abcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxy123456",
             L"_bcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxyabcdefghijklmnopqrstuvwxy123456/a",
@@ -13,6 +13,8 @@
 
 #include <string>
 #include <map>
+#include <mutex>
+#include <condition_variable>
 
 namespace MsixTest {
 
@@ -120,6 +122,132 @@ namespace MsixTest {
     // Use the product ComPtr; enables sharing without updating every qualified use.
     using MSIX::ComPtr;
 
+    // Progress callback that keeps the last progress reported. When cancelAfter isn't 0, it cancels on that call.
+    class ProgressCounter final : public IMsixProgressCallback
+    {
+    public:
+        ProgressCounter(std::size_t cancelAfter = 0) : m_cancelAfter(cancelAfter) {}
+
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+        {
+            if (ppvObject == nullptr || *ppvObject != nullptr) { return static_cast<HRESULT>(MSIX::Error::InvalidParameter); }
+            if (riid == UuidOfImpl<IMsixProgressCallback>::iid || riid == UuidOfImpl<IUnknown>::iid)
+            {
+                *ppvObject = static_cast<void*>(this);
+                AddRef();
+                return S_OK;
+            }
+            return static_cast<HRESULT>(MSIX::Error::NoInterface);
+        }
+        ULONG STDMETHODCALLTYPE AddRef() noexcept override { return 1; }
+        ULONG STDMETHODCALLTYPE Release() noexcept override { return 1; }
+
+        HRESULT STDMETHODCALLTYPE OnProgress(UINT64 bytesCompleted, UINT64 bytesTotal, UINT32 filesCompleted, UINT32 filesTotal,
+            BOOL* cancel) noexcept override
+        {
+            calls++;
+            this->bytesCompleted = bytesCompleted;
+            this->bytesTotal = bytesTotal;
+            this->filesCompleted = filesCompleted;
+            this->filesTotal = filesTotal;
+            *cancel = (calls == m_cancelAfter) ? TRUE : FALSE;
+            return S_OK;
+        }
+
+        std::size_t calls = 0;
+        UINT64 bytesCompleted = 0;
+        UINT64 bytesTotal = 0;
+        UINT32 filesCompleted = 0;
+        UINT32 filesTotal = 0;
+
+    protected:
+        std::size_t m_cancelAfter;
+    };
+
+    // Keeps the statistics of the files unpacked or packed by name. Thread safe, files extracted in parallel are
+    // reported from several threads.
+    class FileStatisticsCollector final : public IMsixFileStatisticsCallback
+    {
+    public:
+        struct File
+        {
+            bool packed = false;
+            UINT64 size = 0;
+            UINT64 compressedSize = 0;
+            UINT32 blockCount = 0;
+            UINT64 readNanoseconds = 0;
+            UINT64 inflateNanoseconds = 0;
+            UINT64 deflateNanoseconds = 0;
+            UINT64 hashNanoseconds = 0;
+            UINT64 writeNanoseconds = 0;
+            std::size_t reports = 0;
+        };
+
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+        {
+            if (ppvObject == nullptr || *ppvObject != nullptr) { return static_cast<HRESULT>(MSIX::Error::InvalidParameter); }
+            if (riid == UuidOfImpl<IMsixFileStatisticsCallback>::iid || riid == UuidOfImpl<IUnknown>::iid)
+            {
+                *ppvObject = static_cast<void*>(this);
+                AddRef();
+                return S_OK;
+            }
+            return static_cast<HRESULT>(MSIX::Error::NoInterface);
+        }
+        ULONG STDMETHODCALLTYPE AddRef() noexcept override { return 1; }
+        ULONG STDMETHODCALLTYPE Release() noexcept override { return 1; }
+
+        void STDMETHODCALLTYPE OnFile(const MSIX_FILE_STATISTICS* statistics) noexcept override
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            auto& file = files[statistics->utf8Name];
+            file.packed = (statistics->packed == TRUE);
+            file.size = statistics->size;
+            file.compressedSize = statistics->compressedSize;
+            file.blockCount = statistics->blockCount;
+            file.readNanoseconds = statistics->readNanoseconds;
+            file.inflateNanoseconds = statistics->inflateNanoseconds;
+            file.deflateNanoseconds = statistics->deflateNanoseconds;
+            file.hashNanoseconds = statistics->hashNanoseconds;
+            file.writeNanoseconds = statistics->writeNanoseconds;
+            file.reports++;
+        }
+
+        std::map<std::string, File> files;
+
+    protected:
+        std::mutex m_lock;
+    };
+
+    // Completion callback of asynchronous operations, Wait blocks until the operation is done. Unlike the other
+    // callbacks it is reference counted, the operation may release it after Wait returns.
+    class CompletionWaiter final : public MSIX::ComClass<CompletionWaiter, IMsixCompletionCallback>
+    {
+    public:
+        void STDMETHODCALLTYPE OnComplete(HRESULT status, IUnknown* result) noexcept override
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            this->status = status;
+            this->result = result;
+            m_done = true;
+            m_signal.notify_all();
+        }
+
+        void Wait()
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_signal.wait(lock, [this]() { return m_done; });
+        }
+
+        HRESULT status = S_OK;
+        ComPtr<IUnknown> result;
+
+    protected:
+        std::mutex m_lock;
+        std::condition_variable m_signal;
+        bool m_done = false;
+    };
+
     // Helper class that creates a stream from a given file name.
     // toRead - true if the file already exists, false to create it
     // toDelete - true if the file should be deleted when the this object
@@ -0,0 +1,406 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+// Tests of internal classes of the library that aren't reachable through its API. The sources they need are
+// built into msixtest, see CMakeLists.txt.
+#include "catch.hpp"
+#include "msixtest_int.hpp"
+#include "macros.hpp"
+#include "ChunkedStream.hpp"
+#include "IoScheduler.hpp"
+#include "UnicodeConversion.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace {
+
+    std::vector<std::uint8_t> MakeBytes(std::size_t size, std::uint8_t seed)
+    {
+        std::vector<std::uint8_t> bytes(size);
+        for (std::size_t i = 0; i < size; i++) { bytes[i] = static_cast<std::uint8_t>((i * 31 + seed) ^ (i >> 8)); }
+        return bytes;
+    }
+
+    void SeekTo(IStream* stream, std::uint64_t position)
+    {
+        LARGE_INTEGER move = { 0 };
+        move.QuadPart = static_cast<LONGLONG>(position);
+        REQUIRE_SUCCEEDED(stream->Seek(move, STREAM_SEEK_SET, nullptr));
+    }
+
+    // Stream without positional reads that records its writes, and fails the one at failAt
+    class RecordingStream final : public MSIX::StreamBase
+    {
+    public:
+        RecordingStream(std::size_t failAt = static_cast<std::size_t>(-1)) : m_failAt(failAt) {}
+
+        HRESULT STDMETHODCALLTYPE Write(const void* buffer, ULONG countBytes, ULONG* bytesWritten) noexcept override
+        {
+            if (m_writes.size() == m_failAt) { return static_cast<HRESULT>(MSIX::Error::FileWrite); }
+            auto bytes = static_cast<const std::uint8_t*>(buffer);
+            m_writes.emplace_back(bytes, bytes + countBytes);
+            if (bytesWritten) { *bytesWritten = countBytes; }
+            return static_cast<HRESULT>(MSIX::Error::OK);
+        }
+
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER, DWORD, ULARGE_INTEGER* newPosition) noexcept override
+        {
+            if (newPosition) { newPosition->QuadPart = 0; }
+            return static_cast<HRESULT>(MSIX::Error::OK);
+        }
+
+        std::vector<std::vector<std::uint8_t>> m_writes;
+        std::size_t m_failAt;
+    };
+}
+
+// Validates writes, reads and seeks that cross the chunks of a ChunkedStream, which start at 64 KB and double
+TEST_CASE("Internal_ChunkedStream_ChunkBoundaries", "[internal]")
+{
+    auto stream = MSIX::ComPtr<MSIX::ChunkedStream>::Make<MSIX::ChunkedStream>();
+    const std::size_t firstChunk = MSIX::ChunkedStreamFirstChunkSize;
+    // Past the first three chunks, 64 KB + 128 KB + 256 KB
+    auto expected = MakeBytes(firstChunk * 7 + 1000, 1);
+
+    // Odd sized writes, so some of them straddle the end of a chunk
+    const std::size_t writeSize = 4099;
+    for (std::size_t offset = 0; offset < expected.size(); offset += writeSize)
+    {
+        auto count = static_cast<ULONG>(std::min(writeSize, expected.size() - offset));
+        ULONG written = 0;
+        REQUIRE_SUCCEEDED(stream->Write(expected.data() + offset, count, &written));
+        REQUIRE(count == written);
+    }
+    REQUIRE(expected.size() == stream->GetSize());
+
+    // One read of the whole stream
+    SeekTo(stream.Get(), 0);
+    std::vector<std::uint8_t> actual(expected.size() + 10);
+    ULONG read = 0;
+    REQUIRE_SUCCEEDED(stream->Read(actual.data(), static_cast<ULONG>(actual.size()), &read));
+    REQUIRE(expected.size() == read);
+    actual.resize(read);
+    REQUIRE(expected == actual);
+
+    // Reads and positional reads around each chunk boundary
+    for (std::uint64_t boundary : { firstChunk, firstChunk * 3, firstChunk * 7 })
+    {
+        std::vector<std::uint8_t> around(200);
+        SeekTo(stream.Get(), boundary - 100);
+        REQUIRE_SUCCEEDED(stream->Read(around.data(), static_cast<ULONG>(around.size()), &read));
+        REQUIRE(around.size() == read);
+        REQUIRE(std::equal(around.begin(), around.end(), expected.begin() + static_cast<std::ptrdiff_t>(boundary - 100)));
+
+        std::vector<std::uint8_t> at(200);
+        REQUIRE(at.size() == stream->ReadAt(boundary - 100, at.data(), static_cast<ULONG>(at.size())));
+        REQUIRE(around == at);
+    }
+    // A read spanning two whole chunks
+    std::vector<std::uint8_t> span(firstChunk * 4);
+    REQUIRE(span.size() == stream->ReadAt(firstChunk - 1, span.data(), static_cast<ULONG>(span.size())));
+    REQUIRE(std::equal(span.begin(), span.end(), expected.begin() + static_cast<std::ptrdiff_t>(firstChunk - 1)));
+    // Reads at or past the end
+    REQUIRE(0 == stream->ReadAt(expected.size(), span.data(), 1));
+    REQUIRE(10 == stream->ReadAt(expected.size() - 10, span.data(), 100));
+
+    // Overwriting across a boundary keeps the size, writing past the end grows it
+    auto patch = MakeBytes(3000, 7);
+    SeekTo(stream.Get(), firstChunk * 3 - 1500);
+    REQUIRE_SUCCEEDED(stream->Write(patch.data(), static_cast<ULONG>(patch.size()), nullptr));
+    std::copy(patch.begin(), patch.end(), expected.begin() + static_cast<std::ptrdiff_t>(firstChunk * 3 - 1500));
+    REQUIRE(expected.size() == stream->GetSize());
+    SeekTo(stream.Get(), expected.size() - 1000);
+    REQUIRE_SUCCEEDED(stream->Write(patch.data(), static_cast<ULONG>(patch.size()), nullptr));
+    expected.resize(expected.size() - 1000);
+    expected.insert(expected.end(), patch.begin(), patch.end());
+    REQUIRE(expected.size() == stream->GetSize());
+
+    // The stream as written to another stream
+    std::vector<std::uint8_t> copy;
+    auto copyStream = MSIX::ComPtr<IStream>::Make<MSIX::ChunkedStream>();
+    stream->WriteTo(copyStream.Get());
+    copy.resize(expected.size());
+    SeekTo(copyStream.Get(), 0);
+    REQUIRE_SUCCEEDED(copyStream->Read(copy.data(), static_cast<ULONG>(copy.size()), &read));
+    REQUIRE(copy.size() == read);
+    REQUIRE(expected == copy);
+
+    // Seeks are relative to the start, the position or the end, and stop at the end
+    ULARGE_INTEGER position = { 0 };
+    LARGE_INTEGER move = { 0 };
+    move.QuadPart = -static_cast<LONGLONG>(firstChunk);
+    REQUIRE_SUCCEEDED(stream->Seek(move, STREAM_SEEK_END, &position));
+    REQUIRE(expected.size() - firstChunk == position.QuadPart);
+    move.QuadPart = 10;
+    REQUIRE_SUCCEEDED(stream->Seek(move, STREAM_SEEK_CUR, &position));
+    REQUIRE(expected.size() - firstChunk + 10 == position.QuadPart);
+    move.QuadPart = static_cast<LONGLONG>(expected.size()) * 2;
+    REQUIRE_SUCCEEDED(stream->Seek(move, STREAM_SEEK_SET, &position));
+    REQUIRE(expected.size() == position.QuadPart);
+    move.QuadPart = -1;
+    REQUIRE_FAILED(stream->Seek(move, STREAM_SEEK_SET, &position));
+}
+
+// Validates the raw view of a ChunkedStream only covers the rest of the stream when it is in one chunk
+TEST_CASE("Internal_ChunkedStream_RawView", "[internal]")
+{
+    auto stream = MSIX::ComPtr<MSIX::ChunkedStream>::Make<MSIX::ChunkedStream>();
+    const std::size_t firstChunk = MSIX::ChunkedStreamFirstChunkSize;
+    auto bytes = MakeBytes(firstChunk + 100, 3);
+    std::uint64_t available = 0;
+    REQUIRE(nullptr == stream->GetRawView(available));
+
+    REQUIRE_SUCCEEDED(stream->Write(bytes.data(), 100, nullptr));
+    SeekTo(stream.Get(), 10);
+    auto view = stream->GetRawView(available);
+    REQUIRE(nullptr != view);
+    REQUIRE(90 == available);
+    REQUIRE(std::equal(view, view + available, bytes.begin() + 10));
+
+    SeekTo(stream.Get(), 100);
+    REQUIRE_SUCCEEDED(stream->Write(bytes.data() + 100, static_cast<ULONG>(bytes.size() - 100), nullptr));
+    SeekTo(stream.Get(), 10);
+    REQUIRE(nullptr == stream->GetRawView(available));
+    REQUIRE(0 == available);
+    SeekTo(stream.Get(), firstChunk + 40);
+    view = stream->GetRawView(available);
+    REQUIRE(nullptr != view);
+    REQUIRE(60 == available);
+    REQUIRE(std::equal(view, view + available, bytes.begin() + static_cast<std::ptrdiff_t>(firstChunk + 40)));
+}
+
+// Validates the requests on a stream without positional reads run in the order of the batch, and positional reads
+// of another stream in the same batch read what is at their offsets
+TEST_CASE("Internal_IoScheduler_Ordering", "[internal]")
+{
+    MSIX::ThreadPoolIoScheduler scheduler(4);
+    auto recording = MSIX::ComPtr<RecordingStream>::Make<RecordingStream>();
+    auto bytes = MakeBytes(64 * 1024, 5);
+    auto positional = MSIX::ComPtr<MSIX::ChunkedStream>::Make<MSIX::ChunkedStream>();
+    REQUIRE_SUCCEEDED(positional->Write(bytes.data(), static_cast<ULONG>(bytes.size()), nullptr));
+
+    const std::size_t count = 100;
+    std::vector<std::vector<std::uint8_t>> reads(count, std::vector<std::uint8_t>(500));
+    std::vector<MSIX::IoRequest> requests;
+    for (std::size_t i = 0; i < count; i++)
+    {
+        requests.push_back(MSIX::IoRequest::Write(recording.As<IStream>(), MSIX::IoCurrentPosition, bytes.data() + i, static_cast<ULONG>(i + 1)));
+        requests.push_back(MSIX::IoRequest::Read(positional.As<IStream>(), (count - i) * 300, reads[i].data(), static_cast<ULONG>(reads[i].size())));
+    }
+    scheduler.Run(requests);
+
+    REQUIRE(count == recording->m_writes.size());
+    for (std::size_t i = 0; i < count; i++)
+    {
+        REQUIRE(i + 1 == recording->m_writes[i].size());
+        REQUIRE(std::equal(recording->m_writes[i].begin(), recording->m_writes[i].end(), bytes.begin() + static_cast<std::ptrdiff_t>(i)));
+        const auto& read = requests[i * 2 + 1];
+        REQUIRE(500 == read.transferred);
+        REQUIRE(std::equal(reads[i].begin(), reads[i].end(), bytes.begin() + static_cast<std::ptrdiff_t>((count - i) * 300)));
+    }
+}
+
+// Validates the completion of a batch runs once every request is done and before its waiters return, and that
+// after a failure the requests of the same stream don't run
+TEST_CASE("Internal_IoScheduler_Completion", "[internal]")
+{
+    MSIX::ThreadPoolIoScheduler scheduler(4);
+    auto bytes = MakeBytes(1000, 2);
+
+    std::atomic<int> completions(0);
+    std::vector<MSIX::ComPtr<RecordingStream>> streams;
+    std::vector<MSIX::IoRequest> requests;
+    for (int s = 0; s < 8; s++)
+    {
+        streams.push_back(MSIX::ComPtr<RecordingStream>::Make<RecordingStream>());
+        for (int i = 0; i < 10; i++)
+        {
+            requests.push_back(MSIX::IoRequest::Write(streams.back().As<IStream>(), MSIX::IoCurrentPosition, bytes.data(), 100));
+        }
+    }
+    bool allDone = false;
+    auto batch = scheduler.Submit(std::move(requests), [&](MSIX::IoBatch& done)
+    {
+        allDone = std::all_of(done.GetRequests().begin(), done.GetRequests().end(),
+            [](const MSIX::IoRequest& request) { return request.transferred == 100; });
+        completions++;
+    });
+    batch->Wait();
+    REQUIRE(batch->IsDone());
+    REQUIRE(1 == completions);
+    REQUIRE(allDone);
+    REQUIRE_SUCCEEDED(batch->GetResult());
+    for (const auto& stream : streams) { REQUIRE(10 == stream->m_writes.size()); }
+
+    // An empty batch is done right away
+    auto empty = scheduler.Submit(std::vector<MSIX::IoRequest>(), [&](MSIX::IoBatch&) { completions++; });
+    REQUIRE(empty->IsDone());
+    REQUIRE(2 == completions);
+
+    auto failing = MSIX::ComPtr<RecordingStream>::Make<RecordingStream>(2);
+    std::vector<MSIX::IoRequest> failingRequests;
+    for (int i = 0; i < 5; i++)
+    {
+        failingRequests.push_back(MSIX::IoRequest::Write(failing.As<IStream>(), MSIX::IoCurrentPosition, bytes.data(), 10));
+    }
+    auto failed = scheduler.Submit(std::move(failingRequests), [&](MSIX::IoBatch&) { completions++; });
+    REQUIRE_THROWS(failed->Wait());
+    REQUIRE(3 == completions);
+    REQUIRE(static_cast<HRESULT>(MSIX::Error::FileWrite) == failed->GetResult());
+    REQUIRE(2 == failing->m_writes.size());
+    REQUIRE(static_cast<HRESULT>(MSIX::Error::Unexpected) == failed->GetRequests()[4].result);
+}
+
+// Validates a scheduler runs requests again after its threads are stopped, and that the threads the SDK shares
+// can be stopped while nothing uses them and start again
+TEST_CASE("Internal_IoScheduler_Stop", "[internal]")
+{
+    MSIX::ThreadPoolIoScheduler scheduler(2);
+    auto bytes = MakeBytes(100, 4);
+    for (int round = 0; round < 3; round++)
+    {
+        auto stream = MSIX::ComPtr<RecordingStream>::Make<RecordingStream>();
+        std::vector<MSIX::IoRequest> requests;
+        requests.push_back(MSIX::IoRequest::Write(stream.As<IStream>(), MSIX::IoCurrentPosition, bytes.data(), 100));
+        scheduler.Run(requests);
+        REQUIRE(1 == stream->m_writes.size());
+        scheduler.Stop();
+    }
+    REQUIRE_SUCCEEDED(MsixShutdownThreads());
+    REQUIRE_SUCCEEDED(MsixShutdownThreads());
+
+    // They start again for the next parallel work
+    auto packagePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack) + "/StoreSigned_Desktop_x64_MoviesTV.appx";
+    REQUIRE_SUCCEEDED(VerifyPackage(MSIX_VALIDATION_OPTION_FULL, const_cast<char*>(packagePath.c_str()), 4));
+    REQUIRE_SUCCEEDED(MsixShutdownThreads());
+}
+
+// Validates the ASCII runs are transcoded the same whatever their length and wherever the first non ASCII
+// character is, before, across and after the 16 units of a vector and the 8 or 4 of a word
+TEST_CASE("Internal_UnicodeConversion_AsciiRuns", "[internal]")
+{
+    for (std::size_t length = 0; length <= 70; length++)
+    {
+        std::string ascii;
+        for (std::size_t i = 0; i < length; i++) { ascii.push_back(static_cast<char>(0x20 + ((i * 7) % 0x60))); }
+        std::u16string expected(ascii.begin(), ascii.end());
+        REQUIRE(expected == MSIX::utf8_to_u16string(ascii));
+        REQUIRE(ascii == MSIX::u16string_to_utf8(expected));
+        REQUIRE(std::wstring(ascii.begin(), ascii.end()) == MSIX::utf8_to_wstring(ascii));
+        REQUIRE(ascii == MSIX::wstring_to_utf8(std::wstring(ascii.begin(), ascii.end())));
+
+        for (std::size_t position = 0; position < length; position++)
+        {   // U+007F is the last ASCII character, U+0080 the first that isn't
+            std::string utf8 = ascii;
+            utf8[position] = '\x7F';
+            std::u16string utf16(utf8.begin(), utf8.end());
+            REQUIRE(utf16 == MSIX::utf8_to_u16string(utf8));
+            REQUIRE(utf8 == MSIX::u16string_to_utf8(utf16));
+
+            utf8 = ascii.substr(0, position) + "\xC2\x80" + ascii.substr(position + 1);
+            utf16 = expected;
+            utf16[position] = 0x80;
+            REQUIRE(utf16 == MSIX::utf8_to_u16string(utf8));
+            REQUIRE(utf8 == MSIX::u16string_to_utf8(utf16));
+        }
+    }
+}
+
+// Validates the sequences of 2 to 4 bytes at the bounds of their ranges, alone and straddling the 16 byte vectors
+TEST_CASE("Internal_UnicodeConversion_Sequences", "[internal]")
+{
+    const std::vector<std::pair<std::string, std::u16string>> sequences = {
+        { "\xC2\x80", { 0x0080 } },
+        { "\xC3\xA9", { 0x00E9 } },
+        { "\xDF\xBF", { 0x07FF } },
+        { "\xE0\xA0\x80", { 0x0800 } },
+        { "\xE2\x82\xAC", { 0x20AC } },
+        { "\xED\x9F\xBF", { 0xD7FF } },
+        { "\xEE\x80\x80", { 0xE000 } },
+        { "\xEF\xBF\xBF", { 0xFFFF } },
+        { "\xF0\x90\x80\x80", { 0xD800, 0xDC00 } },
+        { "\xF0\x9F\x98\x80", { 0xD83D, 0xDE00 } },
+        { "\xF4\x8F\xBF\xBF", { 0xDBFF, 0xDFFF } },
+    };
+    for (std::size_t prefix : { 0, 1, 13, 14, 15, 16, 17, 31 })
+    {
+        std::string asciiUtf8(prefix, 'a');
+        std::u16string asciiUtf16(prefix, u'a');
+        for (const auto& sequence : sequences)
+        {
+            auto utf8 = asciiUtf8 + sequence.first + asciiUtf8;
+            auto utf16 = asciiUtf16 + sequence.second + asciiUtf16;
+            REQUIRE(utf16 == MSIX::utf8_to_u16string(utf8));
+            REQUIRE(utf8 == MSIX::u16string_to_utf8(utf16));
+
+            // A wchar_t of 32 bits gets surrogate pairs too, and takes either them or the code point back
+            std::wstring wide(utf16.begin(), utf16.end());
+            REQUIRE(wide == MSIX::utf8_to_wstring(utf8));
+            REQUIRE(utf8 == MSIX::wstring_to_utf8(wide));
+        }
+    }
+    #ifndef WIN32
+    REQUIRE(std::string("\xF0\x9F\x98\x80") == MSIX::wstring_to_utf8(std::wstring(1, static_cast<wchar_t>(0x1F600))));
+    #endif
+
+    // The non allocating conversions write no more than the bounds they document
+    std::string utf8 = "\xF0\x9F\x98\x80\xE2\x82\xAC";
+    std::vector<char16_t> utf16(utf8.size());
+    REQUIRE(3 == MSIX::utf8_to_utf16(utf8.data(), utf8.size(), utf16.data()));
+    std::vector<char> back(3 * 3);
+    REQUIRE(utf8.size() == MSIX::utf16_to_utf8(utf16.data(), 3, back.data()));
+    REQUIRE(utf8 == std::string(back.data(), utf8.size()));
+}
+
+// Validates invalid input throws, alone and after ASCII runs that fill the vectors before it
+TEST_CASE("Internal_UnicodeConversion_InvalidInput", "[internal]")
+{
+    const std::vector<std::string> invalidUtf8 = {
+        "\x80",                // continuation byte without a lead byte
+        "\xBF",
+        "\xF8\x88\x80\x80",     // lead bytes of 5 and more bytes
+        "\xFF",
+        "\xC3",                // truncated
+        "\xE2\x82",
+        "\xF0\x9F\x98",
+        "\xC3\x28",            // not a continuation byte
+        "\xE2\x28\xAC",
+        "\xC0\xAF",            // overlong
+        "\xC1\xBF",
+        "\xE0\x80\x80",
+        "\xF0\x8F\xBF\xBF",
+        "\xED\xA0\x80",        // surrogates
+        "\xED\xBF\xBF",
+        "\xF4\x90\x80\x80",     // past U+10FFFF
+    };
+    const std::vector<std::u16string> invalidUtf16 = {
+        { 0xD800 },             // high surrogate at the end
+        { 0xDBFF, u'a' },       // high surrogate without a low one
+        { 0xD800, 0xD800 },
+        { 0xDC00 },             // low surrogate without a high one
+        { 0xDFFF, u'a' },
+    };
+    for (std::size_t prefix : { 0, 15, 16, 17, 32 })
+    {
+        std::string asciiUtf8(prefix, 'a');
+        for (const auto& sequence : invalidUtf8)
+        {
+            CHECK_THROWS_AS(MSIX::utf8_to_u16string(asciiUtf8 + sequence), MSIX::Exception);
+            CHECK_THROWS_AS(MSIX::utf8_to_u16string(asciiUtf8 + sequence + asciiUtf8), MSIX::Exception);
+        }
+        std::u16string asciiUtf16(prefix, u'a');
+        for (const auto& sequence : invalidUtf16)
+        {
+            CHECK_THROWS_AS(MSIX::u16string_to_utf8(asciiUtf16 + sequence), MSIX::Exception);
+            CHECK_THROWS_AS(MSIX::u16string_to_utf8(asciiUtf16 + sequence + asciiUtf16), MSIX::Exception);
+        }
+    }
+    #ifndef WIN32
+    CHECK_THROWS_AS(MSIX::wstring_to_utf8(std::wstring(1, static_cast<wchar_t>(0x110000))), MSIX::Exception);
+    #endif
+}
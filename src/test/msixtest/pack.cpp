@@ -10,7 +10,14 @@
 #include "PackTestData.hpp"
 #include "PackValidation.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <vector>
 
 static std::string outputPackage = "package.msix";
 
@@ -61,6 +68,1074 @@ TEST_CASE("Pack_Good_EndsWithSeparator", "[pack]")
     MsixTest::Pack::ValidatePackageStream(outputPackage);
 }
 
+// Compressing the blocks of the payload files on several threads makes a package that unpacks to the same files
+TEST_CASE("Pack_Good_ParallelCompression", "[pack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto directoryPath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Pack) + "/input");
+
+    HRESULT actual = PackPackageWithThreadCount(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_PARALLELCOMPRESSION,
+                                                MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                                const_cast<char*>(directoryPath.c_str()),
+                                                const_cast<char*>(outputPackage.c_str()),
+                                                4);
+    CHECK(S_OK == actual);
+    MsixTest::Log::PrintMsixLog(S_OK, actual);
+
+    // Verify output package
+    MsixTest::Pack::ValidatePackageStream(outputPackage);
+}
+
+// Every compression level makes a valid package. The expected files have the block map of a compressed package.
+TEST_CASE("Pack_Good_CompressionOptions", "[pack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto directoryPath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Pack) + "/input");
+
+    APPX_COMPRESSION_OPTION options[] = { APPX_COMPRESSION_OPTION_SUPERFAST, APPX_COMPRESSION_OPTION_FAST,
+        APPX_COMPRESSION_OPTION_MAXIMUM };
+    for (auto option : options)
+    {
+        HRESULT actual = PackPackageWithOptions(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                                                MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                                const_cast<char*>(directoryPath.c_str()),
+                                                const_cast<char*>(outputPackage.c_str()),
+                                                1,
+                                                option);
+        CHECK(S_OK == actual);
+        MsixTest::Log::PrintMsixLog(S_OK, actual);
+
+        // Verify output package
+        MsixTest::Pack::ValidatePackageStream(outputPackage);
+    }
+}
+
+// The compressible files of the test package shrink enough, adaptive compression still deflates them
+TEST_CASE("Pack_Good_AdaptiveCompression", "[pack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto directoryPath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Pack) + "/input");
+
+    HRESULT actual = PackPackageWithOptions(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_ADAPTIVECOMPRESSION,
+                                            MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                            const_cast<char*>(directoryPath.c_str()),
+                                            const_cast<char*>(outputPackage.c_str()),
+                                            1,
+                                            APPX_COMPRESSION_OPTION_NORMAL);
+    CHECK(S_OK == actual);
+    MsixTest::Log::PrintMsixLog(S_OK, actual);
+
+    // Verify output package
+    MsixTest::Pack::ValidatePackageStream(outputPackage);
+}
+
+// A large stored payload file unpacks to the same bytes however it is extracted, and one whose bytes in the package
+// don't match the block map fails to unpack
+TEST_CASE("Pack_Good_LargeStoredFile", "[pack]")
+{
+    auto outputDir = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Output);
+    std::string storedFile = "stored.bin";
+    std::vector<char> content(2 * 1024 * 1024 + 1000);
+    std::uint32_t state = 12345;
+    for (auto& byte : content)
+    {
+        state = state * 1103515245 + 12345;
+        byte = static_cast<char>(state >> 24);
+    }
+    {
+        std::ofstream stored(storedFile, std::ios::binary | std::ios::trunc);
+        stored.write(content.data(), content.size());
+    }
+    {
+        MsixTest::ComPtr<IStream> storedStream;
+        MsixTest::ComPtr<IStream> manifestStream;
+        REQUIRE_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(storedFile.c_str()), true, &storedStream));
+        MsixTest::Pack::MakeManifestStream(&manifestStream);
+        auto outputStream = MsixTest::StreamFile(outputPackage, false);
+        MsixTest::ComPtr<IAppxFactory> factory;
+        REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+            MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+        MsixTest::ComPtr<IAppxPackageWriter> packageWriter;
+        REQUIRE_SUCCEEDED(factory->CreatePackageWriter(outputStream.Get(), nullptr, &packageWriter));
+        REQUIRE_SUCCEEDED(packageWriter->AddPayloadFile(L"stored.bin", MsixTest::Pack::TestConstants::ContentType.c_str(),
+            APPX_COMPRESSION_OPTION_NONE, storedStream.Get()));
+        REQUIRE_SUCCEEDED(packageWriter->Close(manifestStream.Get()));
+    }
+    std::remove(storedFile.c_str());
+
+    auto readAll = [](const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    };
+    for (auto packUnpack : { MSIX_PACKUNPACK_OPTION_NONE, MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION })
+    {
+        HRESULT actual = UnpackPackageWithThreadCount(packUnpack, MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+            const_cast<char*>(outputPackage.c_str()), const_cast<char*>(outputDir.c_str()), 4);
+        CHECK(S_OK == actual);
+        MsixTest::Log::PrintMsixLog(S_OK, actual);
+        CHECK(readAll(outputDir + "/stored.bin") == content);
+        CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+    }
+
+    // Flip a byte in the second block of the file
+    auto package = readAll(outputPackage);
+    auto data = std::search(package.begin(), package.end(), content.begin(), content.begin() + 64);
+    REQUIRE(data != package.end());
+    data[70000] ^= 0xFF;
+    {
+        std::ofstream output(outputPackage, std::ios::binary | std::ios::trunc);
+        output.write(package.data(), package.size());
+    }
+    HRESULT expected = static_cast<HRESULT>(MSIX::Error::SignatureInvalid);
+    HRESULT actual = UnpackPackageWithThreadCount(MSIX_PACKUNPACK_OPTION_NONE, MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+        const_cast<char*>(outputPackage.c_str()), const_cast<char*>(outputDir.c_str()), 0);
+    CHECK(expected == actual);
+    MsixTest::Log::PrintMsixLog(expected, actual);
+    CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+}
+
+// Validates a package with the sizes in its local file headers is valid and smaller than one with data descriptors
+TEST_CASE("Pack_Good_CompactZipRecords", "[pack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto directoryPath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Pack) + "/input");
+    std::string describedPackage = "described_package.msix";
+
+    HRESULT actual = PackPackage(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                                 MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                 const_cast<char*>(directoryPath.c_str()),
+                                 const_cast<char*>(describedPackage.c_str()));
+    REQUIRE(S_OK == actual);
+
+    actual = PackPackage(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_COMPACTZIPRECORDS,
+                         MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                         const_cast<char*>(directoryPath.c_str()),
+                         const_cast<char*>(outputPackage.c_str()));
+    CHECK(S_OK == actual);
+    MsixTest::Log::PrintMsixLog(S_OK, actual);
+
+    auto fileSize = [](const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        return static_cast<std::uint64_t>(file.tellg());
+    };
+    CHECK(fileSize(outputPackage) < fileSize(describedPackage));
+    std::remove(describedPackage.c_str());
+
+    // Verify output package
+    MsixTest::Pack::ValidatePackageStream(outputPackage);
+}
+
+// Validates the copies of a payload file written from its deflated blocks unpack to the same bytes, and a file of the
+// same size with other bytes isn't taken for a copy
+TEST_CASE("Pack_Good_ReuseDuplicates", "[pack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto directoryPath = testData->GetPath(MsixTest::TestPath::Directory::Pack) + "/duplicates";
+
+    HRESULT actual = PackPackage(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_REUSEDUPLICATES,
+                                 MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                 const_cast<char*>(MsixTest::Directory::PathAsCurrentPlatform(directoryPath).c_str()),
+                                 const_cast<char*>(outputPackage.c_str()));
+    CHECK(S_OK == actual);
+    MsixTest::Log::PrintMsixLog(S_OK, actual);
+
+    auto outputDir = testData->GetPath(MsixTest::TestPath::Directory::Output);
+    auto outputStream = MsixTest::StreamFile(outputPackage, true, true);
+    REQUIRE_SUCCEEDED(UnpackPackageFromStream(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                                              MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                              outputStream.Get(),
+                                              const_cast<char*>(outputDir.c_str())));
+
+    auto readAll = [](const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    };
+    for (const auto& file : { "Strings/en-us/Resources.txt", "Strings/fr-fr/Resources.txt", "Strings/de-de/Resources.txt" })
+    {
+        auto expected = readAll(directoryPath + "/" + file);
+        REQUIRE(!expected.empty());
+        CHECK(readAll(outputDir + "/" + file) == expected);
+    }
+    CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+}
+
+// Validates repacking the same files from a base package copies every block and writes the same package
+TEST_CASE("Pack_Good_FromBase", "[pack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto directoryPath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Pack) + "/input");
+    std::string basePackage = "base_package.msix";
+
+    HRESULT actual = PackPackage(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                                 MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                 const_cast<char*>(directoryPath.c_str()),
+                                 const_cast<char*>(basePackage.c_str()));
+    REQUIRE(S_OK == actual);
+
+    actual = PackPackageFromBase(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                                 MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                 const_cast<char*>(directoryPath.c_str()),
+                                 const_cast<char*>(outputPackage.c_str()),
+                                 1,
+                                 APPX_COMPRESSION_OPTION_NORMAL,
+                                 const_cast<char*>(basePackage.c_str()));
+    CHECK(S_OK == actual);
+    MsixTest::Log::PrintMsixLog(S_OK, actual);
+
+    auto readAll = [](const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    };
+    CHECK(readAll(basePackage) == readAll(outputPackage));
+    // Deletes the base package
+    MsixTest::StreamFile(basePackage, true, true);
+
+    // Verify output package
+    MsixTest::Pack::ValidatePackageStream(outputPackage);
+}
+
+// Validates a block of the base package that doesn't match its hash is deflated again instead of being copied
+TEST_CASE("Pack_Good_FromBase_CorruptBlock", "[pack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto directoryPath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Pack) + "/input");
+    std::string basePackage = "base_package.msix";
+
+    HRESULT actual = PackPackage(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                                 MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                 const_cast<char*>(directoryPath.c_str()),
+                                 const_cast<char*>(basePackage.c_str()));
+    REQUIRE(S_OK == actual);
+
+    auto readAll = [](const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    };
+    auto expected = readAll(basePackage);
+
+    // Changes a byte in the middle of the deflated bytes of the second block of the executable
+    MSIX_BYTE_RANGE range = {};
+    {
+        MsixTest::ComPtr<IStream> packageStream;
+        REQUIRE_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(basePackage.c_str()), true, &packageStream));
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        MsixTest::InitializePackageReader(packageStream.Get(), &packageReader);
+        MsixTest::ComPtr<IMsixPackageLayout> layout;
+        REQUIRE_SUCCEEDED(packageReader->QueryInterface(UuidOfImpl<IMsixPackageLayout>::iid, reinterpret_cast<void**>(&layout)));
+        REQUIRE_SUCCEEDED(layout->GetBlockRange("TestAppxPackage.exe", 1, &range));
+    }
+    auto corrupt = expected;
+    corrupt[static_cast<std::size_t>(range.offset + range.length / 2)] ^= 0x5a;
+    {
+        std::ofstream file(basePackage, std::ios::binary | std::ios::trunc);
+        file.write(corrupt.data(), static_cast<std::streamsize>(corrupt.size()));
+    }
+
+    actual = PackPackageFromBase(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                                 MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                 const_cast<char*>(directoryPath.c_str()),
+                                 const_cast<char*>(outputPackage.c_str()),
+                                 1,
+                                 APPX_COMPRESSION_OPTION_NORMAL,
+                                 const_cast<char*>(basePackage.c_str()));
+    CHECK(S_OK == actual);
+    MsixTest::Log::PrintMsixLog(S_OK, actual);
+
+    CHECK(expected == readAll(outputPackage));
+    // Deletes the base package
+    MsixTest::StreamFile(basePackage, true, true);
+
+    // Verify output package
+    MsixTest::Pack::ValidatePackageStream(outputPackage);
+}
+
+// Validates a package deflated faster is rebuilt from the same files deflated as usual, the delta and the ranges
+// fetched from it, and that a delta applied to another old package fails without leaving the output behind
+TEST_CASE("Pack_Good_DiffAndPatch", "[pack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto directoryPath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Pack) + "/input");
+    std::string oldPackage = "old_package.msix";
+    std::string delta = "package.msixdelta";
+    std::string ranges = "package.ranges";
+    std::string patchedPackage = "patched_package.msix";
+
+    HRESULT actual = PackPackageWithOptions(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                                            MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                            const_cast<char*>(directoryPath.c_str()),
+                                            const_cast<char*>(oldPackage.c_str()),
+                                            1,
+                                            APPX_COMPRESSION_OPTION_NORMAL);
+    REQUIRE(S_OK == actual);
+    actual = PackPackageWithOptions(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                                    MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                    const_cast<char*>(directoryPath.c_str()),
+                                    const_cast<char*>(outputPackage.c_str()),
+                                    1,
+                                    APPX_COMPRESSION_OPTION_FAST);
+    REQUIRE(S_OK == actual);
+
+    actual = DiffPackages(const_cast<char*>(oldPackage.c_str()),
+                          const_cast<char*>(outputPackage.c_str()),
+                          const_cast<char*>(delta.c_str()),
+                          const_cast<char*>(ranges.c_str()));
+    CHECK(S_OK == actual);
+    MsixTest::Log::PrintMsixLog(S_OK, actual);
+
+    actual = PatchPackage(const_cast<char*>(oldPackage.c_str()),
+                          const_cast<char*>(delta.c_str()),
+                          const_cast<char*>(ranges.c_str()),
+                          const_cast<char*>(patchedPackage.c_str()));
+    CHECK(S_OK == actual);
+    MsixTest::Log::PrintMsixLog(S_OK, actual);
+
+    auto readAll = [](const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    };
+    auto expected = readAll(outputPackage);
+    CHECK(expected == readAll(patchedPackage));
+    // Some blocks are deflated the same way at both levels
+    CHECK(readAll(ranges).size() < expected.size());
+
+    // The blocks copied from this one aren't the ones in the delta
+    HRESULT expectedFailure = static_cast<HRESULT>(MSIX::Error::InvalidData);
+    actual = PatchPackage(const_cast<char*>(outputPackage.c_str()),
+                          const_cast<char*>(delta.c_str()),
+                          const_cast<char*>(ranges.c_str()),
+                          const_cast<char*>(patchedPackage.c_str()));
+    CHECK(expectedFailure == actual);
+    MsixTest::Log::PrintMsixLog(expectedFailure, actual);
+    MsixTest::ComPtr<IStream> stream;
+    REQUIRE_FAILED(CreateStreamOnFile(const_cast<char*>(patchedPackage.c_str()), true, &stream));
+
+    std::remove(oldPackage.c_str());
+    std::remove(delta.c_str());
+    std::remove(ranges.c_str());
+
+    // Verify output package
+    MsixTest::Pack::ValidatePackageStream(outputPackage);
+}
+
+// Validates the digests of a package to sign are returned with it, and are the same for the same package
+TEST_CASE("Pack_Good_WithSigningDigests", "[pack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto directoryPath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Pack) + "/input");
+
+    auto pack = [&directoryPath]()
+    {
+        UINT32 digestsSize = 0;
+        BYTE* digests = nullptr;
+        HRESULT actual = PackPackageWithSigningDigests(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                                                       MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                                       const_cast<char*>(directoryPath.c_str()),
+                                                       const_cast<char*>(outputPackage.c_str()),
+                                                       1,
+                                                       APPX_COMPRESSION_OPTION_NORMAL,
+                                                       nullptr,
+                                                       nullptr,
+                                                       MsixTest::Allocators::Allocate,
+                                                       &digestsSize,
+                                                       &digests);
+        CHECK(S_OK == actual);
+        MsixTest::Log::PrintMsixLog(S_OK, actual);
+        std::vector<std::uint8_t> result(digests, digests + digestsSize);
+        MsixTest::Allocators::Free(digests);
+        return result;
+    };
+    auto digests = pack();
+
+    // APPX, then the name and SHA256 of the file records, the central directory, the content types and the block map
+    REQUIRE(digests.size() == 4 + 4 * (4 + 32));
+    CHECK(std::string(digests.begin(), digests.begin() + 4) == "APPX");
+    const char* names[] = { "AXPC", "AXCD", "AXCT", "AXBM" };
+    for (std::size_t i = 0; i < 4; i++)
+    {
+        auto name = digests.begin() + 4 + i * (4 + 32);
+        CHECK(std::string(name, name + 4) == names[i]);
+    }
+    CHECK(digests == pack());
+
+    // Verify output package
+    MsixTest::Pack::ValidatePackageStream(outputPackage);
+}
+
+// Validates a signature is added to a package and replaced without rewriting anything before it
+TEST_CASE("Pack_Good_ReplaceFootprintFiles", "[pack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto directoryPath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Pack) + "/input");
+    std::string signatureFile = "signature.p7x";
+
+    HRESULT actual = PackPackageWithOptions(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                                            MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                            const_cast<char*>(directoryPath.c_str()),
+                                            const_cast<char*>(outputPackage.c_str()),
+                                            1,
+                                            APPX_COMPRESSION_OPTION_NORMAL);
+    REQUIRE(S_OK == actual);
+
+    auto readAll = [](const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    };
+    auto replaceSignature = [&signatureFile](std::size_t size)
+    {
+        {
+            std::ofstream file(signatureFile, std::ios::binary);
+            for (std::size_t i = 0; i < size; i++) { file.put(static_cast<char>((i * 7919) >> 3)); }
+        }
+        MsixTest::ComPtr<IStream> signature;
+        REQUIRE_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(signatureFile.c_str()), true, &signature));
+        APPX_FOOTPRINT_FILE_TYPE type = APPX_FOOTPRINT_FILE_TYPE_SIGNATURE;
+        IStream* files[] = { signature.Get() };
+        HRESULT result = ReplaceFootprintFiles(const_cast<char*>(outputPackage.c_str()), 1, &type, files);
+        CHECK(S_OK == result);
+        MsixTest::Log::PrintMsixLog(S_OK, result);
+    };
+
+    // Adding it rewrites [Content_Types].xml, the last file, with the override of the signature
+    auto unsignedPackage = readAll(outputPackage);
+    replaceSignature(100000);
+    auto signed1 = readAll(outputPackage);
+    CHECK(signed1.size() > unsignedPackage.size());
+
+    // A smaller signature takes the place of the old one and the package is truncated
+    replaceSignature(10);
+    auto signed2 = readAll(outputPackage);
+    CHECK(signed2.size() < signed1.size());
+    auto common = std::mismatch(signed1.begin(), signed1.end(), signed2.begin()).first - signed1.begin();
+    CHECK(static_cast<std::size_t>(common) > unsignedPackage.size() / 2);
+
+    // Only footprint files can be replaced
+    APPX_FOOTPRINT_FILE_TYPE type = APPX_FOOTPRINT_FILE_TYPE_CONTENTGROUPMAP;
+    MsixTest::ComPtr<IStream> stream;
+    REQUIRE_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(signatureFile.c_str()), true, &stream));
+    IStream* files[] = { stream.Get() };
+    HRESULT expected = static_cast<HRESULT>(MSIX::Error::NotSupported);
+    actual = ReplaceFootprintFiles(const_cast<char*>(outputPackage.c_str()), 1, &type, files);
+    CHECK(expected == actual);
+    MsixTest::Log::PrintMsixLog(expected, actual);
+    CHECK(signed2 == readAll(outputPackage));
+    std::remove(signatureFile.c_str());
+
+    // The signature isn't a valid one, the rest of the package is
+    auto outputDir = testData->GetPath(MsixTest::TestPath::Directory::Output);
+    actual = UnpackPackage(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                           MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                           const_cast<char*>(outputPackage.c_str()),
+                           const_cast<char*>(outputDir.c_str()));
+    CHECK(S_OK == actual);
+    MsixTest::Log::PrintMsixLog(S_OK, actual);
+    CHECK(readAll(outputDir + "/AppxSignature.p7x").size() == 10);
+    CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+    std::remove(outputPackage.c_str());
+}
+
+// Validates a package packed from an inventory taken from a previous build of it is the same package, whether the
+// inventory is used or is stale
+TEST_CASE("Pack_Good_FromInventory", "[pack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto directoryPath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Pack) + "/input");
+    std::string basePackage = "base_package.msix";
+
+    HRESULT actual = PackPackageWithOptions(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                                            MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                            const_cast<char*>(directoryPath.c_str()),
+                                            const_cast<char*>(basePackage.c_str()),
+                                            1,
+                                            APPX_COMPRESSION_OPTION_NORMAL);
+    REQUIRE(S_OK == actual);
+
+    auto readAll = [](const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        return std::vector<char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    };
+    auto expected = readAll(basePackage);
+
+    // The inventory of the base package, in its order. The stored bytes of the blocks of every file are
+    // written to a file, they are only used for the compressed ones.
+    struct Entry
+    {
+        std::string name;
+        std::vector<BYTE> hashes;
+        std::vector<UINT64> compressedSizes;
+        std::string blocksFile;
+        MsixTest::ComPtr<IStream> blocks;
+    };
+    std::vector<Entry> entries;
+    std::vector<MSIX_INVENTORY_FILE> inventory;
+    {
+        MsixTest::ComPtr<IStream> packageStream;
+        REQUIRE_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(basePackage.c_str()), true, &packageStream));
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        MsixTest::InitializePackageReader(packageStream.Get(), &packageReader);
+        MsixTest::ComPtr<IMsixPackageLayout> layout;
+        REQUIRE_SUCCEEDED(packageReader->QueryInterface(UuidOfImpl<IMsixPackageLayout>::iid, reinterpret_cast<void**>(&layout)));
+        MsixTest::ComPtr<IAppxBlockMapReader> blockMap;
+        REQUIRE_SUCCEEDED(packageReader->GetBlockMap(&blockMap));
+        MsixTest::ComPtr<IAppxBlockMapFilesEnumerator> files;
+        REQUIRE_SUCCEEDED(blockMap->GetFiles(&files));
+        BOOL hasCurrent = FALSE;
+        REQUIRE_SUCCEEDED(files->GetHasCurrent(&hasCurrent));
+        while (hasCurrent)
+        {
+            MsixTest::ComPtr<IAppxBlockMapFile> file;
+            REQUIRE_SUCCEEDED(files->GetCurrent(&file));
+            MsixTest::ComPtr<IAppxBlockMapFileUtf8> fileUtf8;
+            REQUIRE_SUCCEEDED(file->QueryInterface(UuidOfImpl<IAppxBlockMapFileUtf8>::iid, reinterpret_cast<void**>(&fileUtf8)));
+            MsixTest::Wrappers::Buffer<char> name;
+            REQUIRE_SUCCEEDED(fileUtf8->GetName(&name));
+
+            Entry entry;
+            entry.name = name.ToString();
+            std::replace(entry.name.begin(), entry.name.end(), '\\', '/');
+            entry.blocksFile = "inventory_blocks_" + std::to_string(entries.size());
+            std::ofstream blocksFile(entry.blocksFile, std::ios::binary);
+            MSIX_INVENTORY_FILE inventoryFile = {};
+            REQUIRE_SUCCEEDED(file->GetUncompressedSize(&inventoryFile.size));
+            REQUIRE_SUCCEEDED(layout->GetBlockCount(name.Get(), &inventoryFile.blockCount));
+
+            MsixTest::ComPtr<IAppxBlockMapBlocksEnumerator> blocks;
+            REQUIRE_SUCCEEDED(file->GetBlocks(&blocks));
+            for (UINT32 index = 0; index < inventoryFile.blockCount; index++)
+            {
+                MsixTest::ComPtr<IAppxBlockMapBlock> block;
+                REQUIRE_SUCCEEDED(blocks->GetCurrent(&block));
+                UINT32 hashSize = 0;
+                MsixTest::Wrappers::Buffer<BYTE> hash;
+                REQUIRE_SUCCEEDED(block->GetHash(&hashSize, &hash));
+                entry.hashes.insert(entry.hashes.end(), hash.Get(), hash.Get() + hashSize);
+                BOOL hasNext = FALSE;
+                REQUIRE_SUCCEEDED(blocks->MoveNext(&hasNext));
+
+                MSIX_BYTE_RANGE range = {};
+                REQUIRE_SUCCEEDED(layout->GetBlockRange(name.Get(), index, &range));
+                blocksFile.write(expected.data() + range.offset, static_cast<std::streamsize>(range.length));
+                entry.compressedSizes.push_back(range.length);
+            }
+            blocksFile.close();
+
+            // The crc follows the signature of the data descriptor
+            MSIX_BYTE_RANGE localFileHeader = {};
+            MSIX_BYTE_RANGE data = {};
+            MSIX_BYTE_RANGE dataDescriptor = {};
+            REQUIRE_SUCCEEDED(layout->GetFileRanges(name.Get(), &localFileHeader, &data, &dataDescriptor));
+            REQUIRE(dataDescriptor.length >= 8);
+            for (std::size_t i = 0; i < 4; i++)
+            {
+                inventoryFile.crc |= static_cast<UINT32>(static_cast<std::uint8_t>(expected[dataDescriptor.offset + 4 + i])) << (8 * i);
+            }
+            REQUIRE_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(entry.blocksFile.c_str()), true, &entry.blocks));
+            entries.push_back(std::move(entry));
+            inventory.push_back(inventoryFile);
+            REQUIRE_SUCCEEDED(files->MoveNext(&hasCurrent));
+        }
+    }
+    REQUIRE(inventory.size() > 1);
+    for (std::size_t i = 0; i < inventory.size(); i++)
+    {
+        inventory[i].fileName = entries[i].name.c_str();
+        inventory[i].blockHashes = entries[i].hashes.data();
+        inventory[i].compressedBlockSizes = entries[i].compressedSizes.data();
+        inventory[i].compressedBlocks = entries[i].blocks.Get();
+    }
+
+    auto packFromInventory = [&]()
+    {
+        HRESULT result = PackPackageFromInventory(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                                                  MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                                  const_cast<char*>(directoryPath.c_str()),
+                                                  const_cast<char*>(outputPackage.c_str()),
+                                                  1,
+                                                  APPX_COMPRESSION_OPTION_NORMAL,
+                                                  nullptr,
+                                                  static_cast<UINT32>(inventory.size()),
+                                                  inventory.data());
+        CHECK(S_OK == result);
+        MsixTest::Log::PrintMsixLog(S_OK, result);
+    };
+    packFromInventory();
+    CHECK(expected == readAll(outputPackage));
+
+    // A file whose size changed is packed as usual
+    inventory[0].size++;
+    packFromInventory();
+    CHECK(expected == readAll(outputPackage));
+    inventory[0].size--;
+
+    // The hashes of the inventory are trusted
+    entries[1].hashes[0] ^= 0xff;
+    packFromInventory();
+    CHECK(expected != readAll(outputPackage));
+    entries[1].hashes[0] ^= 0xff;
+    packFromInventory();
+
+    entries.clear();
+    for (std::size_t i = 0; i < inventory.size(); i++)
+    {
+        std::remove(("inventory_blocks_" + std::to_string(i)).c_str());
+    }
+    std::remove(basePackage.c_str());
+
+    // Verify output package
+    MsixTest::Pack::ValidatePackageStream(outputPackage);
+}
+
+// Validates every payload file and the manifest are reported as they are added
+TEST_CASE("Pack_Good_WithProgress", "[pack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto directoryPath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Pack) + "/input");
+
+    MsixTest::ProgressCounter progress;
+    HRESULT actual = PackPackageWithProgress(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_PARALLELCOMPRESSION,
+                                             MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                             const_cast<char*>(directoryPath.c_str()),
+                                             const_cast<char*>(outputPackage.c_str()),
+                                             4,
+                                             APPX_COMPRESSION_OPTION_NORMAL,
+                                             nullptr,
+                                             &progress);
+    CHECK(S_OK == actual);
+    MsixTest::Log::PrintMsixLog(S_OK, actual);
+
+    CHECK(progress.filesTotal != 0);
+    CHECK(progress.filesCompleted == progress.filesTotal);
+    CHECK(progress.bytesCompleted == progress.bytesTotal);
+
+    // Verify output package
+    MsixTest::Pack::ValidatePackageStream(outputPackage);
+}
+
+// Validates a pack started on the worker threads tells its completion callback once the package is written
+TEST_CASE("Pack_Good_Async", "[pack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto directoryPath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Pack) + "/input");
+
+    auto completion = MsixTest::ComPtr<MsixTest::CompletionWaiter>::Make<MsixTest::CompletionWaiter>();
+    REQUIRE_SUCCEEDED(PackPackageAsync(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_PARALLELCOMPRESSION,
+                                       MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                       const_cast<char*>(directoryPath.c_str()),
+                                       const_cast<char*>(outputPackage.c_str()),
+                                       0,
+                                       APPX_COMPRESSION_OPTION_NORMAL,
+                                       nullptr,
+                                       nullptr,
+                                       completion.Get()));
+    completion->Wait();
+    CHECK(S_OK == completion->status);
+    MsixTest::Log::PrintMsixLog(S_OK, completion->status);
+
+    // Verify output package
+    MsixTest::Pack::ValidatePackageStream(outputPackage);
+}
+
+// Validates a time budget that is never reached packs like PackPackageWithProgress, and one that is always passed
+// stores the payload files left after the first one in a larger package that still unpacks
+TEST_CASE("Pack_Good_TimeBudget", "[pack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto directoryPath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Pack) + "/input");
+    std::string normalPackage = "normal_package.msix";
+
+    auto pack = [&](const std::string& output, UINT32 timeBudgetMilliseconds)
+    {
+        return PackPackageWithTimeBudget(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                                         MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                         const_cast<char*>(directoryPath.c_str()),
+                                         const_cast<char*>(output.c_str()),
+                                         1,
+                                         APPX_COMPRESSION_OPTION_NORMAL,
+                                         nullptr,
+                                         nullptr,
+                                         timeBudgetMilliseconds);
+    };
+    auto fileSize = [](const std::string& path)
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        return static_cast<std::uint64_t>(file.tellg());
+    };
+
+    REQUIRE(S_OK == pack(normalPackage, 0));
+    HRESULT actual = pack(outputPackage, 3600000);
+    CHECK(S_OK == actual);
+    MsixTest::Log::PrintMsixLog(S_OK, actual);
+    CHECK(fileSize(outputPackage) == fileSize(normalPackage));
+    MsixTest::Pack::ValidatePackageStream(outputPackage);
+
+    actual = pack(outputPackage, 1);
+    CHECK(S_OK == actual);
+    MsixTest::Log::PrintMsixLog(S_OK, actual);
+    CHECK(fileSize(outputPackage) > fileSize(normalPackage));
+    std::remove(normalPackage.c_str());
+
+    auto outputDir = testData->GetPath(MsixTest::TestPath::Directory::Output);
+    CHECK(S_OK == UnpackPackage(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                                MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                const_cast<char*>(outputPackage.c_str()),
+                                const_cast<char*>(outputDir.c_str())));
+    CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+}
+
+// The payload files of the access order are packed first, in its order, and the others after them. Paths with
+// either separator and paths that aren't payload files are taken.
+TEST_CASE("Pack_Good_AccessOrder", "[pack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto directoryPath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Pack) + "/input");
+
+    std::vector<std::string> order = { "TestAppxPackage.exe", "Assets\\StoreLogo.png", "NotThere.dll", "Assets/SplashScreen.scale-200.png",
+        "TestAppxPackage.exe" };
+    std::vector<char*> accessOrder;
+    for (auto& file : order) { accessOrder.push_back(const_cast<char*>(file.c_str())); }
+    HRESULT actual = PackPackageWithAccessOrder(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                                                MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                                const_cast<char*>(directoryPath.c_str()),
+                                                const_cast<char*>(outputPackage.c_str()),
+                                                1,
+                                                APPX_COMPRESSION_OPTION_NORMAL,
+                                                nullptr,
+                                                nullptr,
+                                                0,
+                                                static_cast<UINT32>(accessOrder.size()),
+                                                accessOrder.data());
+    CHECK(S_OK == actual);
+    MsixTest::Log::PrintMsixLog(S_OK, actual);
+
+    // The local file header of a file, with its name, is the first place its name is in the package
+    std::ifstream file(outputPackage, std::ios::binary);
+    std::vector<char> package((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+    auto positionOf = [&package](const std::string& name)
+    {
+        return std::search(package.begin(), package.end(), name.begin(), name.end()) - package.begin();
+    };
+    // Right after the local file header of the first file
+    CHECK(positionOf("TestAppxPackage.exe") == 30);
+    CHECK(positionOf("TestAppxPackage.exe") < positionOf("Assets/StoreLogo.png"));
+    CHECK(positionOf("Assets/StoreLogo.png") < positionOf("Assets/SplashScreen.scale-200.png"));
+    for (const auto& other : { "resources.pri", "TestAppxPackage.winmd", "Assets/LockScreenLogo.scale-200.png",
+        "Assets/Square150x150Logo.scale-200.png", "AppxBlockMap.xml" })
+    {
+        CHECK(positionOf("Assets/SplashScreen.scale-200.png") < positionOf(other));
+    }
+    MsixTest::Pack::ValidatePackageStream(outputPackage);
+
+    // A null path fails
+    accessOrder[1] = nullptr;
+    CHECK(static_cast<HRESULT>(MSIX::Error::InvalidParameter) == PackPackageWithAccessOrder(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                                                MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                                const_cast<char*>(directoryPath.c_str()),
+                                                const_cast<char*>(outputPackage.c_str()),
+                                                1,
+                                                APPX_COMPRESSION_OPTION_NORMAL,
+                                                nullptr,
+                                                nullptr,
+                                                0,
+                                                static_cast<UINT32>(accessOrder.size()),
+                                                accessOrder.data()));
+}
+
+// Validates a package packed from a zip or a tar archive of a directory unpacks to the files of the directory
+TEST_CASE("Pack_Good_FromArchive", "[pack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto directoryPath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Pack) + "/input");
+
+    // A package is a zip archive with the files of the directory at its root
+    std::string zipArchive = "archive.zip";
+    REQUIRE_SUCCEEDED(PackPackage(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                                  MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                  const_cast<char*>(directoryPath.c_str()),
+                                  const_cast<char*>(zipArchive.c_str())));
+    HRESULT actual = PackPackageFromArchive(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                                            MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                            const_cast<char*>(zipArchive.c_str()),
+                                            const_cast<char*>(outputPackage.c_str()),
+                                            1,
+                                            APPX_COMPRESSION_OPTION_NORMAL,
+                                            nullptr);
+    CHECK(S_OK == actual);
+    MsixTest::Log::PrintMsixLog(S_OK, actual);
+    MsixTest::Pack::ValidatePackageStream(outputPackage);
+    std::remove(zipArchive.c_str());
+
+    // A ustar archive made from the directory, with its directories and names starting with "./" like tar makes them
+    std::string tarArchive = "archive.tar";
+    std::ofstream tar(tarArchive, std::ios::binary);
+    auto writeHeader = [&tar](const std::string& name, std::uint64_t size, char type)
+    {
+        std::array<char, 512> header = {};
+        std::copy(name.begin(), name.end(), header.begin());
+        std::snprintf(&header[100], 8, "%07o", 0644);
+        std::snprintf(&header[108], 8, "%07o", 0);
+        std::snprintf(&header[116], 8, "%07o", 0);
+        std::snprintf(&header[124], 12, "%011llo", static_cast<unsigned long long>(size));
+        std::snprintf(&header[136], 12, "%011o", 0);
+        header[156] = type;
+        std::copy_n("ustar", 6, &header[257]);
+        std::copy_n("00", 2, &header[263]);
+        std::fill_n(&header[148], 8, ' ');
+        unsigned int checksum = 0;
+        for (auto byte : header) { checksum += static_cast<unsigned char>(byte); }
+        std::snprintf(&header[148], 8, "%06o", checksum);
+        tar.write(header.data(), header.size());
+    };
+    writeHeader("./", 0, '5');
+    writeHeader("./Assets/", 0, '5');
+    for (const auto& expected : MsixTest::Pack::GetExpectedFiles())
+    {
+        std::ifstream file(directoryPath + "/" + expected.first, std::ios::binary);
+        if (!file.is_open()) { continue; } // footprint files the pack makes
+        std::vector<char> content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        writeHeader("./" + expected.first, content.size(), '0');
+        tar.write(content.data(), content.size());
+        std::vector<char> padding((512 - content.size() % 512) % 512, 0);
+        tar.write(padding.data(), padding.size());
+    }
+    std::vector<char> end(1024, 0);
+    tar.write(end.data(), end.size());
+    tar.close();
+
+    actual = PackPackageFromArchive(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_PARALLELCOMPRESSION,
+                                    MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                    const_cast<char*>(tarArchive.c_str()),
+                                    const_cast<char*>(outputPackage.c_str()),
+                                    4,
+                                    APPX_COMPRESSION_OPTION_NORMAL,
+                                    nullptr);
+    CHECK(S_OK == actual);
+    MsixTest::Log::PrintMsixLog(S_OK, actual);
+    MsixTest::Pack::ValidatePackageStream(outputPackage);
+    std::remove(tarArchive.c_str());
+
+    // Anything else isn't an archive
+    auto manifestPath = directoryPath + "/AppxManifest.xml";
+    CHECK(S_OK != PackPackageFromArchive(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                                         MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                         const_cast<char*>(manifestPath.c_str()),
+                                         const_cast<char*>(outputPackage.c_str()),
+                                         1,
+                                         APPX_COMPRESSION_OPTION_NORMAL,
+                                         nullptr));
+}
+
+// Validates the pack stops when the progress callback cancels it and the output package is deleted
+TEST_CASE("Pack_Cancelled", "[pack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto directoryPath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Pack) + "/input");
+
+    MsixTest::ProgressCounter progress(1);
+    HRESULT expected = static_cast<HRESULT>(MSIX::Error::Cancelled);
+    HRESULT actual = PackPackageWithProgress(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                                             MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                             const_cast<char*>(directoryPath.c_str()),
+                                             const_cast<char*>(outputPackage.c_str()),
+                                             1,
+                                             APPX_COMPRESSION_OPTION_NORMAL,
+                                             nullptr,
+                                             &progress);
+    CHECK(expected == actual);
+    MsixTest::Log::PrintMsixLog(expected, actual);
+    CHECK(progress.calls == 1);
+
+    MsixTest::ComPtr<IStream> stream;
+    REQUIRE_FAILED(CreateStreamOnFile(const_cast<char*>(outputPackage.c_str()), true, &stream));
+}
+
+// Validates a package added to a bundle is stored as is and can be read back from the bundle
+TEST_CASE("Pack_Good_BundlePayloadPackage", "[pack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto directoryPath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Pack) + "/input");
+
+    HRESULT actual = PackPackage(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                                 MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                 const_cast<char*>(directoryPath.c_str()),
+                                 const_cast<char*>(outputPackage.c_str()));
+    REQUIRE(S_OK == actual);
+
+    std::string outputBundle = "package.msixbundle";
+    MsixTest::ComPtr<IAppxBundleFactory> bundleFactory;
+    REQUIRE_SUCCEEDED(CoCreateAppxBundleFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+        static_cast<MSIX_APPLICABILITY_OPTIONS>(MSIX_APPLICABILITY_OPTIONS::MSIX_APPLICABILITY_OPTION_SKIPPLATFORM |
+                                                MSIX_APPLICABILITY_OPTIONS::MSIX_APPLICABILITY_OPTION_SKIPLANGUAGE),
+        &bundleFactory));
+    {
+        auto bundleStream = MsixTest::StreamFile(outputBundle, false);
+        auto packageStream = MsixTest::StreamFile(outputPackage, true);
+        MsixTest::ComPtr<IAppxBundleWriter> bundleWriter;
+        REQUIRE_SUCCEEDED(bundleFactory->CreateBundleWriter(bundleStream.Get(), 0, &bundleWriter));
+        REQUIRE_SUCCEEDED(bundleWriter->AddPayloadPackage(L"package.msix", packageStream.Get()));
+        REQUIRE_SUCCEEDED(bundleWriter->Close());
+    }
+
+    auto bundleStream = MsixTest::StreamFile(outputBundle, true, true);
+    MsixTest::ComPtr<IAppxBundleReader> bundleReader;
+    REQUIRE_SUCCEEDED(bundleFactory->CreateBundleReader(bundleStream.Get(), &bundleReader));
+    MsixTest::ComPtr<IAppxFile> payloadPackage;
+    REQUIRE_SUCCEEDED(bundleReader->GetPayloadPackage(L"package.msix", &payloadPackage));
+    UINT64 size = 0;
+    REQUIRE_SUCCEEDED(payloadPackage->GetSize(&size));
+    MsixTest::ComPtr<IStream> payloadStream;
+    REQUIRE_SUCCEEDED(payloadPackage->GetStream(&payloadStream));
+    std::vector<char> payload(static_cast<std::size_t>(size));
+    ULONG bytesRead = 0;
+    REQUIRE_SUCCEEDED(payloadStream->Read(payload.data(), static_cast<ULONG>(payload.size()), &bytesRead));
+    CHECK(bytesRead == payload.size());
+
+    std::ifstream file(outputPackage, std::ios::binary);
+    std::vector<char> expected((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+    CHECK(expected == payload);
+
+    // Verify output package
+    MsixTest::Pack::ValidatePackageStream(outputPackage);
+}
+
+// Validates a bundle writer that only reads the manifests of its packages doesn't read their payload files, unless
+// it is asked to validate them
+TEST_CASE("Pack_Good_BundleReadManifests", "[pack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto directoryPath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Pack) + "/input");
+
+    HRESULT actual = PackPackage(MSIX_PACKUNPACK_OPTION::MSIX_PACKUNPACK_OPTION_NONE,
+                                 MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                                 const_cast<char*>(directoryPath.c_str()),
+                                 const_cast<char*>(outputPackage.c_str()));
+    REQUIRE(S_OK == actual);
+
+    // Corrupt the local file header of the first file, a payload file, so only a package reader notices
+    std::string corruptedPackage = "corrupted.msix";
+    {
+        std::ifstream file(outputPackage, std::ios::binary);
+        std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        REQUIRE(bytes.size() > 4);
+        bytes[0] = static_cast<char>(~bytes[0]);
+        std::ofstream corrupted(corruptedPackage, std::ios::binary);
+        corrupted.write(bytes.data(), bytes.size());
+    }
+
+    auto createBundleFactory = [](MSIX_FACTORY_OPTIONS factoryOptions)
+    {
+        MsixTest::ComPtr<IAppxBundleFactory> bundleFactory;
+        REQUIRE_SUCCEEDED(CoCreateAppxBundleFactoryWithHeapAndOptions(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+            MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+            static_cast<MSIX_APPLICABILITY_OPTIONS>(MSIX_APPLICABILITY_OPTIONS::MSIX_APPLICABILITY_OPTION_SKIPPLATFORM |
+                                                    MSIX_APPLICABILITY_OPTIONS::MSIX_APPLICABILITY_OPTION_SKIPLANGUAGE),
+            factoryOptions, &bundleFactory));
+        return bundleFactory;
+    };
+
+    std::string outputBundle = "package.msixbundle";
+    SECTION("Read manifests")
+    {
+        auto bundleFactory = createBundleFactory(MSIX_FACTORY_OPTION_WRITER_BUNDLE_READ_MANIFESTS);
+        {
+            auto bundleStream = MsixTest::StreamFile(outputBundle, false);
+            auto packageStream = MsixTest::StreamFile(outputPackage, true);
+            MsixTest::ComPtr<IAppxBundleWriter> bundleWriter;
+            REQUIRE_SUCCEEDED(bundleFactory->CreateBundleWriter(bundleStream.Get(), 0, &bundleWriter));
+            REQUIRE_SUCCEEDED(bundleWriter->AddPayloadPackage(L"package.msix", packageStream.Get()));
+            REQUIRE_SUCCEEDED(bundleWriter->Close());
+        }
+
+        auto bundleStream = MsixTest::StreamFile(outputBundle, true, true);
+        MsixTest::ComPtr<IAppxBundleReader> bundleReader;
+        REQUIRE_SUCCEEDED(bundleFactory->CreateBundleReader(bundleStream.Get(), &bundleReader));
+        MsixTest::ComPtr<IAppxFile> payloadPackage;
+        REQUIRE_SUCCEEDED(bundleReader->GetPayloadPackage(L"package.msix", &payloadPackage));
+
+        // The corrupted package is referenced as its manifest is fine
+        auto flatBundleStream = MsixTest::StreamFile(outputBundle, false);
+        auto corruptedStream = MsixTest::StreamFile(corruptedPackage, true);
+        MsixTest::ComPtr<IAppxBundleWriter> bundleWriter;
+        REQUIRE_SUCCEEDED(bundleFactory->CreateBundleWriter(flatBundleStream.Get(), 0, &bundleWriter));
+        REQUIRE_SUCCEEDED(bundleWriter.As<IAppxBundleWriter4>()->AddPackageReference(L"corrupted.msix", corruptedStream.Get(), FALSE));
+        REQUIRE_SUCCEEDED(bundleWriter->Close());
+    }
+    SECTION("Read manifests and validate packages")
+    {
+        auto bundleFactory = createBundleFactory(static_cast<MSIX_FACTORY_OPTIONS>(
+            MSIX_FACTORY_OPTION_WRITER_BUNDLE_READ_MANIFESTS | MSIX_FACTORY_OPTION_WRITER_BUNDLE_VALIDATE_PACKAGES));
+        auto bundleStream = MsixTest::StreamFile(outputBundle, false);
+        auto packageStream = MsixTest::StreamFile(outputPackage, true);
+        auto corruptedStream = MsixTest::StreamFile(corruptedPackage, true);
+        MsixTest::ComPtr<IAppxBundleWriter> bundleWriter;
+        REQUIRE_SUCCEEDED(bundleFactory->CreateBundleWriter(bundleStream.Get(), 0, &bundleWriter));
+        auto bundleWriter4 = bundleWriter.As<IAppxBundleWriter4>();
+        REQUIRE_SUCCEEDED(bundleWriter4->AddPackageReference(L"package.msix", packageStream.Get(), FALSE));
+        REQUIRE_FAILED(bundleWriter4->AddPackageReference(L"corrupted.msix", corruptedStream.Get(), FALSE));
+    }
+
+    std::remove(corruptedPackage.c_str());
+}
+
+// Validates a bundle manifest can be made straight from the manifests of its packages
+TEST_CASE("Pack_Good_BundleManifestOnly", "[pack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto manifestPath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Pack) + "/input/AppxManifest.xml");
+    std::string outputManifest = "AppxBundleManifest.xml";
+    {
+        auto manifestStream = MsixTest::StreamFile(manifestPath, true);
+        auto bundleManifestStream = MsixTest::StreamFile(outputManifest, false);
+        LPCSTR fileNames[] = { "package.msix" };
+        IStream* manifests[] = { manifestStream.Get() };
+        HRESULT actual = PackBundleManifest(1, fileNames, manifests, 0x0001000200030000, bundleManifestStream.Get());
+        REQUIRE(S_OK == actual);
+        MsixTest::Log::PrintMsixLog(S_OK, actual);
+    }
+
+    auto bundleManifestStream = MsixTest::StreamFile(outputManifest, true, true);
+    MsixTest::ComPtr<IAppxBundleFactory> bundleFactory;
+    REQUIRE_SUCCEEDED(CoCreateAppxBundleFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION::MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+        static_cast<MSIX_APPLICABILITY_OPTIONS>(MSIX_APPLICABILITY_OPTIONS::MSIX_APPLICABILITY_OPTION_SKIPPLATFORM |
+                                                MSIX_APPLICABILITY_OPTIONS::MSIX_APPLICABILITY_OPTION_SKIPLANGUAGE),
+        &bundleFactory));
+    MsixTest::ComPtr<IAppxBundleManifestReader> manifestReader;
+    REQUIRE_SUCCEEDED(bundleFactory->CreateBundleManifestReader(bundleManifestStream.Get(), &manifestReader));
+
+    MsixTest::ComPtr<IAppxManifestPackageId> packageId;
+    REQUIRE_SUCCEEDED(manifestReader->GetPackageId(&packageId));
+    UINT64 version = 0;
+    REQUIRE_SUCCEEDED(packageId->GetVersion(&version));
+    CHECK(0x0001000200030000 == version);
+
+    MsixTest::ComPtr<IAppxBundleManifestPackageInfoEnumerator> packages;
+    REQUIRE_SUCCEEDED(manifestReader->GetPackageInfoItems(&packages));
+    BOOL hasCurrent = FALSE;
+    REQUIRE_SUCCEEDED(packages->GetHasCurrent(&hasCurrent));
+    REQUIRE(hasCurrent);
+    MsixTest::ComPtr<IAppxBundleManifestPackageInfo> packageInfo;
+    REQUIRE_SUCCEEDED(packages->GetCurrent(&packageInfo));
+    MsixTest::Wrappers::Buffer<wchar_t> fileName;
+    REQUIRE_SUCCEEDED(packageInfo->GetFileName(&fileName));
+    CHECK("package.msix" == fileName.ToString());
+    // The package is referenced by the bundle
+    UINT64 offset = 1;
+    REQUIRE_SUCCEEDED(packageInfo->GetOffset(&offset));
+    CHECK(0 == offset);
+    REQUIRE_SUCCEEDED(packages->MoveNext(&hasCurrent));
+    CHECK_FALSE(hasCurrent);
+}
+
 // Fail if there's no AppxManifest.xml
 TEST_CASE("Pack_AppxManifestNotPresent", "[pack]")
 {
@@ -0,0 +1,289 @@
+//
+//  Copyright (C) 2019 Microsoft.  All rights reserved.
+//  See LICENSE file in the project root for full license information.
+//
+// Large package tests, built with -DMSIX_STRESS_TESTS=on. The packages are generated on the fly: a payload file
+// over 4GB stored after other files (zip64 sizes and offsets), and packages with 10K and 100K files with long
+// names (large central directories and block maps). Each is packed, opened and unpacked, the time of every stage
+// is written to the console and, if MSIX_STRESS_TIMINGS names a file, appended to it as CSV. The number of files
+// and the size of the large file are multiplied by MSIX_STRESS_SCALE, 1 by default.
+#include "catch.hpp"
+#include "msixtest_int.hpp"
+#include "FileHelpers.hpp"
+#include "PackTestData.hpp"
+#include "macros.hpp"
+#include "StreamBase.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+using namespace MsixTest::Pack;
+
+namespace {
+
+    constexpr std::uint32_t StressBlockSize = 65536;
+
+    // The time per file of the larger package can be this many times the one of the smaller package before
+    // the stage is considered to scale worse than linearly.
+    constexpr double ScalingTolerance = 3.0;
+    // Stages faster than this are too noisy to compare
+    constexpr double MinimumComparableSeconds = 0.05;
+
+    double GetScale()
+    {
+        const char* scale = std::getenv("MSIX_STRESS_SCALE");
+        double value = (scale != nullptr) ? std::atof(scale) : 1.0;
+        return (value > 0) ? value : 1.0;
+    }
+
+    // Runs a stage and records how long it took
+    double Measure(const std::string& test, const std::string& stage, std::uint64_t items, const std::function<void()>& run)
+    {
+        auto start = std::chrono::steady_clock::now();
+        run();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "[stress] " << test << " " << stage << ": " << items << " items in "
+            << std::fixed << std::setprecision(3) << seconds << "s" << std::endl;
+        const char* timings = std::getenv("MSIX_STRESS_TIMINGS");
+        if (timings != nullptr)
+        {
+            std::ofstream file(timings, std::ios::app);
+            file << test << "," << stage << "," << items << "," << seconds << "\n";
+        }
+        return seconds;
+    }
+
+    // Read only stream of size bytes, every 64 byte run has the same value derived from its offset and the seed.
+    // Compresses well without being trivial, and costs nothing to generate.
+    class GeneratedStream final : public MSIX::StreamBase
+    {
+    public:
+        GeneratedStream(std::uint64_t size, std::uint8_t seed) : m_size(size), m_seed(seed) {}
+
+        static std::uint8_t ByteAt(std::uint64_t offset, std::uint8_t seed)
+        {
+            return static_cast<std::uint8_t>(((offset / 64) * 31 + seed) & 0xFF);
+        }
+
+        HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER move, DWORD origin, ULARGE_INTEGER* newPosition) noexcept override try
+        {
+            LONGLONG position = move.QuadPart;
+            if (origin == Reference::CURRENT) { position += static_cast<LONGLONG>(m_offset); }
+            else if (origin == Reference::END) { position += static_cast<LONGLONG>(m_size); }
+            m_offset = std::min(static_cast<std::uint64_t>(std::max<LONGLONG>(0, position)), m_size);
+            if (newPosition) { newPosition->QuadPart = m_offset; }
+            return static_cast<HRESULT>(MSIX::Error::OK);
+        } CATCH_RETURN();
+
+        HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) noexcept override try
+        {
+            auto bytes = static_cast<std::uint8_t*>(buffer);
+            auto toRead = static_cast<ULONG>(std::min(static_cast<std::uint64_t>(countBytes), m_size - m_offset));
+            ULONG done = 0;
+            while (done < toRead)
+            {
+                // Up to the end of the 64 byte run
+                auto run = static_cast<ULONG>(std::min<std::uint64_t>(toRead - done, 64 - (m_offset % 64)));
+                std::memset(bytes + done, ByteAt(m_offset, m_seed), run);
+                done += run;
+                m_offset += run;
+            }
+            if (bytesRead) { *bytesRead = done; }
+            return static_cast<HRESULT>(MSIX::Error::OK);
+        } CATCH_RETURN();
+
+    protected:
+        std::uint64_t m_size;
+        std::uint64_t m_offset = 0;
+        std::uint8_t m_seed;
+    };
+
+    // Checks that bytes read from a stream are the generated ones
+    void CheckGeneratedContent(IStream* stream, std::uint64_t offset, std::uint32_t size, std::uint8_t seed)
+    {
+        LARGE_INTEGER position = { 0 };
+        position.QuadPart = static_cast<LONGLONG>(offset);
+        REQUIRE_SUCCEEDED(stream->Seek(position, STREAM_SEEK_SET, nullptr));
+        std::vector<std::uint8_t> buffer(size);
+        ULONG bytesRead = 0;
+        REQUIRE_SUCCEEDED(stream->Read(buffer.data(), size, &bytesRead));
+        REQUIRE(bytesRead == size);
+        std::vector<std::uint8_t> expected(size);
+        for (std::uint32_t i = 0; i < size; i++) { expected[i] = GeneratedStream::ByteAt(offset + i, seed); }
+        REQUIRE(buffer == expected);
+    }
+
+    struct StressPayloadFile
+    {
+        std::string name;
+        std::uint64_t size;
+        APPX_COMPRESSION_OPTION compression;
+    };
+
+    struct StressTimings
+    {
+        double pack = 0;
+        double open = 0;
+        double unpack = 0;
+    };
+
+    // Packs the files to packagePath, opens the package, checks its payload files and unpacks it
+    StressTimings RoundTrip(const std::string& test, const std::string& packagePath, const std::vector<StressPayloadFile>& files)
+    {
+        StressTimings timings;
+        std::map<std::string, std::uint64_t> expected;
+        for (const auto& file : files) { expected.emplace(file.name, file.size); }
+        {
+            auto outputStream = MsixTest::StreamFile(packagePath, false);
+            MsixTest::ComPtr<IAppxFactory> factory;
+            REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+                MSIX_VALIDATION_OPTION_SKIPSIGNATURE, &factory));
+            MsixTest::ComPtr<IAppxPackageWriter> packageWriter;
+            REQUIRE_SUCCEEDED(factory->CreatePackageWriter(outputStream.Get(), nullptr, &packageWriter));
+
+            std::vector<MsixTest::ComPtr<IStream>> streams;
+            std::vector<std::wstring> names;
+            std::vector<APPX_PACKAGE_WRITER_PAYLOAD_STREAM> payloadFiles(files.size());
+            streams.reserve(files.size());
+            names.reserve(files.size());
+            for (std::size_t i = 0; i < files.size(); i++)
+            {
+                streams.push_back(MsixTest::ComPtr<IStream>::Make<GeneratedStream>(files[i].size, static_cast<std::uint8_t>(i)));
+                names.push_back(MsixTest::String::utf8_to_utf16(files[i].name));
+                payloadFiles[i].inputStream = streams[i].Get();
+                payloadFiles[i].fileName = names[i].c_str();
+                payloadFiles[i].contentType = TestConstants::ContentType.c_str();
+                payloadFiles[i].compressionOption = files[i].compression;
+            }
+
+            timings.pack = Measure(test, "pack", files.size(), [&]()
+            {
+                REQUIRE_SUCCEEDED(packageWriter.As<IMsixPackageWriterThreads>()->SetCompressionThreadCount(0));
+                auto packageWriter3 = packageWriter.As<IAppxPackageWriter3>();
+                REQUIRE_SUCCEEDED(packageWriter3->AddPayloadFiles(static_cast<UINT32>(payloadFiles.size()), payloadFiles.data(), 64 * 1024 * 1024));
+                MsixTest::ComPtr<IStream> manifestStream;
+                MakeManifestStream(&manifestStream);
+                REQUIRE_SUCCEEDED(packageWriter->Close(manifestStream.Get()));
+            });
+        }
+
+        {
+            auto inputStream = MsixTest::StreamFile(packagePath, true);
+            MsixTest::ComPtr<IAppxPackageReader> packageReader;
+            timings.open = Measure(test, "open", files.size(), [&]()
+            {
+                MsixTest::InitializePackageReader(inputStream.Get(), &packageReader);
+            });
+
+            MsixTest::ComPtr<IAppxFilesEnumerator> enumerator;
+            REQUIRE_SUCCEEDED(packageReader->GetPayloadFiles(&enumerator));
+            std::size_t count = 0;
+            BOOL hasCurrent = FALSE;
+            REQUIRE_SUCCEEDED(enumerator->GetHasCurrent(&hasCurrent));
+            while (hasCurrent)
+            {
+                count++;
+                REQUIRE_SUCCEEDED(enumerator->MoveNext(&hasCurrent));
+            }
+            CHECK(count == files.size());
+
+            // The footprint files are unpacked with the payload
+            for (const auto& footprint : { MsixTest::Constants::Package::AppxManifest, MsixTest::Constants::Package::AppxBlockMap })
+            {
+                MsixTest::ComPtr<IAppxFile> footprintFile;
+                REQUIRE_SUCCEEDED(packageReader->GetFootprintFile(footprint.first, &footprintFile));
+                UINT64 size = 0;
+                REQUIRE_SUCCEEDED(footprintFile->GetSize(&size));
+                expected.emplace(footprint.second, size);
+            }
+            std::cout << "[stress] " << test << " block map: " << expected[MsixTest::Constants::Package::AppxBlockMap.second] << " bytes" << std::endl;
+
+            // The first and the last block of every file
+            for (std::size_t i = 0; i < files.size(); i++)
+            {
+                MsixTest::ComPtr<IAppxFile> file;
+                REQUIRE_SUCCEEDED(packageReader->GetPayloadFile(MsixTest::String::utf8_to_utf16(files[i].name).c_str(), &file));
+                UINT64 size = 0;
+                REQUIRE_SUCCEEDED(file->GetSize(&size));
+                REQUIRE(size == files[i].size);
+                MsixTest::ComPtr<IStream> fileStream;
+                REQUIRE_SUCCEEDED(file->GetStream(&fileStream));
+                auto block = static_cast<std::uint32_t>(std::min<std::uint64_t>(size, StressBlockSize));
+                CheckGeneratedContent(fileStream.Get(), 0, block, static_cast<std::uint8_t>(i));
+                CheckGeneratedContent(fileStream.Get(), size - block, block, static_cast<std::uint8_t>(i));
+            }
+        }
+
+        auto outputDir = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Output);
+        timings.unpack = Measure(test, "unpack", files.size(), [&]()
+        {
+            REQUIRE_SUCCEEDED(UnpackPackage(MSIX_PACKUNPACK_OPTION_NONE, MSIX_VALIDATION_OPTION_SKIPSIGNATURE,
+                const_cast<char*>(packagePath.c_str()), const_cast<char*>(outputDir.c_str())));
+        });
+
+        CHECK(MsixTest::Directory::CompareDirectory(outputDir, expected));
+        CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+        std::remove(packagePath.c_str());
+        return timings;
+    }
+
+    // Small files with names long enough to make the block map and the central directory big. They are all at the
+    // root of the package, so their names are the same on every platform.
+    std::vector<StressPayloadFile> MakeManyFiles(std::size_t count)
+    {
+        const std::string padding(96, 'x');
+        std::vector<StressPayloadFile> files;
+        files.reserve(count);
+        for (std::size_t i = 0; i < count; i++)
+        {
+            std::ostringstream name;
+            name << "file_" << std::setw(7) << std::setfill('0') << i << "_" << padding << ".bin";
+            files.push_back({ name.str(), 64 + (i * 97) % 4096, (i % 4 == 3) ? APPX_COMPRESSION_OPTION_NONE : APPX_COMPRESSION_OPTION_NORMAL });
+        }
+        return files;
+    }
+
+    void CheckScaling(const std::string& stage, double smallSeconds, std::size_t smallCount, double largeSeconds, std::size_t largeCount)
+    {
+        INFO(stage << ": " << smallCount << " files in " << smallSeconds << "s, " << largeCount << " files in " << largeSeconds << "s");
+        double smallPerFile = std::max(smallSeconds, MinimumComparableSeconds) / smallCount;
+        CHECK(largeSeconds / largeCount <= smallPerFile * ScalingTolerance);
+    }
+}
+
+// Payload file over 4GB, stored, followed by a small file whose offset is over 4GB too
+TEST_CASE("Stress_Zip64_LargeFile", "[stress]")
+{
+    const auto largeSize = static_cast<std::uint64_t>(0x100000000ULL * GetScale()) + 12345;
+    std::vector<StressPayloadFile> files = {
+        { "small_before.bin", 1000, APPX_COMPRESSION_OPTION_NORMAL },
+        { "large.bin", std::max<std::uint64_t>(largeSize, 0x100000000ULL + 12345), APPX_COMPRESSION_OPTION_NONE },
+        { "small_after.bin", 3 * StressBlockSize + 17, APPX_COMPRESSION_OPTION_NORMAL },
+    };
+    auto packagePath = MsixTest::TestPath::GetInstance()->GetRoot() + "stress_zip64.msix";
+    RoundTrip("zip64", packagePath, files);
+}
+
+// Packages with 10K and 100K files, the larger one can't take more time per file than the smaller one
+TEST_CASE("Stress_ManyFiles", "[stress]")
+{
+    const auto largeCount = std::max<std::size_t>(1000, static_cast<std::size_t>(100000 * GetScale()));
+    const auto smallCount = largeCount / 10;
+    auto packagePath = MsixTest::TestPath::GetInstance()->GetRoot() + "stress_many_files.msix";
+
+    auto small = RoundTrip("files_" + std::to_string(smallCount), packagePath, MakeManyFiles(smallCount));
+    auto large = RoundTrip("files_" + std::to_string(largeCount), packagePath, MakeManyFiles(largeCount));
+
+    CheckScaling("pack", small.pack, smallCount, large.pack, largeCount);
+    CheckScaling("open", small.open, smallCount, large.open, largeCount);
+    CheckScaling("unpack", small.unpack, smallCount, large.unpack, largeCount);
+}
@@ -11,7 +11,7 @@
 
 void RunUnbundleTest(HRESULT expected, const std::string& bundle, MSIX_VALIDATION_OPTION validation,
     MSIX_PACKUNPACK_OPTION packUnpack, MSIX_APPLICABILITY_OPTIONS applicability,
-    MsixTest::TestPath::Directory dir = MsixTest::TestPath::Directory::Unbundle, bool clean = true)
+    MsixTest::TestPath::Directory dir = MsixTest::TestPath::Directory::Unbundle, bool clean = true, std::uint32_t threadCount = 0)
 {
     std::cout << "Testing: " << std::endl;
     std::cout << "\tBundle: " << bundle << std::endl; 
@@ -23,11 +23,24 @@ void RunUnbundleTest(HRESULT expected, const std::string& bundle, MSIX_VALIDATIO
 
     auto outputDir = testData->GetPath(MsixTest::TestPath::Directory::Output);
 
-    HRESULT actual = UnpackBundle(packUnpack,
-                                  validation,
-                                  applicability,
-                                  const_cast<char*>(bundlePath.c_str()),
-                                  const_cast<char*>(outputDir.c_str()));
+    HRESULT actual = S_OK;
+    if (threadCount == 0)
+    {
+        actual = UnpackBundle(packUnpack,
+                              validation,
+                              applicability,
+                              const_cast<char*>(bundlePath.c_str()),
+                              const_cast<char*>(outputDir.c_str()));
+    }
+    else
+    {
+        actual = UnpackBundleWithThreadCount(packUnpack,
+                                             validation,
+                                             applicability,
+                                             const_cast<char*>(bundlePath.c_str()),
+                                             const_cast<char*>(outputDir.c_str()),
+                                             threadCount);
+    }
 
     CHECK(expected == actual);
     MsixTest::Log::PrintMsixLog(expected, actual);
@@ -143,6 +156,93 @@ TEST_CASE("Unbundle_StoreSigned_Desktop_x86_x64_MoviesTV_extract-all", "[unbundl
     CHECK(MsixTest::Directory::CleanDirectory(outputDir));
 }
 
+TEST_CASE("Unbundle_StoreSigned_Desktop_x86_x64_MoviesTV_extract-all_parallel", "[unbundle]")
+{
+    HRESULT expected = S_OK;
+    std::string bundle = "StoreSigned_Desktop_x86_x64_MoviesTV.appxbundle";
+    MSIX_VALIDATION_OPTION validation = MSIX_VALIDATION_OPTION_FULL;
+    MSIX_PACKUNPACK_OPTION packUnpack = MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION;
+    MSIX_APPLICABILITY_OPTIONS applicability = static_cast<MSIX_APPLICABILITY_OPTIONS>(MSIX_APPLICABILITY_NONE);
+
+    RunUnbundleTest(expected, bundle, validation, packUnpack, applicability, MsixTest::TestPath::Directory::Unbundle, false, 4);
+
+    auto outputDir = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Output);
+
+    // Unpacking the packages at the same time extracts the same files.
+    auto files = MsixTest::Unbundle::GetExpectedFilesFullApplicable();
+    auto filesNotApplicable = MsixTest::Unbundle::GetExpectedFilesNoApplicable();
+
+    std::map<std::string, std::uint64_t> allFiles;
+    allFiles.insert(files.begin(), files.end());
+    allFiles.insert(filesNotApplicable.begin(), filesNotApplicable.end());
+
+    CHECK(MsixTest::Directory::CompareDirectory(outputDir, allFiles));
+
+    // Clean directory
+    CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+}
+
+TEST_CASE("Unbundle_StoreSigned_Desktop_x86_x64_MoviesTV_extract-all_single_thread", "[unbundle]")
+{
+    HRESULT expected = S_OK;
+    std::string bundle = "StoreSigned_Desktop_x86_x64_MoviesTV.appxbundle";
+    MSIX_VALIDATION_OPTION validation = MSIX_VALIDATION_OPTION_FULL;
+    MSIX_PACKUNPACK_OPTION packUnpack = MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION;
+    MSIX_APPLICABILITY_OPTIONS applicability = static_cast<MSIX_APPLICABILITY_OPTIONS>(MSIX_APPLICABILITY_NONE);
+
+    RunUnbundleTest(expected, bundle, validation, packUnpack, applicability, MsixTest::TestPath::Directory::Unbundle, false, 1);
+
+    auto outputDir = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Output);
+
+    // Parallel extraction limited to a single worker unpacks the packages one after the other
+    auto files = MsixTest::Unbundle::GetExpectedFilesFullApplicable();
+    auto filesNotApplicable = MsixTest::Unbundle::GetExpectedFilesNoApplicable();
+
+    std::map<std::string, std::uint64_t> allFiles;
+    allFiles.insert(files.begin(), files.end());
+    allFiles.insert(filesNotApplicable.begin(), filesNotApplicable.end());
+
+    CHECK(MsixTest::Directory::CompareDirectory(outputDir, allFiles));
+
+    // Clean directory
+    CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+}
+
+TEST_CASE("Unbundle_StoreSigned_Desktop_x86_x64_MoviesTV_packages_as_files", "[unbundle]")
+{
+    HRESULT expected = S_OK;
+    std::string bundle = "StoreSigned_Desktop_x86_x64_MoviesTV.appxbundle";
+    MSIX_VALIDATION_OPTION validation = MSIX_VALIDATION_OPTION_FULL;
+    MSIX_PACKUNPACK_OPTION packUnpack = static_cast<MSIX_PACKUNPACK_OPTION>(MSIX_PACKUNPACK_OPTION_PACKAGESASFILES |
+        MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION);
+    MSIX_APPLICABILITY_OPTIONS applicability = MSIX_APPLICABILITY_OPTION_FULL;
+
+    RunUnbundleTest(expected, bundle, validation, packUnpack, applicability, MsixTest::TestPath::Directory::Unbundle, false, 4);
+
+    auto outputDir = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Output);
+
+    // The applicable packages are written as they are in the bundle, next to the files of the bundle
+    std::map<std::string, std::uint64_t> files =
+    {
+        { "AppxBlockMap.xml" , 340 },
+        { "AppxSignature.p7x" , 10583 },
+        { "AppxMetadata/AppxBundleManifest.xml" , 26712 },
+        { "Video_Production_x64.appx" , 12268070 },
+        { "Video_Production_x86.appx" , 9353845 },
+    };
+    CHECK(MsixTest::Directory::CompareDirectory(outputDir, files));
+
+    {
+        auto packagePath = MsixTest::Directory::PathAsCurrentPlatform(outputDir + "/Video_Production_x64.appx");
+        auto packageStream = MsixTest::StreamFile(packagePath, true, false);
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        MsixTest::InitializePackageReader(packageStream.Get(), &packageReader);
+    }
+
+    // Clean directory
+    CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+}
+
 TEST_CASE("Unbundle_StoreSigned_Desktop_x86_x64_MoviesTV_pfn_extract-all", "[unbundle]")
 {
     HRESULT expected = S_OK;
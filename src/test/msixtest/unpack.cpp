@@ -6,11 +6,25 @@
 #include "msixtest_int.hpp"
 #include "UnpackTestData.hpp"
 #include "FileHelpers.hpp"
+#include "macros.hpp"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <thread>
+#include <vector>
+
+#ifndef WIN32
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
 
 void RunUnpackTest(HRESULT expected, const std::string& package, MSIX_VALIDATION_OPTION validation,
-    MSIX_PACKUNPACK_OPTION packUnpack, bool clean = true, bool absolutePaths = false)
+    MSIX_PACKUNPACK_OPTION packUnpack, bool clean = true, bool absolutePaths = false, UINT32 threadCount = 0)
 {
     std::cout << "Testing: " << std::endl;
     std::cout << "\tPackage:" << package << std::endl; 
@@ -29,10 +43,22 @@ void RunUnpackTest(HRESULT expected, const std::string& package, MSIX_VALIDATION
         outputDir = MsixTest::Directory::PathAsAbsolute(outputDir);
     }
 
-    HRESULT actual = UnpackPackage(packUnpack,
-                                   validation,
-                                   const_cast<char*>(packagePath.c_str()),
-                                   const_cast<char*>(outputDir.c_str()));
+    HRESULT actual = S_OK;
+    if (threadCount == 0)
+    {
+        actual = UnpackPackage(packUnpack,
+                               validation,
+                               const_cast<char*>(packagePath.c_str()),
+                               const_cast<char*>(outputDir.c_str()));
+    }
+    else
+    {
+        actual = UnpackPackageWithThreadCount(packUnpack,
+                                              validation,
+                                              const_cast<char*>(packagePath.c_str()),
+                                              const_cast<char*>(outputDir.c_str()),
+                                              threadCount);
+    }
 
     CHECK(expected == actual);
     MsixTest::Log::PrintMsixLog(expected, actual);
@@ -118,6 +144,67 @@ TEST_CASE("Unpack_StoreSigned_Desktop_x64_MoviesTV_pfn-flat", "[unpack]")
     CHECK(MsixTest::Directory::CleanDirectory(outputDir));
 }
 
+TEST_CASE("Unpack_StoreSigned_Desktop_x64_MoviesTV_parallel", "[unpack]")
+{
+    HRESULT expected                  = S_OK;
+    std::string package               = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    MSIX_VALIDATION_OPTION validation = MSIX_VALIDATION_OPTION_FULL;
+    MSIX_PACKUNPACK_OPTION packUnpack = MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION;
+
+    RunUnpackTest(expected, package, validation, packUnpack, false, false, 4);
+
+    // Verify all the files extracted on disk are correct
+    auto files = MsixTest::Unpack::GetExpectedFiles();
+    auto outputDir = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Output);
+    CHECK(MsixTest::Directory::CompareDirectory(outputDir, files));
+
+    // Clean directory
+    CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+}
+
+TEST_CASE("Unpack_StoreSigned_Desktop_x64_MoviesTV_single_thread", "[unpack]")
+{
+    HRESULT expected                  = S_OK;
+    std::string package               = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    MSIX_VALIDATION_OPTION validation = MSIX_VALIDATION_OPTION_FULL;
+    MSIX_PACKUNPACK_OPTION packUnpack = MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION;
+
+    // Parallel extraction limited to a single worker extracts the same files
+    RunUnpackTest(expected, package, validation, packUnpack, false, false, 1);
+
+    // Verify all the files extracted on disk are correct
+    auto files = MsixTest::Unpack::GetExpectedFiles();
+    auto outputDir = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Output);
+    CHECK(MsixTest::Directory::CompareDirectory(outputDir, files));
+
+    // Clean directory
+    CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+}
+
+TEST_CASE("Unpack_StoreSigned_Desktop_x64_MoviesTV_parallel_content", "[unpack]")
+{
+    std::string package = "StoreSigned_Desktop_x64_MoviesTV.appx";
+    auto outputDir = MsixTest::Directory::PathAsCurrentPlatform(MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Output));
+    auto readFiles = [&outputDir]()
+    {
+        std::map<std::string, std::vector<char>> contents;
+        for (const auto& file : MsixTest::Unpack::GetExpectedFiles())
+        {
+            std::ifstream input(MsixTest::Directory::PathAsCurrentPlatform(outputDir + "/" + file.first), std::ios::binary);
+            contents[file.first].assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+        }
+        CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+        return contents;
+    };
+
+    // The large files, which the workers inflate together in place where the file can be mapped, have the same
+    // bytes as when they are written in order
+    RunUnpackTest(S_OK, package, MSIX_VALIDATION_OPTION_FULL, MSIX_PACKUNPACK_OPTION_NONE, false);
+    auto sequential = readFiles();
+    RunUnpackTest(S_OK, package, MSIX_VALIDATION_OPTION_FULL, MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION, false, false, 4);
+    CHECK(sequential == readFiles());
+}
+
 TEST_CASE("Unpack_Empty", "[unpack]")
 {
     HRESULT expected                  = static_cast<HRESULT>(MSIX::Error::FileSeek);
@@ -206,6 +293,16 @@ TEST_CASE("Unpack_SignedTamperedCD-TRUST_E_BAD_DIGEST", "[unpack]")
     RunUnpackTest(expected, package, validation, packUnpack);
 }
 
+TEST_CASE("Unpack_SignedTamperedCD-TRUST_E_BAD_DIGEST_ac", "[unpack]")
+{
+    HRESULT expected                  = static_cast<HRESULT>(MSIX::Error::SignatureInvalid);
+    std::string package               = "SignedTamperedCD-TRUST_E_BAD_DIGEST.appx";
+    MSIX_VALIDATION_OPTION validation = MSIX_VALIDATION_OPTION_ALLOWSIGNATUREORIGINUNKNOWN;
+    MSIX_PACKUNPACK_OPTION packUnpack = MSIX_PACKUNPACK_OPTION_NONE;
+
+    RunUnpackTest(expected, package, validation, packUnpack);
+}
+
 TEST_CASE("Unpack_SignedUntrustedCert", "[unpack]")
 {
     HRESULT expected                  = static_cast<HRESULT>(MSIX::Error::CertNotTrusted);
@@ -286,6 +383,16 @@ TEST_CASE("Unpack_BlockMap_Invalid_Bad_Block", "[unpack]")
     RunUnpackTest(expected, package, validation, packUnpack);
 }
 
+TEST_CASE("Unpack_BlockMap_Invalid_Bad_Block_parallel", "[unpack]")
+{
+    HRESULT expected                  = static_cast<HRESULT>(MSIX::Error::BlockMapSemanticError);
+    std::string package               = "BlockMap/Invalid_Bad_Block.msix";
+    MSIX_VALIDATION_OPTION validation = MSIX_VALIDATION_OPTION_SKIPSIGNATURE;
+    MSIX_PACKUNPACK_OPTION packUnpack = MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION;
+
+    RunUnpackTest(expected, package, validation, packUnpack, true, false, 4);
+}
+
 TEST_CASE("Unpack_BlockMap_Size_wrong_uncompressed", "[unpack]")
 {
     HRESULT expected                  = static_cast<HRESULT>(MSIX::Error::BlockMapSemanticError);
@@ -374,6 +481,576 @@ TEST_CASE("Unpack_To_Absolute_Path", "[unpack]")
     CHECK(MsixTest::Directory::CleanDirectory(outputDir));
 }
 
+// Validates every file and byte extracted is reported, extracting on one thread or in parallel
+TEST_CASE("Unpack_WithProgress", "[unpack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto packagePath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Unpack) + "/StoreSigned_Desktop_x64_MoviesTV.appx");
+    auto outputDir = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Output));
+
+    auto files = MsixTest::Unpack::GetExpectedFiles();
+    UINT64 expectedBytes = 0;
+    for (const auto& file : files) { expectedBytes += file.second; }
+
+    for (auto packUnpack : { MSIX_PACKUNPACK_OPTION_NONE, MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION })
+    {
+        MsixTest::ProgressCounter progress;
+        HRESULT actual = UnpackPackageWithProgress(packUnpack, MSIX_VALIDATION_OPTION_FULL,
+            const_cast<char*>(packagePath.c_str()), const_cast<char*>(outputDir.c_str()), 4, &progress);
+        CHECK(S_OK == actual);
+        MsixTest::Log::PrintMsixLog(S_OK, actual);
+
+        CHECK(progress.filesTotal == files.size());
+        CHECK(progress.filesCompleted == progress.filesTotal);
+        CHECK(progress.bytesTotal == expectedBytes);
+        CHECK(progress.bytesCompleted == progress.bytesTotal);
+        CHECK(MsixTest::Directory::CompareDirectory(outputDir, files));
+        CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+    }
+}
+
+// Validates the unpack stops when the progress callback cancels it
+TEST_CASE("Unpack_Cancelled", "[unpack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto packagePath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Unpack) + "/StoreSigned_Desktop_x64_MoviesTV.appx");
+    auto outputDir = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Output));
+
+    for (auto packUnpack : { MSIX_PACKUNPACK_OPTION_NONE, MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION })
+    {
+        MsixTest::ProgressCounter progress(3);
+        HRESULT expected = static_cast<HRESULT>(MSIX::Error::Cancelled);
+        HRESULT actual = UnpackPackageWithProgress(packUnpack, MSIX_VALIDATION_OPTION_FULL,
+            const_cast<char*>(packagePath.c_str()), const_cast<char*>(outputDir.c_str()), 4, &progress);
+        CHECK(expected == actual);
+        MsixTest::Log::PrintMsixLog(expected, actual);
+
+        CHECK(progress.calls == 3);
+        CHECK(progress.filesCompleted < progress.filesTotal);
+        CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+    }
+}
+
+// Validates several unpacks run at once on the worker threads, each one telling its own completion callback, and
+// that a failure is told to the callback instead of being returned
+TEST_CASE("Unpack_Async", "[unpack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto packagePath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Unpack) + "/StoreSigned_Desktop_x64_MoviesTV.appx");
+    auto missingPath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Unpack) + "/FileDoesNotExist.appx");
+    auto outputDir = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Output));
+    auto files = MsixTest::Unpack::GetExpectedFiles();
+
+    std::vector<std::string> destinations;
+    std::vector<MsixTest::ComPtr<MsixTest::CompletionWaiter>> waiters;
+    for (std::size_t i = 0; i < 4; i++)
+    {
+        auto destination = MsixTest::Directory::PathAsCurrentPlatform(outputDir + "/async" + std::to_string(i));
+        auto waiter = MsixTest::ComPtr<MsixTest::CompletionWaiter>::Make<MsixTest::CompletionWaiter>();
+        REQUIRE_SUCCEEDED(UnpackPackageAsync(MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION, MSIX_VALIDATION_OPTION_FULL,
+            const_cast<char*>(packagePath.c_str()), const_cast<char*>(destination.c_str()), 0, nullptr, waiter.Get()));
+        destinations.push_back(destination);
+        waiters.push_back(waiter);
+    }
+    auto missing = MsixTest::ComPtr<MsixTest::CompletionWaiter>::Make<MsixTest::CompletionWaiter>();
+    REQUIRE_SUCCEEDED(UnpackPackageAsync(MSIX_PACKUNPACK_OPTION_NONE, MSIX_VALIDATION_OPTION_FULL,
+        const_cast<char*>(missingPath.c_str()), const_cast<char*>(outputDir.c_str()), 0, nullptr, missing.Get()));
+
+    for (std::size_t i = 0; i < waiters.size(); i++)
+    {
+        waiters[i]->Wait();
+        CHECK(S_OK == waiters[i]->status);
+        MsixTest::Log::PrintMsixLog(S_OK, waiters[i]->status);
+        CHECK(waiters[i]->result.Get() == nullptr);
+        CHECK(MsixTest::Directory::CompareDirectory(destinations[i], files));
+    }
+    missing->Wait();
+    CHECK(static_cast<HRESULT>(MSIX::Error::FileOpen) == missing->status);
+
+    HRESULT expected = static_cast<HRESULT>(MSIX::Error::InvalidParameter);
+    CHECK(expected == UnpackPackageAsync(MSIX_PACKUNPACK_OPTION_NONE, MSIX_VALIDATION_OPTION_FULL,
+        const_cast<char*>(packagePath.c_str()), const_cast<char*>(outputDir.c_str()), 0, nullptr, nullptr));
+    CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+}
+
+// Unpacks a package twice through a block store, the first time its payload files are added to the store and the
+// second time they are linked to it
+TEST_CASE("Unpack_BlockStore", "[unpack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto packagePath = testData->GetPath(MsixTest::TestPath::Directory::Unpack) + "/StoreSigned_Desktop_x64_MoviesTV.appx";
+    auto outputDir = testData->GetPath(MsixTest::TestPath::Directory::Output);
+    auto storeDir = outputDir + "/store";
+    auto unpackDir = outputDir + "/unpacked";
+
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_FULL, &factory));
+    REQUIRE_SUCCEEDED(MsixSetBlockStore(factory.Get(), const_cast<char*>(storeDir.c_str())));
+
+    for (auto packUnpack : { MSIX_PACKUNPACK_OPTION_NONE, MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION })
+    {
+        {
+            auto inputStream = MsixTest::StreamFile(packagePath, true);
+            MsixTest::ComPtr<IAppxPackageReader> packageReader;
+            REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+            REQUIRE_SUCCEEDED(UnpackPackageFromPackageReaderWithProgress(packUnpack, packageReader.Get(),
+                const_cast<char*>(unpackDir.c_str()), 4, nullptr));
+        }
+        CHECK(MsixTest::Directory::CompareDirectory(unpackDir, MsixTest::Unpack::GetExpectedFiles()));
+        CHECK(MsixTest::Directory::CleanDirectory(unpackDir));
+    }
+
+    #ifndef WIN32
+    std::size_t storeEntries = 0;
+    if (auto dir = opendir(storeDir.c_str()))
+    {
+        while (auto entry = readdir(dir))
+        {
+            if (entry->d_name[0] != '.') { storeEntries++; }
+        }
+        closedir(dir);
+    }
+    CHECK(storeEntries != 0);
+    #endif
+
+    REQUIRE_SUCCEEDED(MsixSetBlockStore(factory.Get(), nullptr));
+    CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+}
+
+#ifndef WIN32
+// A stored file changed since it was added, with the same size, isn't linked: it is extracted again and replaced
+// in the store
+TEST_CASE("Unpack_BlockStore_ChangedFile", "[unpack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto packagePath = testData->GetPath(MsixTest::TestPath::Directory::Unpack) + "/StoreSigned_Desktop_x64_MoviesTV.appx";
+    auto outputDir = testData->GetPath(MsixTest::TestPath::Directory::Output);
+    auto storeDir = outputDir + "/store";
+    auto unpackDir = outputDir + "/unpacked";
+    auto unpackedFile = unpackDir + "/Assets/video_offline_demo_page3.jpg";
+
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeap(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_FULL, &factory));
+    REQUIRE_SUCCEEDED(MsixSetBlockStore(factory.Get(), const_cast<char*>(storeDir.c_str())));
+    auto unpack = [&]()
+    {
+        auto inputStream = MsixTest::StreamFile(packagePath, true);
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+        REQUIRE_SUCCEEDED(UnpackPackageFromPackageReaderWithProgress(MSIX_PACKUNPACK_OPTION_NONE, packageReader.Get(),
+            const_cast<char*>(unpackDir.c_str()), 0, nullptr));
+    };
+    auto readFile = [](const std::string& path)
+    {
+        std::ifstream input(path, std::ios::binary);
+        return std::vector<char>((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    };
+
+    unpack();
+    auto expected = readFile(unpackedFile);
+    REQUIRE(expected.size() > 70000);
+
+    // The stored file is the one of the same size, flip a byte in its second block
+    std::string storedFile;
+    if (auto dir = opendir(storeDir.c_str()))
+    {
+        while (auto entry = readdir(dir))
+        {
+            if (entry->d_name[0] == '.') { continue; }
+            auto subdirPath = storeDir + "/" + entry->d_name;
+            if (auto subdir = opendir(subdirPath.c_str()))
+            {
+                while (auto file = readdir(subdir))
+                {
+                    struct stat fileStat = {};
+                    auto path = subdirPath + "/" + file->d_name;
+                    if ((file->d_name[0] != '.') && (stat(path.c_str(), &fileStat) == 0) &&
+                        (static_cast<std::size_t>(fileStat.st_size) == expected.size()))
+                    {
+                        storedFile = path;
+                    }
+                }
+                closedir(subdir);
+            }
+        }
+        closedir(dir);
+    }
+    REQUIRE(!storedFile.empty());
+    {
+        std::fstream stored(storedFile, std::ios::binary | std::ios::in | std::ios::out);
+        stored.seekp(70000);
+        stored.put(static_cast<char>(expected[70000] ^ 0xFF));
+    }
+    CHECK(MsixTest::Directory::CleanDirectory(unpackDir));
+
+    unpack();
+    CHECK(readFile(unpackedFile) == expected);
+    CHECK(readFile(storedFile) == expected);
+
+    REQUIRE_SUCCEEDED(MsixSetBlockStore(factory.Get(), nullptr));
+    CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+}
+#endif
+
+TEST_CASE("Unpack_WithFilter", "[unpack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto packagePath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Unpack) + "/StoreSigned_Desktop_x64_MoviesTV.appx");
+    auto outputDir = testData->GetPath(MsixTest::TestPath::Directory::Output);
+
+    char* includes[] = { const_cast<char*>("Assets/**"), const_cast<char*>("*.dll") };
+    char* excludes[] = { const_cast<char*>("*altform-unplated.png"), const_cast<char*>("ASSETS\\*.scale-100.png") };
+
+    std::map<std::string, std::uint64_t> expectedFiles;
+    for (const auto& file : MsixTest::Unpack::GetExpectedFiles())
+    {
+        const auto& name = file.first;
+        auto endsWith = [&name](const std::string& suffix)
+        {
+            return (name.size() >= suffix.size()) && (name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0);
+        };
+        bool included = (name.compare(0, 7, "Assets/") == 0) || endsWith(".dll");
+        bool excluded = endsWith("altform-unplated.png") ||
+            ((name.compare(0, 7, "Assets/") == 0) && (name.find('/', 7) == std::string::npos) && endsWith(".scale-100.png"));
+        if (included && !excluded)
+        {
+            expectedFiles.insert(file);
+        }
+    }
+    REQUIRE(expectedFiles.size() < MsixTest::Unpack::GetExpectedFiles().size());
+
+    for (auto packUnpack : { MSIX_PACKUNPACK_OPTION_NONE, MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION })
+    {
+        HRESULT actual = UnpackPackageWithFilter(packUnpack, MSIX_VALIDATION_OPTION_FULL,
+            const_cast<char*>(packagePath.c_str()), const_cast<char*>(outputDir.c_str()), 4, nullptr,
+            2, includes, 2, excludes);
+        REQUIRE_SUCCEEDED(actual);
+        CHECK(MsixTest::Directory::CompareDirectory(outputDir, expectedFiles));
+        CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+    }
+
+    // Without patterns everything is extracted
+    REQUIRE_SUCCEEDED(UnpackPackageWithFilter(MSIX_PACKUNPACK_OPTION_NONE, MSIX_VALIDATION_OPTION_FULL,
+        const_cast<char*>(packagePath.c_str()), const_cast<char*>(outputDir.c_str()), 0, nullptr, 0, nullptr, 0, nullptr));
+    CHECK(MsixTest::Directory::CompareDirectory(outputDir, MsixTest::Unpack::GetExpectedFiles()));
+    CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+
+    CHECK(static_cast<HRESULT>(E_INVALIDARG) == UnpackPackageWithFilter(MSIX_PACKUNPACK_OPTION_NONE, MSIX_VALIDATION_OPTION_FULL,
+        const_cast<char*>(packagePath.c_str()), const_cast<char*>(outputDir.c_str()), 0, nullptr, 1, nullptr, 0, nullptr));
+}
+
+TEST_CASE("Unpack_SkipUnchanged", "[unpack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto packagePath = testData->GetPath(MsixTest::TestPath::Directory::Unpack) + "/StoreSigned_Desktop_x64_MoviesTV.appx";
+    auto outputDir = testData->GetPath(MsixTest::TestPath::Directory::Output);
+    auto changedFile = MsixTest::Directory::PathAsCurrentPlatform(outputDir + "/Assets/AppList.scale-100.png");
+
+    MsixTest::ComPtr<IAppxFactory> factory;
+    REQUIRE_SUCCEEDED(CoCreateAppxFactoryWithHeapAndOptions(MsixTest::Allocators::Allocate, MsixTest::Allocators::Free,
+        MSIX_VALIDATION_OPTION_FULL, MSIX_FACTORY_OPTION_PERFORMANCE_COUNTERS, &factory));
+    auto unpack = [&](MSIX_PACKUNPACK_OPTION packUnpack)
+    {
+        auto inputStream = MsixTest::StreamFile(packagePath, true);
+        MsixTest::ComPtr<IAppxPackageReader> packageReader;
+        REQUIRE_SUCCEEDED(factory->CreatePackageReader(inputStream.Get(), &packageReader));
+        REQUIRE_SUCCEEDED(UnpackPackageFromPackageReaderWithProgress(packUnpack, packageReader.Get(),
+            const_cast<char*>(outputDir.c_str()), 4, nullptr));
+    };
+
+    for (auto packUnpack : { MSIX_PACKUNPACK_OPTION_SKIPUNCHANGED,
+        static_cast<MSIX_PACKUNPACK_OPTION>(MSIX_PACKUNPACK_OPTION_SKIPUNCHANGED | MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION) })
+    {
+        // Nothing to skip the first time
+        unpack(packUnpack);
+        CHECK(MsixTest::Directory::CompareDirectory(outputDir, MsixTest::Unpack::GetExpectedFiles()));
+
+        // Same size, different content
+        {
+            std::fstream file(changedFile, std::ios::in | std::ios::out | std::ios::binary);
+            REQUIRE(file.is_open());
+            file.put('X');
+        }
+
+        MSIX_PERFORMANCE_COUNTERS counters = {};
+        REQUIRE_SUCCEEDED(MsixGetPerformanceCounters(factory.Get(), true, &counters));
+        unpack(packUnpack);
+        REQUIRE_SUCCEEDED(MsixGetPerformanceCounters(factory.Get(), false, &counters));
+        CHECK(MsixTest::Directory::CompareDirectory(outputDir, MsixTest::Unpack::GetExpectedFiles()));
+
+        // Only the footprint files and the changed file are written again
+        CHECK(counters.stages[MSIX_PERFORMANCE_COUNTER_STAGE_OPENFILE].calls == 5);
+        std::ifstream file(changedFile, std::ios::binary);
+        CHECK(file.get() == 0x89);
+        file.close();
+        CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+    }
+}
+
+// Stream that can only be read in order, in small reads of odd sizes, like a pipe
+class ForwardOnlyReadStream final : public IStream
+{
+public:
+    ForwardOnlyReadStream(std::vector<char> data) : m_data(std::move(data)) {}
+
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppvObject) noexcept override
+    {
+        if (ppvObject == nullptr || *ppvObject != nullptr) { return static_cast<HRESULT>(MSIX::Error::InvalidParameter); }
+        if (riid == UuidOfImpl<IStream>::iid || riid == UuidOfImpl<ISequentialStream>::iid || riid == UuidOfImpl<IUnknown>::iid)
+        {
+            *ppvObject = static_cast<void*>(this);
+            AddRef();
+            return S_OK;
+        }
+        return static_cast<HRESULT>(MSIX::Error::NoInterface);
+    }
+    ULONG STDMETHODCALLTYPE AddRef() noexcept override { return 1; }
+    ULONG STDMETHODCALLTYPE Release() noexcept override { return 1; }
+
+    HRESULT STDMETHODCALLTYPE Read(void* buffer, ULONG countBytes, ULONG* bytesRead) noexcept override
+    {
+        auto count = std::min<std::size_t>({ countBytes, m_data.size() - m_position, 4093 });
+        std::memcpy(buffer, m_data.data() + m_position, count);
+        m_position += count;
+        if (bytesRead) { *bytesRead = static_cast<ULONG>(count); }
+        return S_OK;
+    }
+
+    HRESULT STDMETHODCALLTYPE Seek(LARGE_INTEGER, DWORD, ULARGE_INTEGER*) noexcept override
+    {
+        seeks++;
+        return static_cast<HRESULT>(MSIX::Error::NotImplemented);
+    }
+
+    HRESULT STDMETHODCALLTYPE Write(const void*, ULONG, ULONG*) noexcept override { return static_cast<HRESULT>(MSIX::Error::NotImplemented); }
+    HRESULT STDMETHODCALLTYPE SetSize(ULARGE_INTEGER) noexcept override { return static_cast<HRESULT>(MSIX::Error::NotImplemented); }
+    HRESULT STDMETHODCALLTYPE CopyTo(IStream*, ULARGE_INTEGER, ULARGE_INTEGER*, ULARGE_INTEGER*) noexcept override { return static_cast<HRESULT>(MSIX::Error::NotImplemented); }
+    HRESULT STDMETHODCALLTYPE Commit(DWORD) noexcept override { return static_cast<HRESULT>(MSIX::Error::NotImplemented); }
+    HRESULT STDMETHODCALLTYPE Revert() noexcept override { return static_cast<HRESULT>(MSIX::Error::NotImplemented); }
+    HRESULT STDMETHODCALLTYPE LockRegion(ULARGE_INTEGER, ULARGE_INTEGER, DWORD) noexcept override { return static_cast<HRESULT>(MSIX::Error::NotImplemented); }
+    HRESULT STDMETHODCALLTYPE UnlockRegion(ULARGE_INTEGER, ULARGE_INTEGER, DWORD) noexcept override { return static_cast<HRESULT>(MSIX::Error::NotImplemented); }
+    HRESULT STDMETHODCALLTYPE Stat(STATSTG*, DWORD) noexcept override { return static_cast<HRESULT>(MSIX::Error::NotImplemented); }
+    HRESULT STDMETHODCALLTYPE Clone(IStream**) noexcept override { return static_cast<HRESULT>(MSIX::Error::NotImplemented); }
+
+    std::size_t seeks = 0;
+
+protected:
+    std::vector<char> m_data;
+    std::size_t m_position = 0;
+};
+
+TEST_CASE("Unpack_SequentialStream", "[unpack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto packagePath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Unpack) + "/StoreSigned_Desktop_x64_MoviesTV.appx");
+    auto outputDir = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Output));
+    std::ifstream input(packagePath, std::ios::binary);
+    std::vector<char> package((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+
+    for (auto packUnpack : { MSIX_PACKUNPACK_OPTION_NONE, MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION })
+    {
+        // No provisional file is left next to the payload files
+        ForwardOnlyReadStream stream(package);
+        HRESULT actual = UnpackPackageFromSequentialStream(packUnpack, MSIX_VALIDATION_OPTION_FULL, &stream,
+            const_cast<char*>(outputDir.c_str()), 4, nullptr);
+        CHECK(S_OK == actual);
+        MsixTest::Log::PrintMsixLog(S_OK, actual);
+        CHECK(stream.seeks == 0);
+        CHECK(MsixTest::Directory::CompareDirectory(outputDir, MsixTest::Unpack::GetExpectedFiles()));
+        CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+    }
+
+    // A package that ends early fails, without leaving the files extracted ahead
+    ForwardOnlyReadStream truncated(std::vector<char>(package.begin(), package.begin() + package.size() / 2));
+    HRESULT actual = UnpackPackageFromSequentialStream(MSIX_PACKUNPACK_OPTION_NONE, MSIX_VALIDATION_OPTION_FULL, &truncated,
+        const_cast<char*>(outputDir.c_str()), 0, nullptr);
+    CHECK(FAILED(actual));
+    CHECK(MsixTest::Directory::CompareDirectory(outputDir, {}));
+    CHECK(MsixTest::Directory::CleanDirectory(outputDir));
+}
+
+TEST_CASE("Unpack_TarStream", "[unpack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto packagePath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Unpack) + "/StoreSigned_Desktop_x64_MoviesTV.appx");
+    // Written to the current directory like the packages of the pack tests
+    std::string tarPath = "Unpacked.tar";
+
+    auto unpack = [&](MSIX_PACKUNPACK_OPTION packUnpack, MSIX_TAR_COMPRESSION compression)
+    {
+        {
+            MsixTest::ComPtr<IStream> source;
+            MsixTest::ComPtr<IStream> tar;
+            REQUIRE_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(packagePath.c_str()), true, &source));
+            REQUIRE_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(tarPath.c_str()), false, &tar));
+            HRESULT actual = UnpackPackageToTarStream(packUnpack, MSIX_VALIDATION_OPTION_FULL, source.Get(), tar.Get(), compression, 4, nullptr);
+            CHECK(S_OK == actual);
+            MsixTest::Log::PrintMsixLog(S_OK, actual);
+        }
+        std::ifstream input(tarPath, std::ios::binary);
+        std::vector<char> archive((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+        input.close();
+        std::remove(tarPath.c_str());
+        return archive;
+    };
+
+    // The same archive whatever order the files are extracted in
+    auto archive = unpack(MSIX_PACKUNPACK_OPTION_NONE, MSIX_TAR_COMPRESSION_NONE);
+    CHECK(archive == unpack(MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION, MSIX_TAR_COMPRESSION_NONE));
+    REQUIRE(archive.size() % 512 == 0);
+
+    // Every directory comes before its files, and the files are the ones unpacked to a directory
+    std::map<std::string, std::uint64_t> files;
+    std::vector<std::string> directories;
+    std::size_t offset = 0;
+    while (offset + 512 <= archive.size() && archive[offset] != '\0')
+    {
+        const char* header = &archive[offset];
+        std::string name(header, std::find(header, header + 100, '\0'));
+        std::uint64_t size = std::stoull(std::string(header + 124, 11), nullptr, 8);
+        CHECK(std::string(header + 257, 5) == "ustar");
+        CHECK(std::stoull(std::string(header + 136, 11), nullptr, 8) == 0);
+        if (header[156] == '5')
+        {
+            directories.push_back(name);
+        }
+        else
+        {
+            REQUIRE(header[156] == '0');
+            auto slash = name.rfind('/');
+            if (slash != std::string::npos)
+            {
+                CHECK(std::find(directories.begin(), directories.end(), name.substr(0, slash + 1)) != directories.end());
+            }
+            files.emplace(name, size);
+        }
+        offset += 512 + static_cast<std::size_t>((size + 511) / 512 * 512);
+    }
+    CHECK(files == MsixTest::Unpack::GetExpectedFiles());
+    // Ended by two blocks of zeros
+    CHECK(archive.size() == offset + 1024);
+
+#ifdef MSIX_PACK
+    // gzip, the same every time too
+    auto compressed = unpack(MSIX_PACKUNPACK_OPTION_PARALLELEXTRACTION, MSIX_TAR_COMPRESSION_GZIP);
+    REQUIRE(compressed.size() > 2);
+    CHECK(static_cast<std::uint8_t>(compressed[0]) == 0x1f);
+    CHECK(static_cast<std::uint8_t>(compressed[1]) == 0x8b);
+    CHECK(compressed.size() < archive.size());
+    CHECK(compressed == unpack(MSIX_PACKUNPACK_OPTION_NONE, MSIX_TAR_COMPRESSION_GZIP));
+#else
+    // Nothing is written without a deflater
+    {
+        MsixTest::ComPtr<IStream> source;
+        MsixTest::ComPtr<IStream> tar;
+        REQUIRE_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(packagePath.c_str()), true, &source));
+        REQUIRE_SUCCEEDED(CreateStreamOnFile(const_cast<char*>(tarPath.c_str()), false, &tar));
+        REQUIRE_HR(static_cast<HRESULT>(MSIX::Error::NotSupported), UnpackPackageToTarStream(MSIX_PACKUNPACK_OPTION_NONE,
+            MSIX_VALIDATION_OPTION_FULL, source.Get(), tar.Get(), MSIX_TAR_COMPRESSION_GZIP, 4, nullptr));
+    }
+    std::ifstream input(tarPath, std::ios::binary);
+    CHECK(input.peek() == std::ifstream::traits_type::eof());
+    input.close();
+    std::remove(tarPath.c_str());
+#endif
+}
+
+TEST_CASE("Verify_StoreSigned_Desktop_x64_MoviesTV", "[unpack]")
+{
+    auto packagePath = MsixTest::TestPath::GetInstance()->GetPath(MsixTest::TestPath::Directory::Unpack) + "/StoreSigned_Desktop_x64_MoviesTV.appx";
+    packagePath = MsixTest::Directory::PathAsCurrentPlatform(packagePath);
+
+    for (UINT32 threadCount : { 0, 1 })
+    {
+        HRESULT actual = VerifyPackage(MSIX_VALIDATION_OPTION_FULL, const_cast<char*>(packagePath.c_str()), threadCount);
+        CHECK(S_OK == actual);
+        MsixTest::Log::PrintMsixLog(S_OK, actual);
+    }
+}
+
+TEST_CASE("Verify_Tampered_Payload_File", "[unpack]")
+{
+    auto testData = MsixTest::TestPath::GetInstance();
+    auto packagePath = MsixTest::Directory::PathAsCurrentPlatform(testData->GetPath(MsixTest::TestPath::Directory::Unpack) + "/StoreSigned_Desktop_x64_MoviesTV.appx");
+    // Written to the current directory like the packages of the pack tests
+    std::string tamperedPath = "Tampered.appx";
+
+    // Flip a byte in the second block of a stored payload file
+    std::ifstream input(packagePath, std::ios::binary);
+    std::vector<char> package((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    const std::string fileName = "Assets/video_offline_demo_page3.jpg";
+    std::size_t header = 0;
+    for (; header + 30 + fileName.size() <= package.size(); header++)
+    {
+        if ((std::memcmp(&package[header], "PK\x03\x04", 4) == 0) && (std::memcmp(&package[header + 30], fileName.data(), fileName.size()) == 0))
+        {
+            break;
+        }
+    }
+    REQUIRE(header + 30 + fileName.size() <= package.size());
+    auto readUInt16 = [&package](std::size_t offset)
+    {
+        return static_cast<std::size_t>(static_cast<std::uint8_t>(package[offset]) | (static_cast<std::uint8_t>(package[offset + 1]) << 8));
+    };
+    REQUIRE(readUInt16(header + 8) == 0);
+    auto data = header + 30 + readUInt16(header + 26) + readUInt16(header + 28);
+    package[data + 70000] ^= 0xFF;
+    {
+        std::ofstream output(tamperedPath, std::ios::binary);
+        output.write(package.data(), package.size());
+    }
+
+    // The signature covers the content of the files, skip it so the block map is what catches it
+    HRESULT expected = static_cast<HRESULT>(MSIX::Error::SignatureInvalid);
+    HRESULT actual = VerifyPackage(MSIX_VALIDATION_OPTION_SKIPSIGNATURE, const_cast<char*>(tamperedPath.c_str()), 4);
+    CHECK(expected == actual);
+    MsixTest::Wrappers::Buffer<char> text;
+    REQUIRE_SUCCEEDED(GetLogTextUTF8(MsixTest::Allocators::Allocate, &text));
+    CHECK(text.ToString().find("'Assets\\video_offline_demo_page3.jpg': block 1 doesn't match the block map") != std::string::npos);
+    MsixTest::Log::PrintMsixLog(expected, actual);
+
+    std::remove(tamperedPath.c_str());
+}
+
+// Failures on several threads at once are all logged, up to the capacity of the log, and reading the log empties it
+TEST_CASE("Unpack_Log_Concurrent_Failures", "[unpack]")
+{
+    std::string missingPath = "DoesNotExist.appx";
+    MsixTest::Wrappers::Buffer<char> previous;
+    REQUIRE_SUCCEEDED(GetLogTextUTF8(MsixTest::Allocators::Allocate, &previous));
+
+    const std::size_t threadCount = 4;
+    const std::size_t failuresPerThread = 50;
+    std::vector<HRESULT> results(threadCount * failuresPerThread, S_OK);
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < threadCount; t++)
+    {
+        threads.emplace_back([&, t]()
+        {
+            for (std::size_t i = 0; i < failuresPerThread; i++)
+            {
+                results[t * failuresPerThread + i] = VerifyPackage(MSIX_VALIDATION_OPTION_FULL, const_cast<char*>(missingPath.c_str()), 1);
+            }
+        });
+    }
+    for (auto& thread : threads) { thread.join(); }
+    for (auto result : results) { CHECK(FAILED(result)); }
+
+    MsixTest::Wrappers::Buffer<char> text;
+    REQUIRE_SUCCEEDED(GetLogTextUTF8(MsixTest::Allocators::Allocate, &text));
+    auto log = text.ToString();
+    std::size_t entries = 0;
+    for (auto found = log.find("Call failed in"); found != std::string::npos; found = log.find("Call failed in", found + 1)) { entries++; }
+    CHECK(entries != 0);
+    CHECK(entries <= 64);
+
+    MsixTest::Wrappers::Buffer<char> empty;
+    REQUIRE_SUCCEEDED(GetLogTextUTF8(MsixTest::Allocators::Allocate, &empty));
+    CHECK(empty.ToString().empty());
+}
+
 #ifdef WIN32
 // TODO: verify timestamp in non-windows platforms.
 TEST_CASE("Unpack_Validate_Timestamp", "[unpack]")